@@ -0,0 +1,197 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_ALLOCATOR_H_HEADER_GUARD
+#define CMFT_ALLOCATOR_H_HEADER_GUARD
+
+#include <stdint.h> //uint64_t
+#include <stddef.h> //size_t
+
+#include <bx/mutex.h>
+
+namespace cmft
+{
+    /// Memory for image data and image sized scratch buffers is taken from an Allocator.
+    /// Implementations have to be thread safe, filters allocate from worker threads too.
+    struct Allocator
+    {
+        virtual ~Allocator() = 0;
+        virtual void* alloc(size_t _size) = 0;
+        virtual void* realloc(void* _ptr, size_t _size) = 0;
+        virtual void free(void* _ptr) = 0;
+    };
+
+    inline Allocator::~Allocator()
+    {
+    }
+
+    /// malloc/realloc/free.
+    Allocator* getCrtAllocator();
+
+    /// Sets allocator used by all threads. NULL restores the CRT allocator.
+    /// Has to outlive every image and cached table allocated from it, call cubemapNormalSolidAngleCacheFlush() before destroying it.
+    void setAllocator(Allocator* _allocator);
+
+    /// Returns allocator of the calling thread: the one set by the innermost AllocatorScope, otherwise the one set by setAllocator().
+    Allocator* getAllocator();
+
+    /// Makes cmft calls issued from the calling thread take image storage from _allocator, until the scope ends.
+    /// Images remember the allocator their data came from, so they can be unloaded from anywhere.
+    /// Scratch buffers allocated by worker threads still come from the global allocator.
+    struct AllocatorScope
+    {
+        AllocatorScope(Allocator* _allocator);
+        ~AllocatorScope();
+
+        Allocator* m_prev;
+    };
+
+    /// What an allocation is for, counted separately by TrackingAllocator.
+    struct AllocTag
+    {
+        enum Enum
+        {
+            Other,
+            SourceCopy,  //!< Working copies of filter sources: Rgba32f source, SoA planes, source pyramid, NUMA replicas.
+            NormalTable, //!< Normal, solid angle and normal cone tables.
+            MipChain,    //!< Filter results and generated mip chains.
+            Conversion,  //!< Format conversion results and their scratch buffers.
+            IoBuffer,    //!< Images loaded from files, read, decode and encode buffers of loaders and savers.
+
+            Count
+        };
+    };
+
+    ///
+    const char* getAllocTagStr(AllocTag::Enum _tag);
+
+    /// Returns tag of allocations made by the calling thread, see AllocTagScope.
+    AllocTag::Enum getAllocTag();
+
+    /// Tags allocations made by the calling thread until the scope ends. Innermost scope wins, except that a _weak scope
+    /// only tags allocations no enclosing scope has tagged. General purpose calls like imageConvert() use weak scopes,
+    /// so a conversion done to make a filter's source copy counts as the source copy.
+    struct AllocTagScope
+    {
+        AllocTagScope(AllocTag::Enum _tag, bool _weak = false);
+        ~AllocTagScope();
+
+        AllocTag::Enum m_prev;
+    };
+
+    /// Same as getAllocator()->alloc() in a scope tagging it with _tag.
+    void* allocTagged(size_t _size, AllocTag::Enum _tag);
+
+    /// Scratch buffers that don't outlive the call are taken from the allocator set by setAllocator(), tagged with _tag
+    /// in a weak scope. They can be freed from any thread with freeScratch().
+    void* allocScratch(size_t _size, AllocTag::Enum _tag);
+
+    ///
+    void freeScratch(void* _ptr);
+
+    /// Byte and allocation counts of a TrackingAllocator, in total and per AllocTag.
+    struct MemoryStats
+    {
+        MemoryStats()
+            : m_currentBytes(0)
+            , m_peakBytes(0)
+            , m_numAllocs(0)
+        {
+            for (uint8_t ii = 0; ii < AllocTag::Count; ++ii)
+            {
+                m_tagCurrentBytes[ii] = 0;
+                m_tagPeakBytes[ii] = 0;
+                m_tagNumAllocs[ii] = 0;
+            }
+        }
+
+        uint64_t m_currentBytes;                    //!< Bytes handed out and not freed yet.
+        uint64_t m_peakBytes;                       //!< Highest m_currentBytes so far.
+        uint64_t m_numAllocs;                       //!< Allocations so far, reallocations not included.
+        uint64_t m_tagCurrentBytes[AllocTag::Count];
+        uint64_t m_tagPeakBytes[AllocTag::Count];   //!< Highest bytes of each tag on its own, peaks of tags can be at different times.
+        uint64_t m_tagNumAllocs[AllocTag::Count];
+    };
+
+    /// Forwards to _parent (CRT allocator if NULL) and counts bytes by the tag of the allocating thread, see AllocTagScope.
+    /// Install it with setAllocator() to see where peak memory of a job comes from.
+    struct TrackingAllocator : public Allocator
+    {
+        TrackingAllocator(Allocator* _parent = NULL);
+
+        virtual void* alloc(size_t _size);
+        virtual void* realloc(void* _ptr, size_t _size);
+        virtual void free(void* _ptr);
+
+        ///
+        void getStats(MemoryStats& _stats) const;
+
+        /// Restarts peaks from current usage and zeroes allocation counts, to measure the next job on its own.
+        void resetStats();
+
+        /// Prints getStats() with INFO.
+        void printStats() const;
+
+        Allocator* m_parent;
+        mutable bx::Mutex m_mutex;
+        MemoryStats m_stats;
+    };
+
+    /// Recycles freed buffers of the same size, so that jobs of a batch don't page fault on fresh memory over and over.
+    /// With _maxBytes other than zero, allocations that would take more than _maxBytes in total fail and return NULL,
+    /// pooled buffers are released first to make room. Image loaders then fail, other calls report it like a failed malloc.
+    struct PoolAllocator : public Allocator
+    {
+        PoolAllocator(uint64_t _maxBytes = 0);
+
+        /// All buffers have to be freed before the pool is destroyed.
+        virtual ~PoolAllocator();
+
+        virtual void* alloc(size_t _size);
+        virtual void* realloc(void* _ptr, size_t _size);
+        virtual void free(void* _ptr);
+
+        /// Releases pooled buffers back to the system.
+        void trim();
+
+        uint64_t getUsedBytes() const;   //!< Bytes of buffers handed out.
+        uint64_t getPooledBytes() const; //!< Bytes of freed buffers kept for reuse.
+        uint64_t getPeakBytes() const;   //!< Highest getUsedBytes() so far.
+
+        struct Block;
+
+        mutable bx::Mutex m_mutex;
+        Block* m_pool;
+        uint64_t m_maxBytes;
+        uint64_t m_usedBytes;
+        uint64_t m_pooledBytes;
+        uint64_t m_peakBytes;
+    };
+
+    /// Backs buffers of at least _minSize bytes with huge pages, smaller ones come from malloc().
+    /// Linux: explicit huge pages (MAP_HUGETLB) if the system has them reserved, transparent huge pages (madvise) otherwise.
+    /// Windows: large pages if the process holds SeLockMemoryPrivilege, regular pages otherwise. Other platforms use malloc().
+    /// Filters tap source and normal planes in windows that stride across many rows, huge pages cut the TLB misses of that.
+    struct HugePageAllocator : public Allocator
+    {
+        HugePageAllocator(size_t _minSize = 4<<20);
+
+        virtual void* alloc(size_t _size);
+        virtual void* realloc(void* _ptr, size_t _size);
+        virtual void free(void* _ptr);
+
+        uint64_t getHugePageBytes() const; //!< Bytes currently mapped with explicit or transparent huge pages.
+
+        size_t m_minSize;
+        mutable bx::Mutex m_mutex;
+        uint64_t m_hugePageBytes;
+        bool m_explicitFailed; //!< Set once explicit huge pages ran out, later buffers go straight to the fallback.
+    };
+
+} // namespace cmft
+
+#endif //CMFT_ALLOCATOR_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
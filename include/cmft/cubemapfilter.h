@@ -13,19 +13,328 @@
 namespace cmft
 {
 #define SH_COEFF_NUM 25
+#define MAX_PROBE_BASIS_COMPONENTS 64
+
+    /// Statistics of a single filter call, filled in when filter gets a pointer to it. Times are wall clock seconds.
+    /// Device arrays are indexed the same way as OpenCL contexts passed to the filter.
+    struct FilterStats
+    {
+        FilterStats()
+            : m_prepareTime(0.0)
+            , m_filterTime(0.0)
+            , m_finishTime(0.0)
+            , m_totalTime(0.0)
+            , m_tasksCpu(0)
+            , m_texelsCpu(0)
+            , m_bytesToDevice(0)
+            , m_bytesFromDevice(0)
+            , m_lobeEnergyLoss(0.0f)
+        {
+            for (uint8_t ii = 0; ii < CMFT_CL_MAX_CONTEXTS; ++ii)
+            {
+                m_tasksGpu[ii] = 0;
+                m_texelsGpu[ii] = 0;
+                m_gpuUploadTime[ii] = 0.0;
+                m_gpuKernelTime[ii] = 0.0;
+                m_gpuReadTime[ii] = 0.0;
+                m_gpuHostIdleTime[ii] = 0.0;
+            }
+        }
+
+        double m_prepareTime;                       //!< Source conversion, normal tables and device setup.
+        double m_filterTime;                        //!< Filtering on all devices.
+        double m_finishTime;                        //!< Packing and conversion of the result, cleanup.
+        double m_totalTime;
+        uint32_t m_tasksCpu;                        //!< Faces finished by CPU threads.
+        uint32_t m_tasksGpu[CMFT_CL_MAX_CONTEXTS];  //!< Faces finished by each OpenCL device.
+        uint64_t m_texelsCpu;                       //!< Destination texels filtered by CPU threads.
+        uint64_t m_texelsGpu[CMFT_CL_MAX_CONTEXTS]; //!< Destination texels filtered by each OpenCL device.
+        uint64_t m_bytesToDevice;                   //!< Host to device transfers of all devices.
+        uint64_t m_bytesFromDevice;                 //!< Device to host transfers of all devices.
+        double m_gpuUploadTime[CMFT_CL_MAX_CONTEXTS];   //!< Device time of source uploads, only measured with FilterSettings::m_gpuProfiling.
+        double m_gpuKernelTime[CMFT_CL_MAX_CONTEXTS];   //!< Device time of filter and encode kernels, only measured with FilterSettings::m_gpuProfiling.
+        double m_gpuReadTime[CMFT_CL_MAX_CONTEXTS];     //!< Device time of result readbacks, only measured with FilterSettings::m_gpuProfiling.
+        double m_gpuHostIdleTime[CMFT_CL_MAX_CONTEXTS]; //!< Time the host thread of each device spent blocked on results and uploads.
+        float m_lobeEnergyLoss;                     //!< Largest estimated fraction of radiance lobe energy cut off in any mip, see FilterSettings::m_lobeTolerance.
+    };
+
+    /// Part of a radiance bake split across processes or machines. Face tasks of all mips are split into m_count ranges of about
+    /// equal estimated cost, a filter call with a shard filters only faces of range m_index. Host side work (excluded base, faces
+    /// convolved in the SH domain and 1x1 mips) is done by shard 0. All shards have to be run with the same parameters and build,
+    /// their results are put together with imageRadianceFilterMerge().
+    struct FilterShard
+    {
+        FilterShard()
+            : m_index(0)
+            , m_count(1)
+        {
+        }
+
+        uint32_t m_index; //!< Shard filtered by the call, in [0, m_count).
+        uint32_t m_count;
+    };
+
+    /// Progress reporting and cancellation of a running filter, passed to the filter by pointer and shared with its worker threads.
+    struct FilterProgress
+    {
+        typedef void (*CallbackFn)(float _fraction, double _remainingTime, void* _userData);
+        typedef void (*FaceFn)(uint32_t _cubemap, uint8_t _mip, uint8_t _face, const Image& _image, void* _userData);
+        typedef bool (*ResumeFn)(uint32_t _cubemap, uint8_t _mip, uint8_t _face, void* _data, uint32_t _faceSize, TextureFormat::Enum _format, void* _userData);
+
+        FilterProgress()
+            : m_callback(NULL)
+            , m_faceCallback(NULL)
+            , m_resumeCallback(NULL)
+            , m_userData(NULL)
+            , m_faceCallbackOnly(false)
+            , m_cancel(false)
+        {
+        }
+
+        CallbackFn m_callback;  //!< Called after every finished tile with fraction of work done and estimated remaining seconds. Calls are serialized, but come from worker threads.
+        FaceFn m_faceCallback;  //!< Called once a face of a mip, out of cubemap _cubemap of a batch, holds its final texels while other faces are still filtered.
+                                //!< _image is a single face view, valid only during the call, in the working format (RGBA32F, RGBA16F with half precision) or in the
+                                //!< GPU encode format for faces packed on the device. Calls are serialized with m_callback, but come from worker threads.
+        ResumeFn m_resumeCallback; //!< Radiance filter calls it for each face task before filtering, on the calling thread. Returning true means the face
+                                   //!< was finished by an earlier run and its texels were written to _data in the working format, it is not filtered
+                                   //!< then and not passed to m_faceCallback. 1x1 mips and faces done on the host are always computed again.
+                                   //!< Not used with GPU encoding or when streaming output mips.
+        void* m_userData;
+        bool m_faceCallbackOnly; //!< Radiance output is taken only from m_faceCallback, e.g. written to an ImageMappedWriter. Output mips are then
+                                 //!< filtered a pass at a time, as with the memory budget, and _dst gets no data. Not used with GPU encoding or shards.
+        volatile bool m_cancel; //!< Set from any thread to stop the filter. Workers stop after their current tile, the filter then returns false and leaves _dst untouched.
+    };
+
+    /// Normal/solid angle tables are cached per face size and reused between filter calls.
+    /// Frees all cached tables that are currently not in use.
+    void cubemapNormalSolidAngleCacheFlush();
+
+    /// Options of a filter call, passed to filters by pointer. NULL takes the defaults. Options are per call, so concurrent
+    /// calls with different settings don't affect each other.
+    struct FilterSettings
+    {
+        FilterSettings()
+            : m_lobeTolerance(0.00001f)
+            , m_adaptiveTolerance(0.0f)
+            , m_shSourceFaceSize(64)
+            , m_shSourceMaxError(0.002f)
+            , m_minCpuThreads(0)
+            , m_maxCpuThreads(0)
+            , m_deterministic(false)
+            , m_numaReplicas(false)
+            , m_pinThreadsToCores(false)
+            , m_gpuProfiling(false)
+        {
+        }
+
+        /// Relative lobe weight below which radiance filters cut off the lobe, 0.00001 by default, clamped to (0, 0.5]. Filter angle of each
+        /// mip is acos(pow(tolerance, 1/power)), so bigger tolerances shrink filter areas of glossy mips most. Energy of the lobe outside of
+        /// the cut is estimated as pow(cos(angle), power+1) and reported in FilterStats::m_lobeEnergyLoss.
+        float m_lobeTolerance;
+
+        /// Above zero, CPU radiance filter evaluates wide lobe mips on a sparse grid of destination texels and interpolates the rest.
+        /// Each grid cell is checked at its center and edge midpoints, cells where the bilinear interpolation of its corners is off by
+        /// more than m_adaptiveTolerance relative to the filtered value are split and refined down to single texels. Applies to mips
+        /// where the lobe spans at least CMFT_RADIANCE_ADAPTIVE_MIN_LOBE destination texels, GPU devices filter every texel.
+        /// Off (0) by default. Interpolated texels stay within about twice the tolerance of full filtering.
+        float m_adaptiveTolerance;
+
+        /// SH projections of imageShCoeffs(), imageIrradianceFilterSh() and imageIrradianceFilterShOctahedral() integrate sources with
+        /// faces bigger than m_shSourceFaceSize from a copy box filtered down to at least that size, texels weighted by their solid angle.
+        /// Bands below shOrder of a band limited source change by about L(L+1)/2*(pi/(4*faceSize))^2 relative to it, L = shOrder-1,
+        /// copies are kept big enough for that to stay below m_shSourceMaxError. Defaults are 64 and 0.002, zero m_shSourceFaceSize
+        /// projects full sources.
+        uint32_t m_shSourceFaceSize;
+        float m_shSourceMaxError;
+
+        /// With m_maxCpuThreads above zero, CPU radiance filter starts m_maxCpuThreads threads in place of the requested number and
+        /// adjusts how many of them take tiles as it goes, never less than m_minCpuThreads. Every CMFT_RADIANCE_CONCURRENCY_INTERVAL
+        /// seconds, threads of other processes waiting for a CPU are subtracted from the CPUs available to the process, and the active
+        /// count moves there. Raises that don't pay off in measured throughput are taken back and not retried for a while. Threads made
+        /// inactive end their job system task at a tile boundary, their queued tiles are stolen by the others, and the active count
+        /// stays below them until the next filter pass. Run queue is read on Linux only, elsewhere all m_maxCpuThreads run.
+        /// Off (0, 0) by default.
+        uint16_t m_minCpuThreads;
+        uint16_t m_maxCpuThreads;
+
+        /// With deterministic mode, filter results depend only on the input, parameters and devices used, never on timing or device
+        /// limits. CPU filtering is deterministic either way, every radiance texel is filtered by a single thread and SH partial sums
+        /// are merged in a fixed chunk order, regardless of the number of threads. Deterministic mode additionally:
+        ///  - Filters all radiance faces on the first valid OpenCL device, instead of splitting them between devices and CPU threads
+        ///    by measured throughput. Without OpenCL devices, CPU threads filter as usual.
+        ///  - Projects SH on OpenCL with a fixed work-group size and group count. Devices that can't run that size project on the host.
+        /// Cost is the throughput of the idle CPU threads and additional devices, nothing when filtering on the CPU only.
+        bool m_deterministic;
+
+        /// Sources read by CPU radiance threads are copied to each NUMA node before filtering and threads read the copy of the node
+        /// they run on. Pays off when worker threads are pinned to NUMA nodes. Linux only.
+        bool m_numaReplicas;
+
+        /// Each CPU radiance thread runs on its own physical core while filtering, see ScopeCpuCore. SMT siblings are left to other
+        /// work. Threads confined to CPUs left out by a partitioned OpenCL CPU device are not pinned. Linux only.
+        bool m_pinThreadsToCores;
+
+        /// Radiance filter runs OpenCL devices on queues created with CL_QUEUE_PROFILING_ENABLE and sums upload, kernel and readback
+        /// times of each device from command events. Totals are printed after filtering and returned in FilterStats, so kernel bound
+        /// bakes can be told apart from transfer bound ones. Off by default, profiled queues cost some driver overhead per command.
+        bool m_gpuProfiling;
+    };
 
     /// Computes spherical harominics coefficients for given cubemap data.
-    /// Input data should be in RGBA32F format.
-    void cubemapShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], void* _data, uint32_t _faceSize, uint32_t _faceOffsets[6]);
+    /// Input data should be in RGBA32F format, or RGB32F format if _numChannels is 3.
+    void cubemapShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], void* _data, uint32_t _faceSize, uint64_t _faceOffsets[6], uint8_t _numChannels = 4);
+
+    /// Computes Order*Order spherical harmonics coefficients (bands 0..Order-1) for given cubemap data.
+    /// Instantiated for Order 2 (L1), 3 (L2) and 5 (L4). Same input rules as above.
+    template <uint8_t Order>
+    void cubemapShCoeffs(double _shCoeffs[][3], void* _data, uint32_t _faceSize, uint64_t _faceOffsets[6], uint8_t _numChannels = 4);
+
+    /// Rectangle of a source cube face that changed, in [0.0 .. 1.0] face coordinates.
+    struct CubeFaceRegion
+    {
+        uint8_t m_face;
+        float m_min[2];
+        float m_max[2];
+    };
+
+    /// Updates coefficients of cubemapShCoeffs() after cubemap data changed from _oldData to _newData only inside _regions.
+    /// Projection is linear, so texels overlapped by the regions are projected as the difference of new and old data and
+    /// added to _shCoeffs, other texels are not read. Overlapping regions are counted once. Both data have the same layout,
+    /// result matches a full projection of _newData to float precision.
+    void cubemapShCoeffsUpdate(double _shCoeffs[SH_COEFF_NUM][3]
+                             , const void* _oldData
+                             , const void* _newData
+                             , uint32_t _faceSize
+                             , uint64_t _faceOffsets[6]
+                             , const CubeFaceRegion* _regions
+                             , uint32_t _numRegions
+                             , uint8_t _numChannels = 4
+                             );
+
+    /// Same as above for Order*Order coefficients, instantiated for the same orders as cubemapShCoeffs().
+    template <uint8_t Order>
+    void cubemapShCoeffsUpdate(double _shCoeffs[][3]
+                             , const void* _oldData
+                             , const void* _newData
+                             , uint32_t _faceSize
+                             , uint64_t _faceOffsets[6]
+                             , const CubeFaceRegion* _regions
+                             , uint32_t _numRegions
+                             , uint8_t _numChannels = 4
+                             );
+
+    /// Computes spherical harominics coefficients for given cubemap, cube cross or hstrip image.
+    /// Only the first _shOrder*_shOrder coefficients are computed, the rest are set to zero. Supported orders are 2, 3 and 5.
+    /// RGBA32F and RGB32F faces are read in place through an ImageView, other formats are converted to RGB32F first.
+    /// Projection runs on OpenCL device if valid context is provided, otherwise on the shared thread pool.
+    bool imageShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], const Image& _image, uint8_t _shOrder = 5, const ClContext* _clContext = NULL, const FilterSettings* _settings = NULL);
+
+    /// Computes spherical harmonics coefficients of every probe of an atlas, a grid of _tileWidth x _tileHeight hstrip or cube
+    /// cross tiles numbered row by row (see imageViewFromAtlasTile()). _shCoeffs has to hold imageAtlasNumTiles() entries.
+    /// Probes are spread over the shared thread pool. Small probes are projected several at a time with basis functions evaluated
+    /// once per texel, results match imageShCoeffs() on the tile alone up to float rounding.
+    bool imageShCoeffsAtlas(double (*_shCoeffs)[SH_COEFF_NUM][3], const Image& _atlas, uint32_t _tileWidth, uint32_t _tileHeight, uint8_t _shOrder = 5);
+
+    /// Shared PCA basis of a batch of probes. Probe ii is m_mean plus the sum of m_coeffs[ii*m_numComponents + kk] times
+    /// basis row kk, over rgb of every texel of all faces and mips in Image data order. Rows are orthonormal.
+    struct ProbeBasis
+    {
+        ProbeBasis()
+            : m_mean(NULL)
+            , m_basis(NULL)
+            , m_coeffs(NULL)
+            , m_faceSize(0)
+            , m_dimension(0)
+            , m_numComponents(0)
+            , m_numProbes(0)
+            , m_error(0.0f)
+            , m_numMips(0)
+        {
+        }
+
+        float* m_mean;            //!< m_dimension values.
+        float* m_basis;           //!< m_numComponents rows of m_dimension values, by decreasing variance.
+        float* m_coeffs;          //!< m_numComponents values per probe.
+        uint32_t m_faceSize;
+        uint32_t m_dimension;     //!< Values of a probe, 3 per texel.
+        uint32_t m_numComponents;
+        uint32_t m_numProbes;
+        float m_error;            //!< Relative RMS error of reconstructed probes over the batch.
+        uint8_t m_numMips;
+    };
+
+    /// Computes the basis of _numProbes cubemaps of the same face size and mip count, e.g. filtered by imageRadianceFilterBatch().
+    /// At most _maxComponents (up to MAX_PROBE_BASIS_COMPONENTS) are kept, with _maxError above zero the fewest that reconstruct
+    /// probes within that relative RMS error. Components are found by subspace iteration over the shared thread pool, the cost is
+    /// a few passes over the probes. Release with probeBasisUnload().
+    bool probeBasisCompute(ProbeBasis& _basis, const Image* _probes, uint32_t _numProbes, uint32_t _maxComponents, float _maxError = 0.0f);
+
+    /// Reconstructs probe _probe as a RGBA32F cubemap.
+    bool probeBasisReconstruct(Image& _dst, const ProbeBasis& _basis, uint32_t _probe);
+
+    ///
+    void probeBasisUnload(ProbeBasis& _basis);
+
+    /// Computes spherical harmonics coefficients directly from latlong image, without converting it to a cubemap first.
+    /// Texels are weighted by the exact solid angle of their row. Same _shOrder rules as imageShCoeffs().
+    bool imageShCoeffsFromLatLong(double _shCoeffs[SH_COEFF_NUM][3], const Image& _image, uint8_t _shOrder = 5);
+
+    /// Rotation of spherical harmonics coefficients, a (2l+1)x(2l+1) matrix for each band l of the 25 coefficient layout.
+    struct ShRotation
+    {
+        double m_mtx[1+9+25+49+81];
+    };
 
-    /// Computes spherical harominics coefficients for given cubemap image.
-    bool imageShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], const Image& _image);
+    /// Sets up rotation of an environment by row major 3x3 rotation matrix _mtx, light from direction d comes from _mtx*d afterwards.
+    /// Matrices are built for all 5 bands, it takes a few microseconds. One rotation can be applied to any number of probes.
+    void shRotationInit(ShRotation& _rotation, const float _mtx[9]);
+
+    /// Same with rotation Rz*Ry*Rx by Euler angles in radians, X rotation is applied first.
+    void shRotationInit(ShRotation& _rotation, float _x, float _y, float _z);
+
+    /// Rotates the first _shOrder bands of _src, remaining coefficients are set to zero. _dst can be _src.
+    void shRotate(double _dst[SH_COEFF_NUM][3], const double _src[SH_COEFF_NUM][3], const ShRotation& _rotation, uint8_t _shOrder = 5);
+
+    ///
+    void shRotate(double _dst[SH_COEFF_NUM][3], const double _src[SH_COEFF_NUM][3], const float _mtx[9], uint8_t _shOrder = 5);
 
     /// Creates irradiance cubemap. Uses fast spherical harmonics implementation.
-    bool imageIrradianceFilterSh(Image& _dst, uint32_t _dstFaceSize, const Image& _src);
+    /// SH projection and reconstruction run on OpenCL device if valid context is provided, otherwise on the shared thread pool.
+    /// Source can be a cube cross or hstrip as well, its faces are integrated in place.
+    /// With _stats, stage times, texels written and device transfer sizes are written there. SH projection counts as the prepare stage.
+    bool imageIrradianceFilterSh(Image& _dst, uint32_t _dstFaceSize, const Image& _src, uint8_t _shOrder = 5, const ClContext* _clContext = NULL, FilterStats* _stats = NULL, const FilterSettings* _settings = NULL);
 
     /// Converts cubemap image into irradiance cubemap. Uses fast spherical harmonics implementation.
-    void imageIrradianceFilterSh(Image& _image, uint32_t _faceSize);
+    void imageIrradianceFilterSh(Image& _image, uint32_t _faceSize, uint8_t _shOrder = 5, const ClContext* _clContext = NULL, FilterStats* _stats = NULL, const FilterSettings* _settings = NULL);
+
+    /// Same as imageIrradianceFilterSh(), output is a single octahedral map of _dstSize, see imageOctahedralFromCubemap().
+    /// Directions of octahedral texels are evaluated directly, there is no intermediate cubemap. Zero _dstSize is twice the source face size.
+    /// SH reconstruction runs on the CPU, _clContext is used for the projection only.
+    bool imageIrradianceFilterShOctahedral(Image& _dst, uint32_t _dstSize, const Image& _src, uint8_t _shOrder = 5, const ClContext* _clContext = NULL, FilterStats* _stats = NULL, const FilterSettings* _settings = NULL);
+
+    ///
+    void imageIrradianceFilterShOctahedral(Image& _image, uint32_t _dstSize, uint8_t _shOrder = 5, const ClContext* _clContext = NULL, FilterStats* _stats = NULL, const FilterSettings* _settings = NULL);
+
+    /// Creates irradiance cubemap by direct convolution with the clamped cosine lobe, there is no SH ringing on high contrast sources.
+    /// Source is box filtered down to a face size of CMFT_IRRADIANCE_COSINE_SOURCE_SIZE to twice that first, see cubemapfilter.cpp.
+    /// Output has the scale of imageIrradianceFilterSh(). Zero _dstFaceSize is the source face size.
+    bool imageIrradianceFilterCosine(Image& _dst, uint32_t _dstFaceSize, const Image& _src, FilterStats* _stats = NULL);
+
+    ///
+    void imageIrradianceFilterCosine(Image& _image, uint32_t _faceSize, FilterStats* _stats = NULL);
+
+    /// Same as imageCubemapFromLatLong() in image.h, conversion runs on OpenCL device of _clContext. Faces are converted one at a time,
+    /// latlong source has to fit a single device buffer, otherwise or without a valid context the conversion runs on the CPU.
+    /// Result matches the CPU one up to rounding. With _stats, device transfer sizes are added there.
+    bool imageCubemapFromLatLong(Image& _dst, const Image& _src, bool _useBilinearInterpolation, const ClContext* _clContext, FilterStats* _stats = NULL);
+
+    ///
+    void imageCubemapFromLatLong(Image& _image, bool _useBilinearInterpolation, const ClContext* _clContext, FilterStats* _stats = NULL);
+
+    /// Same as imageGenerateMipMapChain() in image.h. Box filtered chains of exact 2x2 downsamples run on OpenCL device of _clContext,
+    /// every mip including seam averaging is generated on the device and the whole chain is read back once. Other filters, chains that
+    /// don't fit a single device buffer and calls without a valid context run on the CPU.
+    void imageGenerateMipMapChain(Image& _image, uint8_t _numMips, ResampleFilter::Enum _filter, bool _averageSeams, const ClContext* _clContext, FilterStats* _stats = NULL);
 
     struct LightingModel
     {
@@ -41,6 +350,13 @@ namespace cmft
     };
 
     /// Creates radiance cubemap image.
+    /// With _useSourcePyramid, rougher mips are filtered from a box-downsampled copy of the source whose texels still resolve the filter angle,
+    /// instead of the full resolution source. Cost of those mips drops accordingly, at a small quality cost. Mips of 2x2 faces and
+    /// smaller are always filtered from the full source, see CMFT_RADIANCE_SOURCE_FULL_MIP_SIZE.
+    /// With _halfPrecision, source and destination are stored in RGBA16F during filtering, accumulation is still done in fp32.
+    /// OpenCL devices then get the source as CL_HALF_FLOAT and normal tables as solid angles only, texel normals are computed.
+    /// It halves memory use and bandwidth at the cost of fp16 quantization of the input and the result.
+    /// Negative _numCpuProcessingThreads takes getDefaultNumThreads() when no OpenCL device filters, and no CPU threads otherwise.
     bool imageRadianceFilter(Image& _dst
                            , uint32_t _dstFaceSize
                            , LightingModel::Enum _lightingModel
@@ -49,10 +365,458 @@ namespace cmft
                            , uint8_t _glossScale
                            , uint8_t _glossBias
                            , const Image& _src
-                           , int8_t _numCpuProcessingThreads = -1
+                           , int16_t _numCpuProcessingThreads = -1
                            , const ClContext* _clContext = NULL
+                           , bool _useSourcePyramid = false
+                           , bool _halfPrecision = false
+                           , const FilterSettings* _settings = NULL
                            );
 
+    /// Same as above, filtering on up to CMFT_CL_MAX_CONTEXTS OpenCL devices at once.
+    /// Each device gets its own host thread and pulls faces from the task list shared with the CPU threads.
+    /// Devices are weighted by their measured throughput, a slower device leaves large faces to a faster one and takes small faces instead.
+    /// With _gpuEncodeFormat BGRA8, RGBA8 or RGBE, filtered faces stay on the device and are packed there, only packed texels are read back.
+    /// Result is then returned in _gpuEncodeFormat instead of the source format. Faces filtered on the CPU are packed on the host.
+    /// With _stats, per-stage times, per-device face and texel counts and device transfer sizes of the call are written there.
+    /// With _progress, progress is reported and finished faces are passed on as faces get filtered, and the call can be cancelled, see FilterProgress.
+    /// With _maxMemoryBytes other than zero and estimated peak memory above it, output mips are filtered a few at a time
+    /// and converted to the source format right away, instead of converting the whole working format chain at the end.
+    /// With _shard, only faces of the shard are filtered, see FilterShard. Result is returned in the working format, RGBA32F or RGBA16F
+    /// with _halfPrecision, faces of other shards are zero. Memory budget, GPU encoding and copying of shared tier mips are not used then.
+    bool imageRadianceFilter(Image& _dst
+                           , uint32_t _dstFaceSize
+                           , LightingModel::Enum _lightingModel
+                           , bool _excludeBase
+                           , uint8_t _mipCount
+                           , uint8_t _glossScale
+                           , uint8_t _glossBias
+                           , const Image& _src
+                           , int16_t _numCpuProcessingThreads
+                           , const ClContext* const* _clContexts
+                           , uint8_t _numClContexts
+                           , bool _useSourcePyramid = false
+                           , bool _halfPrecision = false
+                           , TextureFormat::Enum _gpuEncodeFormat = TextureFormat::Unknown
+                           , FilterStats* _stats = NULL
+                           , FilterProgress* _progress = NULL
+                           , uint64_t _maxMemoryBytes = 0
+                           , const FilterShard* _shard = NULL
+                           , const FilterSettings* _settings = NULL
+                           );
+
+    /// Creates radiance cubemaps for _count source cubemaps in one go.
+    /// Faces of all cubemaps are processed by the same set of threads and OpenCL program. _dst may alias _src.
+    bool imageRadianceFilterBatch(Image* _dst
+                                , const Image* _src
+                                , uint32_t _count
+                                , uint32_t _dstFaceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , int16_t _numCpuProcessingThreads = -1
+                                , const ClContext* _clContext = NULL
+                                , bool _useSourcePyramid = false
+                                , bool _halfPrecision = false
+                                , const FilterSettings* _settings = NULL
+                                );
+
+    /// Same as above, filtering on multiple OpenCL devices.
+    bool imageRadianceFilterBatch(Image* _dst
+                                , const Image* _src
+                                , uint32_t _count
+                                , uint32_t _dstFaceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , int16_t _numCpuProcessingThreads
+                                , const ClContext* const* _clContexts
+                                , uint8_t _numClContexts
+                                , bool _useSourcePyramid = false
+                                , bool _halfPrecision = false
+                                , TextureFormat::Enum _gpuEncodeFormat = TextureFormat::Unknown
+                                , FilterStats* _stats = NULL
+                                , FilterProgress* _progress = NULL
+                                , uint64_t _maxMemoryBytes = 0
+                                , const FilterShard* _shard = NULL
+                                , const FilterSettings* _settings = NULL
+                                );
+
+    /// Creates _numTiers radiance cubemaps of one source, tier ii with face size _dstFaceSizes[ii] and _mipCounts[ii] mips.
+    /// Source is converted and prepared once for all tiers and their faces are processed by the same threads and OpenCL program.
+    /// Mips of a tier that match a mip of an earlier tier in face size and specular power are copied from it instead of being filtered.
+    /// Gloss follows the position of a mip in its chain, so that happens for equal tiers and for mips at the same relative position,
+    /// e.g. 64 face of 256 with 9 mips and of 128 with 5 mips, or the last mips of chains ending at the same face size.
+    /// Copying is skipped when streaming or with GPU encoding. _dst may alias _src.
+    bool imageRadianceFilterTiers(Image* _dst
+                                , const uint32_t* _dstFaceSizes
+                                , const uint8_t* _mipCounts
+                                , uint32_t _numTiers
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , const Image& _src
+                                , int16_t _numCpuProcessingThreads = -1
+                                , const ClContext* _clContext = NULL
+                                , bool _useSourcePyramid = false
+                                , bool _halfPrecision = false
+                                , const FilterSettings* _settings = NULL
+                                );
+
+    /// Same as above, filtering on multiple OpenCL devices.
+    bool imageRadianceFilterTiers(Image* _dst
+                                , const uint32_t* _dstFaceSizes
+                                , const uint8_t* _mipCounts
+                                , uint32_t _numTiers
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , const Image& _src
+                                , int16_t _numCpuProcessingThreads
+                                , const ClContext* const* _clContexts
+                                , uint8_t _numClContexts
+                                , bool _useSourcePyramid = false
+                                , bool _halfPrecision = false
+                                , TextureFormat::Enum _gpuEncodeFormat = TextureFormat::Unknown
+                                , FilterStats* _stats = NULL
+                                , FilterProgress* _progress = NULL
+                                , uint64_t _maxMemoryBytes = 0
+                                , const FilterShard* _shard = NULL
+                                , const FilterSettings* _settings = NULL
+                                );
+
+    /// Products of imageEnvironmentBake().
+    struct EnvironmentBake
+    {
+        Image m_radiance;
+        Image m_irradiance;                 //!< RGBA32F, empty if it was not requested.
+        double m_shCoeffs[SH_COEFF_NUM][3]; //!< First shOrder bands of the source, the rest are zero.
+    };
+
+    /// Creates radiance cubemap of _src like imageRadianceFilter() together with SH coefficients and irradiance of the source.
+    /// Source is converted and prepared once and projected to SH in the same sweep that convolves the wide radiance lobes,
+    /// coefficients are the first _shOrder bands of that projection. Irradiance cubemap of _irradianceFaceSize is evaluated
+    /// from them, zero _irradianceFaceSize skips it. Supported orders are 2, 3 and 5. Returns false if radiance filtering fails or is cancelled.
+    bool imageEnvironmentBake(EnvironmentBake& _result
+                            , const Image& _src
+                            , uint32_t _dstFaceSize
+                            , LightingModel::Enum _lightingModel
+                            , bool _excludeBase
+                            , uint8_t _mipCount
+                            , uint8_t _glossScale
+                            , uint8_t _glossBias
+                            , uint32_t _irradianceFaceSize
+                            , uint8_t _shOrder = 5
+                            , int16_t _numCpuProcessingThreads = -1
+                            , const ClContext* const* _clContexts = NULL
+                            , uint8_t _numClContexts = 0
+                            , bool _useSourcePyramid = false
+                            , bool _halfPrecision = false
+                            , FilterStats* _stats = NULL
+                            , FilterProgress* _progress = NULL
+                            , const FilterSettings* _settings = NULL
+                            );
+
+    /// Updates radiance cubemap _dst, filtered from an earlier version of _src with the same parameters and without half precision,
+    /// after _src changed only inside _regions. Face size and mip count are taken from _dst. Only output texels whose filter area
+    /// overlaps one of the regions are filtered again, on the CPU. They come out the same as from a full imageRadianceFilter() run,
+    /// other texels are left untouched.
+    bool imageRadianceFilterRegions(Image& _dst
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const Image& _src
+                                  , const CubeFaceRegion* _regions
+                                  , uint32_t _numRegions
+                                  , bool _useSourcePyramid = false
+                                  , FilterStats* _stats = NULL
+                                  , const FilterSettings* _settings = NULL
+                                  );
+
+    /// Creates radiance octahedral map of _dstSize with mips, see imageOctahedralFromCubemap(). Texels are filtered on the CPU
+    /// in their own directions, there is no intermediate cubemap. Mip of size S uses the filter parameters of a cubemap mip
+    /// with face size S/2, so glossiness of each mip is the same as in imageRadianceFilter() output. 1x1 mip is the average
+    /// of the six face directions, like averaged 1x1 faces. Zero _dstSize is twice the source face size.
+    bool imageRadianceFilterOctahedral(Image& _dst
+                                     , uint32_t _dstSize
+                                     , LightingModel::Enum _lightingModel
+                                     , bool _excludeBase
+                                     , uint8_t _mipCount
+                                     , uint8_t _glossScale
+                                     , uint8_t _glossBias
+                                     , const Image& _src
+                                     , bool _useSourcePyramid = false
+                                     , FilterStats* _stats = NULL
+                                     , const FilterSettings* _settings = NULL
+                                     );
+
+    ///
+    void imageRadianceFilterOctahedral(Image& _image
+                                     , uint32_t _dstSize
+                                     , LightingModel::Enum _lightingModel
+                                     , bool _excludeBase
+                                     , uint8_t _mipCount
+                                     , uint8_t _glossScale
+                                     , uint8_t _glossBias
+                                     , bool _useSourcePyramid = false
+                                     , FilterStats* _stats = NULL
+                                     , const FilterSettings* _settings = NULL
+                                     );
+
+    /// Creates radiance latlong map of _dstWidth x _dstWidth/2 with mips, same layout as imageLatLongFromCubemap() makes.
+    /// Texels are filtered on the CPU in their own directions like imageRadianceFilterOctahedral(), there is no intermediate
+    /// cubemap and no resample of the result. Mip of width W uses the filter parameters of a cubemap mip with face size W/4.
+    /// Mips of face size 1 are the average of the six face directions. Zero _dstWidth is four times the source face size.
+    bool imageRadianceFilterLatLong(Image& _dst
+                                  , uint32_t _dstWidth
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const Image& _src
+                                  , bool _useSourcePyramid = false
+                                  , FilterStats* _stats = NULL
+                                  , const FilterSettings* _settings = NULL
+                                  );
+
+    ///
+    void imageRadianceFilterLatLong(Image& _image
+                                  , uint32_t _dstWidth
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , bool _useSourcePyramid = false
+                                  , FilterStats* _stats = NULL
+                                  , const FilterSettings* _settings = NULL
+                                  );
+
+    /// Filters only mip _mip of the radiance chain that imageRadianceFilter() creates with _dstFaceSize and _mipCount, with the same
+    /// gloss mapping. Result is a single mip cubemap of that mip's face size. With _region, only its texels in destination face
+    /// coordinates are filtered and the rest is zero. Mips averaged to 1x1 or convolved in the SH domain are always done whole.
+    /// Mip 0 is filtered even though the full chain copies it with excludeBase. Runs on the CPU and matches imageRadianceFilter()
+    /// without OpenCL and half precision.
+    bool imageRadianceFilterMip(Image& _dst
+                              , uint32_t _dstFaceSize
+                              , LightingModel::Enum _lightingModel
+                              , uint8_t _mip
+                              , uint8_t _mipCount
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , const Image& _src
+                              , const CubeFaceRegion* _region = NULL
+                              , bool _useSourcePyramid = false
+                              , FilterStats* _stats = NULL
+                              , const FilterSettings* _settings = NULL
+                              );
+
+    /// Same mip as imageRadianceFilterMip(), filtered by brute force in double precision with the lobe evaluated exactly and
+    /// without SIMD, lobe table, SH or source pyramid shortcuts. Slow, meant for validating the fast paths against it.
+    bool imageRadianceFilterMipReference(Image& _dst
+                                       , uint32_t _dstFaceSize
+                                       , LightingModel::Enum _lightingModel
+                                       , uint8_t _mip
+                                       , uint8_t _mipCount
+                                       , uint8_t _glossScale
+                                       , uint8_t _glossBias
+                                       , const Image& _src
+                                       , const CubeFaceRegion* _region = NULL
+                                       , FilterStats* _stats = NULL
+                                       , const FilterSettings* _settings = NULL
+                                       );
+
+    /// Cost heatmap of the chain imageRadianceFilter() creates, for finding where the filter spends its time. RGBA32F cubemap
+    /// with the same mips, per destination texel R is the number of source texels in its filter area, G the ones visited after
+    /// block culling and B the taps inside of the specular angle, A is one. Counts follow the CPU traversal over the full
+    /// resolution source. Excluded base and mips convolved in the SH domain have no taps and are zero.
+    bool imageRadianceFilterCost(Image& _dst
+                               , const Image& _src
+                               , uint32_t _dstFaceSize
+                               , LightingModel::Enum _lightingModel
+                               , bool _excludeBase
+                               , uint8_t _mipCount
+                               , uint8_t _glossScale
+                               , uint8_t _glossBias
+                               , const FilterSettings* _settings = NULL
+                               );
+
+    /// Same chain as imageRadianceFilter() filtered by successive convolution on the CPU. Each mip is convolved from the previous,
+    /// sharper one with the residual lobe, mips below 8x8 faces from the last mip of at least that size. Lobes compose about like
+    /// gaussians of variance 1/power, the residual power keeps the first Legendre band of the composed lobe exact. Rough mips then
+    /// cost about as much as filtering at the previous mip face size, and the chain costs about as much as its first mip.
+    /// Result is an approximation of the direct one. With _maxError above zero, a region of one face of every chained mip is
+    /// filtered directly from the source as well, a mip whose relative RMS error in it exceeds _maxError is filtered directly
+    /// and the chain continues from it.
+    bool imageRadianceFilterChain(Image& _dst
+                                , uint32_t _dstFaceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , const Image& _src
+                                , float _maxError = 0.0f
+                                , FilterStats* _stats = NULL
+                                , const FilterSettings* _settings = NULL
+                                );
+
+    ///
+    void imageRadianceFilterChain(Image& _image
+                                , uint32_t _faceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , float _maxError = 0.0f
+                                , FilterStats* _stats = NULL
+                                , const FilterSettings* _settings = NULL
+                                );
+
+    struct RadianceFilterIncrementalState;
+
+    /// Radiance filter that runs in time slices on the calling thread, e.g. within a per-frame job budget of an engine.
+    /// init() prepares the source, each step() then filters rows of faces until its budget is used up. Result is the same as
+    /// imageRadianceFilter() on the CPU without half precision. A slice is at least one row of a face; converting the
+    /// result and the SH projection of wide lobes are slices on their own. RGBA32F source is referenced, not copied, it has
+    /// to stay unchanged until filtering is complete.
+    struct RadianceFilterIncremental
+    {
+        RadianceFilterIncremental();
+        ~RadianceFilterIncremental();
+
+        /// Starts filtering _src with the parameters of imageRadianceFilter(), filtering in progress is dropped.
+        bool init(uint32_t _dstFaceSize
+                , LightingModel::Enum _lightingModel
+                , bool _excludeBase
+                , uint8_t _mipCount
+                , uint8_t _glossScale
+                , uint8_t _glossBias
+                , const Image& _src
+                , bool _useSourcePyramid = false
+                , const FilterSettings* _settings = NULL
+                );
+
+        /// Filters for about _budgetMicroseconds, the last slice can go over it. Returns isComplete().
+        bool step(uint32_t _budgetMicroseconds);
+
+        ///
+        bool isComplete() const;
+
+        /// Fraction of face rows filtered so far, in [0.0 .. 1.0].
+        float getProgress() const;
+
+        /// Moves the result in the source format to _dst and releases the filter. Fails if filtering is not complete.
+        bool getResult(Image& _dst);
+
+        /// Releases the source copy, result and filter state, init() can be called again afterwards.
+        void shutdown();
+
+        RadianceFilterIncrementalState* m_state;
+    };
+
+    /// Radiance filter of one configuration as sparse weights. Row of each destination texel holds normalized weights of the
+    /// source texels it is filtered from, so every source of the same face size is filtered by a matrix product alone.
+    struct RadianceFilterMatrix
+    {
+        RadianceFilterMatrix()
+            : m_srcFaceSize(0)
+            , m_dstFaceSize(0)
+            , m_mipCount(0)
+            , m_glossScale(0)
+            , m_glossBias(0)
+            , m_lightingModel(0)
+            , m_excludeBase(false)
+            , m_useSourcePyramid(false)
+            , m_numRows(0)
+            , m_numEntries(0)
+            , m_rows(NULL)
+            , m_columns(NULL)
+            , m_weights(NULL)
+        {
+            for (uint8_t ii = 0; ii < MAX_MIP_NUM; ++ii)
+            {
+                m_srcLevel[ii] = 0;
+                m_mipRows[ii] = 0;
+            }
+        }
+
+        uint32_t m_srcFaceSize;
+        uint32_t m_dstFaceSize;
+        uint8_t m_mipCount;
+        uint8_t m_glossScale;
+        uint8_t m_glossBias;
+        uint8_t m_lightingModel;
+        bool m_excludeBase;
+        bool m_useSourcePyramid;
+        uint8_t m_srcLevel[MAX_MIP_NUM];  //!< Source pyramid level read by each mip, level 0 is the source itself.
+        uint64_t m_mipRows[MAX_MIP_NUM];  //!< First row of each mip. Rows of a mip are faces one after another, rows of texels within them.
+        uint64_t m_numRows;
+        uint64_t m_numEntries;
+        uint64_t* m_rows;    //!< m_numRows+1 offsets of the row entries.
+        uint32_t* m_columns; //!< Texel index face*size*size + y*size + x within the source level.
+        float* m_weights;
+    };
+
+    /// Computes radiance filter weights of imageRadianceFilter() with the given parameters for sources of _srcFaceSize.
+    /// Lobes are evaluated exactly, including mips imageRadianceFilter() convolves in the SH domain. Fails if the matrix would
+    /// hold more than CMFT_RADIANCE_MATRIX_MAX_ENTRIES weights, wide lobes should then read the source pyramid.
+    bool radianceFilterMatrixBuild(RadianceFilterMatrix& _matrix
+                                 , uint32_t _srcFaceSize
+                                 , uint32_t _dstFaceSize
+                                 , LightingModel::Enum _lightingModel
+                                 , bool _excludeBase
+                                 , uint8_t _mipCount
+                                 , uint8_t _glossScale
+                                 , uint8_t _glossBias
+                                 , bool _useSourcePyramid = false
+                                 , const FilterSettings* _settings = NULL
+                                 );
+
+    ///
+    bool radianceFilterMatrixSave(const RadianceFilterMatrix& _matrix, const char* _filePath);
+
+    /// Fails if the file is not a matrix saved by this version.
+    bool radianceFilterMatrixLoad(RadianceFilterMatrix& _matrix, const char* _filePath);
+
+    ///
+    void radianceFilterMatrixUnload(RadianceFilterMatrix& _matrix);
+
+    /// Filters cubemap _src by _matrix on the CPU. Source face size has to be the one the matrix was built for.
+    /// Output has the same face size, mip count and format as imageRadianceFilter() with the matrix parameters.
+    bool imageRadianceFilterMatrix(Image& _dst, const Image& _src, const RadianceFilterMatrix& _matrix);
+
+    /// One parameter set of imageRadianceFilterSweep().
+    struct RadianceSweepParams
+    {
+        uint8_t m_glossScale;
+        uint8_t m_glossBias;
+        LightingModel::Enum m_lightingModel;
+    };
+
+    /// Filters _src with each of _numSets parameter sets into _dst[set], up to CMFT_RADIANCE_SWEEP_MAX_SETS, on the CPU.
+    /// Sets share one traversal of the widest filter area of each mip, its texel fetches and dot products, so the sweep
+    /// costs about as much as its widest set, wide lobes are convolved in the SH domain for each set. Mips read the source
+    /// pyramid level of the narrowest set. Results are those of CPU imageRadianceFilter() with each set.
+    bool imageRadianceFilterSweep(Image* _dst
+                                , const Image& _src
+                                , const RadianceSweepParams* _sets
+                                , uint8_t _numSets
+                                , uint32_t _dstFaceSize
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , bool _useSourcePyramid = false
+                                , const FilterSettings* _settings = NULL
+                                );
+
     /// Converts cubemap image into radiance cubemap.
     void imageRadianceFilter(Image& _image
                            , uint32_t _dstFaceSize
@@ -61,10 +825,326 @@ namespace cmft
                            , uint8_t _mipCount
                            , uint8_t _glossScale
                            , uint8_t _glossBias
-                           , int8_t _numCpuProcessingThreads = -1
+                           , int16_t _numCpuProcessingThreads = -1
                            , const ClContext* _clContext = NULL
+                           , bool _useSourcePyramid = false
+                           , bool _halfPrecision = false
+                           , const FilterSettings* _settings = NULL
+                           );
+
+    /// Converts cubemap image into radiance cubemap, filtering on multiple OpenCL devices.
+    void imageRadianceFilter(Image& _image
+                           , uint32_t _dstFaceSize
+                           , LightingModel::Enum _lightingModel
+                           , bool _excludeBase
+                           , uint8_t _mipCount
+                           , uint8_t _glossScale
+                           , uint8_t _glossBias
+                           , int16_t _numCpuProcessingThreads
+                           , const ClContext* const* _clContexts
+                           , uint8_t _numClContexts
+                           , bool _useSourcePyramid = false
+                           , bool _halfPrecision = false
+                           , TextureFormat::Enum _gpuEncodeFormat = TextureFormat::Unknown
+                           , FilterStats* _stats = NULL
+                           , FilterProgress* _progress = NULL
+                           , uint64_t _maxMemoryBytes = 0
+                           , const FilterShard* _shard = NULL
+                           , const FilterSettings* _settings = NULL
                            );
 
+    /// Puts together _numShards results of a sharded radiance bake, see FilterShard. Each face is taken from the shard that filtered it.
+    /// Shards have to have the same size, format and mip count. Fails if a face was filtered by several shards.
+    bool imageRadianceFilterMerge(Image& _dst, const Image* _shards, uint32_t _numShards);
+
+    /// Filters a small synthetic cubemap on _clContext alone and returns millions of filtered texels per second, zero if filtering failed.
+    /// Short enough to run for every device at startup, see clRankDevices().
+    double imageRadianceFilterCalibrate(const ClContext* _clContext);
+
+    /// Measured radiance filter throughput of a machine, in source taps per second. See filterProfileCalibrate().
+    struct FilterProfile
+    {
+        FilterProfile()
+            : m_cpuTapsPerSecond(0.0)
+            , m_clTapsPerSecond(0.0)
+            , m_numCpuThreads(0)
+        {
+        }
+
+        double m_cpuTapsPerSecond; //!< Single CPU processing thread.
+        double m_clTapsPerSecond;  //!< All OpenCL devices together.
+        uint16_t m_numCpuThreads;  //!< CPU processing threads the estimate assumes, throughput is taken to scale linearly with them.
+    };
+
+    /// Times short filter runs of a small synthetic cubemap on a single CPU thread and on each of _clContexts, and fills _profile
+    /// for _numCpuThreads CPU processing threads together with all _clContexts. Returns false if nothing could filter.
+    /// Small faces make the most of the calibration run, large bakes tend to filter somewhat faster than estimated from it.
+    bool filterProfileCalibrate(FilterProfile& _profile, int16_t _numCpuThreads, const ClContext* const* _clContexts = NULL, uint8_t _numClContexts = 0);
+
+    /// Expected cost of a radiance filter call, see imageRadianceFilterEstimate().
+    struct RadianceFilterEstimate
+    {
+        uint8_t m_mipCount;                   //!< Output mips, including the base.
+        uint32_t m_mipFaceSize[MAX_MIP_NUM];
+        uint32_t m_mipSrcFaceSize[MAX_MIP_NUM]; //!< Face size of the source level each mip reads, see _useSourcePyramid.
+        float m_mipSpecularPower[MAX_MIP_NUM]; //!< Lobe power of each mip, zero for copied base. Texels of a mip depend only on the
+        float m_mipCosAngle[MAX_MIP_NUM];      //!< source, its face size, power and filter cut, see FilterSettings::m_lobeTolerance.
+        uint64_t m_mipTaps[MAX_MIP_NUM];      //!< Source texels read for all destination texels of the mip, zero for copied base.
+        bool m_mipSh[MAX_MIP_NUM];            //!< Mip is convolved in the SH domain, it takes a tap per texel and SH coefficient.
+        uint64_t m_shProjectionTaps;          //!< SH projection of the source for SH convolved mips, a tap per source texel and coefficient.
+        uint64_t m_numTaps;                   //!< Taps of all mips and of the SH projection.
+        uint64_t m_peakBytes;                 //!< Peak memory of the call, source and result included.
+        double m_seconds;                     //!< Filtering time on the profile, zero without one. Source preparation and conversion of the result are not included.
+    };
+
+    /// Derives tap counts per mip, peak memory and, with _profile, filtering time of imageRadianceFilter() from the filter
+    /// parameters alone, without filtering. Source is described by its face size and format. Taps count the source texels
+    /// under the filter bounds of each destination texel, which is what filter time is proportional to.
+    void imageRadianceFilterEstimate(RadianceFilterEstimate& _estimate
+                                   , uint32_t _srcFaceSize
+                                   , TextureFormat::Enum _srcFormat
+                                   , uint32_t _dstFaceSize
+                                   , LightingModel::Enum _lightingModel
+                                   , bool _excludeBase
+                                   , uint8_t _mipCount
+                                   , uint8_t _glossScale
+                                   , uint8_t _glossBias
+                                   , bool _useSourcePyramid = false
+                                   , bool _halfPrecision = false
+                                   , const FilterProfile* _profile = NULL
+                                   , const FilterSettings* _settings = NULL
+                                   );
+
+    /// Per-mip quality settings of a radiance filter run, chosen for a time budget by imageRadianceFilterPlan().
+    struct RadianceFilterQuality
+    {
+        uint8_t m_mipCount;                      //!< Output mips, including the base.
+        uint8_t m_mipSrcLevel[MAX_MIP_NUM];      //!< Source pyramid level each mip reads, its face size is srcFaceSize>>level.
+        float m_mipLobeTolerance[MAX_MIP_NUM];   //!< Lobe truncation tolerance of each mip, see FilterSettings::m_lobeTolerance.
+        uint32_t m_mipNumSamples[MAX_MIP_NUM];   //!< GGX samples of each mip, zero when planned for imageRadianceFilter().
+        double m_budget;                         //!< Filtering time the settings were chosen for, in seconds.
+        double m_seconds;                        //!< Estimated filtering time with the settings, see RadianceFilterEstimate::m_seconds.
+        bool m_withinBudget;                     //!< False if even the lowest quality doesn't meet the budget.
+    };
+
+    /// Picks per-mip settings of a radiance filter of a source of _srcFaceSize that fit filtering in _seconds on _profile.
+    /// Starts from full quality and makes the most expensive mip cheaper, one step at a time, until the estimate meets the
+    /// budget: first the source pyramid level that leaves results unchanged, see _useSourcePyramid, then lobe tolerance ten
+    /// times larger up to CMFT_RADIANCE_PLAN_MAX_TOLERANCE, then smaller source levels down to the face size of the mip.
+    /// With _ggxNumSamples, plans imageRadianceFilterGgx() instead, halving samples of a mip down to CMFT_GGX_PLAN_MIN_SAMPLES.
+    /// Returns false if _profile has no throughput.
+    bool imageRadianceFilterPlan(RadianceFilterQuality& _quality
+                               , double _seconds
+                               , const FilterProfile& _profile
+                               , uint32_t _srcFaceSize
+                               , uint32_t _dstFaceSize
+                               , LightingModel::Enum _lightingModel
+                               , bool _excludeBase
+                               , uint8_t _mipCount
+                               , uint8_t _glossScale
+                               , uint8_t _glossBias
+                               , uint32_t _ggxNumSamples = 0
+                               , const FilterSettings* _settings = NULL
+                               );
+
+    /// Filters _src into _dst like imageRadianceFilter(), with settings of imageRadianceFilterPlan() for a budget of _seconds.
+    /// _profile has to be calibrated for _clContexts and is run with its CPU thread count. Chosen settings are returned in
+    /// _quality if not NULL. Budget covers filtering only, source preparation and conversion of the result come on top.
+    bool imageRadianceFilterBudget(Image& _dst
+                                 , const Image& _src
+                                 , double _seconds
+                                 , const FilterProfile& _profile
+                                 , uint32_t _dstFaceSize
+                                 , LightingModel::Enum _lightingModel
+                                 , bool _excludeBase
+                                 , uint8_t _mipCount
+                                 , uint8_t _glossScale
+                                 , uint8_t _glossBias
+                                 , const ClContext* const* _clContexts = NULL
+                                 , uint8_t _numClContexts = 0
+                                 , bool _halfPrecision = false
+                                 , RadianceFilterQuality* _quality = NULL
+                                 , const FilterSettings* _settings = NULL
+                                 );
+
+    /// Builds OpenCL programs of the radiance filter and of SH projections that don't depend on the source into the program cache
+    /// of _clContext, so that device setup can overlap with loading the input. Kernels specialized for source and destination
+    /// sizes are still built on first use, or loaded from the binary cache.
+    void filterPrecompile(const ClContext* _clContext, bool _radiance, bool _irradianceSh);
+
+    /// Filters shared cubemap texture _src of _srcFaceSize into shared cubemap texture _dst on the device of _clContext. Neither
+    /// texture is copied to or from the host. Context has to share textures with the graphics API, see ClContext::init().
+    /// _dst needs mips down to the last one filtered, in a format kernels can write (RGBA32F, RGBA16F or RGBA8).
+    /// Graphics API has to be done with both textures, they are handed back to it when the call returns.
+    /// All mips are filtered by the kernel, wide lobes are not convolved in the SH domain. With _excludeBase, mip 0 is copied
+    /// from the source if it has the same size, and filtered otherwise.
+    bool imageRadianceFilterShared(const ClSharedTexture& _dst
+                                 , uint32_t _dstFaceSize
+                                 , LightingModel::Enum _lightingModel
+                                 , bool _excludeBase
+                                 , uint8_t _mipCount
+                                 , uint8_t _glossScale
+                                 , uint8_t _glossBias
+                                 , const ClSharedTexture& _src
+                                 , uint32_t _srcFaceSize
+                                 , const ClContext* _clContext
+                                 , FilterStats* _stats = NULL
+                                 , const FilterSettings* _settings = NULL
+                                 );
+
+    /// Creates radiance cubemap image with GGX lobe using filtered importance sampling.
+    /// Mip glossiness follows the same glossScale/glossBias distribution as imageRadianceFilter(), converted to GGX roughness.
+    /// Each sample reads from the source mip level matching its solid angle, so _numSamples can stay low (64-256).
+    /// _numLightSamples directions are also picked from source luminance and combined with GGX samples by multiple
+    /// importance sampling (balance heuristic). Both kinds of samples then read the base mip only, small bright lights
+    /// converge with far fewer samples while smooth inputs need more of them than filtered importance sampling. 0 disables it.
+    /// With _quality, mips take its sample counts, at most _numSamples, see imageRadianceFilterPlan().
+    bool imageRadianceFilterGgx(Image& _dst
+                              , uint32_t _dstFaceSize
+                              , bool _excludeBase
+                              , uint8_t _mipCount
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , uint32_t _numSamples
+                              , const Image& _src
+                              , uint32_t _numLightSamples = 0
+                              , const RadianceFilterQuality* _quality = NULL
+                              );
+
+    /// Converts cubemap image into GGX radiance cubemap.
+    void imageRadianceFilterGgx(Image& _image
+                              , uint32_t _dstFaceSize
+                              , bool _excludeBase
+                              , uint8_t _mipCount
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , uint32_t _numSamples
+                              , uint32_t _numLightSamples = 0
+                              , const RadianceFilterQuality* _quality = NULL
+                              );
+
+    /// Light far enough to be a direction, a disk of angular radius m_angle around it.
+    struct CubemapLight
+    {
+        float m_dir[3];   //!< Direction towards the light.
+        float m_color[3]; //!< Radiance integrated over the disk, irradiance of a surface facing the light.
+        float m_angle;    //!< Angular radius of the disk in radians, zero for a directional light.
+    };
+
+    /// Finds up to _maxLights lights in cubemap _image and moves them out of its texels. Texels brighter than _threshold times
+    /// the mean luminance of the image are scaled down to that luminance, the excess goes to the light of the brightest texel
+    /// within CMFT_LIGHT_CLUSTER_ANGLE, or starts a new one, brightest texels first. Light direction is the excess weighted
+    /// mean, its disk covers the solid angle of its texels. Texels of lights over _maxLights are left as they are.
+    /// Returns the number of lights found, at most CMFT_LIGHT_MAX_EXTRACT. Lights taken from a large source let the rest be resized and filtered small,
+    /// lights are then added back with imageRadianceAddLights(), imageIrradianceAddLights() and shAddLights().
+    uint32_t imageExtractLights(CubemapLight* _lights, uint32_t _maxLights, Image& _image, float _threshold = 64.0f);
+
+    /// Adds SH projection of _numLights _lights to _shCoeffs, as cubemapShCoeffs() would project their texels.
+    void shAddLights(double _shCoeffs[SH_COEFF_NUM][3], const CubemapLight* _lights, uint32_t _numLights);
+
+    /// Adds _lights to irradiance cubemap _image made by imageIrradianceFilterSh() of the same _shOrder. Lights go through the
+    /// same SH reconstruction, the result is that of the cubemap the lights were taken from.
+    bool imageIrradianceAddLights(Image& _image, const CubemapLight* _lights, uint32_t _numLights, uint8_t _shOrder = 5);
+
+    /// Adds _lights to radiance cubemap _image made by imageRadianceFilter() with the same parameters. Each mip gets the lights
+    /// convolved with its lobe analytically, cut where the filter cuts it. Lobes narrower than a texel of the mip, and the copied
+    /// base with _excludeBase, get the lights spread over the texels of their disks instead, as the filter passes them through.
+    bool imageRadianceAddLights(Image& _image
+                              , const CubemapLight* _lights
+                              , uint32_t _numLights
+                              , LightingModel::Enum _lightingModel
+                              , bool _excludeBase
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , const FilterSettings* _settings = NULL
+                              );
+
+    /// Creates approximate radiance cubemap in a fraction of imageRadianceFilter() time, for previews. Output has the same
+    /// face size, mip count and format as imageRadianceFilter() with the same parameters, so it can be replaced by the full result later.
+    /// Each mip is a 2x2 downsample of the previous one, blurred by box passes across face seams until the blur matches
+    /// the width of the mip lobe. Blur is sized at face centers, towards face corners it gets narrower than the lobe.
+    bool imageRadianceFilterPreview(Image& _dst
+                                  , uint32_t _dstFaceSize
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const Image& _src
+                                  , const FilterSettings* _settings = NULL
+                                  );
+
+    /// Converts cubemap image into preview radiance cubemap.
+    void imageRadianceFilterPreview(Image& _image
+                                  , uint32_t _dstFaceSize
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const FilterSettings* _settings = NULL
+                                  );
+
+    /// Called by imageRadianceFilterProgressive() after each pass, from the calling thread. _image is the working Rgba32f result
+    /// in its final layout, valid only during the call. Returning false stops refinement.
+    typedef bool (*RadianceRefineFn)(const Image& _image, uint8_t _pass, uint8_t _numPasses, void* _userData);
+
+    /// Creates radiance cubemap in passes of increasing quality, each one refining the result of the previous one in place.
+    /// Pass 0 is imageRadianceFilterPreview(). Following passes filter texels on every 4th row and column, then every 2nd,
+    /// then the rest, exactly as imageRadianceFilter() on the CPU does, texels not filtered yet keep their preview values.
+    /// Wide SH lobe mips and 1x1 faces are complete after pass 1. After the last pass, the result is the same as from a full
+    /// imageRadianceFilter() run without OpenCL and half precision. When _callback stops refinement, _dst gets the last pass result.
+    bool imageRadianceFilterProgressive(Image& _dst
+                                      , uint32_t _dstFaceSize
+                                      , LightingModel::Enum _lightingModel
+                                      , bool _excludeBase
+                                      , uint8_t _mipCount
+                                      , uint8_t _glossScale
+                                      , uint8_t _glossBias
+                                      , const Image& _src
+                                      , RadianceRefineFn _callback
+                                      , void* _userData = NULL
+                                      , bool _useSourcePyramid = false
+                                      , const FilterSettings* _settings = NULL
+                                      );
+
+    /// Converts cubemap image into radiance cubemap in passes of increasing quality.
+    void imageRadianceFilterProgressive(Image& _image
+                                      , uint32_t _dstFaceSize
+                                      , LightingModel::Enum _lightingModel
+                                      , bool _excludeBase
+                                      , uint8_t _mipCount
+                                      , uint8_t _glossScale
+                                      , uint8_t _glossBias
+                                      , RadianceRefineFn _callback
+                                      , void* _userData = NULL
+                                      , bool _useSourcePyramid = false
+                                      , const FilterSettings* _settings = NULL
+                                      );
+
+    /// Creates split-sum BRDF integration lookup table for shading with radiance cubemaps: specular = radiance*(f0*red + green).
+    /// Horizontal axis is NdotV, vertical axis is glossiness with the same glossScale/glossBias distribution as imageRadianceFilter(),
+    /// both at texel centers. Blinn models use the specular power as Blinn exponent, Brdf variants include NdotL.
+    bool imageBrdfLut(Image& _dst
+                    , uint32_t _width
+                    , uint32_t _height
+                    , LightingModel::Enum _lightingModel
+                    , uint8_t _glossScale
+                    , uint8_t _glossBias
+                    , uint32_t _numSamples
+                    , TextureFormat::Enum _format = TextureFormat::RG16F
+                    );
+
+    /// Same as imageBrdfLut() for the GGX lobe of imageRadianceFilterGgx(), with separable Smith shadowing.
+    bool imageBrdfLutGgx(Image& _dst
+                       , uint32_t _width
+                       , uint32_t _height
+                       , uint8_t _glossScale
+                       , uint8_t _glossBias
+                       , uint32_t _numSamples
+                       , TextureFormat::Enum _format = TextureFormat::RG16F
+                       );
+
 } // namespace cmft
 
 #endif // CMFT_CUBEMAPFILTER_H_HEADER_GUARD
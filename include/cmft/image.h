@@ -9,6 +9,9 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "allocator.h"
+#include "stream.h"
+
 #ifndef UINT8_MAX // Fixing mingw bug.
 #define UINT8_MAX (255)
 #endif //UINT8_MAX
@@ -47,6 +50,8 @@ namespace cmft
             KTX,
             TGA,
             HDR,
+            EXR,
+            KTX2,
 
             Count
         };
@@ -69,6 +74,22 @@ namespace cmft
             RGBA16F,
             RGBA32F,
 
+            RG16F,
+            RG32F,
+
+            RGB9E5,     //!< Shared 5-bit exponent, 9-bit mantissas.
+            R11G11B10F, //!< Unsigned floats with 5-bit exponents and 6, 6 and 5-bit mantissas.
+
+            RGBM8,      //!< Rgb scaled by alpha and the rgbm range, see ImageEncodeSettings.
+            RGBD8,      //!< Rgb divided by alpha, scaled by the rgbd range.
+            LOGLUV8,    //!< Chromaticity in red and green, 16-bit log luminance in blue (high) and alpha (low).
+
+            BC6H_UF16,
+            BC6H_SF16,
+            BC7,
+            ETC2,
+            ASTC4X4,
+
             Unknown,
 
             Count,
@@ -81,8 +102,11 @@ namespace cmft
         uint8_t m_numChanels;
         uint8_t m_hasAlpha;
         uint8_t m_pixelType;
+        uint8_t m_blockBytes; //!< Bytes per 4x4 block of block compressed formats, 0 for uncompressed formats.
     };
 
+    struct ImageShare;
+
     struct Image
     {
         Image()
@@ -93,16 +117,24 @@ namespace cmft
             , m_numMips(0)
             , m_numFaces(0)
             , m_data(NULL)
+            , m_mapped(false)
+            , m_allocator(getAllocator())
+            , m_share(NULL)
+            , m_faceTransforms(0)
         {
         }
 
         uint32_t m_width;
         uint32_t m_height;
-        uint32_t m_dataSize;
+        uint64_t m_dataSize;
         TextureFormat::Enum m_format;
         uint8_t m_numMips;
         uint8_t m_numFaces;
         void* m_data;
+        bool m_mapped; //!< m_data points into a private file mapping, imageUnload() unmaps it.
+        Allocator* m_allocator; //!< m_data was allocated from it, imageUnload() frees it there. NULL means CRT free().
+        ImageShare* m_share;    //!< Reference count of m_data shared with imageShare(), NULL if the image is its only owner.
+        uint32_t m_faceTransforms; //!< Face transforms recorded by imageTransformDeferred() and not yet applied to m_data, 0 if none.
     };
 
     ///
@@ -129,7 +161,7 @@ namespace cmft
     ///
     void imageUnload(Image& _image);
 
-    ///
+    /// Reference does not own data and is not counted, it must not outlive _src and is not unloaded.
     void imageRef(Image& _dst, const Image& _src);
 
     ///
@@ -138,68 +170,270 @@ namespace cmft
     ///
     void imageCopy(Image& _dst, const Image& _src);
 
+    /// Shares data of _src with _dst instead of copying it. Data is freed by imageUnload() of the last image sharing it.
+    /// Functions modifying an image in place copy shared data first, other images keep the original.
+    /// _src has to own its data, a reference made with imageRef() can not be shared.
+    void imageShare(Image& _dst, Image& _src);
+
+    /// Shares _src with _dst if _src is already shared, copies it otherwise.
+    void imageShareOrCopy(Image& _dst, const Image& _src);
+
+    /// True if data of _image is shared with other images.
+    bool imageIsShared(const Image& _image);
+
+    /// Copies shared data of _image, so it can be modified without affecting other images.
+    void imageMakeUnique(Image& _image);
+
     ///
-    uint32_t imageGetNumPixels(const Image& _image);
+    uint64_t imageGetNumPixels(const Image& _image);
 
     ///
-    void imageGetMipOffsets(uint32_t _offsets[CUBE_FACE_NUM][MAX_MIP_NUM], const Image& _image);
+    void imageGetMipOffsets(uint64_t _offsets[CUBE_FACE_NUM][MAX_MIP_NUM], const Image& _image);
 
     ///
-    void imageGetFaceOffsets(uint32_t _faceOffsets[CUBE_FACE_NUM], const Image& _image);
+    void imageGetFaceOffsets(uint64_t _faceOffsets[CUBE_FACE_NUM], const Image& _image);
+
+    /// Placement of image data, computed once instead of walking faces and mips for every offset.
+    /// Row _y of mip _m of face _f starts at m_offsets[_f][_m] + _y*m_pitch[_m], rows of block compressed formats are rows of 4x4 blocks.
+    /// With m_rowAlignment above 1, every row starts at a multiple of it and is padded up to the next one.
+    struct ImageLayout
+    {
+        uint64_t m_offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint64_t m_pitch[MAX_MIP_NUM];
+        uint32_t m_numRows[MAX_MIP_NUM];
+        uint64_t m_dataSize;
+        uint32_t m_rowAlignment;
+    };
+
+    /// Image data is always tightly packed, which is the layout with _rowAlignment 1. Other alignments have to be a power of two
+    /// and describe padded copies made with imageCopyToLayout(), for example 64 for aligned SIMD loads of whole rows.
+    void imageGetLayout(ImageLayout& _layout, const Image& _image, uint32_t _rowAlignment = 1);
+
+    /// Copies data of _src into _dst, laid out as _layout computed for _src. _dst has to hold _layout.m_dataSize bytes, padding is zeroed.
+    void imageCopyToLayout(void* _dst, const ImageLayout& _layout, const Image& _src);
+
+    struct CompressionQuality
+    {
+        enum Enum
+        {
+            Fast,    //!< Principal axis fit, subblock averages for ETC2.
+            Quality, //!< Fit is refined with least squares and endpoint search, several times slower.
+
+            Count
+        };
+    };
+
+    struct MipLayout
+    {
+        enum Enum
+        {
+            FileType,      //!< As the file type defines it. Dds faces follow each other with all of their mips, Ktx mips with all of their faces.
+            LargestFirst,  //!< Mips follow each other with all of their faces, largest first, and ImageMipIndex is written.
+            SmallestFirst, //!< Same with the smallest mip first.
+
+            Count
+        };
+    };
+
+    /// Encoding parameters of imageConvert() and imageSave(), defaults are used where they take none.
+    struct ImageEncodeSettings
+    {
+        ImageEncodeSettings()
+            : m_rgbmRange(8.0f)
+            , m_rgbdRange(255.0f)
+            , m_compressionQuality(CompressionQuality::Fast)
+            , m_mipLayout(MipLayout::FileType)
+            , m_tgaRle(false)
+        {
+        }
+
+        /// Largest values of RGBM8 and RGBD8 formats, used both for encoding and decoding. Defaults are 8 and 255.
+        /// Ranges are not stored in files, shaders have to decode with the same ones. Loaders, samplers and other
+        /// operations on RGBM8 and RGBD8 images use the defaults, convert with imageConvert() first for other ranges.
+        float m_rgbmRange;
+        float m_rgbdRange;
+
+        /// Preset used by block encoders. Default is CompressionQuality::Fast.
+        CompressionQuality::Enum m_compressionQuality;
+
+        /// Order of data in saved Dds and Ktx files. Default is MipLayout::FileType. With other layouts every mip is a single
+        /// contiguous range of the file, a runtime streaming mips in reads ImageMipIndex and then any mip range with a single read.
+        /// Dds cubemaps and Ktx files with MipLayout::SmallestFirst are no longer laid out as the file type defines, readers
+        /// other than imageLoad() need the index. Single face Dds and any Ktx with MipLayout::LargestFirst stay valid files.
+        MipLayout::Enum m_mipLayout;
+
+        /// Tga files are saved Rle compressed, scanlines are encoded in parallel. Default is false.
+        bool m_tgaRle;
+    };
 
     ///
     void toRgba32f(float _rgba32f[4], TextureFormat::Enum _srcFormat, const void* _src);
 
     ///
-    void imageToRgba32f(Image& _dst, const Image& _src);
+    void imageToRgba32f(Image& _dst, const Image& _src, const ImageEncodeSettings* _settings = NULL);
 
     ///
-    void imageToRgba32f(Image& _image);
+    void imageToRgba32f(Image& _image, const ImageEncodeSettings* _settings = NULL);
 
     ///
     void fromRgba32f(void* _out, TextureFormat::Enum _format, const float _rgba32f[4]);
 
     ///
-    void imageFromRgba32f(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src);
+    void imageFromRgba32f(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src, const ImageEncodeSettings* _settings = NULL);
 
     ///
-    void imageFromRgba32f(Image& _image, TextureFormat::Enum _textureFormat);
+    void imageFromRgba32f(Image& _image, TextureFormat::Enum _textureFormat, const ImageEncodeSettings* _settings = NULL);
 
-    ///
-    void imageConvert(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src);
+    /// Converting to a block compressed format encodes blocks of all faces and mips in parallel.
+    /// BC6H and BC7 images are decoded when converted from, ETC2 and ASTC4X4 images can only be saved.
+    /// Channel reorders and adds/drops of 8 bit formats, and pairs of 16 bit, half, rgbe and rgb32f formats convert directly,
+    /// without an intermediate RGBA32F image. Results are the same as through RGBA32F.
+    /// Face transforms recorded by imageTransformDeferred() are applied in the same pass, _dst has none.
+    void imageConvert(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src, const ImageEncodeSettings* _settings = NULL);
 
-    ///
-    void imageConvert(Image& _image, TextureFormat::Enum _format);
+    /// Narrowing conversions of RGBA32F images are done in place and shrink the data buffer.
+    void imageConvert(Image& _image, TextureFormat::Enum _format, const ImageEncodeSettings* _settings = NULL);
 
     ///
     /// If requested format is the same as source, creates a reference to it (data ptr is the same, member variables are copied).
-    /// Otherwise creates a converted copy of the image.
+    /// Otherwise, or if _src has recorded face transforms, creates a converted copy of the image.
     /// If _dst is a reference to _src, function returns true.
     /// If _dst is a physical copy of _src, function returns false (data should be released with imageUnload()).
     ///
-    bool imageRefOrConvert(Image& _dst, TextureFormat::Enum _format, const Image& _src);
+    bool imageRefOrConvert(Image& _dst, TextureFormat::Enum _format, const Image& _src, const ImageEncodeSettings* _settings = NULL);
 
-    ///
+    /// Mip offsets of a Dds or Ktx file saved with a MipLayout other than FileType. Dds keeps it after image data, dwReserved1
+    /// of the header holds 'CMIX' in word 0 and the offset of the index in words 1 (low) and 2 (high). Ktx keeps it as the
+    /// value of key "cmftMipIndex". All fields are little endian, offsets are from the start of file data.
+    struct ImageMipIndex
+    {
+        uint32_t m_tag;                  //!< 'CMIX'.
+        uint32_t m_layout;               //!< MipLayout::Enum.
+        uint32_t m_numMips;
+        uint32_t m_numFaces;
+        uint64_t m_offsets[MAX_MIP_NUM]; //!< First byte of each mip, indexed by mip.
+        uint64_t m_sizes[MAX_MIP_NUM];   //!< Bytes of all faces of each mip. Ktx rows and faces are padded as in the file type.
+    };
+
+    /// Reads the mip index of a Dds or Ktx file. Returns false if the file has none.
+    bool imageGetMipIndex(ImageMipIndex& _index, const char* _filePath);
+
+    /// Converts a single texel, face and mip offsets are computed on every call. Use CubemapSampler for many lookups.
     void imageGetPixel(void* _out, TextureFormat::Enum _format, uint32_t _x, uint32_t _y, uint8_t _mip, uint8_t _face, const Image& _image);
 
-    /// Notice: only base image gets resized. Mipmaps are lost.
-    void imageResize(Image& _dst, uint32_t _width, uint32_t _height, const Image& _src);
+    struct SamplerFilter
+    {
+        enum Enum
+        {
+            Nearest,  //!< Nearest texel of the nearest mip.
+            Bilinear, //!< Face edges are clamped. Fractional lod blends two mips.
+            Seamless, //!< Bilinear, texels across face edges are read from neighbour faces.
+
+            Count
+        };
+    };
+
+    /// Random access cubemap sampling by direction. Mip offsets are computed once and texels are read as rgba32f.
+    struct CubemapSampler
+    {
+        const float* m_faces[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint32_t m_faceSize;
+        uint8_t m_numMips;
+        bool m_isRef;     //!< m_rgba32f references the source image.
+        Image m_rgba32f;
+    };
+
+    /// Rgba32f cubemaps are referenced and have to outlive the sampler, other formats are converted once.
+    bool cubemapSamplerInit(CubemapSampler& _sampler, const Image& _cubemap);
 
-    /// Notice: only base image gets resized. Mipmaps are lost.
-    void imageResize(Image& _image, uint32_t _width, uint32_t _height);
+    ///
+    void cubemapSamplerFree(CubemapSampler& _sampler);
 
+    /// _dir does not have to be normalized. _lod is the mip level, fractional lod blends two mips unless filter is Nearest.
+    void cubemapSamplerSample(float _rgba[4], const CubemapSampler& _sampler, const float _dir[3], float _lod = 0.0f, SamplerFilter::Enum _filter = SamplerFilter::Bilinear);
+
+    /// Samples _num directions of 3 floats into _rgba, 4 floats each, in parallel. With _lods NULL, base mip is sampled.
+    void cubemapSamplerSampleN(float* _rgba, const CubemapSampler& _sampler, const float* _dirs, const float* _lods, uint32_t _num, SamplerFilter::Enum _filter = SamplerFilter::Bilinear);
+
+    struct ResampleFilter
+    {
+        enum Enum
+        {
+            Box,
+            Triangle,
+            Lanczos,
+            Kaiser,
+
+            Count
+        };
+    };
+
+    struct ResizeMips
+    {
+        enum Enum
+        {
+            Drop,       //!< Only base image is resized.
+            Keep,       //!< Each source mip is resized to the matching destination mip size.
+            Regenerate, //!< Base image is resized and full mip chain is generated from it.
+
+            Count
+        };
+    };
+
+    /// Separable resize, rows are processed in parallel. Faces are resized independently, edges are clamped.
+    /// Notice: Lanczos and Kaiser kernels have negative lobes and can ring around very bright texels.
+    void imageResize(Image& _dst, uint32_t _width, uint32_t _height, const Image& _src, ResampleFilter::Enum _filter = ResampleFilter::Box, ResizeMips::Enum _mips = ResizeMips::Drop);
+
+    ///
+    void imageResize(Image& _image, uint32_t _width, uint32_t _height, ResampleFilter::Enum _filter = ResampleFilter::Box, ResizeMips::Enum _mips = ResizeMips::Drop);
+
+    /// Operations of each face are composed and applied in a single tiled pass, faces and rows are processed in parallel.
     /// Notice: because all transformations are done on data in place,
     /// rotations work properly only when image width == image height (which is true for cubemap images).
     /// Flip operations work properly regardless of aspect ratio.
 #define imageTransform(_image, ...) imageTransformUseMacroInstead(&(_image), __VA_ARGS__, UINT32_MAX)
     void imageTransformUseMacroInstead(Image* _image, ...);
 
-    ///
-    void imageGenerateMipMapChain(Image& _image, uint8_t _numMips=UINT8_MAX);
+    /// Records operations of imageTransform() with a cubemap instead of moving its data. Conversions, filters and savers read
+    /// faces through the recorded transforms, functions that work on faces as stored apply them first. Other images are transformed at once.
+#define imageTransformDeferred(_image, ...) imageTransformDeferredUseMacroInstead(&(_image), __VA_ARGS__, UINT32_MAX)
+    void imageTransformDeferredUseMacroInstead(Image* _image, ...);
+
+    /// Applies face transforms recorded by imageTransformDeferred() to image data.
+    void imageResolveFaceTransforms(Image& _image);
+
+    /// Generates missing mips up to _numMips, each one from its parent. Faces and rows are processed in parallel.
+    /// Rgba32f images that own their data are extended in place.
+    /// With _averageSeams, texels on shared cubemap edges and corners are averaged for every generated mip.
+    void imageGenerateMipMapChain(Image& _image, uint8_t _numMips = UINT8_MAX, ResampleFilter::Enum _filter = ResampleFilter::Box, bool _averageSeams = false);
 
     ///
     void imageApplyGamma(Image& _image, float _gammaPow);
 
+    struct PixelOp
+    {
+        enum Enum
+        {
+            Gamma, //!< Color channels are raised to m_value, alpha is kept.
+            Clamp, //!< All channels are clamped to [0.0-1.0] range.
+
+            Count
+        };
+    };
+
+    struct ImagePixelOp
+    {
+        PixelOp::Enum m_op;
+        float m_value;
+    };
+
+    /// Applies _ops in order and converts to _format in a single parallel pass. Pixels are decoded into rgba32f in small chunks,
+    /// so intermediate results are neither stored nor quantized to the source format. Block compressed formats are encoded afterwards.
+    void imageApplyPixelOps(Image& _dst, TextureFormat::Enum _format, const Image& _src, const ImagePixelOp* _ops, uint8_t _numOps, const ImageEncodeSettings* _settings = NULL);
+
+    /// Done in place when _format is not wider than the image format.
+    void imageApplyPixelOps(Image& _image, TextureFormat::Enum _format, const ImagePixelOp* _ops, uint8_t _numOps, const ImageEncodeSettings* _settings = NULL);
+
     ///
     void imageClamp(Image& _dst, const Image& _src);
 
@@ -234,7 +468,7 @@ namespace cmft
     bool imageValidCubemapFaceList(const Image _faceList[6]);
 
     ///
-    bool imageIsCubeCross(Image& _image);
+    bool imageIsCubeCross(const Image& _image);
 
     ///
     bool imageCubemapFromCross(Image& _dst, const Image& _src);
@@ -242,18 +476,40 @@ namespace cmft
     ///
     void imageCubemapFromCross(Image& _image);
 
-    ///
+    /// Sources in formats other than rgba32f, including mapped ones, are converted a band of rows at a time, without a converted copy of the whole source.
     bool imageCubemapFromLatLong(Image& _dst, const Image& _src, bool _useBilinearInterpolation = true);
 
     ///
     void imageCubemapFromLatLong(Image& _image, bool _useBilinearInterpolation = true);
 
+    /// Converts latlong Hdr file to rgba32f cubemap while decoding it, only a band of _bandRows source rows is kept in memory.
+    /// Result is the same as imageLoad() to RGBA32F followed by imageCubemapFromLatLong(). Returns false if the file is not a latlong Hdr.
+    bool imageCubemapFromLatLongHdr(Image& _dst, const char* _filePath, bool _useBilinearInterpolation = true, uint32_t _bandRows = 0);
+
+    /// Same as imageCubemapFromLatLongHdr() for Exr files. File is mapped and chunks are decoded a band at a time, so it
+    /// returns false where files can not be mapped. Also returns false if the file is not a latlong Exr or if decoding
+    /// fails, imageLoad() then reports what is wrong with it.
+    bool imageCubemapFromLatLongExr(Image& _dst, const char* _filePath, bool _useBilinearInterpolation = true, uint32_t _bandRows = 0);
+
     ///
     bool imageLatLongFromCubemap(Image& _dst, const Image& _src, bool _useBilinearInterpolation = true);
 
     ///
     void imageLatLongFromCubemap(Image& _cubemap, bool _useBilinearInterpolation = true);
 
+    /// Resamples cubemap into an octahedral map, see vecFromOctahedral() in cubemaputils.h. Map is square, twice the face size,
+    /// with a mip for each mip of the cubemap. For filtered maps, imageRadianceFilterOctahedral() and imageIrradianceFilterShOctahedral()
+    /// evaluate octahedral texels directly instead.
+    bool imageOctahedralFromCubemap(Image& _dst, const Image& _src, bool _useBilinearInterpolation = true);
+
+    ///
+    void imageOctahedralFromCubemap(Image& _cubemap, bool _useBilinearInterpolation = true);
+
+    /// Caches source texels and bilinear weights of imageCubemapFromLatLong(), imageCubemapFromLatLongHdr(), imageCubemapFromLatLongExr() and imageLatLongFromCubemap(),
+    /// per source and destination size. Repeated conversions of the same size then only gather texels.
+    /// Tables take 20 bytes per destination texel, least recently used ones are dropped above _maxBytes. 0 disables caching (default).
+    void imageSetRemapCacheSize(uint64_t _maxBytes);
+
     ///
     bool imageHStripFromCubemap(Image& _dst, const Image& _src);
 
@@ -278,11 +534,236 @@ namespace cmft
     ///
     void imageCrossFromCubemap(Image& _image, bool _vertical = true);
 
+    struct CubemapPattern
+    {
+        enum Enum
+        {
+            Gradient,    //!< Smooth sky gradient.
+            Noise,       //!< Uncorrelated texels, the worst case for resampling.
+            SunDisk,     //!< Sky gradient with a small very bright sun disk.
+            MostlyBlack, //!< Black except for the sun disk.
+            Spike,       //!< Dim constant with a single very bright 2x2 texel block on +y face.
+            Constant,    //!< Filtered result has to be the same constant.
+
+            Count
+        };
+    };
+
+    ///
+    const char* getCubemapPatternStr(CubemapPattern::Enum _pattern);
+
+    /// Creates a single mip procedural cubemap of _faceSize faces in _format, for benchmarks and tests that need inputs of any size.
+    /// _seed changes the noise pattern. Rows are generated in parallel and converted as they are generated, except for block
+    /// compressed formats, which are encoded from a whole rgba32f cubemap.
+    bool imageCubemapFromPattern(Image& _dst, CubemapPattern::Enum _pattern, uint32_t _faceSize, TextureFormat::Enum _format = TextureFormat::RGBA32F, uint32_t _seed = 0);
+
+    /// Read-only view of the six faces of a cubemap, cube cross or hstrip image, referencing the image data in place.
+    /// Row _y of face _f in mip _m starts at m_data + m_offsets[_f][_m] + _y*m_pitch[_f][_m]. Pitch is negative for faces stored upside down.
+    /// Faces with m_flipX set are stored mirrored, texel _x of their row is found at column mipSize-1-_x.
+    /// Recorded face flips of a cubemap are viewed the same way, recorded rotations can not be viewed.
+    struct ImageView
+    {
+        ImageView()
+            : m_data(NULL)
+            , m_faceSize(0)
+            , m_format(TextureFormat::Unknown)
+            , m_numMips(0)
+        {
+        }
+
+        const void* m_data;
+        uint64_t m_offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        int64_t m_pitch[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint32_t m_faceSize;
+        TextureFormat::Enum m_format;
+        uint8_t m_numMips;
+        bool m_flipX[CUBE_FACE_NUM];
+    };
+
+    ///
+    bool imageViewFromCubemap(ImageView& _view, const Image& _cubemap);
+
+    /// Views cubemap data stored in _data as _layout of _cubemap, such as a copy with aligned rows made by imageCopyToLayout().
+    /// Only the description of _cubemap is used, its own data is not read.
+    bool imageViewFromLayout(ImageView& _view, const void* _data, const ImageLayout& _layout, const Image& _cubemap);
+
+    /// Views faces of a vertical (3:4) or horizontal (4:3) cube cross. -Z face of vertical cross is viewed rotated by 180 degrees,
+    /// the same way imageCubemapFromCross() stores it.
+    bool imageViewFromCross(ImageView& _view, const Image& _cross);
+
     ///
-    bool imageLoad(Image& _image, const char* _filePath, TextureFormat::Enum _convertTo = TextureFormat::Unknown);
+    bool imageViewFromHStrip(ImageView& _view, const Image& _hstrip);
+
+    /// Views cubemap, hstrip or cube cross image, whichever _image is. Returns false for any other layout.
+    bool imageViewFromImage(ImageView& _view, const Image& _image);
+
+    /// Number of whole _tileWidth x _tileHeight tiles in _atlas.
+    uint32_t imageAtlasNumTiles(const Image& _atlas, uint32_t _tileWidth, uint32_t _tileHeight);
+
+    /// Views base mip faces of tile _tileIdx of an atlas, a grid of _tileWidth x _tileHeight hstrip or cube cross tiles numbered
+    /// row by row. Tiles are read in place. Returns false if the tile is outside of the atlas or has neither layout.
+    bool imageViewFromAtlasTile(ImageView& _view, const Image& _atlas, uint32_t _tileIdx, uint32_t _tileWidth, uint32_t _tileHeight);
+
+    /// Returns pointer to the first texel of row _y in memory, see ImageView.
+    const void* imageViewGetRow(const ImageView& _view, uint8_t _face, uint8_t _mip, uint32_t _y);
+
+    /// Gathers viewed faces into a cubemap in _format. Layout and format are converted in a single pass over the source.
+    bool imageFromView(Image& _dst, const ImageView& _view, TextureFormat::Enum _format);
+
+    /// Image data is decoded straight into _convertTo format, without keeping a copy in the file format.
+    /// BC1 to BC7 blocks of Dds and Ktx files are decoded in parallel. Without _convertTo, BC6H and BC7 stay compressed
+    /// and BC1 to BC5, which have no TextureFormat, are decoded into RGBA32F.
+    /// With _mapFile, Dds files and single mip Ktx files are memory mapped instead of read, which avoids a copy when no conversion is needed.
+    /// Mapping is copy-on-write, but the file must not be truncated or overwritten while the image is loaded.
+    bool imageLoad(Image& _image, const char* _filePath, TextureFormat::Enum _convertTo = TextureFormat::Unknown, bool _mapFile = false);
+
+    /// Part of a file loaded by imageLoad(). Dds and Ktx loaders seek past mips and faces outside of it, they are not read or
+    /// converted. Other file types are loaded whole and cut down afterwards.
+    struct ImageLoadRange
+    {
+        ImageLoadRange()
+            : m_firstMip(0)
+            , m_numMips(UINT8_MAX)
+            , m_faceMask(0x3f)
+        {
+        }
+
+        uint8_t m_firstMip; //!< Becomes mip 0 of the loaded image.
+        uint8_t m_numMips;  //!< Clamped to mips available from m_firstMip on.
+        uint8_t m_faceMask; //!< Bit per cubemap face, faces left out are black in the loaded image. Ignored for other images.
+    };
+
+    /// Loads mips and faces in _range only, see ImageLoadRange. Fails if the file has no mip _range.m_firstMip.
+    /// Mapping is only used when _range covers the whole file.
+    bool imageLoad(Image& _image, const char* _filePath, const ImageLoadRange& _range, TextureFormat::Enum _convertTo = TextureFormat::Unknown, bool _mapFile = false);
+
+    /// Loads image from _size bytes of file data at _data, any file type imageLoad() reads. _data is only read during the call.
+    bool imageLoadFromMemory(Image& _image, const void* _data, size_t _size, TextureFormat::Enum _convertTo = TextureFormat::Unknown);
+
+    /// Loads image from _reader, whose position 0 has to be the beginning of file data. Data is always copied, mapping needs imageLoad() with a file path.
+    bool imageLoad(Image& _image, Reader& _reader, TextureFormat::Enum _convertTo = TextureFormat::Unknown);
+
+    /// Loads six face images concurrently into a cubemap, faces ordered as in imageCubemapFromFaceList(). Each face decodes
+    /// straight into its part of the cubemap data. With _convertTo Unknown, faces in other formats than the first one are
+    /// converted to it, or all faces to RGBA32F if the first one is block compressed. Fails if faces are not of the same size.
+    bool imageCubemapLoadFaceList(Image& _cubemap, const char* const _filePaths[6], TextureFormat::Enum _convertTo = TextureFormat::Unknown);
+
+    /// With _writeBehind and write-behind output started, the file is encoded into memory and queued for the I/O thread.
+    bool imageSave(const Image& _image, const char* _fileName, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo = TextureFormat::Unknown, bool _writeBehind = true, const ImageEncodeSettings* _settings = NULL);
+
+    /// Writes _image as a file of type _ft to _writer, starting at its current position.
+    bool imageSave(const Image& _image, Writer& _writer, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo = TextureFormat::Unknown, const ImageEncodeSettings* _settings = NULL);
+
+    /// Encodes _image as a file of type _ft into a new buffer, returned in _data and _size. Buffer is owned by the caller and released with free().
+    bool imageSaveToMemory(void*& _data, size_t& _size, const Image& _image, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo = TextureFormat::Unknown, const ImageEncodeSettings* _settings = NULL);
+
+    /// Starts write-behind output. imageSave() then returns once the file is queued, a background I/O thread writes each file
+    /// with a single large write. imageSave() blocks only while more than _maxQueuedBytes are waiting to be written.
+    /// Write errors are reported by imageSaveWriteBehindFlush() and imageSaveWriteBehindEnd(). Returns false if not supported (Windows).
+    bool imageSaveWriteBehindBegin(uint64_t _maxQueuedBytes = UINT64_C(512)<<20);
+
+    /// Blocks until all queued files are written. Returns false if writing any of them failed.
+    bool imageSaveWriteBehindFlush();
+
+    /// Flushes queued files and stops the I/O thread.
+    bool imageSaveWriteBehindEnd();
+
+    /// Returns number of array elements in Dds (dxt10 array size) or Ktx (number of array elements) file, 1 for any other file and 0 if it can not be opened.
+    uint32_t imageGetArraySize(const char* _filePath);
+
+    /// Reads base mip size, number of mips and faces from the header of Dds, Ktx or Ktx2 file, without loading image data.
+    /// Returns false for other files.
+    bool imageGetMipChainInfo(uint32_t& _width, uint32_t& _height, uint8_t& _numMips, uint8_t& _numFaces, const char* _filePath);
+
+    /// Loads a single cubemap or image of an array file. Elements are loaded independently, see imageLoad().
+    bool imageLoadArrayElement(Image& _image, const char* _filePath, uint32_t _element, TextureFormat::Enum _convertTo = TextureFormat::Unknown, bool _mapFile = false);
+
+    /// Loads up to _maxImages elements of an array file into _images, ready for imageRadianceFilterBatch(). Returns the number of loaded elements.
+    uint32_t imageLoadArray(Image* _images, uint32_t _maxImages, const char* _filePath, TextureFormat::Enum _convertTo = TextureFormat::Unknown);
+
+    /// Loads a single mip of Ktx2 file as a single mip image. Only that mip is read and decompressed, using the Ktx2 level index.
+    bool imageLoadKtx2Mip(Image& _image, const char* _filePath, uint8_t _mip, TextureFormat::Enum _convertTo = TextureFormat::Unknown);
+
+    /// Streams images into a single Dds or Ktx array file. Elements can be written in any order as they are finished,
+    /// each one is written straight to its place in the file. Header is written with the first element, following elements
+    /// must have the same size, format, mip and face count. Calls are not synchronized.
+    struct ImageArrayWriter
+    {
+        ImageArrayWriter()
+            : m_fp(NULL)
+            , m_fileType(ImageFileType::DDS)
+            , m_numElements(0)
+            , m_numWritten(0)
+            , m_written(NULL)
+            , m_dataOffset(0)
+            , m_dataEnd(0)
+        {
+        }
+
+        FILE* m_fp;
+        ImageFileType::Enum m_fileType;
+        uint32_t m_numElements;
+        uint32_t m_numWritten;
+        uint8_t* m_written; //!< One flag per element.
+        Image m_layout;     //!< Layout of the first written element, without data.
+        int64_t m_dataOffset;
+        int64_t m_dataEnd;
+    };
 
     ///
-    bool imageSave(const Image& _image, const char* _fileName, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo = TextureFormat::Unknown);
+    bool imageArrayWriterOpen(ImageArrayWriter& _writer, const char* _fileName, ImageFileType::Enum _ft, uint32_t _numElements);
+
+    /// Writes _image as element _element. _image must already be in a format valid for the file type.
+    bool imageArrayWriterWrite(ImageArrayWriter& _writer, uint32_t _element, const Image& _image);
+
+    /// Closes the file. Returns false if some elements were not written, those are left zeroed.
+    bool imageArrayWriterClose(ImageArrayWriter& _writer);
+
+    /// Writes a Dds or Ktx file face by face, without holding the image in memory. File is created at its final size with the
+    /// final header when opened and mapped where files can be mapped (CMFT_IMAGE_MMAP), each face is converted and copied straight
+    /// to its place. Faces can be written in any order, e.g. from FilterProgress::m_faceCallback as they get filtered.
+    /// Faces written from several threads at once have to be different ones. Without mapping, calls are not synchronized.
+    /// Files are always in MipLayout::FileType, ImageEncodeSettings::m_mipLayout is ignored.
+    struct ImageMappedWriter
+    {
+        ImageMappedWriter()
+            : m_fp(NULL)
+            , m_data(NULL)
+            , m_fileSize(0)
+            , m_fileType(ImageFileType::DDS)
+            , m_failed(false)
+        {
+        }
+
+        FILE* m_fp;
+        uint8_t* m_data;     //!< Mapping of the whole file, NULL if the file is not mapped.
+        uint64_t m_fileSize;
+        ImageFileType::Enum m_fileType;
+        Image m_layout;      //!< Size, format, mip and face count of the file, without data.
+        ImageEncodeSettings m_settings; //!< Faces are converted with these.
+        ImageLayout m_faceLayout; //!< Rows of faces, padded as the file type requires.
+        uint64_t m_faceOffsets[CUBE_FACE_NUM][MAX_MIP_NUM]; //!< File offsets of faces.
+        uint8_t m_written[CUBE_FACE_NUM][MAX_MIP_NUM];
+        volatile bool m_failed;
+    };
+
+    /// Creates _fileName for an image of _width x _height with _numMips mips and _numFaces faces in _format, which has to be valid for _ft.
+    bool imageMappedWriterOpen(ImageMappedWriter& _writer
+                             , const char* _fileName
+                             , ImageFileType::Enum _ft
+                             , TextureFormat::Enum _format
+                             , uint32_t _width
+                             , uint32_t _height
+                             , uint8_t _numMips
+                             , uint8_t _numFaces = CUBE_FACE_NUM
+                             , const ImageEncodeSettings* _settings = NULL
+                             );
+
+    /// Writes face _face of mip _mip from _image, a single face of the mip size. It is converted to the file format if it differs.
+    bool imageMappedWriterFace(ImageMappedWriter& _writer, uint8_t _mip, uint8_t _face, const Image& _image);
+
+    /// Unmaps and closes the file. Returns false if writing failed or some faces were not written, those are left zeroed.
+    bool imageMappedWriterClose(ImageMappedWriter& _writer);
 
 } // namespace cmft
 
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_JOBSYSTEM_H_HEADER_GUARD
+#define CMFT_JOBSYSTEM_H_HEADER_GUARD
+
+#include <stdint.h> //uint32_t
+#include <stddef.h> //NULL
+
+#include <bx/bx.h>
+#include <bx/sem.h>
+
+namespace cmft
+{
+    typedef void (*JobFn)(void* _userData, uint32_t _taskIdx);
+
+    /// Tasks dispatched together. Wait on it with JobSystem::wait().
+    struct JobGroup
+    {
+        JobGroup()
+            : m_handle(NULL)
+            , m_pending(0)
+        {
+        }
+
+        void* m_handle;       //!< Free for JobSystem implementations, NULL until the first dispatch to the group.
+        uint32_t m_pending;   //!< Internal thread pool only.
+        bx::Semaphore m_done; //!< Internal thread pool only.
+    };
+
+    /// Runs all parallel work of cmft: radiance tiles, SH reductions, image conversions and output saving.
+    /// Host applications with a scheduler of their own (TBB, enkiTS, ...) implement it and install it with setJobSystem(),
+    /// otherwise cmft runs its own thread pool. Implementations have to be thread safe, tasks dispatch and wait for other tasks.
+    /// Tasks of a group never wait for each other, running them one after another on a single thread is valid, just slower.
+    struct JobSystem
+    {
+        virtual ~JobSystem() = 0;
+
+        /// Threads that run tasks besides the one calling wait(). Parallel loops are split into this many ranges plus one.
+        virtual uint16_t getNumThreads() = 0;
+
+        /// Hint that up to _numThreads tasks are about to run at once, e.g. a radiance CPU thread each. Nothing by default.
+        virtual void reserve(uint16_t _numThreads)
+        {
+            BX_UNUSED(_numThreads);
+        }
+
+        /// Queues _fn(_userData, taskIdx) for taskIdx in [0, _numTasks) to _group. A group can be dispatched to several times
+        /// before it is waited for.
+        virtual void dispatch(JobGroup& _group, JobFn _fn, void* _userData, uint32_t _numTasks) = 0;
+
+        /// Blocks until all tasks of _group are done. Group can be reused or destroyed afterwards.
+        virtual void wait(JobGroup& _group) = 0;
+
+        /// Dispatches _numTasks tasks and waits for them.
+        void run(JobFn _fn, void* _userData, uint32_t _numTasks)
+        {
+            JobGroup group;
+            dispatch(group, _fn, _userData, _numTasks);
+            wait(group);
+        }
+    };
+
+    inline JobSystem::~JobSystem()
+    {
+    }
+
+    /// Sets job system used by all cmft calls. NULL restores the internal thread pool.
+    /// Has to be set while no cmft call is running, and has to outlive cmft calls using it.
+    void setJobSystem(JobSystem* _jobSystem);
+
+    /// Returns job system set by setJobSystem(), otherwise the internal thread pool, which is started on first use.
+    JobSystem* getJobSystem();
+
+} // namespace cmft
+
+#endif //CMFT_JOBSYSTEM_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
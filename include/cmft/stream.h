@@ -0,0 +1,140 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_STREAM_H_HEADER_GUARD
+#define CMFT_STREAM_H_HEADER_GUARD
+
+#include <stdio.h>  //FILE, SEEK_SET
+#include <stdint.h> //int64_t
+#include <stddef.h> //size_t
+
+namespace cmft
+{
+    /// Source of file data for image loaders. Loaders read mostly sequentially and seek within headers and between mips.
+    struct Reader
+    {
+        virtual ~Reader() = 0;
+
+        /// Reads up to _size bytes at the current position. Returns number of bytes read, less than _size at the end or on error.
+        virtual size_t read(void* _data, size_t _size) = 0;
+
+        /// Moves current position to _offset relative to _origin, which is SEEK_SET, SEEK_CUR or SEEK_END.
+        virtual bool seek(int64_t _offset, int _origin) = 0;
+
+        ///
+        virtual int64_t tell() = 0;
+
+        /// Reads exactly _size bytes at _offset without moving the current position. Only called if canReadAt() returns true,
+        /// then it has to be safe to call from several threads at once.
+        virtual bool readAt(void* _data, size_t _size, uint64_t _offset);
+
+        /// Default implementation returns false.
+        virtual bool canReadAt() const;
+
+        /// Checked by loaders with CMFT_ENABLE_FILE_ERROR_CHECK.
+        virtual bool isError() const;
+
+        /// File behind the reader, NULL if there is none. Dds and Ktx loaders map it when mapping is requested.
+        virtual FILE* getFile();
+    };
+
+    inline Reader::~Reader()
+    {
+    }
+
+    /// Destination of image savers. Savers write sequentially, seek() is there for writers patching data written earlier.
+    struct Writer
+    {
+        virtual ~Writer() = 0;
+
+        /// Writes _size bytes at the current position. Returns number of bytes written, less than _size on error.
+        virtual size_t write(const void* _data, size_t _size) = 0;
+
+        /// Moves current position to _offset relative to _origin, which is SEEK_SET, SEEK_CUR or SEEK_END.
+        virtual bool seek(int64_t _offset, int _origin) = 0;
+
+        ///
+        virtual int64_t tell() = 0;
+
+        /// Checked by savers with CMFT_ENABLE_FILE_ERROR_CHECK.
+        virtual bool isError() const;
+    };
+
+    inline Writer::~Writer()
+    {
+    }
+
+    /// Reads from a file opened for reading. File is not closed by the reader.
+    /// Positional reads use pread() where available, they don't disturb the position of the file.
+    struct FileReader : public Reader
+    {
+        FileReader(FILE* _fp);
+
+        virtual size_t read(void* _data, size_t _size);
+        virtual bool seek(int64_t _offset, int _origin);
+        virtual int64_t tell();
+        virtual bool readAt(void* _data, size_t _size, uint64_t _offset);
+        virtual bool canReadAt() const;
+        virtual bool isError() const;
+        virtual FILE* getFile();
+
+        FILE* m_fp;
+    };
+
+    /// Reads from _size bytes at _data. Memory is not copied, it has to stay valid while the reader is used.
+    struct MemoryReader : public Reader
+    {
+        MemoryReader(const void* _data, size_t _size);
+
+        virtual size_t read(void* _data, size_t _size);
+        virtual bool seek(int64_t _offset, int _origin);
+        virtual int64_t tell();
+        virtual bool readAt(void* _data, size_t _size, uint64_t _offset);
+        virtual bool canReadAt() const;
+
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_pos;
+    };
+
+    /// Writes to a file opened for writing. File is not closed by the writer.
+    struct FileWriter : public Writer
+    {
+        FileWriter(FILE* _fp);
+
+        virtual size_t write(const void* _data, size_t _size);
+        virtual bool seek(int64_t _offset, int _origin);
+        virtual int64_t tell();
+        virtual bool isError() const;
+
+        FILE* m_fp;
+    };
+
+    /// Writes to a growing buffer allocated with malloc(). Seeking past the end and writing there fills the gap with zeros.
+    struct MemoryWriter : public Writer
+    {
+        MemoryWriter();
+        virtual ~MemoryWriter();
+
+        virtual size_t write(const void* _data, size_t _size);
+        virtual bool seek(int64_t _offset, int _origin);
+        virtual int64_t tell();
+        virtual bool isError() const;
+
+        /// Hands written data over to the caller, who releases it with free(). Writer is empty afterwards.
+        void* release(size_t& _size);
+
+        uint8_t* m_data;
+        size_t m_size;
+        size_t m_capacity;
+        size_t m_pos;
+        bool m_error; //!< Set when growing the buffer failed.
+    };
+
+} // namespace cmft
+
+#endif //CMFT_STREAM_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
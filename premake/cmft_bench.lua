@@ -0,0 +1,67 @@
+--
+-- Copyright 2014 Dario Manesku. All rights reserved.
+-- License: http://www.opensource.org/licenses/BSD-2-Clause
+--
+
+function cmftBenchProject(_cmftDir, _bxDir)
+
+    local CMFT_INCLUDE_DIR   = (_cmftDir .. "include/")
+    local CMFT_SRC_DIR       = (_cmftDir .. "src/cmft/")
+    local CMFT_BENCH_SRC_DIR = (_cmftDir .. "src/cmft_bench/")
+    local CMFT_RUNTIME_DIR   = (_cmftDir .. "runtime/")
+
+    local BX_INCLUDE_DIR    = (_bxDir .. "include/")
+    local BX_THIRDPARTY_DIR = (_bxDir .. "3rdparty/")
+
+    project "cmft_bench"
+        uuid("b5d1c3a4-6f27-4e0b-9a8c-3d2e71f05c19")
+        kind "ConsoleApp"
+
+        targetname ("cmft_bench")
+
+        links { "cmft" }
+
+        configuration { "*gcc*" }
+            links { "dl" }
+            links { "pthread" }
+
+        configuration { "vs*" }
+            buildoptions
+            {
+                "/wd 4127" -- disable 'conditional expression is constant' for do {} while(0)
+            }
+
+        configuration { "Debug" }
+            defines
+            {
+                "CMFT_CONFIG_DEBUG=1",
+            }
+
+        configuration { "Release" }
+            defines
+            {
+                "CMFT_CONFIG_DEBUG=0",
+            }
+
+        configuration {}
+
+        debugdir (CMFT_RUNTIME_DIR)
+
+        files
+        {
+            CMFT_BENCH_SRC_DIR .. "**.h",
+            CMFT_BENCH_SRC_DIR .. "**.cpp",
+        }
+
+        includedirs
+        {
+            BX_INCLUDE_DIR,
+            CMFT_SRC_DIR,
+            (_cmftDir .. "src/"),
+            CMFT_INCLUDE_DIR,
+            BX_THIRDPARTY_DIR,
+        }
+
+end -- cmftBenchProject
+
+-- vim: set sw=4 ts=4 expandtab:
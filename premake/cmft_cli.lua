@@ -58,6 +58,12 @@ function cmftCliProject(_cmftDir, _bxDir)
             CMFT_INCLUDE_DIR .. "**.h",
         }
 
+        excludes
+        {
+            CMFT_CLI_SRC_DIR .. "cmft_bench/**",
+            CMFT_CLI_SRC_DIR .. "tests/**.cpp",
+        }
+
         includedirs
         {
             BX_INCLUDE_DIR,
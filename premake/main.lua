@@ -26,12 +26,23 @@ compat(BX_DIR)
 dofile "cmft_cli.lua"
 cmftCliProject(CMFT_DIR, BX_DIR)
 compat(BX_DIR)
+strip()
+
+-- cmft_bench project.
+dofile "cmft_bench.lua"
+cmftBenchProject(CMFT_DIR, BX_DIR)
+compat(BX_DIR)
+strip()
+
+-- cmft_tests project.
+dofile "cmft_tests.lua"
+cmftTestsProject(CMFT_DIR, BX_DIR)
+compat(BX_DIR)
+strip()
 
 -- cmft project.
 dofile "cmft.lua"
 cmftProject(CMFT_DIR, BX_DIR)
 compat(BX_DIR)
 
-strip()
-
 -- vim: set sw=4 ts=4 expandtab:
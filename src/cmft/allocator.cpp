@@ -0,0 +1,638 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "cmft/allocator.h"
+
+#include "base/config.h"
+#include "messages.h"
+
+#include <stdio.h>
+#include <stdlib.h> //malloc
+#include <string.h> //memcpy
+
+#include <bx/macros.h> //BX_THREAD
+#include <bx/platform.h>
+
+#if BX_PLATFORM_WINDOWS
+#   include <windows.h>
+#elif BX_PLATFORM_LINUX
+#   include <sys/mman.h>
+#endif // BX_PLATFORM_
+
+namespace cmft
+{
+    struct CrtAllocator : public Allocator
+    {
+        virtual void* alloc(size_t _size)
+        {
+            return ::malloc(_size);
+        }
+
+        virtual void* realloc(void* _ptr, size_t _size)
+        {
+            return ::realloc(_ptr, _size);
+        }
+
+        virtual void free(void* _ptr)
+        {
+            ::free(_ptr);
+        }
+    };
+
+    static CrtAllocator s_crtAllocator;
+    static Allocator* s_allocator = &s_crtAllocator;
+    static BX_THREAD Allocator* s_threadAllocator = NULL;
+
+    Allocator* getCrtAllocator()
+    {
+        return &s_crtAllocator;
+    }
+
+    void setAllocator(Allocator* _allocator)
+    {
+        s_allocator = (NULL != _allocator) ? _allocator : &s_crtAllocator;
+    }
+
+    Allocator* getAllocator()
+    {
+        return (NULL != s_threadAllocator) ? s_threadAllocator : s_allocator;
+    }
+
+    AllocatorScope::AllocatorScope(Allocator* _allocator)
+        : m_prev(s_threadAllocator)
+    {
+        s_threadAllocator = _allocator;
+    }
+
+    AllocatorScope::~AllocatorScope()
+    {
+        s_threadAllocator = m_prev;
+    }
+
+    // Allocation tags.
+    //-----
+
+    static const char* s_allocTagStr[AllocTag::Count] =
+    {
+        "Other",
+        "SourceCopy",
+        "NormalTable",
+        "MipChain",
+        "Conversion",
+        "IoBuffer",
+    };
+
+    static BX_THREAD uint8_t s_threadAllocTag = AllocTag::Other;
+
+    const char* getAllocTagStr(AllocTag::Enum _tag)
+    {
+        return s_allocTagStr[_tag];
+    }
+
+    AllocTag::Enum getAllocTag()
+    {
+        return (AllocTag::Enum)s_threadAllocTag;
+    }
+
+    AllocTagScope::AllocTagScope(AllocTag::Enum _tag, bool _weak)
+        : m_prev((AllocTag::Enum)s_threadAllocTag)
+    {
+        if (!_weak
+        ||  AllocTag::Other == s_threadAllocTag)
+        {
+            s_threadAllocTag = uint8_t(_tag);
+        }
+    }
+
+    AllocTagScope::~AllocTagScope()
+    {
+        s_threadAllocTag = uint8_t(m_prev);
+    }
+
+    void* allocTagged(size_t _size, AllocTag::Enum _tag)
+    {
+        AllocTagScope tag(_tag);
+        return getAllocator()->alloc(_size);
+    }
+
+    void* allocScratch(size_t _size, AllocTag::Enum _tag)
+    {
+        AllocTagScope tag(_tag, true);
+        return s_allocator->alloc(_size);
+    }
+
+    void freeScratch(void* _ptr)
+    {
+        s_allocator->free(_ptr);
+    }
+
+    // TrackingAllocator.
+    //-----
+
+    // Header in front of every buffer, padded so that alignment of the parent allocator is kept.
+    struct TrackingHeader
+    {
+        uint64_t m_size;
+        uint32_t m_tag;
+    };
+
+    #define CMFT_TRACKING_HEADER_SIZE 64
+
+    TrackingAllocator::TrackingAllocator(Allocator* _parent)
+        : m_parent((NULL != _parent) ? _parent : &s_crtAllocator)
+    {
+    }
+
+    static inline void trackingAdd(MemoryStats& _stats, uint32_t _tag, uint64_t _size)
+    {
+        _stats.m_currentBytes += _size;
+        _stats.m_peakBytes = (_stats.m_currentBytes > _stats.m_peakBytes) ? _stats.m_currentBytes : _stats.m_peakBytes;
+        _stats.m_tagCurrentBytes[_tag] += _size;
+        _stats.m_tagPeakBytes[_tag] = (_stats.m_tagCurrentBytes[_tag] > _stats.m_tagPeakBytes[_tag]) ? _stats.m_tagCurrentBytes[_tag] : _stats.m_tagPeakBytes[_tag];
+    }
+
+    static inline void trackingSub(MemoryStats& _stats, uint32_t _tag, uint64_t _size)
+    {
+        _stats.m_currentBytes -= _size;
+        _stats.m_tagCurrentBytes[_tag] -= _size;
+    }
+
+    void* TrackingAllocator::alloc(size_t _size)
+    {
+        uint8_t* mem = (uint8_t*)m_parent->alloc(CMFT_TRACKING_HEADER_SIZE + _size);
+        if (NULL == mem)
+        {
+            return NULL;
+        }
+
+        TrackingHeader* header = (TrackingHeader*)mem;
+        header->m_size = _size;
+        header->m_tag = s_threadAllocTag;
+
+        bx::MutexScope lock(m_mutex);
+        trackingAdd(m_stats, header->m_tag, _size);
+        m_stats.m_numAllocs++;
+        m_stats.m_tagNumAllocs[header->m_tag]++;
+
+        return mem + CMFT_TRACKING_HEADER_SIZE;
+    }
+
+    void* TrackingAllocator::realloc(void* _ptr, size_t _size)
+    {
+        if (NULL == _ptr)
+        {
+            return alloc(_size);
+        }
+
+        // Buffer keeps the tag it was allocated with.
+        uint8_t* mem = (uint8_t*)_ptr - CMFT_TRACKING_HEADER_SIZE;
+        const TrackingHeader prev = *(const TrackingHeader*)mem;
+
+        mem = (uint8_t*)m_parent->realloc(mem, CMFT_TRACKING_HEADER_SIZE + _size);
+        if (NULL == mem)
+        {
+            return NULL;
+        }
+
+        TrackingHeader* header = (TrackingHeader*)mem;
+        header->m_size = _size;
+
+        bx::MutexScope lock(m_mutex);
+        trackingSub(m_stats, prev.m_tag, prev.m_size);
+        trackingAdd(m_stats, prev.m_tag, _size);
+
+        return mem + CMFT_TRACKING_HEADER_SIZE;
+    }
+
+    void TrackingAllocator::free(void* _ptr)
+    {
+        if (NULL == _ptr)
+        {
+            return;
+        }
+
+        uint8_t* mem = (uint8_t*)_ptr - CMFT_TRACKING_HEADER_SIZE;
+        const TrackingHeader header = *(const TrackingHeader*)mem;
+        m_parent->free(mem);
+
+        bx::MutexScope lock(m_mutex);
+        trackingSub(m_stats, header.m_tag, header.m_size);
+    }
+
+    void TrackingAllocator::getStats(MemoryStats& _stats) const
+    {
+        bx::MutexScope lock(m_mutex);
+        _stats = m_stats;
+    }
+
+    void TrackingAllocator::resetStats()
+    {
+        bx::MutexScope lock(m_mutex);
+        m_stats.m_peakBytes = m_stats.m_currentBytes;
+        m_stats.m_numAllocs = 0;
+        for (uint8_t ii = 0; ii < AllocTag::Count; ++ii)
+        {
+            m_stats.m_tagPeakBytes[ii] = m_stats.m_tagCurrentBytes[ii];
+            m_stats.m_tagNumAllocs[ii] = 0;
+        }
+    }
+
+    void TrackingAllocator::printStats() const
+    {
+        MemoryStats stats;
+        getStats(stats);
+
+        const double toMiB = 1.0/(1024.0*1024.0);
+        INFO("Memory -> Peak %.2f MiB, current %.2f MiB, %llu allocations."
+            , double(stats.m_peakBytes)*toMiB
+            , double(stats.m_currentBytes)*toMiB
+            , (unsigned long long)stats.m_numAllocs
+            );
+
+        for (uint8_t ii = 0; ii < AllocTag::Count; ++ii)
+        {
+            if (0 != stats.m_tagNumAllocs[ii]
+            ||  0 != stats.m_tagPeakBytes[ii])
+            {
+                INFO("\t[%-11s] peak %10.2f MiB, current %10.2f MiB, %8llu allocations."
+                    , s_allocTagStr[ii]
+                    , double(stats.m_tagPeakBytes[ii])*toMiB
+                    , double(stats.m_tagCurrentBytes[ii])*toMiB
+                    , (unsigned long long)stats.m_tagNumAllocs[ii]
+                    );
+            }
+        }
+    }
+
+    // PoolAllocator.
+    //-----
+
+    // Header in front of every buffer, keeps 16 byte alignment of malloc.
+    struct PoolAllocator::Block
+    {
+        Block* m_next;
+        uint64_t m_size;
+    };
+
+    PoolAllocator::PoolAllocator(uint64_t _maxBytes)
+        : m_pool(NULL)
+        , m_maxBytes(_maxBytes)
+        , m_usedBytes(0)
+        , m_pooledBytes(0)
+        , m_peakBytes(0)
+    {
+    }
+
+    PoolAllocator::~PoolAllocator()
+    {
+        if (0 != m_usedBytes)
+        {
+            WARN("Pool allocator destroyed with %llu bytes in use.", (unsigned long long)m_usedBytes);
+        }
+
+        trim();
+    }
+
+    void* PoolAllocator::alloc(size_t _size)
+    {
+        bx::MutexScope lock(m_mutex);
+
+        // Reuse buffer of the same size.
+        for (Block** it = &m_pool; NULL != *it; it = &(*it)->m_next)
+        {
+            Block* block = *it;
+            if (_size == block->m_size)
+            {
+                *it = block->m_next;
+                m_pooledBytes -= _size;
+                m_usedBytes += _size;
+                m_peakBytes = (m_usedBytes > m_peakBytes) ? m_usedBytes : m_peakBytes;
+                return (void*)(block+1);
+            }
+        }
+
+        // Make room by releasing pooled buffers.
+        while (0 != m_maxBytes
+           &&  NULL != m_pool
+           &&  m_usedBytes + m_pooledBytes + _size > m_maxBytes)
+        {
+            Block* block = m_pool;
+            m_pool = block->m_next;
+            m_pooledBytes -= block->m_size;
+            ::free(block);
+        }
+
+        if (0 != m_maxBytes
+        &&  m_usedBytes + _size > m_maxBytes)
+        {
+            WARN("Pool allocator limit of %llu bytes reached, allocation of %llu bytes failed."
+                , (unsigned long long)m_maxBytes
+                , (unsigned long long)_size
+                );
+            return NULL;
+        }
+
+        Block* block = (Block*)::malloc(sizeof(Block) + _size);
+        if (NULL == block)
+        {
+            return NULL;
+        }
+
+        block->m_size = _size;
+        m_usedBytes += _size;
+        m_peakBytes = (m_usedBytes > m_peakBytes) ? m_usedBytes : m_peakBytes;
+
+        return (void*)(block+1);
+    }
+
+    void* PoolAllocator::realloc(void* _ptr, size_t _size)
+    {
+        if (NULL == _ptr)
+        {
+            return alloc(_size);
+        }
+
+        const Block* block = (const Block*)_ptr - 1;
+        if (_size == block->m_size)
+        {
+            return _ptr;
+        }
+
+        void* ptr = alloc(_size);
+        if (NULL != ptr)
+        {
+            memcpy(ptr, _ptr, size_t(block->m_size < _size ? block->m_size : _size));
+            free(_ptr);
+        }
+
+        return ptr;
+    }
+
+    void PoolAllocator::free(void* _ptr)
+    {
+        if (NULL == _ptr)
+        {
+            return;
+        }
+
+        Block* block = (Block*)_ptr - 1;
+
+        bx::MutexScope lock(m_mutex);
+        m_usedBytes -= block->m_size;
+        m_pooledBytes += block->m_size;
+        block->m_next = m_pool;
+        m_pool = block;
+    }
+
+    void PoolAllocator::trim()
+    {
+        bx::MutexScope lock(m_mutex);
+
+        while (NULL != m_pool)
+        {
+            Block* block = m_pool;
+            m_pool = block->m_next;
+            ::free(block);
+        }
+        m_pooledBytes = 0;
+    }
+
+    uint64_t PoolAllocator::getUsedBytes() const
+    {
+        bx::MutexScope lock(m_mutex);
+        return m_usedBytes;
+    }
+
+    uint64_t PoolAllocator::getPooledBytes() const
+    {
+        bx::MutexScope lock(m_mutex);
+        return m_pooledBytes;
+    }
+
+    uint64_t PoolAllocator::getPeakBytes() const
+    {
+        bx::MutexScope lock(m_mutex);
+        return m_peakBytes;
+    }
+
+    // HugePageAllocator.
+    //-----
+
+    // Header in front of every buffer, padded so that buffers stay 64 byte aligned.
+    struct HugePageHeader
+    {
+        enum Enum
+        {
+            Malloc,
+            Mapped,
+            HugePages,
+        };
+
+        void* m_base;
+        uint64_t m_mappedSize;
+        uint64_t m_size;
+        uint32_t m_kind;
+    };
+
+    #define CMFT_HUGE_PAGE_HEADER_SIZE 64
+    #define CMFT_HUGE_PAGE_SIZE (2<<20)
+
+    static inline size_t hugePageAlign(size_t _size, size_t _alignment)
+    {
+        return (_size + _alignment-1)/_alignment*_alignment;
+    }
+
+    HugePageAllocator::HugePageAllocator(size_t _minSize)
+        : m_minSize(_minSize)
+        , m_hugePageBytes(0)
+        , m_explicitFailed(false)
+    {
+    }
+
+    void* HugePageAllocator::alloc(size_t _size)
+    {
+        const size_t size = CMFT_HUGE_PAGE_HEADER_SIZE + _size;
+
+        void* base = NULL;
+        size_t mappedSize = 0;
+        uint32_t kind = HugePageHeader::Malloc;
+
+        if (_size >= m_minSize)
+        {
+            bool explicitFailed;
+            {
+                bx::MutexScope lock(m_mutex);
+                explicitFailed = m_explicitFailed;
+            }
+
+#if BX_PLATFORM_LINUX
+    #if defined(MAP_HUGETLB)
+            // Explicit huge pages come out of the pool reserved by the administrator.
+            if (!explicitFailed)
+            {
+                mappedSize = hugePageAlign(size, CMFT_HUGE_PAGE_SIZE);
+                void* ptr = mmap(NULL, mappedSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+                if (MAP_FAILED != ptr)
+                {
+                    base = ptr;
+                    kind = HugePageHeader::HugePages;
+                }
+                else
+                {
+                    bx::MutexScope lock(m_mutex);
+                    m_explicitFailed = true;
+                }
+            }
+    #endif // defined(MAP_HUGETLB)
+
+            // Transparent huge pages need 2MB aligned ranges, mapping is over-allocated and trimmed to alignment.
+            if (NULL == base)
+            {
+                mappedSize = hugePageAlign(size, CMFT_HUGE_PAGE_SIZE);
+                uint8_t* ptr = (uint8_t*)mmap(NULL, mappedSize + CMFT_HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+                if ((void*)ptr == MAP_FAILED)
+                {
+                    return NULL;
+                }
+
+                uint8_t* aligned = (uint8_t*)hugePageAlign(size_t(ptr), CMFT_HUGE_PAGE_SIZE);
+                const size_t head = size_t(aligned - ptr);
+                const size_t tail = CMFT_HUGE_PAGE_SIZE - head;
+                if (0 != head)
+                {
+                    munmap(ptr, head);
+                }
+                if (0 != tail)
+                {
+                    munmap(aligned + mappedSize, tail);
+                }
+
+                base = aligned;
+                kind = HugePageHeader::Mapped;
+    #if defined(MADV_HUGEPAGE)
+                if (0 == madvise(base, mappedSize, MADV_HUGEPAGE))
+                {
+                    kind = HugePageHeader::HugePages;
+                }
+    #endif // defined(MADV_HUGEPAGE)
+            }
+#elif BX_PLATFORM_WINDOWS
+            // Large pages need SeLockMemoryPrivilege, without it VirtualAlloc() fails and regular pages are used.
+            const size_t largePageSize = size_t(GetLargePageMinimum());
+            if (!explicitFailed && 0 != largePageSize)
+            {
+                mappedSize = hugePageAlign(size, largePageSize);
+                base = VirtualAlloc(NULL, mappedSize, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (NULL != base)
+                {
+                    kind = HugePageHeader::HugePages;
+                }
+                else
+                {
+                    bx::MutexScope lock(m_mutex);
+                    m_explicitFailed = true;
+                }
+            }
+
+            if (NULL == base)
+            {
+                mappedSize = size;
+                base = VirtualAlloc(NULL, mappedSize, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+                if (NULL == base)
+                {
+                    return NULL;
+                }
+                kind = HugePageHeader::Mapped;
+            }
+#else
+            BX_UNUSED(explicitFailed);
+#endif // BX_PLATFORM_
+        }
+
+        if (NULL == base)
+        {
+            mappedSize = size;
+            base = ::malloc(size);
+            if (NULL == base)
+            {
+                return NULL;
+            }
+            kind = HugePageHeader::Malloc;
+        }
+
+        if (HugePageHeader::HugePages == kind)
+        {
+            bx::MutexScope lock(m_mutex);
+            m_hugePageBytes += mappedSize;
+        }
+
+        HugePageHeader* header = (HugePageHeader*)base;
+        header->m_base = base;
+        header->m_mappedSize = mappedSize;
+        header->m_size = _size;
+        header->m_kind = kind;
+
+        return (uint8_t*)base + CMFT_HUGE_PAGE_HEADER_SIZE;
+    }
+
+    void* HugePageAllocator::realloc(void* _ptr, size_t _size)
+    {
+        if (NULL == _ptr)
+        {
+            return alloc(_size);
+        }
+
+        const HugePageHeader* header = (const HugePageHeader*)((uint8_t*)_ptr - CMFT_HUGE_PAGE_HEADER_SIZE);
+        if (_size == header->m_size)
+        {
+            return _ptr;
+        }
+
+        void* ptr = alloc(_size);
+        if (NULL != ptr)
+        {
+            memcpy(ptr, _ptr, size_t(header->m_size < _size ? header->m_size : _size));
+            free(_ptr);
+        }
+
+        return ptr;
+    }
+
+    void HugePageAllocator::free(void* _ptr)
+    {
+        if (NULL == _ptr)
+        {
+            return;
+        }
+
+        const HugePageHeader header = *(const HugePageHeader*)((uint8_t*)_ptr - CMFT_HUGE_PAGE_HEADER_SIZE);
+        if (HugePageHeader::HugePages == header.m_kind)
+        {
+            bx::MutexScope lock(m_mutex);
+            m_hugePageBytes -= header.m_mappedSize;
+        }
+
+        if (HugePageHeader::Malloc == header.m_kind)
+        {
+            ::free(header.m_base);
+            return;
+        }
+
+#if BX_PLATFORM_LINUX
+        munmap(header.m_base, size_t(header.m_mappedSize));
+#elif BX_PLATFORM_WINDOWS
+        VirtualFree(header.m_base, 0, MEM_RELEASE);
+#endif // BX_PLATFORM_
+    }
+
+    uint64_t HugePageAllocator::getHugePageBytes() const
+    {
+        bx::MutexScope lock(m_mutex);
+        return m_hugePageBytes;
+    }
+
+} // namespace cmft
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -16,6 +16,11 @@
 #define CMFT_ENABLE_INFO_MESSAGES      1
 #define CMFT_ENABLE_WARNINGS           1
 
+// Profile zones, see profiler.h.
+#ifndef CMFT_CONFIG_PROFILE
+    #define CMFT_CONFIG_PROFILE 0
+#endif // CMFT_CONFIG_PROFILE
+
 #if CMFT_CONFIG_DEBUG
     #define CMFT_ENABLE_CL_CHECK           1
     #define CMFT_ENABLE_DEBUG_CHECK        1
@@ -57,8 +62,10 @@
 
 #if CMFT_ENABLE_FILE_ERROR_CHECK
     #define FERROR_CHECK _FERROR_CHECK
+    #define IOERROR_CHECK _IOERROR_CHECK
 #else
     #define FERROR_CHECK(_fp) do {} while(0)
+    #define IOERROR_CHECK(_stream) do {} while(0)
 #endif
 
 #define _FERROR_CHECK(_fp)                                         \
@@ -70,6 +77,16 @@ do                                                                 \
     }                                                              \
 } while(0)
 
+// Same check for cmft::Reader and cmft::Writer streams.
+#define _IOERROR_CHECK(_stream)                                    \
+do                                                                 \
+{                                                                  \
+    if ((_stream)->isError())                                      \
+    {                                                              \
+        fprintf(stderr, "CMFT FILE I/O ERROR " _FILE_LINE_ ".\n"); \
+    }                                                              \
+} while(0)
+
 // Memory alloc check.
 #ifndef CMFT_ENABLE_MEMORY_ALLOC_CHECK
     #define CMFT_ENABLE_MEMORY_ALLOC_CHECK 0
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_HALF_H_HEADER_GUARD
+#define CMFT_HALF_H_HEADER_GUARD
+
+#include <stdint.h>
+#include <string.h> // memcpy
+
+#include "macros.h" // CMFT_UNUSED
+
+namespace cmft
+{
+    // Half float conversions used instead of bx::halfToFloat/bx::halfFromFloat.
+    // Those are forced inline and gcc refuses them (-Winline) in the big translation
+    // units once the unit growth limit is reached. These are left for the compiler
+    // to inline. Rounding matches bx (half up at the first dropped bit) for normal
+    // halves, but values above the half range map to infinity and values just below
+    // the smallest normal half round correctly instead of losing their top bit.
+
+    static CMFT_UNUSED float halfToFloat(uint16_t _a)
+    {
+        const uint32_t sign = uint32_t(_a & 0x8000) << 16;
+        const uint32_t exp  = (_a >> 10) & 0x1f;
+        const uint32_t mant = _a & 0x3ff;
+
+        uint32_t bits;
+        if (0 == exp)
+        {
+            if (0 == mant)
+            {
+                bits = sign;
+            }
+            else
+            {
+                // Denormal, normalize.
+                uint32_t mm = mant;
+                uint32_t ee = 113;
+                while (0 == (mm & 0x400))
+                {
+                    mm <<= 1;
+                    --ee;
+                }
+                bits = sign | (ee << 23) | ((mm & 0x3ff) << 13);
+            }
+        }
+        else if (0x1f == exp)
+        {
+            bits = sign | 0x7f800000 | (mant << 13);
+        }
+        else
+        {
+            bits = sign | ((exp + 112) << 23) | (mant << 13);
+        }
+
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    static CMFT_UNUSED uint16_t halfFromFloat(float _a)
+    {
+        uint32_t bits;
+        memcpy(&bits, &_a, sizeof(bits));
+
+        const uint32_t sign = (bits >> 16) & 0x8000;
+        const uint32_t exp  = (bits >> 23) & 0xff;
+        const uint32_t mant = bits & 0x7fffff;
+
+        if (0xff == exp)
+        {
+            return uint16_t(sign | (0 == mant ? 0x7c00 : 0x7e00));
+        }
+
+        if (exp > 112)
+        {
+            // Normal, rounding may carry into the exponent.
+            const uint32_t half = (((exp - 112) << 10) | (mant >> 13)) + ((mant >> 12) & 1);
+            return uint16_t(sign | (half < 0x7c00 ? half : 0x7c00));
+        }
+
+        // Denormal or zero.
+        const uint32_t sa = 126 - exp;
+        if (sa > 24)
+        {
+            return uint16_t(sign);
+        }
+
+        const uint32_t full = mant | 0x800000;
+        return uint16_t(sign | ((full >> sa) + ((full >> (sa - 1)) & 1)));
+    }
+
+} // namespace cmft
+
+#endif //CMFT_HALF_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_HASH_H_HEADER_GUARD
+#define CMFT_HASH_H_HEADER_GUARD
+
+#include <stdint.h>
+#include <string.h> // memcpy
+
+namespace cmft
+{
+    // MurmurHash2A by Austin Appleby, placed in the public domain.
+    // Same incremental interface and results as bx::HashMurmur2A, but const-correct
+    // and safe for unaligned input.
+
+    #define CMFT_MURMUR_M 0x5bd1e995
+    #define CMFT_MURMUR_R 24
+    #define CMFT_MURMUR_MIX(_h, _k) { _k *= CMFT_MURMUR_M; _k ^= _k >> CMFT_MURMUR_R; _k *= CMFT_MURMUR_M; _h *= CMFT_MURMUR_M; _h ^= _k; }
+
+    struct HashMurmur2A
+    {
+        void begin(uint32_t _seed = 0)
+        {
+            m_hash  = _seed;
+            m_tail  = 0;
+            m_count = 0;
+            m_size  = 0;
+        }
+
+        void add(const void* _data, int _len)
+        {
+            const uint8_t* data = (const uint8_t*)_data;
+            m_size += _len;
+
+            mixTail(data, _len);
+
+            while (_len >= 4)
+            {
+                uint32_t kk;
+                memcpy(&kk, data, 4);
+
+                CMFT_MURMUR_MIX(m_hash, kk);
+
+                data += 4;
+                _len -= 4;
+            }
+
+            mixTail(data, _len);
+        }
+
+        template <typename Ty>
+        void add(Ty _value)
+        {
+            add(&_value, sizeof(Ty));
+        }
+
+        uint32_t end()
+        {
+            CMFT_MURMUR_MIX(m_hash, m_tail);
+            CMFT_MURMUR_MIX(m_hash, m_size);
+
+            m_hash ^= m_hash >> 13;
+            m_hash *= CMFT_MURMUR_M;
+            m_hash ^= m_hash >> 15;
+
+            return m_hash;
+        }
+
+    private:
+        void mixTail(const uint8_t*& _data, int& _len)
+        {
+            while (_len && ((_len < 4) || m_count))
+            {
+                m_tail |= uint32_t(*_data++) << (m_count * 8);
+
+                m_count++;
+                _len--;
+
+                if (4 == m_count)
+                {
+                    CMFT_MURMUR_MIX(m_hash, m_tail);
+                    m_tail  = 0;
+                    m_count = 0;
+                }
+            }
+        }
+
+        uint32_t m_hash;
+        uint32_t m_tail;
+        uint32_t m_count;
+        uint32_t m_size;
+    };
+
+    #undef CMFT_MURMUR_M
+    #undef CMFT_MURMUR_R
+    #undef CMFT_MURMUR_MIX
+
+} // namespace cmft
+
+#endif //CMFT_HASH_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,1638 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "base/config.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+
+#include "base/half.h" // halfFromFloat
+
+#include "base/utils.h"
+#include "blockcompress.h"
+
+namespace cmft
+{
+    // Block helpers.
+    //-----
+
+    #define BLOCK_REFINE_ITER 4
+
+    /// Interpolation weights of 4-bit BC6H/BC7 indices.
+    static const int32_t s_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    /// Interpolation weights of 3-bit ASTC weights and BC6H/BC7 indices.
+    static const int32_t s_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+
+    /// Interpolation weights of 2-bit BC7 indices.
+    static const int32_t s_weights2[4] = { 0, 21, 43, 64 };
+
+    struct BlockBits
+    {
+        BlockBits()
+            : m_pos(0)
+        {
+            m_bits[0] = 0;
+            m_bits[1] = 0;
+        }
+
+        void write(uint32_t _value, uint32_t _numBits)
+        {
+            for (uint32_t ii = 0; ii < _numBits; ++ii, ++m_pos)
+            {
+                m_bits[m_pos>>6] |= uint64_t((_value>>ii)&1) << (m_pos&63);
+            }
+        }
+
+        /// Writes bits downwards from bit 127-_pos, as ASTC weights are stored.
+        void writeReversed(uint32_t _pos, uint32_t _value, uint32_t _numBits)
+        {
+            for (uint32_t ii = 0; ii < _numBits; ++ii)
+            {
+                const uint32_t pos = 127 - (_pos+ii);
+                m_bits[pos>>6] |= uint64_t((_value>>ii)&1) << (pos&63);
+            }
+        }
+
+        void store(uint8_t _dst[16]) const
+        {
+            for (uint32_t ii = 0; ii < 16; ++ii)
+            {
+                _dst[ii] = uint8_t(m_bits[ii>>3] >> ((ii&7)*8));
+            }
+        }
+
+        void load(const uint8_t _src[16])
+        {
+            m_bits[0] = 0;
+            m_bits[1] = 0;
+            m_pos = 0;
+            for (uint32_t ii = 0; ii < 16; ++ii)
+            {
+                m_bits[ii>>3] |= uint64_t(_src[ii]) << ((ii&7)*8);
+            }
+        }
+
+        uint32_t read(uint32_t _numBits)
+        {
+            uint32_t value = 0;
+            for (uint32_t ii = 0; ii < _numBits; ++ii, ++m_pos)
+            {
+                value |= uint32_t((m_bits[m_pos>>6] >> (m_pos&63))&1) << ii;
+            }
+            return value;
+        }
+
+        uint64_t m_bits[2];
+        uint32_t m_pos;
+    };
+
+    static inline bool isNan(float _val)
+    {
+        uint32_t bits;
+        memcpy(&bits, &_val, sizeof(bits));
+        return (0x7f800000 == (bits&0x7f800000)) && (0 != (bits&0x007fffff));
+    }
+
+    /// Same rounding as uncompressed 8-bit formats.
+    static inline int32_t unorm8FromFloat(float _val)
+    {
+        return isNan(_val) ? 0 : int32_t(clamp(_val, 0.0f, 1.0f) * 255.0f);
+    }
+
+    struct BlockFit
+    {
+        int32_t m_endpoints[2][4]; //!< Quantized codes.
+        uint8_t m_pbits[2];        //!< BC7 only.
+        uint8_t m_indices[16];
+        int64_t m_error;
+    };
+
+    struct BlockCodec;
+    typedef void (*BlockQuantizeFn)(BlockFit& _fit, const float _endpoints[2][4], const BlockCodec& _codec);
+    typedef void (*BlockPaletteFn)(int32_t _palette[16][4], const BlockFit& _fit, const BlockCodec& _codec);
+
+    /// Describes an endpoint and index based block format for the shared fitting code.
+    struct BlockCodec
+    {
+        uint8_t m_numChannels;
+        uint8_t m_numIndices;
+        const int32_t* m_weights;
+        int32_t m_codeMin;
+        int32_t m_codeMax;
+        bool m_hasPbits;
+        bool m_signed;
+        BlockQuantizeFn m_quantize;
+        BlockPaletteFn m_palette;
+    };
+
+    /// Picks the nearest palette entry for each texel and returns summed squared error in the target domain.
+    static void blockEvaluate(BlockFit& _fit, const int32_t _target[16][4], const BlockCodec& _codec)
+    {
+        int32_t palette[16][4];
+        _codec.m_palette(palette, _fit, _codec);
+
+        int64_t error = 0;
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            int64_t bestErr = INT64_MAX;
+            uint8_t bestIdx = 0;
+            for (uint8_t ii = 0; ii < _codec.m_numIndices; ++ii)
+            {
+                int64_t err = 0;
+                for (uint8_t cc = 0; cc < _codec.m_numChannels; ++cc)
+                {
+                    const int64_t diff = palette[ii][cc] - _target[texel][cc];
+                    err += diff*diff;
+                }
+
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    bestIdx = ii;
+                }
+            }
+
+            _fit.m_indices[texel] = bestIdx;
+            error += bestErr;
+        }
+
+        _fit.m_error = error;
+    }
+
+    /// Endpoints at the extremes of the texels projected on their principal axis.
+    static void blockPrincipalAxisEndpoints(float _endpoints[2][4], const int32_t _target[16][4], uint8_t _numChannels)
+    {
+        float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            for (uint8_t cc = 0; cc < _numChannels; ++cc)
+            {
+                mean[cc] += float(_target[texel][cc]);
+            }
+        }
+        for (uint8_t cc = 0; cc < _numChannels; ++cc)
+        {
+            mean[cc] *= 1.0f/16.0f;
+        }
+
+        float cov[4][4];
+        memset(cov, 0, sizeof(cov));
+        float minVal[4] = {  FLT_MAX,  FLT_MAX,  FLT_MAX,  FLT_MAX };
+        float maxVal[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            float diff[4];
+            for (uint8_t cc = 0; cc < _numChannels; ++cc)
+            {
+                diff[cc] = float(_target[texel][cc]) - mean[cc];
+                minVal[cc] = fminf(minVal[cc], float(_target[texel][cc]));
+                maxVal[cc] = fmaxf(maxVal[cc], float(_target[texel][cc]));
+            }
+
+            for (uint8_t ii = 0; ii < _numChannels; ++ii)
+            {
+                for (uint8_t jj = ii; jj < _numChannels; ++jj)
+                {
+                    cov[ii][jj] += diff[ii]*diff[jj];
+                }
+            }
+        }
+        for (uint8_t ii = 0; ii < _numChannels; ++ii)
+        {
+            for (uint8_t jj = 0; jj < ii; ++jj)
+            {
+                cov[ii][jj] = cov[jj][ii];
+            }
+        }
+
+        // Power iteration, starting from the bounding box diagonal.
+        float axis[4];
+        for (uint8_t cc = 0; cc < _numChannels; ++cc)
+        {
+            axis[cc] = maxVal[cc]-minVal[cc];
+        }
+        for (uint8_t iter = 0; iter < 8; ++iter)
+        {
+            float next[4];
+            float len = 0.0f;
+            for (uint8_t ii = 0; ii < _numChannels; ++ii)
+            {
+                next[ii] = 0.0f;
+                for (uint8_t jj = 0; jj < _numChannels; ++jj)
+                {
+                    next[ii] += cov[ii][jj]*axis[jj];
+                }
+                len = fmaxf(len, fabsf(next[ii]));
+            }
+
+            if (len < 1e-8f)
+            {
+                break;
+            }
+
+            for (uint8_t cc = 0; cc < _numChannels; ++cc)
+            {
+                axis[cc] = next[cc]/len;
+            }
+        }
+
+        float lenSq = 0.0f;
+        for (uint8_t cc = 0; cc < _numChannels; ++cc)
+        {
+            lenSq += axis[cc]*axis[cc];
+        }
+
+        if (lenSq < 1e-8f)
+        {
+            // Flat block.
+            for (uint8_t cc = 0; cc < _numChannels; ++cc)
+            {
+                _endpoints[0][cc] = mean[cc];
+                _endpoints[1][cc] = mean[cc];
+            }
+            return;
+        }
+
+        float minProj =  FLT_MAX;
+        float maxProj = -FLT_MAX;
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            float proj = 0.0f;
+            for (uint8_t cc = 0; cc < _numChannels; ++cc)
+            {
+                proj += (float(_target[texel][cc])-mean[cc])*axis[cc];
+            }
+            proj /= lenSq;
+
+            minProj = fminf(minProj, proj);
+            maxProj = fmaxf(maxProj, proj);
+        }
+
+        for (uint8_t cc = 0; cc < _numChannels; ++cc)
+        {
+            _endpoints[0][cc] = mean[cc] + axis[cc]*minProj;
+            _endpoints[1][cc] = mean[cc] + axis[cc]*maxProj;
+        }
+    }
+
+    /// Least squares endpoints for the current indices. Returns false if indices do not span a line.
+    static bool blockLeastSquaresEndpoints(float _endpoints[2][4], const BlockFit& _fit, const int32_t _target[16][4], const BlockCodec& _codec)
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float at[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float bt[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            const float beta = float(_codec.m_weights[_fit.m_indices[texel]])*(1.0f/64.0f);
+            const float alpha = 1.0f-beta;
+            aa += alpha*alpha;
+            ab += alpha*beta;
+            bb += beta*beta;
+            for (uint8_t cc = 0; cc < _codec.m_numChannels; ++cc)
+            {
+                at[cc] += alpha*float(_target[texel][cc]);
+                bt[cc] += beta *float(_target[texel][cc]);
+            }
+        }
+
+        const float det = aa*bb - ab*ab;
+        if (fabsf(det) < 1e-6f)
+        {
+            return false;
+        }
+
+        const float invDet = 1.0f/det;
+        for (uint8_t cc = 0; cc < _codec.m_numChannels; ++cc)
+        {
+            _endpoints[0][cc] = (at[cc]*bb - bt[cc]*ab)*invDet;
+            _endpoints[1][cc] = (bt[cc]*aa - at[cc]*ab)*invDet;
+        }
+
+        return true;
+    }
+
+    /// Tries moving each quantized endpoint component by one code, keeps moves that lower the error.
+    static void blockRefineEndpoints(BlockFit& _fit, const int32_t _target[16][4], const BlockCodec& _codec)
+    {
+        bool improved = true;
+        for (uint8_t pass = 0; pass < 2 && improved; ++pass)
+        {
+            improved = false;
+            for (uint8_t ee = 0; ee < 2; ++ee)
+            {
+                for (uint8_t cc = 0; cc < _codec.m_numChannels; ++cc)
+                {
+                    for (int32_t delta = -1; delta <= 1; delta += 2)
+                    {
+                        const int32_t code = _fit.m_endpoints[ee][cc] + delta;
+                        if (code < _codec.m_codeMin || code > _codec.m_codeMax)
+                        {
+                            continue;
+                        }
+
+                        BlockFit cand = _fit;
+                        cand.m_endpoints[ee][cc] = code;
+                        blockEvaluate(cand, _target, _codec);
+                        if (cand.m_error < _fit.m_error)
+                        {
+                            _fit = cand;
+                            improved = true;
+                        }
+                    }
+                }
+
+                if (_codec.m_hasPbits)
+                {
+                    BlockFit cand = _fit;
+                    cand.m_pbits[ee] ^= 1;
+                    blockEvaluate(cand, _target, _codec);
+                    if (cand.m_error < _fit.m_error)
+                    {
+                        _fit = cand;
+                        improved = true;
+                    }
+                }
+            }
+        }
+    }
+
+    /// Fits endpoints and indices of a single region. With _quality, fit is refined with least squares and endpoint search.
+    static void blockFit(BlockFit& _fit, const int32_t _target[16][4], const BlockCodec& _codec, bool _quality)
+    {
+        float endpoints[2][4];
+        blockPrincipalAxisEndpoints(endpoints, _target, _codec.m_numChannels);
+
+        _codec.m_quantize(_fit, endpoints, _codec);
+        blockEvaluate(_fit, _target, _codec);
+
+        if (!_quality)
+        {
+            return;
+        }
+
+        for (uint8_t iter = 0; iter < BLOCK_REFINE_ITER && 0 != _fit.m_error; ++iter)
+        {
+            if (!blockLeastSquaresEndpoints(endpoints, _fit, _target, _codec))
+            {
+                break;
+            }
+
+            BlockFit cand;
+            _codec.m_quantize(cand, endpoints, _codec);
+            blockEvaluate(cand, _target, _codec);
+            if (cand.m_error >= _fit.m_error)
+            {
+                break;
+            }
+            _fit = cand;
+        }
+
+        if (0 != _fit.m_error)
+        {
+            blockRefineEndpoints(_fit, _target, _codec);
+        }
+    }
+
+    /// Swaps endpoints and mirrors indices, the decoded block stays the same.
+    static void blockSwapEndpoints(BlockFit& _fit, const BlockCodec& _codec)
+    {
+        for (uint8_t cc = 0; cc < 4; ++cc)
+        {
+            const int32_t tmp = _fit.m_endpoints[0][cc];
+            _fit.m_endpoints[0][cc] = _fit.m_endpoints[1][cc];
+            _fit.m_endpoints[1][cc] = tmp;
+        }
+
+        const uint8_t pbit = _fit.m_pbits[0];
+        _fit.m_pbits[0] = _fit.m_pbits[1];
+        _fit.m_pbits[1] = pbit;
+
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            _fit.m_indices[texel] = uint8_t(_codec.m_numIndices-1-_fit.m_indices[texel]);
+        }
+    }
+
+    // BC6H.
+    //-----
+
+    #define BC6H_MODE11      0x03
+    #define BC6H_MODE_BITS   5
+    #define BC6H_PREC        10
+    #define BC6H_INDEX_BITS  4
+    #define BC6H_MAX_HALF    0x7bff
+
+    /// Expands endpoint component of _bits to 16 bits.
+    static inline int32_t bc6hUnquantize(int32_t _comp, uint8_t _bits, bool _signed)
+    {
+        if (!_signed)
+        {
+            if (_bits >= 15)
+            {
+                return _comp;
+            }
+            else if (0 == _comp)
+            {
+                return 0;
+            }
+            else if (((1<<_bits)-1) == _comp)
+            {
+                return 0xffff;
+            }
+
+            return ((_comp<<16) + 0x8000) >> _bits;
+        }
+
+        if (_bits >= 16)
+        {
+            return _comp;
+        }
+
+        const bool negative = _comp < 0;
+        const int32_t comp = negative ? -_comp : _comp;
+
+        int32_t unq;
+        if (0 == comp)
+        {
+            unq = 0;
+        }
+        else if (comp >= ((1<<(_bits-1))-1))
+        {
+            unq = 0x7fff;
+        }
+        else
+        {
+            unq = ((comp<<15) + 0x4000) >> (_bits-1);
+        }
+
+        return negative ? -unq : unq;
+    }
+
+    /// Returns half float bits for UF16, signed magnitude of half float bits for SF16.
+    static inline int32_t bc6hFinishUnquantize(int32_t _comp, bool _signed)
+    {
+        if (!_signed)
+        {
+            return (_comp*31) >> 6;
+        }
+
+        return (_comp < 0) ? -(((-_comp)*31) >> 5) : (_comp*31) >> 5;
+    }
+
+    /// Inverse of bc6hFinishUnquantize() applied to a half float value.
+    static inline int32_t bc6hTargetFromFloat(float _val, bool _signed)
+    {
+        const float val = isNan(_val) ? 0.0f : clamp(_val, _signed ? -65504.0f : 0.0f, 65504.0f);
+        const uint16_t half = halfFromFloat(val);
+        const int32_t magnitude = min(int32_t(half&0x7fff), int32_t(BC6H_MAX_HALF));
+
+        return (half&0x8000) ? -magnitude : magnitude;
+    }
+
+    /// Quantizes endpoint component from the finished domain, picks the nearest of neighbouring codes.
+    static inline int32_t bc6hQuantize(float _target, const BlockCodec& _codec)
+    {
+        const bool sgn = _codec.m_signed;
+        const float unq = sgn ? _target*(32.0f/31.0f) : _target*(64.0f/31.0f);
+        const float scale = sgn ? float(1<<(BC6H_PREC-1))/32768.0f : float(1<<BC6H_PREC)/65536.0f;
+        const int32_t guess = int32_t(floorf(unq*scale));
+
+        int32_t best = clamp(guess, _codec.m_codeMin, _codec.m_codeMax);
+        float bestErr = fabsf(float(bc6hFinishUnquantize(bc6hUnquantize(best, BC6H_PREC, sgn), sgn)) - _target);
+        for (int32_t qq = guess-1; qq <= guess+1; ++qq)
+        {
+            const int32_t cand = clamp(qq, _codec.m_codeMin, _codec.m_codeMax);
+            const float err = fabsf(float(bc6hFinishUnquantize(bc6hUnquantize(cand, BC6H_PREC, sgn), sgn)) - _target);
+            if (err < bestErr)
+            {
+                best = cand;
+                bestErr = err;
+            }
+        }
+
+        return best;
+    }
+
+    static void bc6hQuantizeEndpoints(BlockFit& _fit, const float _endpoints[2][4], const BlockCodec& _codec)
+    {
+        for (uint8_t ee = 0; ee < 2; ++ee)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                _fit.m_endpoints[ee][cc] = bc6hQuantize(_endpoints[ee][cc], _codec);
+            }
+            _fit.m_endpoints[ee][3] = 0;
+            _fit.m_pbits[ee] = 0;
+        }
+    }
+
+    static void bc6hPalette(int32_t _palette[16][4], const BlockFit& _fit, const BlockCodec& _codec)
+    {
+        int32_t unq[2][3];
+        for (uint8_t ee = 0; ee < 2; ++ee)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                unq[ee][cc] = bc6hUnquantize(_fit.m_endpoints[ee][cc], BC6H_PREC, _codec.m_signed);
+            }
+        }
+
+        for (uint8_t ii = 0; ii < 16; ++ii)
+        {
+            const int32_t ww = s_weights4[ii];
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                const int32_t comp = (unq[0][cc]*(64-ww) + unq[1][cc]*ww + 32) >> 6;
+                _palette[ii][cc] = bc6hFinishUnquantize(comp, _codec.m_signed);
+            }
+        }
+    }
+
+    void bc6hEncodeBlock(uint8_t _dst[16], const BlockTexels& _texels, bool _signed, bool _quality)
+    {
+        BlockCodec codec;
+        codec.m_numChannels = 3;
+        codec.m_numIndices = 16;
+        codec.m_weights = s_weights4;
+        codec.m_codeMin = _signed ? -((1<<(BC6H_PREC-1))-1) : 0;
+        codec.m_codeMax = _signed ?   (1<<(BC6H_PREC-1))-1  : (1<<BC6H_PREC)-1;
+        codec.m_hasPbits = false;
+        codec.m_signed = _signed;
+        codec.m_quantize = bc6hQuantizeEndpoints;
+        codec.m_palette = bc6hPalette;
+
+        int32_t target[16][4];
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                target[texel][cc] = bc6hTargetFromFloat(_texels[texel][cc], _signed);
+            }
+            target[texel][3] = 0;
+        }
+
+        BlockFit fit;
+        blockFit(fit, target, codec, _quality);
+
+        // Most significant bit of the first index is implicit zero, swap endpoints if needed.
+        if (fit.m_indices[0] >= 8)
+        {
+            blockSwapEndpoints(fit, codec);
+        }
+
+        const uint32_t mask = (1<<BC6H_PREC)-1;
+
+        BlockBits bits;
+        bits.write(BC6H_MODE11, BC6H_MODE_BITS);
+        bits.write(uint32_t(fit.m_endpoints[0][0])&mask, BC6H_PREC);
+        bits.write(uint32_t(fit.m_endpoints[0][1])&mask, BC6H_PREC);
+        bits.write(uint32_t(fit.m_endpoints[0][2])&mask, BC6H_PREC);
+        bits.write(uint32_t(fit.m_endpoints[1][0])&mask, BC6H_PREC);
+        bits.write(uint32_t(fit.m_endpoints[1][1])&mask, BC6H_PREC);
+        bits.write(uint32_t(fit.m_endpoints[1][2])&mask, BC6H_PREC);
+        bits.write(fit.m_indices[0], BC6H_INDEX_BITS-1);
+        for (uint8_t texel = 1; texel < 16; ++texel)
+        {
+            bits.write(fit.m_indices[texel], BC6H_INDEX_BITS);
+        }
+        bits.store(_dst);
+    }
+
+    // BC7.
+    //-----
+
+    #define BC7_MODE6        6
+    #define BC7_PREC         7
+    #define BC7_INDEX_BITS   4
+
+    static void bc7QuantizeEndpoints(BlockFit& _fit, const float _endpoints[2][4], const BlockCodec& /*_codec*/)
+    {
+        for (uint8_t ee = 0; ee < 2; ++ee)
+        {
+            // Pick the shared lowest bit that fits the endpoint best.
+            float bestErr = FLT_MAX;
+            for (uint8_t pbit = 0; pbit < 2; ++pbit)
+            {
+                int32_t codes[4];
+                float err = 0.0f;
+                for (uint8_t cc = 0; cc < 4; ++cc)
+                {
+                    const float val = clamp(_endpoints[ee][cc], 0.0f, 255.0f);
+                    codes[cc] = clamp(int32_t((val - float(pbit))*0.5f + 0.5f), 0, (1<<BC7_PREC)-1);
+                    const float diff = float((codes[cc]<<1)|pbit) - val;
+                    err += diff*diff;
+                }
+
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    memcpy(_fit.m_endpoints[ee], codes, sizeof(codes));
+                    _fit.m_pbits[ee] = pbit;
+                }
+            }
+        }
+    }
+
+    static void bc7Palette(int32_t _palette[16][4], const BlockFit& _fit, const BlockCodec& /*_codec*/)
+    {
+        int32_t endpoints[2][4];
+        for (uint8_t ee = 0; ee < 2; ++ee)
+        {
+            for (uint8_t cc = 0; cc < 4; ++cc)
+            {
+                endpoints[ee][cc] = (_fit.m_endpoints[ee][cc]<<1) | _fit.m_pbits[ee];
+            }
+        }
+
+        for (uint8_t ii = 0; ii < 16; ++ii)
+        {
+            const int32_t ww = s_weights4[ii];
+            for (uint8_t cc = 0; cc < 4; ++cc)
+            {
+                _palette[ii][cc] = (endpoints[0][cc]*(64-ww) + endpoints[1][cc]*ww + 32) >> 6;
+            }
+        }
+    }
+
+    void bc7EncodeBlock(uint8_t _dst[16], const BlockTexels& _texels, bool _quality)
+    {
+        BlockCodec codec;
+        codec.m_numChannels = 4;
+        codec.m_numIndices = 16;
+        codec.m_weights = s_weights4;
+        codec.m_codeMin = 0;
+        codec.m_codeMax = (1<<BC7_PREC)-1;
+        codec.m_hasPbits = true;
+        codec.m_signed = false;
+        codec.m_quantize = bc7QuantizeEndpoints;
+        codec.m_palette = bc7Palette;
+
+        int32_t target[16][4];
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            for (uint8_t cc = 0; cc < 4; ++cc)
+            {
+                target[texel][cc] = unorm8FromFloat(_texels[texel][cc]);
+            }
+        }
+
+        BlockFit fit;
+        blockFit(fit, target, codec, _quality);
+
+        // Most significant bit of the first index is implicit zero, swap endpoints if needed.
+        if (fit.m_indices[0] >= 8)
+        {
+            blockSwapEndpoints(fit, codec);
+        }
+
+        BlockBits bits;
+        bits.write(1<<BC7_MODE6, BC7_MODE6+1);
+        for (uint8_t cc = 0; cc < 4; ++cc)
+        {
+            bits.write(uint32_t(fit.m_endpoints[0][cc]), BC7_PREC);
+            bits.write(uint32_t(fit.m_endpoints[1][cc]), BC7_PREC);
+        }
+        bits.write(fit.m_pbits[0], 1);
+        bits.write(fit.m_pbits[1], 1);
+        bits.write(fit.m_indices[0], BC7_INDEX_BITS-1);
+        for (uint8_t texel = 1; texel < 16; ++texel)
+        {
+            bits.write(fit.m_indices[texel], BC7_INDEX_BITS);
+        }
+        bits.store(_dst);
+    }
+
+    // ASTC.
+    //-----
+
+    // 4x4 weight grid, weight range 0..7 and single partition.
+    #define ASTC_BLOCK_MODE   0x053
+    #define ASTC_CEM_LDR_RGB  8
+    #define ASTC_WEIGHT_BITS  3
+
+    static void astcQuantizeEndpoints(BlockFit& _fit, const float _endpoints[2][4], const BlockCodec& /*_codec*/)
+    {
+        for (uint8_t ee = 0; ee < 2; ++ee)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                _fit.m_endpoints[ee][cc] = int32_t(clamp(_endpoints[ee][cc], 0.0f, 255.0f) + 0.5f);
+            }
+            _fit.m_endpoints[ee][3] = 255;
+            _fit.m_pbits[ee] = 0;
+        }
+    }
+
+    static void astcPalette(int32_t _palette[16][4], const BlockFit& _fit, const BlockCodec& /*_codec*/)
+    {
+        for (uint8_t ii = 0; ii < 8; ++ii)
+        {
+            const int32_t ww = s_weights3[ii];
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                // Endpoints are expanded to 16 bits, result is the top 8 bits.
+                const int32_t e0 = _fit.m_endpoints[0][cc]*257;
+                const int32_t e1 = _fit.m_endpoints[1][cc]*257;
+                _palette[ii][cc] = ((e0*(64-ww) + e1*ww + 32) >> 6) >> 8;
+            }
+        }
+    }
+
+    void astc4x4EncodeBlock(uint8_t _dst[16], const BlockTexels& _texels, bool _quality)
+    {
+        BlockCodec codec;
+        codec.m_numChannels = 3;
+        codec.m_numIndices = 8;
+        codec.m_weights = s_weights3;
+        codec.m_codeMin = 0;
+        codec.m_codeMax = 255;
+        codec.m_hasPbits = false;
+        codec.m_signed = false;
+        codec.m_quantize = astcQuantizeEndpoints;
+        codec.m_palette = astcPalette;
+
+        int32_t target[16][4];
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                target[texel][cc] = unorm8FromFloat(_texels[texel][cc]);
+            }
+            target[texel][3] = 255;
+        }
+
+        BlockFit fit;
+        blockFit(fit, target, codec, _quality);
+
+        // Decoder applies blue contraction and swaps endpoints back when the second one is darker.
+        const int32_t sum0 = fit.m_endpoints[0][0] + fit.m_endpoints[0][1] + fit.m_endpoints[0][2];
+        const int32_t sum1 = fit.m_endpoints[1][0] + fit.m_endpoints[1][1] + fit.m_endpoints[1][2];
+        if (sum1 < sum0)
+        {
+            blockSwapEndpoints(fit, codec);
+        }
+
+        BlockBits bits;
+        bits.write(ASTC_BLOCK_MODE, 11);
+        bits.write(0, 2); // Single partition.
+        bits.write(ASTC_CEM_LDR_RGB, 4);
+        for (uint8_t cc = 0; cc < 3; ++cc)
+        {
+            bits.write(uint32_t(fit.m_endpoints[0][cc]), 8);
+            bits.write(uint32_t(fit.m_endpoints[1][cc]), 8);
+        }
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            bits.writeReversed(texel*ASTC_WEIGHT_BITS, fit.m_indices[texel], ASTC_WEIGHT_BITS);
+        }
+        bits.store(_dst);
+    }
+
+    // ETC2.
+    //-----
+
+    static const int32_t s_etcModifiers[8][2] =
+    {
+        {  2,   8 },
+        {  5,  17 },
+        {  9,  29 },
+        { 13,  42 },
+        { 18,  60 },
+        { 24,  80 },
+        { 33, 106 },
+        { 47, 183 },
+    };
+
+    /// Index bits to modifier: 0 = +small, 1 = +large, 2 = -small, 3 = -large.
+    static inline int32_t etcModifier(uint8_t _table, uint8_t _idx)
+    {
+        const int32_t mod = s_etcModifiers[_table][_idx&1];
+        return (_idx&2) ? -mod : mod;
+    }
+
+    struct EtcSubblockFit
+    {
+        uint8_t m_table;
+        uint8_t m_indices[8];
+        int64_t m_error;
+    };
+
+    /// Picks the best table and per texel modifiers of eight texels for the given base color.
+    static void etcFitSubblock(EtcSubblockFit& _fit, const int32_t _base[3], const int32_t _texels[8][3])
+    {
+        _fit.m_error = INT64_MAX;
+        for (uint8_t table = 0; table < 8; ++table)
+        {
+            EtcSubblockFit cand;
+            cand.m_table = table;
+            cand.m_error = 0;
+            for (uint8_t texel = 0; texel < 8; ++texel)
+            {
+                int64_t bestErr = INT64_MAX;
+                for (uint8_t idx = 0; idx < 4; ++idx)
+                {
+                    const int32_t mod = etcModifier(table, idx);
+                    int64_t err = 0;
+                    for (uint8_t cc = 0; cc < 3; ++cc)
+                    {
+                        const int64_t diff = clamp(_base[cc]+mod, 0, 255) - _texels[texel][cc];
+                        err += diff*diff;
+                    }
+
+                    if (err < bestErr)
+                    {
+                        bestErr = err;
+                        cand.m_indices[texel] = idx;
+                    }
+                }
+                cand.m_error += bestErr;
+            }
+
+            if (cand.m_error < _fit.m_error)
+            {
+                _fit = cand;
+            }
+        }
+    }
+
+    static inline int32_t etcExpand4(int32_t _c4) { return (_c4<<4) | _c4;      }
+    static inline int32_t etcExpand5(int32_t _c5) { return (_c5<<3) | (_c5>>2); }
+
+    /// Differential mode stores second color as a 3-bit signed delta from the first one.
+    static inline bool etcDeltaValid(int32_t _delta)
+    {
+        return _delta >= -4 && _delta <= 3;
+    }
+
+    struct EtcBlockFit
+    {
+        bool m_diff;
+        bool m_flip;
+        int32_t m_colors[2][3]; //!< Quantized, 4 bits or 5 bits (second one absolute too) per channel.
+        EtcSubblockFit m_sub[2];
+        int64_t m_error;
+    };
+
+    /// Fits one partitioning of the block. With _quality, neighbouring base colors are searched too.
+    static void etcFitPartition(EtcBlockFit& _fit, const int32_t _sub[2][8][3], bool _diff, bool _quality)
+    {
+        const int32_t maxCode = _diff ? 31 : 15;
+
+        int32_t avg[2][3];
+        for (uint8_t ss = 0; ss < 2; ++ss)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                int32_t sum = 0;
+                for (uint8_t texel = 0; texel < 8; ++texel)
+                {
+                    sum += _sub[ss][texel][cc];
+                }
+                avg[ss][cc] = clamp((sum*maxCode + 255*4) / (255*8), 0, maxCode);
+            }
+        }
+
+        if (_diff)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                avg[1][cc] = clamp(avg[1][cc], max(avg[0][cc]-4, 0), min(avg[0][cc]+3, maxCode));
+            }
+        }
+
+        _fit.m_diff = _diff;
+        _fit.m_error = 0;
+        for (uint8_t ss = 0; ss < 2; ++ss)
+        {
+            const int32_t range = (_quality && !(_diff && 1 == ss)) ? 1 : 0;
+
+            _fit.m_sub[ss].m_error = INT64_MAX;
+            for (int32_t dr = -range; dr <= range; ++dr)
+            {
+                for (int32_t dg = -range; dg <= range; ++dg)
+                {
+                    for (int32_t db = -range; db <= range; ++db)
+                    {
+                        const int32_t code[3] =
+                        {
+                            clamp(avg[ss][0]+dr, 0, maxCode),
+                            clamp(avg[ss][1]+dg, 0, maxCode),
+                            clamp(avg[ss][2]+db, 0, maxCode),
+                        };
+                        if (_diff && 0 == ss
+                        && (!etcDeltaValid(avg[1][0]-code[0])
+                        ||  !etcDeltaValid(avg[1][1]-code[1])
+                        ||  !etcDeltaValid(avg[1][2]-code[2])))
+                        {
+                            continue;
+                        }
+
+                        int32_t base[3];
+                        for (uint8_t cc = 0; cc < 3; ++cc)
+                        {
+                            base[cc] = _diff ? etcExpand5(code[cc]) : etcExpand4(code[cc]);
+                        }
+
+                        EtcSubblockFit sub;
+                        etcFitSubblock(sub, base, _sub[ss]);
+                        if (sub.m_error < _fit.m_sub[ss].m_error)
+                        {
+                            _fit.m_sub[ss] = sub;
+                            memcpy(_fit.m_colors[ss], code, sizeof(code));
+                        }
+                    }
+                }
+            }
+
+            _fit.m_error += _fit.m_sub[ss].m_error;
+        }
+    }
+
+    void etc2EncodeBlock(uint8_t _dst[8], const BlockTexels& _texels, bool _quality)
+    {
+        int32_t target[16][3];
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                target[texel][cc] = unorm8FromFloat(_texels[texel][cc]);
+            }
+        }
+
+        EtcBlockFit best;
+        best.m_error = INT64_MAX;
+        for (uint8_t flip = 0; flip < 2; ++flip)
+        {
+            // Without flip, subblocks are the left and right 2x4 halves, with flip the top and bottom 4x2 halves.
+            int32_t sub[2][8][3];
+            uint8_t count[2] = { 0, 0 };
+            for (uint8_t xx = 0; xx < 4; ++xx)
+            {
+                for (uint8_t yy = 0; yy < 4; ++yy)
+                {
+                    const uint8_t ss = flip ? (yy >= 2) : (xx >= 2);
+                    memcpy(sub[ss][count[ss]++], target[yy*4+xx], 3*sizeof(int32_t));
+                }
+            }
+
+            for (uint8_t diff = 0; diff < 2; ++diff)
+            {
+                EtcBlockFit fit;
+                etcFitPartition(fit, sub, 0 != diff, _quality);
+                fit.m_flip = 0 != flip;
+                if (fit.m_error < best.m_error)
+                {
+                    best = fit;
+                }
+            }
+        }
+
+        uint64_t bits = 0;
+        if (best.m_diff)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                const int32_t delta = best.m_colors[1][cc] - best.m_colors[0][cc];
+                bits |= uint64_t(best.m_colors[0][cc]) << (59-cc*8);
+                bits |= uint64_t(delta&7) << (56-cc*8);
+            }
+        }
+        else
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                bits |= uint64_t(best.m_colors[0][cc]) << (60-cc*8);
+                bits |= uint64_t(best.m_colors[1][cc]) << (56-cc*8);
+            }
+        }
+        bits |= uint64_t(best.m_sub[0].m_table) << 37;
+        bits |= uint64_t(best.m_sub[1].m_table) << 34;
+        bits |= uint64_t(best.m_diff ? 1 : 0) << 33;
+        bits |= uint64_t(best.m_flip ? 1 : 0) << 32;
+
+        // Texel indices are stored column by column, most significant bits first.
+        uint8_t count[2] = { 0, 0 };
+        for (uint8_t xx = 0; xx < 4; ++xx)
+        {
+            for (uint8_t yy = 0; yy < 4; ++yy)
+            {
+                const uint8_t ss = best.m_flip ? (yy >= 2) : (xx >= 2);
+                const uint8_t idx = best.m_sub[ss].m_indices[count[ss]++];
+                const uint8_t texel = xx*4+yy;
+                bits |= uint64_t(idx>>1) << (16+texel);
+                bits |= uint64_t(idx&1)  << texel;
+            }
+        }
+
+        // Big endian.
+        for (uint8_t ii = 0; ii < 8; ++ii)
+        {
+            _dst[ii] = uint8_t(bits >> (56-ii*8));
+        }
+    }
+
+    // Decoding.
+    //-----
+
+    /// Subset of each texel in BC6H/BC7 two subset partitions, bit per texel.
+    static const uint16_t s_bc7Partitions2[64] =
+    {
+        0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+        0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+        0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+        0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+        0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+        0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+        0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+        0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+    };
+
+    /// Subset of each texel in BC7 three subset partitions, two bits per texel.
+    static const uint32_t s_bc7Partitions3[64] =
+    {
+        0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+        0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+        0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+        0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+        0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+        0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+        0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+        0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+    };
+
+    /// Texel with implicit zero index msb in the second subset of two subset partitions.
+    static const uint8_t s_bc7Anchors2[64] =
+    {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+        15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+         6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+    };
+
+    /// Texels with implicit zero index msb in the second and third subset of three subset partitions.
+    static const uint8_t s_bc7Anchors3[2][64] =
+    {
+        {
+             3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+             3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+             8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+             3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+        },
+        {
+            15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+            15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+            15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+            15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+        },
+    };
+
+    static inline uint8_t bc7Subset(uint8_t _numSubsets, uint8_t _partition, uint8_t _texel)
+    {
+        if (2 == _numSubsets)
+        {
+            return (s_bc7Partitions2[_partition] >> _texel)&1;
+        }
+        else if (3 == _numSubsets)
+        {
+            return (s_bc7Partitions3[_partition] >> (_texel*2))&3;
+        }
+
+        return 0;
+    }
+
+    static inline bool bc7IsAnchor(uint8_t _numSubsets, uint8_t _partition, uint8_t _texel)
+    {
+        return 0 == _texel
+            || (2 == _numSubsets && s_bc7Anchors2[_partition] == _texel)
+            || (3 == _numSubsets && (s_bc7Anchors3[0][_partition] == _texel || s_bc7Anchors3[1][_partition] == _texel))
+            ;
+    }
+
+    static inline const int32_t* bc7Weights(uint32_t _indexBits)
+    {
+        return (2 == _indexBits) ? s_weights2 : (3 == _indexBits) ? s_weights3 : s_weights4;
+    }
+
+    static inline int32_t signExtend(uint32_t _value, uint32_t _bits)
+    {
+        return int32_t(_value << (32-_bits)) >> (32-_bits);
+    }
+
+    static inline void unpack565(float _rgba[4], uint16_t _color)
+    {
+        const uint32_t rr = (_color>>11)&0x1f;
+        const uint32_t gg = (_color>>5)&0x3f;
+        const uint32_t bb = _color&0x1f;
+        _rgba[0] = float((rr<<3)|(rr>>2))*(1.0f/255.0f);
+        _rgba[1] = float((gg<<2)|(gg>>4))*(1.0f/255.0f);
+        _rgba[2] = float((bb<<3)|(bb>>2))*(1.0f/255.0f);
+        _rgba[3] = 1.0f;
+    }
+
+    /// Color part of BC1, BC2 and BC3. Only BC1 has the three color mode with transparent black.
+    static void bc1DecodeColors(BlockTexels& _texels, const uint8_t _src[8], bool _allowThreeColors)
+    {
+        const uint16_t c0 = uint16_t(_src[0] | (_src[1]<<8));
+        const uint16_t c1 = uint16_t(_src[2] | (_src[3]<<8));
+
+        float palette[4][4];
+        unpack565(palette[0], c0);
+        unpack565(palette[1], c1);
+        if (c0 > c1 || !_allowThreeColors)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                palette[2][cc] = (2.0f*palette[0][cc] + palette[1][cc])*(1.0f/3.0f);
+                palette[3][cc] = (palette[0][cc] + 2.0f*palette[1][cc])*(1.0f/3.0f);
+            }
+            palette[2][3] = 1.0f;
+            palette[3][3] = 1.0f;
+        }
+        else
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                palette[2][cc] = (palette[0][cc] + palette[1][cc])*0.5f;
+                palette[3][cc] = 0.0f;
+            }
+            palette[2][3] = 1.0f;
+            palette[3][3] = 0.0f;
+        }
+
+        const uint32_t indices = uint32_t(_src[4]) | (uint32_t(_src[5])<<8) | (uint32_t(_src[6])<<16) | (uint32_t(_src[7])<<24);
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            memcpy(_texels[texel], palette[(indices >> (texel*2))&3], 4*sizeof(float));
+        }
+    }
+
+    /// Single channel of BC3 alpha, BC4 and BC5.
+    static void bc4DecodeChannel(BlockTexels& _texels, uint8_t _channel, const uint8_t _src[8], bool _signed)
+    {
+        float palette[8];
+        float e0, e1;
+        bool eightValues;
+        if (_signed)
+        {
+            const int32_t s0 = max(int32_t(int8_t(_src[0])), -127);
+            const int32_t s1 = max(int32_t(int8_t(_src[1])), -127);
+            e0 = float(s0)*(1.0f/127.0f);
+            e1 = float(s1)*(1.0f/127.0f);
+            eightValues = int8_t(_src[0]) > int8_t(_src[1]);
+        }
+        else
+        {
+            e0 = float(_src[0])*(1.0f/255.0f);
+            e1 = float(_src[1])*(1.0f/255.0f);
+            eightValues = _src[0] > _src[1];
+        }
+
+        palette[0] = e0;
+        palette[1] = e1;
+        if (eightValues)
+        {
+            for (uint8_t ii = 1; ii < 7; ++ii)
+            {
+                palette[ii+1] = (float(7-ii)*e0 + float(ii)*e1)*(1.0f/7.0f);
+            }
+        }
+        else
+        {
+            for (uint8_t ii = 1; ii < 5; ++ii)
+            {
+                palette[ii+1] = (float(5-ii)*e0 + float(ii)*e1)*(1.0f/5.0f);
+            }
+            palette[6] = _signed ? -1.0f : 0.0f;
+            palette[7] = 1.0f;
+        }
+
+        uint64_t indices = 0;
+        for (uint8_t ii = 0; ii < 6; ++ii)
+        {
+            indices |= uint64_t(_src[2+ii]) << (ii*8);
+        }
+
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            _texels[texel][_channel] = palette[(indices >> (texel*3))&7];
+        }
+    }
+
+    static void bc4DecodeBlock(BlockTexels& _texels, const uint8_t* _src, uint8_t _numChannels, bool _signed)
+    {
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            _texels[texel][1] = 0.0f;
+            _texels[texel][2] = 0.0f;
+            _texels[texel][3] = 1.0f;
+        }
+
+        for (uint8_t cc = 0; cc < _numChannels; ++cc)
+        {
+            bc4DecodeChannel(_texels, cc, &_src[cc*8], _signed);
+        }
+    }
+
+    struct Bc6hField
+    {
+        enum Enum
+        {
+            End,
+            RW, GW, BW, // Endpoint 0.
+            RX, GX, BX, // Endpoint 1.
+            RY, GY, BY, // Endpoint 2.
+            RZ, GZ, BZ, // Endpoint 3.
+            D,          // Partition.
+        };
+    };
+
+    /// Bits of a field in header order, from _lsb towards _msb. Some fields are stored with reversed bits, _lsb > _msb.
+    struct Bc6hSegment
+    {
+        uint8_t m_field;
+        uint8_t m_msb;
+        uint8_t m_lsb;
+    };
+
+    struct Bc6hMode
+    {
+        bool m_transformed;     //!< Endpoints other than the first are stored as deltas.
+        uint8_t m_numRegions;
+        uint8_t m_endpointBits;
+        uint8_t m_deltaBits[3];
+        Bc6hSegment m_layout[25];
+    };
+
+    #define BC6H_SEG(_field, _msb, _lsb) { Bc6hField::_field, _msb, _lsb }
+
+    /// Header layouts after the mode bits, modes are in the order of the format specification.
+    static const Bc6hMode s_bc6hModes[14] =
+    {
+        { true,  2, 10, { 5, 5, 5 },
+            { BC6H_SEG(GY,4,4), BC6H_SEG(BY,4,4), BC6H_SEG(BZ,4,4), BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0)
+            , BC6H_SEG(RX,4,0), BC6H_SEG(GZ,4,4), BC6H_SEG(GY,3,0), BC6H_SEG(GX,4,0), BC6H_SEG(BZ,0,0), BC6H_SEG(GZ,3,0)
+            , BC6H_SEG(BX,4,0), BC6H_SEG(BZ,1,1), BC6H_SEG(BY,3,0), BC6H_SEG(RY,4,0), BC6H_SEG(BZ,2,2), BC6H_SEG(RZ,4,0)
+            , BC6H_SEG(BZ,3,3), BC6H_SEG(D,4,0) } },
+        { true,  2, 7,  { 6, 6, 6 },
+            { BC6H_SEG(GY,5,5), BC6H_SEG(GZ,4,4), BC6H_SEG(GZ,5,5), BC6H_SEG(RW,6,0), BC6H_SEG(BZ,0,0), BC6H_SEG(BZ,1,1)
+            , BC6H_SEG(BY,4,4), BC6H_SEG(GW,6,0), BC6H_SEG(BY,5,5), BC6H_SEG(BZ,2,2), BC6H_SEG(GY,4,4), BC6H_SEG(BW,6,0)
+            , BC6H_SEG(BZ,3,3), BC6H_SEG(BZ,5,5), BC6H_SEG(BZ,4,4), BC6H_SEG(RX,5,0), BC6H_SEG(GY,3,0), BC6H_SEG(GX,5,0)
+            , BC6H_SEG(GZ,3,0), BC6H_SEG(BX,5,0), BC6H_SEG(BY,3,0), BC6H_SEG(RY,5,0), BC6H_SEG(RZ,5,0), BC6H_SEG(D,4,0) } },
+        { true,  2, 11, { 5, 4, 4 },
+            { BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0), BC6H_SEG(RX,4,0), BC6H_SEG(RW,10,10), BC6H_SEG(GY,3,0)
+            , BC6H_SEG(GX,3,0), BC6H_SEG(GW,10,10), BC6H_SEG(BZ,0,0), BC6H_SEG(GZ,3,0), BC6H_SEG(BX,3,0), BC6H_SEG(BW,10,10)
+            , BC6H_SEG(BZ,1,1), BC6H_SEG(BY,3,0), BC6H_SEG(RY,4,0), BC6H_SEG(BZ,2,2), BC6H_SEG(RZ,4,0), BC6H_SEG(BZ,3,3)
+            , BC6H_SEG(D,4,0) } },
+        { true,  2, 11, { 4, 5, 4 },
+            { BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0), BC6H_SEG(RX,3,0), BC6H_SEG(RW,10,10), BC6H_SEG(GZ,4,4)
+            , BC6H_SEG(GY,3,0), BC6H_SEG(GX,4,0), BC6H_SEG(GW,10,10), BC6H_SEG(GZ,3,0), BC6H_SEG(BX,3,0), BC6H_SEG(BW,10,10)
+            , BC6H_SEG(BZ,1,1), BC6H_SEG(BY,3,0), BC6H_SEG(RY,3,0), BC6H_SEG(BZ,0,0), BC6H_SEG(BZ,2,2), BC6H_SEG(RZ,3,0)
+            , BC6H_SEG(GY,4,4), BC6H_SEG(BZ,3,3), BC6H_SEG(D,4,0) } },
+        { true,  2, 11, { 4, 4, 5 },
+            { BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0), BC6H_SEG(RX,3,0), BC6H_SEG(RW,10,10), BC6H_SEG(BY,4,4)
+            , BC6H_SEG(GY,3,0), BC6H_SEG(GX,3,0), BC6H_SEG(GW,10,10), BC6H_SEG(BZ,0,0), BC6H_SEG(GZ,3,0), BC6H_SEG(BX,4,0)
+            , BC6H_SEG(BW,10,10), BC6H_SEG(BY,3,0), BC6H_SEG(RY,3,0), BC6H_SEG(BZ,1,1), BC6H_SEG(BZ,2,2), BC6H_SEG(RZ,3,0)
+            , BC6H_SEG(BZ,4,4), BC6H_SEG(BZ,3,3), BC6H_SEG(D,4,0) } },
+        { true,  2, 9,  { 5, 5, 5 },
+            { BC6H_SEG(RW,8,0), BC6H_SEG(BY,4,4), BC6H_SEG(GW,8,0), BC6H_SEG(GY,4,4), BC6H_SEG(BW,8,0), BC6H_SEG(BZ,4,4)
+            , BC6H_SEG(RX,4,0), BC6H_SEG(GZ,4,4), BC6H_SEG(GY,3,0), BC6H_SEG(GX,4,0), BC6H_SEG(BZ,0,0), BC6H_SEG(GZ,3,0)
+            , BC6H_SEG(BX,4,0), BC6H_SEG(BZ,1,1), BC6H_SEG(BY,3,0), BC6H_SEG(RY,4,0), BC6H_SEG(BZ,2,2), BC6H_SEG(RZ,4,0)
+            , BC6H_SEG(BZ,3,3), BC6H_SEG(D,4,0) } },
+        { true,  2, 8,  { 6, 5, 5 },
+            { BC6H_SEG(RW,7,0), BC6H_SEG(GZ,4,4), BC6H_SEG(BY,4,4), BC6H_SEG(GW,7,0), BC6H_SEG(BZ,2,2), BC6H_SEG(GY,4,4)
+            , BC6H_SEG(BW,7,0), BC6H_SEG(BZ,3,3), BC6H_SEG(BZ,4,4), BC6H_SEG(RX,5,0), BC6H_SEG(GY,3,0), BC6H_SEG(GX,4,0)
+            , BC6H_SEG(BZ,0,0), BC6H_SEG(GZ,3,0), BC6H_SEG(BX,4,0), BC6H_SEG(BZ,1,1), BC6H_SEG(BY,3,0), BC6H_SEG(RY,5,0)
+            , BC6H_SEG(RZ,5,0), BC6H_SEG(D,4,0) } },
+        { true,  2, 8,  { 5, 6, 5 },
+            { BC6H_SEG(RW,7,0), BC6H_SEG(BZ,0,0), BC6H_SEG(BY,4,4), BC6H_SEG(GW,7,0), BC6H_SEG(GY,5,5), BC6H_SEG(GY,4,4)
+            , BC6H_SEG(BW,7,0), BC6H_SEG(GZ,5,5), BC6H_SEG(BZ,4,4), BC6H_SEG(RX,4,0), BC6H_SEG(GZ,4,4), BC6H_SEG(GY,3,0)
+            , BC6H_SEG(GX,5,0), BC6H_SEG(GZ,3,0), BC6H_SEG(BX,4,0), BC6H_SEG(BZ,1,1), BC6H_SEG(BY,3,0), BC6H_SEG(RY,4,0)
+            , BC6H_SEG(BZ,2,2), BC6H_SEG(RZ,4,0), BC6H_SEG(BZ,3,3), BC6H_SEG(D,4,0) } },
+        { true,  2, 8,  { 5, 5, 6 },
+            { BC6H_SEG(RW,7,0), BC6H_SEG(BZ,1,1), BC6H_SEG(BY,4,4), BC6H_SEG(GW,7,0), BC6H_SEG(BY,5,5), BC6H_SEG(GY,4,4)
+            , BC6H_SEG(BW,7,0), BC6H_SEG(BZ,5,5), BC6H_SEG(BZ,4,4), BC6H_SEG(RX,4,0), BC6H_SEG(GZ,4,4), BC6H_SEG(GY,3,0)
+            , BC6H_SEG(GX,4,0), BC6H_SEG(BZ,0,0), BC6H_SEG(GZ,3,0), BC6H_SEG(BX,5,0), BC6H_SEG(BY,3,0), BC6H_SEG(RY,4,0)
+            , BC6H_SEG(BZ,2,2), BC6H_SEG(RZ,4,0), BC6H_SEG(BZ,3,3), BC6H_SEG(D,4,0) } },
+        { false, 2, 6,  { 6, 6, 6 },
+            { BC6H_SEG(RW,5,0), BC6H_SEG(GZ,4,4), BC6H_SEG(BZ,0,0), BC6H_SEG(BZ,1,1), BC6H_SEG(BY,4,4), BC6H_SEG(GW,5,0)
+            , BC6H_SEG(GY,5,5), BC6H_SEG(BY,5,5), BC6H_SEG(BZ,2,2), BC6H_SEG(GY,4,4), BC6H_SEG(BW,5,0), BC6H_SEG(GZ,5,5)
+            , BC6H_SEG(BZ,3,3), BC6H_SEG(BZ,5,5), BC6H_SEG(BZ,4,4), BC6H_SEG(RX,5,0), BC6H_SEG(GY,3,0), BC6H_SEG(GX,5,0)
+            , BC6H_SEG(GZ,3,0), BC6H_SEG(BX,5,0), BC6H_SEG(BY,3,0), BC6H_SEG(RY,5,0), BC6H_SEG(RZ,5,0), BC6H_SEG(D,4,0) } },
+        { false, 1, 10, { 10, 10, 10 },
+            { BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0), BC6H_SEG(RX,9,0), BC6H_SEG(GX,9,0), BC6H_SEG(BX,9,0) } },
+        { true,  1, 11, { 9, 9, 9 },
+            { BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0), BC6H_SEG(RX,8,0), BC6H_SEG(RW,10,10), BC6H_SEG(GX,8,0)
+            , BC6H_SEG(GW,10,10), BC6H_SEG(BX,8,0), BC6H_SEG(BW,10,10) } },
+        { true,  1, 12, { 8, 8, 8 },
+            { BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0), BC6H_SEG(RX,7,0), BC6H_SEG(RW,10,11), BC6H_SEG(GX,7,0)
+            , BC6H_SEG(GW,10,11), BC6H_SEG(BX,7,0), BC6H_SEG(BW,10,11) } },
+        { true,  1, 16, { 4, 4, 4 },
+            { BC6H_SEG(RW,9,0), BC6H_SEG(GW,9,0), BC6H_SEG(BW,9,0), BC6H_SEG(RX,3,0), BC6H_SEG(RW,10,15), BC6H_SEG(GX,3,0)
+            , BC6H_SEG(GW,10,15), BC6H_SEG(BX,3,0), BC6H_SEG(BW,10,15) } },
+    };
+
+    #undef BC6H_SEG
+
+    /// Index into s_bc6hModes, UINT8_MAX for reserved modes.
+    static uint8_t bc6hReadMode(BlockBits& _bits)
+    {
+        const uint32_t low = _bits.read(2);
+        if (low < 2)
+        {
+            return uint8_t(low);
+        }
+
+        const uint32_t mode = low | (_bits.read(3)<<2);
+        if (2 == (mode&3))
+        {
+            return uint8_t(2 + (mode>>2));
+        }
+        else if ((mode>>2) < 4)
+        {
+            return uint8_t(10 + (mode>>2));
+        }
+
+        return UINT8_MAX;
+    }
+
+    static void bc6hDecodeBlock(BlockTexels& _texels, const uint8_t _src[16], bool _signed)
+    {
+        BlockBits bits;
+        bits.load(_src);
+
+        const uint8_t modeIdx = bc6hReadMode(bits);
+        if (UINT8_MAX == modeIdx)
+        {
+            for (uint8_t texel = 0; texel < 16; ++texel)
+            {
+                _texels[texel][0] = 0.0f;
+                _texels[texel][1] = 0.0f;
+                _texels[texel][2] = 0.0f;
+                _texels[texel][3] = 1.0f;
+            }
+            return;
+        }
+
+        const Bc6hMode& mode = s_bc6hModes[modeIdx];
+
+        uint32_t fields[Bc6hField::D+1];
+        memset(fields, 0, sizeof(fields));
+        for (const Bc6hSegment* seg = mode.m_layout; Bc6hField::End != seg->m_field; ++seg)
+        {
+            const int32_t step = (seg->m_msb >= seg->m_lsb) ? 1 : -1;
+            for (int32_t bit = seg->m_lsb; bit != int32_t(seg->m_msb)+step; bit += step)
+            {
+                fields[seg->m_field] |= bits.read(1) << bit;
+            }
+        }
+
+        // Endpoints are sign extended for SF16, deltas always.
+        const uint8_t numEndpoints = mode.m_numRegions*2;
+        const uint8_t epb = mode.m_endpointBits;
+        int32_t endpoints[4][3];
+        for (uint8_t ee = 0; ee < numEndpoints; ++ee)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                const uint32_t value = fields[Bc6hField::RW + ee*3 + cc];
+                if (0 != ee && mode.m_transformed)
+                {
+                    const int32_t delta = signExtend(value, mode.m_deltaBits[cc]);
+                    const uint32_t sum = uint32_t(endpoints[0][cc] + delta) & ((1<<epb)-1);
+                    endpoints[ee][cc] = _signed ? signExtend(sum, epb) : int32_t(sum);
+                }
+                else
+                {
+                    endpoints[ee][cc] = _signed ? signExtend(value, epb) : int32_t(value);
+                }
+            }
+        }
+
+        for (uint8_t ee = 0; ee < numEndpoints; ++ee)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                endpoints[ee][cc] = bc6hUnquantize(endpoints[ee][cc], epb, _signed);
+            }
+        }
+
+        const uint8_t partition = uint8_t(fields[Bc6hField::D]);
+        const uint32_t indexBits = (2 == mode.m_numRegions) ? 3 : 4;
+        const int32_t* weights = bc7Weights(indexBits);
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            const uint8_t subset = bc7Subset(mode.m_numRegions, partition, texel);
+            const uint32_t index = bits.read(bc7IsAnchor(mode.m_numRegions, partition, texel) ? indexBits-1 : indexBits);
+            const int32_t ww = weights[index];
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                const int32_t comp = (endpoints[subset*2][cc]*(64-ww) + endpoints[subset*2+1][cc]*ww + 32) >> 6;
+                const int32_t half = bc6hFinishUnquantize(comp, _signed);
+                _texels[texel][cc] = halfToFloat(uint16_t((half < 0) ? (0x8000|(-half)) : half));
+            }
+            _texels[texel][3] = 1.0f;
+        }
+    }
+
+    struct Bc7Mode
+    {
+        uint8_t m_numSubsets;
+        uint8_t m_partitionBits;
+        uint8_t m_rotationBits;
+        uint8_t m_indexModeBits;
+        uint8_t m_colorBits;
+        uint8_t m_alphaBits;
+        uint8_t m_endpointPbits; //!< Lowest bit of each endpoint.
+        uint8_t m_sharedPbits;   //!< Lowest bit shared by endpoints of a subset.
+        uint8_t m_indexBits;
+        uint8_t m_index2Bits;
+    };
+
+    static const Bc7Mode s_bc7Modes[8] =
+    {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+    };
+
+    static void bc7DecodeBlock(BlockTexels& _texels, const uint8_t _src[16])
+    {
+        // Mode is the position of the lowest set bit, block without it is reserved.
+        if (0 == _src[0])
+        {
+            memset(_texels, 0, sizeof(BlockTexels));
+            return;
+        }
+
+        uint8_t modeIdx = 0;
+        while (0 == (_src[0] & (1<<modeIdx)))
+        {
+            ++modeIdx;
+        }
+        const Bc7Mode& mode = s_bc7Modes[modeIdx];
+
+        BlockBits bits;
+        bits.load(_src);
+        bits.m_pos = modeIdx+1;
+
+        const uint8_t partition = uint8_t(bits.read(mode.m_partitionBits));
+        const uint32_t rotation = bits.read(mode.m_rotationBits);
+        const uint32_t indexMode = bits.read(mode.m_indexModeBits);
+
+        const uint8_t numEndpoints = mode.m_numSubsets*2;
+        int32_t endpoints[6][4];
+        for (uint8_t cc = 0; cc < 3; ++cc)
+        {
+            for (uint8_t ee = 0; ee < numEndpoints; ++ee)
+            {
+                endpoints[ee][cc] = int32_t(bits.read(mode.m_colorBits));
+            }
+        }
+        for (uint8_t ee = 0; ee < numEndpoints; ++ee)
+        {
+            endpoints[ee][3] = int32_t(bits.read(mode.m_alphaBits));
+        }
+
+        uint8_t colorBits = mode.m_colorBits;
+        uint8_t alphaBits = mode.m_alphaBits;
+        if (mode.m_endpointPbits || mode.m_sharedPbits)
+        {
+            uint32_t pbits[6];
+            for (uint8_t ee = 0; ee < numEndpoints; ++ee)
+            {
+                pbits[ee] = (mode.m_endpointPbits || 0 == (ee&1)) ? bits.read(1) : pbits[ee-1];
+            }
+
+            for (uint8_t ee = 0; ee < numEndpoints; ++ee)
+            {
+                for (uint8_t cc = 0; cc < 4; ++cc)
+                {
+                    if (cc < 3 || 0 != alphaBits)
+                    {
+                        endpoints[ee][cc] = (endpoints[ee][cc]<<1) | int32_t(pbits[ee]);
+                    }
+                }
+            }
+            colorBits++;
+            alphaBits = (0 != alphaBits) ? alphaBits+1 : 0;
+        }
+
+        // Expand to 8 bits, missing alpha is opaque.
+        for (uint8_t ee = 0; ee < numEndpoints; ++ee)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                endpoints[ee][cc] = (endpoints[ee][cc] << (8-colorBits)) | (endpoints[ee][cc] >> (2*colorBits-8));
+            }
+            endpoints[ee][3] = (0 == alphaBits)
+                             ? 255
+                             : (endpoints[ee][3] << (8-alphaBits)) | (endpoints[ee][3] >> (2*alphaBits-8))
+                             ;
+        }
+
+        uint32_t indices[16];
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            const bool anchor = bc7IsAnchor(mode.m_numSubsets, partition, texel);
+            indices[texel] = bits.read(anchor ? mode.m_indexBits-1 : mode.m_indexBits);
+        }
+
+        uint32_t indices2[16];
+        for (uint8_t texel = 0; texel < 16 && 0 != mode.m_index2Bits; ++texel)
+        {
+            indices2[texel] = bits.read(0 == texel ? mode.m_index2Bits-1 : mode.m_index2Bits);
+        }
+
+        // With index mode set, color uses the second set of indices and alpha the first.
+        const int32_t* weights  = bc7Weights(mode.m_indexBits);
+        const int32_t* weights2 = bc7Weights(mode.m_index2Bits);
+        for (uint8_t texel = 0; texel < 16; ++texel)
+        {
+            const uint8_t subset = bc7Subset(mode.m_numSubsets, partition, texel);
+            const int32_t* e0 = endpoints[subset*2];
+            const int32_t* e1 = endpoints[subset*2+1];
+
+            int32_t colorWeight = weights[indices[texel]];
+            int32_t alphaWeight = colorWeight;
+            if (0 != mode.m_index2Bits)
+            {
+                alphaWeight = weights2[indices2[texel]];
+                if (0 != indexMode)
+                {
+                    const int32_t tmp = colorWeight;
+                    colorWeight = alphaWeight;
+                    alphaWeight = tmp;
+                }
+            }
+
+            int32_t rgba[4];
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                rgba[cc] = (e0[cc]*(64-colorWeight) + e1[cc]*colorWeight + 32) >> 6;
+            }
+            rgba[3] = (e0[3]*(64-alphaWeight) + e1[3]*alphaWeight + 32) >> 6;
+
+            // Rotation swaps alpha with one of the color channels.
+            if (0 != rotation)
+            {
+                const int32_t tmp = rgba[3];
+                rgba[3] = rgba[rotation-1];
+                rgba[rotation-1] = tmp;
+            }
+
+            for (uint8_t cc = 0; cc < 4; ++cc)
+            {
+                _texels[texel][cc] = float(rgba[cc])*(1.0f/255.0f);
+            }
+        }
+    }
+
+    uint8_t blockFormatBytes(BlockFormat::Enum _format)
+    {
+        return (BlockFormat::BC1 == _format || BlockFormat::BC4 == _format || BlockFormat::BC4S == _format) ? 8 : 16;
+    }
+
+    void blockDecode(BlockTexels& _texels, const uint8_t* _src, BlockFormat::Enum _format)
+    {
+        switch (_format)
+        {
+        case BlockFormat::BC1:
+            bc1DecodeColors(_texels, _src, true);
+            break;
+
+        case BlockFormat::BC2:
+            bc1DecodeColors(_texels, &_src[8], false);
+            for (uint8_t texel = 0; texel < 16; ++texel)
+            {
+                _texels[texel][3] = float((_src[texel/2] >> ((texel&1)*4))&0xf)*(1.0f/15.0f);
+            }
+            break;
+
+        case BlockFormat::BC3:
+            bc1DecodeColors(_texels, &_src[8], false);
+            bc4DecodeChannel(_texels, 3, _src, false);
+            break;
+
+        case BlockFormat::BC4:  bc4DecodeBlock(_texels, _src, 1, false); break;
+        case BlockFormat::BC4S: bc4DecodeBlock(_texels, _src, 1, true);  break;
+        case BlockFormat::BC5:  bc4DecodeBlock(_texels, _src, 2, false); break;
+        case BlockFormat::BC5S: bc4DecodeBlock(_texels, _src, 2, true);  break;
+        case BlockFormat::BC6H:  bc6hDecodeBlock(_texels, _src, false); break;
+        case BlockFormat::BC6HS: bc6hDecodeBlock(_texels, _src, true);  break;
+        case BlockFormat::BC7:   bc7DecodeBlock(_texels, _src);         break;
+        default: DEBUG_CHECK(false, "Unknown block format.");
+        };
+    }
+
+} // namespace cmft
+
+/* vim: set sw=4 ts=4 expandtab: */
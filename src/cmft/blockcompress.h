@@ -0,0 +1,66 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_BLOCKCOMPRESS_H_HEADER_GUARD
+#define CMFT_BLOCKCOMPRESS_H_HEADER_GUARD
+
+#include "base/config.h"
+
+#include <stdint.h>
+
+namespace cmft
+{
+    /// Texels of a 4x4 block, row by row, in rgba32f.
+    /// Encoders fit a single region. With _quality, the fit is refined, otherwise it is used as is.
+    typedef float BlockTexels[16][4];
+
+    /// Encodes a block into 16 bytes of BC6H. Only mode 11 is used: one region, two 10-bit endpoints
+    /// and 4-bit indices. With _signed, block is SF16, otherwise UF16 and negative values are clamped to 0.
+    void bc6hEncodeBlock(uint8_t _dst[16], const BlockTexels& _texels, bool _signed, bool _quality);
+
+    /// Encodes a block into 16 bytes of BC7. Only mode 6 is used: one region, two RGBA 7-bit endpoints
+    /// with a shared lowest bit each and 4-bit indices. Texels are in [0, 1] and quantized like 8-bit formats.
+    void bc7EncodeBlock(uint8_t _dst[16], const BlockTexels& _texels, bool _quality);
+
+    /// Encodes a block into 8 bytes of ETC2 RGB8. Only individual and differential modes are used, which
+    /// are also valid ETC1. With _quality, base colors next to subblock averages are searched too.
+    void etc2EncodeBlock(uint8_t _dst[8], const BlockTexels& _texels, bool _quality);
+
+    /// Encodes a block into 16 bytes of ASTC 4x4 LDR. Single partition with RGB direct endpoints of 8 bits
+    /// and 3-bit weights. Alpha is not stored and decodes as 1.
+    void astc4x4EncodeBlock(uint8_t _dst[16], const BlockTexels& _texels, bool _quality);
+
+    /// Block compressed formats with a decoder. BC1 to BC5 have no TextureFormat, they are decoded when loaded.
+    struct BlockFormat
+    {
+        enum Enum
+        {
+            BC1,
+            BC2,
+            BC3,
+            BC4,
+            BC4S,
+            BC5,
+            BC5S,
+            BC6H,
+            BC6HS,
+            BC7,
+
+            Count,
+        };
+    };
+
+    /// Bytes of a single 4x4 block, 8 or 16.
+    uint8_t blockFormatBytes(BlockFormat::Enum _format);
+
+    /// Decodes a block into rgba32f texels. All modes of BC6H and BC7 are handled, reserved modes decode as 0.
+    /// Channels not stored in the format decode as 0, alpha as 1. BC4 and BC5 signed variants are in [-1, 1].
+    void blockDecode(BlockTexels& _texels, const uint8_t* _src, BlockFormat::Enum _format);
+
+} // namespace cmft
+
+#endif //CMFT_BLOCKCOMPRESS_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
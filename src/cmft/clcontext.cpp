@@ -4,9 +4,11 @@
  */
 
 #include <stdint.h>
+#include <string.h> // memmove, memset
 #define BX_CL_IMPLEMENTATION
 #include <bx/cl.h>
 
+#include "base/hash.h"  //HashMurmur2A
 #include "base/utils.h" //strtolower, cmft_strncpy
 
 #include "clcontext.h"
@@ -108,47 +110,157 @@ namespace cmft
 
         // Choose preferred device and create context.
         cl_uint preferredDeviceIdx = (_preferredDeviceIdx < numDevices) ? _preferredDeviceIdx : 0;
-        cl_device_id chosenDevice = devices[preferredDeviceIdx];
-        cl_context context = clCreateContext(NULL, 1, &chosenDevice, NULL, NULL, &err);
-        if (CL_SUCCESS != err)
+        if (!init(choosenPlatform, devices[preferredDeviceIdx])
+        &&  !init(choosenPlatform, devices[0]))
         {
-            chosenDevice = devices[0];
-            context = clCreateContext(NULL, 1, &chosenDevice, NULL, NULL, &err);
-            if (CL_SUCCESS != err)
+            WARN("OpenCL context initialization failed!");
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Returns address of extension function _name of _platform, NULL if there is none.
+    static void* clExtensionFunction(cl_platform_id _platform, const char* _name)
+    {
+        if (NULL != clGetExtensionFunctionAddressForPlatform)
+        {
+            return clGetExtensionFunctionAddressForPlatform(_platform, _name);
+        }
+
+        return (NULL != clGetExtensionFunctionAddress) ? clGetExtensionFunctionAddress(_name) : NULL;
+    }
+
+    /// Entry points of texture sharing with _sharing graphics API. Returns false if _device doesn't support it.
+    static bool clSharingFunctions(ClContext& _clContext, cl_platform_id _platform, cl_device_id _device, ClSharing::Enum _sharing)
+    {
+        const char* extension = (ClSharing::Gl == _sharing) ? "cl_khr_gl_sharing" : "cl_khr_d3d11_sharing";
+
+        char extensions[4096];
+        if (CL_SUCCESS != clGetDeviceInfo(_device, CL_DEVICE_EXTENSIONS, sizeof(extensions), extensions, NULL)
+        ||  NULL == bx::strnstr(extensions, extension, sizeof(extensions)))
+        {
+            WARN("OpenCL device does not support %s.", extension);
+            return false;
+        }
+
+        if (ClSharing::Gl == _sharing)
+        {
+            // clCreateFromGLTexture2D() of OpenCL 1.1 takes the same arguments, it is enough for cubemap faces.
+            _clContext.m_createFromGlTexture = (ClCreateFromGlTextureFn)clExtensionFunction(_platform, "clCreateFromGLTexture");
+            if (NULL == _clContext.m_createFromGlTexture)
+            {
+                _clContext.m_createFromGlTexture = (ClCreateFromGlTextureFn)clExtensionFunction(_platform, "clCreateFromGLTexture2D");
+            }
+            _clContext.m_enqueueAcquireShared = (ClEnqueueSharedObjectsFn)clExtensionFunction(_platform, "clEnqueueAcquireGLObjects");
+            _clContext.m_enqueueReleaseShared = (ClEnqueueSharedObjectsFn)clExtensionFunction(_platform, "clEnqueueReleaseGLObjects");
+        }
+        else
+        {
+            _clContext.m_createFromD3D11Texture2D = (ClCreateFromD3D11Texture2DFn)clExtensionFunction(_platform, "clCreateFromD3D11Texture2DKHR");
+            _clContext.m_enqueueAcquireShared = (ClEnqueueSharedObjectsFn)clExtensionFunction(_platform, "clEnqueueAcquireD3D11ObjectsKHR");
+            _clContext.m_enqueueReleaseShared = (ClEnqueueSharedObjectsFn)clExtensionFunction(_platform, "clEnqueueReleaseD3D11ObjectsKHR");
+        }
+
+        if ((NULL == _clContext.m_createFromGlTexture && NULL == _clContext.m_createFromD3D11Texture2D)
+        ||  NULL == _clContext.m_enqueueAcquireShared
+        ||  NULL == _clContext.m_enqueueReleaseShared)
+        {
+            WARN("OpenCL platform does not provide %s entry points.", extension);
+            _clContext.m_createFromGlTexture = NULL;
+            _clContext.m_createFromD3D11Texture2D = NULL;
+            _clContext.m_enqueueAcquireShared = NULL;
+            _clContext.m_enqueueReleaseShared = NULL;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ClContext::init(cl_platform_id _platform
+                       , cl_device_id _device
+                       , ClSharing::Enum _sharing
+                       , const cl_context_properties* _sharingProperties
+                       )
+    {
+        cl_int err;
+
+        // Sharing properties follow the platform.
+        cl_context_properties properties[32];
+        uint32_t numProperties = 0;
+        if (ClSharing::None != _sharing)
+        {
+            if (!clSharingFunctions(*this, _platform, _device, _sharing))
             {
-                WARN("OpenCL context initialization failed!");
                 return false;
             }
+
+            properties[numProperties++] = CL_CONTEXT_PLATFORM;
+            properties[numProperties++] = cl_context_properties(_platform);
+            for (uint32_t ii = 0; NULL != _sharingProperties && 0 != _sharingProperties[ii] && numProperties+3 <= BX_COUNTOF(properties); ii += 2)
+            {
+                properties[numProperties++] = _sharingProperties[ii];
+                properties[numProperties++] = _sharingProperties[ii+1];
+            }
+            properties[numProperties++] = 0;
+        }
+
+        cl_context context = clCreateContext((0 != numProperties) ? properties : NULL, 1, &_device, NULL, NULL, &err);
+        if (CL_SUCCESS != err)
+        {
+            if (ClSharing::None != _sharing)
+            {
+                WARN("Could not create OpenCL context sharing textures with the graphics context, error %d.", (int)err);
+            }
+            return false;
         }
 
         // Get device name, vendor and type.
         char deviceVendor[128];
-        CL_CHECK(clGetPlatformInfo(choosenPlatform, CL_PLATFORM_VENDOR, sizeof(deviceVendor), deviceVendor, NULL));
+        CL_CHECK(clGetPlatformInfo(_platform, CL_PLATFORM_VENDOR, sizeof(deviceVendor), deviceVendor, NULL));
         char deviceName[128];
-        CL_CHECK(clGetDeviceInfo(chosenDevice, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL));
-        CL_CHECK(clGetDeviceInfo(chosenDevice, CL_DEVICE_TYPE, sizeof(m_deviceType), &m_deviceType, NULL));
+        CL_CHECK(clGetDeviceInfo(_device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL));
+        CL_CHECK(clGetDeviceInfo(_device, CL_DEVICE_TYPE, sizeof(m_deviceType), &m_deviceType, NULL));
+        cl_uint numComputeUnits;
+        CL_CHECK(clGetDeviceInfo(_device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(numComputeUnits), &numComputeUnits, NULL));
+        char driverVersion[128];
+        CL_CHECK(clGetDeviceInfo(_device, CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL));
 
         // Create command queue
         cl_command_queue commandQueue;
-        commandQueue = clCreateCommandQueue(context, chosenDevice, 0, &err);
+        commandQueue = clCreateCommandQueue(context, _device, 0, &err);
         if (CL_SUCCESS != err)
         {
-            WARN("OpenCL context initialization failed!");
+            clReleaseContext(context);
             return false;
         }
 
         // Fill structure.
         cmft_strncpy(m_deviceVendor, deviceVendor, 127);
         cmft_strncpy(m_deviceName, deviceName, 127);
-        m_device = chosenDevice;
+        cmft_strncpy(m_deviceVersion, driverVersion, 127);
+        m_device = _device;
         m_context = context;
         m_commandQueue = commandQueue;
+        m_numComputeUnits = uint32_t(numComputeUnits);
+        m_sharing = _sharing;
 
         return true;
     }
 
     void ClContext::destroy()
     {
+        releaseMemPool();
+
+        {
+            bx::MutexScope lock(m_programMutex);
+            for (uint8_t ii = 0; ii < m_numPrograms; ++ii)
+            {
+                clReleaseProgram(m_programs[ii].m_program);
+            }
+            m_numPrograms = 0;
+        }
+
         if (NULL != m_commandQueue)
         {
             clReleaseCommandQueue(m_commandQueue);
@@ -160,6 +272,463 @@ namespace cmft
             clReleaseContext(m_context);
             m_context = NULL;
         }
+
+        if (NULL != m_parentDevice)
+        {
+            clReleaseDevice(m_device);
+            m_device = NULL;
+            m_parentDevice = NULL;
+        }
+
+        m_sharing = ClSharing::None;
+        m_createFromGlTexture = NULL;
+        m_createFromD3D11Texture2D = NULL;
+        m_enqueueAcquireShared = NULL;
+        m_enqueueReleaseShared = NULL;
+    }
+
+    cl_mem ClContext::createFromSharedTexture(const ClSharedTexture& _texture, cl_mem_flags _flags, uint8_t _face, uint8_t _mip, cl_int* _err) const
+    {
+        cl_int err = CL_INVALID_CONTEXT;
+        cl_mem mem = NULL;
+        if (ClSharing::Gl == m_sharing)
+        {
+            mem = m_createFromGlTexture(m_context, _flags, CMFT_GL_TEXTURE_CUBE_MAP_POSITIVE_X+_face, cl_int(_mip), _texture.m_glName, &err);
+        }
+        else if (ClSharing::D3D11 == m_sharing)
+        {
+            mem = m_createFromD3D11Texture2D(m_context, _flags, _texture.m_d3d11Texture, cl_uint(_mip) + cl_uint(_face)*_texture.m_numMips, &err);
+        }
+
+        if (NULL != _err)
+        {
+            *_err = err;
+        }
+
+        return (CL_SUCCESS == err) ? mem : NULL;
+    }
+
+    bool ClContext::acquireShared(const cl_mem* _mems, uint32_t _num) const
+    {
+        if (ClSharing::None == m_sharing)
+        {
+            return false;
+        }
+
+        const cl_int err = m_enqueueAcquireShared(m_commandQueue, _num, _mems, 0, NULL, NULL);
+        if (CL_SUCCESS != err)
+        {
+            WARN("Could not acquire shared textures, error %d.", (int)err);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ClContext::releaseShared(const cl_mem* _mems, uint32_t _num) const
+    {
+        if (ClSharing::None == m_sharing)
+        {
+            return false;
+        }
+
+        // Without cl_khr_gl_event, the graphics API can only use textures once the queue is finished.
+        const cl_int err = m_enqueueReleaseShared(m_commandQueue, _num, _mems, 0, NULL, NULL);
+        clFinish(m_commandQueue);
+        if (CL_SUCCESS != err)
+        {
+            WARN("Could not release shared textures, error %d.", (int)err);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ClContext::partition(uint32_t _numComputeUnits)
+    {
+        if (NULL == m_context
+        ||  NULL != m_parentDevice
+        ||  ClSharing::None != m_sharing
+        ||  0 == _numComputeUnits
+        ||  _numComputeUnits >= m_numComputeUnits)
+        {
+            return false;
+        }
+
+        if (NULL == clCreateSubDevices
+        ||  NULL == clReleaseDevice)
+        {
+            WARN("OpenCL device partitioning requires OpenCL 1.2.");
+            return false;
+        }
+
+        const cl_device_partition_property properties[] =
+        {
+            CL_DEVICE_PARTITION_BY_COUNTS,
+            cl_device_partition_property(_numComputeUnits),
+            CL_DEVICE_PARTITION_BY_COUNTS_LIST_END,
+            0,
+        };
+
+        cl_device_id subDevice;
+        cl_uint numSubDevices = 0;
+        cl_int err = clCreateSubDevices(m_device, properties, 1, &subDevice, &numSubDevices);
+        if (CL_SUCCESS != err
+        ||  1 != numSubDevices)
+        {
+            WARN("Could not partition OpenCL device %s, error %d.", m_deviceName, (int)err);
+            return false;
+        }
+
+        cl_context context = clCreateContext(NULL, 1, &subDevice, NULL, NULL, &err);
+        if (CL_SUCCESS != err)
+        {
+            clReleaseDevice(subDevice);
+            return false;
+        }
+
+        cl_command_queue commandQueue = clCreateCommandQueue(context, subDevice, 0, &err);
+        if (CL_SUCCESS != err)
+        {
+            clReleaseContext(context);
+            clReleaseDevice(subDevice);
+            return false;
+        }
+
+        cl_device_id device = m_device;
+        destroy();
+
+        m_device = subDevice;
+        m_parentDevice = device;
+        m_context = context;
+        m_commandQueue = commandQueue;
+        m_numComputeUnits = _numComputeUnits;
+
+        return true;
+    }
+
+    static cl_mem clAcquirePooledMem(ClContext::PooledMem* _pool
+                                   , uint8_t& _num
+                                   , uint64_t& _size
+                                   , cl_mem_object_type _type
+                                   , cl_mem_flags _flags
+                                   , const cl_image_format* _format
+                                   , size_t _width
+                                   , size_t _height
+                                   )
+    {
+        // Most recently released object is taken first.
+        for (uint8_t ii = _num; ii--; )
+        {
+            const ClContext::PooledMem& pooled = _pool[ii];
+            if (pooled.m_type   == _type
+            &&  pooled.m_flags  == _flags
+            &&  pooled.m_width  == _width
+            &&  pooled.m_height == _height
+            &&  (NULL == _format
+            ||  (pooled.m_format.image_channel_order     == _format->image_channel_order
+            &&   pooled.m_format.image_channel_data_type == _format->image_channel_data_type)))
+            {
+                cl_mem mem = pooled.m_mem;
+                _size -= pooled.m_size;
+                memmove(&_pool[ii], &_pool[ii+1], (_num-ii-1)*sizeof(ClContext::PooledMem));
+                _num--;
+                return mem;
+            }
+        }
+
+        return NULL;
+    }
+
+    cl_mem ClContext::acquireImage2D(cl_mem_flags _flags, const cl_image_format& _format, size_t _width, size_t _height, cl_int* _err) const
+    {
+        DEBUG_CHECK(0 == (_flags&(CL_MEM_USE_HOST_PTR|CL_MEM_COPY_HOST_PTR|CL_MEM_ALLOC_HOST_PTR)), "Host memory images are not pooled.");
+
+        {
+            bx::MutexScope lock(m_memPoolMutex);
+            cl_mem mem = clAcquirePooledMem(m_pooledMem, m_numPooledMem, m_pooledMemSize, CL_MEM_OBJECT_IMAGE2D, _flags, &_format, _width, _height);
+            if (NULL != mem)
+            {
+                *_err = CL_SUCCESS;
+                return mem;
+            }
+        }
+
+        return clCreateImage2D(m_context, _flags, &_format, _width, _height, 0, NULL, _err);
+    }
+
+    cl_mem ClContext::acquireBuffer(cl_mem_flags _flags, size_t _size, cl_int* _err) const
+    {
+        DEBUG_CHECK(0 == (_flags&(CL_MEM_USE_HOST_PTR|CL_MEM_COPY_HOST_PTR|CL_MEM_ALLOC_HOST_PTR)), "Host memory buffers are not pooled.");
+
+        {
+            bx::MutexScope lock(m_memPoolMutex);
+            cl_mem mem = clAcquirePooledMem(m_pooledMem, m_numPooledMem, m_pooledMemSize, CL_MEM_OBJECT_BUFFER, _flags, NULL, _size, 0);
+            if (NULL != mem)
+            {
+                *_err = CL_SUCCESS;
+                return mem;
+            }
+        }
+
+        return clCreateBuffer(m_context, _flags, _size, NULL, _err);
+    }
+
+    void ClContext::releaseMem(cl_mem _mem) const
+    {
+        if (NULL == _mem)
+        {
+            return;
+        }
+
+        PooledMem pooled;
+        memset(&pooled, 0, sizeof(pooled));
+        pooled.m_mem = _mem;
+        clGetMemObjectInfo(_mem, CL_MEM_TYPE,  sizeof(pooled.m_type),  &pooled.m_type,  NULL);
+        clGetMemObjectInfo(_mem, CL_MEM_FLAGS, sizeof(pooled.m_flags), &pooled.m_flags, NULL);
+        clGetMemObjectInfo(_mem, CL_MEM_SIZE,  sizeof(pooled.m_size),  &pooled.m_size,  NULL);
+        if (CL_MEM_OBJECT_IMAGE2D == pooled.m_type)
+        {
+            clGetImageInfo(_mem, CL_IMAGE_FORMAT, sizeof(pooled.m_format), &pooled.m_format, NULL);
+            clGetImageInfo(_mem, CL_IMAGE_WIDTH,  sizeof(pooled.m_width),  &pooled.m_width,  NULL);
+            clGetImageInfo(_mem, CL_IMAGE_HEIGHT, sizeof(pooled.m_height), &pooled.m_height, NULL);
+        }
+        else
+        {
+            pooled.m_width = pooled.m_size;
+        }
+
+        // Objects wrapping host memory belong to their host allocation.
+        const bool poolable = (CL_MEM_OBJECT_IMAGE2D == pooled.m_type || CL_MEM_OBJECT_BUFFER == pooled.m_type)
+                            && 0 == (pooled.m_flags&(CL_MEM_USE_HOST_PTR|CL_MEM_COPY_HOST_PTR|CL_MEM_ALLOC_HOST_PTR))
+                            && 0 != pooled.m_size
+                            && pooled.m_size <= uint64_t(CMFT_CL_MEM_POOL_SIZE)
+                            ;
+        if (!poolable)
+        {
+            clReleaseMemObject(_mem);
+            return;
+        }
+
+        cl_mem evicted[CMFT_CL_MAX_POOLED_MEM];
+        uint8_t numEvicted = 0;
+        {
+            bx::MutexScope lock(m_memPoolMutex);
+
+            while (0 != m_numPooledMem
+            &&    (CMFT_CL_MAX_POOLED_MEM == m_numPooledMem || m_pooledMemSize + pooled.m_size > uint64_t(CMFT_CL_MEM_POOL_SIZE)))
+            {
+                evicted[numEvicted++] = m_pooledMem[0].m_mem;
+                m_pooledMemSize -= m_pooledMem[0].m_size;
+                memmove(&m_pooledMem[0], &m_pooledMem[1], (m_numPooledMem-1)*sizeof(PooledMem));
+                m_numPooledMem--;
+            }
+
+            m_pooledMem[m_numPooledMem++] = pooled;
+            m_pooledMemSize += pooled.m_size;
+        }
+
+        for (uint8_t ii = 0; ii < numEvicted; ++ii)
+        {
+            clReleaseMemObject(evicted[ii]);
+        }
+    }
+
+    void ClContext::releaseMemPool() const
+    {
+        bx::MutexScope lock(m_memPoolMutex);
+
+        for (uint8_t ii = 0; ii < m_numPooledMem; ++ii)
+        {
+            clReleaseMemObject(m_pooledMem[ii].m_mem);
+        }
+        m_numPooledMem = 0;
+        m_pooledMemSize = 0;
+    }
+
+    void ClContext::setBinaryCacheDir(const char* _dirPath)
+    {
+        m_binaryCacheDir[0] = '\0';
+        if (NULL != _dirPath)
+        {
+            cmft_strncpy(m_binaryCacheDir, _dirPath, CMFT_COUNTOF(m_binaryCacheDir)-1);
+        }
+    }
+
+    static bool buildProgram(cl_program _program, cl_device_id _device, const char* _buildOptions)
+    {
+        const cl_int err = clBuildProgram(_program, 1, &_device, _buildOptions, NULL, NULL);
+        if (CL_SUCCESS != err)
+        {
+            // Print error.
+            char buffer[10240];
+            clGetProgramBuildInfo(_program, _device, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
+            WARN("CL Compilation failed:\n%s", buffer);
+
+            return false;
+        }
+
+        return true;
+    }
+
+    static cl_program loadProgramBinary(const char* _filePath, cl_context _context, cl_device_id _device, const char* _buildOptions)
+    {
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
+        {
+            return NULL;
+        }
+        ScopeFclose cleanup0(fp);
+
+        const long int fileSize = fsize(fp);
+        if (fileSize <= 0)
+        {
+            return NULL;
+        }
+
+        unsigned char* binary = (unsigned char*)malloc(fileSize);
+        MALLOC_CHECK(binary);
+        ScopeFree cleanup1(binary);
+
+        if (1 != fread(binary, fileSize, 1, fp))
+        {
+            return NULL;
+        }
+
+        const size_t binarySize = size_t(fileSize);
+        const unsigned char* binaries[1] = { binary };
+        cl_int binaryStatus;
+        cl_int err;
+        cl_program program = clCreateProgramWithBinary(_context, 1, &_device, &binarySize, binaries, &binaryStatus, &err);
+        if (CL_SUCCESS != err || CL_SUCCESS != binaryStatus)
+        {
+            if (NULL != program)
+            {
+                clReleaseProgram(program);
+            }
+            return NULL;
+        }
+
+        if (!buildProgram(program, _device, _buildOptions))
+        {
+            clReleaseProgram(program);
+            return NULL;
+        }
+
+        return program;
+    }
+
+    static void saveProgramBinary(const char* _filePath, cl_program _program)
+    {
+        size_t binarySize = 0;
+        if (CL_SUCCESS != clGetProgramInfo(_program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, NULL)
+        ||  0 == binarySize)
+        {
+            return;
+        }
+
+        unsigned char* binary = (unsigned char*)malloc(binarySize);
+        MALLOC_CHECK(binary);
+        ScopeFree cleanup0(binary);
+
+        unsigned char* binaries[1] = { binary };
+        if (CL_SUCCESS != clGetProgramInfo(_program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, NULL))
+        {
+            return;
+        }
+
+        FILE* fp = fopen(_filePath, "wb");
+        if (NULL == fp)
+        {
+            WARN("Could not open file %s for writing.", _filePath);
+            return;
+        }
+        ScopeFclose cleanup1(fp);
+
+        CMFT_UNUSED size_t write;
+        write = fwrite(binary, binarySize, 1, fp);
+        DEBUG_CHECK(write == 1, "Error writing OpenCL program binary.");
+        FERROR_CHECK(fp);
+    }
+
+    cl_program ClContext::getProgram(const char* _sourceCode, const char* _buildOptions) const
+    {
+        if (NULL == m_context)
+        {
+            return NULL;
+        }
+
+        // Program binaries are device and driver specific.
+        HashMurmur2A murmur;
+        murmur.begin();
+        murmur.add(_sourceCode, (int)strlen(_sourceCode));
+        if (NULL != _buildOptions)
+        {
+            murmur.add(_buildOptions, (int)strlen(_buildOptions));
+        }
+        murmur.add(m_deviceName, (int)strlen(m_deviceName));
+        murmur.add(m_deviceVersion, (int)strlen(m_deviceVersion));
+        const uint32_t hash = murmur.end();
+
+        bx::MutexScope lock(m_programMutex);
+
+        // Return cached program.
+        for (uint8_t ii = 0; ii < m_numPrograms; ++ii)
+        {
+            if (hash == m_programs[ii].m_hash)
+            {
+                clRetainProgram(m_programs[ii].m_program);
+                return m_programs[ii].m_program;
+            }
+        }
+
+        // Try loading binary from disk.
+        cl_program program = NULL;
+        char binaryPath[CMFT_COUNTOF(m_binaryCacheDir)+32];
+        if ('\0' != m_binaryCacheDir[0])
+        {
+            sprintf(binaryPath, "%s/cmft_%08x.clbin", m_binaryCacheDir, hash);
+            program = loadProgramBinary(binaryPath, m_context, m_device, _buildOptions);
+            if (NULL != program)
+            {
+                INFO("Loaded OpenCL program binary %s.", binaryPath);
+            }
+        }
+
+        // Compile from source.
+        if (NULL == program)
+        {
+            cl_int err;
+            program = clCreateProgramWithSource(m_context, 1, (const char**)&_sourceCode, NULL, &err);
+            if (CL_SUCCESS != err)
+            {
+                WARN("Could not create OpenCL program. OpenCL source file probably missing!");
+                return NULL;
+            }
+
+            if (!buildProgram(program, m_device, _buildOptions))
+            {
+                clReleaseProgram(program);
+                return NULL;
+            }
+
+            if ('\0' != m_binaryCacheDir[0])
+            {
+                saveProgramBinary(binaryPath, program);
+            }
+        }
+
+        // Cache it. If cache is full, caller gets the only reference.
+        if (m_numPrograms < CMFT_CL_MAX_CACHED_PROGRAMS)
+        {
+            m_programs[m_numPrograms].m_hash = hash;
+            m_programs[m_numPrograms].m_program = program;
+            m_numPrograms++;
+
+            clRetainProgram(program);
+        }
+
+        return program;
     }
 
     /// Notice: do NOT use return value of this function for memory deallocation!
@@ -274,6 +843,136 @@ namespace cmft
         }
     }
 
+    static void sortDeviceScores(ClDeviceScore* _devices, uint32_t _num)
+    {
+        for (uint32_t ii = 1; ii < _num; ++ii)
+        {
+            const ClDeviceScore curr = _devices[ii];
+            uint32_t jj = ii;
+            for (; jj > 0 && _devices[jj-1].m_score < curr.m_score; --jj)
+            {
+                _devices[jj] = _devices[jj-1];
+            }
+            _devices[jj] = curr;
+        }
+    }
+
+    uint8_t clRankDevices(ClDeviceScore* _devices, uint8_t _max, ClCalibrateFn _calibrate, const char* _cacheDir)
+    {
+        cl_int err;
+
+        // Enumerate all devices of all platforms.
+        cl_platform_id platforms[8];
+        cl_uint numPlatforms;
+        if (CL_SUCCESS != clGetPlatformIDs(8, platforms, &numPlatforms))
+        {
+            return 0;
+        }
+
+        ClDeviceScore found[CMFT_CL_MAX_DEVICES];
+        uint32_t numFound = 0;
+
+        // Scores are only valid for the same devices and drivers.
+        HashMurmur2A murmur;
+        murmur.begin();
+        for (cl_uint ii = 0; ii < numPlatforms; ++ii)
+        {
+            cl_device_id devices[8];
+            cl_uint numDevices;
+            err = clGetDeviceIDs(platforms[ii], CL_DEVICE_TYPE_ALL, 8, devices, &numDevices);
+            if (CL_SUCCESS != err)
+            {
+                continue;
+            }
+
+            for (cl_uint jj = 0; jj < numDevices && numFound < CMFT_CL_MAX_DEVICES; ++jj)
+            {
+                ClDeviceScore& device = found[numFound++];
+                device.m_platform = platforms[ii];
+                device.m_device = devices[jj];
+                device.m_score = 0.0;
+
+                char driverVersion[128];
+                CL_CHECK(clGetDeviceInfo(devices[jj], CL_DEVICE_NAME, sizeof(device.m_name), device.m_name, NULL));
+                CL_CHECK(clGetDeviceInfo(devices[jj], CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL));
+                murmur.add(device.m_name, (int)strlen(device.m_name));
+                murmur.add(driverVersion, (int)strlen(driverVersion));
+            }
+        }
+        const uint32_t hash = murmur.end();
+
+        // Load cached scores, one line per device in enumeration order.
+        char cachePath[1024];
+        cachePath[0] = '\0';
+        bool cached = false;
+        if (NULL != _cacheDir && '\0' != _cacheDir[0])
+        {
+            snprintf(cachePath, sizeof(cachePath), "%s/cmft_devices_%08x.txt", _cacheDir, hash);
+
+            FILE* fp = fopen(cachePath, "r");
+            if (NULL != fp)
+            {
+                ScopeFclose cleanup(fp);
+
+                uint32_t numRead = 0;
+                for (; numRead < numFound; ++numRead)
+                {
+                    if (1 != fscanf(fp, "%lf%*[^\n]", &found[numRead].m_score))
+                    {
+                        break;
+                    }
+                }
+                cached = (numRead == numFound);
+            }
+        }
+
+        // Calibrate.
+        if (!cached)
+        {
+            for (uint32_t ii = 0; ii < numFound; ++ii)
+            {
+                ClContext context;
+                context.setBinaryCacheDir(_cacheDir);
+                if (context.init(found[ii].m_platform, found[ii].m_device))
+                {
+                    found[ii].m_score = _calibrate(&context);
+                    context.destroy();
+                }
+
+                INFO("OpenCL device %-40s calibration score %.2f.", trimWhitespace(found[ii].m_name), found[ii].m_score);
+            }
+
+            if ('\0' != cachePath[0])
+            {
+                FILE* fp = fopen(cachePath, "w");
+                if (NULL == fp)
+                {
+                    WARN("Could not open file %s for writing.", cachePath);
+                }
+                else
+                {
+                    ScopeFclose cleanup(fp);
+
+                    for (uint32_t ii = 0; ii < numFound; ++ii)
+                    {
+                        fprintf(fp, "%f %s\n", found[ii].m_score, trimWhitespace(found[ii].m_name));
+                    }
+                    FERROR_CHECK(fp);
+                }
+            }
+        }
+
+        sortDeviceScores(found, numFound);
+
+        uint8_t num = 0;
+        for (; num < _max && num < numFound && 0.0 < found[num].m_score; ++num)
+        {
+            _devices[num] = found[num];
+        }
+
+        return num;
+    }
+
 } // namespace cmft
 
 /* vim: set sw=4 ts=4 expandtab: */
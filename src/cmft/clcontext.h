@@ -12,6 +12,7 @@
 
 #include <bx/string.h>
 #include <bx/cl.h>
+#include <bx/mutex.h>
 
 namespace cmft
 {
@@ -22,6 +23,7 @@ namespace cmft
 #define CL_VENDOR_OTHER    (0x8)
 #define CL_VENDOR_ANY_GPU  (CL_VENDOR_AMD|CL_VENDOR_NVIDIA)
 #define CL_VENDOR_ANY_CPU  (CL_VENDOR_AMD|CL_VENDOR_INTEL)
+#define CL_VENDOR_AUTO     (0x10) //!< Devices are ranked by clRankDevices(), not picked by vendor.
 
 // CL check.
 #ifndef CMFT_ENABLE_CL_CHECK
@@ -56,15 +58,87 @@ namespace cmft
         abort();                                                                      \
     }
 
+#define CMFT_CL_MAX_CACHED_PROGRAMS 32
+#define CMFT_CL_MAX_CONTEXTS 8
+
+// Device memory objects kept by a context for reuse, so consecutive filter calls of the same size don't allocate again.
+#ifndef CMFT_CL_MAX_POOLED_MEM
+    #define CMFT_CL_MAX_POOLED_MEM 32
+#endif // CMFT_CL_MAX_POOLED_MEM
+
+// Total size of pooled memory objects in bytes, oldest ones are released first above it. 0 disables pooling.
+#ifndef CMFT_CL_MEM_POOL_SIZE
+    #define CMFT_CL_MEM_POOL_SIZE (512<<20)
+#endif // CMFT_CL_MEM_POOL_SIZE
+
+// Context properties of texture sharing, as in cl_gl.h and cl_d3d11.h, for headers that don't come with them.
+#ifndef CL_GL_CONTEXT_KHR
+    #define CL_GL_CONTEXT_KHR           0x2008
+    #define CL_EGL_DISPLAY_KHR          0x2009
+    #define CL_GLX_DISPLAY_KHR          0x200A
+    #define CL_WGL_HDC_KHR              0x200B
+    #define CL_CGL_SHAREGROUP_KHR       0x200C
+#endif // CL_GL_CONTEXT_KHR
+
+#ifndef CL_CONTEXT_D3D11_DEVICE_KHR
+    #define CL_CONTEXT_D3D11_DEVICE_KHR 0x401D
+#endif // CL_CONTEXT_D3D11_DEVICE_KHR
+
+#define CMFT_GL_TEXTURE_CUBE_MAP_POSITIVE_X 0x8515
+
+    /// Graphics API whose textures a context can use in place.
+    struct ClSharing
+    {
+        enum Enum
+        {
+            None,
+            Gl,    //!< cl_khr_gl_sharing.
+            D3D11, //!< cl_khr_d3d11_sharing.
+        };
+    };
+
+    /// Cubemap texture of the graphics API a context shares textures with. GL texture is given by its name, D3D11 one as
+    /// ID3D11Texture2D* of a six slice texture array. D3D11 subresources are mip + face*m_numMips, so m_numMips has to be
+    /// the mip count the texture was created with.
+    struct ClSharedTexture
+    {
+        ClSharedTexture()
+            : m_glName(0)
+            , m_d3d11Texture(NULL)
+            , m_numMips(1)
+        {
+        }
+
+        uint32_t m_glName;
+        void* m_d3d11Texture;
+        uint8_t m_numMips;
+    };
+
+    typedef cl_mem (CL_API_CALL* ClCreateFromGlTextureFn)(cl_context, cl_mem_flags, cl_uint /*GLenum*/, cl_int /*GLint*/, cl_uint /*GLuint*/, cl_int*);
+    typedef cl_mem (CL_API_CALL* ClCreateFromD3D11Texture2DFn)(cl_context, cl_mem_flags, void* /*ID3D11Texture2D**/, cl_uint, cl_int*);
+    typedef cl_int (CL_API_CALL* ClEnqueueSharedObjectsFn)(cl_command_queue, cl_uint, const cl_mem*, cl_uint, const cl_event*, cl_event*);
+
     struct ClContext
     {
         ClContext()
             : m_device(NULL)
+            , m_parentDevice(NULL)
             , m_context(NULL)
             , m_commandQueue(NULL)
+            , m_numComputeUnits(0)
+            , m_sharing(ClSharing::None)
+            , m_createFromGlTexture(NULL)
+            , m_createFromD3D11Texture2D(NULL)
+            , m_enqueueAcquireShared(NULL)
+            , m_enqueueReleaseShared(NULL)
+            , m_numPrograms(0)
+            , m_numPooledMem(0)
+            , m_pooledMemSize(0)
         {
             m_deviceVendor[0] = '\0';
             m_deviceName[0] = '\0';
+            m_deviceVersion[0] = '\0';
+            m_binaryCacheDir[0] = '\0';
         }
 
         bool init(uint8_t _vendor                     = CL_VENDOR_ANY_GPU
@@ -73,19 +147,121 @@ namespace cmft
                 , char* _vendorStrPart                = NULL
                 );
 
+        /// Creates context and command queue on _device of _platform.
+        /// With _sharing, context shares textures with the graphics context given by _sharingProperties, a 0 terminated list of
+        /// CL_GL_CONTEXT_KHR with CL_GLX_DISPLAY_KHR, CL_WGL_HDC_KHR or CL_EGL_DISPLAY_KHR, or of CL_CONTEXT_D3D11_DEVICE_KHR.
+        /// CL_CONTEXT_PLATFORM is added. _device has to be the device the graphics context runs on.
+        bool init(cl_platform_id _platform
+                , cl_device_id _device
+                , ClSharing::Enum _sharing = ClSharing::None
+                , const cl_context_properties* _sharingProperties = NULL
+                );
+
         void destroy();
 
+        /// Replaces the device with a sub-device of its first _numComputeUnits compute units, for CPU devices sharing
+        /// the machine with native filter threads. Programs compiled so far are released. Requires OpenCL 1.2.
+        /// Returns false and keeps the current device if it can not be partitioned, contexts sharing textures never are.
+        bool partition(uint32_t _numComputeUnits);
+
+        /// Compiled programs are kept for the lifetime of the context.
+        /// If directory is set, program binaries are also stored there and loaded instead of compiling on subsequent runs.
+        void setBinaryCacheDir(const char* _dirPath);
+
+        /// Returns compiled program for the given source and build options (e.g. "-D NAME=VALUE"). Cached per context by source and options hash.
+        /// Returned program is retained and should be released with clReleaseProgram() by the caller.
+        cl_program getProgram(const char* _sourceCode, const char* _buildOptions = NULL) const;
+
+        /// Returns a pooled 2D image of the same flags, format and size, or creates a new one. Contents are undefined.
+        /// Memory objects are given back with releaseMem(). Host pointer flags are not allowed.
+        cl_mem acquireImage2D(cl_mem_flags _flags, const cl_image_format& _format, size_t _width, size_t _height, cl_int* _err) const;
+
+        /// Returns a pooled buffer of the same flags and size, or creates a new one. Contents are undefined.
+        cl_mem acquireBuffer(cl_mem_flags _flags, size_t _size, cl_int* _err) const;
+
+        /// Keeps memory object for a later acquire, or releases it when it can't be pooled. NULL is ignored.
+        /// Commands still using the object have to be on the queue its next user enqueues to, or complete.
+        void releaseMem(cl_mem _mem) const;
+
+        /// Releases all pooled memory objects.
+        void releaseMemPool() const;
+
+        /// Wraps _face of _mip of a shared cubemap texture into a 2D image. Images are released with clReleaseMemObject(), not
+        /// with releaseMem(). Returns NULL if the context doesn't share textures or the texture can't be wrapped.
+        cl_mem createFromSharedTexture(const ClSharedTexture& _texture, cl_mem_flags _flags, uint8_t _face, uint8_t _mip, cl_int* _err) const;
+
+        /// Takes images over from the graphics API for commands enqueued to m_commandQueue afterwards.
+        /// Graphics API has to be done with the textures, e.g. after glFinish() or a D3D11 event query.
+        bool acquireShared(const cl_mem* _mems, uint32_t _num) const;
+
+        /// Hands images back to the graphics API once commands enqueued so far are done, and waits for that.
+        bool releaseShared(const cl_mem* _mems, uint32_t _num) const;
+
         cl_device_id m_device;
+        cl_device_id m_parentDevice;      //!< Device m_device was partitioned from, NULL if it is not a sub-device.
         cl_context m_context;
         cl_command_queue m_commandQueue;
         cl_device_type m_deviceType;
+        uint32_t m_numComputeUnits;
+        ClSharing::Enum m_sharing;
+        ClCreateFromGlTextureFn m_createFromGlTexture;
+        ClCreateFromD3D11Texture2DFn m_createFromD3D11Texture2D;
+        ClEnqueueSharedObjectsFn m_enqueueAcquireShared;
+        ClEnqueueSharedObjectsFn m_enqueueReleaseShared;
         char m_deviceVendor[128];
         char m_deviceName[128];
+        char m_deviceVersion[128];
+        char m_binaryCacheDir[512];
+
+        struct CachedProgram
+        {
+            uint32_t m_hash;
+            cl_program m_program;
+        };
+
+        mutable bx::Mutex m_programMutex;
+        mutable CachedProgram m_programs[CMFT_CL_MAX_CACHED_PROGRAMS];
+        mutable uint8_t m_numPrograms;
+
+        struct PooledMem
+        {
+            cl_mem m_mem;
+            cl_mem_flags m_flags;
+            cl_mem_object_type m_type;
+            cl_image_format m_format; //!< Images only.
+            size_t m_width;           //!< Buffer size for buffers.
+            size_t m_height;
+            size_t m_size;
+        };
+
+        mutable bx::Mutex m_memPoolMutex;
+        mutable PooledMem m_pooledMem[CMFT_CL_MAX_POOLED_MEM]; //!< Oldest first.
+        mutable uint8_t m_numPooledMem;
+        mutable uint64_t m_pooledMemSize;
     };
 
     ///
     void clPrintDevices();
 
+#define CMFT_CL_MAX_DEVICES 32
+
+    /// Device found by clRankDevices().
+    struct ClDeviceScore
+    {
+        cl_platform_id m_platform;
+        cl_device_id m_device;
+        double m_score;           //!< Calibration result, higher is faster.
+        char m_name[128];
+    };
+
+    /// Runs a short benchmark on _clContext and returns its score, higher is faster. Zero means device is unusable.
+    typedef double (*ClCalibrateFn)(const ClContext* _clContext);
+
+    /// Scores all devices of all platforms with _calibrate and returns up to _max devices with non-zero score, fastest first.
+    /// With _cacheDir, scores are stored there per set of devices and drivers, and later runs on the same machine load them
+    /// instead of calibrating again. Program binaries built while calibrating are cached there too.
+    uint8_t clRankDevices(ClDeviceScore* _devices, uint8_t _max, ClCalibrateFn _calibrate, const char* _cacheDir = NULL);
+
 
 } // namespace cmft
 
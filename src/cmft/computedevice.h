@@ -0,0 +1,124 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_COMPUTEDEVICE_H_HEADER_GUARD
+#define CMFT_COMPUTEDEVICE_H_HEADER_GUARD
+
+#include "base/config.h"
+
+#include <stdint.h>
+
+namespace cmft
+{
+    struct Image;
+    struct RadianceFilterParams;
+
+    /// Compute API a ComputeDevice runs on.
+    struct ComputeBackend
+    {
+        enum Enum
+        {
+            OpenCL, //!< RadianceProgram in cubemapfilter.cpp, on a ClContext.
+
+            Count
+        };
+    };
+
+    /// Transfers and device times of a ComputeDevice, summed over the faces it filtered.
+    struct ComputeDeviceStats
+    {
+        ComputeDeviceStats()
+            : m_bytesToDevice(0)
+            , m_bytesFromDevice(0)
+            , m_uploadTime(0.0)
+            , m_kernelTime(0.0)
+            , m_readTime(0.0)
+            , m_hostIdleTime(0.0)
+        {
+        }
+
+        uint64_t m_bytesToDevice;   //!< Zero for sources used in place in host memory.
+        uint64_t m_bytesFromDevice; //!< Zero for results written straight into host memory.
+        double m_uploadTime;        //!< Device times in seconds, measured only when profiling.
+        double m_kernelTime;
+        double m_readTime;
+        double m_hostIdleTime;      //!< Time the host thread spent blocked on the device.
+    };
+
+    /// Radiance filter device driven by a GPU host thread of the radiance task list. The host thread picks faces, or row bands
+    /// of them, from the task list and keeps up to CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT of them submitted at once, each in its own slot.
+    /// Faces get to a device only through this interface, so another compute API plugs into the CPU/GPU scheduling by implementing it.
+    struct ComputeDevice
+    {
+        virtual ~ComputeDevice() = 0;
+
+        ///
+        virtual ComputeBackend::Enum getBackend() const = 0;
+
+        /// Filter program is built and the device can take faces.
+        virtual bool isValid() const = 0;
+
+        /// Device times of the last completed task are measured, see getTaskKernelTime() and getTaskReadTime().
+        virtual bool isProfiling() const = 0;
+
+        /// Faces can be filtered in row bands. Otherwise filterRows() is only given whole faces.
+        virtual bool canFilterRows() const = 0;
+
+        /// Faces can be packed into RadianceFilterParams::m_encodedDstPtr on the device.
+        virtual bool canEncode() const = 0;
+
+        /// Small faces can be filtered many at a time by filterBatch().
+        virtual bool canBatch() const = 0;
+
+        /// Number of faces of _cellSize filterBatch() takes at once, returns cells per atlas row in _cellsPerRow.
+        virtual uint32_t maxBatchCells(uint32_t _cellSize, uint32_t& _cellsPerRow) const = 0;
+
+        /// Filters _numTasks faces no larger than _cellSize and blocks until results are written. No slot may be in use.
+        virtual void filterBatch(const RadianceFilterParams* const* _tasks, uint32_t _numTasks, uint32_t _cellSize) = 0;
+
+        /// Source cubemap faces are filtered from, NULL before the first setSource().
+        virtual const Image* getSource() const = 0;
+
+        /// Replaces source cubemap and its normal/solid angle table. No slot may be in use.
+        virtual void setSource(const Image& _imageRgba32f, const float* _cubemapNormalSolidAngle) = 0;
+
+        /// Filters rows [_yBegin, _yEnd) of the face into _out in slot _slot, in dispatches of about _dispatchRows rows.
+        /// With _encode, whole face is packed into _out in the output format. Returns without waiting, see wait().
+        virtual void filterRows(uint8_t _slot
+                              , const RadianceFilterParams& _params
+                              , void* _out
+                              , uint32_t _yBegin
+                              , uint32_t _yEnd
+                              , uint32_t _dispatchRows
+                              , bool _encode
+                              ) = 0;
+
+        /// Blocks until results of slot _slot are in host memory.
+        virtual void wait(uint8_t _slot) = 0;
+
+        /// Blocks until source uploads are done. Called once all faces are.
+        virtual void waitUploads() = 0;
+
+        /// Device works on host memory. Source faces and normal tables are read in place instead of uploaded, and results are
+        /// written into their destinations instead of read back, whenever their alignment and layout allow it.
+        virtual bool hasHostUnifiedMemory() const = 0;
+
+        ///
+        virtual void getStats(ComputeDeviceStats& _stats) const = 0;
+
+        /// Device times in seconds of the last task completed by wait(), when profiling.
+        virtual double getTaskKernelTime() const = 0;
+        virtual double getTaskReadTime() const = 0;
+    };
+
+    inline ComputeDevice::~ComputeDevice()
+    {
+    }
+
+} // namespace cmft
+
+#endif //CMFT_COMPUTEDEVICE_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -7,9 +7,15 @@
 
 #include "base/config.h"
 #include "base/utils.h"
+#include "base/half.h"
 #include "cubemaputils.h"
 #include "radiance.h"
+#include "irradiance.h"
+#include "resample.h"
 #include "messages.h"
+#include "threadpool.h"
+#include "profiler.h"
+#include "computedevice.h"
 
 #include <stdlib.h> //malloc
 #include <string.h> //memset
@@ -18,8 +24,79 @@
 
 #include <bx/timer.h> //bx::getHPFrequency
 #include <bx/os.h> //bx::sleep
-#include <bx/thread.h> //bx::thread
 #include <bx/mutex.h> //bx::mutex
+#include <bx/float4_t.h> //bx::float4_t
+
+// Vectorized radiance filter inner loop is used when bx provides native SIMD float4_t implementation (SSE2/NEON).
+#ifndef CMFT_RADIANCE_SIMD
+    #if defined(BX_FLOAT4_SSE_H_HEADER_GUARD) || defined(BX_FLOAT4_NEON_H_HEADER_GUARD)
+        #define CMFT_RADIANCE_SIMD 1
+    #else
+        #define CMFT_RADIANCE_SIMD 0
+    #endif
+#endif // CMFT_RADIANCE_SIMD
+
+// Structure-of-arrays layout of normals and source colors for the vectorized radiance filter inner loop.
+#ifndef CMFT_RADIANCE_SOA
+    #define CMFT_RADIANCE_SOA CMFT_RADIANCE_SIMD
+#endif // CMFT_RADIANCE_SOA
+
+// Texels of neighbour faces kept around each face of the SoA layout. Filters narrower than the band read one rectangle. Multiple of 4, 0 disables.
+#ifndef CMFT_RADIANCE_GUARD_BAND
+    #define CMFT_RADIANCE_GUARD_BAND 16
+#endif // CMFT_RADIANCE_GUARD_BAND
+
+// Texels per side of square tiles the SoA planes are stored in, all planes of a tile are next to each other.
+// Filter rectangles are read tile by tile instead of row by row across the face. Multiple of 4, 0 keeps rows of the whole face.
+#ifndef CMFT_RADIANCE_SOA_TILE
+    #define CMFT_RADIANCE_SOA_TILE 0
+#endif // CMFT_RADIANCE_SOA_TILE
+
+// Normal cone blocks of the source with no color channel above the tolerance only accumulate lobe weights, their colors are not read.
+// At 0 only black blocks are left out and results don't change, dim blocks are taken as black above it. Negative disables.
+#ifndef CMFT_RADIANCE_BLACK_BLOCK_TOLERANCE
+    #define CMFT_RADIANCE_BLACK_BLOCK_TOLERANCE 0.0f
+#endif // CMFT_RADIANCE_BLACK_BLOCK_TOLERANCE
+
+// Taps per equator texel spacing around each row of latlong radiance output. Rows with fewer taps than texels, towards the poles,
+// are interpolated around their ring. 0 filters every texel.
+#ifndef CMFT_RADIANCE_LATLONG_RING_DENSITY
+    #define CMFT_RADIANCE_LATLONG_RING_DENSITY 1.0f
+#endif // CMFT_RADIANCE_LATLONG_RING_DENSITY
+
+// Bands of the spherical harmonics used for radiance mips with wide lobes. Such mips are convolved in the SH domain
+// instead of filtering the whole cube for every texel. 0 disables.
+#ifndef CMFT_RADIANCE_SH_ORDER
+    #define CMFT_RADIANCE_SH_ORDER 16
+#endif // CMFT_RADIANCE_SH_ORDER
+
+// Mip is convolved in the SH domain if the lobe coefficients of the first bands left out are below this value.
+#ifndef CMFT_RADIANCE_SH_EPSILON
+    #define CMFT_RADIANCE_SH_EPSILON 0.001
+#endif // CMFT_RADIANCE_SH_EPSILON
+
+// Intervals of the per mip table of lobe weights over [specularAngle, 1], looked up instead of evaluating pow() per texel. 0 disables.
+#ifndef CMFT_RADIANCE_LOBE_TABLE
+    #define CMFT_RADIANCE_LOBE_TABLE 1024
+#endif // CMFT_RADIANCE_LOBE_TABLE
+
+// Lobe table lookups interpolate linearly between neighbouring entries, otherwise the nearest entry is taken.
+#ifndef CMFT_RADIANCE_LOBE_TABLE_LERP
+    #define CMFT_RADIANCE_LOBE_TABLE_LERP 1
+#endif // CMFT_RADIANCE_LOBE_TABLE_LERP
+
+// Hardware half to float conversion (x86 F16C), used when reading RGBA16F source in the radiance filter inner loop.
+#ifndef CMFT_F16C
+    #if defined(__F16C__)
+        #define CMFT_F16C 1
+    #else
+        #define CMFT_F16C 0
+    #endif
+#endif // CMFT_F16C
+
+#if CMFT_F16C
+    #include <immintrin.h>
+#endif // CMFT_F16C
 
 namespace cmft
 {
@@ -30,20 +107,60 @@ namespace cmft
 #define PI64    201.06192982974676726160917652988818458861884156000677
 #define SQRT_PI 1.7724538509055160272981674833411451827975494561223871
 
+    /// Texels per side of a normal cone block.
+#ifndef CMFT_NORMAL_CONE_BLOCK_SIZE
+    #define CMFT_NORMAL_CONE_BLOCK_SIZE 8
+#endif //CMFT_NORMAL_CONE_BLOCK_SIZE
+
+    // Alignment of normal/solid angle tables, so devices sharing host memory can use them in place (see initDeviceMemory()).
+    // Allocator and the allocation itself are stored in front of the table.
+#define CMFT_NORMAL_TABLE_ALIGN 4096
+
+    static inline uint32_t normalConeBlocksPerSide(uint32_t _cubemapFaceSize)
+    {
+        return (_cubemapFaceSize + CMFT_NORMAL_CONE_BLOCK_SIZE-1)/CMFT_NORMAL_CONE_BLOCK_SIZE;
+    }
+
+    /// Returns normal cones stored after the normal/solid angle table built by buildCubemapNormalSolidAngle().
+    static inline const float* cubemapNormalCones(const float* _cubemapNormalSolidAngle, uint32_t _cubemapFaceSize)
+    {
+        return _cubemapNormalSolidAngle + size_t(_cubemapFaceSize)*_cubemapFaceSize*6*4;
+    }
+
+    /// Returns true if none of the block normals are within the specular angle of the tap vector.
+    /// Cone with axis a and half-angle b is outside when angle(tap, a) > specularAngle + b.
+    static inline bool normalConeOutside(const float* _cone, const float* _tapVec, float _cosAngle, float _sinAngle)
+    {
+        const float cosCone = _cone[3];
+        const float sinCone = sqrtf(max(0.0f, 1.0f - cosCone*cosCone));
+        return vec3Dot(_cone, _tapVec) < _cosAngle*cosCone - _sinAngle*sinCone;
+    }
+
     /// Creates a cubemap containing tap vectors and solid angle of each texel on the cubemap.
     /// Output consists of 6 faces of specified size containing (x,y,z,angle) floats for each texel.
+    /// It is followed by bounding cones (x,y,z,cosHalfAngle) of the normals of each CMFT_NORMAL_CONE_BLOCK_SIZE^2 texel block,
+    /// see cubemapNormalCones().
     ///
-    /// Memory should be freed outside of the function !
+    /// Table is taken from the calling thread's allocator, release it with freeCubemapNormalSolidAngle().
     float* buildCubemapNormalSolidAngle(uint32_t _cubemapFaceSize)
     {
-        const uint32_t size = _cubemapFaceSize /*width*/
-                            * _cubemapFaceSize /*height*/
+        CMFT_PROFILE_ZONE("buildCubemapNormalSolidAngle");
+        AllocTagScope allocTag(AllocTag::NormalTable);
+
+        const uint32_t blocksPerSide = normalConeBlocksPerSide(_cubemapFaceSize);
+        const uint32_t size = (_cubemapFaceSize*_cubemapFaceSize + blocksPerSide*blocksPerSide)
                             * 6 /*numFaces*/
                             * 4 /*numChannels*/
                             * 4 /*bytesPerChannel*/
                             ;
-        float* dst = (float*)malloc(size);
-        MALLOC_CHECK(dst);
+        // Allocator is stored in front of the table, cached tables are freed from wherever the cache gets flushed.
+        Allocator* allocator = getAllocator();
+        uint8_t* mem = (uint8_t*)allocator->alloc(size + CMFT_NORMAL_TABLE_ALIGN + 2*sizeof(void*));
+        MALLOC_CHECK(mem);
+        float* dst = (float*)((uintptr_t(mem) + 2*sizeof(void*) + CMFT_NORMAL_TABLE_ALIGN-1) & ~uintptr_t(CMFT_NORMAL_TABLE_ALIGN-1));
+        void** header = (void**)dst - 2;
+        header[0] = (void*)allocator;
+        header[1] = (void*)mem;
 
         const float invFaceSize = 1.0f/float(int32_t(_cubemapFaceSize));
 
@@ -68,1601 +185,18471 @@ namespace cmft
             }
         }
 
-        return dst;
-    }
-
-    // Irradiance.
-    //-----
-
-    void evalSHBasis5(double* _shBasis, const float* _dir)
-    {
-        const double x = double(_dir[0]);
-        const double y = double(_dir[1]);
-        const double z = double(_dir[2]);
-
-        const double x2 = x*x;
-        const double y2 = y*y;
-        const double z2 = z*z;
-
-        const double z3 = pow(z, 3.0);
-
-        const double x4 = pow(x, 4.0);
-        const double y4 = pow(y, 4.0);
-        const double z4 = pow(z, 4.0);
-
-        //Equations based on data from: http://ppsloan.org/publications/StupidSH36.pdf
-        _shBasis[ 0] =  1.0/(2.0*SQRT_PI);
-
-        _shBasis[ 1] = -sqrt(3.0/PI4)*y;
-        _shBasis[ 2] =  sqrt(3.0/PI4)*z;
-        _shBasis[ 3] = -sqrt(3.0/PI4)*x;
-
-        _shBasis[ 4] =  sqrt(15.0/PI4)*y*x;
-        _shBasis[ 5] = -sqrt(15.0/PI4)*y*z;
-        _shBasis[ 6] =  sqrt(5.0/PI16)*(3.0*z2-1.0);
-        _shBasis[ 7] = -sqrt(15.0/PI4)*x*z;
-        _shBasis[ 8] =  sqrt(15.0/PI16)*(x2-y2);
-
-        _shBasis[ 9] = -sqrt( 70.0/PI64)*y*(3*x2-y2);
-        _shBasis[10] =  sqrt(105.0/ PI4)*y*x*z;
-        _shBasis[11] = -sqrt( 21.0/PI16)*y*(-1.0+5.0*z2);
-        _shBasis[12] =  sqrt(  7.0/PI16)*(5.0*z3-3.0*z);
-        _shBasis[13] = -sqrt( 42.0/PI64)*x*(-1.0+5.0*z2);
-        _shBasis[14] =  sqrt(105.0/PI16)*(x2-y2)*z;
-        _shBasis[15] = -sqrt( 70.0/PI64)*x*(x2-3.0*y2);
-
-        _shBasis[16] =  3.0*sqrt(35.0/PI16)*x*y*(x2-y2);
-        _shBasis[17] = -3.0*sqrt(70.0/PI64)*y*z*(3.0*x2-y2);
-        _shBasis[18] =  3.0*sqrt( 5.0/PI16)*y*x*(-1.0+7.0*z2);
-        _shBasis[19] = -3.0*sqrt(10.0/PI64)*y*z*(-3.0+7.0*z2);
-        _shBasis[20] =  (105.0*z4-90.0*z2+9.0)/(16.0*SQRT_PI);
-        _shBasis[21] = -3.0*sqrt(10.0/PI64)*x*z*(-3.0+7.0*z2);
-        _shBasis[22] =  3.0*sqrt( 5.0/PI64)*(x2-y2)*(-1.0+7.0*z2);
-        _shBasis[23] = -3.0*sqrt(70.0/PI64)*x*z*(x2-3.0*y2);
-        _shBasis[24] =  3.0*sqrt(35.0/(4.0*PI64))*(x4-6.0*y2*x2+y4);
-    }
-
-    void cubemapShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], void* _data, uint32_t _faceSize, uint32_t _faceOffsets[6])
-    {
-        memset(_shCoeffs, 0, SH_COEFF_NUM*3*sizeof(double));
-
-        double weightAccum = 0.0;
-
-        // Build cubemap vectors.
-        float* cubemapVectors = buildCubemapNormalSolidAngle(_faceSize);
-        ScopeFree cleanup(cubemapVectors);
-        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        const uint32_t vectorPitch = _faceSize * bytesPerPixel;
-        const uint32_t vectorFaceDataSize = vectorPitch * _faceSize;
-
-        // Evaluate spherical harmonics coefficients.
+        // Normal cones.
         for (uint8_t face = 0; face < 6; ++face)
         {
-            const float* srcPtr = (const float*)((const uint8_t*)_data + _faceOffsets[face]);
-            const float* vecPtr = (const float*)((const uint8_t*)cubemapVectors + vectorFaceDataSize*face);
+            const float* faceNormals = dst + size_t(face)*_cubemapFaceSize*_cubemapFaceSize*4;
 
-            for (uint32_t texel = 0, count = _faceSize*_faceSize; texel < count; ++texel, srcPtr+=4, vecPtr+=4)
+            for (uint32_t blockY = 0; blockY < blocksPerSide; ++blockY)
             {
-                const double rr = double(srcPtr[0]);
-                const double gg = double(srcPtr[1]);
-                const double bb = double(srcPtr[2]);
+                const uint32_t yBegin = blockY*CMFT_NORMAL_CONE_BLOCK_SIZE;
+                const uint32_t yEnd = min(yBegin+CMFT_NORMAL_CONE_BLOCK_SIZE, _cubemapFaceSize);
 
-                double shBasis[SH_COEFF_NUM];
-                evalSHBasis5(shBasis, vecPtr);
+                for (uint32_t blockX = 0; blockX < blocksPerSide; ++blockX)
+                {
+                    const uint32_t xBegin = blockX*CMFT_NORMAL_CONE_BLOCK_SIZE;
+                    const uint32_t xEnd = min(xBegin+CMFT_NORMAL_CONE_BLOCK_SIZE, _cubemapFaceSize);
+
+                    // Axis is the normalized average normal.
+                    float sum[3] = { 0.0f, 0.0f, 0.0f };
+                    for (uint32_t yy = yBegin; yy < yEnd; ++yy)
+                    {
+                        for (uint32_t xx = xBegin; xx < xEnd; ++xx)
+                        {
+                            const float* normal = &faceNormals[(yy*_cubemapFaceSize + xx)*4];
+                            sum[0] += normal[0];
+                            sum[1] += normal[1];
+                            sum[2] += normal[2];
+                        }
+                    }
 
-                const double weight = (double)vecPtr[3];
+                    float* cone = dstPtr;
+                    vec3Norm(cone, sum);
 
-                for (uint8_t ii = 0; ii < SH_COEFF_NUM; ++ii)
-                {
-                    _shCoeffs[ii][0] += rr * shBasis[ii] * weight;
-                    _shCoeffs[ii][1] += gg * shBasis[ii] * weight;
-                    _shCoeffs[ii][2] += bb * shBasis[ii] * weight;
-                }
+                    // Half-angle is the widest normal, slightly widened to stay conservative.
+                    float cosCone = 1.0f;
+                    for (uint32_t yy = yBegin; yy < yEnd; ++yy)
+                    {
+                        for (uint32_t xx = xBegin; xx < xEnd; ++xx)
+                        {
+                            cosCone = min(cosCone, vec3Dot(cone, &faceNormals[(yy*_cubemapFaceSize + xx)*4]));
+                        }
+                    }
+                    cone[3] = max(-1.0f, cosCone - 1e-4f);
 
-                weightAccum += weight;
+                    dstPtr += 4;
+                }
             }
         }
 
-        // Normalization.
-        // This is not really necesarry because usually PI*4 - weightAccum ~= 0.000003
-        // so it doesn't change almost anything, but it doesn't cost much to have more corectness.
-        const double norm = PI4 / weightAccum;
-        for (uint8_t ii = 0; ii < SH_COEFF_NUM; ++ii)
-        {
-            _shCoeffs[ii][0] *= norm;
-            _shCoeffs[ii][1] *= norm;
-            _shCoeffs[ii][2] *= norm;
-        }
+        return dst;
     }
 
-    bool imageShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], const Image& _image)
+    void freeCubemapNormalSolidAngle(const float* _table)
     {
-        // Input image must be a cubemap.
-        if (!imageIsCubemap(_image))
-        {
-            return false;
-        }
-
-        // Processing is done in Rgba32f format.
-        Image imageRgba32f;
-        imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _image);
+        void** header = (void**)const_cast<float*>(_table) - 2;
+        ((Allocator*)header[0])->free(header[1]);
+    }
 
-        // Get face data offsets.
-        uint32_t faceOffsets[6];
-        imageGetFaceOffsets(faceOffsets, imageRgba32f);
+    /// Process-wide cache of normal/solid angle tables keyed by face size.
+    /// Tables are pure functions of face size, so they are kept around after release and reused by subsequent calls.
+    /// Unreferenced tables are evicted in least recently used order when the cache is full.
+    struct NormalSolidAngleCache
+    {
+        enum { MaxEntries = 8 };
 
-        // Compute spherical harmonic coefficients.
-        cubemapShCoeffs(_shCoeffs, imageRgba32f.m_data, imageRgba32f.m_width, faceOffsets);
+        struct Entry
+        {
+            float* m_data;
+            uint32_t m_faceSize;
+            uint32_t m_refCount;
+            uint64_t m_lastUsed;
+        };
 
-        // Cleanup.
-        if (TextureFormat::RGBA32F != _image.m_format)
+        NormalSolidAngleCache()
+            : m_useCounter(0)
         {
-            imageUnload(imageRgba32f);
+            memset(m_entries, 0, sizeof(m_entries));
         }
 
-        return true;
-    }
-
-    bool imageIrradianceFilterSh(Image& _dst, uint32_t _dstFaceSize, const Image& _src)
-    {
-        // Input image must be a cubemap.
-        if (!imageIsCubemap(_src))
+        ~NormalSolidAngleCache()
         {
-            return false;
+            flush();
         }
 
-        // Processing is done in Rgba32f format.
-        Image imageRgba32f;
-        imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+        const float* acquire(uint32_t _faceSize)
+        {
+            {
+                bx::MutexScope lock(m_mutex);
 
-        // Get face data offsets.
-        uint32_t faceOffsets[6];
-        imageGetFaceOffsets(faceOffsets, imageRgba32f);
+                // Return cached table.
+                for (uint8_t ii = 0; ii < MaxEntries; ++ii)
+                {
+                    Entry& entry = m_entries[ii];
+                    if (NULL != entry.m_data && _faceSize == entry.m_faceSize)
+                    {
+                        entry.m_refCount++;
+                        entry.m_lastUsed = ++m_useCounter;
+                        return entry.m_data;
+                    }
+                }
+            }
 
-        // Compute spherical harmonic coefficients.
-        double shRgb[SH_COEFF_NUM][3];
-        cubemapShCoeffs(shRgb, imageRgba32f.m_data, imageRgba32f.m_width, faceOffsets);
+            // Build outside of the lock, it can take a while for big faces.
+            float* data = buildCubemapNormalSolidAngle(_faceSize);
 
-        // Alloc dst data.
-        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _src.m_width : _dstFaceSize;
-        const uint8_t dstBytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        const uint32_t dstPitch = dstFaceSize*dstBytesPerPixel;
-        const uint32_t dstFaceDataSize = dstPitch * dstFaceSize;
-        const uint32_t dstDataSize = dstFaceDataSize * 6 /*numFaces*/;
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
+            bx::MutexScope lock(m_mutex);
 
-        // Build cubemap texel vectors.
-        float* cubemapVectors = buildCubemapNormalSolidAngle(dstFaceSize);
-        ScopeFree cleanup(cubemapVectors);
-        const uint8_t vectorBytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        const uint32_t vectorPitch = dstFaceSize * vectorBytesPerPixel;
-        const uint32_t vectorFaceDataSize = vectorPitch * dstFaceSize;
+            // Another thread might have built the same table in the meantime.
+            for (uint8_t ii = 0; ii < MaxEntries; ++ii)
+            {
+                Entry& entry = m_entries[ii];
+                if (NULL != entry.m_data && _faceSize == entry.m_faceSize)
+                {
+                    freeCubemapNormalSolidAngle(data);
+                    entry.m_refCount++;
+                    entry.m_lastUsed = ++m_useCounter;
+                    return entry.m_data;
+                }
+            }
 
-        uint64_t totalTime = bx::getHPCounter();
+            // Find free slot or least recently used unreferenced one.
+            Entry* slot = NULL;
+            for (uint8_t ii = 0; ii < MaxEntries; ++ii)
+            {
+                Entry& entry = m_entries[ii];
+                if (NULL == entry.m_data)
+                {
+                    slot = &entry;
+                    break;
+                }
 
-        // Output info.
-        INFO("Running irradiance filter for:\n"
-             "\t[srcFaceSize=%u]\n"
-             "\t[shOrder=5]\n"
-             "\t[dstFaceSize=%u]"
-             , imageRgba32f.m_width
-             , dstFaceSize
-             );
+                if (0 == entry.m_refCount
+                && (NULL == slot || entry.m_lastUsed < slot->m_lastUsed))
+                {
+                    slot = &entry;
+                }
+            }
 
-        // Compute irradiance using SH data.
-        for (uint8_t face = 0; face < 6; ++face)
-        {
-            float* dstPtr = (float*)((uint8_t*)dstData + dstFaceDataSize*face);
-            const float* vecPtr = (const float*)((const uint8_t*)cubemapVectors + vectorFaceDataSize*face);
+            // All slots are in use. Return uncached table, it will be freed on release.
+            if (NULL == slot)
+            {
+                return data;
+            }
 
-            for (uint32_t texel = 0, count = dstFaceSize*dstFaceSize; texel < count ;++texel, dstPtr+=4, vecPtr+=4)
+            if (NULL != slot->m_data)
             {
-                double shBasis[SH_COEFF_NUM];
-                evalSHBasis5(shBasis, vecPtr);
+                freeCubemapNormalSolidAngle(slot->m_data);
+            }
 
-                double rgb[3] = { 0.0, 0.0, 0.0 };
+            slot->m_data     = data;
+            slot->m_faceSize = _faceSize;
+            slot->m_refCount = 1;
+            slot->m_lastUsed = ++m_useCounter;
 
-                // Band 0 (factor 1.0)
-                rgb[0] += shRgb[0][0] * shBasis[0] * 1.0f;
-                rgb[1] += shRgb[0][1] * shBasis[0] * 1.0f;
-                rgb[2] += shRgb[0][2] * shBasis[0] * 1.0f;
+            return data;
+        }
 
-                // Band 1 (factor 2/3).
-                uint8_t ii = 1;
-                for (; ii < 4; ++ii)
-                {
-                    rgb[0] += shRgb[ii][0] * shBasis[ii] * (2.0f/3.0f);
-                    rgb[1] += shRgb[ii][1] * shBasis[ii] * (2.0f/3.0f);
-                    rgb[2] += shRgb[ii][2] * shBasis[ii] * (2.0f/3.0f);
-                }
+        void release(const float* _data)
+        {
+            bx::MutexScope lock(m_mutex);
 
-                // Band 2 (factor 1/4).
-                for (; ii < 9; ++ii)
+            for (uint8_t ii = 0; ii < MaxEntries; ++ii)
+            {
+                Entry& entry = m_entries[ii];
+                if (_data == entry.m_data)
                 {
-                    rgb[0] += shRgb[ii][0] * shBasis[ii] * (1.0f/4.0f);
-                    rgb[1] += shRgb[ii][1] * shBasis[ii] * (1.0f/4.0f);
-                    rgb[2] += shRgb[ii][2] * shBasis[ii] * (1.0f/4.0f);
+                    DEBUG_CHECK(0 != entry.m_refCount, "Releasing unreferenced normal table!");
+                    entry.m_refCount--;
+                    return;
                 }
+            }
 
-                // Band 3 (factor 0).
-                ii = 16;
+            // Uncached table.
+            freeCubemapNormalSolidAngle(_data);
+        }
+
+        void flush()
+        {
+            bx::MutexScope lock(m_mutex);
 
-                // Band 4 (factor -1/24).
-                for (; ii < 25; ++ii)
+            for (uint8_t ii = 0; ii < MaxEntries; ++ii)
+            {
+                Entry& entry = m_entries[ii];
+                if (NULL != entry.m_data && 0 == entry.m_refCount)
                 {
-                    rgb[0] += shRgb[ii][0] * shBasis[ii] * (-1.0f/24.0f);
-                    rgb[1] += shRgb[ii][1] * shBasis[ii] * (-1.0f/24.0f);
-                    rgb[2] += shRgb[ii][2] * shBasis[ii] * (-1.0f/24.0f);
+                    freeCubemapNormalSolidAngle(entry.m_data);
+                    memset(&entry, 0, sizeof(Entry));
                 }
-
-                dstPtr[0] = float(rgb[0]);
-                dstPtr[1] = float(rgb[1]);
-                dstPtr[2] = float(rgb[2]);
-                dstPtr[3] = 1.0f;
             }
         }
 
-        // Output progress info.
-        const double freq = double(bx::getHPFrequency());
-        const double toSec = 1.0/freq;
-        totalTime = bx::getHPCounter() - totalTime;
-        INFO("Irradiance -> Done! Total time: %.3f seconds.", double(totalTime)*toSec);
-
-        // Fill structure.
-        Image result;
-        result.m_width = dstFaceSize;
-        result.m_height = dstFaceSize;
-        result.m_dataSize = dstFaceSize /*width*/
-                          * dstFaceSize /*height*/
-                          * 6 /*numFaces*/
-                          * 4 /*numChannels*/
-                          * 4 /*bytesPerChannel*/
-                          ;
-        result.m_format = TextureFormat::RGBA32F;
-        result.m_numMips = 1;
-        result.m_numFaces = 6;
-        result.m_data = dstData;
+        bx::Mutex m_mutex;
+        uint64_t m_useCounter;
+        Entry m_entries[MaxEntries];
+    };
+    static NormalSolidAngleCache s_normalSolidAngleCache;
 
-        // Convert back to source format.
-        if (TextureFormat::RGBA32F == _src.m_format)
-        {
-            imageMove(_dst, result);
-        }
-        else
-        {
-            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
-            imageUnload(result);
-        }
+    /// Returns cached normal/solid angle table for the given face size. Has to be released with releaseCubemapNormalSolidAngle().
+    const float* acquireCubemapNormalSolidAngle(uint32_t _cubemapFaceSize)
+    {
+        return s_normalSolidAngleCache.acquire(_cubemapFaceSize);
+    }
 
-        return true;
+    void releaseCubemapNormalSolidAngle(const float* _cubemapNormalSolidAngle)
+    {
+        s_normalSolidAngleCache.release(_cubemapNormalSolidAngle);
     }
 
-    void imageIrradianceFilterSh(Image& _image, uint32_t _faceSize)
+    void cubemapNormalSolidAngleCacheFlush()
     {
-        Image tmp;
-        if (imageIrradianceFilterSh(tmp, _faceSize, _image))
-        {
-            imageMove(_image, tmp);
-        }
+        s_normalSolidAngleCache.flush();
     }
 
-    // Radiance.
+    // Filter settings.
     //-----
 
-    struct Aabb
+    static const FilterSettings s_defaultFilterSettings;
+
+    static inline const FilterSettings& filterSettings(const FilterSettings* _settings)
     {
-        Aabb()
+        return NULL != _settings ? *_settings : s_defaultFilterSettings;
+    }
+
+    static inline float filterLobeTolerance(const FilterSettings& _settings)
+    {
+        return clamp(_settings.m_lobeTolerance, FLT_MIN, 0.5f);
+    }
+
+    struct ScopeReleaseNormalSolidAngle : NoCopyNoAssign
+    {
+        ScopeReleaseNormalSolidAngle(const float* _ptr) : m_ptr(_ptr) { }
+
+        ~ScopeReleaseNormalSolidAngle()
         {
-            m_min[0] = FLT_MAX;
-            m_min[1] = FLT_MAX;
-            m_max[0] = -FLT_MAX;
-            m_max[1] = -FLT_MAX;
+            releaseCubemapNormalSolidAngle(m_ptr);
         }
 
-        void add(float _x, float _y)
+    private:
+        const float* m_ptr;
+    };
+
+    // 1 - SoA normal planes hold normals as 16-bit snorms and solid angles as 16-bit unorms scaled to the largest one,
+    //     8 bytes per texel instead of 16. Decoding is an integer to float conversion, snorm scale is applied to the tap
+    //     vector instead. Normals differ from the table by less than 0.00003, filtered texels by about 0.2% at most.
+    //     Pays off where the loop is bound by memory bandwidth, many cores on big faces.
+    // 0 - Normals and solid angles are kept as floats. Default: on a single core, conversions make the loop about 7% slower.
+#ifndef CMFT_RADIANCE_SOA_COMPACT_NORMALS
+    #define CMFT_RADIANCE_SOA_COMPACT_NORMALS 0
+#endif //CMFT_RADIANCE_SOA_COMPACT_NORMALS
+
+    /// Cubemap stored as separate float (or half) planes per face (for example nx, ny, nz, solidAngle).
+    /// Each row is padded and aligned to 64 bytes, so rows can be read with aligned SIMD loads past the face width.
+    /// With CMFT_RADIANCE_SOA_TILE, planes are stored in tiles of the padded face instead and rows are only contiguous
+    /// within a tile, see row() and tileLastX().
+    /// Faces are surrounded by a guard band of m_border texels copied from neighbour faces, rows and columns in
+    /// [-m_border, m_faceSize+m_border) are valid. Corners of the band do not map to any texel and are left zeroed.
+    struct SoaCubemap
+    {
+        enum
         {
-            m_min[0] = min(m_min[0], _x);
-            m_min[1] = min(m_min[1], _y);
-            m_max[0] = max(m_max[0], _x);
-            m_max[1] = max(m_max[1], _y);
-        }
+            MaxPlanes    = 4,
+            RowAlignment = 64,
+        };
 
-        inline void clampMin(float _x, float _y)
+        SoaCubemap()
+            : m_faceSize(0)
+            , m_border(0)
+            , m_pitch(0)
+            , m_numPlanes(0)
+            , m_bytesPerChannel(0)
+            , m_blocksPerSide(0)
+            , m_solidAngleScale(0.0f)
+            , m_mem(NULL)
+            , m_data(NULL)
+            , m_cones(NULL)
+            , m_blockMax(NULL)
+            , m_allocator(NULL)
+            , m_replicas(NULL)
+            , m_numReplicas(0)
         {
-            m_min[0] = max(m_min[0], _x);
-            m_min[1] = max(m_min[1], _y);
         }
 
-        inline void clampMax(float _x, float _y)
+        ~SoaCubemap()
         {
-            m_max[0] = min(m_max[0], _x);
-            m_max[1] = min(m_max[1], _y);
+            unload();
         }
 
-        void clamp(float _minX, float _minY, float _maxX, float _maxY)
+        /// Takes the first _numPlanes channels out of an interleaved 4-channel float cubemap.
+        void init(const float* _aos, uint32_t _faceSize, uint8_t _numPlanes, const uint64_t _faceOffsets[CUBE_FACE_NUM] = NULL)
         {
-            clampMin(_minX, _minY);
-            clampMax(_maxX, _maxY);
+            alloc(_faceSize, _numPlanes, 4);
+
+            const size_t aosFaceSize = size_t(_faceSize)*_faceSize*4 /*numChannels*/;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                const float* aosFace = (NULL == _faceOffsets)
+                                     ? _aos + aosFaceSize*face
+                                     : (const float*)((const uint8_t*)_aos + _faceOffsets[face])
+                                     ;
+
+                for (uint8_t plane = 0; plane < m_numPlanes; ++plane)
+                {
+                    for (uint32_t yy = 0; yy < _faceSize; ++yy)
+                    {
+                        const float* src = aosFace + size_t(yy)*_faceSize*4 + plane;
+                        for (uint32_t xx = 0; xx < _faceSize;)
+                        {
+                            float* dst = row(face, plane, int32_t(xx), int32_t(yy));
+                            const uint32_t xEnd = uint32_t(min(int32_t(_faceSize)-1, tileLastX(int32_t(xx))));
+                            for (; xx <= xEnd; ++xx)
+                            {
+                                dst[xx] = src[xx*4];
+                            }
+                        }
+                    }
+                }
+            }
+
+            fillGuardBand();
         }
 
-        void clamp(float _min, float _max)
+        /// Same as init() but takes the channels out of an interleaved 4-channel half cubemap and keeps them as halfs.
+        void initHalf(const uint16_t* _aos, uint32_t _faceSize, uint8_t _numPlanes, const uint64_t _faceOffsets[CUBE_FACE_NUM] = NULL)
         {
-            clampMin(_min, _min);
-            clampMax(_max, _max);
+            alloc(_faceSize, _numPlanes, 2);
+
+            const size_t aosFaceSize = size_t(_faceSize)*_faceSize*4 /*numChannels*/;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                const uint16_t* aosFace = (NULL == _faceOffsets)
+                                        ? _aos + aosFaceSize*face
+                                        : (const uint16_t*)((const uint8_t*)_aos + _faceOffsets[face])
+                                        ;
+
+                for (uint8_t plane = 0; plane < m_numPlanes; ++plane)
+                {
+                    for (uint32_t yy = 0; yy < _faceSize; ++yy)
+                    {
+                        const uint16_t* src = aosFace + size_t(yy)*_faceSize*4 + plane;
+                        for (uint32_t xx = 0; xx < _faceSize;)
+                        {
+                            uint16_t* dst = rowHalf(face, plane, int32_t(xx), int32_t(yy));
+                            const uint32_t xEnd = uint32_t(min(int32_t(_faceSize)-1, tileLastX(int32_t(xx))));
+                            for (; xx <= xEnd; ++xx)
+                            {
+                                dst[xx] = src[xx*4];
+                            }
+                        }
+                    }
+                }
+            }
+
+            fillGuardBand();
         }
 
-        bool isEmpty()
+        /// Takes normals and solid angles out of an interleaved normal and solid angle table as 16-bit planes, see
+        /// CMFT_RADIANCE_SOA_COMPACT_NORMALS and texelNormal().
+        void initCompactNormals(const float* _cubemapNormalSolidAngle, uint32_t _faceSize)
         {
-            // Has to have at least two points added so that no value is equal to initial state.
-            return ((m_min[0] ==  FLT_MAX)
-                  ||(m_min[1] ==  FLT_MAX)
-                  ||(m_max[0] == -FLT_MAX)
-                  ||(m_max[1] == -FLT_MAX)
-                   );
-        }
+            alloc(_faceSize, 4, 2);
+
+            const size_t numTexels = size_t(_faceSize)*_faceSize*CUBE_FACE_NUM;
+            float maxSolidAngle = 0.0f;
+            for (size_t ii = 0; ii < numTexels; ++ii)
+            {
+                maxSolidAngle = max(maxSolidAngle, _cubemapNormalSolidAngle[ii*4+3]);
+            }
+            m_solidAngleScale = maxSolidAngle/65535.0f;
+
+            const float invScale = (0.0f != maxSolidAngle) ? 65535.0f/maxSolidAngle : 0.0f;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                for (uint32_t yy = 0; yy < _faceSize; ++yy)
+                {
+                    const float* src = _cubemapNormalSolidAngle + (size_t(face)*_faceSize + yy)*_faceSize*4;
+                    for (uint32_t xx = 0; xx < _faceSize; ++xx, src += 4)
+                    {
+                        for (uint8_t plane = 0; plane < 3; ++plane)
+                        {
+                            rowHalf(face, plane, int32_t(xx), int32_t(yy))[xx] = uint16_t(int16_t(floorf(src[plane]*32767.0f + 0.5f)));
+                        }
+                        rowHalf(face, 3, int32_t(xx), int32_t(yy))[xx] = uint16_t(min(src[3]*invScale + 0.5f, 65535.0f));
+                    }
+                }
+            }
+
+            fillGuardBand();
+        }
+
+        /// Takes normals and solid angles out of a table built by buildCubemapNormalSolidAngle() and builds normal cones
+        /// of CMFT_NORMAL_CONE_BLOCK_SIZE^2 texel blocks of the padded faces, guard band included.
+        void initNormals(const float* _cubemapNormalSolidAngle, uint32_t _faceSize)
+        {
+            AllocTagScope allocTag(AllocTag::NormalTable);
+
+#if CMFT_RADIANCE_SOA_COMPACT_NORMALS
+            initCompactNormals(_cubemapNormalSolidAngle, _faceSize);
+#else
+            init(_cubemapNormalSolidAngle, _faceSize, 4);
+#endif // CMFT_RADIANCE_SOA_COMPACT_NORMALS
+
+            const uint32_t paddedSize = _faceSize + 2*m_border;
+            m_blocksPerSide = normalConeBlocksPerSide(paddedSize);
+            m_cones = (float*)m_allocator->alloc(size_t(m_blocksPerSide)*m_blocksPerSide*CUBE_FACE_NUM*4*sizeof(float));
+            MALLOC_CHECK(m_cones);
+
+            const int32_t border = int32_t(m_border);
+            float* dstPtr = m_cones;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                for (uint32_t blockY = 0; blockY < m_blocksPerSide; ++blockY)
+                {
+                    const int32_t yBegin = int32_t(blockY*CMFT_NORMAL_CONE_BLOCK_SIZE) - border;
+                    const int32_t yEnd = min(yBegin+CMFT_NORMAL_CONE_BLOCK_SIZE, int32_t(paddedSize) - border);
+
+                    for (uint32_t blockX = 0; blockX < m_blocksPerSide; ++blockX)
+                    {
+                        const int32_t xBegin = int32_t(blockX*CMFT_NORMAL_CONE_BLOCK_SIZE) - border;
+                        const int32_t xEnd = min(xBegin+CMFT_NORMAL_CONE_BLOCK_SIZE, int32_t(paddedSize) - border);
+
+                        // Axis is the normalized average normal. Band corners have zero solid angle and are left out.
+                        float sum[3] = { 0.0f, 0.0f, 0.0f };
+                        for (int32_t yy = yBegin; yy < yEnd; ++yy)
+                        {
+                            for (int32_t xx = xBegin; xx < xEnd; ++xx)
+                            {
+                                float normal[3];
+                                if (0.0f != texelNormal(normal, face, xx, yy))
+                                {
+                                    sum[0] += normal[0];
+                                    sum[1] += normal[1];
+                                    sum[2] += normal[2];
+                                }
+                            }
+                        }
+
+                        float* cone = dstPtr;
+                        dstPtr += 4;
+
+                        // Block entirely in a band corner. Zero axis with zero half-angle is outside of any positive angle.
+                        if (0.0f == vec3Dot(sum, sum))
+                        {
+                            cone[0] = 0.0f;
+                            cone[1] = 0.0f;
+                            cone[2] = 0.0f;
+                            cone[3] = 1.0f;
+                            continue;
+                        }
+
+                        vec3Norm(cone, sum);
+
+                        // Half-angle is the widest normal, slightly widened to stay conservative.
+                        float cosCone = 1.0f;
+                        for (int32_t yy = yBegin; yy < yEnd; ++yy)
+                        {
+                            for (int32_t xx = xBegin; xx < xEnd; ++xx)
+                            {
+                                float normal[3];
+                                if (0.0f != texelNormal(normal, face, xx, yy))
+                                {
+                                    cosCone = min(cosCone, vec3Dot(cone, normal));
+                                }
+                            }
+                        }
+                        cone[3] = max(-1.0f, cosCone - 1e-4f);
+                    }
+                }
+            }
+        }
+
+        /// Builds the largest absolute value of any plane of CMFT_NORMAL_CONE_BLOCK_SIZE^2 texel blocks of the padded faces,
+        /// the same blocks initNormals() builds cones of.
+        void initBlockMax()
+        {
+            const uint32_t paddedSize = m_faceSize + 2*m_border;
+            const uint32_t blocksPerSide = normalConeBlocksPerSide(paddedSize);
+            m_blockMax = (float*)m_allocator->alloc(size_t(blocksPerSide)*blocksPerSide*CUBE_FACE_NUM*sizeof(float));
+            MALLOC_CHECK(m_blockMax);
+
+            const int32_t border = int32_t(m_border);
+            float* dstPtr = m_blockMax;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                for (uint32_t blockY = 0; blockY < blocksPerSide; ++blockY)
+                {
+                    const int32_t yBegin = int32_t(blockY*CMFT_NORMAL_CONE_BLOCK_SIZE) - border;
+                    const int32_t yEnd = min(yBegin+CMFT_NORMAL_CONE_BLOCK_SIZE, int32_t(paddedSize) - border);
+
+                    for (uint32_t blockX = 0; blockX < blocksPerSide; ++blockX)
+                    {
+                        const int32_t xBegin = int32_t(blockX*CMFT_NORMAL_CONE_BLOCK_SIZE) - border;
+                        const int32_t xEnd = min(xBegin+CMFT_NORMAL_CONE_BLOCK_SIZE, int32_t(paddedSize) - border);
+
+                        float blockMax = 0.0f;
+                        for (uint8_t plane = 0; plane < m_numPlanes; ++plane)
+                        {
+                            for (int32_t yy = yBegin; yy < yEnd; ++yy)
+                            {
+                                for (int32_t xx = xBegin; xx < xEnd; ++xx)
+                                {
+                                    const float val = isHalf()
+                                                    ? halfToFloat(rowHalf(face, plane, xx, yy)[xx])
+                                                    : row(face, plane, xx, yy)[xx]
+                                                    ;
+                                    // Written as a negated test so NaNs count as bright.
+                                    if (!(fabsf(val) <= blockMax))
+                                    {
+                                        blockMax = (val == val) ? fabsf(val) : FLT_MAX;
+                                    }
+                                }
+                            }
+                        }
+
+                        *dstPtr++ = blockMax;
+                    }
+                }
+            }
+        }
+
+        /// Normal of texel _xx, _yy of planes built by initNormals() as the filter loop decodes it. Returns its solid angle.
+        inline float texelNormal(float _normal[3], uint8_t _face, int32_t _xx, int32_t _yy) const
+        {
+#if CMFT_RADIANCE_SOA_COMPACT_NORMALS
+            _normal[0] = float(int16_t(rowHalf(_face, 0, _xx, _yy)[_xx]))*(1.0f/32767.0f);
+            _normal[1] = float(int16_t(rowHalf(_face, 1, _xx, _yy)[_xx]))*(1.0f/32767.0f);
+            _normal[2] = float(int16_t(rowHalf(_face, 2, _xx, _yy)[_xx]))*(1.0f/32767.0f);
+            return float(rowHalf(_face, 3, _xx, _yy)[_xx])*m_solidAngleScale;
+#else
+            _normal[0] = row(_face, 0, _xx, _yy)[_xx];
+            _normal[1] = row(_face, 1, _xx, _yy)[_xx];
+            _normal[2] = row(_face, 2, _xx, _yy)[_xx];
+            return row(_face, 3, _xx, _yy)[_xx];
+#endif // CMFT_RADIANCE_SOA_COMPACT_NORMALS
+        }
+
+        /// Bytes of SoA normal planes per padded texel, see paddedTexels().
+        static inline uint32_t normalBytesPerTexel()
+        {
+            return CMFT_RADIANCE_SOA_COMPACT_NORMALS ? 4*sizeof(uint16_t) : 4*sizeof(float);
+        }
+
+        /// Copies texels, normal cones and block maxima of _src. Memory is first touched by the calling thread.
+        void copy(const SoaCubemap& _src)
+        {
+            alloc(_src.m_faceSize, _src.m_numPlanes, _src.m_bytesPerChannel);
+            memcpy(m_data, _src.m_data, dataSize());
+            m_solidAngleScale = _src.m_solidAngleScale;
+
+            if (NULL != _src.m_cones)
+            {
+                const size_t conesSize = size_t(_src.m_blocksPerSide)*_src.m_blocksPerSide*CUBE_FACE_NUM*4*sizeof(float);
+                m_blocksPerSide = _src.m_blocksPerSide;
+                m_cones = (float*)m_allocator->alloc(conesSize);
+                MALLOC_CHECK(m_cones);
+                memcpy(m_cones, _src.m_cones, conesSize);
+            }
+
+            if (NULL != _src.m_blockMax)
+            {
+                const uint32_t blocksPerSide = normalConeBlocksPerSide(m_faceSize + 2*m_border);
+                const size_t blockMaxSize = size_t(blocksPerSide)*blocksPerSide*CUBE_FACE_NUM*sizeof(float);
+                m_blockMax = (float*)m_allocator->alloc(blockMaxSize);
+                MALLOC_CHECK(m_blockMax);
+                memcpy(m_blockMax, _src.m_blockMax, blockMaxSize);
+            }
+        }
+
+        /// Prepares empty replicas for _numNodes NUMA nodes, to be filled with copy() by threads of each node.
+        void initReplicas(uint16_t _numNodes)
+        {
+            unloadReplicas();
+
+            m_replicas = (SoaCubemap*)m_allocator->alloc(_numNodes*sizeof(SoaCubemap));
+            MALLOC_CHECK(m_replicas);
+            for (uint16_t ii = 0; ii < _numNodes; ++ii)
+            {
+                m_replicas[ii] = SoaCubemap();
+            }
+            m_numReplicas = _numNodes;
+        }
+
+        /// Replica on NUMA node _node if there is one, this cubemap otherwise.
+        inline const SoaCubemap& forNode(uint16_t _node) const
+        {
+            return (_node < m_numReplicas && NULL != m_replicas[_node].m_data) ? m_replicas[_node] : *this;
+        }
+
+        void unload()
+        {
+            unloadReplicas();
+
+            if (NULL != m_mem)
+            {
+                m_allocator->free(m_mem);
+                m_mem = NULL;
+                m_data = NULL;
+            }
+
+            if (NULL != m_cones)
+            {
+                m_allocator->free(m_cones);
+                m_cones = NULL;
+            }
+
+            if (NULL != m_blockMax)
+            {
+                m_allocator->free(m_blockMax);
+                m_blockMax = NULL;
+            }
+        }
+
+        void unloadReplicas()
+        {
+            if (NULL != m_replicas)
+            {
+                for (uint16_t ii = 0; ii < m_numReplicas; ++ii)
+                {
+                    m_replicas[ii].unload();
+                }
+
+                m_allocator->free(m_replicas);
+                m_replicas = NULL;
+                m_numReplicas = 0;
+            }
+        }
+
+        inline bool isHalf() const
+        {
+            return 2 == m_bytesPerChannel;
+        }
+
+        /// True if a filter of _filterSize (in face size units) around any texel stays inside of the guard band.
+        inline bool fitsGuardBand(float _filterSize) const
+        {
+            return _filterSize*float(int32_t(m_faceSize)) + 1.0f <= float(int32_t(m_border));
+        }
+
+        /// Normal cones of block row _blockY of _face, see initNormals(). Block 0 starts at texel -m_border.
+        inline const float* coneRow(uint8_t _face, uint32_t _blockY) const
+        {
+            return m_cones + (size_t(_face)*m_blocksPerSide + _blockY)*m_blocksPerSide*4;
+        }
+
+        /// Block maxima of block row _blockY of _face, see initBlockMax(). NULL if there are none.
+        inline const float* blockMaxRow(uint8_t _face, uint32_t _blockY) const
+        {
+            if (NULL == m_blockMax)
+            {
+                return NULL;
+            }
+
+            const uint32_t blocksPerSide = normalConeBlocksPerSide(m_faceSize + 2*m_border);
+            return m_blockMax + (size_t(_face)*blocksPerSide + _blockY)*blocksPerSide;
+        }
+
+        /// Padded texels of all faces.
+        static inline uint64_t paddedTexels(uint32_t _faceSize)
+        {
+            const uint64_t paddedSize = _faceSize + 2*(min(uint32_t(CMFT_RADIANCE_GUARD_BAND), _faceSize)&~UINT32_C(3));
+            return paddedSize*paddedSize*CUBE_FACE_NUM;
+        }
+
+        /// Pointer to texel 0 of row _yy, valid for the texels of the row in the same tile as texel _xx (see tileLastX()).
+        /// Row is 16 byte aligned at every 4th texel, including the guard band.
+        inline float* row(uint8_t _face, uint8_t _plane, int32_t _xx, int32_t _yy) const
+        {
+            return (float*)rowData(_face, _plane, _xx, _yy);
+        }
+
+        inline uint16_t* rowHalf(uint8_t _face, uint8_t _plane, int32_t _xx, int32_t _yy) const
+        {
+            return (uint16_t*)rowData(_face, _plane, _xx, _yy);
+        }
+
+        inline void* rowData(uint8_t _face, uint8_t _plane, int32_t _xx, int32_t _yy) const
+        {
+            const uint32_t paddedSize = m_faceSize + 2*m_border;
+
+#if CMFT_RADIANCE_SOA_TILE
+            const uint32_t tileX = uint32_t(_xx + int32_t(m_border))/CMFT_RADIANCE_SOA_TILE;
+            const uint32_t tileY = uint32_t(_yy + int32_t(m_border))/CMFT_RADIANCE_SOA_TILE;
+            const uint32_t tileRow = uint32_t(_yy + int32_t(m_border))%CMFT_RADIANCE_SOA_TILE;
+            const uint32_t tilesPerSide = (paddedSize + CMFT_RADIANCE_SOA_TILE-1)/CMFT_RADIANCE_SOA_TILE;
+            const size_t tileIdx = (size_t(_face)*tilesPerSide + tileY)*tilesPerSide + tileX;
+            const size_t rowIdx = (tileIdx*m_numPlanes + _plane)*CMFT_RADIANCE_SOA_TILE + tileRow;
+
+            // Texel 0 of the row is where it would be if all tiles to the left were stored before this one.
+            const ptrdiff_t texelIdx = ptrdiff_t(rowIdx*m_pitch) + ptrdiff_t(m_border) - ptrdiff_t(tileX*CMFT_RADIANCE_SOA_TILE);
+            return (uint8_t*)m_data + texelIdx*ptrdiff_t(m_bytesPerChannel);
+#else
+            BX_UNUSED(_xx);
+            const size_t rowIdx = (size_t(_face)*m_numPlanes + _plane)*paddedSize + uint32_t(_yy + int32_t(m_border));
+            return (uint8_t*)m_data + (rowIdx*m_pitch + m_border)*m_bytesPerChannel;
+#endif // CMFT_RADIANCE_SOA_TILE
+        }
+
+        /// Last texel of the row that is contiguous with texel _xx, the last texel of its tile.
+        static inline int32_t tileLastX(int32_t _xx, int32_t _border)
+        {
+#if CMFT_RADIANCE_SOA_TILE
+            return int32_t(uint32_t(_xx + _border)/CMFT_RADIANCE_SOA_TILE*CMFT_RADIANCE_SOA_TILE + CMFT_RADIANCE_SOA_TILE-1) - _border;
+#else
+            BX_UNUSED(_xx, _border);
+            return INT32_MAX;
+#endif // CMFT_RADIANCE_SOA_TILE
+        }
+
+        inline int32_t tileLastX(int32_t _xx) const
+        {
+            return tileLastX(_xx, int32_t(m_border));
+        }
+
+        void alloc(uint32_t _faceSize, uint8_t _numPlanes, uint8_t _bytesPerChannel)
+        {
+            unload();
+
+            m_faceSize        = _faceSize;
+            m_border          = min(uint32_t(CMFT_RADIANCE_GUARD_BAND), _faceSize)&~UINT32_C(3);
+            m_blocksPerSide   = 0;
+#if CMFT_RADIANCE_SOA_TILE
+            BX_STATIC_ASSERT(0 == (CMFT_RADIANCE_SOA_TILE&3));
+            m_pitch           = CMFT_RADIANCE_SOA_TILE;
+#else
+            m_pitch           = align(_faceSize + 2*m_border, RowAlignment/_bytesPerChannel);
+#endif // CMFT_RADIANCE_SOA_TILE
+            m_numPlanes       = min(_numPlanes, uint8_t(MaxPlanes));
+            m_bytesPerChannel = _bytesPerChannel;
+
+            m_allocator = getAllocator();
+            m_mem = m_allocator->alloc(dataSize() + RowAlignment-1);
+            MALLOC_CHECK(m_mem);
+            m_data = (void*)(((uintptr_t)m_mem + RowAlignment-1) & ~uintptr_t(RowAlignment-1));
+            memset(m_data, 0, dataSize());
+        }
+
+        inline size_t dataSize() const
+        {
+#if CMFT_RADIANCE_SOA_TILE
+            const uint32_t paddedSize = align(m_faceSize + 2*m_border, CMFT_RADIANCE_SOA_TILE);
+            return size_t(paddedSize)*paddedSize*m_numPlanes*CUBE_FACE_NUM*m_bytesPerChannel;
+#else
+            const uint32_t paddedSize = m_faceSize + 2*m_border;
+            return size_t(m_pitch)*paddedSize*m_numPlanes*CUBE_FACE_NUM*m_bytesPerChannel;
+#endif // CMFT_RADIANCE_SOA_TILE
+        }
+
+        /// Copies texels along the edges of neighbour faces into the guard band of each face.
+        /// Same mapping as determineFilterArea() uses when it bleeds filter area over a face edge.
+        void fillGuardBand()
+        {
+            const uint32_t faceSize = m_faceSize;
+            const uint32_t last = faceSize-1;
+
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                for (uint8_t side = 0; side < 4; ++side)
+                {
+                    const uint8_t neighbourFaceIdx  = s_cubeFaceNeighbours[face][side].m_faceIdx;
+                    const uint8_t neighbourFaceEdge = s_cubeFaceNeighbours[face][side].m_faceEdge;
+                    const bool flip = (side == neighbourFaceEdge) || (3 == (side + neighbourFaceEdge));
+
+                    for (uint8_t plane = 0; plane < m_numPlanes; ++plane)
+                    {
+                        for (uint32_t dd = 0; dd < m_border; ++dd)
+                        {
+                            for (uint32_t tt = 0; tt < faceSize; ++tt)
+                            {
+                                // Destination in the guard band, dd texels away from the edge.
+                                const int32_t dstX = (CMFT_EDGE_LEFT   == side) ? -1-int32_t(dd)
+                                                   : (CMFT_EDGE_RIGHT  == side) ? int32_t(faceSize+dd)
+                                                   : int32_t(tt)
+                                                   ;
+                                const int32_t dstY = (CMFT_EDGE_TOP    == side) ? -1-int32_t(dd)
+                                                   : (CMFT_EDGE_BOTTOM == side) ? int32_t(faceSize+dd)
+                                                   : int32_t(tt)
+                                                   ;
+
+                                // Source on the neighbour face, dd texels away from its edge.
+                                const uint32_t along = flip ? last-tt : tt;
+                                const uint32_t srcX = (CMFT_EDGE_LEFT   == neighbourFaceEdge) ? dd
+                                                    : (CMFT_EDGE_RIGHT  == neighbourFaceEdge) ? last-dd
+                                                    : along
+                                                    ;
+                                const uint32_t srcY = (CMFT_EDGE_TOP    == neighbourFaceEdge) ? dd
+                                                    : (CMFT_EDGE_BOTTOM == neighbourFaceEdge) ? last-dd
+                                                    : along
+                                                    ;
+
+                                const uint8_t* src = (const uint8_t*)rowData(neighbourFaceIdx, plane, int32_t(srcX), int32_t(srcY)) + srcX*m_bytesPerChannel;
+                                uint8_t* dst = (uint8_t*)rowData(face, plane, dstX, dstY) + dstX*m_bytesPerChannel;
+                                memcpy(dst, src, m_bytesPerChannel);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        uint32_t m_faceSize;
+        uint32_t m_border; //!< Guard band texels on each side of a face.
+        uint32_t m_pitch;
+        uint8_t m_numPlanes;
+        uint8_t m_bytesPerChannel;
+        uint32_t m_blocksPerSide;
+        float m_solidAngleScale; //!< Solid angle of one unit of the solid angle plane, only with initCompactNormals().
+        void* m_mem;
+        void* m_data;
+        float* m_cones; //!< Only with initNormals().
+        float* m_blockMax; //!< Only with initBlockMax().
+        Allocator* m_allocator;
+        SoaCubemap* m_replicas; //!< Copies per NUMA node, see initReplicas(). Empty where the original lives.
+        uint16_t m_numReplicas;
+    };
+
+    /// Initializes SoA color planes from a RGBA32F or RGBA16F cubemap, keeping its precision.
+    static void soaInitColors(SoaCubemap& _colors, const Image& _image, const uint64_t _faceOffsets[CUBE_FACE_NUM])
+    {
+        AllocTagScope allocTag(AllocTag::SourceCopy);
+
+        if (TextureFormat::RGBA16F == _image.m_format)
+        {
+            _colors.initHalf((const uint16_t*)_image.m_data, _image.m_width, 3, _faceOffsets);
+        }
+        else
+        {
+            _colors.init((const float*)_image.m_data, _image.m_width, 3, _faceOffsets);
+        }
+
+        if (0.0f <= CMFT_RADIANCE_BLACK_BLOCK_TOLERANCE)
+        {
+            _colors.initBlockMax();
+        }
+    }
+
+    /// Reads rgb of a RGBA32F or RGBA16F texel.
+    static inline void texelLoadRgb(float _rgb[3], const void* _texel, bool _half)
+    {
+        if (_half)
+        {
+            const uint16_t* texel = (const uint16_t*)_texel;
+            _rgb[0] = halfToFloat(texel[0]);
+            _rgb[1] = halfToFloat(texel[1]);
+            _rgb[2] = halfToFloat(texel[2]);
+        }
+        else
+        {
+            const float* texel = (const float*)_texel;
+            _rgb[0] = texel[0];
+            _rgb[1] = texel[1];
+            _rgb[2] = texel[2];
+        }
+    }
+
+    /// Writes rgb and alpha of one to a RGBA32F or RGBA16F texel.
+    static inline void texelStoreRgb(void* _texel, const float _rgb[3], bool _half)
+    {
+        if (_half)
+        {
+            uint16_t* texel = (uint16_t*)_texel;
+            texel[0] = halfFromFloat(_rgb[0]);
+            texel[1] = halfFromFloat(_rgb[1]);
+            texel[2] = halfFromFloat(_rgb[2]);
+            texel[3] = halfFromFloat(1.0f);
+        }
+        else
+        {
+            float* texel = (float*)_texel;
+            texel[0] = _rgb[0];
+            texel[1] = _rgb[1];
+            texel[2] = _rgb[2];
+            texel[3] = 1.0f;
+        }
+    }
+
+    // Irradiance.
+    //-----
+
+    /// Evaluates basis functions of the first Order bands (Order*Order values) for given direction.
+    template <uint8_t Order>
+    static inline void evalSHBasis(double* _shBasis, const float* _dir)
+    {
+        const double x = double(_dir[0]);
+        const double y = double(_dir[1]);
+        const double z = double(_dir[2]);
+
+        const double x2 = x*x;
+        const double y2 = y*y;
+        const double z2 = z*z;
+
+        //Equations based on data from: http://ppsloan.org/publications/StupidSH36.pdf
+        _shBasis[ 0] =  1.0/(2.0*SQRT_PI);
+
+        if (Order > 1)
+        {
+            _shBasis[ 1] = -sqrt(3.0/PI4)*y;
+            _shBasis[ 2] =  sqrt(3.0/PI4)*z;
+            _shBasis[ 3] = -sqrt(3.0/PI4)*x;
+        }
+
+        if (Order > 2)
+        {
+            _shBasis[ 4] =  sqrt(15.0/PI4)*y*x;
+            _shBasis[ 5] = -sqrt(15.0/PI4)*y*z;
+            _shBasis[ 6] =  sqrt(5.0/PI16)*(3.0*z2-1.0);
+            _shBasis[ 7] = -sqrt(15.0/PI4)*x*z;
+            _shBasis[ 8] =  sqrt(15.0/PI16)*(x2-y2);
+        }
+
+        if (Order > 3)
+        {
+            const double z3 = pow(z, 3.0);
+
+            _shBasis[ 9] = -sqrt( 70.0/PI64)*y*(3*x2-y2);
+            _shBasis[10] =  sqrt(105.0/ PI4)*y*x*z;
+            _shBasis[11] = -sqrt( 42.0/PI64)*y*(-1.0+5.0*z2);
+            _shBasis[12] =  sqrt(  7.0/PI16)*(5.0*z3-3.0*z);
+            _shBasis[13] = -sqrt( 42.0/PI64)*x*(-1.0+5.0*z2);
+            _shBasis[14] =  sqrt(105.0/PI16)*(x2-y2)*z;
+            _shBasis[15] = -sqrt( 70.0/PI64)*x*(x2-3.0*y2);
+        }
+
+        if (Order > 4)
+        {
+            const double x4 = pow(x, 4.0);
+            const double y4 = pow(y, 4.0);
+            const double z4 = pow(z, 4.0);
+
+            _shBasis[16] =  3.0*sqrt(35.0/PI16)*x*y*(x2-y2);
+            _shBasis[17] = -3.0*sqrt(70.0/PI64)*y*z*(3.0*x2-y2);
+            _shBasis[18] =  3.0*sqrt( 5.0/PI16)*y*x*(-1.0+7.0*z2);
+            _shBasis[19] = -3.0*sqrt(10.0/PI64)*y*z*(-3.0+7.0*z2);
+            _shBasis[20] =  (105.0*z4-90.0*z2+9.0)/(16.0*SQRT_PI);
+            _shBasis[21] = -3.0*sqrt(10.0/PI64)*x*z*(-3.0+7.0*z2);
+            _shBasis[22] =  3.0*sqrt( 5.0/PI64)*(x2-y2)*(-1.0+7.0*z2);
+            _shBasis[23] = -3.0*sqrt(70.0/PI64)*x*z*(x2-3.0*y2);
+            _shBasis[24] =  3.0*sqrt(35.0/(4.0*PI64))*(x4-6.0*y2*x2+y4);
+        }
+
+        if (Order > 5)
+        {
+            // Higher bands from the normalized associated Legendre recurrence, times Re/Im of (x+iy)^m.
+            // Same sign convention as the explicit bands above.
+            double pmm = 1.0/(2.0*SQRT_PI);
+            double cosm = 1.0;
+            double sinm = 0.0;
+            for (int32_t mm = 0; mm < int32_t(Order); ++mm)
+            {
+                if (0 != mm)
+                {
+                    const double cc = cosm*x - sinm*y;
+                    sinm = sinm*x + cosm*y;
+                    cosm = cc;
+                    pmm *= -sqrt(double(2*mm+1)/double(2*mm));
+                }
+
+                double p1 = 0.0;
+                double p2 = 0.0;
+                for (int32_t ll = mm; ll < int32_t(Order); ++ll)
+                {
+                    double pl = pmm;
+                    if (ll != mm)
+                    {
+                        const double aa = sqrt(double(4*ll*ll-1)/double(ll*ll-mm*mm));
+                        const double bb = sqrt(double((ll-1)*(ll-1)-mm*mm)/double(4*(ll-1)*(ll-1)-1));
+                        pl = aa*(z*p1 - bb*p2);
+                    }
+                    p2 = p1;
+                    p1 = pl;
+
+                    if (ll > 4)
+                    {
+                        const int32_t idx = ll*ll+ll;
+                        if (0 == mm)
+                        {
+                            _shBasis[idx] = pl;
+                        }
+                        else
+                        {
+                            _shBasis[idx+mm] = sqrt(2.0)*pl*cosm;
+                            _shBasis[idx-mm] = sqrt(2.0)*pl*sinm;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+#if CMFT_RADIANCE_SIMD
+    /// Same as evalSHBasis() for 4 directions at a time, in single precision.
+    template <uint8_t Order>
+    static inline void evalSHBasisSimd(bx::float4_t* _shBasis, bx::float4_t _x, bx::float4_t _y, bx::float4_t _z)
+    {
+        using namespace bx;
+
+        const float4_t x2 = float4_mul(_x, _x);
+        const float4_t y2 = float4_mul(_y, _y);
+        const float4_t z2 = float4_mul(_z, _z);
+
+        const float4_t one   = float4_splat(1.0f);
+        const float4_t three = float4_splat(3.0f);
+        const float4_t xy    = float4_mul(_x, _y);
+        const float4_t x2_y2 = float4_sub(x2, y2);
+
+        #define CMFT_SH_CONST(_val) float4_splat(float(_val))
+
+        _shBasis[ 0] = CMFT_SH_CONST(1.0/(2.0*SQRT_PI));
+
+        if (Order > 1)
+        {
+            _shBasis[ 1] = float4_mul(CMFT_SH_CONST(-sqrt(3.0/PI4)), _y);
+            _shBasis[ 2] = float4_mul(CMFT_SH_CONST( sqrt(3.0/PI4)), _z);
+            _shBasis[ 3] = float4_mul(CMFT_SH_CONST(-sqrt(3.0/PI4)), _x);
+        }
+
+        if (Order > 2)
+        {
+            _shBasis[ 4] = float4_mul(CMFT_SH_CONST( sqrt(15.0/PI4)), xy);
+            _shBasis[ 5] = float4_mul(CMFT_SH_CONST(-sqrt(15.0/PI4)), float4_mul(_y, _z));
+            _shBasis[ 6] = float4_mul(CMFT_SH_CONST( sqrt(5.0/PI16)), float4_sub(float4_mul(three, z2), one));
+            _shBasis[ 7] = float4_mul(CMFT_SH_CONST(-sqrt(15.0/PI4)), float4_mul(_x, _z));
+            _shBasis[ 8] = float4_mul(CMFT_SH_CONST( sqrt(15.0/PI16)), x2_y2);
+        }
+
+        if (Order > 3)
+        {
+            const float4_t z3      = float4_mul(z2, _z);
+            const float4_t x2_3y2  = float4_nmsub(three, y2, x2);
+            const float4_t _3x2_y2 = float4_sub(float4_mul(three, x2), y2);
+            const float4_t _5z2_1  = float4_sub(float4_mul(float4_splat(5.0f), z2), one);
+
+            _shBasis[ 9] = float4_mul(CMFT_SH_CONST(-sqrt( 70.0/PI64)), float4_mul(_y, _3x2_y2));
+            _shBasis[10] = float4_mul(CMFT_SH_CONST( sqrt(105.0/ PI4)), float4_mul(xy, _z));
+            _shBasis[11] = float4_mul(CMFT_SH_CONST(-sqrt( 42.0/PI64)), float4_mul(_y, _5z2_1));
+            _shBasis[12] = float4_mul(CMFT_SH_CONST( sqrt(  7.0/PI16)), float4_sub(float4_mul(float4_splat(5.0f), z3), float4_mul(three, _z)));
+            _shBasis[13] = float4_mul(CMFT_SH_CONST(-sqrt( 42.0/PI64)), float4_mul(_x, _5z2_1));
+            _shBasis[14] = float4_mul(CMFT_SH_CONST( sqrt(105.0/PI16)), float4_mul(x2_y2, _z));
+            _shBasis[15] = float4_mul(CMFT_SH_CONST(-sqrt( 70.0/PI64)), float4_mul(_x, x2_3y2));
+
+            if (Order > 4)
+            {
+                const float4_t x4     = float4_mul(x2, x2);
+                const float4_t y4     = float4_mul(y2, y2);
+                const float4_t z4     = float4_mul(z2, z2);
+                const float4_t _7z2_1 = float4_sub(float4_mul(float4_splat(7.0f), z2), one);
+                const float4_t _7z2_3 = float4_sub(float4_mul(float4_splat(7.0f), z2), three);
+
+                _shBasis[16] = float4_mul(CMFT_SH_CONST( 3.0*sqrt(35.0/PI16)), float4_mul(xy, x2_y2));
+                _shBasis[17] = float4_mul(CMFT_SH_CONST(-3.0*sqrt(70.0/PI64)), float4_mul(float4_mul(_y, _z), _3x2_y2));
+                _shBasis[18] = float4_mul(CMFT_SH_CONST( 3.0*sqrt( 5.0/PI16)), float4_mul(xy, _7z2_1));
+                _shBasis[19] = float4_mul(CMFT_SH_CONST(-3.0*sqrt(10.0/PI64)), float4_mul(float4_mul(_y, _z), _7z2_3));
+                _shBasis[20] = float4_mul(CMFT_SH_CONST(1.0/(16.0*SQRT_PI))
+                                        , float4_madd(float4_splat(105.0f), z4, float4_nmsub(float4_splat(90.0f), z2, float4_splat(9.0f)))
+                                        );
+                _shBasis[21] = float4_mul(CMFT_SH_CONST(-3.0*sqrt(10.0/PI64)), float4_mul(float4_mul(_x, _z), _7z2_3));
+                _shBasis[22] = float4_mul(CMFT_SH_CONST( 3.0*sqrt( 5.0/PI64)), float4_mul(x2_y2, _7z2_1));
+                _shBasis[23] = float4_mul(CMFT_SH_CONST(-3.0*sqrt(70.0/PI64)), float4_mul(float4_mul(_x, _z), x2_3y2));
+                _shBasis[24] = float4_mul(CMFT_SH_CONST( 3.0*sqrt(35.0/(4.0*PI64)))
+                                        , float4_add(float4_nmsub(float4_splat(6.0f), float4_mul(y2, x2), x4), y4)
+                                        );
+            }
+        }
+
+        #undef CMFT_SH_CONST
+    }
+#endif // CMFT_RADIANCE_SIMD
+
+    // Partial SH sums are computed per fixed-size chunk of rows and merged in chunk order,
+    // so the result does not depend on the number of threads.
+#ifndef CMFT_SH_ROWS_PER_CHUNK
+    #define CMFT_SH_ROWS_PER_CHUNK 16
+#endif //CMFT_SH_ROWS_PER_CHUNK
+
+    template <uint8_t Order>
+    struct ShPartialSum
+    {
+        double m_coeffs[Order*Order][3];
+        double m_weight;
+    };
+
+    template <uint8_t Order>
+    struct ShCoeffsArgs
+    {
+        ShPartialSum<Order>* m_partials;
+        const ImageView* m_view;
+        const float* m_cubemapVectors;
+        uint32_t m_faceSize;
+        uint32_t m_chunksPerFace;
+    };
+
+    template <uint8_t Order>
+    static void shAccumulateTexel(ShPartialSum<Order>& _sum, const float* _srcPtr, const float* _vecPtr)
+    {
+        const double rr = double(_srcPtr[0]);
+        const double gg = double(_srcPtr[1]);
+        const double bb = double(_srcPtr[2]);
+
+        double shBasis[Order*Order];
+        evalSHBasis<Order>(shBasis, _vecPtr);
+
+        const double weight = (double)_vecPtr[3];
+
+        for (uint16_t ii = 0; ii < Order*Order; ++ii)
+        {
+            _sum.m_coeffs[ii][0] += rr * shBasis[ii] * weight;
+            _sum.m_coeffs[ii][1] += gg * shBasis[ii] * weight;
+            _sum.m_coeffs[ii][2] += bb * shBasis[ii] * weight;
+        }
+
+        _sum.m_weight += weight;
+    }
+
+#if CMFT_RADIANCE_SIMD
+    /// Accumulates groups of 4 texels of the row into _sum. Returns the number of texels processed.
+    /// Source texels are RGBA32F or RGB32F, depending on NumChannels. Bands above 5 are left to the scalar path.
+    template <uint8_t Order, uint8_t NumChannels>
+    static uint32_t shAccumulateRowSimd(ShPartialSum<Order>& _sum, const float* _srcPtr, const float* _vecPtr, uint32_t _count)
+    {
+        using namespace bx;
+
+        if (Order > 5)
+        {
+            return 0;
+        }
+
+        float4_t acc[Order*Order][3];
+        for (uint16_t ii = 0; ii < Order*Order; ++ii)
+        {
+            acc[ii][0] = float4_zero();
+            acc[ii][1] = float4_zero();
+            acc[ii][2] = float4_zero();
+        }
+        float4_t accWeight = float4_zero();
+
+        const uint32_t count4 = _count&~UINT32_C(3);
+        for (uint32_t xx = 0; xx < count4; xx += 4)
+        {
+            const float* nn = &_vecPtr[xx*4];
+            const float* cc = &_srcPtr[xx*NumChannels];
+
+            // Transpose to xxxx, yyyy, zzzz, wwww.
+            const float4_t n0 = float4_ld(nn[ 0], nn[ 1], nn[ 2], nn[ 3]);
+            const float4_t n1 = float4_ld(nn[ 4], nn[ 5], nn[ 6], nn[ 7]);
+            const float4_t n2 = float4_ld(nn[ 8], nn[ 9], nn[10], nn[11]);
+            const float4_t n3 = float4_ld(nn[12], nn[13], nn[14], nn[15]);
+            const float4_t t0 = float4_shuf_xAyB(n0, n1);
+            const float4_t t1 = float4_shuf_zCwD(n0, n1);
+            const float4_t t2 = float4_shuf_xAyB(n2, n3);
+            const float4_t t3 = float4_shuf_zCwD(n2, n3);
+            const float4_t nx = float4_shuf_xyAB(t0, t2);
+            const float4_t ny = float4_shuf_zwCD(t0, t2);
+            const float4_t nz = float4_shuf_xyAB(t1, t3);
+            const float4_t sa = float4_shuf_zwCD(t1, t3);
+
+            float4_t rr;
+            float4_t gg;
+            float4_t bb;
+            if (4 == NumChannels)
+            {
+                const float4_t c0 = float4_ld(cc[ 0], cc[ 1], cc[ 2], cc[ 3]);
+                const float4_t c1 = float4_ld(cc[ 4], cc[ 5], cc[ 6], cc[ 7]);
+                const float4_t c2 = float4_ld(cc[ 8], cc[ 9], cc[10], cc[11]);
+                const float4_t c3 = float4_ld(cc[12], cc[13], cc[14], cc[15]);
+                const float4_t u0 = float4_shuf_xAyB(c0, c1);
+                const float4_t u1 = float4_shuf_zCwD(c0, c1);
+                const float4_t u2 = float4_shuf_xAyB(c2, c3);
+                const float4_t u3 = float4_shuf_zCwD(c2, c3);
+                rr = float4_mul(float4_shuf_xyAB(u0, u2), sa);
+                gg = float4_mul(float4_shuf_zwCD(u0, u2), sa);
+                bb = float4_mul(float4_shuf_xyAB(u1, u3), sa);
+            }
+            else
+            {
+                rr = float4_mul(float4_ld(cc[0], cc[3], cc[6], cc[ 9]), sa);
+                gg = float4_mul(float4_ld(cc[1], cc[4], cc[7], cc[10]), sa);
+                bb = float4_mul(float4_ld(cc[2], cc[5], cc[8], cc[11]), sa);
+            }
+
+            float4_t shBasis[Order*Order];
+            evalSHBasisSimd<Order>(shBasis, nx, ny, nz);
+
+            for (uint16_t ii = 0; ii < Order*Order; ++ii)
+            {
+                acc[ii][0] = float4_madd(shBasis[ii], rr, acc[ii][0]);
+                acc[ii][1] = float4_madd(shBasis[ii], gg, acc[ii][1]);
+                acc[ii][2] = float4_madd(shBasis[ii], bb, acc[ii][2]);
+            }
+            accWeight = float4_add(accWeight, sa);
+        }
+
+        // Reduce lanes in double precision.
+        for (uint16_t ii = 0; ii < Order*Order; ++ii)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                _sum.m_coeffs[ii][cc] += double(float4_x(acc[ii][cc])) + double(float4_y(acc[ii][cc]))
+                                       + double(float4_z(acc[ii][cc])) + double(float4_w(acc[ii][cc]));
+            }
+        }
+        _sum.m_weight += double(float4_x(accWeight)) + double(float4_y(accWeight))
+                       + double(float4_z(accWeight)) + double(float4_w(accWeight));
+
+        return count4;
+    }
+#endif // CMFT_RADIANCE_SIMD
+
+    template <uint8_t Order, uint8_t NumChannels>
+    static void shCoeffsChunks(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ShCoeffsArgs<Order>* args = (const ShCoeffsArgs<Order>*)_userData;
+
+        const ImageView& view = *args->m_view;
+        const uint32_t faceSize = args->m_faceSize;
+        const uint32_t vecPitch = faceSize * 4 /*numChannels*/;
+
+        // Rows of mirrored faces are reversed here first.
+        float* mirrored = NULL;
+
+        for (uint32_t chunk = _begin; chunk < _end; ++chunk)
+        {
+            ShPartialSum<Order>& sum = args->m_partials[chunk];
+            memset(&sum, 0, sizeof(ShPartialSum<Order>));
+
+            const uint8_t face = uint8_t(chunk / args->m_chunksPerFace);
+            const uint32_t yBegin = (chunk % args->m_chunksPerFace) * CMFT_SH_ROWS_PER_CHUNK;
+            const uint32_t yEnd = min(yBegin + CMFT_SH_ROWS_PER_CHUNK, faceSize);
+
+            const float* faceVectors = args->m_cubemapVectors + size_t(face)*vecPitch*faceSize;
+
+            if (view.m_flipX[face] && NULL == mirrored)
+            {
+                mirrored = (float*)malloc(faceSize*NumChannels*sizeof(float));
+                MALLOC_CHECK(mirrored);
+            }
+
+            for (uint32_t yy = yBegin; yy < yEnd; ++yy)
+            {
+                const float* srcPtr = (const float*)imageViewGetRow(view, face, 0, yy);
+                const float* vecPtr = faceVectors + yy*vecPitch;
+
+                if (view.m_flipX[face])
+                {
+                    for (uint32_t xx = 0, xxEnd = faceSize-1; xx < faceSize; ++xx, --xxEnd)
+                    {
+                        memcpy(&mirrored[xx*NumChannels], &srcPtr[xxEnd*NumChannels], NumChannels*sizeof(float));
+                    }
+                    srcPtr = mirrored;
+                }
+
+                uint32_t xx = 0;
+#if CMFT_RADIANCE_SIMD
+                xx = shAccumulateRowSimd<Order, NumChannels>(sum, srcPtr, vecPtr, faceSize);
+#endif // CMFT_RADIANCE_SIMD
+
+                // Remaining texels.
+                for (; xx < faceSize; ++xx)
+                {
+                    shAccumulateTexel<Order>(sum, &srcPtr[xx*NumChannels], &vecPtr[xx*4]);
+                }
+            }
+        }
+
+        free(mirrored);
+    }
+
+    /// Sums chunk partials in chunk order and normalizes the result.
+    template <uint8_t Order>
+    static void shMergePartials(double _shCoeffs[][3], const ShPartialSum<Order>* _partials, uint32_t _numChunks)
+    {
+        memset(_shCoeffs, 0, Order*Order*3*sizeof(double));
+
+        double weightAccum = 0.0;
+        for (uint32_t chunk = 0; chunk < _numChunks; ++chunk)
+        {
+            for (uint16_t ii = 0; ii < Order*Order; ++ii)
+            {
+                _shCoeffs[ii][0] += _partials[chunk].m_coeffs[ii][0];
+                _shCoeffs[ii][1] += _partials[chunk].m_coeffs[ii][1];
+                _shCoeffs[ii][2] += _partials[chunk].m_coeffs[ii][2];
+            }
+            weightAccum += _partials[chunk].m_weight;
+        }
+
+        // Normalization.
+        // This is not really necesarry because usually PI*4 - weightAccum ~= 0.000003
+        // so it doesn't change almost anything, but it doesn't cost much to have more corectness.
+        const double norm = PI4 / weightAccum;
+        for (uint16_t ii = 0; ii < Order*Order; ++ii)
+        {
+            _shCoeffs[ii][0] *= norm;
+            _shCoeffs[ii][1] *= norm;
+            _shCoeffs[ii][2] *= norm;
+        }
+    }
+
+    /// Integrates base mip of a RGBA32F or RGB32F view. Chunks run on the calling thread only if _parallel is false.
+    /// Texel vectors and solid angles are taken from _cubemapVectors if given, from the normal table cache otherwise.
+    template <uint8_t Order>
+    static void viewShCoeffs(double _shCoeffs[][3], const ImageView& _view, bool _parallel = true, const float* _cubemapVectors = NULL)
+    {
+        const uint32_t faceSize = _view.m_faceSize;
+        const bool rgb = (TextureFormat::RGB32F == _view.m_format);
+
+        // Build cubemap vectors.
+        const float* cubemapVectors = (NULL != _cubemapVectors) ? _cubemapVectors : acquireCubemapNormalSolidAngle(faceSize);
+
+        // Evaluate spherical harmonics coefficients per chunk.
+        const uint32_t chunksPerFace = (faceSize + CMFT_SH_ROWS_PER_CHUNK-1)/CMFT_SH_ROWS_PER_CHUNK;
+        const uint32_t numChunks = 6*chunksPerFace;
+
+        ShPartialSum<Order>* partials = (ShPartialSum<Order>*)malloc(numChunks*sizeof(ShPartialSum<Order>));
+        MALLOC_CHECK(partials);
+
+        ShCoeffsArgs<Order> args;
+        args.m_partials = partials;
+        args.m_view = &_view;
+        args.m_cubemapVectors = cubemapVectors;
+        args.m_faceSize = faceSize;
+        args.m_chunksPerFace = chunksPerFace;
+        parallelFor(rgb ? shCoeffsChunks<Order, 3> : shCoeffsChunks<Order, 4>, (void*)&args, numChunks, _parallel ? 1 : numChunks);
+
+        // Merge in chunk order.
+        shMergePartials<Order>(_shCoeffs, partials, numChunks);
+
+        free(partials);
+        if (NULL == _cubemapVectors)
+        {
+            releaseCubemapNormalSolidAngle(cubemapVectors);
+        }
+    }
+
+    /// View of the base mip of tightly packed RGBA32F or RGB32F cubemap faces.
+    static void shCubemapView(ImageView& _view, void* _data, uint32_t _faceSize, const uint64_t _faceOffsets[6], uint8_t _numChannels)
+    {
+        _view.m_data = _data;
+        _view.m_faceSize = _faceSize;
+        _view.m_format = (3 == _numChannels) ? TextureFormat::RGB32F : TextureFormat::RGBA32F;
+        _view.m_numMips = 1;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            _view.m_offsets[face][0] = _faceOffsets[face];
+            _view.m_pitch[face][0] = int64_t(_faceSize) * _numChannels * sizeof(float);
+            _view.m_flipX[face] = false;
+        }
+    }
+
+    template <uint8_t Order>
+    void cubemapShCoeffs(double _shCoeffs[][3], void* _data, uint32_t _faceSize, uint64_t _faceOffsets[6], uint8_t _numChannels)
+    {
+        ImageView view;
+        shCubemapView(view, _data, _faceSize, _faceOffsets, _numChannels);
+
+        viewShCoeffs<Order>(_shCoeffs, view);
+    }
+
+    template void cubemapShCoeffs<2>(double _shCoeffs[][3], void* _data, uint32_t _faceSize, uint64_t _faceOffsets[6], uint8_t _numChannels);
+    template void cubemapShCoeffs<3>(double _shCoeffs[][3], void* _data, uint32_t _faceSize, uint64_t _faceOffsets[6], uint8_t _numChannels);
+    template void cubemapShCoeffs<5>(double _shCoeffs[][3], void* _data, uint32_t _faceSize, uint64_t _faceOffsets[6], uint8_t _numChannels);
+
+    void cubemapShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], void* _data, uint32_t _faceSize, uint64_t _faceOffsets[6], uint8_t _numChannels)
+    {
+        cubemapShCoeffs<5>(_shCoeffs, _data, _faceSize, _faceOffsets, _numChannels);
+    }
+
+    /// Projects new minus old texels of one row span [_xBegin, _xEnd] into _sum.
+    template <uint8_t Order, uint8_t NumChannels>
+    static void shAccumulateDeltaSpan(ShPartialSum<Order>& _sum
+                                    , float* _delta
+                                    , const float* _oldRow
+                                    , const float* _newRow
+                                    , const float* _vecRow
+                                    , uint32_t _xBegin
+                                    , uint32_t _xEnd
+                                    )
+    {
+        const uint32_t count = _xEnd - _xBegin + 1;
+        const float* oldPtr = &_oldRow[_xBegin*NumChannels];
+        const float* newPtr = &_newRow[_xBegin*NumChannels];
+        for (uint32_t ii = 0; ii < count*NumChannels; ++ii)
+        {
+            _delta[ii] = newPtr[ii] - oldPtr[ii];
+        }
+
+        const float* vecPtr = &_vecRow[_xBegin*4];
+
+        uint32_t xx = 0;
+#if CMFT_RADIANCE_SIMD
+        xx = shAccumulateRowSimd<Order, NumChannels>(_sum, _delta, vecPtr, count);
+#endif // CMFT_RADIANCE_SIMD
+
+        for (; xx < count; ++xx)
+        {
+            shAccumulateTexel<Order>(_sum, &_delta[xx*NumChannels], &vecPtr[xx*4]);
+        }
+    }
+
+    template <uint8_t Order>
+    void cubemapShCoeffsUpdate(double _shCoeffs[][3]
+                             , const void* _oldData
+                             , const void* _newData
+                             , uint32_t _faceSize
+                             , uint64_t _faceOffsets[6]
+                             , const CubeFaceRegion* _regions
+                             , uint32_t _numRegions
+                             , uint8_t _numChannels
+                             )
+    {
+        if (0 == _numRegions)
+        {
+            return;
+        }
+
+        const uint32_t faceSize = _faceSize;
+        const float faceSizef = float(int32_t(faceSize));
+        const uint32_t pitch = faceSize*_numChannels;
+        const uint32_t vecPitch = faceSize*4;
+        const float* cubemapVectors = acquireCubemapNormalSolidAngle(faceSize);
+
+        // Texel rectangles of the regions, same rounding as imageRadianceFilterRegions(). Row spans of each face are merged,
+        // so texels of overlapping regions are only counted once.
+        uint32_t* rects = (uint32_t*)malloc(_numRegions*(5+2)*sizeof(uint32_t));
+        MALLOC_CHECK(rects);
+        uint32_t* spans = rects + _numRegions*5;
+        for (uint32_t ii = 0; ii < _numRegions; ++ii)
+        {
+            const CubeFaceRegion& region = _regions[ii];
+            uint32_t* rect = &rects[ii*5];
+            rect[0] = min(region.m_face, uint8_t(CUBE_FACE_NUM-1));
+            for (uint8_t axis = 0; axis < 2; ++axis)
+            {
+                rect[1+axis*2] = min(uint32_t(clamp(region.m_min[axis], 0.0f, 1.0f)*faceSizef), faceSize-1);
+                rect[2+axis*2] = min(uint32_t(clamp(region.m_max[axis], 0.0f, 1.0f)*faceSizef), faceSize-1);
+            }
+        }
+
+        float* delta = (float*)malloc(faceSize*_numChannels*sizeof(float));
+        MALLOC_CHECK(delta);
+
+        ShPartialSum<Order> sum;
+        memset(&sum, 0, sizeof(ShPartialSum<Order>));
+
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            uint32_t yBegin = UINT32_MAX;
+            uint32_t yEnd = 0;
+            for (uint32_t ii = 0; ii < _numRegions; ++ii)
+            {
+                if (face == rects[ii*5])
+                {
+                    yBegin = min(yBegin, rects[ii*5+3]);
+                    yEnd = max(yEnd, rects[ii*5+4]);
+                }
+            }
+
+            for (uint32_t yy = yBegin; yy <= yEnd && UINT32_MAX != yBegin; ++yy)
+            {
+                // Spans of the regions covering the row, sorted by start.
+                uint32_t numSpans = 0;
+                for (uint32_t ii = 0; ii < _numRegions; ++ii)
+                {
+                    const uint32_t* rect = &rects[ii*5];
+                    if (face == rect[0]
+                    &&  yy >= rect[3]
+                    &&  yy <= rect[4])
+                    {
+                        uint32_t pos = numSpans++;
+                        for (; 0 != pos && spans[(pos-1)*2] > rect[1]; --pos)
+                        {
+                            spans[pos*2  ] = spans[(pos-1)*2  ];
+                            spans[pos*2+1] = spans[(pos-1)*2+1];
+                        }
+                        spans[pos*2  ] = rect[1];
+                        spans[pos*2+1] = rect[2];
+                    }
+                }
+
+                const float* oldRow = (const float*)((const uint8_t*)_oldData + _faceOffsets[face]) + yy*pitch;
+                const float* newRow = (const float*)((const uint8_t*)_newData + _faceOffsets[face]) + yy*pitch;
+                const float* vecRow = cubemapVectors + (uint64_t(face)*faceSize + yy)*vecPitch;
+
+                for (uint32_t ii = 0; ii < numSpans;)
+                {
+                    const uint32_t xBegin = spans[ii*2];
+                    uint32_t xEnd = spans[ii*2+1];
+                    for (++ii; ii < numSpans && spans[ii*2] <= xEnd+1; ++ii)
+                    {
+                        xEnd = max(xEnd, spans[ii*2+1]);
+                    }
+
+                    if (3 == _numChannels)
+                    {
+                        shAccumulateDeltaSpan<Order, 3>(sum, delta, oldRow, newRow, vecRow, xBegin, xEnd);
+                    }
+                    else
+                    {
+                        shAccumulateDeltaSpan<Order, 4>(sum, delta, oldRow, newRow, vecRow, xBegin, xEnd);
+                    }
+                }
+            }
+        }
+
+        // Solid angles of all texels add up to 4pi to float precision, normalization of the full projection is left out.
+        for (uint16_t ii = 0; ii < Order*Order; ++ii)
+        {
+            _shCoeffs[ii][0] += sum.m_coeffs[ii][0];
+            _shCoeffs[ii][1] += sum.m_coeffs[ii][1];
+            _shCoeffs[ii][2] += sum.m_coeffs[ii][2];
+        }
+
+        free(delta);
+        free(rects);
+        releaseCubemapNormalSolidAngle(cubemapVectors);
+    }
+
+    template void cubemapShCoeffsUpdate<2>(double _shCoeffs[][3], const void* _oldData, const void* _newData, uint32_t _faceSize, uint64_t _faceOffsets[6], const CubeFaceRegion* _regions, uint32_t _numRegions, uint8_t _numChannels);
+    template void cubemapShCoeffsUpdate<3>(double _shCoeffs[][3], const void* _oldData, const void* _newData, uint32_t _faceSize, uint64_t _faceOffsets[6], const CubeFaceRegion* _regions, uint32_t _numRegions, uint8_t _numChannels);
+    template void cubemapShCoeffsUpdate<5>(double _shCoeffs[][3], const void* _oldData, const void* _newData, uint32_t _faceSize, uint64_t _faceOffsets[6], const CubeFaceRegion* _regions, uint32_t _numRegions, uint8_t _numChannels);
+
+    void cubemapShCoeffsUpdate(double _shCoeffs[SH_COEFF_NUM][3]
+                             , const void* _oldData
+                             , const void* _newData
+                             , uint32_t _faceSize
+                             , uint64_t _faceOffsets[6]
+                             , const CubeFaceRegion* _regions
+                             , uint32_t _numRegions
+                             , uint8_t _numChannels
+                             )
+    {
+        cubemapShCoeffsUpdate<5>(_shCoeffs, _oldData, _newData, _faceSize, _faceOffsets, _regions, _numRegions, _numChannels);
+    }
+
+    static bool shOrderIsValid(uint8_t _shOrder)
+    {
+        return (2 == _shOrder || 3 == _shOrder || 5 == _shOrder);
+    }
+
+    /// Working copy of a filter source, counted as AllocTag::SourceCopy.
+    static bool filterSourceRefOrConvert(Image& _dst, TextureFormat::Enum _format, const Image& _src)
+    {
+        AllocTagScope allocTag(AllocTag::SourceCopy);
+        return imageRefOrConvert(_dst, _format, _src);
+    }
+
+    /// SH integration never reads alpha. RGBA32F input is referenced as is, anything else is converted to RGB32F.
+    static bool shRefOrConvert(Image& _dst, const Image& _src)
+    {
+        AllocTagScope allocTag(AllocTag::SourceCopy);
+
+        const TextureFormat::Enum format = (TextureFormat::RGBA32F == _src.m_format)
+                                         ? TextureFormat::RGBA32F
+                                         : TextureFormat::RGB32F
+                                         ;
+        return imageRefOrConvert(_dst, format, _src);
+    }
+
+    static uint8_t shNumChannels(const Image& _image)
+    {
+        return (TextureFormat::RGB32F == _image.m_format) ? 3 : 4;
+    }
+
+    struct ShDownsampleArgs
+    {
+        const ImageView* m_src;
+        float* m_dst;
+        float* m_vectors;
+        uint32_t m_faceSize;
+        uint32_t m_factor;
+    };
+
+    /// Box filters rows [_begin, _end) of all six faces. Solid angles of source texels are differences of area elements at their
+    /// corners, rows of corners are shared by the faces. Vectors of filtered texels point to the solid angle weighted centroid of
+    /// source texels, projecting from texel centers would be off by the first order of texel size.
+    template <uint8_t NumChannels>
+    static void shDownsampleRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ShDownsampleArgs* args = (const ShDownsampleArgs*)_userData;
+        const ImageView& view = *args->m_src;
+        const uint32_t dstFaceSize = args->m_faceSize;
+        const uint32_t factor = args->m_factor;
+        const uint32_t srcFaceSize = dstFaceSize*factor;
+        const float cornerStep = 2.0f/float(int32_t(srcFaceSize));
+
+        const uint32_t numSums = dstFaceSize*(3+CUBE_FACE_NUM*3);
+        float* corners = (float*)malloc((2*(srcFaceSize+1) + srcFaceSize + numSums)*sizeof(float));
+        MALLOC_CHECK(corners);
+        float* corners0 = corners;
+        float* corners1 = corners0 + srcFaceSize+1;
+        float* solidAngles = corners1 + srcFaceSize+1;
+        float* weights = solidAngles + srcFaceSize;
+        float* centroids = weights + dstFaceSize;
+        float* sums = centroids + dstFaceSize*2;
+
+        for (uint32_t dstY = _begin; dstY < _end; ++dstY)
+        {
+            memset(weights, 0, numSums*sizeof(float));
+
+            const float y0 = float(int32_t(dstY*factor))*cornerStep - 1.0f;
+            for (uint32_t xx = 0; xx <= srcFaceSize; ++xx)
+            {
+                corners1[xx] = areaElement(float(int32_t(xx))*cornerStep - 1.0f, y0);
+            }
+
+            for (uint32_t srcY = dstY*factor, srcYEnd = srcY+factor; srcY < srcYEnd; ++srcY)
+            {
+                float* tmp = corners0;
+                corners0 = corners1;
+                corners1 = tmp;
+
+                const float y1 = float(int32_t(srcY+1))*cornerStep - 1.0f;
+                for (uint32_t xx = 0; xx <= srcFaceSize; ++xx)
+                {
+                    corners1[xx] = areaElement(float(int32_t(xx))*cornerStep - 1.0f, y1);
+                }
+
+                const float vv = y1 - 0.5f*cornerStep;
+                for (uint32_t xx = 0; xx < srcFaceSize; ++xx)
+                {
+                    const float uu = (float(int32_t(xx))+0.5f)*cornerStep - 1.0f;
+                    solidAngles[xx] = corners1[xx+1] - corners1[xx] - corners0[xx+1] + corners0[xx];
+                    weights[xx/factor] += solidAngles[xx];
+                    centroids[(xx/factor)*2+0] += solidAngles[xx]*uu;
+                    centroids[(xx/factor)*2+1] += solidAngles[xx]*vv;
+                }
+
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    const float* src = (const float*)imageViewGetRow(view, face, 0, srcY);
+                    const int32_t step = view.m_flipX[face] ? -int32_t(NumChannels) : int32_t(NumChannels);
+                    src += view.m_flipX[face] ? (srcFaceSize-1)*NumChannels : 0;
+
+                    float* sum = sums + face*dstFaceSize*3;
+                    for (uint32_t xx = 0; xx < srcFaceSize; ++xx, src += step)
+                    {
+                        float* dst = &sum[(xx/factor)*3];
+                        dst[0] += src[0]*solidAngles[xx];
+                        dst[1] += src[1]*solidAngles[xx];
+                        dst[2] += src[2]*solidAngles[xx];
+                    }
+                }
+            }
+
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                const uint64_t dstOffset = (uint64_t(face)*dstFaceSize + dstY)*dstFaceSize;
+                const float* sum = sums + face*dstFaceSize*3;
+                float* dst = args->m_dst + dstOffset*3;
+                float* vec = args->m_vectors + dstOffset*4;
+                for (uint32_t xx = 0; xx < dstFaceSize; ++xx)
+                {
+                    const float invWeight = 1.0f/weights[xx];
+                    dst[xx*3+0] = sum[xx*3+0]*invWeight;
+                    dst[xx*3+1] = sum[xx*3+1]*invWeight;
+                    dst[xx*3+2] = sum[xx*3+2]*invWeight;
+
+                    // Same as texelCoordToVec(), without the edge fixup.
+                    const float uu = centroids[xx*2+0]*invWeight;
+                    const float vv = centroids[xx*2+1]*invWeight;
+                    float tmp[3];
+                    for (uint8_t ii = 0; ii < 3; ++ii)
+                    {
+                        tmp[ii] = uu*s_faceUvVectors[face][0][ii] + vv*s_faceUvVectors[face][1][ii] + s_faceUvVectors[face][2][ii];
+                    }
+                    vec3Norm(&vec[xx*4], tmp);
+                    vec[xx*4+3] = weights[xx];
+                }
+            }
+        }
+
+        free(corners);
+    }
+
+    /// Box filters faces of a RGBA32F or RGB32F view into RGB32F cubemap _dst for SH projection of _shOrder, see FilterSettings::m_shSourceFaceSize.
+    /// Faces are filtered by the biggest factor that divides the face size and keeps the error bound. Returns the table of _dst texel
+    /// vectors and solid angles to project with, in the layout of buildCubemapNormalSolidAngle(), or NULL if there is no such factor.
+    static float* shDownsampleView(Image& _dst, const ImageView& _view, uint8_t _shOrder, const FilterSettings& _settings)
+    {
+        if (0 == _settings.m_shSourceFaceSize)
+        {
+            return NULL;
+        }
+
+        // Smallest face size whose texels keep the error bound of the highest band.
+        const double band = double(_shOrder-1);
+        const double minFaceSize = PI/4.0 * sqrt(band*(band+1.0)/(2.0*double(max(_settings.m_shSourceMaxError, FLT_MIN))));
+        const uint32_t faceSize = max(_settings.m_shSourceFaceSize, uint32_t(ceil(minFaceSize)));
+
+        const uint32_t srcFaceSize = _view.m_faceSize;
+        uint32_t factor = srcFaceSize/max(faceSize, UINT32_C(1));
+        while (1 < factor && 0 != srcFaceSize%factor)
+        {
+            --factor;
+        }
+
+        if (2 > factor)
+        {
+            return NULL;
+        }
+
+        const uint32_t dstFaceSize = srcFaceSize/factor;
+        const uint64_t dstNumTexels = uint64_t(dstFaceSize)*dstFaceSize*CUBE_FACE_NUM;
+        const uint64_t dstDataSize = dstNumTexels*3*sizeof(float);
+        void* dstData = allocTagged(size_t(dstDataSize), AllocTag::SourceCopy);
+        MALLOC_CHECK(dstData);
+        float* vectors = (float*)malloc(size_t(dstNumTexels)*4*sizeof(float));
+        MALLOC_CHECK(vectors);
+
+        ShDownsampleArgs args;
+        args.m_src = &_view;
+        args.m_dst = (float*)dstData;
+        args.m_vectors = vectors;
+        args.m_faceSize = dstFaceSize;
+        args.m_factor = factor;
+        parallelFor((TextureFormat::RGB32F == _view.m_format) ? shDownsampleRows<3> : shDownsampleRows<4>, (void*)&args, dstFaceSize);
+
+        INFO("Spherical harmonics are projected from %ux%u faces box filtered from %ux%u.", dstFaceSize, dstFaceSize, srcFaceSize, srcFaceSize);
+
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGB32F;
+        result.m_numMips = 1;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = dstData;
+        imageMove(_dst, result);
+
+        return vectors;
+    }
+
+    /// Views cubemap, cube cross or hstrip faces for SH integration. RGBA32F and RGB32F faces are read in place,
+    /// anything else is gathered into _tmp as RGB32F.
+    static bool shViewOrConvert(ImageView& _view, Image& _tmp, const Image& _src)
+    {
+        AllocTagScope allocTag(AllocTag::SourceCopy);
+
+        // Recorded face rotations can not be viewed, faces are converted with them applied.
+        if (0 != _src.m_faceTransforms
+        &&  !imageViewFromImage(_view, _src))
+        {
+            imageConvert(_tmp, TextureFormat::RGB32F, _src);
+            return imageViewFromCubemap(_view, _tmp);
+        }
+
+        if (!imageViewFromImage(_view, _src))
+        {
+            return false;
+        }
+
+        if (TextureFormat::RGBA32F != _view.m_format
+        &&  TextureFormat::RGB32F  != _view.m_format)
+        {
+            ImageView baseMip = _view;
+            baseMip.m_numMips = 1;
+            imageFromView(_tmp, baseMip, TextureFormat::RGB32F);
+            imageViewFromCubemap(_view, _tmp);
+        }
+
+        return true;
+    }
+
+    /// Replaces view of big faces by a view of their copy in _tmp, box filtered for SH projection of _shOrder.
+    /// _tmp can be the image _view is of, see FilterSettings::m_shSourceFaceSize. Returns vectors to project the copy with, free() them
+    /// afterwards. Returns NULL and leaves _view as it is if faces are not reduced.
+    static float* shReduceView(ImageView& _view, Image& _tmp, uint8_t _shOrder, const FilterSettings& _settings)
+    {
+        AllocTagScope allocTag(AllocTag::SourceCopy);
+
+        Image small;
+        float* vectors = shDownsampleView(small, _view, _shOrder, _settings);
+        if (NULL != vectors)
+        {
+            imageMove(_tmp, small);
+            imageViewFromCubemap(_view, _tmp);
+        }
+
+        return vectors;
+    }
+
+    static void viewShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], const ImageView& _view, uint8_t _shOrder, bool _parallel = true, const float* _cubemapVectors = NULL)
+    {
+        // Unused higher order coefficients are zero.
+        memset(_shCoeffs, 0, SH_COEFF_NUM*3*sizeof(double));
+
+        switch (_shOrder)
+        {
+        case 2:  viewShCoeffs<2>(_shCoeffs, _view, _parallel, _cubemapVectors); break;
+        case 3:  viewShCoeffs<3>(_shCoeffs, _view, _parallel, _cubemapVectors); break;
+        default: viewShCoeffs<5>(_shCoeffs, _view, _parallel, _cubemapVectors); break;
+        }
+    }
+
+#ifndef CMFT_SH_PROJECT_GROUP_SIZE
+    #define CMFT_SH_PROJECT_GROUP_SIZE 64
+#endif //CMFT_SH_PROJECT_GROUP_SIZE
+
+#ifndef CMFT_SH_PROJECT_MAX_GROUPS
+    #define CMFT_SH_PROJECT_MAX_GROUPS 64
+#endif //CMFT_SH_PROJECT_MAX_GROUPS
+
+    /// Integrates base mip of a RGBA32F or RGB32F view with OpenCL. Returns false if device is not available.
+    /// Faces are uploaded one at a time, partial sums of each work-group are merged on the host in group order.
+    static bool viewShCoeffsGpu(double _shCoeffs[SH_COEFF_NUM][3], const ImageView& _view, uint8_t _shOrder, const ClContext* _clContext, bool _deterministic, FilterStats* _stats = NULL)
+    {
+        if (NULL == _clContext || NULL == _clContext->m_context)
+        {
+            return false;
+        }
+
+        cl_program program = _clContext->getProgram(s_irradianceShProgramSource);
+        if (NULL == program)
+        {
+            return false;
+        }
+
+        cl_int err;
+        cl_kernel kernel = clCreateKernel(program, "shProject", &err);
+        if (CL_SUCCESS != err)
+        {
+            WARN("Could not create OpenCL kernel shProject.");
+            clReleaseProgram(program);
+            return false;
+        }
+
+        // Reduction needs a power of two work-group size.
+        size_t maxWorkGroupSize = 0;
+        clGetKernelWorkGroupInfo(kernel, _clContext->m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
+        size_t groupSize = CMFT_SH_PROJECT_GROUP_SIZE;
+        while (groupSize > maxWorkGroupSize)
+        {
+            groupSize /= 2;
+        }
+
+        // Group size determines the order partial sums are added in.
+        if (_deterministic && CMFT_SH_PROJECT_GROUP_SIZE != groupSize)
+        {
+            groupSize = 0;
+        }
+
+        const uint32_t faceSize = _view.m_faceSize;
+        const uint8_t numChannels = (TextureFormat::RGB32F == _view.m_format) ? 3 : 4;
+        const size_t rowSize = size_t(faceSize)*numChannels*sizeof(float);
+
+        cl_mem memSrc = NULL;
+        if (0 != groupSize)
+        {
+            memSrc = clCreateBuffer(_clContext->m_context, CL_MEM_READ_ONLY, rowSize*faceSize, NULL, &err);
+        }
+        if (NULL == memSrc || CL_SUCCESS != err)
+        {
+            WARN("Could not set up OpenCL SH projection, coefficients are computed on the host.");
+            clReleaseKernel(kernel);
+            clReleaseProgram(program);
+            return false;
+        }
+
+        const uint32_t numTexels = faceSize*faceSize;
+        const uint32_t numGroups = min(uint32_t(CMFT_SH_PROJECT_MAX_GROUPS), uint32_t((numTexels + groupSize-1)/groupSize));
+        const uint32_t partialsPerFace = numGroups*SH_COEFF_NUM*4;
+        cl_mem memPartials = CL_CHECK_ERR(clCreateBuffer(_clContext->m_context
+                                        , CL_MEM_WRITE_ONLY
+                                        , partialsPerFace*sizeof(float)
+                                        , NULL
+                                        , &err
+                                        ));
+
+        float* partials = (float*)malloc(6*partialsPerFace*sizeof(float));
+        MALLOC_CHECK(partials);
+
+        const int32_t faceSizeArg = int32_t(faceSize);
+        const int32_t numChannelsArg = int32_t(numChannels);
+        const int32_t numCoeffs = int32_t(_shOrder)*_shOrder;
+        CL_CHECK(clSetKernelArg(kernel, 0, sizeof(cl_mem), (const void*)&memPartials));
+        CL_CHECK(clSetKernelArg(kernel, 1, sizeof(cl_mem), (const void*)&memSrc));
+        CL_CHECK(clSetKernelArg(kernel, 2, groupSize*4*sizeof(float), NULL));
+        CL_CHECK(clSetKernelArg(kernel, 3, sizeof(int32_t), (const void*)&faceSizeArg));
+        CL_CHECK(clSetKernelArg(kernel, 5, sizeof(int32_t), (const void*)&numChannelsArg));
+        CL_CHECK(clSetKernelArg(kernel, 7, sizeof(int32_t), (const void*)&numCoeffs));
+
+        // Queue is in order, so buffers are reused for each face. Source rows stay valid until clFinish().
+        const size_t globalSize = numGroups*groupSize;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (int64_t(rowSize) == _view.m_pitch[face][0])
+            {
+                CL_CHECK(clEnqueueWriteBuffer(_clContext->m_commandQueue, memSrc, CL_FALSE, 0, rowSize*faceSize, imageViewGetRow(_view, face, 0, 0), 0, NULL, NULL));
+            }
+            else
+            {
+                for (uint32_t yy = 0; yy < faceSize; ++yy)
+                {
+                    CL_CHECK(clEnqueueWriteBuffer(_clContext->m_commandQueue, memSrc, CL_FALSE, yy*rowSize, rowSize, imageViewGetRow(_view, face, 0, yy), 0, NULL, NULL));
+                }
+            }
+
+            const int8_t faceId = int8_t(face);
+            const int32_t flipX = int32_t(_view.m_flipX[face]);
+            CL_CHECK(clSetKernelArg(kernel, 4, sizeof(int8_t),  (const void*)&faceId));
+            CL_CHECK(clSetKernelArg(kernel, 6, sizeof(int32_t), (const void*)&flipX));
+            CL_CHECK(clEnqueueNDRangeKernel(_clContext->m_commandQueue, kernel, 1, NULL, &globalSize, &groupSize, 0, NULL, NULL));
+            CL_CHECK(clEnqueueReadBuffer(_clContext->m_commandQueue
+                                       , memPartials
+                                       , CL_FALSE
+                                       , 0
+                                       , partialsPerFace*sizeof(float)
+                                       , (void*)&partials[face*partialsPerFace]
+                                       , 0
+                                       , NULL
+                                       , NULL
+                                       ));
+        }
+        CL_CHECK(clFinish(_clContext->m_commandQueue));
+
+        if (NULL != _stats)
+        {
+            _stats->m_bytesToDevice += 6*rowSize*faceSize;
+            _stats->m_bytesFromDevice += 6*partialsPerFace*sizeof(float);
+        }
+
+        clReleaseMemObject(memPartials);
+        clReleaseMemObject(memSrc);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+
+        // Merge in group order. Unused higher order coefficients are zero.
+        memset(_shCoeffs, 0, SH_COEFF_NUM*3*sizeof(double));
+        double weightAccum = 0.0;
+        for (uint32_t group = 0; group < 6*numGroups; ++group)
+        {
+            const float* partial = &partials[group*SH_COEFF_NUM*4];
+            for (int32_t ii = 0; ii < numCoeffs; ++ii)
+            {
+                _shCoeffs[ii][0] += double(partial[ii*4+0]);
+                _shCoeffs[ii][1] += double(partial[ii*4+1]);
+                _shCoeffs[ii][2] += double(partial[ii*4+2]);
+            }
+            weightAccum += double(partial[3]);
+        }
+
+        free(partials);
+
+        const double norm = PI4 / weightAccum;
+        for (int32_t ii = 0; ii < numCoeffs; ++ii)
+        {
+            _shCoeffs[ii][0] *= norm;
+            _shCoeffs[ii][1] *= norm;
+            _shCoeffs[ii][2] *= norm;
+        }
+
+        return true;
+    }
+
+    bool imageShCoeffs(double _shCoeffs[SH_COEFF_NUM][3], const Image& _image, uint8_t _shOrder, const ClContext* _clContext, const FilterSettings* _settings)
+    {
+        const FilterSettings& settings = filterSettings(_settings);
+
+        if (!shOrderIsValid(_shOrder))
+        {
+            WARN("Spherical harmonics order %u is not supported. Supported orders are 2, 3 and 5.", _shOrder);
+            return false;
+        }
+
+        // Processing is done in Rgba32f or Rgb32f format.
+        ImageView view;
+        Image imageF32;
+        if (!shViewOrConvert(view, imageF32, _image))
+        {
+            return false;
+        }
+        float* reducedVectors = shReduceView(view, imageF32, _shOrder, settings);
+
+        // Compute spherical harmonic coefficients. Reduced sources are projected on the CPU, with their own texel vectors.
+        if (NULL != reducedVectors
+        ||  !viewShCoeffsGpu(_shCoeffs, view, _shOrder, _clContext, settings.m_deterministic))
+        {
+            viewShCoeffs(_shCoeffs, view, _shOrder, true, reducedVectors);
+        }
+        free(reducedVectors);
+
+        // Cleanup.
+        imageUnload(imageF32);
+
+        return true;
+    }
+
+    // Probe atlas.
+    //-----
+
+    /// Atlases of probes up to this face size are projected probe-major: basis functions are evaluated once per texel and
+    /// applied to 4 probes at a time, one per SIMD lane. Table of weighted basis values takes 6*faceSize^2*Order^2 floats.
+#ifndef CMFT_SH_ATLAS_BATCH_MAX_FACE_SIZE
+    #define CMFT_SH_ATLAS_BATCH_MAX_FACE_SIZE 64
+#endif //CMFT_SH_ATLAS_BATCH_MAX_FACE_SIZE
+
+    /// Probes projected by one task of the probe-major path. Rows of the basis table stay in cache across them.
+#ifndef CMFT_SH_ATLAS_BATCH_PROBES
+    #define CMFT_SH_ATLAS_BATCH_PROBES 16
+#endif //CMFT_SH_ATLAS_BATCH_PROBES
+
+    struct ShAtlasArgs
+    {
+        double (*m_shCoeffs)[SH_COEFF_NUM][3];
+        const Image* m_atlas;
+        const float* m_cubemapVectors;
+        float* m_basisTable;  //!< Basis values times solid angle, Order*Order floats per texel, faces and rows in order.
+        double m_norm;
+        uint32_t m_tileWidth;
+        uint32_t m_tileHeight;
+        uint32_t m_numTiles;
+        uint32_t m_faceSize;
+        uint8_t m_shOrder;
+    };
+
+    // Probes are small, each one is integrated on a single thread and threads take whole probes.
+    static void shCoeffsAtlasTiles(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ShAtlasArgs* args = (const ShAtlasArgs*)_userData;
+
+        for (uint32_t tile = _begin; tile < _end; ++tile)
+        {
+            ImageView view;
+            imageViewFromAtlasTile(view, *args->m_atlas, tile, args->m_tileWidth, args->m_tileHeight);
+            viewShCoeffs(args->m_shCoeffs[tile], view, args->m_shOrder, false);
+        }
+    }
+
+#if CMFT_RADIANCE_SIMD
+    /// Fills rows [_begin, _end) of the basis table, rows of all faces numbered in order.
+    template <uint8_t Order>
+    static void shBasisTableRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ShAtlasArgs* args = (const ShAtlasArgs*)_userData;
+        const uint32_t faceSize = args->m_faceSize;
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const float* vecPtr = &args->m_cubemapVectors[uint64_t(row)*faceSize*4];
+            float* dst = &args->m_basisTable[uint64_t(row)*faceSize*Order*Order];
+
+            for (uint32_t xx = 0; xx < faceSize; ++xx, vecPtr += 4, dst += Order*Order)
+            {
+                double shBasis[Order*Order];
+                evalSHBasis<Order>(shBasis, vecPtr);
+
+                const double weight = double(vecPtr[3]);
+                for (uint16_t ii = 0; ii < Order*Order; ++ii)
+                {
+                    dst[ii] = float(shBasis[ii]*weight);
+                }
+            }
+        }
+    }
+
+    /// Probe-major projection of CMFT_SH_ATLAS_BATCH_PROBES probes per task. Each texel row is a small matrix product:
+    /// weighted basis values of the row times colors of 4 probes, one per lane, accumulated in float and reduced per row
+    /// in double precision, like shAccumulateRowSimd() does.
+    template <uint8_t Order, uint8_t NumChannels>
+    static void shCoeffsAtlasBlocks(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        using namespace bx;
+
+        const ShAtlasArgs* args = (const ShAtlasArgs*)_userData;
+        const uint32_t faceSize = args->m_faceSize;
+        const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+        for (uint32_t block = _begin; block < _end; ++block)
+        {
+            const uint32_t tileBegin = block*CMFT_SH_ATLAS_BATCH_PROBES;
+            const uint32_t tileEnd = min(tileBegin + CMFT_SH_ATLAS_BATCH_PROBES, args->m_numTiles);
+            const uint32_t numGroups = (tileEnd - tileBegin + 3)/4;
+
+            ImageView views[CMFT_SH_ATLAS_BATCH_PROBES];
+            for (uint32_t tile = tileBegin; tile < tileEnd; ++tile)
+            {
+                imageViewFromAtlasTile(views[tile-tileBegin], *args->m_atlas, tile, args->m_tileWidth, args->m_tileHeight);
+                memset(args->m_shCoeffs[tile], 0, sizeof(args->m_shCoeffs[tile]));
+            }
+
+            for (uint8_t face = 0; face < 6; ++face)
+            {
+                for (uint32_t yy = 0; yy < faceSize; ++yy)
+                {
+                    const float* basisRow = &args->m_basisTable[(uint64_t(face)*faceSize + yy)*faceSize*Order*Order];
+
+                    for (uint32_t group = 0; group < numGroups; ++group)
+                    {
+                        // Mirrored faces are walked backwards, missing probes of the last group read zeros.
+                        const float* srcPtr[4];
+                        int32_t srcStep[4];
+                        for (uint32_t lane = 0; lane < 4; ++lane)
+                        {
+                            const uint32_t tile = tileBegin + group*4 + lane;
+                            if (tile < tileEnd)
+                            {
+                                const ImageView& view = views[tile-tileBegin];
+                                srcPtr[lane] = (const float*)imageViewGetRow(view, face, 0, yy);
+                                srcStep[lane] = NumChannels;
+                                if (view.m_flipX[face])
+                                {
+                                    srcPtr[lane] += (faceSize-1)*NumChannels;
+                                    srcStep[lane] = -NumChannels;
+                                }
+                            }
+                            else
+                            {
+                                srcPtr[lane] = zero;
+                                srcStep[lane] = 0;
+                            }
+                        }
+
+                        float4_t acc[Order*Order][3];
+                        for (uint16_t ii = 0; ii < Order*Order; ++ii)
+                        {
+                            acc[ii][0] = float4_zero();
+                            acc[ii][1] = float4_zero();
+                            acc[ii][2] = float4_zero();
+                        }
+
+                        const float* basis = basisRow;
+                        for (uint32_t xx = 0; xx < faceSize; ++xx, basis += Order*Order)
+                        {
+                            const float* c0 = srcPtr[0] + int32_t(xx)*srcStep[0];
+                            const float* c1 = srcPtr[1] + int32_t(xx)*srcStep[1];
+                            const float* c2 = srcPtr[2] + int32_t(xx)*srcStep[2];
+                            const float* c3 = srcPtr[3] + int32_t(xx)*srcStep[3];
+                            float4_t rr;
+                            float4_t gg;
+                            float4_t bb;
+                            if (4 == NumChannels)
+                            {
+                                // Transpose 4 rgba texels to rrrr, gggg, bbbb. Rows are not aligned to float4s.
+                                float4_t t0, t1, t2, t3;
+                                memcpy(&t0, c0, sizeof(float4_t));
+                                memcpy(&t1, c1, sizeof(float4_t));
+                                memcpy(&t2, c2, sizeof(float4_t));
+                                memcpy(&t3, c3, sizeof(float4_t));
+                                const float4_t u0 = float4_shuf_xAyB(t0, t1);
+                                const float4_t u1 = float4_shuf_zCwD(t0, t1);
+                                const float4_t u2 = float4_shuf_xAyB(t2, t3);
+                                const float4_t u3 = float4_shuf_zCwD(t2, t3);
+                                rr = float4_shuf_xyAB(u0, u2);
+                                gg = float4_shuf_zwCD(u0, u2);
+                                bb = float4_shuf_xyAB(u1, u3);
+                            }
+                            else
+                            {
+                                rr = float4_ld(c0[0], c1[0], c2[0], c3[0]);
+                                gg = float4_ld(c0[1], c1[1], c2[1], c3[1]);
+                                bb = float4_ld(c0[2], c1[2], c2[2], c3[2]);
+                            }
+
+                            for (uint16_t ii = 0; ii < Order*Order; ++ii)
+                            {
+                                const float4_t bw = float4_splat(basis[ii]);
+                                acc[ii][0] = float4_madd(bw, rr, acc[ii][0]);
+                                acc[ii][1] = float4_madd(bw, gg, acc[ii][1]);
+                                acc[ii][2] = float4_madd(bw, bb, acc[ii][2]);
+                            }
+                        }
+
+                        // Reduce the row in double precision, a lane per probe.
+                        for (uint32_t lane = 0, tile = tileBegin + group*4; lane < 4 && tile < tileEnd; ++lane, ++tile)
+                        {
+                            double (*shCoeffs)[3] = args->m_shCoeffs[tile];
+                            for (uint16_t ii = 0; ii < Order*Order; ++ii)
+                            {
+                                for (uint8_t cc = 0; cc < 3; ++cc)
+                                {
+                                    float val[4];
+                                    memcpy(val, &acc[ii][cc], sizeof(val));
+                                    shCoeffs[ii][cc] += double(val[lane]);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Normalization, solid angles are the same for all probes.
+            for (uint32_t tile = tileBegin; tile < tileEnd; ++tile)
+            {
+                for (uint16_t ii = 0; ii < Order*Order; ++ii)
+                {
+                    args->m_shCoeffs[tile][ii][0] *= args->m_norm;
+                    args->m_shCoeffs[tile][ii][1] *= args->m_norm;
+                    args->m_shCoeffs[tile][ii][2] *= args->m_norm;
+                }
+            }
+        }
+    }
+
+    template <uint8_t Order>
+    static void shCoeffsAtlasBatch(ShAtlasArgs& _args, bool _rgb)
+    {
+        const uint32_t faceSize = _args.m_faceSize;
+        const uint32_t numRows = 6*faceSize;
+
+        _args.m_basisTable = (float*)malloc(uint64_t(numRows)*faceSize*Order*Order*sizeof(float));
+        MALLOC_CHECK(_args.m_basisTable);
+        parallelFor(shBasisTableRows<Order>, (void*)&_args, numRows, CMFT_SH_ROWS_PER_CHUNK);
+
+        double weightAccum = 0.0;
+        for (uint32_t ii = 0, end = numRows*faceSize; ii < end; ++ii)
+        {
+            weightAccum += double(_args.m_cubemapVectors[ii*4+3]);
+        }
+        _args.m_norm = PI4 / weightAccum;
+
+        const uint32_t numBlocks = (_args.m_numTiles + CMFT_SH_ATLAS_BATCH_PROBES-1)/CMFT_SH_ATLAS_BATCH_PROBES;
+        parallelFor(_rgb ? shCoeffsAtlasBlocks<Order, 3> : shCoeffsAtlasBlocks<Order, 4>, (void*)&_args, numBlocks);
+
+        free(_args.m_basisTable);
+        _args.m_basisTable = NULL;
+    }
+#endif // CMFT_RADIANCE_SIMD
+
+    bool imageShCoeffsAtlas(double (*_shCoeffs)[SH_COEFF_NUM][3], const Image& _atlas, uint32_t _tileWidth, uint32_t _tileHeight, uint8_t _shOrder)
+    {
+        if (!shOrderIsValid(_shOrder))
+        {
+            WARN("Spherical harmonics order %u is not supported. Supported orders are 2, 3 and 5.", _shOrder);
+            return false;
+        }
+
+        // Layout is checked on the first tile, all of them are the same.
+        ImageView view;
+        if (!imageViewFromAtlasTile(view, _atlas, 0, _tileWidth, _tileHeight))
+        {
+            WARN("Tiles of %ux%u image have to be %ux%u hstrips or cube crosses.", _atlas.m_width, _atlas.m_height, _tileWidth, _tileHeight);
+            return false;
+        }
+
+        // Processing is done in Rgba32f or Rgb32f format.
+        Image atlasF32;
+        const bool isRef = shRefOrConvert(atlasF32, _atlas);
+
+        // Cached vectors are shared by all probes.
+        const float* cubemapVectors = acquireCubemapNormalSolidAngle(view.m_faceSize);
+        ScopeReleaseNormalSolidAngle cleanup(cubemapVectors);
+
+        ShAtlasArgs args;
+        args.m_shCoeffs = _shCoeffs;
+        args.m_atlas = &atlasF32;
+        args.m_cubemapVectors = cubemapVectors;
+        args.m_basisTable = NULL;
+        args.m_norm = 1.0;
+        args.m_tileWidth = _tileWidth;
+        args.m_tileHeight = _tileHeight;
+        args.m_numTiles = imageAtlasNumTiles(_atlas, _tileWidth, _tileHeight);
+        args.m_faceSize = view.m_faceSize;
+        args.m_shOrder = _shOrder;
+
+#if CMFT_RADIANCE_SIMD
+        // Many small probes share all texel directions, basis functions are evaluated once for all of them.
+        if (view.m_faceSize <= CMFT_SH_ATLAS_BATCH_MAX_FACE_SIZE
+        &&  args.m_numTiles >= 4)
+        {
+            const bool rgb = (TextureFormat::RGB32F == atlasF32.m_format);
+            switch (_shOrder)
+            {
+            case 2:  shCoeffsAtlasBatch<2>(args, rgb); break;
+            case 3:  shCoeffsAtlasBatch<3>(args, rgb); break;
+            default: shCoeffsAtlasBatch<5>(args, rgb); break;
+            }
+        }
+        else
+#endif // CMFT_RADIANCE_SIMD
+        {
+            parallelFor(shCoeffsAtlasTiles, (void*)&args, args.m_numTiles);
+        }
+
+        if (!isRef)
+        {
+            imageUnload(atlasF32);
+        }
+
+        return true;
+    }
+
+    // Probe basis.
+    //-----
+
+    /// Subspace iterations, each one refines all components at once. Probes of a grid are similar, few are needed.
+#ifndef CMFT_PROBE_BASIS_ITERATIONS
+    #define CMFT_PROBE_BASIS_ITERATIONS 8
+#endif //CMFT_PROBE_BASIS_ITERATIONS
+
+    /// Rows of the probe and basis matrices are padded to whole float4s and aligned to them.
+    static inline float* probeBasisAlign(void* _mem)
+    {
+        return (float*)(((uintptr_t)_mem + 15) & ~uintptr_t(15));
+    }
+
+    static inline float probeBasisDot(const float* _a, const float* _b, uint32_t _stride)
+    {
+#if CMFT_RADIANCE_SIMD
+        using namespace bx;
+        float4_t acc = float4_zero();
+        for (uint32_t ii = 0; ii < _stride; ii += 4)
+        {
+            acc = float4_madd(float4_ld(&_a[ii]), float4_ld(&_b[ii]), acc);
+        }
+        return float4_x(acc) + float4_y(acc) + float4_z(acc) + float4_w(acc);
+#else
+        float acc = 0.0f;
+        for (uint32_t ii = 0; ii < _stride; ++ii)
+        {
+            acc += _a[ii]*_b[ii];
+        }
+        return acc;
+#endif // CMFT_RADIANCE_SIMD
+    }
+
+    /// _dst += _src*_scale over [_begin, _end), both multiples of 4.
+    static inline void probeBasisMadd(float* _dst, const float* _src, float _scale, uint32_t _begin, uint32_t _end)
+    {
+#if CMFT_RADIANCE_SIMD
+        using namespace bx;
+        const float4_t scale = float4_splat(_scale);
+        for (uint32_t ii = _begin; ii < _end; ii += 4)
+        {
+            float4_st(&_dst[ii], float4_madd(float4_ld(&_src[ii]), scale, float4_ld(&_dst[ii])));
+        }
+#else
+        for (uint32_t ii = _begin; ii < _end; ++ii)
+        {
+            _dst[ii] += _src[ii]*_scale;
+        }
+#endif // CMFT_RADIANCE_SIMD
+    }
+
+    struct ProbeBasisArgs
+    {
+        const Image* m_probes;
+        float* m_data;        //!< Probes minus mean, a row of m_stride values each.
+        float* m_mean;
+        float* m_proj;        //!< Projections of every probe on every component.
+        float* m_basis;       //!< Components, a row of m_stride values each.
+        float* m_next;
+        uint32_t m_numProbes;
+        uint32_t m_numComponents;
+        uint32_t m_dimension;
+        uint32_t m_stride;
+    };
+
+    /// Rgb of all texels of each probe, padding stays zero.
+    static void probeBasisGather(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ProbeBasisArgs* args = (const ProbeBasisArgs*)_userData;
+
+        for (uint32_t probe = _begin; probe < _end; ++probe)
+        {
+            Image rgba32f;
+            const bool isRef = imageRefOrConvert(rgba32f, TextureFormat::RGBA32F, args->m_probes[probe]);
+
+            const float* src = (const float*)rgba32f.m_data;
+            float* dst = &args->m_data[uint64_t(probe)*args->m_stride];
+            for (uint32_t ii = 0, end = args->m_dimension/3; ii < end; ++ii)
+            {
+                dst[ii*3+0] = src[ii*4+0];
+                dst[ii*3+1] = src[ii*4+1];
+                dst[ii*3+2] = src[ii*4+2];
+            }
+
+            if (!isRef)
+            {
+                imageUnload(rgba32f);
+            }
+        }
+    }
+
+    /// Mean of columns [_begin*4, _end*4) and its removal from every probe.
+    static void probeBasisCenter(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ProbeBasisArgs* args = (const ProbeBasisArgs*)_userData;
+        const float invNumProbes = 1.0f/float(int32_t(args->m_numProbes));
+
+        memset(&args->m_mean[_begin*4], 0, (_end-_begin)*4*sizeof(float));
+        for (uint32_t probe = 0; probe < args->m_numProbes; ++probe)
+        {
+            probeBasisMadd(args->m_mean, &args->m_data[uint64_t(probe)*args->m_stride], invNumProbes, _begin*4, _end*4);
+        }
+
+        for (uint32_t probe = 0; probe < args->m_numProbes; ++probe)
+        {
+            probeBasisMadd(&args->m_data[uint64_t(probe)*args->m_stride], args->m_mean, -1.0f, _begin*4, _end*4);
+        }
+    }
+
+    /// Projections of probes on the components.
+    static void probeBasisProject(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ProbeBasisArgs* args = (const ProbeBasisArgs*)_userData;
+
+        for (uint32_t probe = _begin; probe < _end; ++probe)
+        {
+            const float* row = &args->m_data[uint64_t(probe)*args->m_stride];
+            for (uint32_t comp = 0; comp < args->m_numComponents; ++comp)
+            {
+                args->m_proj[uint64_t(probe)*args->m_numComponents + comp] = probeBasisDot(row, &args->m_basis[uint64_t(comp)*args->m_stride], args->m_stride);
+            }
+        }
+    }
+
+    /// Probes summed with their projections as weights, over columns [_begin*4, _end*4). The range of every probe stays in cache for all components.
+    static void probeBasisAccumulate(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ProbeBasisArgs* args = (const ProbeBasisArgs*)_userData;
+
+        for (uint32_t comp = 0; comp < args->m_numComponents; ++comp)
+        {
+            memset(&args->m_next[uint64_t(comp)*args->m_stride + _begin*4], 0, (_end-_begin)*4*sizeof(float));
+        }
+
+        for (uint32_t probe = 0; probe < args->m_numProbes; ++probe)
+        {
+            const float* row = &args->m_data[uint64_t(probe)*args->m_stride];
+            for (uint32_t comp = 0; comp < args->m_numComponents; ++comp)
+            {
+                const float weight = args->m_proj[uint64_t(probe)*args->m_numComponents + comp];
+                probeBasisMadd(&args->m_next[uint64_t(comp)*args->m_stride], row, weight, _begin*4, _end*4);
+            }
+        }
+    }
+
+    /// Modified Gram-Schmidt of _numRows rows. Rows that are not independent of the previous ones become zero.
+    static void probeBasisOrthonormalize(float* _rows, uint32_t _numRows, uint32_t _stride)
+    {
+        for (uint32_t ii = 0; ii < _numRows; ++ii)
+        {
+            float* row = &_rows[uint64_t(ii)*_stride];
+            const float norm0 = sqrtf(probeBasisDot(row, row, _stride));
+            for (uint32_t jj = 0; jj < ii; ++jj)
+            {
+                const float* prev = &_rows[uint64_t(jj)*_stride];
+                probeBasisMadd(row, prev, -probeBasisDot(row, prev, _stride), 0, _stride);
+            }
+
+            const float norm = sqrtf(probeBasisDot(row, row, _stride));
+            const float scale = (norm > norm0*1e-4f && norm > 0.0f) ? 1.0f/norm : 0.0f;
+            for (uint32_t kk = 0; kk < _stride; ++kk)
+            {
+                row[kk] *= scale;
+            }
+        }
+    }
+
+    /// Eigenvalues and eigenvectors of symmetric _n x _n matrix _a by cyclic Jacobi rotations. _a is destroyed,
+    /// its diagonal holds eigenvalues, column jj of _v the eigenvector of _a[jj][jj].
+    static void probeBasisEigen(double* _a, double* _v, uint32_t _n)
+    {
+        for (uint32_t ii = 0; ii < _n*_n; ++ii)
+        {
+            _v[ii] = (ii/_n == ii%_n) ? 1.0 : 0.0;
+        }
+
+        for (uint32_t sweep = 0; sweep < 64; ++sweep)
+        {
+            double offDiagonal = 0.0;
+            for (uint32_t pp = 0; pp < _n; ++pp)
+            {
+                for (uint32_t qq = pp+1; qq < _n; ++qq)
+                {
+                    offDiagonal += _a[pp*_n+qq]*_a[pp*_n+qq];
+                }
+            }
+            if (offDiagonal < 1e-30)
+            {
+                break;
+            }
+
+            for (uint32_t pp = 0; pp < _n; ++pp)
+            {
+                for (uint32_t qq = pp+1; qq < _n; ++qq)
+                {
+                    const double apq = _a[pp*_n+qq];
+                    if (0.0 == apq)
+                    {
+                        continue;
+                    }
+
+                    const double theta = (_a[qq*_n+qq] - _a[pp*_n+pp])/(2.0*apq);
+                    const double tt = ((theta >= 0.0) ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1.0));
+                    const double cc = 1.0/sqrt(tt*tt + 1.0);
+                    const double ss = tt*cc;
+
+                    for (uint32_t kk = 0; kk < _n; ++kk)
+                    {
+                        const double akp = _a[kk*_n+pp];
+                        const double akq = _a[kk*_n+qq];
+                        _a[kk*_n+pp] = cc*akp - ss*akq;
+                        _a[kk*_n+qq] = ss*akp + cc*akq;
+                    }
+
+                    for (uint32_t kk = 0; kk < _n; ++kk)
+                    {
+                        const double apk = _a[pp*_n+kk];
+                        const double aqk = _a[qq*_n+kk];
+                        _a[pp*_n+kk] = cc*apk - ss*aqk;
+                        _a[qq*_n+kk] = ss*apk + cc*aqk;
+                    }
+
+                    for (uint32_t kk = 0; kk < _n; ++kk)
+                    {
+                        const double vkp = _v[kk*_n+pp];
+                        const double vkq = _v[kk*_n+qq];
+                        _v[kk*_n+pp] = cc*vkp - ss*vkq;
+                        _v[kk*_n+qq] = ss*vkp + cc*vkq;
+                    }
+                }
+            }
+        }
+    }
+
+    bool probeBasisCompute(ProbeBasis& _basis, const Image* _probes, uint32_t _numProbes, uint32_t _maxComponents, float _maxError)
+    {
+        CMFT_PROFILE_ZONE("probeBasisCompute");
+
+        const uint64_t entryTime = bx::getHPCounter();
+
+        if (0 == _numProbes
+        ||  0 == _maxComponents
+        ||  !imageIsCubemap(_probes[0]))
+        {
+            WARN("Probe basis needs at least one cubemap probe and one component.");
+            return false;
+        }
+
+        const Image& first = _probes[0];
+        for (uint32_t probe = 1; probe < _numProbes; ++probe)
+        {
+            if (_probes[probe].m_width != first.m_width
+            ||  _probes[probe].m_numMips != first.m_numMips
+            ||  !imageIsCubemap(_probes[probe]))
+            {
+                WARN("Probe %u differs from probe 0 in face size or mip count.", probe);
+                return false;
+            }
+        }
+
+        uint32_t numTexels = 0;
+        for (uint8_t mip = 0; mip < first.m_numMips; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), first.m_width >> mip);
+            numTexels += mipFaceSize*mipFaceSize*CUBE_FACE_NUM;
+        }
+
+        ProbeBasisArgs args;
+        args.m_probes = _probes;
+        args.m_numProbes = _numProbes;
+        args.m_dimension = numTexels*3;
+        args.m_stride = align(args.m_dimension, UINT32_C(4));
+        args.m_numComponents = min(min(_maxComponents, uint32_t(MAX_PROBE_BASIS_COMPONENTS)), min(_numProbes, args.m_dimension));
+
+        const uint64_t dataFloats = uint64_t(_numProbes)*args.m_stride;
+        const uint64_t basisFloats = uint64_t(args.m_numComponents)*args.m_stride;
+        void* mem = malloc((dataFloats + args.m_stride + 2*basisFloats)*sizeof(float) + 15);
+        MALLOC_CHECK(mem);
+        memset(mem, 0, (dataFloats + args.m_stride + 2*basisFloats)*sizeof(float) + 15);
+        args.m_data  = probeBasisAlign(mem);
+        args.m_mean  = args.m_data + dataFloats;
+        args.m_basis = args.m_mean + args.m_stride;
+        args.m_next  = args.m_basis + basisFloats;
+        args.m_proj  = (float*)malloc(uint64_t(_numProbes)*args.m_numComponents*sizeof(float));
+        MALLOC_CHECK(args.m_proj);
+
+        INFO("Computing probe basis:"
+             "\n\t[probes=%u]"
+             "\n\t[faceSize=%u]"
+             "\n\t[mips=%u]"
+             "\n\t[dimension=%u]"
+             "\n\t[maxComponents=%u]"
+             , _numProbes
+             , first.m_width
+             , first.m_numMips
+             , args.m_dimension
+             , args.m_numComponents
+             );
+
+        const uint32_t numChunks = args.m_stride/4;
+        parallelFor(probeBasisGather, (void*)&args, _numProbes);
+
+        // Energy of the probes, relative error is measured against it.
+        double signalEnergy = 0.0;
+        for (uint32_t probe = 0; probe < _numProbes; ++probe)
+        {
+            const float* row = &args.m_data[uint64_t(probe)*args.m_stride];
+            signalEnergy += double(probeBasisDot(row, row, args.m_stride));
+        }
+
+        parallelFor(probeBasisCenter, (void*)&args, numChunks, 64);
+
+        double centeredEnergy = 0.0;
+        for (uint32_t probe = 0; probe < _numProbes; ++probe)
+        {
+            const float* row = &args.m_data[uint64_t(probe)*args.m_stride];
+            centeredEnergy += double(probeBasisDot(row, row, args.m_stride));
+        }
+
+        // Start from the first probes, they span the batch better than random vectors.
+        for (uint32_t comp = 0; comp < args.m_numComponents; ++comp)
+        {
+            const uint32_t probe = uint32_t(uint64_t(comp)*_numProbes/args.m_numComponents);
+            memcpy(&args.m_basis[uint64_t(comp)*args.m_stride], &args.m_data[uint64_t(probe)*args.m_stride], args.m_stride*sizeof(float));
+        }
+        probeBasisOrthonormalize(args.m_basis, args.m_numComponents, args.m_stride);
+
+        for (uint32_t iter = 0; iter < CMFT_PROBE_BASIS_ITERATIONS; ++iter)
+        {
+            parallelFor(probeBasisProject, (void*)&args, _numProbes);
+            parallelFor(probeBasisAccumulate, (void*)&args, numChunks, 64);
+            probeBasisOrthonormalize(args.m_next, args.m_numComponents, args.m_stride);
+
+            float* tmp = args.m_basis;
+            args.m_basis = args.m_next;
+            args.m_next = tmp;
+        }
+
+        // Rayleigh-Ritz, components are rotated to the principal axes within the subspace and sorted by variance.
+        parallelFor(probeBasisProject, (void*)&args, _numProbes);
+
+        const uint32_t numComps = args.m_numComponents;
+        double* gram = (double*)malloc(2*numComps*numComps*sizeof(double));
+        MALLOC_CHECK(gram);
+        double* vecs = gram + numComps*numComps;
+        memset(gram, 0, numComps*numComps*sizeof(double));
+        for (uint32_t probe = 0; probe < _numProbes; ++probe)
+        {
+            const float* proj = &args.m_proj[uint64_t(probe)*numComps];
+            for (uint32_t ii = 0; ii < numComps; ++ii)
+            {
+                for (uint32_t jj = 0; jj < numComps; ++jj)
+                {
+                    gram[ii*numComps+jj] += double(proj[ii])*double(proj[jj]);
+                }
+            }
+        }
+        probeBasisEigen(gram, vecs, numComps);
+
+        uint32_t order[MAX_PROBE_BASIS_COMPONENTS];
+        for (uint32_t ii = 0; ii < numComps; ++ii)
+        {
+            order[ii] = ii;
+        }
+        for (uint32_t ii = 1; ii < numComps; ++ii)
+        {
+            for (uint32_t jj = ii; jj > 0 && gram[order[jj]*numComps+order[jj]] > gram[order[jj-1]*numComps+order[jj-1]]; --jj)
+            {
+                const uint32_t tmp = order[jj];
+                order[jj] = order[jj-1];
+                order[jj-1] = tmp;
+            }
+        }
+
+        // Fewest components within _maxError.
+        uint32_t numKept = numComps;
+        double captured = 0.0;
+        double error = 0.0;
+        for (uint32_t ii = 0; ii < numComps; ++ii)
+        {
+            captured += max(0.0, gram[order[ii]*numComps+order[ii]]);
+            error = (0.0 < signalEnergy) ? sqrt(max(0.0, centeredEnergy - captured)/signalEnergy) : 0.0;
+            if (0.0f < _maxError
+            &&  error <= double(_maxError))
+            {
+                numKept = ii+1;
+                break;
+            }
+        }
+
+        ProbeBasis result;
+        result.m_faceSize = first.m_width;
+        result.m_numMips = first.m_numMips;
+        result.m_dimension = args.m_dimension;
+        result.m_numComponents = numKept;
+        result.m_numProbes = _numProbes;
+        result.m_error = float(error);
+        result.m_mean = (float*)malloc(uint64_t(args.m_dimension)*sizeof(float));
+        result.m_basis = (float*)malloc(uint64_t(numKept)*args.m_dimension*sizeof(float));
+        result.m_coeffs = (float*)malloc(uint64_t(_numProbes)*numKept*sizeof(float));
+        MALLOC_CHECK(result.m_mean);
+        MALLOC_CHECK(result.m_basis);
+        MALLOC_CHECK(result.m_coeffs);
+
+        memcpy(result.m_mean, args.m_mean, args.m_dimension*sizeof(float));
+        for (uint32_t kk = 0; kk < numKept; ++kk)
+        {
+            float* dst = &args.m_next[0];
+            memset(dst, 0, args.m_stride*sizeof(float));
+            for (uint32_t ii = 0; ii < numComps; ++ii)
+            {
+                probeBasisMadd(dst, &args.m_basis[uint64_t(ii)*args.m_stride], float(vecs[ii*numComps+order[kk]]), 0, args.m_stride);
+            }
+            memcpy(&result.m_basis[uint64_t(kk)*args.m_dimension], dst, args.m_dimension*sizeof(float));
+        }
+
+        for (uint32_t probe = 0; probe < _numProbes; ++probe)
+        {
+            const float* proj = &args.m_proj[uint64_t(probe)*numComps];
+            for (uint32_t kk = 0; kk < numKept; ++kk)
+            {
+                double coeff = 0.0;
+                for (uint32_t ii = 0; ii < numComps; ++ii)
+                {
+                    coeff += double(proj[ii])*vecs[ii*numComps+order[kk]];
+                }
+                result.m_coeffs[uint64_t(probe)*numKept + kk] = float(coeff);
+            }
+        }
+
+        free(gram);
+        free(args.m_proj);
+        free(mem);
+
+        probeBasisUnload(_basis);
+        _basis = result;
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Probe basis -> %u components, relative RMS error %.4f, %.1fx smaller. Total time: %.3f seconds."
+             , numKept
+             , result.m_error
+             , double(uint64_t(_numProbes)*args.m_dimension)/double(uint64_t(numKept + 1)*args.m_dimension + uint64_t(_numProbes)*numKept)
+             , double(bx::getHPCounter() - entryTime)*toSec
+             );
+
+        return true;
+    }
+
+    bool probeBasisReconstruct(Image& _dst, const ProbeBasis& _basis, uint32_t _probe)
+    {
+        if (_probe >= _basis.m_numProbes)
+        {
+            WARN("Probe %u requested, basis has %u.", _probe, _basis.m_numProbes);
+            return false;
+        }
+
+        Image result;
+        result.m_width = _basis.m_faceSize;
+        result.m_height = _basis.m_faceSize;
+        result.m_dataSize = uint64_t(_basis.m_dimension/3)*4*sizeof(float);
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = _basis.m_numMips;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = malloc(result.m_dataSize);
+        MALLOC_CHECK(result.m_data);
+
+        const float* coeffs = &_basis.m_coeffs[uint64_t(_probe)*_basis.m_numComponents];
+        float* dst = (float*)result.m_data;
+        for (uint32_t ii = 0, end = _basis.m_dimension/3; ii < end; ++ii)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                const uint32_t idx = ii*3+cc;
+                float val = _basis.m_mean[idx];
+                for (uint32_t kk = 0; kk < _basis.m_numComponents; ++kk)
+                {
+                    val += coeffs[kk]*_basis.m_basis[uint64_t(kk)*_basis.m_dimension + idx];
+                }
+                dst[ii*4+cc] = val;
+            }
+            dst[ii*4+3] = 1.0f;
+        }
+
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    void probeBasisUnload(ProbeBasis& _basis)
+    {
+        free(_basis.m_mean);
+        free(_basis.m_basis);
+        free(_basis.m_coeffs);
+        _basis = ProbeBasis();
+    }
+
+    // Latlong images are integrated directly, rows are chunked the same way as cubemap faces.
+    template <uint8_t Order>
+    struct ShLatLongArgs
+    {
+        ShPartialSum<Order>* m_partials;
+        const float* m_data;
+        const float* m_sinCosPhi;
+        uint32_t m_width;
+        uint32_t m_height;
+    };
+
+    template <uint8_t Order, uint8_t NumChannels>
+    static void shCoeffsLatLongChunks(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ShLatLongArgs<Order>* args = (const ShLatLongArgs<Order>*)_userData;
+
+        const uint32_t width = args->m_width;
+        const uint32_t height = args->m_height;
+        const uint32_t pitch = width * NumChannels;
+        const double dPhi = 2.0*PI/double(width);
+
+        // Row of (x,y,z,solidAngle) vectors, same layout as the cubemap vectors.
+        float* rowVectors = (float*)malloc(width*4*sizeof(float));
+        MALLOC_CHECK(rowVectors);
+
+        for (uint32_t chunk = _begin; chunk < _end; ++chunk)
+        {
+            ShPartialSum<Order>& sum = args->m_partials[chunk];
+            memset(&sum, 0, sizeof(ShPartialSum<Order>));
+
+            const uint32_t yBegin = chunk * CMFT_SH_ROWS_PER_CHUNK;
+            const uint32_t yEnd = min(yBegin + CMFT_SH_ROWS_PER_CHUNK, height);
+
+            for (uint32_t yy = yBegin; yy < yEnd; ++yy)
+            {
+                // Exact solid angle of the texel row band: dPhi * (cos(theta0) - cos(theta1)).
+                const double theta0 = PI*double(yy)  /double(height);
+                const double theta1 = PI*double(yy+1)/double(height);
+                const double thetaC = PI*(double(yy)+0.5)/double(height);
+                const float solidAngle = float(dPhi*(cos(theta0) - cos(theta1)));
+                const float sinTheta = float(sin(thetaC));
+                const float cosTheta = float(cos(thetaC));
+
+                for (uint32_t xx = 0; xx < width; ++xx)
+                {
+                    const float* sinCosPhi = &args->m_sinCosPhi[xx*2];
+                    float* vec = &rowVectors[xx*4];
+                    vec[0] =  sinTheta*sinCosPhi[1];
+                    vec[1] =  cosTheta;
+                    vec[2] = -sinTheta*sinCosPhi[0];
+                    vec[3] =  solidAngle;
+                }
+
+                const float* srcPtr = args->m_data + yy*pitch;
+
+                uint32_t xx = 0;
+#if CMFT_RADIANCE_SIMD
+                xx = shAccumulateRowSimd<Order, NumChannels>(sum, srcPtr, rowVectors, width);
+#endif // CMFT_RADIANCE_SIMD
+
+                // Remaining texels.
+                for (; xx < width; ++xx)
+                {
+                    shAccumulateTexel<Order>(sum, &srcPtr[xx*NumChannels], &rowVectors[xx*4]);
+                }
+            }
+        }
+
+        free(rowVectors);
+    }
+
+    template <uint8_t Order>
+    static void latLongShCoeffs(double _shCoeffs[][3], const void* _data, uint32_t _width, uint32_t _height, uint8_t _numChannels)
+    {
+        // Directions follow vecFromLatLong(), evaluated at texel centers.
+        float* sinCosPhi = (float*)malloc(_width*2*sizeof(float));
+        MALLOC_CHECK(sinCosPhi);
+        for (uint32_t xx = 0; xx < _width; ++xx)
+        {
+            const double phi = 2.0*PI*(double(xx)+0.5)/double(_width);
+            sinCosPhi[xx*2+0] = float(sin(phi));
+            sinCosPhi[xx*2+1] = float(cos(phi));
+        }
+
+        const uint32_t numChunks = (_height + CMFT_SH_ROWS_PER_CHUNK-1)/CMFT_SH_ROWS_PER_CHUNK;
+
+        ShPartialSum<Order>* partials = (ShPartialSum<Order>*)malloc(numChunks*sizeof(ShPartialSum<Order>));
+        MALLOC_CHECK(partials);
+
+        ShLatLongArgs<Order> args;
+        args.m_partials = partials;
+        args.m_data = (const float*)_data;
+        args.m_sinCosPhi = sinCosPhi;
+        args.m_width = _width;
+        args.m_height = _height;
+        parallelFor(3 == _numChannels ? shCoeffsLatLongChunks<Order, 3> : shCoeffsLatLongChunks<Order, 4>, (void*)&args, numChunks);
+
+        // Merge in chunk order.
+        double weightAccum = 0.0;
+        for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            for (uint16_t ii = 0; ii < Order*Order; ++ii)
+            {
+                _shCoeffs[ii][0] += partials[chunk].m_coeffs[ii][0];
+                _shCoeffs[ii][1] += partials[chunk].m_coeffs[ii][1];
+                _shCoeffs[ii][2] += partials[chunk].m_coeffs[ii][2];
+            }
+            weightAccum += partials[chunk].m_weight;
+        }
+
+        free(partials);
+        free(sinCosPhi);
+
+        // Normalization.
+        const double norm = PI4 / weightAccum;
+        for (uint16_t ii = 0; ii < Order*Order; ++ii)
+        {
+            _shCoeffs[ii][0] *= norm;
+            _shCoeffs[ii][1] *= norm;
+            _shCoeffs[ii][2] *= norm;
+        }
+    }
+
+    bool imageShCoeffsFromLatLong(double _shCoeffs[SH_COEFF_NUM][3], const Image& _image, uint8_t _shOrder)
+    {
+        // Input image must be a latlong image.
+        if (!imageIsLatLong(_image))
+        {
+            return false;
+        }
+
+        if (!shOrderIsValid(_shOrder))
+        {
+            WARN("Spherical harmonics order %u is not supported. Supported orders are 2, 3 and 5.", _shOrder);
+            return false;
+        }
+
+        // Processing is done in Rgba32f or Rgb32f format.
+        Image imageF32;
+        const bool isRef = shRefOrConvert(imageF32, _image);
+        const uint8_t numChannels = shNumChannels(imageF32);
+
+        // Compute spherical harmonic coefficients from the top mip level.
+        memset(_shCoeffs, 0, SH_COEFF_NUM*3*sizeof(double));
+        switch (_shOrder)
+        {
+        case 2:  latLongShCoeffs<2>(_shCoeffs, imageF32.m_data, imageF32.m_width, imageF32.m_height, numChannels); break;
+        case 3:  latLongShCoeffs<3>(_shCoeffs, imageF32.m_data, imageF32.m_width, imageF32.m_height, numChannels); break;
+        default: latLongShCoeffs<5>(_shCoeffs, imageF32.m_data, imageF32.m_width, imageF32.m_height, numChannels); break;
+        }
+
+        // Cleanup.
+        if (!isRef)
+        {
+            imageUnload(imageF32);
+        }
+
+        return true;
+    }
+
+    // SH rotation.
+    //-----
+
+    // Gauss-Legendre nodes and weights in z, together with 10 uniform steps in phi these integrate
+    // products of two band 0..4 functions exactly.
+    static const double s_shRotationGaussZ[5] = { -0.9061798459386640, -0.5384693101056831, 0.0, 0.5384693101056831, 0.9061798459386640 };
+    static const double s_shRotationGaussW[5] = {  0.2369268850561891,  0.4786286704993665, 0.5688888888888889, 0.4786286704993665, 0.2369268850561891 };
+#define CMFT_SH_ROTATION_PHI_STEPS 10
+
+    void shRotationInit(ShRotation& _rotation, const float _mtx[9])
+    {
+        // Band matrices are projections M[m][n] = integral of Y_m(d)*Y_n(R^T*d), coefficient c_n of the source contributes
+        // M[m][n]*c_n to coefficient m of the rotated one. Same basis and signs as evalSHBasis(), whatever its convention is.
+        memset(_rotation.m_mtx, 0, sizeof(_rotation.m_mtx));
+
+        const double phiStep = 2.0*PI/double(CMFT_SH_ROTATION_PHI_STEPS);
+        for (uint8_t iz = 0; iz < 5; ++iz)
+        {
+            const double zz = s_shRotationGaussZ[iz];
+            const double rr = sqrt(1.0 - zz*zz);
+            const double weight = s_shRotationGaussW[iz]*phiStep;
+
+            for (uint8_t iphi = 0; iphi < CMFT_SH_ROTATION_PHI_STEPS; ++iphi)
+            {
+                const double phi = (double(iphi)+0.5)*phiStep;
+                const float dir[3] = { float(rr*cos(phi)), float(rr*sin(phi)), float(zz) };
+
+                // Transposed rotation, source direction that ends up in dir.
+                const float srcDir[3] =
+                {
+                    _mtx[0]*dir[0] + _mtx[3]*dir[1] + _mtx[6]*dir[2],
+                    _mtx[1]*dir[0] + _mtx[4]*dir[1] + _mtx[7]*dir[2],
+                    _mtx[2]*dir[0] + _mtx[5]*dir[1] + _mtx[8]*dir[2],
+                };
+
+                double basis[SH_COEFF_NUM];
+                double srcBasis[SH_COEFF_NUM];
+                evalSHBasis<5>(basis, dir);
+                evalSHBasis<5>(srcBasis, srcDir);
+
+                double* mtx = _rotation.m_mtx;
+                for (uint8_t band = 0; band < 5; ++band)
+                {
+                    const uint8_t first = band*band;
+                    const uint8_t size = 2*band+1;
+                    for (uint8_t mm = 0; mm < size; ++mm)
+                    {
+                        const double wm = weight*basis[first+mm];
+                        for (uint8_t nn = 0; nn < size; ++nn)
+                        {
+                            mtx[mm*size+nn] += wm*srcBasis[first+nn];
+                        }
+                    }
+                    mtx += size*size;
+                }
+            }
+        }
+    }
+
+    void shRotationInit(ShRotation& _rotation, float _x, float _y, float _z)
+    {
+        const float sx = sinf(_x), cx = cosf(_x);
+        const float sy = sinf(_y), cy = cosf(_y);
+        const float sz = sinf(_z), cz = cosf(_z);
+
+        // Rz*Ry*Rx, row major.
+        const float mtx[9] =
+        {
+            cz*cy, cz*sy*sx - sz*cx, cz*sy*cx + sz*sx,
+            sz*cy, sz*sy*sx + cz*cx, sz*sy*cx - cz*sx,
+              -sy,            cy*sx,            cy*cx,
+        };
+
+        shRotationInit(_rotation, mtx);
+    }
+
+    void shRotate(double _dst[SH_COEFF_NUM][3], const double _src[SH_COEFF_NUM][3], const ShRotation& _rotation, uint8_t _shOrder)
+    {
+        const uint8_t numBands = min(_shOrder, uint8_t(5));
+
+        // _dst may be _src.
+        double result[SH_COEFF_NUM][3];
+        memset(result, 0, sizeof(result));
+
+        const double* mtx = _rotation.m_mtx;
+        for (uint8_t band = 0; band < numBands; ++band)
+        {
+            const uint8_t first = band*band;
+            const uint8_t size = 2*band+1;
+            for (uint8_t mm = 0; mm < size; ++mm)
+            {
+                for (uint8_t nn = 0; nn < size; ++nn)
+                {
+                    const double mmn = mtx[mm*size+nn];
+                    result[first+mm][0] += mmn*_src[first+nn][0];
+                    result[first+mm][1] += mmn*_src[first+nn][1];
+                    result[first+mm][2] += mmn*_src[first+nn][2];
+                }
+            }
+            mtx += size*size;
+        }
+
+        memcpy(_dst, result, sizeof(result));
+    }
+
+    void shRotate(double _dst[SH_COEFF_NUM][3], const double _src[SH_COEFF_NUM][3], const float _mtx[9], uint8_t _shOrder)
+    {
+        ShRotation rotation;
+        shRotationInit(rotation, _mtx);
+        shRotate(_dst, _src, rotation, _shOrder);
+    }
+
+    // Irradiance is the cosine lobe convolution, applied per band as: 1, 2/3, 1/4, 0, -1/24.
+    static const float s_shIrradianceBandFactor[5] = { 1.0f, 2.0f/3.0f, 1.0f/4.0f, 0.0f, -1.0f/24.0f };
+
+    struct IrradianceShEvalArgs
+    {
+        const double (*m_shRgb)[3];
+        float* m_dst;
+        const float* m_cubemapVectors;
+    };
+
+    // Texels of all faces are evaluated as one range, destination and cubemap vectors share the same layout.
+    template <uint8_t Order>
+    static void irradianceShEvalRange(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const IrradianceShEvalArgs* args = (const IrradianceShEvalArgs*)_userData;
+        const double (*shRgb)[3] = args->m_shRgb;
+
+        float* dstPtr = args->m_dst + size_t(_begin)*4;
+        const float* vecPtr = args->m_cubemapVectors + size_t(_begin)*4;
+        for (uint32_t texel = _begin; texel < _end; ++texel, dstPtr+=4, vecPtr+=4)
+        {
+            double shBasis[Order*Order];
+            evalSHBasis<Order>(shBasis, vecPtr);
+
+            double rgb[3] = { 0.0, 0.0, 0.0 };
+
+            for (uint8_t band = 0, ii = 0; band < Order; ++band)
+            {
+                const uint8_t end = (band+1)*(band+1);
+
+                // Band 3 has factor 0.
+                const float factor = s_shIrradianceBandFactor[band];
+                if (0.0f == factor)
+                {
+                    ii = end;
+                    continue;
+                }
+
+                for (; ii < end; ++ii)
+                {
+                    rgb[0] += shRgb[ii][0] * shBasis[ii] * factor;
+                    rgb[1] += shRgb[ii][1] * shBasis[ii] * factor;
+                    rgb[2] += shRgb[ii][2] * shBasis[ii] * factor;
+                }
+            }
+
+            dstPtr[0] = float(rgb[0]);
+            dstPtr[1] = float(rgb[1]);
+            dstPtr[2] = float(rgb[2]);
+            dstPtr[3] = 1.0f;
+        }
+    }
+
+    /// Largest buffer the device of _clContext can allocate.
+    static uint64_t clMaxAllocSize(const ClContext* _clContext)
+    {
+        cl_ulong maxAllocSize = 0;
+        clGetDeviceInfo(_clContext->m_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAllocSize), &maxAllocSize, NULL);
+        return uint64_t(maxAllocSize);
+    }
+
+    /// Evaluates irradiance from SH coefficients with OpenCL. Returns false if device is not available.
+    /// All faces are evaluated by a single dispatch when their results fit into one buffer.
+    static bool irradianceShEvalGpu(float* _dst, const double _shRgb[SH_COEFF_NUM][3], uint8_t _shOrder, uint32_t _dstFaceSize, const ClContext* _clContext, FilterStats* _stats)
+    {
+        if (NULL == _clContext || NULL == _clContext->m_context)
+        {
+            return false;
+        }
+
+        cl_program program = _clContext->getProgram(s_irradianceShProgramSource);
+        if (NULL == program)
+        {
+            return false;
+        }
+
+        cl_int err;
+        cl_kernel kernel = clCreateKernel(program, "irradianceSh", &err);
+        if (CL_SUCCESS != err)
+        {
+            WARN("Could not create OpenCL kernel irradianceSh.");
+            clReleaseProgram(program);
+            return false;
+        }
+
+        // Coefficients are premultiplied by band factors. Kernel always evaluates 5 bands, higher orders are zero.
+        float shRgb[SH_COEFF_NUM][4];
+        memset(shRgb, 0, sizeof(shRgb));
+        for (uint8_t band = 0, ii = 0; band < _shOrder; ++band)
+        {
+            for (uint8_t end = (band+1)*(band+1); ii < end; ++ii)
+            {
+                shRgb[ii][0] = float(_shRgb[ii][0]*s_shIrradianceBandFactor[band]);
+                shRgb[ii][1] = float(_shRgb[ii][1]*s_shIrradianceBandFactor[band]);
+                shRgb[ii][2] = float(_shRgb[ii][2]*s_shIrradianceBandFactor[band]);
+            }
+        }
+
+        cl_mem memShRgb = CL_CHECK_ERR(clCreateBuffer(_clContext->m_context
+                                     , CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR
+                                     , sizeof(shRgb)
+                                     , (void*)shRgb
+                                     , &err
+                                     ));
+
+        // Third dimension of the dispatch goes over faces, destination faces are consecutive.
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint64_t dstFaceDataSize = uint64_t(_dstFaceSize)*_dstFaceSize*bytesPerPixel;
+        const uint8_t facesPerDispatch = (6*dstFaceDataSize <= clMaxAllocSize(_clContext)) ? 6 : 1;
+        cl_mem memOut = CL_CHECK_ERR(clCreateBuffer(_clContext->m_context
+                                   , CL_MEM_WRITE_ONLY
+                                   , size_t(dstFaceDataSize*facesPerDispatch)
+                                   , NULL
+                                   , &err
+                                   ));
+
+        const int32_t faceSize = int32_t(_dstFaceSize);
+        CL_CHECK(clSetKernelArg(kernel, 0, sizeof(cl_mem),  (const void*)&memOut));
+        CL_CHECK(clSetKernelArg(kernel, 1, sizeof(cl_mem),  (const void*)&memShRgb));
+        CL_CHECK(clSetKernelArg(kernel, 2, sizeof(int32_t), (const void*)&faceSize));
+
+        const size_t workSize[3] = { _dstFaceSize, _dstFaceSize, facesPerDispatch };
+        for (uint8_t face = 0; face < 6; face += facesPerDispatch)
+        {
+            const int8_t faceId = int8_t(face);
+            CL_CHECK(clSetKernelArg(kernel, 3, sizeof(int8_t), (const void*)&faceId));
+            CL_CHECK(clEnqueueNDRangeKernel(_clContext->m_commandQueue, kernel, 3, NULL, workSize, NULL, 0, NULL, NULL));
+            CL_CHECK(clEnqueueReadBuffer(_clContext->m_commandQueue
+                                       , memOut
+                                       , CL_TRUE
+                                       , 0
+                                       , size_t(dstFaceDataSize*facesPerDispatch)
+                                       , (void*)(_dst + size_t(face)*_dstFaceSize*_dstFaceSize*4)
+                                       , 0
+                                       , NULL
+                                       , NULL
+                                       ));
+        }
+
+        if (NULL != _stats)
+        {
+            _stats->m_bytesToDevice += sizeof(shRgb);
+            _stats->m_bytesFromDevice += 6*uint64_t(_dstFaceSize)*_dstFaceSize*bytesPerPixel;
+        }
+
+        clReleaseMemObject(memOut);
+        clReleaseMemObject(memShRgb);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+
+        return true;
+    }
+
+    /// Evaluates irradiance of SH coefficients into RGBA32F cubemap _dst of _dstFaceSize, on OpenCL device if valid context is provided.
+    static void irradianceShEval(Image& _dst, const double _shRgb[SH_COEFF_NUM][3], uint8_t _shOrder, uint32_t _dstFaceSize, const ClContext* _clContext, FilterStats& _stats)
+    {
+        const uint8_t dstBytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstPitch = _dstFaceSize*dstBytesPerPixel;
+        const uint64_t dstFaceDataSize = uint64_t(dstPitch) * _dstFaceSize;
+        const uint64_t dstDataSize = dstFaceDataSize * 6 /*numFaces*/;
+        void* dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+        MALLOC_CHECK(dstData);
+
+        const uint64_t dstNumTexels = uint64_t(_dstFaceSize)*_dstFaceSize*CUBE_FACE_NUM;
+        if (irradianceShEvalGpu((float*)dstData, _shRgb, _shOrder, _dstFaceSize, _clContext, &_stats))
+        {
+            _stats.m_tasksGpu[0] = CUBE_FACE_NUM;
+            _stats.m_texelsGpu[0] = dstNumTexels;
+        }
+        else
+        {
+            _stats.m_tasksCpu = CUBE_FACE_NUM;
+            _stats.m_texelsCpu = dstNumTexels;
+
+            // Build cubemap texel vectors.
+            const float* cubemapVectors = acquireCubemapNormalSolidAngle(_dstFaceSize);
+            ScopeReleaseNormalSolidAngle cleanup(cubemapVectors);
+
+            IrradianceShEvalArgs args;
+            args.m_shRgb = _shRgb;
+            args.m_dst = (float*)dstData;
+            args.m_cubemapVectors = cubemapVectors;
+            ParallelForFn evalFn = irradianceShEvalRange<5>;
+            switch (_shOrder)
+            {
+            case 2: evalFn = irradianceShEvalRange<2>; break;
+            case 3: evalFn = irradianceShEvalRange<3>; break;
+            default: break;
+            }
+            parallelFor(evalFn, (void*)&args, _dstFaceSize*_dstFaceSize*CUBE_FACE_NUM, 4096);
+        }
+
+        // Fill structure.
+        imageUnload(_dst);
+        _dst.m_width = _dstFaceSize;
+        _dst.m_height = _dstFaceSize;
+        _dst.m_dataSize = dstDataSize;
+        _dst.m_format = TextureFormat::RGBA32F;
+        _dst.m_numMips = 1;
+        _dst.m_numFaces = 6;
+        _dst.m_data = dstData;
+    }
+
+    bool imageIrradianceFilterSh(Image& _dst, uint32_t _dstFaceSize, const Image& _src, uint8_t _shOrder, const ClContext* _clContext, FilterStats* _stats, const FilterSettings* _settings)
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        FilterStats stats;
+
+        if (!shOrderIsValid(_shOrder))
+        {
+            WARN("Spherical harmonics order %u is not supported. Supported orders are 2, 3 and 5.", _shOrder);
+            return false;
+        }
+
+        // Coefficients are integrated in Rgba32f or Rgb32f format, cube cross and hstrip sources are read in place.
+        ImageView view;
+        Image imageF32;
+        if (!shViewOrConvert(view, imageF32, _src))
+        {
+            return false;
+        }
+        const uint32_t srcFaceSize = view.m_faceSize;
+        float* reducedVectors = shReduceView(view, imageF32, _shOrder, settings);
+
+        // Compute spherical harmonic coefficients. Reduced sources are projected on the CPU, with their own texel vectors.
+        double shRgb[SH_COEFF_NUM][3];
+        if (NULL != reducedVectors
+        ||  !viewShCoeffsGpu(shRgb, view, _shOrder, _clContext, settings.m_deterministic, &stats))
+        {
+            viewShCoeffs(shRgb, view, _shOrder, true, reducedVectors);
+        }
+        free(reducedVectors);
+
+        // Source is not needed anymore.
+        imageUnload(imageF32);
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? srcFaceSize : _dstFaceSize;
+
+        // Output info.
+        INFO("Running irradiance filter for:\n"
+             "\t[srcFaceSize=%u]\n"
+             "\t[shOrder=%u]\n"
+             "\t[dstFaceSize=%u]"
+             , srcFaceSize
+             , _shOrder
+             , dstFaceSize
+             );
+
+        uint64_t totalTime = bx::getHPCounter();
+
+        // Compute irradiance using SH data.
+        Image result;
+        irradianceShEval(result, shRgb, _shOrder, dstFaceSize, _clContext, stats);
+
+        // Output progress info.
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+        totalTime = bx::getHPCounter() - totalTime;
+        INFO("Irradiance -> Done! Total time: %.3f seconds.", double(totalTime)*toSec);
+        const uint64_t finishStartTime = bx::getHPCounter();
+
+        // Convert back to source format.
+        if (TextureFormat::RGBA32F == _src.m_format)
+        {
+            imageMove(_dst, result);
+        }
+        else
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+            imageMove(_dst, result);
+        }
+
+        if (NULL != _stats)
+        {
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_filterTime = double(totalTime)*toSec;
+            stats.m_finishTime = double(endTime - finishStartTime)*toSec;
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            *_stats = stats;
+        }
+
+        return true;
+    }
+
+    void imageIrradianceFilterSh(Image& _image, uint32_t _faceSize, uint8_t _shOrder, const ClContext* _clContext, FilterStats* _stats, const FilterSettings* _settings)
+    {
+        Image tmp;
+        if (imageIrradianceFilterSh(tmp, _faceSize, _image, _shOrder, _clContext, _stats, _settings))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    bool imageIrradianceFilterShOctahedral(Image& _dst, uint32_t _dstSize, const Image& _src, uint8_t _shOrder, const ClContext* _clContext, FilterStats* _stats, const FilterSettings* _settings)
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        FilterStats stats;
+
+        if (!shOrderIsValid(_shOrder))
+        {
+            WARN("Spherical harmonics order %u is not supported. Supported orders are 2, 3 and 5.", _shOrder);
+            return false;
+        }
+
+        ImageView view;
+        Image imageF32;
+        if (!shViewOrConvert(view, imageF32, _src))
+        {
+            return false;
+        }
+        const uint32_t srcFaceSize = view.m_faceSize;
+        float* reducedVectors = shReduceView(view, imageF32, _shOrder, settings);
+
+        double shRgb[SH_COEFF_NUM][3];
+        if (NULL != reducedVectors
+        ||  !viewShCoeffsGpu(shRgb, view, _shOrder, _clContext, settings.m_deterministic, &stats))
+        {
+            viewShCoeffs(shRgb, view, _shOrder, true, reducedVectors);
+        }
+        free(reducedVectors);
+
+        imageUnload(imageF32);
+
+        // Octahedral map of twice the face size has 4/6 texels of the cubemap with the same texel density at face centers.
+        const uint32_t dstSize = (0 == _dstSize) ? srcFaceSize*2 : _dstSize;
+        const uint64_t dstNumTexels = uint64_t(dstSize)*dstSize;
+        const uint64_t dstDataSize = dstNumTexels * 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        void* dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+        MALLOC_CHECK(dstData);
+
+        uint64_t totalTime = bx::getHPCounter();
+
+        INFO("Running irradiance filter for:\n"
+             "\t[srcFaceSize=%u]\n"
+             "\t[shOrder=%u]\n"
+             "\t[dstSize=%u, octahedral]"
+             , srcFaceSize
+             , _shOrder
+             , dstSize
+             );
+
+        // Texel directions, in the layout of cubemap vectors.
+        float* vectors = (float*)malloc(size_t(dstNumTexels)*4*sizeof(float));
+        MALLOC_CHECK(vectors);
+        const float invDstSize = 1.0f/float(int32_t(dstSize));
+        for (uint32_t yy = 0; yy < dstSize; ++yy)
+        {
+            float* vecPtr = vectors + size_t(yy)*dstSize*4;
+            for (uint32_t xx = 0; xx < dstSize; ++xx, vecPtr+=4)
+            {
+                vecFromOctahedral(vecPtr, (float(int32_t(xx))+0.5f)*invDstSize, (float(int32_t(yy))+0.5f)*invDstSize);
+                vecPtr[3] = 0.0f;
+            }
+        }
+
+        stats.m_tasksCpu = 1;
+        stats.m_texelsCpu = dstNumTexels;
+
+        IrradianceShEvalArgs args;
+        args.m_shRgb = shRgb;
+        args.m_dst = (float*)dstData;
+        args.m_cubemapVectors = vectors;
+        ParallelForFn evalFn = irradianceShEvalRange<5>;
+        switch (_shOrder)
+        {
+        case 2: evalFn = irradianceShEvalRange<2>; break;
+        case 3: evalFn = irradianceShEvalRange<3>; break;
+        default: break;
+        }
+        parallelFor(evalFn, (void*)&args, uint32_t(dstNumTexels), 4096);
+
+        free(vectors);
+
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+        totalTime = bx::getHPCounter() - totalTime;
+        INFO("Irradiance -> Done! Total time: %.3f seconds.", double(totalTime)*toSec);
+        const uint64_t finishStartTime = bx::getHPCounter();
+
+        Image result;
+        result.m_width = dstSize;
+        result.m_height = dstSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = 1;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
+
+        if (TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+        }
+        imageMove(_dst, result);
+
+        if (NULL != _stats)
+        {
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_filterTime = double(totalTime)*toSec;
+            stats.m_finishTime = double(endTime - finishStartTime)*toSec;
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            *_stats = stats;
+        }
+
+        return true;
+    }
+
+    void imageIrradianceFilterShOctahedral(Image& _image, uint32_t _dstSize, uint8_t _shOrder, const ClContext* _clContext, FilterStats* _stats, const FilterSettings* _settings)
+    {
+        Image tmp;
+        if (imageIrradianceFilterShOctahedral(tmp, _dstSize, _image, _shOrder, _clContext, _stats, _settings))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    // Radiance.
+    //-----
+
+    struct Aabb
+    {
+        Aabb()
+        {
+            m_min[0] = FLT_MAX;
+            m_min[1] = FLT_MAX;
+            m_max[0] = -FLT_MAX;
+            m_max[1] = -FLT_MAX;
+        }
+
+        void add(float _x, float _y)
+        {
+            m_min[0] = min(m_min[0], _x);
+            m_min[1] = min(m_min[1], _y);
+            m_max[0] = max(m_max[0], _x);
+            m_max[1] = max(m_max[1], _y);
+        }
+
+        inline void clampMin(float _x, float _y)
+        {
+            m_min[0] = max(m_min[0], _x);
+            m_min[1] = max(m_min[1], _y);
+        }
+
+        inline void clampMax(float _x, float _y)
+        {
+            m_max[0] = min(m_max[0], _x);
+            m_max[1] = min(m_max[1], _y);
+        }
+
+        void clamp(float _minX, float _minY, float _maxX, float _maxY)
+        {
+            clampMin(_minX, _minY);
+            clampMax(_maxX, _maxY);
+        }
+
+        void clamp(float _min, float _max)
+        {
+            clampMin(_min, _min);
+            clampMax(_max, _max);
+        }
+
+        bool isEmpty()
+        {
+            // Has to have at least two points added so that no value is equal to initial state.
+            return ((m_min[0] ==  FLT_MAX)
+                  ||(m_min[1] ==  FLT_MAX)
+                  ||(m_max[0] == -FLT_MAX)
+                  ||(m_max[1] == -FLT_MAX)
+                   );
+        }
 
         float m_min[2];
         float m_max[2];
     };
 
-    /// Computes filter area for each of the cubemap faces for given tap vector and filter size.
-    void determineFilterArea(Aabb _filterArea[6], const float* _tapVec, float _filterSize)
+    /// Filter area of the tap vector on its hit face. Returns false if the area bleeds over an edge of the face,
+    /// which is when determineFilterArea() also adds area on neighbour faces. Otherwise _area and _face are all of it.
+    static inline bool determineHitFaceFilterArea(Aabb& _area, uint8_t& _face, const float* _tapVec, float _filterSize)
+    {
+        float uu, vv;
+        vecToTexelCoord(uu, vv, _face, _tapVec);
+
+        // Same conditions as the bleed amounts in determineFilterArea().
+        if (_filterSize - uu > 0.0f
+        ||  uu + _filterSize - 1.0f > 0.0f
+        ||  _filterSize - vv > 0.0f
+        ||  vv + _filterSize - 1.0f > 0.0f)
+        {
+            return false;
+        }
+
+        _area.add(uu-_filterSize, vv-_filterSize);
+        _area.add(uu+_filterSize, vv+_filterSize);
+        _area.clamp(0.0f, 1.0f);
+
+        return true;
+    }
+
+    /// Conservative test whether filter areas of all destination texels in [_xBegin, _xEnd) x [_yBegin, _yEnd) stay on their face.
+    /// Leaves a destination texel of slack for the edge fixup and the round trip through the tap vector.
+    static inline bool filterAreaOnFace(uint32_t _xBegin, uint32_t _xEnd, uint32_t _yBegin, uint32_t _yEnd, uint32_t _faceSize, float _filterSize)
+    {
+        const float invFaceSize = 1.0f/float(int32_t(_faceSize));
+        const float margin = _filterSize + invFaceSize;
+
+        return float(int32_t(_xBegin))*invFaceSize >= margin
+            && float(int32_t(_xEnd))  *invFaceSize <= 1.0f - margin
+            && float(int32_t(_yBegin))*invFaceSize >= margin
+            && float(int32_t(_yEnd))  *invFaceSize <= 1.0f - margin
+            ;
+    }
+
+    /// Computes filter area for each of the cubemap faces for given tap vector and filter size.
+    void determineFilterArea(Aabb _filterArea[6], const float* _tapVec, float _filterSize)
+    {
+        ///   ______
+        ///  |      |
+        ///  |      |
+        ///  |    x |
+        ///  |______|
+        ///
+        // Get face and hit coordinates.
+        float uu, vv;
+        uint8_t hitFaceIdx;
+        vecToTexelCoord(uu, vv, hitFaceIdx, _tapVec);
+
+        ///  ........
+        ///  .      .
+        ///  .   ___.
+        ///  .  | x |
+        ///  ...|___|
+        ///
+        // Calculate hit face filter bounds.
+        Aabb hitFaceFilterBounds;
+        hitFaceFilterBounds.add(uu-_filterSize, vv-_filterSize);
+        hitFaceFilterBounds.add(uu+_filterSize, vv+_filterSize);
+        hitFaceFilterBounds.clamp(0.0f, 1.0f);
+
+        // Output result for hit face.
+        DEBUG_CHECK(6 > hitFaceIdx, "Face idx should be in range 0-5");
+        memcpy(&_filterArea[hitFaceIdx], &hitFaceFilterBounds, sizeof(Aabb));
+
+        /// Filter area might extend on neighbour faces.
+        /// Case when extending over the right edge:
+        ///
+        ///  --> U
+        /// |        ......
+        /// v       .      .
+        /// V       .      .
+        ///         .      .
+        ///  ....... ...... .......
+        ///  .      .      .      .
+        ///  .      .  .....__min .
+        ///  .      .  .   .  |  -> amount
+        ///  ....... .....x.__|....
+        ///         .  .   .  max
+        ///         .  ........
+        ///         .      .
+        ///          ......
+        ///         .      .
+        ///         .      .
+        ///         .      .
+        ///          ......
+        ///
+
+        enum NeighbourSides
+        {
+            Left,
+            Right,
+            Top,
+            Bottom,
+
+            Count,
+        };
+
+        struct NeighourFaceBleed
+        {
+            float m_amount;
+            float m_bbMin;
+            float m_bbMax;
+        } bleed[NeighbourSides::Count] =
+        {
+            { // Left
+                _filterSize - uu,
+                hitFaceFilterBounds.m_min[1],
+                hitFaceFilterBounds.m_max[1],
+            },
+            { // Right
+                uu + _filterSize - 1.0f,
+                hitFaceFilterBounds.m_min[1],
+                hitFaceFilterBounds.m_max[1],
+            },
+            { // Top
+                _filterSize - vv,
+                hitFaceFilterBounds.m_min[0],
+                hitFaceFilterBounds.m_max[0],
+            },
+            { // Bottom
+                vv + _filterSize - 1.0f,
+                hitFaceFilterBounds.m_min[0],
+                hitFaceFilterBounds.m_max[0],
+            },
+        };
+
+        // Determine bleeding for each side.
+        for (uint8_t side = 0; side < 4; ++side)
+        {
+            uint8_t currentFaceIdx = hitFaceIdx;
+
+            for (float bleedAmount = bleed[side].m_amount; bleedAmount > 0.0f; bleedAmount -= 1.0f)
+            {
+                uint8_t neighbourFaceIdx  = s_cubeFaceNeighbours[currentFaceIdx][side].m_faceIdx;
+                uint8_t neighbourFaceEdge = s_cubeFaceNeighbours[currentFaceIdx][side].m_faceEdge;
+                currentFaceIdx = neighbourFaceIdx;
+
+                ///
+                /// https://code.google.com/p/cubemapgen/source/browse/trunk/CCubeMapProcessor.cpp#773
+                ///
+                /// Handle situations when bbMin and bbMax should be flipped.
+                ///
+                ///    L - Left           ....................T-T
+                ///    R - Right          v                     .
+                ///    T - Top        __________                .
+                ///    B - Bottom    .          |               .
+                ///                  .          |               .
+                ///                  .          |<...R-T        .
+                ///                  .          |    v          v
+                ///        .......... ..........|__________ __________
+                ///       .          .          .          .          .
+                ///       .          .          .          .          .
+                ///       .          .          .          .          .
+                ///       .          .          .          .          .
+                ///        __________ .......... .......... __________
+                ///            ^     |          .               ^
+                ///            .     |          .               .
+                ///            B-L..>|          .               .
+                ///                  |          .               .
+                ///                  |__________.               .
+                ///                       ^                     .
+                ///                       ....................B-B
+                ///
+                /// Those are:
+                ///     B-L, B-B
+                ///     T-R, T-T
+                ///     (and in reverse order, R-T and L-B)
+                ///
+                /// If we add, R-R and L-L (which never occur), we get:
+                ///     B-L, B-B
+                ///     T-R, T-T
+                ///     R-T, R-R
+                ///     L-B, L-L
+                ///
+                /// And if L = 0, R = 1, T = 2, B = 3 as in NeighbourSides enumeration,
+                /// a general rule can be derived for when to flip bbMin and bbMax:
+                ///     if ((a+b) == 3 || (a == b))
+                ///     {
+                ///        ..flip bbMin and bbMax
+                ///     }
+                ///
+                float bbMin = bleed[side].m_bbMin;
+                float bbMax = bleed[side].m_bbMax;
+                if ((side == neighbourFaceEdge)
+                || (3 == (side + neighbourFaceEdge)))
+                {
+                    // Flip.
+                    bbMin = 1.0f - bbMin;
+                    bbMax = 1.0f - bbMax;
+                }
+
+                switch (neighbourFaceEdge)
+                {
+                case CMFT_EDGE_LEFT:
+                    {
+                        ///  --> U
+                        /// |  .............
+                        /// v  .           .
+                        /// V  x___        .
+                        ///    |   |       .
+                        ///    |   |       .
+                        ///    |___x       .
+                        ///    .           .
+                        ///    .............
+                        ///
+                        _filterArea[neighbourFaceIdx].add(0.0f, bbMin);
+                        _filterArea[neighbourFaceIdx].add(bleedAmount, bbMax);
+                    }
+                break;
+
+                case CMFT_EDGE_RIGHT:
+                    {
+                        ///  --> U
+                        /// |  .............
+                        /// v  .           .
+                        /// V  .       x___.
+                        ///    .       |   |
+                        ///    .       |   |
+                        ///    .       |___x
+                        ///    .           .
+                        ///    .............
+                        ///
+                        _filterArea[neighbourFaceIdx].add(1.0f - bleedAmount, bbMin);
+                        _filterArea[neighbourFaceIdx].add(1.0f, bbMax);
+                    }
+                break;
+
+                case CMFT_EDGE_TOP:
+                    {
+                        ///  --> U
+                        /// |  ...x____ ...
+                        /// v  .  |    |  .
+                        /// V  .  |____x  .
+                        ///    .          .
+                        ///    .          .
+                        ///    .          .
+                        ///    ............
+                        ///
+                        _filterArea[neighbourFaceIdx].add(bbMin, 0.0f);
+                        _filterArea[neighbourFaceIdx].add(bbMax, bleedAmount);
+                    }
+                break;
+
+                case CMFT_EDGE_BOTTOM:
+                    {
+                        ///  --> U
+                        /// |  ............
+                        /// v  .          .
+                        /// V  .          .
+                        ///    .          .
+                        ///    .  x____   .
+                        ///    .  |    |  .
+                        ///    ...|____x...
+                        ///
+                        _filterArea[neighbourFaceIdx].add(bbMin, 1.0f - bleedAmount);
+                        _filterArea[neighbourFaceIdx].add(bbMax, 1.0f);
+                    }
+                break;
+                }
+
+                // Clamp bounding box to face size.
+                _filterArea[neighbourFaceIdx].clamp(0.0f, 1.0f);
+            }
+        }
+    }
+
+    /// Lobe weights pow(dot, specularPower) of a single mip, tabulated at CMFT_RADIANCE_LOBE_TABLE+1 points over [specularAngle, 1].
+    /// Lookups expect dot within the specular angle. The last entry is repeated, so interpolation at dot = 1 stays in bounds.
+    struct RadianceLobeTable
+    {
+        enum
+        {
+            Size = CMFT_RADIANCE_LOBE_TABLE,
+        };
+
+        void init(float _specularPower, float _specularAngle)
+        {
+            const double range = 1.0 - double(_specularAngle);
+            m_angle = _specularAngle;
+            m_scale = (0.0 < range) ? float(double(Size)/range) : 0.0f;
+
+            for (uint32_t ii = 0; ii <= Size; ++ii)
+            {
+                const double dot = min(1.0, double(_specularAngle) + range*double(ii)/double(Size));
+                m_weights[ii] = float(pow(dot, double(_specularPower)));
+            }
+            m_weights[Size+1] = m_weights[Size];
+        }
+
+        inline float weight(float _dot) const
+        {
+            const float tt = min((_dot - m_angle)*m_scale, float(Size));
+#if CMFT_RADIANCE_LOBE_TABLE_LERP
+            const int32_t idx = int32_t(tt);
+            return m_weights[idx] + (m_weights[idx+1] - m_weights[idx])*(tt - float(idx));
+#else
+            return m_weights[int32_t(tt + 0.5f)];
+#endif // CMFT_RADIANCE_LOBE_TABLE_LERP
+        }
+
+#if CMFT_RADIANCE_SIMD
+        /// Lanes outside of the specular angle get the weight of the angle itself and have to be masked out by the caller.
+        inline bx::float4_t weight4(bx::float4_t _dot) const
+        {
+            using namespace bx;
+
+            const float4_t offset = float4_sub(_dot, float4_splat(m_angle));
+            const float4_t tt = float4_min(float4_max(float4_mul(offset, float4_splat(m_scale)), float4_zero()), float4_splat(float(Size)));
+#if CMFT_RADIANCE_LOBE_TABLE_LERP
+            const int32_t i0 = int32_t(float4_x(tt));
+            const int32_t i1 = int32_t(float4_y(tt));
+            const int32_t i2 = int32_t(float4_z(tt));
+            const int32_t i3 = int32_t(float4_w(tt));
+            const float4_t w0 = float4_ld(m_weights[i0],   m_weights[i1],   m_weights[i2],   m_weights[i3]);
+            const float4_t w1 = float4_ld(m_weights[i0+1], m_weights[i1+1], m_weights[i2+1], m_weights[i3+1]);
+            const float4_t frac = float4_sub(tt, float4_ld(float(i0), float(i1), float(i2), float(i3)));
+            return float4_madd(float4_sub(w1, w0), frac, w0);
+#else
+            const float4_t rr = float4_add(tt, float4_splat(0.5f));
+            return float4_ld(m_weights[int32_t(float4_x(rr))]
+                           , m_weights[int32_t(float4_y(rr))]
+                           , m_weights[int32_t(float4_z(rr))]
+                           , m_weights[int32_t(float4_w(rr))]
+                           );
+#endif // CMFT_RADIANCE_LOBE_TABLE_LERP
+        }
+#endif // CMFT_RADIANCE_SIMD
+
+        float m_angle;
+        float m_scale;
+        float m_weights[Size+2];
+    };
+
+    static inline float filterAreaLobeWeight(float /*_tag*/, float _dotProduct, float _specularPower, const RadianceLobeTable* _lobeTable)
+    {
+        BX_UNUSED(_specularPower, _lobeTable);
+#if CMFT_RADIANCE_LOBE_TABLE
+        return _lobeTable->weight(_dotProduct);
+#else
+        return powf(_dotProduct, _specularPower);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+    }
+
+    /// Double precision is the reference, the lobe is evaluated exactly.
+    static inline double filterAreaLobeWeight(double /*_tag*/, float _dotProduct, float _specularPower, const RadianceLobeTable* /*_lobeTable*/)
+    {
+        return pow(double(_dotProduct), double(_specularPower));
+    }
+
+    template <typename floatOrDouble>
+    void processFilterArea(floatOrDouble _res[3]
+                         , float _specularPower
+                         , float _specularAngle
+                         , const RadianceLobeTable* _lobeTable
+                         , const float* _tapVec
+                         , const float* _cubemapNormalSolidAngle
+                         , Aabb _filterArea[6]
+                         , uint32_t _srcFaceSize
+                         , const void* _srcData
+                         , const uint64_t _faceOffsets[6]
+                         )
+    {
+        floatOrDouble colorWeight[4] = { floatOrDouble(0.0), floatOrDouble(0.0), floatOrDouble(0.0), floatOrDouble(0.0) };
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t pitch = _srcFaceSize*bytesPerPixel;
+        const uint32_t normalFaceSize = pitch*_srcFaceSize;
+        const float faceSize_MinusOne = float(int32_t(_srcFaceSize-1));
+
+        const uint32_t blocksPerSide = normalConeBlocksPerSide(_srcFaceSize);
+        const float* normalCones = cubemapNormalCones(_cubemapNormalSolidAngle, _srcFaceSize);
+        const float sinAngle = sqrtf(max(0.0f, 1.0f - _specularAngle*_specularAngle));
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_filterArea[face].isEmpty())
+            {
+                continue;
+            }
+
+            const uint32_t minX = uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne);
+            const uint32_t maxX = uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne);
+            const uint32_t minY = uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne);
+            const uint32_t maxY = uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne);
+
+            const uint8_t* faceData    = (const uint8_t*)_srcData                 + _faceOffsets[face];
+            const uint8_t* faceNormals = (const uint8_t*)_cubemapNormalSolidAngle + normalFaceSize*face;
+            const float*   faceCones   = normalCones + size_t(face)*blocksPerSide*blocksPerSide*4;
+
+            for (uint32_t blockY = minY/CMFT_NORMAL_CONE_BLOCK_SIZE; blockY <= maxY/CMFT_NORMAL_CONE_BLOCK_SIZE; ++blockY)
+            {
+                const uint32_t yBegin = max(minY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                const uint32_t yEnd   = min(maxY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+
+                const float* rowCones = faceCones + blockY*blocksPerSide*4;
+                const uint32_t lastBlockX = maxX/CMFT_NORMAL_CONE_BLOCK_SIZE;
+
+                for (uint32_t blockX = minX/CMFT_NORMAL_CONE_BLOCK_SIZE; blockX <= lastBlockX; ++blockX)
+                {
+                    // Skip blocks that are entirely outside of the specular angle.
+                    if (normalConeOutside(&rowCones[blockX*4], _tapVec, _specularAngle, sinAngle))
+                    {
+                        continue;
+                    }
+
+                    // Merge following blocks that are not skipped into a single span.
+                    const uint32_t firstBlockX = blockX;
+                    while (blockX < lastBlockX
+                       && !normalConeOutside(&rowCones[(blockX+1)*4], _tapVec, _specularAngle, sinAngle))
+                    {
+                        ++blockX;
+                    }
+
+                    const uint32_t xBegin = max(minX, firstBlockX*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                    const uint32_t xEnd   = min(maxX, blockX*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+
+                    for (uint32_t yy = yBegin; yy <= yEnd; ++yy)
+                    {
+                        const uint8_t* rowData    = (const uint8_t*)faceData    + yy*pitch;
+                        const uint8_t* rowNormals = (const uint8_t*)faceNormals + yy*pitch;
+
+                        for (uint32_t xx = xBegin; xx <= xEnd; ++xx)
+                        {
+                            const float* normalPtr = (const float*)((const uint8_t*)rowNormals + xx*bytesPerPixel);
+                            const float dotProduct = vec3Dot(normalPtr, _tapVec);
+
+                            if (dotProduct >= _specularAngle)
+                            {
+                                const floatOrDouble solidAngle = floatOrDouble(normalPtr[3]);
+                                const floatOrDouble weight = solidAngle * filterAreaLobeWeight(floatOrDouble(0.0), dotProduct, _specularPower, _lobeTable);
+
+                                const float* dataPtr = (const float*)((const uint8_t*)rowData + xx*bytesPerPixel);
+                                colorWeight[0] += floatOrDouble(dataPtr[0]) * weight;
+                                colorWeight[1] += floatOrDouble(dataPtr[1]) * weight;
+                                colorWeight[2] += floatOrDouble(dataPtr[2]) * weight;
+                                colorWeight[3] += floatOrDouble(1.0)        * weight;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Divide color by colorWeight and store result.
+        if (0.0f != colorWeight[3])
+        {
+            const floatOrDouble invWeight = floatOrDouble(1.0)/colorWeight[3];
+            _res[0] = colorWeight[0] * invWeight;
+            _res[1] = colorWeight[1] * invWeight;
+            _res[2] = colorWeight[2] * invWeight;
+        }
+        // Else if colorWeight == 0 (result of convolution is zero) take a direct color sample.
+        else
+        {
+            float uu, vv;
+            uint8_t hitFaceIdx;
+            vecToTexelCoord(uu, vv, hitFaceIdx, _tapVec);
+
+            const uint32_t xx = uint32_t(uu*float(_srcFaceSize));
+            const uint32_t yy = uint32_t(vv*float(_srcFaceSize));
+
+            const float* dataPtr = (const float*)((const uint8_t*)_srcData
+                                 + _faceOffsets[hitFaceIdx]
+                                 + yy*pitch
+                                 + xx*bytesPerPixel
+                                 );
+
+            _res[0] = floatOrDouble(dataPtr[0]);
+            _res[1] = floatOrDouble(dataPtr[1]);
+            _res[2] = floatOrDouble(dataPtr[2]);
+        }
+    }
+
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+    /// Loads 4 consecutive values from a float or half SoA plane.
+    template <bool HalfColors>
+    static inline bx::float4_t soaLoad4(const void* _row, int32_t _xx)
+    {
+        if (!HalfColors)
+        {
+            return bx::float4_ld(&((const float*)_row)[_xx]);
+        }
+
+        const uint16_t* ptr = &((const uint16_t*)_row)[_xx];
+#if CMFT_F16C
+        return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)ptr));
+#elif defined(BX_FLOAT4_NEON_H_HEADER_GUARD) && defined(__aarch64__)
+        return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(ptr)));
+#else
+        using namespace bx;
+
+        // Rebias exponent and shift mantissa, then fix up Inf/NaN and denormals.
+#if defined(BX_FLOAT4_SSE_H_HEADER_GUARD)
+        const float4_t half       = _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)ptr), _mm_setzero_si128()));
+#else
+        const float4_t half       = float4_ild(ptr[0], ptr[1], ptr[2], ptr[3]);
+#endif // defined(BX_FLOAT4_SSE_H_HEADER_GUARD)
+        const float4_t shiftedExp = float4_isplat(0x7c00<<13);
+        const float4_t bits       = float4_sll(float4_and(half, float4_isplat(0x7fff)), 13);
+        const float4_t exp        = float4_and(bits, shiftedExp);
+        const float4_t normal     = float4_iadd(bits, float4_isplat((127-15)<<23));
+        const float4_t infNan     = float4_iadd(normal, float4_and(float4_icmpeq(exp, shiftedExp), float4_isplat((128-16)<<23)));
+        const float4_t denormal   = float4_sub(float4_iadd(normal, float4_isplat(1<<23)), float4_isplat(113<<23));
+        const float4_t result     = float4_selb(float4_icmpeq(exp, float4_zero()), denormal, infNan);
+        const float4_t sign       = float4_sll(float4_and(half, float4_isplat(0x8000)), 16);
+
+        return float4_or(result, sign);
+#endif // CMFT_F16C
+    }
+
+    /// Loads 4 consecutive 16-bit integers as floats, sign extended with Signed.
+    template <bool Signed>
+    static inline bx::float4_t soaLoadInt16x4(const uint16_t* _row, int32_t _xx)
+    {
+        using namespace bx;
+
+        const uint16_t* ptr = &_row[_xx];
+#if defined(BX_FLOAT4_SSE_H_HEADER_GUARD)
+        const float4_t raw = _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)ptr), _mm_setzero_si128()));
+#else
+        const float4_t raw = float4_ild(ptr[0], ptr[1], ptr[2], ptr[3]);
+#endif // defined(BX_FLOAT4_SSE_H_HEADER_GUARD)
+
+        return float4_itof(Signed ? float4_sra(float4_sll(raw, 16), 16) : raw);
+    }
+
+    /// Normal and solid angle planes of a row of SoaCubemap::initNormals(), valid in the tile of texel _xx.
+    /// With CMFT_RADIANCE_SOA_COMPACT_NORMALS, tap vector passed to dot4() has to be scaled by snormScale().
+    struct SoaNormalRow
+    {
+        SoaNormalRow(const SoaCubemap* _normals, uint8_t _face, int32_t _xx, int32_t _yy)
+        {
+#if CMFT_RADIANCE_SOA_COMPACT_NORMALS
+            m_solidAngleScale = bx::float4_splat(_normals->m_solidAngleScale);
+#endif // CMFT_RADIANCE_SOA_COMPACT_NORMALS
+            for (uint8_t plane = 0; plane < 4; ++plane)
+            {
+                m_planes[plane] = _normals->rowData(_face, plane, _xx, _yy);
+            }
+        }
+
+        /// Factor of the tap vector that dot4() takes.
+        static inline float snormScale()
+        {
+            return CMFT_RADIANCE_SOA_COMPACT_NORMALS ? 1.0f/32767.0f : 1.0f;
+        }
+
+        /// Cosines between normals of 4 texels starting at _xx and the tap vector scaled by snormScale().
+        inline bx::float4_t dot4(int32_t _xx, bx::float4_t _tapX, bx::float4_t _tapY, bx::float4_t _tapZ) const
+        {
+            using namespace bx;
+
+            return float4_madd(load4<true>(0, _xx), _tapX
+                 , float4_madd(load4<true>(1, _xx), _tapY
+                 , float4_mul (load4<true>(2, _xx), _tapZ)));
+        }
+
+        inline bx::float4_t solidAngle4(int32_t _xx) const
+        {
+#if CMFT_RADIANCE_SOA_COMPACT_NORMALS
+            return bx::float4_mul(load4<false>(3, _xx), m_solidAngleScale);
+#else
+            return load4<false>(3, _xx);
+#endif // CMFT_RADIANCE_SOA_COMPACT_NORMALS
+        }
+
+        template <bool Signed>
+        inline bx::float4_t load4(uint8_t _plane, int32_t _xx) const
+        {
+#if CMFT_RADIANCE_SOA_COMPACT_NORMALS
+            return soaLoadInt16x4<Signed>((const uint16_t*)m_planes[_plane], _xx);
+#else
+            return bx::float4_ld(&((const float*)m_planes[_plane])[_xx]);
+#endif // CMFT_RADIANCE_SOA_COMPACT_NORMALS
+        }
+
+        const void* m_planes[4];
+#if CMFT_RADIANCE_SOA_COMPACT_NORMALS
+        bx::float4_t m_solidAngleScale;
+#endif // CMFT_RADIANCE_SOA_COMPACT_NORMALS
+    };
+
+    // Trims rows of filter rectangles to the span of the specular cap, see CapRowSpans. Off by default: normal cone culling
+    // already skips 8x8 blocks outside of the cap, spans only trim partially covered blocks at both ends of a row and
+    // save about 1% of the iterations, which is less than solving the section for each row costs.
+#ifndef CMFT_RADIANCE_CAP_SPANS
+    #define CMFT_RADIANCE_CAP_SPANS 0
+#endif //CMFT_RADIANCE_CAP_SPANS
+
+    // Only rows of filter rectangles at least this wide are trimmed.
+#ifndef CMFT_RADIANCE_CAP_SPAN_MIN_WIDTH
+    #define CMFT_RADIANCE_CAP_SPAN_MIN_WIDTH 16
+#endif //CMFT_RADIANCE_CAP_SPAN_MIN_WIDTH
+
+#if CMFT_RADIANCE_CAP_SPANS
+    /// Conservative spans of texels within the specular angle of a tap vector, for rows of a single face.
+    /// Normals of a row are normalize(u*U + v*V + N) with warped u and v, so the cap cuts the row in a conic section:
+    /// (tu*u + b)^2 >= c^2*(u^2 + v^2 + 1) with tu*u + b >= 0. Cosine is lowered by an epsilon, so that rounding of
+    /// the dot test never passes a texel outside of the span.
+    struct CapRowSpans
+    {
+        CapRowSpans()
+        {
+        }
+
+        CapRowSpans(const float* _tapVec, uint8_t _face, uint32_t _faceSize, float _cosAngle)
+        {
+            m_cos = double(_cosAngle) - 1e-4;
+            m_tu = double(vec3Dot(_tapVec, s_faceUvVectors[_face][0]));
+            m_tv = double(vec3Dot(_tapVec, s_faceUvVectors[_face][1]));
+            m_tn = double(vec3Dot(_tapVec, s_faceUvVectors[_face][2]));
+            m_faceSize = double(int32_t(_faceSize));
+
+            // Same as texelCoordWarp(). Warp moves coordinates within the face by at most m_warp.
+            m_warp = (1 == _faceSize) ? 0.0 : m_faceSize*m_faceSize/((m_faceSize-1.0)*(m_faceSize-1.0)*(m_faceSize-1.0));
+
+            // Spans are unbounded if tilt of the tap vector along rows is above the cosine.
+            m_bounded = 0.0 < m_cos && m_tu*m_tu < m_cos*m_cos;
+        }
+
+        /// Computes span [_xMin, _xMax] of row _yy, with a texel of slack on each side. Returns false if no texel of the row is
+        /// within the angle. Row has to be inside of the face, normals of guard band texels come from neighbour faces.
+        bool row(int32_t& _xMin, int32_t& _xMax, int32_t _yy) const
+        {
+            _xMin = INT32_MIN;
+            _xMax = INT32_MAX;
+
+            if (!m_bounded)
+            {
+                return true;
+            }
+
+            const double v0 = 2.0*(double(_yy)+0.5)/m_faceSize - 1.0;
+            const double vv = m_warp*v0*v0*v0 + v0;
+            const double bb = vv*m_tv + m_tn;
+
+            const double qa = m_tu*m_tu - m_cos*m_cos;
+            const double qb = 2.0*m_tu*bb;
+            const double qc = bb*bb - m_cos*m_cos*(vv*vv + 1.0);
+            const double disc = qb*qb - 4.0*qa*qc;
+            if (disc < 0.0)
+            {
+                return false;
+            }
+
+            // Leading coefficient is negative, section is between the roots. Discard the mirrored cap on the opposite side.
+            const double sq = sqrt(disc);
+            const double u0 = (-qb + sq)/(2.0*qa);
+            const double u1 = (-qb - sq)/(2.0*qa);
+            if (m_tu*0.5*(u0+u1) + bb < 0.0)
+            {
+                return false;
+            }
+
+            const double halfSize = 0.5*m_faceSize;
+            _xMin = int32_t(floor((clamp(u0 - m_warp, -2.0, 2.0) + 1.0)*halfSize - 0.5) - 1.0);
+            _xMax = int32_t( ceil((clamp(u1 + m_warp, -2.0, 2.0) + 1.0)*halfSize - 0.5) + 1.0);
+
+            return true;
+        }
+
+        double m_cos;
+        double m_tu;
+        double m_tv;
+        double m_tn;
+        double m_faceSize;
+        double m_warp;
+        bool m_bounded;
+    };
+
+    /// Fills spans of rows [_yBegin, _yEnd] for processFilterRectSoa(), indexed from _blockBeginY.
+    /// Rows in the guard band and, if the rectangle reaches them, guard band columns are not trimmed.
+    static inline void capRowSpansInit(int32_t* _spanMin
+                                     , int32_t* _spanMax
+                                     , const CapRowSpans& _capSpans
+                                     , bool _trimRows
+                                     , int32_t _yBegin
+                                     , int32_t _yEnd
+                                     , int32_t _blockBeginY
+                                     , int32_t _minX
+                                     , int32_t _maxX
+                                     , int32_t _faceSize
+                                     )
+    {
+        for (int32_t yy = _yBegin; yy <= _yEnd; ++yy)
+        {
+            int32_t& rowMin = _spanMin[yy-_blockBeginY];
+            int32_t& rowMax = _spanMax[yy-_blockBeginY];
+            rowMin = INT32_MIN;
+            rowMax = INT32_MAX;
+
+            if (_trimRows
+            &&  0 <= yy && yy < _faceSize)
+            {
+                if (!_capSpans.row(rowMin, rowMax, yy))
+                {
+                    rowMin = INT32_MAX;
+                    rowMax = INT32_MIN;
+                }
+
+                if (_minX < 0)
+                {
+                    rowMin = INT32_MIN;
+                }
+                if (_maxX >= _faceSize)
+                {
+                    rowMax = INT32_MAX;
+                }
+            }
+        }
+    }
+#endif // CMFT_RADIANCE_CAP_SPANS
+
+    // 1 - Rows of source faces of at least CMFT_RADIANCE_TABLE_FREE_MIN_FACE_SIZE generate texel directions and solid angles
+    //     instead of reading them from the normal planes, which take more memory traffic than the color planes. Pays off
+    //     where the loop is bound by memory bandwidth, many cores on big faces. Solid angles are taken at texel centers,
+    //     which differs from the exact ones by about 1/faceSize^2 relatively.
+    // 0 - Normals and solid angles are always read from the table. Default: planes stream from cache at the rate the
+    //     loop consumes them on a single core, there generating directions is more than 50% slower.
+#ifndef CMFT_RADIANCE_TABLE_FREE
+    #define CMFT_RADIANCE_TABLE_FREE 0
+#endif //CMFT_RADIANCE_TABLE_FREE
+
+#ifndef CMFT_RADIANCE_TABLE_FREE_MIN_FACE_SIZE
+    #define CMFT_RADIANCE_TABLE_FREE_MIN_FACE_SIZE 512
+#endif //CMFT_RADIANCE_TABLE_FREE_MIN_FACE_SIZE
+
+    /// Rectangle [m_minX, m_maxX] x [m_minY, m_maxY] of m_face filtered for a single tap vector, see processFilterRectSoa().
+    struct SoaFilterRect
+    {
+        void init(const float* _tapVec
+                , float _specularAngle
+                , const SoaCubemap* _normals
+                , uint8_t _face
+                , int32_t _minX
+                , int32_t _maxX
+                , int32_t _minY
+                , int32_t _maxY
+                )
+        {
+            const int32_t border = int32_t(_normals->m_border);
+
+            m_face  = _face;
+            m_minX  = _minX;
+            m_maxX  = _maxX;
+            m_minY  = _minY;
+            m_maxY  = _maxY;
+
+            // Blocks are counted from the start of the guard band, which is a multiple of 4 texels.
+            m_firstBlockY = uint32_t(_minY + border)/CMFT_NORMAL_CONE_BLOCK_SIZE;
+            m_lastBlockY  = uint32_t(_maxY + border)/CMFT_NORMAL_CONE_BLOCK_SIZE;
+
+#if CMFT_RADIANCE_CAP_SPANS
+            m_capSpans = CapRowSpans(_tapVec, _face, _normals->m_faceSize, _specularAngle);
+            m_trimRows = m_capSpans.m_bounded && (_maxX - _minX + 1) >= CMFT_RADIANCE_CAP_SPAN_MIN_WIDTH;
+#else
+            BX_UNUSED(_specularAngle);
+#endif // CMFT_RADIANCE_CAP_SPANS
+
+#if CMFT_RADIANCE_TABLE_FREE
+            // Guard band texels lie on neighbouring faces, their directions are only in the table.
+            const int32_t faceSize = int32_t(_normals->m_faceSize);
+            m_tableFree = (CMFT_RADIANCE_TABLE_FREE_MIN_FACE_SIZE <= faceSize)
+                       && 0 <= _minX && _maxX < faceSize
+                       && 0 <= _minY && _maxY < faceSize
+                       ;
+            if (m_tableFree)
+            {
+                // Edge fixup factor of texelCoordWarp().
+                const float faceSize_MinusOne = float(faceSize - 1);
+                m_invFaceSize_Mul2 = 2.0f/float(faceSize);
+                m_warp = float(faceSize*faceSize) / (faceSize_MinusOne*faceSize_MinusOne*faceSize_MinusOne);
+                m_uDot = vec3Dot(s_faceUvVectors[_face][0], _tapVec);
+                m_vDot = vec3Dot(s_faceUvVectors[_face][1], _tapVec);
+                m_wDot = vec3Dot(s_faceUvVectors[_face][2], _tapVec);
+            }
+#else
+            BX_UNUSED(_tapVec);
+#endif // CMFT_RADIANCE_TABLE_FREE
+        }
+
+        uint8_t m_face;
+        int32_t m_minX;
+        int32_t m_maxX;
+        int32_t m_minY;
+        int32_t m_maxY;
+        uint32_t m_firstBlockY;
+        uint32_t m_lastBlockY;
+#if CMFT_RADIANCE_CAP_SPANS
+        CapRowSpans m_capSpans;
+        bool m_trimRows;
+#endif // CMFT_RADIANCE_CAP_SPANS
+#if CMFT_RADIANCE_TABLE_FREE
+        bool m_tableFree; //!< Directions and solid angles are generated, see CMFT_RADIANCE_TABLE_FREE.
+        float m_invFaceSize_Mul2;
+        float m_warp;
+        float m_uDot;     //!< Tap vector projected on the u, v and face axes of m_face.
+        float m_vDot;
+        float m_wDot;
+#endif // CMFT_RADIANCE_TABLE_FREE
+    };
+
+    /// True if 4 texels starting at _xx are in a block with no color above CMFT_RADIANCE_BLACK_BLOCK_TOLERANCE.
+    /// _blockMax is the block row of SoaCubemap::blockMaxRow(), NULL if the span has no such blocks.
+    static inline bool soaBlockBlack(const float* _blockMax, int32_t _xx, int32_t _border)
+    {
+        return NULL != _blockMax
+            && _blockMax[uint32_t(_xx + _border)/CMFT_NORMAL_CONE_BLOCK_SIZE] <= CMFT_RADIANCE_BLACK_BLOCK_TOLERANCE
+            ;
+    }
+
+    /// Block row of SoaCubemap::blockMaxRow() if any of blocks [_firstBlockX, _lastBlockX] is black, see soaBlockBlack().
+    static inline const float* soaSpanBlockMax(const float* _blockMax, uint32_t _firstBlockX, uint32_t _lastBlockX)
+    {
+        if (NULL != _blockMax)
+        {
+            for (uint32_t blockX = _firstBlockX; blockX <= _lastBlockX; ++blockX)
+            {
+                if (_blockMax[blockX] <= CMFT_RADIANCE_BLACK_BLOCK_TOLERANCE)
+                {
+                    return _blockMax;
+                }
+            }
+        }
+
+        return NULL;
+    }
+
+    /// Accumulates colors of 4 texels starting at _xx with cosine _dot to the tap vector and solid angle _solidAngle.
+    /// Texels outside of _mask are left out. With _black, only weights are accumulated and colors are not read.
+    template <bool HalfColors>
+    static inline void soaAccumulate4(bx::float4_t& _red
+                                    , bx::float4_t& _green
+                                    , bx::float4_t& _blue
+                                    , bx::float4_t& _weight
+                                    , bx::float4_t _dot
+                                    , bx::float4_t _solidAngle
+                                    , bx::float4_t _mask
+                                    , bx::float4_t _power
+                                    , const RadianceLobeTable* _lobeTable
+                                    , const void* _rr
+                                    , const void* _gg
+                                    , const void* _bb
+                                    , int32_t _xx
+                                    , bool _black
+                                    )
+    {
+        using namespace bx;
+
+#if CMFT_RADIANCE_LOBE_TABLE
+        BX_UNUSED(_power);
+        const float4_t ww = float4_and(_mask, float4_mul(_solidAngle, _lobeTable->weight4(_dot)));
+#else
+        BX_UNUSED(_lobeTable);
+        const float4_t ww = float4_and(_mask, float4_mul(_solidAngle, float4_pow(_dot, _power)));
+#endif // CMFT_RADIANCE_LOBE_TABLE
+        _weight = float4_add(_weight, ww);
+        if (_black)
+        {
+            return;
+        }
+
+        _red    = float4_madd(soaLoad4<HalfColors>(_rr, _xx), ww, _red);
+        _green  = float4_madd(soaLoad4<HalfColors>(_gg, _xx), ww, _green);
+        _blue   = float4_madd(soaLoad4<HalfColors>(_bb, _xx), ww, _blue);
+    }
+
+    /// Accumulates red, green, blue and weight of texels of block row _blockY of _rect that are within the specular angle.
+    /// Rectangle may extend into the guard band. Reads normals and colors from SoA planes with aligned loads,
+    /// texels outside of the rectangle in the first and the last 4-texel block of a row are masked out.
+    /// With CMFT_RADIANCE_CAP_SPANS, wide rows inside of the face are trimmed to the span of the specular cap, see CapRowSpans.
+    /// Trimmed texels would fail the angle test, so the result doesn't change.
+    /// With CMFT_RADIANCE_TABLE_FREE, rows of rectangles inside of big faces generate directions instead of loading normals.
+    /// Unnormalized direction of a texel is linear in the warped u, it only needs an rsqrt per texel to normalize it.
+    /// With HalfColors, color planes are halfs and are converted while loading. Accumulation is done in fp32.
+    template <bool HalfColors>
+    static void processFilterRectRowSoa(bx::float4_t _sum[4]
+                                      , float _specularPower
+                                      , float _specularAngle
+                                      , float _sinAngle
+                                      , const RadianceLobeTable* _lobeTable
+                                      , const float* _tapVec
+                                      , const SoaCubemap* _normals
+                                      , const SoaCubemap* _colors
+                                      , const SoaFilterRect& _rect
+                                      , uint32_t _blockY
+                                      )
+    {
+        using namespace bx;
+
+        const int32_t border = int32_t(_normals->m_border);
+        const uint8_t face = _rect.m_face;
+        const int32_t minX = _rect.m_minX;
+        const int32_t maxX = _rect.m_maxX;
+
+        const float4_t tapX  = float4_splat(_tapVec[0]*SoaNormalRow::snormScale());
+        const float4_t tapY  = float4_splat(_tapVec[1]*SoaNormalRow::snormScale());
+        const float4_t tapZ  = float4_splat(_tapVec[2]*SoaNormalRow::snormScale());
+        const float4_t angle = float4_splat(_specularAngle);
+        const float4_t power = float4_splat(_specularPower);
+        const float4_t lane  = float4_ld(0.0f, 1.0f, 2.0f, 3.0f);
+        const float4_t minXf = float4_splat(float(minX));
+        const float4_t maxXf = float4_splat(float(maxX));
+
+        float4_t red    = _sum[0];
+        float4_t green  = _sum[1];
+        float4_t blue   = _sum[2];
+        float4_t weight = _sum[3];
+
+        const uint32_t lastBlockX = uint32_t(maxX + border)/CMFT_NORMAL_CONE_BLOCK_SIZE;
+
+        const int32_t blockBeginY = int32_t(_blockY*CMFT_NORMAL_CONE_BLOCK_SIZE) - border;
+        const int32_t yBegin = max(_rect.m_minY, blockBeginY);
+        const int32_t yEnd   = min(_rect.m_maxY, blockBeginY + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+
+        const float* rowCones = _normals->coneRow(face, _blockY);
+        const float* rowBlockMax = _colors->blockMaxRow(face, _blockY);
+
+#if CMFT_RADIANCE_CAP_SPANS
+        // Cap spans of the rows of this block row, computed once the first block passes and shared by all spans.
+        int32_t spanMin[CMFT_NORMAL_CONE_BLOCK_SIZE];
+        int32_t spanMax[CMFT_NORMAL_CONE_BLOCK_SIZE];
+        bool spansReady = false;
+#endif // CMFT_RADIANCE_CAP_SPANS
+
+        for (uint32_t blockX = uint32_t(minX + border)/CMFT_NORMAL_CONE_BLOCK_SIZE; blockX <= lastBlockX; ++blockX)
+        {
+            // Skip blocks that are entirely outside of the specular angle.
+            if (normalConeOutside(&rowCones[blockX*4], _tapVec, _specularAngle, _sinAngle))
+            {
+                continue;
+            }
+
+            // Merge following blocks that are not skipped into a single span.
+            const uint32_t firstBlockX = blockX;
+            while (blockX < lastBlockX
+               && !normalConeOutside(&rowCones[(blockX+1)*4], _tapVec, _specularAngle, _sinAngle))
+            {
+                ++blockX;
+            }
+
+#if CMFT_RADIANCE_CAP_SPANS
+            if (!spansReady)
+            {
+                spansReady = true;
+                capRowSpansInit(spanMin, spanMax, _rect.m_capSpans, _rect.m_trimRows, yBegin, yEnd, blockBeginY, minX, maxX, int32_t(_normals->m_faceSize));
+            }
+#endif // CMFT_RADIANCE_CAP_SPANS
+
+            // Spans start and end on block boundaries, so 4-texel groups never straddle a skipped block.
+            const int32_t spanBegin = max(minX, int32_t(firstBlockX*CMFT_NORMAL_CONE_BLOCK_SIZE) - border)&~int32_t(3);
+            const int32_t spanEnd   = min(maxX, int32_t(blockX*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1) - border);
+
+            // Spans without black blocks don't look blocks up per texel.
+            const float* spanBlockMax = soaSpanBlockMax(rowBlockMax, firstBlockX, blockX);
+
+            // Rows are only contiguous within a tile, spans are read tile by tile. Tiles start on 4-texel boundaries.
+            for (int32_t xBegin = spanBegin; xBegin <= spanEnd;)
+            {
+                const int32_t xEnd = min(spanEnd, _colors->tileLastX(xBegin));
+
+                for (int32_t yy = yBegin; yy <= yEnd; ++yy)
+                {
+#if CMFT_RADIANCE_CAP_SPANS
+                    // Starts stay aligned to 4 texels, so texels keep their accumulation lanes.
+                    const int32_t rowBegin = max(xBegin, spanMin[yy-blockBeginY]&~int32_t(3));
+                    const int32_t rowEnd   = min(xEnd, spanMax[yy-blockBeginY]);
+#else
+                    const int32_t rowBegin = xBegin;
+                    const int32_t rowEnd   = xEnd;
+#endif // CMFT_RADIANCE_CAP_SPANS
+
+                    const void* rr = _colors->rowData(face, 0, xBegin, yy);
+                    const void* gg = _colors->rowData(face, 1, xBegin, yy);
+                    const void* bb = _colors->rowData(face, 2, xBegin, yy);
+
+#if CMFT_RADIANCE_TABLE_FREE
+                    if (_rect.m_tableFree)
+                    {
+                        // Same coordinates and edge fixup as buildCubemapNormalSolidAngle().
+                        const float invFaceSize_Mul2 = _rect.m_invFaceSize_Mul2;
+                        const float warp = _rect.m_warp;
+                        const float vv = (float(yy) + 0.5f)*invFaceSize_Mul2 - 1.0f;
+                        const float vw = vv*(warp*vv*vv + 1.0f);
+
+                        const float4_t uDot       = float4_splat(_rect.m_uDot);
+                        const float4_t rowDot     = float4_splat(vw*_rect.m_vDot + _rect.m_wDot);
+                        const float4_t rowLenSq   = float4_splat(vw*vw + 1.0f);
+                        const float4_t rowAreaSq  = float4_splat(vv*vv + 1.0f);
+                        const float4_t warp4      = float4_splat(warp);
+                        const float4_t one        = float4_splat(1.0f);
+                        const float4_t texelArea  = float4_splat(invFaceSize_Mul2*invFaceSize_Mul2);
+                        const float4_t uScale     = float4_splat(invFaceSize_Mul2);
+                        const float4_t uBias      = float4_splat(0.5f*invFaceSize_Mul2 - 1.0f);
+
+                        for (int32_t xx = rowBegin; xx <= rowEnd; xx += 4)
+                        {
+                            const float4_t idx = float4_add(float4_splat(float(xx)), lane);
+                            const float4_t uu  = float4_madd(idx, uScale, uBias);
+                            const float4_t uw  = float4_mul(uu, float4_madd(float4_mul(warp4, uu), uu, one));
+
+                            const float4_t invLen = float4_rsqrt_nr(float4_madd(uw, uw, rowLenSq));
+                            const float4_t dot = float4_mul(float4_madd(uw, uDot, rowDot), invLen);
+                            float4_t mask = float4_cmpge(dot, angle);
+
+                            // Mask out texels outside of the filter area.
+                            if (xx < minX || xx+3 > maxX)
+                            {
+                                mask = float4_and(mask, float4_and(float4_cmpge(idx, minXf), float4_cmple(idx, maxXf)));
+                            }
+
+                            if (!float4_test_any_xyzw(mask))
+                            {
+                                continue;
+                            }
+
+                            // Solid angle of the texel is its area over the cube of the distance of its center, see texelSolidAngle().
+                            const float4_t invDist = float4_rsqrt_nr(float4_madd(uu, uu, rowAreaSq));
+                            const float4_t solidAngle = float4_mul(texelArea, float4_mul(invDist, float4_mul(invDist, invDist)));
+
+                            soaAccumulate4<HalfColors>(red, green, blue, weight, dot, solidAngle, mask, power, _lobeTable, rr, gg, bb, xx, soaBlockBlack(spanBlockMax, xx, border));
+                        }
+
+                        continue;
+                    }
+#endif // CMFT_RADIANCE_TABLE_FREE
+
+                    const SoaNormalRow normalRow(_normals, face, xBegin, yy);
+
+                    for (int32_t xx = rowBegin; xx <= rowEnd; xx += 4)
+                    {
+                        const float4_t dot = normalRow.dot4(xx, tapX, tapY, tapZ);
+                        float4_t mask = float4_cmpge(dot, angle);
+
+                        // Mask out texels outside of the filter area.
+                        if (xx < minX || xx+3 > maxX)
+                        {
+                            const float4_t idx = float4_add(float4_splat(float(xx)), lane);
+                            mask = float4_and(mask, float4_and(float4_cmpge(idx, minXf), float4_cmple(idx, maxXf)));
+                        }
+
+                        if (!float4_test_any_xyzw(mask))
+                        {
+                            continue;
+                        }
+
+                        soaAccumulate4<HalfColors>(red, green, blue, weight, dot, normalRow.solidAngle4(xx), mask, power, _lobeTable, rr, gg, bb, xx, soaBlockBlack(spanBlockMax, xx, border));
+                    }
+                }
+
+                xBegin = xEnd+1;
+            }
+        }
+
+        _sum[0] = red;
+        _sum[1] = green;
+        _sum[2] = blue;
+        _sum[3] = weight;
+    }
+
+    /// Accumulates texels of rectangle [_minX, _maxX] x [_minY, _maxY] of _face, block row by block row, see processFilterRectRowSoa().
+    template <bool HalfColors>
+    static inline void processFilterRectSoa(bx::float4_t _sum[4]
+                                          , float _specularPower
+                                          , float _specularAngle
+                                          , const RadianceLobeTable* _lobeTable
+                                          , const float* _tapVec
+                                          , const SoaCubemap* _normals
+                                          , const SoaCubemap* _colors
+                                          , uint8_t _face
+                                          , int32_t _minX
+                                          , int32_t _maxX
+                                          , int32_t _minY
+                                          , int32_t _maxY
+                                          )
+    {
+        const float sinAngle = sqrtf(max(0.0f, 1.0f - _specularAngle*_specularAngle));
+
+        SoaFilterRect rect;
+        rect.init(_tapVec, _specularAngle, _normals, _face, _minX, _maxX, _minY, _maxY);
+
+        for (uint32_t blockY = rect.m_firstBlockY; blockY <= rect.m_lastBlockY; ++blockY)
+        {
+            processFilterRectRowSoa<HalfColors>(_sum, _specularPower, _specularAngle, sinAngle, _lobeTable, _tapVec, _normals, _colors, rect, blockY);
+        }
+    }
+
+    /// Divides accumulated color by accumulated weight. If the weight is zero, takes a direct color sample of the tap vector.
+    template <bool HalfColors>
+    static inline void processFilterResolveSoa(float _res[3], const bx::float4_t _sum[4], const float* _tapVec, const SoaCubemap* _colors)
+    {
+        using namespace bx;
+
+        const float4_t red    = _sum[0];
+        const float4_t green  = _sum[1];
+        const float4_t blue   = _sum[2];
+        const float4_t weight = _sum[3];
+        const float totalWeight = float4_x(weight) + float4_y(weight) + float4_z(weight) + float4_w(weight);
+
+        // Divide color by colorWeight and store result.
+        if (0.0f != totalWeight)
+        {
+            const float invWeight = 1.0f/totalWeight;
+            _res[0] = (float4_x(red)   + float4_y(red)   + float4_z(red)   + float4_w(red)  ) * invWeight;
+            _res[1] = (float4_x(green) + float4_y(green) + float4_z(green) + float4_w(green)) * invWeight;
+            _res[2] = (float4_x(blue)  + float4_y(blue)  + float4_z(blue)  + float4_w(blue) ) * invWeight;
+        }
+        // Else if colorWeight == 0 (result of convolution is zero) take a direct color sample.
+        else
+        {
+            float uu, vv;
+            uint8_t hitFaceIdx;
+            vecToTexelCoord(uu, vv, hitFaceIdx, _tapVec);
+
+            const uint32_t srcFaceSize = _colors->m_faceSize;
+            const int32_t xx = int32_t(uu*float(int32_t(srcFaceSize)));
+            const int32_t yy = int32_t(vv*float(int32_t(srcFaceSize)));
+
+            for (uint8_t channel = 0; channel < 3; ++channel)
+            {
+                _res[channel] = HalfColors
+                              ? halfToFloat(_colors->rowHalf(hitFaceIdx, channel, xx, yy)[xx])
+                              : _colors->row(hitFaceIdx, channel, xx, yy)[xx]
+                              ;
+            }
+        }
+    }
+
+    /// Same as processFilterAreaSimd() but reads normals and colors from SoA planes, see processFilterRectSoa().
+    template <bool HalfColors>
+    void processFilterAreaSoa(float _res[3]
+                            , float _specularPower
+                            , float _specularAngle
+                            , const RadianceLobeTable* _lobeTable
+                            , const float* _tapVec
+                            , const SoaCubemap* _normals
+                            , const SoaCubemap* _colors
+                            , Aabb _filterArea[6]
+                            )
+    {
+        const float faceSize_MinusOne = float(int32_t(_normals->m_faceSize-1));
+
+        bx::float4_t sum[4] = { bx::float4_zero(), bx::float4_zero(), bx::float4_zero(), bx::float4_zero() };
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_filterArea[face].isEmpty())
+            {
+                continue;
+            }
+
+            const int32_t minX = int32_t(uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne));
+            const int32_t maxX = int32_t(uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne));
+            const int32_t minY = int32_t(uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne));
+            const int32_t maxY = int32_t(uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne));
+
+            processFilterRectSoa<HalfColors>(sum, _specularPower, _specularAngle, _lobeTable, _tapVec, _normals, _colors, face, minX, maxX, minY, maxY);
+        }
+
+        processFilterResolveSoa<HalfColors>(_res, sum, _tapVec, _colors);
+    }
+
+    /// Same as processFilterAreaSoa() with the whole filter area on _face, see determineHitFaceFilterArea().
+    template <bool HalfColors>
+    void processFilterAreaSoaFace(float _res[3]
+                                , float _specularPower
+                                , float _specularAngle
+                                , const RadianceLobeTable* _lobeTable
+                                , const float* _tapVec
+                                , const SoaCubemap* _normals
+                                , const SoaCubemap* _colors
+                                , uint8_t _face
+                                , const Aabb& _filterArea
+                                )
+    {
+        const float faceSize_MinusOne = float(int32_t(_normals->m_faceSize-1));
+
+        const int32_t minX = int32_t(uint32_t(_filterArea.m_min[0] * faceSize_MinusOne));
+        const int32_t maxX = int32_t(uint32_t(_filterArea.m_max[0] * faceSize_MinusOne));
+        const int32_t minY = int32_t(uint32_t(_filterArea.m_min[1] * faceSize_MinusOne));
+        const int32_t maxY = int32_t(uint32_t(_filterArea.m_max[1] * faceSize_MinusOne));
+
+        bx::float4_t sum[4] = { bx::float4_zero(), bx::float4_zero(), bx::float4_zero(), bx::float4_zero() };
+        processFilterRectSoa<HalfColors>(sum, _specularPower, _specularAngle, _lobeTable, _tapVec, _normals, _colors, _face, minX, maxX, minY, maxY);
+        processFilterResolveSoa<HalfColors>(_res, sum, _tapVec, _colors);
+    }
+
+    /// Same as processFilterAreaSoa() for filters that fit into the guard band (SoaCubemap::fitsGuardBand()).
+    /// Filter area is a single rectangle on the hit face that extends into the guard band, there is no edge handling.
+    /// Corners of the band have zero normals and never pass the angle test.
+    template <bool HalfColors>
+    void processFilterAreaSoaGuardBand(float _res[3]
+                                     , float _specularPower
+                                     , float _specularAngle
+                                     , const RadianceLobeTable* _lobeTable
+                                     , const float* _tapVec
+                                     , const SoaCubemap* _normals
+                                     , const SoaCubemap* _colors
+                                     , float _filterSize
+                                     )
+    {
+        float uu, vv;
+        uint8_t face;
+        vecToTexelCoord(uu, vv, face, _tapVec);
+
+        // Texels overlapped by the filter area, widened to the bounds processFilterArea() takes on the hit face.
+        const float faceSizef = float(int32_t(_normals->m_faceSize));
+        const float faceSize_MinusOne = faceSizef - 1.0f;
+        const int32_t bandMin = -int32_t(_normals->m_border);
+        const int32_t bandMax = int32_t(_normals->m_faceSize + _normals->m_border) - 1;
+        const float u0 = uu-_filterSize;
+        const float u1 = uu+_filterSize;
+        const float v0 = vv-_filterSize;
+        const float v1 = vv+_filterSize;
+        const int32_t minX = max(bandMin, int32_t(floorf(min(u0*faceSizef, u0*faceSize_MinusOne))));
+        const int32_t maxX = min(bandMax, int32_t(floorf(max(u1*faceSizef, u1*faceSize_MinusOne))));
+        const int32_t minY = max(bandMin, int32_t(floorf(min(v0*faceSizef, v0*faceSize_MinusOne))));
+        const int32_t maxY = min(bandMax, int32_t(floorf(max(v1*faceSizef, v1*faceSize_MinusOne))));
+
+        bx::float4_t sum[4] = { bx::float4_zero(), bx::float4_zero(), bx::float4_zero(), bx::float4_zero() };
+        processFilterRectSoa<HalfColors>(sum, _specularPower, _specularAngle, _lobeTable, _tapVec, _normals, _colors, face, minX, maxX, minY, maxY);
+        processFilterResolveSoa<HalfColors>(_res, sum, _tapVec, _colors);
+    }
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+#if CMFT_RADIANCE_SIMD
+    /// Same as processFilterArea<float>() but processes 4 texels at a time.
+    /// Uses polynomial exp2/log2 approximation of pow() from bx, masked by the specular angle test.
+    void processFilterAreaSimd(float _res[3]
+                             , float _specularPower
+                             , float _specularAngle
+                             , const RadianceLobeTable* _lobeTable
+                             , const float* _tapVec
+                             , const float* _cubemapNormalSolidAngle
+                             , Aabb _filterArea[6]
+                             , uint32_t _srcFaceSize
+                             , const void* _srcData
+                             , const uint64_t _faceOffsets[6]
+                             )
+    {
+        using namespace bx;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t pitch = _srcFaceSize*bytesPerPixel;
+        const uint32_t normalFaceSize = pitch*_srcFaceSize;
+        const float faceSize_MinusOne = float(int32_t(_srcFaceSize-1));
+
+        const float4_t tapX  = float4_splat(_tapVec[0]);
+        const float4_t tapY  = float4_splat(_tapVec[1]);
+        const float4_t tapZ  = float4_splat(_tapVec[2]);
+        const float4_t angle = float4_splat(_specularAngle);
+#if CMFT_RADIANCE_LOBE_TABLE
+        BX_UNUSED(_specularPower);
+#else
+        BX_UNUSED(_lobeTable);
+        const float4_t power = float4_splat(_specularPower);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+
+        const uint32_t blocksPerSide = normalConeBlocksPerSide(_srcFaceSize);
+        const float* normalCones = cubemapNormalCones(_cubemapNormalSolidAngle, _srcFaceSize);
+        const float sinAngle = sqrtf(max(0.0f, 1.0f - _specularAngle*_specularAngle));
+
+        float4_t color  = float4_zero();
+        float4_t weight = float4_zero();
+        double colorWeightTail[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_filterArea[face].isEmpty())
+            {
+                continue;
+            }
+
+            const uint32_t minX = uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne);
+            const uint32_t maxX = uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne);
+            const uint32_t minY = uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne);
+            const uint32_t maxY = uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne);
+            const uint8_t* faceData    = (const uint8_t*)_srcData                 + _faceOffsets[face];
+            const uint8_t* faceNormals = (const uint8_t*)_cubemapNormalSolidAngle + normalFaceSize*face;
+            const float*   faceCones   = normalCones + size_t(face)*blocksPerSide*blocksPerSide*4;
+
+            for (uint32_t blockY = minY/CMFT_NORMAL_CONE_BLOCK_SIZE; blockY <= maxY/CMFT_NORMAL_CONE_BLOCK_SIZE; ++blockY)
+            {
+                const uint32_t yBegin = max(minY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                const uint32_t yEnd   = min(maxY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+
+                const float* rowCones = faceCones + blockY*blocksPerSide*4;
+                const uint32_t lastBlockX = maxX/CMFT_NORMAL_CONE_BLOCK_SIZE;
+
+                for (uint32_t blockX = minX/CMFT_NORMAL_CONE_BLOCK_SIZE; blockX <= lastBlockX; ++blockX)
+                {
+                    // Skip blocks that are entirely outside of the specular angle.
+                    if (normalConeOutside(&rowCones[blockX*4], _tapVec, _specularAngle, sinAngle))
+                    {
+                        continue;
+                    }
+
+                    // Merge following blocks that are not skipped into a single span.
+                    const uint32_t firstBlockX = blockX;
+                    while (blockX < lastBlockX
+                       && !normalConeOutside(&rowCones[(blockX+1)*4], _tapVec, _specularAngle, sinAngle))
+                    {
+                        ++blockX;
+                    }
+
+                    const uint32_t xBegin = max(minX, firstBlockX*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                    const uint32_t xEnd   = min(maxX, blockX*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+                    const uint32_t endX4  = xBegin + ((xEnd-xBegin+1)&~UINT32_C(3));
+
+                    for (uint32_t yy = yBegin; yy <= yEnd; ++yy)
+                    {
+                        const float* rowData    = (const float*)((const uint8_t*)faceData    + yy*pitch);
+                        const float* rowNormals = (const float*)((const uint8_t*)faceNormals + yy*pitch);
+
+                        uint32_t xx = xBegin;
+                        for (; xx < endX4; xx += 4)
+                        {
+                            const float* nn = &rowNormals[xx*4];
+                            const float4_t n0 = float4_ld(nn[ 0], nn[ 1], nn[ 2], nn[ 3]);
+                            const float4_t n1 = float4_ld(nn[ 4], nn[ 5], nn[ 6], nn[ 7]);
+                            const float4_t n2 = float4_ld(nn[ 8], nn[ 9], nn[10], nn[11]);
+                            const float4_t n3 = float4_ld(nn[12], nn[13], nn[14], nn[15]);
+
+                            // Transpose to xxxx, yyyy, zzzz, wwww.
+                            const float4_t t0 = float4_shuf_xAyB(n0, n1);
+                            const float4_t t1 = float4_shuf_zCwD(n0, n1);
+                            const float4_t t2 = float4_shuf_xAyB(n2, n3);
+                            const float4_t t3 = float4_shuf_zCwD(n2, n3);
+                            const float4_t nx = float4_shuf_xyAB(t0, t2);
+                            const float4_t ny = float4_shuf_zwCD(t0, t2);
+                            const float4_t nz = float4_shuf_xyAB(t1, t3);
+                            const float4_t sa = float4_shuf_zwCD(t1, t3);
+
+                            const float4_t dot  = float4_madd(nx, tapX, float4_madd(ny, tapY, float4_mul(nz, tapZ)));
+                            const float4_t mask = float4_cmpge(dot, angle);
+                            if (!float4_test_any_xyzw(mask))
+                            {
+                                continue;
+                            }
+
+#if CMFT_RADIANCE_LOBE_TABLE
+                            const float4_t ww = float4_and(mask, float4_mul(sa, _lobeTable->weight4(dot)));
+#else
+                            const float4_t ww = float4_and(mask, float4_mul(sa, float4_pow(dot, power)));
+#endif // CMFT_RADIANCE_LOBE_TABLE
+                            weight = float4_add(weight, ww);
+
+                            const float* cc = &rowData[xx*4];
+                            color = float4_madd(float4_ld(cc[ 0], cc[ 1], cc[ 2], cc[ 3]), float4_swiz_xxxx(ww), color);
+                            color = float4_madd(float4_ld(cc[ 4], cc[ 5], cc[ 6], cc[ 7]), float4_swiz_yyyy(ww), color);
+                            color = float4_madd(float4_ld(cc[ 8], cc[ 9], cc[10], cc[11]), float4_swiz_zzzz(ww), color);
+                            color = float4_madd(float4_ld(cc[12], cc[13], cc[14], cc[15]), float4_swiz_wwww(ww), color);
+                        }
+
+                        // Remaining texels.
+                        for (; xx <= xEnd; ++xx)
+                        {
+                            const float* normalPtr = &rowNormals[xx*4];
+                            const float dotProduct = vec3Dot(normalPtr, _tapVec);
+
+                            if (dotProduct >= _specularAngle)
+                            {
+#if CMFT_RADIANCE_LOBE_TABLE
+                                const float ww = normalPtr[3] * _lobeTable->weight(dotProduct);
+#else
+                                const float ww = normalPtr[3] * powf(dotProduct, _specularPower);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+
+                                const float* dataPtr = &rowData[xx*4];
+                                colorWeightTail[0] += dataPtr[0] * ww;
+                                colorWeightTail[1] += dataPtr[1] * ww;
+                                colorWeightTail[2] += dataPtr[2] * ww;
+                                colorWeightTail[3] += ww;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        const float colorWeight[3] = { float4_x(color), float4_y(color), float4_z(color) };
+        const float totalWeight = float4_x(weight) + float4_y(weight) + float4_z(weight) + float4_w(weight) + float(colorWeightTail[3]);
+
+        // Divide color by colorWeight and store result.
+        if (0.0f != totalWeight)
+        {
+            const float invWeight = 1.0f/totalWeight;
+            _res[0] = (colorWeight[0] + float(colorWeightTail[0])) * invWeight;
+            _res[1] = (colorWeight[1] + float(colorWeightTail[1])) * invWeight;
+            _res[2] = (colorWeight[2] + float(colorWeightTail[2])) * invWeight;
+        }
+        // Else if colorWeight == 0 (result of convolution is zero) take a direct color sample.
+        else
+        {
+            float uu, vv;
+            uint8_t hitFaceIdx;
+            vecToTexelCoord(uu, vv, hitFaceIdx, _tapVec);
+
+            const uint32_t xx = uint32_t(uu*float(_srcFaceSize));
+            const uint32_t yy = uint32_t(vv*float(_srcFaceSize));
+
+            const float* dataPtr = (const float*)((const uint8_t*)_srcData
+                                 + _faceOffsets[hitFaceIdx]
+                                 + yy*pitch
+                                 + xx*bytesPerPixel
+                                 );
+
+            _res[0] = dataPtr[0];
+            _res[1] = dataPtr[1];
+            _res[2] = dataPtr[2];
+        }
+    }
+#endif // CMFT_RADIANCE_SIMD
+
+    // Destination texels are visited in square blocks of this size, so neighbouring texels filtered one after another
+    // share most of their source window while it is still in cache. 0 walks rows in plain row-major order.
+#ifndef CMFT_RADIANCE_TRAVERSAL_BLOCK
+    #define CMFT_RADIANCE_TRAVERSAL_BLOCK 16
+#endif //CMFT_RADIANCE_TRAVERSAL_BLOCK
+
+    /// Filters rows [_yBegin, _yEnd) of a single destination cube face. _dstPtr points to the beginning of the face,
+    /// which is RGBA16F if _halfDst is set and RGBA32F otherwise. With _mask, only texels with a non-zero mask byte are written.
+    /// Filters a single destination texel with direction _tapVec. _guardBand is the result of SoaCubemap::fitsGuardBand(),
+    /// _onFace allows reading the filter area from a single face when it does not bleed over the face edges.
+    static inline void radianceFilterTap(float _color[3]
+                                       , const float _tapVec[3]
+                                       , bool _guardBand
+                                       , bool _onFace
+                                       , float _filterSize
+                                       , float _specularPower
+                                       , float _specularAngle
+                                       , const RadianceLobeTable* _lobeTable
+                                       , const float* _cubemapVectors
+                                       , const Image* _imageRgba32f
+                                       , const uint64_t _faceOffsets[CUBE_FACE_NUM]
+                                       , const SoaCubemap* _normalsSoa
+                                       , const SoaCubemap* _colorsSoa
+                                       )
+    {
+        BX_UNUSED(_guardBand, _cubemapVectors, _imageRgba32f, _faceOffsets, _normalsSoa, _colorsSoa);
+
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        if (_guardBand)
+        {
+            if (_colorsSoa->isHalf())
+            {
+                processFilterAreaSoaGuardBand<true>(_color, _specularPower, _specularAngle, _lobeTable, _tapVec, _normalsSoa, _colorsSoa, _filterSize);
+            }
+            else
+            {
+                processFilterAreaSoaGuardBand<false>(_color, _specularPower, _specularAngle, _lobeTable, _tapVec, _normalsSoa, _colorsSoa, _filterSize);
+            }
+
+            return;
+        }
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        Aabb hitFaceBb;
+        uint8_t hitFace;
+        const bool singleFace = _onFace && determineHitFaceFilterArea(hitFaceBb, hitFace, _tapVec, _filterSize);
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        if (singleFace)
+        {
+            if (_colorsSoa->isHalf())
+            {
+                processFilterAreaSoaFace<true>(_color, _specularPower, _specularAngle, _lobeTable, _tapVec, _normalsSoa, _colorsSoa, hitFace, hitFaceBb);
+            }
+            else
+            {
+                processFilterAreaSoaFace<false>(_color, _specularPower, _specularAngle, _lobeTable, _tapVec, _normalsSoa, _colorsSoa, hitFace, hitFaceBb);
+            }
+
+            return;
+        }
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        Aabb facesBb[6];
+        if (singleFace)
+        {
+            facesBb[hitFace] = hitFaceBb;
+        }
+        else
+        {
+            determineFilterArea(facesBb, _tapVec, _filterSize);
+        }
+
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        if (_colorsSoa->isHalf())
+        {
+            processFilterAreaSoa<true>(_color, _specularPower, _specularAngle, _lobeTable, _tapVec, _normalsSoa, _colorsSoa, facesBb);
+        }
+        else
+        {
+            processFilterAreaSoa<false>(_color, _specularPower, _specularAngle, _lobeTable, _tapVec, _normalsSoa, _colorsSoa, facesBb);
+        }
+#else
+#if CMFT_RADIANCE_SIMD
+        processFilterAreaSimd(_color
+#else
+        processFilterArea<float>(_color
+#endif // CMFT_RADIANCE_SIMD
+                               , _specularPower
+                               , _specularAngle
+                               , _lobeTable
+                               , _tapVec
+                               , _cubemapVectors
+                               , facesBb
+                               , _imageRgba32f->m_width
+                               , _imageRgba32f->m_data
+                               , _faceOffsets
+                               );
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+    }
+
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+    // Destination faces up to this size that are not filtered from the guard band are filtered source-major, see
+    // radianceFilterScatterSoa(). 0 filters all faces texel by texel.
+#ifndef CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE
+    #define CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE 8
+#endif //CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE
+
+#if CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE
+    /// Source-major variant of radianceFilter() for tiny destination faces with wide filters, where each texel walks most
+    /// of the source. Filter rectangles of all texels of the rows are set up first, then the source is walked once, block row
+    /// by block row, and each texel accumulates the block rows its rectangles cover while they are in cache. Texels sum the
+    /// same source texels in the same order as radianceFilterTap() does, so the results are identical.
+    template <bool HalfColors>
+    static void radianceFilterScatterSoa(void* _dstPtr
+                                       , bool _halfDst
+                                       , uint8_t _face
+                                       , uint32_t _mipFaceSize
+                                       , uint32_t _yBegin
+                                       , uint32_t _yEnd
+                                       , float _filterSize
+                                       , float _specularPower
+                                       , float _specularAngle
+                                       , const RadianceLobeTable* _lobeTable
+                                       , const SoaCubemap* _normalsSoa
+                                       , const SoaCubemap* _colorsSoa
+                                       , const uint8_t* _mask
+                                       )
+    {
+        struct Tap
+        {
+            bx::float4_t m_sum[4];
+            SoaFilterRect m_rects[CUBE_FACE_NUM];
+            float m_vec[3];
+            uint32_t m_texel;
+            uint8_t m_faces; // Bit per face with a filter rectangle.
+        };
+
+        Tap taps[CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE*CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE];
+        uint32_t numTaps = 0;
+
+        const float invFaceSize = 1.0f/float(int32_t(_mipFaceSize));
+        const float faceSize_MinusOne = float(int32_t(_normalsSoa->m_faceSize-1));
+        const uint32_t blockSize = (0 != CMFT_RADIANCE_TRAVERSAL_BLOCK) ? CMFT_RADIANCE_TRAVERSAL_BLOCK : _mipFaceSize;
+
+        // Filter areas are classified per traversal block, as in radianceFilter().
+        for (uint32_t blockY = _yBegin; blockY < _yEnd; blockY += blockSize)
+        {
+            const uint32_t blockYEnd = min(_yEnd, blockY+blockSize);
+            for (uint32_t blockX = 0; blockX < _mipFaceSize; blockX += blockSize)
+            {
+                const uint32_t blockXEnd = min(_mipFaceSize, blockX+blockSize);
+                const bool onFace = filterAreaOnFace(blockX, blockXEnd, blockY, blockYEnd, _mipFaceSize, _filterSize);
+
+                for (uint32_t yy = blockY; yy < blockYEnd; ++yy)
+                {
+                    for (uint32_t xx = blockX; xx < blockXEnd; ++xx)
+                    {
+                        if (NULL != _mask
+                        &&  0 == _mask[yy*_mipFaceSize + xx])
+                        {
+                            continue;
+                        }
+
+                        Tap& tap = taps[numTaps++];
+                        tap.m_texel = yy*_mipFaceSize + xx;
+                        tap.m_faces = 0;
+                        tap.m_sum[0] = bx::float4_zero();
+                        tap.m_sum[1] = bx::float4_zero();
+                        tap.m_sum[2] = bx::float4_zero();
+                        tap.m_sum[3] = bx::float4_zero();
+
+                        const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                        const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+                        texelCoordToVec(tap.m_vec, uu, vv, _face, _mipFaceSize);
+
+                        Aabb facesBb[6];
+                        Aabb hitFaceBb;
+                        uint8_t hitFace;
+                        if (onFace && determineHitFaceFilterArea(hitFaceBb, hitFace, tap.m_vec, _filterSize))
+                        {
+                            facesBb[hitFace] = hitFaceBb;
+                        }
+                        else
+                        {
+                            determineFilterArea(facesBb, tap.m_vec, _filterSize);
+                        }
+
+                        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                        {
+                            if (facesBb[face].isEmpty())
+                            {
+                                continue;
+                            }
+
+                            const int32_t minX = int32_t(uint32_t(facesBb[face].m_min[0] * faceSize_MinusOne));
+                            const int32_t maxX = int32_t(uint32_t(facesBb[face].m_max[0] * faceSize_MinusOne));
+                            const int32_t minY = int32_t(uint32_t(facesBb[face].m_min[1] * faceSize_MinusOne));
+                            const int32_t maxY = int32_t(uint32_t(facesBb[face].m_max[1] * faceSize_MinusOne));
+
+                            tap.m_rects[face].init(tap.m_vec, _specularAngle, _normalsSoa, face, minX, maxX, minY, maxY);
+                            tap.m_faces |= uint8_t(1<<face);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Faces and block rows are walked in the order processFilterAreaSoa() accumulates them.
+        const float sinAngle = sqrtf(max(0.0f, 1.0f - _specularAngle*_specularAngle));
+        const uint32_t lastBlockY = (_normalsSoa->m_faceSize - 1 + _normalsSoa->m_border)/CMFT_NORMAL_CONE_BLOCK_SIZE;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint32_t blockY = 0; blockY <= lastBlockY; ++blockY)
+            {
+                for (uint32_t ii = 0; ii < numTaps; ++ii)
+                {
+                    Tap& tap = taps[ii];
+                    const SoaFilterRect& rect = tap.m_rects[face];
+                    if (0 != (tap.m_faces & (1<<face))
+                    &&  rect.m_firstBlockY <= blockY && blockY <= rect.m_lastBlockY)
+                    {
+                        processFilterRectRowSoa<HalfColors>(tap.m_sum, _specularPower, _specularAngle, sinAngle, _lobeTable, tap.m_vec, _normalsSoa, _colorsSoa, rect, blockY);
+                    }
+                }
+            }
+        }
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * (_halfDst ? 2 : 4) /*bytesPerChannel*/;
+        for (uint32_t ii = 0; ii < numTaps; ++ii)
+        {
+            float color[3];
+            processFilterResolveSoa<HalfColors>(color, taps[ii].m_sum, taps[ii].m_vec, _colorsSoa);
+            texelStoreRgb((uint8_t*)_dstPtr + taps[ii].m_texel*bytesPerPixel, color, _halfDst);
+        }
+    }
+#endif // CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+    // Adaptive sampling, see FilterSettings::m_adaptiveTolerance.
+    //-----
+
+    /// Size of top level cells of the sparse grid. Rows of a face are split into tiles of whole cell rows.
+#ifndef CMFT_RADIANCE_ADAPTIVE_CELL
+    #define CMFT_RADIANCE_ADAPTIVE_CELL 8
+#endif //CMFT_RADIANCE_ADAPTIVE_CELL
+
+    /// Smallest lobe radius, in destination texels, of mips that are sampled adaptively.
+#ifndef CMFT_RADIANCE_ADAPTIVE_MIN_LOBE
+    #define CMFT_RADIANCE_ADAPTIVE_MIN_LOBE 4
+#endif //CMFT_RADIANCE_ADAPTIVE_MIN_LOBE
+
+    static inline bool radianceFilterAdaptive(uint32_t _mipFaceSize, float _specularAngle, float _adaptiveTolerance)
+    {
+        // Texels near the face center span about 2/faceSize radians.
+        return 0.0f < _adaptiveTolerance
+            && 2*CMFT_RADIANCE_ADAPTIVE_CELL <= _mipFaceSize
+            && float(CMFT_RADIANCE_ADAPTIVE_MIN_LOBE) <= acosf(_specularAngle)*float(int32_t(_mipFaceSize))*0.5f
+            ;
+    }
+
+    struct RadianceAdaptiveStrip
+    {
+        enum State
+        {
+            Empty,
+            Interpolated,
+            Filtered,
+        };
+
+        float (*m_color)[3];  //!< CMFT_RADIANCE_ADAPTIVE_CELL+1 rows of the face, starting at m_y.
+        uint8_t* m_state;
+        uint32_t m_y;
+        uint8_t m_face;
+        uint32_t m_mipFaceSize;
+        float m_invFaceSize;
+        bool m_guardBand;
+        float m_filterSize;
+        float m_specularPower;
+        float m_specularAngle;
+        float m_adaptiveTolerance;
+        const RadianceLobeTable* m_lobeTable;
+        const float* m_cubemapVectors;
+        const Image* m_imageRgba32f;
+        const uint64_t* m_faceOffsets;
+        const SoaCubemap* m_normalsSoa;
+        const SoaCubemap* m_colorsSoa;
+    };
+
+    static const float* radianceAdaptiveFilter(RadianceAdaptiveStrip& _strip, uint32_t _xx, uint32_t _yy)
+    {
+        const uint32_t idx = (_yy-_strip.m_y)*_strip.m_mipFaceSize + _xx;
+        if (RadianceAdaptiveStrip::Filtered != _strip.m_state[idx])
+        {
+            const float uu = 2.0f*(float(int32_t(_xx))+0.5f)*_strip.m_invFaceSize - 1.0f;
+            const float vv = 2.0f*(float(int32_t(_yy))+0.5f)*_strip.m_invFaceSize - 1.0f;
+
+            float tapVec[3];
+            texelCoordToVec(tapVec, uu, vv, _strip.m_face, _strip.m_mipFaceSize);
+
+            radianceFilterTap(_strip.m_color[idx]
+                            , tapVec
+                            , _strip.m_guardBand
+                            , filterAreaOnFace(_xx, _xx+1, _yy, _yy+1, _strip.m_mipFaceSize, _strip.m_filterSize)
+                            , _strip.m_filterSize
+                            , _strip.m_specularPower
+                            , _strip.m_specularAngle
+                            , _strip.m_lobeTable
+                            , _strip.m_cubemapVectors
+                            , _strip.m_imageRgba32f
+                            , _strip.m_faceOffsets
+                            , _strip.m_normalsSoa
+                            , _strip.m_colorsSoa
+                            );
+            _strip.m_state[idx] = RadianceAdaptiveStrip::Filtered;
+        }
+
+        return _strip.m_color[idx];
+    }
+
+    static inline void radianceAdaptiveLerp(float _rgb[3], const float* _c00, const float* _c10, const float* _c01, const float* _c11, float _fx, float _fy)
+    {
+        for (uint8_t cc = 0; cc < 3; ++cc)
+        {
+            const float top    = _c00[cc] + (_c10[cc]-_c00[cc])*_fx;
+            const float bottom = _c01[cc] + (_c11[cc]-_c01[cc])*_fx;
+            _rgb[cc] = top + (bottom-top)*_fy;
+        }
+    }
+
+    /// Filters texel (_xx, _yy) of a cell and tells whether bilinear interpolation of the cell corners is within tolerance there.
+    static bool radianceAdaptiveTest(RadianceAdaptiveStrip& _strip
+                                   , const float* _c00
+                                   , const float* _c10
+                                   , const float* _c01
+                                   , const float* _c11
+                                   , uint32_t _xx
+                                   , uint32_t _yy
+                                   , float _fx
+                                   , float _fy
+                                   )
+    {
+        float lerp[3];
+        radianceAdaptiveLerp(lerp, _c00, _c10, _c01, _c11, _fx, _fy);
+        const float* color = radianceAdaptiveFilter(_strip, _xx, _yy);
+
+        float maxDiff = 0.0f;
+        float maxValue = 0.0f;
+        for (uint8_t cc = 0; cc < 3; ++cc)
+        {
+            maxDiff  = max(maxDiff, fabsf(color[cc]-lerp[cc]));
+            maxValue = max(maxValue, fabsf(color[cc]));
+        }
+
+        return maxDiff <= _strip.m_adaptiveTolerance*maxValue;
+    }
+
+    /// Cell with inclusive corners [_x0, _x1] x [_y0, _y1], corners are filtered already. Cells are tested at the center and
+    /// edge midpoints, which are shared with neighbouring cells, then either interpolated or split in four.
+    static void radianceAdaptiveCell(RadianceAdaptiveStrip& _strip, uint32_t _x0, uint32_t _y0, uint32_t _x1, uint32_t _y1)
+    {
+        if (_x1-_x0 <= 1
+        &&  _y1-_y0 <= 1)
+        {
+            return;
+        }
+
+        const uint32_t xm = (_x0+_x1)/2;
+        const uint32_t ym = (_y0+_y1)/2;
+        const float invWidth  = (_x1 != _x0) ? 1.0f/float(int32_t(_x1-_x0)) : 0.0f;
+        const float invHeight = (_y1 != _y0) ? 1.0f/float(int32_t(_y1-_y0)) : 0.0f;
+        const float fx = float(int32_t(xm-_x0))*invWidth;
+        const float fy = float(int32_t(ym-_y0))*invHeight;
+
+        const uint32_t stride = _strip.m_mipFaceSize;
+        const float* c00 = _strip.m_color[(_y0-_strip.m_y)*stride + _x0];
+        const float* c10 = _strip.m_color[(_y0-_strip.m_y)*stride + _x1];
+        const float* c01 = _strip.m_color[(_y1-_strip.m_y)*stride + _x0];
+        const float* c11 = _strip.m_color[(_y1-_strip.m_y)*stride + _x1];
+
+        // All five are filtered either way, the cell is split if any of them is off.
+        bool smooth = radianceAdaptiveTest(_strip, c00, c10, c01, c11, xm,  ym,  fx,   fy);
+        smooth &= radianceAdaptiveTest(_strip, c00, c10, c01, c11, xm,  _y0, fx,   0.0f);
+        smooth &= radianceAdaptiveTest(_strip, c00, c10, c01, c11, xm,  _y1, fx,   1.0f);
+        smooth &= radianceAdaptiveTest(_strip, c00, c10, c01, c11, _x0, ym,  0.0f, fy);
+        smooth &= radianceAdaptiveTest(_strip, c00, c10, c01, c11, _x1, ym,  1.0f, fy);
+
+        if (smooth)
+        {
+            for (uint32_t yy = _y0; yy <= _y1; ++yy)
+            {
+                const float fy = float(int32_t(yy-_y0))*invHeight;
+                for (uint32_t xx = _x0; xx <= _x1; ++xx)
+                {
+                    const uint32_t idx = (yy-_strip.m_y)*stride + xx;
+                    if (RadianceAdaptiveStrip::Empty == _strip.m_state[idx])
+                    {
+                        radianceAdaptiveLerp(_strip.m_color[idx], c00, c10, c01, c11, float(int32_t(xx-_x0))*invWidth, fy);
+                        _strip.m_state[idx] = RadianceAdaptiveStrip::Interpolated;
+                    }
+                }
+            }
+
+            return;
+        }
+
+        radianceAdaptiveCell(_strip, _x0, _y0, xm,  ym);
+        radianceAdaptiveCell(_strip, xm,  _y0, _x1, ym);
+        radianceAdaptiveCell(_strip, _x0, ym,  xm,  _y1);
+        radianceAdaptiveCell(_strip, xm,  ym,  _x1, _y1);
+    }
+
+    /// Adaptive variant of radianceFilter(). Faces are processed in strips of one row of cells, each strip writes rows
+    /// [m_y, m_y+CMFT_RADIANCE_ADAPTIVE_CELL) and filters the corners on its bottom edge too. Results do not depend on how rows
+    /// are split into tiles, tiles of whole strips filter each texel at most once.
+    static void radianceFilterAdaptiveRows(RadianceAdaptiveStrip& _strip, void* _dstPtr, bool _halfDst, uint32_t _yBegin, uint32_t _yEnd)
+    {
+        const uint32_t cell = CMFT_RADIANCE_ADAPTIVE_CELL;
+        const uint32_t faceSize = _strip.m_mipFaceSize;
+        const uint32_t last = faceSize-1;
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * (_halfDst ? 2 : 4) /*bytesPerChannel*/;
+
+        for (uint32_t y0 = _yBegin/cell*cell; y0 < _yEnd; y0 += cell)
+        {
+            const uint32_t y1 = min(y0+cell, last);
+            _strip.m_y = y0;
+            memset(_strip.m_state, RadianceAdaptiveStrip::Empty, (y1-y0+1)*faceSize);
+
+            for (uint32_t x0 = 0; x0 < faceSize; x0 += cell)
+            {
+                radianceAdaptiveFilter(_strip, x0, y0);
+                radianceAdaptiveFilter(_strip, x0, y1);
+            }
+            if (0 != last%cell)
+            {
+                radianceAdaptiveFilter(_strip, last, y0);
+                radianceAdaptiveFilter(_strip, last, y1);
+            }
+
+            for (uint32_t x0 = 0; x0 < faceSize; x0 += cell)
+            {
+                radianceAdaptiveCell(_strip, x0, y0, min(x0+cell, last), y1);
+            }
+
+            const uint32_t yEnd = min(_yEnd, (y1 == last) ? faceSize : y1);
+            for (uint32_t yy = max(_yBegin, y0); yy < yEnd; ++yy)
+            {
+                uint8_t* dstPtr = (uint8_t*)_dstPtr + yy*faceSize*bytesPerPixel;
+                const float (*src)[3] = &_strip.m_color[(yy-y0)*faceSize];
+                for (uint32_t xx = 0; xx < faceSize; ++xx, dstPtr += bytesPerPixel)
+                {
+                    texelStoreRgb(dstPtr, src[xx], _halfDst);
+                }
+            }
+        }
+    }
+
+    void radianceFilter(void* _dstPtr
+                      , bool _halfDst
+                      , uint8_t _face
+                      , uint32_t _mipFaceSize
+                      , uint32_t _yBegin
+                      , uint32_t _yEnd
+                      , float _filterSize
+                      , float _specularPower
+                      , float _specularAngle
+                      , const RadianceLobeTable* _lobeTable
+                      , const float* _cubemapVectors
+                      , const Image* _imageRgba32f
+                      , const uint64_t _faceOffsets[CUBE_FACE_NUM]
+                      , const SoaCubemap* _normalsSoa
+                      , const SoaCubemap* _colorsSoa
+                      , float _adaptiveTolerance
+                      , const uint8_t* _mask = NULL
+                      )
+    {
+        const float invFaceSize = 1.0f/float(int32_t(_mipFaceSize));
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        // Narrow filters read a single rectangle out of the guard band. Zero normals in band corners rely on a positive angle.
+        const bool guardBand = _normalsSoa->fitsGuardBand(_filterSize) && 0.0f < _specularAngle;
+#else
+        const bool guardBand = false;
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA && CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE
+        if (!guardBand
+        &&  _mipFaceSize <= CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE)
+        {
+            if (_colorsSoa->isHalf())
+            {
+                radianceFilterScatterSoa<true>(_dstPtr, _halfDst, _face, _mipFaceSize, _yBegin, _yEnd, _filterSize, _specularPower, _specularAngle, _lobeTable, _normalsSoa, _colorsSoa, _mask);
+            }
+            else
+            {
+                radianceFilterScatterSoa<false>(_dstPtr, _halfDst, _face, _mipFaceSize, _yBegin, _yEnd, _filterSize, _specularPower, _specularAngle, _lobeTable, _normalsSoa, _colorsSoa, _mask);
+            }
+
+            return;
+        }
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA && CMFT_RADIANCE_SCATTER_MAX_FACE_SIZE
+
+        if (NULL == _mask
+        &&  radianceFilterAdaptive(_mipFaceSize, _specularAngle, _adaptiveTolerance))
+        {
+            const uint64_t stripTexels = uint64_t(CMFT_RADIANCE_ADAPTIVE_CELL+1)*_mipFaceSize;
+            void* mem = malloc(stripTexels*(3*sizeof(float) + 1));
+            MALLOC_CHECK(mem);
+
+            RadianceAdaptiveStrip strip;
+            strip.m_color = (float (*)[3])mem;
+            strip.m_state = (uint8_t*)mem + stripTexels*3*sizeof(float);
+            strip.m_y = 0;
+            strip.m_face = _face;
+            strip.m_mipFaceSize = _mipFaceSize;
+            strip.m_invFaceSize = invFaceSize;
+            strip.m_guardBand = guardBand;
+            strip.m_filterSize = _filterSize;
+            strip.m_specularPower = _specularPower;
+            strip.m_specularAngle = _specularAngle;
+            strip.m_adaptiveTolerance = _adaptiveTolerance;
+            strip.m_lobeTable = _lobeTable;
+            strip.m_cubemapVectors = _cubemapVectors;
+            strip.m_imageRgba32f = _imageRgba32f;
+            strip.m_faceOffsets = _faceOffsets;
+            strip.m_normalsSoa = _normalsSoa;
+            strip.m_colorsSoa = _colorsSoa;
+            radianceFilterAdaptiveRows(strip, _dstPtr, _halfDst, _yBegin, _yEnd);
+
+            free(mem);
+            return;
+        }
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * (_halfDst ? 2 : 4) /*bytesPerChannel*/;
+        const uint32_t blockSize = (0 != CMFT_RADIANCE_TRAVERSAL_BLOCK) ? CMFT_RADIANCE_TRAVERSAL_BLOCK : _mipFaceSize;
+
+        for (uint32_t blockY = _yBegin; blockY < _yEnd; blockY += blockSize)
+        {
+            const uint32_t blockYEnd = min(_yEnd, blockY+blockSize);
+            for (uint32_t blockX = 0; blockX < _mipFaceSize; blockX += blockSize)
+            {
+                const uint32_t blockXEnd = min(_mipFaceSize, blockX+blockSize);
+
+                // Filter area is classified once per block. Blocks away from face edges skip the neighbour face bleed logic,
+                // each texel still checks its own area and falls back to determineFilterArea() if it is not on its face.
+                const bool onFace = filterAreaOnFace(blockX, blockXEnd, blockY, blockYEnd, _mipFaceSize, _filterSize);
+
+                for (uint32_t yy = blockY; yy < blockYEnd; ++yy)
+                {
+                    for (uint32_t xx = blockX; xx < blockXEnd; ++xx)
+                    {
+                        if (NULL != _mask
+                        &&  0 == _mask[yy*_mipFaceSize + xx])
+                        {
+                            continue;
+                        }
+
+                        uint8_t* dstPtr = (uint8_t*)_dstPtr + (yy*_mipFaceSize + xx)*bytesPerPixel;
+
+                        // From [0..size-1] to [-1.0+invSize .. 1.0-invSize].
+                        const float xxf = float(int32_t(xx));
+                        const float yyf = float(int32_t(yy));
+                        const float uu = 2.0f*(xxf+0.5f)*invFaceSize - 1.0f;
+                        const float vv = 2.0f*(yyf+0.5f)*invFaceSize - 1.0f;
+
+                        float tapVec[3];
+                        texelCoordToVec(tapVec, uu, vv, _face, _mipFaceSize);
+
+                        float color[3];
+                        radianceFilterTap(color
+                                        , tapVec
+                                        , guardBand
+                                        , onFace
+                                        , _filterSize
+                                        , _specularPower
+                                        , _specularAngle
+                                        , _lobeTable
+                                        , _cubemapVectors
+                                        , _imageRgba32f
+                                        , _faceOffsets
+                                        , _normalsSoa
+                                        , _colorsSoa
+                                        );
+
+                        texelStoreRgb(dstPtr, color, _halfDst);
+                    }
+                }
+            }
+        }
+    }
+
+    /// Per-invocation statistics, shared between the processing threads of a single imageRadianceFilter() call.
+    struct RadianceFilterStats
+    {
+        RadianceFilterStats()
+            : m_startTime(0)
+            , m_completedTasksGpu(0)
+            , m_completedTasksCpu(0)
+            , m_texelsCpu(0)
+        {
+            for (uint8_t ii = 0; ii < CMFT_CL_MAX_CONTEXTS; ++ii)
+            {
+                m_deviceTasks[ii] = 0;
+                m_deviceTexels[ii] = 0;
+            }
+        }
+
+        void incrCompletedTasksGpu(uint8_t _deviceIdx)
+        {
+            bx::MutexScope lock(m_mutex);
+            m_completedTasksGpu++;
+            m_deviceTasks[_deviceIdx]++;
+        }
+
+        void incrCompletedTasksCpu()
+        {
+            bx::MutexScope lock(m_mutex);
+            m_completedTasksCpu++;
+        }
+
+        void addTexelsCpu(uint64_t _numTexels)
+        {
+            bx::MutexScope lock(m_mutex);
+            m_texelsCpu += _numTexels;
+        }
+
+        void addTexelsGpu(uint8_t _deviceIdx, uint64_t _numTexels)
+        {
+            bx::MutexScope lock(m_mutex);
+            m_deviceTexels[_deviceIdx] += _numTexels;
+        }
+
+        uint64_t m_startTime;
+        uint16_t m_completedTasksGpu;
+        uint16_t m_completedTasksCpu;
+        uint64_t m_texelsCpu;
+        uint32_t m_deviceTasks[CMFT_CL_MAX_CONTEXTS];
+        uint64_t m_deviceTexels[CMFT_CL_MAX_CONTEXTS];
+        bx::Mutex m_mutex;
+    };
+
+    struct RadianceFilterParams
+    {
+        void* m_dstPtr;
+        bool m_halfDst;
+        uint8_t m_face;
+        uint32_t m_mipFaceSize;
+        float m_filterSize;
+        float m_specularPower;
+        float m_specularAngle;
+        const RadianceLobeTable* m_lobeTable;
+        const float* m_cubemapVectors;
+        const Image* m_imageRgba32f;
+        const uint64_t* m_faceOffsets;
+        const SoaCubemap* m_normalsSoa;
+        const SoaCubemap* m_colorsSoa;
+        float m_adaptiveTolerance;
+        void* m_encodedDstPtr; //!< Destination for face packed on the GPU, NULL if the face is not packed.
+        bool* m_encoded;       //!< Set when packed face was written to m_encodedDstPtr instead of m_dstPtr.
+        uint32_t m_cubemap;    //!< Cubemap of a batch, for face callbacks.
+        uint8_t m_mip;
+    };
+
+    /// Row band of a single cube face. Smallest unit of work processed by CPU threads.
+    struct RadianceFilterTile
+    {
+        const RadianceFilterParams* m_params;
+        uint32_t m_yBegin;
+        uint32_t m_yEnd;
+        uint32_t m_taskIdx;
+    };
+
+    #define CMFT_RADIANCE_MAX_TILES_PER_FACE 32
+
+    /// Rows of CPU tiles of a face. Adaptively sampled faces are split into whole strips of cells.
+    static inline uint32_t radianceFilterTileRows(const RadianceFilterParams& _params)
+    {
+        const uint32_t faceSize = _params.m_mipFaceSize;
+        const uint32_t tileRows = (faceSize + CMFT_RADIANCE_MAX_TILES_PER_FACE-1)/CMFT_RADIANCE_MAX_TILES_PER_FACE;
+        return radianceFilterAdaptive(faceSize, _params.m_specularAngle, _params.m_adaptiveTolerance)
+             ? align(tileRows, uint32_t(CMFT_RADIANCE_ADAPTIVE_CELL))
+             : tileRows
+             ;
+    }
+
+    /// Per thread tile deque. Owner thread pops tiles from the back, other threads steal them from the front.
+    struct RadianceFilterTileDeque
+    {
+        RadianceFilterTileDeque()
+            : m_begin(0)
+            , m_end(0)
+        {
+        }
+
+        // Splits face rows from _yBegin on into row tiles. Deque has to be empty.
+        void fill(const RadianceFilterParams* _params, uint32_t _taskIdx, uint16_t _numTiles, uint32_t _tileRows, uint32_t _yBegin = 0)
+        {
+            bx::MutexScope lock(m_mutex);
+            DEBUG_CHECK(m_begin == m_end, "Deque has to be empty!");
+
+            const uint32_t faceSize = _params->m_mipFaceSize;
+            for (uint16_t ii = 0; ii < _numTiles; ++ii)
+            {
+                RadianceFilterTile& tile = m_tiles[ii];
+                tile.m_params  = _params;
+                tile.m_yBegin  = _yBegin + uint32_t(ii)*_tileRows;
+                tile.m_yEnd    = min(faceSize, tile.m_yBegin+_tileRows);
+                tile.m_taskIdx = _taskIdx;
+            }
+            m_begin = 0;
+            m_end = _numTiles;
+        }
+
+        bool isEmpty()
+        {
+            bx::MutexScope lock(m_mutex);
+            return (m_begin == m_end);
+        }
+
+        bool popBack(RadianceFilterTile& _tile)
+        {
+            bx::MutexScope lock(m_mutex);
+            if (m_begin == m_end)
+            {
+                return false;
+            }
+
+            _tile = m_tiles[--m_end];
+            return true;
+        }
+
+        bool stealFront(RadianceFilterTile& _tile)
+        {
+            bx::MutexScope lock(m_mutex);
+            if (m_begin == m_end)
+            {
+                return false;
+            }
+
+            _tile = m_tiles[m_begin++];
+            return true;
+        }
+
+        // Returns front tile without taking it and the number of tiles in the deque.
+        bool peekFront(RadianceFilterTile& _tile, uint16_t& _numTiles)
+        {
+            bx::MutexScope lock(m_mutex);
+            if (m_begin == m_end)
+            {
+                return false;
+            }
+
+            _tile = m_tiles[m_begin];
+            _numTiles = uint16_t(m_end - m_begin);
+            return true;
+        }
+
+        // Takes front tile only if it is still _tile returned by peekFront().
+        bool stealFrontIf(const RadianceFilterTile& _tile)
+        {
+            bx::MutexScope lock(m_mutex);
+            if (m_begin == m_end
+            ||  m_tiles[m_begin].m_params != _tile.m_params
+            ||  m_tiles[m_begin].m_yBegin != _tile.m_yBegin)
+            {
+                return false;
+            }
+
+            m_begin++;
+            return true;
+        }
+
+        bx::Mutex m_mutex;
+        uint16_t m_begin;
+        uint16_t m_end;
+        RadianceFilterTile m_tiles[CMFT_RADIANCE_MAX_TILES_PER_FACE];
+    };
+
+    /// Progress of a single cube face while it is being processed as row tiles.
+    struct RadianceFilterTaskProgress
+    {
+        uint64_t m_startTime;
+        uint16_t m_tilesLeft;
+    };
+
+    /// Measured throughput of a single OpenCL device.
+    struct RadianceFilterDeviceLoad
+    {
+        double m_cost;      //!< Cost of all completed faces.
+        double m_time;      //!< Time spent on completed faces, in seconds.
+        double m_busyUntil; //!< Expected end of queued faces, in seconds.
+        uint32_t m_maxSrcFaceSize; //!< Faces with larger source or destination are left to CPU threads.
+        uint32_t m_maxDstFaceSize;
+        bool m_active;
+    };
+
+    /// Estimated relative cost of filtering a cube face: destination texels times source texels under the filter.
+    static inline double radianceFilterTaskCost(const RadianceFilterParams& _params)
+    {
+        const double faceSize = double(_params.m_mipFaceSize);
+        const double filterTexels = max(1.0, double(_params.m_filterSize)*double(_params.m_imageRgba32f->m_width));
+        return faceSize*faceSize*filterTexels*filterTexels;
+    }
+
+    /// Passes a face with final texels to the face callback of _progress, viewed as a single face image.
+    static inline void radianceFilterReportFace(FilterProgress* _progress
+                                              , uint32_t _cubemap
+                                              , uint8_t _mip
+                                              , uint8_t _face
+                                              , void* _data
+                                              , uint32_t _faceSize
+                                              , TextureFormat::Enum _format
+                                              )
+    {
+        if (NULL != _progress
+        &&  NULL != _progress->m_faceCallback)
+        {
+            Image image;
+            image.m_width = _faceSize;
+            image.m_height = _faceSize;
+            image.m_format = _format;
+            image.m_numMips = 1;
+            image.m_numFaces = 1;
+            image.m_data = _data;
+
+            ImageLayout layout;
+            imageGetLayout(layout, image);
+            image.m_dataSize = layout.m_dataSize;
+
+            _progress->m_faceCallback(_cubemap, _mip, _face, image, _progress->m_userData);
+        }
+    }
+
+    /// Seconds between updates of the active CPU thread count with adaptive concurrency.
+#ifndef CMFT_RADIANCE_CONCURRENCY_INTERVAL
+    #define CMFT_RADIANCE_CONCURRENCY_INTERVAL 0.25
+#endif //CMFT_RADIANCE_CONCURRENCY_INTERVAL
+
+    /// Updates without raising the active CPU thread count after a raise that did not pay off.
+#ifndef CMFT_RADIANCE_CONCURRENCY_HOLD
+    #define CMFT_RADIANCE_CONCURRENCY_HOLD 8
+#endif //CMFT_RADIANCE_CONCURRENCY_HOLD
+
+    /// Flat list of cube face tasks. Tasks of a single cubemap are ordered from the top level mip map to the bottom,
+    /// batches simply append one cubemap after another.
+    /// CPU threads and OpenCL devices measure their throughput as they go. Towards the end of the list, faces taken by a device
+    /// are split, the device keeps the top rows proportional to its share of the total throughput and CPU threads get the rest as tiles.
+    struct RadianceFilterTaskList
+    {
+        RadianceFilterTaskList(const RadianceFilterParams* _params
+                             , uint32_t _numTasks
+                             , uint16_t _numCpuThreads
+                             , uint8_t _numDevices
+                             , FilterProgress* _progress
+                             , uint16_t _concurrencyMin
+                             , uint16_t _concurrencyMax
+                             )
+            : m_params(_params)
+            , m_top(0)
+            , m_bottom(_numTasks)
+            , m_remainingCost(0.0)
+            , m_numCpuThreads(max(uint16_t(1), _numCpuThreads))
+            , m_hasCpuThreads(0 != _numCpuThreads)
+            , m_numDevices(_numDevices)
+            , m_cpuCost(0.0)
+            , m_cpuStartTime(0)
+            , m_filterProgress(_progress)
+            , m_encodeFormat(TextureFormat::Unknown)
+            , m_costBefore(0.0)
+            , m_totalCost(0.0)
+            , m_completedCost(0.0)
+            , m_startTime(bx::getHPCounter())
+        {
+            // Adaptive concurrency, bounds are clamped to the threads started.
+            m_maxActive = (0 != _concurrencyMax && 0 != _numCpuThreads) ? min(_concurrencyMax, m_numCpuThreads) : 0;
+            m_minActive = min(_concurrencyMin, m_maxActive);
+            m_numActive = (0 != m_maxActive) ? m_maxActive : m_numCpuThreads;
+            m_concurrencyTime = m_startTime;
+            m_concurrencyCost = 0.0;
+            m_concurrencyThroughput = 0.0;
+            m_concurrencyRaised = 0;
+            m_concurrencyHold = 0;
+            m_otherRunnable = 0.0f;
+
+            const uint32_t progressSize = max(UINT32_C(1), _numTasks)*sizeof(RadianceFilterTaskProgress);
+            m_progress = (RadianceFilterTaskProgress*)malloc(progressSize);
+            MALLOC_CHECK(m_progress);
+            memset(m_progress, 0, progressSize);
+
+            memset(m_devices, 0, sizeof(m_devices));
+            for (uint8_t ii = 0; ii < _numDevices; ++ii)
+            {
+                m_devices[ii].m_maxSrcFaceSize = UINT32_MAX;
+                m_devices[ii].m_maxDstFaceSize = UINT32_MAX;
+                m_devices[ii].m_active = true;
+            }
+
+            for (uint32_t ii = 0; ii < _numTasks; ++ii)
+            {
+                m_remainingCost += radianceFilterTaskCost(_params[ii]);
+            }
+            m_totalCost = m_remainingCost;
+        }
+
+        // Progress of this list is reported as part of a bigger job, with _costBefore already done out of _costTotal since _startTime.
+        void setProgressRange(double _costBefore, double _costTotal, uint64_t _startTime)
+        {
+            m_costBefore = _costBefore;
+            m_totalCost = _costTotal;
+            m_startTime = _startTime;
+        }
+
+        // Sets face sizes OpenCL device _deviceIdx can hold, see RadianceProgram::maxSourceFaceSize().
+        void setDeviceLimits(uint8_t _deviceIdx, uint32_t _maxSrcFaceSize, uint32_t _maxDstFaceSize)
+        {
+            m_devices[_deviceIdx].m_maxSrcFaceSize = _maxSrcFaceSize;
+            m_devices[_deviceIdx].m_maxDstFaceSize = _maxDstFaceSize;
+        }
+
+        ~RadianceFilterTaskList()
+        {
+            free(m_progress);
+        }
+
+        // Returns next cube face task from the top of the list.
+        const RadianceFilterParams* getFromTop()
+        {
+            bx::MutexScope lock(m_indexMutex);
+            return (m_top < m_bottom) ? take(m_top++) : NULL;
+        }
+
+        // Returns next cube face task from the bottom of the list.
+        const RadianceFilterParams* getFromBottom()
+        {
+            bx::MutexScope lock(m_indexMutex);
+            return (m_top < m_bottom) ? take(--m_bottom) : NULL;
+        }
+
+        // Returns next cube face task for OpenCL device _deviceIdx, NULL when the device should stop.
+        // Devices take faces from the top of the list. Once throughputs are measured, a device that would finish the top face
+        // later than a faster device could after its current face, takes the smallest face from the bottom instead.
+        // Device processes rows [_yBegin, _yEnd) of the face. Whole faces start at row 0, if _yEnd is less than the face size,
+        // remaining rows went to CPU threads. Once the list is empty, a device with _rowOffsets takes row tiles of faces of
+        // _srcImage from CPU threads, see stealForDevice().
+        const RadianceFilterParams* getForDevice(uint8_t _deviceIdx, const Image* _srcImage, bool _rowOffsets, uint32_t& _yBegin, uint32_t& _yEnd)
+        {
+            bx::MutexScope lock(m_indexMutex);
+
+            RadianceFilterDeviceLoad& own = m_devices[_deviceIdx];
+            const double now = double(bx::getHPCounter())/double(bx::getHPFrequency());
+            if (m_top >= m_bottom)
+            {
+                const RadianceFilterParams* tile = _rowOffsets ? stealForDevice(own, _srcImage, now, _yBegin, _yEnd) : NULL;
+                own.m_active = (NULL != tile);
+                return tile;
+            }
+
+            const RadianceFilterParams* top = &m_params[m_top];
+
+            // Faces too big for the device are the most expensive ones at the top, the device keeps to the bottom instead.
+            const bool topFits = fitsDevice(*top, own);
+            if (!topFits
+            &&  !fitsDevice(m_params[m_bottom-1], own))
+            {
+                own.m_active = false;
+                return NULL;
+            }
+
+            bool fasterDeviceAvailable = !topFits;
+            if (0.0 != own.m_time && topFits)
+            {
+                const double cost = radianceFilterTaskCost(*top);
+                const double ownFinish = max(now, own.m_busyUntil) + cost*own.m_time/own.m_cost;
+                for (uint8_t ii = 0; ii < m_numDevices; ++ii)
+                {
+                    const RadianceFilterDeviceLoad& other = m_devices[ii];
+                    if (ii != _deviceIdx
+                    &&  other.m_active
+                    &&  0.0 != other.m_time
+                    &&  max(now, other.m_busyUntil) + cost*other.m_time/other.m_cost < ownFinish)
+                    {
+                        fasterDeviceAvailable = true;
+                        break;
+                    }
+                }
+            }
+
+            const RadianceFilterParams* params;
+            if (!fasterDeviceAvailable)
+            {
+                params = take(m_top++);
+            }
+            else if (m_bottom - m_top > 1 || !topFits)
+            {
+                params = take(--m_bottom);
+            }
+            else
+            {
+                // Last face is better left to the faster device.
+                own.m_active = false;
+                return NULL;
+            }
+
+            const double cost = radianceFilterTaskCost(*params);
+            _yBegin = 0;
+            _yEnd = splitForDevice(params, own, cost + m_remainingCost, now);
+
+            // Device can have several faces queued.
+            own.m_busyUntil = (0.0 != own.m_time)
+                            ? max(now, own.m_busyUntil) + cost*double(_yEnd)/double(params->m_mipFaceSize)*own.m_time/own.m_cost
+                            : 0.0
+                            ;
+
+            return params;
+        }
+
+        // Source face size of the top face of the list if OpenCL device _deviceIdx can filter it in a batch with faces no bigger
+        // than _maxFaceSize, 0 otherwise. See getBatchForDevice().
+        uint32_t topBatchCellSize(uint8_t _deviceIdx, uint32_t _maxFaceSize)
+        {
+            bx::MutexScope lock(m_indexMutex);
+            return (m_top < m_bottom && isBatchable(m_params[m_top], m_devices[_deviceIdx], _maxFaceSize))
+                 ? m_params[m_top].m_imageRgba32f->m_width
+                 : 0
+                 ;
+        }
+
+        // Takes consecutive faces from the top of the list for a single batched dispatch of OpenCL device _deviceIdx.
+        // Faces are taken while their source and destination are no bigger than _cellSize, sources change at most _maxSources
+        // times, destinations have at most _maxTexels texels together and their cost stays within _maxCost. First face is always
+        // taken if it fits. Returns number of faces written to _tasks.
+        uint32_t getBatchForDevice(uint8_t _deviceIdx
+                                 , const RadianceFilterParams** _tasks
+                                 , uint32_t _maxTasks
+                                 , uint32_t _cellSize
+                                 , uint32_t _maxSources
+                                 , uint64_t _maxTexels
+                                 , double _maxCost
+                                 )
+        {
+            bx::MutexScope lock(m_indexMutex);
+
+            RadianceFilterDeviceLoad& own = m_devices[_deviceIdx];
+
+            uint32_t numTasks = 0;
+            uint32_t numSources = 0;
+            uint64_t numTexels = 0;
+            double cost = 0.0;
+            const Image* source = NULL;
+            while (m_top < m_bottom && numTasks < _maxTasks)
+            {
+                const RadianceFilterParams& params = m_params[m_top];
+                if (!isBatchable(params, own, _cellSize))
+                {
+                    break;
+                }
+
+                const uint32_t sourceChange = (params.m_imageRgba32f != source);
+                const uint64_t texels = uint64_t(params.m_mipFaceSize)*params.m_mipFaceSize;
+                const double taskCost = radianceFilterTaskCost(params);
+                if (0 != numTasks
+                && (numSources + sourceChange > _maxSources
+                ||  numTexels + texels > _maxTexels
+                ||  cost + taskCost > _maxCost))
+                {
+                    break;
+                }
+
+                _tasks[numTasks++] = take(m_top++);
+                numSources += sourceChange;
+                numTexels += texels;
+                cost += taskCost;
+                source = params.m_imageRgba32f;
+            }
+
+            own.m_busyUntil = 0.0;
+
+            return numTasks;
+        }
+
+        // Measured throughput of OpenCL device _deviceIdx in radianceFilterTaskCost() units per second, 0 before its first task is done.
+        double deviceThroughput(uint8_t _deviceIdx)
+        {
+            bx::MutexScope lock(m_indexMutex);
+
+            const RadianceFilterDeviceLoad& own = m_devices[_deviceIdx];
+            return (0.0 != own.m_time) ? own.m_cost/own.m_time : 0.0;
+        }
+
+        // Updates throughput of OpenCL device _deviceIdx with _rows completed rows of a face.
+        // Returns true if the face is done. Split faces are done once CPU threads finish their tiles too.
+        bool deviceTaskDone(uint8_t _deviceIdx, const RadianceFilterParams& _params, uint32_t _rows, double _duration)
+        {
+            const double cost = radianceFilterTaskCost(_params)*double(_rows)/double(_params.m_mipFaceSize);
+            {
+                bx::MutexScope lock(m_indexMutex);
+
+                RadianceFilterDeviceLoad& own = m_devices[_deviceIdx];
+                own.m_cost += cost;
+                own.m_time += max(_duration, 1e-9);
+            }
+
+            bx::MutexScope lock(m_progressMutex);
+            m_completedCost += cost;
+
+            return (_rows == _params.m_mipFaceSize)
+                || (0 == --m_progress[&_params - m_params].m_tilesLeft)
+                ;
+        }
+
+        // Returns next row tile for CPU thread _threadIdx.
+        // Order: own deque, then rows left over by devices, then a new face from the top of the task list, then steal from other threads.
+        bool getTile(RadianceFilterTile& _tile, uint16_t _threadIdx)
+        {
+            RadianceFilterTileDeque& own = m_deques[_threadIdx];
+
+            {
+                bx::MutexScope lock(m_progressMutex);
+                if (0 == m_cpuStartTime)
+                {
+                    m_cpuStartTime = bx::getHPCounter();
+                }
+            }
+
+            for (;;)
+            {
+                if (own.popBack(_tile)
+                ||  m_spill.stealFront(_tile))
+                {
+                    return true;
+                }
+
+                const RadianceFilterParams* params = getFromTop();
+                if (NULL == params)
+                {
+                    break;
+                }
+
+                // Split face into row tiles.
+                const uint32_t faceSize = params->m_mipFaceSize;
+                const uint32_t tileRows = radianceFilterTileRows(*params);
+                const uint16_t numTiles = uint16_t((faceSize + tileRows-1)/tileRows);
+                const uint32_t taskIdx = uint32_t(params - m_params);
+                {
+                    bx::MutexScope lock(m_progressMutex);
+                    m_progress[taskIdx].m_tilesLeft = numTiles;
+                    m_progress[taskIdx].m_startTime = bx::getHPCounter();
+                }
+                own.fill(params, taskIdx, numTiles, tileRows);
+            }
+
+            // Nothing left in the task list, steal from others.
+            for (uint16_t ii = 1; ii < m_numCpuThreads; ++ii)
+            {
+                const uint16_t victim = uint16_t((_threadIdx + ii) % m_numCpuThreads);
+                if (m_deques[victim].stealFront(_tile))
+                {
+                    return true;
+                }
+            }
+
+            return m_spill.stealFront(_tile);
+        }
+
+        // Returns true if _tile was the last unfinished tile of its face.
+        bool tileDone(const RadianceFilterTile& _tile, uint64_t& _faceStartTime)
+        {
+            const RadianceFilterParams& params = *_tile.m_params;
+            const double cost = radianceFilterTaskCost(params)*double(_tile.m_yEnd-_tile.m_yBegin)/double(params.m_mipFaceSize);
+
+            bx::MutexScope lock(m_progressMutex);
+            m_cpuCost += cost;
+            m_completedCost += cost;
+
+            RadianceFilterTaskProgress& progress = m_progress[_tile.m_taskIdx];
+            _faceStartTime = progress.m_startTime;
+            return (0 == --progress.m_tilesLeft);
+        }
+
+        // Load-adaptive concurrency, see FilterSettings::m_maxCpuThreads. Called by CPU thread _threadIdx between tiles.
+        // Returns false for threads at or above the active count, they end their task and their queued tiles are stolen by the
+        // others. Tasks never wait for each other, job systems may run them in any order or one after another. Threads that
+        // ended can't be brought back, raises stop at the lowest of them.
+        bool keepActive(uint16_t _threadIdx)
+        {
+            if (0 == m_maxActive)
+            {
+                return true;
+            }
+
+            updateConcurrency();
+
+            bx::MutexScope lock(m_concurrencyMutex);
+            if (_threadIdx < m_numActive)
+            {
+                return true;
+            }
+
+            m_maxActive = min(m_maxActive, _threadIdx);
+            return false;
+        }
+
+        // Moves the active thread count towards CPUs not taken by other processes, once per CMFT_RADIANCE_CONCURRENCY_INTERVAL.
+        void updateConcurrency()
+        {
+            const uint64_t now = bx::getHPCounter();
+            const double freq = double(bx::getHPFrequency());
+
+            bx::MutexScope lock(m_concurrencyMutex);
+
+            const double elapsed = double(now - m_concurrencyTime)/freq;
+            if (elapsed < CMFT_RADIANCE_CONCURRENCY_INTERVAL)
+            {
+                return;
+            }
+
+            double cpuCost;
+            {
+                bx::MutexScope progressLock(m_progressMutex);
+                cpuCost = m_cpuCost;
+            }
+            const double throughput = (cpuCost - m_concurrencyCost)/elapsed;
+            m_concurrencyTime = now;
+            m_concurrencyCost = cpuCost;
+
+            // Run queue holds active threads of this filter too, a single sample is noisy and is smoothed over intervals.
+            const uint32_t runnable = getNumRunnableThreads();
+            if (0 != runnable)
+            {
+                const float other = float(max(0, int32_t(runnable) - int32_t(m_numActive)));
+                m_otherRunnable = m_otherRunnable*0.5f + other*0.5f;
+            }
+
+            const uint16_t numActive = m_numActive;
+            const int32_t available = int32_t(getNumHardwareThreads()) - int32_t(m_otherRunnable + 0.5f);
+            uint16_t target = uint16_t(clamp(available, int32_t(m_minActive), int32_t(m_maxActive)));
+
+            // Threads added last interval have to bring in at least half of the per thread throughput they joined, otherwise
+            // cores are taken by others more than the run queue tells. They are taken back and raises wait for a while.
+            if (0 != m_concurrencyRaised
+            &&  0.0 != m_concurrencyThroughput)
+            {
+                const uint16_t before = uint16_t(numActive - m_concurrencyRaised);
+                const double expected = m_concurrencyThroughput*(1.0 + 0.5*double(m_concurrencyRaised)/double(before));
+                if (throughput < expected)
+                {
+                    target = before;
+                    m_concurrencyHold = CMFT_RADIANCE_CONCURRENCY_HOLD;
+                }
+            }
+            else if (0 != m_concurrencyHold)
+            {
+                m_concurrencyHold--;
+                target = min(target, numActive);
+            }
+
+            m_concurrencyRaised = (target > numActive) ? uint16_t(target - numActive) : 0;
+            m_concurrencyThroughput = throughput;
+            m_numActive = target;
+
+            if (target != numActive)
+            {
+                INFO("Radiance -> %u of %u CPU threads active, %.1f threads of other processes runnable."
+                    , target
+                    , m_numCpuThreads
+                    , m_otherRunnable
+                    );
+            }
+        }
+
+        // Filter was cancelled through FilterProgress, workers stop picking up tiles.
+        bool isCancelled() const
+        {
+            return NULL != m_filterProgress && m_filterProgress->m_cancel;
+        }
+
+        // Passes fraction of completed cost and remaining time extrapolated from it to the progress callback.
+        void reportProgress()
+        {
+            if (NULL == m_filterProgress
+            ||  NULL == m_filterProgress->m_callback)
+            {
+                return;
+            }
+
+            bx::MutexScope callbackLock(m_callbackMutex);
+
+            double completedCost;
+            {
+                bx::MutexScope lock(m_progressMutex);
+                completedCost = m_costBefore + m_completedCost;
+            }
+
+            const double fraction = (m_totalCost > 0.0) ? min(1.0, completedCost/m_totalCost) : 1.0;
+            const double elapsed = double(bx::getHPCounter() - m_startTime)/double(bx::getHPFrequency());
+            const double remaining = (fraction > 0.0) ? elapsed*(1.0-fraction)/fraction : 0.0;
+
+            m_filterProgress->m_callback(float(fraction), remaining, m_filterProgress->m_userData);
+        }
+
+        // Passes finished face to the face callback, from the thread that finished it.
+        // 1x1 faces are averaged on the host afterwards and reported there.
+        void reportFace(const RadianceFilterParams& _params)
+        {
+            if (NULL == m_filterProgress
+            ||  NULL == m_filterProgress->m_faceCallback
+            ||  1 == _params.m_mipFaceSize)
+            {
+                return;
+            }
+
+            bx::MutexScope callbackLock(m_callbackMutex);
+
+            const bool encoded = *_params.m_encoded;
+            const TextureFormat::Enum format = encoded ? m_encodeFormat : (_params.m_halfDst ? TextureFormat::RGBA16F : TextureFormat::RGBA32F);
+            radianceFilterReportFace(m_filterProgress
+                                   , _params.m_cubemap
+                                   , _params.m_mip
+                                   , _params.m_face
+                                   , encoded ? _params.m_encodedDstPtr : _params.m_dstPtr
+                                   , _params.m_mipFaceSize
+                                   , format
+                                   );
+        }
+
+        // Mutex has to be locked.
+        static bool fitsDevice(const RadianceFilterParams& _params, const RadianceFilterDeviceLoad& _device)
+        {
+            return _params.m_imageRgba32f->m_width <= _device.m_maxSrcFaceSize
+                && _params.m_mipFaceSize           <= _device.m_maxDstFaceSize
+                ;
+        }
+
+        // Mutex has to be locked.
+        static bool isBatchable(const RadianceFilterParams& _params, const RadianceFilterDeviceLoad& _device, uint32_t _maxFaceSize)
+        {
+            return _params.m_imageRgba32f->m_width <= _maxFaceSize
+                && _params.m_mipFaceSize           <= _maxFaceSize
+                && fitsDevice(_params, _device)
+                ;
+        }
+
+        const RadianceFilterParams* take(uint32_t _idx)
+        {
+            m_remainingCost = max(0.0, m_remainingCost - radianceFilterTaskCost(m_params[_idx]));
+            return &m_params[_idx];
+        }
+
+        // Takes front row tile of a CPU thread deque or rows left over by devices, if device _own would finish the tile before
+        // the CPU threads get to it. Owner threads pop tiles from the back, so the front tile is the last one the owner filters.
+        // Only tiles of faces of _src are taken, so the device doesn't upload another source for them.
+        // Index mutex has to be locked.
+        const RadianceFilterParams* stealForDevice(RadianceFilterDeviceLoad& _own, const Image* _src, double _now, uint32_t& _yBegin, uint32_t& _yEnd)
+        {
+            if (!m_hasCpuThreads || 0.0 == _own.m_time || NULL == _src)
+            {
+                return NULL;
+            }
+
+            double cpuThroughput = 0.0;
+            {
+                bx::MutexScope lock(m_progressMutex);
+                const double cpuTime = (0 != m_cpuStartTime)
+                                     ? _now - double(m_cpuStartTime)/double(bx::getHPFrequency())
+                                     : 0.0
+                                     ;
+                cpuThroughput = (cpuTime > 0.0) ? m_cpuCost/cpuTime : 0.0;
+            }
+
+            if (0.0 == cpuThroughput)
+            {
+                return NULL;
+            }
+
+            const double threadThroughput = cpuThroughput/double(m_numCpuThreads);
+            const double ownThroughput = _own.m_cost/_own.m_time;
+            const double ownStart = max(_now, _own.m_busyUntil);
+            for (uint16_t ii = 0; ii <= m_numCpuThreads; ++ii)
+            {
+                // Leftover rows are shared by all threads, thread deques by their owners.
+                const bool spill = (ii == m_numCpuThreads);
+                RadianceFilterTileDeque& deque = spill ? m_spill : m_deques[ii];
+
+                RadianceFilterTile tile;
+                uint16_t numTiles;
+                if (!deque.peekFront(tile, numTiles)
+                ||  tile.m_params->m_imageRgba32f != _src
+                ||  !fitsDevice(*tile.m_params, _own))
+                {
+                    continue;
+                }
+
+                const RadianceFilterParams& params = *tile.m_params;
+                const double tileCost = radianceFilterTaskCost(params)*double(tile.m_yEnd-tile.m_yBegin)/double(params.m_mipFaceSize);
+                const double cpuFinish = _now + double(numTiles)*tileCost/(spill ? cpuThroughput : threadThroughput);
+                const double ownFinish = ownStart + tileCost/ownThroughput;
+                if (ownFinish < cpuFinish
+                &&  deque.stealFrontIf(tile))
+                {
+                    _own.m_busyUntil = ownFinish;
+                    _yBegin = tile.m_yBegin;
+                    _yEnd = tile.m_yEnd;
+                    return tile.m_params;
+                }
+            }
+
+            return NULL;
+        }
+
+        // Returns number of top rows of the face the device should process, rest is handed to CPU threads as tiles.
+        // Split only happens when the device alone would finish the face later than all processors together finish all remaining work.
+        // Index mutex has to be locked.
+        uint32_t splitForDevice(const RadianceFilterParams* _params, const RadianceFilterDeviceLoad& _own, double _remainingCost, double _now)
+        {
+            const uint32_t faceSize = _params->m_mipFaceSize;
+            if (!m_hasCpuThreads || 0.0 == _own.m_time || faceSize < 2)
+            {
+                return faceSize;
+            }
+
+            double cpuThroughput = 0.0;
+            {
+                bx::MutexScope lock(m_progressMutex);
+                const double cpuTime = (0 != m_cpuStartTime)
+                                     ? _now - double(m_cpuStartTime)/double(bx::getHPFrequency())
+                                     : 0.0
+                                     ;
+                cpuThroughput = (cpuTime > 0.0) ? m_cpuCost/cpuTime : 0.0;
+            }
+
+            if (0.0 == cpuThroughput)
+            {
+                return faceSize;
+            }
+
+            double totalThroughput = cpuThroughput;
+            for (uint8_t ii = 0; ii < m_numDevices; ++ii)
+            {
+                const RadianceFilterDeviceLoad& device = m_devices[ii];
+                if (device.m_active && 0.0 != device.m_time)
+                {
+                    totalThroughput += device.m_cost/device.m_time;
+                }
+            }
+
+            const double ownThroughput = _own.m_cost/_own.m_time;
+            const double ownStart = max(_now, _own.m_busyUntil);
+            const double allDone = _now + _remainingCost/totalThroughput;
+            const double faceCost = radianceFilterTaskCost(*_params);
+            if (ownStart + faceCost/ownThroughput <= allDone)
+            {
+                return faceSize;
+            }
+
+            // Split in CPU tile granularity. Leftover rows are only handed over if no other split is pending.
+            const uint32_t tileRows = radianceFilterTileRows(*_params);
+            const double fraction = max(0.0, allDone - ownStart)*ownThroughput/faceCost;
+            const uint32_t rows = min(faceSize, max(tileRows, uint32_t(fraction*double(faceSize))/tileRows*tileRows));
+            if (rows == faceSize || !m_spill.isEmpty())
+            {
+                return faceSize;
+            }
+
+            const uint16_t numTiles = uint16_t((faceSize - rows + tileRows-1)/tileRows);
+            const uint32_t taskIdx = uint32_t(_params - m_params);
+            {
+                bx::MutexScope lock(m_progressMutex);
+                m_progress[taskIdx].m_tilesLeft = numTiles + 1;
+                m_progress[taskIdx].m_startTime = bx::getHPCounter();
+            }
+            m_spill.fill(_params, taskIdx, numTiles, tileRows, rows);
+
+            return rows;
+        }
+
+        const RadianceFilterParams* m_params;
+
+        bx::Mutex m_indexMutex;
+        uint32_t m_top;
+        uint32_t m_bottom;
+        double m_remainingCost;
+
+        uint16_t m_numCpuThreads;
+        bool m_hasCpuThreads;
+
+        bx::Mutex m_concurrencyMutex;
+        uint16_t m_minActive;
+        uint16_t m_maxActive; // Zero without adaptive concurrency, lowered to the first thread that ended.
+        uint16_t m_numActive; // Threads [0, m_numActive) take tiles.
+        uint16_t m_concurrencyRaised; // Threads added at the last update.
+        uint16_t m_concurrencyHold; // Updates left before the next raise.
+        uint64_t m_concurrencyTime;
+        double m_concurrencyCost; // CPU cost done at the last update.
+        double m_concurrencyThroughput; // Over the last interval.
+        float m_otherRunnable;
+
+        RadianceFilterTileDeque m_deques[CMFT_MAX_THREADS];
+        RadianceFilterTileDeque m_spill; // Rows of split faces left over by devices.
+
+        uint8_t m_numDevices;
+        RadianceFilterDeviceLoad m_devices[CMFT_CL_MAX_CONTEXTS];
+
+        bx::Mutex m_progressMutex;
+        RadianceFilterTaskProgress* m_progress;
+        double m_cpuCost;
+        uint64_t m_cpuStartTime;
+
+        bx::Mutex m_callbackMutex;
+        FilterProgress* m_filterProgress;
+        TextureFormat::Enum m_encodeFormat; // Format of faces packed on the GPU.
+        double m_costBefore;
+        double m_totalCost;
+        double m_completedCost; // Cost of finished rows on all devices. Progress mutex has to be locked.
+        uint64_t m_startTime;
+    };
+
+    struct RadianceFilterThreadArgs
+    {
+        RadianceFilterTaskList* m_taskList;
+        RadianceFilterStats* m_stats;
+        ComputeDevice* m_device; // Gpu threads only.
+        uint16_t m_threadIdx;
+        uint16_t m_firstCpu; // Cpu range the thread is restricted to, none if m_numCpus is 0.
+        uint16_t m_numCpus;
+        bool m_pinToCore;    // Otherwise pinned to core m_threadIdx, see FilterSettings::m_pinThreadsToCores.
+    };
+
+    int32_t radianceFilterCpu(void* _threadArgs)
+    {
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+
+        const RadianceFilterThreadArgs* args = (const RadianceFilterThreadArgs*)_threadArgs;
+        RadianceFilterTaskList* taskList = args->m_taskList;
+        RadianceFilterStats* stats = args->m_stats;
+        const uint16_t threadId = args->m_threadIdx;
+
+        // Source replicas of the node the thread runs on are read, if there are any.
+        const uint16_t numaNode = getCurrentNumaNode();
+
+        // Cpu threads are processing row tiles from the top level mip map to the bottom and steal from each other when out of work.
+        uint64_t numTexels = 0;
+        RadianceFilterTile tile;
+        while (!taskList->isCancelled()
+           &&  taskList->keepActive(threadId)
+           &&  taskList->getTile(tile, threadId))
+        {
+            CMFT_PROFILE_ZONE("radianceFilterTile");
+
+            const RadianceFilterParams* params = tile.m_params;
+            numTexels += uint64_t(tile.m_yEnd - tile.m_yBegin)*params->m_mipFaceSize;
+
+            // Process data.
+            radianceFilter(params->m_dstPtr
+                         , params->m_halfDst
+                         , params->m_face
+                         , params->m_mipFaceSize
+                         , tile.m_yBegin
+                         , tile.m_yEnd
+                         , params->m_filterSize
+                         , params->m_specularPower
+                         , params->m_specularAngle
+                         , params->m_lobeTable
+                         , params->m_cubemapVectors
+                         , params->m_imageRgba32f
+                         , params->m_faceOffsets
+                         , (NULL != params->m_normalsSoa) ? &params->m_normalsSoa->forNode(numaNode) : NULL
+                         , (NULL != params->m_colorsSoa)  ? &params->m_colorsSoa->forNode(numaNode)  : NULL
+                         , params->m_adaptiveTolerance
+                         );
+
+            uint64_t faceStartTime;
+            if (taskList->tileDone(tile, faceStartTime))
+            {
+                // Determine face duration.
+                const uint64_t currentTime = bx::getHPCounter();
+                const uint64_t taskDuration = currentTime - faceStartTime;
+                const uint64_t totalDuration = currentTime - stats->m_startTime;
+
+                // Output process info.
+                char cpuId[16];
+                sprintf(cpuId, "[CPU%u]", threadId);
+                INFO("Radiance -> %-8s| %4u | %7.3fs | %7.3fs"
+                    , cpuId
+                    , params->m_mipFaceSize
+                    , double(taskDuration)*toSec
+                    , double(totalDuration)*toSec
+                    );
+
+                // Update task counter.
+                stats->incrCompletedTasksCpu();
+
+                taskList->reportFace(*params);
+            }
+
+            taskList->reportProgress();
+        }
+
+        stats->addTexelsCpu(numTexels);
+
+        return EXIT_SUCCESS;
+    }
+
+    static void radianceFilterCpuTask(void* _threadArgs, uint32_t _taskIdx)
+    {
+        RadianceFilterThreadArgs* threadArgs = (RadianceFilterThreadArgs*)_threadArgs;
+        if (0 != threadArgs[_taskIdx].m_numCpus)
+        {
+            ScopeCpuRange cpuRange(threadArgs[_taskIdx].m_firstCpu, threadArgs[_taskIdx].m_numCpus);
+            radianceFilterCpu((void*)&threadArgs[_taskIdx]);
+        }
+        else if (threadArgs[_taskIdx].m_pinToCore)
+        {
+            ScopeCpuCore cpuCore(threadArgs[_taskIdx].m_threadIdx);
+            radianceFilterCpu((void*)&threadArgs[_taskIdx]);
+        }
+        else
+        {
+            radianceFilterCpu((void*)&threadArgs[_taskIdx]);
+        }
+    }
+
+#ifndef CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT
+    #define CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT 3
+#endif // CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT
+
+// Kernel variants with per mip parameters built as constants, per device.
+#ifndef CMFT_RADIANCE_MAX_KERNEL_VARIANTS
+    #define CMFT_RADIANCE_MAX_KERNEL_VARIANTS 16
+#endif // CMFT_RADIANCE_MAX_KERNEL_VARIANTS
+
+// Work-group size of radianceFilterTiled kernel. Has to match TILE_SIZE in radiance.h.
+#define CMFT_RADIANCE_TILE_SIZE 8
+
+// 1 - Texel normals and solid angles are always computed on the device.
+// 0 - Only when the source together with normal and solid angle images doesn't fit into half of device memory.
+#ifndef CMFT_RADIANCE_GPU_ANALYTIC_NORMALS
+    #define CMFT_RADIANCE_GPU_ANALYTIC_NORMALS 0
+#endif // CMFT_RADIANCE_GPU_ANALYTIC_NORMALS
+
+// 1 - Normal images hold only the solid angle in R32F and texel normals are computed on the device.
+// 0 - Only with half precision sources, full RGBA32F normals are uploaded otherwise.
+#ifndef CMFT_RADIANCE_GPU_COMPACT_NORMALS
+    #define CMFT_RADIANCE_GPU_COMPACT_NORMALS 0
+#endif // CMFT_RADIANCE_GPU_COMPACT_NORMALS
+
+// Target duration of a single kernel dispatch in seconds. Faces are filtered in row bands of about this length, well below
+// display driver watchdogs (TDR is 2 seconds on Windows).
+#ifndef CMFT_RADIANCE_GPU_DISPATCH_TIME
+    #define CMFT_RADIANCE_GPU_DISPATCH_TIME 0.05
+#endif // CMFT_RADIANCE_GPU_DISPATCH_TIME
+
+// Throughput assumed before the device measured its own, in radianceFilterTaskCost() units per second. Low on purpose,
+// first dispatches are short rather than long.
+#ifndef CMFT_RADIANCE_GPU_INITIAL_THROUGHPUT
+    #define CMFT_RADIANCE_GPU_INITIAL_THROUGHPUT 1e9
+#endif // CMFT_RADIANCE_GPU_INITIAL_THROUGHPUT
+
+// Faces with source and destination up to this size are filtered many at a time by radianceFilterBatch, a dispatch per face
+// would be mostly launch and transfer overhead. 0 disables batching.
+#ifndef CMFT_RADIANCE_GPU_BATCH_MAX_FACE_SIZE
+    #define CMFT_RADIANCE_GPU_BATCH_MAX_FACE_SIZE 128
+#endif // CMFT_RADIANCE_GPU_BATCH_MAX_FACE_SIZE
+
+// 1 - On devices sharing memory with the host, results are written into the destination faces through buffers wrapping them
+//     (CL_MEM_USE_HOST_PTR) and mapped back, instead of being copied out of the device with clEnqueueReadImage().
+// 0 - Results are always read back.
+#ifndef CMFT_RADIANCE_GPU_HOST_PTR_READBACK
+    #define CMFT_RADIANCE_GPU_HOST_PTR_READBACK 1
+#endif // CMFT_RADIANCE_GPU_HOST_PTR_READBACK
+
+// 1 - On devices sharing memory with the host, source and normal atlases are images over host memory (CL_MEM_USE_HOST_PTR),
+//     read in place without an upload. Faces are gathered into an aligned host copy when they can't be used as they are.
+// 0 - Source is always uploaded.
+#ifndef CMFT_RADIANCE_GPU_HOST_PTR_SOURCE
+    #define CMFT_RADIANCE_GPU_HOST_PTR_SOURCE 1
+#endif // CMFT_RADIANCE_GPU_HOST_PTR_SOURCE
+
+// Alignment of host memory used in place by the device. Drivers copy less aligned memory behind the scenes.
+#define CMFT_RADIANCE_GPU_HOST_ALIGN 4096
+
+// Faces of a single batched dispatch.
+#ifndef CMFT_RADIANCE_GPU_BATCH_MAX_TASKS
+    #define CMFT_RADIANCE_GPU_BATCH_MAX_TASKS 2048
+#endif // CMFT_RADIANCE_GPU_BATCH_MAX_TASKS
+
+// Device memory of the batch source atlas in bytes, results take at most as much.
+#ifndef CMFT_RADIANCE_GPU_BATCH_ATLAS_SIZE
+    #define CMFT_RADIANCE_GPU_BATCH_ATLAS_SIZE (64<<20)
+#endif // CMFT_RADIANCE_GPU_BATCH_ATLAS_SIZE
+
+    /// Face of a batched dispatch. Has to match BatchTask in radiance.h.
+    struct RadianceBatchTask
+    {
+        int32_t m_texelBegin;
+        int32_t m_srcCell;
+        int32_t m_srcFaceSize;
+        int32_t m_dstFaceSize;
+        int32_t m_face;
+        float m_specularPower;
+        float m_specularAngle;
+        float m_filterSize;
+    };
+
+    /// Rows of a face filtered by a single dispatch on a device of _throughput, 0 if it wasn't measured yet.
+    static inline uint32_t radianceGpuDispatchRows(const RadianceFilterParams& _params, double _throughput)
+    {
+        const uint32_t faceSize = _params.m_mipFaceSize;
+        const double rowCost = radianceFilterTaskCost(_params)/double(faceSize);
+        const double throughput = (0.0 != _throughput) ? _throughput : CMFT_RADIANCE_GPU_INITIAL_THROUGHPUT;
+        const double rows = CMFT_RADIANCE_GPU_DISPATCH_TIME*throughput/rowCost;
+
+        return uint32_t(clamp(rows, 1.0, double(faceSize)));
+    }
+
+    // Device time from the start of command _first to the end of command _last of the same queue.
+    // Zero if the commands were enqueued without CL_QUEUE_PROFILING_ENABLE.
+    static double clEventDuration(cl_event _first, cl_event _last)
+    {
+        cl_ulong start = 0;
+        cl_ulong end = 0;
+        if (CL_SUCCESS != clGetEventProfilingInfo(_first, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL)
+        ||  CL_SUCCESS != clGetEventProfilingInfo(_last,  CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &end,   NULL)
+        ||  end < start)
+        {
+            return 0.0;
+        }
+
+        return double(end - start)*1e-9;
+    }
+
+    /// OpenCL ComputeDevice.
+    struct RadianceProgram : public ComputeDevice
+    {
+        RadianceProgram()
+            : m_clContext(NULL)
+            , m_queue(NULL)
+            , m_profileQueue(NULL)
+            , m_profiling(false)
+            , m_program(NULL)
+            , m_kernel(NULL)
+            , m_encodeKernel(NULL)
+            , m_batchKernel(NULL)
+            , m_readQueue(NULL)
+            , m_memSrcAtlas(NULL)
+            , m_memNormalAtlas(NULL)
+            , m_memStaging(NULL)
+            , m_stagingPtr(NULL)
+            , m_stagingSize(0)
+            , m_hostCopy(NULL)
+            , m_memBatchAtlas(NULL)
+            , m_memBatchTasks(NULL)
+            , m_memBatchOut(NULL)
+            , m_batchTasks(NULL)
+            , m_batchSources(NULL)
+            , m_batchCellSize(0)
+            , m_srcImage(NULL)
+            , m_sharedSrc(false)
+            , m_sourceCode(NULL)
+            , m_kernelName(NULL)
+            , m_globalMemSize(0)
+            , m_maxAllocSize(0)
+            , m_maxImageWidth(0)
+            , m_maxImageHeight(0)
+            , m_numVariants(0)
+            , m_encodeFormat(0)
+            , m_bounded(false)
+            , m_localMemory(false)
+            , m_tiled(false)
+            , m_compactNormalsSupported(false)
+            , m_rowOffsets(false)
+            , m_hostUnifiedMemory(false)
+            , m_hostPtrReadback(false)
+            , m_mode(0)
+            , m_modeFailed(0)
+            , m_bytesToDevice(0)
+            , m_bytesFromDevice(0)
+            , m_uploadTime(0.0)
+            , m_kernelTime(0.0)
+            , m_readTime(0.0)
+            , m_hostIdleTime(0.0)
+            , m_taskKernelTime(0.0)
+            , m_taskReadTime(0.0)
+        {
+            for (uint8_t ii = 0; ii < ModeCount; ++ii)
+            {
+                m_modeProgram[ii] = NULL;
+                m_modeKernel[ii] = NULL;
+                m_modeTiledKernel[ii] = NULL;
+            }
+            m_uploadEvent[0] = NULL;
+            m_uploadEvent[1] = NULL;
+            for (uint8_t ii = 0; ii < CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT; ++ii)
+            {
+                m_memOut[ii] = NULL;
+                m_memEncoded[ii] = NULL;
+                m_memHostOut[ii] = NULL;
+                m_hostOutPtr[ii] = NULL;
+                m_hostCopyEvent[ii] = NULL;
+                m_readEvent[ii] = NULL;
+                m_kernelEvent[ii] = NULL;
+                m_lastKernelEvent[ii] = NULL;
+                m_encodeEvent[ii] = NULL;
+                m_outFaceSize[ii] = 0;
+                m_halfOut[ii] = false;
+            }
+            m_memSrcData[0] = NULL;
+            m_memSrcData[1] = NULL;
+            m_memSrcData[2] = NULL;
+            m_memSrcData[3] = NULL;
+            m_memSrcData[4] = NULL;
+            m_memSrcData[5] = NULL;
+            m_memNormalSolidAngle[0] = NULL;
+            m_memNormalSolidAngle[1] = NULL;
+            m_memNormalSolidAngle[2] = NULL;
+            m_memNormalSolidAngle[3] = NULL;
+            m_memNormalSolidAngle[4] = NULL;
+            m_memNormalSolidAngle[5] = NULL;
+        }
+
+        void setClContext(const ClContext* _clContext)
+        {
+            m_clContext = _clContext;
+            m_queue = (NULL != _clContext) ? _clContext->m_commandQueue : NULL;
+        }
+
+        /// Call before createFromStr().
+        void setProfiling(bool _enabled)
+        {
+            m_profiling = _enabled;
+        }
+
+        virtual bool isProfiling() const
+        {
+            return (NULL != m_profileQueue);
+        }
+
+        bool hasValidDeviceContext() const
+        {
+            return (NULL != m_clContext && NULL != m_clContext->m_context);
+        }
+
+        virtual ComputeBackend::Enum getBackend() const
+        {
+            return ComputeBackend::OpenCL;
+        }
+
+        virtual bool isValid() const
+        {
+            return (NULL != m_program);
+        }
+
+        virtual bool canFilterRows() const
+        {
+            return m_rowOffsets;
+        }
+
+        bool createFromStr(const char* _sourceCode, const char* _kernelName)
+        {
+            cl_int err;
+
+            // Get compiled program from context cache.
+            m_program = m_clContext->getProgram(_sourceCode);
+            if (NULL == m_program)
+            {
+                return false;
+            }
+
+            // Create OpenCL Kernel.
+            m_modeKernel[0] = clCreateKernel(m_program, _kernelName, &err);
+            if (CL_SUCCESS != err)
+            {
+                WARN("Could not create OpenCL kernel. Kernel name probably inavlid! Should be: %s", _kernelName);
+                m_modeKernel[0] = NULL;
+                return false;
+            }
+            m_kernel = m_modeKernel[0];
+
+            // Source is kept for building specialized variants.
+            m_sourceCode = _sourceCode;
+            m_kernelName = _kernelName;
+
+            // Bounded kernel variant takes filter size as an additional argument.
+            cl_uint numArgs = 0;
+            CL_CHECK(clGetKernelInfo(m_kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &numArgs, NULL));
+            m_bounded = (numArgs > 18);
+
+            // Tiled kernel only pays off with dedicated local memory. It has the same arguments as the bounded one.
+            cl_device_local_mem_type localMemType = 0;
+            clGetDeviceInfo(m_clContext->m_device, CL_DEVICE_LOCAL_MEM_TYPE, sizeof(localMemType), &localMemType, NULL);
+            m_localMemory = (m_bounded && CL_LOCAL == localMemType);
+            m_modeTiledKernel[0] = createTiledKernel(m_program);
+
+            cl_ulong globalMemSize = 0;
+            clGetDeviceInfo(m_clContext->m_device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMemSize), &globalMemSize, NULL);
+            m_globalMemSize = uint64_t(globalMemSize);
+
+            cl_ulong maxAllocSize = 0;
+            clGetDeviceInfo(m_clContext->m_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAllocSize), &maxAllocSize, NULL);
+            m_maxAllocSize = uint64_t(maxAllocSize);
+
+            size_t maxImageWidth = 0;
+            clGetDeviceInfo(m_clContext->m_device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(maxImageWidth), &maxImageWidth, NULL);
+            m_maxImageWidth = uint32_t(min(maxImageWidth, size_t(UINT32_MAX)));
+
+            size_t maxImageHeight = 0;
+            clGetDeviceInfo(m_clContext->m_device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(maxImageHeight), &maxImageHeight, NULL);
+            m_maxImageHeight = uint32_t(min(maxImageHeight, size_t(UINT32_MAX)));
+
+            // Single channel float images are not required before OpenCL 2.0.
+            m_compactNormalsSupported = false;
+            cl_image_format formats[256];
+            cl_uint numFormats = 0;
+            clGetSupportedImageFormats(m_clContext->m_context, CL_MEM_READ_ONLY, CL_MEM_OBJECT_IMAGE2D, 256, formats, &numFormats);
+            for (cl_uint ii = 0, end = min(numFormats, cl_uint(256)); ii < end; ++ii)
+            {
+                m_compactNormalsSupported |= (CL_R == formats[ii].image_channel_order && CL_FLOAT == formats[ii].image_channel_data_type);
+            }
+
+            // OpenCL 1.0 requires NULL global work offset.
+            char deviceVersion[128] = { '\0' };
+            clGetDeviceInfo(m_clContext->m_device, CL_DEVICE_VERSION, sizeof(deviceVersion), deviceVersion, NULL);
+            m_rowOffsets = (0 != strncmp(deviceVersion, "OpenCL 1.0", 10));
+
+            // Buffers over host memory are not copied on integrated devices, results can land in the destination directly.
+            cl_bool hostUnifiedMemory = CL_FALSE;
+            clGetDeviceInfo(m_clContext->m_device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(hostUnifiedMemory), &hostUnifiedMemory, NULL);
+            m_hostUnifiedMemory = (CL_TRUE == hostUnifiedMemory);
+            m_hostPtrReadback = (0 != CMFT_RADIANCE_GPU_HOST_PTR_READBACK) && m_hostUnifiedMemory;
+
+            // Context queue is created without profiling, profiled program gets a queue of its own.
+            const cl_command_queue_properties queueProperties = m_profiling ? CL_QUEUE_PROFILING_ENABLE : 0;
+            if (m_profiling)
+            {
+                m_profileQueue = clCreateCommandQueue(m_clContext->m_context, m_clContext->m_device, queueProperties, &err);
+                if (CL_SUCCESS == err)
+                {
+                    m_queue = m_profileQueue;
+                }
+                else
+                {
+                    WARN("Could not create OpenCL command queue with profiling enabled, GPU times are not measured.");
+                    m_profileQueue = NULL;
+                }
+            }
+
+            // Results are read back on a separate queue, so transfers overlap with the next kernel.
+            m_readQueue = clCreateCommandQueue(m_clContext->m_context, m_clContext->m_device, isProfiling() ? queueProperties : 0, &err);
+            if (CL_SUCCESS != err)
+            {
+                m_readQueue = NULL;
+            }
+
+            // Programs built from files may not have the batch kernel, small faces are then filtered one by one.
+            if (0 != CMFT_RADIANCE_GPU_BATCH_MAX_FACE_SIZE)
+            {
+                m_batchKernel = clCreateKernel(m_program, "radianceFilterBatch", &err);
+                if (CL_SUCCESS != err)
+                {
+                    m_batchKernel = NULL;
+                }
+            }
+
+            return true;
+        }
+
+        // Creates kernel packing results into _format on the device. Supported formats are BGRA8, RGBA8 and RGBE.
+        bool setEncodeFormat(TextureFormat::Enum _format)
+        {
+            cl_int err;
+
+            m_encodeFormat = (TextureFormat::BGRA8 == _format) ? 0
+                           : (TextureFormat::RGBA8 == _format) ? 1
+                           : 2
+                           ;
+
+            m_encodeKernel = clCreateKernel(m_program, "radianceEncode", &err);
+            if (CL_SUCCESS != err)
+            {
+                WARN("Could not create OpenCL kernel radianceEncode, results are encoded on the host.");
+                m_encodeKernel = NULL;
+                return false;
+            }
+
+            return true;
+        }
+
+        virtual bool canEncode() const
+        {
+            return (NULL != m_encodeKernel);
+        }
+
+        virtual bool canBatch() const
+        {
+            return (NULL != m_batchKernel);
+        }
+
+        // Atlas cells of _cellSize for batched dispatches, returns cells per atlas row in _cellsPerRow.
+        virtual uint32_t maxBatchCells(uint32_t _cellSize, uint32_t& _cellsPerRow) const
+        {
+            const uint64_t cellBytes = uint64_t(_cellSize)*_cellSize*16;
+
+            uint64_t atlasSize = CMFT_RADIANCE_GPU_BATCH_ATLAS_SIZE;
+            if (0 != m_maxAllocSize)
+            {
+                atlasSize = min(atlasSize, m_maxAllocSize);
+            }
+
+            if (0 != m_globalMemSize)
+            {
+                atlasSize = min(atlasSize, m_globalMemSize/8);
+            }
+
+            const uint32_t maxWidth  = (0 != m_maxImageWidth)  ? m_maxImageWidth  : 8192;
+            const uint32_t maxHeight = (0 != m_maxImageHeight) ? m_maxImageHeight : 8192;
+
+            const uint32_t cells = uint32_t(min(atlasSize/cellBytes, uint64_t(CMFT_RADIANCE_GPU_BATCH_MAX_TASKS*6)));
+            _cellsPerRow = max(UINT32_C(1), min(maxWidth/_cellSize, cells));
+            const uint32_t rows = min(maxHeight/_cellSize, (cells + _cellsPerRow-1)/_cellsPerRow);
+
+            return min(cells, _cellsPerRow*rows);
+        }
+
+        // Filters _numTasks faces with a single dispatch of radianceFilterBatch and writes results to their destinations.
+        // Distinct sources, no wider than _cellSize, are copied into six atlas cells each. Texel normals are computed on the
+        // device. Blocks until results are read back.
+        virtual void filterBatch(const RadianceFilterParams* const* _tasks, uint32_t _numTasks, uint32_t _cellSize)
+        {
+            cl_int err;
+
+            uint32_t cellsPerRow;
+            const uint32_t maxCells = maxBatchCells(_cellSize, cellsPerRow);
+            const uint32_t atlasWidth = cellsPerRow*_cellSize;
+            const uint64_t maxTexels = uint64_t(maxCells)*_cellSize*_cellSize;
+
+            // Atlas and buffers are kept for following batches with the same cell size.
+            if (_cellSize != m_batchCellSize)
+            {
+                releaseBatchMemory();
+
+                const cl_image_format imageFormat = { CL_RGBA, CL_FLOAT };
+                m_memBatchAtlas = CL_CHECK_ERR(m_clContext->acquireImage2D(CL_MEM_READ_ONLY
+                                             , imageFormat
+                                             , atlasWidth
+                                             , (maxCells + cellsPerRow-1)/cellsPerRow*_cellSize
+                                             , &err
+                                             ));
+
+                m_memBatchTasks = CL_CHECK_ERR(m_clContext->acquireBuffer(CL_MEM_READ_ONLY
+                                             , CMFT_RADIANCE_GPU_BATCH_MAX_TASKS*sizeof(RadianceBatchTask)
+                                             , &err
+                                             ));
+
+                m_memBatchOut = CL_CHECK_ERR(m_clContext->acquireBuffer(CL_MEM_WRITE_ONLY
+                                           , size_t(maxTexels)*16
+                                           , &err
+                                           ));
+
+                m_batchTasks = (RadianceBatchTask*)malloc(CMFT_RADIANCE_GPU_BATCH_MAX_TASKS*sizeof(RadianceBatchTask));
+                MALLOC_CHECK(m_batchTasks);
+
+                m_batchSources = (const Image**)malloc(CMFT_RADIANCE_GPU_BATCH_MAX_TASKS*sizeof(const Image*));
+                MALLOC_CHECK(m_batchSources);
+
+                m_batchCellSize = _cellSize;
+            }
+
+            // Tasks of the same source are adjacent in the task list, so only the previous source is checked.
+            uint32_t numSources = 0;
+            int32_t numTexels = 0;
+            for (uint32_t ii = 0; ii < _numTasks; ++ii)
+            {
+                const RadianceFilterParams& params = *_tasks[ii];
+                if (0 == numSources || m_batchSources[numSources-1] != params.m_imageRgba32f)
+                {
+                    m_batchSources[numSources++] = params.m_imageRgba32f;
+                }
+
+                RadianceBatchTask& task = m_batchTasks[ii];
+                task.m_texelBegin    = numTexels;
+                task.m_srcCell       = int32_t(numSources-1)*6;
+                task.m_srcFaceSize   = int32_t(params.m_imageRgba32f->m_width);
+                task.m_dstFaceSize   = int32_t(params.m_mipFaceSize);
+                task.m_face          = int32_t(params.m_face);
+                task.m_specularPower = params.m_specularPower;
+                task.m_specularAngle = params.m_specularAngle;
+                task.m_filterSize    = params.m_filterSize;
+                numTexels += int32_t(params.m_mipFaceSize*params.m_mipFaceSize);
+            }
+            DEBUG_CHECK(numSources*6 <= maxCells && uint64_t(numTexels) <= maxTexels, "Batch doesn't fit the atlas!");
+
+            // Sources are copied into pinned memory in the atlas layout and uploaded with a single transfer.
+            const uint32_t numRows = (numSources*6 + cellsPerRow-1)/cellsPerRow*_cellSize;
+            const size_t atlasPitch = size_t(atlasWidth)*16;
+            uint8_t* staging = (uint8_t*)mapStaging(atlasPitch*numRows);
+            for (uint32_t ii = 0; ii < numSources; ++ii)
+            {
+                const Image& image = *m_batchSources[ii];
+                const bool halfSrc = (TextureFormat::RGBA16F == image.m_format);
+                const uint32_t bytesPerPixel = halfSrc ? 8 : 16;
+
+                uint64_t faceOffsets[CUBE_FACE_NUM];
+                imageGetFaceOffsets(faceOffsets, image);
+
+                for (uint8_t face = 0; face < 6; ++face)
+                {
+                    const uint32_t cell = ii*6 + face;
+                    uint8_t* dst = staging + size_t(cell/cellsPerRow)*_cellSize*atlasPitch + size_t(cell%cellsPerRow)*_cellSize*16;
+                    const uint8_t* src = (const uint8_t*)image.m_data + faceOffsets[face];
+                    for (uint32_t yy = 0; yy < image.m_width; ++yy)
+                    {
+                        float* dstRow = (float*)(dst + yy*atlasPitch);
+                        const uint8_t* srcRow = src + size_t(yy)*image.m_width*bytesPerPixel;
+                        if (halfSrc)
+                        {
+                            const uint16_t* srcHalf = (const uint16_t*)srcRow;
+                            for (uint32_t xx = 0; xx < image.m_width*4; ++xx)
+                            {
+                                dstRow[xx] = halfToFloat(srcHalf[xx]);
+                            }
+                        }
+                        else
+                        {
+                            memcpy(dstRow, srcRow, image.m_width*16);
+                        }
+                    }
+                }
+            }
+
+            const size_t origin[3] = { 0, 0, 0 };
+            const size_t region[3] = { atlasWidth, numRows, 1 };
+            CL_CHECK(clEnqueueWriteImage(m_queue
+                                       , m_memBatchAtlas
+                                       , CL_FALSE
+                                       , origin
+                                       , region
+                                       , atlasPitch
+                                       , 0
+                                       , staging
+                                       , 0
+                                       , NULL
+                                       , &m_uploadEvent[0]
+                                       ));
+
+            // Host task table isn't touched until the blocking readback below, queue is in order.
+            CL_CHECK(clEnqueueWriteBuffer(m_queue
+                                        , m_memBatchTasks
+                                        , CL_FALSE
+                                        , 0
+                                        , _numTasks*sizeof(RadianceBatchTask)
+                                        , m_batchTasks
+                                        , 0
+                                        , NULL
+                                        , NULL
+                                        ));
+            m_bytesToDevice += atlasPitch*numRows + _numTasks*sizeof(RadianceBatchTask);
+
+            const int32_t numTasks = int32_t(_numTasks);
+            const int32_t cellSize = int32_t(_cellSize);
+            const int32_t cellsPerRowArg = int32_t(cellsPerRow);
+            CL_CHECK(clSetKernelArg(m_batchKernel, 0, sizeof(cl_mem),  (const void*)&m_memBatchOut));
+            CL_CHECK(clSetKernelArg(m_batchKernel, 1, sizeof(cl_mem),  (const void*)&m_memBatchTasks));
+            CL_CHECK(clSetKernelArg(m_batchKernel, 2, sizeof(int32_t), (const void*)&numTasks));
+            CL_CHECK(clSetKernelArg(m_batchKernel, 3, sizeof(int32_t), (const void*)&numTexels));
+            CL_CHECK(clSetKernelArg(m_batchKernel, 4, sizeof(int32_t), (const void*)&cellSize));
+            CL_CHECK(clSetKernelArg(m_batchKernel, 5, sizeof(int32_t), (const void*)&cellsPerRowArg));
+            CL_CHECK(clSetKernelArg(m_batchKernel, 6, sizeof(cl_mem),  (const void*)&m_memBatchAtlas));
+
+            // Work items past the last texel return right away.
+            const size_t globalSize = (size_t(numTexels) + 63)/64*64;
+            cl_event kernelEvent = NULL;
+            CL_CHECK(clEnqueueNDRangeKernel(m_queue, m_batchKernel, 1, NULL, &globalSize, NULL, 0, NULL, isProfiling() ? &kernelEvent : NULL));
+
+            const int64_t waitStartTime = bx::getHPCounter();
+            cl_event readEvent = NULL;
+            float* out = (float*)CL_CHECK_ERR(clEnqueueMapBuffer(m_queue
+                                              , m_memBatchOut
+                                              , CL_TRUE
+                                              , CL_MAP_READ
+                                              , 0
+                                              , size_t(numTexels)*16
+                                              , 0
+                                              , NULL
+                                              , isProfiling() ? &readEvent : NULL
+                                              , &err
+                                              ));
+            m_hostIdleTime += double(bx::getHPCounter() - waitStartTime)/double(bx::getHPFrequency());
+            m_bytesFromDevice += uint64_t(numTexels)*16;
+
+            // Results are RGBA32F, half destinations are converted on the host.
+            for (uint32_t ii = 0; ii < _numTasks; ++ii)
+            {
+                const RadianceFilterParams& params = *_tasks[ii];
+                const float* src = out + size_t(m_batchTasks[ii].m_texelBegin)*4;
+                const uint32_t numFloats = params.m_mipFaceSize*params.m_mipFaceSize*4;
+                if (params.m_halfDst)
+                {
+                    uint16_t* dst = (uint16_t*)params.m_dstPtr;
+                    for (uint32_t jj = 0; jj < numFloats; ++jj)
+                    {
+                        dst[jj] = halfFromFloat(src[jj]);
+                    }
+                }
+                else
+                {
+                    memcpy(params.m_dstPtr, src, numFloats*sizeof(float));
+                }
+                *params.m_encoded = false;
+            }
+
+            CL_CHECK(clEnqueueUnmapMemObject(m_queue, m_memBatchOut, out, 0, NULL, NULL));
+
+            m_taskKernelTime = 0.0;
+            m_taskReadTime = 0.0;
+            if (isProfiling())
+            {
+                m_taskKernelTime = clEventDuration(kernelEvent, kernelEvent);
+                m_taskReadTime = clEventDuration(readEvent, readEvent);
+                m_kernelTime += m_taskKernelTime;
+                m_readTime += m_taskReadTime;
+                clReleaseEvent(kernelEvent);
+                clReleaseEvent(readEvent);
+            }
+        }
+
+        // Device memory goes back to the context pool, following jobs of the same size take it from there.
+        void releaseMem(cl_mem& _mem)
+        {
+            if (NULL != _mem)
+            {
+                m_clContext->releaseMem(_mem);
+                _mem = NULL;
+            }
+        }
+
+        void releaseBatchMemory()
+        {
+            releaseMem(m_memBatchAtlas);
+            releaseMem(m_memBatchTasks);
+            releaseMem(m_memBatchOut);
+
+            free(m_batchTasks);
+            free(m_batchSources);
+            m_batchTasks = NULL;
+            m_batchSources = NULL;
+            m_batchCellSize = 0;
+        }
+
+        bool createFromFile(const char* _filePath, const char* _kernelName)
+        {
+            CMFT_UNUSED size_t read;
+
+            // Open file.
+            FILE* fp = fopen(_filePath, "rb");
+            if (NULL == fp)
+            {
+                WARN("Could not open file %s for reading.", _filePath);
+                return false;
+            }
+            ScopeFclose cleanup0(fp);
+
+            // Alloc data for string.
+            const long int fileSize = fsize(fp);
+            char* sourceData = (char*)malloc(fileSize+1);
+            ScopeFree cleanup1(sourceData);
+
+            // Read opencl source file.
+            read = fread(sourceData, fileSize, 1, fp);
+            sourceData[fileSize] = '\0';
+            DEBUG_CHECK(read == 1, "Could not read from file.");
+            FERROR_CHECK(fp);
+
+            bool result = createFromStr(sourceData, _kernelName);
+
+            // Source data is freed on return, generic kernel is used for all faces.
+            m_sourceCode = NULL;
+
+            return result;
+        }
+
+        void initDeviceMemory(const Image& _image, const float* _cubemapNormalSolidAngle)
+        {
+            cl_int err;
+
+            uint64_t faceOffsets[CUBE_FACE_NUM];
+            imageGetFaceOffsets(faceOffsets, _image);
+
+            // Source is RGBA32F or RGBA16F. Normals are RGBA32F, or only R32F solid angles with half precision sources.
+            const bool halfSrc = (TextureFormat::RGBA16F == _image.m_format);
+            const cl_image_format srcImageFormat = { CL_RGBA, cl_channel_type(halfSrc ? CL_HALF_FLOAT : CL_FLOAT) };
+            const uint32_t srcBytesPerPixel = 4 /*numChannels*/ * (halfSrc ? 2 : 4) /*bytesPerChannel*/;
+            const uint64_t srcSize = uint64_t(_image.m_width)*_image.m_height*srcBytesPerPixel*6;
+
+            uint8_t mode = 0;
+            if ((CMFT_RADIANCE_GPU_COMPACT_NORMALS || halfSrc)
+            &&  m_compactNormalsSupported
+            &&  !CMFT_RADIANCE_GPU_ANALYTIC_NORMALS
+            &&  initModeKernels(ModeCompactNormals))
+            {
+                mode |= ModeCompactNormals;
+            }
+
+            const bool compact = (0 != (mode&ModeCompactNormals));
+            const cl_image_format imageFormat = { cl_channel_order(compact ? CL_R : CL_RGBA), CL_FLOAT };
+            const uint32_t bytesPerPixel = (compact ? 1 : 4) /*numChannels*/ * 4 /*bytesPerChannel*/;
+            const uint32_t normalFaceSize = _image.m_width * _image.m_width * bytesPerPixel;
+
+            // Normal and solid angle images take as much memory as RGBA32F source, compact ones a quarter of it.
+            // Without them, sources twice as big fit on the device, for some extra ALU work per tap.
+            const uint64_t normalsSize = uint64_t(normalFaceSize)*6;
+            if ((CMFT_RADIANCE_GPU_ANALYTIC_NORMALS || srcSize+normalsSize > m_globalMemSize/2)
+            &&  initModeKernels(ModeAnalyticNormals))
+            {
+                mode = ModeAnalyticNormals;
+            }
+
+            // Faces stacked in one image are uploaded with a single transfer, which matters for small sources where setup dominates.
+            // Atlas is a single allocation, it has to fit the allocation limit together with the normal atlas.
+            const uint64_t atlasNormalsSize = (0 != (mode&ModeAnalyticNormals)) ? 0 : normalsSize;
+            if (6*_image.m_height <= m_maxImageHeight
+            &&  (0 == m_maxAllocSize || (srcSize <= m_maxAllocSize && atlasNormalsSize <= m_maxAllocSize))
+            &&  initModeKernels(mode|ModeFaceAtlas))
+            {
+                mode |= ModeFaceAtlas;
+            }
+            m_mode = mode;
+
+            if (0 != (m_mode&ModeFaceAtlas)
+            &&  initHostAtlas(_image, faceOffsets, srcImageFormat, imageFormat, _cubemapNormalSolidAngle))
+            {
+                // Nothing to upload.
+            }
+            else if (0 != (m_mode&ModeFaceAtlas))
+            {
+                const size_t srcFaceBytes = size_t(_image.m_width)*_image.m_height*srcBytesPerPixel;
+                const size_t normalsBytes = (0 != (m_mode&ModeAnalyticNormals)) ? 0 : size_t(normalsSize);
+                uint8_t* staging = (uint8_t*)mapStaging(srcFaceBytes*6 + normalsBytes);
+                m_bytesToDevice += srcFaceBytes*6 + normalsBytes;
+
+                // Faces are copied into pinned memory, transfers from it don't go through driver staging copies.
+                for (uint8_t face = 0; face < 6; ++face)
+                {
+                    memcpy(staging + srcFaceBytes*face, (const uint8_t*)_image.m_data + faceOffsets[face], srcFaceBytes);
+                }
+
+                const size_t origin[3] = { 0, 0, 0 };
+                const size_t region[3] = { _image.m_width, size_t(_image.m_height)*6, 1 };
+                m_memSrcAtlas = CL_CHECK_ERR(m_clContext->acquireImage2D(CL_MEM_READ_ONLY
+                                           , srcImageFormat
+                                           , region[0]
+                                           , region[1]
+                                           , &err
+                                           ));
+                CL_CHECK(clEnqueueWriteImage(m_queue
+                                           , m_memSrcAtlas
+                                           , CL_FALSE
+                                           , origin
+                                           , region
+                                           , _image.m_width*srcBytesPerPixel
+                                           , 0
+                                           , staging
+                                           , 0
+                                           , NULL
+                                           , &m_uploadEvent[0]
+                                           ));
+
+                // Normal table already has the faces one after another.
+                if (0 != normalsBytes)
+                {
+                    if (0 != (m_mode&ModeCompactNormals))
+                    {
+                        copySolidAngles((float*)(staging + srcFaceBytes*6), _cubemapNormalSolidAngle, uint32_t(normalsBytes/sizeof(float)));
+                    }
+                    else
+                    {
+                        memcpy(staging + srcFaceBytes*6, _cubemapNormalSolidAngle, normalsBytes);
+                    }
+
+                    m_memNormalAtlas = CL_CHECK_ERR(m_clContext->acquireImage2D(CL_MEM_READ_ONLY
+                                                  , imageFormat
+                                                  , region[0]
+                                                  , region[1]
+                                                  , &err
+                                                  ));
+                    CL_CHECK(clEnqueueWriteImage(m_queue
+                                               , m_memNormalAtlas
+                                               , CL_FALSE
+                                               , origin
+                                               , region
+                                               , _image.m_width*bytesPerPixel
+                                               , 0
+                                               , staging + srcFaceBytes*6
+                                               , 0
+                                               , NULL
+                                               , &m_uploadEvent[1]
+                                               ));
+                }
+            }
+            else
+            {
+                m_bytesToDevice += (0 != (m_mode&ModeAnalyticNormals)) ? srcSize : srcSize+normalsSize;
+
+                // Images are created from host memory, so one face of solid angles is enough.
+                float* solidAngles = NULL;
+                if (0 != (m_mode&ModeCompactNormals))
+                {
+                    solidAngles = (float*)malloc(normalFaceSize);
+                    MALLOC_CHECK(solidAngles);
+                }
+
+                // Faces are written with blocking transfers, which have no events kept. Host time of the writes is counted as upload time.
+                const int64_t uploadStartTime = bx::getHPCounter();
+
+                const size_t origin[3] = { 0, 0, 0 };
+                const size_t region[3] = { _image.m_width, _image.m_height, 1 };
+                const float* normals = _cubemapNormalSolidAngle;
+                for (uint8_t face = 0; face < 6; ++face)
+                {
+                    m_memSrcData[face] = CL_CHECK_ERR(m_clContext->acquireImage2D(CL_MEM_READ_ONLY
+                                                    , srcImageFormat
+                                                    , _image.m_width
+                                                    , _image.m_height
+                                                    , &err
+                                                    ));
+                    CL_CHECK(clEnqueueWriteImage(m_queue
+                                               , m_memSrcData[face]
+                                               , CL_TRUE
+                                               , origin
+                                               , region
+                                               , _image.m_width*srcBytesPerPixel
+                                               , 0
+                                               , (const uint8_t*)_image.m_data + faceOffsets[face]
+                                               , 0
+                                               , NULL
+                                               , NULL
+                                               ));
+
+                    if (0 != (m_mode&ModeAnalyticNormals))
+                    {
+                        continue;
+                    }
+
+                    const uint32_t faceTexels = _image.m_width*_image.m_width;
+                    const float* faceNormals = normals + faceTexels*4*face;
+                    if (NULL != solidAngles)
+                    {
+                        copySolidAngles(solidAngles, faceNormals, faceTexels);
+                    }
+
+                    m_memNormalSolidAngle[face] = CL_CHECK_ERR(m_clContext->acquireImage2D(CL_MEM_READ_ONLY
+                                                             , imageFormat
+                                                             , _image.m_width
+                                                             , _image.m_height
+                                                             , &err
+                                                             ));
+                    CL_CHECK(clEnqueueWriteImage(m_queue
+                                               , m_memNormalSolidAngle[face]
+                                               , CL_TRUE
+                                               , origin
+                                               , region
+                                               , _image.m_width*bytesPerPixel
+                                               , 0
+                                               , (NULL != solidAngles) ? (const void*)solidAngles : (const void*)faceNormals
+                                               , 0
+                                               , NULL
+                                               , NULL
+                                               ));
+                }
+
+                if (isProfiling())
+                {
+                    m_uploadTime += double(bx::getHPCounter() - uploadStartTime)/double(bx::getHPFrequency());
+                }
+
+                free(solidAngles);
+            }
+
+            m_srcImage = &_image;
+            setSourceArgs();
+        }
+
+        // Binds images over shared source texture faces instead of uploading a source. _image only gives the face size.
+        // Texel normals are computed in kernels, so there is nothing to upload. Returns false if such kernels can't be built.
+        bool initSharedDeviceMemory(const cl_mem _faces[6], const Image& _image)
+        {
+            if (!initModeKernels(ModeAnalyticNormals))
+            {
+                return false;
+            }
+            m_mode = ModeAnalyticNormals;
+
+            for (uint8_t face = 0; face < 6; ++face)
+            {
+                m_memSrcData[face] = _faces[face];
+            }
+            m_sharedSrc = true;
+
+            m_srcImage = &_image;
+            setSourceArgs();
+
+            return true;
+        }
+
+        // Atlases over host memory for devices sharing it, there is no upload. Source faces and the normal table are used in place when
+        // they are laid out as the atlas and aligned, otherwise they are gathered into an aligned copy. Returns false if the device
+        // doesn't share memory with the host or images can't be created, source is then uploaded.
+        bool initHostAtlas(const Image& _image
+                         , const uint64_t _faceOffsets[CUBE_FACE_NUM]
+                         , const cl_image_format& _srcImageFormat
+                         , const cl_image_format& _normalImageFormat
+                         , const float* _cubemapNormalSolidAngle
+                         )
+        {
+            if (!CMFT_RADIANCE_GPU_HOST_PTR_SOURCE
+            ||  !m_hostUnifiedMemory)
+            {
+                return false;
+            }
+
+            const bool halfSrc = (CL_HALF_FLOAT == _srcImageFormat.image_channel_data_type);
+            const size_t srcBytesPerPixel = 4 /*numChannels*/ * (halfSrc ? 2 : 4) /*bytesPerChannel*/;
+            const size_t srcFaceBytes = size_t(_image.m_width)*_image.m_height*srcBytesPerPixel;
+            const bool compact = (0 != (m_mode&ModeCompactNormals));
+            const size_t normalBytesPerPixel = (compact ? 1 : 4) /*numChannels*/ * 4 /*bytesPerChannel*/;
+            const size_t normalsBytes = (0 != (m_mode&ModeAnalyticNormals)) ? 0 : size_t(_image.m_width)*_image.m_width*normalBytesPerPixel*6;
+
+            // Faces of a source with mips are not one after another.
+            bool srcInPlace = (0 == (uintptr_t(_image.m_data)&(CMFT_RADIANCE_GPU_HOST_ALIGN-1)));
+            for (uint8_t face = 0; face < 6; ++face)
+            {
+                srcInPlace &= (_faceOffsets[face] == srcFaceBytes*face);
+            }
+            const bool normalsInPlace = !compact && (0 == (uintptr_t(_cubemapNormalSolidAngle)&(CMFT_RADIANCE_GPU_HOST_ALIGN-1)));
+
+            const size_t srcCopyBytes = srcInPlace ? 0 : (srcFaceBytes*6 + CMFT_RADIANCE_GPU_HOST_ALIGN-1)&~size_t(CMFT_RADIANCE_GPU_HOST_ALIGN-1);
+            const size_t copyBytes = srcCopyBytes + (normalsInPlace ? 0 : normalsBytes);
+            uint8_t* copy = NULL;
+            if (0 != copyBytes)
+            {
+                m_hostCopy = malloc(copyBytes + CMFT_RADIANCE_GPU_HOST_ALIGN-1);
+                MALLOC_CHECK(m_hostCopy);
+                copy = (uint8_t*)((uintptr_t(m_hostCopy) + CMFT_RADIANCE_GPU_HOST_ALIGN-1) & ~uintptr_t(CMFT_RADIANCE_GPU_HOST_ALIGN-1));
+            }
+
+            const void* srcData = _image.m_data;
+            if (!srcInPlace)
+            {
+                for (uint8_t face = 0; face < 6; ++face)
+                {
+                    memcpy(copy + srcFaceBytes*face, (const uint8_t*)_image.m_data + _faceOffsets[face], srcFaceBytes);
+                }
+                srcData = copy;
+            }
+
+            const void* normalData = _cubemapNormalSolidAngle;
+            if (0 != normalsBytes && !normalsInPlace)
+            {
+                if (compact)
+                {
+                    copySolidAngles((float*)(copy + srcCopyBytes), _cubemapNormalSolidAngle, uint32_t(normalsBytes/sizeof(float)));
+                }
+                else
+                {
+                    memcpy(copy + srcCopyBytes, _cubemapNormalSolidAngle, normalsBytes);
+                }
+                normalData = copy + srcCopyBytes;
+            }
+
+            cl_int err;
+            m_memSrcAtlas = clCreateImage2D(m_clContext->m_context
+                                          , CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR
+                                          , &_srcImageFormat
+                                          , _image.m_width
+                                          , size_t(_image.m_height)*6
+                                          , _image.m_width*srcBytesPerPixel
+                                          , const_cast<void*>(srcData)
+                                          , &err
+                                          );
+            if (CL_SUCCESS == err
+            &&  0 != normalsBytes)
+            {
+                m_memNormalAtlas = clCreateImage2D(m_clContext->m_context
+                                                 , CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR
+                                                 , &_normalImageFormat
+                                                 , _image.m_width
+                                                 , size_t(_image.m_width)*6
+                                                 , _image.m_width*normalBytesPerPixel
+                                                 , const_cast<void*>(normalData)
+                                                 , &err
+                                                 );
+            }
+
+            if (CL_SUCCESS != err)
+            {
+                WARN("Could not create OpenCL images over host memory, error %d. Source is uploaded.", (int)err);
+                releaseMem(m_memSrcAtlas);
+                releaseMem(m_memNormalAtlas);
+                free(m_hostCopy);
+                m_hostCopy = NULL;
+                return false;
+            }
+
+            return true;
+        }
+
+        // Largest source face that fits device limits together with CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT outputs of _dstFaceSize.
+        // Faces are separate images, normals are computed on the device if source and normal tables don't fit together.
+        uint32_t maxSourceFaceSize(uint32_t _srcBytesPerPixel, uint32_t _dstFaceSize) const
+        {
+            if (0 == m_globalMemSize)
+            {
+                return UINT32_MAX;
+            }
+
+            // Part of the memory is left to the driver and other applications.
+            const uint64_t budget = m_globalMemSize/4*3;
+            const uint64_t outSize = uint64_t(_dstFaceSize)*_dstFaceSize*16*CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT;
+            if (outSize >= budget)
+            {
+                return 0;
+            }
+
+            const double bySize = sqrt(double(budget - outSize)/double(6*_srcBytesPerPixel));
+            const uint32_t faceSize = uint32_t(min(bySize, double(UINT32_MAX)));
+
+            return min(faceSize, maxImageFaceSize(_srcBytesPerPixel));
+        }
+
+        // Largest destination face of a single output image.
+        uint32_t maxDestinationFaceSize() const
+        {
+            return maxImageFaceSize(16);
+        }
+
+        // Largest square image within allocation and image size limits. Limits the device didn't report are ignored.
+        uint32_t maxImageFaceSize(uint32_t _bytesPerPixel) const
+        {
+            uint32_t faceSize = UINT32_MAX;
+            if (0 != m_maxAllocSize)
+            {
+                faceSize = uint32_t(min(sqrt(double(m_maxAllocSize)/double(_bytesPerPixel)), double(UINT32_MAX)));
+            }
+
+            if (0 != m_maxImageWidth)
+            {
+                faceSize = min(faceSize, m_maxImageWidth);
+            }
+
+            if (0 != m_maxImageHeight)
+            {
+                faceSize = min(faceSize, m_maxImageHeight);
+            }
+
+            return faceSize;
+        }
+
+        // Takes every fourth float, the solid angle, of _num texel normals.
+        static void copySolidAngles(float* _dst, const float* _normalSolidAngle, uint32_t _num)
+        {
+            for (uint32_t ii = 0; ii < _num; ++ii)
+            {
+                _dst[ii] = _normalSolidAngle[ii*4+3];
+            }
+        }
+
+        static void modeBuildOptions(char* _options, uint8_t _mode)
+        {
+            _options[0] = '\0';
+            if (0 != (_mode&ModeAnalyticNormals))
+            {
+                strcat(_options, " -D CMFT_ANALYTIC_NORMALS");
+            }
+
+            if (0 != (_mode&ModeFaceAtlas))
+            {
+                strcat(_options, " -D CMFT_FACE_ATLAS");
+            }
+
+            if (0 != (_mode&ModeCompactNormals))
+            {
+                strcat(_options, " -D CMFT_COMPACT_NORMALS");
+            }
+        }
+
+        // Builds generic kernels for the given source mode. Returns false if they can't be built.
+        bool initModeKernels(uint8_t _mode)
+        {
+            if (NULL != m_modeKernel[_mode])
+            {
+                return true;
+            }
+
+            if (NULL == m_sourceCode || 0 != (m_modeFailed&(1<<_mode)))
+            {
+                return false;
+            }
+
+            char options[96];
+            modeBuildOptions(options, _mode);
+
+            m_modeProgram[_mode] = m_clContext->getProgram(m_sourceCode, options);
+            if (NULL != m_modeProgram[_mode])
+            {
+                cl_int err;
+                m_modeKernel[_mode] = clCreateKernel(m_modeProgram[_mode], m_kernelName, &err);
+                if (CL_SUCCESS != err)
+                {
+                    m_modeKernel[_mode] = NULL;
+                }
+                else
+                {
+                    m_modeTiledKernel[_mode] = createTiledKernel(m_modeProgram[_mode]);
+                }
+            }
+
+            if (NULL == m_modeKernel[_mode])
+            {
+                WARN("Could not build OpenCL kernel with%s, source is uploaded without it.", options);
+                m_modeFailed |= uint8_t(1<<_mode);
+                return false;
+            }
+
+            return true;
+        }
+
+        // Returns pointer to pinned host memory of at least _size bytes. Waits for previous uploads from it.
+        void* mapStaging(size_t _size)
+        {
+            cl_int err;
+
+            waitUploads();
+
+            if (_size > m_stagingSize)
+            {
+                releaseStaging();
+
+                m_memStaging = CL_CHECK_ERR(clCreateBuffer(m_clContext->m_context
+                                          , CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR
+                                          , _size
+                                          , NULL
+                                          , &err
+                                          ));
+
+                // Buffer stays mapped until released.
+                m_stagingPtr = CL_CHECK_ERR(clEnqueueMapBuffer(m_queue
+                                          , m_memStaging
+                                          , CL_TRUE
+                                          , CL_MAP_WRITE
+                                          , 0
+                                          , _size
+                                          , 0
+                                          , NULL
+                                          , NULL
+                                          , &err
+                                          ));
+                m_stagingSize = _size;
+            }
+
+            return m_stagingPtr;
+        }
+
+        virtual void waitUploads()
+        {
+            for (uint8_t ii = 0; ii < 2; ++ii)
+            {
+                if (NULL != m_uploadEvent[ii])
+                {
+                    const int64_t waitStartTime = bx::getHPCounter();
+                    CL_CHECK(clWaitForEvents(1, &m_uploadEvent[ii]));
+                    m_hostIdleTime += double(bx::getHPCounter() - waitStartTime)/double(bx::getHPFrequency());
+                    m_uploadTime += isProfiling() ? clEventDuration(m_uploadEvent[ii], m_uploadEvent[ii]) : 0.0;
+                    clReleaseEvent(m_uploadEvent[ii]);
+                    m_uploadEvent[ii] = NULL;
+                }
+            }
+        }
+
+        void releaseStaging()
+        {
+            if (NULL != m_memStaging)
+            {
+                waitUploads();
+                clEnqueueUnmapMemObject(m_queue, m_memStaging, m_stagingPtr, 0, NULL, NULL);
+                clFinish(m_queue);
+                clReleaseMemObject(m_memStaging);
+                m_memStaging = NULL;
+                m_stagingPtr = NULL;
+                m_stagingSize = 0;
+            }
+        }
+
+        // Returns NULL if device has no dedicated local memory, program has no tiled kernel or work-group size is not supported.
+        cl_kernel createTiledKernel(cl_program _program) const
+        {
+            if (!m_localMemory)
+            {
+                return NULL;
+            }
+
+            cl_int err;
+            cl_kernel kernel = clCreateKernel(_program, "radianceFilterTiled", &err);
+            if (CL_SUCCESS != err)
+            {
+                return NULL;
+            }
+
+            size_t maxWorkGroupSize = 0;
+            clGetKernelWorkGroupInfo(kernel, m_clContext->m_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
+            if (maxWorkGroupSize < CMFT_RADIANCE_TILE_SIZE*CMFT_RADIANCE_TILE_SIZE)
+            {
+                clReleaseKernel(kernel);
+                return NULL;
+            }
+
+            return kernel;
+        }
+
+        void setSourceArgs() const
+        {
+            // With face atlas, the same image is bound for each face.
+            // Kernels with analytic normals don't read normal images, source images are bound in their place.
+            const bool atlas = (0 != (m_mode&ModeFaceAtlas));
+            const bool analytic = (0 != (m_mode&ModeAnalyticNormals));
+
+            CL_CHECK(clSetKernelArg(m_kernel, 5, sizeof(int32_t), (const void*)&m_srcImage->m_width));
+            for (uint8_t face = 0; face < 6; ++face)
+            {
+                const cl_mem src = atlas ? m_memSrcAtlas : m_memSrcData[face];
+                const cl_mem normals = analytic ? src : (atlas ? m_memNormalAtlas : m_memNormalSolidAngle[face]);
+                CL_CHECK(clSetKernelArg(m_kernel,  6+face, sizeof(cl_mem), (const void*)&src));
+                CL_CHECK(clSetKernelArg(m_kernel, 12+face, sizeof(cl_mem), (const void*)&normals));
+            }
+        }
+
+        // Switches to the kernel variant built for the given mip parameters. Source memory has to be initialized.
+        // Variants are built on first use and kept until destroy(). Generic kernel is used if a variant can't be built.
+        void selectKernel(uint32_t _dstFaceSize, float _specularPower, float _specularAngle, float _filterSize)
+        {
+            cl_kernel kernel = m_modeKernel[m_mode];
+            cl_kernel tiledKernel = m_modeTiledKernel[m_mode];
+
+            if (NULL != m_sourceCode)
+            {
+                const uint32_t srcFaceSize = m_srcImage->m_width;
+
+                KernelVariant* variant = NULL;
+                for (uint8_t ii = 0; ii < m_numVariants; ++ii)
+                {
+                    KernelVariant& curr = m_variants[ii];
+                    if (curr.m_srcFaceSize   == srcFaceSize
+                    &&  curr.m_dstFaceSize   == _dstFaceSize
+                    &&  curr.m_specularPower == _specularPower
+                    &&  curr.m_specularAngle == _specularAngle
+                    &&  curr.m_filterSize    == _filterSize
+                    &&  curr.m_mode          == m_mode)
+                    {
+                        variant = &curr;
+                        break;
+                    }
+                }
+
+                if (NULL == variant && m_numVariants < CMFT_RADIANCE_MAX_KERNEL_VARIANTS)
+                {
+                    variant = &m_variants[m_numVariants++];
+                    variant->m_srcFaceSize   = srcFaceSize;
+                    variant->m_dstFaceSize   = _dstFaceSize;
+                    variant->m_specularPower = _specularPower;
+                    variant->m_specularAngle = _specularAngle;
+                    variant->m_filterSize    = _filterSize;
+                    variant->m_mode          = m_mode;
+                    variant->m_kernel        = NULL;
+                    variant->m_tiledKernel   = NULL;
+                    variant->m_memLobeTable  = NULL;
+
+                    // Hexadecimal float literals keep the values exact.
+                    char modeOptions[96];
+                    modeBuildOptions(modeOptions, m_mode);
+
+                    // Lobe table is the same as on the CPU, so both look up the same weights.
+                    char lobeOptions[128] = "";
+#if CMFT_RADIANCE_LOBE_TABLE
+                    RadianceLobeTable lobeTable;
+                    lobeTable.init(_specularPower, _specularAngle);
+
+                    cl_int memErr;
+                    variant->m_memLobeTable = clCreateBuffer(m_clContext->m_context
+                                            , CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR
+                                            , sizeof(lobeTable.m_weights)
+                                            , (void*)lobeTable.m_weights
+                                            , &memErr
+                                            );
+                    if (CL_SUCCESS != memErr)
+                    {
+                        variant->m_memLobeTable = NULL;
+                    }
+                    else
+                    {
+                        sprintf(lobeOptions
+                              , " -D CMFT_LOBE_TABLE_SIZE=%u -D CMFT_LOBE_TABLE_SCALE=%af -D CMFT_LOBE_TABLE_LERP=%u"
+                              , uint32_t(RadianceLobeTable::Size)
+                              , double(lobeTable.m_scale)
+                              , uint32_t(CMFT_RADIANCE_LOBE_TABLE_LERP)
+                              );
+                    }
+#endif // CMFT_RADIANCE_LOBE_TABLE
+
+                    char options[512];
+                    sprintf(options
+                          , "-D CMFT_SRC_FACE_SIZE=%u -D CMFT_DST_FACE_SIZE=%u"
+                            " -D CMFT_SPECULAR_POWER=%af -D CMFT_SPECULAR_ANGLE=%af -D CMFT_FILTER_SIZE=%af%s%s"
+                          , srcFaceSize
+                          , _dstFaceSize
+                          , double(_specularPower)
+                          , double(_specularAngle)
+                          , double(_filterSize)
+                          , modeOptions
+                          , lobeOptions
+                          );
+
+                    // Failed variant is remembered with NULL kernel, so it isn't rebuilt for every face.
+                    variant->m_program = m_clContext->getProgram(m_sourceCode, options);
+                    if (NULL != variant->m_program)
+                    {
+                        cl_int err;
+                        variant->m_kernel = clCreateKernel(variant->m_program, m_kernelName, &err);
+                        if (CL_SUCCESS != err)
+                        {
+                            variant->m_kernel = NULL;
+                        }
+                        else
+                        {
+                            variant->m_tiledKernel = createTiledKernel(variant->m_program);
+                        }
+                    }
+
+                    // Table follows the last parameter, which is the filter size with bounded and tiled kernels.
+                    if (NULL != variant->m_memLobeTable)
+                    {
+                        const cl_uint lobeTableArg = m_bounded ? 19 : 18;
+                        if (NULL != variant->m_kernel)
+                        {
+                            CL_CHECK(clSetKernelArg(variant->m_kernel, lobeTableArg, sizeof(cl_mem), (const void*)&variant->m_memLobeTable));
+                        }
+
+                        if (NULL != variant->m_tiledKernel)
+                        {
+                            CL_CHECK(clSetKernelArg(variant->m_tiledKernel, 19, sizeof(cl_mem), (const void*)&variant->m_memLobeTable));
+                        }
+                    }
+
+                    if (NULL == variant->m_kernel)
+                    {
+                        WARN("Could not build specialized OpenCL kernel for %u face size, using generic kernel.", _dstFaceSize);
+                    }
+                }
+
+                if (NULL != variant && NULL != variant->m_kernel)
+                {
+                    kernel = variant->m_kernel;
+                    tiledKernel = variant->m_tiledKernel;
+                }
+            }
+
+            // Work-group shares source blocks once filter areas of its texels overlap, that is when
+            // filter area is wider than the work-group footprint. Otherwise the union of areas is mostly wasted work.
+            m_tiled = (NULL != tiledKernel && 2.0f*_filterSize*float(_dstFaceSize) >= float(CMFT_RADIANCE_TILE_SIZE));
+            if (m_tiled)
+            {
+                kernel = tiledKernel;
+            }
+
+            // Kernel arguments are per kernel object, source arguments are set again on every switch.
+            if (kernel != m_kernel)
+            {
+                m_kernel = kernel;
+                setSourceArgs();
+            }
+        }
+
+        void setupOutputBuffer(uint8_t _slot, uint32_t _dstFaceSize, bool _halfDst)
+        {
+            cl_int err;
+
+            // Buffer of the slot is kept while subsequent faces have the same size and format.
+            if (NULL == m_memOut[_slot]
+            ||  m_outFaceSize[_slot] != _dstFaceSize
+            ||  m_halfOut[_slot] != _halfDst)
+            {
+                releaseMem(m_memOut[_slot]);
+                releaseMem(m_memEncoded[_slot]);
+
+                // Results are read back as they are, so output image has the same format as the destination.
+                // With encoding, the output image stays on the device and is read by the encode kernel.
+                const cl_image_format imageFormat = { CL_RGBA, cl_channel_type(_halfDst ? CL_HALF_FLOAT : CL_FLOAT) };
+                m_memOut[_slot] = CL_CHECK_ERR(m_clContext->acquireImage2D(canEncode() ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY
+                                , imageFormat
+                                , _dstFaceSize
+                                , _dstFaceSize
+                                , &err
+                                ));
+
+                if (canEncode())
+                {
+                    m_memEncoded[_slot] = CL_CHECK_ERR(m_clContext->acquireBuffer(CL_MEM_WRITE_ONLY
+                                        , size_t(_dstFaceSize)*_dstFaceSize*4
+                                        , &err
+                                        ));
+                }
+
+                m_outFaceSize[_slot] = _dstFaceSize;
+                m_halfOut[_slot] = _halfDst;
+            }
+
+            CL_CHECK(clSetKernelArg(m_kernel, 0, sizeof(cl_mem), (const void*)&m_memOut[_slot]));
+        }
+
+        void setArgs(uint8_t _faceId, uint32_t _dstFaceSize, float _specularPower, float _specularAngle, float _filterSize) const
+        {
+            CL_CHECK(clSetKernelArg(m_kernel, 1, sizeof(float),   (const void*)&_specularPower));
+            CL_CHECK(clSetKernelArg(m_kernel, 2, sizeof(float),   (const void*)&_specularAngle));
+            CL_CHECK(clSetKernelArg(m_kernel, 3, sizeof(int32_t), (const void*)&_dstFaceSize));
+            CL_CHECK(clSetKernelArg(m_kernel, 4, sizeof(uint8_t), (const void*)&_faceId));
+
+            // Only bounded kernel takes filter size.
+            if (m_bounded)
+            {
+                CL_CHECK(clSetKernelArg(m_kernel, 18, sizeof(float), (const void*)&_filterSize));
+            }
+        }
+
+        // Enqueues the kernel with current arguments over rows [_yBegin, _yEnd) in dispatches of about _dispatchRows rows,
+        // so a single dispatch doesn't run into driver watchdogs. Events of the first and the last dispatch are returned.
+        void enqueueBands(cl_event& _first, cl_event& _last, uint32_t _dstFaceSize, uint32_t _yBegin, uint32_t _yEnd, uint32_t _dispatchRows)
+        {
+            // Tiled kernel has fixed work-group size, bands are multiples of it. Without work offsets, rows go in a single dispatch.
+            const uint32_t rows = _yEnd - _yBegin;
+            uint32_t dispatchRows = m_rowOffsets ? min(max(_dispatchRows, uint32_t(1)), rows) : rows;
+            if (m_tiled)
+            {
+                dispatchRows = (dispatchRows + CMFT_RADIANCE_TILE_SIZE-1)/CMFT_RADIANCE_TILE_SIZE*CMFT_RADIANCE_TILE_SIZE;
+            }
+
+            // Kernel maps first dimension to destination rows.
+            // Tiled kernel global size is rounded up to the work-group size, rows past _yEnd are not read back.
+            // Queue is in order, readback waits for the last dispatch only.
+            for (uint32_t yy = _yBegin; yy < _yEnd; yy += dispatchRows)
+            {
+                if (NULL != _last
+                &&  _first != _last)
+                {
+                    clReleaseEvent(_last);
+                }
+
+                const uint32_t bandRows = min(dispatchRows, _yEnd - yy);
+                const size_t workOffset[2] = { yy, 0 };
+                if (m_tiled)
+                {
+                    const size_t localSize[2] = { CMFT_RADIANCE_TILE_SIZE, CMFT_RADIANCE_TILE_SIZE };
+                    const size_t workSize[2] =
+                    {
+                        (bandRows     + CMFT_RADIANCE_TILE_SIZE-1)/CMFT_RADIANCE_TILE_SIZE*CMFT_RADIANCE_TILE_SIZE,
+                        (_dstFaceSize + CMFT_RADIANCE_TILE_SIZE-1)/CMFT_RADIANCE_TILE_SIZE*CMFT_RADIANCE_TILE_SIZE,
+                    };
+                    CL_CHECK(clEnqueueNDRangeKernel(m_queue, m_kernel, 2, (0 != yy) ? workOffset : NULL, workSize, localSize, 0, NULL, &_last));
+                }
+                else
+                {
+                    const size_t workSize[2] = { bandRows, _dstFaceSize };
+                    CL_CHECK(clEnqueueNDRangeKernel(m_queue, m_kernel, 2, (0 != yy) ? workOffset : NULL, workSize, NULL, 0, NULL, &_last));
+                }
+
+                // Each band is sent to the device on its own.
+                clFlush(m_queue);
+
+                _first = (NULL != _first) ? _first : _last;
+            }
+        }
+
+        // Filters the whole face into _dst, an image over a shared texture of the graphics API. Nothing is read back.
+        void submitShared(cl_mem _dst, uint32_t _dstFaceSize, uint32_t _dispatchRows)
+        {
+            CL_CHECK(clSetKernelArg(m_kernel, 0, sizeof(cl_mem), (const void*)&_dst));
+
+            cl_event firstEvent = NULL;
+            cl_event lastEvent = NULL;
+            enqueueBands(firstEvent, lastEvent, _dstFaceSize, 0, _dstFaceSize, _dispatchRows);
+
+            if (firstEvent != lastEvent)
+            {
+                clReleaseEvent(lastEvent);
+            }
+            clReleaseEvent(firstEvent);
+        }
+
+        // Enqueues the kernel with current arguments and a non-blocking read of the slot output into _out. Returns immediately.
+        // Kernel arguments are captured on enqueue, so they can be set up for the next face right away.
+        // Only rows [_yBegin, _yEnd) of the face are processed and read back, _out points to the whole face.
+        // Rows are filtered in dispatches of about _dispatchRows rows, so a single dispatch doesn't run into driver watchdogs.
+        // With _encode, output is packed on the device and only packed texels (4 bytes each) are read back, rows have to start at 0.
+        void submit(uint8_t _slot, void* _out, uint32_t _dstFaceSize, uint32_t _yBegin, uint32_t _yEnd, uint32_t _dispatchRows, bool _encode = false)
+        {
+            CMFT_PROFILE_ZONE("RadianceProgram::submit");
+
+            cl_command_queue readQueue = (NULL != m_readQueue) ? m_readQueue : m_queue;
+            const uint32_t rows = _yEnd - _yBegin;
+
+            cl_event firstEvent = NULL;
+            cl_event kernelEvent = NULL;
+            enqueueBands(firstEvent, kernelEvent, _dstFaceSize, _yBegin, _yEnd, _dispatchRows);
+
+            // Rows of the destination wrapped for the device, packed texels are written there by the encode kernel directly.
+            const uint32_t outBytesPerPixel = _encode ? 4 : 4 /*numChannels*/ * (m_halfOut[_slot] ? 2 : 4) /*bytesPerChannel*/;
+            const size_t outSize = size_t(_dstFaceSize)*rows*outBytesPerPixel;
+            void* outRows = (uint8_t*)_out + size_t(_yBegin)*_dstFaceSize*outBytesPerPixel;
+            DEBUG_CHECK(NULL == m_memHostOut[_slot], "Slot has to be waited for before it is submitted again.");
+            if (m_hostPtrReadback)
+            {
+                cl_int err;
+                m_memHostOut[_slot] = clCreateBuffer(m_clContext->m_context
+                                                   , CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR
+                                                   , outSize
+                                                   , outRows
+                                                   , &err
+                                                   );
+                if (CL_SUCCESS != err)
+                {
+                    m_memHostOut[_slot] = NULL;
+                }
+            }
+            cl_mem encodedMem = (NULL != m_memHostOut[_slot]) ? m_memHostOut[_slot] : m_memEncoded[_slot];
+
+            if (_encode)
+            {
+                // In-order queue, encoding starts after filtering is done.
+                keepKernelEvents(_slot, firstEvent, kernelEvent);
+
+                DEBUG_CHECK(0 == _yBegin, "Encoded rows have to start at the top of the face.");
+
+                const int32_t faceSize = int32_t(_dstFaceSize);
+                CL_CHECK(clSetKernelArg(m_encodeKernel, 0, sizeof(cl_mem),  (const void*)&m_memOut[_slot]));
+                CL_CHECK(clSetKernelArg(m_encodeKernel, 1, sizeof(cl_mem),  (const void*)&encodedMem));
+                CL_CHECK(clSetKernelArg(m_encodeKernel, 2, sizeof(int32_t), (const void*)&faceSize));
+                CL_CHECK(clSetKernelArg(m_encodeKernel, 3, sizeof(uint8_t), (const void*)&m_encodeFormat));
+                const size_t encodeWorkSize[2] = { _dstFaceSize, rows };
+                CL_CHECK(clEnqueueNDRangeKernel(m_queue, m_encodeKernel, 2, NULL, encodeWorkSize, NULL, 0, NULL, &kernelEvent));
+            }
+
+            if (NULL != m_memHostOut[_slot])
+            {
+                cl_event mapWait = kernelEvent;
+                if (!_encode)
+                {
+                    const size_t origin[3] = { 0, _yBegin, 0 };
+                    const size_t region[3] = { _dstFaceSize, rows, 1 };
+                    CL_CHECK(clEnqueueCopyImageToBuffer(readQueue
+                                                      , m_memOut[_slot]
+                                                      , m_memHostOut[_slot]
+                                                      , origin
+                                                      , region
+                                                      , 0
+                                                      , 1
+                                                      , &kernelEvent
+                                                      , &m_hostCopyEvent[_slot]
+                                                      ));
+                    mapWait = m_hostCopyEvent[_slot];
+                }
+
+                // Mapping makes results visible to the host, pointer returned is the destination itself.
+                cl_int err;
+                m_hostOutPtr[_slot] = CL_CHECK_ERR(clEnqueueMapBuffer(readQueue
+                                                 , m_memHostOut[_slot]
+                                                 , CL_FALSE
+                                                 , CL_MAP_READ
+                                                 , 0
+                                                 , outSize
+                                                 , 1
+                                                 , &mapWait
+                                                 , &m_readEvent[_slot]
+                                                 , &err
+                                                 ));
+            }
+            else if (_encode)
+            {
+                m_bytesFromDevice += uint64_t(_dstFaceSize)*rows*4;
+                CL_CHECK(clEnqueueReadBuffer(readQueue
+                                           , m_memEncoded[_slot]
+                                           , CL_FALSE
+                                           , 0
+                                           , size_t(_dstFaceSize)*rows*4
+                                           , _out
+                                           , 1
+                                           , &kernelEvent
+                                           , &m_readEvent[_slot]
+                                           ));
+            }
+            else
+            {
+                const size_t origin[3] = { 0, _yBegin, 0 };
+                const size_t region[3] = { _dstFaceSize, rows, 1 };
+                m_bytesFromDevice += outSize;
+                CL_CHECK(clEnqueueReadImage(readQueue
+                                          , m_memOut[_slot]
+                                          , CL_FALSE
+                                          , origin
+                                          , region
+                                          , _dstFaceSize*outBytesPerPixel
+                                          , 0
+                                          , outRows
+                                          , 1
+                                          , &kernelEvent
+                                          , &m_readEvent[_slot]
+                                          ));
+            }
+            if (_encode)
+            {
+                keepEvent(m_encodeEvent[_slot], kernelEvent);
+            }
+            else
+            {
+                keepKernelEvents(_slot, firstEvent, kernelEvent);
+            }
+
+            clFlush(m_queue);
+            clFlush(readQueue);
+        }
+
+        virtual void filterRows(uint8_t _slot
+                              , const RadianceFilterParams& _params
+                              , void* _out
+                              , uint32_t _yBegin
+                              , uint32_t _yEnd
+                              , uint32_t _dispatchRows
+                              , bool _encode
+                              )
+        {
+            selectKernel(_params.m_mipFaceSize, _params.m_specularPower, _params.m_specularAngle, _params.m_filterSize);
+            setupOutputBuffer(_slot, _params.m_mipFaceSize, _params.m_halfDst);
+            setArgs(_params.m_face, _params.m_mipFaceSize, _params.m_specularPower, _params.m_specularAngle, _params.m_filterSize);
+            submit(_slot, _out, _params.m_mipFaceSize, _yBegin, _yEnd, _dispatchRows, _encode);
+        }
+
+        // Blocks until results of the slot are in host memory.
+        virtual void wait(uint8_t _slot)
+        {
+            CMFT_PROFILE_ZONE("RadianceProgram::wait");
+
+            if (NULL != m_readEvent[_slot])
+            {
+                const int64_t waitStartTime = bx::getHPCounter();
+                CL_CHECK(clWaitForEvents(1, &m_readEvent[_slot]));
+                m_hostIdleTime += double(bx::getHPCounter() - waitStartTime)/double(bx::getHPFrequency());
+
+                // Readback waits for the kernels, so their events are complete as well.
+                // With results mapped in place, read time spans the copy out of the output image and the map.
+                const cl_event readStart = (NULL != m_hostCopyEvent[_slot]) ? m_hostCopyEvent[_slot] : m_readEvent[_slot];
+                m_taskReadTime = isProfiling() ? clEventDuration(readStart, m_readEvent[_slot]) : 0.0;
+                m_taskKernelTime = releaseEvents(m_kernelEvent[_slot], m_lastKernelEvent[_slot])
+                                 + releaseEvents(m_encodeEvent[_slot], m_encodeEvent[_slot])
+                                 ;
+                m_readTime += m_taskReadTime;
+                m_kernelTime += m_taskKernelTime;
+
+                clReleaseEvent(m_readEvent[_slot]);
+                m_readEvent[_slot] = NULL;
+
+                if (NULL != m_hostCopyEvent[_slot])
+                {
+                    clReleaseEvent(m_hostCopyEvent[_slot]);
+                    m_hostCopyEvent[_slot] = NULL;
+                }
+            }
+
+            // Results stay in the destination, buffer over it is dropped. Release is deferred by the runtime until unmapped.
+            if (NULL != m_memHostOut[_slot])
+            {
+                cl_command_queue readQueue = (NULL != m_readQueue) ? m_readQueue : m_queue;
+                CL_CHECK(clEnqueueUnmapMemObject(readQueue, m_memHostOut[_slot], m_hostOutPtr[_slot], 0, NULL, NULL));
+                clReleaseMemObject(m_memHostOut[_slot]);
+                m_memHostOut[_slot] = NULL;
+                m_hostOutPtr[_slot] = NULL;
+            }
+        }
+
+        // Kernel events are only kept for profiling, they are released right away otherwise.
+        void keepEvent(cl_event& _dst, cl_event _event)
+        {
+            if (isProfiling())
+            {
+                _dst = _event;
+            }
+            else
+            {
+                clReleaseEvent(_event);
+            }
+        }
+
+        // Keeps first and last filter dispatch of the slot, kernel time of the slot is measured from one to the other.
+        void keepKernelEvents(uint8_t _slot, cl_event _first, cl_event _last)
+        {
+            if (_first != _last)
+            {
+                keepEvent(m_lastKernelEvent[_slot], _last);
+            }
+            keepEvent(m_kernelEvent[_slot], _first);
+        }
+
+        // Releases kept events and returns device time from the start of _first to the end of _last, which may be NULL
+        // or the same as _first for a single command.
+        double releaseEvents(cl_event& _first, cl_event& _last)
+        {
+            if (NULL == _first)
+            {
+                return 0.0;
+            }
+
+            const bool single = (NULL == _last || _first == _last);
+            const double duration = clEventDuration(_first, single ? _first : _last);
+            clReleaseEvent(_first);
+            if (!single)
+            {
+                clReleaseEvent(_last);
+            }
+            _first = NULL;
+            _last = NULL;
+
+            return duration;
+        }
+
+        void finish()
+        {
+            for (uint8_t ii = 0; ii < CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT; ++ii)
+            {
+                wait(ii);
+            }
+            clFinish(m_queue);
+        }
+
+        virtual const Image* getSource() const
+        {
+            return m_srcImage;
+        }
+
+        virtual void setSource(const Image& _imageRgba32f, const float* _cubemapNormalSolidAngle)
+        {
+            releaseDeviceMemory();
+            initDeviceMemory(_imageRgba32f, _cubemapNormalSolidAngle);
+        }
+
+        virtual bool hasHostUnifiedMemory() const
+        {
+            return m_hostUnifiedMemory;
+        }
+
+        virtual void getStats(ComputeDeviceStats& _stats) const
+        {
+            _stats.m_bytesToDevice   = m_bytesToDevice;
+            _stats.m_bytesFromDevice = m_bytesFromDevice;
+            _stats.m_uploadTime      = m_uploadTime;
+            _stats.m_kernelTime      = m_kernelTime;
+            _stats.m_readTime        = m_readTime;
+            _stats.m_hostIdleTime    = m_hostIdleTime;
+        }
+
+        virtual double getTaskKernelTime() const
+        {
+            return m_taskKernelTime;
+        }
+
+        virtual double getTaskReadTime() const
+        {
+            return m_taskReadTime;
+        }
+
+        void releaseDeviceMemory()
+        {
+            for (uint8_t ii = 0; ii < CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT; ++ii)
+            {
+                releaseMem(m_memOut[ii]);
+                releaseMem(m_memEncoded[ii]);
+                m_outFaceSize[ii] = 0;
+            }
+            if (m_sharedSrc)
+            {
+                for (uint8_t face = 0; face < 6; ++face)
+                {
+                    m_memSrcData[face] = NULL;
+                }
+                m_sharedSrc = false;
+            }
+            releaseMem(m_memSrcData[0]);
+            releaseMem(m_memSrcData[1]);
+            releaseMem(m_memSrcData[2]);
+            releaseMem(m_memSrcData[3]);
+            releaseMem(m_memSrcData[4]);
+            releaseMem(m_memSrcData[5]);
+            releaseMem(m_memNormalSolidAngle[0]);
+            releaseMem(m_memNormalSolidAngle[1]);
+            releaseMem(m_memNormalSolidAngle[2]);
+            releaseMem(m_memNormalSolidAngle[3]);
+            releaseMem(m_memNormalSolidAngle[4]);
+            releaseMem(m_memNormalSolidAngle[5]);
+            releaseMem(m_memSrcAtlas);
+            releaseMem(m_memNormalAtlas);
+
+            // Host memory atlases are released above, nothing in flight reads them anymore.
+            free(m_hostCopy);
+            m_hostCopy = NULL;
+
+            m_srcImage = NULL;
+        }
+
+        void destroy()
+        {
+            if (NULL != m_program)
+            {
+                clReleaseProgram(m_program);
+                m_program = NULL;
+            }
+
+            for (uint8_t ii = 0; ii < m_numVariants; ++ii)
+            {
+                if (NULL != m_variants[ii].m_kernel)
+                {
+                    clReleaseKernel(m_variants[ii].m_kernel);
+                }
+
+                if (NULL != m_variants[ii].m_tiledKernel)
+                {
+                    clReleaseKernel(m_variants[ii].m_tiledKernel);
+                }
+
+                if (NULL != m_variants[ii].m_program)
+                {
+                    clReleaseProgram(m_variants[ii].m_program);
+                }
+
+                if (NULL != m_variants[ii].m_memLobeTable)
+                {
+                    clReleaseMemObject(m_variants[ii].m_memLobeTable);
+                }
+            }
+            m_numVariants = 0;
+
+            for (uint8_t ii = 0; ii < ModeCount; ++ii)
+            {
+                if (NULL != m_modeKernel[ii])
+                {
+                    clReleaseKernel(m_modeKernel[ii]);
+                    m_modeKernel[ii] = NULL;
+                }
+
+                if (NULL != m_modeTiledKernel[ii])
+                {
+                    clReleaseKernel(m_modeTiledKernel[ii]);
+                    m_modeTiledKernel[ii] = NULL;
+                }
+
+                if (NULL != m_modeProgram[ii])
+                {
+                    clReleaseProgram(m_modeProgram[ii]);
+                    m_modeProgram[ii] = NULL;
+                }
+            }
+            m_mode = 0;
+            m_modeFailed = 0;
+
+            releaseStaging();
+            m_kernel = NULL;
+            m_tiled = false;
+
+            if (NULL != m_encodeKernel)
+            {
+                clReleaseKernel(m_encodeKernel);
+                m_encodeKernel = NULL;
+            }
+
+            releaseBatchMemory();
+            if (NULL != m_batchKernel)
+            {
+                clReleaseKernel(m_batchKernel);
+                m_batchKernel = NULL;
+            }
+
+            if (NULL != m_readQueue)
+            {
+                clReleaseCommandQueue(m_readQueue);
+                m_readQueue = NULL;
+            }
+
+            if (NULL != m_profileQueue)
+            {
+                clReleaseCommandQueue(m_profileQueue);
+                m_profileQueue = NULL;
+                m_queue = (NULL != m_clContext) ? m_clContext->m_commandQueue : NULL;
+            }
+        }
+
+        // Source layouts kernels are built for, see CMFT_ANALYTIC_NORMALS, CMFT_FACE_ATLAS and CMFT_COMPACT_NORMALS in radiance.h.
+        enum
+        {
+            ModeAnalyticNormals = 0x1,
+            ModeFaceAtlas       = 0x2,
+            ModeCompactNormals  = 0x4,
+
+            ModeCount = 8,
+        };
+
+        struct KernelVariant
+        {
+            uint32_t m_srcFaceSize;
+            uint32_t m_dstFaceSize;
+            float m_specularPower;
+            float m_specularAngle;
+            float m_filterSize;
+            uint8_t m_mode;
+            cl_program m_program;
+            cl_kernel m_kernel;
+            cl_kernel m_tiledKernel;
+            cl_mem m_memLobeTable; //!< Lobe weights passed as the last kernel argument, NULL if the variant evaluates pow().
+        };
+
+        const ClContext* m_clContext;
+        cl_command_queue m_queue;        //!< Kernels and uploads are enqueued here, either context queue or m_profileQueue.
+        cl_command_queue m_profileQueue; //!< Queue with profiling enabled owned by the program, NULL without m_profiling.
+        bool m_profiling;                //!< Create m_profileQueue, see FilterSettings::m_gpuProfiling.
+        cl_program m_program;
+        cl_kernel m_kernel;        //!< Currently selected kernel.
+        cl_program m_modeProgram[ModeCount]; //!< Generic program for each source mode, except the default one which is m_program.
+        cl_kernel m_modeKernel[ModeCount];
+        cl_kernel m_modeTiledKernel[ModeCount];
+        cl_kernel m_encodeKernel;
+        cl_kernel m_batchKernel;   //!< radianceFilterBatch, NULL if the program doesn't have it.
+        cl_command_queue m_readQueue;
+        cl_mem m_memOut[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        cl_mem m_memEncoded[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        cl_mem m_memHostOut[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];          //!< Buffer over the destination of the slot, mapped until wait(). NULL when read back.
+        void* m_hostOutPtr[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        cl_event m_hostCopyEvent[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];    //!< Copy from the output image into m_memHostOut, kept when profiling.
+        cl_event m_readEvent[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        cl_event m_kernelEvent[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];     //!< First filter dispatch of the slot, kept until the readback is done when profiling.
+        cl_event m_lastKernelEvent[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT]; //!< Last filter dispatch, NULL if the slot was filtered in a single dispatch.
+        cl_event m_encodeEvent[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        uint32_t m_outFaceSize[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        bool m_halfOut[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        cl_mem m_memSrcData[6];
+        cl_mem m_memNormalSolidAngle[6];
+        cl_mem m_memSrcAtlas;
+        cl_mem m_memNormalAtlas;
+        cl_mem m_memStaging;
+        void* m_stagingPtr;
+        size_t m_stagingSize;
+        void* m_hostCopy;          //!< Allocation of source faces gathered for host memory atlases, NULL if they are used in place.
+        cl_mem m_memBatchAtlas;
+        cl_mem m_memBatchTasks;
+        cl_mem m_memBatchOut;
+        RadianceBatchTask* m_batchTasks;
+        const Image** m_batchSources;
+        uint32_t m_batchCellSize;  //!< Cell size batch memory was allocated for, 0 if there is none.
+        cl_event m_uploadEvent[2];
+        const Image* m_srcImage;
+        bool m_sharedSrc;       //!< Source faces are images over shared textures, they are released by whoever created them.
+        const char* m_sourceCode;
+        const char* m_kernelName;
+        uint64_t m_globalMemSize;
+        uint64_t m_maxAllocSize;
+        uint32_t m_maxImageWidth;
+        uint32_t m_maxImageHeight;
+        KernelVariant m_variants[CMFT_RADIANCE_MAX_KERNEL_VARIANTS];
+        uint8_t m_numVariants;
+        uint8_t m_encodeFormat;
+        bool m_bounded;
+        bool m_localMemory;
+        bool m_tiled;
+        bool m_compactNormalsSupported;
+        bool m_rowOffsets; //!< Global work offsets are supported, so faces can be filtered in row bands. Not in OpenCL 1.0.
+        bool m_hostUnifiedMemory; //!< Device shares memory with the host.
+        bool m_hostPtrReadback;   //!< See CMFT_RADIANCE_GPU_HOST_PTR_READBACK.
+        uint8_t m_mode;
+        uint8_t m_modeFailed;
+        uint64_t m_bytesToDevice;
+        uint64_t m_bytesFromDevice;
+        double m_uploadTime;     //!< Device times in seconds, measured only when profiling.
+        double m_kernelTime;
+        double m_readTime;
+        double m_hostIdleTime;   //!< Time spent blocked in wait() and waitUploads().
+        double m_taskKernelTime; //!< Kernel and readback time of the last task completed by wait().
+        double m_taskReadTime;
+    };
+    int32_t radianceFilterGpu(void* _threadArgs)
+    {
+        const RadianceFilterThreadArgs* args = (const RadianceFilterThreadArgs*)_threadArgs;
+        RadianceFilterTaskList* taskList = args->m_taskList;
+        RadianceFilterStats* stats = args->m_stats;
+        ComputeDevice* device = args->m_device;
+        const uint8_t deviceIdx = uint8_t(args->m_threadIdx);
+
+        if (!device->isValid())
+        {
+            return EXIT_FAILURE;
+        }
+
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+
+        char gpuId[16];
+        if (1 == taskList->m_numDevices)
+        {
+            sprintf(gpuId, " <GPU>");
+        }
+        else
+        {
+            sprintf(gpuId, "<GPU%u>", deviceIdx);
+        }
+
+        // Faces submitted to the device, oldest first.
+        const RadianceFilterParams* inFlight[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        uint64_t inFlightStartTime[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        bool inFlightEncoded[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        uint32_t inFlightRows[CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT];
+        const RadianceFilterParams* batch[CMFT_RADIANCE_GPU_BATCH_MAX_TASKS];
+        uint8_t head = 0;
+        uint8_t numInFlight = 0;
+        uint64_t lastCompletionTime = 0;
+        uint64_t numTexels = 0;
+
+        // Gpu is processing from the top level mip map to the bottom.
+        // Up to CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT faces are queued, so the device doesn't idle during readbacks and task pickup.
+        // Faces are filtered in row bands of about CMFT_RADIANCE_GPU_DISPATCH_TIME each, sized from the measured throughput.
+        const RadianceFilterParams* next = NULL;
+        uint32_t nextYBegin = 0;
+        uint32_t nextYEnd = 0;
+        bool moreTasks = true;
+        for (;;)
+        {
+            // On cancel, only faces already queued on the device are waited for.
+            if (taskList->isCancelled())
+            {
+                next = NULL;
+                moreTasks = false;
+            }
+
+            // Small faces are filtered many at a time by a single dispatch, once faces queued one by one are done.
+            const uint32_t batchCellSize = (NULL == next && moreTasks && device->canBatch())
+                                         ? taskList->topBatchCellSize(deviceIdx, CMFT_RADIANCE_GPU_BATCH_MAX_FACE_SIZE)
+                                         : 0
+                                         ;
+            uint32_t batchCellsPerRow = 0;
+            const uint32_t batchCells = (0 != batchCellSize) ? device->maxBatchCells(batchCellSize, batchCellsPerRow) : 0;
+            const bool batchNext = (batchCells >= 6);
+            if (batchNext && 0 == numInFlight)
+            {
+                const uint64_t batchStartTime = bx::getHPCounter();
+                const double throughput = taskList->deviceThroughput(deviceIdx);
+                const double maxCost = CMFT_RADIANCE_GPU_DISPATCH_TIME*((0.0 != throughput) ? throughput : CMFT_RADIANCE_GPU_INITIAL_THROUGHPUT);
+                const uint32_t numBatched = taskList->getBatchForDevice(deviceIdx
+                                                                      , batch
+                                                                      , CMFT_RADIANCE_GPU_BATCH_MAX_TASKS
+                                                                      , batchCellSize
+                                                                      , batchCells/6
+                                                                      , uint64_t(batchCells)*batchCellSize*batchCellSize
+                                                                      , maxCost
+                                                                      );
+                if (0 == numBatched)
+                {
+                    continue;
+                }
+
+                device->filterBatch(batch, numBatched, batchCellSize);
+
+                const uint64_t currentTime = bx::getHPCounter();
+                const double batchDuration = double(currentTime - batchStartTime)*toSec;
+                lastCompletionTime = currentTime;
+
+                // Batch duration is split between faces by their cost.
+                double batchCost = 0.0;
+                for (uint32_t ii = 0; ii < numBatched; ++ii)
+                {
+                    batchCost += radianceFilterTaskCost(*batch[ii]);
+                }
+
+                for (uint32_t ii = 0; ii < numBatched; ++ii)
+                {
+                    const RadianceFilterParams& params = *batch[ii];
+                    const double share = (batchCost > 0.0) ? radianceFilterTaskCost(params)/batchCost : 1.0/double(numBatched);
+                    taskList->deviceTaskDone(deviceIdx, params, params.m_mipFaceSize, batchDuration*share);
+                    numTexels += uint64_t(params.m_mipFaceSize)*params.m_mipFaceSize;
+                    stats->incrCompletedTasksGpu(deviceIdx);
+                    taskList->reportFace(params);
+                }
+                taskList->reportProgress();
+
+                INFO("Radiance -> %-8s| %4u | %7.3fs | %7.3fs | batch of %u faces"
+                    , gpuId
+                    , batch[0]->m_mipFaceSize
+                    , batchDuration
+                    , double(currentTime - stats->m_startTime)*toSec
+                    , numBatched
+                    );
+
+                continue;
+            }
+
+            if (!batchNext && NULL == next && moreTasks && numInFlight < CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT)
+            {
+                next = taskList->getForDevice(deviceIdx, device->getSource(), device->canFilterRows(), nextYBegin, nextYEnd);
+                moreTasks = (NULL != next);
+            }
+
+            // Source cubemap is only replaced once faces of the previous one are done.
+            if (NULL != next
+            &&  numInFlight < CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT
+            &&  (next->m_imageRgba32f == device->getSource() || 0 == numInFlight))
+            {
+                // Upload source cubemap when moving on to the next cubemap of a batch.
+                if (next->m_imageRgba32f != device->getSource())
+                {
+                    device->setSource(*next->m_imageRgba32f, next->m_cubemapVectors);
+                }
+
+                // Enqueue processing job and readback. Faces shared with CPU threads are packed on the host.
+                const uint8_t slot = uint8_t((head + numInFlight) % CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT);
+                const uint32_t rows = nextYEnd - nextYBegin;
+                const bool encode = (NULL != next->m_encodedDstPtr && device->canEncode() && rows == next->m_mipFaceSize);
+                const uint32_t dispatchRows = radianceGpuDispatchRows(*next, taskList->deviceThroughput(deviceIdx));
+                inFlightStartTime[slot] = bx::getHPCounter();
+                device->filterRows(slot, *next, encode ? next->m_encodedDstPtr : next->m_dstPtr, nextYBegin, nextYEnd, dispatchRows, encode);
+                inFlight[slot] = next;
+                inFlightEncoded[slot] = encode;
+                inFlightRows[slot] = rows;
+                numInFlight++;
+
+                next = NULL;
+                continue;
+            }
+
+            if (0 == numInFlight)
+            {
+                break;
+            }
+
+            // Wait for the oldest face.
+            const RadianceFilterParams* params = inFlight[head];
+            const uint64_t startTime = inFlightStartTime[head];
+            const uint32_t rows = inFlightRows[head];
+            device->wait(head);
+            *params->m_encoded = inFlightEncoded[head];
+            numTexels += uint64_t(rows)*params->m_mipFaceSize;
+            head = uint8_t((head + 1) % CMFT_RADIANCE_GPU_TASKS_IN_FLIGHT);
+            numInFlight--;
+
+            // Determine task duration. Queued faces overlap, throughput is measured from the time between completions.
+            const uint64_t currentTime = bx::getHPCounter();
+            const uint64_t taskDuration = currentTime - startTime;
+            const uint64_t totalDuration = currentTime - stats->m_startTime;
+            const uint64_t deviceDuration = currentTime - max(startTime, lastCompletionTime);
+            lastCompletionTime = currentTime;
+
+            // Face shared with CPU threads is reported by whoever finishes it.
+            const bool faceDone = taskList->deviceTaskDone(deviceIdx, *params, rows, double(deviceDuration)*toSec);
+            taskList->reportProgress();
+            if (!faceDone)
+            {
+                continue;
+            }
+
+            // Output process info. Profiled device also reports device times of the last part of the face.
+            if (device->isProfiling())
+            {
+                INFO("Radiance -> %-8s| %4u | %7.3fs | %7.3fs | kernel %7.3fs | read %7.3fs"
+                    , gpuId
+                    , params->m_mipFaceSize
+                    , double(taskDuration)*toSec
+                    , double(totalDuration)*toSec
+                    , device->getTaskKernelTime()
+                    , device->getTaskReadTime()
+                    );
+            }
+            else
+            {
+                INFO("Radiance -> %-8s| %4u | %7.3fs | %7.3fs"
+                    , gpuId
+                    , params->m_mipFaceSize
+                    , double(taskDuration)*toSec
+                    , double(totalDuration)*toSec
+                    );
+            }
+
+            // Update task counter.
+            stats->incrCompletedTasksGpu(deviceIdx);
+
+            taskList->reportFace(*params);
+        }
+
+        stats->addTexelsGpu(deviceIdx, numTexels);
+
+        // All tasks are done, so are the uploads. Their events are released here to have upload times before stats are read.
+        device->waitUploads();
+
+        return EXIT_SUCCESS;
+    }
+
+    static void radianceFilterGpuTask(void* _threadArgs, uint32_t _taskIdx)
+    {
+        RadianceFilterThreadArgs* threadArgs = (RadianceFilterThreadArgs*)_threadArgs;
+        radianceFilterGpu((void*)&threadArgs[_taskIdx]);
+    }
+
+    static const char* s_lightingModelStr[LightingModel::Count] =
+    {
+        "phong",
+        "phongbrdf",
+        "blinn",
+        "blinnbrdf",
+    };
+
+    const char* getLightingModelStr(LightingModel::Enum _lightingModel)
+    {
+        DEBUG_CHECK(_lightingModel < LightingModel::Count, "Reading array out of bounds!");
+        return s_lightingModelStr[uint8_t(_lightingModel)];
+    }
+
+    /// Returns the angle of cosine power function where the results are above the lobe tolerance, see FilterSettings::m_lobeTolerance.
+    static float cosinePowerFilterAngle(float _cosinePower, float _tolerance)
+    {
+        // Bigger value leads to performance improvement but might hurt the results.
+        const float treshold = clamp(_tolerance, FLT_MIN, 0.5f);
+
+        // Cosine power filter is: pow(cos(angle), power).
+        // We want the value of the angle above each result is <= treshold.
+        // So: angle = acos(pow(treshold, 1.0 / power))
+        return acosf(powf(treshold, 1.0f / _cosinePower));
+    }
+
+    /// Fraction of energy of lobe pow(cos, _cosinePower) outside of _cosAngle. Integral of the lobe over the solid angle of
+    /// the cap is 2pi*(1 - pow(cos, power+1))/(power+1), of which the hemisphere is the whole.
+    static inline float cosinePowerEnergyLoss(float _cosinePower, float _cosAngle)
+    {
+        return (0.0f < _cosAngle) ? powf(_cosAngle, _cosinePower + 1.0f) : 0.0f;
+    }
+
+    float applyLightningModel(float _specularPowerRef, LightingModel::Enum _lightingModel)
+    {
+        /// http://seblagarde.wordpress.com/2012/06/10/amd-cubemapgen-for-physically-based-rendering/
+        /// http://seblagarde.wordpress.com/2012/03/29/relationship-between-phong-and-blinn-lighting-model/
+        switch (_lightingModel)
+        {
+        case LightingModel::Phong:
+            {
+                return _specularPowerRef;
+            }
+        break;
+
+        case LightingModel::PhongBrdf:
+            {
+                return _specularPowerRef + 1.0f;
+            }
+        break;
+
+        case LightingModel::Blinn:
+            {
+                return _specularPowerRef/4.0f;
+            }
+        break;
+
+        case LightingModel::BlinnBrdf:
+            {
+                return _specularPowerRef/4.0f + 1.0f;
+            }
+        break;
+
+        default:
+            {
+                DEBUG_CHECK(false, "ERROR! This should never happen!");
+                WARN("Lighting model error. Please check for invalid parameters!");
+                return _specularPowerRef;
+            }
+        break;
+        };
+    }
+
+    /// Per source cubemap state of a radiance filter batch.
+    /// Downsampled copy of the source cubemap. Rougher mips are filtered from these instead of the full resolution source.
+    struct RadianceFilterSource
+    {
+        Image m_image;
+        uint64_t m_faceOffsets[CUBE_FACE_NUM];
+        const float* m_cubemapVectors;
+        SoaCubemap m_normalsSoa;
+        SoaCubemap m_colorsSoa;
+    };
+
+    struct RadianceFilterJob
+    {
+        ~RadianceFilterJob();
+
+        Image m_imageRgba32f; // RGBA16F with half precision source.
+        bool m_imageIsRef;
+        bool m_halfDst;
+        void* m_dstData;
+        uint64_t m_dstDataSize;
+        uint32_t m_dstFaceSize;
+        uint8_t m_mipCount;
+        uint64_t m_srcFaceOffsets[CUBE_FACE_NUM];
+        uint64_t m_dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        const float* m_cubemapVectors;
+        const SoaCubemap* m_normals;
+        SoaCubemap m_normalsSoa;
+        SoaCubemap m_colorsSoa;
+        RadianceFilterSource m_sources[MAX_MIP_NUM]; // Level 0 is unused, m_imageRgba32f is the level 0 source.
+        uint8_t m_numSources;
+        void* m_encodedData; // Destination packed to the GPU encode format, NULL without GPU encoding.
+        bool m_encoded[CUBE_FACE_NUM][MAX_MIP_NUM];
+        void* m_finalData; // Streaming only, output in the source format. m_dstData then holds mips of the current pass.
+        uint64_t m_finalDataSize;
+        uint64_t m_finalOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        TextureFormat::Enum m_finalFormat;
+#if CMFT_RADIANCE_SH_ORDER
+        bool m_shMip[MAX_MIP_NUM]; // Mip is convolved in the SH domain instead of being filtered by a task.
+        double m_shLobes[MAX_MIP_NUM][CMFT_RADIANCE_SH_ORDER]; // Zonal lobe coefficient of each band.
+        double (*m_shCoeffs)[3]; // SH projection of the source, computed with the first SH mip.
+#endif // CMFT_RADIANCE_SH_ORDER
+        RadianceLobeTable m_lobeTables[MAX_MIP_NUM];
+        RadianceFilterJob* m_sourceJob; // Job of the first output of the same source, it owns the working source, pyramid and SoA copies.
+        uint32_t m_reuseJob[MAX_MIP_NUM]; // Job whose mip is copied instead of filtering this one, UINT32_MAX if there is none.
+        uint8_t m_reuseMip[MAX_MIP_NUM];
+    };
+
+    // Out of line, the SoA copies and sources make it too big to inline at every job array.
+    RadianceFilterJob::~RadianceFilterJob()
+    {
+    }
+
+    /// Source pyramid levels are used only if each filter angle still covers this many source texels.
+#ifndef CMFT_RADIANCE_SOURCE_TEXELS_PER_FILTER_ANGLE
+    #define CMFT_RADIANCE_SOURCE_TEXELS_PER_FILTER_ANGLE 8
+#endif //CMFT_RADIANCE_SOURCE_TEXELS_PER_FILTER_ANGLE
+
+    /// Output mips of at most this face size are filtered from the full source. Their lobes are the widest ones, so coarse levels
+    /// that resolve the filter angle still place texels by their centers only, while the few destination texels cost next to nothing.
+#ifndef CMFT_RADIANCE_SOURCE_FULL_MIP_SIZE
+    #define CMFT_RADIANCE_SOURCE_FULL_MIP_SIZE 2
+#endif //CMFT_RADIANCE_SOURCE_FULL_MIP_SIZE
+
+    /// Picks the smallest source pyramid level that is not smaller than the output mip and still resolves the filter angle.
+    static uint8_t radianceFilterSourceLevel(uint32_t _srcFaceSize, uint32_t _mipFaceSize, float _filterAngle)
+    {
+        if (_mipFaceSize <= CMFT_RADIANCE_SOURCE_FULL_MIP_SIZE)
+        {
+            return 0;
+        }
+
+        uint8_t level = 0;
+        for (;;)
+        {
+            const uint32_t faceSize = _srcFaceSize >> (level+1);
+            const float texelAngle = (float(M_PI)/2.0f)/float(int32_t(faceSize));
+
+            if (level+1 >= MAX_MIP_NUM
+            ||  faceSize < max(_mipFaceSize, UINT32_C(1))
+            ||  texelAngle*float(CMFT_RADIANCE_SOURCE_TEXELS_PER_FILTER_ANGLE) > _filterAngle)
+            {
+                return level;
+            }
+
+            level++;
+        }
+    }
+
+    /// Source pyramid level mip _mip reads with _quality, kept within the levels of a source of _srcFaceSize.
+    static uint8_t radianceFilterQualityLevel(const RadianceFilterQuality& _quality, uint8_t _mip, uint32_t _srcFaceSize)
+    {
+        uint8_t level = min(_quality.m_mipSrcLevel[_mip], uint8_t(MAX_MIP_NUM-1));
+        while (0 != level
+           &&  0 == (_srcFaceSize >> level))
+        {
+            level--;
+        }
+
+        return level;
+    }
+
+    /// Box filters RGBA32F or RGBA16F source cubemap faces into destination faces of _dstFaceSize.
+    static void radianceFilterBoxResize(void* _dstData
+                                      , const uint64_t _dstOffsets[CUBE_FACE_NUM]
+                                      , uint32_t _dstFaceSize
+                                      , bool _halfDst
+                                      , const Image& _src
+                                      , const uint64_t _srcOffsets[CUBE_FACE_NUM]
+                                      )
+    {
+        const bool halfSrc = (TextureFormat::RGBA16F == _src.m_format);
+        const uint32_t srcBytesPerPixel = 4 /*numChannels*/ * (halfSrc ? 2 : 4) /*bytesPerChannel*/;
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * (_halfDst ? 2 : 4) /*bytesPerChannel*/;
+        const uint32_t dstFaceSize = _dstFaceSize;
+        const float dstToSrcRatio = float(int32_t(_src.m_width))/float(int32_t(dstFaceSize));
+        const uint32_t dstFacePitch = dstFaceSize * bytesPerPixel;
+        const uint32_t srcFacePitch = _src.m_width * srcBytesPerPixel;
+
+        // For all top level cubemap faces:
+        for(uint8_t face = 0; face < 6; ++face)
+        {
+            const uint8_t* srcFaceData = (const uint8_t*)_src.m_data + _srcOffsets[face];
+            uint8_t* dstFaceData = (uint8_t*)_dstData + _dstOffsets[face];
+            // Iterate through destination pixels.
+            for (uint32_t yDst = 0; yDst < dstFaceSize; ++yDst)
+            {
+                uint8_t* dstFaceRow = (uint8_t*)dstFaceData + yDst*dstFacePitch;
+                for (uint32_t xDst = 0; xDst < dstFaceSize; ++xDst)
+                {
+                    uint8_t* dstFaceColumn = (uint8_t*)dstFaceRow + xDst*bytesPerPixel;
+
+                    // For each destination pixel, sample and accumulate color from source.
+                    float color[3] = { 0.0f, 0.0f, 0.0f };
+                    uint32_t weightAccum = 0;
+
+                    for (uint32_t ySrc = uint32_t(float(yDst)*dstToSrcRatio)
+                        , end = ySrc+max(uint32_t(1), uint32_t(dstToSrcRatio))
+                        ; ySrc < end
+                        ; ++ySrc)
+                    {
+                        const uint8_t* srcRowData = (const uint8_t*)srcFaceData + ySrc*srcFacePitch;
+
+                        for (uint32_t xSrc = uint32_t(float(xDst)*dstToSrcRatio)
+                            , end = xSrc+max(uint32_t(1), uint32_t(dstToSrcRatio))
+                            ; xSrc < end
+                            ; ++xSrc)
+                        {
+                            float srcColor[3];
+                            texelLoadRgb(srcColor, (const uint8_t*)srcRowData + xSrc*srcBytesPerPixel, halfSrc);
+                            color[0] += srcColor[0];
+                            color[1] += srcColor[1];
+                            color[2] += srcColor[2];
+                            weightAccum++;
+                        }
+                    }
+
+                    // Divide by weight and save to destination pixel.
+                    const float invWeight = 1.0f/float(int32_t(weightAccum));
+                    color[0] *= invWeight;
+                    color[1] *= invWeight;
+                    color[2] *= invWeight;
+                    texelStoreRgb(dstFaceColumn, color, _halfDst);
+                }
+            }
+        }
+    }
+
+    /// Builds source pyramid levels down to _level, each level is a box downsample of the previous one in the same format.
+    static void radianceFilterBuildSources(RadianceFilterJob& _job, uint8_t _level, bool _buildSoa)
+    {
+        AllocTagScope allocTag(AllocTag::SourceCopy);
+
+        for (uint8_t level = max(_job.m_numSources, uint8_t(1)); level <= _level; ++level)
+        {
+            const Image& parent = (1 == level) ? _job.m_imageRgba32f : _job.m_sources[level-1].m_image;
+            const uint32_t faceSize = max(UINT32_C(1), parent.m_width >> 1);
+
+            const bool half = (TextureFormat::RGBA16F == parent.m_format);
+            const uint32_t bytesPerPixel = 4 /*numChannels*/ * (half ? 2 : 4) /*bytesPerChannel*/;
+
+            RadianceFilterSource& source = _job.m_sources[level];
+            source.m_image.m_width = faceSize;
+            source.m_image.m_height = faceSize;
+            source.m_image.m_dataSize = uint64_t(faceSize)*faceSize*bytesPerPixel*CUBE_FACE_NUM;
+            source.m_image.m_format = parent.m_format;
+            source.m_image.m_numMips = 1;
+            source.m_image.m_numFaces = CUBE_FACE_NUM;
+            source.m_image.m_data = source.m_image.m_allocator->alloc(source.m_image.m_dataSize);
+            MALLOC_CHECK(source.m_image.m_data);
+            imageGetFaceOffsets(source.m_faceOffsets, source.m_image);
+
+            const uint64_t* parentOffsets = (1 == level) ? _job.m_srcFaceOffsets : _job.m_sources[level-1].m_faceOffsets;
+            radianceFilterBoxResize(source.m_image.m_data, source.m_faceOffsets, faceSize, half, parent, parentOffsets);
+            source.m_cubemapVectors = acquireCubemapNormalSolidAngle(faceSize);
+
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+            if (_buildSoa)
+            {
+                source.m_normalsSoa.initNormals(source.m_cubemapVectors, faceSize);
+                soaInitColors(source.m_colorsSoa, source.m_image, source.m_faceOffsets);
+            }
+#else
+            BX_UNUSED(_buildSoa);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+            _job.m_numSources = level+1;
+        }
+    }
+
+    static void radianceFilterReleaseSources(RadianceFilterJob& _job)
+    {
+        for (uint8_t level = 1; level < _job.m_numSources; ++level)
+        {
+            RadianceFilterSource& source = _job.m_sources[level];
+            source.m_normalsSoa.unload();
+            source.m_colorsSoa.unload();
+            releaseCubemapNormalSolidAngle(source.m_cubemapVectors);
+            imageUnload(source.m_image);
+        }
+        _job.m_numSources = 0;
+    }
+
+    static void radianceFilterCopyBase(RadianceFilterJob& _job)
+    {
+        uint64_t dstOffsets[CUBE_FACE_NUM];
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            dstOffsets[face] = _job.m_dstOffsets[face][0];
+        }
+
+        radianceFilterBoxResize(_job.m_dstData, dstOffsets, _job.m_dstFaceSize, _job.m_halfDst, _job.m_imageRgba32f, _job.m_srcFaceOffsets);
+    }
+
+    /// Passes all faces of mip _mip of the job, filled on the host, to the face callback of _progress.
+    static void radianceFilterReportMip(FilterProgress* _progress, uint32_t _cubemap, const RadianceFilterJob& _job, uint8_t _mip)
+    {
+        const TextureFormat::Enum format = _job.m_halfDst ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+        const uint32_t faceSize = max(UINT32_C(1), _job.m_dstFaceSize >> _mip);
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            radianceFilterReportFace(_progress, _cubemap, _mip, face, (uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][_mip], faceSize, format);
+        }
+    }
+
+    /// Packs faces that were not packed on the GPU (CPU faces, base image, averaged last mip) on the host.
+    static void radianceFilterEncodeRemaining(RadianceFilterJob& _job, TextureFormat::Enum _format)
+    {
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * (_job.m_halfDst ? 2 : 4) /*bytesPerChannel*/;
+
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t mip = 0; mip < _job.m_mipCount; ++mip)
+            {
+                if (_job.m_encoded[face][mip])
+                {
+                    continue;
+                }
+
+                const uint32_t faceSize = max(UINT32_C(1), _job.m_dstFaceSize >> mip);
+
+                Image src;
+                src.m_width = faceSize;
+                src.m_height = faceSize;
+                src.m_dataSize = uint64_t(faceSize)*faceSize*bytesPerPixel;
+                src.m_format = _job.m_halfDst ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+                src.m_numMips = 1;
+                src.m_numFaces = 1;
+                src.m_data = (uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][mip];
+
+                Image packed;
+                imageConvert(packed, _format, src);
+                memcpy((uint8_t*)_job.m_encodedData + _job.m_dstOffsets[face][mip]*4/bytesPerPixel, packed.m_data, packed.m_dataSize);
+                imageUnload(packed);
+            }
+        }
+    }
+
+    static void radianceFilterAverageLastMip(RadianceFilterJob& _job)
+    {
+        const uint8_t lastMip = _job.m_mipCount-1;
+        if ((_job.m_dstFaceSize>>lastMip) > 1)
+        {
+            return;
+        }
+
+        float color[3] = { 0.0f, 0.0f, 0.0f };
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            float faceColor[3];
+            texelLoadRgb(faceColor, (const uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][lastMip], _job.m_halfDst);
+            color[0] += faceColor[0];
+            color[1] += faceColor[1];
+            color[2] += faceColor[2];
+        }
+
+        color[0] /= 6.0f;
+        color[1] /= 6.0f;
+        color[2] /= 6.0f;
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            texelStoreRgb((uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][lastMip], color, _job.m_halfDst);
+        }
+    }
+
+    /// Filter parameters of output mip _mip out of _mipCount, with face size _mipFaceSize.
+    /// Lobe is cut at _lobeTolerance, see FilterSettings::m_lobeTolerance.
+    static void radianceFilterMipParams(float& _specularPower
+                                      , float& _filterAngle
+                                      , float& _cosAngle
+                                      , float& _filterSize
+                                      , uint32_t _mipFaceSize
+                                      , uint8_t _mip
+                                      , uint8_t _mipCount
+                                      , float _glossScalef
+                                      , float _glossBiasf
+                                      , LightingModel::Enum _lightingModel
+                                      , float _lobeTolerance
+                                      )
+    {
+        const float mipFaceSizef = float(int32_t(_mipFaceSize));
+        const float minAngle = atan2f(1.0f, mipFaceSizef);
+        const float maxAngle = float(M_PI)/2.0f;
+        const float toFilterSize = 1.0f/(minAngle*mipFaceSizef*2.0f);
+        const float glossiness = (_mipCount == 1)
+                               ? 1.0f
+                               : max(0.0f, 1.0f - (float)(int32_t)_mip/(float)(int32_t)(_mipCount-1))
+                               ;
+        const float specularPowerRef = powf(2.0f, _glossScalef * glossiness + _glossBiasf);
+        _specularPower = applyLightningModel(specularPowerRef, _lightingModel);
+        _filterAngle = clamp(cosinePowerFilterAngle(_specularPower, _lobeTolerance), minAngle, maxAngle);
+        _cosAngle = max(0.0f, cosf(_filterAngle));
+        const float texelSize = 1.0f/mipFaceSizef;
+        _filterSize = max(texelSize, _filterAngle * toFilterSize);
+    }
+
+    /// Same as above, with _specularPower given instead of the gloss mapping.
+    static void radianceFilterMipParams(float& _filterAngle
+                                      , float& _cosAngle
+                                      , float& _filterSize
+                                      , float _specularPower
+                                      , uint32_t _mipFaceSize
+                                      , float _lobeTolerance
+                                      )
+    {
+        const float mipFaceSizef = float(int32_t(_mipFaceSize));
+        const float minAngle = atan2f(1.0f, mipFaceSizef);
+        const float maxAngle = float(M_PI)/2.0f;
+        const float toFilterSize = 1.0f/(minAngle*mipFaceSizef*2.0f);
+        _filterAngle = clamp(cosinePowerFilterAngle(_specularPower, _lobeTolerance), minAngle, maxAngle);
+        _cosAngle = max(0.0f, cosf(_filterAngle));
+        const float texelSize = 1.0f/mipFaceSizef;
+        _filterSize = max(texelSize, _filterAngle * toFilterSize);
+    }
+
+#if CMFT_RADIANCE_SH_ORDER
+    /// SH projection reads the smallest source pyramid level of at least this face size.
+#ifndef CMFT_RADIANCE_SH_SOURCE_SIZE
+    #define CMFT_RADIANCE_SH_SOURCE_SIZE 128
+#endif //CMFT_RADIANCE_SH_SOURCE_SIZE
+
+    /// Zonal coefficients of the normalized lobe pow(cos, _specularPower) cut at _cosAngle, for bands [0, _numBands).
+    /// By Funk-Hecke theorem, convolution scales all coefficients of band l of the source by _lobes[l].
+    static void radianceFilterShLobes(double* _lobes, uint8_t _numBands, float _specularPower, float _cosAngle)
+    {
+        // Simpson integration of P_l(t)*pow(t, power) over [cosAngle, 1].
+        const uint32_t numIntervals = 1024;
+        const double tBegin = double(_cosAngle);
+        const double step = (1.0 - tBegin)/double(numIntervals);
+
+        double integral[CMFT_RADIANCE_SH_ORDER+2];
+        memset(integral, 0, sizeof(integral));
+
+        for (uint32_t ii = 0; ii <= numIntervals; ++ii)
+        {
+            const double tt = tBegin + double(ii)*step;
+            const double scale = (0 == ii || numIntervals == ii) ? 1.0 : ((ii&1) ? 4.0 : 2.0);
+            const double weight = scale * pow(tt, double(_specularPower));
+
+            // Legendre polynomials, P_l = ((2l-1)*t*P_l-1 - (l-1)*P_l-2)/l.
+            double p2 = 0.0;
+            double p1 = 1.0;
+            integral[0] += weight;
+            for (uint8_t ll = 1; ll < _numBands; ++ll)
+            {
+                const double pl = (double(2*ll-1)*tt*p1 - double(ll-1)*p2)/double(ll);
+                p2 = p1;
+                p1 = pl;
+                integral[ll] += weight*pl;
+            }
+        }
+
+        for (uint8_t ll = 0; ll < _numBands; ++ll)
+        {
+            _lobes[ll] = integral[ll]/integral[0];
+        }
+    }
+
+    /// Checks whether the lobe of a mip is wide enough to be convolved with CMFT_RADIANCE_SH_ORDER bands.
+    /// Lobe coefficients are set for kept bands.
+    static bool radianceFilterShMip(double _lobes[CMFT_RADIANCE_SH_ORDER], float _specularPower, float _cosAngle)
+    {
+        // Two bands left out are checked, odd bands of some lobes are close to zero.
+        double lobes[CMFT_RADIANCE_SH_ORDER+2];
+        radianceFilterShLobes(lobes, CMFT_RADIANCE_SH_ORDER+2, _specularPower, _cosAngle);
+
+        if (fabs(lobes[CMFT_RADIANCE_SH_ORDER  ]) > CMFT_RADIANCE_SH_EPSILON
+        ||  fabs(lobes[CMFT_RADIANCE_SH_ORDER+1]) > CMFT_RADIANCE_SH_EPSILON)
+        {
+            return false;
+        }
+
+        memcpy(_lobes, lobes, CMFT_RADIANCE_SH_ORDER*sizeof(double));
+        return true;
+    }
+
+    /// Projects source of the job to CMFT_RADIANCE_SH_ORDER bands. Source pyramid is used above CMFT_RADIANCE_SH_SOURCE_SIZE.
+    /// Runs after all filter tasks are prepared, levels built here are never filtered and get no SoA copies.
+    /// Source the SH projection integrates, the smallest pyramid level that is still at least CMFT_RADIANCE_SH_SOURCE_SIZE.
+    /// Returns true if _imageRgb32f references the source.
+    static bool radianceFilterShSource(RadianceFilterJob& _job, Image& _imageRgb32f)
+    {
+        uint8_t level = 0;
+        while (level+1 < MAX_MIP_NUM
+           && (_job.m_imageRgba32f.m_width >> (level+1)) >= CMFT_RADIANCE_SH_SOURCE_SIZE)
+        {
+            level++;
+        }
+
+        if (0 != level)
+        {
+            radianceFilterBuildSources(_job, level, false);
+        }
+        const Image& source = (0 == level) ? _job.m_imageRgba32f : _job.m_sources[level].m_image;
+
+        return shRefOrConvert(_imageRgb32f, source);
+    }
+
+    static void radianceFilterShProject(RadianceFilterJob& _job)
+    {
+        if (NULL != _job.m_shCoeffs)
+        {
+            return;
+        }
+
+        Image imageRgb32f;
+        const bool imageIsRef = radianceFilterShSource(_job, imageRgb32f);
+
+        uint64_t faceOffsets[CUBE_FACE_NUM];
+        imageGetFaceOffsets(faceOffsets, imageRgb32f);
+
+        _job.m_shCoeffs = (double(*)[3])malloc(CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER*3*sizeof(double));
+        MALLOC_CHECK(_job.m_shCoeffs);
+        cubemapShCoeffs<CMFT_RADIANCE_SH_ORDER>(_job.m_shCoeffs, imageRgb32f.m_data, imageRgb32f.m_width, faceOffsets, shNumChannels(imageRgb32f));
+
+        if (!imageIsRef)
+        {
+            imageUnload(imageRgb32f);
+        }
+    }
+
+    struct RadianceFilterShArgs
+    {
+        void* m_dstData;
+        const uint64_t* m_dstOffsets; // Per face.
+        uint32_t m_mipFaceSize;
+        bool m_halfDst;
+        const double (*m_coeffs)[3]; // Source coefficients scaled by lobe coefficients.
+    };
+
+    static void radianceFilterShRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterShArgs& args = *(const RadianceFilterShArgs*)_userData;
+
+        const uint32_t mipFaceSize = args.m_mipFaceSize;
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * (args.m_halfDst ? 2 : 4) /*bytesPerChannel*/;
+        const float invFaceSize = 1.0f/float(int32_t(mipFaceSize));
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(row/mipFaceSize);
+            const uint32_t yy = row%mipFaceSize;
+            uint8_t* dstPtr = (uint8_t*)args.m_dstData + args.m_dstOffsets[face] + uint64_t(yy)*mipFaceSize*bytesPerPixel;
+
+            for (uint32_t xx = 0; xx < mipFaceSize; ++xx)
+            {
+                // Same texel directions as radianceFilter().
+                const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+
+                float tapVec[3];
+                texelCoordToVec(tapVec, uu, vv, face, mipFaceSize);
+
+                double shBasis[CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER];
+                evalSHBasis<CMFT_RADIANCE_SH_ORDER>(shBasis, tapVec);
+
+                double rgb[3] = { 0.0, 0.0, 0.0 };
+                for (uint32_t ii = 0; ii < CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER; ++ii)
+                {
+                    rgb[0] += args.m_coeffs[ii][0]*shBasis[ii];
+                    rgb[1] += args.m_coeffs[ii][1]*shBasis[ii];
+                    rgb[2] += args.m_coeffs[ii][2]*shBasis[ii];
+                }
+
+                // Truncated series may ring below zero next to bright texels, filtering never does.
+                const float color[3] = { float(max(0.0, rgb[0])), float(max(0.0, rgb[1])), float(max(0.0, rgb[2])) };
+                texelStoreRgb(dstPtr, color, args.m_halfDst);
+                dstPtr += bytesPerPixel;
+            }
+        }
+    }
+
+    /// Writes mip _mip of the job from its SH projection scaled by the lobe coefficients of the mip.
+    static void radianceFilterShEvaluate(RadianceFilterJob& _job, uint8_t _mip)
+    {
+        double coeffs[CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER][3];
+        for (uint8_t ll = 0; ll < CMFT_RADIANCE_SH_ORDER; ++ll)
+        {
+            for (uint32_t ii = uint32_t(ll)*ll; ii < uint32_t(ll+1)*(ll+1); ++ii)
+            {
+                coeffs[ii][0] = _job.m_shCoeffs[ii][0]*_job.m_shLobes[_mip][ll];
+                coeffs[ii][1] = _job.m_shCoeffs[ii][1]*_job.m_shLobes[_mip][ll];
+                coeffs[ii][2] = _job.m_shCoeffs[ii][2]*_job.m_shLobes[_mip][ll];
+            }
+        }
+
+        uint64_t dstOffsets[CUBE_FACE_NUM];
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            dstOffsets[face] = _job.m_dstOffsets[face][_mip];
+        }
+
+        RadianceFilterShArgs args;
+        args.m_dstData = _job.m_dstData;
+        args.m_dstOffsets = dstOffsets;
+        args.m_mipFaceSize = max(UINT32_C(1), _job.m_dstFaceSize >> _mip);
+        args.m_halfDst = _job.m_halfDst;
+        args.m_coeffs = coeffs;
+        parallelFor(radianceFilterShRows, (void*)&args, CUBE_FACE_NUM*args.m_mipFaceSize);
+    }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+    static inline uint8_t radianceFilterMipCount(uint32_t _dstFaceSize, uint8_t _mipCount)
+    {
+        const uint8_t mipMin = 1;
+        const uint8_t mipMax = (uint8_t)log2f(float(int32_t(_dstFaceSize)))+uint8_t(1);
+        return clamp(_mipCount, mipMin, mipMax);
+    }
+
+    /// Texels of all faces of mips [_mipBegin, _mipEnd).
+    static inline uint64_t radianceFilterMipTexels(uint32_t _faceSize, uint8_t _mipBegin, uint8_t _mipEnd)
+    {
+        uint64_t numTexels = 0;
+        for (uint8_t mip = _mipBegin; mip < _mipEnd; ++mip)
+        {
+            const uint64_t faceSize = max(UINT32_C(1), _faceSize >> mip);
+            numTexels += faceSize*faceSize*CUBE_FACE_NUM;
+        }
+        return numTexels;
+    }
+
+    /// Returns end of the streaming pass starting at _passBegin. Pass takes as many mips as fit in _budget, at least one.
+    static uint8_t radianceFilterStreamPassEnd(const RadianceFilterJob* _jobs, uint32_t _count, uint8_t _passBegin, uint8_t _maxMipCount, uint64_t _budget, uint32_t _bytesPerPixel)
+    {
+        uint64_t size = 0;
+        uint8_t passEnd = _passBegin;
+        while (passEnd < _maxMipCount)
+        {
+            for (uint32_t ii = 0; ii < _count; ++ii)
+            {
+                if (passEnd < _jobs[ii].m_mipCount)
+                {
+                    size += radianceFilterMipTexels(_jobs[ii].m_dstFaceSize, passEnd, passEnd+1)*_bytesPerPixel;
+                }
+            }
+
+            if (size > _budget && passEnd != _passBegin)
+            {
+                break;
+            }
+            passEnd++;
+        }
+
+        return passEnd;
+    }
+
+    /// Allocates working buffer for mips [_passBegin, _passEnd) of the job. m_dstOffsets are relative to it.
+    static void radianceFilterStreamAlloc(RadianceFilterJob& _job, uint8_t _passBegin, uint8_t _passEnd, uint32_t _bytesPerPixel)
+    {
+        const uint8_t passEnd = min(_passEnd, _job.m_mipCount);
+
+        uint64_t dstDataSize = 0;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t mip = _passBegin; mip < passEnd; ++mip)
+            {
+                const uint64_t faceSize = max(UINT32_C(1), _job.m_dstFaceSize >> mip);
+                _job.m_dstOffsets[face][mip] = dstDataSize;
+                dstDataSize += faceSize*faceSize*_bytesPerPixel;
+            }
+        }
+
+        _job.m_dstData = NULL;
+        if (0 != dstDataSize)
+        {
+            _job.m_dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+            MALLOC_CHECK(_job.m_dstData);
+        }
+    }
+
+    /// Converts mips [_passBegin, _passEnd) of the working buffer into the output and frees the working buffer.
+    static void radianceFilterStreamFinish(RadianceFilterJob& _job, uint8_t _passBegin, uint8_t _passEnd)
+    {
+        if (NULL == _job.m_dstData)
+        {
+            return;
+        }
+
+        // Faces of the pass were only passed to the face callback.
+        if (NULL == _job.m_finalData)
+        {
+            getAllocator()->free(_job.m_dstData);
+            _job.m_dstData = NULL;
+            return;
+        }
+
+        const TextureFormat::Enum workingFormat = _job.m_halfDst ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+        const uint32_t bytesPerPixel = getImageDataInfo(workingFormat).m_bytesPerPixel;
+        const uint8_t passEnd = min(_passEnd, _job.m_mipCount);
+
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t mip = _passBegin; mip < passEnd; ++mip)
+            {
+                const uint32_t faceSize = max(UINT32_C(1), _job.m_dstFaceSize >> mip);
+                uint8_t* dst = (uint8_t*)_job.m_finalData + _job.m_finalOffsets[face][mip];
+                uint8_t* src = (uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][mip];
+                const uint64_t srcSize = uint64_t(faceSize)*faceSize*bytesPerPixel;
+
+                if (workingFormat == _job.m_finalFormat)
+                {
+                    memcpy(dst, src, srcSize);
+                    continue;
+                }
+
+                Image view;
+                view.m_width = faceSize;
+                view.m_height = faceSize;
+                view.m_dataSize = srcSize;
+                view.m_format = workingFormat;
+                view.m_numMips = 1;
+                view.m_numFaces = 1;
+                view.m_data = src;
+
+                Image converted;
+                imageConvert(converted, _job.m_finalFormat, view);
+                memcpy(dst, converted.m_data, converted.m_dataSize);
+                imageUnload(converted);
+            }
+        }
+
+        getAllocator()->free(_job.m_dstData);
+        _job.m_dstData = NULL;
+    }
+
+    struct SoaReplicateArgs
+    {
+        SoaCubemap** m_soa;
+        uint32_t m_num;
+        uint16_t m_homeNode;
+    };
+
+    static void soaReplicateNode(void* _userData, uint32_t _node)
+    {
+        AllocTagScope allocTag(AllocTag::SourceCopy);
+
+        const SoaReplicateArgs* args = (const SoaReplicateArgs*)_userData;
+        if (_node == args->m_homeNode)
+        {
+            return;
+        }
+
+        for (uint32_t ii = 0; ii < args->m_num; ++ii)
+        {
+            args->m_soa[ii]->m_replicas[_node].copy(*args->m_soa[ii]);
+        }
+    }
+
+    /// Copies SoA sources read by CPU threads to every NUMA node except the one of the calling thread, which built them.
+    /// Replicas are released together with the sources.
+    static void radianceFilterReplicateSources(const RadianceFilterParams* _params, uint32_t _numTasks)
+    {
+        const uint16_t numNodes = getNumNumaNodes();
+        if (numNodes <= 1)
+        {
+            return;
+        }
+
+        SoaCubemap** soa = (SoaCubemap**)malloc(max(UINT32_C(1), 2*_numTasks)*sizeof(SoaCubemap*));
+        MALLOC_CHECK(soa);
+
+        uint32_t numSoa = 0;
+        uint64_t numBytes = 0;
+        for (uint32_t ii = 0; ii < _numTasks; ++ii)
+        {
+            const SoaCubemap* taskSoa[2] = { _params[ii].m_normalsSoa, _params[ii].m_colorsSoa };
+            for (uint8_t jj = 0; jj < 2; ++jj)
+            {
+                if (NULL == taskSoa[jj] || NULL == taskSoa[jj]->m_data || NULL != taskSoa[jj]->m_replicas)
+                {
+                    continue;
+                }
+
+                SoaCubemap* curr = const_cast<SoaCubemap*>(taskSoa[jj]);
+                curr->initReplicas(numNodes);
+                soa[numSoa++] = curr;
+                numBytes += curr->dataSize();
+            }
+        }
+
+        SoaReplicateArgs args;
+        args.m_soa = soa;
+        args.m_num = numSoa;
+        args.m_homeNode = getCurrentNumaNode();
+        runOnNumaNodes(soaReplicateNode, (void*)&args);
+
+        INFO("Radiance -> Sources replicated on %u NUMA nodes, %.1f MB per node.", numNodes, double(numBytes)/(1024.0*1024.0));
+
+        free(soa);
+    }
+
+    /// Output of a radiance filter run. Outputs may share a source, it is then prepared only once.
+    struct RadianceFilterOutput
+    {
+        const Image* m_src;
+        double (*m_shCoeffs)[3]; // Receives SH_COEFF_NUM coefficients of the SH projection of the source, NULL if not needed.
+        uint32_t m_dstFaceSize;  // 0 takes the source face size.
+        uint8_t m_mipCount;
+        const RadianceFilterQuality* m_quality; // Source levels and lobe tolerances of each mip, NULL for defaults.
+    };
+
+    static uint32_t radianceFilterOutputFaceSize(const RadianceFilterOutput& _output)
+    {
+        return (0 == _output.m_dstFaceSize) ? _output.m_src->m_width : _output.m_dstFaceSize;
+    }
+
+    /// Index of the first output with the same source as output _idx.
+    static uint32_t radianceFilterOutputSource(const RadianceFilterOutput* _outputs, uint32_t _idx)
+    {
+        uint32_t idx = 0;
+        while (_outputs[idx].m_src != _outputs[_idx].m_src)
+        {
+            idx++;
+        }
+
+        return idx;
+    }
+
+    /// Memory needed by radiance filtering of outputs, see radianceFilterOutputsMemory().
+    struct RadianceFilterMemory
+    {
+        uint64_t m_fixedBytes;       //!< Working source, normal tables and SoA copies, needed throughout.
+        uint64_t m_chainBytes;       //!< Output chains in the working format.
+        uint64_t m_finalBytes;       //!< Output chains in the source format.
+        uint64_t m_largestPassBytes; //!< Base mips in the working format, the largest streaming pass.
+        bool m_convert;              //!< Output chains are converted from the working format at the end.
+
+        /// Without streaming, the whole output chain in the working format and its conversion are alive at the end.
+        uint64_t peakBytes() const
+        {
+            return m_fixedBytes + m_chainBytes + (m_convert ? m_finalBytes : 0);
+        }
+    };
+
+    static void radianceFilterOutputsMemory(RadianceFilterMemory& _memory
+                                          , const RadianceFilterOutput* _outputs
+                                          , uint32_t _count
+                                          , TextureFormat::Enum _srcWorkingFormat
+                                          , TextureFormat::Enum _dstWorkingFormat
+                                          , bool _soa
+                                          )
+    {
+        const uint32_t srcBytesPerPixel = getImageDataInfo(_srcWorkingFormat).m_bytesPerPixel;
+        const uint32_t bytesPerPixel = getImageDataInfo(_dstWorkingFormat).m_bytesPerPixel;
+
+        memset(&_memory, 0, sizeof(RadianceFilterMemory));
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            // Outputs of the same source share its working copy.
+            const Image& src = *_outputs[ii].m_src;
+            const TextureFormat::Enum format = (TextureFormat::Enum)src.m_format;
+            if (radianceFilterOutputSource(_outputs, ii) == ii)
+            {
+                const uint64_t srcTexels = radianceFilterMipTexels(src.m_width, 0, 1);
+                _memory.m_fixedBytes += (_srcWorkingFormat != format) ? srcTexels*srcBytesPerPixel : 0;
+                _memory.m_fixedBytes += srcTexels*4*sizeof(float); // Normal/solid angle table.
+                _memory.m_fixedBytes += _soa ? SoaCubemap::paddedTexels(src.m_width)*(SoaCubemap::normalBytesPerTexel() + srcBytesPerPixel) : 0; // SoA normals and colors.
+            }
+
+            const uint32_t dstFaceSize = radianceFilterOutputFaceSize(_outputs[ii]);
+            const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _outputs[ii].m_mipCount);
+            const uint64_t dstTexels = radianceFilterMipTexels(dstFaceSize, 0, mipCount);
+            _memory.m_chainBytes += dstTexels*bytesPerPixel;
+            _memory.m_finalBytes += dstTexels*getImageDataInfo(format).m_bytesPerPixel;
+            _memory.m_largestPassBytes += radianceFilterMipTexels(dstFaceSize, 0, 1)*bytesPerPixel;
+            _memory.m_convert |= (_dstWorkingFormat != format);
+        }
+    }
+
+    /// Looks for a filtered mip of the jobs before _jobIdx with the same source, face size and specular power.
+    static bool radianceFilterFindLevel(uint32_t& _job
+                                      , uint8_t& _mip
+                                      , const RadianceFilterJob* _jobs
+                                      , uint32_t _jobIdx
+                                      , uint8_t _mipStart
+                                      , uint32_t _mipFaceSize
+                                      , float _specularPower
+                                      , float _glossScalef
+                                      , float _glossBiasf
+                                      , LightingModel::Enum _lightingModel
+                                      , float _lobeTolerance
+                                      )
+    {
+        for (uint32_t ii = 0; ii < _jobIdx; ++ii)
+        {
+            const RadianceFilterJob& job = _jobs[ii];
+            if (job.m_sourceJob != _jobs[_jobIdx].m_sourceJob)
+            {
+                continue;
+            }
+
+            for (uint8_t mip = _mipStart; mip < job.m_mipCount; ++mip)
+            {
+                const uint32_t mipFaceSize = max(UINT32_C(1), job.m_dstFaceSize >> mip);
+                if (mipFaceSize != _mipFaceSize
+                ||  UINT32_MAX != job.m_reuseJob[mip])
+                {
+                    continue;
+                }
+
+                float specularPower, filterAngle, cosAngle, filterSize;
+                radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, job.m_mipCount, _glossScalef, _glossBiasf, _lightingModel, _lobeTolerance);
+                if (specularPower == _specularPower)
+                {
+                    _job = ii;
+                    _mip = mip;
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /// Copies all faces of mip _srcMip of _src into mip _mip of _job. Both have the same face size and working format.
+    static void radianceFilterCopyLevel(RadianceFilterJob& _job, uint8_t _mip, const RadianceFilterJob& _src, uint8_t _srcMip, uint32_t _bytesPerPixel)
+    {
+        const uint32_t faceSize = max(UINT32_C(1), _job.m_dstFaceSize >> _mip);
+        const size_t faceDataSize = size_t(faceSize)*faceSize*_bytesPerPixel;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            memcpy((uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][_mip]
+                 , (const uint8_t*)_src.m_dstData + _src.m_dstOffsets[face][_srcMip]
+                 , faceDataSize
+                 );
+        }
+    }
+
+    /// Keeps tasks of _shard at the front of the task arrays and returns their number. Tasks are split into consecutive ranges
+    /// of about equal estimated cost, faces of 1x1 mips go to shard 0, which averages them.
+    static uint32_t radianceFilterShardTasks(RadianceFilterParams* _params, uint32_t* _taskJobs, uint8_t* _taskMips, uint32_t _numTasks, const FilterShard& _shard)
+    {
+        double totalCost = 0.0;
+        for (uint32_t ii = 0; ii < _numTasks; ++ii)
+        {
+            totalCost += (1 < _params[ii].m_mipFaceSize) ? radianceFilterTaskCost(_params[ii]) : 0.0;
+        }
+
+        double cost = 0.0;
+        double shardCost = 0.0;
+        uint32_t numShardTasks = 0;
+        for (uint32_t ii = 0; ii < _numTasks; ++ii)
+        {
+            // Task goes to the shard its cost midpoint falls into.
+            uint32_t shardIdx = 0;
+            if (1 < _params[ii].m_mipFaceSize)
+            {
+                const double taskCost = radianceFilterTaskCost(_params[ii]);
+                shardIdx = min(_shard.m_count-1, uint32_t((cost + taskCost*0.5)/totalCost*double(_shard.m_count)));
+                cost += taskCost;
+
+                shardCost += (shardIdx == _shard.m_index) ? taskCost : 0.0;
+            }
+
+            if (shardIdx == _shard.m_index)
+            {
+                _params[numShardTasks] = _params[ii];
+                _taskJobs[numShardTasks] = _taskJobs[ii];
+                _taskMips[numShardTasks] = _taskMips[ii];
+                numShardTasks++;
+            }
+        }
+
+        INFO("Radiance -> Shard %u of %u, filtering %u of %u faces, %.1f%% of estimated cost."
+            , _shard.m_index
+            , _shard.m_count
+            , numShardTasks
+            , _numTasks
+            , (totalCost > 0.0) ? shardCost/totalCost*100.0 : 0.0
+            );
+
+        return numShardTasks;
+    }
+
+    /// Fills faces finished by an earlier run with the resume callback of _progress, keeps the remaining tasks at the front
+    /// of the task arrays and returns their number.
+    static uint32_t radianceFilterResumeTasks(RadianceFilterParams* _params, uint32_t* _taskJobs, uint8_t* _taskMips, uint32_t _numTasks, const FilterProgress& _progress)
+    {
+        uint32_t numLeft = 0;
+        for (uint32_t ii = 0; ii < _numTasks; ++ii)
+        {
+            const RadianceFilterParams& params = _params[ii];
+            const TextureFormat::Enum format = params.m_halfDst ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+            if (1 < params.m_mipFaceSize
+            &&  _progress.m_resumeCallback(params.m_cubemap, params.m_mip, params.m_face, params.m_dstPtr, params.m_mipFaceSize, format, _progress.m_userData))
+            {
+                continue;
+            }
+
+            _params[numLeft] = _params[ii];
+            _taskJobs[numLeft] = _taskJobs[ii];
+            _taskMips[numLeft] = _taskMips[ii];
+            numLeft++;
+        }
+
+        if (numLeft != _numTasks)
+        {
+            INFO("Radiance -> Resuming, %u of %u faces were finished by an earlier run.", _numTasks-numLeft, _numTasks);
+        }
+
+        return numLeft;
+    }
+
+    static bool radianceFilterOutputs(Image* _dst
+                                    , const RadianceFilterOutput* _outputs
+                                    , uint32_t _count
+                                    , LightingModel::Enum _lightingModel
+                                    , bool _excludeBase
+                                    , uint8_t _glossScale
+                                    , uint8_t _glossBias
+                                    , int16_t _numCpuProcessingThreads
+                                    , const ClContext* const* _clContexts
+                                    , uint8_t _numClContexts
+                                    , bool _useSourcePyramid
+                                    , bool _halfPrecision
+                                    , TextureFormat::Enum _gpuEncodeFormat
+                                    , FilterStats* _stats
+                                    , FilterProgress* _progress
+                                    , uint64_t _maxMemoryBytes
+                                    , const FilterShard* _shard
+                                    , const FilterSettings& _settings
+                                    )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+
+        // Input images must be cubemaps.
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            if (!imageIsCubemap(*_outputs[ii].m_src))
+            {
+                WARN("Image is not cubemap.");
+
+                return false;
+            }
+        }
+
+        if (0 == _count)
+        {
+            return true;
+        }
+
+        // Sharded bake. Shard 0 does the host side work on top of its faces.
+        const bool shard = (NULL != _shard && 1 < _shard->m_count);
+        const bool hostShard = (!shard || 0 == _shard->m_index);
+        if (shard && _shard->m_index >= _shard->m_count)
+        {
+            WARN("Radiance -> Shard %u is out of range, bake is split into %u shards.", _shard->m_index, _shard->m_count);
+
+            return false;
+        }
+
+        // Multi-threading parameters.
+        RadianceFilterThreadArgs threadArgs[CMFT_MAX_THREADS+CMFT_CL_MAX_CONTEXTS];
+        uint16_t maxActiveCpuThreads = (uint16_t)max(int16_t(0), min(_numCpuProcessingThreads, int16_t(CMFT_MAX_THREADS)));
+
+        // Per-invocation state, so concurrent calls don't share programs or statistics.
+        RadianceFilterStats stats;
+        RadianceProgram radianceProgram[CMFT_CL_MAX_CONTEXTS];
+
+        // Prepare OpenCL kernel for each device. Devices with invalid context or program are skipped.
+        uint8_t numDevices = 0;
+        uint8_t contextIdx[CMFT_CL_MAX_CONTEXTS];
+        bool cpuDevice = false;
+        bool cpuDevicePartitioned = true;
+        uint32_t numClCpuUnits = 0;
+        for (uint8_t ii = 0, end = min(_numClContexts, uint8_t(CMFT_CL_MAX_CONTEXTS)); ii < end; ++ii)
+        {
+            RadianceProgram& program = radianceProgram[numDevices];
+            program.setClContext(_clContexts[ii]);
+            program.setProfiling(_settings.m_gpuProfiling);
+            if (program.hasValidDeviceContext()
+            &&  program.createFromStr(s_radianceProgramSource, "radianceFilterBounded"))
+            {
+                if (0 != (_clContexts[ii]->m_deviceType&CL_DEVICE_TYPE_CPU))
+                {
+                    cpuDevice = true;
+                    cpuDevicePartitioned &= (NULL != _clContexts[ii]->m_parentDevice);
+                    numClCpuUnits += _clContexts[ii]->m_numComputeUnits;
+                }
+                contextIdx[numDevices] = ii;
+                numDevices++;
+            }
+            else
+            {
+                program.destroy();
+                program.setClContext(NULL);
+            }
+        }
+
+        // Without OpenCL devices, negative thread count takes one thread per physical core available to the process.
+        if (0 > _numCpuProcessingThreads
+        &&  0 == numDevices)
+        {
+            const CpuInfo& cpuInfo = getCpuInfo();
+            maxActiveCpuThreads = getDefaultNumThreads();
+
+            INFO("Radiance -> %u CPU processing threads by default, %u physical cores of %u CPUs available, CPU quota %s."
+                , maxActiveCpuThreads
+                , cpuInfo.m_numCores
+                , cpuInfo.m_numCpus
+                , (0.0f != cpuInfo.m_cpuQuota) ? "applied" : "not set"
+                );
+        }
+
+        // Faces are not shared between processing devices, which devices filter what would depend on timing.
+        if (_settings.m_deterministic && 0 != numDevices)
+        {
+            for (uint8_t ii = 1; ii < numDevices; ++ii)
+            {
+                radianceProgram[ii].destroy();
+                radianceProgram[ii].setClContext(NULL);
+            }
+            numDevices = 1;
+            maxActiveCpuThreads = 0;
+            cpuDevice = false;
+
+            INFO("Radiance -> Deterministic mode, filtering on OpenCL device %u only.", contextIdx[0]);
+        }
+
+        // With adaptive concurrency, the most threads that may run are started, the task list picks the active ones.
+        const uint16_t concurrencyMax = min(_settings.m_maxCpuThreads, uint16_t(CMFT_MAX_THREADS));
+        const uint16_t concurrencyMin = max(uint16_t(1), min(_settings.m_minCpuThreads, concurrencyMax));
+        if (0 != concurrencyMax
+        &&  0 != maxActiveCpuThreads)
+        {
+            maxActiveCpuThreads = concurrencyMax;
+        }
+
+        // Faces whose source or destination don't fit into device memory are left to CPU threads. Source pyramid levels are
+        // smaller than the source, so rougher mips of too big sources may still go to devices.
+        // Half precision sources are uploaded as RGBA16F, except without SIMD when CPU threads take part.
+        const uint32_t deviceSrcBytesPerPixel = (_halfPrecision && CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA) ? 8 : 16;
+        uint32_t maxDstFaceSize = 0;
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            maxDstFaceSize = max(maxDstFaceSize, radianceFilterOutputFaceSize(_outputs[ii]));
+        }
+
+        uint32_t deviceMaxSrcFaceSize[CMFT_CL_MAX_CONTEXTS];
+        uint32_t deviceMaxDstFaceSize[CMFT_CL_MAX_CONTEXTS];
+        for (uint8_t ii = 0; ii < numDevices; ++ii)
+        {
+            deviceMaxSrcFaceSize[ii] = radianceProgram[ii].maxSourceFaceSize(deviceSrcBytesPerPixel, maxDstFaceSize);
+            deviceMaxDstFaceSize[ii] = radianceProgram[ii].maxDestinationFaceSize();
+        }
+
+        bool allFit = true;
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            const uint32_t dstFaceSize = radianceFilterOutputFaceSize(_outputs[ii]);
+
+            bool fits = false;
+            for (uint8_t jj = 0; jj < numDevices; ++jj)
+            {
+                fits |= (_outputs[ii].m_src->m_width <= deviceMaxSrcFaceSize[jj] && dstFaceSize <= deviceMaxDstFaceSize[jj]);
+            }
+            allFit &= fits;
+        }
+
+        if (0 != numDevices && !allFit)
+        {
+            // Mixing devices would make results depend on timing, deterministic mode filters on CPU only then.
+            if (_settings.m_deterministic)
+            {
+                for (uint8_t ii = 0; ii < numDevices; ++ii)
+                {
+                    radianceProgram[ii].destroy();
+                    radianceProgram[ii].setClContext(NULL);
+                }
+                numDevices = 0;
+                cpuDevice = false;
+            }
+
+            if (0 == maxActiveCpuThreads)
+            {
+                maxActiveCpuThreads = getDefaultNumThreads();
+            }
+
+            WARN("Radiance -> Source does not fit into OpenCL device memory, faces that don't fit are filtered on %u CPU threads.", maxActiveCpuThreads);
+        }
+
+        // Packing results on the GPU. Shards are returned in the working format.
+        const bool gpuEncode = (0 != numDevices)
+                            && !shard
+                            && (TextureFormat::BGRA8 == _gpuEncodeFormat
+                            ||  TextureFormat::RGBA8 == _gpuEncodeFormat
+                            ||  TextureFormat::RGBE  == _gpuEncodeFormat)
+                            ;
+        if (TextureFormat::Unknown != _gpuEncodeFormat && !gpuEncode && !shard)
+        {
+            WARN("Radiance -> GPU encoding requires a valid OpenCL device and BGRA8, RGBA8 or RGBE format. Results are converted on the host.");
+        }
+
+        for (uint8_t ii = 0; ii < numDevices && gpuEncode; ++ii)
+        {
+            radianceProgram[ii].setEncodeFormat(_gpuEncodeFormat);
+        }
+
+        // Check at least some processig device is valid and choosen for filtering.
+        if (0 == maxActiveCpuThreads && 0 == numDevices)
+        {
+            WARN("No hardware devices selected for processing."
+                " OpenCL context is invalid and 0 CPU processing theads are choosen for filtering."
+                );
+
+            return false;
+        }
+
+        // Don't use the same CPU device for OpenCL and CPU processing! Unless it is partitioned with ClContext::partition(),
+        // then CPU processing threads are kept on the cores it left out. Sub-devices don't tell which cores they run on,
+        // CPU threads take the last ones and the scheduler moves OpenCL threads away from them.
+        uint16_t firstNativeCpu = 0;
+        uint16_t numNativeCpus = 0;
+        const uint16_t numHardwareThreads = getNumHardwareThreads();
+        if (cpuDevice
+        &&  maxActiveCpuThreads != 0
+        &&  cpuDevicePartitioned
+        &&  numClCpuUnits < numHardwareThreads)
+        {
+            firstNativeCpu = uint16_t(numClCpuUnits);
+            numNativeCpus = uint16_t(numHardwareThreads - firstNativeCpu);
+            maxActiveCpuThreads = min(maxActiveCpuThreads, numNativeCpus);
+
+            INFO("Radiance -> OpenCL CPU device uses %u cores, %u CPU processing threads run on the remaining %u."
+                , numClCpuUnits
+                , maxActiveCpuThreads
+                , numNativeCpus
+                );
+        }
+        else if (cpuDevice
+        &&  maxActiveCpuThreads != 0)
+        {
+            WARN(" !! Choosing CPU device as OpenCL device and running CPU processing"
+                 " threads on the SAME device is NOT a good idea. It will work, but it is"
+                 " certainly not the best utilization of processing resources."
+                 " In case OpenCL device type is CPU but it is a different processing"
+                 " device other than the host device, simply ignore this warning. !!"
+                 );
+        }
+
+        RadianceFilterJob* jobs = (RadianceFilterJob*)malloc(_count*sizeof(RadianceFilterJob));
+        MALLOC_CHECK(jobs);
+
+        // With half precision, source and destination are stored in RGBA16F. Filtering is still done in fp32.
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        const bool halfSrc = _halfPrecision;
+#else
+        // Non SoA CPU filter reads RGBA32F source directly.
+        const bool halfSrc = _halfPrecision && 0 == maxActiveCpuThreads;
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        const TextureFormat::Enum srcWorkingFormat = halfSrc ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+        const TextureFormat::Enum dstWorkingFormat = _halfPrecision ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * (_halfPrecision ? 2 : 4) /*bytesPerChannel*/;
+        const uint8_t mipStart = uint8_t(_excludeBase);
+        uint32_t numTasks = 0;
+
+        // Memory budget. Working source, normal tables and SoA copies are needed throughout. Without streaming,
+        // the whole output chain in the working format and its conversion to the source format are alive at the end.
+        // Streaming converts every pass of mips to the output right away and keeps only the pass in the working format.
+        // Output taken only from the face callback is always streamed and never kept in the source format.
+        const bool facesOnly = NULL != _progress
+                            && NULL != _progress->m_faceCallback
+                            && _progress->m_faceCallbackOnly
+                            && !gpuEncode
+                            && !shard
+                            ;
+        bool stream = false;
+        uint64_t passBudget = 0;
+        if (facesOnly)
+        {
+            RadianceFilterMemory memory;
+            radianceFilterOutputsMemory(memory, _outputs, _count, srcWorkingFormat, dstWorkingFormat, 0 != maxActiveCpuThreads);
+
+            // Without a budget, passes are as big as the largest one, small mips are filtered together.
+            stream = true;
+            passBudget = (0 != _maxMemoryBytes && memory.m_fixedBytes < _maxMemoryBytes)
+                       ? max(_maxMemoryBytes - memory.m_fixedBytes, memory.m_largestPassBytes)
+                       : memory.m_largestPassBytes
+                       ;
+
+            INFO("Radiance -> Output mips are passed on as they get filtered, about %.1f MB are needed."
+                , double(memory.m_fixedBytes + passBudget)/(1024.0*1024.0)
+                );
+        }
+        else if (0 != _maxMemoryBytes && !gpuEncode && !shard)
+        {
+            RadianceFilterMemory memory;
+            radianceFilterOutputsMemory(memory, _outputs, _count, srcWorkingFormat, dstWorkingFormat, 0 != maxActiveCpuThreads);
+
+            const uint64_t fixedBytes = memory.m_fixedBytes;
+            const uint64_t finalBytes = memory.m_finalBytes;
+            const uint64_t largestPassBytes = memory.m_largestPassBytes;
+            const bool convert = memory.m_convert;
+
+            const uint64_t peakBytes = memory.peakBytes();
+            if (convert
+            &&  peakBytes > _maxMemoryBytes
+            &&  fixedBytes + finalBytes + largestPassBytes < peakBytes)
+            {
+                stream = true;
+                passBudget = (fixedBytes + finalBytes < _maxMemoryBytes) ? _maxMemoryBytes - fixedBytes - finalBytes : 0;
+
+                INFO("Radiance -> Estimated peak memory of %.1f MB exceeds the budget of %.1f MB, streaming output mips."
+                    , double(peakBytes)/(1024.0*1024.0)
+                    , double(_maxMemoryBytes)/(1024.0*1024.0)
+                    );
+
+                if (fixedBytes + finalBytes + largestPassBytes > _maxMemoryBytes)
+                {
+                    WARN("Radiance -> Memory budget of %.1f MB can not be met, about %.1f MB are needed with one mip per pass."
+                        , double(_maxMemoryBytes)/(1024.0*1024.0)
+                        , double(fixedBytes + finalBytes + largestPassBytes)/(1024.0*1024.0)
+                        );
+                }
+            }
+        }
+
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            RadianceFilterJob& job = jobs[ii];
+            job.m_imageRgba32f = Image();
+            job.m_normalsSoa = SoaCubemap();
+            job.m_colorsSoa = SoaCubemap();
+            for (uint8_t level = 0; level < MAX_MIP_NUM; ++level)
+            {
+                job.m_sources[level].m_image = Image();
+                job.m_sources[level].m_normalsSoa = SoaCubemap();
+                job.m_sources[level].m_colorsSoa = SoaCubemap();
+            }
+            job.m_numSources = 0;
+            job.m_halfDst = _halfPrecision;
+            job.m_sourceJob = &jobs[radianceFilterOutputSource(_outputs, ii)];
+            memset(job.m_reuseJob, 0xff, sizeof(job.m_reuseJob));
+            memset(job.m_reuseMip, 0, sizeof(job.m_reuseMip));
+#if CMFT_RADIANCE_SH_ORDER
+            memset(job.m_shMip, 0, sizeof(job.m_shMip));
+            job.m_shCoeffs = NULL;
+#endif // CMFT_RADIANCE_SH_ORDER
+
+            // Processing is done in Rgba32f (or Rgba16f) format. Further outputs of the same source refer to the first one's copy.
+            if (job.m_sourceJob == &job)
+            {
+                job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, srcWorkingFormat, *_outputs[ii].m_src);
+            }
+            else
+            {
+                job.m_imageIsRef = true;
+                job.m_imageRgba32f = job.m_sourceJob->m_imageRgba32f;
+            }
+            const Image& imageRgba32f = job.m_imageRgba32f;
+
+            // Alloc dst data.
+            const uint32_t dstFaceSize = radianceFilterOutputFaceSize(_outputs[ii]);
+            const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _outputs[ii].m_mipCount);
+            uint64_t dstDataSize = 0;
+            for (uint8_t face = 0; face < 6; ++face)
+            {
+                for (uint8_t mip = 0; mip < mipCount; ++mip)
+                {
+                    job.m_dstOffsets[face][mip] = dstDataSize;
+                    uint32_t faceSize = max(uint32_t(1), dstFaceSize >> mip);
+                    dstDataSize += uint64_t(faceSize) * faceSize * bytesPerPixel;
+                }
+            }
+            job.m_dstDataSize = dstDataSize;
+            job.m_dstData = NULL;
+            job.m_finalData = NULL;
+            job.m_finalDataSize = 0;
+            job.m_finalFormat = (TextureFormat::Enum)_outputs[ii].m_src->m_format;
+            if (stream && !facesOnly)
+            {
+                // Output is written in the source format pass by pass.
+                const uint32_t finalBytesPerPixel = getImageDataInfo(job.m_finalFormat).m_bytesPerPixel;
+                for (uint8_t face = 0; face < 6; ++face)
+                {
+                    for (uint8_t mip = 0; mip < mipCount; ++mip)
+                    {
+                        const uint64_t faceSize = max(uint32_t(1), dstFaceSize >> mip);
+                        job.m_finalOffsets[face][mip] = job.m_finalDataSize;
+                        job.m_finalDataSize += faceSize*faceSize*finalBytesPerPixel;
+                    }
+                }
+                job.m_finalData = allocTagged(job.m_finalDataSize, AllocTag::MipChain);
+                MALLOC_CHECK(job.m_finalData);
+            }
+            else
+            {
+                job.m_dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+                MALLOC_CHECK(job.m_dstData);
+
+                // Faces of other shards stay zero.
+                if (shard)
+                {
+                    memset(job.m_dstData, 0, size_t(dstDataSize));
+                }
+            }
+
+            // Packed formats take 4 bytes per texel, offsets are scaled from m_dstOffsets.
+            job.m_encodedData = NULL;
+            memset(job.m_encoded, 0, sizeof(job.m_encoded));
+            if (gpuEncode)
+            {
+                job.m_encodedData = allocTagged(dstDataSize*4/bytesPerPixel, AllocTag::MipChain);
+                MALLOC_CHECK(job.m_encodedData);
+            }
+            job.m_dstFaceSize = dstFaceSize;
+            job.m_mipCount = mipCount;
+
+            // Get source image offsets.
+            imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+
+            // Build cubemap vectors. Cubemaps of the same size share the cached table.
+            job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+            job.m_normals = &job.m_normalsSoa;
+
+            // SoA copies of normals and source colors for CPU filtering. They are kept with the first output of the source.
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+            RadianceFilterJob& sourceJob = *job.m_sourceJob;
+            if (0 != maxActiveCpuThreads && mipCount > mipStart && NULL == sourceJob.m_colorsSoa.m_data)
+            {
+                for (uint32_t jj = 0; jj < ii; ++jj)
+                {
+                    if (jobs[jj].m_cubemapVectors == sourceJob.m_cubemapVectors
+                    &&  NULL != jobs[jj].m_normalsSoa.m_data)
+                    {
+                        sourceJob.m_normals = &jobs[jj].m_normalsSoa;
+                        break;
+                    }
+                }
+
+                if (sourceJob.m_normals == &sourceJob.m_normalsSoa)
+                {
+                    sourceJob.m_normalsSoa.initNormals(sourceJob.m_cubemapVectors, imageRgba32f.m_width);
+                }
+                soaInitColors(sourceJob.m_colorsSoa, imageRgba32f, sourceJob.m_srcFaceOffsets);
+            }
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+            // Resize and copy base image. Streaming does it with the first pass. 1x1 base is reported as the last mip.
+            if (_excludeBase && !stream && hostShard)
+            {
+                radianceFilterCopyBase(job);
+                if (1 < mipCount)
+                {
+                    radianceFilterReportMip(_progress, ii, job, 0);
+                }
+            }
+
+            numTasks += (mipCount > mipStart) ? uint32_t(mipCount-mipStart)*CUBE_FACE_NUM : 0;
+        }
+
+        float lobeEnergyLoss = 0.0f;
+
+        // Output info.
+        INFO("Running radiance filter for:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[dstFaceSize=%u]"
+             , jobs[0].m_imageRgba32f.m_width
+             , getLightingModelStr(_lightingModel)
+             , &"false\0true"[6*_excludeBase]
+             , jobs[0].m_mipCount
+             , _glossScale
+             , _glossBias
+             , jobs[0].m_dstFaceSize
+             );
+
+        uint32_t numSources = 0;
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            numSources += uint32_t(jobs[ii].m_sourceJob == &jobs[ii]);
+        }
+
+        if (numSources > 1)
+        {
+            INFO("Radiance -> Batch of %u cubemaps.", numSources);
+        }
+
+        if (_count > numSources)
+        {
+            INFO("Radiance -> %u outputs of different face size or mip count.", _count);
+        }
+
+        if (_excludeBase)
+        {
+            INFO("Radiance -> Excluding base image.");
+        }
+
+        if (_halfPrecision)
+        {
+            INFO("Radiance -> Storing %s in RGBA16F.", halfSrc ? "source and destination" : "destination");
+        }
+
+        uint8_t maxMipCount = 0;
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            maxMipCount = max(maxMipCount, jobs[ii].m_mipCount);
+        }
+
+        uint64_t filterTime = 0;
+        bool cancelled = false;
+        if (0 == numTasks)
+        {
+            INFO("Radiance -> Nothing left for processing... Increase mip count or do not exclude base image.");
+        }
+        else
+        {
+            // Prepare processing tasks parameters.
+            RadianceFilterParams* params = (RadianceFilterParams*)malloc(numTasks*sizeof(RadianceFilterParams));
+            MALLOC_CHECK(params);
+
+            // Mip and job of each task, to pick tasks of a streaming pass.
+            uint32_t* taskJobs = (uint32_t*)malloc(numTasks*(sizeof(uint32_t)+sizeof(uint8_t)));
+            MALLOC_CHECK(taskJobs);
+            uint8_t* taskMips = (uint8_t*)(taskJobs + numTasks);
+
+            const float glossScalef = float(int32_t(_glossScale));
+            const float glossBiasf = float(int32_t(_glossBias));
+
+            uint32_t taskIdx = 0;
+            uint32_t numShMips = 0;
+            uint32_t numReusedMips = 0;
+            for (uint32_t ii = 0; ii < _count; ++ii)
+            {
+                RadianceFilterJob& job = jobs[ii];
+                RadianceFilterJob& sourceJob = *job.m_sourceJob;
+                const uint8_t mipCount = job.m_mipCount;
+                const RadianceFilterQuality* quality = _outputs[ii].m_quality;
+
+                for (uint32_t mip = mipStart; mip < mipCount; ++mip)
+                {
+                    // Determine filter parameters.
+                    const uint32_t mipFaceSize = max(UINT32_C(1), job.m_dstFaceSize >> mip);
+                    const float lobeTolerance = (NULL != quality) ? quality->m_mipLobeTolerance[mip] : _settings.m_lobeTolerance;
+                    float specularPower, filterAngle, cosAngle, filterSize;
+                    radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, uint8_t(mip), mipCount, glossScalef, glossBiasf, _lightingModel, lobeTolerance);
+                    lobeEnergyLoss = max(lobeEnergyLoss, cosinePowerEnergyLoss(specularPower, cosAngle));
+
+                    // Outputs of the same source whose mips coincide in face size and specular power copy them from the first one.
+                    if (!stream
+                    &&  !gpuEncode
+                    &&  !shard
+                    &&  NULL == quality
+                    &&  radianceFilterFindLevel(job.m_reuseJob[mip], job.m_reuseMip[mip], jobs, ii, mipStart, mipFaceSize, specularPower, glossScalef, glossBiasf, _lightingModel, _settings.m_lobeTolerance))
+                    {
+                        numReusedMips++;
+                        continue;
+                    }
+
+#if CMFT_RADIANCE_SH_ORDER
+                    // Wide lobes are convolved in the SH domain on the host, no tasks are needed.
+                    if (radianceFilterShMip(job.m_shLobes[mip], specularPower, cosAngle))
+                    {
+                        job.m_shMip[mip] = true;
+                        numShMips++;
+                        continue;
+                    }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+#if CMFT_RADIANCE_LOBE_TABLE
+                    job.m_lobeTables[mip].init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+
+                    // Source for this mip.
+                    const Image* srcImage = &sourceJob.m_imageRgba32f;
+                    const uint64_t* srcFaceOffsets = sourceJob.m_srcFaceOffsets;
+                    const float* srcCubemapVectors = sourceJob.m_cubemapVectors;
+                    const SoaCubemap* srcNormals = sourceJob.m_normals;
+                    const SoaCubemap* srcColors = &sourceJob.m_colorsSoa;
+                    if (_useSourcePyramid
+                    ||  NULL != quality)
+                    {
+                        const uint8_t level = (NULL != quality)
+                                            ? radianceFilterQualityLevel(*quality, uint8_t(mip), sourceJob.m_imageRgba32f.m_width)
+                                            : radianceFilterSourceLevel(sourceJob.m_imageRgba32f.m_width, mipFaceSize, filterAngle)
+                                            ;
+                        if (0 != level)
+                        {
+                            radianceFilterBuildSources(sourceJob, level, 0 != maxActiveCpuThreads);
+
+                            const RadianceFilterSource& source = sourceJob.m_sources[level];
+                            srcImage = &source.m_image;
+                            srcFaceOffsets = source.m_faceOffsets;
+                            srcCubemapVectors = source.m_cubemapVectors;
+                            srcNormals = &source.m_normalsSoa;
+                            srcColors = &source.m_colorsSoa;
+                        }
+                    }
+
+                    for (uint8_t face = 0; face < 6; ++face)
+                    {
+                        // Streaming passes set it once their working buffer is allocated.
+                        void* dstPtr = stream ? NULL : (uint8_t*)job.m_dstData + job.m_dstOffsets[face][mip];
+
+                        // 1x1 faces are averaged on the host afterwards, they are packed there too.
+                        void* encodedDstPtr = (gpuEncode && 1 < mipFaceSize)
+                                            ? (uint8_t*)job.m_encodedData + job.m_dstOffsets[face][mip]*4/bytesPerPixel
+                                            : NULL
+                                            ;
+
+                        RadianceFilterParams taskParams =
+                        {
+                            dstPtr,
+                            job.m_halfDst,
+                            face,
+                            mipFaceSize,
+                            filterSize,
+                            specularPower,
+                            cosAngle,
+                            &job.m_lobeTables[mip],
+                            srcCubemapVectors,
+                            srcImage,
+                            srcFaceOffsets,
+                            srcNormals,
+                            srcColors,
+                            _settings.m_adaptiveTolerance,
+                            encodedDstPtr,
+                            &job.m_encoded[face][mip],
+                            ii,
+                            uint8_t(mip),
+                        };
+
+                        // Enqueue processing parameters.
+                        taskMips[taskIdx] = uint8_t(mip);
+                        taskJobs[taskIdx] = ii;
+                        memcpy(&params[taskIdx++], &taskParams, sizeof(RadianceFilterParams));
+                    }
+                }
+            }
+
+            numTasks = taskIdx;
+
+            if (shard)
+            {
+                numTasks = radianceFilterShardTasks(params, taskJobs, taskMips, numTasks, *_shard);
+            }
+
+            if (NULL != _progress
+            &&  NULL != _progress->m_resumeCallback
+            &&  !stream
+            &&  !gpuEncode)
+            {
+                numTasks = radianceFilterResumeTasks(params, taskJobs, taskMips, numTasks, *_progress);
+            }
+
+            if (s_defaultFilterSettings.m_lobeTolerance != _settings.m_lobeTolerance)
+            {
+                INFO("Radiance -> Lobe tolerance %g, at most %.3f%% of lobe energy is cut off.", double(filterLobeTolerance(_settings)), double(lobeEnergyLoss)*100.0);
+            }
+
+            if (_settings.m_numaReplicas && 0 != maxActiveCpuThreads)
+            {
+                radianceFilterReplicateSources(params, numTasks);
+            }
+
+            if (0 != numReusedMips)
+            {
+                INFO("Radiance -> %u mip%s shared between outputs of the same source.", numReusedMips, numReusedMips==1?"":"s");
+            }
+
+            if (0 != numShMips)
+            {
+                INFO("Radiance -> %u mip%s with wide lobes convolved in the SH domain, %u bands."
+                    , numShMips
+                    , numShMips==1?"":"s"
+                    , CMFT_RADIANCE_SH_ORDER
+                    );
+            }
+
+            // Start global timer.
+            stats.m_startTime = bx::getHPCounter();
+            INFO("Radiance -> Starting filter...");
+
+            INFO("Radiance -> Utilizing %u CPU processing thread%s%s%s."
+                 , maxActiveCpuThreads
+                 , maxActiveCpuThreads==1?"":"s"
+                 , 0 == numDevices?"":" and "
+                 , 0 == numDevices?"":radianceProgram[0].m_clContext->m_deviceName
+                 );
+
+            for (uint8_t ii = 1; ii < numDevices; ++ii)
+            {
+                INFO("Radiance -> Utilizing <GPU%u> %s.", ii, radianceProgram[ii].m_clContext->m_deviceName);
+            }
+
+            // Output process header info.
+            INFO("Radiance -> ------------------------------------");
+            INFO("Radiance ->  Device / Face /     Time /    Total");
+            INFO("Radiance -> ------------------------------------");
+
+            // CPU processing runs on the job system. Host side of the first OpenCL device runs on this thread,
+            // other devices get their own task each. Without OpenCL, this thread takes one of the CPU tasks while waiting.
+            JobSystem& jobSystem = *getJobSystem();
+            jobSystem.reserve(0 != numDevices
+                            ? uint16_t(maxActiveCpuThreads + numDevices-1)
+                            : uint16_t(max(uint16_t(1), maxActiveCpuThreads)-1)
+                            );
+
+            // Streaming filters a range of mips at a time into a working buffer, which is then converted to the output.
+            RadianceFilterParams* passParams = stream ? (RadianceFilterParams*)malloc(numTasks*sizeof(RadianceFilterParams)) : params;
+            MALLOC_CHECK(passParams);
+
+            double totalCost = 0.0;
+            for (uint32_t ii = 0; ii < numTasks; ++ii)
+            {
+                totalCost += radianceFilterTaskCost(params[ii]);
+            }
+
+            double costDone = 0.0;
+            uint8_t passBegin = 0;
+            while (passBegin < maxMipCount && !cancelled)
+            {
+                uint8_t passEnd = maxMipCount;
+                uint32_t numPassTasks = numTasks;
+                if (stream)
+                {
+                    passEnd = radianceFilterStreamPassEnd(jobs, _count, passBegin, maxMipCount, passBudget, bytesPerPixel);
+                    INFO("Radiance -> Streaming mips [%u, %u).", passBegin, passEnd);
+
+                    for (uint32_t ii = 0; ii < _count; ++ii)
+                    {
+                        radianceFilterStreamAlloc(jobs[ii], passBegin, passEnd, bytesPerPixel);
+                        if (0 == passBegin && _excludeBase)
+                        {
+                            radianceFilterCopyBase(jobs[ii]);
+                            if (1 < jobs[ii].m_mipCount)
+                            {
+                                radianceFilterReportMip(_progress, ii, jobs[ii], 0);
+                            }
+                        }
+                    }
+
+                    numPassTasks = 0;
+                    for (uint32_t ii = 0; ii < numTasks; ++ii)
+                    {
+                        const uint8_t mip = taskMips[ii];
+                        if (passBegin <= mip && mip < passEnd)
+                        {
+                            const RadianceFilterJob& job = jobs[taskJobs[ii]];
+                            passParams[numPassTasks] = params[ii];
+                            passParams[numPassTasks].m_dstPtr = (uint8_t*)job.m_dstData + job.m_dstOffsets[params[ii].m_face][mip];
+                            numPassTasks++;
+                        }
+                    }
+                }
+
+                if (0 != numPassTasks)
+                {
+                    RadianceFilterTaskList taskList(passParams, numPassTasks, maxActiveCpuThreads, numDevices, _progress, concurrencyMin, concurrencyMax);
+                    taskList.setProgressRange(costDone, totalCost, stats.m_startTime);
+                    taskList.m_encodeFormat = _gpuEncodeFormat;
+                    for (uint8_t ii = 0; ii < numDevices; ++ii)
+                    {
+                        taskList.setDeviceLimits(ii, deviceMaxSrcFaceSize[ii], deviceMaxDstFaceSize[ii]);
+                    }
+
+                    for (uint16_t ii = 0; ii < maxActiveCpuThreads; ++ii)
+                    {
+                        threadArgs[ii].m_taskList = &taskList;
+                        threadArgs[ii].m_stats = &stats;
+                        threadArgs[ii].m_device = NULL;
+                        threadArgs[ii].m_threadIdx = ii;
+                        threadArgs[ii].m_firstCpu = firstNativeCpu;
+                        threadArgs[ii].m_numCpus = numNativeCpus;
+                        threadArgs[ii].m_pinToCore = _settings.m_pinThreadsToCores;
+                    }
+
+                    // Gpu host threads are indexed by device.
+                    RadianceFilterThreadArgs* gpuThreadArgs = &threadArgs[maxActiveCpuThreads];
+                    for (uint8_t ii = 0; ii < numDevices; ++ii)
+                    {
+                        gpuThreadArgs[ii].m_taskList = &taskList;
+                        gpuThreadArgs[ii].m_stats = &stats;
+                        gpuThreadArgs[ii].m_device = &radianceProgram[ii];
+                        gpuThreadArgs[ii].m_threadIdx = ii;
+                        gpuThreadArgs[ii].m_firstCpu = 0;
+                        gpuThreadArgs[ii].m_numCpus = 0;
+                        gpuThreadArgs[ii].m_pinToCore = false;
+                    }
+
+                    // Gpu tasks are dispatched first so that workers pick them up before the CPU tasks.
+                    JobGroup gpuGroup;
+                    if (numDevices > 1)
+                    {
+                        jobSystem.dispatch(gpuGroup, radianceFilterGpuTask, (void*)&gpuThreadArgs[1], numDevices-1);
+                    }
+
+                    JobGroup cpuGroup;
+                    jobSystem.dispatch(cpuGroup, radianceFilterCpuTask, (void*)threadArgs, maxActiveCpuThreads);
+
+                    if (0 != numDevices)
+                    {
+                        radianceFilterGpu((void*)&gpuThreadArgs[0]);
+                    }
+
+                    // Wait for everything to finish.
+                    jobSystem.wait(cpuGroup);
+                    jobSystem.wait(gpuGroup);
+                    cancelled = taskList.isCancelled();
+
+                    for (uint32_t ii = 0; ii < numPassTasks; ++ii)
+                    {
+                        costDone += radianceFilterTaskCost(passParams[ii]);
+                    }
+                }
+
+                for (uint32_t ii = 0; ii < _count && !cancelled; ++ii)
+                {
+                    RadianceFilterJob& job = jobs[ii];
+
+                    // Earlier outputs are finished by now, shared mips are copied from them.
+                    for (uint8_t mip = passBegin, end = min(passEnd, job.m_mipCount); mip < end; ++mip)
+                    {
+                        if (UINT32_MAX != job.m_reuseJob[mip])
+                        {
+                            radianceFilterCopyLevel(job, mip, jobs[job.m_reuseJob[mip]], job.m_reuseMip[mip], bytesPerPixel);
+                            radianceFilterReportMip(_progress, ii, job, mip);
+                        }
+                    }
+
+#if CMFT_RADIANCE_SH_ORDER
+                    for (uint8_t mip = passBegin, end = min(passEnd, job.m_mipCount); mip < end && hostShard; ++mip)
+                    {
+                        if (job.m_shMip[mip])
+                        {
+                            // Projection of the source is shared by its outputs.
+                            radianceFilterShProject(*job.m_sourceJob);
+                            job.m_shCoeffs = job.m_sourceJob->m_shCoeffs;
+                            radianceFilterShEvaluate(job, mip);
+                            if (1 < (job.m_dstFaceSize >> mip))
+                            {
+                                radianceFilterReportMip(_progress, ii, job, mip);
+                            }
+                        }
+                    }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+                    // Average 1x1 face size. Copied last mip is averaged already.
+                    if (passBegin < job.m_mipCount && job.m_mipCount <= passEnd && UINT32_MAX == job.m_reuseJob[job.m_mipCount-1] && hostShard)
+                    {
+                        radianceFilterAverageLastMip(job);
+
+                        const uint8_t lastMip = job.m_mipCount-1;
+                        if (1 >= (job.m_dstFaceSize >> lastMip))
+                        {
+                            radianceFilterReportMip(_progress, ii, job, lastMip);
+                        }
+                    }
+
+                    if (stream)
+                    {
+                        radianceFilterStreamFinish(job, passBegin, passEnd);
+                    }
+                }
+
+                passBegin = passEnd;
+            }
+            filterTime = bx::getHPCounter() - stats.m_startTime;
+
+            if (stream)
+            {
+                free(passParams);
+            }
+
+            if (gpuEncode)
+            {
+                INFO("Radiance -> Results packed to %s on the GPU.", getTextureFormatStr(_gpuEncodeFormat));
+            }
+
+            // Get filter duration.
+            const double freq = double(bx::getHPFrequency());
+            const double toSec = 1.0/freq;
+            const uint64_t totalTime = bx::getHPCounter() - stats.m_startTime;
+
+            // Output progress info.
+            INFO("Radiance -> ------------------------------------");
+            INFO("Radiance -> Total faces processed on [CPU]: %u", stats.m_completedTasksCpu);
+            INFO("Radiance -> Total faces processed on <GPU>: %u", stats.m_completedTasksGpu);
+            INFO("Radiance -> Total time: %.3f seconds.", double(totalTime)*toSec);
+
+            // Kernel time close to device busy time means the bake is compute bound, large transfer times point to the bus.
+            for (uint8_t ii = 0; ii < numDevices; ++ii)
+            {
+                const ComputeDevice& device = radianceProgram[ii];
+                ComputeDeviceStats deviceStats;
+                device.getStats(deviceStats);
+
+                if (device.hasHostUnifiedMemory())
+                {
+                    INFO("Radiance -> <GPU%u> shares memory with the host, %.1f MB uploaded and %.1f MB read back."
+                        , ii
+                        , double(deviceStats.m_bytesToDevice)/(1024.0*1024.0)
+                        , double(deviceStats.m_bytesFromDevice)/(1024.0*1024.0)
+                        );
+                }
+
+                if (device.isProfiling())
+                {
+                    const double transferTime = deviceStats.m_uploadTime + deviceStats.m_readTime;
+                    INFO("Radiance -> <GPU%u> kernel %.3fs, transfer %.3fs (upload %.3fs, read %.3fs), host idle %.3fs, %.1f%% of device time in kernels."
+                        , ii
+                        , deviceStats.m_kernelTime
+                        , transferTime
+                        , deviceStats.m_uploadTime
+                        , deviceStats.m_readTime
+                        , deviceStats.m_hostIdleTime
+                        , (deviceStats.m_kernelTime + transferTime) > 0.0 ? deviceStats.m_kernelTime/(deviceStats.m_kernelTime + transferTime)*100.0 : 0.0
+                        );
+                }
+            }
+
+            if (cancelled)
+            {
+                INFO("Radiance -> Cancelled.");
+            }
+
+            free(taskJobs);
+            free(params);
+        }
+
+        const uint64_t finishStartTime = bx::getHPCounter();
+
+        if (NULL != _stats)
+        {
+            *_stats = FilterStats();
+            _stats->m_tasksCpu = stats.m_completedTasksCpu;
+            _stats->m_texelsCpu = stats.m_texelsCpu;
+            _stats->m_lobeEnergyLoss = lobeEnergyLoss;
+            for (uint8_t ii = 0; ii < numDevices; ++ii)
+            {
+                _stats->m_tasksGpu[contextIdx[ii]] = stats.m_deviceTasks[ii];
+                _stats->m_texelsGpu[contextIdx[ii]] = stats.m_deviceTexels[ii];
+                ComputeDeviceStats deviceStats;
+                radianceProgram[ii].getStats(deviceStats);
+                _stats->m_bytesToDevice += deviceStats.m_bytesToDevice;
+                _stats->m_bytesFromDevice += deviceStats.m_bytesFromDevice;
+                _stats->m_gpuUploadTime[contextIdx[ii]] = deviceStats.m_uploadTime;
+                _stats->m_gpuKernelTime[contextIdx[ii]] = deviceStats.m_kernelTime;
+                _stats->m_gpuReadTime[contextIdx[ii]] = deviceStats.m_readTime;
+                _stats->m_gpuHostIdleTime[contextIdx[ii]] = deviceStats.m_hostIdleTime;
+            }
+        }
+
+        // Cleanup.
+        for (uint8_t ii = 0; ii < numDevices; ++ii)
+        {
+            radianceProgram[ii].releaseDeviceMemory();
+            radianceProgram[ii].destroy();
+        }
+
+#if CMFT_RADIANCE_SH_ORDER >= 5
+        // Bands of the projection wide lobes were convolved with, the source is projected now if no mip needed it.
+        for (uint32_t ii = 0; ii < _count && !cancelled; ++ii)
+        {
+            if (NULL != _outputs[ii].m_shCoeffs)
+            {
+                radianceFilterShProject(*jobs[ii].m_sourceJob);
+                memcpy(_outputs[ii].m_shCoeffs, jobs[ii].m_sourceJob->m_shCoeffs, SH_COEFF_NUM*3*sizeof(double));
+            }
+        }
+#endif // CMFT_RADIANCE_SH_ORDER >= 5
+
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            RadianceFilterJob& job = jobs[ii];
+            job.m_normalsSoa.unload();
+            job.m_colorsSoa.unload();
+            releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+            radianceFilterReleaseSources(job);
+#if CMFT_RADIANCE_SH_ORDER
+            if (job.m_sourceJob == &job)
+            {
+                free(job.m_shCoeffs);
+            }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+            // Source format is taken from the job, _dst may alias _src and earlier outputs are written already.
+            const TextureFormat::Enum srcFormat = job.m_finalFormat;
+            if (!job.m_imageIsRef)
+            {
+                imageUnload(job.m_imageRgba32f);
+            }
+
+            // Partial results are dropped.
+            if (cancelled)
+            {
+                getAllocator()->free(job.m_dstData);
+                getAllocator()->free(job.m_encodedData);
+                getAllocator()->free(job.m_finalData);
+                continue;
+            }
+
+            // Fill result structure.
+            Image result;
+            result.m_width = job.m_dstFaceSize;
+            result.m_height = job.m_dstFaceSize;
+            result.m_dataSize = job.m_dstDataSize;
+            result.m_format = dstWorkingFormat;
+            result.m_numMips = job.m_mipCount;
+            result.m_numFaces = 6;
+            result.m_data = job.m_dstData;
+
+            if (facesOnly)
+            {
+                // Faces were passed on, there is nothing to return.
+                imageUnload(_dst[ii]);
+            }
+            else if (stream)
+            {
+                // Streamed output is already in the source format.
+                result.m_dataSize = job.m_finalDataSize;
+                result.m_format = job.m_finalFormat;
+                result.m_data = job.m_finalData;
+                imageMove(_dst[ii], result);
+            }
+            else if (gpuEncode)
+            {
+                // Result stays in the packed format, faces left in the working format are packed here.
+                radianceFilterEncodeRemaining(job, _gpuEncodeFormat);
+                getAllocator()->free(job.m_dstData);
+
+                result.m_dataSize = job.m_dstDataSize*4/bytesPerPixel;
+                result.m_format = _gpuEncodeFormat;
+                result.m_data = job.m_encodedData;
+                imageMove(_dst[ii], result);
+            }
+            // Convert back to source format. Shards stay in the working format for merging.
+            else if (dstWorkingFormat == srcFormat || shard)
+            {
+                imageMove(_dst[ii], result);
+            }
+            else
+            {
+                imageConvert(result, srcFormat);
+                imageMove(_dst[ii], result);
+            }
+        }
+
+        free(jobs);
+
+        if (NULL != _stats)
+        {
+            const double toSec = 1.0/double(bx::getHPFrequency());
+            const uint64_t endTime = bx::getHPCounter();
+            _stats->m_filterTime = double(filterTime)*toSec;
+            _stats->m_finishTime = double(endTime - finishStartTime)*toSec;
+            _stats->m_totalTime = double(endTime - entryTime)*toSec;
+            _stats->m_prepareTime = max(0.0, _stats->m_totalTime - _stats->m_filterTime - _stats->m_finishTime);
+        }
+
+        return !cancelled;
+    }
+
+    bool imageRadianceFilterBatch(Image* _dst
+                                , const Image* _src
+                                , uint32_t _count
+                                , uint32_t _dstFaceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , int16_t _numCpuProcessingThreads
+                                , const ClContext* const* _clContexts
+                                , uint8_t _numClContexts
+                                , bool _useSourcePyramid
+                                , bool _halfPrecision
+                                , TextureFormat::Enum _gpuEncodeFormat
+                                , FilterStats* _stats
+                                , FilterProgress* _progress
+                                , uint64_t _maxMemoryBytes
+                                , const FilterShard* _shard
+                                , const FilterSettings* _settings
+                                )
+    {
+        if (0 == _count)
+        {
+            return true;
+        }
+
+        RadianceFilterOutput* outputs = (RadianceFilterOutput*)malloc(_count*sizeof(RadianceFilterOutput));
+        MALLOC_CHECK(outputs);
+        for (uint32_t ii = 0; ii < _count; ++ii)
+        {
+            outputs[ii].m_src = &_src[ii];
+            outputs[ii].m_shCoeffs = NULL;
+            outputs[ii].m_dstFaceSize = _dstFaceSize;
+            outputs[ii].m_mipCount = _mipCount;
+            outputs[ii].m_quality = NULL;
+        }
+
+        const bool result = radianceFilterOutputs(_dst, outputs, _count, _lightingModel, _excludeBase, _glossScale, _glossBias, _numCpuProcessingThreads, _clContexts, _numClContexts, _useSourcePyramid, _halfPrecision, _gpuEncodeFormat, _stats, _progress, _maxMemoryBytes, _shard, filterSettings(_settings));
+
+        free(outputs);
+
+        return result;
+    }
+
+    bool imageRadianceFilterTiers(Image* _dst
+                                , const uint32_t* _dstFaceSizes
+                                , const uint8_t* _mipCounts
+                                , uint32_t _numTiers
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , const Image& _src
+                                , int16_t _numCpuProcessingThreads
+                                , const ClContext* const* _clContexts
+                                , uint8_t _numClContexts
+                                , bool _useSourcePyramid
+                                , bool _halfPrecision
+                                , TextureFormat::Enum _gpuEncodeFormat
+                                , FilterStats* _stats
+                                , FilterProgress* _progress
+                                , uint64_t _maxMemoryBytes
+                                , const FilterShard* _shard
+                                , const FilterSettings* _settings
+                                )
+    {
+        if (0 == _numTiers)
+        {
+            return true;
+        }
+
+        RadianceFilterOutput* outputs = (RadianceFilterOutput*)malloc(_numTiers*sizeof(RadianceFilterOutput));
+        MALLOC_CHECK(outputs);
+        for (uint32_t ii = 0; ii < _numTiers; ++ii)
+        {
+            outputs[ii].m_src = &_src;
+            outputs[ii].m_shCoeffs = NULL;
+            outputs[ii].m_dstFaceSize = _dstFaceSizes[ii];
+            outputs[ii].m_mipCount = _mipCounts[ii];
+            outputs[ii].m_quality = NULL;
+        }
+
+        const bool result = radianceFilterOutputs(_dst, outputs, _numTiers, _lightingModel, _excludeBase, _glossScale, _glossBias, _numCpuProcessingThreads, _clContexts, _numClContexts, _useSourcePyramid, _halfPrecision, _gpuEncodeFormat, _stats, _progress, _maxMemoryBytes, _shard, filterSettings(_settings));
+
+        free(outputs);
+
+        return result;
+    }
+
+    bool imageRadianceFilterTiers(Image* _dst
+                                , const uint32_t* _dstFaceSizes
+                                , const uint8_t* _mipCounts
+                                , uint32_t _numTiers
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , const Image& _src
+                                , int16_t _numCpuProcessingThreads
+                                , const ClContext* _clContext
+                                , bool _useSourcePyramid
+                                , bool _halfPrecision
+                                , const FilterSettings* _settings
+                                )
+    {
+        return imageRadianceFilterTiers(_dst, _dstFaceSizes, _mipCounts, _numTiers, _lightingModel, _excludeBase, _glossScale, _glossBias, _src, _numCpuProcessingThreads, &_clContext, uint8_t(NULL != _clContext), _useSourcePyramid, _halfPrecision, TextureFormat::Unknown, NULL, NULL, 0, NULL, _settings);
+    }
+
+    bool imageEnvironmentBake(EnvironmentBake& _result
+                            , const Image& _src
+                            , uint32_t _dstFaceSize
+                            , LightingModel::Enum _lightingModel
+                            , bool _excludeBase
+                            , uint8_t _mipCount
+                            , uint8_t _glossScale
+                            , uint8_t _glossBias
+                            , uint32_t _irradianceFaceSize
+                            , uint8_t _shOrder
+                            , int16_t _numCpuProcessingThreads
+                            , const ClContext* const* _clContexts
+                            , uint8_t _numClContexts
+                            , bool _useSourcePyramid
+                            , bool _halfPrecision
+                            , FilterStats* _stats
+                            , FilterProgress* _progress
+                            , const FilterSettings* _settings
+                            )
+    {
+        if (!shOrderIsValid(_shOrder))
+        {
+            WARN("Spherical harmonics order %u is not supported. Supported orders are 2, 3 and 5.", _shOrder);
+            return false;
+        }
+
+        double shCoeffs[SH_COEFF_NUM][3];
+
+        RadianceFilterOutput output;
+        output.m_src = &_src;
+        output.m_shCoeffs = (CMFT_RADIANCE_SH_ORDER >= 5) ? shCoeffs : NULL;
+        output.m_dstFaceSize = _dstFaceSize;
+        output.m_mipCount = _mipCount;
+        output.m_quality = NULL;
+
+        Image radiance;
+        if (!radianceFilterOutputs(&radiance, &output, 1, _lightingModel, _excludeBase, _glossScale, _glossBias, _numCpuProcessingThreads, _clContexts, _numClContexts, _useSourcePyramid, _halfPrecision, TextureFormat::Unknown, _stats, _progress, 0, NULL, filterSettings(_settings)))
+        {
+            return false;
+        }
+
+        // Without enough radiance SH bands the source is projected on its own.
+        if (NULL == output.m_shCoeffs
+        &&  !imageShCoeffs(shCoeffs, _src, 5, (0 != _numClContexts) ? _clContexts[0] : NULL, _settings))
+        {
+            imageUnload(radiance);
+            return false;
+        }
+
+        // Higher bands are left out, the same as a projection of _shOrder bands.
+        for (uint8_t ii = _shOrder*_shOrder; ii < SH_COEFF_NUM; ++ii)
+        {
+            shCoeffs[ii][0] = 0.0;
+            shCoeffs[ii][1] = 0.0;
+            shCoeffs[ii][2] = 0.0;
+        }
+
+        imageUnload(_result.m_irradiance);
+        if (0 != _irradianceFaceSize)
+        {
+            FilterStats stats;
+            irradianceShEval(_result.m_irradiance, shCoeffs, _shOrder, _irradianceFaceSize, (0 != _numClContexts) ? _clContexts[0] : NULL, stats);
+            INFO("Irradiance -> Evaluated from the radiance SH projection, %u bands, face size %u.", _shOrder, _irradianceFaceSize);
+        }
+
+        imageMove(_result.m_radiance, radiance);
+        memcpy(_result.m_shCoeffs, shCoeffs, sizeof(shCoeffs));
+
+        return true;
+    }
+
+    bool imageRadianceFilterBatch(Image* _dst
+                                , const Image* _src
+                                , uint32_t _count
+                                , uint32_t _dstFaceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , int16_t _numCpuProcessingThreads
+                                , const ClContext* _clContext
+                                , bool _useSourcePyramid
+                                , bool _halfPrecision
+                                , const FilterSettings* _settings
+                                )
+    {
+        return imageRadianceFilterBatch(_dst, _src, _count, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _numCpuProcessingThreads, &_clContext, uint8_t(NULL != _clContext), _useSourcePyramid, _halfPrecision, TextureFormat::Unknown, NULL, NULL, 0, NULL, _settings);
+    }
+
+    bool imageRadianceFilter(Image& _dst
+                           , uint32_t _dstFaceSize
+                           , LightingModel::Enum _lightingModel
+                           , bool _excludeBase
+                           , uint8_t _mipCount
+                           , uint8_t _glossScale
+                           , uint8_t _glossBias
+                           , const Image& _src
+                           , int16_t _numCpuProcessingThreads
+                           , const ClContext* const* _clContexts
+                           , uint8_t _numClContexts
+                           , bool _useSourcePyramid
+                           , bool _halfPrecision
+                           , TextureFormat::Enum _gpuEncodeFormat
+                           , FilterStats* _stats
+                           , FilterProgress* _progress
+                           , uint64_t _maxMemoryBytes
+                           , const FilterShard* _shard
+                           , const FilterSettings* _settings
+                           )
+    {
+        return imageRadianceFilterBatch(&_dst, &_src, 1, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _numCpuProcessingThreads, _clContexts, _numClContexts, _useSourcePyramid, _halfPrecision, _gpuEncodeFormat, _stats, _progress, _maxMemoryBytes, _shard, _settings);
+    }
+
+    bool imageRadianceFilter(Image& _dst
+                           , uint32_t _dstFaceSize
+                           , LightingModel::Enum _lightingModel
+                           , bool _excludeBase
+                           , uint8_t _mipCount
+                           , uint8_t _glossScale
+                           , uint8_t _glossBias
+                           , const Image& _src
+                           , int16_t _numCpuProcessingThreads
+                           , const ClContext* _clContext
+                           , bool _useSourcePyramid
+                           , bool _halfPrecision
+                           , const FilterSettings* _settings
+                           )
+    {
+        return imageRadianceFilterBatch(&_dst, &_src, 1, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _numCpuProcessingThreads, &_clContext, uint8_t(NULL != _clContext), _useSourcePyramid, _halfPrecision, TextureFormat::Unknown, NULL, NULL, 0, NULL, _settings);
+    }
+
+    void imageRadianceFilter(Image& _image
+                           , uint32_t _dstFaceSize
+                           , LightingModel::Enum _lightingModel
+                           , bool _excludeBase
+                           , uint8_t _mipCount
+                           , uint8_t _glossScale
+                           , uint8_t _glossBias
+                           , int16_t _numCpuProcessingThreads
+                           , const ClContext* const* _clContexts
+                           , uint8_t _numClContexts
+                           , bool _useSourcePyramid
+                           , bool _halfPrecision
+                           , TextureFormat::Enum _gpuEncodeFormat
+                           , FilterStats* _stats
+                           , FilterProgress* _progress
+                           , uint64_t _maxMemoryBytes
+                           , const FilterShard* _shard
+                           , const FilterSettings* _settings
+                           )
+    {
+        Image tmp;
+        if(imageRadianceFilter(tmp, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _image, _numCpuProcessingThreads, _clContexts, _numClContexts, _useSourcePyramid, _halfPrecision, _gpuEncodeFormat, _stats, _progress, _maxMemoryBytes, _shard, _settings))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    void imageRadianceFilter(Image& _image
+                           , uint32_t _dstFaceSize
+                           , LightingModel::Enum _lightingModel
+                           , bool _excludeBase
+                           , uint8_t _mipCount
+                           , uint8_t _glossScale
+                           , uint8_t _glossBias
+                           , int16_t _numCpuProcessingThreads
+                           , const ClContext* _clContext
+                           , bool _useSourcePyramid
+                           , bool _halfPrecision
+                           , const FilterSettings* _settings
+                           )
+    {
+        imageRadianceFilter(_image, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _numCpuProcessingThreads, &_clContext, uint8_t(NULL != _clContext), _useSourcePyramid, _halfPrecision, TextureFormat::Unknown, NULL, NULL, 0, NULL, _settings);
+    }
+
+    static bool radianceFilterIsZero(const uint8_t* _data, uint64_t _size)
+    {
+        for (uint64_t ii = 0; ii < _size; ++ii)
+        {
+            if (0 != _data[ii])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool imageRadianceFilterMerge(Image& _dst, const Image* _shards, uint32_t _numShards)
+    {
+        if (0 == _numShards)
+        {
+            WARN("Radiance -> No shards to merge.");
+
+            return false;
+        }
+
+        const Image& first = _shards[0];
+        if (TextureFormat::RGBA32F != first.m_format
+        &&  TextureFormat::RGBA16F != first.m_format)
+        {
+            WARN("Radiance -> Shards have to be in RGBA32F or RGBA16F format, not %s.", getTextureFormatStr(first.m_format));
+
+            return false;
+        }
+
+        for (uint32_t ii = 1; ii < _numShards; ++ii)
+        {
+            const Image& shard = _shards[ii];
+            if (shard.m_width    != first.m_width
+            ||  shard.m_height   != first.m_height
+            ||  shard.m_format   != first.m_format
+            ||  shard.m_numMips  != first.m_numMips
+            ||  shard.m_numFaces != first.m_numFaces
+            ||  shard.m_dataSize != first.m_dataSize)
+            {
+                WARN("Radiance -> Shard %u does not match shard 0, shards have to come from the same bake.", ii);
+
+                return false;
+            }
+        }
+
+        Image result;
+        result.m_width = first.m_width;
+        result.m_height = first.m_height;
+        result.m_dataSize = first.m_dataSize;
+        result.m_format = first.m_format;
+        result.m_numMips = first.m_numMips;
+        result.m_numFaces = first.m_numFaces;
+        result.m_data = result.m_allocator->alloc(result.m_dataSize);
+        MALLOC_CHECK(result.m_data);
+
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, first);
+
+        // Faces of other shards are zero, each face is taken from the only shard with texels other than zero.
+        const uint32_t bytesPerPixel = getImageDataInfo(first.m_format).m_bytesPerPixel;
+        for (uint8_t face = 0; face < first.m_numFaces; ++face)
+        {
+            for (uint8_t mip = 0; mip < first.m_numMips; ++mip)
+            {
+                const uint64_t width  = max(UINT32_C(1), first.m_width  >> mip);
+                const uint64_t height = max(UINT32_C(1), first.m_height >> mip);
+                const uint64_t size = width*height*bytesPerPixel;
+
+                uint32_t owner = UINT32_MAX;
+                for (uint32_t ii = 0; ii < _numShards; ++ii)
+                {
+                    if (radianceFilterIsZero((const uint8_t*)_shards[ii].m_data + offsets[face][mip], size))
+                    {
+                        continue;
+                    }
+
+                    if (UINT32_MAX != owner)
+                    {
+                        WARN("Radiance -> Face %u of mip %u was filtered by shards %u and %u.", face, mip, owner, ii);
+                        imageUnload(result);
+
+                        return false;
+                    }
+                    owner = ii;
+                }
+
+                uint8_t* dst = (uint8_t*)result.m_data + offsets[face][mip];
+                if (UINT32_MAX != owner)
+                {
+                    memcpy(dst, (const uint8_t*)_shards[owner].m_data + offsets[face][mip], size_t(size));
+                }
+                else
+                {
+                    memset(dst, 0, size_t(size));
+                }
+            }
+        }
+
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    // Device calibration.
+    //-----
+
+    #ifndef CMFT_CALIBRATE_FACE_SIZE
+        #define CMFT_CALIBRATE_FACE_SIZE 128
+    #endif //CMFT_CALIBRATE_FACE_SIZE
+
+    /// Calibration cubemap is filtered into half its face size with this many mips, gloss scale 10 and bias 1.
+    static const uint8_t s_calibrateMipCount = 7;
+
+    /// Filters the calibration cubemap on _numCpuThreads CPU threads and _clContext. Returns the best time of the runs after
+    /// the first one in seconds, zero if filtering failed. With _filterTimeOnly, source preparation and conversion of the result
+    /// are left out, see FilterStats::m_filterTime.
+    static double radianceFilterCalibrateTime(int16_t _numCpuThreads, const ClContext* _clContext, bool _filterTimeOnly = false)
+    {
+        // Smooth synthetic source, content does not change the cost of radiance filtering.
+        const uint32_t faceSize = CMFT_CALIBRATE_FACE_SIZE;
+        const uint64_t faceTexels = uint64_t(faceSize)*faceSize;
+        float* data = (float*)malloc(CUBE_FACE_NUM*faceTexels*4*sizeof(float));
+        MALLOC_CHECK(data);
+        if (NULL == data)
+        {
+            return 0.0;
+        }
+
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint64_t ii = 0; ii < faceTexels; ++ii)
+            {
+                float* texel = &data[(face*faceTexels + ii)*4];
+                texel[0] = float(face)/float(CUBE_FACE_NUM);
+                texel[1] = float(ii%faceSize)/float(faceSize);
+                texel[2] = float(ii/faceSize)/float(faceSize);
+                texel[3] = 1.0f;
+            }
+        }
+
+        Image src;
+        src.m_width = faceSize;
+        src.m_height = faceSize;
+        src.m_dataSize = CUBE_FACE_NUM*faceTexels*4*sizeof(float);
+        src.m_format = TextureFormat::RGBA32F;
+        src.m_numMips = 1;
+        src.m_numFaces = CUBE_FACE_NUM;
+        src.m_data = (void*)data;
+
+        // First run builds the program and warms up the device. Best of the next two runs is taken.
+        const bool printInfo = g_printInfo;
+        g_printInfo = false;
+
+        double best = 0.0;
+        for (uint8_t run = 0; run < 3; ++run)
+        {
+            Image dst;
+            FilterStats stats;
+            const uint64_t begin = bx::getHPCounter();
+            const bool filtered = imageRadianceFilter(dst, faceSize/2, LightingModel::PhongBrdf, false, s_calibrateMipCount, 10, 1, src, _numCpuThreads, &_clContext, uint8_t(NULL != _clContext), false, false, TextureFormat::Unknown, &stats);
+            const double time = _filterTimeOnly ? stats.m_filterTime : double(bx::getHPCounter() - begin)/double(bx::getHPFrequency());
+            imageUnload(dst);
+
+            if (!filtered)
+            {
+                best = 0.0;
+                break;
+            }
+
+            if (0 != run && 0.0 < time)
+            {
+                best = (0.0 == best) ? time : min(best, time);
+            }
+        }
+
+        g_printInfo = printInfo;
+        free(data);
+
+        return best;
+    }
+
+    double imageRadianceFilterCalibrate(const ClContext* _clContext)
+    {
+        const double time = radianceFilterCalibrateTime(0, _clContext);
+        if (0.0 == time)
+        {
+            return 0.0;
+        }
+
+        // Millions of filtered texels per second.
+        const uint64_t numTexels = radianceFilterMipTexels(CMFT_CALIBRATE_FACE_SIZE/2, 0, s_calibrateMipCount);
+        return double(numTexels)/time*1e-6;
+    }
+
+    bool filterProfileCalibrate(FilterProfile& _profile, int16_t _numCpuThreads, const ClContext* const* _clContexts, uint8_t _numClContexts)
+    {
+        RadianceFilterEstimate estimate;
+        imageRadianceFilterEstimate(estimate
+                                  , CMFT_CALIBRATE_FACE_SIZE
+                                  , TextureFormat::RGBA32F
+                                  , CMFT_CALIBRATE_FACE_SIZE/2
+                                  , LightingModel::PhongBrdf
+                                  , false
+                                  , s_calibrateMipCount
+                                  , 10
+                                  , 1
+                                  );
+        const double numTaps = double(estimate.m_numTaps);
+
+        _profile = FilterProfile();
+        _profile.m_numCpuThreads = (0 > _numCpuThreads && 0 == _numClContexts)
+                                 ? getDefaultNumThreads()
+                                 : (uint16_t)max(int16_t(0), min(_numCpuThreads, int16_t(CMFT_MAX_THREADS)))
+                                 ;
+
+        if (0 != _profile.m_numCpuThreads)
+        {
+            const double time = radianceFilterCalibrateTime(1, NULL, true);
+            _profile.m_cpuTapsPerSecond = (0.0 < time) ? numTaps/time : 0.0;
+        }
+
+        for (uint8_t ii = 0; ii < _numClContexts; ++ii)
+        {
+            const double time = radianceFilterCalibrateTime(0, _clContexts[ii], true);
+            _profile.m_clTapsPerSecond += (0.0 < time) ? numTaps/time : 0.0;
+        }
+
+        return 0.0 < _profile.m_cpuTapsPerSecond
+            || 0.0 < _profile.m_clTapsPerSecond
+            ;
+    }
+
+    /// Source taps of a mip of _mipFaceSize filtered with _filterSize from a source of _srcFaceSize.
+    static uint64_t radianceFilterMipTaps(uint32_t _srcFaceSize, uint32_t _mipFaceSize, float _filterSize)
+    {
+        // Filter bounds are 2*filterSize across in face coordinates, they can't take more than the whole source.
+        const double filterTexels = 2.0*double(_filterSize)*double(_srcFaceSize);
+        const double srcTexels = double(radianceFilterMipTexels(_srcFaceSize, 0, 1));
+        const double tapsPerTexel = min(max(1.0, filterTexels*filterTexels), srcTexels);
+        const double dstTexels = double(radianceFilterMipTexels(_mipFaceSize, 0, 1));
+
+        return uint64_t(dstTexels*tapsPerTexel);
+    }
+
+#if CMFT_RADIANCE_SH_ORDER
+    /// Source pyramid level the SH projection of a source of _srcFaceSize reads, see radianceFilterShSource().
+    static uint8_t radianceFilterShSourceLevel(uint32_t _srcFaceSize)
+    {
+        uint8_t level = 0;
+        while (level+1 < MAX_MIP_NUM
+           && (_srcFaceSize >> (level+1)) >= CMFT_RADIANCE_SH_SOURCE_SIZE)
+        {
+            level++;
+        }
+
+        return level;
+    }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+    void imageRadianceFilterEstimate(RadianceFilterEstimate& _estimate
+                                   , uint32_t _srcFaceSize
+                                   , TextureFormat::Enum _srcFormat
+                                   , uint32_t _dstFaceSize
+                                   , LightingModel::Enum _lightingModel
+                                   , bool _excludeBase
+                                   , uint8_t _mipCount
+                                   , uint8_t _glossScale
+                                   , uint8_t _glossBias
+                                   , bool _useSourcePyramid
+                                   , bool _halfPrecision
+                                   , const FilterProfile* _profile
+                                   , const FilterSettings* _settings
+                                   )
+    {
+        const FilterSettings& settings = filterSettings(_settings);
+        memset(&_estimate, 0, sizeof(RadianceFilterEstimate));
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _srcFaceSize : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        const bool soa = (NULL == _profile || 0 != _profile->m_numCpuThreads);
+        _estimate.m_mipCount = mipCount;
+
+        // Same working formats as radianceFilterOutputs().
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        const bool halfSrc = _halfPrecision;
+#else
+        const bool halfSrc = _halfPrecision && !soa;
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        const TextureFormat::Enum srcWorkingFormat = halfSrc ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+        const TextureFormat::Enum dstWorkingFormat = _halfPrecision ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+        const uint32_t srcBytesPerPixel = getImageDataInfo(srcWorkingFormat).m_bytesPerPixel;
+
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        // Pyramid levels are built down to the smallest one used, filtered levels get SoA copies too.
+        uint8_t maxFilterLevel = 0;
+        uint8_t maxLevel = 0;
+
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            _estimate.m_mipFaceSize[mip] = mipFaceSize;
+            _estimate.m_mipSrcFaceSize[mip] = _srcFaceSize;
+
+            // Base is copied.
+            if (0 == mip && _excludeBase)
+            {
+                continue;
+            }
+
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+            _estimate.m_mipSpecularPower[mip] = specularPower;
+            _estimate.m_mipCosAngle[mip] = cosAngle;
+
+#if CMFT_RADIANCE_SH_ORDER
+            // One tap per texel and SH coefficient.
+            double lobes[CMFT_RADIANCE_SH_ORDER];
+            if (radianceFilterShMip(lobes, specularPower, cosAngle))
+            {
+                _estimate.m_mipSh[mip] = true;
+                _estimate.m_mipTaps[mip] = radianceFilterMipTexels(mipFaceSize, 0, 1)*CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER;
+                _estimate.m_numTaps += _estimate.m_mipTaps[mip];
+
+                // Source is projected once, see radianceFilterShSource().
+                if (0 == _estimate.m_shProjectionTaps)
+                {
+                    const uint8_t level = radianceFilterShSourceLevel(_srcFaceSize);
+                    maxLevel = max(maxLevel, level);
+
+                    _estimate.m_shProjectionTaps = radianceFilterMipTexels(_srcFaceSize >> level, 0, 1)*CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER;
+                    _estimate.m_numTaps += _estimate.m_shProjectionTaps;
+                }
+                continue;
+            }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+            uint32_t srcFaceSize = _srcFaceSize;
+            if (_useSourcePyramid)
+            {
+                const uint8_t level = radianceFilterSourceLevel(_srcFaceSize, mipFaceSize, filterAngle);
+                maxFilterLevel = max(maxFilterLevel, level);
+                maxLevel = max(maxLevel, level);
+                srcFaceSize = max(UINT32_C(1), _srcFaceSize >> level);
+            }
+            _estimate.m_mipSrcFaceSize[mip] = srcFaceSize;
+
+            _estimate.m_mipTaps[mip] = radianceFilterMipTaps(srcFaceSize, mipFaceSize, filterSize);
+            _estimate.m_numTaps += _estimate.m_mipTaps[mip];
+        }
+
+        // Memory of the call, see the memory budget in radianceFilterOutputs().
+        Image src;
+        src.m_width = _srcFaceSize;
+        src.m_height = _srcFaceSize;
+        src.m_format = _srcFormat;
+        src.m_numFaces = CUBE_FACE_NUM;
+
+        RadianceFilterOutput output = { &src, NULL, dstFaceSize, mipCount, NULL };
+        RadianceFilterMemory memory;
+        radianceFilterOutputsMemory(memory, &output, 1, srcWorkingFormat, dstWorkingFormat, soa);
+
+        for (uint8_t level = 1; level <= maxLevel; ++level)
+        {
+            const uint32_t levelFaceSize = max(UINT32_C(1), _srcFaceSize >> level);
+            memory.m_fixedBytes += radianceFilterMipTexels(levelFaceSize, 0, 1)*(srcBytesPerPixel + 4*sizeof(float));
+            memory.m_fixedBytes += (soa && level <= maxFilterLevel) ? SoaCubemap::paddedTexels(levelFaceSize)*(SoaCubemap::normalBytesPerTexel() + srcBytesPerPixel) : 0;
+        }
+
+        const uint64_t srcBytes = radianceFilterMipTexels(_srcFaceSize, 0, 1)*getImageDataInfo(_srcFormat).m_bytesPerPixel;
+        _estimate.m_peakBytes = srcBytes + memory.peakBytes();
+
+        if (NULL != _profile)
+        {
+            const double tapsPerSecond = _profile->m_cpuTapsPerSecond*double(_profile->m_numCpuThreads) + _profile->m_clTapsPerSecond;
+            _estimate.m_seconds = (0.0 < tapsPerSecond) ? double(_estimate.m_numTaps)/tapsPerSecond : 0.0;
+        }
+    }
+
+    /// Largest lobe tolerance imageRadianceFilterPlan() goes up to, lobes then lose about a percent of their energy.
+#ifndef CMFT_RADIANCE_PLAN_MAX_TOLERANCE
+    #define CMFT_RADIANCE_PLAN_MAX_TOLERANCE 0.01f
+#endif // CMFT_RADIANCE_PLAN_MAX_TOLERANCE
+
+    /// Fewest GGX samples per mip imageRadianceFilterPlan() goes down to.
+#ifndef CMFT_GGX_PLAN_MIN_SAMPLES
+    #define CMFT_GGX_PLAN_MIN_SAMPLES 16
+#endif // CMFT_GGX_PLAN_MIN_SAMPLES
+
+    /// Cost of a GGX sample in radiance filter taps. Filtered lookup blends eight texels of two source mips, scalar.
+#ifndef CMFT_GGX_TAPS_PER_SAMPLE
+    #define CMFT_GGX_TAPS_PER_SAMPLE 16
+#endif // CMFT_GGX_TAPS_PER_SAMPLE
+
+    /// Taps of mip _mip with the settings of _quality, SH convolved mips take a tap per texel and SH coefficient.
+    static uint64_t radianceFilterPlanMipTaps(bool& _sh
+                                            , const RadianceFilterQuality& _quality
+                                            , uint8_t _mip
+                                            , uint32_t _srcFaceSize
+                                            , uint32_t _mipFaceSize
+                                            , float _glossScalef
+                                            , float _glossBiasf
+                                            , LightingModel::Enum _lightingModel
+                                            )
+    {
+        _sh = false;
+
+        const uint64_t dstTexels = radianceFilterMipTexels(_mipFaceSize, 0, 1);
+        if (0 != _quality.m_mipNumSamples[_mip])
+        {
+            return dstTexels*_quality.m_mipNumSamples[_mip]*CMFT_GGX_TAPS_PER_SAMPLE;
+        }
+
+        float specularPower, filterAngle, cosAngle, filterSize;
+        radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, _mipFaceSize, _mip, _quality.m_mipCount, _glossScalef, _glossBiasf, _lightingModel, _quality.m_mipLobeTolerance[_mip]);
+
+#if CMFT_RADIANCE_SH_ORDER
+        double lobes[CMFT_RADIANCE_SH_ORDER];
+        if (radianceFilterShMip(lobes, specularPower, cosAngle))
+        {
+            _sh = true;
+            return dstTexels*CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER;
+        }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        return radianceFilterMipTaps(max(UINT32_C(1), _srcFaceSize >> _quality.m_mipSrcLevel[_mip]), _mipFaceSize, filterSize);
+    }
+
+    bool imageRadianceFilterPlan(RadianceFilterQuality& _quality
+                               , double _seconds
+                               , const FilterProfile& _profile
+                               , uint32_t _srcFaceSize
+                               , uint32_t _dstFaceSize
+                               , LightingModel::Enum _lightingModel
+                               , bool _excludeBase
+                               , uint8_t _mipCount
+                               , uint8_t _glossScale
+                               , uint8_t _glossBias
+                               , uint32_t _ggxNumSamples
+                               , const FilterSettings* _settings
+                               )
+    {
+        const FilterSettings& settings = filterSettings(_settings);
+        memset(&_quality, 0, sizeof(RadianceFilterQuality));
+
+        const double tapsPerSecond = _profile.m_cpuTapsPerSecond*double(_profile.m_numCpuThreads) + _profile.m_clTapsPerSecond;
+        if (0.0 >= tapsPerSecond)
+        {
+            WARN("Filter profile has no throughput, calibrate it with filterProfileCalibrate().");
+            return false;
+        }
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _srcFaceSize : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+        const float lobeTolerance = filterLobeTolerance(settings);
+        const float maxTolerance = max(lobeTolerance, CMFT_RADIANCE_PLAN_MAX_TOLERANCE);
+        const uint8_t mipStart = uint8_t(_excludeBase);
+
+        _quality.m_mipCount = mipCount;
+        _quality.m_budget = _seconds;
+
+        // Start from full quality, the source pyramid level that doesn't change results is the first step of each mip.
+        uint8_t safeLevel[MAX_MIP_NUM];
+        uint64_t mipTaps[MAX_MIP_NUM];
+        bool mipSh[MAX_MIP_NUM];
+        bool mipDone[MAX_MIP_NUM];
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            _quality.m_mipLobeTolerance[mip] = lobeTolerance;
+            _quality.m_mipNumSamples[mip] = _ggxNumSamples;
+
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+            safeLevel[mip] = radianceFilterSourceLevel(_srcFaceSize, mipFaceSize, filterAngle);
+
+            mipDone[mip] = (mip < mipStart);
+            mipSh[mip] = false;
+            mipTaps[mip] = mipDone[mip] ? 0 : radianceFilterPlanMipTaps(mipSh[mip], _quality, mip, _srcFaceSize, mipFaceSize, glossScalef, glossBiasf, _lightingModel);
+        }
+
+#if CMFT_RADIANCE_SH_ORDER
+        const uint64_t shProjectionTaps = radianceFilterMipTexels(_srcFaceSize >> radianceFilterShSourceLevel(_srcFaceSize), 0, 1)*CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER;
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        for (;;)
+        {
+            uint64_t numTaps = 0;
+            bool sh = false;
+            for (uint8_t mip = mipStart; mip < mipCount; ++mip)
+            {
+                numTaps += mipTaps[mip];
+                sh |= mipSh[mip];
+            }
+#if CMFT_RADIANCE_SH_ORDER
+            numTaps += sh ? shProjectionTaps : 0;
+#endif // CMFT_RADIANCE_SH_ORDER
+
+            _quality.m_seconds = double(numTaps)/tapsPerSecond;
+            _quality.m_withinBudget = (_quality.m_seconds <= _seconds);
+            if (_quality.m_withinBudget)
+            {
+                break;
+            }
+
+            // Most expensive mip that can still get cheaper takes the next step.
+            uint8_t worst = UINT8_MAX;
+            for (uint8_t mip = mipStart; mip < mipCount; ++mip)
+            {
+                if (!mipDone[mip]
+                && (UINT8_MAX == worst || mipTaps[mip] > mipTaps[worst]))
+                {
+                    worst = mip;
+                }
+            }
+
+            if (UINT8_MAX == worst)
+            {
+                break;
+            }
+
+            // GGX halves its samples. Radiance takes the safe source level, then cuts lobes shorter, then reads smaller
+            // source levels until they are no larger than the mip.
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> worst);
+            uint8_t& level = _quality.m_mipSrcLevel[worst];
+            float& tolerance = _quality.m_mipLobeTolerance[worst];
+            uint32_t& numSamples = _quality.m_mipNumSamples[worst];
+            if (0 != numSamples)
+            {
+                numSamples = max(numSamples/2, min(_ggxNumSamples, uint32_t(CMFT_GGX_PLAN_MIN_SAMPLES)));
+                mipDone[worst] = (numSamples <= CMFT_GGX_PLAN_MIN_SAMPLES);
+            }
+            else if (mipSh[worst])
+            {
+                mipDone[worst] = true;
+            }
+            else if (level < safeLevel[worst])
+            {
+                level = safeLevel[worst];
+            }
+            else if (tolerance < maxTolerance)
+            {
+                tolerance = min(tolerance*10.0f, maxTolerance);
+            }
+            else if (level+1 < MAX_MIP_NUM
+                 && (_srcFaceSize >> (level+1)) >= mipFaceSize)
+            {
+                level++;
+            }
+            else
+            {
+                mipDone[worst] = true;
+            }
+
+            mipTaps[worst] = radianceFilterPlanMipTaps(mipSh[worst], _quality, worst, _srcFaceSize, mipFaceSize, glossScalef, glossBiasf, _lightingModel);
+        }
+
+        for (uint8_t mip = mipStart; mip < mipCount; ++mip)
+        {
+            if (0 != _ggxNumSamples)
+            {
+                INFO("Budget -> Mip %u: %u GGX samples.", mip, _quality.m_mipNumSamples[mip]);
+            }
+            else
+            {
+                INFO("Budget -> Mip %u: source level %u, lobe tolerance %g%s."
+                    , mip
+                    , _quality.m_mipSrcLevel[mip]
+                    , double(_quality.m_mipLobeTolerance[mip])
+                    , mipSh[mip] ? ", SH convolved" : ""
+                    );
+            }
+        }
+
+        INFO("Budget -> Estimated %.3f seconds for a budget of %.3f seconds%s."
+            , _quality.m_seconds
+            , _seconds
+            , _quality.m_withinBudget ? "" : ", lowest quality can't meet it"
+            );
+
+        return true;
+    }
+
+    bool imageRadianceFilterBudget(Image& _dst
+                                 , const Image& _src
+                                 , double _seconds
+                                 , const FilterProfile& _profile
+                                 , uint32_t _dstFaceSize
+                                 , LightingModel::Enum _lightingModel
+                                 , bool _excludeBase
+                                 , uint8_t _mipCount
+                                 , uint8_t _glossScale
+                                 , uint8_t _glossBias
+                                 , const ClContext* const* _clContexts
+                                 , uint8_t _numClContexts
+                                 , bool _halfPrecision
+                                 , RadianceFilterQuality* _quality
+                                 , const FilterSettings* _settings
+                                 )
+    {
+        RadianceFilterQuality quality;
+        if (!imageRadianceFilterPlan(quality, _seconds, _profile, _src.m_width, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, 0, _settings))
+        {
+            return false;
+        }
+
+        RadianceFilterOutput output;
+        output.m_src = &_src;
+        output.m_shCoeffs = NULL;
+        output.m_dstFaceSize = _dstFaceSize;
+        output.m_mipCount = _mipCount;
+        output.m_quality = &quality;
+
+        const bool result = radianceFilterOutputs(&_dst, &output, 1, _lightingModel, _excludeBase, _glossScale, _glossBias, int16_t(_profile.m_numCpuThreads), _clContexts, _numClContexts, false, _halfPrecision, TextureFormat::Unknown, NULL, NULL, 0, NULL, filterSettings(_settings));
+
+        if (NULL != _quality)
+        {
+            memcpy(_quality, &quality, sizeof(RadianceFilterQuality));
+        }
+
+        return result;
+    }
+
+    void filterPrecompile(const ClContext* _clContext, bool _radiance, bool _irradianceSh)
+    {
+        if (NULL == _clContext || NULL == _clContext->m_context)
+        {
+            return;
+        }
+
+        // Programs stay in the cache of the context, the filter takes them from there.
+        if (_radiance)
+        {
+            RadianceProgram program;
+            program.setClContext(_clContext);
+            if (program.createFromStr(s_radianceProgramSource, "radianceFilterBounded"))
+            {
+                // Faces of sources that fit the device are uploaded as an atlas.
+                program.initModeKernels(RadianceProgram::ModeFaceAtlas);
+            }
+            program.destroy();
+        }
+
+        if (_irradianceSh)
+        {
+            cl_program program = _clContext->getProgram(s_irradianceShProgramSource);
+            if (NULL != program)
+            {
+                clReleaseProgram(program);
+            }
+        }
+    }
+
+    // Shared textures.
+    //-----
+
+    /// Averages 1x1 faces of the last mip like radianceFilterAverageLastMip(). Faces of other than float or half formats are left as they are.
+    static void radianceFilterSharedAverageLastMip(const ClContext* _clContext, const cl_mem _faces[6])
+    {
+        cl_image_format format;
+        if (CL_SUCCESS != clGetImageInfo(_faces[0], CL_IMAGE_FORMAT, sizeof(format), &format, NULL)
+        ||  CL_RGBA != format.image_channel_order
+        ||  (CL_FLOAT != format.image_channel_data_type && CL_HALF_FLOAT != format.image_channel_data_type))
+        {
+            return;
+        }
+
+        const bool half = (CL_HALF_FLOAT == format.image_channel_data_type);
+        const size_t origin[3] = { 0, 0, 0 };
+        const size_t region[3] = { 1, 1, 1 };
+
+        float texels[6][4];
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            CL_CHECK(clEnqueueReadImage(_clContext->m_commandQueue, _faces[face], CL_TRUE, origin, region, 0, 0, texels[face], 0, NULL, NULL));
+        }
+
+        float color[3] = { 0.0f, 0.0f, 0.0f };
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            float faceColor[3];
+            texelLoadRgb(faceColor, texels[face], half);
+            color[0] += faceColor[0];
+            color[1] += faceColor[1];
+            color[2] += faceColor[2];
+        }
+
+        color[0] /= 6.0f;
+        color[1] /= 6.0f;
+        color[2] /= 6.0f;
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            texelStoreRgb(texels[face], color, half);
+            CL_CHECK(clEnqueueWriteImage(_clContext->m_commandQueue, _faces[face], CL_TRUE, origin, region, 0, 0, texels[face], 0, NULL, NULL));
+        }
+    }
+
+    bool imageRadianceFilterShared(const ClSharedTexture& _dst
+                                 , uint32_t _dstFaceSize
+                                 , LightingModel::Enum _lightingModel
+                                 , bool _excludeBase
+                                 , uint8_t _mipCount
+                                 , uint8_t _glossScale
+                                 , uint8_t _glossBias
+                                 , const ClSharedTexture& _src
+                                 , uint32_t _srcFaceSize
+                                 , const ClContext* _clContext
+                                 , FilterStats* _stats
+                                 , const FilterSettings* _settings
+                                 )
+    {
+        const FilterSettings& settings = filterSettings(_settings);
+        CMFT_PROFILE_ZONE("imageRadianceFilterShared");
+
+        const uint64_t startTime = bx::getHPCounter();
+        const double toSec = 1.0/double(bx::getHPFrequency());
+
+        if (NULL == _clContext
+        ||  ClSharing::None == _clContext->m_sharing)
+        {
+            WARN("Radiance -> OpenCL context does not share textures with a graphics API.");
+
+            return false;
+        }
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _srcFaceSize : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+
+        RadianceProgram program;
+        program.setClContext(_clContext);
+        if (!program.createFromStr(s_radianceProgramSource, "radianceFilterBounded"))
+        {
+            program.destroy();
+            WARN("Radiance -> Could not build OpenCL program.");
+
+            return false;
+        }
+
+        // Images over source faces come first, then faces of each destination mip.
+        cl_mem mems[CUBE_FACE_NUM*(1+MAX_MIP_NUM)];
+        uint32_t numMems = 0;
+        bool valid = true;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM && valid; ++face)
+        {
+            cl_int err;
+            mems[numMems] = _clContext->createFromSharedTexture(_src, CL_MEM_READ_ONLY, face, 0, &err);
+            valid = (NULL != mems[numMems]);
+            numMems += valid;
+        }
+        for (uint8_t mip = 0; mip < mipCount && valid; ++mip)
+        {
+            for (uint8_t face = 0; face < CUBE_FACE_NUM && valid; ++face)
+            {
+                cl_int err;
+                mems[numMems] = _clContext->createFromSharedTexture(_dst, CL_MEM_WRITE_ONLY, face, mip, &err);
+                valid = (NULL != mems[numMems]);
+                numMems += valid;
+            }
+        }
+
+        // Only face size of the source is read from it.
+        Image srcImage;
+        srcImage.m_width = _srcFaceSize;
+        srcImage.m_height = _srcFaceSize;
+        srcImage.m_format = TextureFormat::RGBA32F;
+        srcImage.m_numMips = 1;
+        srcImage.m_numFaces = CUBE_FACE_NUM;
+
+        if (!valid)
+        {
+            WARN("Radiance -> Could not create OpenCL images from shared textures, destination needs %u mips.", mipCount);
+        }
+        else if (!_clContext->acquireShared(mems, numMems))
+        {
+            valid = false;
+        }
+        else if (!program.initSharedDeviceMemory(mems, srcImage))
+        {
+            WARN("Radiance -> Shared textures require kernels with analytic normals.");
+            _clContext->releaseShared(mems, numMems);
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            for (uint32_t ii = 0; ii < numMems; ++ii)
+            {
+                clReleaseMemObject(mems[ii]);
+            }
+            program.destroy();
+
+            return false;
+        }
+
+        const uint64_t filterStartTime = bx::getHPCounter();
+
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+        uint64_t numTexels = 0;
+        uint32_t numTasks = 0;
+        float lobeEnergyLoss = 0.0f;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            const cl_mem* dstFaces = &mems[CUBE_FACE_NUM*(1+mip)];
+
+            // Base is copied as it is when nothing has to be resized.
+            if (0 == mip && _excludeBase && _srcFaceSize == dstFaceSize)
+            {
+                const size_t origin[3] = { 0, 0, 0 };
+                const size_t region[3] = { dstFaceSize, dstFaceSize, 1 };
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    CL_CHECK(clEnqueueCopyImage(_clContext->m_commandQueue, mems[face], dstFaces[face], origin, origin, region, 0, NULL, NULL));
+                }
+                continue;
+            }
+
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+            lobeEnergyLoss = max(lobeEnergyLoss, cosinePowerEnergyLoss(specularPower, cosAngle));
+
+            // Only fields the dispatch size is computed from.
+            RadianceFilterParams params;
+            memset(&params, 0, sizeof(params));
+            params.m_mipFaceSize = mipFaceSize;
+            params.m_filterSize = filterSize;
+            params.m_imageRgba32f = &srcImage;
+            const uint32_t dispatchRows = radianceGpuDispatchRows(params, 0.0);
+
+            program.selectKernel(mipFaceSize, specularPower, cosAngle, filterSize);
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                program.setArgs(face, mipFaceSize, specularPower, cosAngle, filterSize);
+                program.submitShared(dstFaces[face], mipFaceSize, dispatchRows);
+            }
+
+            numTexels += uint64_t(mipFaceSize)*mipFaceSize*CUBE_FACE_NUM;
+            numTasks += CUBE_FACE_NUM;
+        }
+
+        if (1 == max(UINT32_C(1), dstFaceSize >> (mipCount-1)))
+        {
+            radianceFilterSharedAverageLastMip(_clContext, &mems[CUBE_FACE_NUM*mipCount]);
+        }
+
+        const bool released = _clContext->releaseShared(mems, numMems);
+        const uint64_t finishStartTime = bx::getHPCounter();
+
+        for (uint32_t ii = 0; ii < numMems; ++ii)
+        {
+            clReleaseMemObject(mems[ii]);
+        }
+        program.releaseDeviceMemory();
+        program.destroy();
+
+        if (NULL != _stats)
+        {
+            const uint64_t endTime = bx::getHPCounter();
+            _stats->m_prepareTime = double(filterStartTime - startTime)*toSec;
+            _stats->m_filterTime = double(finishStartTime - filterStartTime)*toSec;
+            _stats->m_finishTime = double(endTime - finishStartTime)*toSec;
+            _stats->m_totalTime = double(endTime - startTime)*toSec;
+            _stats->m_tasksGpu[0] = numTasks;
+            _stats->m_texelsGpu[0] = numTexels;
+            _stats->m_lobeEnergyLoss = lobeEnergyLoss;
+        }
+
+        INFO("Radiance -> Filtered %u shared faces in %.3fs.", numTasks, double(bx::getHPCounter() - startTime)*toSec);
+
+        return released;
+    }
+
+    // Dirty regions.
+    //-----
+
+    /// Changed source texels of a single face, inclusive, in texels of the source level being filtered from.
+    struct RadianceFilterDirtyRect
+    {
+        uint8_t m_face;
+        uint32_t m_min[2];
+        uint32_t m_max[2];
+    };
+
+    struct RadianceFilterRegionsArgs
+    {
+        float* m_dst[CUBE_FACE_NUM];
+        uint8_t* m_mask;
+        uint32_t m_mipFaceSize;
+        float m_filterSize;
+        float m_specularPower;
+        float m_cosAngle;
+        RadianceLobeTable m_lobeTable;
+        const float* m_cubemapVectors;
+        const Image* m_srcImage;
+        const uint64_t* m_srcFaceOffsets;
+        const SoaCubemap* m_normalsSoa;
+        const SoaCubemap* m_colorsSoa;
+        const RadianceFilterDirtyRect* m_rects;
+        uint32_t m_numRects;
+        bool m_all;
+        uint8_t m_pass; // Progressive only, texels of this refinement pass are filtered.
+    };
+
+    static inline bool radianceFilterAreaIsDirty(Aabb _filterArea[6], uint32_t _srcFaceSize, const RadianceFilterDirtyRect* _rects, uint32_t _numRects)
+    {
+        const float faceSize_MinusOne = float(int32_t(_srcFaceSize-1));
+        for (uint32_t ii = 0; ii < _numRects; ++ii)
+        {
+            const RadianceFilterDirtyRect& rect = _rects[ii];
+            Aabb& area = _filterArea[rect.m_face];
+            if (area.isEmpty())
+            {
+                continue;
+            }
+
+            // Same texel bounds as in processFilterArea(), one texel wider for SIMD variants.
+            const uint32_t minX = uint32_t(area.m_min[0] * faceSize_MinusOne);
+            const uint32_t maxX = uint32_t(area.m_max[0] * faceSize_MinusOne) + 1;
+            const uint32_t minY = uint32_t(area.m_min[1] * faceSize_MinusOne);
+            const uint32_t maxY = uint32_t(area.m_max[1] * faceSize_MinusOne) + 1;
+            if (minX <= rect.m_max[0] + 1 && rect.m_min[0] <= maxX
+            &&  minY <= rect.m_max[1] + 1 && rect.m_min[1] <= maxY)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static void radianceFilterRegionsRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterRegionsArgs* args = (const RadianceFilterRegionsArgs*)_userData;
+        const uint32_t mipFaceSize = args->m_mipFaceSize;
+        const float invFaceSize = 1.0f/float(int32_t(mipFaceSize));
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(row/mipFaceSize);
+            const uint32_t yy = row%mipFaceSize;
+            uint8_t* faceMask = args->m_mask + uint64_t(face)*mipFaceSize*mipFaceSize;
+            uint8_t* rowMask = faceMask + uint64_t(yy)*mipFaceSize;
+
+            bool any = false;
+            for (uint32_t xx = 0; xx < mipFaceSize; ++xx)
+            {
+                bool dirty = args->m_all;
+                if (!dirty)
+                {
+                    const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                    const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+
+                    float tapVec[3];
+                    texelCoordToVec(tapVec, uu, vv, face, mipFaceSize);
+
+                    Aabb facesBb[6];
+                    determineFilterArea(facesBb, tapVec, args->m_filterSize);
+                    dirty = radianceFilterAreaIsDirty(facesBb, args->m_srcImage->m_width, args->m_rects, args->m_numRects);
+                }
+
+                rowMask[xx] = uint8_t(dirty);
+                any |= dirty;
+            }
+
+            if (any)
+            {
+                radianceFilter(args->m_dst[face]
+                             , false
+                             , face
+                             , mipFaceSize
+                             , yy
+                             , yy+1
+                             , args->m_filterSize
+                             , args->m_specularPower
+                             , args->m_cosAngle
+                             , &args->m_lobeTable
+                             , args->m_cubemapVectors
+                             , args->m_srcImage
+                             , args->m_srcFaceOffsets
+                             , args->m_normalsSoa
+                             , args->m_colorsSoa
+                             , 0.0f // Masked rows are never sampled adaptively.
+                             , faceMask
+                             );
+            }
+        }
+    }
+
+    bool imageRadianceFilterRegions(Image& _dst
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const Image& _src
+                                  , const CubeFaceRegion* _regions
+                                  , uint32_t _numRegions
+                                  , bool _useSourcePyramid
+                                  , FilterStats* _stats
+                                  , const FilterSettings* _settings
+                                  )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        // Input images must be cubemaps.
+        if (!imageIsCubemap(_src)
+        ||  !imageIsCubemap(_dst))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        const uint32_t dstFaceSize = _dst.m_width;
+        const uint8_t mipCount = _dst.m_numMips;
+        if (mipCount != radianceFilterMipCount(dstFaceSize, mipCount))
+        {
+            WARN("Radiance -> Mip count of the previous result is not valid for its face size.");
+
+            return false;
+        }
+
+        if (0 == _numRegions)
+        {
+            return true;
+        }
+
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+        job.m_dstFaceSize = dstFaceSize;
+        job.m_mipCount = mipCount;
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+        imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+        job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+        job.m_normals = &job.m_normalsSoa;
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        job.m_normalsSoa.initNormals(job.m_cubemapVectors, imageRgba32f.m_width);
+        soaInitColors(job.m_colorsSoa, imageRgba32f, job.m_srcFaceOffsets);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        // Previous result in Rgba32f. It is updated in place when it already is in that format.
+        Image result;
+        const bool inPlace = (TextureFormat::RGBA32F == _dst.m_format && !_dst.m_mapped && !imageIsShared(_dst));
+        if (inPlace)
+        {
+            imageRef(result, _dst);
+        }
+        else
+        {
+            imageConvert(result, TextureFormat::RGBA32F, _dst);
+        }
+        job.m_dstData = result.m_data;
+        job.m_dstDataSize = result.m_dataSize;
+        imageGetMipOffsets(job.m_dstOffsets, result);
+
+        // One byte per destination texel, set for texels that were filtered again.
+        const uint64_t numTexels = imageGetNumPixels(result);
+        uint8_t* mask = (uint8_t*)malloc(numTexels);
+        MALLOC_CHECK(mask);
+        memset(mask, 0, numTexels);
+        uint64_t maskOffsets[MAX_MIP_NUM];
+        maskOffsets[0] = 0;
+        for (uint8_t mip = 1; mip < mipCount; ++mip)
+        {
+            maskOffsets[mip] = maskOffsets[mip-1] + radianceFilterMipTexels(dstFaceSize, mip-1, mip);
+        }
+
+        RadianceFilterDirtyRect* rects = (RadianceFilterDirtyRect*)malloc(_numRegions*sizeof(RadianceFilterDirtyRect));
+        MALLOC_CHECK(rects);
+
+        INFO("Running radiance filter for %u changed region%s:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[dstFaceSize=%u]"
+             , _numRegions
+             , _numRegions==1?"":"s"
+             , imageRgba32f.m_width
+             , getLightingModelStr(_lightingModel)
+             , &"false\0true"[6*_excludeBase]
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , dstFaceSize
+             );
+
+        // Resize and copy base image, it is cheap enough to be done as a whole.
+        if (_excludeBase)
+        {
+            radianceFilterCopyBase(job);
+            memset(mask, 1, radianceFilterMipTexels(dstFaceSize, 0, 1));
+        }
+
+        const uint64_t filterStartTime = bx::getHPCounter();
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        float lobeEnergyLoss = 0.0f;
+        for (uint8_t mip = uint8_t(_excludeBase); mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+            lobeEnergyLoss = max(lobeEnergyLoss, cosinePowerEnergyLoss(specularPower, cosAngle));
+
+            // Source for this mip.
+            RadianceFilterRegionsArgs args;
+            args.m_srcImage = &job.m_imageRgba32f;
+            args.m_srcFaceOffsets = job.m_srcFaceOffsets;
+            args.m_cubemapVectors = job.m_cubemapVectors;
+            args.m_normalsSoa = job.m_normals;
+            args.m_colorsSoa = &job.m_colorsSoa;
+            if (_useSourcePyramid)
+            {
+                const uint8_t level = radianceFilterSourceLevel(imageRgba32f.m_width, mipFaceSize, filterAngle);
+                if (0 != level)
+                {
+                    radianceFilterBuildSources(job, level, true);
+
+                    const RadianceFilterSource& source = job.m_sources[level];
+                    args.m_srcImage = &source.m_image;
+                    args.m_srcFaceOffsets = source.m_faceOffsets;
+                    args.m_cubemapVectors = source.m_cubemapVectors;
+                    args.m_normalsSoa = &source.m_normalsSoa;
+                    args.m_colorsSoa = &source.m_colorsSoa;
+                }
+            }
+
+            // Regions in texels of the source level. Box downsampled levels spread a change by less than two of their texels.
+            const uint32_t srcFaceSize = args.m_srcImage->m_width;
+            const uint32_t margin = (args.m_srcImage == &job.m_imageRgba32f) ? 0 : 2;
+            const float srcFaceSizef = float(int32_t(srcFaceSize));
+            for (uint32_t ii = 0; ii < _numRegions; ++ii)
+            {
+                const CubeFaceRegion& region = _regions[ii];
+                RadianceFilterDirtyRect& rect = rects[ii];
+                rect.m_face = min(region.m_face, uint8_t(CUBE_FACE_NUM-1));
+                for (uint8_t axis = 0; axis < 2; ++axis)
+                {
+                    const uint32_t texelMin = uint32_t(clamp(region.m_min[axis], 0.0f, 1.0f)*srcFaceSizef);
+                    const uint32_t texelMax = uint32_t(clamp(region.m_max[axis], 0.0f, 1.0f)*srcFaceSizef);
+                    rect.m_min[axis] = (texelMin > margin) ? texelMin - margin : 0;
+                    rect.m_max[axis] = min(texelMax + margin, srcFaceSize-1);
+                }
+            }
+
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                args.m_dst[face] = (float*)((uint8_t*)job.m_dstData + job.m_dstOffsets[face][mip]);
+            }
+            args.m_mask = mask + maskOffsets[mip];
+            args.m_mipFaceSize = mipFaceSize;
+            args.m_filterSize = filterSize;
+            args.m_specularPower = specularPower;
+            args.m_cosAngle = cosAngle;
+#if CMFT_RADIANCE_LOBE_TABLE
+            args.m_lobeTable.init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+            args.m_rects = rects;
+            args.m_numRects = _numRegions;
+            args.m_all = false;
+
+            // 1x1 faces are averaged afterwards, so all of them are needed once any of them changed.
+            if (1 == mipFaceSize)
+            {
+                bool any = false;
+                for (uint8_t face = 0; face < CUBE_FACE_NUM && !any; ++face)
+                {
+                    float tapVec[3];
+                    texelCoordToVec(tapVec, 0.0f, 0.0f, face, 1);
+
+                    Aabb facesBb[6];
+                    determineFilterArea(facesBb, tapVec, filterSize);
+                    any = radianceFilterAreaIsDirty(facesBb, srcFaceSize, rects, _numRegions);
+                }
+                if (!any)
+                {
+                    continue;
+                }
+                args.m_all = true;
+            }
+
+            parallelFor(radianceFilterRegionsRows, (void*)&args, mipFaceSize*CUBE_FACE_NUM);
+        }
+
+        // Average 1x1 face size.
+        const uint8_t lastMip = mipCount-1;
+        if (0 != mask[maskOffsets[lastMip]])
+        {
+            radianceFilterAverageLastMip(job);
+        }
+
+        const uint64_t filterEndTime = bx::getHPCounter();
+
+        // Faces and texels filtered again.
+        uint64_t numDirty = 0;
+        uint32_t numDirtyFaces = 0;
+        for (uint8_t mip = uint8_t(_excludeBase); mip < mipCount; ++mip)
+        {
+            const uint64_t faceTexels = radianceFilterMipTexels(max(UINT32_C(1), dstFaceSize >> mip), 0, 1)/CUBE_FACE_NUM;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                const uint8_t* faceMask = mask + maskOffsets[mip] + face*faceTexels;
+                uint64_t faceDirty = 0;
+                for (uint64_t ii = 0; ii < faceTexels; ++ii)
+                {
+                    faceDirty += faceMask[ii];
+                }
+                numDirty += faceDirty;
+                numDirtyFaces += uint32_t(0 != faceDirty);
+            }
+        }
+
+        // Write back only texels that were filtered again, the rest of _dst stays exactly as it was.
+        if (!inPlace)
+        {
+            imageConvert(result, (TextureFormat::Enum)_dst.m_format);
+
+            if (_dst.m_mapped || imageIsShared(_dst))
+            {
+                imageMove(_dst, result);
+            }
+            else
+            {
+                uint64_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+                imageGetMipOffsets(dstOffsets, _dst);
+                const uint32_t bytesPerPixel = getImageDataInfo((TextureFormat::Enum)_dst.m_format).m_bytesPerPixel;
+                for (uint8_t mip = 0; mip < mipCount; ++mip)
+                {
+                    const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+                    for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                    {
+                        const uint64_t faceOffset = dstOffsets[face][mip];
+                        const uint8_t* faceMask = mask + maskOffsets[mip] + uint64_t(face)*mipFaceSize*mipFaceSize;
+                        for (uint64_t ii = 0, end = uint64_t(mipFaceSize)*mipFaceSize; ii < end; ++ii)
+                        {
+                            if (0 != faceMask[ii])
+                            {
+                                const uint64_t offset = faceOffset + ii*bytesPerPixel;
+                                memcpy((uint8_t*)_dst.m_data + offset, (const uint8_t*)result.m_data + offset, bytesPerPixel);
+                            }
+                        }
+                    }
+                }
+                imageUnload(result);
+            }
+        }
+
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+        INFO("Radiance -> Filtered %llu of %llu texels again. Total time: %.3f seconds."
+            , (unsigned long long)numDirty
+            , (unsigned long long)(numTexels - (_excludeBase ? radianceFilterMipTexels(dstFaceSize, 0, 1) : 0))
+            , double(bx::getHPCounter() - entryTime)*toSec
+            );
+
+        if (NULL != _stats)
+        {
+            FilterStats stats;
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_filterTime = double(filterEndTime - filterStartTime)*toSec;
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_finishTime = double(endTime - filterEndTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            stats.m_tasksCpu = numDirtyFaces;
+            stats.m_texelsCpu = numDirty;
+            stats.m_lobeEnergyLoss = lobeEnergyLoss;
+            *_stats = stats;
+        }
+
+        // Cleanup.
+        free(rects);
+        free(mask);
+        radianceFilterReleaseSources(job);
+        releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+
+        return true;
+    }
+
+    struct RadianceFilterOctahedralArgs
+    {
+        float* m_dst;
+        uint32_t m_mipSize;
+        float m_filterSize;
+        float m_specularPower;
+        float m_cosAngle;
+        RadianceLobeTable m_lobeTable;
+        bool m_guardBand;
+        const float* m_cubemapVectors;
+        const Image* m_srcImage;
+        const uint64_t* m_srcFaceOffsets;
+        const SoaCubemap* m_normalsSoa;
+        const SoaCubemap* m_colorsSoa;
+        bool m_copyBase; // Base mip with excludeBase, source is resampled instead of filtered.
+    };
+
+    /// Bilinear sample of Rgba32f cubemap _src in direction _vec, within a face.
+    /// Without _centered, texel centers are half a texel off like imageLatLongFromCubemap() samples them.
+    static inline void radianceFilterSampleSource(float _color[3], const float _vec[3], const Image& _src, const uint64_t _faceOffsets[CUBE_FACE_NUM], bool _centered = true)
+    {
+        float uu, vv;
+        uint8_t face;
+        vecToTexelCoord(uu, vv, face, _vec);
+
+        const uint32_t faceSize = _src.m_width;
+        const float maxCoord = float(int32_t(faceSize-1));
+        const float offset = _centered ? 0.5f : 0.0f;
+        const float xx = clamp(uu*float(int32_t(faceSize)) - offset, 0.0f, maxCoord);
+        const float yy = clamp(vv*float(int32_t(faceSize)) - offset, 0.0f, maxCoord);
+        const uint32_t x0 = uint32_t(xx);
+        const uint32_t y0 = uint32_t(yy);
+        const uint32_t x1 = min(x0+1, faceSize-1);
+        const uint32_t y1 = min(y0+1, faceSize-1);
+        const float tx = xx - float(int32_t(x0));
+        const float ty = yy - float(int32_t(y0));
+
+        const float* faceData = (const float*)((const uint8_t*)_src.m_data + _faceOffsets[face]);
+        const float* src00 = faceData + (size_t(y0)*faceSize + x0)*4;
+        const float* src01 = faceData + (size_t(y0)*faceSize + x1)*4;
+        const float* src10 = faceData + (size_t(y1)*faceSize + x0)*4;
+        const float* src11 = faceData + (size_t(y1)*faceSize + x1)*4;
+        for (uint8_t ii = 0; ii < 3; ++ii)
+        {
+            const float top    = src00[ii] + (src01[ii]-src00[ii])*tx;
+            const float bottom = src10[ii] + (src11[ii]-src10[ii])*tx;
+            _color[ii] = top + (bottom-top)*ty;
+        }
+    }
+
+    static void radianceFilterOctahedralRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterOctahedralArgs* args = (const RadianceFilterOctahedralArgs*)_userData;
+        const uint32_t mipSize = args->m_mipSize;
+        const float invMipSize = 1.0f/float(int32_t(mipSize));
+
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            uint8_t* dstRow = (uint8_t*)(args->m_dst + size_t(yy)*mipSize*4);
+            const float vv = (float(int32_t(yy))+0.5f)*invMipSize;
+            for (uint32_t xx = 0; xx < mipSize; ++xx)
+            {
+                const float uu = (float(int32_t(xx))+0.5f)*invMipSize;
+
+                float tapVec[3];
+                vecFromOctahedral(tapVec, uu, vv);
+
+                float color[3];
+                if (args->m_copyBase)
+                {
+                    radianceFilterSampleSource(color, tapVec, *args->m_srcImage, args->m_srcFaceOffsets);
+                }
+                else
+                {
+                    // Octahedral texels don't line up with face edges, each texel checks its own filter area.
+                    radianceFilterTap(color
+                                    , tapVec
+                                    , args->m_guardBand
+                                    , true
+                                    , args->m_filterSize
+                                    , args->m_specularPower
+                                    , args->m_cosAngle
+                                    , &args->m_lobeTable
+                                    , args->m_cubemapVectors
+                                    , args->m_srcImage
+                                    , args->m_srcFaceOffsets
+                                    , args->m_normalsSoa
+                                    , args->m_colorsSoa
+                                    );
+                }
+
+                texelStoreRgb(dstRow + xx*16, color, false);
+            }
+        }
+    }
+
+    bool imageRadianceFilterOctahedral(Image& _dst
+                                     , uint32_t _dstSize
+                                     , LightingModel::Enum _lightingModel
+                                     , bool _excludeBase
+                                     , uint8_t _mipCount
+                                     , uint8_t _glossScale
+                                     , uint8_t _glossBias
+                                     , const Image& _src
+                                     , bool _useSourcePyramid
+                                     , FilterStats* _stats
+                                     , const FilterSettings* _settings
+                                     )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+        imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+        job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+        job.m_normals = &job.m_normalsSoa;
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        job.m_normalsSoa.initNormals(job.m_cubemapVectors, imageRgba32f.m_width);
+        soaInitColors(job.m_colorsSoa, imageRgba32f, job.m_srcFaceOffsets);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        // Mip of size S is filtered like a cubemap mip with face size S/2, which has the same texel density at face centers.
+        const uint32_t dstSize = (0 == _dstSize) ? imageRgba32f.m_width*2 : _dstSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstSize, _mipCount);
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        uint64_t mipOffsets[MAX_MIP_NUM];
+        uint64_t dstDataSize = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            mipOffsets[mip] = dstDataSize;
+            const uint32_t mipSize = max(UINT32_C(1), dstSize >> mip);
+            dstDataSize += uint64_t(mipSize)*mipSize*bytesPerPixel;
+        }
+        void* dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+        MALLOC_CHECK(dstData);
+
+        INFO("Running radiance filter for:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[dstSize=%u, octahedral]"
+             , imageRgba32f.m_width
+             , getLightingModelStr(_lightingModel)
+             , &"false\0true"[6*_excludeBase]
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , dstSize
+             );
+
+        const uint64_t filterStartTime = bx::getHPCounter();
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        float lobeEnergyLoss = 0.0f;
+        uint64_t numTexels = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipSize = max(UINT32_C(1), dstSize >> mip);
+            const uint32_t mipFaceSize = max(UINT32_C(1), mipSize/2);
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+
+            RadianceFilterOctahedralArgs args;
+            args.m_dst = (float*)((uint8_t*)dstData + mipOffsets[mip]);
+            args.m_mipSize = mipSize;
+            args.m_filterSize = filterSize;
+            args.m_specularPower = specularPower;
+            args.m_cosAngle = cosAngle;
+            args.m_srcImage = &job.m_imageRgba32f;
+            args.m_srcFaceOffsets = job.m_srcFaceOffsets;
+            args.m_cubemapVectors = job.m_cubemapVectors;
+            args.m_normalsSoa = job.m_normals;
+            args.m_colorsSoa = &job.m_colorsSoa;
+            args.m_copyBase = (0 == mip && _excludeBase);
+            args.m_guardBand = false;
+
+            if (!args.m_copyBase)
+            {
+                lobeEnergyLoss = max(lobeEnergyLoss, cosinePowerEnergyLoss(specularPower, cosAngle));
+
+                if (_useSourcePyramid)
+                {
+                    const uint8_t level = radianceFilterSourceLevel(imageRgba32f.m_width, mipFaceSize, filterAngle);
+                    if (0 != level)
+                    {
+                        radianceFilterBuildSources(job, level, true);
+
+                        const RadianceFilterSource& source = job.m_sources[level];
+                        args.m_srcImage = &source.m_image;
+                        args.m_srcFaceOffsets = source.m_faceOffsets;
+                        args.m_cubemapVectors = source.m_cubemapVectors;
+                        args.m_normalsSoa = &source.m_normalsSoa;
+                        args.m_colorsSoa = &source.m_colorsSoa;
+                    }
+                }
+
+#if CMFT_RADIANCE_LOBE_TABLE
+                args.m_lobeTable.init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+                args.m_guardBand = args.m_normalsSoa->fitsGuardBand(filterSize) && 0.0f < cosAngle;
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+            }
+
+            if (1 == mipSize && !args.m_copyBase)
+            {
+                // Same as the averaged 1x1 faces of a cubemap result.
+                float color[3] = { 0.0f, 0.0f, 0.0f };
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    float tapVec[3];
+                    texelCoordToVec(tapVec, 0.0f, 0.0f, face, 1);
+
+                    float faceColor[3];
+                    radianceFilterTap(faceColor
+                                    , tapVec
+                                    , args.m_guardBand
+                                    , true
+                                    , filterSize
+                                    , specularPower
+                                    , cosAngle
+                                    , &args.m_lobeTable
+                                    , args.m_cubemapVectors
+                                    , args.m_srcImage
+                                    , args.m_srcFaceOffsets
+                                    , args.m_normalsSoa
+                                    , args.m_colorsSoa
+                                    );
+                    color[0] += faceColor[0]/6.0f;
+                    color[1] += faceColor[1]/6.0f;
+                    color[2] += faceColor[2]/6.0f;
+                }
+                texelStoreRgb(args.m_dst, color, false);
+            }
+            else
+            {
+                parallelFor(radianceFilterOctahedralRows, (void*)&args, mipSize);
+            }
+
+            numTexels += uint64_t(mipSize)*mipSize;
+        }
+
+        const uint64_t filterEndTime = bx::getHPCounter();
+
+        Image result;
+        result.m_width = dstSize;
+        result.m_height = dstSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = mipCount;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
+
+        if (TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+        }
+        imageMove(_dst, result);
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Radiance -> Done! Total time: %.3f seconds.", double(bx::getHPCounter() - entryTime)*toSec);
+
+        if (NULL != _stats)
+        {
+            FilterStats stats;
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_filterTime = double(filterEndTime - filterStartTime)*toSec;
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_finishTime = double(endTime - filterEndTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            stats.m_tasksCpu = mipCount;
+            stats.m_texelsCpu = numTexels;
+            stats.m_lobeEnergyLoss = lobeEnergyLoss;
+            *_stats = stats;
+        }
+
+        // Cleanup.
+        radianceFilterReleaseSources(job);
+        releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+
+        return true;
+    }
+
+    void imageRadianceFilterOctahedral(Image& _image
+                                     , uint32_t _dstSize
+                                     , LightingModel::Enum _lightingModel
+                                     , bool _excludeBase
+                                     , uint8_t _mipCount
+                                     , uint8_t _glossScale
+                                     , uint8_t _glossBias
+                                     , bool _useSourcePyramid
+                                     , FilterStats* _stats
+                                     , const FilterSettings* _settings
+                                     )
+    {
+        Image tmp;
+        if (imageRadianceFilterOctahedral(tmp, _dstSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _image, _useSourcePyramid, _stats, _settings))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    struct RadianceFilterLatLongArgs
+    {
+        float* m_dst;
+        uint32_t m_mipWidth;
+        uint32_t m_mipHeight;
+        float m_filterSize;
+        float m_specularPower;
+        float m_cosAngle;
+        RadianceLobeTable m_lobeTable;
+        bool m_guardBand;
+        const float* m_cubemapVectors;
+        const Image* m_srcImage;
+        const uint64_t* m_srcFaceOffsets;
+        const SoaCubemap* m_normalsSoa;
+        const SoaCubemap* m_colorsSoa;
+        bool m_copyBase; // Base mip with excludeBase, source is resampled instead of filtered.
+#if CMFT_RADIANCE_SH_ORDER
+        const double (*m_shCoeffs)[3]; // Source coefficients scaled by lobe coefficients of a wide mip, NULL if the mip is filtered.
+#endif // CMFT_RADIANCE_SH_ORDER
+    };
+
+    /// Filters a single latlong texel in direction _tapVec, or evaluates the SH projection for wide lobes like radianceFilterShRows().
+    static void radianceFilterLatLongTap(float _color[3], const float* _tapVec, const RadianceFilterLatLongArgs& _args)
+    {
+#if CMFT_RADIANCE_SH_ORDER
+        if (NULL != _args.m_shCoeffs)
+        {
+            double shBasis[CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER];
+            evalSHBasis<CMFT_RADIANCE_SH_ORDER>(shBasis, _tapVec);
+
+            double rgb[3] = { 0.0, 0.0, 0.0 };
+            for (uint32_t ii = 0; ii < CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER; ++ii)
+            {
+                rgb[0] += _args.m_shCoeffs[ii][0]*shBasis[ii];
+                rgb[1] += _args.m_shCoeffs[ii][1]*shBasis[ii];
+                rgb[2] += _args.m_shCoeffs[ii][2]*shBasis[ii];
+            }
+
+            _color[0] = float(max(0.0, rgb[0]));
+            _color[1] = float(max(0.0, rgb[1]));
+            _color[2] = float(max(0.0, rgb[2]));
+            return;
+        }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        radianceFilterTap(_color
+                        , _tapVec
+                        , _args.m_guardBand
+                        , true
+                        , _args.m_filterSize
+                        , _args.m_specularPower
+                        , _args.m_cosAngle
+                        , &_args.m_lobeTable
+                        , _args.m_cubemapVectors
+                        , _args.m_srcImage
+                        , _args.m_srcFaceOffsets
+                        , _args.m_normalsSoa
+                        , _args.m_colorsSoa
+                        );
+    }
+
+    static void radianceFilterLatLongRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterLatLongArgs* args = (const RadianceFilterLatLongArgs*)_userData;
+        const uint32_t mipWidth = args->m_mipWidth;
+
+        // Same texel mapping as imageLatLongFromCubemap(), first and last column and row are on the seam and the poles.
+        const float invWidth  = (1 < mipWidth)          ? 1.0f/float(int32_t(mipWidth-1))          : 0.0f;
+        const float invHeight = (1 < args->m_mipHeight) ? 1.0f/float(int32_t(args->m_mipHeight-1)) : 0.0f;
+
+        // Taps of a row ring, see CMFT_RADIANCE_LATLONG_RING_DENSITY.
+        float* ring = NULL;
+        if (0.0f < CMFT_RADIANCE_LATLONG_RING_DENSITY && !args->m_copyBase)
+        {
+            ring = (float*)malloc(mipWidth*3*sizeof(float));
+            MALLOC_CHECK(ring);
+        }
+
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            uint8_t* dstRow = (uint8_t*)(args->m_dst + size_t(yy)*mipWidth*4);
+            const float vv = float(int32_t(yy))*invHeight;
+
+            // Circumference of the row ring is sin(theta) of the equator, so are the taps it needs.
+            const float ringTaps = ceilf(float(int32_t(mipWidth))*sinf(vv*float(M_PI))*CMFT_RADIANCE_LATLONG_RING_DENSITY);
+            const uint32_t ringSize = max(UINT32_C(1), uint32_t(max(0.0f, ringTaps)));
+            if (NULL != ring
+            &&  ringSize < mipWidth)
+            {
+                for (uint32_t ii = 0; ii < ringSize; ++ii)
+                {
+                    float tapVec[3];
+                    vecFromLatLong(tapVec, float(int32_t(ii))/float(int32_t(ringSize)), vv);
+                    radianceFilterLatLongTap(&ring[ii*3], tapVec, *args);
+                }
+
+                // Ring wraps around, last column is on the seam like the first one.
+                for (uint32_t xx = 0; xx < mipWidth; ++xx)
+                {
+                    const float pos = float(int32_t(xx))*invWidth*float(int32_t(ringSize));
+                    const uint32_t i0 = uint32_t(pos);
+                    const float tt = pos - float(int32_t(i0));
+                    const float* c0 = &ring[(i0%ringSize)*3];
+                    const float* c1 = &ring[((i0+1)%ringSize)*3];
+
+                    const float color[3] =
+                    {
+                        c0[0] + (c1[0]-c0[0])*tt,
+                        c0[1] + (c1[1]-c0[1])*tt,
+                        c0[2] + (c1[2]-c0[2])*tt,
+                    };
+                    texelStoreRgb(dstRow + xx*16, color, false);
+                }
+
+                continue;
+            }
+
+            for (uint32_t xx = 0; xx < mipWidth; ++xx)
+            {
+                const float uu = float(int32_t(xx))*invWidth;
+
+                float tapVec[3];
+                vecFromLatLong(tapVec, uu, vv);
+
+                float color[3];
+                if (args->m_copyBase)
+                {
+                    radianceFilterSampleSource(color, tapVec, *args->m_srcImage, args->m_srcFaceOffsets, false);
+                }
+                else
+                {
+                    radianceFilterLatLongTap(color, tapVec, *args);
+                }
+
+                texelStoreRgb(dstRow + xx*16, color, false);
+            }
+        }
+
+        free(ring);
+    }
+
+    bool imageRadianceFilterLatLong(Image& _dst
+                                  , uint32_t _dstWidth
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const Image& _src
+                                  , bool _useSourcePyramid
+                                  , FilterStats* _stats
+                                  , const FilterSettings* _settings
+                                  )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+#if CMFT_RADIANCE_SH_ORDER
+        job.m_shCoeffs = NULL;
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+        imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+        job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+        job.m_normals = &job.m_normalsSoa;
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        job.m_normalsSoa.initNormals(job.m_cubemapVectors, imageRgba32f.m_width);
+        soaInitColors(job.m_colorsSoa, imageRgba32f, job.m_srcFaceOffsets);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        // Latlong of width W is what imageLatLongFromCubemap() makes out of a cubemap with face size W/4.
+        const uint32_t dstWidth = (0 == _dstWidth) ? imageRgba32f.m_width*4 : _dstWidth;
+        const uint32_t dstHeight = max(UINT32_C(1), dstWidth/2);
+        const uint32_t dstFaceSize = max(UINT32_C(1), dstWidth/4);
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        uint64_t mipOffsets[MAX_MIP_NUM];
+        uint64_t dstDataSize = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            mipOffsets[mip] = dstDataSize;
+            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
+            dstDataSize += uint64_t(mipWidth)*mipHeight*bytesPerPixel;
+        }
+        void* dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+        MALLOC_CHECK(dstData);
+
+        INFO("Running radiance filter for:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[dstSize=%ux%u, latlong]"
+             , imageRgba32f.m_width
+             , getLightingModelStr(_lightingModel)
+             , &"false\0true"[6*_excludeBase]
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , dstWidth
+             , dstHeight
+             );
+
+        const uint64_t filterStartTime = bx::getHPCounter();
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        float lobeEnergyLoss = 0.0f;
+        uint64_t numTexels = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+
+            RadianceFilterLatLongArgs args;
+            args.m_dst = (float*)((uint8_t*)dstData + mipOffsets[mip]);
+            args.m_mipWidth = mipWidth;
+            args.m_mipHeight = mipHeight;
+            args.m_filterSize = filterSize;
+            args.m_specularPower = specularPower;
+            args.m_cosAngle = cosAngle;
+            args.m_srcImage = &job.m_imageRgba32f;
+            args.m_srcFaceOffsets = job.m_srcFaceOffsets;
+            args.m_cubemapVectors = job.m_cubemapVectors;
+            args.m_normalsSoa = job.m_normals;
+            args.m_colorsSoa = &job.m_colorsSoa;
+            args.m_copyBase = (0 == mip && _excludeBase);
+            args.m_guardBand = false;
+            bool shMip = false;
+#if CMFT_RADIANCE_SH_ORDER
+            args.m_shCoeffs = NULL;
+            double shCoeffs[CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER][3];
+#endif // CMFT_RADIANCE_SH_ORDER
+
+            if (!args.m_copyBase)
+            {
+                lobeEnergyLoss = max(lobeEnergyLoss, cosinePowerEnergyLoss(specularPower, cosAngle));
+            }
+
+#if CMFT_RADIANCE_SH_ORDER
+            // Wide lobes are convolved in the SH domain, same as imageRadianceFilter() does.
+            if (!args.m_copyBase
+            &&  radianceFilterShMip(job.m_shLobes[mip], specularPower, cosAngle))
+            {
+                radianceFilterShProject(job);
+                for (uint8_t ll = 0; ll < CMFT_RADIANCE_SH_ORDER; ++ll)
+                {
+                    for (uint32_t ii = uint32_t(ll)*ll; ii < uint32_t(ll+1)*(ll+1); ++ii)
+                    {
+                        shCoeffs[ii][0] = job.m_shCoeffs[ii][0]*job.m_shLobes[mip][ll];
+                        shCoeffs[ii][1] = job.m_shCoeffs[ii][1]*job.m_shLobes[mip][ll];
+                        shCoeffs[ii][2] = job.m_shCoeffs[ii][2]*job.m_shLobes[mip][ll];
+                    }
+                }
+                args.m_shCoeffs = shCoeffs;
+                shMip = true;
+            }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+            if (!args.m_copyBase
+            &&  !shMip)
+            {
+                if (_useSourcePyramid)
+                {
+                    const uint8_t level = radianceFilterSourceLevel(imageRgba32f.m_width, mipFaceSize, filterAngle);
+                    if (0 != level)
+                    {
+                        radianceFilterBuildSources(job, level, true);
+
+                        const RadianceFilterSource& source = job.m_sources[level];
+                        args.m_srcImage = &source.m_image;
+                        args.m_srcFaceOffsets = source.m_faceOffsets;
+                        args.m_cubemapVectors = source.m_cubemapVectors;
+                        args.m_normalsSoa = &source.m_normalsSoa;
+                        args.m_colorsSoa = &source.m_colorsSoa;
+                    }
+                }
+
+#if CMFT_RADIANCE_LOBE_TABLE
+                args.m_lobeTable.init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+                args.m_guardBand = args.m_normalsSoa->fitsGuardBand(filterSize) && 0.0f < cosAngle;
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+            }
+
+            if (1 == mipFaceSize && !args.m_copyBase)
+            {
+                // Same as the averaged 1x1 faces of a cubemap result, see radianceFilterAverageLastMip().
+                float color[3] = { 0.0f, 0.0f, 0.0f };
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    float tapVec[3];
+                    texelCoordToVec(tapVec, 0.0f, 0.0f, face, 1);
+
+                    float faceColor[3];
+                    radianceFilterLatLongTap(faceColor, tapVec, args);
+                    color[0] += faceColor[0]/6.0f;
+                    color[1] += faceColor[1]/6.0f;
+                    color[2] += faceColor[2]/6.0f;
+                }
+
+                for (uint32_t ii = 0, end = mipWidth*mipHeight; ii < end; ++ii)
+                {
+                    texelStoreRgb(args.m_dst + ii*4, color, false);
+                }
+            }
+            else
+            {
+                parallelFor(radianceFilterLatLongRows, (void*)&args, mipHeight);
+            }
+
+            numTexels += uint64_t(mipWidth)*mipHeight;
+        }
+
+        const uint64_t filterEndTime = bx::getHPCounter();
+
+        Image result;
+        result.m_width = dstWidth;
+        result.m_height = dstHeight;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = mipCount;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
+
+        if (TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+        }
+        imageMove(_dst, result);
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Radiance -> Done! Total time: %.3f seconds.", double(bx::getHPCounter() - entryTime)*toSec);
+
+        if (NULL != _stats)
+        {
+            FilterStats stats;
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_filterTime = double(filterEndTime - filterStartTime)*toSec;
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_finishTime = double(endTime - filterEndTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            stats.m_tasksCpu = mipCount;
+            stats.m_texelsCpu = numTexels;
+            stats.m_lobeEnergyLoss = lobeEnergyLoss;
+            *_stats = stats;
+        }
+
+        // Cleanup.
+#if CMFT_RADIANCE_SH_ORDER
+        free(job.m_shCoeffs);
+#endif // CMFT_RADIANCE_SH_ORDER
+        radianceFilterReleaseSources(job);
+        releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+
+        return true;
+    }
+
+    void imageRadianceFilterLatLong(Image& _image
+                                  , uint32_t _dstWidth
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , bool _useSourcePyramid
+                                  , FilterStats* _stats
+                                  , const FilterSettings* _settings
+                                  )
+    {
+        Image tmp;
+        if (imageRadianceFilterLatLong(tmp, _dstWidth, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _image, _useSourcePyramid, _stats, _settings))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    struct RadianceFilterMipArgs
+    {
+        float* m_dst[CUBE_FACE_NUM];
+        const uint8_t* m_mask; // Region only, texels of m_faceBegin to filter.
+        uint8_t m_faceBegin;
+        uint32_t m_yBegin;
+        uint32_t m_numRows; // Rows of each face, starting at m_yBegin.
+        uint32_t m_mipFaceSize;
+        float m_filterSize;
+        float m_specularPower;
+        float m_cosAngle;
+        RadianceLobeTable m_lobeTable;
+        const float* m_cubemapVectors;
+        const Image* m_srcImage;
+        const uint64_t* m_srcFaceOffsets;
+        const SoaCubemap* m_normalsSoa;
+        const SoaCubemap* m_colorsSoa;
+        float m_adaptiveTolerance;
+    };
+
+    static void radianceFilterMipRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterMipArgs* args = (const RadianceFilterMipArgs*)_userData;
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(args->m_faceBegin + row/args->m_numRows);
+            const uint32_t yy = args->m_yBegin + row%args->m_numRows;
+
+            radianceFilter(args->m_dst[face]
+                         , false
+                         , face
+                         , args->m_mipFaceSize
+                         , yy
+                         , yy+1
+                         , args->m_filterSize
+                         , args->m_specularPower
+                         , args->m_cosAngle
+                         , &args->m_lobeTable
+                         , args->m_cubemapVectors
+                         , args->m_srcImage
+                         , args->m_srcFaceOffsets
+                         , args->m_normalsSoa
+                         , args->m_colorsSoa
+                         , args->m_adaptiveTolerance
+                         , args->m_mask
+                         );
+        }
+    }
+
+    /// Brute force rows of the reference, every texel sums its whole filter area in double precision.
+    static void radianceFilterMipRowsReference(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterMipArgs* args = (const RadianceFilterMipArgs*)_userData;
+        const uint32_t mipFaceSize = args->m_mipFaceSize;
+        const float invFaceSize = 1.0f/float(int32_t(mipFaceSize));
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(args->m_faceBegin + row/args->m_numRows);
+            const uint32_t yy = args->m_yBegin + row%args->m_numRows;
+
+            for (uint32_t xx = 0; xx < mipFaceSize; ++xx)
+            {
+                if (NULL != args->m_mask
+                &&  0 == args->m_mask[yy*mipFaceSize + xx])
+                {
+                    continue;
+                }
+
+                const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+
+                float tapVec[3];
+                texelCoordToVec(tapVec, uu, vv, face, mipFaceSize);
+
+                Aabb facesBb[6];
+                determineFilterArea(facesBb, tapVec, args->m_filterSize);
+
+                double res[3];
+                processFilterArea<double>(res
+                                        , args->m_specularPower
+                                        , args->m_cosAngle
+                                        , NULL
+                                        , tapVec
+                                        , args->m_cubemapVectors
+                                        , facesBb
+                                        , args->m_srcImage->m_width
+                                        , args->m_srcImage->m_data
+                                        , args->m_srcFaceOffsets
+                                        );
+
+                const float color[3] = { float(res[0]), float(res[1]), float(res[2]) };
+                texelStoreRgb(args->m_dst[face] + (yy*mipFaceSize + xx)*4, color, false);
+            }
+        }
+    }
+
+    static bool radianceFilterMipImpl(Image& _dst
+                                    , uint32_t _dstFaceSize
+                                    , LightingModel::Enum _lightingModel
+                                    , uint8_t _mip
+                                    , uint8_t _mipCount
+                                    , uint8_t _glossScale
+                                    , uint8_t _glossBias
+                                    , const Image& _src
+                                    , const CubeFaceRegion* _region
+                                    , bool _useSourcePyramid
+                                    , FilterStats* _stats
+                                    , bool _reference
+                                    , const FilterSettings& _settings
+                                    , float _specularPower = 0.0f
+                                    )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _src.m_width : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        if (_mip >= mipCount)
+        {
+            WARN("Radiance -> Mip %u is out of the mip chain of %u mips.", _mip, mipCount);
+
+            return false;
+        }
+
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+        imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+        job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+        job.m_normals = &job.m_normalsSoa;
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        if (!_reference)
+        {
+            job.m_normalsSoa.initNormals(job.m_cubemapVectors, imageRgba32f.m_width);
+            soaInitColors(job.m_colorsSoa, imageRgba32f, job.m_srcFaceOffsets);
+        }
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        // Result is a single mip cubemap, texels outside of the region are zero.
+        const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> _mip);
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint64_t faceDataSize = uint64_t(mipFaceSize)*mipFaceSize*bytesPerPixel;
+
+        Image result;
+        result.m_width = mipFaceSize;
+        result.m_height = mipFaceSize;
+        result.m_dataSize = faceDataSize*CUBE_FACE_NUM;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = 1;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = allocTagged(result.m_dataSize, AllocTag::MipChain);
+        MALLOC_CHECK(result.m_data);
+        memset(result.m_data, 0, result.m_dataSize);
+
+        // Same parameters as mip _mip of imageRadianceFilter(), unless the power is given.
+        float specularPower, filterAngle, cosAngle, filterSize;
+        radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, _mip, mipCount, float(int32_t(_glossScale)), float(int32_t(_glossBias)), _lightingModel, _settings.m_lobeTolerance);
+        if (0.0f < _specularPower)
+        {
+            specularPower = _specularPower;
+            radianceFilterMipParams(filterAngle, cosAngle, filterSize, specularPower, mipFaceSize, _settings.m_lobeTolerance);
+        }
+
+        RadianceFilterMipArgs args;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            args.m_dst[face] = (float*)((uint8_t*)result.m_data + face*faceDataSize);
+        }
+        args.m_mipFaceSize = mipFaceSize;
+        args.m_filterSize = filterSize;
+        args.m_specularPower = specularPower;
+        args.m_cosAngle = cosAngle;
+#if CMFT_RADIANCE_LOBE_TABLE
+        args.m_lobeTable.init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+        args.m_srcImage = &job.m_imageRgba32f;
+        args.m_srcFaceOffsets = job.m_srcFaceOffsets;
+        args.m_cubemapVectors = job.m_cubemapVectors;
+        args.m_normalsSoa = job.m_normals;
+        args.m_colorsSoa = &job.m_colorsSoa;
+        args.m_adaptiveTolerance = _settings.m_adaptiveTolerance;
+        if (_useSourcePyramid && !_reference)
+        {
+            const uint8_t level = radianceFilterSourceLevel(imageRgba32f.m_width, mipFaceSize, filterAngle);
+            if (0 != level)
+            {
+                radianceFilterBuildSources(job, level, true);
+
+                const RadianceFilterSource& source = job.m_sources[level];
+                args.m_srcImage = &source.m_image;
+                args.m_srcFaceOffsets = source.m_faceOffsets;
+                args.m_cubemapVectors = source.m_cubemapVectors;
+                args.m_normalsSoa = &source.m_normalsSoa;
+                args.m_colorsSoa = &source.m_colorsSoa;
+            }
+        }
+
+        // 1x1 faces are averaged afterwards, they are all filtered regardless of the region.
+        uint8_t* mask = NULL;
+        uint64_t numTexels = uint64_t(mipFaceSize)*mipFaceSize*CUBE_FACE_NUM;
+        if (NULL != _region && 1 != mipFaceSize)
+        {
+            uint32_t texelMin[2];
+            uint32_t texelMax[2];
+            const float mipFaceSizef = float(int32_t(mipFaceSize));
+            for (uint8_t axis = 0; axis < 2; ++axis)
+            {
+                texelMin[axis] = min(uint32_t(clamp(_region->m_min[axis], 0.0f, 1.0f)*mipFaceSizef), mipFaceSize-1);
+                texelMax[axis] = min(uint32_t(clamp(_region->m_max[axis], 0.0f, 1.0f)*mipFaceSizef), mipFaceSize-1);
+                texelMax[axis] = max(texelMin[axis], texelMax[axis]);
+            }
+
+            mask = (uint8_t*)malloc(uint64_t(mipFaceSize)*mipFaceSize);
+            MALLOC_CHECK(mask);
+            memset(mask, 0, uint64_t(mipFaceSize)*mipFaceSize);
+            for (uint32_t yy = texelMin[1]; yy <= texelMax[1]; ++yy)
+            {
+                memset(mask + yy*mipFaceSize + texelMin[0], 1, texelMax[0] - texelMin[0] + 1);
+            }
+
+            args.m_mask = mask;
+            args.m_faceBegin = min(_region->m_face, uint8_t(CUBE_FACE_NUM-1));
+            args.m_yBegin = texelMin[1];
+            args.m_numRows = texelMax[1] - texelMin[1] + 1;
+            numTexels = uint64_t(texelMax[0] - texelMin[0] + 1)*args.m_numRows;
+        }
+        else
+        {
+            args.m_mask = NULL;
+            args.m_faceBegin = 0;
+            args.m_yBegin = 0;
+            args.m_numRows = mipFaceSize;
+        }
+        const uint32_t numFaces = (NULL != mask) ? 1 : CUBE_FACE_NUM;
+
+        INFO("Running %s for a single mip:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[mip=%u of %u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[dstFaceSize=%u, mip face size %u]"
+             "\n\t[texels=%llu]"
+             , _reference ? "reference radiance filter" : "radiance filter"
+             , imageRgba32f.m_width
+             , getLightingModelStr(_lightingModel)
+             , _mip
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , dstFaceSize
+             , mipFaceSize
+             , (unsigned long long)numTexels
+             );
+
+        const uint64_t filterStartTime = bx::getHPCounter();
+
+        job.m_dstData = result.m_data;
+        job.m_dstFaceSize = mipFaceSize;
+        job.m_mipCount = 1;
+        imageGetMipOffsets(job.m_dstOffsets, result);
+
+#if CMFT_RADIANCE_SH_ORDER
+        // Wide lobes are convolved in the SH domain as in the full chain, the whole mip costs less than filtering the region.
+        job.m_shCoeffs = NULL;
+        if (!_reference
+        &&  radianceFilterShMip(job.m_shLobes[0], specularPower, cosAngle))
+        {
+            radianceFilterShProject(job);
+            radianceFilterShEvaluate(job, 0);
+            free(job.m_shCoeffs);
+
+            numTexels = uint64_t(mipFaceSize)*mipFaceSize*CUBE_FACE_NUM;
+        }
+        else
+#endif // CMFT_RADIANCE_SH_ORDER
+        {
+            parallelFor(_reference ? radianceFilterMipRowsReference : radianceFilterMipRows, (void*)&args, numFaces*args.m_numRows);
+        }
+
+        // Average 1x1 face size.
+        radianceFilterAverageLastMip(job);
+
+        const uint64_t filterEndTime = bx::getHPCounter();
+
+        if (TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+        }
+        imageMove(_dst, result);
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Radiance -> Done! Total time: %.3f seconds.", double(bx::getHPCounter() - entryTime)*toSec);
+
+        if (NULL != _stats)
+        {
+            FilterStats stats;
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_filterTime = double(filterEndTime - filterStartTime)*toSec;
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_finishTime = double(endTime - filterEndTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            stats.m_tasksCpu = numFaces;
+            stats.m_texelsCpu = numTexels;
+            stats.m_lobeEnergyLoss = cosinePowerEnergyLoss(specularPower, cosAngle);
+            *_stats = stats;
+        }
+
+        // Cleanup.
+        free(mask);
+        radianceFilterReleaseSources(job);
+        releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+
+        return true;
+    }
+
+    bool imageRadianceFilterMip(Image& _dst
+                              , uint32_t _dstFaceSize
+                              , LightingModel::Enum _lightingModel
+                              , uint8_t _mip
+                              , uint8_t _mipCount
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , const Image& _src
+                              , const CubeFaceRegion* _region
+                              , bool _useSourcePyramid
+                              , FilterStats* _stats
+                              , const FilterSettings* _settings
+                              )
+    {
+        return radianceFilterMipImpl(_dst, _dstFaceSize, _lightingModel, _mip, _mipCount, _glossScale, _glossBias, _src, _region, _useSourcePyramid, _stats, false, filterSettings(_settings));
+    }
+
+    bool imageRadianceFilterMipReference(Image& _dst
+                                       , uint32_t _dstFaceSize
+                                       , LightingModel::Enum _lightingModel
+                                       , uint8_t _mip
+                                       , uint8_t _mipCount
+                                       , uint8_t _glossScale
+                                       , uint8_t _glossBias
+                                       , const Image& _src
+                                       , const CubeFaceRegion* _region
+                                       , FilterStats* _stats
+                                       , const FilterSettings* _settings
+                                       )
+    {
+        return radianceFilterMipImpl(_dst, _dstFaceSize, _lightingModel, _mip, _mipCount, _glossScale, _glossBias, _src, _region, false, _stats, true, filterSettings(_settings));
+    }
+
+    // Cosine irradiance.
+    //-----
+
+    /// Cosine irradiance filter reads the source box filtered to the smallest halving of its face size that is at least this size.
+    /// Sources smaller than this are read as they are.
+#ifndef CMFT_IRRADIANCE_COSINE_SOURCE_SIZE
+    #define CMFT_IRRADIANCE_COSINE_SOURCE_SIZE 16
+#endif //CMFT_IRRADIANCE_COSINE_SOURCE_SIZE
+
+    bool imageIrradianceFilterCosine(Image& _dst, uint32_t _dstFaceSize, const Image& _src, FilterStats* _stats)
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        Image imageRgba32f;
+        const bool imageIsRef = filterSourceRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+        uint64_t faceOffsets[CUBE_FACE_NUM];
+        imageGetFaceOffsets(faceOffsets, imageRgba32f);
+
+        // Cosine lobe spans a hemisphere, a face of 16 to 31 texels resolves it.
+        uint32_t srcFaceSize = imageRgba32f.m_width;
+        while ((srcFaceSize >> 1) >= CMFT_IRRADIANCE_COSINE_SOURCE_SIZE)
+        {
+            srcFaceSize >>= 1;
+        }
+
+        Image downsampled;
+        const Image* source = &imageRgba32f;
+        uint64_t srcFaceOffsets[CUBE_FACE_NUM];
+        memcpy(srcFaceOffsets, faceOffsets, sizeof(faceOffsets));
+        if (srcFaceSize != imageRgba32f.m_width)
+        {
+            AllocTagScope allocTag(AllocTag::SourceCopy);
+
+            downsampled.m_width = srcFaceSize;
+            downsampled.m_height = srcFaceSize;
+            downsampled.m_dataSize = uint64_t(srcFaceSize)*srcFaceSize*4 /*numChannels*/ * 4 /*bytesPerChannel*/ * CUBE_FACE_NUM;
+            downsampled.m_format = TextureFormat::RGBA32F;
+            downsampled.m_numMips = 1;
+            downsampled.m_numFaces = CUBE_FACE_NUM;
+            downsampled.m_data = downsampled.m_allocator->alloc(downsampled.m_dataSize);
+            MALLOC_CHECK(downsampled.m_data);
+            imageGetFaceOffsets(srcFaceOffsets, downsampled);
+
+            radianceFilterBoxResize(downsampled.m_data, srcFaceOffsets, srcFaceSize, false, imageRgba32f, faceOffsets);
+            source = &downsampled;
+
+            // Full resolution source is not needed anymore.
+            if (!imageIsRef)
+            {
+                imageUnload(imageRgba32f);
+            }
+        }
+
+        const float* cubemapVectors = acquireCubemapNormalSolidAngle(srcFaceSize);
+        ScopeReleaseNormalSolidAngle cleanup(cubemapVectors);
+        SoaCubemap normalsSoa;
+        SoaCubemap colorsSoa;
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        normalsSoa.initNormals(cubemapVectors, srcFaceSize);
+        soaInitColors(colorsSoa, *source, srcFaceOffsets);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _src.m_width : _dstFaceSize;
+        const uint64_t faceDataSize = uint64_t(dstFaceSize)*dstFaceSize*4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = faceDataSize*CUBE_FACE_NUM;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = 1;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = allocTagged(result.m_dataSize, AllocTag::MipChain);
+        MALLOC_CHECK(result.m_data);
+        memset(result.m_data, 0, result.m_dataSize);
+
+        // Power 1 lobe cut at the horizon. Filter weights are normalized, which divides irradiance by pi as the SH filter does.
+        const float filterAngle = float(M_PI)/2.0f;
+        const float cosAngle = 0.0f;
+        const float toFilterSize = 1.0f/(atan2f(1.0f, float(int32_t(dstFaceSize)))*float(int32_t(dstFaceSize))*2.0f);
+
+        RadianceFilterMipArgs args;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            args.m_dst[face] = (float*)((uint8_t*)result.m_data + face*faceDataSize);
+        }
+        args.m_mask = NULL;
+        args.m_faceBegin = 0;
+        args.m_yBegin = 0;
+        args.m_numRows = dstFaceSize;
+        args.m_mipFaceSize = dstFaceSize;
+        args.m_filterSize = max(1.0f/float(int32_t(dstFaceSize)), filterAngle*toFilterSize);
+        args.m_specularPower = 1.0f;
+        args.m_cosAngle = cosAngle;
+#if CMFT_RADIANCE_LOBE_TABLE
+        args.m_lobeTable.init(1.0f, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+        args.m_cubemapVectors = cubemapVectors;
+        args.m_srcImage = source;
+        args.m_srcFaceOffsets = srcFaceOffsets;
+        args.m_normalsSoa = &normalsSoa;
+        args.m_colorsSoa = &colorsSoa;
+
+        INFO("Running irradiance filter for:\n"
+             "\t[srcFaceSize=%u, filtered at %u]\n"
+             "\t[cosine convolution]\n"
+             "\t[dstFaceSize=%u]"
+             , _src.m_width
+             , srcFaceSize
+             , dstFaceSize
+             );
+
+        const uint64_t filterStartTime = bx::getHPCounter();
+
+        parallelFor(radianceFilterMipRows, (void*)&args, CUBE_FACE_NUM*dstFaceSize);
+
+        const uint64_t filterEndTime = bx::getHPCounter();
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Irradiance -> Done! Total time: %.3f seconds.", double(filterEndTime - filterStartTime)*toSec);
+
+        // Convert back to source format.
+        if (TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+        }
+        imageMove(_dst, result);
+
+        // Cleanup.
+        normalsSoa.unload();
+        colorsSoa.unload();
+        imageUnload(downsampled);
+        if (!imageIsRef)
+        {
+            imageUnload(imageRgba32f);
+        }
+
+        if (NULL != _stats)
+        {
+            FilterStats stats;
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_filterTime = double(filterEndTime - filterStartTime)*toSec;
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_finishTime = double(endTime - filterEndTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            stats.m_tasksCpu = CUBE_FACE_NUM;
+            stats.m_texelsCpu = uint64_t(dstFaceSize)*dstFaceSize*CUBE_FACE_NUM;
+            *_stats = stats;
+        }
+
+        return true;
+    }
+
+    void imageIrradianceFilterCosine(Image& _image, uint32_t _faceSize, FilterStats* _stats)
+    {
+        Image tmp;
+        if (imageIrradianceFilterCosine(tmp, _faceSize, _image, _stats))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    // Radiance filter cost.
+    //-----
+
+    /// Same traversal as processFilterArea(). _cost gets texels of the filter area, texels visited after block culling and
+    /// taps inside of the specular angle.
+    static void processFilterAreaCost(float _cost[3]
+                                    , float _specularAngle
+                                    , const float* _tapVec
+                                    , const float* _cubemapNormalSolidAngle
+                                    , Aabb _filterArea[6]
+                                    , uint32_t _srcFaceSize
+                                    )
+    {
+        uint64_t numArea = 0;
+        uint64_t numVisited = 0;
+        uint64_t numAccepted = 0;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t pitch = _srcFaceSize*bytesPerPixel;
+        const uint32_t normalFaceSize = pitch*_srcFaceSize;
+        const float faceSize_MinusOne = float(int32_t(_srcFaceSize-1));
+
+        const uint32_t blocksPerSide = normalConeBlocksPerSide(_srcFaceSize);
+        const float* normalCones = cubemapNormalCones(_cubemapNormalSolidAngle, _srcFaceSize);
+        const float sinAngle = sqrtf(max(0.0f, 1.0f - _specularAngle*_specularAngle));
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_filterArea[face].isEmpty())
+            {
+                continue;
+            }
+
+            const uint32_t minX = uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne);
+            const uint32_t maxX = uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne);
+            const uint32_t minY = uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne);
+            const uint32_t maxY = uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne);
+            numArea += uint64_t(maxX-minX+1)*(maxY-minY+1);
+
+            const uint8_t* faceNormals = (const uint8_t*)_cubemapNormalSolidAngle + normalFaceSize*face;
+            const float*   faceCones   = normalCones + size_t(face)*blocksPerSide*blocksPerSide*4;
+
+            for (uint32_t blockY = minY/CMFT_NORMAL_CONE_BLOCK_SIZE; blockY <= maxY/CMFT_NORMAL_CONE_BLOCK_SIZE; ++blockY)
+            {
+                const uint32_t yBegin = max(minY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                const uint32_t yEnd   = min(maxY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+
+                const float* rowCones = faceCones + blockY*blocksPerSide*4;
+                const uint32_t lastBlockX = maxX/CMFT_NORMAL_CONE_BLOCK_SIZE;
+
+                for (uint32_t blockX = minX/CMFT_NORMAL_CONE_BLOCK_SIZE; blockX <= lastBlockX; ++blockX)
+                {
+                    if (normalConeOutside(&rowCones[blockX*4], _tapVec, _specularAngle, sinAngle))
+                    {
+                        continue;
+                    }
+
+                    const uint32_t firstBlockX = blockX;
+                    while (blockX < lastBlockX
+                       && !normalConeOutside(&rowCones[(blockX+1)*4], _tapVec, _specularAngle, sinAngle))
+                    {
+                        ++blockX;
+                    }
+
+                    const uint32_t xBegin = max(minX, firstBlockX*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                    const uint32_t xEnd   = min(maxX, blockX*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+                    numVisited += uint64_t(xEnd-xBegin+1)*(yEnd-yBegin+1);
+
+                    for (uint32_t yy = yBegin; yy <= yEnd; ++yy)
+                    {
+                        const uint8_t* rowNormals = (const uint8_t*)faceNormals + yy*pitch;
+
+                        for (uint32_t xx = xBegin; xx <= xEnd; ++xx)
+                        {
+                            const float* normalPtr = (const float*)((const uint8_t*)rowNormals + xx*bytesPerPixel);
+                            if (vec3Dot(normalPtr, _tapVec) >= _specularAngle)
+                            {
+                                ++numAccepted;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        _cost[0] = float(numArea);
+        _cost[1] = float(numVisited);
+        _cost[2] = float(numAccepted);
+    }
+
+    struct RadianceFilterCostArgs
+    {
+        float* m_dst;
+        uint32_t m_mipFaceSize;
+        float m_filterSize;
+        float m_cosAngle;
+        const float* m_cubemapVectors;
+        uint32_t m_srcFaceSize;
+    };
+
+    static void radianceFilterCostRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterCostArgs* args = (const RadianceFilterCostArgs*)_userData;
+        const uint32_t mipFaceSize = args->m_mipFaceSize;
+        const float invFaceSize = 1.0f/float(int32_t(mipFaceSize));
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(row/mipFaceSize);
+            const uint32_t yy = row%mipFaceSize;
+            float* dst = args->m_dst + uint64_t(row)*mipFaceSize*4;
+
+            for (uint32_t xx = 0; xx < mipFaceSize; ++xx)
+            {
+                const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+
+                float tapVec[3];
+                texelCoordToVec(tapVec, uu, vv, face, mipFaceSize);
+
+                Aabb facesBb[6];
+                determineFilterArea(facesBb, tapVec, args->m_filterSize);
+
+                processFilterAreaCost(&dst[xx*4], args->m_cosAngle, tapVec, args->m_cubemapVectors, facesBb, args->m_srcFaceSize);
+                dst[xx*4+3] = 1.0f;
+            }
+        }
+    }
+
+    bool imageRadianceFilterCost(Image& _dst
+                               , const Image& _src
+                               , uint32_t _dstFaceSize
+                               , LightingModel::Enum _lightingModel
+                               , bool _excludeBase
+                               , uint8_t _mipCount
+                               , uint8_t _glossScale
+                               , uint8_t _glossBias
+                               , const FilterSettings* _settings
+                               )
+    {
+        const FilterSettings& settings = filterSettings(_settings);
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        const uint32_t srcFaceSize = _src.m_width;
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? srcFaceSize : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        const float* cubemapVectors = acquireCubemapNormalSolidAngle(srcFaceSize);
+        ScopeReleaseNormalSolidAngle releaseVectors(cubemapVectors);
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        uint64_t dstDataSize = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint64_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            dstDataSize += mipFaceSize*mipFaceSize*bytesPerPixel*CUBE_FACE_NUM;
+        }
+
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = mipCount;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = malloc(dstDataSize);
+        MALLOC_CHECK(result.m_data);
+        memset(result.m_data, 0, dstDataSize);
+
+        uint64_t mipOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(mipOffsets, result);
+
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+        for (uint8_t mip = (_excludeBase ? 1 : 0); mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            const uint64_t faceDataSize = uint64_t(mipFaceSize)*mipFaceSize*bytesPerPixel;
+
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+
+#if CMFT_RADIANCE_SH_ORDER
+            // Mip is convolved in the SH domain, no taps.
+            double lobes[CMFT_RADIANCE_SH_ORDER];
+            if (radianceFilterShMip(lobes, specularPower, cosAngle))
+            {
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    float* dst = (float*)((uint8_t*)result.m_data + mipOffsets[face][mip]);
+                    for (uint64_t ii = 0, end = uint64_t(mipFaceSize)*mipFaceSize; ii < end; ++ii)
+                    {
+                        dst[ii*4+3] = 1.0f;
+                    }
+                }
+                continue;
+            }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+            // Faces of a mip are consecutive only per face, rows are filtered into a temporary and copied.
+            float* mipData = (float*)malloc(faceDataSize*CUBE_FACE_NUM);
+            MALLOC_CHECK(mipData);
+
+            RadianceFilterCostArgs args;
+            args.m_dst = mipData;
+            args.m_mipFaceSize = mipFaceSize;
+            args.m_filterSize = filterSize;
+            args.m_cosAngle = cosAngle;
+            args.m_cubemapVectors = cubemapVectors;
+            args.m_srcFaceSize = srcFaceSize;
+            parallelFor(radianceFilterCostRows, (void*)&args, CUBE_FACE_NUM*mipFaceSize);
+
+            double sumAccepted = 0.0;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                const float* src = (const float*)((const uint8_t*)mipData + face*faceDataSize);
+                memcpy((uint8_t*)result.m_data + mipOffsets[face][mip], src, faceDataSize);
+
+                for (uint64_t ii = 0, end = uint64_t(mipFaceSize)*mipFaceSize; ii < end; ++ii)
+                {
+                    sumAccepted += double(src[ii*4+2]);
+                }
+            }
+            free(mipData);
+
+            INFO("Cost -> Mip %u, face size %u: %.0f taps per texel.", mip, mipFaceSize, sumAccepted/double(uint64_t(mipFaceSize)*mipFaceSize*CUBE_FACE_NUM));
+        }
+
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    // Radiance filter chain.
+    //-----
+
+    /// Check region of chained mips, in face coordinates of a face that changes with the mip.
+    #define CMFT_RADIANCE_CHAIN_CHECK_MIN 0.375f
+    #define CMFT_RADIANCE_CHAIN_CHECK_MAX 0.625f
+
+    /// Smaller mips are too coarse to take the next lobe from, the following mips are all filtered from the last bigger one.
+    #define CMFT_RADIANCE_CHAIN_MIN_FACE_SIZE 8
+
+    /// Power of the lobe that convolved with lobe of _prevPower gives about lobe of _power. Legendre coefficients of convolved
+    /// zonal lobes multiply, the residual keeps band 1 of pow(cos, n) over the hemisphere exact, (n+1)/(n+2). For sharp lobes
+    /// that is the same as adding variances 1/n of gaussians.
+    static float radianceChainResidualPower(float _power, float _prevPower)
+    {
+        const float band1 = (_power+1.0f)/(_power+2.0f);
+        const float prevBand1 = (_prevPower+1.0f)/(_prevPower+2.0f);
+        const float residualBand1 = band1/prevBand1;
+        return (2.0f*residualBand1 - 1.0f)/(1.0f - residualBand1);
+    }
+
+    /// Relative RMS difference of _image to _ref over texels of the check region of _face, see imageRadianceFilterChain().
+    static float radianceChainError(const Image& _image, const Image& _ref, uint8_t _face, const CubeFaceRegion& _region)
+    {
+        const uint32_t faceSize = _image.m_width;
+        const uint64_t faceTexels = uint64_t(faceSize)*faceSize;
+
+        uint32_t texelMin[2];
+        uint32_t texelMax[2];
+        for (uint8_t axis = 0; axis < 2; ++axis)
+        {
+            texelMin[axis] = min(uint32_t(_region.m_min[axis]*float(int32_t(faceSize))), faceSize-1);
+            texelMax[axis] = max(texelMin[axis], min(uint32_t(_region.m_max[axis]*float(int32_t(faceSize))), faceSize-1));
+        }
+
+        // 1x1 faces are filtered and averaged whole.
+        const uint8_t faceBegin = (1 == faceSize) ? 0 : _face;
+        const uint8_t faceEnd = (1 == faceSize) ? CUBE_FACE_NUM : _face+1;
+
+        double errorSum = 0.0;
+        double refSum = 0.0;
+        for (uint8_t face = faceBegin; face < faceEnd; ++face)
+        {
+            const float* image = (const float*)_image.m_data + face*faceTexels*4;
+            const float* ref = (const float*)_ref.m_data + face*faceTexels*4;
+            for (uint32_t yy = texelMin[1]; yy <= texelMax[1]; ++yy)
+            {
+                for (uint32_t xx = texelMin[0]; xx <= texelMax[0]; ++xx)
+                {
+                    const uint32_t idx = (yy*faceSize + xx)*4;
+                    for (uint8_t ch = 0; ch < 3; ++ch)
+                    {
+                        const double diff = double(image[idx+ch]) - double(ref[idx+ch]);
+                        errorSum += diff*diff;
+                        refSum += double(ref[idx+ch])*double(ref[idx+ch]);
+                    }
+                }
+            }
+        }
+
+        return (0.0 < refSum) ? float(sqrt(errorSum/refSum)) : ((0.0 < errorSum) ? FLT_MAX : 0.0f);
+    }
+
+    bool imageRadianceFilterChain(Image& _dst
+                                , uint32_t _dstFaceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , const Image& _src
+                                , float _maxError
+                                , FilterStats* _stats
+                                , const FilterSettings* _settings
+                                )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        // Mips are chained in Rgba32f format.
+        Image imageRgba32f;
+        const bool imageIsRef = filterSourceRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _src.m_width : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        INFO("Running radiance filter chain:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[dstFaceSize=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[maxError=%g]"
+             , imageRgba32f.m_width
+             , dstFaceSize
+             , getLightingModelStr(_lightingModel)
+             , _excludeBase ? "true" : "false"
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , _maxError
+             );
+
+        uint64_t faceDataSize[MAX_MIP_NUM];
+        uint64_t dataSize = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint64_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            faceDataSize[mip] = mipFaceSize*mipFaceSize*4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+            dataSize += faceDataSize[mip]*CUBE_FACE_NUM;
+        }
+
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = mipCount;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = allocTagged(result.m_dataSize, AllocTag::MipChain);
+        MALLOC_CHECK(result.m_data);
+
+        uint64_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(dstOffsets, result);
+
+        // Single mip calls report on their own, only the chain summary is printed.
+        const bool printInfo = g_printInfo;
+        g_printInfo = false;
+
+        FilterStats stats;
+        uint8_t numChained = 0;
+        float maxChainError = 0.0f;
+        // Mip the next one is filtered from and its power, zero for the unfiltered base.
+        float prevSpecularPower = 0.0f;
+        Image prev;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+
+            Image image;
+            FilterStats mipStats;
+            if (0 == mip && _excludeBase)
+            {
+                image.m_width = mipFaceSize;
+                image.m_height = mipFaceSize;
+                image.m_dataSize = faceDataSize[0]*CUBE_FACE_NUM;
+                image.m_format = TextureFormat::RGBA32F;
+                image.m_numMips = 1;
+                image.m_numFaces = CUBE_FACE_NUM;
+                image.m_data = allocTagged(image.m_dataSize, AllocTag::MipChain);
+                MALLOC_CHECK(image.m_data);
+
+                uint64_t srcOffsets[CUBE_FACE_NUM];
+                uint64_t baseOffsets[CUBE_FACE_NUM];
+                imageGetFaceOffsets(srcOffsets, imageRgba32f);
+                imageGetFaceOffsets(baseOffsets, image);
+                radianceFilterBoxResize(image.m_data, baseOffsets, mipFaceSize, false, imageRgba32f, srcOffsets);
+
+                // Box filtered base is the unfiltered source, the next mip takes the whole lobe.
+                specularPower = 0.0f;
+            }
+            else if (0 != mip
+                 &&  (0.0f == prevSpecularPower || specularPower < prevSpecularPower))
+            {
+                const float residualPower = (0.0f == prevSpecularPower)
+                                          ? specularPower
+                                          : radianceChainResidualPower(specularPower, prevSpecularPower)
+                                          ;
+                radianceFilterMipImpl(image, dstFaceSize, _lightingModel, mip, mipCount, _glossScale, _glossBias, prev, NULL, false, &mipStats, false, settings, residualPower);
+                numChained++;
+
+                if (0.0f < _maxError)
+                {
+                    // Check region is filtered directly from the source, the mip is filtered again if the chain drifted away.
+                    const uint8_t checkFace = uint8_t(mip%CUBE_FACE_NUM);
+                    CubeFaceRegion region;
+                    region.m_face = checkFace;
+                    region.m_min[0] = region.m_min[1] = CMFT_RADIANCE_CHAIN_CHECK_MIN;
+                    region.m_max[0] = region.m_max[1] = CMFT_RADIANCE_CHAIN_CHECK_MAX;
+
+                    Image check;
+                    FilterStats checkStats;
+                    radianceFilterMipImpl(check, dstFaceSize, _lightingModel, mip, mipCount, _glossScale, _glossBias, imageRgba32f, &region, false, &checkStats, false, settings);
+                    mipStats.m_filterTime += checkStats.m_filterTime;
+                    mipStats.m_texelsCpu += checkStats.m_texelsCpu;
+
+                    const float error = radianceChainError(image, check, checkFace, region);
+                    imageUnload(check);
+                    maxChainError = max(maxChainError, error);
+
+                    if (error > _maxError)
+                    {
+                        g_printInfo = printInfo;
+                        INFO("Radiance chain -> Mip %u is %.4f off the direct result, above %.4f. Filtering it from the source.", mip, error, _maxError);
+                        g_printInfo = false;
+
+                        imageUnload(image);
+                        radianceFilterMipImpl(image, dstFaceSize, _lightingModel, mip, mipCount, _glossScale, _glossBias, imageRgba32f, NULL, false, &checkStats, false, settings);
+                        mipStats.m_filterTime += checkStats.m_filterTime;
+                        mipStats.m_texelsCpu += checkStats.m_texelsCpu;
+                        numChained--;
+                    }
+                }
+            }
+            else
+            {
+                radianceFilterMipImpl(image, dstFaceSize, _lightingModel, mip, mipCount, _glossScale, _glossBias, imageRgba32f, NULL, false, &mipStats, false, settings);
+            }
+
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                memcpy((uint8_t*)result.m_data + dstOffsets[face][mip], (const uint8_t*)image.m_data + face*faceDataSize[mip], size_t(faceDataSize[mip]));
+            }
+
+            stats.m_filterTime += mipStats.m_filterTime;
+            stats.m_tasksCpu += mipStats.m_tasksCpu;
+            stats.m_texelsCpu += mipStats.m_texelsCpu;
+            stats.m_lobeEnergyLoss = max(stats.m_lobeEnergyLoss, mipStats.m_lobeEnergyLoss);
+
+            if (CMFT_RADIANCE_CHAIN_MIN_FACE_SIZE <= mipFaceSize
+            ||  0 == mip)
+            {
+                imageUnload(prev);
+                imageMove(prev, image);
+                prevSpecularPower = specularPower;
+            }
+            else
+            {
+                imageUnload(image);
+            }
+        }
+        imageUnload(prev);
+
+        g_printInfo = printInfo;
+
+        const uint64_t finishTime = bx::getHPCounter();
+
+        if (TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+        }
+        imageMove(_dst, result);
+
+        if (!imageIsRef)
+        {
+            imageUnload(imageRgba32f);
+        }
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        if (0.0f < _maxError)
+        {
+            INFO("Radiance chain -> %u of %u mips filtered from an earlier mip, largest checked error %.4f.", numChained, mipCount, maxChainError);
+        }
+        else
+        {
+            INFO("Radiance chain -> %u of %u mips filtered from an earlier mip.", numChained, mipCount);
+        }
+        INFO("Radiance chain -> Done! Total time: %.3f seconds.", double(bx::getHPCounter() - entryTime)*toSec);
+
+        if (NULL != _stats)
+        {
+            const uint64_t endTime = bx::getHPCounter();
+            stats.m_totalTime = double(endTime - entryTime)*toSec;
+            stats.m_finishTime = double(endTime - finishTime)*toSec;
+            stats.m_prepareTime = max(0.0, stats.m_totalTime - stats.m_filterTime - stats.m_finishTime);
+            *_stats = stats;
+        }
+
+        return true;
+    }
+
+    void imageRadianceFilterChain(Image& _image
+                                , uint32_t _faceSize
+                                , LightingModel::Enum _lightingModel
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , uint8_t _glossScale
+                                , uint8_t _glossBias
+                                , float _maxError
+                                , FilterStats* _stats
+                                , const FilterSettings* _settings
+                                )
+    {
+        Image tmp;
+        if (imageRadianceFilterChain(tmp, _faceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _image, _maxError, _stats, _settings))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    // Incremental radiance filter.
+    //-----
+
+    struct RadianceFilterIncrementalState
+    {
+        RadianceFilterJob m_job;
+        Image m_result;
+        TextureFormat::Enum m_format;
+        bool m_excludeBase;
+        bool m_complete;
+        uint8_t m_mip;      // Mip being filtered, m_mipCount once all are.
+        uint32_t m_row;     // Next row of the mip, faces one after another.
+        uint64_t m_numRows;  // Rows of all mips, for progress.
+        uint64_t m_rowsDone;
+        float m_specularPower[MAX_MIP_NUM];
+        float m_cosAngle[MAX_MIP_NUM];
+        float m_filterSize[MAX_MIP_NUM];
+        uint8_t m_srcLevel[MAX_MIP_NUM];
+        float m_adaptiveTolerance;
+#if CMFT_RADIANCE_SH_ORDER
+        // SH projection, one chunk of rows per step. Partials are merged in chunk order, as viewShCoeffs() does.
+        Image m_shImage;
+        bool m_shImageIsRef;
+        ImageView m_shView;
+        const float* m_shVectors;
+        ShPartialSum<CMFT_RADIANCE_SH_ORDER>* m_shPartials;
+        uint32_t m_shChunk;
+        uint32_t m_shNumChunks;
+#endif // CMFT_RADIANCE_SH_ORDER
+    };
+
+#if CMFT_RADIANCE_SH_ORDER
+    static void radianceFilterIncrementalShRelease(RadianceFilterIncrementalState& _state)
+    {
+        if (NULL == _state.m_shPartials)
+        {
+            return;
+        }
+
+        free(_state.m_shPartials);
+        _state.m_shPartials = NULL;
+        releaseCubemapNormalSolidAngle(_state.m_shVectors);
+        if (!_state.m_shImageIsRef)
+        {
+            imageUnload(_state.m_shImage);
+        }
+    }
+
+    /// Does the next step of the SH projection, sets job.m_shCoeffs after the last one.
+    static void radianceFilterIncrementalShProject(RadianceFilterIncrementalState& _state)
+    {
+        RadianceFilterJob& job = _state.m_job;
+
+        if (NULL == _state.m_shPartials)
+        {
+            _state.m_shImageIsRef = radianceFilterShSource(job, _state.m_shImage);
+
+            const Image& image = _state.m_shImage;
+            uint64_t faceOffsets[CUBE_FACE_NUM];
+            imageGetFaceOffsets(faceOffsets, image);
+            shCubemapView(_state.m_shView, image.m_data, image.m_width, faceOffsets, shNumChannels(image));
+
+            const uint32_t chunksPerFace = (image.m_width + CMFT_SH_ROWS_PER_CHUNK-1)/CMFT_SH_ROWS_PER_CHUNK;
+            _state.m_shVectors = acquireCubemapNormalSolidAngle(image.m_width);
+            _state.m_shNumChunks = CUBE_FACE_NUM*chunksPerFace;
+            _state.m_shChunk = 0;
+            _state.m_shPartials = (ShPartialSum<CMFT_RADIANCE_SH_ORDER>*)malloc(_state.m_shNumChunks*sizeof(ShPartialSum<CMFT_RADIANCE_SH_ORDER>));
+            MALLOC_CHECK(_state.m_shPartials);
+            return;
+        }
+
+        if (_state.m_shChunk < _state.m_shNumChunks)
+        {
+            ShCoeffsArgs<CMFT_RADIANCE_SH_ORDER> args;
+            args.m_partials = _state.m_shPartials;
+            args.m_view = &_state.m_shView;
+            args.m_cubemapVectors = _state.m_shVectors;
+            args.m_faceSize = _state.m_shView.m_faceSize;
+            args.m_chunksPerFace = _state.m_shNumChunks/CUBE_FACE_NUM;
+
+            const bool rgb = (TextureFormat::RGB32F == _state.m_shView.m_format);
+            if (rgb)
+            {
+                shCoeffsChunks<CMFT_RADIANCE_SH_ORDER, 3>((void*)&args, _state.m_shChunk, _state.m_shChunk+1);
+            }
+            else
+            {
+                shCoeffsChunks<CMFT_RADIANCE_SH_ORDER, 4>((void*)&args, _state.m_shChunk, _state.m_shChunk+1);
+            }
+
+            _state.m_shChunk++;
+            return;
+        }
+
+        job.m_shCoeffs = (double(*)[3])malloc(CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER*3*sizeof(double));
+        MALLOC_CHECK(job.m_shCoeffs);
+        shMergePartials<CMFT_RADIANCE_SH_ORDER>(job.m_shCoeffs, _state.m_shPartials, _state.m_shNumChunks);
+        radianceFilterIncrementalShRelease(_state);
+    }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+    RadianceFilterIncremental::RadianceFilterIncremental()
+        : m_state(NULL)
+    {
+    }
+
+    RadianceFilterIncremental::~RadianceFilterIncremental()
+    {
+        shutdown();
+    }
+
+    bool RadianceFilterIncremental::init(uint32_t _dstFaceSize
+                                       , LightingModel::Enum _lightingModel
+                                       , bool _excludeBase
+                                       , uint8_t _mipCount
+                                       , uint8_t _glossScale
+                                       , uint8_t _glossBias
+                                       , const Image& _src
+                                       , bool _useSourcePyramid
+                                       , const FilterSettings* _settings
+                                       )
+    {
+        const FilterSettings& settings = filterSettings(_settings);
+        shutdown();
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        RadianceFilterIncrementalState* state = (RadianceFilterIncrementalState*)malloc(sizeof(RadianceFilterIncrementalState));
+        MALLOC_CHECK(state);
+        if (NULL == state)
+        {
+            return false;
+        }
+        state->m_result = Image();
+
+        RadianceFilterJob& job = state->m_job;
+        job.m_imageRgba32f = Image();
+        job.m_normalsSoa = SoaCubemap();
+        job.m_colorsSoa = SoaCubemap();
+        for (uint8_t level = 0; level < MAX_MIP_NUM; ++level)
+        {
+            job.m_sources[level].m_image = Image();
+            job.m_sources[level].m_normalsSoa = SoaCubemap();
+            job.m_sources[level].m_colorsSoa = SoaCubemap();
+        }
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+#if CMFT_RADIANCE_SH_ORDER
+        job.m_shCoeffs = NULL;
+        state->m_shImage = Image();
+        state->m_shPartials = NULL;
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+        imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+        job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+        job.m_normals = &job.m_normalsSoa;
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        job.m_normalsSoa.initNormals(job.m_cubemapVectors, imageRgba32f.m_width);
+        soaInitColors(job.m_colorsSoa, imageRgba32f, job.m_srcFaceOffsets);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _src.m_width : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+
+        uint64_t dataSize = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint64_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            dataSize += mipFaceSize*mipFaceSize*4 /*numChannels*/ * 4 /*bytesPerChannel*/ * CUBE_FACE_NUM;
+        }
+
+        Image& result = state->m_result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = mipCount;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = allocTagged(result.m_dataSize, AllocTag::MipChain);
+        MALLOC_CHECK(result.m_data);
+
+        job.m_dstData = result.m_data;
+        job.m_dstDataSize = dataSize;
+        job.m_dstFaceSize = dstFaceSize;
+        job.m_mipCount = mipCount;
+        imageGetMipOffsets(job.m_dstOffsets, result);
+
+        // Same parameters and sources as imageRadianceFilter() on the CPU.
+        uint8_t maxLevel = 0;
+        state->m_numRows = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, float(int32_t(_glossScale)), float(int32_t(_glossBias)), _lightingModel, settings.m_lobeTolerance);
+
+            state->m_specularPower[mip] = specularPower;
+            state->m_cosAngle[mip] = cosAngle;
+            state->m_filterSize[mip] = filterSize;
+            state->m_srcLevel[mip] = _useSourcePyramid ? radianceFilterSourceLevel(imageRgba32f.m_width, mipFaceSize, filterAngle) : 0;
+#if CMFT_RADIANCE_LOBE_TABLE
+            job.m_lobeTables[mip].init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+#if CMFT_RADIANCE_SH_ORDER
+            job.m_shMip[mip] = !(0 == mip && _excludeBase) && radianceFilterShMip(job.m_shLobes[mip], specularPower, cosAngle);
+            if (job.m_shMip[mip])
+            {
+                state->m_srcLevel[mip] = 0;
+            }
+#endif // CMFT_RADIANCE_SH_ORDER
+            maxLevel = max(maxLevel, state->m_srcLevel[mip]);
+
+            state->m_numRows += uint64_t(mipFaceSize)*CUBE_FACE_NUM;
+        }
+
+        // Pyramid levels that are filtered get SoA copies, they have to be built before the SH projection.
+        if (0 != maxLevel)
+        {
+            radianceFilterBuildSources(job, maxLevel, true);
+        }
+
+        state->m_format = TextureFormat::Enum(_src.m_format);
+        state->m_excludeBase = _excludeBase;
+        state->m_adaptiveTolerance = settings.m_adaptiveTolerance;
+        state->m_complete = false;
+        state->m_mip = 0;
+        state->m_row = 0;
+        state->m_rowsDone = 0;
+
+        m_state = state;
+        return true;
+    }
+
+    /// Filters the next row of the current mip, or does the next whole step of the chain. Returns false once complete.
+    static bool radianceFilterIncrementalUnit(RadianceFilterIncrementalState& _state)
+    {
+        RadianceFilterJob& job = _state.m_job;
+        const uint8_t mip = _state.m_mip;
+
+        if (mip == job.m_mipCount)
+        {
+            // Average 1x1 face size.
+            radianceFilterAverageLastMip(job);
+
+            if (TextureFormat::RGBA32F != _state.m_format)
+            {
+                imageConvert(_state.m_result, _state.m_format);
+            }
+
+            _state.m_complete = true;
+            return false;
+        }
+
+        const uint32_t mipFaceSize = max(UINT32_C(1), job.m_dstFaceSize >> mip);
+        uint32_t numRows = 1;
+
+        if (0 == mip && _state.m_excludeBase)
+        {
+            radianceFilterCopyBase(job);
+            numRows = mipFaceSize*CUBE_FACE_NUM;
+        }
+#if CMFT_RADIANCE_SH_ORDER
+        else if (job.m_shMip[mip] && NULL == job.m_shCoeffs)
+        {
+            // Projection is done in steps of its own, rows are evaluated afterwards.
+            radianceFilterIncrementalShProject(_state);
+            return true;
+        }
+        else if (job.m_shMip[mip])
+        {
+            double coeffs[CMFT_RADIANCE_SH_ORDER*CMFT_RADIANCE_SH_ORDER][3];
+            for (uint8_t ll = 0; ll < CMFT_RADIANCE_SH_ORDER; ++ll)
+            {
+                for (uint32_t ii = uint32_t(ll)*ll; ii < uint32_t(ll+1)*(ll+1); ++ii)
+                {
+                    coeffs[ii][0] = job.m_shCoeffs[ii][0]*job.m_shLobes[mip][ll];
+                    coeffs[ii][1] = job.m_shCoeffs[ii][1]*job.m_shLobes[mip][ll];
+                    coeffs[ii][2] = job.m_shCoeffs[ii][2]*job.m_shLobes[mip][ll];
+                }
+            }
+
+            uint64_t dstOffsets[CUBE_FACE_NUM];
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                dstOffsets[face] = job.m_dstOffsets[face][mip];
+            }
+
+            RadianceFilterShArgs args;
+            args.m_dstData = job.m_dstData;
+            args.m_dstOffsets = dstOffsets;
+            args.m_mipFaceSize = mipFaceSize;
+            args.m_halfDst = false;
+            args.m_coeffs = coeffs;
+            radianceFilterShRows((void*)&args, _state.m_row, _state.m_row+1);
+        }
+#endif // CMFT_RADIANCE_SH_ORDER
+        else
+        {
+            const uint8_t level = _state.m_srcLevel[mip];
+            const bool pyramid = (0 != level);
+            const uint8_t face = uint8_t(_state.m_row/mipFaceSize);
+            const uint32_t yy = _state.m_row%mipFaceSize;
+
+            radianceFilter((uint8_t*)job.m_dstData + job.m_dstOffsets[face][mip]
+                         , false
+                         , face
+                         , mipFaceSize
+                         , yy
+                         , yy+1
+                         , _state.m_filterSize[mip]
+                         , _state.m_specularPower[mip]
+                         , _state.m_cosAngle[mip]
+                         , &job.m_lobeTables[mip]
+                         , pyramid ? job.m_sources[level].m_cubemapVectors : job.m_cubemapVectors
+                         , pyramid ? &job.m_sources[level].m_image : &job.m_imageRgba32f
+                         , pyramid ? job.m_sources[level].m_faceOffsets : job.m_srcFaceOffsets
+                         , pyramid ? &job.m_sources[level].m_normalsSoa : job.m_normals
+                         , pyramid ? &job.m_sources[level].m_colorsSoa : &job.m_colorsSoa
+                         , _state.m_adaptiveTolerance
+                         );
+        }
+
+        _state.m_row += numRows;
+        _state.m_rowsDone += numRows;
+        if (_state.m_row >= mipFaceSize*CUBE_FACE_NUM)
+        {
+            _state.m_row = 0;
+            _state.m_mip++;
+        }
+
+        return true;
+    }
+
+    bool RadianceFilterIncremental::step(uint32_t _budgetMicroseconds)
+    {
+        if (NULL == m_state)
+        {
+            return false;
+        }
+
+        CMFT_PROFILE_ZONE("radianceFilterIncrementalStep");
+
+        const int64_t budget = int64_t(_budgetMicroseconds)*bx::getHPFrequency()/1000000;
+        const int64_t startTime = bx::getHPCounter();
+        while (!m_state->m_complete
+           &&  radianceFilterIncrementalUnit(*m_state)
+           &&  bx::getHPCounter() - startTime < budget)
+        {
+        }
+
+        return m_state->m_complete;
+    }
+
+    bool RadianceFilterIncremental::isComplete() const
+    {
+        return NULL != m_state && m_state->m_complete;
+    }
+
+    float RadianceFilterIncremental::getProgress() const
+    {
+        if (NULL == m_state)
+        {
+            return 0.0f;
+        }
+
+        if (m_state->m_complete)
+        {
+            return 1.0f;
+        }
+
+        return float(double(m_state->m_rowsDone)/double(m_state->m_numRows + 1));
+    }
+
+    bool RadianceFilterIncremental::getResult(Image& _dst)
+    {
+        if (!isComplete())
+        {
+            return false;
+        }
+
+        imageMove(_dst, m_state->m_result);
+        shutdown();
+
+        return true;
+    }
+
+    void RadianceFilterIncremental::shutdown()
+    {
+        RadianceFilterIncrementalState* state = m_state;
+        if (NULL == state)
+        {
+            return;
+        }
+
+        RadianceFilterJob& job = state->m_job;
+#if CMFT_RADIANCE_SH_ORDER
+        radianceFilterIncrementalShRelease(*state);
+        free(job.m_shCoeffs);
+#endif // CMFT_RADIANCE_SH_ORDER
+        radianceFilterReleaseSources(job);
+        job.m_normalsSoa.unload();
+        job.m_colorsSoa.unload();
+        releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+        imageUnload(state->m_result);
+
+        free(state);
+        m_state = NULL;
+    }
+
+    // Radiance filter matrices.
+    //-----
+
+    /// Matrices with more weights than this are not built, each weight takes 8 bytes of memory and of the cache file.
+#ifndef CMFT_RADIANCE_MATRIX_MAX_ENTRIES
+    #define CMFT_RADIANCE_MATRIX_MAX_ENTRIES (UINT64_C(1)<<28)
+#endif //CMFT_RADIANCE_MATRIX_MAX_ENTRIES
+
+#define CMFT_RADIANCE_MATRIX_MAGIC   0x4d464d43 // "CMFM"
+#define CMFT_RADIANCE_MATRIX_VERSION 1
+
+    struct RadianceMatrixFileHeader
+    {
+        uint32_t m_magic;
+        uint32_t m_version;
+        uint32_t m_srcFaceSize;
+        uint32_t m_dstFaceSize;
+        uint8_t m_mipCount;
+        uint8_t m_glossScale;
+        uint8_t m_glossBias;
+        uint8_t m_lightingModel;
+        uint8_t m_excludeBase;
+        uint8_t m_useSourcePyramid;
+        uint8_t m_srcLevel[MAX_MIP_NUM];
+        uint8_t m_pad[2];
+        uint64_t m_mipRows[MAX_MIP_NUM];
+        uint64_t m_numRows;
+        uint64_t m_numEntries;
+    };
+
+    struct RadianceMatrixMipArgs
+    {
+        RadianceFilterMatrix* m_matrix;
+        uint64_t m_rowBegin;
+        uint32_t m_mipFaceSize;
+        uint32_t m_srcFaceSize;
+        float m_filterSize;
+        float m_specularPower;
+        float m_cosAngle;
+        const float* m_cubemapVectors;
+        bool m_box;  // Base mip with excludeBase, box filtered from the source.
+        bool m_fill; // Entry counts of rows are written to m_rows[row+1] otherwise.
+    };
+
+    /// Lobe weights of the filter area, the same texels processFilterArea() accumulates. Returns sum of the weights,
+    /// weights scaled by _scale and their columns are written only if _columns is not NULL.
+    static double radianceMatrixArea(uint32_t& _numEntries
+                                   , uint32_t* _columns
+                                   , float* _weights
+                                   , double _scale
+                                   , const RadianceMatrixMipArgs& _args
+                                   , const float* _tapVec
+                                   , Aabb _filterArea[6]
+                                   )
+    {
+        const uint32_t srcFaceSize = _args.m_srcFaceSize;
+        const uint32_t faceTexels = srcFaceSize*srcFaceSize;
+        const float faceSize_MinusOne = float(int32_t(srcFaceSize-1));
+
+        double weightSum = 0.0;
+        uint32_t numEntries = 0;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_filterArea[face].isEmpty())
+            {
+                continue;
+            }
+
+            const uint32_t minX = uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne);
+            const uint32_t maxX = uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne);
+            const uint32_t minY = uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne);
+            const uint32_t maxY = uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne);
+
+            const float* faceNormals = _args.m_cubemapVectors + uint64_t(face)*faceTexels*4;
+            for (uint32_t yy = minY; yy <= maxY; ++yy)
+            {
+                for (uint32_t xx = minX; xx <= maxX; ++xx)
+                {
+                    const float* normalPtr = faceNormals + (yy*srcFaceSize + xx)*4;
+                    const float dotProduct = vec3Dot(normalPtr, _tapVec);
+                    if (dotProduct < _args.m_cosAngle)
+                    {
+                        continue;
+                    }
+
+                    const double weight = double(normalPtr[3]) * pow(double(dotProduct), double(_args.m_specularPower));
+                    if (0.0 == weight)
+                    {
+                        continue;
+                    }
+
+                    if (NULL != _columns)
+                    {
+                        _columns[numEntries] = face*faceTexels + yy*srcFaceSize + xx;
+                        _weights[numEntries] = float(weight*_scale);
+                    }
+                    weightSum += weight;
+                    numEntries++;
+                }
+            }
+        }
+
+        _numEntries = numEntries;
+        return weightSum;
+    }
+
+    static void radianceMatrixRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceMatrixMipArgs* args = (const RadianceMatrixMipArgs*)_userData;
+        RadianceFilterMatrix& matrix = *args->m_matrix;
+        const uint32_t mipFaceSize = args->m_mipFaceSize;
+        const uint32_t srcFaceSize = args->m_srcFaceSize;
+        const float invFaceSize = 1.0f/float(int32_t(mipFaceSize));
+
+        for (uint32_t line = _begin; line < _end; ++line)
+        {
+            const uint8_t face = uint8_t(line/mipFaceSize);
+            const uint32_t yy = line%mipFaceSize;
+
+            for (uint32_t xx = 0; xx < mipFaceSize; ++xx)
+            {
+                const uint64_t row = args->m_rowBegin + uint64_t(line)*mipFaceSize + xx;
+                uint32_t* columns = args->m_fill ? matrix.m_columns + matrix.m_rows[row] : NULL;
+                float* weights = args->m_fill ? matrix.m_weights + matrix.m_rows[row] : NULL;
+                uint32_t numEntries;
+
+                if (args->m_box)
+                {
+                    // Same texels as radianceFilterBoxResize().
+                    const float dstToSrcRatio = float(int32_t(srcFaceSize))/float(int32_t(mipFaceSize));
+                    const uint32_t side = max(uint32_t(1), uint32_t(dstToSrcRatio));
+                    const uint32_t xBegin = uint32_t(float(xx)*dstToSrcRatio);
+                    const uint32_t yBegin = uint32_t(float(yy)*dstToSrcRatio);
+                    numEntries = side*side;
+
+                    if (NULL != columns)
+                    {
+                        const float weight = 1.0f/float(int32_t(numEntries));
+                        for (uint32_t ii = 0; ii < numEntries; ++ii)
+                        {
+                            columns[ii] = face*srcFaceSize*srcFaceSize + (yBegin + ii/side)*srcFaceSize + xBegin + ii%side;
+                            weights[ii] = weight;
+                        }
+                    }
+                }
+                else
+                {
+                    const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                    const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+
+                    float tapVec[3];
+                    texelCoordToVec(tapVec, uu, vv, face, mipFaceSize);
+
+                    Aabb facesBb[6];
+                    determineFilterArea(facesBb, tapVec, args->m_filterSize);
+
+                    const double weightSum = radianceMatrixArea(numEntries, NULL, NULL, 1.0, *args, tapVec, facesBb);
+                    if (0.0 == weightSum)
+                    {
+                        // Direct color sample, as processFilterArea() takes when the convolution is zero.
+                        numEntries = 1;
+                        if (NULL != columns)
+                        {
+                            float su, sv;
+                            uint8_t hitFaceIdx;
+                            vecToTexelCoord(su, sv, hitFaceIdx, tapVec);
+
+                            const uint32_t sx = min(uint32_t(su*float(srcFaceSize)), srcFaceSize-1);
+                            const uint32_t sy = min(uint32_t(sv*float(srcFaceSize)), srcFaceSize-1);
+                            columns[0] = hitFaceIdx*srcFaceSize*srcFaceSize + sy*srcFaceSize + sx;
+                            weights[0] = 1.0f;
+                        }
+                    }
+                    else if (NULL != columns)
+                    {
+                        radianceMatrixArea(numEntries, columns, weights, 1.0/weightSum, *args, tapVec, facesBb);
+                    }
+                }
+
+                if (!args->m_fill)
+                {
+                    matrix.m_rows[row+1] = numEntries;
+                }
+            }
+        }
+    }
+
+    bool radianceFilterMatrixBuild(RadianceFilterMatrix& _matrix
+                                 , uint32_t _srcFaceSize
+                                 , uint32_t _dstFaceSize
+                                 , LightingModel::Enum _lightingModel
+                                 , bool _excludeBase
+                                 , uint8_t _mipCount
+                                 , uint8_t _glossScale
+                                 , uint8_t _glossBias
+                                 , bool _useSourcePyramid
+                                 , const FilterSettings* _settings
+                                 )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        radianceFilterMatrixUnload(_matrix);
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _srcFaceSize : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        RadianceFilterMatrix matrix;
+        matrix.m_srcFaceSize = _srcFaceSize;
+        matrix.m_dstFaceSize = dstFaceSize;
+        matrix.m_mipCount = mipCount;
+        matrix.m_glossScale = _glossScale;
+        matrix.m_glossBias = _glossBias;
+        matrix.m_lightingModel = uint8_t(_lightingModel);
+        matrix.m_excludeBase = _excludeBase;
+        matrix.m_useSourcePyramid = _useSourcePyramid;
+
+        // Filter parameters and source level of each mip.
+        RadianceMatrixMipArgs args[MAX_MIP_NUM];
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+
+            const bool box = (0 == mip && _excludeBase);
+            const uint8_t level = (_useSourcePyramid && !box) ? radianceFilterSourceLevel(_srcFaceSize, mipFaceSize, filterAngle) : 0;
+            uint32_t levelFaceSize = _srcFaceSize;
+            for (uint8_t ii = 0; ii < level; ++ii)
+            {
+                levelFaceSize = max(UINT32_C(1), levelFaceSize >> 1);
+            }
+
+            matrix.m_srcLevel[mip] = level;
+            matrix.m_mipRows[mip] = matrix.m_numRows;
+            matrix.m_numRows += uint64_t(mipFaceSize)*mipFaceSize*CUBE_FACE_NUM;
+
+            args[mip].m_matrix = &matrix;
+            args[mip].m_rowBegin = matrix.m_mipRows[mip];
+            args[mip].m_mipFaceSize = mipFaceSize;
+            args[mip].m_srcFaceSize = levelFaceSize;
+            args[mip].m_filterSize = filterSize;
+            args[mip].m_specularPower = specularPower;
+            args[mip].m_cosAngle = cosAngle;
+            args[mip].m_cubemapVectors = box ? NULL : acquireCubemapNormalSolidAngle(levelFaceSize);
+            args[mip].m_box = box;
+            args[mip].m_fill = false;
+        }
+
+        INFO("Building radiance filter matrix:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[dstFaceSize=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[sourcePyramid=%s]"
+             , _srcFaceSize
+             , dstFaceSize
+             , getLightingModelStr(_lightingModel)
+             , _excludeBase ? "true" : "false"
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , _useSourcePyramid ? "true" : "false"
+             );
+
+        // Entry counts of all rows first, then the entries themselves.
+        matrix.m_rows = (uint64_t*)malloc((matrix.m_numRows+1)*sizeof(uint64_t));
+        MALLOC_CHECK(matrix.m_rows);
+        matrix.m_rows[0] = 0;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            parallelFor(radianceMatrixRows, (void*)&args[mip], args[mip].m_mipFaceSize*CUBE_FACE_NUM);
+        }
+
+        for (uint64_t row = 0; row < matrix.m_numRows; ++row)
+        {
+            matrix.m_rows[row+1] += matrix.m_rows[row];
+        }
+        matrix.m_numEntries = matrix.m_rows[matrix.m_numRows];
+
+        bool built = false;
+        if (matrix.m_numEntries > CMFT_RADIANCE_MATRIX_MAX_ENTRIES)
+        {
+            WARN("Radiance matrix -> %llu weights are over the limit of %llu, use source pyramid or fewer mips."
+                , (unsigned long long)matrix.m_numEntries
+                , (unsigned long long)CMFT_RADIANCE_MATRIX_MAX_ENTRIES
+                );
+        }
+        else
+        {
+            matrix.m_columns = (uint32_t*)malloc(matrix.m_numEntries*sizeof(uint32_t));
+            MALLOC_CHECK(matrix.m_columns);
+            matrix.m_weights = (float*)malloc(matrix.m_numEntries*sizeof(float));
+            MALLOC_CHECK(matrix.m_weights);
+
+            for (uint8_t mip = 0; mip < mipCount; ++mip)
+            {
+                args[mip].m_fill = true;
+                parallelFor(radianceMatrixRows, (void*)&args[mip], args[mip].m_mipFaceSize*CUBE_FACE_NUM);
+            }
+
+            built = true;
+        }
+
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            if (NULL != args[mip].m_cubemapVectors)
+            {
+                releaseCubemapNormalSolidAngle(args[mip].m_cubemapVectors);
+            }
+        }
+
+        if (!built)
+        {
+            radianceFilterMatrixUnload(matrix);
+            return false;
+        }
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Radiance matrix -> Done! %llu weights, %.1f MB, %.3f seconds."
+            , (unsigned long long)matrix.m_numEntries
+            , double((matrix.m_numRows+1)*sizeof(uint64_t) + matrix.m_numEntries*(sizeof(uint32_t)+sizeof(float)))/(1024.0*1024.0)
+            , double(bx::getHPCounter() - entryTime)*toSec
+            );
+
+        _matrix = matrix;
+        return true;
+    }
+
+    bool radianceFilterMatrixSave(const RadianceFilterMatrix& _matrix, const char* _filePath)
+    {
+        RadianceMatrixFileHeader header;
+        memset(&header, 0, sizeof(header));
+        header.m_magic = CMFT_RADIANCE_MATRIX_MAGIC;
+        header.m_version = CMFT_RADIANCE_MATRIX_VERSION;
+        header.m_srcFaceSize = _matrix.m_srcFaceSize;
+        header.m_dstFaceSize = _matrix.m_dstFaceSize;
+        header.m_mipCount = _matrix.m_mipCount;
+        header.m_glossScale = _matrix.m_glossScale;
+        header.m_glossBias = _matrix.m_glossBias;
+        header.m_lightingModel = _matrix.m_lightingModel;
+        header.m_excludeBase = uint8_t(_matrix.m_excludeBase);
+        header.m_useSourcePyramid = uint8_t(_matrix.m_useSourcePyramid);
+        memcpy(header.m_srcLevel, _matrix.m_srcLevel, sizeof(header.m_srcLevel));
+        memcpy(header.m_mipRows, _matrix.m_mipRows, sizeof(header.m_mipRows));
+        header.m_numRows = _matrix.m_numRows;
+        header.m_numEntries = _matrix.m_numEntries;
+
+        FILE* fp = fopen(_filePath, "wb");
+        if (NULL == fp)
+        {
+            WARN("Could not open file %s for writing.", _filePath);
+            return false;
+        }
+        ScopeFclose cleanup(fp);
+
+        const bool written = (1 == fwrite(&header, sizeof(header), 1, fp))
+                          && (1 == fwrite(_matrix.m_rows, (_matrix.m_numRows+1)*sizeof(uint64_t), 1, fp))
+                          && (_matrix.m_numEntries == fwrite(_matrix.m_columns, sizeof(uint32_t), _matrix.m_numEntries, fp))
+                          && (_matrix.m_numEntries == fwrite(_matrix.m_weights, sizeof(float), _matrix.m_numEntries, fp))
+                          ;
+        if (!written)
+        {
+            WARN("Could not write radiance matrix to %s.", _filePath);
+        }
+
+        return written;
+    }
+
+    bool radianceFilterMatrixLoad(RadianceFilterMatrix& _matrix, const char* _filePath)
+    {
+        radianceFilterMatrixUnload(_matrix);
+
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
+        {
+            return false;
+        }
+        ScopeFclose cleanup(fp);
+
+        RadianceMatrixFileHeader header;
+        if (1 != fread(&header, sizeof(header), 1, fp)
+        ||  CMFT_RADIANCE_MATRIX_MAGIC != header.m_magic
+        ||  CMFT_RADIANCE_MATRIX_VERSION != header.m_version
+        ||  0 == header.m_srcFaceSize
+        ||  0 == header.m_mipCount
+        ||  header.m_mipCount > MAX_MIP_NUM
+        ||  header.m_numEntries > CMFT_RADIANCE_MATRIX_MAX_ENTRIES)
+        {
+            WARN("%s is not a radiance matrix of this version.", _filePath);
+            return false;
+        }
+
+        RadianceFilterMatrix matrix;
+        matrix.m_srcFaceSize = header.m_srcFaceSize;
+        matrix.m_dstFaceSize = header.m_dstFaceSize;
+        matrix.m_mipCount = header.m_mipCount;
+        matrix.m_glossScale = header.m_glossScale;
+        matrix.m_glossBias = header.m_glossBias;
+        matrix.m_lightingModel = header.m_lightingModel;
+        matrix.m_excludeBase = (0 != header.m_excludeBase);
+        matrix.m_useSourcePyramid = (0 != header.m_useSourcePyramid);
+        memcpy(matrix.m_srcLevel, header.m_srcLevel, sizeof(matrix.m_srcLevel));
+        memcpy(matrix.m_mipRows, header.m_mipRows, sizeof(matrix.m_mipRows));
+        matrix.m_numRows = header.m_numRows;
+        matrix.m_numEntries = header.m_numEntries;
+
+        // Layout has to be the one the build would produce, apply trusts rows and columns.
+        bool valid = (0 != matrix.m_dstFaceSize)
+                  && (matrix.m_numRows == radianceFilterMipTexels(matrix.m_dstFaceSize, 0, matrix.m_mipCount))
+                  ;
+        for (uint8_t mip = 0; valid && mip < matrix.m_mipCount; ++mip)
+        {
+            valid = (matrix.m_mipRows[mip] == radianceFilterMipTexels(matrix.m_dstFaceSize, 0, mip))
+                 && (matrix.m_srcLevel[mip] < MAX_MIP_NUM)
+                 ;
+        }
+
+        if (valid)
+        {
+            matrix.m_rows = (uint64_t*)malloc((matrix.m_numRows+1)*sizeof(uint64_t));
+            MALLOC_CHECK(matrix.m_rows);
+            matrix.m_columns = (uint32_t*)malloc(matrix.m_numEntries*sizeof(uint32_t));
+            MALLOC_CHECK(matrix.m_columns);
+            matrix.m_weights = (float*)malloc(matrix.m_numEntries*sizeof(float));
+            MALLOC_CHECK(matrix.m_weights);
+
+            valid = (1 == fread(matrix.m_rows, (matrix.m_numRows+1)*sizeof(uint64_t), 1, fp))
+                 && (matrix.m_numEntries == fread(matrix.m_columns, sizeof(uint32_t), matrix.m_numEntries, fp))
+                 && (matrix.m_numEntries == fread(matrix.m_weights, sizeof(float), matrix.m_numEntries, fp))
+                 && (0 == matrix.m_rows[0])
+                 && (matrix.m_numEntries == matrix.m_rows[matrix.m_numRows])
+                 ;
+        }
+
+        for (uint8_t mip = 0; valid && mip < matrix.m_mipCount; ++mip)
+        {
+            uint32_t levelFaceSize = matrix.m_srcFaceSize;
+            for (uint8_t ii = 0; ii < matrix.m_srcLevel[mip]; ++ii)
+            {
+                levelFaceSize = max(UINT32_C(1), levelFaceSize >> 1);
+            }
+            const uint64_t levelTexels = uint64_t(levelFaceSize)*levelFaceSize*CUBE_FACE_NUM;
+
+            const uint64_t rowEnd = (mip+1 < matrix.m_mipCount) ? matrix.m_mipRows[mip+1] : matrix.m_numRows;
+            for (uint64_t row = matrix.m_mipRows[mip]; valid && row < rowEnd; ++row)
+            {
+                valid = (matrix.m_rows[row] <= matrix.m_rows[row+1]);
+                for (uint64_t ii = matrix.m_rows[row], end = matrix.m_rows[row+1]; valid && ii < end; ++ii)
+                {
+                    valid = (matrix.m_columns[ii] < levelTexels);
+                }
+            }
+        }
+
+        if (!valid)
+        {
+            WARN("Radiance matrix %s is corrupt.", _filePath);
+            radianceFilterMatrixUnload(matrix);
+            return false;
+        }
+
+        _matrix = matrix;
+        return true;
+    }
+
+    void radianceFilterMatrixUnload(RadianceFilterMatrix& _matrix)
+    {
+        free(_matrix.m_rows);
+        free(_matrix.m_columns);
+        free(_matrix.m_weights);
+        _matrix = RadianceFilterMatrix();
+    }
+
+    struct RadianceMatrixApplyArgs
+    {
+        const RadianceFilterMatrix* m_matrix;
+        uint64_t m_rowBegin;
+        uint32_t m_mipFaceSize;
+        const float* m_src; // RGBA32F texels of the source level, faces one after another.
+        float* m_dst[CUBE_FACE_NUM];
+    };
+
+    static void radianceMatrixApplyRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceMatrixApplyArgs* args = (const RadianceMatrixApplyArgs*)_userData;
+        const uint64_t* rows = args->m_matrix->m_rows;
+        const uint32_t* columns = args->m_matrix->m_columns;
+        const float* weights = args->m_matrix->m_weights;
+        const uint32_t mipFaceSize = args->m_mipFaceSize;
+
+        for (uint32_t line = _begin; line < _end; ++line)
+        {
+            const uint8_t face = uint8_t(line/mipFaceSize);
+            const uint32_t yy = line%mipFaceSize;
+            float* dstRow = args->m_dst[face] + uint64_t(yy)*mipFaceSize*4;
+
+            for (uint32_t xx = 0; xx < mipFaceSize; ++xx)
+            {
+                const uint64_t row = args->m_rowBegin + uint64_t(line)*mipFaceSize + xx;
+
+                float color[3] = { 0.0f, 0.0f, 0.0f };
+                for (uint64_t ii = rows[row], end = rows[row+1]; ii < end; ++ii)
+                {
+                    const float* texel = args->m_src + uint64_t(columns[ii])*4;
+                    const float weight = weights[ii];
+                    color[0] += texel[0]*weight;
+                    color[1] += texel[1]*weight;
+                    color[2] += texel[2]*weight;
+                }
+
+                texelStoreRgb(dstRow + xx*4, color, false);
+            }
+        }
+    }
+
+    bool imageRadianceFilterMatrix(Image& _dst, const Image& _src, const RadianceFilterMatrix& _matrix)
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+            return false;
+        }
+
+        if (NULL == _matrix.m_rows
+        ||  _src.m_width != _matrix.m_srcFaceSize)
+        {
+            WARN("Radiance matrix -> Matrix filters %u face size sources, source face size is %u.", _matrix.m_srcFaceSize, _src.m_width);
+            return false;
+        }
+
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+
+        // Processing is done in Rgba32f format, level 0 columns index faces one after another.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        imageGetFaceOffsets(job.m_srcFaceOffsets, job.m_imageRgba32f);
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint64_t srcFaceDataSize = uint64_t(_src.m_width)*_src.m_width*bytesPerPixel;
+
+        bool contiguous = true;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            contiguous &= (job.m_srcFaceOffsets[face] == face*srcFaceDataSize);
+        }
+
+        void* srcFaces = NULL;
+        if (!contiguous)
+        {
+            srcFaces = allocScratch(srcFaceDataSize*CUBE_FACE_NUM, AllocTag::SourceCopy);
+            MALLOC_CHECK(srcFaces);
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                memcpy((uint8_t*)srcFaces + face*srcFaceDataSize, (const uint8_t*)job.m_imageRgba32f.m_data + job.m_srcFaceOffsets[face], srcFaceDataSize);
+            }
+        }
+
+        Image result;
+        result.m_width = _matrix.m_dstFaceSize;
+        result.m_height = _matrix.m_dstFaceSize;
+        result.m_dataSize = radianceFilterMipTexels(_matrix.m_dstFaceSize, 0, _matrix.m_mipCount)*bytesPerPixel;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = _matrix.m_mipCount;
+        result.m_numFaces = CUBE_FACE_NUM;
+        result.m_data = allocTagged(result.m_dataSize, AllocTag::MipChain);
+        MALLOC_CHECK(result.m_data);
+
+        job.m_dstData = result.m_data;
+        job.m_dstFaceSize = _matrix.m_dstFaceSize;
+        job.m_mipCount = _matrix.m_mipCount;
+        imageGetMipOffsets(job.m_dstOffsets, result);
+
+        for (uint8_t mip = 0; mip < _matrix.m_mipCount; ++mip)
+        {
+            const uint8_t level = _matrix.m_srcLevel[mip];
+            radianceFilterBuildSources(job, level, false);
+
+            RadianceMatrixApplyArgs args;
+            args.m_matrix = &_matrix;
+            args.m_rowBegin = _matrix.m_mipRows[mip];
+            args.m_mipFaceSize = max(UINT32_C(1), _matrix.m_dstFaceSize >> mip);
+            args.m_src = (const float*)((0 != level) ? job.m_sources[level].m_image.m_data
+                                     : (contiguous ? job.m_imageRgba32f.m_data : srcFaces)
+                                     );
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                args.m_dst[face] = (float*)((uint8_t*)result.m_data + job.m_dstOffsets[face][mip]);
+            }
+
+            parallelFor(radianceMatrixApplyRows, (void*)&args, args.m_mipFaceSize*CUBE_FACE_NUM);
+        }
+
+        // Average 1x1 face size.
+        radianceFilterAverageLastMip(job);
+
+        if (TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageConvert(result, (TextureFormat::Enum)_src.m_format);
+        }
+        imageMove(_dst, result);
+
+        // Cleanup.
+        if (NULL != srcFaces)
+        {
+            freeScratch(srcFaces);
+        }
+        radianceFilterReleaseSources(job);
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Radiance matrix -> Done! %llu weights, total time: %.3f seconds."
+            , (unsigned long long)_matrix.m_numEntries
+            , double(bx::getHPCounter() - entryTime)*toSec
+            );
+
+        return true;
+    }
+
+    // Radiance parameter sweep.
+    //-----
+
+    /// Parameter sets of a single sweep, each set keeps its own lobe table and accumulators on the stack of a worker.
+#ifndef CMFT_RADIANCE_SWEEP_MAX_SETS
+    #define CMFT_RADIANCE_SWEEP_MAX_SETS 16
+#endif //CMFT_RADIANCE_SWEEP_MAX_SETS
+
+    /// Sets filtered by a mip are its slots, sets convolved in the SH domain are left out.
+    struct RadianceSweepMipArgs
+    {
+        uint8_t m_numSets;
+        uint32_t m_mipFaceSize;
+        float m_filterSize; // Widest set, its filter area covers areas of all sets.
+        float m_cosAngle;   // Widest set.
+        float m_filterSizes[CMFT_RADIANCE_SWEEP_MAX_SETS];
+        float m_specularPower[CMFT_RADIANCE_SWEEP_MAX_SETS];
+        float m_cosAngles[CMFT_RADIANCE_SWEEP_MAX_SETS];
+        RadianceLobeTable m_lobeTables[CMFT_RADIANCE_SWEEP_MAX_SETS];
+        float* m_dst[CMFT_RADIANCE_SWEEP_MAX_SETS][CUBE_FACE_NUM];
+        const float* m_cubemapVectors;
+        const Image* m_srcImage;
+        const uint64_t* m_srcFaceOffsets;
+        const SoaCubemap* m_normalsSoa;
+        const SoaCubemap* m_colorsSoa;
+    };
+
+    /// Bit mask of the sets whose filter area on _face has texels in row _yy between _xBegin and _xEnd.
+    static inline uint32_t radianceSweepSpanSets(const int32_t (*_setBounds)[6][4], uint8_t _numSets, uint8_t _face, int32_t _yy, int32_t _xBegin, int32_t _xEnd)
+    {
+        uint32_t spanSets = 0;
+        for (uint8_t set = 0; set < _numSets; ++set)
+        {
+            const int32_t* bounds = _setBounds[set][_face];
+            if (_yy >= bounds[2] && _yy <= bounds[3]
+            &&  _xEnd >= bounds[0] && _xBegin <= bounds[1])
+            {
+                spanSets |= UINT32_C(1)<<set;
+            }
+        }
+
+        return spanSets;
+    }
+
+    /// Same as processFilterArea<float>() for all sets at once. Texels are fetched and dot products computed once for the
+    /// widest filter area, every set accumulates its own lobe weights of the texels within its own filter area.
+    static void radianceSweepFilterArea(float (*_res)[3]
+                                      , const RadianceSweepMipArgs& _args
+                                      , const float* _tapVec
+                                      , Aabb _filterArea[6]
+                                      , const int32_t (*_setBounds)[6][4]
+                                      )
+    {
+        float colorWeight[CMFT_RADIANCE_SWEEP_MAX_SETS][4];
+        memset(colorWeight, 0, sizeof(colorWeight));
+
+        const uint8_t numSets = _args.m_numSets;
+        const uint32_t srcFaceSize = _args.m_srcImage->m_width;
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t pitch = srcFaceSize*bytesPerPixel;
+        const uint32_t normalFaceSize = pitch*srcFaceSize;
+        const float faceSize_MinusOne = float(int32_t(srcFaceSize-1));
+
+        const uint32_t blocksPerSide = normalConeBlocksPerSide(srcFaceSize);
+        const float* normalCones = cubemapNormalCones(_args.m_cubemapVectors, srcFaceSize);
+        const float cosAngle = _args.m_cosAngle;
+        const float sinAngle = sqrtf(max(0.0f, 1.0f - cosAngle*cosAngle));
+
+#if CMFT_RADIANCE_SIMD
+        using namespace bx;
+
+        const float4_t tapX  = float4_splat(_tapVec[0]);
+        const float4_t tapY  = float4_splat(_tapVec[1]);
+        const float4_t tapZ  = float4_splat(_tapVec[2]);
+        const float4_t angle = float4_splat(cosAngle);
+        const float4_t lanes = float4_ld(0.0f, 1.0f, 2.0f, 3.0f);
+
+        float4_t color[CMFT_RADIANCE_SWEEP_MAX_SETS];
+        float4_t weight[CMFT_RADIANCE_SWEEP_MAX_SETS];
+        for (uint8_t set = 0; set < numSets; ++set)
+        {
+            color[set] = float4_zero();
+            weight[set] = float4_zero();
+        }
+#endif // CMFT_RADIANCE_SIMD
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_filterArea[face].isEmpty())
+            {
+                continue;
+            }
+
+            const uint32_t minX = uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne);
+            const uint32_t maxX = uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne);
+            const uint32_t minY = uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne);
+            const uint32_t maxY = uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne);
+
+            const uint8_t* faceData    = (const uint8_t*)_args.m_srcImage->m_data + _args.m_srcFaceOffsets[face];
+            const uint8_t* faceNormals = (const uint8_t*)_args.m_cubemapVectors  + normalFaceSize*face;
+            const float*   faceCones   = normalCones + size_t(face)*blocksPerSide*blocksPerSide*4;
+
+            for (uint32_t blockY = minY/CMFT_NORMAL_CONE_BLOCK_SIZE; blockY <= maxY/CMFT_NORMAL_CONE_BLOCK_SIZE; ++blockY)
+            {
+                const uint32_t yBegin = max(minY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                const uint32_t yEnd   = min(maxY, blockY*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+                const float* rowCones = faceCones + blockY*blocksPerSide*4;
+                const uint32_t lastBlockX = maxX/CMFT_NORMAL_CONE_BLOCK_SIZE;
+
+                for (uint32_t blockX = minX/CMFT_NORMAL_CONE_BLOCK_SIZE; blockX <= lastBlockX; ++blockX)
+                {
+                    // Blocks outside of the widest specular angle are outside of all of them.
+                    if (normalConeOutside(&rowCones[blockX*4], _tapVec, cosAngle, sinAngle))
+                    {
+                        continue;
+                    }
+
+                    // Merge following blocks that are not skipped into a single span.
+                    const uint32_t firstBlockX = blockX;
+                    while (blockX < lastBlockX
+                       && !normalConeOutside(&rowCones[(blockX+1)*4], _tapVec, cosAngle, sinAngle))
+                    {
+                        ++blockX;
+                    }
+
+                    const uint32_t xBegin = max(minX, firstBlockX*CMFT_NORMAL_CONE_BLOCK_SIZE);
+                    const uint32_t xEnd   = min(maxX, blockX*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+
+                    for (uint32_t yy = yBegin; yy <= yEnd; ++yy)
+                    {
+                        const uint32_t spanSets = radianceSweepSpanSets(_setBounds, numSets, face, int32_t(yy), int32_t(xBegin), int32_t(xEnd));
+
+                        if (0 == spanSets)
+                        {
+                            continue;
+                        }
+
+                        const float* rowData    = (const float*)(faceData    + yy*pitch);
+                        const float* rowNormals = (const float*)(faceNormals + yy*pitch);
+
+                        uint32_t xx = xBegin;
+#if CMFT_RADIANCE_SIMD
+                        for (; xx+3 <= xEnd; xx += 4)
+                        {
+                            const float* nn = &rowNormals[xx*4];
+                            const float4_t n0 = float4_ld(nn[ 0], nn[ 1], nn[ 2], nn[ 3]);
+                            const float4_t n1 = float4_ld(nn[ 4], nn[ 5], nn[ 6], nn[ 7]);
+                            const float4_t n2 = float4_ld(nn[ 8], nn[ 9], nn[10], nn[11]);
+                            const float4_t n3 = float4_ld(nn[12], nn[13], nn[14], nn[15]);
+
+                            // Transpose to xxxx, yyyy, zzzz, wwww.
+                            const float4_t t0 = float4_shuf_xAyB(n0, n1);
+                            const float4_t t1 = float4_shuf_zCwD(n0, n1);
+                            const float4_t t2 = float4_shuf_xAyB(n2, n3);
+                            const float4_t t3 = float4_shuf_zCwD(n2, n3);
+                            const float4_t nx = float4_shuf_xyAB(t0, t2);
+                            const float4_t ny = float4_shuf_zwCD(t0, t2);
+                            const float4_t nz = float4_shuf_xyAB(t1, t3);
+                            const float4_t sa = float4_shuf_zwCD(t1, t3);
+
+                            const float4_t dot = float4_madd(nx, tapX, float4_madd(ny, tapY, float4_mul(nz, tapZ)));
+                            if (!float4_test_any_xyzw(float4_cmpge(dot, angle)))
+                            {
+                                continue;
+                            }
+
+                            const float* cc = &rowData[xx*4];
+                            const float4_t c0 = float4_ld(cc[ 0], cc[ 1], cc[ 2], cc[ 3]);
+                            const float4_t c1 = float4_ld(cc[ 4], cc[ 5], cc[ 6], cc[ 7]);
+                            const float4_t c2 = float4_ld(cc[ 8], cc[ 9], cc[10], cc[11]);
+                            const float4_t c3 = float4_ld(cc[12], cc[13], cc[14], cc[15]);
+                            const float4_t xs = float4_add(float4_splat(float(int32_t(xx))), lanes);
+
+                            for (uint8_t set = 0; set < numSets; ++set)
+                            {
+                                if (0 == (spanSets & (UINT32_C(1)<<set)))
+                                {
+                                    continue;
+                                }
+
+                                const int32_t* bounds = _setBounds[set][face];
+                                const float4_t inside = float4_and(float4_cmpge(xs, float4_splat(float(int32_t(bounds[0]))))
+                                                                 , float4_cmple(xs, float4_splat(float(int32_t(bounds[1]))))
+                                                                 );
+                                const float4_t mask = float4_and(inside, float4_cmpge(dot, float4_splat(_args.m_cosAngles[set])));
+                                if (!float4_test_any_xyzw(mask))
+                                {
+                                    continue;
+                                }
+
+#if CMFT_RADIANCE_LOBE_TABLE
+                                const float4_t ww = float4_and(mask, float4_mul(sa, _args.m_lobeTables[set].weight4(dot)));
+#else
+                                const float4_t ww = float4_and(mask, float4_mul(sa, float4_pow(dot, float4_splat(_args.m_specularPower[set]))));
+#endif // CMFT_RADIANCE_LOBE_TABLE
+                                weight[set] = float4_add(weight[set], ww);
+                                color[set] = float4_madd(c0, float4_swiz_xxxx(ww), color[set]);
+                                color[set] = float4_madd(c1, float4_swiz_yyyy(ww), color[set]);
+                                color[set] = float4_madd(c2, float4_swiz_zzzz(ww), color[set]);
+                                color[set] = float4_madd(c3, float4_swiz_wwww(ww), color[set]);
+                            }
+                        }
+#endif // CMFT_RADIANCE_SIMD
+
+                        // Remaining texels.
+                        for (; xx <= xEnd; ++xx)
+                        {
+                            const float* normalPtr = &rowNormals[xx*4];
+                            const float dotProduct = vec3Dot(normalPtr, _tapVec);
+                            if (dotProduct < cosAngle)
+                            {
+                                continue;
+                            }
+
+                            const float* dataPtr = &rowData[xx*4];
+                            for (uint8_t set = 0; set < numSets; ++set)
+                            {
+                                const int32_t* bounds = _setBounds[set][face];
+                                if (dotProduct >= _args.m_cosAngles[set]
+                                &&  int32_t(xx) >= bounds[0] && int32_t(xx) <= bounds[1]
+                                &&  int32_t(yy) >= bounds[2] && int32_t(yy) <= bounds[3])
+                                {
+                                    const float ww = normalPtr[3] * filterAreaLobeWeight(0.0f, dotProduct, _args.m_specularPower[set], &_args.m_lobeTables[set]);
+                                    colorWeight[set][0] += dataPtr[0] * ww;
+                                    colorWeight[set][1] += dataPtr[1] * ww;
+                                    colorWeight[set][2] += dataPtr[2] * ww;
+                                    colorWeight[set][3] += ww;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        for (uint8_t set = 0; set < numSets; ++set)
+        {
+#if CMFT_RADIANCE_SIMD
+            colorWeight[set][0] += float4_x(color[set]);
+            colorWeight[set][1] += float4_y(color[set]);
+            colorWeight[set][2] += float4_z(color[set]);
+            colorWeight[set][3] += float4_x(weight[set]) + float4_y(weight[set]) + float4_z(weight[set]) + float4_w(weight[set]);
+#endif // CMFT_RADIANCE_SIMD
+
+            if (0.0f != colorWeight[set][3])
+            {
+                const float invWeight = 1.0f/colorWeight[set][3];
+                _res[set][0] = colorWeight[set][0] * invWeight;
+                _res[set][1] = colorWeight[set][1] * invWeight;
+                _res[set][2] = colorWeight[set][2] * invWeight;
+            }
+            // Else if colorWeight == 0 (result of convolution is zero) take a direct color sample.
+            else
+            {
+                float uu, vv;
+                uint8_t hitFaceIdx;
+                vecToTexelCoord(uu, vv, hitFaceIdx, _tapVec);
+
+                const uint32_t xx = uint32_t(uu*float(srcFaceSize));
+                const uint32_t yy = uint32_t(vv*float(srcFaceSize));
+
+                const float* dataPtr = (const float*)((const uint8_t*)_args.m_srcImage->m_data
+                                     + _args.m_srcFaceOffsets[hitFaceIdx]
+                                     + yy*pitch
+                                     + xx*bytesPerPixel
+                                     );
+
+                _res[set][0] = dataPtr[0];
+                _res[set][1] = dataPtr[1];
+                _res[set][2] = dataPtr[2];
+            }
+        }
+    }
+
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+    /// Same as radianceSweepFilterArea() but reads normals and colors from SoA planes the way processFilterRectSoa() does.
+    /// Each 4-texel group is loaded once, sets only add their lobe weights and accumulators.
+    static void radianceSweepFilterAreaSoa(float (*_res)[3]
+                                         , const RadianceSweepMipArgs& _args
+                                         , const float* _tapVec
+                                         , Aabb _filterArea[6]
+                                         , const int32_t (*_setBounds)[6][4]
+                                         )
+    {
+        using namespace bx;
+
+        const SoaCubemap* normals = _args.m_normalsSoa;
+        const SoaCubemap* colors = _args.m_colorsSoa;
+        const uint8_t numSets = _args.m_numSets;
+        const int32_t border = int32_t(normals->m_border);
+        const float faceSize_MinusOne = float(int32_t(normals->m_faceSize-1));
+        const float cosAngle = _args.m_cosAngle;
+        const float sinAngle = sqrtf(max(0.0f, 1.0f - cosAngle*cosAngle));
+
+        const float4_t tapX  = float4_splat(_tapVec[0]*SoaNormalRow::snormScale());
+        const float4_t tapY  = float4_splat(_tapVec[1]*SoaNormalRow::snormScale());
+        const float4_t tapZ  = float4_splat(_tapVec[2]*SoaNormalRow::snormScale());
+        const float4_t angle = float4_splat(cosAngle);
+        const float4_t lane  = float4_ld(0.0f, 1.0f, 2.0f, 3.0f);
+
+        float4_t sum[CMFT_RADIANCE_SWEEP_MAX_SETS][4];
+        for (uint8_t set = 0; set < numSets; ++set)
+        {
+            sum[set][0] = float4_zero();
+            sum[set][1] = float4_zero();
+            sum[set][2] = float4_zero();
+            sum[set][3] = float4_zero();
+        }
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_filterArea[face].isEmpty())
+            {
+                continue;
+            }
+
+            const int32_t minX = int32_t(uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne));
+            const int32_t maxX = int32_t(uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne));
+            const int32_t minY = int32_t(uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne));
+            const int32_t maxY = int32_t(uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne));
+
+            // Blocks are counted from the start of the guard band, which is a multiple of 4 texels.
+            const uint32_t lastBlockX = uint32_t(maxX + border)/CMFT_NORMAL_CONE_BLOCK_SIZE;
+            const uint32_t lastBlockY = uint32_t(maxY + border)/CMFT_NORMAL_CONE_BLOCK_SIZE;
+
+            for (uint32_t blockY = uint32_t(minY + border)/CMFT_NORMAL_CONE_BLOCK_SIZE; blockY <= lastBlockY; ++blockY)
+            {
+                const int32_t blockBeginY = int32_t(blockY*CMFT_NORMAL_CONE_BLOCK_SIZE) - border;
+                const int32_t yBegin = max(minY, blockBeginY);
+                const int32_t yEnd   = min(maxY, blockBeginY + CMFT_NORMAL_CONE_BLOCK_SIZE-1);
+
+                const float* rowCones = normals->coneRow(face, blockY);
+                const float* rowBlockMax = colors->blockMaxRow(face, blockY);
+
+                for (uint32_t blockX = uint32_t(minX + border)/CMFT_NORMAL_CONE_BLOCK_SIZE; blockX <= lastBlockX; ++blockX)
+                {
+                    // Blocks outside of the widest specular angle are outside of all of them.
+                    if (normalConeOutside(&rowCones[blockX*4], _tapVec, cosAngle, sinAngle))
+                    {
+                        continue;
+                    }
+
+                    // Merge following blocks that are not skipped into a single span.
+                    const uint32_t firstBlockX = blockX;
+                    while (blockX < lastBlockX
+                       && !normalConeOutside(&rowCones[(blockX+1)*4], _tapVec, cosAngle, sinAngle))
+                    {
+                        ++blockX;
+                    }
+
+                    // Spans start and end on block boundaries, so 4-texel groups never straddle a skipped block.
+                    const int32_t spanBegin = max(minX, int32_t(firstBlockX*CMFT_NORMAL_CONE_BLOCK_SIZE) - border)&~int32_t(3);
+                    const int32_t spanEnd   = min(maxX, int32_t(blockX*CMFT_NORMAL_CONE_BLOCK_SIZE + CMFT_NORMAL_CONE_BLOCK_SIZE-1) - border);
+
+                    const float* spanBlockMax = soaSpanBlockMax(rowBlockMax, firstBlockX, blockX);
+
+                    // Rows are only contiguous within a tile, see processFilterRectRowSoa().
+                    for (int32_t xBegin = spanBegin; xBegin <= spanEnd;)
+                    {
+                        const int32_t xEnd = min(spanEnd, colors->tileLastX(xBegin));
+
+                        for (int32_t yy = yBegin; yy <= yEnd; ++yy)
+                        {
+                            const uint32_t spanSets = radianceSweepSpanSets(_setBounds, numSets, face, yy, xBegin, xEnd);
+                            if (0 == spanSets)
+                            {
+                                continue;
+                            }
+
+                            const SoaNormalRow normalRow(normals, face, xBegin, yy);
+                            const float* rr = colors->row(face, 0, xBegin, yy);
+                            const float* gg = colors->row(face, 1, xBegin, yy);
+                            const float* bb = colors->row(face, 2, xBegin, yy);
+
+                            for (int32_t xx = xBegin; xx <= xEnd; xx += 4)
+                            {
+                                const float4_t dot = normalRow.dot4(xx, tapX, tapY, tapZ);
+                                if (!float4_test_any_xyzw(float4_cmpge(dot, angle)))
+                                {
+                                    continue;
+                                }
+
+                                // Colors of black blocks are not read, see soaAccumulate4().
+                                const bool black = soaBlockBlack(spanBlockMax, xx, border);
+                                const float4_t solidAngle = normalRow.solidAngle4(xx);
+                                const float4_t red   = black ? float4_zero() : float4_ld(&rr[xx]);
+                                const float4_t green = black ? float4_zero() : float4_ld(&gg[xx]);
+                                const float4_t blue  = black ? float4_zero() : float4_ld(&bb[xx]);
+
+                                for (uint8_t set = 0; set < numSets; ++set)
+                                {
+                                    const int32_t* bounds = _setBounds[set][face];
+                                    if (0 == (spanSets & (UINT32_C(1)<<set))
+                                    ||  xx+3 < bounds[0]
+                                    ||  xx > bounds[1])
+                                    {
+                                        continue;
+                                    }
+
+                                    float4_t mask = float4_cmpge(dot, float4_splat(_args.m_cosAngles[set]));
+
+                                    // Mask out texels outside of the filter area of the set.
+                                    if (xx < bounds[0] || xx+3 > bounds[1])
+                                    {
+                                        const float4_t idx = float4_add(float4_splat(float(xx)), lane);
+                                        mask = float4_and(mask, float4_and(float4_cmpge(idx, float4_splat(float(bounds[0])))
+                                                                         , float4_cmple(idx, float4_splat(float(bounds[1])))
+                                                                         ));
+                                    }
+
+                                    if (!float4_test_any_xyzw(mask))
+                                    {
+                                        continue;
+                                    }
+
+#if CMFT_RADIANCE_LOBE_TABLE
+                                    const float4_t ww = float4_and(mask, float4_mul(solidAngle, _args.m_lobeTables[set].weight4(dot)));
+#else
+                                    const float4_t ww = float4_and(mask, float4_mul(solidAngle, float4_pow(dot, float4_splat(_args.m_specularPower[set]))));
+#endif // CMFT_RADIANCE_LOBE_TABLE
+                                    sum[set][3] = float4_add(sum[set][3], ww);
+                                    if (!black)
+                                    {
+                                        sum[set][0] = float4_madd(red,   ww, sum[set][0]);
+                                        sum[set][1] = float4_madd(green, ww, sum[set][1]);
+                                        sum[set][2] = float4_madd(blue,  ww, sum[set][2]);
+                                    }
+                                }
+                            }
+                        }
+
+                        xBegin = xEnd+1;
+                    }
+                }
+            }
+        }
+
+        for (uint8_t set = 0; set < numSets; ++set)
+        {
+            processFilterResolveSoa<false>(_res[set], sum[set], _tapVec, colors);
+        }
+    }
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+    /// Filters destination texel _xx, _yy of _face for all sets of the mip.
+    static void radianceSweepTexel(const RadianceSweepMipArgs& _args, uint8_t _face, uint32_t _xx, uint32_t _yy)
+    {
+        const uint32_t mipFaceSize = _args.m_mipFaceSize;
+        const float invFaceSize = 1.0f/float(int32_t(mipFaceSize));
+        const float srcFaceSize_MinusOne = float(int32_t(_args.m_srcImage->m_width-1));
+
+        const float uu = 2.0f*(float(int32_t(_xx))+0.5f)*invFaceSize - 1.0f;
+        const float vv = 2.0f*(float(int32_t(_yy))+0.5f)*invFaceSize - 1.0f;
+
+        float tapVec[3];
+        texelCoordToVec(tapVec, uu, vv, _face, mipFaceSize);
+
+        Aabb facesBb[6];
+        determineFilterArea(facesBb, tapVec, _args.m_filterSize);
+
+        // Texel bounds of the filter area of each set, empty faces get bounds no texel is in.
+        int32_t setBounds[CMFT_RADIANCE_SWEEP_MAX_SETS][6][4];
+        for (uint8_t set = 0; set < _args.m_numSets; ++set)
+        {
+            Aabb setBb[6];
+            determineFilterArea(setBb, tapVec, _args.m_filterSizes[set]);
+            for (uint8_t bbFace = 0; bbFace < 6; ++bbFace)
+            {
+                int32_t* bounds = setBounds[set][bbFace];
+                if (setBb[bbFace].isEmpty())
+                {
+                    bounds[0] = INT32_MAX;
+                    bounds[1] = INT32_MIN;
+                    bounds[2] = INT32_MAX;
+                    bounds[3] = INT32_MIN;
+                    continue;
+                }
+
+                bounds[0] = int32_t(uint32_t(setBb[bbFace].m_min[0] * srcFaceSize_MinusOne));
+                bounds[1] = int32_t(uint32_t(setBb[bbFace].m_max[0] * srcFaceSize_MinusOne));
+                bounds[2] = int32_t(uint32_t(setBb[bbFace].m_min[1] * srcFaceSize_MinusOne));
+                bounds[3] = int32_t(uint32_t(setBb[bbFace].m_max[1] * srcFaceSize_MinusOne));
+            }
+        }
+
+        float color[CMFT_RADIANCE_SWEEP_MAX_SETS][3];
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        radianceSweepFilterAreaSoa(color, _args, tapVec, facesBb, setBounds);
+#else
+        radianceSweepFilterArea(color, _args, tapVec, facesBb, setBounds);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        const uint32_t texel = (_yy*mipFaceSize + _xx)*4;
+        for (uint8_t set = 0; set < _args.m_numSets; ++set)
+        {
+            texelStoreRgb(_args.m_dst[set][_face] + texel, color[set], false);
+        }
+    }
+
+    /// Tasks are bands of CMFT_RADIANCE_TRAVERSAL_BLOCK rows of a face, visited in square blocks as in radianceFilter().
+    static void radianceSweepBands(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceSweepMipArgs* args = (const RadianceSweepMipArgs*)_userData;
+        const uint32_t mipFaceSize = args->m_mipFaceSize;
+        const uint32_t blockSize = (0 != CMFT_RADIANCE_TRAVERSAL_BLOCK) ? CMFT_RADIANCE_TRAVERSAL_BLOCK : mipFaceSize;
+        const uint32_t numBands = (mipFaceSize + blockSize-1)/blockSize;
+
+        for (uint32_t band = _begin; band < _end; ++band)
+        {
+            const uint8_t face = uint8_t(band/numBands);
+            const uint32_t yBegin = (band%numBands)*blockSize;
+            const uint32_t yEnd = min(mipFaceSize, yBegin+blockSize);
+
+            for (uint32_t blockX = 0; blockX < mipFaceSize; blockX += blockSize)
+            {
+                const uint32_t blockXEnd = min(mipFaceSize, blockX+blockSize);
+                for (uint32_t yy = yBegin; yy < yEnd; ++yy)
+                {
+                    for (uint32_t xx = blockX; xx < blockXEnd; ++xx)
+                    {
+                        radianceSweepTexel(*args, face, xx, yy);
+                    }
+                }
+            }
+        }
+    }
+
+    bool imageRadianceFilterSweep(Image* _dst
+                                , const Image& _src
+                                , const RadianceSweepParams* _sets
+                                , uint8_t _numSets
+                                , uint32_t _dstFaceSize
+                                , bool _excludeBase
+                                , uint8_t _mipCount
+                                , bool _useSourcePyramid
+                                , const FilterSettings* _settings
+                                )
+    {
+        const uint64_t entryTime = bx::getHPCounter();
+        const FilterSettings& settings = filterSettings(_settings);
+
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+            return false;
+        }
+
+        if (0 == _numSets
+        ||  _numSets > CMFT_RADIANCE_SWEEP_MAX_SETS)
+        {
+            WARN("Radiance sweep -> %u parameter sets, 1 to %u are supported.", _numSets, CMFT_RADIANCE_SWEEP_MAX_SETS);
+            return false;
+        }
+
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+        imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+        job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+        job.m_normalsSoa.initNormals(job.m_cubemapVectors, imageRgba32f.m_width);
+        soaInitColors(job.m_colorsSoa, imageRgba32f, job.m_srcFaceOffsets);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? imageRgba32f.m_width : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+
+        INFO("Running radiance filter sweep of %u parameter sets:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[dstFaceSize=%u]"
+             , _numSets
+             , imageRgba32f.m_width
+             , _excludeBase ? "true" : "false"
+             , mipCount
+             , dstFaceSize
+             );
+
+        Image results[CMFT_RADIANCE_SWEEP_MAX_SETS];
+        for (uint8_t set = 0; set < _numSets; ++set)
+        {
+            INFO("\t[set %u: glossScale=%u, glossBias=%u, lightingModel=%s]"
+                , set
+                , _sets[set].m_glossScale
+                , _sets[set].m_glossBias
+                , getLightingModelStr(_sets[set].m_lightingModel)
+                );
+
+            Image& result = results[set];
+            result.m_width = dstFaceSize;
+            result.m_height = dstFaceSize;
+            result.m_dataSize = radianceFilterMipTexels(dstFaceSize, 0, mipCount)*bytesPerPixel;
+            result.m_format = TextureFormat::RGBA32F;
+            result.m_numMips = mipCount;
+            result.m_numFaces = CUBE_FACE_NUM;
+            result.m_data = allocTagged(result.m_dataSize, AllocTag::MipChain);
+            MALLOC_CHECK(result.m_data);
+        }
+
+        job.m_dstFaceSize = dstFaceSize;
+        job.m_mipCount = mipCount;
+        imageGetMipOffsets(job.m_dstOffsets, results[0]);
+
+        RadianceSweepMipArgs* args = (RadianceSweepMipArgs*)malloc(sizeof(RadianceSweepMipArgs));
+        MALLOC_CHECK(args);
+
+        const uint8_t mipStart = _excludeBase ? 1 : 0;
+        for (uint8_t set = 0; set < _numSets && _excludeBase; ++set)
+        {
+            job.m_dstData = results[set].m_data;
+            radianceFilterCopyBase(job);
+        }
+
+#if CMFT_RADIANCE_SH_ORDER
+        job.m_shCoeffs = NULL;
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        for (uint8_t mip = mipStart; mip < mipCount; ++mip)
+        {
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+
+            args->m_numSets = 0;
+            args->m_mipFaceSize = mipFaceSize;
+            args->m_filterSize = 0.0f;
+            args->m_cosAngle = 1.0f;
+
+            // Pyramid level fine enough for the narrowest set.
+            uint8_t level = _useSourcePyramid ? UINT8_MAX : 0;
+            for (uint8_t set = 0; set < _numSets; ++set)
+            {
+                float specularPower, filterAngle, cosAngle, filterSize;
+                radianceFilterMipParams(specularPower
+                                      , filterAngle
+                                      , cosAngle
+                                      , filterSize
+                                      , mipFaceSize
+                                      , mip
+                                      , mipCount
+                                      , float(int32_t(_sets[set].m_glossScale))
+                                      , float(int32_t(_sets[set].m_glossBias))
+                                      , _sets[set].m_lightingModel
+                                      , settings.m_lobeTolerance
+                                      );
+
+#if CMFT_RADIANCE_SH_ORDER
+                // Wide lobes are convolved in the SH domain as in imageRadianceFilter(), each set from the same projection.
+                if (radianceFilterShMip(job.m_shLobes[mip], specularPower, cosAngle))
+                {
+                    job.m_dstData = results[set].m_data;
+                    radianceFilterShProject(job);
+                    radianceFilterShEvaluate(job, mip);
+                    continue;
+                }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+                const uint8_t slot = args->m_numSets++;
+                args->m_filterSize = max(args->m_filterSize, filterSize);
+                args->m_cosAngle = min(args->m_cosAngle, cosAngle);
+                args->m_filterSizes[slot] = filterSize;
+                args->m_specularPower[slot] = specularPower;
+                args->m_cosAngles[slot] = cosAngle;
+#if CMFT_RADIANCE_LOBE_TABLE
+                args->m_lobeTables[slot].init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    args->m_dst[slot][face] = (float*)((uint8_t*)results[set].m_data + job.m_dstOffsets[face][mip]);
+                }
+
+                if (_useSourcePyramid)
+                {
+                    level = min(level, radianceFilterSourceLevel(imageRgba32f.m_width, mipFaceSize, filterAngle));
+                }
+            }
+
+            if (0 == args->m_numSets)
+            {
+                continue;
+            }
+
+            args->m_srcImage = &imageRgba32f;
+            args->m_srcFaceOffsets = job.m_srcFaceOffsets;
+            args->m_cubemapVectors = job.m_cubemapVectors;
+            args->m_normalsSoa = &job.m_normalsSoa;
+            args->m_colorsSoa = &job.m_colorsSoa;
+            if (0 != level)
+            {
+                radianceFilterBuildSources(job, level, true);
+
+                const RadianceFilterSource& source = job.m_sources[level];
+                args->m_srcImage = &source.m_image;
+                args->m_srcFaceOffsets = source.m_faceOffsets;
+                args->m_cubemapVectors = source.m_cubemapVectors;
+                args->m_normalsSoa = &source.m_normalsSoa;
+                args->m_colorsSoa = &source.m_colorsSoa;
+            }
+
+            const uint32_t blockSize = (0 != CMFT_RADIANCE_TRAVERSAL_BLOCK) ? CMFT_RADIANCE_TRAVERSAL_BLOCK : mipFaceSize;
+            parallelFor(radianceSweepBands, (void*)args, (mipFaceSize + blockSize-1)/blockSize*CUBE_FACE_NUM);
+        }
+
+        free(args);
+#if CMFT_RADIANCE_SH_ORDER
+        free(job.m_shCoeffs);
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        for (uint8_t set = 0; set < _numSets; ++set)
+        {
+            // Average 1x1 face size.
+            job.m_dstData = results[set].m_data;
+            radianceFilterAverageLastMip(job);
+
+            if (TextureFormat::RGBA32F != _src.m_format)
+            {
+                imageConvert(results[set], (TextureFormat::Enum)_src.m_format);
+            }
+            imageMove(_dst[set], results[set]);
+        }
+
+        // Cleanup.
+        radianceFilterReleaseSources(job);
+        releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+
+        const double toSec = 1.0/double(bx::getHPFrequency());
+        INFO("Radiance sweep -> Done! Total time: %.3f seconds.", double(bx::getHPCounter() - entryTime)*toSec);
+
+        return true;
+    }
+
+    // GGX importance sampling.
+    //-----
+
+    /// Hammersley point _ii of _num, both coordinates in [0.0 .. 1.0) range.
+    static inline void hammersley(float _xi[2], uint32_t _ii, uint32_t _num)
+    {
+        uint32_t bits = _ii;
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & UINT32_C(0x55555555)) << 1) | ((bits & UINT32_C(0xaaaaaaaa)) >> 1);
+        bits = ((bits & UINT32_C(0x33333333)) << 2) | ((bits & UINT32_C(0xcccccccc)) >> 2);
+        bits = ((bits & UINT32_C(0x0f0f0f0f)) << 4) | ((bits & UINT32_C(0xf0f0f0f0)) >> 4);
+        bits = ((bits & UINT32_C(0x00ff00ff)) << 8) | ((bits & UINT32_C(0xff00ff00)) >> 8);
+
+        _xi[0] = float(double(_ii)/double(_num));
+        _xi[1] = float(double(bits) * 2.3283064365386963e-10);
+    }
+
+    /// Light direction in tangent space around N=V=(0,0,1) with its weight (NdotL) and source mip level.
+    struct GgxSample
+    {
+        float m_dir[3];
+        float m_weight;
+        float m_lod;
+        float m_pdf;    //!< Pdf of the direction times the number of samples drawn, for weighting against light samples.
+    };
+
+    /// Source cubemap with full mip chain, sampled with trilinear filtering.
+    /// Filtered importance sampling: each sample reads from the source mip whose texel solid angle matches the sample's solid angle.
+    /// http://http.developer.nvidia.com/GPUGems3/gpugems3_ch20.html
+    static uint32_t ggxBuildSamples(GgxSample* _samples, uint32_t _numSamples, float _alpha, const CubemapSampler& _src)
+    {
+        const double alpha2 = double(_alpha)*double(_alpha);
+        const double srcFaceSize = double(_src.m_faceSize);
+        const double texelSolidAngle = PI4/(6.0*srcFaceSize*srcFaceSize);
+        const float maxLod = float(_src.m_numMips-1);
+
+        uint32_t count = 0;
+        for (uint32_t ii = 0; ii < _numSamples; ++ii)
+        {
+            float xi[2];
+            hammersley(xi, ii, _numSamples);
+
+            // Half vector from GGX distribution.
+            const double phi = 2.0*PI*double(xi[0]);
+            const double cosTheta = sqrt((1.0-double(xi[1])) / (1.0 + (alpha2-1.0)*double(xi[1])));
+            const double sinTheta = sqrt(max(0.0, 1.0 - cosTheta*cosTheta));
+            const double hh[3] = { sinTheta*cos(phi), sinTheta*sin(phi), cosTheta };
+
+            // Reflect V=N around H.
+            const double ll[3] = { 2.0*cosTheta*hh[0], 2.0*cosTheta*hh[1], 2.0*cosTheta*hh[2] - 1.0 };
+            if (ll[2] <= 0.0)
+            {
+                continue;
+            }
+
+            // With N=V, pdf(L) = D(NdotH)*NdotH/(4*VdotH) = D(NdotH)/4.
+            const double dd = (cosTheta*cosTheta)*(alpha2-1.0) + 1.0;
+            const double pdf = alpha2/(PI*dd*dd) * 0.25;
+            const double sampleSolidAngle = 1.0/(double(_numSamples)*pdf + 1e-30);
+            const float lod = float(0.5*log2(sampleSolidAngle/texelSolidAngle) + 1.0);
+
+            GgxSample& sample = _samples[count++];
+            sample.m_dir[0] = float(ll[0]);
+            sample.m_dir[1] = float(ll[1]);
+            sample.m_dir[2] = float(ll[2]);
+            sample.m_weight = float(ll[2]);
+            sample.m_lod = clamp(lod, 0.0f, maxLod);
+            sample.m_pdf = float(double(_numSamples)*pdf);
+        }
+
+        return count;
+    }
+
+    // Environment importance sampling.
+    //-----
+
+    /// Face size of the source mip the light distribution is built from. Bright spots smaller than its texels are
+    /// still found, their energy ends up in the texel holding them.
+#ifndef CMFT_GGX_LIGHT_FACE_SIZE
+    #define CMFT_GGX_LIGHT_FACE_SIZE 64
+#endif // CMFT_GGX_LIGHT_FACE_SIZE
+
+    /// Luminance distribution over texels of one source mip. Directions are picked uniformly in face coordinates
+    /// within the texel, so their pdf over solid angle also depends on the position within the texel.
+    struct GgxLightTable
+    {
+        double* m_cdf;          //!< Cumulative luminance times solid angle, one more entry than texels.
+        float* m_pdf;           //!< Per texel pdf over face coordinates, times the number of light samples.
+        uint32_t m_faceSize;
+        uint8_t m_mip;
+    };
+
+    /// Returns false if the source is black, there is nothing to sample then.
+    static bool ggxBuildLightTable(GgxLightTable& _table, const CubemapSampler& _src, uint32_t _numLightSamples)
+    {
+        uint8_t mip = 0;
+        while (mip+1 < _src.m_numMips && (_src.m_faceSize >> mip) > CMFT_GGX_LIGHT_FACE_SIZE)
+        {
+            ++mip;
+        }
+
+        const uint32_t faceSize = max(UINT32_C(1), _src.m_faceSize >> mip);
+        const uint32_t numTexels = faceSize*faceSize*CUBE_FACE_NUM;
+        const float invFaceSize = 1.0f/float(int32_t(faceSize));
+
+        _table.m_faceSize = faceSize;
+        _table.m_mip = mip;
+        _table.m_cdf = (double*)malloc((numTexels+1)*sizeof(double));
+        MALLOC_CHECK(_table.m_cdf);
+        _table.m_pdf = (float*)malloc(numTexels*sizeof(float));
+        MALLOC_CHECK(_table.m_pdf);
+
+        double sum = 0.0;
+        _table.m_cdf[0] = 0.0;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            const float* texel = _src.m_faces[face][mip];
+            for (uint32_t yy = 0; yy < faceSize; ++yy)
+            {
+                for (uint32_t xx = 0; xx < faceSize; ++xx, texel+=4)
+                {
+                    const uint32_t idx = (face*faceSize + yy)*faceSize + xx;
+                    const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                    const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+
+                    // Rec. 709 luminance.
+                    const float lum = max(0.0f, 0.2126f*texel[0] + 0.7152f*texel[1] + 0.0722f*texel[2]);
+                    sum += double(lum)*double(texelSolidAngle(uu, vv, invFaceSize));
+                    _table.m_cdf[idx+1] = sum;
+                }
+            }
+        }
+
+        if (!(sum > 0.0))
+        {
+            free(_table.m_cdf);
+            free(_table.m_pdf);
+            return false;
+        }
+
+        // Texel is picked with probability lum*solidAngle/sum and spans (2/faceSize)^2 of face coordinates.
+        // Conversion to pdf over solid angle is done in ggxLightPdf() at the actual position.
+        const double scale = double(_numLightSamples)*double(faceSize)*double(faceSize)*0.25/sum;
+        for (uint32_t ii = 0; ii < numTexels; ++ii)
+        {
+            _table.m_pdf[ii] = float((_table.m_cdf[ii+1] - _table.m_cdf[ii])*scale);
+        }
+
+        return true;
+    }
+
+    static void ggxFreeLightTable(GgxLightTable& _table)
+    {
+        free(_table.m_cdf);
+        free(_table.m_pdf);
+    }
+
+    /// Pdf of picking direction _dir, times the number of light samples.
+    static inline float ggxLightPdf(const GgxLightTable& _table, const float _dir[3])
+    {
+        float uu;
+        float vv;
+        uint8_t face;
+        vecToTexelCoord(uu, vv, face, _dir);
+
+        const uint32_t faceSize = _table.m_faceSize;
+        const uint32_t xx = min(uint32_t(uu*float(faceSize)), faceSize-1);
+        const uint32_t yy = min(uint32_t(vv*float(faceSize)), faceSize-1);
+
+        // Projection of the face plane onto the sphere, d(solid angle) = d(area)/(1+u^2+v^2)^(3/2).
+        const float cu = 2.0f*uu - 1.0f;
+        const float cv = 2.0f*vv - 1.0f;
+        const float dd = 1.0f + cu*cu + cv*cv;
+        return _table.m_pdf[(face*faceSize + yy)*faceSize + xx] * dd*sqrtf(dd);
+    }
+
+    /// World space light direction with its pdf times the number of light samples.
+    struct GgxLightSample
+    {
+        float m_dir[3];
+        float m_pdf;
+    };
+
+    /// Light samples do not depend on the filtered texel, so they are picked once for the whole job.
+    static void ggxBuildLightSamples(GgxLightSample* _samples, uint32_t _numSamples, const GgxLightTable& _table)
+    {
+        const uint32_t faceSize = _table.m_faceSize;
+        const uint32_t numTexels = faceSize*faceSize*CUBE_FACE_NUM;
+        const double sum = _table.m_cdf[numTexels];
+        const float texelSize = 2.0f/float(int32_t(faceSize));
+
+        for (uint32_t ii = 0; ii < _numSamples; ++ii)
+        {
+            float xi[2];
+            hammersley(xi, ii, _numSamples);
+
+            // Texel from the first coordinate, the rest of it is reused for the position within the texel.
+            const double target = double(xi[0])*sum;
+            uint32_t lo = 0;
+            uint32_t hi = numTexels;
+            while (lo+1 < hi)
+            {
+                const uint32_t mid = (lo+hi)/2;
+                if (_table.m_cdf[mid] <= target)
+                {
+                    lo = mid;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            const double texelSa = _table.m_cdf[lo+1] - _table.m_cdf[lo];
+            const float fraction = (texelSa > 0.0) ? min(float((target - _table.m_cdf[lo])/texelSa), 0.99999f) : 0.5f;
+
+            const uint8_t face = uint8_t(lo/(faceSize*faceSize));
+            const uint32_t yy = (lo/faceSize)%faceSize;
+            const uint32_t xx = lo%faceSize;
+            const float uu = (float(int32_t(xx)) + fraction)*texelSize - 1.0f;
+            const float vv = (float(int32_t(yy)) + xi[1])*texelSize - 1.0f;
+
+            GgxLightSample& sample = _samples[ii];
+            texelCoordToVec(sample.m_dir, uu, vv, face);
+            sample.m_pdf = ggxLightPdf(_table, sample.m_dir);
+        }
+    }
+
+    struct GgxFilterArgs
+    {
+        float* m_dst[CUBE_FACE_NUM];
+        const GgxSample* m_samples;
+        uint32_t m_numSamples;
+        uint32_t m_faceSize;
+        const CubemapSampler* m_src;
+        const GgxLightTable* m_lightTable; //!< NULL without light samples.
+        const GgxLightSample* m_lightSamples;
+        uint32_t m_numLightSamples;
+        float m_alpha2;
+        float m_numDrawn;                  //!< GGX samples drawn, including the ones below the horizon.
+    };
+
+    // Rows of all faces of one mip are processed as one range.
+    static void ggxFilterRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const GgxFilterArgs* args = (const GgxFilterArgs*)_userData;
+        const uint32_t faceSize = args->m_faceSize;
+        const float invFaceSize = 1.0f/float(int32_t(faceSize));
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(row / faceSize);
+            const uint32_t yy = row % faceSize;
+            float* dstPtr = args->m_dst[face] + yy*faceSize*4;
+
+            for (uint32_t xx = 0; xx < faceSize; ++xx, dstPtr+=4)
+            {
+                const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+
+                float nn[3];
+                texelCoordToVec(nn, uu, vv, face, faceSize);
+
+                // Tangent frame around N.
+                const float up[3] = { 0.0f, 0.0f, 1.0f };
+                const float right[3] = { 1.0f, 0.0f, 0.0f };
+                float txUnorm[3];
+                vec3Cross(txUnorm, (fabsf(nn[2]) < 0.999f) ? up : right, nn);
+                float tx[3];
+                vec3Norm(tx, txUnorm);
+                float ty[3];
+                vec3Cross(ty, nn, tx);
+
+                float color[3] = { 0.0f, 0.0f, 0.0f };
+                float weight = 0.0f;
+                for (uint32_t ii = 0; ii < args->m_numSamples; ++ii)
+                {
+                    const GgxSample& sample = args->m_samples[ii];
+                    const float ll[3] =
+                    {
+                        tx[0]*sample.m_dir[0] + ty[0]*sample.m_dir[1] + nn[0]*sample.m_dir[2],
+                        tx[1]*sample.m_dir[0] + ty[1]*sample.m_dir[1] + nn[1]*sample.m_dir[2],
+                        tx[2]*sample.m_dir[0] + ty[2]*sample.m_dir[1] + nn[2]*sample.m_dir[2],
+                    };
+
+                    // Balance heuristic against light samples. Blurred lookups spread bright texels into directions the
+                    // weights don't account for, so with light samples both strategies read the base mip.
+                    float sampleWeight = sample.m_weight;
+                    float lod = sample.m_lod;
+                    if (NULL != args->m_lightTable)
+                    {
+                        const float lightPdf = ggxLightPdf(*args->m_lightTable, ll);
+                        sampleWeight /= 1.0f + lightPdf/sample.m_pdf;
+                        lod = 0.0f;
+                    }
+
+                    float rgb[4];
+                    cubemapSamplerSample(rgb, *args->m_src, ll, lod);
+                    color[0] += rgb[0]*sampleWeight;
+                    color[1] += rgb[1]*sampleWeight;
+                    color[2] += rgb[2]*sampleWeight;
+                    weight += sampleWeight;
+                }
+
+                // Light samples are weighted the same way as GGX ones, NdotL times GGX pdf over the sum of pdfs.
+                // With N=V, NdotH^2 = (1+NdotL)/2.
+                for (uint32_t ii = 0; ii < args->m_numLightSamples; ++ii)
+                {
+                    const GgxLightSample& sample = args->m_lightSamples[ii];
+                    const float nDotL = vec3Dot(nn, sample.m_dir);
+                    if (nDotL <= 0.0f)
+                    {
+                        continue;
+                    }
+
+                    const float alpha2 = args->m_alpha2;
+                    const float dd = (0.5f + 0.5f*nDotL)*(alpha2-1.0f) + 1.0f;
+                    const float ggxPdf = args->m_numDrawn*alpha2/(float(PI)*dd*dd) * 0.25f;
+                    const float sampleWeight = nDotL/(1.0f + sample.m_pdf/ggxPdf);
+
+                    float rgb[4];
+                    cubemapSamplerSample(rgb, *args->m_src, sample.m_dir, 0.0f);
+                    color[0] += rgb[0]*sampleWeight;
+                    color[1] += rgb[1]*sampleWeight;
+                    color[2] += rgb[2]*sampleWeight;
+                    weight += sampleWeight;
+                }
+
+                const float invWeight = (0.0f != weight) ? 1.0f/weight : 0.0f;
+                dstPtr[0] = color[0]*invWeight;
+                dstPtr[1] = color[1]*invWeight;
+                dstPtr[2] = color[2]*invWeight;
+                dstPtr[3] = 1.0f;
+            }
+        }
+    }
+
+    bool imageRadianceFilterGgx(Image& _dst
+                              , uint32_t _dstFaceSize
+                              , bool _excludeBase
+                              , uint8_t _mipCount
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , uint32_t _numSamples
+                              , const Image& _src
+                              , uint32_t _numLightSamples
+                              , const RadianceFilterQuality* _quality
+                              )
+    {
+        // Input image must be a cubemap.
+        if (!imageIsCubemap(_src))
+        {
+            WARN("Image is not cubemap.");
+
+            return false;
+        }
+
+        if (0 == _numSamples)
+        {
+            WARN("GGX filter requires at least one sample.");
+
+            return false;
+        }
+
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+
+        // Alloc dst data.
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? imageRgba32f.m_width : _dstFaceSize;
+        const uint8_t mipMin = 1;
+        const uint8_t mipMax = (uint8_t)log2f(float(int32_t(dstFaceSize)))+uint8_t(1);
+        const uint8_t mipCount = clamp(_mipCount, mipMin, mipMax);
+        uint64_t dstDataSize = 0;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            for (uint8_t mip = 0; mip < mipCount; ++mip)
+            {
+                job.m_dstOffsets[face][mip] = dstDataSize;
+                uint32_t faceSize = max(uint32_t(1), dstFaceSize >> mip);
+                dstDataSize += uint64_t(faceSize) * faceSize * bytesPerPixel;
+            }
+        }
+        job.m_dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+        MALLOC_CHECK(job.m_dstData);
+        job.m_dstDataSize = dstDataSize;
+        job.m_dstFaceSize = dstFaceSize;
+        job.m_mipCount = mipCount;
+        imageGetFaceOffsets(job.m_srcFaceOffsets, imageRgba32f);
+
+        // Output info.
+        INFO("Running GGX radiance filter for:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[numSamples=%u]"
+             "\n\t[numLightSamples=%u]"
+             "\n\t[dstFaceSize=%u]"
+             , imageRgba32f.m_width
+             , &"false\0true"[6*_excludeBase]
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , _numSamples
+             , _numLightSamples
+             , dstFaceSize
+             );
+
+        // Resize and copy base image.
+        if (_excludeBase)
+        {
+            radianceFilterCopyBase(job);
+        }
+
+        // Source mip chain for filtered lookups.
+        Image srcMips;
+        imageCopy(srcMips, imageRgba32f);
+        imageGenerateMipMapChain(srcMips);
+
+        CubemapSampler src;
+        cubemapSamplerInit(src, srcMips);
+
+        // Mips of _quality take at most _numSamples.
+        GgxSample* samples = (GgxSample*)malloc(_numSamples*sizeof(GgxSample));
+        MALLOC_CHECK(samples);
+
+        // Light samples are picked from the source luminance once and shared by all mips.
+        GgxLightTable lightTable;
+        GgxLightSample* lightSamples = NULL;
+        uint32_t numLightSamples = 0;
+        if (0 != _numLightSamples
+        &&  ggxBuildLightTable(lightTable, src, _numLightSamples))
+        {
+            lightSamples = (GgxLightSample*)malloc(_numLightSamples*sizeof(GgxLightSample));
+            MALLOC_CHECK(lightSamples);
+            ggxBuildLightSamples(lightSamples, _numLightSamples, lightTable);
+            numLightSamples = _numLightSamples;
+        }
+
+        const uint64_t startTime = bx::getHPCounter();
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        for (uint8_t mip = uint8_t(_excludeBase); mip < mipCount; ++mip)
+        {
+            // Same glossiness distribution as the radiance filter.
+            // Phong specular power is converted to GGX roughness with alpha = sqrt(2/(n+2)).
+            const float glossiness = (mipCount == 1)
+                                   ? 1.0f
+                                   : max(0.0f, 1.0f - (float)(int32_t)mip/(float)(int32_t)(mipCount-1))
+                                   ;
+            const float specularPower = powf(2.0f, glossScalef * glossiness + glossBiasf);
+            const float alpha = sqrtf(2.0f/(specularPower+2.0f));
+            const uint32_t numSamples = (NULL != _quality && mip < _quality->m_mipCount && 0 != _quality->m_mipNumSamples[mip])
+                                      ? min(_quality->m_mipNumSamples[mip], _numSamples)
+                                      : _numSamples
+                                      ;
+
+            GgxFilterArgs args;
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                args.m_dst[face] = (float*)((uint8_t*)job.m_dstData + job.m_dstOffsets[face][mip]);
+            }
+            args.m_samples = samples;
+            args.m_numSamples = ggxBuildSamples(samples, numSamples, alpha, src);
+            args.m_faceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            args.m_src = &src;
+            args.m_lightTable = (0 != numLightSamples) ? &lightTable : NULL;
+            args.m_lightSamples = lightSamples;
+            args.m_numLightSamples = numLightSamples;
+            args.m_alpha2 = alpha*alpha;
+            args.m_numDrawn = float(numSamples);
+            parallelFor(ggxFilterRows, (void*)&args, args.m_faceSize*CUBE_FACE_NUM);
+
+            INFO("Radiance -> Mip %u [roughness=%.3f, samples=%u] done.", mip, alpha, numSamples);
+        }
+
+        // Average 1x1 face size.
+        radianceFilterAverageLastMip(job);
+
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+        INFO("Radiance -> Total time: %.3f seconds.", double(bx::getHPCounter() - startTime)*toSec);
+
+        // Cleanup.
+        free(samples);
+        if (0 != numLightSamples)
+        {
+            free(lightSamples);
+            ggxFreeLightTable(lightTable);
+        }
+        cubemapSamplerFree(src);
+        imageUnload(srcMips);
+
+        const TextureFormat::Enum srcFormat = (TextureFormat::Enum)_src.m_format;
+        if (!job.m_imageIsRef)
+        {
+            imageUnload(job.m_imageRgba32f);
+        }
+
+        // Fill result structure.
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = mipCount;
+        result.m_numFaces = 6;
+        result.m_data = job.m_dstData;
+
+        // Convert back to source format.
+        if (TextureFormat::RGBA32F == srcFormat)
+        {
+            imageMove(_dst, result);
+        }
+        else
+        {
+            imageConvert(result, srcFormat);
+            imageMove(_dst, result);
+        }
+
+        return true;
+    }
+
+    void imageRadianceFilterGgx(Image& _image
+                              , uint32_t _dstFaceSize
+                              , bool _excludeBase
+                              , uint8_t _mipCount
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , uint32_t _numSamples
+                              , uint32_t _numLightSamples
+                              , const RadianceFilterQuality* _quality
+                              )
+    {
+        Image tmp;
+        if (imageRadianceFilterGgx(tmp, _dstFaceSize, _excludeBase, _mipCount, _glossScale, _glossBias, _numSamples, _image, _numLightSamples, _quality))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    // Analytic lights.
+    //-----
+
+    /// Texels above the threshold join a light whose brightest texel is within this angle, in radians.
+#ifndef CMFT_LIGHT_CLUSTER_ANGLE
+    #define CMFT_LIGHT_CLUSTER_ANGLE 0.1f
+#endif // CMFT_LIGHT_CLUSTER_ANGLE
+
+    /// Most lights imageExtractLights() takes out of a cubemap.
+#ifndef CMFT_LIGHT_MAX_EXTRACT
+    #define CMFT_LIGHT_MAX_EXTRACT 16
+#endif // CMFT_LIGHT_MAX_EXTRACT
+
+    /// Directions a disk light is integrated over, spread evenly over its solid angle.
+#ifndef CMFT_LIGHT_DISK_SAMPLES
+    #define CMFT_LIGHT_DISK_SAMPLES 32
+#endif // CMFT_LIGHT_DISK_SAMPLES
+
+    /// Most directions a disk light is spread over texels with, see lightSplat().
+#ifndef CMFT_LIGHT_MAX_SPLAT_SAMPLES
+    #define CMFT_LIGHT_MAX_SPLAT_SAMPLES 65536
+#endif // CMFT_LIGHT_MAX_SPLAT_SAMPLES
+
+    static inline float lightLuminance(const float* _rgb)
+    {
+        return 0.2126f*_rgb[0] + 0.7152f*_rgb[1] + 0.0722f*_rgb[2];
+    }
+
+    /// Solid angle of the disk of _light.
+    static inline float lightSolidAngle(const CubemapLight& _light)
+    {
+        return 2.0f*float(M_PI)*(1.0f - cosf(min(_light.m_angle, float(M_PI))));
+    }
+
+    /// _numDirs directions spread evenly over the disk of _light, on a spiral of equal solid angle steps.
+    static void lightDirs(float (*_dirs)[3], uint32_t _numDirs, const CubemapLight& _light)
+    {
+        float dir[3];
+        vec3Norm(dir, _light.m_dir);
+
+        if (1 == _numDirs)
+        {
+            memcpy(_dirs[0], dir, sizeof(dir));
+            return;
+        }
+
+        // Tangent frame around the light direction.
+        const float up[3] = { 0.0f, 0.0f, 1.0f };
+        const float right[3] = { 1.0f, 0.0f, 0.0f };
+        float txUnorm[3];
+        vec3Cross(txUnorm, (fabsf(dir[2]) < 0.999f) ? up : right, dir);
+        float tx[3];
+        vec3Norm(tx, txUnorm);
+        float ty[3];
+        vec3Cross(ty, dir, tx);
+
+        const float cosAngle = cosf(min(_light.m_angle, float(M_PI)));
+        const float goldenAngle = 2.39996323f;
+        for (uint32_t ii = 0; ii < _numDirs; ++ii)
+        {
+            const float uu = (float(int32_t(ii))+0.5f)/float(int32_t(_numDirs));
+            const float cosTheta = 1.0f - uu*(1.0f - cosAngle);
+            const float sinTheta = sqrtf(max(0.0f, 1.0f - cosTheta*cosTheta));
+            const float phi = float(int32_t(ii))*goldenAngle;
+            const float xx = cosf(phi)*sinTheta;
+            const float yy = sinf(phi)*sinTheta;
+
+            _dirs[ii][0] = tx[0]*xx + ty[0]*yy + dir[0]*cosTheta;
+            _dirs[ii][1] = tx[1]*xx + ty[1]*yy + dir[1]*cosTheta;
+            _dirs[ii][2] = tx[2]*xx + ty[2]*yy + dir[2]*cosTheta;
+        }
+    }
+
+    /// Directions of _light together with the share of its color each of them carries. Returns their count, free with free().
+    static uint32_t lightSamples(float (*&_dirs)[3], float (*&_colors)[3], const CubemapLight* _lights, uint32_t _numLights, float _pointAngle)
+    {
+        uint32_t numSamples = 0;
+        for (uint32_t ii = 0; ii < _numLights; ++ii)
+        {
+            numSamples += (_lights[ii].m_angle > _pointAngle) ? CMFT_LIGHT_DISK_SAMPLES : 1;
+        }
+
+        _dirs = (float(*)[3])malloc(numSamples*2*sizeof(float[3]));
+        MALLOC_CHECK(_dirs);
+        _colors = _dirs + numSamples;
+
+        uint32_t sample = 0;
+        for (uint32_t ii = 0; ii < _numLights; ++ii)
+        {
+            const uint32_t num = (_lights[ii].m_angle > _pointAngle) ? CMFT_LIGHT_DISK_SAMPLES : 1;
+            lightDirs(_dirs + sample, num, _lights[ii]);
+
+            const float share = 1.0f/float(int32_t(num));
+            for (uint32_t jj = 0; jj < num; ++jj, ++sample)
+            {
+                _colors[sample][0] = _lights[ii].m_color[0]*share;
+                _colors[sample][1] = _lights[ii].m_color[1]*share;
+                _colors[sample][2] = _lights[ii].m_color[2]*share;
+            }
+        }
+
+        return numSamples;
+    }
+
+    struct TexelLuminance
+    {
+        float m_luminance;
+        uint32_t m_texel;
+    };
+
+    static int texelLuminanceCompare(const void* _a, const void* _b)
+    {
+        const float aa = ((const TexelLuminance*)_a)->m_luminance;
+        const float bb = ((const TexelLuminance*)_b)->m_luminance;
+        return (aa > bb) ? -1 : (aa < bb) ? 1 : 0;
+    }
+
+    uint32_t imageExtractLights(CubemapLight* _lights, uint32_t _maxLights, Image& _image, float _threshold)
+    {
+        if (!imageIsCubemap(_image))
+        {
+            WARN("Image is not cubemap.");
+            return 0;
+        }
+
+        if (0 == _maxLights)
+        {
+            return 0;
+        }
+
+        const TextureFormat::Enum format = (TextureFormat::Enum)_image.m_format;
+        imageConvert(_image, TextureFormat::RGBA32F);
+
+        const uint32_t faceSize = _image.m_width;
+        const uint32_t faceTexels = faceSize*faceSize;
+        uint64_t faceOffsets[CUBE_FACE_NUM];
+        imageGetFaceOffsets(faceOffsets, _image);
+
+        const float* cubemapVectors = acquireCubemapNormalSolidAngle(faceSize);
+        ScopeReleaseNormalSolidAngle cleanup(cubemapVectors);
+
+        // Mean luminance over the sphere.
+        double sum = 0.0;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            const float* data = (const float*)((const uint8_t*)_image.m_data + faceOffsets[face]);
+            const float* vectors = cubemapVectors + size_t(face)*faceTexels*4;
+            for (uint32_t ii = 0; ii < faceTexels; ++ii)
+            {
+                sum += double(lightLuminance(&data[ii*4]))*double(vectors[ii*4+3]);
+            }
+        }
+        const float threshold = _threshold*float(sum/(4.0*M_PI));
+
+        // Texels above the threshold, brightest first.
+        uint32_t numCandidates = 0;
+        uint32_t maxCandidates = 0;
+        TexelLuminance* candidates = NULL;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM && 0.0f < threshold; ++face)
+        {
+            const float* data = (const float*)((const uint8_t*)_image.m_data + faceOffsets[face]);
+            for (uint32_t ii = 0; ii < faceTexels; ++ii)
+            {
+                const float luminance = lightLuminance(&data[ii*4]);
+                if (luminance > threshold)
+                {
+                    if (numCandidates == maxCandidates)
+                    {
+                        maxCandidates = max(UINT32_C(256), maxCandidates*2);
+                        candidates = (TexelLuminance*)realloc(candidates, maxCandidates*sizeof(TexelLuminance));
+                        MALLOC_CHECK(candidates);
+                    }
+
+                    candidates[numCandidates].m_luminance = luminance;
+                    candidates[numCandidates].m_texel = face*faceTexels + ii;
+                    numCandidates++;
+                }
+            }
+        }
+        qsort(candidates, numCandidates, sizeof(TexelLuminance), texelLuminanceCompare);
+
+        // Brightest texel of each light seeds it, excess over the threshold is moved to the light.
+        float seeds[CMFT_LIGHT_MAX_EXTRACT][3];
+        float solidAngles[CMFT_LIGHT_MAX_EXTRACT];
+        const uint32_t maxLights = min(_maxLights, uint32_t(CMFT_LIGHT_MAX_EXTRACT));
+        const float cosCluster = cosf(CMFT_LIGHT_CLUSTER_ANGLE);
+        uint32_t numLights = 0;
+        for (uint32_t ii = 0; ii < numCandidates; ++ii)
+        {
+            const uint32_t texel = candidates[ii].m_texel;
+            const float* vec = cubemapVectors + size_t(texel)*4;
+
+            uint32_t light = 0;
+            while (light < numLights
+               &&  vec3Dot(seeds[light], vec) < cosCluster)
+            {
+                light++;
+            }
+
+            if (light == numLights)
+            {
+                if (numLights == maxLights)
+                {
+                    continue;
+                }
+
+                memcpy(seeds[light], vec, 3*sizeof(float));
+                memset(&_lights[light], 0, sizeof(CubemapLight));
+                solidAngles[light] = 0.0f;
+                numLights++;
+            }
+
+            const uint8_t face = uint8_t(texel/faceTexels);
+            float* rgb = (float*)((uint8_t*)_image.m_data + faceOffsets[face]) + (texel%faceTexels)*4;
+            const float scale = threshold/candidates[ii].m_luminance;
+            const float solidAngle = vec[3];
+            const float excess = (candidates[ii].m_luminance - threshold)*solidAngle;
+
+            CubemapLight& dst = _lights[light];
+            dst.m_color[0] += rgb[0]*(1.0f - scale)*solidAngle;
+            dst.m_color[1] += rgb[1]*(1.0f - scale)*solidAngle;
+            dst.m_color[2] += rgb[2]*(1.0f - scale)*solidAngle;
+            dst.m_dir[0] += vec[0]*excess;
+            dst.m_dir[1] += vec[1]*excess;
+            dst.m_dir[2] += vec[2]*excess;
+            solidAngles[light] += solidAngle;
+
+            rgb[0] *= scale;
+            rgb[1] *= scale;
+            rgb[2] *= scale;
+        }
+
+        for (uint32_t ii = 0; ii < numLights; ++ii)
+        {
+            CubemapLight& light = _lights[ii];
+            float dir[3];
+            vec3Norm(dir, light.m_dir);
+            memcpy(light.m_dir, dir, sizeof(dir));
+            light.m_angle = acosf(max(-1.0f, 1.0f - solidAngles[ii]/(2.0f*float(M_PI))));
+
+            INFO("Lights -> Light %u: [dir=%.3f %.3f %.3f] [color=%g %g %g] [angle=%.3f deg]"
+                , ii
+                , light.m_dir[0], light.m_dir[1], light.m_dir[2]
+                , light.m_color[0], light.m_color[1], light.m_color[2]
+                , light.m_angle*180.0f/float(M_PI)
+                );
+        }
+
+        free(candidates);
+        imageConvert(_image, format);
+
+        return numLights;
+    }
+
+    void shAddLights(double _shCoeffs[SH_COEFF_NUM][3], const CubemapLight* _lights, uint32_t _numLights)
+    {
+        float (*dirs)[3];
+        float (*colors)[3];
+        const uint32_t numSamples = lightSamples(dirs, colors, _lights, _numLights, 0.0f);
+
+        for (uint32_t ii = 0; ii < numSamples; ++ii)
+        {
+            double shBasis[SH_COEFF_NUM];
+            evalSHBasis<5>(shBasis, dirs[ii]);
+
+            for (uint8_t jj = 0; jj < SH_COEFF_NUM; ++jj)
+            {
+                _shCoeffs[jj][0] += double(colors[ii][0])*shBasis[jj];
+                _shCoeffs[jj][1] += double(colors[ii][1])*shBasis[jj];
+                _shCoeffs[jj][2] += double(colors[ii][2])*shBasis[jj];
+            }
+        }
+
+        free(dirs);
+    }
+
+    /// Adds RGBA32F faces of _add to mip _mip of RGBA32F cubemap _image.
+    static void lightAddFaces(Image& _image, uint8_t _mip, const float* _add, uint32_t _faceSize)
+    {
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, _image);
+
+        const uint32_t faceTexels = _faceSize*_faceSize;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            float* dst = (float*)((uint8_t*)_image.m_data + offsets[face][_mip]);
+            const float* add = _add + size_t(face)*faceTexels*4;
+            for (uint32_t ii = 0; ii < faceTexels*4; ii += 4)
+            {
+                dst[ii+0] += add[ii+0];
+                dst[ii+1] += add[ii+1];
+                dst[ii+2] += add[ii+2];
+            }
+        }
+    }
+
+    bool imageIrradianceAddLights(Image& _image, const CubemapLight* _lights, uint32_t _numLights, uint8_t _shOrder)
+    {
+        if (!imageIsCubemap(_image))
+        {
+            WARN("Image is not cubemap.");
+            return false;
+        }
+
+        if (!shOrderIsValid(_shOrder))
+        {
+            WARN("Spherical harmonics order %u is not supported. Supported orders are 2, 3 and 5.", _shOrder);
+            return false;
+        }
+
+        double shCoeffs[SH_COEFF_NUM][3];
+        memset(shCoeffs, 0, sizeof(shCoeffs));
+        shAddLights(shCoeffs, _lights, _numLights);
+
+        FilterStats stats;
+        Image irradiance;
+        irradianceShEval(irradiance, shCoeffs, _shOrder, _image.m_width, NULL, stats);
+
+        const TextureFormat::Enum format = (TextureFormat::Enum)_image.m_format;
+        imageConvert(_image, TextureFormat::RGBA32F);
+        lightAddFaces(_image, 0, (const float*)irradiance.m_data, _image.m_width);
+        imageConvert(_image, format);
+
+        imageUnload(irradiance);
+
+        return true;
+    }
+
+    /// Adds light samples to faces of _faceSize as radiance of the texels they fall into.
+    static void lightSplat(float* _dst, uint32_t _faceSize, const CubemapLight* _lights, uint32_t _numLights)
     {
-        ///   ______
-        ///  |      |
-        ///  |      |
-        ///  |    x |
-        ///  |______|
-        ///
-        // Get face and hit coordinates.
-        float uu, vv;
-        uint8_t hitFaceIdx;
-        vecToTexelCoord(uu, vv, hitFaceIdx, _tapVec);
+        const float invFaceSize = 1.0f/float(int32_t(_faceSize));
+        const float texelSolidAngleMean = 4.0f*float(M_PI)/(6.0f*float(int32_t(_faceSize))*float(int32_t(_faceSize)));
 
-        ///  ........
-        ///  .      .
-        ///  .   ___.
-        ///  .  | x |
-        ///  ...|___|
-        ///
-        // Calculate hit face filter bounds.
-        Aabb hitFaceFilterBounds;
-        hitFaceFilterBounds.add(uu-_filterSize, vv-_filterSize);
-        hitFaceFilterBounds.add(uu+_filterSize, vv+_filterSize);
-        hitFaceFilterBounds.clamp(0.0f, 1.0f);
+        for (uint32_t ii = 0; ii < _numLights; ++ii)
+        {
+            // Enough directions for a few per texel the disk covers.
+            const float texels = 4.0f*lightSolidAngle(_lights[ii])/texelSolidAngleMean;
+            const uint32_t numDirs = (0.0f < _lights[ii].m_angle)
+                                   ? uint32_t(min(max(texels, float(CMFT_LIGHT_DISK_SAMPLES)), float(CMFT_LIGHT_MAX_SPLAT_SAMPLES)))
+                                   : 1
+                                   ;
 
-        // Output result for hit face.
-        DEBUG_CHECK(6 > hitFaceIdx, "Face idx should be in range 0-5");
-        memcpy(&_filterArea[hitFaceIdx], &hitFaceFilterBounds, sizeof(Aabb));
+            float (*dirs)[3] = (float(*)[3])malloc(numDirs*sizeof(float[3]));
+            MALLOC_CHECK(dirs);
+            lightDirs(dirs, numDirs, _lights[ii]);
 
-        /// Filter area might extend on neighbour faces.
-        /// Case when extending over the right edge:
-        ///
-        ///  --> U
-        /// |        ......
-        /// v       .      .
-        /// V       .      .
-        ///         .      .
-        ///  ....... ...... .......
-        ///  .      .      .      .
-        ///  .      .  .....__min .
-        ///  .      .  .   .  |  -> amount
-        ///  ....... .....x.__|....
-        ///         .  .   .  max
-        ///         .  ........
-        ///         .      .
-        ///          ......
-        ///         .      .
-        ///         .      .
-        ///         .      .
-        ///          ......
-        ///
+            const float share = 1.0f/float(int32_t(numDirs));
+            for (uint32_t jj = 0; jj < numDirs; ++jj)
+            {
+                float uu, vv;
+                uint8_t face;
+                vecToTexelCoord(uu, vv, face, dirs[jj]);
 
-        enum NeighbourSides
+                const uint32_t xx = min(uint32_t(max(0.0f, uu)*float(int32_t(_faceSize))), _faceSize-1);
+                const uint32_t yy = min(uint32_t(max(0.0f, vv)*float(int32_t(_faceSize))), _faceSize-1);
+                const float uc = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                const float vc = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
+                const float scale = share/texelSolidAngle(uc, vc, invFaceSize);
+
+                float* dst = _dst + (size_t(face)*_faceSize*_faceSize + yy*_faceSize + xx)*4;
+                dst[0] += _lights[ii].m_color[0]*scale;
+                dst[1] += _lights[ii].m_color[1]*scale;
+                dst[2] += _lights[ii].m_color[2]*scale;
+            }
+
+            free(dirs);
+        }
+    }
+
+    struct LightLobeArgs
+    {
+        float* m_dst;
+        uint32_t m_faceSize;
+        float m_specularPower;
+        float m_cosAngle;
+        float m_invLobeIntegral;
+        const float (*m_dirs)[3];
+        const float (*m_colors)[3];
+        uint32_t m_numSamples;
+    };
+
+    // Rows of all faces of one mip are processed as one range.
+    static void lightLobeRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const LightLobeArgs* args = (const LightLobeArgs*)_userData;
+        const uint32_t faceSize = args->m_faceSize;
+        const float invFaceSize = 1.0f/float(int32_t(faceSize));
+
+        for (uint32_t row = _begin; row < _end; ++row)
         {
-            Left,
-            Right,
-            Top,
-            Bottom,
+            const uint8_t face = uint8_t(row/faceSize);
+            const uint32_t yy = row%faceSize;
+            float* dstPtr = args->m_dst + size_t(row)*faceSize*4;
 
-            Count,
-        };
+            for (uint32_t xx = 0; xx < faceSize; ++xx, dstPtr+=4)
+            {
+                // Same texel directions as radianceFilter().
+                const float uu = 2.0f*(float(int32_t(xx))+0.5f)*invFaceSize - 1.0f;
+                const float vv = 2.0f*(float(int32_t(yy))+0.5f)*invFaceSize - 1.0f;
 
-        struct NeighourFaceBleed
+                float tapVec[3];
+                texelCoordToVec(tapVec, uu, vv, face, faceSize);
+
+                for (uint32_t ii = 0; ii < args->m_numSamples; ++ii)
+                {
+                    const float dotProduct = vec3Dot(tapVec, args->m_dirs[ii]);
+                    if (dotProduct >= args->m_cosAngle)
+                    {
+                        const float weight = powf(dotProduct, args->m_specularPower)*args->m_invLobeIntegral;
+                        dstPtr[0] += args->m_colors[ii][0]*weight;
+                        dstPtr[1] += args->m_colors[ii][1]*weight;
+                        dstPtr[2] += args->m_colors[ii][2]*weight;
+                    }
+                }
+            }
+        }
+    }
+
+    bool imageRadianceAddLights(Image& _image
+                              , const CubemapLight* _lights
+                              , uint32_t _numLights
+                              , LightingModel::Enum _lightingModel
+                              , bool _excludeBase
+                              , uint8_t _glossScale
+                              , uint8_t _glossBias
+                              , const FilterSettings* _settings
+                              )
+    {
+        const FilterSettings& settings = filterSettings(_settings);
+        if (!imageIsCubemap(_image))
         {
-            float m_amount;
-            float m_bbMin;
-            float m_bbMax;
-        } bleed[NeighbourSides::Count] =
+            WARN("Image is not cubemap.");
+            return false;
+        }
+
+        if (0 == _numLights)
         {
-            { // Left
-                _filterSize - uu,
-                hitFaceFilterBounds.m_min[1],
-                hitFaceFilterBounds.m_max[1],
-            },
-            { // Right
-                uu + _filterSize - 1.0f,
-                hitFaceFilterBounds.m_min[1],
-                hitFaceFilterBounds.m_max[1],
-            },
-            { // Top
-                _filterSize - vv,
-                hitFaceFilterBounds.m_min[0],
-                hitFaceFilterBounds.m_max[0],
-            },
-            { // Bottom
-                vv + _filterSize - 1.0f,
-                hitFaceFilterBounds.m_min[0],
-                hitFaceFilterBounds.m_max[0],
-            },
-        };
+            return true;
+        }
 
-        // Determine bleeding for each side.
-        for (uint8_t side = 0; side < 4; ++side)
+        const TextureFormat::Enum format = (TextureFormat::Enum)_image.m_format;
+        imageConvert(_image, TextureFormat::RGBA32F);
+
+        const uint32_t dstFaceSize = _image.m_width;
+        const uint8_t mipCount = _image.m_numMips;
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        float* add = (float*)malloc(uint64_t(dstFaceSize)*dstFaceSize*CUBE_FACE_NUM*4*sizeof(float));
+        MALLOC_CHECK(add);
+
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
         {
-            uint8_t currentFaceIdx = hitFaceIdx;
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+            memset(add, 0, uint64_t(mipFaceSize)*mipFaceSize*CUBE_FACE_NUM*4*sizeof(float));
 
-            for (float bleedAmount = bleed[side].m_amount; bleedAmount > 0.0f; bleedAmount -= 1.0f)
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+
+            // Filter weights of the lobe integrate to 2pi*(1 - pow(cos, power+1))/(power+1) over the cap, see processFilterArea().
+            const float lobeIntegral = 2.0f*float(M_PI)*(1.0f - powf(cosAngle, specularPower + 1.0f))/(specularPower + 1.0f);
+            const float texelSolidAngleMean = 4.0f*float(M_PI)/(6.0f*float(int32_t(mipFaceSize))*float(int32_t(mipFaceSize)));
+
+            if ((0 == mip && _excludeBase)
+            ||  lobeIntegral < texelSolidAngleMean)
             {
-                uint8_t neighbourFaceIdx  = s_cubeFaceNeighbours[currentFaceIdx][side].m_faceIdx;
-                uint8_t neighbourFaceEdge = s_cubeFaceNeighbours[currentFaceIdx][side].m_faceEdge;
-                currentFaceIdx = neighbourFaceIdx;
+                lightSplat(add, mipFaceSize, _lights, _numLights);
+            }
+            else
+            {
+                // Disks much narrower than the lobe are taken as directions.
+                float (*dirs)[3];
+                float (*colors)[3];
+                const uint32_t numSamples = lightSamples(dirs, colors, _lights, _numLights, filterAngle/8.0f);
 
-                ///
-                /// https://code.google.com/p/cubemapgen/source/browse/trunk/CCubeMapProcessor.cpp#773
-                ///
-                /// Handle situations when bbMin and bbMax should be flipped.
-                ///
-                ///    L - Left           ....................T-T
-                ///    R - Right          v                     .
-                ///    T - Top        __________                .
-                ///    B - Bottom    .          |               .
-                ///                  .          |               .
-                ///                  .          |<...R-T        .
-                ///                  .          |    v          v
-                ///        .......... ..........|__________ __________
-                ///       .          .          .          .          .
-                ///       .          .          .          .          .
-                ///       .          .          .          .          .
-                ///       .          .          .          .          .
-                ///        __________ .......... .......... __________
-                ///            ^     |          .               ^
-                ///            .     |          .               .
-                ///            B-L..>|          .               .
-                ///                  |          .               .
-                ///                  |__________.               .
-                ///                       ^                     .
-                ///                       ....................B-B
-                ///
-                /// Those are:
-                ///     B-L, B-B
-                ///     T-R, T-T
-                ///     (and in reverse order, R-T and L-B)
-                ///
-                /// If we add, R-R and L-L (which never occur), we get:
-                ///     B-L, B-B
-                ///     T-R, T-T
-                ///     R-T, R-R
-                ///     L-B, L-L
-                ///
-                /// And if L = 0, R = 1, T = 2, B = 3 as in NeighbourSides enumeration,
-                /// a general rule can be derived for when to flip bbMin and bbMax:
-                ///     if ((a+b) == 3 || (a == b))
-                ///     {
-                ///        ..flip bbMin and bbMax
-                ///     }
-                ///
-                float bbMin = bleed[side].m_bbMin;
-                float bbMax = bleed[side].m_bbMax;
-                if ((side == neighbourFaceEdge)
-                || (3 == (side + neighbourFaceEdge)))
+                LightLobeArgs args;
+                args.m_dst = add;
+                args.m_faceSize = mipFaceSize;
+                args.m_specularPower = specularPower;
+                args.m_cosAngle = cosAngle;
+                args.m_invLobeIntegral = 1.0f/lobeIntegral;
+                args.m_dirs = dirs;
+                args.m_colors = colors;
+                args.m_numSamples = numSamples;
+                parallelFor(lightLobeRows, (void*)&args, mipFaceSize*CUBE_FACE_NUM);
+
+                free(dirs);
+            }
+
+            // 1x1 faces are averaged, as radianceFilterAverageLastMip() does.
+            if (1 == mipFaceSize)
+            {
+                float color[3] = { 0.0f, 0.0f, 0.0f };
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
                 {
-                    // Flip.
-                    bbMin = 1.0f - bbMin;
-                    bbMax = 1.0f - bbMax;
+                    color[0] += add[face*4+0]/6.0f;
+                    color[1] += add[face*4+1]/6.0f;
+                    color[2] += add[face*4+2]/6.0f;
                 }
-
-                switch (neighbourFaceEdge)
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
                 {
-                case CMFT_EDGE_LEFT:
-                    {
-                        ///  --> U
-                        /// |  .............
-                        /// v  .           .
-                        /// V  x___        .
-                        ///    |   |       .
-                        ///    |   |       .
-                        ///    |___x       .
-                        ///    .           .
-                        ///    .............
-                        ///
-                        _filterArea[neighbourFaceIdx].add(0.0f, bbMin);
-                        _filterArea[neighbourFaceIdx].add(bleedAmount, bbMax);
-                    }
-                break;
+                    memcpy(&add[face*4], color, sizeof(color));
+                }
+            }
 
-                case CMFT_EDGE_RIGHT:
-                    {
-                        ///  --> U
-                        /// |  .............
-                        /// v  .           .
-                        /// V  .       x___.
-                        ///    .       |   |
-                        ///    .       |   |
-                        ///    .       |___x
-                        ///    .           .
-                        ///    .............
-                        ///
-                        _filterArea[neighbourFaceIdx].add(1.0f - bleedAmount, bbMin);
-                        _filterArea[neighbourFaceIdx].add(1.0f, bbMax);
-                    }
-                break;
+            lightAddFaces(_image, mip, add, mipFaceSize);
+        }
+
+        free(add);
+        imageConvert(_image, format);
+
+        return true;
+    }
+
+    // Preview radiance.
+    //-----
+
+    /// Box blur passes per preview mip. Repeated box passes converge to a gaussian, three are close enough.
+#ifndef CMFT_RADIANCE_PREVIEW_PASSES
+    #define CMFT_RADIANCE_PREVIEW_PASSES 3
+#endif // CMFT_RADIANCE_PREVIEW_PASSES
+
+    struct PreviewBlurArgs
+    {
+        const float* m_src[CUBE_FACE_NUM];
+        float* m_dst[CUBE_FACE_NUM];
+        uint32_t m_faceSize;
+        uint32_t m_radius;     //!< Below m_faceSize, so lines reach no further than the neighbour faces.
+        float m_edgeWeight;    //!< Weight of the two texels just outside of the box, in [0, 1].
+        bool m_vertical;
+    };
+
+    /// Texel _ii of line _tt of _face, rows or columns with _vertical. Texels in [-faceSize, 0) and [faceSize, 2*faceSize)
+    /// are read from the neighbour face beyond that end of the line, with the same mapping as SoaCubemap::fillGuardBand().
+    static inline const float* previewLineTexel(const PreviewBlurArgs* _args, uint8_t _face, uint32_t _tt, int32_t _ii)
+    {
+        const uint32_t faceSize = _args->m_faceSize;
+        if (0 <= _ii && _ii < int32_t(faceSize))
+        {
+            const uint32_t xx = _args->m_vertical ? _tt : uint32_t(_ii);
+            const uint32_t yy = _args->m_vertical ? uint32_t(_ii) : _tt;
+            return _args->m_src[_face] + (size_t(yy)*faceSize + xx)*4;
+        }
+
+        const uint8_t side = (0 > _ii)
+                           ? uint8_t(_args->m_vertical ? CMFT_EDGE_TOP    : CMFT_EDGE_LEFT)
+                           : uint8_t(_args->m_vertical ? CMFT_EDGE_BOTTOM : CMFT_EDGE_RIGHT)
+                           ;
+        const uint32_t dd = (0 > _ii) ? uint32_t(-1-_ii) : uint32_t(_ii)-faceSize;
+
+        const uint8_t neighbourFaceIdx  = s_cubeFaceNeighbours[_face][side].m_faceIdx;
+        const uint8_t neighbourFaceEdge = s_cubeFaceNeighbours[_face][side].m_faceEdge;
+        const bool flip = (side == neighbourFaceEdge) || (3 == (side + neighbourFaceEdge));
+
+        const uint32_t last = faceSize-1;
+        const uint32_t along = flip ? last-_tt : _tt;
+        const uint32_t srcX = (CMFT_EDGE_LEFT   == neighbourFaceEdge) ? dd
+                            : (CMFT_EDGE_RIGHT  == neighbourFaceEdge) ? last-dd
+                            : along
+                            ;
+        const uint32_t srcY = (CMFT_EDGE_TOP    == neighbourFaceEdge) ? dd
+                            : (CMFT_EDGE_BOTTOM == neighbourFaceEdge) ? last-dd
+                            : along
+                            ;
+
+        return _args->m_src[neighbourFaceIdx] + (size_t(srcY)*faceSize + srcX)*4;
+    }
+
+    /// Blurs lines [_begin, _end) of all faces from m_src into m_dst with an extended box: a running sum over 2*m_radius+1 texels
+    /// and the next texel on each side weighted by m_edgeWeight. Its variance grows continuously with the edge weight.
+    static void previewBlurLines(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const PreviewBlurArgs* args = (const PreviewBlurArgs*)_userData;
+        const uint32_t faceSize = args->m_faceSize;
+        const int32_t radius = int32_t(args->m_radius);
+        const float edgeWeight = args->m_edgeWeight;
+        const float invCount = 1.0f/(float(2*radius+1) + 2.0f*edgeWeight);
+        const size_t step = args->m_vertical ? size_t(faceSize)*4 : 4;
+
+        for (uint32_t line = _begin; line < _end; ++line)
+        {
+            const uint8_t face = uint8_t(line / faceSize);
+            const uint32_t tt = line % faceSize;
+            float* dst = args->m_dst[face] + (args->m_vertical ? size_t(tt)*4 : size_t(tt)*faceSize*4);
+
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            for (int32_t ii = -radius; ii <= radius; ++ii)
+            {
+                const float* texel = previewLineTexel(args, face, tt, ii);
+                sum[0] += texel[0];
+                sum[1] += texel[1];
+                sum[2] += texel[2];
+            }
 
-                case CMFT_EDGE_TOP:
-                    {
-                        ///  --> U
-                        /// |  ...x____ ...
-                        /// v  .  |    |  .
-                        /// V  .  |____x  .
-                        ///    .          .
-                        ///    .          .
-                        ///    .          .
-                        ///    ............
-                        ///
-                        _filterArea[neighbourFaceIdx].add(bbMin, 0.0f);
-                        _filterArea[neighbourFaceIdx].add(bbMax, bleedAmount);
-                    }
-                break;
+            for (int32_t ii = 0; ii < int32_t(faceSize); ++ii, dst += step)
+            {
+                const float* before = previewLineTexel(args, face, tt, ii-radius-1);
+                const float* next = previewLineTexel(args, face, tt, ii+radius+1);
+                dst[0] = (sum[0] + (before[0] + next[0])*edgeWeight)*invCount;
+                dst[1] = (sum[1] + (before[1] + next[1])*edgeWeight)*invCount;
+                dst[2] = (sum[2] + (before[2] + next[2])*edgeWeight)*invCount;
+                dst[3] = 1.0f;
 
-                case CMFT_EDGE_BOTTOM:
-                    {
-                        ///  --> U
-                        /// |  ............
-                        /// v  .          .
-                        /// V  .          .
-                        ///    .          .
-                        ///    .  x____   .
-                        ///    .  |    |  .
-                        ///    ...|____x...
-                        ///
-                        _filterArea[neighbourFaceIdx].add(bbMin, 1.0f - bleedAmount);
-                        _filterArea[neighbourFaceIdx].add(bbMax, 1.0f);
-                    }
-                break;
-                }
+                const float* prev = previewLineTexel(args, face, tt, ii-radius);
+                sum[0] += next[0] - prev[0];
+                sum[1] += next[1] - prev[1];
+                sum[2] += next[2] - prev[2];
+            }
+        }
+    }
 
-                // Clamp bounding box to face size.
-                _filterArea[neighbourFaceIdx].clamp(0.0f, 1.0f);
+    /// Allocates Rgba32f destination of the job, same layout as imageRadianceFilter().
+    static void radianceFilterPreviewAlloc(RadianceFilterJob& _job, uint32_t _dstFaceSize, uint8_t _mipCount)
+    {
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _job.m_imageRgba32f.m_width : _dstFaceSize;
+        const uint8_t mipCount = radianceFilterMipCount(dstFaceSize, _mipCount);
+        uint64_t dstDataSize = 0;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            for (uint8_t mip = 0; mip < mipCount; ++mip)
+            {
+                _job.m_dstOffsets[face][mip] = dstDataSize;
+                uint32_t faceSize = max(uint32_t(1), dstFaceSize >> mip);
+                dstDataSize += uint64_t(faceSize) * faceSize * bytesPerPixel;
             }
         }
+        _job.m_dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+        MALLOC_CHECK(_job.m_dstData);
+        _job.m_dstDataSize = dstDataSize;
+        _job.m_dstFaceSize = dstFaceSize;
+        _job.m_mipCount = mipCount;
+        imageGetFaceOffsets(_job.m_srcFaceOffsets, _job.m_imageRgba32f);
     }
 
-    template <typename floatOrDouble>
-    void processFilterArea(floatOrDouble _res[3]
-                         , float _specularPower
-                         , float _specularAngle
-                         , const float* _tapVec
-                         , const float* _cubemapNormalSolidAngle
-                         , Aabb _filterArea[6]
-                         , uint32_t _srcFaceSize
-                         , const void* _srcData
-                         , const uint32_t _faceOffsets[6]
-                         )
+    /// Image referencing Rgba32f destination of the job.
+    static void radianceFilterPreviewImage(Image& _image, const RadianceFilterJob& _job)
     {
-        floatOrDouble colorWeight[4] = { floatOrDouble(0.0), floatOrDouble(0.0), floatOrDouble(0.0), floatOrDouble(0.0) };
+        _image.m_width = _job.m_dstFaceSize;
+        _image.m_height = _job.m_dstFaceSize;
+        _image.m_dataSize = _job.m_dstDataSize;
+        _image.m_format = TextureFormat::RGBA32F;
+        _image.m_numMips = _job.m_mipCount;
+        _image.m_numFaces = 6;
+        _image.m_data = _job.m_dstData;
+    }
 
+    /// Fills destination of the job with the preview, see imageRadianceFilterPreview().
+    static void radianceFilterPreviewMips(RadianceFilterJob& _job
+                                        , LightingModel::Enum _lightingModel
+                                        , bool _excludeBase
+                                        , uint8_t _glossScale
+                                        , uint8_t _glossBias
+                                        , float _lobeTolerance
+                                        )
+    {
         const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        const uint32_t pitch = _srcFaceSize*bytesPerPixel;
-        const uint32_t normalFaceSize = pitch*_srcFaceSize;
-        const float faceSize_MinusOne = float(int32_t(_srcFaceSize-1));
+        const uint32_t dstFaceSize = _job.m_dstFaceSize;
+        const uint8_t mipCount = _job.m_mipCount;
 
-        for (uint8_t face = 0; face < 6; ++face)
+        // Base mip is a resized copy of the source, each following mip starts as a 2x2 box downsample of the previous one.
+        radianceFilterCopyBase(_job);
+
+        float* scratch = (float*)getAllocator()->alloc(uint64_t(dstFaceSize)*dstFaceSize*bytesPerPixel*CUBE_FACE_NUM);
+        MALLOC_CHECK(scratch);
+
+        const float glossScalef = float(int32_t(_glossScale));
+        const float glossBiasf = float(int32_t(_glossBias));
+
+        // Blur already present in the current mip, as variance in its squared texels.
+        float variance = 0.0f;
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
         {
-            if (_filterArea[face].isEmpty())
+            const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+
+            float* faces[CUBE_FACE_NUM];
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
             {
-                continue;
+                faces[face] = (float*)((uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][mip]);
             }
 
-            const uint32_t minX = uint32_t(_filterArea[face].m_min[0] * faceSize_MinusOne);
-            const uint32_t maxX = uint32_t(_filterArea[face].m_max[0] * faceSize_MinusOne);
-            const uint32_t minY = uint32_t(_filterArea[face].m_min[1] * faceSize_MinusOne);
-            const uint32_t maxY = uint32_t(_filterArea[face].m_max[1] * faceSize_MinusOne);
+            if (0 != mip)
+            {
+                const uint32_t parentFaceSize = mipFaceSize*2;
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    const float* parent = (const float*)((const uint8_t*)_job.m_dstData + _job.m_dstOffsets[face][mip-1]);
+                    for (uint32_t yy = 0; yy < mipFaceSize; ++yy)
+                    {
+                        const float* row0 = parent + size_t(yy*2)*parentFaceSize*4;
+                        const float* row1 = row0 + parentFaceSize*4;
+                        float* dst = faces[face] + size_t(yy)*mipFaceSize*4;
+                        for (uint32_t xx = 0; xx < mipFaceSize; ++xx, row0 += 8, row1 += 8, dst += 4)
+                        {
+                            dst[0] = (row0[0] + row0[4] + row1[0] + row1[4])*0.25f;
+                            dst[1] = (row0[1] + row0[5] + row1[1] + row1[5])*0.25f;
+                            dst[2] = (row0[2] + row0[6] + row1[2] + row1[6])*0.25f;
+                            dst[3] = 1.0f;
+                        }
+                    }
+                }
 
-            const uint8_t* faceData    = (const uint8_t*)_srcData                 + _faceOffsets[face];
-            const uint8_t* faceNormals = (const uint8_t*)_cubemapNormalSolidAngle + normalFaceSize*face;
+                // Parent texels are half of a texel apart, their box adds a quarter of a parent texel squared.
+                variance = variance*0.25f + 0.0625f;
+            }
 
-            for (uint32_t yy = minY; yy <= maxY; ++yy)
+            if (_excludeBase && 0 == mip)
             {
-                const uint8_t* rowData    = (const uint8_t*)faceData    + yy*pitch;
-                const uint8_t* rowNormals = (const uint8_t*)faceNormals + yy*pitch;
+                continue;
+            }
 
-                for (uint32_t xx = minX; xx <= maxX; ++xx)
-                {
-                    const float* normalPtr = (const float*)((const uint8_t*)rowNormals + xx*bytesPerPixel);
-                    const float dotProduct = vec3Dot(normalPtr, _tapVec);
+            // Lobe pow(cos, power) is close to a gaussian with variance of 1/power squared radians.
+            // Texels near the face center span 2/faceSize radians, the remaining variance is made up by box passes.
+            float specularPower, filterAngle, cosAngle, filterSize;
+            radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, _lobeTolerance);
+
+            const float mipFaceSizef = float(int32_t(mipFaceSize));
+            const float texelAngle = (float(M_PI)/2.0f)/mipFaceSizef;
+            const float target = 1.0f/(specularPower*texelAngle*texelAngle);
+            const float perPass = max(0.0f, target - variance)/float(CMFT_RADIANCE_PREVIEW_PASSES);
 
-                    if (dotProduct >= _specularAngle)
+            // Box of 2*radius+1 texels has variance of radius*(radius+1)/3, edge weight makes up the rest of it.
+            const uint32_t radius = min(mipFaceSize-1, uint32_t((sqrtf(1.0f + 12.0f*perPass) - 1.0f)*0.5f));
+            const float rr = float(int32_t(radius));
+            const float boxMoment = rr*(rr+1.0f)*(2.0f*rr+1.0f)/3.0f;
+            const float edgeWeight = clamp((perPass*(2.0f*rr+1.0f) - boxMoment)/(2.0f*(rr+1.0f)*(rr+1.0f) - 2.0f*perPass), 0.0f, 1.0f);
+            if (0.0f < perPass)
+            {
+                PreviewBlurArgs args;
+                args.m_faceSize = mipFaceSize;
+                args.m_radius = radius;
+                args.m_edgeWeight = edgeWeight;
+                for (uint8_t pass = 0; pass < CMFT_RADIANCE_PREVIEW_PASSES; ++pass)
+                {
+                    for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
                     {
-                        const float solidAngle = normalPtr[3];
-                        const floatOrDouble weight = floatOrDouble(solidAngle * powf(dotProduct, _specularPower));
+                        args.m_src[face] = faces[face];
+                        args.m_dst[face] = scratch + size_t(face)*mipFaceSize*mipFaceSize*4;
+                    }
+                    args.m_vertical = false;
+                    parallelFor(previewBlurLines, (void*)&args, mipFaceSize*CUBE_FACE_NUM);
 
-                        const float* dataPtr = (const float*)((const uint8_t*)rowData + xx*bytesPerPixel);
-                        colorWeight[0] += floatOrDouble(dataPtr[0]) * weight;
-                        colorWeight[1] += floatOrDouble(dataPtr[1]) * weight;
-                        colorWeight[2] += floatOrDouble(dataPtr[2]) * weight;
-                        colorWeight[3] += floatOrDouble(1.0)        * weight;
+                    for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                    {
+                        args.m_src[face] = args.m_dst[face];
+                        args.m_dst[face] = faces[face];
                     }
+                    args.m_vertical = true;
+                    parallelFor(previewBlurLines, (void*)&args, mipFaceSize*CUBE_FACE_NUM);
                 }
+
+                const float passVariance = (boxMoment + 2.0f*edgeWeight*(rr+1.0f)*(rr+1.0f))/(2.0f*rr+1.0f + 2.0f*edgeWeight);
+                variance += float(CMFT_RADIANCE_PREVIEW_PASSES)*passVariance;
             }
+
+            INFO("Radiance -> Preview mip %u [lobe=%.2f texels] done.", mip, sqrtf(target));
         }
 
-        // Divide color by colorWeight and store result.
-        if (0.0f != colorWeight[3])
+        getAllocator()->free(scratch);
+
+        // Average 1x1 face size.
+        radianceFilterAverageLastMip(_job);
+    }
+
+    /// Moves Rgba32f destination of the job to _dst, converted back to _format.
+    static void radianceFilterPreviewResult(Image& _dst, RadianceFilterJob& _job, TextureFormat::Enum _format)
+    {
+        if (!_job.m_imageIsRef)
         {
-            const floatOrDouble invWeight = floatOrDouble(1.0)/colorWeight[3];
-            _res[0] = colorWeight[0] * invWeight;
-            _res[1] = colorWeight[1] * invWeight;
-            _res[2] = colorWeight[2] * invWeight;
+            imageUnload(_job.m_imageRgba32f);
         }
-        // Else if colorWeight == 0 (result of convolution is zero) take a direct color sample.
-        else
-        {
-            float uu, vv;
-            uint8_t hitFaceIdx;
-            vecToTexelCoord(uu, vv, hitFaceIdx, _tapVec);
-
-            const uint32_t xx = uint32_t(uu*float(_srcFaceSize));
-            const uint32_t yy = uint32_t(vv*float(_srcFaceSize));
 
-            const float* dataPtr = (const float*)((const uint8_t*)_srcData
-                                 + _faceOffsets[hitFaceIdx]
-                                 + yy*pitch
-                                 + xx*bytesPerPixel
-                                 );
+        Image result;
+        radianceFilterPreviewImage(result, _job);
 
-            _res[0] = floatOrDouble(dataPtr[0]);
-            _res[1] = floatOrDouble(dataPtr[1]);
-            _res[2] = floatOrDouble(dataPtr[2]);
+        // Convert back to source format.
+        if (TextureFormat::RGBA32F != _format)
+        {
+            imageConvert(result, _format);
         }
+        imageMove(_dst, result);
     }
 
-    void radianceFilter(float *_dstPtr
-                      , uint8_t _face
-                      , uint32_t _mipFaceSize
-                      , float _filterSize
-                      , float _specularPower
-                      , float _specularAngle
-                      , const float* _cubemapVectors
-                      , const Image* _imageRgba32f
-                      , const uint32_t _faceOffsets[CUBE_FACE_NUM]
-                      )
+    bool imageRadianceFilterPreview(Image& _dst
+                                  , uint32_t _dstFaceSize
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const Image& _src
+                                  , const FilterSettings* _settings
+                                  )
     {
-        const float invFaceSize = 1.0f/float(int32_t(_mipFaceSize));
-
-        for (uint32_t yy = 0; yy < _mipFaceSize; ++yy)
+        const FilterSettings& settings = filterSettings(_settings);
+        // Input image must be a cubemap.
+        if (!imageIsCubemap(_src))
         {
-            for (uint32_t xx = 0; xx < _mipFaceSize; ++xx)
-            {
-                // From [0..size-1] to [-1.0+invSize .. 1.0-invSize].
-                const float xxf = float(int32_t(xx));
-                const float yyf = float(int32_t(yy));
-                const float uu = 2.0f*(xxf+0.5f)*invFaceSize - 1.0f;
-                const float vv = 2.0f*(yyf+0.5f)*invFaceSize - 1.0f;
+            WARN("Image is not cubemap.");
 
-                float tapVec[3];
-                texelCoordToVec(tapVec, uu, vv, _face, _mipFaceSize);
+            return false;
+        }
 
-                Aabb facesBb[6];
-                determineFilterArea(facesBb, tapVec, _filterSize);
+        RadianceFilterJob job;
+        job.m_halfDst = false;
 
-                float color[3];
-                processFilterArea<float>(color
-                                       , _specularPower
-                                       , _specularAngle
-                                       , tapVec
-                                       , _cubemapVectors
-                                       , facesBb
-                                       , _imageRgba32f->m_width
-                                       , _imageRgba32f->m_data
-                                       , _faceOffsets
-                                       );
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        radianceFilterPreviewAlloc(job, _dstFaceSize, _mipCount);
 
-                _dstPtr[0] = float(color[0]);
-                _dstPtr[1] = float(color[1]);
-                _dstPtr[2] = float(color[2]);
-                _dstPtr[3] = 1.0f;
+        // Output info.
+        INFO("Running preview radiance filter for:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[dstFaceSize=%u]"
+             , job.m_imageRgba32f.m_width
+             , &"false\0true"[6*_excludeBase]
+             , job.m_mipCount
+             , _glossScale
+             , _glossBias
+             , getLightingModelStr(_lightingModel)
+             , job.m_dstFaceSize
+             );
 
-                _dstPtr += 4;
-            }
-        }
+        const uint64_t startTime = bx::getHPCounter();
+
+        radianceFilterPreviewMips(job, _lightingModel, _excludeBase, _glossScale, _glossBias, settings.m_lobeTolerance);
+
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+        INFO("Radiance -> Total time: %.3f seconds.", double(bx::getHPCounter() - startTime)*toSec);
+
+        // Fill result structure.
+        radianceFilterPreviewResult(_dst, job, (TextureFormat::Enum)_src.m_format);
+
+        return true;
     }
 
-    struct RadianceFilterGlobalState
+    void imageRadianceFilterPreview(Image& _image
+                                  , uint32_t _dstFaceSize
+                                  , LightingModel::Enum _lightingModel
+                                  , bool _excludeBase
+                                  , uint8_t _mipCount
+                                  , uint8_t _glossScale
+                                  , uint8_t _glossBias
+                                  , const FilterSettings* _settings
+                                  )
     {
-        RadianceFilterGlobalState()
-            : m_startTime(0)
-            , m_completedTasksGpu(0)
-            , m_completedTasksCpu(0)
-            , m_threadId(0)
+        Image tmp;
+        if (imageRadianceFilterPreview(tmp, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _image, _settings))
         {
+            imageMove(_image, tmp);
         }
+    }
 
-        uint8_t getThreadId()
-        {
-            bx::MutexScope lock(m_threadIdMutex);
-            return m_threadId++;
-        }
+    // Progressive radiance.
+    //-----
 
-        void incrCompletedTasksGpu()
+    /// Number of refinement passes after the preview. Each one filters every other texel of the previous grid in both directions,
+    /// the last one filters the remaining texels.
+#ifndef CMFT_RADIANCE_REFINE_PASSES
+    #define CMFT_RADIANCE_REFINE_PASSES 3
+#endif // CMFT_RADIANCE_REFINE_PASSES
+
+    /// Refinement pass in which texel _xx, _yy is filtered, starting from 1.
+    static inline uint8_t radianceFilterRefinePass(uint32_t _xx, uint32_t _yy)
+    {
+        const uint32_t bits = _xx|_yy;
+        uint8_t pass = 1;
+        for (uint32_t step = 1 << (CMFT_RADIANCE_REFINE_PASSES-1); step > 1 && 0 != (bits & (step-1)); step >>= 1)
         {
-            bx::MutexScope lock(m_completedTasksCpuMutex);
-            m_completedTasksCpu++;
+            pass++;
         }
+        return pass;
+    }
 
-        void incrCompletedTasksCpu()
+    static void radianceFilterRefineRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const RadianceFilterRegionsArgs* args = (const RadianceFilterRegionsArgs*)_userData;
+        const uint32_t mipFaceSize = args->m_mipFaceSize;
+
+        for (uint32_t row = _begin; row < _end; ++row)
         {
-            bx::MutexScope lock(m_completedTasksGpuMutex);
-            m_completedTasksGpu++;
-        }
+            const uint8_t face = uint8_t(row/mipFaceSize);
+            const uint32_t yy = row%mipFaceSize;
+            uint8_t* faceMask = args->m_mask + uint64_t(face)*mipFaceSize*mipFaceSize;
+            uint8_t* rowMask = faceMask + uint64_t(yy)*mipFaceSize;
 
-        uint64_t m_startTime;
-        uint16_t m_completedTasksGpu;
-        uint16_t m_completedTasksCpu;
-        uint8_t m_threadId;
-        bx::Mutex m_threadIdMutex;
-        bx::Mutex m_completedTasksGpuMutex;
-        bx::Mutex m_completedTasksCpuMutex;
-    };
-    static RadianceFilterGlobalState s_globalState;
+            bool any = false;
+            for (uint32_t xx = 0; xx < mipFaceSize; ++xx)
+            {
+                const bool current = (args->m_pass == radianceFilterRefinePass(xx, yy));
+                rowMask[xx] = uint8_t(current);
+                any |= current;
+            }
 
-    struct RadianceFilterParams
-    {
-        float* m_dstPtr;
-        uint8_t m_face;
-        uint32_t m_mipFaceSize;
-        float m_filterSize;
-        float m_specularPower;
-        float m_specularAngle;
-        const float* m_cubemapVectors;
-        const Image* m_imageRgba32f;
-        const uint32_t* m_faceOffsets;
-    };
+            if (any)
+            {
+                radianceFilter(args->m_dst[face]
+                             , false
+                             , face
+                             , mipFaceSize
+                             , yy
+                             , yy+1
+                             , args->m_filterSize
+                             , args->m_specularPower
+                             , args->m_cosAngle
+                             , &args->m_lobeTable
+                             , args->m_cubemapVectors
+                             , args->m_srcImage
+                             , args->m_srcFaceOffsets
+                             , args->m_normalsSoa
+                             , args->m_colorsSoa
+                             , 0.0f // Masked rows are never sampled adaptively.
+                             , faceMask
+                             );
+            }
+        }
+    }
 
-    struct RadianceFilterTaskList
+    bool imageRadianceFilterProgressive(Image& _dst
+                                      , uint32_t _dstFaceSize
+                                      , LightingModel::Enum _lightingModel
+                                      , bool _excludeBase
+                                      , uint8_t _mipCount
+                                      , uint8_t _glossScale
+                                      , uint8_t _glossBias
+                                      , const Image& _src
+                                      , RadianceRefineFn _callback
+                                      , void* _userData
+                                      , bool _useSourcePyramid
+                                      , const FilterSettings* _settings
+                                      )
     {
-        RadianceFilterTaskList(uint8_t _mipStart, uint8_t _mipCount)
-            : m_topMipIndex(_mipStart)
-            , m_bottomMipIndex(_mipCount-1)
-            , m_totalMipCount(_mipCount)
+        const FilterSettings& settings = filterSettings(_settings);
+        // Input image must be a cubemap.
+        if (!imageIsCubemap(_src))
         {
-            memset(m_mipFaceIdx, 0, MAX_MIP_NUM);
+            WARN("Image is not cubemap.");
+
+            return false;
         }
 
-        // Returns cube face radiance filter parameters starting from the top mip level.
-        const RadianceFilterParams* getFromTop()
+        RadianceFilterJob job;
+        job.m_halfDst = false;
+        job.m_numSources = 0;
+#if CMFT_RADIANCE_SH_ORDER
+        job.m_shCoeffs = NULL;
+#endif // CMFT_RADIANCE_SH_ORDER
+
+        // Processing is done in Rgba32f format.
+        job.m_imageIsRef = filterSourceRefOrConvert(job.m_imageRgba32f, TextureFormat::RGBA32F, _src);
+        const Image& imageRgba32f = job.m_imageRgba32f;
+        radianceFilterPreviewAlloc(job, _dstFaceSize, _mipCount);
+        const uint32_t dstFaceSize = job.m_dstFaceSize;
+        const uint8_t mipCount = job.m_mipCount;
+
+        // Output info.
+        INFO("Running progressive radiance filter for:"
+             "\n\t[srcFaceSize=%u]"
+             "\n\t[excludeBase=%s]"
+             "\n\t[mipCount=%u]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[lightingModel=%s]"
+             "\n\t[dstFaceSize=%u]"
+             "\n\t[useSourcePyramid=%s]"
+             , imageRgba32f.m_width
+             , &"false\0true"[6*_excludeBase]
+             , mipCount
+             , _glossScale
+             , _glossBias
+             , getLightingModelStr(_lightingModel)
+             , dstFaceSize
+             , &"false\0true"[6*_useSourcePyramid]
+             );
+
+        const uint64_t startTime = bx::getHPCounter();
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+        const uint8_t numPasses = CMFT_RADIANCE_REFINE_PASSES+1;
+
+        Image current;
+        radianceFilterPreviewImage(current, job);
+
+        // Pass 0, preview of all texels.
+        radianceFilterPreviewMips(job, _lightingModel, _excludeBase, _glossScale, _glossBias, settings.m_lobeTolerance);
+        INFO("Radiance -> Pass 0/%u done in %.3f seconds.", numPasses-1, double(bx::getHPCounter() - startTime)*toSec);
+        bool proceed = (NULL == _callback) || _callback(current, 0, numPasses, _userData);
+
+        if (proceed)
         {
-            bx::MutexScope lock(m_indexMutex);
-            while (m_topMipIndex <= m_bottomMipIndex)
+            job.m_cubemapVectors = acquireCubemapNormalSolidAngle(imageRgba32f.m_width);
+            job.m_normals = &job.m_normalsSoa;
+#if CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+            job.m_normalsSoa.initNormals(job.m_cubemapVectors, imageRgba32f.m_width);
+            soaInitColors(job.m_colorsSoa, imageRgba32f, job.m_srcFaceOffsets);
+#endif // CMFT_RADIANCE_SIMD && CMFT_RADIANCE_SOA
+
+            // One byte per texel of the largest filtered mip, set for texels filtered by the current pass.
+            const uint64_t maskSize = uint64_t(dstFaceSize)*dstFaceSize*CUBE_FACE_NUM;
+            uint8_t* mask = (uint8_t*)malloc(maskSize);
+            MALLOC_CHECK(mask);
+
+            const float glossScalef = float(int32_t(_glossScale));
+            const float glossBiasf = float(int32_t(_glossBias));
+
+            // Remaining passes filter growing subsets of all texels exactly as imageRadianceFilter() does.
+            for (uint8_t pass = 1; pass < numPasses && proceed; ++pass)
             {
-                if (m_mipFaceIdx[m_topMipIndex] >= 6)
-                {
-                    m_topMipIndex++;
-                }
-                else
+                for (uint8_t mip = uint8_t(_excludeBase); mip < mipCount; ++mip)
                 {
-                    return &m_params[m_topMipIndex][m_mipFaceIdx[m_topMipIndex]++];
-                }
+                    const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
+                    float specularPower, filterAngle, cosAngle, filterSize;
+                    radianceFilterMipParams(specularPower, filterAngle, cosAngle, filterSize, mipFaceSize, mip, mipCount, glossScalef, glossBiasf, _lightingModel, settings.m_lobeTolerance);
+
+#if CMFT_RADIANCE_SH_ORDER
+                    // Wide lobes are convolved in the SH domain as a whole, in the first pass.
+                    if (radianceFilterShMip(job.m_shLobes[mip], specularPower, cosAngle))
+                    {
+                        if (1 == pass)
+                        {
+                            radianceFilterShProject(job);
+                            radianceFilterShEvaluate(job, mip);
+                        }
+                        continue;
+                    }
+#endif // CMFT_RADIANCE_SH_ORDER
+
+                    // Source for this mip.
+                    RadianceFilterRegionsArgs args;
+                    args.m_srcImage = &job.m_imageRgba32f;
+                    args.m_srcFaceOffsets = job.m_srcFaceOffsets;
+                    args.m_cubemapVectors = job.m_cubemapVectors;
+                    args.m_normalsSoa = job.m_normals;
+                    args.m_colorsSoa = &job.m_colorsSoa;
+                    if (_useSourcePyramid)
+                    {
+                        const uint8_t level = radianceFilterSourceLevel(imageRgba32f.m_width, mipFaceSize, filterAngle);
+                        if (0 != level)
+                        {
+                            radianceFilterBuildSources(job, level, true);
+
+                            const RadianceFilterSource& source = job.m_sources[level];
+                            args.m_srcImage = &source.m_image;
+                            args.m_srcFaceOffsets = source.m_faceOffsets;
+                            args.m_cubemapVectors = source.m_cubemapVectors;
+                            args.m_normalsSoa = &source.m_normalsSoa;
+                            args.m_colorsSoa = &source.m_colorsSoa;
+                        }
+                    }
 
-            }
-            return NULL;
-        }
+                    for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                    {
+                        args.m_dst[face] = (float*)((uint8_t*)job.m_dstData + job.m_dstOffsets[face][mip]);
+                    }
+                    args.m_mask = mask;
+                    args.m_mipFaceSize = mipFaceSize;
+                    args.m_filterSize = filterSize;
+                    args.m_specularPower = specularPower;
+                    args.m_cosAngle = cosAngle;
+#if CMFT_RADIANCE_LOBE_TABLE
+                    args.m_lobeTable.init(specularPower, cosAngle);
+#endif // CMFT_RADIANCE_LOBE_TABLE
+                    args.m_rects = NULL;
+                    args.m_numRects = 0;
+                    args.m_all = false;
+                    args.m_pass = pass;
 
-        // Returns cube face radiance filter parameters starting from the bottom mip level.
-        const RadianceFilterParams* getFromBottom(uint8_t _numLevels = 0)
-        {
-            bx::MutexScope lock(m_indexMutex);
-            const uint8_t barrier = (0 == _numLevels) ? m_topMipIndex : max(m_topMipIndex, uint8_t(m_totalMipCount-_numLevels));
-            while (barrier <= m_bottomMipIndex)
-            {
-                if (m_mipFaceIdx[m_bottomMipIndex] >= 6)
-                {
-                    m_bottomMipIndex--;
+                    parallelFor(radianceFilterRefineRows, (void*)&args, mipFaceSize*CUBE_FACE_NUM);
                 }
-                else
+
+                // Average 1x1 face size, it is fully filtered by the first pass.
+                if (1 == pass)
                 {
-                    return &m_params[m_bottomMipIndex][m_mipFaceIdx[m_bottomMipIndex]++];
+                    radianceFilterAverageLastMip(job);
                 }
-            }
-            return NULL;
-        }
 
-        bx::Mutex m_indexMutex;
-        uint8_t m_topMipIndex;
-        uint8_t m_bottomMipIndex;
-        uint8_t m_totalMipCount;
-        uint8_t m_mipFaceIdx[MAX_MIP_NUM];
-        RadianceFilterParams m_params[MAX_MIP_NUM][CUBE_FACE_NUM];
-    };
-
-    int32_t radianceFilterCpu(void* _taskList)
-    {
-        const uint8_t threadId = s_globalState.getThreadId();
-        const double freq = double(bx::getHPFrequency());
-        const double toSec = 1.0/freq;
-
-        RadianceFilterTaskList* taskList = (RadianceFilterTaskList*)_taskList;
+                INFO("Radiance -> Pass %u/%u done in %.3f seconds.", pass, numPasses-1, double(bx::getHPCounter() - startTime)*toSec);
+                proceed = (NULL == _callback) || _callback(current, pass, numPasses, _userData);
+            }
 
-        // Gpu is processing from the top level mip map to the bottom.
-        const RadianceFilterParams* params;
-        while ((params = taskList->getFromTop()) != NULL)
-        {
-            // Start timer.
-            const uint64_t startTime = bx::getHPCounter();
+            free(mask);
+            job.m_normalsSoa.unload();
+            job.m_colorsSoa.unload();
+            releaseCubemapNormalSolidAngle(job.m_cubemapVectors);
+            radianceFilterReleaseSources(job);
+        }
 
-            // Process data.
-            radianceFilter(params->m_dstPtr
-                         , params->m_face
-                         , params->m_mipFaceSize
-                         , params->m_filterSize
-                         , params->m_specularPower
-                         , params->m_specularAngle
-                         , params->m_cubemapVectors
-                         , params->m_imageRgba32f
-                         , params->m_faceOffsets
-                         );
+#if CMFT_RADIANCE_SH_ORDER
+        free(job.m_shCoeffs);
+#endif // CMFT_RADIANCE_SH_ORDER
 
-            // Determine task duration.
-            const uint64_t currentTime = bx::getHPCounter();
-            const uint64_t taskDuration = currentTime - startTime;
-            const uint64_t totalDuration = currentTime - s_globalState.m_startTime;
-
-            // Output process info.
-            char cpuId[16];
-            sprintf(cpuId, "[CPU%u]", threadId);
-            INFO("Radiance -> %-8s| %4u | %7.3fs | %7.3fs"
-                , cpuId
-                , params->m_mipFaceSize
-                , double(taskDuration)*toSec
-                , double(totalDuration)*toSec
-                );
+        INFO("Radiance -> Total time: %.3f seconds.", double(bx::getHPCounter() - startTime)*toSec);
 
-            // Update task counter.
-            s_globalState.incrCompletedTasksGpu();
-        }
+        // Fill result structure.
+        radianceFilterPreviewResult(_dst, job, (TextureFormat::Enum)_src.m_format);
 
-        return EXIT_SUCCESS;
+        return true;
     }
 
-    struct RadianceProgram
+    void imageRadianceFilterProgressive(Image& _image
+                                      , uint32_t _dstFaceSize
+                                      , LightingModel::Enum _lightingModel
+                                      , bool _excludeBase
+                                      , uint8_t _mipCount
+                                      , uint8_t _glossScale
+                                      , uint8_t _glossBias
+                                      , RadianceRefineFn _callback
+                                      , void* _userData
+                                      , bool _useSourcePyramid
+                                      , const FilterSettings* _settings
+                                      )
     {
-        RadianceProgram()
-            : m_clContext(NULL)
-            , m_program(NULL)
-            , m_kernel(NULL)
-            , m_event(NULL)
-            , m_memOut(NULL)
+        Image tmp;
+        if (imageRadianceFilterProgressive(tmp, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _image, _callback, _userData, _useSourcePyramid, _settings))
         {
-            m_memSrcData[0] = NULL;
-            m_memSrcData[1] = NULL;
-            m_memSrcData[2] = NULL;
-            m_memSrcData[3] = NULL;
-            m_memSrcData[4] = NULL;
-            m_memSrcData[5] = NULL;
-            m_memNormalSolidAngle[0] = NULL;
-            m_memNormalSolidAngle[1] = NULL;
-            m_memNormalSolidAngle[2] = NULL;
-            m_memNormalSolidAngle[3] = NULL;
-            m_memNormalSolidAngle[4] = NULL;
-            m_memNormalSolidAngle[5] = NULL;
+            imageMove(_image, tmp);
         }
+    }
 
-        void setClContext(const ClContext* _clContext)
-        {
-            m_clContext = _clContext;
-        }
+    // Split-sum BRDF lookup table.
+    //-----
 
-        bool hasValidDeviceContext() const
+    /// Lobes of the lookup table, lighting models followed by GGX.
+    struct BrdfLutModel
+    {
+        enum Enum
         {
-            return (NULL != m_clContext->m_context);
-        }
+            Phong     = LightingModel::Phong,
+            PhongBrdf = LightingModel::PhongBrdf,
+            Blinn     = LightingModel::Blinn,
+            BlinnBrdf = LightingModel::BlinnBrdf,
+            Ggx       = LightingModel::Count,
+        };
+    };
 
-        bool isValid() const
-        {
-            return (NULL != m_program);
-        }
+    struct BrdfLutArgs
+    {
+        float* m_dst;
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_numSamples;
+        float m_glossScale;
+        float m_glossBias;
+        uint8_t m_model;
+    };
 
-        bool createFromStr(const char* _sourceCode, const char* _kernelName)
+    /// Lobe samples in SoA layout. Only x and z are stored, lookup table depends on them alone.
+    /// Blinn and GGX samples are half vectors around N, Phong samples are light directions around R.
+    static void brdfLutBuildSamples(float* _sampleX, float* _sampleZ, uint32_t _numSamples, uint8_t _model, float _specularPower, float _alpha2)
+    {
+        for (uint32_t ii = 0; ii < _numSamples; ++ii)
         {
-            cl_int err;
+            float xi[2];
+            hammersley(xi, ii, _numSamples);
 
-            // Create program.
-            m_program = clCreateProgramWithSource(m_clContext->m_context, 1, (const char**)&_sourceCode, NULL, &err);
-            if (CL_SUCCESS != err)
+            // Pdf of the half vector is D(NdotH)*NdotH, pdf of the light direction is normalized cosine power lobe itself.
+            float cosTheta;
+            if (BrdfLutModel::Ggx == _model)
             {
-                WARN("Could not create OpenCL program. OpenCL source file probably missing!");
-                return false;
+                cosTheta = sqrtf((1.0f-xi[1]) / (1.0f + (_alpha2-1.0f)*xi[1]));
             }
-
-            // Build program.
-            err = clBuildProgram(m_program, 1, &m_clContext->m_device, NULL, NULL, NULL);
-            if (CL_SUCCESS != err)
+            else if (BrdfLutModel::Blinn == _model || BrdfLutModel::BlinnBrdf == _model)
             {
-                // Print error.
-                char buffer[10240];
-                clGetProgramBuildInfo(m_program, m_clContext->m_device, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
-                WARN("CL Compilation failed:\n%s", buffer);
-
-                return false;
+                cosTheta = powf(1.0f-xi[1], 1.0f/(_specularPower+2.0f));
             }
-
-            // Create OpenCL Kernel.
-            m_kernel = clCreateKernel(m_program, _kernelName, &err);
-            if (CL_SUCCESS != err)
+            else
             {
-                WARN("Could not create OpenCL kernel. Kernel name probably inavlid! Should be: %s", _kernelName);
-                return false;
+                cosTheta = powf(1.0f-xi[1], 1.0f/(_specularPower+1.0f));
             }
 
-            return true;
+            const float sinTheta = sqrtf(max(0.0f, 1.0f - cosTheta*cosTheta));
+            const float phi = 2.0f*float(PI)*xi[0];
+            _sampleX[ii] = sinTheta*cosf(phi);
+            _sampleZ[ii] = cosTheta;
         }
+    }
 
-        bool createFromFile(const char* _filePath, const char* _kernelName)
+    /// Smith shadowing term of GGX for one direction.
+    static inline float ggxSmithG1(float _nDotX, float _alpha2)
+    {
+        return 2.0f*_nDotX / (_nDotX + sqrtf(_alpha2 + (1.0f-_alpha2)*_nDotX*_nDotX));
+    }
+
+    /// Integrates scale and bias of f0 for view direction V=(sinV, 0, cosV) with N=(0,0,1).
+    /// Phong lobe is around R=(-sinV, 0, cosV) with the second tangent (0,1,0), its samples are rotated into that frame.
+    template <uint8_t Model>
+    static void brdfLutTexel(float _ab[2], float _cosV, const float* _sampleX, const float* _sampleZ, uint32_t _numSamples, float _alpha2)
+    {
+        const float sinV = sqrtf(max(0.0f, 1.0f - _cosV*_cosV));
+        const float cos2V = _cosV*_cosV - sinV*sinV;
+        const float sin2V = 2.0f*sinV*_cosV;
+        const float g1V = ggxSmithG1(_cosV, _alpha2);
+
+        float scale = 0.0f;
+        float bias = 0.0f;
+        for (uint32_t ii = 0; ii < _numSamples; ++ii)
         {
-            CMFT_UNUSED size_t read;
+            const float sx = _sampleX[ii];
+            const float sz = _sampleZ[ii];
 
-            // Open file.
-            FILE* fp = fopen(_filePath, "rb");
-            if (NULL == fp)
+            float vDotH;
+            float nDotL;
+            if (Model == BrdfLutModel::Phong || Model == BrdfLutModel::PhongBrdf)
             {
-                WARN("Could not open file %s for reading.", _filePath);
-                return false;
+                const float vDotL = sx*sin2V + sz*cos2V;
+                vDotH = sqrtf(max(0.0f, 0.5f + 0.5f*vDotL));
+                nDotL = sx*sinV + sz*_cosV;
+            }
+            else
+            {
+                vDotH = sx*sinV + sz*_cosV;
+                nDotL = 2.0f*vDotH*sz - _cosV;
             }
-            ScopeFclose cleanup0(fp);
-
-            // Alloc data for string.
-            const long int fileSize = fsize(fp);
-            char* sourceData = (char*)malloc(fileSize+1);
-            ScopeFree cleanup1(sourceData);
 
-            // Read opencl source file.
-            read = fread(sourceData, fileSize, 1, fp);
-            sourceData[fileSize] = '\0';
-            DEBUG_CHECK(read == 1, "Could not read from file.");
-            FERROR_CHECK(fp);
+            if (nDotL <= 0.0f)
+            {
+                continue;
+            }
 
-            bool result = createFromStr(sourceData, _kernelName);
+            // BRDF * NdotL / pdf. Blinn models use implicit shadowing, G = NdotL*NdotV.
+            float weight;
+            switch (Model)
+            {
+            case BrdfLutModel::Phong:     weight = 1.0f;                                            break;
+            case BrdfLutModel::PhongBrdf: weight = nDotL;                                           break;
+            case BrdfLutModel::Blinn:     weight = vDotH/sz;                                        break;
+            case BrdfLutModel::BlinnBrdf: weight = nDotL*vDotH/sz;                                  break;
+            default:                      weight = g1V*ggxSmithG1(nDotL, _alpha2)*vDotH/(sz*_cosV); break;
+            }
 
-            return result;
+            // Schlick Fresnel.
+            const float fc0 = 1.0f - vDotH;
+            const float fc2 = fc0*fc0;
+            const float fc = fc2*fc2*fc0;
+            scale += (1.0f-fc)*weight;
+            bias  += fc*weight;
         }
 
-        void initDeviceMemory(const Image& _image, float* _cubemapNormalSolidAngle)
-        {
-            cl_int err;
+        const float invNumSamples = 1.0f/float(int32_t(_numSamples));
+        _ab[0] = scale*invNumSamples;
+        _ab[1] = bias*invNumSamples;
+    }
 
-            uint32_t faceOffsets[CUBE_FACE_NUM];
-            imageGetFaceOffsets(faceOffsets, _image);
-            const cl_image_format imageFormat = { CL_RGBA, CL_FLOAT };
-            const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-            const uint32_t normalFaceSize = _image.m_width * _image.m_width * bytesPerPixel;
+#if CMFT_RADIANCE_SIMD
+    /// Same as brdfLutTexel() for 4 view directions at a time.
+    template <uint8_t Model>
+    static void brdfLutTexelSimd(bx::float4_t& _scale, bx::float4_t& _bias, bx::float4_t _cosV, const float* _sampleX, const float* _sampleZ, uint32_t _numSamples, float _alpha2)
+    {
+        using namespace bx;
 
-            for (uint8_t face = 0; face < 6; ++face)
-            {
-                m_memSrcData[face] = CL_CHECK_ERR(clCreateImage2D(m_clContext->m_context
-                                                , CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR
-                                                , &imageFormat
-                                                , _image.m_width
-                                                , _image.m_height
-                                                , _image.m_width*bytesPerPixel
-                                                , (void*)((uint8_t*)_image.m_data + faceOffsets[face])
-                                                , &err
-                                                ));
-
-                m_memNormalSolidAngle[face] = CL_CHECK_ERR(clCreateImage2D(m_clContext->m_context
-                                                         , CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR
-                                                         , &imageFormat
-                                                         , _image.m_width
-                                                         , _image.m_height
-                                                         , _image.m_width*bytesPerPixel
-                                                         , (void*)((uint8_t*)_cubemapNormalSolidAngle + normalFaceSize*face)
-                                                         , &err
-                                                         ));
-            }
-
-            CL_CHECK(clSetKernelArg(m_kernel,   5, sizeof(int32_t), (const void*)&_image.m_width));
-            CL_CHECK(clSetKernelArg(m_kernel,   6, sizeof(cl_mem),  (const void*)&m_memSrcData[0]));
-            CL_CHECK(clSetKernelArg(m_kernel,   7, sizeof(cl_mem),  (const void*)&m_memSrcData[1]));
-            CL_CHECK(clSetKernelArg(m_kernel,   8, sizeof(cl_mem),  (const void*)&m_memSrcData[2]));
-            CL_CHECK(clSetKernelArg(m_kernel,   9, sizeof(cl_mem),  (const void*)&m_memSrcData[3]));
-            CL_CHECK(clSetKernelArg(m_kernel,  10, sizeof(cl_mem),  (const void*)&m_memSrcData[4]));
-            CL_CHECK(clSetKernelArg(m_kernel,  11, sizeof(cl_mem),  (const void*)&m_memSrcData[5]));
-            CL_CHECK(clSetKernelArg(m_kernel,  12, sizeof(cl_mem),  (const void*)&m_memNormalSolidAngle[0]));
-            CL_CHECK(clSetKernelArg(m_kernel,  13, sizeof(cl_mem),  (const void*)&m_memNormalSolidAngle[1]));
-            CL_CHECK(clSetKernelArg(m_kernel,  14, sizeof(cl_mem),  (const void*)&m_memNormalSolidAngle[2]));
-            CL_CHECK(clSetKernelArg(m_kernel,  15, sizeof(cl_mem),  (const void*)&m_memNormalSolidAngle[3]));
-            CL_CHECK(clSetKernelArg(m_kernel,  16, sizeof(cl_mem),  (const void*)&m_memNormalSolidAngle[4]));
-            CL_CHECK(clSetKernelArg(m_kernel,  17, sizeof(cl_mem),  (const void*)&m_memNormalSolidAngle[5]));
-        }
-
-        void setupOutputBuffer(uint32_t _dstFaceSize)
+        const float4_t zero  = float4_zero();
+        const float4_t one   = float4_splat(1.0f);
+        const float4_t half  = float4_splat(0.5f);
+        const float4_t two   = float4_splat(2.0f);
+        const float4_t alpha2 = float4_splat(_alpha2);
+        const float4_t alpha2c = float4_splat(1.0f-_alpha2);
+
+        const float4_t sinV  = float4_sqrt(float4_max(zero, float4_nmsub(_cosV, _cosV, one)));
+        const float4_t cos2V = float4_sub(float4_mul(_cosV, _cosV), float4_mul(sinV, sinV));
+        const float4_t sin2V = float4_mul(two, float4_mul(sinV, _cosV));
+
+        // Smith G1 of the view direction over NdotV, shared by all samples.
+        const float4_t g1VOverCosV = float4_div(two, float4_add(_cosV, float4_sqrt(float4_madd(alpha2c, float4_mul(_cosV, _cosV), alpha2))));
+
+        float4_t scale = zero;
+        float4_t bias = zero;
+        for (uint32_t ii = 0; ii < _numSamples; ++ii)
         {
-            cl_int err;
+            const float4_t sx = float4_splat(_sampleX[ii]);
+            const float4_t sz = float4_splat(_sampleZ[ii]);
 
-            if (NULL != m_memOut)
+            float4_t vDotH;
+            float4_t nDotL;
+            if (Model == BrdfLutModel::Phong || Model == BrdfLutModel::PhongBrdf)
+            {
+                const float4_t vDotL = float4_madd(sx, sin2V, float4_mul(sz, cos2V));
+                vDotH = float4_sqrt(float4_max(zero, float4_madd(half, vDotL, half)));
+                nDotL = float4_madd(sx, sinV, float4_mul(sz, _cosV));
+            }
+            else
             {
-                clReleaseMemObject(m_memOut);
-                m_memOut = NULL;
+                vDotH = float4_madd(sx, sinV, float4_mul(sz, _cosV));
+                nDotL = float4_sub(float4_mul(two, float4_mul(vDotH, sz)), _cosV);
             }
 
-            const cl_image_format imageFormat = { CL_RGBA, CL_FLOAT };
-            m_memOut = CL_CHECK_ERR(clCreateImage2D(m_clContext->m_context
-                        , CL_MEM_WRITE_ONLY
-                        , &imageFormat
-                        , _dstFaceSize
-                        , _dstFaceSize
-                        , 0
-                        , NULL
-                        , &err
-                        ));
+            float4_t weight;
+            switch (Model)
+            {
+            case BrdfLutModel::Phong:     weight = one;                                           break;
+            case BrdfLutModel::PhongBrdf: weight = nDotL;                                         break;
+            case BrdfLutModel::Blinn:     weight = float4_div(vDotH, sz);                         break;
+            case BrdfLutModel::BlinnBrdf: weight = float4_div(float4_mul(nDotL, vDotH), sz);      break;
+            default:
+                {
+                    const float4_t nDotLc = float4_max(nDotL, zero);
+                    const float4_t g1L = float4_div(float4_mul(two, nDotLc)
+                                                  , float4_add(nDotLc, float4_sqrt(float4_madd(alpha2c, float4_mul(nDotLc, nDotLc), alpha2)))
+                                                  );
+                    weight = float4_div(float4_mul(float4_mul(g1VOverCosV, g1L), vDotH), sz);
+                }
+            break;
+            }
+            weight = float4_and(weight, float4_cmpgt(nDotL, zero));
 
-            CL_CHECK(clSetKernelArg(m_kernel, 0, sizeof(cl_mem), (const void*)&m_memOut));
+            const float4_t fc0 = float4_sub(one, vDotH);
+            const float4_t fc2 = float4_mul(fc0, fc0);
+            const float4_t fcw = float4_mul(float4_mul(float4_mul(fc2, fc2), fc0), weight);
+            scale = float4_add(scale, float4_sub(weight, fcw));
+            bias  = float4_add(bias, fcw);
         }
 
-        void setArgs(uint8_t _faceId, uint32_t _dstFaceSize, float _specularPower, float _specularAngle) const
-        {
-            CL_CHECK(clSetKernelArg(m_kernel, 1, sizeof(float),   (const void*)&_specularPower));
-            CL_CHECK(clSetKernelArg(m_kernel, 2, sizeof(float),   (const void*)&_specularAngle));
-            CL_CHECK(clSetKernelArg(m_kernel, 3, sizeof(int32_t), (const void*)&_dstFaceSize));
-            CL_CHECK(clSetKernelArg(m_kernel, 4, sizeof(uint8_t), (const void*)&_faceId));
-        }
+        const float4_t invNumSamples = float4_splat(1.0f/float(int32_t(_numSamples)));
+        _scale = float4_mul(scale, invNumSamples);
+        _bias  = float4_mul(bias,  invNumSamples);
+    }
+#endif // CMFT_RADIANCE_SIMD
 
-        bool isIdle() const
+    template <uint8_t Model>
+    static void brdfLutRow(float* _dst, uint32_t _width, const float* _sampleX, const float* _sampleZ, uint32_t _numSamples, float _alpha2)
+    {
+        const float invWidth = 1.0f/float(int32_t(_width));
+
+        uint32_t xx = 0;
+#if CMFT_RADIANCE_SIMD
+        for (; xx+4 <= _width; xx+=4)
         {
-            cl_int status;
-            clGetEventInfo(m_event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), (void*)&status, NULL);
+            const bx::float4_t cosV = bx::float4_mul(bx::float4_add(bx::float4_ld(float(int32_t(xx)), float(int32_t(xx+1)), float(int32_t(xx+2)), float(int32_t(xx+3)))
+                                                                  , bx::float4_splat(0.5f)
+                                                                  )
+                                                   , bx::float4_splat(invWidth)
+                                                   );
 
-            return ((CL_COMPLETE == status) || (NULL == m_event));
-        }
+            bx::float4_t scale4;
+            bx::float4_t bias4;
+            brdfLutTexelSimd<Model>(scale4, bias4, cosV, _sampleX, _sampleZ, _numSamples, _alpha2);
+            const float scale[4] = { bx::float4_x(scale4), bx::float4_y(scale4), bx::float4_z(scale4), bx::float4_w(scale4) };
+            const float bias[4]  = { bx::float4_x(bias4),  bx::float4_y(bias4),  bx::float4_z(bias4),  bx::float4_w(bias4)  };
 
-        void run(uint32_t _dstFaceSize)
-        {
-            size_t workSize[2] = { _dstFaceSize, _dstFaceSize };
-            CL_CHECK(clEnqueueNDRangeKernel(m_clContext->m_commandQueue, m_kernel, 2, NULL, workSize, NULL, 0, NULL, &m_event));
+            for (uint32_t ii = 0; ii < 4; ++ii)
+            {
+                float* dst = &_dst[(xx+ii)*4];
+                dst[0] = scale[ii];
+                dst[1] = bias[ii];
+                dst[2] = 0.0f;
+                dst[3] = 1.0f;
+            }
         }
+#endif // CMFT_RADIANCE_SIMD
 
-        void readResults(void* _out, uint32_t _dstFaceSize)
+        for (; xx < _width; ++xx)
         {
-            const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-            const size_t origin[3] = { 0, 0, 0 };
-            const size_t region[3] = { _dstFaceSize, _dstFaceSize, 1 };
-            CL_CHECK(clEnqueueReadImage(m_clContext->m_commandQueue
-                                      , m_memOut
-                                      , CL_TRUE
-                                      , origin
-                                      , region
-                                      , _dstFaceSize*bytesPerPixel
-                                      , 0
-                                      , _out
-                                      , 0
-                                      , NULL
-                                      , &m_event
-                                      ));
+            float* dst = &_dst[xx*4];
+            brdfLutTexel<Model>(dst, (float(int32_t(xx))+0.5f)*invWidth, _sampleX, _sampleZ, _numSamples, _alpha2);
+            dst[2] = 0.0f;
+            dst[3] = 1.0f;
         }
+    }
 
-        void finish() const
-        {
-            clFinish(m_clContext->m_commandQueue);
-        }
+    static void brdfLutRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const BrdfLutArgs* args = (const BrdfLutArgs*)_userData;
+        const uint32_t numSamples = args->m_numSamples;
 
-        void releaseDeviceMemory()
-        {
-#define RELEASE_CL_MEM(_mem) do { if (NULL != (_mem)) { clReleaseMemObject(_mem); (_mem) = NULL; } } while (0)
-            RELEASE_CL_MEM(m_memOut);
-            RELEASE_CL_MEM(m_memSrcData[0]);
-            RELEASE_CL_MEM(m_memSrcData[1]);
-            RELEASE_CL_MEM(m_memSrcData[2]);
-            RELEASE_CL_MEM(m_memSrcData[3]);
-            RELEASE_CL_MEM(m_memSrcData[4]);
-            RELEASE_CL_MEM(m_memSrcData[5]);
-            RELEASE_CL_MEM(m_memNormalSolidAngle[0]);
-            RELEASE_CL_MEM(m_memNormalSolidAngle[1]);
-            RELEASE_CL_MEM(m_memNormalSolidAngle[2]);
-            RELEASE_CL_MEM(m_memNormalSolidAngle[3]);
-            RELEASE_CL_MEM(m_memNormalSolidAngle[4]);
-            RELEASE_CL_MEM(m_memNormalSolidAngle[5]);
-#undef RELEASE_CL_MEM
-        }
+        float* sampleX = (float*)malloc(2*numSamples*sizeof(float));
+        MALLOC_CHECK(sampleX);
+        float* sampleZ = sampleX + numSamples;
 
-        void destroy()
+        for (uint32_t yy = _begin; yy < _end; ++yy)
         {
-            if (NULL != m_program)
-            {
-                clReleaseProgram(m_program);
-                m_program = NULL;
-            }
+            // Same glossiness mapping as radiance filters, GGX roughness is alpha = sqrt(2/(n+2)).
+            const float glossiness = (float(int32_t(yy))+0.5f)/float(int32_t(args->m_height));
+            const float specularPower = powf(2.0f, args->m_glossScale*glossiness + args->m_glossBias);
+            const float alpha2 = 2.0f/(specularPower+2.0f);
 
-            if (NULL != m_kernel)
+            brdfLutBuildSamples(sampleX, sampleZ, numSamples, args->m_model, specularPower, alpha2);
+
+            float* dst = args->m_dst + size_t(yy)*args->m_width*4;
+            switch (args->m_model)
             {
-                clReleaseKernel(m_kernel);
-                m_kernel = NULL;
+            case BrdfLutModel::Phong:     brdfLutRow<BrdfLutModel::Phong>    (dst, args->m_width, sampleX, sampleZ, numSamples, alpha2); break;
+            case BrdfLutModel::PhongBrdf: brdfLutRow<BrdfLutModel::PhongBrdf>(dst, args->m_width, sampleX, sampleZ, numSamples, alpha2); break;
+            case BrdfLutModel::Blinn:     brdfLutRow<BrdfLutModel::Blinn>    (dst, args->m_width, sampleX, sampleZ, numSamples, alpha2); break;
+            case BrdfLutModel::BlinnBrdf: brdfLutRow<BrdfLutModel::BlinnBrdf>(dst, args->m_width, sampleX, sampleZ, numSamples, alpha2); break;
+            default:                      brdfLutRow<BrdfLutModel::Ggx>      (dst, args->m_width, sampleX, sampleZ, numSamples, alpha2); break;
             }
         }
 
-        const ClContext* m_clContext;
-        cl_program m_program;
-        cl_kernel m_kernel;
-        cl_event m_event;
-        cl_mem m_memOut;
-        cl_mem m_memSrcData[6];
-        cl_mem m_memNormalSolidAngle[6];
-    };
-    RadianceProgram s_radianceProgram;
+        free(sampleX);
+    }
 
-    int32_t radianceFilterGpu(void* _taskList)
+    static bool imageBrdfLutImpl(Image& _dst
+                               , uint32_t _width
+                               , uint32_t _height
+                               , uint8_t _model
+                               , uint8_t _glossScale
+                               , uint8_t _glossBias
+                               , uint32_t _numSamples
+                               , TextureFormat::Enum _format
+                               )
     {
-        if (!s_radianceProgram.isValid())
+        if (0 == _width || 0 == _height)
         {
-            return EXIT_FAILURE;
-        }
-
-        const double freq = double(bx::getHPFrequency());
-        const double toSec = 1.0/freq;
-
-        RadianceFilterTaskList* taskList = (RadianceFilterTaskList*)_taskList;
-
-        // Gpu is processing from the top level mip map to the bottom.
-        const RadianceFilterParams* params;
-        while ((params = taskList->getFromTop()) != NULL)
-        {
-            // Start timer.
-            const uint64_t startTime = bx::getHPCounter();
-
-            // Prepare parameters.
-            s_radianceProgram.setupOutputBuffer(params->m_mipFaceSize);
-            s_radianceProgram.setArgs(params->m_face
-                                    , params->m_mipFaceSize
-                                    , params->m_specularPower
-                                    , params->m_specularAngle
-                                    );
+            WARN("BRDF lookup table size has to be at least 1x1.");
 
-            // Enqueue processing job.
-            s_radianceProgram.run(params->m_mipFaceSize);
-
-            // Read results.
-            s_radianceProgram.readResults(params->m_dstPtr, params->m_mipFaceSize);
-
-            // Determine task duration.
-            const uint64_t currentTime = bx::getHPCounter();
-            const uint64_t taskDuration = currentTime - startTime;
-            const uint64_t totalDuration = currentTime - s_globalState.m_startTime;
+            return false;
+        }
 
-            // Output process info.
-            INFO("Radiance ->  <GPU>  | %4u | %7.3fs | %7.3fs"
-                , params->m_mipFaceSize
-                , double(taskDuration)*toSec
-                , double(totalDuration)*toSec
-                );
+        if (0 == _numSamples)
+        {
+            WARN("BRDF lookup table requires at least one sample.");
 
-            // Update task counter.
-            s_globalState.incrCompletedTasksCpu();
+            return false;
         }
 
-        return EXIT_SUCCESS;
-    }
+        INFO("Running BRDF lookup table for:"
+             "\n\t[lightingModel=%s]"
+             "\n\t[glossScale=%u]"
+             "\n\t[glossBias=%u]"
+             "\n\t[numSamples=%u]"
+             "\n\t[size=%ux%u]"
+             , (BrdfLutModel::Ggx == _model) ? "ggx" : getLightingModelStr((LightingModel::Enum)_model)
+             , _glossScale
+             , _glossBias
+             , _numSamples
+             , _width
+             , _height
+             );
 
-    static const char* s_lightingModelStr[LightingModel::Count] =
-    {
-        "phong",
-        "phongbrdf",
-        "blinn",
-        "blinnbrdf",
-    };
+        const uint64_t startTime = bx::getHPCounter();
 
-    const char* getLightingModelStr(LightingModel::Enum _lightingModel)
-    {
-        DEBUG_CHECK(_lightingModel < LightingModel::Count, "Reading array out of bounds!");
-        return s_lightingModelStr[uint8_t(_lightingModel)];
-    }
+        // Alloc dst data.
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstDataSize = _width*_height*bytesPerPixel;
+        void* dstData = allocTagged(dstDataSize, AllocTag::MipChain);
+        MALLOC_CHECK(dstData);
 
-    /// Returns the angle of cosine power function where the results are above a small empirical treshold.
-    static float cosinePowerFilterAngle(float _cosinePower)
-    {
-        // Bigger value leads to performance improvement but might hurt the results.
-        // 0.00001f was tested empirically and it gives almost the same values as reference.
-        const float treshold = 0.00001f;
+        BrdfLutArgs args;
+        args.m_dst = (float*)dstData;
+        args.m_width = _width;
+        args.m_height = _height;
+        args.m_numSamples = _numSamples;
+        args.m_glossScale = float(int32_t(_glossScale));
+        args.m_glossBias = float(int32_t(_glossBias));
+        args.m_model = _model;
+        parallelFor(brdfLutRows, (void*)&args, _height);
 
-        // Cosine power filter is: pow(cos(angle), power).
-        // We want the value of the angle above each result is <= treshold.
-        // So: angle = acos(pow(treshold, 1.0 / power))
-        return acosf(powf(treshold, 1.0f / _cosinePower));
-    }
+        const double freq = double(bx::getHPFrequency());
+        const double toSec = 1.0/freq;
+        INFO("BRDF lookup table -> Total time: %.3f seconds.", double(bx::getHPCounter() - startTime)*toSec);
 
-    float applyLightningModel(float _specularPowerRef, LightingModel::Enum _lightingModel)
-    {
-        /// http://seblagarde.wordpress.com/2012/06/10/amd-cubemapgen-for-physically-based-rendering/
-        /// http://seblagarde.wordpress.com/2012/03/29/relationship-between-phong-and-blinn-lighting-model/
-        switch (_lightingModel)
-        {
-        case LightingModel::Phong:
-            {
-                return _specularPowerRef;
-            }
-        break;
+        // Fill result structure.
+        Image result;
+        result.m_width = _width;
+        result.m_height = _height;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = 1;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
 
-        case LightingModel::PhongBrdf:
-            {
-                return _specularPowerRef + 1.0f;
-            }
-        break;
+        if (TextureFormat::RGBA32F != _format)
+        {
+            imageConvert(result, _format);
+        }
+        imageMove(_dst, result);
 
-        case LightingModel::Blinn:
-            {
-                return _specularPowerRef/4.0f;
-            }
-        break;
+        return true;
+    }
 
-        case LightingModel::BlinnBrdf:
-            {
-                return _specularPowerRef/4.0f + 1.0f;
-            }
-        break;
+    bool imageBrdfLut(Image& _dst
+                    , uint32_t _width
+                    , uint32_t _height
+                    , LightingModel::Enum _lightingModel
+                    , uint8_t _glossScale
+                    , uint8_t _glossBias
+                    , uint32_t _numSamples
+                    , TextureFormat::Enum _format
+                    )
+    {
+        return imageBrdfLutImpl(_dst, _width, _height, uint8_t(_lightingModel), _glossScale, _glossBias, _numSamples, _format);
+    }
 
-        default:
-            {
-                DEBUG_CHECK(false, "ERROR! This should never happen!");
-                WARN("Lighting model error. Please check for invalid parameters!");
-                return _specularPowerRef;
-            }
-        break;
-        };
+    bool imageBrdfLutGgx(Image& _dst
+                       , uint32_t _width
+                       , uint32_t _height
+                       , uint8_t _glossScale
+                       , uint8_t _glossBias
+                       , uint32_t _numSamples
+                       , TextureFormat::Enum _format
+                       )
+    {
+        return imageBrdfLutImpl(_dst, _width, _height, uint8_t(BrdfLutModel::Ggx), _glossScale, _glossBias, _numSamples, _format);
     }
 
-    bool imageRadianceFilter(Image& _dst
-                           , uint32_t _dstFaceSize
-                           , LightingModel::Enum _lightingModel
-                           , bool _excludeBase
-                           , uint8_t _mipCount
-                           , uint8_t _glossScale
-                           , uint8_t _glossBias
-                           , const Image& _src
-                           , int8_t _numCpuProcessingThreads
-                           , const ClContext* _clContext
-                           )
+    // Resampling on OpenCL devices.
+    //-----
+
+    /// Writes 6 faces of _dstFaceSize converted from Rgba32f latlong _src on the device, all of them by a single dispatch
+    /// when they fit into one buffer, one face at a time otherwise.
+    /// Returns false if the device is not available or the source doesn't fit into a single buffer.
+    static bool cubemapFromLatLongGpu(void* _dstData, uint32_t _dstFaceSize, const Image& _src, bool _useBilinearInterpolation, const ClContext* _clContext, FilterStats* _stats)
     {
-        // Input image must be a cubemap.
-        if (!imageIsCubemap(_src))
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint64_t srcSize = uint64_t(_src.m_width)*_src.m_height*bytesPerPixel;
+        const uint64_t dstFaceDataSize = uint64_t(_dstFaceSize)*_dstFaceSize*bytesPerPixel;
+        const uint64_t maxAllocSize = clMaxAllocSize(_clContext);
+        if (srcSize > maxAllocSize
+        ||  dstFaceDataSize > maxAllocSize
+        ||  uint64_t(_src.m_width)*_src.m_height > uint64_t(INT32_MAX))
         {
-            WARN("Image is not cubemap.");
+            return false;
+        }
 
+        cl_program program = _clContext->getProgram(s_resampleProgramSource);
+        if (NULL == program)
+        {
             return false;
         }
 
-        // Multi-threading parameters.
-        bx::Thread cpuThreads[64];
-        uint8_t activeCpuThreads = 0;
-        const uint8_t maxActiveCpuThreads = (uint8_t)max(int8_t(0), min(_numCpuProcessingThreads, int8_t(64)));
+        cl_int err;
+        cl_kernel kernel = clCreateKernel(program, "cubemapFromLatLong", &err);
+        if (CL_SUCCESS != err)
+        {
+            WARN("Could not create OpenCL kernel cubemapFromLatLong.");
+            clReleaseProgram(program);
+            return false;
+        }
 
-        // Prepare OpenCL kernel and device memory.
-        s_radianceProgram.setClContext(_clContext);
-        if (s_radianceProgram.hasValidDeviceContext())
+        cl_mem memSrc = CL_CHECK_ERR(clCreateBuffer(_clContext->m_context
+                                   , CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR
+                                   , size_t(srcSize)
+                                   , _src.m_data
+                                   , &err
+                                   ));
+        const uint8_t facesPerDispatch = (6*dstFaceDataSize <= maxAllocSize) ? 6 : 1;
+        cl_mem memDst = CL_CHECK_ERR(clCreateBuffer(_clContext->m_context
+                                   , CL_MEM_WRITE_ONLY
+                                   , size_t(dstFaceDataSize*facesPerDispatch)
+                                   , NULL
+                                   , &err
+                                   ));
+
+        // Edge fixup factor of texelCoordWarp().
+        const float warp = (1 == _dstFaceSize) ? 0.0f : float(_dstFaceSize*_dstFaceSize) / powf(float(_dstFaceSize - 1), 3.0f);
+        const int32_t srcWidth  = int32_t(_src.m_width);
+        const int32_t srcHeight = int32_t(_src.m_height);
+        const int32_t faceSize  = int32_t(_dstFaceSize);
+        const int32_t bilinear  = int32_t(_useBilinearInterpolation);
+        CL_CHECK(clSetKernelArg(kernel, 0, sizeof(cl_mem),  (const void*)&memDst));
+        CL_CHECK(clSetKernelArg(kernel, 1, sizeof(cl_mem),  (const void*)&memSrc));
+        CL_CHECK(clSetKernelArg(kernel, 2, sizeof(int32_t), (const void*)&srcWidth));
+        CL_CHECK(clSetKernelArg(kernel, 3, sizeof(int32_t), (const void*)&srcHeight));
+        CL_CHECK(clSetKernelArg(kernel, 4, sizeof(int32_t), (const void*)&faceSize));
+        CL_CHECK(clSetKernelArg(kernel, 5, sizeof(float),   (const void*)&warp));
+        CL_CHECK(clSetKernelArg(kernel, 7, sizeof(int32_t), (const void*)&bilinear));
+
+        // Third dimension of the dispatch goes over faces, destination faces are consecutive.
+        const size_t workSize[3] = { _dstFaceSize, _dstFaceSize, facesPerDispatch };
+        for (uint8_t face = 0; face < 6; face += facesPerDispatch)
         {
-            s_radianceProgram.createFromStr(s_radianceProgramSource, "radianceFilter");
+            const int8_t faceId = int8_t(face);
+            CL_CHECK(clSetKernelArg(kernel, 6, sizeof(int8_t), (const void*)&faceId));
+            CL_CHECK(clEnqueueNDRangeKernel(_clContext->m_commandQueue, kernel, 3, NULL, workSize, NULL, 0, NULL, NULL));
+            CL_CHECK(clEnqueueReadBuffer(_clContext->m_commandQueue
+                                       , memDst
+                                       , CL_TRUE
+                                       , 0
+                                       , size_t(dstFaceDataSize*facesPerDispatch)
+                                       , (uint8_t*)_dstData + dstFaceDataSize*face
+                                       , 0
+                                       , NULL
+                                       , NULL
+                                       ));
         }
 
-        // Check at least some processig device is valid and choosen for filtering.
-        if (0 == maxActiveCpuThreads && !s_radianceProgram.isValid())
+        if (NULL != _stats)
         {
-            WARN("No hardware devices selected for processing."
-                " OpenCL context is invalid and 0 CPU processing theads are choosen for filtering."
-                );
+            _stats->m_bytesToDevice += srcSize;
+            _stats->m_bytesFromDevice += dstFaceDataSize*6;
+        }
+
+        clReleaseMemObject(memDst);
+        clReleaseMemObject(memSrc);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
 
+        return true;
+    }
+
+    bool imageCubemapFromLatLong(Image& _dst, const Image& _src, bool _useBilinearInterpolation, const ClContext* _clContext, FilterStats* _stats)
+    {
+        if (!imageIsLatLong(_src))
+        {
             return false;
         }
 
-        // Don't use the same CPU device for OpenCL and CPU processing!
-        if (_clContext->m_deviceType&CL_DEVICE_TYPE_CPU
-        &&  maxActiveCpuThreads != 0)
+        if (NULL == _clContext || NULL == _clContext->m_context)
         {
-            WARN(" !! Choosing CPU device as OpenCL device and running CPU processing"
-                 " threads on the SAME device is NOT a good idea. It will work, but it is"
-                 " certainly not the best utilization of processing resources."
-                 " In case OpenCL device type is CPU but it is a different processing"
-                 " device other than the host device, simply ignore this warning. !!"
-                 );
+            return imageCubemapFromLatLong(_dst, _src, _useBilinearInterpolation);
         }
 
-        // Processing is done in Rgba32f format.
+        CMFT_PROFILE_ZONE("imageCubemapFromLatLongGpu");
+
+        // Conversion is done in rgba32f format.
         Image imageRgba32f;
-        imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
 
-        // Alloc dst data.
-        const uint32_t dstFaceSize = (0 == _dstFaceSize) ? _src.m_width : _dstFaceSize;
-        const uint8_t mipMin = 1;
-        const uint8_t mipMax = (uint8_t)log2f(float(int32_t(dstFaceSize)))+uint8_t(1);
-        const uint8_t mipCount = clamp(_mipCount, mipMin, mipMax);
+        // Alloc data.
         const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        uint32_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        uint32_t dstDataSize = 0;
-        for (uint8_t face = 0; face < 6; ++face)
+        const uint32_t dstFaceSize = (imageRgba32f.m_height+1)/2;
+        const uint64_t dstDataSize = uint64_t(dstFaceSize)*dstFaceSize*bytesPerPixel*CUBE_FACE_NUM;
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        const bool converted = cubemapFromLatLongGpu(dstData, dstFaceSize, imageRgba32f, _useBilinearInterpolation, _clContext, _stats);
+        if (!imageIsRef)
         {
-            for (uint8_t mip = 0; mip < mipCount; ++mip)
-            {
-                dstOffsets[face][mip] = dstDataSize;
-                uint32_t faceSize = max(uint32_t(1), dstFaceSize >> mip);
-                dstDataSize += faceSize * faceSize * bytesPerPixel;
-            }
+            imageUnload(imageRgba32f);
         }
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
 
-        // Get source image offsets.
-        uint32_t srcFaceOffsets[CUBE_FACE_NUM];
-        imageGetFaceOffsets(srcFaceOffsets, imageRgba32f);
+        if (!converted)
+        {
+            getAllocator()->free(dstData);
+            return imageCubemapFromLatLong(_dst, _src, _useBilinearInterpolation);
+        }
 
-        // Output info.
-        INFO("Running radiance filter for:"
-             "\n\t[srcFaceSize=%u]"
-             "\n\t[lightingModel=%s]"
-             "\n\t[excludeBase=%s]"
-             "\n\t[mipCount=%u]"
-             "\n\t[glossScale=%u]"
-             "\n\t[glossBias=%u]"
-             "\n\t[dstFaceSize=%u]"
-             , imageRgba32f.m_width
-             , getLightingModelStr(_lightingModel)
-             , &"false\0true"[6*_excludeBase]
-             , mipCount
-             , _glossScale
-             , _glossBias
-             , dstFaceSize
-             );
+        // Fill image structure.
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = 1;
+        result.m_numFaces = 6;
+        result.m_data = dstData;
 
-        // Resize and copy base image.
-        if (_excludeBase)
+        // Convert result to source format.
+        if (TextureFormat::RGBA32F == _src.m_format)
         {
-            INFO("Radiance -> Excluding base image.");
+            imageMove(_dst, result);
+        }
+        else
+        {
+            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
+            imageUnload(result);
+        }
+
+        return true;
+    }
+
+    void imageCubemapFromLatLong(Image& _image, bool _useBilinearInterpolation, const ClContext* _clContext, FilterStats* _stats)
+    {
+        Image tmp;
+        if (imageCubemapFromLatLong(tmp, _image, _useBilinearInterpolation, _clContext, _stats))
+        {
+            imageMove(_image, tmp);
+        }
+    }
 
-            const float dstToSrcRatio = float(int32_t(imageRgba32f.m_width))/float(int32_t(dstFaceSize));
-            const uint32_t dstFacePitch = dstFaceSize * bytesPerPixel;
-            const uint32_t srcFacePitch = imageRgba32f.m_width * bytesPerPixel;
+    /// Texels shared by cube edges and corners of one mip as groups for the averageSeams kernel, in the order the host averages them.
+    /// Texel indices are global, _faceOffsets are the first texels of faces. Returns number of groups, release _groups with free().
+    static uint32_t cubemapSeamGroups(cl_int4*& _groups, const uint64_t _faceOffsets[CUBE_FACE_NUM], uint32_t _faceSize)
+    {
+        const uint32_t maxGroups = 12*(_faceSize-2) + 8;
+        _groups = (cl_int4*)malloc(maxGroups*sizeof(cl_int4));
+        MALLOC_CHECK(_groups);
+
+        uint32_t numGroups = 0;
 
-            // For all top level cubemap faces:
-            for(uint8_t face = 0; face < 6; ++face)
+        // Edges, every shared edge is visited once.
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t edge = 0; edge < 4; ++edge)
             {
-                const uint8_t* srcFaceData = (const uint8_t*)imageRgba32f.m_data + srcFaceOffsets[face];
-                uint8_t* dstFaceData = (uint8_t*)dstData + dstOffsets[face][0];
+                const uint8_t neighbourFace = s_cubeFaceNeighbours[face][edge].m_faceIdx;
+                const uint8_t neighbourEdge = s_cubeFaceNeighbours[face][edge].m_faceEdge;
+                if (neighbourFace < face)
+                {
+                    continue;
+                }
 
-                // Iterate through destination pixels.
-                for (uint32_t yDst = 0; yDst < dstFaceSize; ++yDst)
+                const bool reversed = cubemapEdgeStartCorner(face, edge) != cubemapEdgeStartCorner(neighbourFace, neighbourEdge);
+                for (uint32_t ii = 1; ii < _faceSize-1; ++ii)
                 {
-                    uint8_t* dstFaceRow = (uint8_t*)dstFaceData + yDst*dstFacePitch;
-                    for (uint32_t xDst = 0; xDst < dstFaceSize; ++xDst)
-                    {
-                        float* dstFaceColumn = (float*)((uint8_t*)dstFaceRow + xDst*bytesPerPixel);
+                    cl_int4& group = _groups[numGroups++];
+                    group.s[0] = cl_int(_faceOffsets[face]          + cubemapEdgeTexelIndex(_faceSize, edge,          ii));
+                    group.s[1] = cl_int(_faceOffsets[neighbourFace] + cubemapEdgeTexelIndex(_faceSize, neighbourEdge, reversed ? _faceSize-1-ii : ii));
+                    group.s[2] = -1;
+                    group.s[3] = 0;
+                }
+            }
+        }
 
-                        // For each destination pixel, sample and accumulate color from source.
-                        float color[3] = { 0.0f, 0.0f, 0.0f };
-                        uint32_t weightAccum = 0;
+        // Corners, each one is shared by three faces.
+        cl_int4 corners[8];
+        uint8_t cornerCount[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t ii = 0; ii < 4; ++ii)
+            {
+                const bool right  = (0 != (ii&1));
+                const bool bottom = (0 != (ii&2));
+                const uint8_t corner = cubemapCorner(face, right ? 1.0f : -1.0f, bottom ? 1.0f : -1.0f);
 
-                        for (uint32_t ySrc = uint32_t(float(yDst)*dstToSrcRatio)
-                            , end = ySrc+max(uint32_t(1), uint32_t(dstToSrcRatio))
-                            ; ySrc < end
-                            ; ++ySrc)
-                        {
-                            const uint8_t* srcRowData = (const uint8_t*)srcFaceData + ySrc*srcFacePitch;
+                const uint32_t xx = right  ? _faceSize-1 : 0;
+                const uint32_t yy = bottom ? _faceSize-1 : 0;
+                corners[corner].s[cornerCount[corner]++] = cl_int(_faceOffsets[face] + yy*_faceSize + xx);
+            }
+        }
 
-                            for (uint32_t xSrc = uint32_t(float(xDst)*dstToSrcRatio)
-                                , end = xSrc+max(uint32_t(1), uint32_t(dstToSrcRatio))
-                                ; xSrc < end
-                                ; ++xSrc)
-                            {
-                                const float* srcColumnData = (const float*)((const uint8_t*)srcRowData + xSrc*bytesPerPixel);
-                                color[0] += srcColumnData[0];
-                                color[1] += srcColumnData[1];
-                                color[2] += srcColumnData[2];
-                                weightAccum++;
-                            }
-                        }
+        for (uint8_t corner = 0; corner < 8; ++corner)
+        {
+            DEBUG_CHECK(3 == cornerCount[corner], "Invalid cube corner.");
+            corners[corner].s[3] = 0;
+            _groups[numGroups++] = corners[corner];
+        }
 
-                        // Divide by weight and save to destination pixel.
-                        const float invWeight = 1.0f/float(int32_t(weightAccum));
-                        dstFaceColumn[0] = color[0] * invWeight;
-                        dstFaceColumn[1] = color[1] * invWeight;
-                        dstFaceColumn[2] = color[2] * invWeight;
-                        dstFaceColumn[3] = 1.0f;
-                    }
-                }
-            }
+        return numGroups;
+    }
+
+    /// Box filtered mip chain on the device, all missing mips are generated before the result is read back.
+    /// Returns false if the device is not available, the filter is not a 2x2 box for every mip or the chain doesn't fit a single buffer.
+    static bool mipMapChainGpu(Image& _image, uint8_t _numMips, ResampleFilter::Enum _filter, bool _averageSeams, const ClContext* _clContext, FilterStats* _stats)
+    {
+        if (NULL == _clContext
+        ||  NULL == _clContext->m_context
+        ||  ResampleFilter::Box != _filter)
+        {
+            return false;
         }
 
-        if (mipCount - uint8_t(_excludeBase) <= 0)
+        uint8_t chainLength = 1;
+        for (uint32_t size = max(_image.m_width, _image.m_height); size > 1; size >>= 1)
         {
-            INFO("Radiance -> Nothing left for processing... Increase mip count or do not exclude base image.");
+            chainLength++;
         }
-        else
+
+        const uint8_t srcNumMips = _image.m_numMips;
+        const uint8_t numMips = min(_numMips, min(chainLength, uint8_t(MAX_MIP_NUM)));
+        if (numMips <= srcNumMips)
         {
-            // Build cubemap vectors.
-            float* cubemapVectors = buildCubemapNormalSolidAngle(imageRgba32f.m_width);
-            ScopeFree cleanup(cubemapVectors);
+            return true;
+        }
 
-            // Enqueue memory transfer for cl device.
-            if (s_radianceProgram.isValid())
+        // Every mip has to be an exact half of its parent.
+        for (uint8_t mip = srcNumMips; mip < numMips; ++mip)
+        {
+            if (max(UINT32_C(1), _image.m_width  >> (mip-1)) != max(UINT32_C(1), _image.m_width  >> mip)*2
+            ||  max(UINT32_C(1), _image.m_height >> (mip-1)) != max(UINT32_C(1), _image.m_height >> mip)*2)
             {
-                s_radianceProgram.initDeviceMemory(imageRgba32f, cubemapVectors);
+                return false;
             }
+        }
 
-            // Start global timer.
-            s_globalState.m_startTime = bx::getHPCounter();
-            INFO("Radiance -> Starting filter...");
+        // Fill image structure.
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        Image result;
+        result.m_width = _image.m_width;
+        result.m_height = _image.m_height;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = numMips;
+        result.m_numFaces = _image.m_numFaces;
+        result.m_dataSize = imageGetNumPixels(result)*bytesPerPixel;
 
-            INFO("Radiance -> Utilizing %u CPU processing thread%s%s%s."
-                 , maxActiveCpuThreads
-                 , maxActiveCpuThreads==1?"":"s"
-                 , !s_radianceProgram.isValid()?"":" and "
-                 , !s_radianceProgram.isValid()?"":s_radianceProgram.m_clContext->m_deviceName
-                 );
+        if (result.m_dataSize > clMaxAllocSize(_clContext)
+        ||  result.m_dataSize/bytesPerPixel > uint64_t(INT32_MAX))
+        {
+            return false;
+        }
 
-            // Alloc data for tasks parameters.
-            const uint8_t mipStart = uint8_t(_excludeBase);
-            RadianceFilterTaskList taskList(mipStart, mipCount);
+        cl_program program = _clContext->getProgram(s_resampleProgramSource);
+        if (NULL == program)
+        {
+            return false;
+        }
 
-            const float glossScalef = float(int32_t(_glossScale));
-            const float glossBiasf = float(int32_t(_glossBias));
+        cl_int err;
+        cl_kernel boxKernel = clCreateKernel(program, "mipBox", &err);
+        cl_kernel seamsKernel = (CL_SUCCESS == err) ? clCreateKernel(program, "averageSeams", &err) : NULL;
+        if (CL_SUCCESS != err)
+        {
+            WARN("Could not create OpenCL kernels mipBox and averageSeams.");
+            if (NULL != boxKernel)
+            {
+                clReleaseKernel(boxKernel);
+            }
+            clReleaseProgram(program);
+            return false;
+        }
 
-            //Prepare processing tasks parameters.
-            for (uint32_t mip = mipStart; mip < mipCount; ++mip)
-            {
-                // Determine filter parameters.
-                const uint32_t mipFaceSize = max(UINT32_C(1), dstFaceSize >> mip);
-                const float mipFaceSizef = float(int32_t(mipFaceSize));
-                const float minAngle = atan2f(1.0f, mipFaceSizef);
-                const float maxAngle = float(M_PI)/2.0f;
-                const float toFilterSize = 1.0f/(minAngle*mipFaceSizef*2.0f);
-                const float glossiness = (mipCount == 1)
-                                       ? 1.0f
-                                       : max(0.0f, 1.0f - (float)(int32_t)mip/(float)(int32_t)(mipCount-1))
-                                       ;
-                const float specularPowerRef = powf(2.0f, glossScalef * glossiness + glossBiasf);
-                const float specularPower = applyLightningModel(specularPowerRef, _lightingModel);
-                const float filterAngle = clamp(cosinePowerFilterAngle(specularPower), minAngle, maxAngle);
-                const float cosAngle = max(0.0f, cosf(filterAngle));
-                const float texelSize = 1.0f/mipFaceSizef;
-                const float filterSize = max(texelSize, filterAngle * toFilterSize);
+        CMFT_PROFILE_ZONE("imageGenerateMipMapChainGpu");
 
-                for (uint8_t face = 0; face < 6; ++face)
-                {
-                    float* dstPtr = (float*)((uint8_t*)dstData + dstOffsets[face][mip]);
+        // Processing is done in rgba32f format, recorded face transforms are applied by the conversion.
+        Image imageRgba32f;
+        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _image);
 
-                    RadianceFilterParams taskParams =
-                    {
-                        dstPtr,
-                        face,
-                        mipFaceSize,
-                        filterSize,
-                        specularPower,
-                        cosAngle,
-                        cubemapVectors,
-                        &imageRgba32f,
-                        srcFaceOffsets,
-                    };
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, imageRgba32f);
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, result);
 
-                    // Enqueue processing parameters.
-                    memcpy(&taskList.m_params[mip][face], &taskParams, sizeof(RadianceFilterParams));
-                }
-            }
+        cl_mem memData = CL_CHECK_ERR(clCreateBuffer(_clContext->m_context
+                                    , CL_MEM_READ_WRITE
+                                    , size_t(result.m_dataSize)
+                                    , NULL
+                                    , &err
+                                    ));
 
-            // Output process header info.
-            INFO("Radiance -> ------------------------------------");
-            INFO("Radiance ->  Device / Face /     Time /    Total");
-            INFO("Radiance -> ------------------------------------");
+        // Existing mips are uploaded to their places in the whole chain.
+        uint64_t bytesToDevice = 0;
+        for (uint8_t face = 0; face < result.m_numFaces; ++face)
+        {
+            const uint64_t faceSrcSize = imageRgba32f.m_dataSize/imageRgba32f.m_numFaces;
+            CL_CHECK(clEnqueueWriteBuffer(_clContext->m_commandQueue
+                                        , memData
+                                        , CL_FALSE
+                                        , size_t(offsets[face][0])
+                                        , size_t(faceSrcSize)
+                                        , (const uint8_t*)imageRgba32f.m_data + srcOffsets[face][0]
+                                        , 0
+                                        , NULL
+                                        , NULL
+                                        ));
+            bytesToDevice += faceSrcSize;
+        }
 
-            // Single thread, no OpenCL.
-            if (maxActiveCpuThreads == 1 && !s_radianceProgram.isValid())
+        // Generate missing mips, each from its parent, seams of each mip are averaged before its children are generated.
+        const bool averageSeams = _averageSeams && imageIsCubemap(imageRgba32f);
+        for (uint8_t mip = srcNumMips; mip < numMips; ++mip)
+        {
+            const int32_t width = int32_t(max(UINT32_C(1), result.m_width >> mip));
+            const size_t workSize[2] = { size_t(width), size_t(max(UINT32_C(1), result.m_height >> mip)) };
+            for (uint8_t face = 0; face < result.m_numFaces; ++face)
             {
-                radianceFilterCpu((void*)&taskList);
+                const cl_uint srcOffset = cl_uint(offsets[face][mip-1]/bytesPerPixel);
+                const cl_uint dstOffset = cl_uint(offsets[face][mip]/bytesPerPixel);
+                CL_CHECK(clSetKernelArg(boxKernel, 0, sizeof(cl_mem),  (const void*)&memData));
+                CL_CHECK(clSetKernelArg(boxKernel, 1, sizeof(cl_uint), (const void*)&srcOffset));
+                CL_CHECK(clSetKernelArg(boxKernel, 2, sizeof(cl_uint), (const void*)&dstOffset));
+                CL_CHECK(clSetKernelArg(boxKernel, 3, sizeof(int32_t), (const void*)&width));
+                CL_CHECK(clEnqueueNDRangeKernel(_clContext->m_commandQueue, boxKernel, 2, NULL, workSize, NULL, 0, NULL, NULL));
             }
-            // Multi thread (with or without OpenCL).
-            else
-            {
-                // Start CPU processing threads.
-                while (activeCpuThreads < maxActiveCpuThreads)
-                {
-                    cpuThreads[activeCpuThreads++].init(radianceFilterCpu, (void*)&taskList);
-                }
-
-                // Start one GPU host thread.
-                if (s_radianceProgram.isValid() && s_radianceProgram.isIdle())
-                {
-                    cpuThreads[activeCpuThreads++].init(radianceFilterGpu, (void*)&taskList);
-                }
 
-                // Wait for everything to finish.
-                for (uint8_t ii = 0; ii < activeCpuThreads; ++ii)
+            if (averageSeams && 1 < width)
+            {
+                uint64_t faceOffsets[CUBE_FACE_NUM];
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
                 {
-                    cpuThreads[ii].shutdown();
+                    faceOffsets[face] = offsets[face][mip]/bytesPerPixel;
                 }
-            }
 
-            // Average 1x1 face size.
-            if ((dstFaceSize>>(mipCount-1)) <= 1)
-            {
-                float* face0 = (float*)((uint8_t*)dstData + dstOffsets[0][mipCount-1]);
-                float* face1 = (float*)((uint8_t*)dstData + dstOffsets[1][mipCount-1]);
-                float* face2 = (float*)((uint8_t*)dstData + dstOffsets[2][mipCount-1]);
-                float* face3 = (float*)((uint8_t*)dstData + dstOffsets[3][mipCount-1]);
-                float* face4 = (float*)((uint8_t*)dstData + dstOffsets[4][mipCount-1]);
-                float* face5 = (float*)((uint8_t*)dstData + dstOffsets[5][mipCount-1]);
+                cl_int4* groups;
+                const uint32_t numGroups = cubemapSeamGroups(groups, faceOffsets, uint32_t(width));
 
-                const float color[3] =
-                {
-                    (face0[0] + face1[0] + face2[0] + face3[0] + face4[0] + face5[0]) / 6.0f,
-                    (face0[1] + face1[1] + face2[1] + face3[1] + face4[1] + face5[1]) / 6.0f,
-                    (face0[2] + face1[2] + face2[2] + face3[2] + face4[2] + face5[2]) / 6.0f,
-                };
+                // Buffer is released once the kernel using it is done.
+                cl_mem memGroups = CL_CHECK_ERR(clCreateBuffer(_clContext->m_context
+                                              , CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR
+                                              , numGroups*sizeof(cl_int4)
+                                              , (void*)groups
+                                              , &err
+                                              ));
+                free(groups);
+                bytesToDevice += numGroups*sizeof(cl_int4);
 
-                face0[0] = face1[0] = face2[0] = face3[0] = face4[0] = face5[0] = color[0];
-                face0[1] = face1[1] = face2[1] = face3[1] = face4[1] = face5[1] = color[1];
-                face0[2] = face1[2] = face2[2] = face3[2] = face4[2] = face5[2] = color[2];
+                const size_t groupsWorkSize = numGroups;
+                CL_CHECK(clSetKernelArg(seamsKernel, 0, sizeof(cl_mem), (const void*)&memData));
+                CL_CHECK(clSetKernelArg(seamsKernel, 1, sizeof(cl_mem), (const void*)&memGroups));
+                CL_CHECK(clEnqueueNDRangeKernel(_clContext->m_commandQueue, seamsKernel, 1, NULL, &groupsWorkSize, NULL, 0, NULL, NULL));
+                clReleaseMemObject(memGroups);
             }
+        }
 
-            // Get filter duration.
-            const double freq = double(bx::getHPFrequency());
-            const double toSec = 1.0/freq;
-            const uint64_t totalTime = bx::getHPCounter() - s_globalState.m_startTime;
-
-            // Output progress info.
-            INFO("Radiance -> ------------------------------------");
-            INFO("Radiance -> Total faces processed on [CPU]: %u", s_globalState.m_completedTasksCpu);
-            INFO("Radiance -> Total faces processed on <GPU>: %u", s_globalState.m_completedTasksGpu);
-            INFO("Radiance -> Total time: %.3f seconds.", double(totalTime)*toSec);
+        // Read back the whole chain.
+        result.m_data = getAllocator()->alloc(result.m_dataSize);
+        MALLOC_CHECK(result.m_data);
+        CL_CHECK(clEnqueueReadBuffer(_clContext->m_commandQueue
+                                   , memData
+                                   , CL_TRUE
+                                   , 0
+                                   , size_t(result.m_dataSize)
+                                   , result.m_data
+                                   , 0
+                                   , NULL
+                                   , NULL
+                                   ));
 
-            // Cleanup.
-            if (s_radianceProgram.isValid())
-            {
-                s_radianceProgram.releaseDeviceMemory();
-                s_radianceProgram.destroy();
-            }
+        if (NULL != _stats)
+        {
+            _stats->m_bytesToDevice += bytesToDevice;
+            _stats->m_bytesFromDevice += result.m_dataSize;
         }
 
-        // Fill result structure.
-        Image result;
-        result.m_width = dstFaceSize;
-        result.m_height = dstFaceSize;
-        result.m_dataSize = dstDataSize;
-        result.m_format = TextureFormat::RGBA32F;
-        result.m_numMips = mipCount;
-        result.m_numFaces = 6;
-        result.m_data = dstData;
+        clReleaseMemObject(memData);
+        clReleaseKernel(seamsKernel);
+        clReleaseKernel(boxKernel);
+        clReleaseProgram(program);
 
-        // Convert back to source format.
-        if (TextureFormat::RGBA32F == _src.m_format)
+        if (!imageIsRef)
         {
-            imageMove(_dst, result);
+            imageUnload(imageRgba32f);
+        }
+
+        // Convert result to source format.
+        const TextureFormat::Enum format = (TextureFormat::Enum)_image.m_format;
+        if (TextureFormat::RGBA32F == format)
+        {
+            imageMove(_image, result);
         }
         else
         {
-            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
+            imageConvert(_image, format, result);
             imageUnload(result);
         }
 
         return true;
     }
 
-    void imageRadianceFilter(Image& _image
-                           , uint32_t _dstFaceSize
-                           , LightingModel::Enum _lightingModel
-                           , bool _excludeBase
-                           , uint8_t _mipCount
-                           , uint8_t _glossScale
-                           , uint8_t _glossBias
-                           , int8_t _numCpuProcessingThreads
-                           , const ClContext* _clContext
-                           )
+    void imageGenerateMipMapChain(Image& _image, uint8_t _numMips, ResampleFilter::Enum _filter, bool _averageSeams, const ClContext* _clContext, FilterStats* _stats)
     {
-        Image tmp;
-        if(imageRadianceFilter(tmp, _dstFaceSize, _lightingModel, _excludeBase, _mipCount, _glossScale, _glossBias, _image, _numCpuProcessingThreads, _clContext))
+        AllocTagScope allocTag(AllocTag::MipChain, true);
+
+        if (!mipMapChainGpu(_image, _numMips, _filter, _averageSeams, _clContext, _stats))
         {
-            imageMove(_image, tmp);
+            imageGenerateMipMapChain(_image, _numMips, _filter, _averageSeams);
         }
     }
 
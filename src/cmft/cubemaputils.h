@@ -8,6 +8,8 @@
 
 #include "base/fpumath.h"
 
+#include <bx/float4_t.h>
+
 namespace cmft
 {
     ///
@@ -139,18 +141,66 @@ namespace cmft
         }
     };
 
-    /// _u and _v should be center adressing and in [-1.0+invSize..1.0-invSize] range.
-    static inline void texelCoordToVec(float* _out3f, float _u, float _v, uint8_t _faceId, uint32_t _faceSize = 1)
+    /// Texel index within face of texel _idx of face edge. Index runs along increasing u for top/bottom edges and increasing v for left/right edges.
+    static inline uint32_t cubemapEdgeTexelIndex(uint32_t _faceSize, uint8_t _edge, uint32_t _idx)
+    {
+        uint32_t xx;
+        uint32_t yy;
+        switch (_edge)
+        {
+        case CMFT_EDGE_LEFT:   xx = 0;           yy = _idx;        break;
+        case CMFT_EDGE_RIGHT:  xx = _faceSize-1; yy = _idx;        break;
+        case CMFT_EDGE_TOP:    xx = _idx;        yy = 0;           break;
+        default:               xx = _idx;        yy = _faceSize-1; break;
+        }
+
+        return yy*_faceSize + xx;
+    }
+
+    /// Cube corner at face texel (u, v), u and v being -1 or 1. Encoded as (x>0)*4 + (y>0)*2 + (z>0).
+    static inline uint8_t cubemapCorner(uint8_t _face, float _u, float _v)
+    {
+        uint8_t corner = 0;
+        for (uint8_t ii = 0; ii < 3; ++ii)
+        {
+            const float pos = _u*s_faceUvVectors[_face][0][ii]
+                            + _v*s_faceUvVectors[_face][1][ii]
+                            +    s_faceUvVectors[_face][2][ii]
+                            ;
+            corner = uint8_t(corner*2 + (pos > 0.0f ? 1 : 0));
+        }
+
+        return corner;
+    }
+
+    /// Cube corner at the start (idx = 0) of face edge.
+    static inline uint8_t cubemapEdgeStartCorner(uint8_t _face, uint8_t _edge)
+    {
+        const float uu = (CMFT_EDGE_RIGHT  == _edge) ? 1.0f : -1.0f;
+        const float vv = (CMFT_EDGE_BOTTOM == _edge) ? 1.0f : -1.0f;
+        return cubemapCorner(_face, uu, vv);
+    }
+
+    /// Edge fixup of a face coordinate, as done by texelCoordToVec().
+    /// Code from Nvtt : http://code.google.com/p/nvidia-texture-tools/source/browse/trunk/src/nvtt/CubeSurface.cpp
+    static inline float texelCoordWarp(float _coord, uint32_t _faceSize)
     {
-        if (1 != _faceSize)
+        if (1 == _faceSize)
         {
-            // Edge fixup.
-            // Code from Nvtt : http://code.google.com/p/nvidia-texture-tools/source/browse/trunk/src/nvtt/CubeSurface.cpp
-            const float a = float(_faceSize*_faceSize) / powf(float(_faceSize - 1), 3.0f);
-            _u = a * powf(_u, 3.0f) + _u;
-            _v = a * powf(_v, 3.0f) + _v;
+            return _coord;
         }
 
+        const float a = float(_faceSize*_faceSize) / powf(float(_faceSize - 1), 3.0f);
+        return a * powf(_coord, 3.0f) + _coord;
+    }
+
+    /// _u and _v should be center adressing and in [-1.0+invSize..1.0-invSize] range.
+    static inline void texelCoordToVec(float* _out3f, float _u, float _v, uint8_t _faceId, uint32_t _faceSize = 1)
+    {
+        // Edge fixup.
+        _u = texelCoordWarp(_u, _faceSize);
+        _v = texelCoordWarp(_v, _faceSize);
+
         // This does: Dst = normalize(u * s_faceUv[0] + v * s_faceUv[1] + s_faceUv[2]).
         float tmp0[3];
         float tmp1[3];
@@ -209,6 +259,62 @@ namespace cmft
         _v = theta*invPi;
     }
 
+    /// Four lanes version of latLongFromVec(), _x, _y and _z are normalized vector components.
+    /// Uses polynomial atan2 and acos approximations (Abramowitz & Stegun 4.4.49 and 4.4.46), error is below 1e-6 radians.
+    static inline void latLongFromVec4(bx::float4_t& _u, bx::float4_t& _v, bx::float4_t _x, bx::float4_t _y, bx::float4_t _z)
+    {
+        using namespace bx;
+
+        const float4_t zero   = float4_zero();
+        const float4_t one    = float4_splat(1.0f);
+        const float4_t pi     = float4_splat(float(M_PI));
+        const float4_t halfPi = float4_splat(float(M_PI)*0.5f);
+
+        // phi = atan2(z, -x), atan() is evaluated on [0, 1] and mapped to the right octant.
+        // Octants are picked by sign bits, so signed zeros map like atan2f() does.
+        const float4_t yy = _z;
+        const float4_t xx = float4_xor(_x, float4_splat(-0.0f));
+        const float4_t ax = float4_abs(xx);
+        const float4_t ay = float4_abs(yy);
+        const float4_t tt = float4_div(float4_min(ax, ay), float4_max(float4_max(ax, ay), float4_splat(1e-30f)));
+        const float4_t t2 = float4_mul(tt, tt);
+
+        float4_t atanPoly = float4_splat( 0.0028662257f);
+        atanPoly = float4_madd(atanPoly, t2, float4_splat(-0.0161657367f));
+        atanPoly = float4_madd(atanPoly, t2, float4_splat( 0.0429096138f));
+        atanPoly = float4_madd(atanPoly, t2, float4_splat(-0.0752896400f));
+        atanPoly = float4_madd(atanPoly, t2, float4_splat( 0.1065626393f));
+        atanPoly = float4_madd(atanPoly, t2, float4_splat(-0.1420889944f));
+        atanPoly = float4_madd(atanPoly, t2, float4_splat( 0.1999355085f));
+        atanPoly = float4_madd(atanPoly, t2, float4_splat(-0.3333314528f));
+        atanPoly = float4_madd(atanPoly, t2, one);
+        atanPoly = float4_mul(atanPoly, tt);
+
+        atanPoly = float4_selb(float4_cmpgt(ay, ax), float4_sub(halfPi, atanPoly), atanPoly);
+        atanPoly = float4_selb(float4_sra(xx, 31), float4_sub(pi, atanPoly), atanPoly);
+        const float4_t phi = float4_selb(float4_sra(yy, 31), float4_neg(atanPoly), atanPoly);
+
+        // theta = acos(y), evaluated for |y| and mirrored.
+        const float4_t ty = float4_min(float4_abs(_y), one);
+
+        float4_t acosPoly = float4_splat(-0.0012624911f);
+        acosPoly = float4_madd(acosPoly, ty, float4_splat( 0.0066700901f));
+        acosPoly = float4_madd(acosPoly, ty, float4_splat(-0.0170881256f));
+        acosPoly = float4_madd(acosPoly, ty, float4_splat( 0.0308918810f));
+        acosPoly = float4_madd(acosPoly, ty, float4_splat(-0.0501743046f));
+        acosPoly = float4_madd(acosPoly, ty, float4_splat( 0.0889789874f));
+        acosPoly = float4_madd(acosPoly, ty, float4_splat(-0.2145988016f));
+        acosPoly = float4_madd(acosPoly, ty, float4_splat( 1.5707963050f));
+        acosPoly = float4_mul(acosPoly, float4_sqrt(float4_sub(one, ty)));
+
+        const float4_t theta = float4_selb(float4_cmplt(_y, zero), float4_sub(pi, acosPoly), acosPoly);
+
+        const float4_t invHalfPi = float4_splat(0.15915494309f);
+        const float4_t invPi = float4_splat(0.31830988618f);
+        _u = float4_min(float4_mul(float4_add(pi, phi), invHalfPi), one);
+        _v = float4_min(float4_mul(theta, invPi), one);
+    }
+
     /// For right-handed coordinate system.
     /// _u, _v are in [0.0-1.0] range.
     static inline void vecFromLatLong(float _vec[3], float _u, float _v)
@@ -221,6 +327,45 @@ namespace cmft
         _vec[2] = -sinf(theta)*sinf(phi);
     }
 
+    /// Octahedral map: upper hemisphere (+Y) is the inner diamond of the map, lower hemisphere is folded over to the corners.
+    /// Map x runs along +X and map y along +Z, both at the center of the map.
+    /// _u and _v are in [0.0-1.0] range.
+    static inline void vecFromOctahedral(float _vec[3], float _u, float _v)
+    {
+        const float uu = _u*2.0f - 1.0f;
+        const float vv = _v*2.0f - 1.0f;
+
+        float tmp[3];
+        tmp[0] = uu;
+        tmp[1] = 1.0f - fabsf(uu) - fabsf(vv);
+        tmp[2] = vv;
+        if (tmp[1] < 0.0f)
+        {
+            tmp[0] = (1.0f - fabsf(vv)) * (uu >= 0.0f ? 1.0f : -1.0f);
+            tmp[2] = (1.0f - fabsf(uu)) * (vv >= 0.0f ? 1.0f : -1.0f);
+        }
+
+        vec3Norm(_vec, tmp);
+    }
+
+    /// Inverse of vecFromOctahedral(). _u, _v are in [0.0-1.0] range.
+    static inline void octahedralFromVec(float& _u, float& _v, const float _vec[3])
+    {
+        const float invL1 = 1.0f/(fabsf(_vec[0]) + fabsf(_vec[1]) + fabsf(_vec[2]));
+        float uu = _vec[0]*invL1;
+        float vv = _vec[2]*invL1;
+        if (_vec[1] < 0.0f)
+        {
+            const float fu = (1.0f - fabsf(vv)) * (uu >= 0.0f ? 1.0f : -1.0f);
+            const float fv = (1.0f - fabsf(uu)) * (vv >= 0.0f ? 1.0f : -1.0f);
+            uu = fu;
+            vv = fv;
+        }
+
+        _u = (uu + 1.0f)*0.5f;
+        _v = (vv + 1.0f)*0.5f;
+    }
+
     /// http://www.mpia-hd.mpg.de/~mathar/public/mathar20051002.pdf
     /// http://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/
     static inline float areaElement(float _x, float _y)
@@ -0,0 +1,971 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "base/config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bx/uint32_t.h> // bx::uint32_cntlz
+
+#include "base/utils.h"
+#include "deflate.h"
+
+namespace cmft
+{
+    // Deflate tables (RFC 1951).
+    //-----
+
+    #define DEFLATE_NUM_LITLEN  288
+    #define DEFLATE_NUM_DIST    30
+    #define DEFLATE_NUM_CODELEN 19
+    #define DEFLATE_MAX_BITS    15
+    #define DEFLATE_WINDOW      32768
+    #define DEFLATE_MIN_MATCH   3
+    #define DEFLATE_MAX_MATCH   258
+
+    static const uint16_t s_lengthBase[29] =
+    {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+    };
+
+    static const uint8_t s_lengthExtra[29] =
+    {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+    };
+
+    static const uint16_t s_distBase[DEFLATE_NUM_DIST] =
+    {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+    };
+
+    static const uint8_t s_distExtra[DEFLATE_NUM_DIST] =
+    {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+    };
+
+    static const uint8_t s_codeLengthOrder[DEFLATE_NUM_CODELEN] =
+    {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+    };
+
+    static uint32_t adler32(const uint8_t* _data, uint32_t _size)
+    {
+        uint32_t aa = 1;
+        uint32_t bb = 0;
+        while (_size > 0)
+        {
+            // Largest run that can not overflow before the modulo.
+            const uint32_t num = min(_size, UINT32_C(5552));
+            for (uint32_t ii = 0; ii < num; ++ii)
+            {
+                aa += _data[ii];
+                bb += aa;
+            }
+            aa %= 65521;
+            bb %= 65521;
+            _data += num;
+            _size -= num;
+        }
+
+        return (bb<<16) | aa;
+    }
+
+    static inline uint32_t reverseBits(uint32_t _code, uint32_t _numBits)
+    {
+        uint32_t result = 0;
+        for (uint32_t ii = 0; ii < _numBits; ++ii)
+        {
+            result = (result<<1) | (_code&1);
+            _code >>= 1;
+        }
+        return result;
+    }
+
+    /// Canonical codes from code lengths. Codes are bit reversed, as they are written starting with the lowest bit.
+    static void huffmanCodes(uint16_t* _codes, const uint8_t* _lengths, uint32_t _num)
+    {
+        uint16_t count[DEFLATE_MAX_BITS+1];
+        memset(count, 0, sizeof(count));
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            ++count[_lengths[ii]];
+        }
+        count[0] = 0;
+
+        uint32_t next[DEFLATE_MAX_BITS+1];
+        uint32_t code = 0;
+        for (uint32_t bits = 1; bits <= DEFLATE_MAX_BITS; ++bits)
+        {
+            code = (code + count[bits-1]) << 1;
+            next[bits] = code;
+        }
+
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            const uint8_t len = _lengths[ii];
+            if (0 != len)
+            {
+                _codes[ii] = uint16_t(reverseBits(next[len]++, len));
+            }
+        }
+    }
+
+    // Inflate.
+    //-----
+
+    #define INFLATE_FAST_BITS 10
+
+    struct InflateHuffman
+    {
+        uint16_t m_fast[1<<INFLATE_FAST_BITS]; //!< Symbol<<4 | length for codes up to INFLATE_FAST_BITS long, 0 for longer ones.
+        uint16_t m_count[DEFLATE_MAX_BITS+1];  //!< Number of codes of each length.
+        uint16_t m_symbol[DEFLATE_NUM_LITLEN]; //!< Symbols ordered by code.
+    };
+
+    /// Over-subscribed code sets are rejected. Incomplete ones are valid, deflate uses them for a single distance code.
+    static bool inflateHuffmanInit(InflateHuffman& _huff, const uint8_t* _lengths, uint32_t _num)
+    {
+        memset(_huff.m_count, 0, sizeof(_huff.m_count));
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            ++_huff.m_count[_lengths[ii]];
+        }
+        _huff.m_count[0] = 0;
+
+        int32_t left = 1;
+        for (uint32_t len = 1; len <= DEFLATE_MAX_BITS; ++len)
+        {
+            left <<= 1;
+            left -= _huff.m_count[len];
+            if (left < 0)
+            {
+                return false;
+            }
+        }
+
+        uint16_t offsets[DEFLATE_MAX_BITS+1];
+        offsets[1] = 0;
+        for (uint32_t len = 1; len < DEFLATE_MAX_BITS; ++len)
+        {
+            offsets[len+1] = offsets[len] + _huff.m_count[len];
+        }
+
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            if (0 != _lengths[ii])
+            {
+                _huff.m_symbol[offsets[_lengths[ii]]++] = uint16_t(ii);
+            }
+        }
+
+        uint16_t codes[DEFLATE_NUM_LITLEN];
+        huffmanCodes(codes, _lengths, _num);
+
+        memset(_huff.m_fast, 0, sizeof(_huff.m_fast));
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            const uint32_t len = _lengths[ii];
+            if (0 != len && len <= INFLATE_FAST_BITS)
+            {
+                for (uint32_t idx = codes[ii]; idx < (1<<INFLATE_FAST_BITS); idx += (1<<len))
+                {
+                    _huff.m_fast[idx] = uint16_t((ii<<4) | len);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    struct InflateState
+    {
+        const uint8_t* m_src;
+        const uint8_t* m_srcEnd;
+        uint64_t m_bits;
+        uint32_t m_numBits;
+        uint32_t m_overrun; //!< Zero bytes fed in past the end of the stream.
+    };
+
+    static inline void inflateRefill(InflateState& _state)
+    {
+        while (_state.m_numBits <= 56)
+        {
+            uint64_t byte = 0;
+            if (_state.m_src < _state.m_srcEnd)
+            {
+                byte = *_state.m_src++;
+            }
+            else
+            {
+                ++_state.m_overrun;
+            }
+            _state.m_bits |= byte << _state.m_numBits;
+            _state.m_numBits += 8;
+        }
+    }
+
+    static inline uint32_t inflateBits(InflateState& _state, uint32_t _numBits)
+    {
+        if (_state.m_numBits < _numBits)
+        {
+            inflateRefill(_state);
+        }
+
+        const uint32_t value = uint32_t(_state.m_bits & ((UINT64_C(1)<<_numBits)-1));
+        _state.m_bits >>= _numBits;
+        _state.m_numBits -= _numBits;
+        return value;
+    }
+
+    /// Returns decoded symbol, or -1 for an invalid code.
+    static inline int32_t inflateDecode(InflateState& _state, const InflateHuffman& _huff)
+    {
+        if (_state.m_numBits < DEFLATE_MAX_BITS)
+        {
+            inflateRefill(_state);
+        }
+
+        const uint16_t entry = _huff.m_fast[_state.m_bits & ((1<<INFLATE_FAST_BITS)-1)];
+        if (0 != entry)
+        {
+            _state.m_bits >>= (entry&0xf);
+            _state.m_numBits -= (entry&0xf);
+            return entry>>4;
+        }
+
+        // Long codes are decoded bit by bit.
+        int32_t code = 0;
+        int32_t first = 0;
+        int32_t index = 0;
+        for (uint32_t len = 1; len <= DEFLATE_MAX_BITS; ++len)
+        {
+            code |= int32_t(_state.m_bits&1);
+            _state.m_bits >>= 1;
+            _state.m_numBits -= 1;
+
+            const int32_t count = _huff.m_count[len];
+            if (code - count < first)
+            {
+                return _huff.m_symbol[index + (code-first)];
+            }
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+
+        return -1;
+    }
+
+    static bool inflateCodes(uint8_t* _dst, uint32_t& _pos, uint32_t _dstSize, InflateState& _state, const InflateHuffman& _litLen, const InflateHuffman& _dist)
+    {
+        for (;;)
+        {
+            const int32_t sym = inflateDecode(_state, _litLen);
+            if (sym < 256)
+            {
+                if (sym < 0 || _pos == _dstSize)
+                {
+                    return false;
+                }
+                _dst[_pos++] = uint8_t(sym);
+            }
+            else if (256 == sym)
+            {
+                return true;
+            }
+            else
+            {
+                const uint32_t lenIdx = uint32_t(sym-257);
+                if (lenIdx >= 29)
+                {
+                    return false;
+                }
+                const uint32_t len = s_lengthBase[lenIdx] + inflateBits(_state, s_lengthExtra[lenIdx]);
+
+                const int32_t distSym = inflateDecode(_state, _dist);
+                if (distSym < 0 || distSym >= DEFLATE_NUM_DIST)
+                {
+                    return false;
+                }
+                const uint32_t dist = s_distBase[distSym] + inflateBits(_state, s_distExtra[distSym]);
+
+                if (dist > _pos || len > _dstSize-_pos)
+                {
+                    return false;
+                }
+
+                // Byte by byte, source and destination overlap when dist < len.
+                const uint8_t* from = _dst + _pos - dist;
+                uint8_t* to = _dst + _pos;
+                for (uint32_t ii = 0; ii < len; ++ii)
+                {
+                    to[ii] = from[ii];
+                }
+                _pos += len;
+            }
+        }
+    }
+
+    bool zlibDecompress(uint8_t* _dst, uint32_t _dstSize, const uint8_t* _src, uint32_t _srcSize)
+    {
+        if (_srcSize < 6)
+        {
+            return false;
+        }
+
+        // Deflate method, no preset dictionary.
+        const uint8_t cmf = _src[0];
+        const uint8_t flg = _src[1];
+        if (8 != (cmf&0xf)
+        ||  (cmf>>4) > 7
+        ||  0 != (uint32_t(cmf)*256 + flg)%31
+        ||  0 != (flg&0x20))
+        {
+            return false;
+        }
+
+        InflateState state;
+        state.m_src = _src + 2;
+        state.m_srcEnd = _src + _srcSize;
+        state.m_bits = 0;
+        state.m_numBits = 0;
+        state.m_overrun = 0;
+
+        InflateHuffman litLen;
+        InflateHuffman dist;
+        uint32_t pos = 0;
+        bool final = false;
+        while (!final)
+        {
+            final = (0 != inflateBits(state, 1));
+            const uint32_t type = inflateBits(state, 2);
+
+            if (0 == type)
+            {
+                // Stored block starts at the next byte.
+                inflateBits(state, state.m_numBits&7);
+                const uint32_t len  = inflateBits(state, 16);
+                const uint32_t nlen = inflateBits(state, 16);
+                if (len != (~nlen&0xffff)
+                ||  len > _dstSize-pos)
+                {
+                    return false;
+                }
+
+                for (uint32_t ii = 0; ii < len; ++ii)
+                {
+                    _dst[pos++] = uint8_t(inflateBits(state, 8));
+                }
+            }
+            else if (1 == type || 2 == type)
+            {
+                uint8_t lengths[DEFLATE_NUM_LITLEN+DEFLATE_NUM_DIST];
+                uint32_t numLit;
+                uint32_t numDist;
+
+                if (1 == type)
+                {
+                    // Fixed codes.
+                    numLit = DEFLATE_NUM_LITLEN;
+                    numDist = DEFLATE_NUM_DIST;
+                    memset(&lengths[0],   8, 144);
+                    memset(&lengths[144], 9, 112);
+                    memset(&lengths[256], 7, 24);
+                    memset(&lengths[280], 8, 8);
+                    memset(&lengths[DEFLATE_NUM_LITLEN], 5, DEFLATE_NUM_DIST);
+                }
+                else
+                {
+                    // Dynamic codes, code lengths are themselves Huffman coded.
+                    numLit  = inflateBits(state, 5) + 257;
+                    numDist = inflateBits(state, 5) + 1;
+                    const uint32_t numCodeLen = inflateBits(state, 4) + 4;
+                    if (numLit > 286 || numDist > DEFLATE_NUM_DIST)
+                    {
+                        return false;
+                    }
+
+                    uint8_t codeLengths[DEFLATE_NUM_CODELEN];
+                    memset(codeLengths, 0, sizeof(codeLengths));
+                    for (uint32_t ii = 0; ii < numCodeLen; ++ii)
+                    {
+                        codeLengths[s_codeLengthOrder[ii]] = uint8_t(inflateBits(state, 3));
+                    }
+
+                    InflateHuffman codeLen;
+                    if (!inflateHuffmanInit(codeLen, codeLengths, DEFLATE_NUM_CODELEN))
+                    {
+                        return false;
+                    }
+
+                    const uint32_t numLengths = numLit + numDist;
+                    for (uint32_t ii = 0; ii < numLengths; )
+                    {
+                        const int32_t sym = inflateDecode(state, codeLen);
+                        if (sym < 0)
+                        {
+                            return false;
+                        }
+
+                        if (sym < 16)
+                        {
+                            lengths[ii++] = uint8_t(sym);
+                            continue;
+                        }
+
+                        uint8_t value = 0;
+                        uint32_t repeat;
+                        if (16 == sym)
+                        {
+                            if (0 == ii)
+                            {
+                                return false;
+                            }
+                            value = lengths[ii-1];
+                            repeat = 3 + inflateBits(state, 2);
+                        }
+                        else if (17 == sym)
+                        {
+                            repeat = 3 + inflateBits(state, 3);
+                        }
+                        else
+                        {
+                            repeat = 11 + inflateBits(state, 7);
+                        }
+
+                        if (ii + repeat > numLengths)
+                        {
+                            return false;
+                        }
+                        memset(&lengths[ii], value, repeat);
+                        ii += repeat;
+                    }
+
+                    if (0 == lengths[256])
+                    {
+                        return false;
+                    }
+                }
+
+                if (!inflateHuffmanInit(litLen, lengths, numLit)
+                ||  !inflateHuffmanInit(dist, lengths+numLit, numDist)
+                ||  !inflateCodes(_dst, pos, _dstSize, state, litLen, dist))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+
+            // Reading zeros past the end means the stream is truncated.
+            if (state.m_overrun*8 > state.m_numBits)
+            {
+                return false;
+            }
+        }
+
+        if (pos != _dstSize)
+        {
+            return false;
+        }
+
+        // Adler-32 follows at the next byte, big endian.
+        const uint32_t loaded = uint32_t(state.m_src - _src) + state.m_overrun;
+        const uint32_t trailer = loaded - state.m_numBits/8;
+        if (trailer + 4 > _srcSize)
+        {
+            return false;
+        }
+
+        const uint32_t adler = (uint32_t(_src[trailer+0])<<24)
+                             | (uint32_t(_src[trailer+1])<<16)
+                             | (uint32_t(_src[trailer+2])<<8)
+                             |  uint32_t(_src[trailer+3]);
+
+        return adler == adler32(_dst, _dstSize);
+    }
+
+    // Deflate.
+    //-----
+
+    #define DEFLATE_HASH_BITS     15
+    #define DEFLATE_MAX_CHAIN     32
+    #define DEFLATE_BLOCK_SYMBOLS (1<<15)
+
+    struct DeflateWriter
+    {
+        uint8_t* m_dst;
+        uint32_t m_capacity;
+        uint32_t m_pos;
+        uint64_t m_bits;
+        uint32_t m_numBits;
+        bool m_overflow;
+    };
+
+    static inline void deflateWrite(DeflateWriter& _writer, uint32_t _value, uint32_t _numBits)
+    {
+        _writer.m_bits |= uint64_t(_value) << _writer.m_numBits;
+        _writer.m_numBits += _numBits;
+        while (_writer.m_numBits >= 8)
+        {
+            if (_writer.m_pos < _writer.m_capacity)
+            {
+                _writer.m_dst[_writer.m_pos++] = uint8_t(_writer.m_bits);
+            }
+            else
+            {
+                _writer.m_overflow = true;
+            }
+            _writer.m_bits >>= 8;
+            _writer.m_numBits -= 8;
+        }
+    }
+
+    static inline void deflateFlush(DeflateWriter& _writer)
+    {
+        if (0 != _writer.m_numBits)
+        {
+            deflateWrite(_writer, 0, 8-_writer.m_numBits);
+        }
+    }
+
+    struct DeflateSymbol
+    {
+        uint16_t m_litLen; //!< Literal byte, or match length when m_dist is not 0.
+        uint16_t m_dist;
+    };
+
+    /// Length code 257-285 of a match length in [3, 258].
+    static inline uint32_t deflateLengthCode(uint32_t _len)
+    {
+        if (DEFLATE_MAX_MATCH == _len)
+        {
+            return 285;
+        }
+
+        const uint32_t vv = _len-3;
+        if (vv < 8)
+        {
+            return 257 + vv;
+        }
+
+        const uint32_t hb = 31 - bx::uint32_cntlz(vv);
+        return 257 + 4*(hb-1) + ((vv>>(hb-2))&3);
+    }
+
+    /// Distance code 0-29 of a distance in [1, 32768].
+    static inline uint32_t deflateDistCode(uint32_t _dist)
+    {
+        if (_dist <= 4)
+        {
+            return _dist-1;
+        }
+
+        const uint32_t vv = _dist-1;
+        const uint32_t hb = 31 - bx::uint32_cntlz(vv);
+        return 2*hb + ((vv>>(hb-1))&1);
+    }
+
+    /// Every code needs two symbols at least to be complete.
+    static inline void huffmanEnsureTwoSymbols(uint32_t* _freqs, uint32_t _num)
+    {
+        uint32_t used = 0;
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            used += (0 != _freqs[ii]);
+        }
+
+        for (uint32_t ii = 0; used < 2; ++ii)
+        {
+            if (0 == _freqs[ii])
+            {
+                _freqs[ii] = 1;
+                ++used;
+            }
+        }
+    }
+
+    /// Huffman code lengths of symbol frequencies, limited to _maxBits.
+    static void huffmanLengths(uint8_t* _lengths, const uint32_t* _freqs, uint32_t _num, uint32_t _maxBits)
+    {
+        memset(_lengths, 0, _num);
+
+        // Used symbols, sorted by increasing frequency.
+        uint16_t sorted[DEFLATE_NUM_LITLEN];
+        uint32_t numUsed = 0;
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            if (0 != _freqs[ii])
+            {
+                uint32_t jj = numUsed++;
+                for (; jj > 0 && _freqs[sorted[jj-1]] > _freqs[ii]; --jj)
+                {
+                    sorted[jj] = sorted[jj-1];
+                }
+                sorted[jj] = uint16_t(ii);
+            }
+        }
+
+        if (numUsed < 2)
+        {
+            _lengths[sorted[0]] = 1;
+            return;
+        }
+
+        // Two queue construction. Leaves are nodes [0, numUsed), internal nodes are appended in increasing weight order.
+        uint32_t weight[2*DEFLATE_NUM_LITLEN];
+        uint16_t parent[2*DEFLATE_NUM_LITLEN];
+        for (uint32_t ii = 0; ii < numUsed; ++ii)
+        {
+            weight[ii] = _freqs[sorted[ii]];
+        }
+
+        uint32_t leaf = 0;
+        uint32_t node = numUsed;
+        uint32_t next = numUsed;
+        for (uint32_t ii = 1; ii < numUsed; ++ii)
+        {
+            uint32_t pick[2];
+            for (uint8_t kk = 0; kk < 2; ++kk)
+            {
+                if (leaf < numUsed && (node >= next || weight[leaf] <= weight[node]))
+                {
+                    pick[kk] = leaf++;
+                }
+                else
+                {
+                    pick[kk] = node++;
+                }
+            }
+            weight[next] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = uint16_t(next);
+            parent[pick[1]] = uint16_t(next);
+            ++next;
+        }
+
+        // Depths from the root, which is the last node.
+        uint16_t depth[2*DEFLATE_NUM_LITLEN];
+        depth[next-1] = 0;
+        for (uint32_t ii = next-1; ii-- > 0; )
+        {
+            depth[ii] = depth[parent[ii]] + 1;
+        }
+
+        uint32_t numCodes[2*DEFLATE_NUM_LITLEN];
+        memset(numCodes, 0, sizeof(numCodes));
+        for (uint32_t ii = 0; ii < numUsed; ++ii)
+        {
+            ++numCodes[depth[ii]];
+        }
+
+        // Longer codes are moved to _maxBits, then shorter codes are lengthened until the code is complete again.
+        for (uint32_t len = _maxBits+1; len < 2*DEFLATE_NUM_LITLEN; ++len)
+        {
+            numCodes[_maxBits] += numCodes[len];
+        }
+
+        uint32_t total = 0;
+        for (uint32_t len = _maxBits; len > 0; --len)
+        {
+            total += numCodes[len] << (_maxBits-len);
+        }
+
+        while (total != (UINT32_C(1)<<_maxBits))
+        {
+            --numCodes[_maxBits];
+            for (uint32_t len = _maxBits-1; len > 0; --len)
+            {
+                if (0 != numCodes[len])
+                {
+                    --numCodes[len];
+                    numCodes[len+1] += 2;
+                    break;
+                }
+            }
+            --total;
+        }
+
+        // Least frequent symbols get the longest codes.
+        uint32_t idx = 0;
+        for (uint32_t len = _maxBits; len > 0; --len)
+        {
+            for (uint32_t ii = 0; ii < numCodes[len]; ++ii)
+            {
+                _lengths[sorted[idx++]] = uint8_t(len);
+            }
+        }
+    }
+
+    static void deflateWriteBlock(DeflateWriter& _writer, const DeflateSymbol* _symbols, uint32_t _numSymbols, bool _final)
+    {
+        uint32_t litFreq[286];
+        uint32_t distFreq[DEFLATE_NUM_DIST];
+        memset(litFreq, 0, sizeof(litFreq));
+        memset(distFreq, 0, sizeof(distFreq));
+        for (uint32_t ii = 0; ii < _numSymbols; ++ii)
+        {
+            if (0 == _symbols[ii].m_dist)
+            {
+                ++litFreq[_symbols[ii].m_litLen];
+            }
+            else
+            {
+                ++litFreq[deflateLengthCode(_symbols[ii].m_litLen)];
+                ++distFreq[deflateDistCode(_symbols[ii].m_dist)];
+            }
+        }
+        litFreq[256] = 1;
+        huffmanEnsureTwoSymbols(litFreq, 286);
+        huffmanEnsureTwoSymbols(distFreq, DEFLATE_NUM_DIST);
+
+        // Literal/length and distance code lengths go one after another.
+        uint8_t lengths[286+DEFLATE_NUM_DIST];
+        uint8_t distLengths[DEFLATE_NUM_DIST];
+        huffmanLengths(lengths, litFreq, 286, DEFLATE_MAX_BITS);
+        huffmanLengths(distLengths, distFreq, DEFLATE_NUM_DIST, DEFLATE_MAX_BITS);
+
+        uint32_t numLit = 286;
+        while (0 == lengths[numLit-1])
+        {
+            --numLit;
+        }
+        uint32_t numDist = DEFLATE_NUM_DIST;
+        while (0 == distLengths[numDist-1])
+        {
+            --numDist;
+        }
+
+        uint16_t litCodes[286];
+        uint16_t distCodes[DEFLATE_NUM_DIST];
+        huffmanCodes(litCodes, lengths, numLit);
+        huffmanCodes(distCodes, distLengths, numDist);
+        memcpy(&lengths[numLit], distLengths, numDist);
+
+        // Run length encoded code lengths.
+        const uint32_t numLengths = numLit + numDist;
+        uint8_t rle[286+DEFLATE_NUM_DIST];
+        uint8_t rleExtra[286+DEFLATE_NUM_DIST];
+        uint32_t numRle = 0;
+        for (uint32_t ii = 0; ii < numLengths; )
+        {
+            const uint8_t len = lengths[ii];
+            uint32_t run = 1;
+            while (ii+run < numLengths && lengths[ii+run] == len)
+            {
+                ++run;
+            }
+
+            if (0 == len && run >= 3)
+            {
+                run = min(run, UINT32_C(138));
+                rle[numRle] = (run >= 11) ? 18 : 17;
+                rleExtra[numRle++] = uint8_t((run >= 11) ? run-11 : run-3);
+                ii += run;
+            }
+            else if (0 != len && run >= 4)
+            {
+                run = min(run-1, UINT32_C(6));
+                rle[numRle++] = len;
+                rle[numRle] = 16;
+                rleExtra[numRle++] = uint8_t(run-3);
+                ii += 1+run;
+            }
+            else
+            {
+                rle[numRle++] = len;
+                ++ii;
+            }
+        }
+
+        uint32_t codeLenFreq[DEFLATE_NUM_CODELEN];
+        memset(codeLenFreq, 0, sizeof(codeLenFreq));
+        for (uint32_t ii = 0; ii < numRle; ++ii)
+        {
+            ++codeLenFreq[rle[ii]];
+        }
+        huffmanEnsureTwoSymbols(codeLenFreq, DEFLATE_NUM_CODELEN);
+
+        uint8_t codeLenLengths[DEFLATE_NUM_CODELEN];
+        uint16_t codeLenCodes[DEFLATE_NUM_CODELEN];
+        huffmanLengths(codeLenLengths, codeLenFreq, DEFLATE_NUM_CODELEN, 7);
+        huffmanCodes(codeLenCodes, codeLenLengths, DEFLATE_NUM_CODELEN);
+
+        uint32_t numCodeLen = DEFLATE_NUM_CODELEN;
+        while (numCodeLen > 4 && 0 == codeLenLengths[s_codeLengthOrder[numCodeLen-1]])
+        {
+            --numCodeLen;
+        }
+
+        // Dynamic block header.
+        deflateWrite(_writer, _final ? 1 : 0, 1);
+        deflateWrite(_writer, 2, 2);
+        deflateWrite(_writer, numLit-257, 5);
+        deflateWrite(_writer, numDist-1, 5);
+        deflateWrite(_writer, numCodeLen-4, 4);
+        for (uint32_t ii = 0; ii < numCodeLen; ++ii)
+        {
+            deflateWrite(_writer, codeLenLengths[s_codeLengthOrder[ii]], 3);
+        }
+
+        static const uint8_t s_rleExtraBits[3] = { 2, 3, 7 };
+        for (uint32_t ii = 0; ii < numRle; ++ii)
+        {
+            const uint8_t sym = rle[ii];
+            deflateWrite(_writer, codeLenCodes[sym], codeLenLengths[sym]);
+            if (sym >= 16)
+            {
+                deflateWrite(_writer, rleExtra[ii], s_rleExtraBits[sym-16]);
+            }
+        }
+
+        // Symbols.
+        for (uint32_t ii = 0; ii < _numSymbols; ++ii)
+        {
+            const DeflateSymbol& symbol = _symbols[ii];
+            if (0 == symbol.m_dist)
+            {
+                deflateWrite(_writer, litCodes[symbol.m_litLen], lengths[symbol.m_litLen]);
+                continue;
+            }
+
+            const uint32_t lenCode = deflateLengthCode(symbol.m_litLen);
+            const uint32_t lenIdx = lenCode-257;
+            deflateWrite(_writer, litCodes[lenCode], lengths[lenCode]);
+            deflateWrite(_writer, symbol.m_litLen - s_lengthBase[lenIdx], s_lengthExtra[lenIdx]);
+
+            const uint32_t distCode = deflateDistCode(symbol.m_dist);
+            deflateWrite(_writer, distCodes[distCode], distLengths[distCode]);
+            deflateWrite(_writer, symbol.m_dist - s_distBase[distCode], s_distExtra[distCode]);
+        }
+
+        deflateWrite(_writer, litCodes[256], lengths[256]);
+    }
+
+    static inline uint32_t deflateHash(const uint8_t* _src)
+    {
+        const uint32_t vv = (uint32_t(_src[0])<<16) | (uint32_t(_src[1])<<8) | uint32_t(_src[2]);
+        return (vv*UINT32_C(2654435761)) >> (32-DEFLATE_HASH_BITS);
+    }
+
+    uint32_t zlibCompress(uint8_t* _dst, uint32_t _dstCapacity, const uint8_t* _src, uint32_t _srcSize)
+    {
+        DeflateWriter writer;
+        writer.m_dst = _dst;
+        writer.m_capacity = _dstCapacity;
+        writer.m_pos = 0;
+        writer.m_bits = 0;
+        writer.m_numBits = 0;
+        writer.m_overflow = false;
+
+        // Deflate with 32k window, default compression level.
+        deflateWrite(writer, 0x78, 8);
+        deflateWrite(writer, 0x9c, 8);
+
+        const size_t headSize = sizeof(int32_t)<<DEFLATE_HASH_BITS;
+        const size_t prevSize = sizeof(int32_t)*DEFLATE_WINDOW;
+        uint8_t* mem = (uint8_t*)malloc(headSize + prevSize + sizeof(DeflateSymbol)*DEFLATE_BLOCK_SYMBOLS);
+        MALLOC_CHECK(mem);
+        int32_t* head = (int32_t*)mem;
+        int32_t* prev = (int32_t*)(mem + headSize);
+        DeflateSymbol* symbols = (DeflateSymbol*)(mem + headSize + prevSize);
+        memset(head, 0xff, headSize);
+
+        // Greedy matching over hash chains.
+        uint32_t numSymbols = 0;
+        for (uint32_t pos = 0; pos < _srcSize && !writer.m_overflow; )
+        {
+            uint32_t bestLen = 0;
+            uint32_t bestDist = 0;
+            if (pos + DEFLATE_MIN_MATCH <= _srcSize)
+            {
+                const uint32_t hash = deflateHash(_src+pos);
+                const uint32_t maxLen = min(_srcSize-pos, uint32_t(DEFLATE_MAX_MATCH));
+                const uint8_t* cur = _src + pos;
+
+                int32_t cand = head[hash];
+                for (uint32_t chain = DEFLATE_MAX_CHAIN; cand >= 0 && pos-uint32_t(cand) <= DEFLATE_WINDOW && chain > 0; --chain)
+                {
+                    const uint8_t* match = _src + cand;
+                    if (match[bestLen] == cur[bestLen])
+                    {
+                        uint32_t len = 0;
+                        while (len < maxLen && match[len] == cur[len])
+                        {
+                            ++len;
+                        }
+
+                        if (len > bestLen)
+                        {
+                            bestLen = len;
+                            bestDist = pos - uint32_t(cand);
+                            if (len == maxLen)
+                            {
+                                break;
+                            }
+                        }
+                    }
+                    cand = prev[cand&(DEFLATE_WINDOW-1)];
+                }
+
+                prev[pos&(DEFLATE_WINDOW-1)] = head[hash];
+                head[hash] = int32_t(pos);
+            }
+
+            if (bestLen >= DEFLATE_MIN_MATCH)
+            {
+                symbols[numSymbols].m_litLen = uint16_t(bestLen);
+                symbols[numSymbols].m_dist = uint16_t(bestDist);
+
+                // Positions inside the match are still added to the chains.
+                for (uint32_t ii = 1; ii < bestLen; ++ii)
+                {
+                    const uint32_t pp = pos+ii;
+                    if (pp + DEFLATE_MIN_MATCH <= _srcSize)
+                    {
+                        const uint32_t hash = deflateHash(_src+pp);
+                        prev[pp&(DEFLATE_WINDOW-1)] = head[hash];
+                        head[hash] = int32_t(pp);
+                    }
+                }
+                pos += bestLen;
+            }
+            else
+            {
+                symbols[numSymbols].m_litLen = _src[pos];
+                symbols[numSymbols].m_dist = 0;
+                ++pos;
+            }
+
+            if (++numSymbols == DEFLATE_BLOCK_SYMBOLS)
+            {
+                deflateWriteBlock(writer, symbols, numSymbols, false);
+                numSymbols = 0;
+            }
+        }
+
+        deflateWriteBlock(writer, symbols, numSymbols, true);
+        deflateFlush(writer);
+
+        free(mem);
+
+        // Adler-32, big endian.
+        const uint32_t adler = adler32(_src, _srcSize);
+        deflateWrite(writer, (adler>>24)&0xff, 8);
+        deflateWrite(writer, (adler>>16)&0xff, 8);
+        deflateWrite(writer, (adler>>8)&0xff,  8);
+        deflateWrite(writer, adler&0xff,       8);
+
+        return writer.m_overflow ? 0 : writer.m_pos;
+    }
+
+} // namespace cmft
+
+/* vim: set sw=4 ts=4 expandtab: */
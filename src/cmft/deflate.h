@@ -0,0 +1,26 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_DEFLATE_H_HEADER_GUARD
+#define CMFT_DEFLATE_H_HEADER_GUARD
+
+#include "base/config.h"
+
+#include <stdint.h>
+
+namespace cmft
+{
+    /// Compresses _srcSize bytes into a zlib stream (RFC 1950) in _dst.
+    /// Returns compressed size, or 0 if the stream does not fit into _dstCapacity bytes.
+    uint32_t zlibCompress(uint8_t* _dst, uint32_t _dstCapacity, const uint8_t* _src, uint32_t _srcSize);
+
+    /// Decompresses zlib stream of _srcSize bytes. Returns true only if the stream is valid and decompresses to exactly _dstSize bytes.
+    bool zlibDecompress(uint8_t* _dst, uint32_t _dstSize, const uint8_t* _src, uint32_t _srcSize);
+
+} // namespace cmft
+
+#endif //CMFT_DEFLATE_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -8,14 +8,106 @@
 #include "base/config.h"
 #include "base/utils.h"
 #include "base/macros.h"
+#include "base/half.h"
 #include "cubemaputils.h"
+#include "blockcompress.h"
+#include "deflate.h"
 #include "messages.h"
+#include "threadpool.h"
+#include "profiler.h"
+#include "writebehind.h"
 
 #include <bx/uint32_t.h>
+#include <bx/float4_t.h>
+#include <bx/mutex.h>
 
 #include <string.h>
+#include <float.h>
 #include <stdarg.h>
 
+// Memory mapped Dds/Ktx loading.
+#ifndef CMFT_IMAGE_MMAP
+    #define CMFT_IMAGE_MMAP BX_PLATFORM_POSIX
+#endif // CMFT_IMAGE_MMAP
+
+#if CMFT_IMAGE_MMAP
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif // CMFT_IMAGE_MMAP
+
+// Row format converters use SSE2 when bx provides SSE float4_t implementation.
+#ifndef CMFT_CONVERT_SIMD
+    #if defined(BX_FLOAT4_SSE_H_HEADER_GUARD)
+        #define CMFT_CONVERT_SIMD 1
+    #else
+        #define CMFT_CONVERT_SIMD 0
+    #endif
+#endif // CMFT_CONVERT_SIMD
+
+// Hardware half float conversion (x86 F16C).
+#ifndef CMFT_F16C
+    #if defined(__F16C__)
+        #define CMFT_F16C 1
+    #else
+        #define CMFT_F16C 0
+    #endif
+#endif // CMFT_F16C
+
+#if CMFT_F16C
+    #include <immintrin.h>
+#endif // CMFT_F16C
+
+// Minimum number of rows per imageResize() task.
+#ifndef CMFT_RESIZE_MIN_ROWS
+    #define CMFT_RESIZE_MIN_ROWS 8
+#endif // CMFT_RESIZE_MIN_ROWS
+
+// Face transforms are done in tiles of this many texels per side, multiple of 4.
+#ifndef CMFT_TRANSFORM_TILE_SIZE
+    #define CMFT_TRANSFORM_TILE_SIZE 32
+#endif // CMFT_TRANSFORM_TILE_SIZE
+
+// Minimum number of texels per imageTransform() task.
+#ifndef CMFT_TRANSFORM_MIN_PIXELS
+    #define CMFT_TRANSFORM_MIN_PIXELS (1<<14)
+#endif // CMFT_TRANSFORM_MIN_PIXELS
+
+// Minimum number of 4x4 blocks per block encoding task.
+#ifndef CMFT_ENCODE_MIN_BLOCKS
+    #define CMFT_ENCODE_MIN_BLOCKS 64
+#endif // CMFT_ENCODE_MIN_BLOCKS
+
+// Minimum number of 4x4 blocks per block decoding task.
+#ifndef CMFT_DECODE_MIN_BLOCKS
+    #define CMFT_DECODE_MIN_BLOCKS 1024
+#endif // CMFT_DECODE_MIN_BLOCKS
+
+// Hdr files are read in chunks of this size.
+#ifndef CMFT_HDR_READ_BUFFER_SIZE
+    #define CMFT_HDR_READ_BUFFER_SIZE (64<<10)
+#endif // CMFT_HDR_READ_BUFFER_SIZE
+
+// Hdr files are written in bands of this many pixels, scanlines of a band are converted and rle encoded in parallel.
+#ifndef CMFT_HDR_WRITE_BAND_PIXELS
+    #define CMFT_HDR_WRITE_BAND_PIXELS (1<<22)
+#endif // CMFT_HDR_WRITE_BAND_PIXELS
+
+// Minimum number of scanlines per Hdr encoding task.
+#ifndef CMFT_HDR_WRITE_MIN_ROWS
+    #define CMFT_HDR_WRITE_MIN_ROWS 4
+#endif // CMFT_HDR_WRITE_MIN_ROWS
+
+// Rle compressed Tga files are read in chunks of this size. Has to hold the largest packet, 513 bytes.
+#ifndef CMFT_TGA_READ_BUFFER_SIZE
+    #define CMFT_TGA_READ_BUFFER_SIZE (64<<10)
+#endif // CMFT_TGA_READ_BUFFER_SIZE
+
+// Rgba32f source rows kept in memory while converting latlong files or non-rgba32f latlong images to cubemap.
+#ifndef CMFT_LATLONG_BAND_SIZE
+    #define CMFT_LATLONG_BAND_SIZE (64<<20)
+#endif // CMFT_LATLONG_BAND_SIZE
+
 namespace cmft
 {
     // Texture format string.
@@ -34,6 +126,18 @@ namespace cmft
         "RGBA16",    //RGBA16
         "RGBA16F",   //RGBA16F
         "RGBA32F",   //RGBA32F
+        "RG16F",     //RG16F
+        "RG32F",     //RG32F
+        "RGB9E5",    //RGB9E5
+        "R11G11B10F",//R11G11B10F
+        "RGBM8",     //RGBM8
+        "RGBD8",     //RGBD8
+        "LOGLUV8",   //LOGLUV8
+        "BC6H_UF16", //BC6H_UF16
+        "BC6H_SF16", //BC6H_SF16
+        "BC7",       //BC7
+        "ETC2",      //ETC2
+        "ASTC4X4",   //ASTC4X4
         "<unknown>", //Unknown
     };
 
@@ -52,6 +156,8 @@ namespace cmft
         ".ktx", //KTX
         ".tga", //TGA
         ".hdr", //HDR
+        ".exr", //EXR
+        ".ktx2", //KTX2
     };
 
     const char* getFilenameExtensionStr(ImageFileType::Enum _ft)
@@ -69,6 +175,8 @@ namespace cmft
         "KTX", //KTX
         "TGA", //TGA
         "HDR", //HDR
+        "EXR", //EXR
+        "KTX2", //KTX2
     };
 
     const char* getFileTypeStr(ImageFileType::Enum _ft)
@@ -89,6 +197,16 @@ namespace cmft
         TextureFormat::RGBA16,
         TextureFormat::RGBA16F,
         TextureFormat::RGBA32F,
+        TextureFormat::RG16F,
+        TextureFormat::RG32F,
+        TextureFormat::RGB9E5,
+        TextureFormat::R11G11B10F,
+        TextureFormat::RGBM8,
+        TextureFormat::RGBD8,
+        TextureFormat::LOGLUV8,
+        TextureFormat::BC6H_UF16,
+        TextureFormat::BC6H_SF16,
+        TextureFormat::BC7,
         TEXTURE_FORMAT_NULL
     };
 
@@ -102,6 +220,37 @@ namespace cmft
         TextureFormat::RGBA16,
         TextureFormat::RGBA16F,
         TextureFormat::RGBA32F,
+        TextureFormat::RG16F,
+        TextureFormat::RG32F,
+        TextureFormat::RGB9E5,
+        TextureFormat::R11G11B10F,
+        TextureFormat::RGBM8,
+        TextureFormat::RGBD8,
+        TextureFormat::LOGLUV8,
+        TextureFormat::BC6H_UF16,
+        TextureFormat::BC6H_SF16,
+        TextureFormat::ETC2,
+        TextureFormat::ASTC4X4,
+        TEXTURE_FORMAT_NULL
+    };
+
+    static const TextureFormat::Enum s_ktx2ValidFormats[] =
+    {
+        TextureFormat::RGB8,
+        TextureFormat::RGB16,
+        TextureFormat::RGB16F,
+        TextureFormat::RGB32F,
+        TextureFormat::RGBA8,
+        TextureFormat::RGBA16,
+        TextureFormat::RGBA16F,
+        TextureFormat::RGBA32F,
+        TextureFormat::RG16F,
+        TextureFormat::RG32F,
+        TextureFormat::BC6H_UF16,
+        TextureFormat::BC6H_SF16,
+        TextureFormat::BC7,
+        TextureFormat::ETC2,
+        TextureFormat::ASTC4X4,
         TEXTURE_FORMAT_NULL
     };
 
@@ -109,6 +258,9 @@ namespace cmft
     {
         TextureFormat::BGR8,
         TextureFormat::BGRA8,
+        TextureFormat::RGBM8,
+        TextureFormat::RGBD8,
+        TextureFormat::LOGLUV8,
         TEXTURE_FORMAT_NULL
     };
 
@@ -118,6 +270,15 @@ namespace cmft
         TEXTURE_FORMAT_NULL
     };
 
+    static const TextureFormat::Enum s_exrValidFormats[] =
+    {
+        TextureFormat::RGB16F,
+        TextureFormat::RGB32F,
+        TextureFormat::RGBA16F,
+        TextureFormat::RGBA32F,
+        TEXTURE_FORMAT_NULL
+    };
+
     const TextureFormat::Enum* getValidTextureFormats(ImageFileType::Enum _fileType)
     {
         if (ImageFileType::DDS == _fileType)
@@ -136,6 +297,14 @@ namespace cmft
         {
             return s_hdrValidFormats;
         }
+        else if (ImageFileType::EXR == _fileType)
+        {
+            return s_exrValidFormats;
+        }
+        else if (ImageFileType::KTX2 == _fileType)
+        {
+            return s_ktx2ValidFormats;
+        }
         else
         {
             return NULL;
@@ -197,6 +366,14 @@ namespace cmft
         {
             return contains(_internalFormat, s_hdrValidFormats);
         }
+        else if (ImageFileType::EXR == _fileType)
+        {
+            return contains(_internalFormat, s_exrValidFormats);
+        }
+        else if (ImageFileType::KTX2 == _fileType)
+        {
+            return contains(_internalFormat, s_ktx2ValidFormats);
+        }
 
         return false;
     }
@@ -220,18 +397,30 @@ namespace cmft
 
     static const ImageDataInfo s_imageDataInfo[TextureFormat::Count] =
     {
-        {  3, 3, 0, PixelDataType::UINT8       }, //BGR8
-        {  3, 3, 0, PixelDataType::UINT8       }, //RGB8
-        {  6, 3, 0, PixelDataType::UINT16      }, //RGB16
-        {  6, 3, 0, PixelDataType::HALF_FLOAT  }, //RGB16F
-        { 12, 3, 0, PixelDataType::FLOAT       }, //RGB32F
-        {  4, 4, 0, PixelDataType::UINT8       }, //RGBE
-        {  4, 4, 1, PixelDataType::UINT8       }, //BGRA8
-        {  4, 4, 1, PixelDataType::UINT8       }, //RGBA8
-        {  8, 4, 1, PixelDataType::UINT16      }, //RGBA16
-        {  8, 4, 1, PixelDataType::HALF_FLOAT  }, //RGBA16F
-        { 16, 4, 1, PixelDataType::FLOAT       }, //RGBA32F
-        {  0, 0, 0, 0 }, //Unknown
+        {  3, 3, 0, PixelDataType::UINT8,       0  }, //BGR8
+        {  3, 3, 0, PixelDataType::UINT8,       0  }, //RGB8
+        {  6, 3, 0, PixelDataType::UINT16,      0  }, //RGB16
+        {  6, 3, 0, PixelDataType::HALF_FLOAT,  0  }, //RGB16F
+        { 12, 3, 0, PixelDataType::FLOAT,       0  }, //RGB32F
+        {  4, 4, 0, PixelDataType::UINT8,       0  }, //RGBE
+        {  4, 4, 1, PixelDataType::UINT8,       0  }, //BGRA8
+        {  4, 4, 1, PixelDataType::UINT8,       0  }, //RGBA8
+        {  8, 4, 1, PixelDataType::UINT16,      0  }, //RGBA16
+        {  8, 4, 1, PixelDataType::HALF_FLOAT,  0  }, //RGBA16F
+        { 16, 4, 1, PixelDataType::FLOAT,       0  }, //RGBA32F
+        {  4, 2, 0, PixelDataType::HALF_FLOAT,  0  }, //RG16F
+        {  8, 2, 0, PixelDataType::FLOAT,       0  }, //RG32F
+        {  4, 3, 0, PixelDataType::UINT32,      0  }, //RGB9E5
+        {  4, 3, 0, PixelDataType::UINT32,      0  }, //R11G11B10F
+        {  4, 4, 0, PixelDataType::UINT8,       0  }, //RGBM8
+        {  4, 4, 0, PixelDataType::UINT8,       0  }, //RGBD8
+        {  4, 4, 0, PixelDataType::UINT8,       0  }, //LOGLUV8
+        {  0, 3, 0, PixelDataType::HALF_FLOAT,  16 }, //BC6H_UF16
+        {  0, 3, 0, PixelDataType::HALF_FLOAT,  16 }, //BC6H_SF16
+        {  0, 4, 1, PixelDataType::UINT8,       16 }, //BC7
+        {  0, 3, 0, PixelDataType::UINT8,       8  }, //ETC2
+        {  0, 4, 1, PixelDataType::UINT8,       16 }, //ASTC4X4
+        {  0, 0, 0, 0,                          0  }, //Unknown
     };
 
     const ImageDataInfo& getImageDataInfo(TextureFormat::Enum _format)
@@ -271,6 +460,8 @@ namespace cmft
 #define TGA_IT_BW          0x3
 #define TGA_IT_RLE         0x8
 
+#define TGA_RLE_MAX_PACKET 128
+
 #define TGA_DESC_HORIZONTAL 0x10
 #define TGA_DESC_VERTICAL   0x20
 
@@ -297,6 +488,52 @@ namespace cmft
         uint8_t m_signature[18];
     };
 
+    // EXR format.
+    //-----
+
+#define EXR_MAGIC                0x01312f76
+#define EXR_VERSION              2
+#define EXR_FLAG_TILED           0x200
+#define EXR_FLAG_DEEP            0x800
+#define EXR_FLAG_MULTIPART       0x1000
+#define EXR_MAX_CHANNELS         32
+
+#define EXR_PIXEL_UINT           0
+#define EXR_PIXEL_HALF           1
+#define EXR_PIXEL_FLOAT          2
+
+#define EXR_COMPRESSION_NONE     0
+#define EXR_COMPRESSION_RLE      1
+#define EXR_COMPRESSION_ZIPS     2
+#define EXR_COMPRESSION_ZIP      3
+#define EXR_COMPRESSION_PIZ      4
+#define EXR_COMPRESSION_PXR24    5
+#define EXR_COMPRESSION_B44      6
+#define EXR_COMPRESSION_B44A     7
+#define EXR_COMPRESSION_DWAA     8
+#define EXR_COMPRESSION_DWAB     9
+
+#define EXR_COMPONENT_Y          4
+
+    struct ExrChannel
+    {
+        int32_t m_pixelType;
+        int32_t m_xSampling;
+        int32_t m_ySampling;
+        int8_t m_component; //!< 0-3 for R, G, B, A, EXR_COMPONENT_Y for luminance, -1 for skipped channels.
+    };
+
+    struct ExrHeader
+    {
+        ExrChannel m_channels[EXR_MAX_CHANNELS]; //!< In file order, which is alphabetical.
+        uint8_t m_numChannels;
+        uint8_t m_compression;
+        int32_t m_dataWindow[4]; //!< xMin, yMin, xMax, yMax.
+        bool m_tiled;
+        uint32_t m_tileWidth;
+        uint32_t m_tileHeight;
+    };
+
     // DDS format.
     //-----
 
@@ -315,6 +552,8 @@ namespace cmft
 #define DDS_BC4U CMFT_MAKEFOURCC('B', 'C', '4', 'U')
 #define DDS_ATI2 CMFT_MAKEFOURCC('A', 'T', 'I', '2')
 #define DDS_BC5U CMFT_MAKEFOURCC('B', 'C', '5', 'U')
+#define DDS_BC4S CMFT_MAKEFOURCC('B', 'C', '4', 'S')
+#define DDS_BC5S CMFT_MAKEFOURCC('B', 'C', '5', 'S')
 
 #define DDS_DX10 CMFT_MAKEFOURCC('D', 'X', '1', '0')
 
@@ -324,7 +563,9 @@ namespace cmft
 #define D3DFMT_A8B8G8R8      32
 #define D3DFMT_X8B8G8R8      33
 #define D3DFMT_A16B16G16R16  36
+#define D3DFMT_G16R16F       112
 #define D3DFMT_A16B16G16R16F 113
+#define D3DFMT_G32R32F       115
 #define D3DFMT_A32B32G32R32F 116
 
 #define DDSD_CAPS                   0x00000001
@@ -371,11 +612,36 @@ namespace cmft
 #define DXGI_FORMAT_R32G32B32A32_FLOAT  2
 #define DXGI_FORMAT_R16G16B16A16_FLOAT  10
 #define DXGI_FORMAT_R16G16B16A16_UINT   12
+#define DXGI_FORMAT_R32G32_FLOAT        16
+#define DXGI_FORMAT_R11G11B10_FLOAT     26
 #define DXGI_FORMAT_R8G8B8A8_UNORM      28
 #define DXGI_FORMAT_R8G8B8A8_UINT       30
+#define DXGI_FORMAT_R16G16_FLOAT        34
+#define DXGI_FORMAT_R9G9B9E5_SHAREDEXP  67
+#define DXGI_FORMAT_BC1_TYPELESS        70
+#define DXGI_FORMAT_BC1_UNORM           71
+#define DXGI_FORMAT_BC1_UNORM_SRGB      72
+#define DXGI_FORMAT_BC2_TYPELESS        73
+#define DXGI_FORMAT_BC2_UNORM           74
+#define DXGI_FORMAT_BC2_UNORM_SRGB      75
+#define DXGI_FORMAT_BC3_TYPELESS        76
+#define DXGI_FORMAT_BC3_UNORM           77
+#define DXGI_FORMAT_BC3_UNORM_SRGB      78
+#define DXGI_FORMAT_BC4_TYPELESS        79
+#define DXGI_FORMAT_BC4_UNORM           80
+#define DXGI_FORMAT_BC4_SNORM           81
+#define DXGI_FORMAT_BC5_TYPELESS        82
+#define DXGI_FORMAT_BC5_UNORM           83
+#define DXGI_FORMAT_BC5_SNORM           84
 #define DXGI_FORMAT_B8G8R8A8_UNORM      87
 #define DXGI_FORMAT_B8G8R8X8_UNORM      88
 #define DXGI_FORMAT_B8G8R8A8_TYPELESS   90
+#define DXGI_FORMAT_BC6H_TYPELESS       94
+#define DXGI_FORMAT_BC6H_UF16           95
+#define DXGI_FORMAT_BC6H_SF16           96
+#define DXGI_FORMAT_BC7_TYPELESS        97
+#define DXGI_FORMAT_BC7_UNORM           98
+#define DXGI_FORMAT_BC7_UNORM_SRGB      99
 
 #define DDS_DIMENSION_TEXTURE1D 2
 #define DDS_DIMENSION_TEXTURE2D 3
@@ -439,6 +705,10 @@ namespace cmft
         { sizeof(DdsPixelFormat), DDPF_FOURCC, DDS_DX10,  64, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 }, //RGBA16
         { sizeof(DdsPixelFormat), DDPF_FOURCC, DDS_DX10,  64, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 }, //RGBA16F
         { sizeof(DdsPixelFormat), DDPF_FOURCC, DDS_DX10, 128, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 }, //RGBA32F
+        { sizeof(DdsPixelFormat), DDPF_FOURCC, DDS_DX10,   0, 0x00000000, 0x00000000, 0x00000000, 0x00000000 }, //Block compressed
+        { sizeof(DdsPixelFormat), DDPF_FOURCC, DDS_DX10,  32, 0x0000ffff, 0xffff0000, 0x00000000, 0x00000000 }, //RG16F
+        { sizeof(DdsPixelFormat), DDPF_FOURCC, DDS_DX10,  64, 0xffffffff, 0xffffffff, 0x00000000, 0x00000000 }, //RG32F
+        { sizeof(DdsPixelFormat), DDPF_FOURCC, DDS_DX10,  32, 0x00000000, 0x00000000, 0x00000000, 0x00000000 }, //Packed 32-bit
     };
 
     static inline const DdsPixelFormat& getDdsPixelFormat(TextureFormat::Enum _format)
@@ -448,14 +718,33 @@ namespace cmft
         else if (TextureFormat::BGRA8   == _format) { return s_ddsPixelFormat[1];  }
         else if (TextureFormat::RGBA16  == _format) { return s_ddsPixelFormat[2];  }
         else if (TextureFormat::RGBA16F == _format) { return s_ddsPixelFormat[3];  }
-        else/*(TextureFormat::RGBA32F == _format)*/ { return s_ddsPixelFormat[4];  }
+        else if (TextureFormat::RGBA32F == _format) { return s_ddsPixelFormat[4];  }
+        else if (TextureFormat::RG16F   == _format) { return s_ddsPixelFormat[6];  }
+        else if (TextureFormat::RG32F   == _format) { return s_ddsPixelFormat[7];  }
+        else if (TextureFormat::RGB9E5     == _format
+              || TextureFormat::R11G11B10F == _format
+              || TextureFormat::RGBM8      == _format
+              || TextureFormat::RGBD8      == _format
+              || TextureFormat::LOGLUV8    == _format) { return s_ddsPixelFormat[8];  }
+        else/*(block compressed)*/                  { return s_ddsPixelFormat[5];  }
     }
 
     static inline uint8_t getDdsDxgiFormat(TextureFormat::Enum _format)
     {
-        if      (TextureFormat::RGBA16  == _format) { return DXGI_FORMAT_R16G16B16A16_UINT;  }
+        if      (TextureFormat::BGRA8   == _format) { return DXGI_FORMAT_B8G8R8A8_UNORM;     }
+        else if (TextureFormat::RGBA16  == _format) { return DXGI_FORMAT_R16G16B16A16_UINT;  }
         else if (TextureFormat::RGBA16F == _format) { return DXGI_FORMAT_R16G16B16A16_FLOAT; }
         else if (TextureFormat::RGBA32F == _format) { return DXGI_FORMAT_R32G32B32A32_FLOAT; }
+        else if (TextureFormat::RG16F   == _format) { return DXGI_FORMAT_R16G16_FLOAT;       }
+        else if (TextureFormat::RG32F   == _format) { return DXGI_FORMAT_R32G32_FLOAT;       }
+        else if (TextureFormat::RGB9E5     == _format) { return DXGI_FORMAT_R9G9B9E5_SHAREDEXP; }
+        else if (TextureFormat::R11G11B10F == _format) { return DXGI_FORMAT_R11G11B10_FLOAT;    }
+        else if (TextureFormat::RGBM8      == _format
+              || TextureFormat::RGBD8      == _format
+              || TextureFormat::LOGLUV8    == _format) { return DXGI_FORMAT_R8G8B8A8_UNORM; }
+        else if (TextureFormat::BC6H_UF16 == _format) { return DXGI_FORMAT_BC6H_UF16; }
+        else if (TextureFormat::BC6H_SF16 == _format) { return DXGI_FORMAT_BC6H_SF16; }
+        else if (TextureFormat::BC7       == _format) { return DXGI_FORMAT_BC7_UNORM; }
         else { return DXGI_FORMAT_UNKNOWN; }
     }
 
@@ -482,6 +771,8 @@ namespace cmft
         { D3DFMT_A16B16G16R16,    TextureFormat::RGBA16  },
         { D3DFMT_A16B16G16R16F,   TextureFormat::RGBA16F },
         { D3DFMT_A32B32G32R32F,   TextureFormat::RGBA32F },
+        { D3DFMT_G16R16F,         TextureFormat::RG16F   },
+        { D3DFMT_G32R32F,         TextureFormat::RG32F   },
         { DDS_PF_BC_24|DDPF_RGB,  TextureFormat::BGR8    },
         { DDS_PF_BC_32|DDPF_RGBA, TextureFormat::BGRA8   },
         { DDS_PF_BC_48|DDPF_RGB,  TextureFormat::RGB16   },
@@ -494,9 +785,59 @@ namespace cmft
 
     } s_translateDdsDxgiFormat[] =
     {
+        { DXGI_FORMAT_B8G8R8A8_UNORM,     TextureFormat::BGRA8   },
+        { DXGI_FORMAT_R8G8B8A8_UNORM,     TextureFormat::RGBA8   },
         { DXGI_FORMAT_R16G16B16A16_UINT,  TextureFormat::RGBA16  },
         { DXGI_FORMAT_R16G16B16A16_FLOAT, TextureFormat::RGBA16F },
         { DXGI_FORMAT_R32G32B32A32_FLOAT, TextureFormat::RGBA32F },
+        { DXGI_FORMAT_R16G16_FLOAT,       TextureFormat::RG16F   },
+        { DXGI_FORMAT_R32G32_FLOAT,       TextureFormat::RG32F   },
+        { DXGI_FORMAT_R9G9B9E5_SHAREDEXP, TextureFormat::RGB9E5     },
+        { DXGI_FORMAT_R11G11B10_FLOAT,    TextureFormat::R11G11B10F },
+        { DXGI_FORMAT_BC6H_UF16,          TextureFormat::BC6H_UF16  },
+        { DXGI_FORMAT_BC6H_SF16,          TextureFormat::BC6H_SF16  },
+        { DXGI_FORMAT_BC7_UNORM,          TextureFormat::BC7        },
+    };
+
+    /// Block compressed formats decoded on load. Srgb and typeless variants are decoded as they are stored.
+    static const struct TranslateDdsBlockFormat
+    {
+        uint32_t m_format;
+        BlockFormat::Enum m_blockFormat;
+
+    } s_translateDdsFourccBlockFormat[] =
+    {
+        { DDS_DXT1, BlockFormat::BC1  },
+        { DDS_DXT2, BlockFormat::BC2  },
+        { DDS_DXT3, BlockFormat::BC2  },
+        { DDS_DXT4, BlockFormat::BC3  },
+        { DDS_DXT5, BlockFormat::BC3  },
+        { DDS_ATI1, BlockFormat::BC4  },
+        { DDS_BC4U, BlockFormat::BC4  },
+        { DDS_BC4S, BlockFormat::BC4S },
+        { DDS_ATI2, BlockFormat::BC5  },
+        { DDS_BC5U, BlockFormat::BC5  },
+        { DDS_BC5S, BlockFormat::BC5S },
+    }, s_translateDdsDxgiBlockFormat[] =
+    {
+        { DXGI_FORMAT_BC1_TYPELESS,   BlockFormat::BC1   },
+        { DXGI_FORMAT_BC1_UNORM,      BlockFormat::BC1   },
+        { DXGI_FORMAT_BC1_UNORM_SRGB, BlockFormat::BC1   },
+        { DXGI_FORMAT_BC2_TYPELESS,   BlockFormat::BC2   },
+        { DXGI_FORMAT_BC2_UNORM,      BlockFormat::BC2   },
+        { DXGI_FORMAT_BC2_UNORM_SRGB, BlockFormat::BC2   },
+        { DXGI_FORMAT_BC3_TYPELESS,   BlockFormat::BC3   },
+        { DXGI_FORMAT_BC3_UNORM,      BlockFormat::BC3   },
+        { DXGI_FORMAT_BC3_UNORM_SRGB, BlockFormat::BC3   },
+        { DXGI_FORMAT_BC4_TYPELESS,   BlockFormat::BC4   },
+        { DXGI_FORMAT_BC4_UNORM,      BlockFormat::BC4   },
+        { DXGI_FORMAT_BC4_SNORM,      BlockFormat::BC4S  },
+        { DXGI_FORMAT_BC5_TYPELESS,   BlockFormat::BC5   },
+        { DXGI_FORMAT_BC5_UNORM,      BlockFormat::BC5   },
+        { DXGI_FORMAT_BC5_SNORM,      BlockFormat::BC5S  },
+        { DXGI_FORMAT_BC6H_TYPELESS,  BlockFormat::BC6H  },
+        { DXGI_FORMAT_BC7_TYPELESS,   BlockFormat::BC7   },
+        { DXGI_FORMAT_BC7_UNORM_SRGB, BlockFormat::BC7   },
     };
 
     // KTX format.
@@ -520,11 +861,16 @@ namespace cmft
 #define GL_FLOAT            0x1406
 #define GL_HALF_FLOAT       0x140B
 #define GL_FIXED            0x140C
+#define GL_UNSIGNED_INT_10F_11F_11F_REV 0x8C3B
+#define GL_UNSIGNED_INT_5_9_9_9_REV     0x8C3E
 
 // GL pixel format.
+#define GL_RG               0x8227
 #define GL_RGB              0x1907
 #define GL_RGBA             0x1908
 
+#define GL_RG16F            0x822F
+#define GL_RG32F            0x8230
 #define GL_RGBA32F          0x8814
 #define GL_RGB32F           0x8815
 #define GL_RGBA16F          0x881A
@@ -533,6 +879,7 @@ namespace cmft
 #define GL_RGB32UI          0x8D71
 #define GL_RGBA16UI         0x8D76
 #define GL_RGB16UI          0x8D77
+#define GL_RGBA8            0x8058
 #define GL_RGBA8UI          0x8D7C
 #define GL_RGB8UI           0x8D7D
 #define GL_RGBA32I          0x8D82
@@ -541,6 +888,28 @@ namespace cmft
 #define GL_RGB16I           0x8D89
 #define GL_RGBA8I           0x8D8E
 #define GL_RGB8I            0x8D8F
+#define GL_R11F_G11F_B10F   0x8C3A
+#define GL_RGB9_E5          0x8C3D
+
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT        0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT       0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT       0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT       0x83F3
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT       0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#define GL_COMPRESSED_RED_RGTC1                0x8DBB
+#define GL_COMPRESSED_SIGNED_RED_RGTC1         0x8DBC
+#define GL_COMPRESSED_RG_RGTC2                 0x8DBD
+#define GL_COMPRESSED_SIGNED_RG_RGTC2          0x8DBE
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM    0x8E8D
+
+#define GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT   0x8E8E
+#define GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT 0x8E8F
+#define GL_COMPRESSED_RGBA_BPTC_UNORM         0x8E8C
+#define GL_COMPRESSED_RGB8_ETC2               0x9274
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR       0x93B0
 
     struct KtxHeader
     {
@@ -578,6 +947,18 @@ namespace cmft
         { GL_RGBA16UI, GL_RGBA }, //RGBA16
         { GL_RGBA16F,  GL_RGBA }, //RGBA16F
         { GL_RGBA32F,  GL_RGBA }, //RGBA32F
+        { GL_RG16F,    GL_RG   }, //RG16F
+        { GL_RG32F,    GL_RG   }, //RG32F
+        { GL_RGB9_E5,        GL_RGB }, //RGB9E5
+        { GL_R11F_G11F_B10F, GL_RGB }, //R11G11B10F
+        { GL_RGBA8,    GL_RGBA }, //RGBM8
+        { GL_RGBA8,    GL_RGBA }, //RGBD8
+        { GL_RGBA8,    GL_RGBA }, //LOGLUV8
+        { GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, GL_RGB }, //BC6H_UF16
+        { GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT,   GL_RGB }, //BC6H_SF16
+        { GL_COMPRESSED_RGBA_BPTC_UNORM,   GL_RGBA }, //BC7
+        { GL_COMPRESSED_RGB8_ETC2,         GL_RGB  }, //ETC2
+        { GL_COMPRESSED_RGBA_ASTC_4x4_KHR, GL_RGBA }, //ASTC4X4
         { 0, 0 }, //Unknown
     };
 
@@ -616,20 +997,151 @@ namespace cmft
         { GL_RGB32F,   TextureFormat::RGB32F  },
         { GL_RGBA,     TextureFormat::RGBA8   },
         { GL_RGBA8UI,  TextureFormat::RGBA8   },
+        { GL_RGBA8,    TextureFormat::RGBA8   },
         { GL_RGBA16UI, TextureFormat::RGBA16  },
         { GL_RGBA16F,  TextureFormat::RGBA16F },
         { GL_RGBA32F,  TextureFormat::RGBA32F },
+        { GL_RG16F,    TextureFormat::RG16F   },
+        { GL_RG32F,    TextureFormat::RG32F   },
+        { GL_RGB9_E5,        TextureFormat::RGB9E5     },
+        { GL_R11F_G11F_B10F, TextureFormat::R11G11B10F },
+        { GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, TextureFormat::BC6H_UF16 },
+        { GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT,   TextureFormat::BC6H_SF16 },
+        { GL_COMPRESSED_RGBA_BPTC_UNORM,         TextureFormat::BC7       },
+    };
+
+    /// Block compressed formats decoded on load. Srgb variants are decoded as they are stored.
+    static const struct TranslateKtxBlockFormat
+    {
+        uint32_t m_glInternalFormat;
+        BlockFormat::Enum m_blockFormat;
+
+    } s_translateKtxBlockFormat[] =
+    {
+        { GL_COMPRESSED_RGB_S3TC_DXT1_EXT,        BlockFormat::BC1  },
+        { GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,       BlockFormat::BC1  },
+        { GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,       BlockFormat::BC1  },
+        { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, BlockFormat::BC1  },
+        { GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,       BlockFormat::BC2  },
+        { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, BlockFormat::BC2  },
+        { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,       BlockFormat::BC3  },
+        { GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, BlockFormat::BC3  },
+        { GL_COMPRESSED_RED_RGTC1,                BlockFormat::BC4  },
+        { GL_COMPRESSED_SIGNED_RED_RGTC1,         BlockFormat::BC4S },
+        { GL_COMPRESSED_RG_RGTC2,                 BlockFormat::BC5  },
+        { GL_COMPRESSED_SIGNED_RG_RGTC2,          BlockFormat::BC5S },
+        { GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,    BlockFormat::BC7  },
+    };
+
+    // KTX2 format.
+    //-----
+
+#define KTX2_MAGIC            { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }
+#define KTX2_MAGIC_LEN        12
+#define KTX2_HEADER_SIZE      68 // Header with index, after magic.
+#define KTX2_LEVEL_INDEX_SIZE 24
+
+// Supercompression scheme.
+#define KTX2_SUPERCOMPRESSION_NONE     0
+#define KTX2_SUPERCOMPRESSION_BASISLZ  1
+#define KTX2_SUPERCOMPRESSION_ZSTD     2
+#define KTX2_SUPERCOMPRESSION_ZLIB     3
+
+// Data format descriptor.
+#define KHR_DF_VERSION                 2
+#define KHR_DF_MODEL_RGBSDA            1
+#define KHR_DF_MODEL_BC6H              131
+#define KHR_DF_MODEL_BC7               132
+#define KHR_DF_MODEL_ETC2              161
+#define KHR_DF_MODEL_ASTC              162
+#define KHR_DF_PRIMARIES_BT709         1
+#define KHR_DF_TRANSFER_LINEAR         1
+#define KHR_DF_CHANNEL_RGBSDA_ALPHA    15
+#define KHR_DF_CHANNEL_ETC2_COLOR      2
+#define KHR_DF_SAMPLE_DATATYPE_SIGNED  0x40
+#define KHR_DF_SAMPLE_DATATYPE_FLOAT   0x80
+
+// Vulkan formats.
+#define VK_FORMAT_R8G8B8_UNORM              23
+#define VK_FORMAT_R8G8B8A8_UNORM            37
+#define VK_FORMAT_R16G16_SFLOAT             83
+#define VK_FORMAT_R16G16B16_UINT            88
+#define VK_FORMAT_R16G16B16_SFLOAT          90
+#define VK_FORMAT_R16G16B16A16_UINT         95
+#define VK_FORMAT_R16G16B16A16_SFLOAT       97
+#define VK_FORMAT_R32G32_SFLOAT             103
+#define VK_FORMAT_R32G32B32_SFLOAT          106
+#define VK_FORMAT_R32G32B32A32_SFLOAT       109
+#define VK_FORMAT_BC6H_UFLOAT_BLOCK         143
+#define VK_FORMAT_BC6H_SFLOAT_BLOCK         144
+#define VK_FORMAT_BC7_UNORM_BLOCK           145
+#define VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK   147
+#define VK_FORMAT_ASTC_4x4_UNORM_BLOCK      157
+
+    struct Ktx2Header
+    {
+        uint32_t m_vkFormat;
+        uint32_t m_typeSize;
+        uint32_t m_pixelWidth;
+        uint32_t m_pixelHeight;
+        uint32_t m_pixelDepth;
+        uint32_t m_layerCount;
+        uint32_t m_faceCount;
+        uint32_t m_levelCount;
+        uint32_t m_supercompressionScheme;
+        uint32_t m_dfdByteOffset;
+        uint32_t m_dfdByteLength;
+        uint32_t m_kvdByteOffset;
+        uint32_t m_kvdByteLength;
+        uint64_t m_sgdByteOffset;
+        uint64_t m_sgdByteLength;
+    };
+
+    struct Ktx2Level
+    {
+        uint64_t m_byteOffset;
+        uint64_t m_byteLength;
+        uint64_t m_uncompressedByteLength;
+    };
+
+    static const struct TranslateKtx2Format
+    {
+        uint32_t m_vkFormat;
+        TextureFormat::Enum m_textureFormat;
+        uint8_t m_colorModel;   //!< Of data format descriptor.
+        uint8_t m_channelType;  //!< Of the single sample of block compressed formats.
+
+    } s_translateKtx2Format[] =
+    {
+        { VK_FORMAT_R8G8B8_UNORM,            TextureFormat::RGB8,      KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R16G16B16_UINT,          TextureFormat::RGB16,     KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R16G16B16_SFLOAT,        TextureFormat::RGB16F,    KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R32G32B32_SFLOAT,        TextureFormat::RGB32F,    KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R8G8B8A8_UNORM,          TextureFormat::RGBA8,     KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R16G16B16A16_UINT,       TextureFormat::RGBA16,    KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R16G16B16A16_SFLOAT,     TextureFormat::RGBA16F,   KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R32G32B32A32_SFLOAT,     TextureFormat::RGBA32F,   KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R16G16_SFLOAT,           TextureFormat::RG16F,     KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_R32G32_SFLOAT,           TextureFormat::RG32F,     KHR_DF_MODEL_RGBSDA, 0 },
+        { VK_FORMAT_BC6H_UFLOAT_BLOCK,       TextureFormat::BC6H_UF16, KHR_DF_MODEL_BC6H,   KHR_DF_SAMPLE_DATATYPE_FLOAT },
+        { VK_FORMAT_BC6H_SFLOAT_BLOCK,       TextureFormat::BC6H_SF16, KHR_DF_MODEL_BC6H,   KHR_DF_SAMPLE_DATATYPE_FLOAT|KHR_DF_SAMPLE_DATATYPE_SIGNED },
+        { VK_FORMAT_BC7_UNORM_BLOCK,         TextureFormat::BC7,       KHR_DF_MODEL_BC7,    0 },
+        { VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, TextureFormat::ETC2,      KHR_DF_MODEL_ETC2,   KHR_DF_CHANNEL_ETC2_COLOR },
+        { VK_FORMAT_ASTC_4x4_UNORM_BLOCK,    TextureFormat::ASTC4X4,   KHR_DF_MODEL_ASTC,   0 },
     };
 
     // Image -> format headers/footers.
     //-----
 
-    // Notice: creates proper dds headers only for uncompressed formats.
-    void ddsHeaderFromImage(DdsHeader& _ddsHeader, DdsHeaderDxt10* _ddsHeaderDxt10, const Image& _image)
+    // Notice: block compressed formats are written with dxt10 header only.
+    /// Arrays of more than one element are always written with dxt10 header.
+    void ddsHeaderFromImage(DdsHeader& _ddsHeader, DdsHeaderDxt10* _ddsHeaderDxt10, const Image& _image, uint32_t _arraySize = 1)
     {
-        const DdsPixelFormat& ddsPixelFormat = getDdsPixelFormat(_image.m_format);
+        const DdsPixelFormat& ddsPixelFormat = (_arraySize > 1) ? s_ddsPixelFormat[5] : getDdsPixelFormat(_image.m_format);
 
-        const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
+        const uint32_t bytesPerPixel = imageDataInfo.m_bytesPerPixel;
+        const bool isCompressed = 0 != imageDataInfo.m_blockBytes;
         const bool hasMipMaps = _image.m_numMips > 1;
         const bool hasMultipleFaces = _image.m_numFaces > 0;
         const bool isCubemap = _image.m_numFaces == 6;
@@ -642,7 +1154,7 @@ namespace cmft
                 DEBUG_CHECK(0 != _ddsHeaderDxt10->m_dxgiFormat, "Dxt10 format should not be 0.");
                 _ddsHeaderDxt10->m_resourceDimension = DDS_DIMENSION_TEXTURE2D;
                 _ddsHeaderDxt10->m_miscFlags = isCubemap ? D3D10_RESOURCE_MISC_TEXTURECUBE : 0;
-                _ddsHeaderDxt10->m_arraySize = 1;
+                _ddsHeaderDxt10->m_arraySize = _arraySize;
                 _ddsHeaderDxt10->m_miscFlags2 = 0;
             }
             else
@@ -655,11 +1167,14 @@ namespace cmft
         _ddsHeader.m_size = DDS_HEADER_SIZE;
         _ddsHeader.m_flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT
                            | (hasMipMaps ? DDSD_MIPMAPCOUNT : 0)
-                           | DDSD_PITCH
+                           | (isCompressed ? DDSD_LINEARSIZE : DDSD_PITCH)
                            ;
         _ddsHeader.m_height = _image.m_height;
         _ddsHeader.m_width = _image.m_width;
-        _ddsHeader.m_pitchOrLinearSize = _image.m_width * bytesPerPixel;
+        _ddsHeader.m_pitchOrLinearSize = isCompressed
+                                       ? ((_image.m_width+3)/4) * ((_image.m_height+3)/4) * imageDataInfo.m_blockBytes
+                                       : _image.m_width * bytesPerPixel
+                                       ;
         _ddsHeader.m_mipMapCount = _image.m_numMips;
         memcpy(&_ddsHeader.m_pixelFormat, &ddsPixelFormat, sizeof(DdsPixelFormat));
         _ddsHeader.m_caps = DDSCAPS_TEXTURE
@@ -731,20 +1246,39 @@ namespace cmft
                );
     }
 
-    void ktxHeaderFromImage(KtxHeader& _ktxHeader, const Image& _image)
+    /// _numArrayElements is 0 for images that are not arrays.
+    void ktxHeaderFromImage(KtxHeader& _ktxHeader, const Image& _image, uint32_t _numArrayElements = 0)
     {
         const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
 
         _ktxHeader.m_endianness = KTX_ENDIAN_REF;
-        _ktxHeader.m_glType = pixelDataTypeToGlType((PixelDataType::Enum)imageDataInfo.m_pixelType);
-        _ktxHeader.m_glTypeSize = (imageDataInfo.m_bytesPerPixel/imageDataInfo.m_numChanels);
-        _ktxHeader.m_glFormat = getGlSizedInternalFormat(_image.m_format).m_glFormat;
+        if (0 != imageDataInfo.m_blockBytes)
+        {
+            // Compressed formats have no type and format, only base internal format.
+            _ktxHeader.m_glType = 0;
+            _ktxHeader.m_glTypeSize = 1;
+            _ktxHeader.m_glFormat = 0;
+        }
+        else if (TextureFormat::RGB9E5     == _image.m_format
+             ||  TextureFormat::R11G11B10F == _image.m_format)
+        {
+            // Packed formats have a packed type, the whole pixel is a single 4 byte value.
+            _ktxHeader.m_glType = (TextureFormat::RGB9E5 == _image.m_format) ? GL_UNSIGNED_INT_5_9_9_9_REV : GL_UNSIGNED_INT_10F_11F_11F_REV;
+            _ktxHeader.m_glTypeSize = 4;
+            _ktxHeader.m_glFormat = GL_RGB;
+        }
+        else
+        {
+            _ktxHeader.m_glType = pixelDataTypeToGlType((PixelDataType::Enum)imageDataInfo.m_pixelType);
+            _ktxHeader.m_glTypeSize = (imageDataInfo.m_bytesPerPixel/imageDataInfo.m_numChanels);
+            _ktxHeader.m_glFormat = getGlSizedInternalFormat(_image.m_format).m_glFormat;
+        }
         _ktxHeader.m_glInternalFormat = getGlSizedInternalFormat(_image.m_format).m_glInternalFormat;
-        _ktxHeader.m_glBaseInternalFormat = _ktxHeader.m_glFormat;
+        _ktxHeader.m_glBaseInternalFormat = getGlSizedInternalFormat(_image.m_format).m_glFormat;
         _ktxHeader.m_pixelWidth = _image.m_width;
         _ktxHeader.m_pixelHeight = _image.m_height;
         _ktxHeader.m_pixelDepth = 0;
-        _ktxHeader.m_numArrayElements = 0;
+        _ktxHeader.m_numArrayElements = _numArrayElements;
         _ktxHeader.m_numFaces = _image.m_numFaces;
         _ktxHeader.m_numMips = _image.m_numMips;
         _ktxHeader.m_bytesKeyValue = 0;
@@ -788,6 +1322,77 @@ namespace cmft
                );
     }
 
+    /// Writes basic data format descriptor of _format, with total size in front. Returns its size, at most 92 bytes.
+    uint32_t ktx2DfdFromFormat(uint8_t* _dfd, TextureFormat::Enum _format)
+    {
+        const TranslateKtx2Format* translate = NULL;
+        for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateKtx2Format); ii < end; ++ii)
+        {
+            if (s_translateKtx2Format[ii].m_textureFormat == _format)
+            {
+                translate = &s_translateKtx2Format[ii];
+                break;
+            }
+        }
+        DEBUG_CHECK(NULL != translate, "Not a valid Ktx2 texture format!");
+
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_format);
+        const bool isCompressed = 0 != imageDataInfo.m_blockBytes;
+        const uint32_t numSamples = isCompressed ? 1 : imageDataInfo.m_numChanels;
+        const uint32_t blockSize = 24 + 16*numSamples;
+        const uint32_t totalSize = 4 + blockSize;
+
+        memset(_dfd, 0, totalSize);
+        memcpy(&_dfd[0], &totalSize, 4);
+
+        // Descriptor block header, vendor and descriptor type are 0.
+        const uint16_t version = KHR_DF_VERSION;
+        const uint16_t blockSize16 = uint16_t(blockSize);
+        memcpy(&_dfd[8],  &version,     2);
+        memcpy(&_dfd[10], &blockSize16, 2);
+        _dfd[12] = translate->m_colorModel;
+        _dfd[13] = KHR_DF_PRIMARIES_BT709;
+        _dfd[14] = KHR_DF_TRANSFER_LINEAR;
+        _dfd[15] = 0; // Straight alpha.
+        _dfd[16] = isCompressed ? 3 : 0; // Texel block dimensions minus one.
+        _dfd[17] = isCompressed ? 3 : 0;
+        _dfd[20] = isCompressed ? imageDataInfo.m_blockBytes : imageDataInfo.m_bytesPerPixel;
+
+        uint8_t* sample = &_dfd[28];
+        if (isCompressed)
+        {
+            const uint16_t bitOffset = 0;
+            const uint32_t lower = (translate->m_channelType & KHR_DF_SAMPLE_DATATYPE_SIGNED) ? 0xbf800000 : 0;
+            const uint32_t upper = (translate->m_channelType & KHR_DF_SAMPLE_DATATYPE_FLOAT)  ? 0x3f800000 : UINT32_MAX;
+            memcpy(&sample[0], &bitOffset, 2);
+            sample[2] = uint8_t(imageDataInfo.m_blockBytes*8-1);
+            sample[3] = translate->m_channelType;
+            memcpy(&sample[8],  &lower, 4);
+            memcpy(&sample[12], &upper, 4);
+        }
+        else
+        {
+            const uint32_t channelBits = imageDataInfo.m_bytesPerPixel*8/imageDataInfo.m_numChanels;
+            const bool isFloat = (PixelDataType::HALF_FLOAT == imageDataInfo.m_pixelType || PixelDataType::FLOAT == imageDataInfo.m_pixelType);
+            static const uint8_t s_channelId[4] = { 0, 1, 2, KHR_DF_CHANNEL_RGBSDA_ALPHA };
+
+            // Floats span [-1, 1], normalized bytes [0, 255] and integers [0, 1].
+            const uint32_t lower = isFloat ? 0xbf800000 : 0;
+            const uint32_t upper = isFloat ? 0x3f800000 : (8 == channelBits ? 255 : 1);
+            for (uint32_t ii = 0; ii < numSamples; ++ii, sample += 16)
+            {
+                const uint16_t bitOffset = uint16_t(ii*channelBits);
+                memcpy(&sample[0], &bitOffset, 2);
+                sample[2] = uint8_t(channelBits-1);
+                sample[3] = s_channelId[ii] | (isFloat ? KHR_DF_SAMPLE_DATATYPE_FLOAT|KHR_DF_SAMPLE_DATATYPE_SIGNED : 0);
+                memcpy(&sample[8],  &lower, 4);
+                memcpy(&sample[12], &upper, 4);
+            }
+        }
+
+        return totalSize;
+    }
+
     void tgaHeaderFromImage(TgaHeader& _tgaHeader, const Image& _image)
     {
         memset(&_tgaHeader, 0, sizeof(TgaHeader));
@@ -852,15 +1457,194 @@ namespace cmft
                );
     }
 
+    // File mapping.
+    //-----
+
+    /// Maps _size bytes of the file behind _stream starting at _offset. Returns NULL if there is no file, it is too short or mapping fails.
+    static void* fileMap(Reader* _stream, int64_t _offset, uint64_t _size)
+    {
+#if CMFT_IMAGE_MMAP
+        FILE* fp = _stream->getFile();
+        if (NULL == fp)
+        {
+            return NULL;
+        }
+
+        const int fd = fileno(fp);
+
+        struct stat st;
+        if (0 != fstat(fd, &st)
+        ||  int64_t(st.st_size) < _offset + int64_t(_size))
+        {
+            return NULL;
+        }
+
+        // Mapping has to start at page boundary.
+        const int64_t pageSize = int64_t(sysconf(_SC_PAGESIZE));
+        const int64_t mapOffset = _offset & ~(pageSize-1);
+        const size_t mapSize = size_t(uint64_t(_offset - mapOffset) + _size);
+
+        // Private mapping, in place modifications of the image are not written back to the file.
+        void* ptr = mmap(NULL, mapSize, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, off_t(mapOffset));
+        if (MAP_FAILED == ptr)
+        {
+            return NULL;
+        }
+
+        return (void*)((uint8_t*)ptr + (_offset - mapOffset));
+#else
+        BX_UNUSED(_stream, _offset, _size);
+        return NULL;
+#endif // CMFT_IMAGE_MMAP
+    }
+
+    static void fileUnmap(void* _data, uint64_t _size)
+    {
+#if CMFT_IMAGE_MMAP
+        // Data starts less than a page after the mapping start.
+        const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+        const uintptr_t base = uintptr_t(_data) & ~(pageSize-1);
+        munmap((void*)base, size_t(uintptr_t(_data) - base + _size));
+#else
+        BX_UNUSED(_data, _size);
+#endif // CMFT_IMAGE_MMAP
+    }
+
+    /// Drops pages of mapped file data fully inside [_data, _data+_size). They are read from the file again if touched.
+    static void fileRelease(const void* _data, uint64_t _size)
+    {
+#if CMFT_IMAGE_MMAP
+        const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+        const uintptr_t begin = (uintptr_t(_data) + pageSize-1) & ~(pageSize-1);
+        const uintptr_t end = (uintptr_t(_data) + uintptr_t(_size)) & ~(pageSize-1);
+        if (begin < end)
+        {
+            madvise((void*)begin, size_t(end-begin), MADV_DONTNEED);
+        }
+#else
+        BX_UNUSED(_data, _size);
+#endif // CMFT_IMAGE_MMAP
+    }
+
+    // Stream I/O.
+    //-----
+
+    // Same arguments and results as fread(), fwrite(), fseek(), ftell() and fgets(), loaders and savers were written against those.
+    static inline size_t ioRead(void* _data, size_t _size, size_t _count, Reader* _stream)
+    {
+        return (0 != _size) ? _stream->read(_data, _size*_count)/_size : 0;
+    }
+
+    static inline size_t ioWrite(const void* _data, size_t _size, size_t _count, Writer* _stream)
+    {
+        return (0 != _size) ? _stream->write(_data, _size*_count)/_size : 0;
+    }
+
+    static inline int ioSeek(Reader* _stream, int64_t _offset, int _origin)
+    {
+        return _stream->seek(_offset, _origin) ? 0 : -1;
+    }
+
+    static inline int ioSeek(Writer* _stream, int64_t _offset, int _origin)
+    {
+        return _stream->seek(_offset, _origin) ? 0 : -1;
+    }
+
+    static inline int64_t ioTell(Reader* _stream)
+    {
+        return _stream->tell();
+    }
+
+    static inline int64_t ioTell(Writer* _stream)
+    {
+        return _stream->tell();
+    }
+
+    static char* ioGets(char* _buf, int _size, Reader* _stream)
+    {
+        int len = 0;
+        while (len < _size-1)
+        {
+            char ch;
+            if (1 != _stream->read(&ch, 1))
+            {
+                break;
+            }
+
+            _buf[len++] = ch;
+            if ('\n' == ch)
+            {
+                break;
+            }
+        }
+
+        if (0 == len)
+        {
+            return NULL;
+        }
+
+        _buf[len] = '\0';
+        return _buf;
+    }
+
     // Image.
     //-----
 
+    static inline Allocator* imageAllocator(const Image& _image)
+    {
+        return (NULL != _image.m_allocator) ? _image.m_allocator : getCrtAllocator();
+    }
+
+    struct ImageShare
+    {
+        uint32_t m_refCount;
+    };
+
+    static bx::Mutex s_imageShareMutex;
+
+    /// Drops one reference of shared data. Returns true if _image was the last image holding it.
+    static bool imageShareRelease(Image& _image)
+    {
+        ImageShare* share = _image.m_share;
+        _image.m_share = NULL;
+
+        uint32_t refCount;
+        {
+            bx::MutexScope lock(s_imageShareMutex);
+            refCount = --share->m_refCount;
+        }
+
+        if (0 != refCount)
+        {
+            return false;
+        }
+
+        free(share);
+        return true;
+    }
+
     void imageUnload(Image& _image)
     {
+        if (NULL != _image.m_share
+        &&  !imageShareRelease(_image))
+        {
+            _image.m_data = NULL;
+            _image.m_mapped = false;
+            return;
+        }
+
         if (_image.m_data)
         {
-            free(_image.m_data);
+            if (_image.m_mapped)
+            {
+                fileUnmap(_image.m_data, _image.m_dataSize);
+            }
+            else
+            {
+                imageAllocator(_image)->free(_image.m_data);
+            }
             _image.m_data = NULL;
+            _image.m_mapped = false;
         }
     }
 
@@ -873,20 +1657,27 @@ namespace cmft
         _dst.m_format   = _src.m_format;
         _dst.m_numMips  = _src.m_numMips;
         _dst.m_numFaces = _src.m_numFaces;
+        _dst.m_mapped   = _src.m_mapped;
+        _dst.m_allocator = _src.m_allocator;
+        _dst.m_faceTransforms = _src.m_faceTransforms;
     }
 
     void imageMove(Image& _dst, Image& _src)
     {
         imageUnload(_dst);
         imageRef(_dst, _src);
+        _dst.m_share = _src.m_share;
         _src.m_data = NULL;
+        _src.m_mapped = false;
+        _src.m_share = NULL;
     }
 
     void imageCopy(Image& _dst, const Image& _src)
     {
         imageUnload(_dst);
 
-        _dst.m_data = malloc(_src.m_dataSize);
+        _dst.m_allocator = getAllocator();
+        _dst.m_data = _dst.m_allocator->alloc(_src.m_dataSize);
         MALLOC_CHECK(_dst.m_data);
         memcpy(_dst.m_data, _src.m_data, _src.m_dataSize);
         _dst.m_width    = _src.m_width;
@@ -895,64 +1686,180 @@ namespace cmft
         _dst.m_format   = _src.m_format;
         _dst.m_numMips  = _src.m_numMips;
         _dst.m_numFaces = _src.m_numFaces;
+        _dst.m_mapped   = false;
+        _dst.m_faceTransforms = _src.m_faceTransforms;
+    }
+
+    void imageShare(Image& _dst, Image& _src)
+    {
+        if (&_dst == &_src)
+        {
+            return;
+        }
+
+        imageUnload(_dst);
+
+        if (NULL == _src.m_share)
+        {
+            _src.m_share = (ImageShare*)malloc(sizeof(ImageShare));
+            MALLOC_CHECK(_src.m_share);
+            _src.m_share->m_refCount = 1;
+        }
+
+        {
+            bx::MutexScope lock(s_imageShareMutex);
+            ++_src.m_share->m_refCount;
+        }
+
+        imageRef(_dst, _src);
+        _dst.m_share = _src.m_share;
+    }
+
+    void imageShareOrCopy(Image& _dst, const Image& _src)
+    {
+        if (NULL != _src.m_share)
+        {
+            imageShare(_dst, const_cast<Image&>(_src));
+        }
+        else
+        {
+            imageCopy(_dst, _src);
+        }
+    }
+
+    bool imageIsShared(const Image& _image)
+    {
+        if (NULL == _image.m_share)
+        {
+            return false;
+        }
+
+        // Only the caller can add references of its own image, a count of one can not grow meanwhile.
+        bx::MutexScope lock(s_imageShareMutex);
+        return 1 < _image.m_share->m_refCount;
+    }
+
+    void imageMakeUnique(Image& _image)
+    {
+        if (imageIsShared(_image))
+        {
+            Image tmp;
+            imageCopy(tmp, _image);
+            imageMove(_image, tmp);
+        }
     }
 
-    uint32_t imageGetNumPixels(const Image& _image)
+    uint64_t imageGetNumPixels(const Image& _image)
     {
         DEBUG_CHECK(0 != _image.m_numMips, "Mips count cannot be 0.");
 
-        uint32_t count = 0;
+        uint64_t count = 0;
         for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
         {
             const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
             const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
-            count += width * height;
+            count += uint64_t(width) * height;
         }
         count *= _image.m_numFaces;
 
         return count;
     }
 
-    void imageGetMipOffsets(uint32_t _offsets[CUBE_FACE_NUM][MAX_MIP_NUM], const Image& _image)
+    /// Bytes of a single face of a _width x _height mip. Block compressed mips are padded to whole blocks.
+    static inline uint64_t mipFaceDataSize(const ImageDataInfo& _info, uint32_t _width, uint32_t _height)
     {
-        const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
+        if (0 != _info.m_blockBytes)
+        {
+            return uint64_t((_width+3)/4) * ((_height+3)/4) * _info.m_blockBytes;
+        }
+
+        return uint64_t(_width) * _height * _info.m_bytesPerPixel;
+    }
+
+    void imageGetLayout(ImageLayout& _layout, const Image& _image, uint32_t _rowAlignment)
+    {
+        DEBUG_CHECK(0 != _rowAlignment && 0 == (_rowAlignment&(_rowAlignment-1)), "Row alignment has to be a power of two.");
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
+        const uint64_t alignMask = uint64_t(_rowAlignment) - 1;
+
+        for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
+        {
+            const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
+            const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
+            const uint64_t rowSize = (0 != imageDataInfo.m_blockBytes)
+                                   ? uint64_t((width+3)/4) * imageDataInfo.m_blockBytes
+                                   : uint64_t(width) * imageDataInfo.m_bytesPerPixel
+                                   ;
+            _layout.m_pitch[mip] = (rowSize + alignMask) & ~alignMask;
+            _layout.m_numRows[mip] = (0 != imageDataInfo.m_blockBytes) ? (height+3)/4 : height;
+        }
 
-        uint32_t offset = 0;
+        uint64_t offset = 0;
         for (uint8_t face = 0; face < _image.m_numFaces; ++face)
         {
             for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
             {
-                _offsets[face][mip] = offset;
+                _layout.m_offsets[face][mip] = offset;
+                offset += _layout.m_pitch[mip] * _layout.m_numRows[mip];
+            }
+        }
+
+        _layout.m_dataSize = offset;
+        _layout.m_rowAlignment = _rowAlignment;
+    }
+
+    void imageCopyToLayout(void* _dst, const ImageLayout& _layout, const Image& _src)
+    {
+        ImageLayout srcLayout;
+        imageGetLayout(srcLayout, _src);
 
-                const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
-                const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
-                offset += width * height * bytesPerPixel;
+        for (uint8_t face = 0; face < _src.m_numFaces; ++face)
+        {
+            for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
+            {
+                const uint64_t rowSize = srcLayout.m_pitch[mip];
+                const uint8_t* srcRow = (const uint8_t*)_src.m_data + srcLayout.m_offsets[face][mip];
+                uint8_t* dstRow = (uint8_t*)_dst + _layout.m_offsets[face][mip];
+                for (uint32_t yy = 0; yy < _layout.m_numRows[mip]; ++yy)
+                {
+                    memcpy(dstRow, srcRow, size_t(rowSize));
+                    memset(dstRow + rowSize, 0, size_t(_layout.m_pitch[mip] - rowSize));
+                    srcRow += rowSize;
+                    dstRow += _layout.m_pitch[mip];
+                }
             }
         }
     }
 
-    void imageGetFaceOffsets(uint32_t _faceOffsets[CUBE_FACE_NUM], const Image& _image)
+    void imageGetMipOffsets(uint64_t _offsets[CUBE_FACE_NUM][MAX_MIP_NUM], const Image& _image)
     {
-        const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
+        ImageLayout layout;
+        imageGetLayout(layout, _image);
 
-        uint32_t offset = 0;
         for (uint8_t face = 0; face < _image.m_numFaces; ++face)
         {
-            _faceOffsets[face] = offset;
-
             for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
             {
-                const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
-                const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
-                offset += width * height * bytesPerPixel;
+                _offsets[face][mip] = layout.m_offsets[face][mip];
             }
         }
     }
 
-    // To rgba32f.
-    //-----
-
-    inline void bgr8ToRgba32f(float* _rgba32f, const uint8_t* _bgr8)
+    void imageGetFaceOffsets(uint64_t _faceOffsets[CUBE_FACE_NUM], const Image& _image)
+    {
+        ImageLayout layout;
+        imageGetLayout(layout, _image);
+
+        for (uint8_t face = 0; face < _image.m_numFaces; ++face)
+        {
+            _faceOffsets[face] = layout.m_offsets[face][0];
+        }
+    }
+
+    // To rgba32f.
+    //-----
+
+    inline void bgr8ToRgba32f(float* _rgba32f, const uint8_t* _bgr8)
     {
         _rgba32f[0] = float(_bgr8[2]) * (1.0f/255.0f);
         _rgba32f[1] = float(_bgr8[1]) * (1.0f/255.0f);
@@ -1002,18 +1909,18 @@ namespace cmft
 
     inline void rgb16fToRgba32f(float* _rgba32f, const uint16_t* _rgb16f)
     {
-        _rgba32f[0] = bx::halfToFloat(_rgb16f[0]);
-        _rgba32f[1] = bx::halfToFloat(_rgb16f[1]);
-        _rgba32f[2] = bx::halfToFloat(_rgb16f[2]);
+        _rgba32f[0] = halfToFloat(_rgb16f[0]);
+        _rgba32f[1] = halfToFloat(_rgb16f[1]);
+        _rgba32f[2] = halfToFloat(_rgb16f[2]);
         _rgba32f[3] = 1.0f;
     }
 
     inline void rgba16fToRgba32f(float* _rgba32f, const uint16_t* _rgba16f)
     {
-        _rgba32f[0] = bx::halfToFloat(_rgba16f[0]);
-        _rgba32f[1] = bx::halfToFloat(_rgba16f[1]);
-        _rgba32f[2] = bx::halfToFloat(_rgba16f[2]);
-        _rgba32f[3] = bx::halfToFloat(_rgba16f[3]);
+        _rgba32f[0] = halfToFloat(_rgba16f[0]);
+        _rgba32f[1] = halfToFloat(_rgba16f[1]);
+        _rgba32f[2] = halfToFloat(_rgba16f[2]);
+        _rgba32f[3] = halfToFloat(_rgba16f[3]);
     }
 
     inline void rgb32fToRgba32f(float* _rgba32f, const float* _rgb32f)
@@ -1029,6 +1936,22 @@ namespace cmft
         memcpy(_dst, _src, 4*sizeof(float));
     }
 
+    inline void rg16fToRgba32f(float* _rgba32f, const uint16_t* _rg16f)
+    {
+        _rgba32f[0] = halfToFloat(_rg16f[0]);
+        _rgba32f[1] = halfToFloat(_rg16f[1]);
+        _rgba32f[2] = 0.0f;
+        _rgba32f[3] = 1.0f;
+    }
+
+    inline void rg32fToRgba32f(float* _rgba32f, const float* _rg32f)
+    {
+        _rgba32f[0] = _rg32f[0];
+        _rgba32f[1] = _rg32f[1];
+        _rgba32f[2] = 0.0f;
+        _rgba32f[3] = 1.0f;
+    }
+
     inline void rgbeToRgba32f(float* _rgba32f, const uint8_t* _rgbe)
     {
         if (_rgbe[3])
@@ -1048,68 +1971,555 @@ namespace cmft
         }
     }
 
+    inline void rgb9e5ToRgba32f(float* _rgba32f, const uint32_t* _rgb9e5)
+    {
+        // Mantissas are scaled by 2^(exp-15-9).
+        const uint32_t packed = *_rgb9e5;
+        union { uint32_t m_u; float m_f; } scale;
+        scale.m_u = ((packed>>27) + 103)<<23;
+        _rgba32f[0] = float((packed    )&0x1ff) * scale.m_f;
+        _rgba32f[1] = float((packed>>9 )&0x1ff) * scale.m_f;
+        _rgba32f[2] = float((packed>>18)&0x1ff) * scale.m_f;
+        _rgba32f[3] = 1.0f;
+    }
+
+    inline void r11g11b10fToRgba32f(float* _rgba32f, const uint32_t* _r11g11b10f)
+    {
+        // Small floats have the same exponent bias as halfs, only fewer mantissa bits.
+        const uint32_t packed = *_r11g11b10f;
+        _rgba32f[0] = halfToFloat(uint16_t(((packed    )&0x7ff)<<4));
+        _rgba32f[1] = halfToFloat(uint16_t(((packed>>11)&0x7ff)<<4));
+        _rgba32f[2] = halfToFloat(uint16_t(((packed>>22)&0x3ff)<<5));
+        _rgba32f[3] = 1.0f;
+    }
+
+    // Rgbm, rgbd and LogLuv.
+    //-----
+
+    static const ImageEncodeSettings s_defaultEncodeSettings;
+
+    static inline const ImageEncodeSettings& encodeSettings(const ImageEncodeSettings* _settings)
+    {
+        return NULL != _settings ? *_settings : s_defaultEncodeSettings;
+    }
+
+    // Ranges that are not positive can not be encoded, defaults are used instead.
+    static inline float rgbmRange(const ImageEncodeSettings& _settings)
+    {
+        return _settings.m_rgbmRange > 0.0f ? _settings.m_rgbmRange : s_defaultEncodeSettings.m_rgbmRange;
+    }
+
+    static inline float rgbdRange(const ImageEncodeSettings& _settings)
+    {
+        return _settings.m_rgbdRange > 0.0f ? _settings.m_rgbdRange : s_defaultEncodeSettings.m_rgbdRange;
+    }
+
+    // Rgb to X'YZ' of LogLuv and back, for rgb on the left.
+    static const float s_logLuvM[3][3] =
+    {
+        { 0.2209f, 0.3390f, 0.4184f },
+        { 0.1138f, 0.6780f, 0.7319f },
+        { 0.0102f, 0.1130f, 0.2969f },
+    };
+
+    static const float s_logLuvInvM[3][3] =
+    {
+        {  6.0014f, -2.7008f, -1.7996f },
+        { -1.3320f,  3.1029f, -5.7721f },
+        {  0.3008f, -1.0882f,  5.6268f },
+    };
+
+    inline void rgbmToRgba32f(float* _rgba32f, const uint8_t* _rgbm, float _range)
+    {
+        const float scale = float(_rgbm[3]) * (_range/(255.0f*255.0f));
+        _rgba32f[0] = float(_rgbm[0]) * scale;
+        _rgba32f[1] = float(_rgbm[1]) * scale;
+        _rgba32f[2] = float(_rgbm[2]) * scale;
+        _rgba32f[3] = 1.0f;
+    }
+
+    inline void rgbdToRgba32f(float* _rgba32f, const uint8_t* _rgbd, float _range)
+    {
+        const float scale = (0 != _rgbd[3]) ? _range/(255.0f*float(_rgbd[3])) : 0.0f;
+        _rgba32f[0] = float(_rgbd[0]) * scale;
+        _rgba32f[1] = float(_rgbd[1]) * scale;
+        _rgba32f[2] = float(_rgbd[2]) * scale;
+        _rgba32f[3] = 1.0f;
+    }
+
+    inline void logLuvToRgba32f(float* _rgba32f, const uint8_t* _logLuv)
+    {
+        // Log luminance is 2*log2(Y)+127, in integer part and 1/255s.
+        const float le = float(_logLuv[2]) + float(_logLuv[3])*(1.0f/255.0f);
+        const float yy = exp2f((le-127.0f)*0.5f);
+        const float zz = (0 != _logLuv[1]) ? yy*255.0f/float(_logLuv[1]) : 0.0f;
+        const float xx = float(_logLuv[0])*(1.0f/255.0f)*zz;
+
+        for (uint8_t ii = 0; ii < 3; ++ii)
+        {
+            const float value = xx*s_logLuvInvM[0][ii] + yy*s_logLuvInvM[1][ii] + zz*s_logLuvInvM[2][ii];
+            _rgba32f[ii] = max(value, 0.0f);
+        }
+        _rgba32f[3] = 1.0f;
+    }
+
+    // Row converters to rgba32f.
+    //-----
+
+#if CMFT_CONVERT_SIMD
+    /// Replaces alpha with 1.0f.
+    static inline __m128 simdAlphaOne(__m128 _rgba)
+    {
+        const __m128 rgbMask  = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+        const __m128 alphaOne = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        return _mm_or_ps(_mm_and_ps(_rgba, rgbMask), alphaOne);
+    }
+
+    /// Swaps red and blue.
+    static inline __m128 simdSwapRb(__m128 _rgba)
+    {
+        return _mm_shuffle_ps(_rgba, _rgba, _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    /// Converts 4 positive halfs held in low 16 bits of 32-bit lanes to floats.
+    static inline __m128 simdHalfToFloat(__m128i _half)
+    {
+    #if CMFT_F16C
+        return _mm_cvtph_ps(_mm_packs_epi32(_half, _half));
+    #else
+        using namespace bx;
+
+        // Rebias exponent and shift mantissa, then fix up Inf/NaN and denormals.
+        const float4_t half       = _mm_castsi128_ps(_half);
+        const float4_t shiftedExp = float4_isplat(0x7c00<<13);
+        const float4_t bits       = float4_sll(float4_and(half, float4_isplat(0x7fff)), 13);
+        const float4_t exp        = float4_and(bits, shiftedExp);
+        const float4_t normal     = float4_iadd(bits, float4_isplat((127-15)<<23));
+        const float4_t infNan     = float4_iadd(normal, float4_and(float4_icmpeq(exp, shiftedExp), float4_isplat((128-16)<<23)));
+        const float4_t denormal   = float4_sub(float4_iadd(normal, float4_isplat(1<<23)), float4_isplat(113<<23));
+        const float4_t result     = float4_selb(float4_icmpeq(exp, float4_zero()), denormal, infNan);
+        const float4_t sign       = float4_sll(float4_and(half, float4_isplat(0x8000)), 16);
+
+        return float4_or(result, sign);
+    #endif // CMFT_F16C
+    }
+
+    /// Loads 4 consecutive halfs as floats.
+    static inline __m128 simdLoadHalf4(const uint16_t* _src)
+    {
+    #if CMFT_F16C
+        return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)_src));
+    #else
+        return simdHalfToFloat(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)_src), _mm_setzero_si128()));
+    #endif // CMFT_F16C
+    }
+#endif // CMFT_CONVERT_SIMD
+
+    /// Bgra8/rgba8 row to rgba32f.
+    template <bool Bgra>
+    static void rgba8ToRgba32fRow(float* _dst, const uint8_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128 scale = _mm_set1_ps(1.0f/255.0f);
+        const __m128i zero = _mm_setzero_si128();
+        for (; ii+4 <= _num; ii+=4)
+        {
+            const __m128i src = _mm_loadu_si128((const __m128i*)&_src[ii*4]);
+            const __m128i lo = _mm_unpacklo_epi8(src, zero);
+            const __m128i hi = _mm_unpackhi_epi8(src, zero);
+
+            __m128 rgba[4] =
+            {
+                _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)),
+                _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)),
+                _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)),
+                _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)),
+            };
+
+            for (uint8_t jj = 0; jj < 4; ++jj)
+            {
+                rgba[jj] = _mm_mul_ps(rgba[jj], scale);
+                _mm_storeu_ps(&_dst[(ii+jj)*4], Bgra ? simdSwapRb(rgba[jj]) : rgba[jj]);
+            }
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            if (Bgra)
+            {
+                bgra8ToRgba32f(&_dst[ii*4], &_src[ii*4]);
+            }
+            else
+            {
+                rgba8ToRgba32f(&_dst[ii*4], &_src[ii*4]);
+            }
+        }
+    }
+
+    /// Bgr8/rgb8 row to rgba32f.
+    template <bool Bgr>
+    static void rgb8ToRgba32fRow(float* _dst, const uint8_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128 scale = _mm_set1_ps(1.0f/255.0f);
+        const __m128i zero = _mm_setzero_si128();
+        for (; ii+4 <= _num; ii+=4)
+        {
+            // Load 12 bytes of 4 pixels.
+            int32_t last;
+            memcpy(&last, &_src[ii*3+8], sizeof(int32_t));
+            const __m128i src = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)&_src[ii*3]), _mm_cvtsi32_si128(last));
+            const __m128i lo = _mm_unpacklo_epi8(src, zero);
+            const __m128i hi = _mm_unpackhi_epi8(src, zero);
+
+            // aa = r0 g0 b0 r1, bb = g1 b1 r2 g2, cc = b2 r3 g3 b3.
+            const __m128 aa = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+            const __m128 bb = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+            const __m128 cc = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+            const __m128 ab = _mm_shuffle_ps(aa, bb, _MM_SHUFFLE(1, 0, 3, 3));
+
+            __m128 rgba[4] =
+            {
+                aa,
+                _mm_shuffle_ps(ab, ab, _MM_SHUFFLE(3, 3, 2, 0)),
+                _mm_shuffle_ps(bb, cc, _MM_SHUFFLE(0, 0, 3, 2)),
+                _mm_shuffle_ps(cc, cc, _MM_SHUFFLE(3, 3, 2, 1)),
+            };
+
+            for (uint8_t jj = 0; jj < 4; ++jj)
+            {
+                rgba[jj] = simdAlphaOne(_mm_mul_ps(rgba[jj], scale));
+                _mm_storeu_ps(&_dst[(ii+jj)*4], Bgr ? simdSwapRb(rgba[jj]) : rgba[jj]);
+            }
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            if (Bgr)
+            {
+                bgr8ToRgba32f(&_dst[ii*4], &_src[ii*3]);
+            }
+            else
+            {
+                rgb8ToRgba32f(&_dst[ii*4], &_src[ii*3]);
+            }
+        }
+    }
+
+    /// Rgba16f row to rgba32f.
+    static void rgba16fToRgba32fRow(float* _dst, const uint16_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        for (; ii < _num; ++ii)
+        {
+            _mm_storeu_ps(&_dst[ii*4], simdLoadHalf4(&_src[ii*4]));
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgba16fToRgba32f(&_dst[ii*4], &_src[ii*4]);
+        }
+    }
+
+    /// Rgb16f row to rgba32f.
+    static void rgb16fToRgba32fRow(float* _dst, const uint16_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Loads 4 halfs, the last pixel is converted separately to not read past the end.
+        for (; ii+1 < _num; ++ii)
+        {
+            _mm_storeu_ps(&_dst[ii*4], simdAlphaOne(simdLoadHalf4(&_src[ii*3])));
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgb16fToRgba32f(&_dst[ii*4], &_src[ii*3]);
+        }
+    }
+
+    /// Rgbe row to rgba32f.
+    static void rgbeToRgba32fRow(float* _dst, const uint8_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128i zero = _mm_setzero_si128();
+        for (; ii < _num; ++ii)
+        {
+            int32_t rgbe;
+            memcpy(&rgbe, &_src[ii*4], sizeof(int32_t));
+            const __m128i src = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(rgbe), zero), zero);
+
+            // Same as ldexp(1.0f, exp-(128+8)), exponents below 9 give denormals.
+            const uint32_t exp = _src[ii*4+3];
+            union { uint32_t m_u; float m_f; } scale;
+            scale.m_u = (exp >= 9) ? (exp-9)<<23 : (0 != exp) ? UINT32_C(1)<<(exp+13) : 0;
+
+            const __m128 rgba = _mm_mul_ps(_mm_cvtepi32_ps(src), _mm_set1_ps(scale.m_f));
+            _mm_storeu_ps(&_dst[ii*4], simdAlphaOne(rgba));
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgbeToRgba32f(&_dst[ii*4], &_src[ii*4]);
+        }
+    }
+
+    /// Rgb9e5 row to rgba32f.
+    static void rgb9e5ToRgba32fRow(float* _dst, const uint32_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128i mantissaMask = _mm_set1_epi32(0x1ff);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            const __m128i packed = _mm_loadu_si128((const __m128i*)&_src[ii]);
+            const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_srli_epi32(packed, 27), _mm_set1_epi32(103)), 23));
+
+            __m128 rr = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(packed,                     mantissaMask)), scale);
+            __m128 gg = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed,  9), mantissaMask)), scale);
+            __m128 bb = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 18), mantissaMask)), scale);
+            __m128 aa = _mm_set1_ps(1.0f);
+            _MM_TRANSPOSE4_PS(rr, gg, bb, aa);
+
+            _mm_storeu_ps(&_dst[(ii+0)*4], rr);
+            _mm_storeu_ps(&_dst[(ii+1)*4], gg);
+            _mm_storeu_ps(&_dst[(ii+2)*4], bb);
+            _mm_storeu_ps(&_dst[(ii+3)*4], aa);
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgb9e5ToRgba32f(&_dst[ii*4], &_src[ii]);
+        }
+    }
+
+    /// R11g11b10f row to rgba32f.
+    static void r11g11b10fToRgba32fRow(float* _dst, const uint32_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Channels are shifted into halfs, 4 pixels at a time.
+        for (; ii+4 <= _num; ii+=4)
+        {
+            const __m128i packed = _mm_loadu_si128((const __m128i*)&_src[ii]);
+
+            __m128 rr = simdHalfToFloat(_mm_slli_epi32(_mm_and_si128(packed, _mm_set1_epi32(0x7ff)), 4));
+            __m128 gg = simdHalfToFloat(_mm_and_si128(_mm_srli_epi32(packed,  7), _mm_set1_epi32(0x7ff0)));
+            __m128 bb = simdHalfToFloat(_mm_and_si128(_mm_srli_epi32(packed, 17), _mm_set1_epi32(0x7fe0)));
+            __m128 aa = _mm_set1_ps(1.0f);
+            _MM_TRANSPOSE4_PS(rr, gg, bb, aa);
+
+            _mm_storeu_ps(&_dst[(ii+0)*4], rr);
+            _mm_storeu_ps(&_dst[(ii+1)*4], gg);
+            _mm_storeu_ps(&_dst[(ii+2)*4], bb);
+            _mm_storeu_ps(&_dst[(ii+3)*4], aa);
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            r11g11b10fToRgba32f(&_dst[ii*4], &_src[ii]);
+        }
+    }
+
+#if CMFT_CONVERT_SIMD
+    /// Loads 4 rgba8 pixels as 4 channel vectors, values 0-255.
+    static inline void simdLoadChannels8(__m128& _rr, __m128& _gg, __m128& _bb, __m128& _aa, const uint8_t* _src)
+    {
+        const __m128i packed = _mm_loadu_si128((const __m128i*)_src);
+        const __m128i mask = _mm_set1_epi32(0xff);
+        _rr = _mm_cvtepi32_ps(_mm_and_si128(packed, mask));
+        _gg = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed,  8), mask));
+        _bb = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 16), mask));
+        _aa = _mm_cvtepi32_ps(_mm_srli_epi32(packed, 24));
+    }
+
+    /// Stores channel vectors of 4 pixels as rgba32f, alpha is 1.0f.
+    static inline void simdStoreRgb(float* _dst, __m128 _rr, __m128 _gg, __m128 _bb)
+    {
+        __m128 aa = _mm_set1_ps(1.0f);
+        _MM_TRANSPOSE4_PS(_rr, _gg, _bb, aa);
+        _mm_storeu_ps(&_dst[0],  _rr);
+        _mm_storeu_ps(&_dst[4],  _gg);
+        _mm_storeu_ps(&_dst[8],  _bb);
+        _mm_storeu_ps(&_dst[12], aa);
+    }
+#endif // CMFT_CONVERT_SIMD
+
+    /// Rgbm row to rgba32f.
+    static void rgbmToRgba32fRow(float* _dst, const uint8_t* _src, uint32_t _num, float _range)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128 range = _mm_set1_ps(_range/(255.0f*255.0f));
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr, gg, bb, mm;
+            simdLoadChannels8(rr, gg, bb, mm, &_src[ii*4]);
+
+            const __m128 scale = _mm_mul_ps(mm, range);
+            simdStoreRgb(&_dst[ii*4], _mm_mul_ps(rr, scale), _mm_mul_ps(gg, scale), _mm_mul_ps(bb, scale));
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgbmToRgba32f(&_dst[ii*4], &_src[ii*4], _range);
+        }
+    }
+
+    /// Rgbd row to rgba32f.
+    static void rgbdToRgba32fRow(float* _dst, const uint8_t* _src, uint32_t _num, float _range)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128 range = _mm_set1_ps(_range/255.0f);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr, gg, bb, dd;
+            simdLoadChannels8(rr, gg, bb, dd, &_src[ii*4]);
+
+            // Zero divisor gives black.
+            const __m128 valid = _mm_cmpgt_ps(dd, _mm_setzero_ps());
+            const __m128 scale = _mm_and_ps(_mm_div_ps(range, _mm_max_ps(dd, _mm_set1_ps(1.0f))), valid);
+            simdStoreRgb(&_dst[ii*4], _mm_mul_ps(rr, scale), _mm_mul_ps(gg, scale), _mm_mul_ps(bb, scale));
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgbdToRgba32f(&_dst[ii*4], &_src[ii*4], _range);
+        }
+    }
+
+    /// LogLuv row to rgba32f.
+    static void logLuvToRgba32fRow(float* _dst, const uint8_t* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 inv255 = _mm_set1_ps(1.0f/255.0f);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 uu, vv, hi, lo;
+            simdLoadChannels8(uu, vv, hi, lo, &_src[ii*4]);
+
+            const __m128 le = _mm_add_ps(hi, _mm_mul_ps(lo, inv255));
+            const __m128 yy = bx::float4_exp2(_mm_mul_ps(_mm_sub_ps(le, _mm_set1_ps(127.0f)), _mm_set1_ps(0.5f)));
+            const __m128 valid = _mm_cmpgt_ps(vv, zero);
+            const __m128 zz = _mm_and_ps(_mm_div_ps(_mm_mul_ps(yy, _mm_set1_ps(255.0f)), _mm_max_ps(vv, _mm_set1_ps(1.0f))), valid);
+            const __m128 xx = _mm_mul_ps(_mm_mul_ps(uu, inv255), zz);
+
+            __m128 rgb[3];
+            for (uint8_t jj = 0; jj < 3; ++jj)
+            {
+                rgb[jj] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xx, _mm_set1_ps(s_logLuvInvM[0][jj]))
+                                              , _mm_mul_ps(yy, _mm_set1_ps(s_logLuvInvM[1][jj])))
+                                              , _mm_mul_ps(zz, _mm_set1_ps(s_logLuvInvM[2][jj])));
+                rgb[jj] = _mm_max_ps(rgb[jj], zero);
+            }
+            simdStoreRgb(&_dst[ii*4], rgb[0], rgb[1], rgb[2]);
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            logLuvToRgba32f(&_dst[ii*4], &_src[ii*4]);
+        }
+    }
+
     void toRgba32f(float _rgba32f[4], TextureFormat::Enum _srcFormat, const void* _src)
     {
         switch(_srcFormat)
         {
-        case TextureFormat::BGR8:     bgr8ToRgba32f(_rgba32f,     (uint8_t*)_src); break;
-        case TextureFormat::RGB8:     rgb8ToRgba32f(_rgba32f,     (uint8_t*)_src); break;
-        case TextureFormat::RGB16:    rgb16ToRgba32f(_rgba32f,   (uint16_t*)_src); break;
-        case TextureFormat::RGB16F:   rgb16fToRgba32f(_rgba32f,  (uint16_t*)_src); break;
-        case TextureFormat::RGB32F:   rgb32fToRgba32f(_rgba32f,     (float*)_src); break;
-        case TextureFormat::RGBE:     rgbeToRgba32f(_rgba32f,     (uint8_t*)_src); break;
-        case TextureFormat::BGRA8:    bgra8ToRgba32f(_rgba32f,    (uint8_t*)_src); break;
-        case TextureFormat::RGBA8:    rgba8ToRgba32f(_rgba32f,    (uint8_t*)_src); break;
-        case TextureFormat::RGBA16:   rgba16ToRgba32f(_rgba32f,  (uint16_t*)_src); break;
-        case TextureFormat::RGBA16F:  rgba16fToRgba32f(_rgba32f, (uint16_t*)_src); break;
-        case TextureFormat::RGBA32F:  rgba32fToRgba32f(_rgba32f,    (float*)_src); break;
+        case TextureFormat::BGR8:       bgr8ToRgba32f(_rgba32f,        (const uint8_t*)_src); break;
+        case TextureFormat::RGB8:       rgb8ToRgba32f(_rgba32f,        (const uint8_t*)_src); break;
+        case TextureFormat::RGB16:      rgb16ToRgba32f(_rgba32f,      (const uint16_t*)_src); break;
+        case TextureFormat::RGB16F:     rgb16fToRgba32f(_rgba32f,     (const uint16_t*)_src); break;
+        case TextureFormat::RGB32F:     rgb32fToRgba32f(_rgba32f,        (const float*)_src); break;
+        case TextureFormat::RGBE:       rgbeToRgba32f(_rgba32f,        (const uint8_t*)_src); break;
+        case TextureFormat::BGRA8:      bgra8ToRgba32f(_rgba32f,       (const uint8_t*)_src); break;
+        case TextureFormat::RGBA8:      rgba8ToRgba32f(_rgba32f,       (const uint8_t*)_src); break;
+        case TextureFormat::RGBA16:     rgba16ToRgba32f(_rgba32f,     (const uint16_t*)_src); break;
+        case TextureFormat::RGBA16F:    rgba16fToRgba32f(_rgba32f,    (const uint16_t*)_src); break;
+        case TextureFormat::RGBA32F:    rgba32fToRgba32f(_rgba32f,       (const float*)_src); break;
+        case TextureFormat::RG16F:      rg16fToRgba32f(_rgba32f,      (const uint16_t*)_src); break;
+        case TextureFormat::RG32F:      rg32fToRgba32f(_rgba32f,         (const float*)_src); break;
+        case TextureFormat::RGB9E5:     rgb9e5ToRgba32f(_rgba32f,     (const uint32_t*)_src); break;
+        case TextureFormat::R11G11B10F: r11g11b10fToRgba32f(_rgba32f, (const uint32_t*)_src); break;
+        case TextureFormat::RGBM8:      rgbmToRgba32f(_rgba32f,        (const uint8_t*)_src, s_defaultEncodeSettings.m_rgbmRange); break;
+        case TextureFormat::RGBD8:      rgbdToRgba32f(_rgba32f,        (const uint8_t*)_src, s_defaultEncodeSettings.m_rgbdRange); break;
+        case TextureFormat::LOGLUV8:    logLuvToRgba32f(_rgba32f,      (const uint8_t*)_src); break;
         default: DEBUG_CHECK(false, "Unknown image format.");
         };
     }
 
-    void imageToRgba32f(Image& _dst, const Image& _src)
+    struct ImageConvertArgs
     {
-        // Alloc dst data.
-        const uint32_t pixelCount = imageGetNumPixels(_src);
-        const uint8_t dstBytesPerPixel = getImageDataInfo(TextureFormat::RGBA32F).m_bytesPerPixel;
-        const uint32_t dataSize = pixelCount*dstBytesPerPixel;
-        void* data = malloc(dataSize);
-        MALLOC_CHECK(data);
+        ImageConvertArgs(const ImageEncodeSettings& _settings = s_defaultEncodeSettings)
+            : m_rgbmRange(rgbmRange(_settings))
+            , m_rgbdRange(rgbdRange(_settings))
+        {
+        }
 
-        // Get total number of channels.
-        const uint8_t numChannelsPerPixel = getImageDataInfo(TextureFormat::RGBA32F).m_numChanels;
-        const uint32_t totalNumChannels = pixelCount*numChannelsPerPixel;
+        void* m_dst;
+        const void* m_src;
+        TextureFormat::Enum m_srcFormat;
+        TextureFormat::Enum m_dstFormat;
+        uint8_t m_srcBytesPerPixel;
+        uint8_t m_dstBytesPerPixel;
+        float m_rgbmRange;
+        float m_rgbdRange;
+    };
+
+    // Minimum number of pixels converted by a single thread.
+    #define CMFT_CONVERT_MIN_PIXELS_PER_THREAD (1<<14)
+
+    static void imageToRgba32fRange(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ImageConvertArgs* args = (const ImageConvertArgs*)_userData;
 
         // Convert each channel.
-        float* dst = (float*)data;
-        const float* end = (float*)dst + totalNumChannels;
-        switch(_src.m_format)
+        float* dst = (float*)args->m_dst + size_t(_begin)*4;
+        const float* end = (float*)args->m_dst + size_t(_end)*4;
+        const void* srcData = (const uint8_t*)args->m_src + size_t(_begin)*args->m_srcBytesPerPixel;
+        switch(args->m_srcFormat)
         {
         case TextureFormat::BGR8:
             {
-                const uint8_t* src = (const uint8_t*)_src.m_data;
-
-                for (;dst < end; dst+=4, src+=3)
-                {
-                    bgr8ToRgba32f(dst, src);
-                }
+                rgb8ToRgba32fRow<true>(dst, (const uint8_t*)srcData, _end-_begin);
             }
         break;
 
         case TextureFormat::RGB8:
             {
-                const uint8_t* src = (const uint8_t*)_src.m_data;
-
-                for (;dst < end; dst+=4, src+=3)
-                {
-                    rgb8ToRgba32f(dst, src);
-                }
+                rgb8ToRgba32fRow<false>(dst, (const uint8_t*)srcData, _end-_begin);
             }
         break;
 
         case TextureFormat::RGB16:
             {
-                const uint16_t* src = (const uint16_t*)_src.m_data;
+                const uint16_t* src = (const uint16_t*)srcData;
 
                 for (;dst < end; dst+=4, src+=3)
                 {
@@ -1120,18 +2530,13 @@ namespace cmft
 
         case TextureFormat::RGB16F:
             {
-                const uint16_t* src = (const uint16_t*)_src.m_data;
-
-                for (;dst < end; dst+=4, src+=3)
-                {
-                    rgb16fToRgba32f(dst, src);
-                }
+                rgb16fToRgba32fRow(dst, (const uint16_t*)srcData, _end-_begin);
             }
         break;
 
         case TextureFormat::RGB32F:
             {
-                const float* src = (const float*)_src.m_data;
+                const float* src = (const float*)srcData;
 
                 for (;dst < end; dst+=4, src+=3)
                 {
@@ -1142,40 +2547,25 @@ namespace cmft
 
         case TextureFormat::RGBE:
             {
-                const uint8_t* src = (const uint8_t*)_src.m_data;
-
-                for (;dst < end; dst+=4, src+=4)
-                {
-                    rgbeToRgba32f(dst, src);
-                }
+                rgbeToRgba32fRow(dst, (const uint8_t*)srcData, _end-_begin);
             }
         break;
 
         case TextureFormat::BGRA8:
             {
-                const uint8_t* src = (const uint8_t*)_src.m_data;
-
-                for (;dst < end; dst+=4, src+=4)
-                {
-                    bgra8ToRgba32f(dst, src);
-                }
+                rgba8ToRgba32fRow<true>(dst, (const uint8_t*)srcData, _end-_begin);
             }
         break;
 
         case TextureFormat::RGBA8:
             {
-                const uint8_t* src = (const uint8_t*)_src.m_data;
-
-                for (;dst < end; dst+=4, src+=4)
-                {
-                    rgba8ToRgba32f(dst, src);
-                }
+                rgba8ToRgba32fRow<false>(dst, (const uint8_t*)srcData, _end-_begin);
             }
         break;
 
         case TextureFormat::RGBA16:
             {
-                const uint16_t* src = (const uint16_t*)_src.m_data;
+                const uint16_t* src = (const uint16_t*)srcData;
 
                 for (;dst < end; dst+=4, src+=4)
                 {
@@ -1186,47 +2576,125 @@ namespace cmft
 
         case TextureFormat::RGBA16F:
             {
-                const uint16_t* src = (const uint16_t*)_src.m_data;
-
-                for (;dst < end; dst+=4, src+=4)
-                {
-                    rgba16fToRgba32f(dst, src);
-                }
+                rgba16fToRgba32fRow(dst, (const uint16_t*)srcData, _end-_begin);
             }
         break;
 
         case TextureFormat::RGBA32F:
             {
                 // Copy data.
-                memcpy(data, _src.m_data, dataSize);
+                memcpy(dst, srcData, (_end-_begin)*4*sizeof(float));
             }
         break;
 
-        default:
+        case TextureFormat::RG16F:
             {
-                DEBUG_CHECK(false, "Unknown image format.");
+                const uint16_t* src = (const uint16_t*)srcData;
+
+                for (;dst < end; dst+=4, src+=2)
+                {
+                    rg16fToRgba32f(dst, src);
+                }
             }
         break;
-        };
-
-        // Fill image structure.
-        Image result;
-        result.m_data = data;
-        result.m_width = _src.m_width;
-        result.m_height = _src.m_height;
-        result.m_dataSize = dataSize;
-        result.m_format = TextureFormat::RGBA32F;
-        result.m_numMips = _src.m_numMips;
-        result.m_numFaces = _src.m_numFaces;
 
-        // Fill image structure.
-        imageMove(_dst, result);
-    }
+        case TextureFormat::RG32F:
+            {
+                const float* src = (const float*)srcData;
 
-    void imageToRgba32f(Image& _image)
+                for (;dst < end; dst+=4, src+=2)
+                {
+                    rg32fToRgba32f(dst, src);
+                }
+            }
+        break;
+
+        case TextureFormat::RGB9E5:
+            {
+                rgb9e5ToRgba32fRow(dst, (const uint32_t*)srcData, _end-_begin);
+            }
+        break;
+
+        case TextureFormat::R11G11B10F:
+            {
+                r11g11b10fToRgba32fRow(dst, (const uint32_t*)srcData, _end-_begin);
+            }
+        break;
+
+        case TextureFormat::RGBM8:
+            {
+                rgbmToRgba32fRow(dst, (const uint8_t*)srcData, _end-_begin, args->m_rgbmRange);
+            }
+        break;
+
+        case TextureFormat::RGBD8:
+            {
+                rgbdToRgba32fRow(dst, (const uint8_t*)srcData, _end-_begin, args->m_rgbdRange);
+            }
+        break;
+
+        case TextureFormat::LOGLUV8:
+            {
+                logLuvToRgba32fRow(dst, (const uint8_t*)srcData, _end-_begin);
+            }
+        break;
+
+        default:
+            {
+                DEBUG_CHECK(false, "Unknown image format.");
+            }
+        break;
+        };
+    }
+
+    static void imageConvertTransformed(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src, const ImageEncodeSettings& _settings);
+
+    void imageToRgba32f(Image& _dst, const Image& _src, const ImageEncodeSettings* _settings)
+    {
+        AllocTagScope allocTag(AllocTag::Conversion, true);
+
+        if (0 != _src.m_faceTransforms)
+        {
+            imageConvertTransformed(_dst, TextureFormat::RGBA32F, _src, encodeSettings(_settings));
+            return;
+        }
+
+        // Alloc dst data.
+        const uint64_t pixelCount = imageGetNumPixels(_src);
+        const uint8_t dstBytesPerPixel = getImageDataInfo(TextureFormat::RGBA32F).m_bytesPerPixel;
+        const uint64_t dataSize = pixelCount*dstBytesPerPixel;
+        void* data = getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
+
+        // Convert each channel.
+        ImageConvertArgs args(encodeSettings(_settings));
+        args.m_dst = data;
+        args.m_src = _src.m_data;
+        args.m_srcFormat = (TextureFormat::Enum)_src.m_format;
+        args.m_dstFormat = TextureFormat::RGBA32F;
+        args.m_srcBytesPerPixel = getImageDataInfo((TextureFormat::Enum)_src.m_format).m_bytesPerPixel;
+        args.m_dstBytesPerPixel = dstBytesPerPixel;
+        DEBUG_CHECK(pixelCount <= UINT32_MAX, "Image has too many pixels to convert at once.");
+        parallelFor(imageToRgba32fRange, (void*)&args, uint32_t(pixelCount), CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+
+        // Fill image structure.
+        Image result;
+        result.m_data = data;
+        result.m_width = _src.m_width;
+        result.m_height = _src.m_height;
+        result.m_dataSize = dataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = _src.m_numMips;
+        result.m_numFaces = _src.m_numFaces;
+
+        // Fill image structure.
+        imageMove(_dst, result);
+    }
+
+    void imageToRgba32f(Image& _image, const ImageEncodeSettings* _settings)
     {
         Image tmp;
-        imageToRgba32f(tmp, _image);
+        imageToRgba32f(tmp, _image, _settings);
         imageMove(_image, tmp);
     }
 
@@ -1280,18 +2748,17 @@ namespace cmft
 
     inline void rgb16fFromRgba32f(uint16_t* _rgb16f, const float* _rgba32f)
     {
-        _rgb16f[0] = bx::halfFromFloat(_rgba32f[0]);
-        _rgb16f[1] = bx::halfFromFloat(_rgba32f[1]);
-        _rgb16f[2] = bx::halfFromFloat(_rgba32f[2]);
-        _rgb16f[3] = bx::halfFromFloat(_rgba32f[3]);
+        _rgb16f[0] = halfFromFloat(_rgba32f[0]);
+        _rgb16f[1] = halfFromFloat(_rgba32f[1]);
+        _rgb16f[2] = halfFromFloat(_rgba32f[2]);
     }
 
-    inline void rgba16fFromRgba32f(uint16_t* _rgba16f, const float* _rgba32f)
+    static void rgba16fFromRgba32f(uint16_t* _rgba16f, const float* _rgba32f)
     {
-        _rgba16f[0] = bx::halfFromFloat(_rgba32f[0]);
-        _rgba16f[1] = bx::halfFromFloat(_rgba32f[1]);
-        _rgba16f[2] = bx::halfFromFloat(_rgba32f[2]);
-        _rgba16f[3] = bx::halfFromFloat(_rgba32f[3]);
+        _rgba16f[0] = halfFromFloat(_rgba32f[0]);
+        _rgba16f[1] = halfFromFloat(_rgba32f[1]);
+        _rgba16f[2] = halfFromFloat(_rgba32f[2]);
+        _rgba16f[3] = halfFromFloat(_rgba32f[3]);
     }
 
     inline void rgb32fFromRgba32f(float* _rgb32f, const float* _rgba32f)
@@ -1306,15 +2773,521 @@ namespace cmft
         memcpy(_dst, _src, 4*sizeof(float));
     }
 
+    inline void rg16fFromRgba32f(uint16_t* _rg16f, const float* _rgba32f)
+    {
+        _rg16f[0] = halfFromFloat(_rgba32f[0]);
+        _rg16f[1] = halfFromFloat(_rgba32f[1]);
+    }
+
+    inline void rg32fFromRgba32f(float* _rg32f, const float* _rgba32f)
+    {
+        _rg32f[0] = _rgba32f[0];
+        _rg32f[1] = _rgba32f[1];
+    }
+
+    // 2^127, largest value with exponent that fits into rgbe.
+    #define RGBE_MAX_VALUE 1.70141183e+38f
+
     inline void rgbeFromRgba32f(uint8_t* _rgbe, const float* _rgba32f)
     {
-        const float maxVal = max(_rgba32f[0], max(_rgba32f[1], _rgba32f[2]));
-        const float exp = ceilf(log2f(maxVal));
-        const float toRgb8 = 255.0f * 1.0f/ldexp(1.0f, int(exp)); //ldexp -> exp2 (c++11 - <cmath.h>)
-        _rgbe[0] = uint8_t(_rgba32f[0] * toRgb8);
-        _rgbe[1] = uint8_t(_rgba32f[1] * toRgb8);
-        _rgbe[2] = uint8_t(_rgba32f[2] * toRgb8);
-        _rgbe[3] = uint8_t(exp+128.0f);
+        const float maxVal = min(max(_rgba32f[0], max(_rgba32f[1], _rgba32f[2])), RGBE_MAX_VALUE);
+        if (!(maxVal > 0.0f))
+        {
+            _rgbe[0] = 0;
+            _rgbe[1] = 0;
+            _rgbe[2] = 0;
+            _rgbe[3] = 0;
+            return;
+        }
+
+        // Exponent is ceil(log2(maxVal)), taken from float bits.
+        union { float m_f; uint32_t m_u; } bits;
+        bits.m_f = maxVal;
+        const int32_t exp = int32_t(bits.m_u>>23) - 127 + (0 != (bits.m_u&0x7fffff));
+
+        union { uint32_t m_u; float m_f; } invExp2;
+        invExp2.m_u = uint32_t(127-exp)<<23;
+        const float toRgb8 = 255.0f * invExp2.m_f;
+        _rgbe[0] = uint8_t(min(max(_rgba32f[0] * toRgb8, 0.0f), 255.0f));
+        _rgbe[1] = uint8_t(min(max(_rgba32f[1] * toRgb8, 0.0f), 255.0f));
+        _rgbe[2] = uint8_t(min(max(_rgba32f[2] * toRgb8, 0.0f), 255.0f));
+        _rgbe[3] = uint8_t(exp+128);
+    }
+
+    // (2^9-1)/2^9 * 2^16, largest rgb9e5 value.
+    #define RGB9E5_MAX_VALUE 65408.0f
+
+    // 2^-16, values below it have the smallest shared exponent.
+    #define RGB9E5_MIN_EXP_VALUE 1.52587890625e-05f
+
+    // Largest finite 11 and 10-bit floats.
+    #define R11F_MAX_VALUE 65024.0f
+    #define B10F_MAX_VALUE 64512.0f
+
+    // 2^-14, smallest normalized 11 and 10-bit float.
+    #define R11G11B10F_MIN_NORMAL 6.103515625e-05f
+
+    /// Negative values are stored as zero, values out of range as the largest one. Rounds to nearest.
+    inline void rgb9e5FromRgba32f(uint32_t* _rgb9e5, const float* _rgba32f)
+    {
+        const float rr = min(max(_rgba32f[0], 0.0f), RGB9E5_MAX_VALUE);
+        const float gg = min(max(_rgba32f[1], 0.0f), RGB9E5_MAX_VALUE);
+        const float bb = min(max(_rgba32f[2], 0.0f), RGB9E5_MAX_VALUE);
+        const float maxVal = max(max(rr, max(gg, bb)), RGB9E5_MIN_EXP_VALUE);
+
+        // Shared exponent is floor(log2(maxVal))+1+15, taken from float bits. Mantissas are scaled by 2^(15+9-exp).
+        union { float m_f; uint32_t m_u; } bits;
+        bits.m_f = maxVal;
+        uint32_t exp = (bits.m_u>>23) - 111;
+
+        union { uint32_t m_u; float m_f; } scale;
+        scale.m_u = (151-exp)<<23;
+
+        // Largest mantissa can round up to 2^9, then the exponent goes up by one.
+        if (512 == uint32_t(maxVal*scale.m_f + 0.5f))
+        {
+            ++exp;
+            scale.m_u = (151-exp)<<23;
+        }
+
+        *_rgb9e5 = (uint32_t(rr*scale.m_f + 0.5f)    )
+                 | (uint32_t(gg*scale.m_f + 0.5f)<<9 )
+                 | (uint32_t(bb*scale.m_f + 0.5f)<<18)
+                 | (exp<<27)
+                 ;
+    }
+
+    /// Unsigned small float with _mantissaBits bits of mantissa and 5 of exponent. Rounds to nearest, ties away from zero.
+    static inline uint32_t packedUfloatFromFloat(float _value, uint32_t _mantissaBits, float _maxValue)
+    {
+        const float value = min(max(_value, 0.0f), _maxValue);
+        if (value < R11G11B10F_MIN_NORMAL)
+        {
+            return uint32_t(value*float(1<<(14+_mantissaBits)) + 0.5f);
+        }
+
+        // Exponent is rebiased from 127 to 15, mantissa rounding carries over into the exponent.
+        union { float m_f; uint32_t m_u; } bits;
+        bits.m_f = value;
+        return (bits.m_u - (UINT32_C(112)<<23) + (UINT32_C(1)<<(22-_mantissaBits))) >> (23-_mantissaBits);
+    }
+
+    /// Negative values are stored as zero, values out of range as the largest finite one.
+    inline void r11g11b10fFromRgba32f(uint32_t* _r11g11b10f, const float* _rgba32f)
+    {
+        *_r11g11b10f = (packedUfloatFromFloat(_rgba32f[0], 6, R11F_MAX_VALUE)    )
+                     | (packedUfloatFromFloat(_rgba32f[1], 6, R11F_MAX_VALUE)<<11)
+                     | (packedUfloatFromFloat(_rgba32f[2], 5, B10F_MAX_VALUE)<<22)
+                     ;
+    }
+
+    /// Channels are clamped to [0, range]. Multiplier is rounded up, so that channels always fit.
+    inline void rgbmFromRgba32f(uint8_t* _rgbm, const float* _rgba32f, float _range)
+    {
+        const float invRange = 1.0f/_range;
+        const float rr = min(max(_rgba32f[0]*invRange, 0.0f), 1.0f);
+        const float gg = min(max(_rgba32f[1]*invRange, 0.0f), 1.0f);
+        const float bb = min(max(_rgba32f[2]*invRange, 0.0f), 1.0f);
+        const float mm = ceilf(max(max(rr, max(gg, bb)), 1.0f/255.0f)*255.0f);
+
+        const float toRgb8 = 255.0f*255.0f/mm;
+        _rgbm[0] = uint8_t(min(rr*toRgb8 + 0.5f, 255.0f));
+        _rgbm[1] = uint8_t(min(gg*toRgb8 + 0.5f, 255.0f));
+        _rgbm[2] = uint8_t(min(bb*toRgb8 + 0.5f, 255.0f));
+        _rgbm[3] = uint8_t(mm);
+    }
+
+    /// Divisor is the largest one that keeps channels in range, values above range are clamped.
+    inline void rgbdFromRgba32f(uint8_t* _rgbd, const float* _rgba32f, float _range)
+    {
+        const float rr = max(_rgba32f[0], 0.0f);
+        const float gg = max(_rgba32f[1], 0.0f);
+        const float bb = max(_rgba32f[2], 0.0f);
+        const float maxVal = max(max(rr, max(gg, bb)), FLT_MIN);
+        const float dd = max(floorf(min(_range/maxVal, 255.0f)), 1.0f);
+
+        const float toRgb8 = 255.0f*dd/_range;
+        _rgbd[0] = uint8_t(min(rr*toRgb8 + 0.5f, 255.0f));
+        _rgbd[1] = uint8_t(min(gg*toRgb8 + 0.5f, 255.0f));
+        _rgbd[2] = uint8_t(min(bb*toRgb8 + 0.5f, 255.0f));
+        _rgbd[3] = uint8_t(dd);
+    }
+
+    /// Luminance and chromaticity are clamped to 1e-6, the same as shader encoders do.
+    inline void logLuvFromRgba32f(uint8_t* _logLuv, const float* _rgba32f)
+    {
+        float xyz[3];
+        for (uint8_t ii = 0; ii < 3; ++ii)
+        {
+            const float value = max(_rgba32f[0], 0.0f)*s_logLuvM[0][ii]
+                              + max(_rgba32f[1], 0.0f)*s_logLuvM[1][ii]
+                              + max(_rgba32f[2], 0.0f)*s_logLuvM[2][ii]
+                              ;
+            xyz[ii] = max(value, 1e-6f);
+        }
+
+        const float le = min(2.0f*log2f(xyz[1]) + 127.0f, 255.0f);
+        const float hi = floorf(le);
+
+        _logLuv[0] = uint8_t(min(xyz[0]/xyz[2], 1.0f)*255.0f + 0.5f);
+        _logLuv[1] = uint8_t(min(xyz[1]/xyz[2], 1.0f)*255.0f + 0.5f);
+        _logLuv[2] = uint8_t(hi);
+        _logLuv[3] = uint8_t((le-hi)*255.0f + 0.5f);
+    }
+
+    // Row converters from rgba32f.
+    //-----
+
+    /// Rgba32f row to bgra8/rgba8.
+    template <bool Bgra>
+    static void rgba8FromRgba32fRow(uint8_t* _dst, const float* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        const __m128 zero  = _mm_setzero_ps();
+        const __m128 one   = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128i rgba[4];
+            for (uint8_t jj = 0; jj < 4; ++jj)
+            {
+                __m128 px = _mm_loadu_ps(&_src[(ii+jj)*4]);
+                px = _mm_mul_ps(_mm_min_ps(_mm_max_ps(px, zero), one), scale);
+                rgba[jj] = _mm_cvttps_epi32(Bgra ? simdSwapRb(px) : px);
+            }
+
+            const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(rgba[0], rgba[1]), _mm_packs_epi32(rgba[2], rgba[3]));
+            _mm_storeu_si128((__m128i*)&_dst[ii*4], packed);
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            if (Bgra)
+            {
+                bgra8FromRgba32f(&_dst[ii*4], &_src[ii*4]);
+            }
+            else
+            {
+                rgba8FromRgba32f(&_dst[ii*4], &_src[ii*4]);
+            }
+        }
+    }
+
+    /// Rgba32f row to rgba16f.
+    static void rgba16fFromRgba32fRow(uint16_t* _dst, const float* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD && CMFT_F16C
+        // Rounds to nearest even, software conversion rounds ties up.
+        for (; ii < _num; ++ii)
+        {
+            const __m128i half = _mm_cvtps_ph(_mm_loadu_ps(&_src[ii*4]), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storel_epi64((__m128i*)&_dst[ii*4], half);
+        }
+#endif // CMFT_CONVERT_SIMD && CMFT_F16C
+
+        for (; ii < _num; ++ii)
+        {
+            rgba16fFromRgba32f(&_dst[ii*4], &_src[ii*4]);
+        }
+    }
+
+    /// Rgba32f row to rgbe.
+    static void rgbeFromRgba32fRow(uint8_t* _dst, const float* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Same as rgbeFromRgba32f(), 4 pixels at a time.
+        const __m128 zero   = _mm_setzero_ps();
+        const __m128 maxExp = _mm_set1_ps(RGBE_MAX_VALUE);
+        const __m128 scale  = _mm_set1_ps(255.0f);
+        const __m128i mantissaMask = _mm_set1_epi32(0x7fffff);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr = _mm_loadu_ps(&_src[(ii+0)*4]);
+            __m128 gg = _mm_loadu_ps(&_src[(ii+1)*4]);
+            __m128 bb = _mm_loadu_ps(&_src[(ii+2)*4]);
+            __m128 aa = _mm_loadu_ps(&_src[(ii+3)*4]);
+            _MM_TRANSPOSE4_PS(rr, gg, bb, aa);
+
+            const __m128 maxVal = _mm_min_ps(_mm_max_ps(rr, _mm_max_ps(gg, bb)), maxExp);
+            const __m128i bits = _mm_castps_si128(maxVal);
+            const __m128i biasedExp = _mm_srli_epi32(bits, 23);
+            const __m128i isPow2 = _mm_cmpeq_epi32(_mm_and_si128(bits, mantissaMask), _mm_setzero_si128());
+
+            // exp = biasedExp-127 + (mantissa != 0). Pixels with maxVal <= 0 are stored as zero.
+            const __m128i exp = _mm_add_epi32(_mm_sub_epi32(biasedExp, _mm_set1_epi32(126)), isPow2);
+            const __m128 toRgb8 = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127), exp), 23)), scale);
+            const __m128i valid = _mm_castps_si128(_mm_cmpgt_ps(maxVal, zero));
+
+            __m128i rgbe[4] =
+            {
+                _mm_and_si128(_mm_cvttps_epi32(_mm_max_ps(_mm_mul_ps(rr, toRgb8), zero)), valid),
+                _mm_and_si128(_mm_cvttps_epi32(_mm_max_ps(_mm_mul_ps(gg, toRgb8), zero)), valid),
+                _mm_and_si128(_mm_cvttps_epi32(_mm_max_ps(_mm_mul_ps(bb, toRgb8), zero)), valid),
+                _mm_and_si128(_mm_add_epi32(exp, _mm_set1_epi32(128)), valid),
+            };
+
+            // Back to pixel order.
+            __m128 p0 = _mm_castsi128_ps(rgbe[0]);
+            __m128 p1 = _mm_castsi128_ps(rgbe[1]);
+            __m128 p2 = _mm_castsi128_ps(rgbe[2]);
+            __m128 p3 = _mm_castsi128_ps(rgbe[3]);
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+
+            const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(_mm_castps_si128(p0), _mm_castps_si128(p1))
+                                                  , _mm_packs_epi32(_mm_castps_si128(p2), _mm_castps_si128(p3))
+                                                  );
+            _mm_storeu_si128((__m128i*)&_dst[ii*4], packed);
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgbeFromRgba32f(&_dst[ii*4], &_src[ii*4]);
+        }
+    }
+
+#if CMFT_CONVERT_SIMD
+    /// Same as packedUfloatFromFloat(), for 4 values.
+    static inline __m128i simdPackedUfloatFromFloat(__m128 _value, uint32_t _mantissaBits, float _maxValue)
+    {
+        const __m128 value = _mm_min_ps(_mm_max_ps(_value, _mm_setzero_ps()), _mm_set1_ps(_maxValue));
+        const __m128i denormal = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(float(1<<(14+_mantissaBits)))), _mm_set1_ps(0.5f)));
+        const __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_castps_si128(value), _mm_set1_epi32(int32_t((UINT32_C(1)<<(22-_mantissaBits)) - (UINT32_C(112)<<23)))), 23-_mantissaBits);
+        const __m128i isDenormal = _mm_castps_si128(_mm_cmplt_ps(value, _mm_set1_ps(R11G11B10F_MIN_NORMAL)));
+        return _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+    }
+#endif // CMFT_CONVERT_SIMD
+
+    /// Rgba32f row to rgb9e5.
+    static void rgb9e5FromRgba32fRow(uint32_t* _dst, const float* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Same as rgb9e5FromRgba32f(), 4 pixels at a time.
+        const __m128 zero   = _mm_setzero_ps();
+        const __m128 maxVal = _mm_set1_ps(RGB9E5_MAX_VALUE);
+        const __m128 half   = _mm_set1_ps(0.5f);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr = _mm_loadu_ps(&_src[(ii+0)*4]);
+            __m128 gg = _mm_loadu_ps(&_src[(ii+1)*4]);
+            __m128 bb = _mm_loadu_ps(&_src[(ii+2)*4]);
+            __m128 aa = _mm_loadu_ps(&_src[(ii+3)*4]);
+            _MM_TRANSPOSE4_PS(rr, gg, bb, aa);
+
+            rr = _mm_min_ps(_mm_max_ps(rr, zero), maxVal);
+            gg = _mm_min_ps(_mm_max_ps(gg, zero), maxVal);
+            bb = _mm_min_ps(_mm_max_ps(bb, zero), maxVal);
+            const __m128 maxChannel = _mm_max_ps(_mm_max_ps(rr, _mm_max_ps(gg, bb)), _mm_set1_ps(RGB9E5_MIN_EXP_VALUE));
+
+            __m128i exp = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(maxChannel), 23), _mm_set1_epi32(111));
+            __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(151), exp), 23));
+
+            // Comparison result is -1 where the largest mantissa rounds up to 2^9.
+            const __m128i maxMantissa = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxChannel, scale), half));
+            exp = _mm_sub_epi32(exp, _mm_cmpeq_epi32(maxMantissa, _mm_set1_epi32(512)));
+            scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(151), exp), 23));
+
+            const __m128i packed = _mm_or_si128(_mm_or_si128(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(rr, scale), half))
+                                                           , _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(gg, scale), half)), 9)
+                                                           )
+                                              , _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(bb, scale), half)), 18)
+                                                           , _mm_slli_epi32(exp, 27)
+                                                           )
+                                              );
+            _mm_storeu_si128((__m128i*)&_dst[ii], packed);
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgb9e5FromRgba32f(&_dst[ii], &_src[ii*4]);
+        }
+    }
+
+    /// Rgba32f row to r11g11b10f.
+    static void r11g11b10fFromRgba32fRow(uint32_t* _dst, const float* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr = _mm_loadu_ps(&_src[(ii+0)*4]);
+            __m128 gg = _mm_loadu_ps(&_src[(ii+1)*4]);
+            __m128 bb = _mm_loadu_ps(&_src[(ii+2)*4]);
+            __m128 aa = _mm_loadu_ps(&_src[(ii+3)*4]);
+            _MM_TRANSPOSE4_PS(rr, gg, bb, aa);
+
+            const __m128i packed = _mm_or_si128(_mm_or_si128(simdPackedUfloatFromFloat(rr, 6, R11F_MAX_VALUE)
+                                                           , _mm_slli_epi32(simdPackedUfloatFromFloat(gg, 6, R11F_MAX_VALUE), 11)
+                                                           )
+                                              , _mm_slli_epi32(simdPackedUfloatFromFloat(bb, 5, B10F_MAX_VALUE), 22)
+                                              );
+            _mm_storeu_si128((__m128i*)&_dst[ii], packed);
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            r11g11b10fFromRgba32f(&_dst[ii], &_src[ii*4]);
+        }
+    }
+
+#if CMFT_CONVERT_SIMD
+    /// Loads 4 rgba32f pixels as channel vectors.
+    static inline void simdLoadChannels(__m128& _rr, __m128& _gg, __m128& _bb, const float* _src)
+    {
+        __m128 aa = _mm_loadu_ps(&_src[12]);
+        _rr = _mm_loadu_ps(&_src[0]);
+        _gg = _mm_loadu_ps(&_src[4]);
+        _bb = _mm_loadu_ps(&_src[8]);
+        _MM_TRANSPOSE4_PS(_rr, _gg, _bb, aa);
+    }
+
+    /// Rounds 4 channel vectors, values 0-255, and stores them as 4 rgba8 pixels.
+    static inline void simdStoreChannels8(uint8_t* _dst, __m128 _rr, __m128 _gg, __m128 _bb, __m128 _aa)
+    {
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i packed = _mm_or_si128(_mm_or_si128(_mm_cvttps_epi32(_mm_add_ps(_rr, half))
+                                                       , _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(_gg, half)), 8)
+                                                       )
+                                          , _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(_bb, half)), 16)
+                                                       , _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(_aa, half)), 24)
+                                                       )
+                                          );
+        _mm_storeu_si128((__m128i*)_dst, packed);
+    }
+#endif // CMFT_CONVERT_SIMD
+
+    /// Rgba32f row to rgbm.
+    static void rgbmFromRgba32fRow(uint8_t* _dst, const float* _src, uint32_t _num, float _range)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Same as rgbmFromRgba32f(), 4 pixels at a time.
+        const __m128 zero     = _mm_setzero_ps();
+        const __m128 one      = _mm_set1_ps(1.0f);
+        const __m128 max8     = _mm_set1_ps(255.0f - 0.5f);
+        const __m128 invRange = _mm_set1_ps(1.0f/_range);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr, gg, bb;
+            simdLoadChannels(rr, gg, bb, &_src[ii*4]);
+
+            rr = _mm_min_ps(_mm_max_ps(_mm_mul_ps(rr, invRange), zero), one);
+            gg = _mm_min_ps(_mm_max_ps(_mm_mul_ps(gg, invRange), zero), one);
+            bb = _mm_min_ps(_mm_max_ps(_mm_mul_ps(bb, invRange), zero), one);
+            const __m128 maxVal = _mm_max_ps(_mm_max_ps(rr, _mm_max_ps(gg, bb)), _mm_set1_ps(1.0f/255.0f));
+            const __m128 mm = bx::float4_ceil(_mm_mul_ps(maxVal, _mm_set1_ps(255.0f)));
+
+            const __m128 toRgb8 = _mm_div_ps(_mm_set1_ps(255.0f*255.0f), mm);
+            simdStoreChannels8(&_dst[ii*4]
+                             , _mm_min_ps(_mm_mul_ps(rr, toRgb8), max8)
+                             , _mm_min_ps(_mm_mul_ps(gg, toRgb8), max8)
+                             , _mm_min_ps(_mm_mul_ps(bb, toRgb8), max8)
+                             , mm
+                             );
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgbmFromRgba32f(&_dst[ii*4], &_src[ii*4], _range);
+        }
+    }
+
+    /// Rgba32f row to rgbd.
+    static void rgbdFromRgba32fRow(uint8_t* _dst, const float* _src, uint32_t _num, float _range)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Same as rgbdFromRgba32f(), 4 pixels at a time.
+        const __m128 zero  = _mm_setzero_ps();
+        const __m128 max8  = _mm_set1_ps(255.0f - 0.5f);
+        const __m128 range = _mm_set1_ps(_range);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr, gg, bb;
+            simdLoadChannels(rr, gg, bb, &_src[ii*4]);
+
+            rr = _mm_max_ps(rr, zero);
+            gg = _mm_max_ps(gg, zero);
+            bb = _mm_max_ps(bb, zero);
+            const __m128 maxVal = _mm_max_ps(_mm_max_ps(rr, _mm_max_ps(gg, bb)), _mm_set1_ps(FLT_MIN));
+            const __m128 dd = _mm_max_ps(bx::float4_floor(_mm_min_ps(_mm_div_ps(range, maxVal), _mm_set1_ps(255.0f))), _mm_set1_ps(1.0f));
+
+            const __m128 toRgb8 = _mm_mul_ps(dd, _mm_set1_ps(255.0f/_range));
+            simdStoreChannels8(&_dst[ii*4]
+                             , _mm_min_ps(_mm_mul_ps(rr, toRgb8), max8)
+                             , _mm_min_ps(_mm_mul_ps(gg, toRgb8), max8)
+                             , _mm_min_ps(_mm_mul_ps(bb, toRgb8), max8)
+                             , dd
+                             );
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            rgbdFromRgba32f(&_dst[ii*4], &_src[ii*4], _range);
+        }
+    }
+
+    /// Rgba32f row to LogLuv.
+    static void logLuvFromRgba32fRow(uint8_t* _dst, const float* _src, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Same as logLuvFromRgba32f(), 4 pixels at a time.
+        const __m128 zero   = _mm_setzero_ps();
+        const __m128 one    = _mm_set1_ps(1.0f);
+        const __m128 scale  = _mm_set1_ps(255.0f);
+        const __m128 minVal = _mm_set1_ps(1e-6f);
+        for (; ii+4 <= _num; ii+=4)
+        {
+            __m128 rr, gg, bb;
+            simdLoadChannels(rr, gg, bb, &_src[ii*4]);
+
+            rr = _mm_max_ps(rr, zero);
+            gg = _mm_max_ps(gg, zero);
+            bb = _mm_max_ps(bb, zero);
+
+            __m128 xyz[3];
+            for (uint8_t jj = 0; jj < 3; ++jj)
+            {
+                xyz[jj] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rr, _mm_set1_ps(s_logLuvM[0][jj]))
+                                              , _mm_mul_ps(gg, _mm_set1_ps(s_logLuvM[1][jj])))
+                                              , _mm_mul_ps(bb, _mm_set1_ps(s_logLuvM[2][jj])));
+                xyz[jj] = _mm_max_ps(xyz[jj], minVal);
+            }
+
+            const __m128 le = _mm_min_ps(_mm_add_ps(_mm_mul_ps(bx::float4_log2(xyz[1]), _mm_set1_ps(2.0f)), _mm_set1_ps(127.0f)), scale);
+            const __m128 hi = bx::float4_floor(le);
+
+            simdStoreChannels8(&_dst[ii*4]
+                             , _mm_mul_ps(_mm_min_ps(_mm_div_ps(xyz[0], xyz[2]), one), scale)
+                             , _mm_mul_ps(_mm_min_ps(_mm_div_ps(xyz[1], xyz[2]), one), scale)
+                             , hi
+                             , _mm_mul_ps(_mm_sub_ps(le, hi), scale)
+                             );
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            logLuvFromRgba32f(&_dst[ii*4], &_src[ii*4]);
+        }
     }
 
     void fromRgba32f(void* _out, TextureFormat::Enum _format, const float _rgba32f[4])
@@ -1332,29 +3305,26 @@ namespace cmft
         case TextureFormat::RGBA16:   rgba16FromRgba32f((uint16_t*)_out,  _rgba32f); break;
         case TextureFormat::RGBA16F:  rgba16fFromRgba32f((uint16_t*)_out, _rgba32f); break;
         case TextureFormat::RGBA32F:  rgba32fFromRgba32f((float*)_out,    _rgba32f); break;
+        case TextureFormat::RG16F:    rg16fFromRgba32f((uint16_t*)_out,   _rgba32f); break;
+        case TextureFormat::RG32F:    rg32fFromRgba32f((float*)_out,      _rgba32f); break;
+        case TextureFormat::RGB9E5:     rgb9e5FromRgba32f((uint32_t*)_out,     _rgba32f); break;
+        case TextureFormat::R11G11B10F: r11g11b10fFromRgba32f((uint32_t*)_out, _rgba32f); break;
+        case TextureFormat::RGBM8:      rgbmFromRgba32f((uint8_t*)_out,        _rgba32f, s_defaultEncodeSettings.m_rgbmRange); break;
+        case TextureFormat::RGBD8:      rgbdFromRgba32f((uint8_t*)_out,        _rgba32f, s_defaultEncodeSettings.m_rgbdRange); break;
+        case TextureFormat::LOGLUV8:    logLuvFromRgba32f((uint8_t*)_out,      _rgba32f); break;
         default: DEBUG_CHECK(false, "Unknown image format.");
         };
     }
 
-    void imageFromRgba32f(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src)
+    static void imageFromRgba32fRange(void* _userData, uint32_t _begin, uint32_t _end)
     {
-        DEBUG_CHECK(TextureFormat::RGBA32F == _src.m_format, "Source image is not in RGBA32F format!");
-
-        // Alloc dst data.
-        const uint32_t pixelCount = imageGetNumPixels(_src);
-        const uint8_t dstBytesPerPixel = getImageDataInfo(_dstFormat).m_bytesPerPixel;
-        const uint32_t dstDataSize = pixelCount*dstBytesPerPixel;
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
-
-        // Get total number of channels.
-        const uint8_t srcNumChannels = getImageDataInfo(_src.m_format).m_numChanels;
-        const uint32_t totalNumChannels = pixelCount*srcNumChannels;
+        const ImageConvertArgs* args = (const ImageConvertArgs*)_userData;
 
         // Convert data.
-        const float* src = (const float*)_src.m_data;
-        const float* end = (const float*)_src.m_data + totalNumChannels;
-        switch(_dstFormat)
+        const float* src = (const float*)args->m_src + size_t(_begin)*4;
+        const float* end = (const float*)args->m_src + size_t(_end)*4;
+        void* dstData = (uint8_t*)args->m_dst + size_t(_begin)*args->m_dstBytesPerPixel;
+        switch(args->m_dstFormat)
         {
         case TextureFormat::BGR8:
             {
@@ -1413,34 +3383,19 @@ namespace cmft
 
         case TextureFormat::RGBE:
             {
-                uint8_t* dst = (uint8_t*)dstData;
-
-                for (;src < end; src+=4, dst+=4)
-                {
-                    rgbeFromRgba32f(dst, src);
-                }
+                rgbeFromRgba32fRow((uint8_t*)dstData, src, _end-_begin);
             }
         break;
 
         case TextureFormat::BGRA8:
             {
-                uint8_t* dst = (uint8_t*)dstData;
-
-                for (;src < end; src+=4, dst+=4)
-                {
-                    bgra8FromRgba32f(dst, src);
-                }
+                rgba8FromRgba32fRow<true>((uint8_t*)dstData, src, _end-_begin);
             }
         break;
 
         case TextureFormat::RGBA8:
             {
-                uint8_t* dst = (uint8_t*)dstData;
-
-                for (;src < end; src+=4, dst+=4)
-                {
-                    rgba8FromRgba32f(dst, src);
-                }
+                rgba8FromRgba32fRow<false>((uint8_t*)dstData, src, _end-_begin);
             }
         break;
 
@@ -1457,12 +3412,7 @@ namespace cmft
 
         case TextureFormat::RGBA16F:
             {
-                uint16_t* dst = (uint16_t*)dstData;
-
-                for (;src < end; src+=4, dst+=4)
-                {
-                    rgba16fFromRgba32f(dst, src);
-                }
+                rgba16fFromRgba32fRow((uint16_t*)dstData, src, _end-_begin);
             }
         break;
 
@@ -1477,2697 +3427,9673 @@ namespace cmft
             }
         break;
 
-        default:
+        case TextureFormat::RG16F:
             {
-                DEBUG_CHECK(false, "Unknown image format.");
+                uint16_t* dst = (uint16_t*)dstData;
+
+                for (;src < end; src+=4, dst+=2)
+                {
+                    rg16fFromRgba32f(dst, src);
+                }
             }
         break;
-        };
 
-        // Fill image structure.
-        Image result;
-        result.m_data = dstData;
-        result.m_width = _src.m_width;
-        result.m_height = _src.m_height;
-        result.m_dataSize = dstDataSize;
-        result.m_format = _dstFormat;
-        result.m_numMips = _src.m_numMips;
-        result.m_numFaces = _src.m_numFaces;
+        case TextureFormat::RG32F:
+            {
+                float* dst = (float*)dstData;
 
-        // Output.
-        imageMove(_dst, result);
-    }
+                for (;src < end; src+=4, dst+=2)
+                {
+                    rg32fFromRgba32f(dst, src);
+                }
+            }
+        break;
 
-    void imageFromRgba32f(Image& _image, TextureFormat::Enum _textureFormat)
-    {
-        Image tmp;
-        imageFromRgba32f(tmp, _textureFormat, _image);
-        imageMove(_image, tmp);
+        case TextureFormat::RGB9E5:
+            {
+                rgb9e5FromRgba32fRow((uint32_t*)dstData, src, _end-_begin);
+            }
+        break;
+
+        case TextureFormat::R11G11B10F:
+            {
+                r11g11b10fFromRgba32fRow((uint32_t*)dstData, src, _end-_begin);
+            }
+        break;
+
+        case TextureFormat::RGBM8:
+            {
+                rgbmFromRgba32fRow((uint8_t*)dstData, src, _end-_begin, args->m_rgbmRange);
+            }
+        break;
+
+        case TextureFormat::RGBD8:
+            {
+                rgbdFromRgba32fRow((uint8_t*)dstData, src, _end-_begin, args->m_rgbdRange);
+            }
+        break;
+
+        case TextureFormat::LOGLUV8:
+            {
+                logLuvFromRgba32fRow((uint8_t*)dstData, src, _end-_begin);
+            }
+        break;
+
+        default:
+            {
+                DEBUG_CHECK(false, "Unknown image format.");
+            }
+        break;
+        };
     }
 
-    void imageConvert(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src)
+    void imageFromRgba32f(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src, const ImageEncodeSettings* _settings)
     {
-        // Image _src to rgba32f.
-        Image imageRgba32f;
-        if (TextureFormat::RGBA32F == _src.m_format)
-        {
-            imageRef(imageRgba32f, _src);
-        }
-        else
-        {
-            imageToRgba32f(imageRgba32f, _src);
-        }
+        AllocTagScope allocTag(AllocTag::Conversion, true);
 
-        // Image rgba32f to _dst.
-        if (TextureFormat::RGBA32F == _dstFormat)
-        {
-            imageUnload(_dst);
-            imageCopy(_dst, imageRgba32f);
-        }
-        else
+        if (0 != _src.m_faceTransforms)
         {
-            imageUnload(_dst);
-            imageFromRgba32f(_dst, _dstFormat, imageRgba32f);
+            imageConvertTransformed(_dst, _dstFormat, _src, encodeSettings(_settings));
+            return;
         }
 
-        // Unload imageRgba32f if its a copy and NOT a reference of _src.
-        if (_src.m_data != imageRgba32f.m_data)
-        {
-            imageUnload(imageRgba32f);
-        }
+        DEBUG_CHECK(TextureFormat::RGBA32F == _src.m_format, "Source image is not in RGBA32F format!");
+
+        // Alloc dst data.
+        const uint64_t pixelCount = imageGetNumPixels(_src);
+        const uint8_t dstBytesPerPixel = getImageDataInfo(_dstFormat).m_bytesPerPixel;
+        const uint64_t dstDataSize = pixelCount*dstBytesPerPixel;
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        // Convert data.
+        ImageConvertArgs args(encodeSettings(_settings));
+        args.m_dst = dstData;
+        args.m_src = _src.m_data;
+        args.m_srcFormat = TextureFormat::RGBA32F;
+        args.m_dstFormat = _dstFormat;
+        args.m_srcBytesPerPixel = getImageDataInfo(TextureFormat::RGBA32F).m_bytesPerPixel;
+        args.m_dstBytesPerPixel = dstBytesPerPixel;
+        DEBUG_CHECK(pixelCount <= UINT32_MAX, "Image has too many pixels to convert at once.");
+        parallelFor(imageFromRgba32fRange, (void*)&args, uint32_t(pixelCount), CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+
+        // Fill image structure.
+        Image result;
+        result.m_data = dstData;
+        result.m_width = _src.m_width;
+        result.m_height = _src.m_height;
+        result.m_dataSize = dstDataSize;
+        result.m_format = _dstFormat;
+        result.m_numMips = _src.m_numMips;
+        result.m_numFaces = _src.m_numFaces;
+
+        // Output.
+        imageMove(_dst, result);
     }
 
-    void imageConvert(Image& _image, TextureFormat::Enum _format)
+    void imageFromRgba32f(Image& _image, TextureFormat::Enum _textureFormat, const ImageEncodeSettings* _settings)
     {
-        if (_format != _image.m_format)
-        {
-            Image tmp;
-            imageConvert(tmp, _format, _image);
-            imageMove(_image, tmp);
-        }
+        Image tmp;
+        imageFromRgba32f(tmp, _textureFormat, _image, _settings);
+        imageMove(_image, tmp);
     }
 
-    bool imageRefOrConvert(Image& _dst, TextureFormat::Enum _format, const Image& _src)
+    // Block compression.
+    //-----
+
+    struct ImageEncodeArgs
+    {
+        uint8_t* m_dst;
+        const float* m_src;
+        TextureFormat::Enum m_format;
+        bool m_quality;
+        uint8_t m_numLevels;
+        uint32_t m_firstBlock[CUBE_FACE_NUM*MAX_MIP_NUM+1]; //!< Per face and mip, in storage order.
+        uint32_t m_blocksX[CUBE_FACE_NUM*MAX_MIP_NUM];
+        uint32_t m_width[CUBE_FACE_NUM*MAX_MIP_NUM];
+        uint32_t m_height[CUBE_FACE_NUM*MAX_MIP_NUM];
+        uint64_t m_srcOffset[CUBE_FACE_NUM*MAX_MIP_NUM];
+    };
+
+    static void imageEncodeBlocks(void* _userData, uint32_t _begin, uint32_t _end)
     {
-        if (_format == _src.m_format)
+        const ImageEncodeArgs* args = (const ImageEncodeArgs*)_userData;
+        const uint8_t blockBytes = getImageDataInfo(args->m_format).m_blockBytes;
+
+        uint8_t level = 0;
+        while (args->m_firstBlock[level+1] <= _begin)
         {
-            imageRef(_dst, _src);
-            return true;
+            ++level;
         }
-        else
+
+        for (uint32_t block = _begin; block < _end; ++block)
         {
-            imageUnload(_dst);
-            imageConvert(_dst, _format, _src);
-            return false;
+            while (args->m_firstBlock[level+1] <= block)
+            {
+                ++level;
+            }
+
+            const uint32_t local = block - args->m_firstBlock[level];
+            const uint32_t blockX = (local % args->m_blocksX[level])*4;
+            const uint32_t blockY = (local / args->m_blocksX[level])*4;
+            const uint32_t width  = args->m_width[level];
+            const uint32_t height = args->m_height[level];
+            const float* src = args->m_src + args->m_srcOffset[level]/sizeof(float);
+
+            // Edge texels are repeated to fill partial blocks.
+            BlockTexels texels;
+            for (uint32_t yy = 0; yy < 4; ++yy)
+            {
+                const uint32_t srcY = min(blockY+yy, height-1);
+                for (uint32_t xx = 0; xx < 4; ++xx)
+                {
+                    const uint32_t srcX = min(blockX+xx, width-1);
+                    memcpy(texels[yy*4+xx], &src[(uint64_t(srcY)*width + srcX)*4], 4*sizeof(float));
+                }
+            }
+
+            uint8_t* dst = args->m_dst + uint64_t(block)*blockBytes;
+            switch (args->m_format)
+            {
+            case TextureFormat::BC6H_UF16: bc6hEncodeBlock(dst, texels, false, args->m_quality); break;
+            case TextureFormat::BC6H_SF16: bc6hEncodeBlock(dst, texels, true,  args->m_quality); break;
+            case TextureFormat::BC7:       bc7EncodeBlock(dst, texels, args->m_quality);         break;
+            case TextureFormat::ETC2:      etc2EncodeBlock(dst, texels, args->m_quality);        break;
+            case TextureFormat::ASTC4X4:   astc4x4EncodeBlock(dst, texels, args->m_quality);     break;
+            default: DEBUG_CHECK(false, "Unknown block compressed format.");
+            };
         }
     }
 
-    void imageGetPixel(void* _out, TextureFormat::Enum _format, uint32_t _x, uint32_t _y, uint8_t _mip, uint8_t _face, const Image& _image)
+    /// Encodes rgba32f _src into block compressed _format. Blocks of all faces and mips are split between threads.
+    static void imageEncode(Image& _dst, TextureFormat::Enum _format, const Image& _src, CompressionQuality::Enum _quality)
     {
-        // Input check.
-        DEBUG_CHECK(_x < _image.m_width,       "Invalid input parameters. X coord bigger than image width.");
-        DEBUG_CHECK(_y < _image.m_height,      "Invalid input parameters. Y coord bigger than image height.");
-        DEBUG_CHECK(_face < _image.m_numFaces, "Invalid input parameters. Requesting pixel from non-existing face.");
-        DEBUG_CHECK(_mip < _image.m_numMips,   "Invalid input parameters. Requesting pixel from non-existing mip level.");
+        CMFT_PROFILE_ZONE("imageEncode");
+        DEBUG_CHECK(TextureFormat::RGBA32F == _src.m_format, "Source image is not in RGBA32F format!");
 
-        const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
-        const uint32_t pitch = _image.m_width * bytesPerPixel;
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, _src);
 
-        // Get face and mip offset.
-        uint32_t offset = 0;
-        for (uint8_t face = 0; face < _face; ++face)
+        ImageEncodeArgs args;
+        args.m_src = (const float*)_src.m_data;
+        args.m_format = _format;
+        args.m_quality = (CompressionQuality::Quality == _quality);
+        args.m_numLevels = 0;
+
+        uint64_t numBlocks = 0;
+        for (uint8_t face = 0; face < _src.m_numFaces; ++face)
         {
-            for (uint8_t mip = 0; mip < _mip; ++mip)
+            for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
             {
-                const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
-                const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
-                offset += width * height * bytesPerPixel;
+                const uint8_t level = args.m_numLevels++;
+                const uint32_t width  = max(UINT32_C(1), _src.m_width  >> mip);
+                const uint32_t height = max(UINT32_C(1), _src.m_height >> mip);
+                args.m_firstBlock[level] = uint32_t(numBlocks);
+                args.m_blocksX[level] = (width+3)/4;
+                args.m_width[level] = width;
+                args.m_height[level] = height;
+                args.m_srcOffset[level] = srcOffsets[face][mip];
+                numBlocks += uint64_t((width+3)/4) * ((height+3)/4);
             }
         }
+        args.m_firstBlock[args.m_numLevels] = uint32_t(numBlocks);
+        DEBUG_CHECK(numBlocks <= UINT32_MAX, "Image has too many blocks to encode at once.");
 
-        const void* src = (const void*)((const uint8_t*)_image.m_data + offset + _y*pitch + _x*bytesPerPixel);
+        const uint64_t dstDataSize = numBlocks*getImageDataInfo(_format).m_blockBytes;
+        args.m_dst = (uint8_t*)getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(args.m_dst);
 
-        // Output.
-        if (_image.m_format == _format)
-        {
-            // Image is already in requested format, just copy data.
-            memcpy(_out, src, bytesPerPixel);
-        }
-        else if (_image.m_format == TextureFormat::RGBA32F)
-        {
-            // Image is in rgba32f format. Transform to output format.
-            fromRgba32f(_out, _format, (const float*)src);
-        }
-        else
+        parallelFor(imageEncodeBlocks, (void*)&args, uint32_t(numBlocks), CMFT_ENCODE_MIN_BLOCKS);
+
+        Image result;
+        result.m_data = args.m_dst;
+        result.m_width = _src.m_width;
+        result.m_height = _src.m_height;
+        result.m_dataSize = dstDataSize;
+        result.m_format = _format;
+        result.m_numMips = _src.m_numMips;
+        result.m_numFaces = _src.m_numFaces;
+
+        imageMove(_dst, result);
+    }
+
+    /// Decodable block format of _format, BlockFormat::Count if _format is not block compressed or has no decoder.
+    static BlockFormat::Enum blockFormatFromTextureFormat(TextureFormat::Enum _format)
+    {
+        switch (_format)
         {
-            // Image is in some other format.
-            // Transform to rgba32f and then back to requested output format.
-            float buf[4];
-            toRgba32f(buf, _image.m_format, src);
-            fromRgba32f(_out, _format, buf);
-        }
+        case TextureFormat::BC6H_UF16: return BlockFormat::BC6H;
+        case TextureFormat::BC6H_SF16: return BlockFormat::BC6HS;
+        case TextureFormat::BC7:       return BlockFormat::BC7;
+        default:                       return BlockFormat::Count;
+        };
     }
 
-    void imageResize(Image& _dst, uint32_t _width, uint32_t _height, const Image& _src)
+    struct ImageDecodeArgs
     {
-        // Operation is done in rgba32f format.
-        Image imageRgba32f;
-        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+        uint8_t* m_dst;
+        const uint8_t* m_src;
+        BlockFormat::Enum m_format;
+        bool m_half;
+        uint8_t m_numLevels;
+        uint32_t m_firstBlock[CUBE_FACE_NUM*MAX_MIP_NUM+1]; //!< Per face and mip, in storage order.
+        uint32_t m_blocksX[CUBE_FACE_NUM*MAX_MIP_NUM];
+        uint32_t m_width[CUBE_FACE_NUM*MAX_MIP_NUM];
+        uint32_t m_height[CUBE_FACE_NUM*MAX_MIP_NUM];
+        uint64_t m_dstOffset[CUBE_FACE_NUM*MAX_MIP_NUM];
+    };
 
-        // Alloc dst data.
-        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        const uint32_t dstPitch = _width * bytesPerPixel;
-        const uint32_t dstFaceDataSize = dstPitch * _height;
-        const uint32_t dstDataSize = dstFaceDataSize * imageRgba32f.m_numFaces;
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
+    static void imageDecodeBlocks(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ImageDecodeArgs* args = (const ImageDecodeArgs*)_userData;
+        const uint8_t blockBytes = blockFormatBytes(args->m_format);
+        const uint32_t dstBytesPerPixel = args->m_half ? 4*sizeof(uint16_t) : 4*sizeof(float);
 
-        // Get source offsets.
-        uint32_t srcFaceOffsets[6];
-        imageGetFaceOffsets(srcFaceOffsets, imageRgba32f);
-        const uint32_t srcPitch = imageRgba32f.m_width * bytesPerPixel;
+        uint8_t level = 0;
+        for (uint32_t block = _begin; block < _end; ++block)
+        {
+            while (args->m_firstBlock[level+1] <= block)
+            {
+                ++level;
+            }
 
-        // Get required parameters for processing.
-        const float dstToSrcRatioX = float(int32_t(imageRgba32f.m_width))  / float(int32_t(_width));
-        const float dstToSrcRatioY = float(int32_t(imageRgba32f.m_height)) / float(int32_t(_height));
+            const uint32_t local = block - args->m_firstBlock[level];
+            const uint32_t blockX = (local % args->m_blocksX[level])*4;
+            const uint32_t blockY = (local / args->m_blocksX[level])*4;
+            const uint32_t width  = args->m_width[level];
+            const uint32_t height = args->m_height[level];
 
-        // Resize base image.
-        for (uint8_t face = 0; face < imageRgba32f.m_numFaces; ++face)
-        {
-            uint8_t* dstFaceData = (uint8_t*)dstData + face*dstFaceDataSize;
-            const uint8_t* srcFaceData = (const uint8_t*)imageRgba32f.m_data + srcFaceOffsets[face];
+            BlockTexels texels;
+            blockDecode(texels, args->m_src + uint64_t(block)*blockBytes, args->m_format);
 
-            for (uint32_t yDst = 0; yDst < _height; ++yDst)
+            // Texels of partial blocks outside of the image are dropped.
+            const uint32_t numX = min(UINT32_C(4), width -blockX);
+            const uint32_t numY = min(UINT32_C(4), height-blockY);
+            for (uint32_t yy = 0; yy < numY; ++yy)
             {
-                uint8_t* dstFaceRow = (uint8_t*)dstFaceData + yDst*dstPitch;
-
-                for (uint32_t xDst = 0; xDst < _width; ++xDst)
+                uint8_t* dst = args->m_dst + args->m_dstOffset[level] + (uint64_t(blockY+yy)*width + blockX)*dstBytesPerPixel;
+                if (args->m_half)
+                {
+                    rgba16fFromRgba32fRow((uint16_t*)dst, texels[yy*4], numX);
+                }
+                else
                 {
-                    float* dstFaceColumn = (float*)((uint8_t*)dstFaceRow + xDst*bytesPerPixel);
+                    memcpy(dst, texels[yy*4], numX*dstBytesPerPixel);
+                }
+            }
+        }
+    }
 
-                    float color[3] = { 0.0f, 0.0f, 0.0f };
-                    uint32_t weight = 0;
+    /// Decodes blocks of all faces and mips at _src, stored in Image order. Blocks are decoded straight into
+    /// rgba32f or rgba16f, other formats are converted from rgba32f afterwards.
+    static bool imageDecode(Image& _dst, TextureFormat::Enum _dstFormat, const void* _src, BlockFormat::Enum _format
+                          , uint32_t _width, uint32_t _height, uint8_t _numMips, uint8_t _numFaces)
+    {
+        CMFT_PROFILE_ZONE("imageDecode");
 
-                    uint32_t ySrc = uint32_t(float(yDst)*dstToSrcRatioY);
-                    uint32_t ySrcEnd = ySrc + max(uint32_t(1), uint32_t(dstToSrcRatioY));
-                    for (; ySrc < ySrcEnd; ++ySrc)
-                    {
-                        const uint8_t* srcRowData = (const uint8_t*)srcFaceData + ySrc*srcPitch;
+        const TextureFormat::Enum decodeFormat = (TextureFormat::RGBA16F == _dstFormat) ? TextureFormat::RGBA16F : TextureFormat::RGBA32F;
+        const uint8_t dstBytesPerPixel = getImageDataInfo(decodeFormat).m_bytesPerPixel;
 
-                        uint32_t xSrc = uint32_t(float(xDst)*dstToSrcRatioX);
-                        uint32_t xSrcEnd = xSrc + max(uint32_t(1), uint32_t(dstToSrcRatioX));
-                        for (; xSrc < xSrcEnd; ++xSrc)
-                        {
-                            const float* srcColumnData = (const float*)((const uint8_t*)srcRowData + xSrc*bytesPerPixel);
-                            color[0] += srcColumnData[0];
-                            color[1] += srcColumnData[1];
-                            color[2] += srcColumnData[2];
-                            weight++;
-                        }
-                    }
+        ImageDecodeArgs args;
+        args.m_src = (const uint8_t*)_src;
+        args.m_format = _format;
+        args.m_half = (TextureFormat::RGBA16F == decodeFormat);
+        args.m_numLevels = 0;
 
-                    const float invWeight = 1.0f/float(max(weight, UINT32_C(1)));
-                    dstFaceColumn[0] = color[0] * invWeight;
-                    dstFaceColumn[1] = color[1] * invWeight;
-                    dstFaceColumn[2] = color[2] * invWeight;
-                    dstFaceColumn[3] = 1.0f;
-                }
+        uint64_t numBlocks = 0;
+        uint64_t dstDataSize = 0;
+        for (uint8_t face = 0; face < _numFaces; ++face)
+        {
+            for (uint8_t mip = 0; mip < _numMips; ++mip)
+            {
+                const uint8_t level = args.m_numLevels++;
+                const uint32_t width  = max(UINT32_C(1), _width  >> mip);
+                const uint32_t height = max(UINT32_C(1), _height >> mip);
+                args.m_firstBlock[level] = uint32_t(numBlocks);
+                args.m_blocksX[level] = (width+3)/4;
+                args.m_width[level] = width;
+                args.m_height[level] = height;
+                args.m_dstOffset[level] = dstDataSize;
+                numBlocks += uint64_t((width+3)/4) * ((height+3)/4);
+                dstDataSize += uint64_t(width) * height * dstBytesPerPixel;
             }
         }
+        args.m_firstBlock[args.m_numLevels] = uint32_t(numBlocks);
+
+        if (numBlocks > UINT32_MAX)
+        {
+            WARN("Image has too many blocks to decode at once.");
+            return false;
+        }
+
+        args.m_dst = (uint8_t*)getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(args.m_dst);
+        if (NULL == args.m_dst)
+        {
+            return false;
+        }
+
+        parallelFor(imageDecodeBlocks, (void*)&args, uint32_t(numBlocks), CMFT_DECODE_MIN_BLOCKS);
 
-        // Fill image structure.
         Image result;
+        result.m_data = args.m_dst;
         result.m_width = _width;
         result.m_height = _height;
         result.m_dataSize = dstDataSize;
-        result.m_format = TextureFormat::RGBA32F;
-        result.m_numMips = 1;
-        result.m_numFaces = imageRgba32f.m_numFaces;
-        result.m_data = dstData;
+        result.m_format = decodeFormat;
+        result.m_numMips = _numMips;
+        result.m_numFaces = _numFaces;
 
-        // Convert result to source format.
-        if (TextureFormat::RGBA32F == _src.m_format)
+        if (decodeFormat != _dstFormat)
         {
-            imageMove(_dst, result);
+            imageConvert(result, _dstFormat);
         }
-        else
+
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    // Direct conversions.
+    //-----
+
+    /// Reorders 8 bit channels, alpha is added as 255 or dropped. Same result as going through rgba32f.
+    template <uint8_t SrcChannels, uint8_t DstChannels, bool SwapRb>
+    static void convertBytesRange(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ImageConvertArgs* args = (const ImageConvertArgs*)_userData;
+        const uint8_t* src = (const uint8_t*)args->m_src + size_t(_begin)*SrcChannels;
+        uint8_t* dst = (uint8_t*)args->m_dst + size_t(_begin)*DstChannels;
+
+        for (uint32_t ii = _begin; ii < _end; ++ii, src+=SrcChannels, dst+=DstChannels)
         {
-            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
-            imageUnload(result);
+            dst[0] = src[SwapRb ? 2 : 0];
+            dst[1] = src[1];
+            dst[2] = src[SwapRb ? 0 : 2];
+            if (4 == DstChannels)
+            {
+                dst[3] = (4 == SrcChannels) ? src[3] : UINT8_MAX;
+            }
         }
+    }
 
-        // Cleanup.
-        if (!imageIsRef)
+    /// Adapts per-pixel helpers to the row interface of rgba16fToRgba32fRow() and friends.
+    template <typename Type, uint8_t Channels, void (*ToRgba32f)(float*, const Type*)>
+    static void pixelsToRgba32fRow(float* _dst, const Type* _src, uint32_t _num)
+    {
+        for (uint32_t ii = 0; ii < _num; ++ii)
         {
-            imageUnload(imageRgba32f);
+            ToRgba32f(&_dst[ii*4], &_src[ii*Channels]);
         }
     }
 
-    void imageResize(Image& _image, uint32_t _width, uint32_t _height)
+    template <typename Type, uint8_t Channels, void (*FromRgba32f)(Type*, const float*)>
+    static void pixelsFromRgba32fRow(Type* _dst, const float* _src, uint32_t _num)
     {
-        Image tmp;
-        imageResize(tmp, _width, _height, _image);
-        imageMove(_image, tmp);
+        for (uint32_t ii = 0; ii < _num; ++ii)
+        {
+            FromRgba32f(&_dst[ii*Channels], &_src[ii*4]);
+        }
     }
 
-    void imageTransformUseMacroInstead(Image* _image, ...)
+    // Pixels decoded at once by convertFusedRange(), on the stack.
+    #define CMFT_CONVERT_FUSED_CHUNK_PIXELS 256
+
+    /// Decodes chunks of pixels into a small rgba32f buffer on the stack and encodes them right away,
+    /// no intermediate image is allocated. Row functions keep their SIMD paths.
+    template <typename SrcType, uint8_t SrcChannels, void (*ToRgba32fRow)(float*, const SrcType*, uint32_t)
+            , typename DstType, uint8_t DstChannels, void (*FromRgba32fRow)(DstType*, const float*, uint32_t)>
+    static void convertFusedRange(void* _userData, uint32_t _begin, uint32_t _end)
     {
-        va_list argList;
-        va_start(argList, _image);
+        const ImageConvertArgs* args = (const ImageConvertArgs*)_userData;
+        const SrcType* src = (const SrcType*)args->m_src + size_t(_begin)*SrcChannels;
+        DstType* dst = (DstType*)args->m_dst + size_t(_begin)*DstChannels;
 
-        uint32_t op = va_arg(argList, uint32_t);
-        if (UINT32_MAX != op)
+        float rgba32f[CMFT_CONVERT_FUSED_CHUNK_PIXELS*4];
+        for (uint32_t first = _begin; first < _end; first += CMFT_CONVERT_FUSED_CHUNK_PIXELS)
         {
-            const uint32_t bytesPerPixel = getImageDataInfo(_image->m_format).m_bytesPerPixel;
+            const uint32_t num = min(_end-first, uint32_t(CMFT_CONVERT_FUSED_CHUNK_PIXELS));
+            ToRgba32fRow(rgba32f, src, num);
+            FromRgba32fRow(dst, rgba32f, num);
+            src += num*SrcChannels;
+            dst += num*DstChannels;
+        }
+    }
 
-            uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-            imageGetMipOffsets(offsets, *_image);
+    struct DirectConversion
+    {
+        TextureFormat::Enum m_src;
+        TextureFormat::Enum m_dst;
+        ParallelForFn m_fn;
+    };
 
-            for (uint8_t ii = 0; op != UINT32_MAX; ++ii, op = va_arg(argList, uint32_t))
-            {
-                const uint16_t imageOp = (op&IMAGE_OP_MASK);
-                const uint8_t imageFace = (op&IMAGE_FACE_MASK)>>IMAGE_FACE_SHIFT;
+    static const DirectConversion s_directConversions[] =
+    {
+        { TextureFormat::BGRA8,   TextureFormat::RGBA8,   convertBytesRange<4, 4, true>  },
+        { TextureFormat::RGBA8,   TextureFormat::BGRA8,   convertBytesRange<4, 4, true>  },
+        { TextureFormat::BGR8,    TextureFormat::RGB8,    convertBytesRange<3, 3, true>  },
+        { TextureFormat::RGB8,    TextureFormat::BGR8,    convertBytesRange<3, 3, true>  },
+        { TextureFormat::RGB8,    TextureFormat::RGBA8,   convertBytesRange<3, 4, false> },
+        { TextureFormat::RGBA8,   TextureFormat::RGB8,    convertBytesRange<4, 3, false> },
+        { TextureFormat::BGR8,    TextureFormat::BGRA8,   convertBytesRange<3, 4, false> },
+        { TextureFormat::BGRA8,   TextureFormat::BGR8,    convertBytesRange<4, 3, false> },
+        { TextureFormat::RGB8,    TextureFormat::BGRA8,   convertBytesRange<3, 4, true>  },
+        { TextureFormat::BGRA8,   TextureFormat::RGB8,    convertBytesRange<4, 3, true>  },
+        { TextureFormat::BGR8,    TextureFormat::RGBA8,   convertBytesRange<3, 4, true>  },
+        { TextureFormat::RGBA8,   TextureFormat::BGR8,    convertBytesRange<4, 3, true>  },
+        { TextureFormat::RGB16,   TextureFormat::RGBA16,  convertFusedRange<uint16_t, 3, pixelsToRgba32fRow<uint16_t, 3, rgb16ToRgba32f>, uint16_t, 4, pixelsFromRgba32fRow<uint16_t, 4, rgba16FromRgba32f> > },
+        { TextureFormat::RGBA16,  TextureFormat::RGB16,   convertFusedRange<uint16_t, 4, pixelsToRgba32fRow<uint16_t, 4, rgba16ToRgba32f>, uint16_t, 3, pixelsFromRgba32fRow<uint16_t, 3, rgb16FromRgba32f> > },
+        { TextureFormat::RGB16F,  TextureFormat::RGBA16F, convertFusedRange<uint16_t, 3, rgb16fToRgba32fRow, uint16_t, 4, rgba16fFromRgba32fRow> },
+        { TextureFormat::RGBA16F, TextureFormat::RGB16F,  convertFusedRange<uint16_t, 4, rgba16fToRgba32fRow, uint16_t, 3, pixelsFromRgba32fRow<uint16_t, 3, rgb16fFromRgba32f> > },
+        { TextureFormat::RGBE,    TextureFormat::RGBA16F, convertFusedRange<uint8_t, 4, rgbeToRgba32fRow, uint16_t, 4, rgba16fFromRgba32fRow> },
+        { TextureFormat::RGBA16F, TextureFormat::RGBE,    convertFusedRange<uint16_t, 4, rgba16fToRgba32fRow, uint8_t, 4, rgbeFromRgba32fRow> },
+        { TextureFormat::RGBE,    TextureFormat::RGB16F,  convertFusedRange<uint8_t, 4, rgbeToRgba32fRow, uint16_t, 3, pixelsFromRgba32fRow<uint16_t, 3, rgb16fFromRgba32f> > },
+        { TextureFormat::RGB16F,  TextureFormat::RGBE,    convertFusedRange<uint16_t, 3, rgb16fToRgba32fRow, uint8_t, 4, rgbeFromRgba32fRow> },
+        { TextureFormat::RGB9E5,     TextureFormat::RGBA16F,    convertFusedRange<uint32_t, 1, rgb9e5ToRgba32fRow, uint16_t, 4, rgba16fFromRgba32fRow> },
+        { TextureFormat::RGBA16F,    TextureFormat::RGB9E5,     convertFusedRange<uint16_t, 4, rgba16fToRgba32fRow, uint32_t, 1, rgb9e5FromRgba32fRow> },
+        { TextureFormat::R11G11B10F, TextureFormat::RGBA16F,    convertFusedRange<uint32_t, 1, r11g11b10fToRgba32fRow, uint16_t, 4, rgba16fFromRgba32fRow> },
+        { TextureFormat::RGBA16F,    TextureFormat::R11G11B10F, convertFusedRange<uint16_t, 4, rgba16fToRgba32fRow, uint32_t, 1, r11g11b10fFromRgba32fRow> },
+        { TextureFormat::RGB32F,  TextureFormat::RGBA16F, convertFusedRange<float, 3, pixelsToRgba32fRow<float, 3, rgb32fToRgba32f>, uint16_t, 4, rgba16fFromRgba32fRow> },
+        { TextureFormat::RGBA16F, TextureFormat::RGB32F,  convertFusedRange<uint16_t, 4, rgba16fToRgba32fRow, float, 3, pixelsFromRgba32fRow<float, 3, rgb32fFromRgba32f> > },
+    };
 
-                if (imageOp&IMAGE_OP_ROT_90)
-                {
-                    if (_image->m_width == _image->m_height)
-                    {
-                        for (uint8_t mip = 0; mip < _image->m_numMips; ++mip)
-                        {
-                            const uint32_t width  = max(UINT32_C(1), _image->m_width  >> mip);
-                            const uint32_t height = max(UINT32_C(1), _image->m_height >> mip);
-                            const uint32_t pitch = width * bytesPerPixel;
-
-                            uint8_t* facePtr = (uint8_t*)_image->m_data + offsets[imageFace][mip];
-                            for (uint32_t yy = 0, yyEnd = height-1; yy < height; ++yy, --yyEnd)
-                            {
-                                uint8_t* rowPtr    = (uint8_t*)facePtr + yy*pitch;
-                                uint8_t* columnPtr = (uint8_t*)facePtr + yyEnd*bytesPerPixel;
-                                for (uint32_t xx = 0, xxEnd = width-1; xx < width; ++xx, --xxEnd)
-                                {
-                                    if (xx < yyEnd)
-                                    {
-                                        uint8_t* aa = (uint8_t*)rowPtr    + xx*bytesPerPixel;
-                                        uint8_t* bb = (uint8_t*)columnPtr + xxEnd*pitch;
-                                        cmft_swap(aa, bb, bytesPerPixel);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        WARN("Because image data transformation is done in place, "
-                             "rotation operations work only when image width is equal to image height."
-                             );
-                    }
-                }
+    static ParallelForFn directConversion(TextureFormat::Enum _src, TextureFormat::Enum _dst)
+    {
+        for (uint32_t ii = 0; ii < BX_COUNTOF(s_directConversions); ++ii)
+        {
+            if (_src == s_directConversions[ii].m_src
+            &&  _dst == s_directConversions[ii].m_dst)
+            {
+                return s_directConversions[ii].m_fn;
+            }
+        }
 
-                if (imageOp&IMAGE_OP_ROT_180)
-                {
-                    if (_image->m_width == _image->m_height)
-                    {
-                        for (uint8_t mip = 0; mip < _image->m_numMips; ++mip)
-                        {
-                            const uint32_t width  = max(UINT32_C(1), _image->m_width  >> mip);
-                            const uint32_t height = max(UINT32_C(1), _image->m_height >> mip);
-                            const uint32_t pitch = width * bytesPerPixel;
-
-                            uint8_t* facePtr = (uint8_t*)_image->m_data + offsets[imageFace][mip];
-                            uint32_t yy = 0, yyEnd = height-1;
-                            for (; yy < yyEnd; ++yy, --yyEnd)
-                            {
-                                uint8_t* rowPtr    = (uint8_t*)facePtr + pitch*yy;
-                                uint8_t* rowPtrEnd = (uint8_t*)facePtr + pitch*yyEnd;
-                                for (uint32_t xx = 0, xxEnd = width-1; xx < width; ++xx, --xxEnd)
-                                {
-                                    uint8_t* aa = (uint8_t*)rowPtr    + bytesPerPixel*xx;
-                                    uint8_t* bb = (uint8_t*)rowPtrEnd + bytesPerPixel*xxEnd;
-                                    cmft_swap(aa, bb, bytesPerPixel);
-                                }
-                            }
-
-                            // Handle middle line as special case.
-                            if (yy == yyEnd)
-                            {
-                                uint8_t* rowPtr = (uint8_t*)facePtr + pitch*yy;
-                                for (uint32_t xx = 0, xxEnd = width-1; xx < xxEnd; ++xx, --xxEnd)
-                                {
-                                    uint8_t* aa = (uint8_t*)rowPtr + bytesPerPixel*xx;
-                                    uint8_t* bb = (uint8_t*)rowPtr + bytesPerPixel*xxEnd;
-                                    cmft_swap(aa, bb, bytesPerPixel);
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        WARN("Because image data transformation is done in place, "
-                             "rotation operations work only when image width is equal to image height."
-                             );
-                    }
-                }
+        return NULL;
+    }
 
-                if (imageOp&IMAGE_OP_ROT_270)
-                {
-                    if (_image->m_width == _image->m_height)
-                    {
-                        for (uint8_t mip = 0; mip < _image->m_numMips; ++mip)
-                        {
-                            const uint32_t width  = max(UINT32_C(1), _image->m_width  >> mip);
-                            const uint32_t height = max(UINT32_C(1), _image->m_height >> mip);
-                            const uint32_t pitch = width * bytesPerPixel;
-
-                            uint8_t* facePtr = (uint8_t*)_image->m_data + offsets[imageFace][mip];
-                            for (uint32_t yy = 0; yy < height; ++yy)
-                            {
-                                uint8_t* rowPtr    = (uint8_t*)facePtr + yy*pitch;
-                                uint8_t* columnPtr = (uint8_t*)facePtr + yy*bytesPerPixel;
-                                for (uint32_t xx = 0; xx < width; ++xx)
-                                {
-                                    if (xx > yy)
-                                    {
-                                        uint8_t* aa = (uint8_t*)rowPtr    + xx*bytesPerPixel;
-                                        uint8_t* bb = (uint8_t*)columnPtr + xx*pitch;
-                                        cmft_swap(aa, bb, bytesPerPixel);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        WARN("Because image data transformation is done in place, "
-                             "rotation operations work only when image width is equal to image height."
-                             );
-                    }
-                }
+    /// Converts _src with a direct kernel if there is one for the format pair.
+    static bool imageConvertDirect(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src, const ImageEncodeSettings& _settings)
+    {
+        const ParallelForFn fn = directConversion((TextureFormat::Enum)_src.m_format, _dstFormat);
+        const uint64_t pixelCount = imageGetNumPixels(_src);
+        if (NULL == fn
+        ||  pixelCount > UINT32_MAX)
+        {
+            return false;
+        }
 
-                if (imageOp&IMAGE_OP_FLIP_X)
-                {
-                    for (uint8_t mip = 0; mip < _image->m_numMips; ++mip)
-                    {
-                        const uint32_t width  = max(UINT32_C(1), _image->m_width  >> mip);
-                        const uint32_t height = max(UINT32_C(1), _image->m_height >> mip);
-                        const uint32_t pitch = width * bytesPerPixel;
+        const uint8_t dstBytesPerPixel = getImageDataInfo(_dstFormat).m_bytesPerPixel;
+        const uint64_t dataSize = pixelCount*dstBytesPerPixel;
+        void* data = getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
 
-                        uint8_t* facePtr = (uint8_t*)_image->m_data + offsets[imageFace][mip];
-                        for (uint32_t yy = 0, yyEnd = height-1; yy < yyEnd; ++yy, --yyEnd)
-                        {
-                            uint8_t* rowPtr    = (uint8_t*)facePtr + pitch*yy;
-                            uint8_t* rowPtrEnd = (uint8_t*)facePtr + pitch*yyEnd;
-                            cmft_swap(rowPtr, rowPtrEnd, pitch);
-                        }
-                    }
-                }
+        ImageConvertArgs args(_settings);
+        args.m_dst = data;
+        args.m_src = _src.m_data;
+        args.m_srcFormat = (TextureFormat::Enum)_src.m_format;
+        args.m_dstFormat = _dstFormat;
+        args.m_srcBytesPerPixel = getImageDataInfo((TextureFormat::Enum)_src.m_format).m_bytesPerPixel;
+        args.m_dstBytesPerPixel = dstBytesPerPixel;
+        parallelFor(fn, (void*)&args, uint32_t(pixelCount), CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
 
-                if (imageOp&IMAGE_OP_FLIP_Y)
-                {
-                    for (uint8_t mip = 0; mip < _image->m_numMips; ++mip)
-                    {
-                        const uint32_t width  = max(UINT32_C(1), _image->m_width  >> mip);
-                        const uint32_t height = max(UINT32_C(1), _image->m_height >> mip);
-                        const uint32_t pitch = width * bytesPerPixel;
+        Image result;
+        result.m_data = data;
+        result.m_width = _src.m_width;
+        result.m_height = _src.m_height;
+        result.m_dataSize = dataSize;
+        result.m_format = _dstFormat;
+        result.m_numMips = _src.m_numMips;
+        result.m_numFaces = _src.m_numFaces;
 
-                        uint8_t* facePtr = (uint8_t*)_image->m_data + offsets[imageFace][mip];
-                        for (uint32_t yy = 0; yy < height; ++yy)
-                        {
-                            uint8_t* rowPtr = (uint8_t*)facePtr + pitch*yy;
-                            for (uint32_t xx = 0, xxEnd = width-1; xx < xxEnd; ++xx, --xxEnd)
-                            {
-                                uint8_t* columnPtr    = (uint8_t*)rowPtr + bytesPerPixel*xx;
-                                uint8_t* columnPtrEnd = (uint8_t*)rowPtr + bytesPerPixel*xxEnd;
-                                cmft_swap(columnPtr, columnPtrEnd, bytesPerPixel);
-                            }
-                        }
-                    }
-                }
-            }
-        }
+        imageUnload(_dst);
+        imageMove(_dst, result);
 
-        va_end(argList);
+        return true;
     }
 
-    void imageGenerateMipMapChain(Image& _image, uint8_t _numMips)
+    void imageConvert(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src, const ImageEncodeSettings* _settings)
     {
-        // Processing is done in rgba32f format.
-        Image imageRgba32f;
-        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _image);
+        CMFT_PROFILE_ZONE("imageConvert");
+        AllocTagScope allocTag(AllocTag::Conversion, true);
 
-        // Calculate dataSize and offsets for the entire mip map chain.
-        uint32_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        uint32_t dstDataSize = 0;
-        uint8_t mipCount = 0;
-        const uint8_t maxMipNum = min(_numMips, uint8_t(MAX_MIP_NUM));
-        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        for (uint8_t face = 0; face < imageRgba32f.m_numFaces; ++face)
+        // Block compressed source is decoded first, anything else is done on the decoded image.
+        if (0 != getImageDataInfo(_src.m_format).m_blockBytes)
         {
-            uint32_t width = 0;
-            uint32_t height = 0;
-
-            for (mipCount = 0; (mipCount < maxMipNum) && (width != 1) && (height != 1); ++mipCount)
+            const BlockFormat::Enum blockFormat = blockFormatFromTextureFormat((TextureFormat::Enum)_src.m_format);
+            if (BlockFormat::Count == blockFormat)
             {
-                dstOffsets[face][mipCount] = dstDataSize;
-                width  = max(UINT32_C(1), imageRgba32f.m_width  >> mipCount);
-                height = max(UINT32_C(1), imageRgba32f.m_height >> mipCount);
-
-                dstDataSize += width * height * bytesPerPixel;
+                WARN("Converting from %s is not supported.", getTextureFormatStr(_src.m_format));
+                return;
             }
-        }
-
-        // Alloc data.
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
-
-        // Get source offsets.
-        uint32_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(srcOffsets, imageRgba32f);
 
-        // Generate mip chain.
-        for (uint8_t face = 0; face < imageRgba32f.m_numFaces; ++face)
-        {
-            for (uint8_t mip = 0; mip < mipCount; ++mip)
+            const TextureFormat::Enum decodeFormat = (0 == _src.m_faceTransforms && 0 == getImageDataInfo(_dstFormat).m_blockBytes)
+                                                   ? _dstFormat
+                                                   : TextureFormat::RGBA32F
+                                                   ;
+            Image decoded;
+            if (imageDecode(decoded, decodeFormat, _src.m_data, blockFormat, _src.m_width, _src.m_height, _src.m_numMips, _src.m_numFaces))
             {
-                const uint32_t width  = max(UINT32_C(1), imageRgba32f.m_width  >> mip);
-                const uint32_t height = max(UINT32_C(1), imageRgba32f.m_height >> mip);
-                const uint32_t pitch = width * bytesPerPixel;
-
-                uint8_t* dstMipData       = (uint8_t*)dstData                   + dstOffsets[face][mip];
-                const uint8_t* srcMipData = (const uint8_t*)imageRgba32f.m_data + srcOffsets[face][mip];
-
-                // If mip is present, copy data.
-                if (mip < imageRgba32f.m_numMips)
+                decoded.m_faceTransforms = _src.m_faceTransforms;
+                if (decodeFormat == _dstFormat)
                 {
-                    for (uint32_t yy = 0; yy < height; ++yy)
-                    {
-                        uint8_t* dst       = (uint8_t*)dstMipData       + yy*pitch;
-                        const uint8_t* src = (const uint8_t*)srcMipData + yy*pitch;
-                        memcpy(dst, src, pitch);
-                    }
+                    imageUnload(_dst);
+                    imageMove(_dst, decoded);
                 }
-                // Else generate it.
                 else
                 {
-                    const uint8_t parentMip = mip - 1;
-                    const uint32_t parentWidth = max(UINT32_C(1), imageRgba32f.m_width >> parentMip);
-                    const uint32_t parentPitch = parentWidth * bytesPerPixel;
-                    const uint8_t* parentMipData = (const uint8_t*)dstData + dstOffsets[face][parentMip];
-
-                    for (uint32_t yy = 0; yy < height; ++yy)
-                    {
-                        uint8_t* dstRowData = (uint8_t*)dstMipData + pitch*yy;
-                        for (uint32_t xx = 0; xx < width; ++xx)
-                        {
-                            float* dstColumnData = (float*)((uint8_t*)dstRowData + xx*bytesPerPixel);
-
-                            float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-                            for (uint32_t yParent = yy*2, end = yParent+2; yParent < end; ++yParent)
-                            {
-                                const uint8_t* parentRowData = (const uint8_t*)parentMipData + parentPitch*yParent;
-                                for (uint32_t xParent = xx*2, end = xParent+2; xParent < end; ++xParent)
-                                {
-                                    const float* parentColumnData = (const float*)((const uint8_t*)parentRowData + xParent*bytesPerPixel);
-                                    color[0] += parentColumnData[0];
-                                    color[1] += parentColumnData[1];
-                                    color[2] += parentColumnData[2];
-                                    color[3] += parentColumnData[3];
-                                }
-                            }
-
-                            dstColumnData[0] = color[0] * 0.25f;
-                            dstColumnData[1] = color[1] * 0.25f;
-                            dstColumnData[2] = color[2] * 0.25f;
-                            dstColumnData[3] = color[3] * 0.25f;
-                        }
-                    }
+                    imageConvert(_dst, _dstFormat, decoded, _settings);
+                    imageUnload(decoded);
                 }
             }
+            return;
         }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = imageRgba32f.m_width;
-        result.m_height = imageRgba32f.m_height;
-        result.m_dataSize = dstDataSize;
-        result.m_format = imageRgba32f.m_format;
-        result.m_numMips = mipCount;
-        result.m_numFaces = imageRgba32f.m_numFaces;
-        result.m_data = dstData;
+        // Recorded face transforms are applied while converting. Block compressed formats are encoded from the rgba32f result.
+        if (0 != _src.m_faceTransforms)
+        {
+            if (0 != getImageDataInfo(_dstFormat).m_blockBytes)
+            {
+                Image imageRgba32f;
+                imageConvertTransformed(imageRgba32f, TextureFormat::RGBA32F, _src, encodeSettings(_settings));
+                imageConvert(_dst, _dstFormat, imageRgba32f, _settings);
+                imageUnload(imageRgba32f);
+            }
+            else
+            {
+                imageConvertTransformed(_dst, _dstFormat, _src, encodeSettings(_settings));
+            }
+            return;
+        }
 
-        // Convert result to source format.
-        if (TextureFormat::RGBA32F == (TextureFormat::Enum)_image.m_format)
+        // Common pairs are converted without the rgba32f image in between.
+        if (imageConvertDirect(_dst, _dstFormat, _src, encodeSettings(_settings)))
         {
-            imageMove(_image, result);
+            return;
+        }
+
+        // Conversion to rgba32f is done directly as well.
+        if (TextureFormat::RGBA32F == _dstFormat
+        &&  TextureFormat::RGBA32F != _src.m_format)
+        {
+            imageUnload(_dst);
+            imageToRgba32f(_dst, _src, _settings);
+            return;
+        }
+
+        // Image _src to rgba32f.
+        Image imageRgba32f;
+        if (TextureFormat::RGBA32F == _src.m_format)
+        {
+            imageRef(imageRgba32f, _src);
         }
         else
         {
-            imageConvert(_image, (TextureFormat::Enum)_image.m_format, result);
-            imageUnload(result);
+            imageToRgba32f(imageRgba32f, _src, _settings);
         }
 
-        // Cleanup.
-        if (!imageIsRef)
+        // Image rgba32f to _dst.
+        if (TextureFormat::RGBA32F == _dstFormat)
+        {
+            imageShareOrCopy(_dst, _src);
+        }
+        else if (0 != getImageDataInfo(_dstFormat).m_blockBytes)
+        {
+            imageUnload(_dst);
+            imageEncode(_dst, _dstFormat, imageRgba32f, encodeSettings(_settings).m_compressionQuality);
+        }
+        else
+        {
+            imageUnload(_dst);
+            imageFromRgba32f(_dst, _dstFormat, imageRgba32f, _settings);
+        }
+
+        // Unload imageRgba32f if its a copy and NOT a reference of _src.
+        if (_src.m_data != imageRgba32f.m_data)
         {
             imageUnload(imageRgba32f);
         }
     }
 
-    void imageApplyGamma(Image& _image, float _gammaPow)
+    // Pixels converted sequentially before the in-place conversion goes parallel.
+    #define CMFT_CONVERT_IN_PLACE_HEAD_PIXELS 64
+
+    static bool imageFromRgba32fInPlace(Image& _image, TextureFormat::Enum _format, const ImageEncodeSettings& _settings)
     {
-        // Do nothing if _gammaPow is ~= 1.0f.
-        if (0.0001f > fabsf(_gammaPow-1.0f))
+        const uint8_t dstBytesPerPixel = getImageDataInfo(_format).m_bytesPerPixel;
+        const uint8_t srcBytesPerPixel = getImageDataInfo(TextureFormat::RGBA32F).m_bytesPerPixel;
+        const uint64_t pixelCount = imageGetNumPixels(_image);
+        if (TextureFormat::RGBA32F != _image.m_format
+        ||  0 != _image.m_faceTransforms
+        ||  0 != getImageDataInfo(_format).m_blockBytes
+        ||  dstBytesPerPixel >= srcBytesPerPixel
+        ||  _image.m_mapped
+        ||  imageIsShared(_image)
+        ||  pixelCount > UINT32_MAX)
         {
-            return;
+            return false;
         }
 
-        // Operation is done in rgba32f format.
-        Image imageRgba32f;
-        imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _image);
+        uint8_t* data = (uint8_t*)_image.m_data;
+
+        ImageConvertArgs args(_settings);
+        args.m_srcFormat = TextureFormat::RGBA32F;
+        args.m_dstFormat = _format;
+        args.m_srcBytesPerPixel = srcBytesPerPixel;
+        args.m_dstBytesPerPixel = dstBytesPerPixel;
 
-        // Iterate through image channels and apply gamma function.
-        float* channel = (float*)imageRgba32f.m_data;
-        const float* end = (const float*)((const uint8_t*)imageRgba32f.m_data + imageRgba32f.m_dataSize);
+        // Destination pixel ii ends at or before source pixel ii begins, except for the first few,
+        // which are read through a copy. Converting front-to-back never overwrites unread source data.
+        const uint32_t headCount = uint32_t(min(pixelCount, uint64_t(CMFT_CONVERT_IN_PLACE_HEAD_PIXELS)));
+        float head[CMFT_CONVERT_IN_PLACE_HEAD_PIXELS*4];
+        memcpy(head, data, headCount*srcBytesPerPixel);
+        args.m_dst = data;
+        args.m_src = head;
+        imageFromRgba32fRange((void*)&args, 0, headCount);
 
-        for(;channel < end; channel+=4)
+        // Once [0, done) is converted, source pixels [done, done*src/dst) can not overlap destination
+        // pixels still to be written, so each wave converts in parallel and grows geometrically.
+        uint32_t done = headCount;
+        while (done < pixelCount)
         {
-            channel[0] = powf(channel[0], _gammaPow);
-            channel[1] = powf(channel[1], _gammaPow);
-            channel[2] = powf(channel[2], _gammaPow);
-            //channel[3] = leave alpha channel as is.
+            const uint32_t end = uint32_t(min(pixelCount, uint64_t(done)*srcBytesPerPixel/dstBytesPerPixel));
+            args.m_dst = data + uint64_t(done)*dstBytesPerPixel;
+            args.m_src = data + uint64_t(done)*srcBytesPerPixel;
+            parallelFor(imageFromRgba32fRange, (void*)&args, end-done, CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+            done = end;
+        }
+
+        // Give back the tail.
+        const uint64_t dstDataSize = pixelCount*dstBytesPerPixel;
+        void* shrunk = imageAllocator(_image)->realloc(_image.m_data, dstDataSize);
+        if (NULL != shrunk)
+        {
+            _image.m_data = shrunk;
         }
+        _image.m_dataSize = dstDataSize;
+        _image.m_format = _format;
 
-        // If image was converted, convert back to original format. Otherwise, a reference to self is passed.
-        imageRefOrConvert(_image, (TextureFormat::Enum)_image.m_format, imageRgba32f);
+        return true;
     }
 
-    void imageClamp(Image& _dst, const Image& _src)
+    void imageConvert(Image& _image, TextureFormat::Enum _format, const ImageEncodeSettings* _settings)
     {
-        // Get a copy in rgba32f format.
-        Image imageRgba32f;
-        imageConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
-
-        // Iterate through image channels and clamp to [0.0-1.0] range.
-        float* channel = (float*)imageRgba32f.m_data;
-        const float* end = (const float*)((const uint8_t*)imageRgba32f.m_data + imageRgba32f.m_dataSize);
+        AllocTagScope allocTag(AllocTag::Conversion, true);
 
-        for(;channel < end; channel+=4)
+        if (_format != _image.m_format
+        ||  0 != _image.m_faceTransforms)
         {
-            channel[0] = clamp(channel[0], 0.0f, 1.0f);
-            channel[1] = clamp(channel[1], 0.0f, 1.0f);
-            channel[2] = clamp(channel[2], 0.0f, 1.0f);
-            channel[3] = clamp(channel[3], 0.0f, 1.0f);
+            // Narrowing from RGBA32F is done in place, without a second buffer.
+            CMFT_PROFILE_ZONE("imageConvert");
+            if (imageFromRgba32fInPlace(_image, _format, encodeSettings(_settings)))
+            {
+                return;
+            }
+
+            Image tmp;
+            imageConvert(tmp, _format, _image, _settings);
+            imageMove(_image, tmp);
         }
+    }
 
-        // Move or convert to original format.
-        if (TextureFormat::RGBA32F == _src.m_format)
+    bool imageRefOrConvert(Image& _dst, TextureFormat::Enum _format, const Image& _src, const ImageEncodeSettings* _settings)
+    {
+        if (_format == _src.m_format
+        &&  0 == _src.m_faceTransforms)
         {
-            imageMove(_dst, imageRgba32f);
+            imageRef(_dst, _src);
+            return true;
         }
         else
         {
-            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, imageRgba32f);
-            imageUnload(imageRgba32f);
+            imageUnload(_dst);
+            imageConvert(_dst, _format, _src, _settings);
+            return false;
         }
     }
 
-    void imageClamp(Image& _image)
+    // Pixels read and converted at once when loaders decode straight into the requested format.
+    #define CMFT_LOAD_CONVERT_CHUNK_PIXELS (1<<18)
+
+    // Positional reads split data bigger than this into chunks, read and converted concurrently.
+    #ifndef CMFT_LOAD_PARALLEL_READ_MIN_SIZE
+        #define CMFT_LOAD_PARALLEL_READ_MIN_SIZE (UINT64_C(32)<<20)
+    #endif //CMFT_LOAD_PARALLEL_READ_MIN_SIZE
+
+    #ifndef CMFT_LOAD_PARALLEL_READ_CHUNK_SIZE
+        #define CMFT_LOAD_PARALLEL_READ_CHUNK_SIZE (UINT32_C(4)<<20)
+    #endif //CMFT_LOAD_PARALLEL_READ_CHUNK_SIZE
+
+    /// Converts _numPixels pixels from _srcFormat to _dstFormat.
+    /// _rgba32f has to hold _numPixels rgba32f pixels when neither of formats is RGBA32F, otherwise it can be NULL.
+    /// Without _parallel conversion runs on the calling thread, for callers already running on the thread pool.
+    static void convertPixels(void* _dst, TextureFormat::Enum _dstFormat, const void* _src, TextureFormat::Enum _srcFormat, uint32_t _numPixels, float* _rgba32f, bool _parallel = true, const ImageEncodeSettings& _settings = s_defaultEncodeSettings)
     {
-        // Operation is done in rgba32f format.
-        Image imageRgba32f;
-        imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _image);
+        const uint8_t srcBytesPerPixel = getImageDataInfo(_srcFormat).m_bytesPerPixel;
+        const uint8_t dstBytesPerPixel = getImageDataInfo(_dstFormat).m_bytesPerPixel;
 
-        // Iterate through image channels and clamp to [0.0-1.0] range.
-        float* channel = (float*)imageRgba32f.m_data;
-        const float* end = (const float*)((const uint8_t*)imageRgba32f.m_data + imageRgba32f.m_dataSize);
+        if (_srcFormat == _dstFormat)
+        {
+            memcpy(_dst, _src, size_t(_numPixels)*srcBytesPerPixel);
+            return;
+        }
+
+        ImageConvertArgs args(_settings);
+        args.m_dst = (TextureFormat::RGBA32F == _dstFormat) ? _dst : (void*)_rgba32f;
+        args.m_src = _src;
+        args.m_srcFormat = _srcFormat;
+        args.m_dstFormat = TextureFormat::RGBA32F;
+        args.m_srcBytesPerPixel = srcBytesPerPixel;
+        args.m_dstBytesPerPixel = getImageDataInfo(TextureFormat::RGBA32F).m_bytesPerPixel;
 
-        for(;channel < end; channel+=4)
+        if (TextureFormat::RGBA32F != _srcFormat)
         {
-            channel[0] = clamp(channel[0], 0.0f, 1.0f);
-            channel[1] = clamp(channel[1], 0.0f, 1.0f);
-            channel[2] = clamp(channel[2], 0.0f, 1.0f);
-            channel[3] = clamp(channel[3], 0.0f, 1.0f);
+            DEBUG_CHECK(NULL != args.m_dst, "Rgba32f chunk is required.");
+            if (_parallel)
+            {
+                parallelFor(imageToRgba32fRange, (void*)&args, _numPixels, CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+            }
+            else
+            {
+                imageToRgba32fRange((void*)&args, 0, _numPixels);
+            }
+
+            args.m_src = args.m_dst;
+            args.m_srcFormat = TextureFormat::RGBA32F;
+            args.m_srcBytesPerPixel = args.m_dstBytesPerPixel;
         }
 
-        // If image was converted, convert back to original format. Otherwise, a reference to self is passed.
-        imageRefOrConvert(_image, (TextureFormat::Enum)_image.m_format, imageRgba32f);
+        if (TextureFormat::RGBA32F != _dstFormat)
+        {
+            args.m_dst = _dst;
+            args.m_dstFormat = _dstFormat;
+            args.m_dstBytesPerPixel = dstBytesPerPixel;
+            if (_parallel)
+            {
+                parallelFor(imageFromRgba32fRange, (void*)&args, _numPixels, CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+            }
+            else
+            {
+                imageFromRgba32fRange((void*)&args, 0, _numPixels);
+            }
+        }
     }
 
-    bool imageIsCubemap(const Image& _image)
+    struct ReadConvertedArgs
     {
-        return (6 == _image.m_numFaces) && (_image.m_width == _image.m_height);
-    }
+        Reader* m_stream;
+        uint64_t m_offset;
+        uint64_t m_numPixels;
+        uint32_t m_chunkPixels;
+        TextureFormat::Enum m_srcFormat;
+        TextureFormat::Enum m_dstFormat;
+        uint8_t* m_dst;
+        volatile bool m_failed;
+    };
 
-    bool imageIsLatLong(const Image& _image)
+    /// Reads and converts chunks [_begin, _end) with positional reads, each range uses its own buffer.
+    static void readConvertedChunks(void* _userData, uint32_t _begin, uint32_t _end)
     {
-        const float aspect = (float)(int32_t)_image.m_width/(float)(int32_t)_image.m_height;
-        return (0.00001f > fabsf(aspect-2.0f));
-    }
+        ReadConvertedArgs& args = *(ReadConvertedArgs*)_userData;
 
-    bool imageIsHStrip(const Image& _image)
-    {
-        return (_image.m_width == 6*_image.m_height);
-    }
+        const uint8_t srcBytesPerPixel = getImageDataInfo(args.m_srcFormat).m_bytesPerPixel;
+        const uint8_t dstBytesPerPixel = getImageDataInfo(args.m_dstFormat).m_bytesPerPixel;
+        const bool sameFormat = (args.m_srcFormat == args.m_dstFormat);
 
-    bool imageValidCubemapFaceList(const Image _faceList[6])
-    {
-        const uint32_t size = _faceList[0].m_width;
-        const uint8_t numMips = _faceList[0].m_numMips;
-        for (uint8_t face = 0; face < 6; ++face)
+        // Rgba32f chunk goes first to keep it aligned.
+        const bool viaRgba32f = (TextureFormat::RGBA32F != args.m_srcFormat && TextureFormat::RGBA32F != args.m_dstFormat);
+        const size_t rgba32fSize = viaRgba32f ? size_t(args.m_chunkPixels)*4*sizeof(float) : 0;
+        uint8_t* chunk = NULL;
+        if (!sameFormat)
         {
-            if (_faceList[face].m_width != _faceList[face].m_height
-            ||  size    != _faceList[face].m_width
-            ||  numMips != _faceList[face].m_numMips)
+            chunk = (uint8_t*)allocScratch(rgba32fSize + size_t(args.m_chunkPixels)*srcBytesPerPixel, AllocTag::Conversion);
+            MALLOC_CHECK(chunk);
+            if (NULL == chunk)
             {
-                return false;
+                args.m_failed = true;
+                return;
             }
         }
-        return true;
+        float* rgba32f = viaRgba32f ? (float*)chunk : NULL;
+        uint8_t* src = chunk + rgba32fSize;
+
+        for (uint32_t ii = _begin; ii < _end && !args.m_failed; ++ii)
+        {
+            const uint64_t pixel = uint64_t(ii)*args.m_chunkPixels;
+            const uint32_t count = uint32_t(min(args.m_numPixels-pixel, uint64_t(args.m_chunkPixels)));
+            const size_t size = size_t(count)*srcBytesPerPixel;
+            uint8_t* dst = args.m_dst + pixel*dstBytesPerPixel;
+
+            if (!args.m_stream->readAt(sameFormat ? dst : src, size, args.m_offset + pixel*srcBytesPerPixel))
+            {
+                args.m_failed = true;
+                break;
+            }
+
+            if (!sameFormat)
+            {
+                convertPixels(dst, args.m_dstFormat, src, args.m_srcFormat, count, rgba32f, false);
+            }
+        }
+
+        freeScratch(chunk);
     }
 
-    bool imageIsCubeCross(Image& _image)
+    /// Reads _numPixels pixels stored in _srcFormat and converts them to _dstFormat chunk by chunk,
+    /// so the file data is never held in memory in both formats.
+    /// Data of at least CMFT_LOAD_PARALLEL_READ_MIN_SIZE bytes is read with Reader::readAt() by several threads when the stream supports it.
+    static void readConvertedPixels(void* _dst, TextureFormat::Enum _dstFormat, Reader* _stream, TextureFormat::Enum _srcFormat, uint64_t _numPixels)
     {
-        // Check face count.
-        if (1 != _image.m_numFaces)
+        CMFT_UNUSED size_t read;
+
+        const uint8_t srcBytesPerPixel = getImageDataInfo(_srcFormat).m_bytesPerPixel;
+        const uint8_t dstBytesPerPixel = getImageDataInfo(_dstFormat).m_bytesPerPixel;
+
+        // Large data is read in chunks at computed offsets, several threads read and convert at once.
+        const uint64_t srcSize = _numPixels*srcBytesPerPixel;
+        const int64_t offset = (srcSize >= uint64_t(CMFT_LOAD_PARALLEL_READ_MIN_SIZE) && _stream->canReadAt()) ? ioTell(_stream) : -1;
+        if (0 <= offset)
+        {
+            ReadConvertedArgs args;
+            args.m_stream = _stream;
+            args.m_offset = uint64_t(offset);
+            args.m_numPixels = _numPixels;
+            args.m_chunkPixels = max(UINT32_C(1), uint32_t(CMFT_LOAD_PARALLEL_READ_CHUNK_SIZE)/srcBytesPerPixel);
+            args.m_srcFormat = _srcFormat;
+            args.m_dstFormat = _dstFormat;
+            args.m_dst = (uint8_t*)_dst;
+            args.m_failed = false;
+
+            const uint64_t numChunks = (_numPixels + args.m_chunkPixels-1)/args.m_chunkPixels;
+            parallelFor(readConvertedChunks, (void*)&args, uint32_t(numChunks), 1);
+            DEBUG_CHECK(!args.m_failed, "Could not read from file.");
+
+            // Leave the stream after the data, as sequential reads would.
+            ioSeek(_stream, offset + int64_t(srcSize), SEEK_SET);
+            return;
+        }
+
+        // Same format, read directly.
+        if (_srcFormat == _dstFormat)
         {
-            return false;
+            read = ioRead(_dst, 1, _numPixels*srcBytesPerPixel, _stream);
+            DEBUG_CHECK(read == _numPixels*srcBytesPerPixel, "Could not read from file.");
+            IOERROR_CHECK(_stream);
+            return;
         }
 
-        // Check aspect.
-        const float aspect = (float)(int32_t)_image.m_width/(float)(int32_t)_image.m_height;
-        const bool isVertical   = (aspect - 3.0f/4.0f) < 0.0001f;
-        const bool isHorizontal = (aspect - 4.0f/3.0f) < 0.0001f;
+        // Rgba32f chunk goes first to keep it aligned.
+        const uint32_t chunkPixels = uint32_t(min(_numPixels, uint64_t(CMFT_LOAD_CONVERT_CHUNK_PIXELS)));
+        const bool viaRgba32f = (TextureFormat::RGBA32F != _srcFormat && TextureFormat::RGBA32F != _dstFormat);
+        const size_t rgba32fSize = viaRgba32f ? size_t(chunkPixels)*4*sizeof(float) : 0;
+        uint8_t* chunk = (uint8_t*)allocScratch(rgba32fSize + size_t(chunkPixels)*srcBytesPerPixel, AllocTag::Conversion);
+        MALLOC_CHECK(chunk);
+        float* rgba32f = viaRgba32f ? (float*)chunk : NULL;
+        uint8_t* src = chunk + rgba32fSize;
 
-        if (!isVertical && !isHorizontal)
+        uint8_t* dst = (uint8_t*)_dst;
+        for (uint64_t pixel = 0; pixel < _numPixels; pixel += chunkPixels)
         {
-            return false;
+            const uint32_t count = uint32_t(min(_numPixels-pixel, uint64_t(chunkPixels)));
+            const size_t size = size_t(count)*srcBytesPerPixel;
+
+            read = ioRead(src, 1, size, _stream);
+            DEBUG_CHECK(read == size, "Could not read from file.");
+            IOERROR_CHECK(_stream);
+
+            convertPixels(dst, _dstFormat, src, _srcFormat, count, rgba32f);
+            dst += size_t(count)*dstBytesPerPixel;
         }
 
-        // Define key points.
+        freeScratch(chunk);
+    }
+
+    void imageGetPixel(void* _out, TextureFormat::Enum _format, uint32_t _x, uint32_t _y, uint8_t _mip, uint8_t _face, const Image& _image)
+    {
+        // Input check.
+        DEBUG_CHECK(_x < _image.m_width,       "Invalid input parameters. X coord bigger than image width.");
+        DEBUG_CHECK(_y < _image.m_height,      "Invalid input parameters. Y coord bigger than image height.");
+        DEBUG_CHECK(_face < _image.m_numFaces, "Invalid input parameters. Requesting pixel from non-existing face.");
+        DEBUG_CHECK(_mip < _image.m_numMips,   "Invalid input parameters. Requesting pixel from non-existing mip level.");
+
         const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
-        const uint32_t imagePitch = _image.m_width * bytesPerPixel;
+        const uint32_t pitch = max(UINT32_C(1), _image.m_width >> _mip) * bytesPerPixel;
 
-        const uint32_t faceSize = alignf((float)(int32_t)_image.m_width / (isVertical ? 3.0f : 4.0f), bytesPerPixel);
-        const uint32_t facePitch = faceSize * bytesPerPixel;
-        const uint32_t rowDataSize = imagePitch * faceSize;
+        // Get face and mip offset.
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, _image);
+        const uint64_t offset = offsets[_face][_mip];
 
-        const uint32_t halfFacePitch   = alignf((float)(int32_t)facePitch   / 2.0f, bytesPerPixel);
-        const uint32_t halfRowDataSize = alignf((float)(int32_t)rowDataSize / 2.0f, bytesPerPixel);
+        const void* src = (const void*)((const uint8_t*)_image.m_data + offset + _y*pitch + _x*bytesPerPixel);
 
-        uint32_t keyPointsOffsets[6];
-        if (isVertical)
+        // Output.
+        if (_image.m_format == _format)
         {
-            //   ___ ___ ___
-            //  |   |   |   | -> rowDataSize
-            //  |___|___|___|
-            //
-            //   ___  -> facePitch
-            //
-            //   . -> keyPoint
-            //       ___
-            //    . |Y+ | .
-            //   ___|___|___
-            //  |X- |Z+ |X+ |
-            //  |___|___|___|
-            //    . |Y- | .
-            //      |___|
-            //    . |Z- | .
-            //      |___|
-            //
-            const uint32_t leftCenter  = halfRowDataSize + halfFacePitch;
-            const uint32_t rightCenter = halfRowDataSize + 5*halfFacePitch;
-            const uint32_t firstRow  = 0;
-            const uint32_t thirdRow  = 2*rowDataSize;
-            const uint32_t fourthRow = 3*rowDataSize;
-            keyPointsOffsets[0] =  leftCenter + firstRow;  //+x
-            keyPointsOffsets[1] = rightCenter + firstRow;  //-x
-            keyPointsOffsets[2] =  leftCenter + thirdRow;  //+y
-            keyPointsOffsets[3] = rightCenter + thirdRow;  //-y
-            keyPointsOffsets[4] =  leftCenter + fourthRow; //+z
-            keyPointsOffsets[5] = rightCenter + fourthRow; //-z
+            // Image is already in requested format, just copy data.
+            memcpy(_out, src, bytesPerPixel);
+        }
+        else if (_image.m_format == TextureFormat::RGBA32F)
+        {
+            // Image is in rgba32f format. Transform to output format.
+            fromRgba32f(_out, _format, (const float*)src);
         }
         else
         {
-            //       ___
-            //    . |+Y | .   .
-            //   ___|___|___ ___
-            //  |-X |+Z |+X |-Z |
-            //  |___|___|___|___|
-            //    . |-Y | .   .
-            //      |___|
-            //
-            const uint32_t center0 = halfRowDataSize + halfFacePitch;
-            const uint32_t center1 = halfRowDataSize + 5*halfFacePitch;
-            const uint32_t center2 = halfRowDataSize + 7*halfFacePitch;
-            const uint32_t firstRow = 0;
-            const uint32_t thirdRow = 2*rowDataSize;
-            keyPointsOffsets[0] = firstRow + center0; //+x
-            keyPointsOffsets[1] = firstRow + center1; //-x
-            keyPointsOffsets[2] = firstRow + center2; //+y
-            keyPointsOffsets[3] = thirdRow + center0; //-y
-            keyPointsOffsets[4] = thirdRow + center1; //+z
-            keyPointsOffsets[5] = thirdRow + center2; //-z
+            // Image is in some other format.
+            // Transform to rgba32f and then back to requested output format.
+            float buf[4];
+            toRgba32f(buf, _image.m_format, src);
+            fromRgba32f(_out, _format, buf);
         }
+    }
 
-        // Check key points.
-        bool result = true;
-        switch(_image.m_format)
+    // Cubemap sampler.
+    //-----
+
+    // Minimum number of directions per cubemapSamplerSampleN() task.
+    #define CMFT_SAMPLER_MIN_SAMPLES 1024
+
+    bool cubemapSamplerInit(CubemapSampler& _sampler, const Image& _cubemap)
+    {
+        if (!imageIsCubemap(_cubemap))
         {
-        case TextureFormat::BGR8:
-        case TextureFormat::RGB8:
-        case TextureFormat::BGRA8:
-        case TextureFormat::RGBA8:
+            WARN("Image is not cubemap.");
+            return false;
+        }
+
+        _sampler.m_isRef = imageRefOrConvert(_sampler.m_rgba32f, TextureFormat::RGBA32F, _cubemap);
+        _sampler.m_faceSize = _cubemap.m_width;
+        _sampler.m_numMips = _cubemap.m_numMips;
+
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, _sampler.m_rgba32f);
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t mip = 0; mip < _sampler.m_numMips; ++mip)
             {
-                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                _sampler.m_faces[face][mip] = (const float*)((const uint8_t*)_sampler.m_rgba32f.m_data + offsets[face][mip]);
+            }
+        }
+
+        return true;
+    }
+
+    void cubemapSamplerFree(CubemapSampler& _sampler)
+    {
+        if (!_sampler.m_isRef)
+        {
+            imageUnload(_sampler.m_rgba32f);
+        }
+        _sampler.m_rgba32f.m_data = NULL;
+    }
+
+    /// Texel (_x,_y) of a face, texels outside of the face are read from the neighbour face across the edge.
+    static const float* samplerTexelSeamless(const CubemapSampler& _sampler, uint8_t _face, uint8_t _mip, int32_t _x, int32_t _y)
+    {
+        const int32_t faceSize = int32_t(max(UINT32_C(1), _sampler.m_faceSize >> _mip));
+        if (_x < 0 || _x >= faceSize || _y < 0 || _y >= faceSize)
+        {
+            // Direction through the texel center, just past the edge.
+            const float invFaceSize = 1.0f/float(faceSize);
+            const float uu = 2.0f*(float(_x)+0.5f)*invFaceSize - 1.0f;
+            const float vv = 2.0f*(float(_y)+0.5f)*invFaceSize - 1.0f;
+
+            float tmp0[3];
+            float tmp1[3];
+            float tmp2[3];
+            float vec[3];
+            vec3Mul(tmp0, s_faceUvVectors[_face][0], uu);
+            vec3Mul(tmp1, s_faceUvVectors[_face][1], vv);
+            vec3Add(tmp2, tmp0, tmp1);
+            vec3Add(vec, tmp2, s_faceUvVectors[_face][2]);
+
+            float faceU;
+            float faceV;
+            vecToTexelCoord(faceU, faceV, _face, vec);
+            _x = clamp(int32_t(faceU*float(faceSize)), int32_t(0), faceSize-1);
+            _y = clamp(int32_t(faceV*float(faceSize)), int32_t(0), faceSize-1);
+        }
+
+        return _sampler.m_faces[_face][_mip] + (size_t(_y)*faceSize + _x)*4;
+    }
+
+    static inline void samplerBilinear(float _rgba[4], const CubemapSampler& _sampler, uint8_t _face, uint8_t _mip, float _u, float _v, bool _seamless)
+    {
+        const uint32_t faceSize = max(UINT32_C(1), _sampler.m_faceSize >> _mip);
+        const float* c00;
+        const float* c01;
+        const float* c10;
+        const float* c11;
+        float tx;
+        float ty;
+
+        if (_seamless)
+        {
+            const float xx = _u*float(int32_t(faceSize)) - 0.5f;
+            const float yy = _v*float(int32_t(faceSize)) - 0.5f;
+            const int32_t x0 = int32_t(floorf(xx));
+            const int32_t y0 = int32_t(floorf(yy));
+            tx = xx - float(x0);
+            ty = yy - float(y0);
+
+            c00 = samplerTexelSeamless(_sampler, _face, _mip, x0,   y0  );
+            c01 = samplerTexelSeamless(_sampler, _face, _mip, x0+1, y0  );
+            c10 = samplerTexelSeamless(_sampler, _face, _mip, x0,   y0+1);
+            c11 = samplerTexelSeamless(_sampler, _face, _mip, x0+1, y0+1);
+        }
+        else
+        {
+            // Face edges are clamped.
+            const float faceSizeMinusOne = float(int32_t(faceSize-1));
+            const float xx = clamp(_u*float(int32_t(faceSize)) - 0.5f, 0.0f, faceSizeMinusOne);
+            const float yy = clamp(_v*float(int32_t(faceSize)) - 0.5f, 0.0f, faceSizeMinusOne);
+            const uint32_t x0 = uint32_t(xx);
+            const uint32_t y0 = uint32_t(yy);
+            const uint32_t x1 = min(x0+1, faceSize-1);
+            const uint32_t y1 = min(y0+1, faceSize-1);
+            tx = xx - float(int32_t(x0));
+            ty = yy - float(int32_t(y0));
+
+            const float* faceData = _sampler.m_faces[_face][_mip];
+            c00 = faceData + (size_t(y0)*faceSize + x0)*4;
+            c01 = faceData + (size_t(y0)*faceSize + x1)*4;
+            c10 = faceData + (size_t(y1)*faceSize + x0)*4;
+            c11 = faceData + (size_t(y1)*faceSize + x1)*4;
+        }
+
+        for (uint8_t ii = 0; ii < 4; ++ii)
+        {
+            const float top    = c00[ii] + (c01[ii]-c00[ii])*tx;
+            const float bottom = c10[ii] + (c11[ii]-c10[ii])*tx;
+            _rgba[ii] = top + (bottom-top)*ty;
+        }
+    }
+
+    // Not inlined, so batched and single lookups return the same bits.
+    static BX_NO_INLINE void samplerSample(float _rgba[4], const CubemapSampler& _sampler, const float _dir[3], float _lod, SamplerFilter::Enum _filter)
+    {
+        float uu;
+        float vv;
+        uint8_t face;
+        vecToTexelCoord(uu, vv, face, _dir);
+
+        const float lod = clamp(_lod, 0.0f, float(_sampler.m_numMips-1));
+
+        if (SamplerFilter::Nearest == _filter)
+        {
+            const uint8_t mip = uint8_t(lod + 0.5f);
+            const uint32_t faceSize = max(UINT32_C(1), _sampler.m_faceSize >> mip);
+            const uint32_t xx = min(uint32_t(uu*float(int32_t(faceSize))), faceSize-1);
+            const uint32_t yy = min(uint32_t(vv*float(int32_t(faceSize))), faceSize-1);
+            memcpy(_rgba, _sampler.m_faces[face][mip] + (size_t(yy)*faceSize + xx)*4, 4*sizeof(float));
+            return;
+        }
+
+        const bool seamless = (SamplerFilter::Seamless == _filter);
+        const uint8_t mip0 = uint8_t(lod);
+        const float frac = lod - float(mip0);
+
+        samplerBilinear(_rgba, _sampler, face, mip0, uu, vv, seamless);
+
+        // Trilinear.
+        if (0.0f != frac && mip0+1 < _sampler.m_numMips)
+        {
+            float rgba1[4];
+            samplerBilinear(rgba1, _sampler, face, mip0+1, uu, vv, seamless);
+            _rgba[0] += (rgba1[0]-_rgba[0])*frac;
+            _rgba[1] += (rgba1[1]-_rgba[1])*frac;
+            _rgba[2] += (rgba1[2]-_rgba[2])*frac;
+            _rgba[3] += (rgba1[3]-_rgba[3])*frac;
+        }
+    }
+
+    void cubemapSamplerSample(float _rgba[4], const CubemapSampler& _sampler, const float _dir[3], float _lod, SamplerFilter::Enum _filter)
+    {
+        samplerSample(_rgba, _sampler, _dir, _lod, _filter);
+    }
+
+    struct SamplerSampleArgs
+    {
+        float* m_rgba;
+        const CubemapSampler* m_sampler;
+        const float* m_dirs;
+        const float* m_lods;
+        SamplerFilter::Enum m_filter;
+    };
+
+    static void samplerSampleRange(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const SamplerSampleArgs* args = (const SamplerSampleArgs*)_userData;
+
+        for (uint32_t ii = _begin; ii < _end; ++ii)
+        {
+            const float lod = (NULL != args->m_lods) ? args->m_lods[ii] : 0.0f;
+            samplerSample(&args->m_rgba[size_t(ii)*4], *args->m_sampler, &args->m_dirs[size_t(ii)*3], lod, args->m_filter);
+        }
+    }
+
+    void cubemapSamplerSampleN(float* _rgba, const CubemapSampler& _sampler, const float* _dirs, const float* _lods, uint32_t _num, SamplerFilter::Enum _filter)
+    {
+        SamplerSampleArgs args;
+        args.m_rgba = _rgba;
+        args.m_sampler = &_sampler;
+        args.m_dirs = _dirs;
+        args.m_lods = _lods;
+        args.m_filter = _filter;
+        parallelFor(samplerSampleRange, (void*)&args, _num, CMFT_SAMPLER_MIN_SAMPLES);
+    }
+
+    // Resampling kernels.
+    //-----
+
+    static inline double resampleSinc(double _x)
+    {
+        if (_x < 1e-8)
+        {
+            return 1.0;
+        }
+
+        const double xx = _x*M_PI;
+        return sin(xx)/xx;
+    }
+
+    // Power series of the zero order modified Bessel function of the first kind.
+    static double resampleBessel0(double _x)
+    {
+        const double xx = _x*_x*0.25;
+
+        double sum = 1.0;
+        double term = 1.0;
+        for (uint32_t ii = 1; ii < 64 && term > sum*1e-12; ++ii)
+        {
+            term *= xx/(double(ii)*double(ii));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    static double resampleBox(double _x)
+    {
+        return (-0.5 <= _x && _x < 0.5) ? 1.0 : 0.0;
+    }
+
+    static double resampleTriangle(double _x)
+    {
+        const double ax = fabs(_x);
+        return (ax < 1.0) ? 1.0-ax : 0.0;
+    }
+
+    static double resampleLanczos(double _x)
+    {
+        const double ax = fabs(_x);
+        return (ax < 3.0) ? resampleSinc(ax)*resampleSinc(ax/3.0) : 0.0;
+    }
+
+    // Kaiser windowed sinc, width = 3, alpha = 4.
+    static double resampleKaiser(double _x)
+    {
+        const double ax = fabs(_x);
+        if (ax >= 3.0)
+        {
+            return 0.0;
+        }
+
+        const double alpha = 4.0;
+        const double tt = ax/3.0;
+        return resampleSinc(ax)*resampleBessel0(alpha*sqrt(1.0-tt*tt))/resampleBessel0(alpha);
+    }
+
+    struct ResampleKernel
+    {
+        double (*m_fn)(double _x);
+        double m_radius;
+    };
+
+    static const ResampleKernel s_resampleKernels[ResampleFilter::Count] =
+    {
+        { resampleBox,      0.5 },
+        { resampleTriangle, 1.0 },
+        { resampleLanczos,  3.0 },
+        { resampleKaiser,   3.0 },
+    };
+
+    /// Source texels and weights contributing to each destination texel along one axis.
+    /// Texels outside of the source are clamped to the edge.
+    struct ResampleAxis
+    {
+        uint32_t* m_first;
+        uint32_t* m_count;
+        float* m_weights; // m_taps weights per destination texel.
+        uint32_t m_taps;
+    };
+
+    static void resampleAxisInit(ResampleAxis& _axis, uint32_t _srcSize, uint32_t _dstSize, ResampleFilter::Enum _filter)
+    {
+        const ResampleKernel& kernel = s_resampleKernels[_filter];
+
+        // Kernel is widened when downsampling.
+        const double scale = double(_srcSize)/double(_dstSize);
+        const double filterScale = max(1.0, scale);
+        const double support = kernel.m_radius*filterScale;
+
+        const uint32_t taps = min(uint32_t(ceil(support*2.0))+2, _srcSize);
+
+        void* mem = malloc(_dstSize*(2*sizeof(uint32_t) + taps*sizeof(float)));
+        MALLOC_CHECK(mem);
+        _axis.m_first   = (uint32_t*)mem;
+        _axis.m_count   = _axis.m_first + _dstSize;
+        _axis.m_weights = (float*)(_axis.m_count + _dstSize);
+        _axis.m_taps = taps;
+
+        double* weights = (double*)malloc(taps*sizeof(double));
+        MALLOC_CHECK(weights);
+
+        for (uint32_t ii = 0; ii < _dstSize; ++ii)
+        {
+            const double center = (double(ii)+0.5)*scale;
+            const int32_t left  = int32_t(floor(center - support));
+            const int32_t right = int32_t(ceil(center + support));
+            const int32_t first = max(left, 0);
+            const int32_t last  = min(right, int32_t(_srcSize-1));
+            const uint32_t count = uint32_t(last-first+1);
+            DEBUG_CHECK(count <= taps, "Resample window overflow.");
+
+            memset(weights, 0, count*sizeof(double));
+            double sum = 0.0;
+            for (int32_t jj = left; jj <= right; ++jj)
+            {
+                const double weight = kernel.m_fn((double(jj)+0.5-center)/filterScale);
+                weights[clamp(jj, first, last)-first] += weight;
+                sum += weight;
+            }
+
+            float* dst = _axis.m_weights + ii*taps;
+            if (0.0 == sum)
+            {
+                // Kernel missed all texels, take the nearest one.
+                memset(dst, 0, count*sizeof(float));
+                dst[clamp(int32_t(center), first, last)-first] = 1.0f;
+            }
+            else
+            {
+                const double invSum = 1.0/sum;
+                for (uint32_t jj = 0; jj < count; ++jj)
                 {
-                    const uint8_t* point = (const uint8_t*)_image.m_data + keyPointsOffsets[key];
-                    const bool tap0 = point[0] < 2;
-                    const bool tap1 = point[1] < 2;
-                    const bool tap2 = point[2] < 2;
-                    result &= (tap0 & tap1 & tap2);
+                    dst[jj] = float(weights[jj]*invSum);
                 }
             }
-        break;
 
-        case TextureFormat::RGB16:
-        case TextureFormat::RGBA16:
+            _axis.m_first[ii] = uint32_t(first);
+            _axis.m_count[ii] = count;
+        }
+
+        free(weights);
+    }
+
+    static void resampleAxisFree(ResampleAxis& _axis)
+    {
+        free(_axis.m_first);
+    }
+
+    struct ResizeFaceArgs
+    {
+        const ResampleAxis* m_axisX;
+        const ResampleAxis* m_axisY;
+        const float* m_src;
+        float* m_tmp;
+        float* m_dst;
+        uint32_t m_srcWidth;
+        uint32_t m_dstWidth;
+    };
+
+    // Horizontal pass, source rows into m_tmp (dstWidth x srcHeight).
+    static void resizeRowsX(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ResizeFaceArgs* args = (const ResizeFaceArgs*)_userData;
+        const ResampleAxis& axis = *args->m_axisX;
+
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            const float* srcRow = args->m_src + size_t(yy)*args->m_srcWidth*4;
+            float* tmpRow = args->m_tmp + size_t(yy)*args->m_dstWidth*4;
+
+            for (uint32_t xx = 0; xx < args->m_dstWidth; ++xx)
             {
-                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                const float* src = srcRow + axis.m_first[xx]*4;
+                const float* weights = axis.m_weights + xx*axis.m_taps;
+
+                float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (uint32_t tap = 0, end = axis.m_count[xx]; tap < end; ++tap, src += 4)
                 {
-                    const uint16_t* point = (const uint16_t*)((const uint8_t*)_image.m_data + keyPointsOffsets[key]);
-                    const bool tap0 = point[0] < 2;
-                    const bool tap1 = point[1] < 2;
-                    const bool tap2 = point[2] < 2;
-                    result &= (tap0 & tap1 & tap2);
+                    const float weight = weights[tap];
+                    color[0] += src[0]*weight;
+                    color[1] += src[1]*weight;
+                    color[2] += src[2]*weight;
+                    color[3] += src[3]*weight;
                 }
+
+                float* dst = tmpRow + xx*4;
+                dst[0] = color[0];
+                dst[1] = color[1];
+                dst[2] = color[2];
+                dst[3] = color[3];
             }
-        break;
+        }
+    }
 
-        case TextureFormat::RGB16F:
-        case TextureFormat::RGBA16F:
+    // Vertical pass, m_tmp rows into destination rows.
+    static void resizeRowsY(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ResizeFaceArgs* args = (const ResizeFaceArgs*)_userData;
+        const ResampleAxis& axis = *args->m_axisY;
+        const uint32_t rowFloats = args->m_dstWidth*4;
+
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            float* dstRow = args->m_dst + size_t(yy)*rowFloats;
+            memset(dstRow, 0, rowFloats*sizeof(float));
+
+            const float* weights = axis.m_weights + yy*axis.m_taps;
+            const float* tmpRow = args->m_tmp + size_t(axis.m_first[yy])*rowFloats;
+            for (uint32_t tap = 0, end = axis.m_count[yy]; tap < end; ++tap, tmpRow += rowFloats)
             {
-                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                const float weight = weights[tap];
+                for (uint32_t ii = 0; ii < rowFloats; ++ii)
                 {
-                    const uint16_t* point = (const uint16_t*)((const uint8_t*)_image.m_data + keyPointsOffsets[key]);
-                    const bool tap0 = bx::halfToFloat(point[0]) < 0.01f;
-                    const bool tap1 = bx::halfToFloat(point[1]) < 0.01f;
-                    const bool tap2 = bx::halfToFloat(point[2]) < 0.01f;
-                    result &= (tap0 & tap1 & tap2);
+                    dstRow[ii] += tmpRow[ii]*weight;
                 }
             }
-        break;
+        }
+    }
+
+    static uint8_t mipChainLength(uint32_t _width, uint32_t _height)
+    {
+        uint8_t numMips = 1;
+        for (uint32_t size = max(_width, _height); size > 1; size >>= 1)
+        {
+            numMips++;
+        }
+
+        return min(numMips, uint8_t(MAX_MIP_NUM));
+    }
+
+    void imageResize(Image& _dst, uint32_t _width, uint32_t _height, const Image& _src, ResampleFilter::Enum _filter, ResizeMips::Enum _mips)
+    {
+        CMFT_PROFILE_ZONE("imageResize");
+
+        // Operation is done in rgba32f format.
+        Image imageRgba32f;
+        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+
+        // Fill image structure.
+        Image result;
+        result.m_width = _width;
+        result.m_height = _height;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = (ResizeMips::Keep == _mips) ? min(imageRgba32f.m_numMips, mipChainLength(_width, _height)) : 1;
+        result.m_numFaces = imageRgba32f.m_numFaces;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        uint64_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(dstOffsets, result);
+        result.m_dataSize = imageGetNumPixels(result)*bytesPerPixel;
+
+        // Alloc dst data.
+        result.m_data = getAllocator()->alloc(result.m_dataSize);
+        MALLOC_CHECK(result.m_data);
+
+        // Get source offsets.
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, imageRgba32f);
+
+        // Intermediate buffer for the horizontal pass, sized for the base mip.
+        float* tmp = (float*)getAllocator()->alloc(size_t(_width)*imageRgba32f.m_height*bytesPerPixel);
+        MALLOC_CHECK(tmp);
+
+        // Resize each mip of each face. Rows are processed in parallel.
+        for (uint8_t mip = 0; mip < result.m_numMips; ++mip)
+        {
+            const uint32_t srcWidth  = max(UINT32_C(1), imageRgba32f.m_width  >> mip);
+            const uint32_t srcHeight = max(UINT32_C(1), imageRgba32f.m_height >> mip);
+            const uint32_t dstWidth  = max(UINT32_C(1), _width  >> mip);
+            const uint32_t dstHeight = max(UINT32_C(1), _height >> mip);
+
+            ResampleAxis axisX;
+            ResampleAxis axisY;
+            resampleAxisInit(axisX, srcWidth,  dstWidth,  _filter);
+            resampleAxisInit(axisY, srcHeight, dstHeight, _filter);
+
+            for (uint8_t face = 0; face < result.m_numFaces; ++face)
+            {
+                ResizeFaceArgs args;
+                args.m_axisX = &axisX;
+                args.m_axisY = &axisY;
+                args.m_src = (const float*)((const uint8_t*)imageRgba32f.m_data + srcOffsets[face][mip]);
+                args.m_tmp = tmp;
+                args.m_dst = (float*)((uint8_t*)result.m_data + dstOffsets[face][mip]);
+                args.m_srcWidth = srcWidth;
+                args.m_dstWidth = dstWidth;
+
+                parallelFor(resizeRowsX, (void*)&args, srcHeight, CMFT_RESIZE_MIN_ROWS);
+                parallelFor(resizeRowsY, (void*)&args, dstHeight, CMFT_RESIZE_MIN_ROWS);
+            }
+
+            resampleAxisFree(axisX);
+            resampleAxisFree(axisY);
+        }
+
+        getAllocator()->free(tmp);
+
+        // Cleanup.
+        if (!imageIsRef)
+        {
+            imageUnload(imageRgba32f);
+        }
+
+        if (ResizeMips::Regenerate == _mips)
+        {
+            imageGenerateMipMapChain(result);
+        }
+
+        // Convert result to source format.
+        if (TextureFormat::RGBA32F == _src.m_format)
+        {
+            imageMove(_dst, result);
+        }
+        else
+        {
+            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
+            imageUnload(result);
+        }
+    }
+
+    void imageResize(Image& _image, uint32_t _width, uint32_t _height, ResampleFilter::Enum _filter, ResizeMips::Enum _mips)
+    {
+        Image tmp;
+        imageResize(tmp, _width, _height, _image, _filter, _mips);
+        imageMove(_image, tmp);
+    }
+
+    // Face transforms.
+    //-----
+
+    // Destination texel (x,y) is read from source texel at swapped (y,x) coordinates, then mirrored.
+#define CMFT_TRANSFORM_SWAP     0x1
+#define CMFT_TRANSFORM_MIRROR_X 0x2
+#define CMFT_TRANSFORM_MIRROR_Y 0x4
+
+    /// Transform that applies _first and then _second.
+    static uint8_t transformCompose(uint8_t _first, uint8_t _second)
+    {
+        const bool firstSwap = 0 != (_first&CMFT_TRANSFORM_SWAP);
+        const uint8_t secondMirrorX = (_second&CMFT_TRANSFORM_MIRROR_X) ? CMFT_TRANSFORM_MIRROR_X : 0;
+        const uint8_t secondMirrorY = (_second&CMFT_TRANSFORM_MIRROR_Y) ? CMFT_TRANSFORM_MIRROR_Y : 0;
+
+        // Mirrors of the second transform are seen in swapped coordinates of the first one.
+        const uint8_t secondMirror = firstSwap
+                                   ? uint8_t((secondMirrorX ? CMFT_TRANSFORM_MIRROR_Y : 0) | (secondMirrorY ? CMFT_TRANSFORM_MIRROR_X : 0))
+                                   : uint8_t(secondMirrorX | secondMirrorY)
+                                   ;
+
+        return uint8_t((_first ^ _second) & CMFT_TRANSFORM_SWAP) | uint8_t((_first ^ secondMirror) & (CMFT_TRANSFORM_MIRROR_X|CMFT_TRANSFORM_MIRROR_Y));
+    }
+
+    template <uint32_t BytesPerPixel>
+    static inline void transformCopyTexel(uint8_t* _dst, const uint8_t* _src, uint32_t _bytesPerPixel)
+    {
+        memcpy(_dst, _src, (0 == BytesPerPixel) ? _bytesPerPixel : BytesPerPixel);
+    }
+
+#if CMFT_CONVERT_SIMD
+    /// Writes 4x4 block of 4-byte texels at _dst from swapped source rows. Source rows are reversed when mirrored.
+    static inline void transformBlock4x4(uint8_t* _dst, size_t _dstPitch, const uint8_t* const _srcRows[4], bool _reverse)
+    {
+        __m128 row0 = _mm_loadu_ps((const float*)_srcRows[0]);
+        __m128 row1 = _mm_loadu_ps((const float*)_srcRows[1]);
+        __m128 row2 = _mm_loadu_ps((const float*)_srcRows[2]);
+        __m128 row3 = _mm_loadu_ps((const float*)_srcRows[3]);
+
+        if (_reverse)
+        {
+            row0 = _mm_shuffle_ps(row0, row0, _MM_SHUFFLE(0, 1, 2, 3));
+            row1 = _mm_shuffle_ps(row1, row1, _MM_SHUFFLE(0, 1, 2, 3));
+            row2 = _mm_shuffle_ps(row2, row2, _MM_SHUFFLE(0, 1, 2, 3));
+            row3 = _mm_shuffle_ps(row3, row3, _MM_SHUFFLE(0, 1, 2, 3));
+        }
+
+        // Texels are only moved, bits go through unchanged.
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+        _mm_storeu_ps((float*)(_dst            ), row0);
+        _mm_storeu_ps((float*)(_dst+_dstPitch  ), row1);
+        _mm_storeu_ps((float*)(_dst+_dstPitch*2), row2);
+        _mm_storeu_ps((float*)(_dst+_dstPitch*3), row3);
+    }
+#endif // CMFT_CONVERT_SIMD
+
+    /// Writes destination rows [_begin, _end) of a transformed face. BytesPerPixel 0 uses _bytesPerPixel.
+    template <uint32_t BytesPerPixel>
+    static void transformRows(uint8_t* _dst, const uint8_t* _src, uint32_t _width, uint32_t _height, uint32_t _bytesPerPixel, uint8_t _transform, uint32_t _begin, uint32_t _end)
+    {
+        const uint32_t bytesPerPixel = (0 == BytesPerPixel) ? _bytesPerPixel : BytesPerPixel;
+        const size_t pitch = size_t(_width)*bytesPerPixel;
+        const bool mirrorX = 0 != (_transform&CMFT_TRANSFORM_MIRROR_X);
+        const bool mirrorY = 0 != (_transform&CMFT_TRANSFORM_MIRROR_Y);
+
+        if (0 == (_transform&CMFT_TRANSFORM_SWAP))
+        {
+            for (uint32_t yy = _begin; yy < _end; ++yy)
+            {
+                uint8_t* dstRow = _dst + yy*pitch;
+                const uint8_t* srcRow = _src + (mirrorY ? _height-1-yy : yy)*pitch;
+
+                if (!mirrorX)
+                {
+                    memcpy(dstRow, srcRow, pitch);
+                    continue;
+                }
+
+                uint32_t xx = 0;
+            #if CMFT_CONVERT_SIMD
+                if (4 == BytesPerPixel)
+                {
+                    for (; xx+4 <= _width; xx += 4)
+                    {
+                        const __m128 texels = _mm_loadu_ps((const float*)(srcRow + (_width-4-xx)*4));
+                        _mm_storeu_ps((float*)(dstRow + xx*4), _mm_shuffle_ps(texels, texels, _MM_SHUFFLE(0, 1, 2, 3)));
+                    }
+                }
+            #endif // CMFT_CONVERT_SIMD
+                for (; xx < _width; ++xx)
+                {
+                    transformCopyTexel<BytesPerPixel>(dstRow + xx*bytesPerPixel, srcRow + (_width-1-xx)*bytesPerPixel, bytesPerPixel);
+                }
+            }
+
+            return;
+        }
+
+        // Swapped coordinates, face is square. Tiles keep the source columns in cache.
+        for (uint32_t tileX = 0; tileX < _width; tileX += CMFT_TRANSFORM_TILE_SIZE)
+        {
+            const uint32_t tileEnd = min(_width, tileX+CMFT_TRANSFORM_TILE_SIZE);
+
+            uint32_t yy = _begin;
+        #if CMFT_CONVERT_SIMD
+            if (4 == BytesPerPixel)
+            {
+                for (; yy+4 <= _end; yy += 4)
+                {
+                    const uint32_t srcX = mirrorX ? _width-4-yy : yy;
+
+                    uint32_t xx = tileX;
+                    for (; xx+4 <= tileEnd; xx += 4)
+                    {
+                        const uint8_t* srcRows[4];
+                        for (uint32_t ii = 0; ii < 4; ++ii)
+                        {
+                            const uint32_t srcY = mirrorY ? _height-1-(xx+ii) : xx+ii;
+                            srcRows[ii] = _src + srcY*pitch + srcX*4;
+                        }
+
+                        transformBlock4x4(_dst + yy*pitch + xx*4, pitch, srcRows, mirrorX);
+                    }
+
+                    for (uint32_t row = yy; row < yy+4; ++row)
+                    {
+                        const uint32_t texelX = mirrorX ? _width-1-row : row;
+                        for (uint32_t col = xx; col < tileEnd; ++col)
+                        {
+                            const uint32_t srcY = mirrorY ? _height-1-col : col;
+                            transformCopyTexel<BytesPerPixel>(_dst + row*pitch + col*4, _src + srcY*pitch + texelX*4, bytesPerPixel);
+                        }
+                    }
+                }
+            }
+        #endif // CMFT_CONVERT_SIMD
+
+            for (; yy < _end; ++yy)
+            {
+                uint8_t* dstRow = _dst + yy*pitch;
+                const uint8_t* srcColumn = _src + (mirrorX ? _width-1-yy : yy)*bytesPerPixel;
+                for (uint32_t xx = tileX; xx < tileEnd; ++xx)
+                {
+                    const uint32_t srcY = mirrorY ? _height-1-xx : xx;
+                    transformCopyTexel<BytesPerPixel>(dstRow + xx*bytesPerPixel, srcColumn + srcY*pitch, bytesPerPixel);
+                }
+            }
+        }
+    }
+
+    typedef void (*TransformRowsFn)(uint8_t* _dst, const uint8_t* _src, uint32_t _width, uint32_t _height, uint32_t _bytesPerPixel, uint8_t _transform, uint32_t _begin, uint32_t _end);
+
+    static TransformRowsFn transformRowsFn(uint32_t _bytesPerPixel)
+    {
+        switch (_bytesPerPixel)
+        {
+        case  3: return transformRows<3>;
+        case  4: return transformRows<4>;
+        case  6: return transformRows<6>;
+        case  8: return transformRows<8>;
+        case 12: return transformRows<12>;
+        case 16: return transformRows<16>;
+        default: return transformRows<0>;
+        }
+    }
+
+    struct TransformFacesArgs
+    {
+        TransformRowsFn m_fn;
+        uint8_t* m_data;
+        uint8_t* m_scratch;
+        uint64_t m_offsets[CUBE_FACE_NUM]; //!< Data offsets of transformed faces for current mip.
+        uint8_t m_transforms[CUBE_FACE_NUM];
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_bytesPerPixel;
+        uint32_t m_numBands;
+        bool m_copyBack;
+    };
+
+    // Processes bands of CMFT_TRANSFORM_TILE_SIZE rows, item index is face*numBands + band.
+    static void transformFaceBands(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const TransformFacesArgs* args = (const TransformFacesArgs*)_userData;
+        const size_t pitch = size_t(args->m_width)*args->m_bytesPerPixel;
+        const size_t faceSize = pitch*args->m_height;
+
+        for (uint32_t ii = _begin; ii < _end; ++ii)
+        {
+            const uint32_t face = ii / args->m_numBands;
+            const uint32_t rowBegin = (ii % args->m_numBands) * CMFT_TRANSFORM_TILE_SIZE;
+            const uint32_t rowEnd = min(args->m_height, rowBegin+CMFT_TRANSFORM_TILE_SIZE);
+
+            uint8_t* faceData = args->m_data + args->m_offsets[face];
+            uint8_t* scratch = args->m_scratch + face*faceSize;
+
+            if (args->m_copyBack)
+            {
+                memcpy(faceData + rowBegin*pitch, scratch + rowBegin*pitch, (rowEnd-rowBegin)*pitch);
+            }
+            else
+            {
+                args->m_fn(scratch, faceData, args->m_width, args->m_height, args->m_bytesPerPixel, args->m_transforms[face], rowBegin, rowEnd);
+            }
+        }
+    }
+
+    static inline uint8_t faceTransformGet(uint32_t _faceTransforms, uint8_t _face)
+    {
+        return uint8_t((_faceTransforms >> (_face*3)) & 0x7);
+    }
+
+    static inline uint32_t faceTransformSet(uint32_t _faceTransforms, uint8_t _face, uint8_t _transform)
+    {
+        return (_faceTransforms & ~(UINT32_C(0x7) << (_face*3))) | (uint32_t(_transform) << (_face*3));
+    }
+
+    /// Composes operations of each face into a single transform.
+    static void transformsFromOps(uint8_t _transforms[CUBE_FACE_NUM], const Image& _image, va_list _argList)
+    {
+        memset(_transforms, 0, CUBE_FACE_NUM);
+        const bool isSquare = (_image.m_width == _image.m_height);
+
+        for (uint32_t op = va_arg(_argList, uint32_t); UINT32_MAX != op; op = va_arg(_argList, uint32_t))
+        {
+            const uint16_t imageOp = (op&IMAGE_OP_MASK);
+            const uint8_t imageFace = (op&IMAGE_FACE_MASK)>>IMAGE_FACE_SHIFT;
+            if (imageFace >= _image.m_numFaces)
+            {
+                continue;
+            }
+
+            uint8_t& transform = _transforms[imageFace];
+
+            if (imageOp&(IMAGE_OP_ROT_90|IMAGE_OP_ROT_180|IMAGE_OP_ROT_270))
+            {
+                if (isSquare)
+                {
+                    if (imageOp&IMAGE_OP_ROT_90)
+                    {
+                        transform = transformCompose(transform, CMFT_TRANSFORM_SWAP|CMFT_TRANSFORM_MIRROR_X|CMFT_TRANSFORM_MIRROR_Y);
+                    }
+
+                    if (imageOp&IMAGE_OP_ROT_180)
+                    {
+                        transform = transformCompose(transform, CMFT_TRANSFORM_MIRROR_X|CMFT_TRANSFORM_MIRROR_Y);
+                    }
+
+                    if (imageOp&IMAGE_OP_ROT_270)
+                    {
+                        transform = transformCompose(transform, CMFT_TRANSFORM_SWAP);
+                    }
+                }
+                else
+                {
+                    WARN("Because image data transformation is done in place, "
+                         "rotation operations work only when image width is equal to image height."
+                         );
+                }
+            }
+
+            if (imageOp&IMAGE_OP_FLIP_X)
+            {
+                transform = transformCompose(transform, CMFT_TRANSFORM_MIRROR_Y);
+            }
+
+            if (imageOp&IMAGE_OP_FLIP_Y)
+            {
+                transform = transformCompose(transform, CMFT_TRANSFORM_MIRROR_X);
+            }
+        }
+    }
+
+    /// Applies _transforms to image data. Recorded transforms of _image are applied as well.
+    static void imageApplyTransforms(Image& _image, const uint8_t _transforms[CUBE_FACE_NUM])
+    {
+        // Gather faces that change.
+        TransformFacesArgs args;
+        uint8_t faces[CUBE_FACE_NUM];
+        uint8_t numFaces = 0;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            const uint8_t transform = transformCompose(faceTransformGet(_image.m_faceTransforms, face), _transforms[face]);
+            if (0 != transform)
+            {
+                args.m_transforms[numFaces] = transform;
+                faces[numFaces++] = face;
+            }
+        }
+
+        if (0 == numFaces)
+        {
+            return;
+        }
+
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
+        if (0 != imageDataInfo.m_blockBytes)
+        {
+            WARN("Transformation of block compressed images is not supported.");
+            return;
+        }
+
+        imageMakeUnique(_image);
+        _image.m_faceTransforms = 0;
+
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, _image);
+
+        // Faces of a mip are transformed in parallel into scratch memory and copied back.
+        args.m_bytesPerPixel = imageDataInfo.m_bytesPerPixel;
+        args.m_fn = transformRowsFn(args.m_bytesPerPixel);
+        args.m_data = (uint8_t*)_image.m_data;
+        args.m_scratch = (uint8_t*)allocScratch(size_t(numFaces)*_image.m_width*_image.m_height*args.m_bytesPerPixel, AllocTag::Other);
+        MALLOC_CHECK(args.m_scratch);
+
+        for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
+        {
+            args.m_width  = max(UINT32_C(1), _image.m_width  >> mip);
+            args.m_height = max(UINT32_C(1), _image.m_height >> mip);
+            args.m_numBands = (args.m_height + CMFT_TRANSFORM_TILE_SIZE - 1) / CMFT_TRANSFORM_TILE_SIZE;
+            for (uint8_t ii = 0; ii < numFaces; ++ii)
+            {
+                args.m_offsets[ii] = offsets[faces[ii]][mip];
+            }
+
+            const uint32_t numItems = numFaces*args.m_numBands;
+            const uint32_t minItems = max(UINT32_C(1), CMFT_TRANSFORM_MIN_PIXELS/(args.m_width*CMFT_TRANSFORM_TILE_SIZE));
+
+            args.m_copyBack = false;
+            parallelFor(transformFaceBands, (void*)&args, numItems, minItems);
+
+            args.m_copyBack = true;
+            parallelFor(transformFaceBands, (void*)&args, numItems, minItems);
+        }
+
+        freeScratch(args.m_scratch);
+    }
+
+    void imageTransformUseMacroInstead(Image* _image, ...)
+    {
+        CMFT_PROFILE_ZONE("imageTransform");
+
+        uint8_t transforms[CUBE_FACE_NUM];
+        va_list argList;
+        va_start(argList, _image);
+        transformsFromOps(transforms, *_image, argList);
+        va_end(argList);
+
+        imageApplyTransforms(*_image, transforms);
+    }
+
+    void imageTransformDeferredUseMacroInstead(Image* _image, ...)
+    {
+        uint8_t transforms[CUBE_FACE_NUM];
+        va_list argList;
+        va_start(argList, _image);
+        transformsFromOps(transforms, *_image, argList);
+        va_end(argList);
+
+        if (!imageIsCubemap(*_image)
+        ||  0 != getImageDataInfo(_image->m_format).m_blockBytes)
+        {
+            imageApplyTransforms(*_image, transforms);
+            return;
+        }
+
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            const uint8_t transform = transformCompose(faceTransformGet(_image->m_faceTransforms, face), transforms[face]);
+            _image->m_faceTransforms = faceTransformSet(_image->m_faceTransforms, face, transform);
+        }
+    }
+
+    void imageResolveFaceTransforms(Image& _image)
+    {
+        const uint8_t none[CUBE_FACE_NUM] = { 0 };
+        imageApplyTransforms(_image, none);
+    }
+
+    struct ConvertTransformedArgs
+    {
+        uint8_t* m_dst;
+        const uint8_t* m_src;
+        TextureFormat::Enum m_dstFormat;
+        TextureFormat::Enum m_srcFormat;
+        uint32_t m_dstBytesPerPixel;
+        uint32_t m_srcBytesPerPixel;
+        uint64_t m_dstOffsets[CUBE_FACE_NUM];
+        uint64_t m_srcOffsets[CUBE_FACE_NUM];
+        uint8_t m_transforms[CUBE_FACE_NUM];
+        uint32_t m_size;
+        const ImageEncodeSettings* m_settings;
+    };
+
+    // Pixels gathered from transformed source rows and converted at once.
+    #define CMFT_CONVERT_TRANSFORMED_CHUNK_PIXELS 256
+
+    // Converts rows of one mip, row index is face*size + y.
+    static void convertTransformedRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ConvertTransformedArgs* args = (const ConvertTransformedArgs*)_userData;
+        const uint32_t size = args->m_size;
+        const uint32_t srcBytesPerPixel = args->m_srcBytesPerPixel;
+        const bool sameFormat = (args->m_srcFormat == args->m_dstFormat);
+
+        uint8_t gathered[CMFT_CONVERT_TRANSFORMED_CHUNK_PIXELS*16];
+        float rgba32f[CMFT_CONVERT_TRANSFORMED_CHUNK_PIXELS*4];
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(row / size);
+            const uint32_t yy = row % size;
+            const uint8_t transform = args->m_transforms[face];
+            const bool swap    = 0 != (transform&CMFT_TRANSFORM_SWAP);
+            const bool mirrorX = 0 != (transform&CMFT_TRANSFORM_MIRROR_X);
+            const bool mirrorY = 0 != (transform&CMFT_TRANSFORM_MIRROR_Y);
+
+            const uint8_t* srcFace = args->m_src + args->m_srcOffsets[face];
+            uint8_t* dstRow = args->m_dst + args->m_dstOffsets[face] + uint64_t(yy)*size*args->m_dstBytesPerPixel;
+
+            // Untransformed rows are converted as they are.
+            if (0 == transform)
+            {
+                convertPixels(dstRow, args->m_dstFormat, srcFace + uint64_t(yy)*size*srcBytesPerPixel, args->m_srcFormat, size, rgba32f, false, *args->m_settings);
+                continue;
+            }
+
+            // Texel (x,y) is read from (u,v), swapped (y,x) coordinates when rotated, then mirrored.
+            for (uint32_t x0 = 0; x0 < size; x0 += CMFT_CONVERT_TRANSFORMED_CHUNK_PIXELS)
+            {
+                const uint32_t num = min(size-x0, uint32_t(CMFT_CONVERT_TRANSFORMED_CHUNK_PIXELS));
+                uint8_t* gather = sameFormat ? dstRow + x0*srcBytesPerPixel : gathered;
+                for (uint32_t ii = 0; ii < num; ++ii)
+                {
+                    const uint32_t xx = x0+ii;
+                    const uint32_t uu = swap ? yy : xx;
+                    const uint32_t vv = swap ? xx : yy;
+                    const uint32_t srcX = mirrorX ? size-1-uu : uu;
+                    const uint32_t srcY = mirrorY ? size-1-vv : vv;
+                    memcpy(gather + ii*srcBytesPerPixel, srcFace + (uint64_t(srcY)*size + srcX)*srcBytesPerPixel, srcBytesPerPixel);
+                }
+
+                if (!sameFormat)
+                {
+                    convertPixels(dstRow + x0*args->m_dstBytesPerPixel, args->m_dstFormat, gathered, args->m_srcFormat, num, rgba32f, false, *args->m_settings);
+                }
+            }
+        }
+    }
+
+    /// Converts cubemap with recorded face transforms to uncompressed _dstFormat, faces are written transformed.
+    static void imageConvertTransformed(Image& _dst, TextureFormat::Enum _dstFormat, const Image& _src, const ImageEncodeSettings& _settings)
+    {
+        CMFT_PROFILE_ZONE("imageConvertTransformed");
+
+        ConvertTransformedArgs args;
+        args.m_settings = &_settings;
+        args.m_src = (const uint8_t*)_src.m_data;
+        args.m_srcFormat = (TextureFormat::Enum)_src.m_format;
+        args.m_dstFormat = _dstFormat;
+        args.m_srcBytesPerPixel = getImageDataInfo(_src.m_format).m_bytesPerPixel;
+        args.m_dstBytesPerPixel = getImageDataInfo(_dstFormat).m_bytesPerPixel;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            args.m_transforms[face] = faceTransformGet(_src.m_faceTransforms, face);
+        }
+
+        const uint64_t dataSize = imageGetNumPixels(_src)*args.m_dstBytesPerPixel;
+        void* data = getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
+        args.m_dst = (uint8_t*)data;
+
+        Image result;
+        result.m_data = data;
+        result.m_width = _src.m_width;
+        result.m_height = _src.m_height;
+        result.m_dataSize = dataSize;
+        result.m_format = _dstFormat;
+        result.m_numMips = _src.m_numMips;
+        result.m_numFaces = _src.m_numFaces;
+
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint64_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, _src);
+        imageGetMipOffsets(dstOffsets, result);
+
+        for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
+        {
+            args.m_size = max(UINT32_C(1), _src.m_width >> mip);
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                args.m_srcOffsets[face] = srcOffsets[face][mip];
+                args.m_dstOffsets[face] = dstOffsets[face][mip];
+            }
+
+            const uint32_t minRows = max(UINT32_C(1), CMFT_CONVERT_MIN_PIXELS_PER_THREAD/args.m_size);
+            parallelFor(convertTransformedRows, (void*)&args, CUBE_FACE_NUM*args.m_size, minRows);
+        }
+
+        imageMove(_dst, result);
+    }
+
+    struct MipBoxArgs
+    {
+        float* m_data;
+        const uint64_t (*m_offsets)[MAX_MIP_NUM];
+        uint8_t m_mip;
+        uint32_t m_width;
+        uint32_t m_height;
+    };
+
+    // 2x2 box downsample of rows [_begin, _end) over all faces, row index is face*height + y.
+    static void mipBoxRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        using namespace bx;
+
+        const MipBoxArgs* args = (const MipBoxArgs*)_userData;
+        const uint32_t width = args->m_width;
+        const uint32_t parentWidth = width*2;
+        const float4_t quarter = float4_splat(0.25f);
+
+        for (uint32_t ii = _begin; ii < _end; ++ii)
+        {
+            const uint32_t face = ii / args->m_height;
+            const uint32_t yy   = ii % args->m_height;
+
+            float* dst = args->m_data + args->m_offsets[face][args->m_mip]/sizeof(float) + size_t(yy)*width*4;
+            const float* src0 = args->m_data + args->m_offsets[face][args->m_mip-1]/sizeof(float) + size_t(yy*2)*parentWidth*4;
+            const float* src1 = src0 + parentWidth*4;
+
+            for (uint32_t xx = 0; xx < width; ++xx, dst += 4, src0 += 8, src1 += 8)
+            {
+                const float4_t a = float4_ld(src0);
+                const float4_t b = float4_ld(src0+4);
+                const float4_t c = float4_ld(src1);
+                const float4_t d = float4_ld(src1+4);
+                const float4_t sum = float4_add(float4_add(float4_add(a, b), c), d);
+                float4_st(dst, float4_mul(sum, quarter));
+            }
+        }
+    }
+
+    // Texel of face edge, see cubemapEdgeTexelIndex().
+    static inline float* cubemapEdgeTexel(float* _face, uint32_t _faceSize, uint8_t _edge, uint32_t _idx)
+    {
+        return _face + size_t(cubemapEdgeTexelIndex(_faceSize, _edge, _idx))*4;
+    }
+
+    // Averages texels that lie on the same cube edge or corner so that faces match exactly across seams.
+    static void cubemapAverageSeams(float* _faces[CUBE_FACE_NUM], uint32_t _faceSize)
+    {
+        if (1 == _faceSize)
+        {
+            return;
+        }
+
+        // Edges, every shared edge is visited once.
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t edge = 0; edge < 4; ++edge)
+            {
+                const uint8_t neighbourFace = s_cubeFaceNeighbours[face][edge].m_faceIdx;
+                const uint8_t neighbourEdge = s_cubeFaceNeighbours[face][edge].m_faceEdge;
+                if (neighbourFace < face)
+                {
+                    continue;
+                }
+
+                const bool reversed = cubemapEdgeStartCorner(face, edge) != cubemapEdgeStartCorner(neighbourFace, neighbourEdge);
+                for (uint32_t ii = 1; ii < _faceSize-1; ++ii)
+                {
+                    float* aa = cubemapEdgeTexel(_faces[face],          _faceSize, edge,          ii);
+                    float* bb = cubemapEdgeTexel(_faces[neighbourFace], _faceSize, neighbourEdge, reversed ? _faceSize-1-ii : ii);
+                    for (uint8_t ch = 0; ch < 4; ++ch)
+                    {
+                        aa[ch] = bb[ch] = (aa[ch]+bb[ch])*0.5f;
+                    }
+                }
+            }
+        }
+
+        // Corners, each one is shared by three faces.
+        float* corners[8][3];
+        uint8_t cornerCount[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            for (uint8_t ii = 0; ii < 4; ++ii)
+            {
+                const bool right  = (0 != (ii&1));
+                const bool bottom = (0 != (ii&2));
+                const uint8_t corner = cubemapCorner(face, right ? 1.0f : -1.0f, bottom ? 1.0f : -1.0f);
+
+                const uint32_t xx = right  ? _faceSize-1 : 0;
+                const uint32_t yy = bottom ? _faceSize-1 : 0;
+                corners[corner][cornerCount[corner]++] = _faces[face] + (size_t(yy)*_faceSize + xx)*4;
+            }
+        }
+
+        for (uint8_t corner = 0; corner < 8; ++corner)
+        {
+            DEBUG_CHECK(3 == cornerCount[corner], "Invalid cube corner.");
+
+            for (uint8_t ch = 0; ch < 4; ++ch)
+            {
+                const float avg = (corners[corner][0][ch] + corners[corner][1][ch] + corners[corner][2][ch]) * (1.0f/3.0f);
+                corners[corner][0][ch] = avg;
+                corners[corner][1][ch] = avg;
+                corners[corner][2][ch] = avg;
+            }
+        }
+    }
+
+    void imageGenerateMipMapChain(Image& _image, uint8_t _numMips, ResampleFilter::Enum _filter, bool _averageSeams)
+    {
+        AllocTagScope allocTag(AllocTag::MipChain, true);
+
+        const uint8_t srcNumMips = _image.m_numMips;
+        const uint8_t numMips = min(_numMips, mipChainLength(_image.m_width, _image.m_height));
+        if (numMips <= srcNumMips)
+        {
+            return;
+        }
+
+        // Processing is done in rgba32f format. Image's own rgba32f data is extended in place.
+        const TextureFormat::Enum format = (TextureFormat::Enum)_image.m_format;
+        Image imageRgba32f;
+        // Recorded face transforms are applied first, copies and conversions apply them on the way.
+        if (TextureFormat::RGBA32F == format && !_image.m_mapped && !imageIsShared(_image))
+        {
+            imageResolveFaceTransforms(_image);
+            imageMove(imageRgba32f, _image);
+        }
+        else if (TextureFormat::RGBA32F == format && 0 == _image.m_faceTransforms)
+        {
+            imageCopy(imageRgba32f, _image);
+        }
+        else
+        {
+            imageConvert(imageRgba32f, TextureFormat::RGBA32F, _image);
+        }
+
+        // Offsets of the existing and of the entire mip map chain.
+        uint64_t srcFaceOffsets[CUBE_FACE_NUM];
+        imageGetFaceOffsets(srcFaceOffsets, imageRgba32f);
+        const uint64_t srcFaceSize = imageRgba32f.m_dataSize/imageRgba32f.m_numFaces;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        imageRgba32f.m_numMips = numMips;
+        imageRgba32f.m_dataSize = imageGetNumPixels(imageRgba32f)*bytesPerPixel;
+
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, imageRgba32f);
+
+        // Grow data and move faces to their new offsets, back to front so that nothing gets overwritten.
+        imageRgba32f.m_data = imageAllocator(imageRgba32f)->realloc(imageRgba32f.m_data, imageRgba32f.m_dataSize);
+        MALLOC_CHECK(imageRgba32f.m_data);
+        for (uint8_t face = imageRgba32f.m_numFaces; face--; )
+        {
+            uint8_t* data = (uint8_t*)imageRgba32f.m_data;
+            memmove(data + offsets[face][0], data + srcFaceOffsets[face], srcFaceSize);
+        }
+
+        // Generate missing mips, each from its parent. Faces and rows are processed in parallel.
+        float* data = (float*)imageRgba32f.m_data;
+        const bool averageSeams = _averageSeams && imageIsCubemap(imageRgba32f);
+        for (uint8_t mip = srcNumMips; mip < numMips; ++mip)
+        {
+            const uint32_t parentWidth  = max(UINT32_C(1), imageRgba32f.m_width  >> (mip-1));
+            const uint32_t parentHeight = max(UINT32_C(1), imageRgba32f.m_height >> (mip-1));
+            const uint32_t width  = max(UINT32_C(1), imageRgba32f.m_width  >> mip);
+            const uint32_t height = max(UINT32_C(1), imageRgba32f.m_height >> mip);
+
+            if (ResampleFilter::Box == _filter && parentWidth == width*2 && parentHeight == height*2)
+            {
+                MipBoxArgs args;
+                args.m_data = data;
+                args.m_offsets = offsets;
+                args.m_mip = mip;
+                args.m_width = width;
+                args.m_height = height;
+
+                parallelFor(mipBoxRows, (void*)&args, imageRgba32f.m_numFaces*height, CMFT_RESIZE_MIN_ROWS);
+            }
+            else
+            {
+                ResampleAxis axisX;
+                ResampleAxis axisY;
+                resampleAxisInit(axisX, parentWidth,  width,  _filter);
+                resampleAxisInit(axisY, parentHeight, height, _filter);
+
+                float* tmp = (float*)getAllocator()->alloc(size_t(width)*parentHeight*bytesPerPixel);
+                MALLOC_CHECK(tmp);
+
+                for (uint8_t face = 0; face < imageRgba32f.m_numFaces; ++face)
+                {
+                    ResizeFaceArgs args;
+                    args.m_axisX = &axisX;
+                    args.m_axisY = &axisY;
+                    args.m_src = data + offsets[face][mip-1]/sizeof(float);
+                    args.m_tmp = tmp;
+                    args.m_dst = data + offsets[face][mip]/sizeof(float);
+                    args.m_srcWidth = parentWidth;
+                    args.m_dstWidth = width;
+
+                    parallelFor(resizeRowsX, (void*)&args, parentHeight, CMFT_RESIZE_MIN_ROWS);
+                    parallelFor(resizeRowsY, (void*)&args, height,       CMFT_RESIZE_MIN_ROWS);
+                }
+
+                getAllocator()->free(tmp);
+                resampleAxisFree(axisX);
+                resampleAxisFree(axisY);
+            }
+
+            if (averageSeams)
+            {
+                float* faces[CUBE_FACE_NUM];
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    faces[face] = data + offsets[face][mip]/sizeof(float);
+                }
+
+                cubemapAverageSeams(faces, width);
+            }
+        }
+
+        // Convert result to source format.
+        if (TextureFormat::RGBA32F == format)
+        {
+            imageMove(_image, imageRgba32f);
+        }
+        else
+        {
+            imageConvert(_image, format, imageRgba32f);
+            imageUnload(imageRgba32f);
+        }
+    }
+
+    // Gamma.
+    //-----
+
+#if CMFT_CONVERT_SIMD
+    /// Natural logarithm of positive normal floats, Cephes polynomial.
+    static inline __m128 simdLog(__m128 _x)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128i bits = _mm_castps_si128(_x);
+
+        // Split into exponent and mantissa in [sqrt(1/2), sqrt(2)).
+        __m128i exp = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+        __m128 mant = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_castps_si128(one)));
+        const __m128 large = _mm_cmpgt_ps(mant, _mm_set1_ps(1.41421356f));
+        mant = _mm_or_ps(_mm_and_ps(large, _mm_mul_ps(mant, _mm_set1_ps(0.5f))), _mm_andnot_ps(large, mant));
+        exp = _mm_sub_epi32(exp, _mm_castps_si128(large));
+
+        const __m128 xx = _mm_sub_ps(mant, one);
+        const __m128 zz = _mm_mul_ps(xx, xx);
+
+        __m128 poly = _mm_set1_ps(7.0376836292e-2f);
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(-1.1514610310e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps( 1.1676998740e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(-1.2420140846e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps( 1.4249322787e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(-1.6668057665e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps( 2.0000714765e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(-2.4999993993e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps( 3.3333331174e-1f));
+
+        const __m128 ee = _mm_cvtepi32_ps(exp);
+        __m128 yy = _mm_mul_ps(_mm_mul_ps(xx, zz), poly);
+        yy = _mm_add_ps(yy, _mm_mul_ps(ee, _mm_set1_ps(-2.12194440e-4f)));
+        yy = _mm_sub_ps(yy, _mm_mul_ps(zz, _mm_set1_ps(0.5f)));
+
+        return _mm_add_ps(_mm_add_ps(xx, yy), _mm_mul_ps(ee, _mm_set1_ps(0.693359375f)));
+    }
+
+    /// Exponential of floats in [-87, 88], Cephes polynomial.
+    static inline __m128 simdExp(__m128 _x)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        // Round to nearest power of two, floor with truncation fixed up for negative values.
+        const __m128 fx = _mm_add_ps(_mm_mul_ps(_x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+        __m128i nn = _mm_cvttps_epi32(fx);
+        nn = _mm_add_epi32(nn, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(nn), fx)));
+        const __m128 fn = _mm_cvtepi32_ps(nn);
+
+        const __m128 xx = _mm_sub_ps(_mm_sub_ps(_x, _mm_mul_ps(fn, _mm_set1_ps(0.693359375f))), _mm_mul_ps(fn, _mm_set1_ps(-2.12194440e-4f)));
+
+        __m128 poly = _mm_set1_ps(1.9875691500e-4f);
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(1.3981999507e-3f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(8.3334519073e-3f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(4.1665795894e-2f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(1.6666665459e-1f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, xx), _mm_set1_ps(5.0000001201e-1f));
+
+        const __m128 yy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(poly, _mm_mul_ps(xx, xx)), xx), one);
+        const __m128 pow2n = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(nn, _mm_set1_epi32(127)), 23));
+
+        return _mm_mul_ps(yy, pow2n);
+    }
+
+    /// pow(x, g) = exp(g*log(x)) for positive normal values with result in float range.
+    /// Lanes out of range are reported in bits of _invalid.
+    static inline __m128 simdPow(__m128 _x, __m128 _gamma, int& _invalid)
+    {
+        const __m128 expArg = _mm_mul_ps(_gamma, simdLog(_x));
+        const __m128 valid = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_x, _mm_set1_ps(FLT_MIN)), _mm_cmple_ps(_x, _mm_set1_ps(FLT_MAX)))
+                                      , _mm_and_ps(_mm_cmpge_ps(expArg, _mm_set1_ps(-87.0f)), _mm_cmple_ps(expArg, _mm_set1_ps(88.0f)))
+                                      );
+        _invalid = 0xf & ~_mm_movemask_ps(valid);
+
+        return simdExp(expArg);
+    }
+#endif // CMFT_CONVERT_SIMD
+
+    struct ApplyGammaArgs
+    {
+        float* m_data;
+        float m_gammaPow;
+    };
+
+    static void applyGammaRange(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ApplyGammaArgs* args = (const ApplyGammaArgs*)_userData;
+        const float gammaPow = args->m_gammaPow;
+
+#if CMFT_CONVERT_SIMD
+        // Four pixels are transposed so each channel fills a register. Values out of range of the approximation use powf().
+        const __m128 gamma = _mm_set1_ps(gammaPow);
+        for (uint32_t ii = _begin; ii < _end; ii += 4)
+        {
+            float* dst = args->m_data + size_t(ii)*4;
+            float* pixels = dst;
+
+            // Pad last pixels, 1.0f is in range.
+            const uint32_t num = min(_end-ii, UINT32_C(4));
+            float tail[16];
+            if (num < 4)
+            {
+                for (uint8_t jj = 0; jj < 16; ++jj)
+                {
+                    tail[jj] = 1.0f;
+                }
+                memcpy(tail, dst, num*4*sizeof(float));
+                pixels = tail;
+            }
+
+            __m128 rr = _mm_loadu_ps(&pixels[ 0]);
+            __m128 gg = _mm_loadu_ps(&pixels[ 4]);
+            __m128 bb = _mm_loadu_ps(&pixels[ 8]);
+            __m128 aa = _mm_loadu_ps(&pixels[12]);
+            _MM_TRANSPOSE4_PS(rr, gg, bb, aa);
+
+            int invalid[3];
+            __m128 rPow = simdPow(rr, gamma, invalid[0]);
+            __m128 gPow = simdPow(gg, gamma, invalid[1]);
+            __m128 bPow = simdPow(bb, gamma, invalid[2]);
+            _MM_TRANSPOSE4_PS(rPow, gPow, bPow, aa);
+
+            if (0 != (invalid[0]|invalid[1]|invalid[2]))
+            {
+                float src[3][4];
+                _mm_storeu_ps(src[0], rr);
+                _mm_storeu_ps(src[1], gg);
+                _mm_storeu_ps(src[2], bb);
+
+                float result[16];
+                _mm_storeu_ps(&result[ 0], rPow);
+                _mm_storeu_ps(&result[ 4], gPow);
+                _mm_storeu_ps(&result[ 8], bPow);
+                _mm_storeu_ps(&result[12], aa);
+                for (uint8_t ch = 0; ch < 3; ++ch)
+                {
+                    for (uint8_t px = 0; px < 4; ++px)
+                    {
+                        if (invalid[ch] & (1<<px))
+                        {
+                            result[px*4+ch] = powf(src[ch][px], gammaPow);
+                        }
+                    }
+                }
+                memcpy(pixels, result, sizeof(result));
+            }
+            else
+            {
+                _mm_storeu_ps(&pixels[ 0], rPow);
+                _mm_storeu_ps(&pixels[ 4], gPow);
+                _mm_storeu_ps(&pixels[ 8], bPow);
+                _mm_storeu_ps(&pixels[12], aa);
+            }
+
+            if (num < 4)
+            {
+                memcpy(dst, tail, num*4*sizeof(float));
+            }
+        }
+#else
+        float* channel = args->m_data + size_t(_begin)*4;
+        const float* end = args->m_data + size_t(_end)*4;
+        for (;channel < end; channel+=4)
+        {
+            channel[0] = powf(channel[0], gammaPow);
+            channel[1] = powf(channel[1], gammaPow);
+            channel[2] = powf(channel[2], gammaPow);
+            //channel[3] = leave alpha channel as is.
+        }
+#endif // CMFT_CONVERT_SIMD
+    }
+
+    static void imageApplyGammaRgba32f(Image& _image, float _gammaPow)
+    {
+        ApplyGammaArgs args;
+        args.m_data = (float*)_image.m_data;
+        args.m_gammaPow = _gammaPow;
+
+        const uint64_t pixelCount = imageGetNumPixels(_image);
+        DEBUG_CHECK(pixelCount <= UINT32_MAX, "Image has too many pixels to process at once.");
+        parallelFor(applyGammaRange, (void*)&args, uint32_t(pixelCount), CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+    }
+
+    /// Number of lookup table entries for formats with independent 8 or 16 bit channels, 0 for other formats.
+    static uint32_t gammaLutSize(TextureFormat::Enum _format)
+    {
+        switch (_format)
+        {
+        case TextureFormat::BGR8:
+        case TextureFormat::RGB8:
+        case TextureFormat::BGRA8:
+        case TextureFormat::RGBA8:
+            return 1<<8;
+
+        case TextureFormat::RGB16:
+        case TextureFormat::RGBA16:
+        case TextureFormat::RGB16F:
+        case TextureFormat::RGBA16F:
+            return 1<<16;
+
+        default:
+            return 0;
+        }
+    }
+
+    struct ApplyGammaLutArgs
+    {
+        uint8_t* m_data;
+        const uint16_t* m_lut;      //!< Color channels.
+        const uint16_t* m_lutAlpha; //!< Alpha channel.
+        uint8_t m_numChannels;
+        bool m_wide;                //!< 16 bit channels.
+    };
+
+    static void applyGammaLutRange(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ApplyGammaLutArgs* args = (const ApplyGammaLutArgs*)_userData;
+        const uint8_t numChannels = args->m_numChannels;
+        const uint16_t* lut = args->m_lut;
+        const uint16_t* lutAlpha = args->m_lutAlpha;
+
+        if (args->m_wide)
+        {
+            uint16_t* channel = (uint16_t*)args->m_data + size_t(_begin)*numChannels;
+            const uint16_t* end = (const uint16_t*)args->m_data + size_t(_end)*numChannels;
+            for (;channel < end; channel+=numChannels)
+            {
+                channel[0] = lut[channel[0]];
+                channel[1] = lut[channel[1]];
+                channel[2] = lut[channel[2]];
+                if (4 == numChannels)
+                {
+                    channel[3] = lutAlpha[channel[3]];
+                }
+            }
+        }
+        else
+        {
+            uint8_t* channel = args->m_data + size_t(_begin)*numChannels;
+            const uint8_t* end = args->m_data + size_t(_end)*numChannels;
+            for (;channel < end; channel+=numChannels)
+            {
+                channel[0] = uint8_t(lut[channel[0]]);
+                channel[1] = uint8_t(lut[channel[1]]);
+                channel[2] = uint8_t(lut[channel[2]]);
+                if (4 == numChannels)
+                {
+                    channel[3] = uint8_t(lutAlpha[channel[3]]);
+                }
+            }
+        }
+    }
+
+    /// Applies gamma through a table of every channel value. Table is built by passing all values through
+    /// the rgba32f path, so results are the same as converting the image.
+    static void imageApplyGammaLut(Image& _image, float _gammaPow, uint32_t _lutSize)
+    {
+        imageMakeUnique(_image);
+
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
+        const bool wide = (1<<16) == _lutSize;
+
+        // Image with every value in all channels.
+        Image lutImage;
+        lutImage.m_width = _lutSize;
+        lutImage.m_height = 1;
+        lutImage.m_format = _image.m_format;
+        lutImage.m_numMips = 1;
+        lutImage.m_numFaces = 1;
+        lutImage.m_dataSize = _lutSize*imageDataInfo.m_bytesPerPixel;
+        lutImage.m_data = getAllocator()->alloc(lutImage.m_dataSize);
+        MALLOC_CHECK(lutImage.m_data);
+
+        for (uint32_t ii = 0; ii < _lutSize; ++ii)
+        {
+            for (uint8_t ch = 0; ch < imageDataInfo.m_numChanels; ++ch)
+            {
+                if (wide)
+                {
+                    ((uint16_t*)lutImage.m_data)[ii*imageDataInfo.m_numChanels + ch] = uint16_t(ii);
+                }
+                else
+                {
+                    ((uint8_t*)lutImage.m_data)[ii*imageDataInfo.m_numChanels + ch] = uint8_t(ii);
+                }
+            }
+        }
+
+        imageToRgba32f(lutImage);
+        imageApplyGammaRgba32f(lutImage, _gammaPow);
+        imageConvert(lutImage, (TextureFormat::Enum)_image.m_format);
+
+        uint16_t* lut = (uint16_t*)malloc(2*_lutSize*sizeof(uint16_t));
+        MALLOC_CHECK(lut);
+        uint16_t* lutAlpha = lut + _lutSize;
+        for (uint32_t ii = 0; ii < _lutSize; ++ii)
+        {
+            const uint32_t first = ii*imageDataInfo.m_numChanels;
+            const uint32_t last  = first + imageDataInfo.m_numChanels-1;
+            lut[ii]      = wide ? ((const uint16_t*)lutImage.m_data)[first] : ((const uint8_t*)lutImage.m_data)[first];
+            lutAlpha[ii] = wide ? ((const uint16_t*)lutImage.m_data)[last]  : ((const uint8_t*)lutImage.m_data)[last];
+        }
+        imageUnload(lutImage);
+
+        ApplyGammaLutArgs args;
+        args.m_data = (uint8_t*)_image.m_data;
+        args.m_lut = lut;
+        args.m_lutAlpha = lutAlpha;
+        args.m_numChannels = imageDataInfo.m_numChanels;
+        args.m_wide = wide;
+
+        const uint64_t pixelCount = imageGetNumPixels(_image);
+        DEBUG_CHECK(pixelCount <= UINT32_MAX, "Image has too many pixels to process at once.");
+        parallelFor(applyGammaLutRange, (void*)&args, uint32_t(pixelCount), CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+
+        free(lut);
+    }
+
+    void imageApplyGamma(Image& _image, float _gammaPow)
+    {
+        // Do nothing if _gammaPow is ~= 1.0f.
+        if (0.0001f > fabsf(_gammaPow-1.0f))
+        {
+            return;
+        }
+
+        CMFT_PROFILE_ZONE("imageApplyGamma");
+
+        // Images with fewer pixels than table entries are cheaper to convert.
+        const uint32_t lutSize = gammaLutSize((TextureFormat::Enum)_image.m_format);
+        if (0 != lutSize
+        &&  imageGetNumPixels(_image) >= lutSize)
+        {
+            imageApplyGammaLut(_image, _gammaPow, lutSize);
+            return;
+        }
+
+        // Operation is done in rgba32f format. Image's own rgba32f data is modified in place, recorded face transforms are kept.
+        if (TextureFormat::RGBA32F == _image.m_format)
+        {
+            imageMakeUnique(_image);
+            imageApplyGammaRgba32f(_image, _gammaPow);
+            return;
+        }
+
+        Image imageRgba32f;
+        imageConvert(imageRgba32f, TextureFormat::RGBA32F, _image);
+
+        imageApplyGammaRgba32f(imageRgba32f, _gammaPow);
+
+        // Convert back to original format.
+        imageConvert(imageRgba32f, (TextureFormat::Enum)_image.m_format);
+        imageMove(_image, imageRgba32f);
+    }
+
+    // Pixel operations.
+    //-----
+
+    // Pixels decoded into a stack buffer at once by imageApplyPixelOps().
+    #define CMFT_PIXEL_OPS_CHUNK_PIXELS 512
+
+    static void clampRange(float* _rgba32f, uint32_t _num)
+    {
+        uint32_t ii = 0;
+
+#if CMFT_CONVERT_SIMD
+        // Min and max return the second operand for NaN, NaN passes through like in clamp().
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one  = _mm_set1_ps(1.0f);
+        for (; ii < _num; ++ii)
+        {
+            const __m128 px = _mm_loadu_ps(&_rgba32f[ii*4]);
+            _mm_storeu_ps(&_rgba32f[ii*4], _mm_max_ps(zero, _mm_min_ps(one, px)));
+        }
+#endif // CMFT_CONVERT_SIMD
+
+        for (; ii < _num; ++ii)
+        {
+            float* channel = &_rgba32f[ii*4];
+            channel[0] = clamp(channel[0], 0.0f, 1.0f);
+            channel[1] = clamp(channel[1], 0.0f, 1.0f);
+            channel[2] = clamp(channel[2], 0.0f, 1.0f);
+            channel[3] = clamp(channel[3], 0.0f, 1.0f);
+        }
+    }
+
+    struct PixelOpsArgs
+    {
+        void* m_dst;
+        const void* m_src;
+        const ImagePixelOp* m_ops;
+        uint8_t m_numOps;
+        TextureFormat::Enum m_srcFormat;
+        TextureFormat::Enum m_dstFormat;
+        uint8_t m_srcBytesPerPixel;
+        uint8_t m_dstBytesPerPixel;
+        const ImageEncodeSettings* m_settings;
+    };
+
+    // Each chunk is decoded into rgba32f, goes through all operations and is encoded while it is in cache.
+    static void pixelOpsRange(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const PixelOpsArgs* args = (const PixelOpsArgs*)_userData;
+
+        float rgba32f[CMFT_PIXEL_OPS_CHUNK_PIXELS*4];
+        for (uint32_t first = _begin; first < _end; first += CMFT_PIXEL_OPS_CHUNK_PIXELS)
+        {
+            const uint32_t num = min(_end-first, uint32_t(CMFT_PIXEL_OPS_CHUNK_PIXELS));
+
+            ImageConvertArgs convertArgs(*args->m_settings);
+            convertArgs.m_dst = rgba32f;
+            convertArgs.m_src = (const uint8_t*)args->m_src + size_t(first)*args->m_srcBytesPerPixel;
+            convertArgs.m_srcFormat = args->m_srcFormat;
+            convertArgs.m_dstFormat = TextureFormat::RGBA32F;
+            convertArgs.m_srcBytesPerPixel = args->m_srcBytesPerPixel;
+            convertArgs.m_dstBytesPerPixel = 4*sizeof(float);
+            imageToRgba32fRange((void*)&convertArgs, 0, num);
+
+            for (uint8_t ii = 0; ii < args->m_numOps; ++ii)
+            {
+                const ImagePixelOp& op = args->m_ops[ii];
+                if (PixelOp::Gamma == op.m_op)
+                {
+                    ApplyGammaArgs gammaArgs;
+                    gammaArgs.m_data = rgba32f;
+                    gammaArgs.m_gammaPow = op.m_value;
+                    applyGammaRange((void*)&gammaArgs, 0, num);
+                }
+                else if (PixelOp::Clamp == op.m_op)
+                {
+                    clampRange(rgba32f, num);
+                }
+            }
+
+            convertArgs.m_dst = (uint8_t*)args->m_dst + size_t(first)*args->m_dstBytesPerPixel;
+            convertArgs.m_src = rgba32f;
+            convertArgs.m_srcFormat = TextureFormat::RGBA32F;
+            convertArgs.m_dstFormat = args->m_dstFormat;
+            convertArgs.m_srcBytesPerPixel = 4*sizeof(float);
+            convertArgs.m_dstBytesPerPixel = args->m_dstBytesPerPixel;
+            imageFromRgba32fRange((void*)&convertArgs, 0, num);
+        }
+    }
+
+    /// Drops gamma operations with power ~= 1.0f, like imageApplyGamma() does. Clamp is dropped too while pixels
+    /// decoded from _format can not leave [0.0-1.0] range, which is the case for normalized integer formats.
+    static uint8_t pixelOpsActive(ImagePixelOp _active[], const ImagePixelOp* _ops, uint8_t _numOps, TextureFormat::Enum _format)
+    {
+        const ImageDataInfo& info = getImageDataInfo(_format);
+        bool inRange = (PixelDataType::UINT8 == info.m_pixelType || PixelDataType::UINT16 == info.m_pixelType)
+                    && TextureFormat::RGBE != _format
+                    && 0 == info.m_blockBytes
+                    ;
+
+        uint8_t numActive = 0;
+        for (uint8_t ii = 0; ii < _numOps; ++ii)
+        {
+            const ImagePixelOp& op = _ops[ii];
+            if (PixelOp::Gamma == op.m_op)
+            {
+                if (0.0001f > fabsf(op.m_value-1.0f))
+                {
+                    continue;
+                }
+
+                inRange &= (0.0f < op.m_value);
+            }
+            else if (PixelOp::Clamp == op.m_op)
+            {
+                if (inRange)
+                {
+                    continue;
+                }
+
+                inRange = true;
+            }
+
+            _active[numActive++] = op;
+        }
+
+        return numActive;
+    }
+
+    static void pixelOpsArgsInit(PixelOpsArgs& _args, TextureFormat::Enum _srcFormat, TextureFormat::Enum _dstFormat, const ImagePixelOp* _ops, uint8_t _numOps, const ImageEncodeSettings& _settings)
+    {
+        _args.m_ops = _ops;
+        _args.m_numOps = _numOps;
+        _args.m_srcFormat = _srcFormat;
+        _args.m_dstFormat = _dstFormat;
+        _args.m_srcBytesPerPixel = getImageDataInfo(_srcFormat).m_bytesPerPixel;
+        _args.m_dstBytesPerPixel = getImageDataInfo(_dstFormat).m_bytesPerPixel;
+        _args.m_settings = &_settings;
+    }
+
+    void imageApplyPixelOps(Image& _dst, TextureFormat::Enum _format, const Image& _src, const ImagePixelOp* _ops, uint8_t _numOps, const ImageEncodeSettings* _settings)
+    {
+        CMFT_PROFILE_ZONE("imageApplyPixelOps");
+
+        if (0 != getImageDataInfo(_src.m_format).m_blockBytes)
+        {
+            WARN("Converting from %s is not supported.", getTextureFormatStr(_src.m_format));
+            return;
+        }
+
+        ImagePixelOp ops[UINT8_MAX];
+        const uint8_t numOps = pixelOpsActive(ops, _ops, _numOps, (TextureFormat::Enum)_src.m_format);
+
+        // Block compressed formats are encoded from the rgba32f result.
+        const bool encode = 0 != getImageDataInfo(_format).m_blockBytes;
+        const TextureFormat::Enum dstFormat = encode ? TextureFormat::RGBA32F : _format;
+
+        PixelOpsArgs args;
+        pixelOpsArgsInit(args, (TextureFormat::Enum)_src.m_format, dstFormat, ops, numOps, encodeSettings(_settings));
+
+        // Alloc dst data.
+        const uint64_t pixelCount = imageGetNumPixels(_src);
+        const uint64_t dstDataSize = pixelCount*args.m_dstBytesPerPixel;
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        args.m_dst = dstData;
+        args.m_src = _src.m_data;
+        DEBUG_CHECK(pixelCount <= UINT32_MAX, "Image has too many pixels to convert at once.");
+        parallelFor(pixelOpsRange, (void*)&args, uint32_t(pixelCount), CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+
+        // Fill image structure.
+        Image result;
+        result.m_data = dstData;
+        result.m_width = _src.m_width;
+        result.m_height = _src.m_height;
+        result.m_dataSize = dstDataSize;
+        result.m_format = dstFormat;
+        result.m_numMips = _src.m_numMips;
+        result.m_numFaces = _src.m_numFaces;
+        result.m_faceTransforms = _src.m_faceTransforms;
+
+        // Output.
+        if (encode)
+        {
+            imageResolveFaceTransforms(result);
+            imageUnload(_dst);
+            imageEncode(_dst, _format, result, encodeSettings(_settings).m_compressionQuality);
+            imageUnload(result);
+        }
+        else
+        {
+            imageMove(_dst, result);
+        }
+    }
+
+    void imageApplyPixelOps(Image& _image, TextureFormat::Enum _format, const ImagePixelOp* _ops, uint8_t _numOps, const ImageEncodeSettings* _settings)
+    {
+        const uint8_t srcBytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
+        const uint8_t dstBytesPerPixel = getImageDataInfo(_format).m_bytesPerPixel;
+        const uint64_t pixelCount = imageGetNumPixels(_image);
+
+        // Nothing to do, mapped and shared data is left as it is too.
+        ImagePixelOp ops[UINT8_MAX];
+        const uint8_t numOps = pixelOpsActive(ops, _ops, _numOps, (TextureFormat::Enum)_image.m_format);
+        if (0 == numOps
+        &&  _format == _image.m_format)
+        {
+            return;
+        }
+
+        if (0 != getImageDataInfo(_image.m_format).m_blockBytes
+        ||  0 != getImageDataInfo(_format).m_blockBytes
+        ||  dstBytesPerPixel > srcBytesPerPixel
+        ||  _image.m_mapped
+        ||  imageIsShared(_image)
+        ||  pixelCount > UINT32_MAX)
+        {
+            Image tmp;
+            imageApplyPixelOps(tmp, _format, _image, _ops, _numOps, _settings);
+            imageMove(_image, tmp);
+            return;
+        }
+
+        CMFT_PROFILE_ZONE("imageApplyPixelOps");
+
+        PixelOpsArgs args;
+        pixelOpsArgsInit(args, (TextureFormat::Enum)_image.m_format, _format, ops, numOps, encodeSettings(_settings));
+
+        uint8_t* data = (uint8_t*)_image.m_data;
+
+        // Same size pixels, every chunk reads its source pixels before writing them.
+        if (dstBytesPerPixel == srcBytesPerPixel)
+        {
+            args.m_dst = data;
+            args.m_src = data;
+            parallelFor(pixelOpsRange, (void*)&args, uint32_t(pixelCount), CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+            _image.m_format = _format;
+            return;
+        }
+
+        // Narrowing is done front-to-back in waves, like imageFromRgba32fInPlace(). First chunk is decoded
+        // entirely before it is written, then each wave only writes below the source pixels it reads.
+        const uint32_t headCount = uint32_t(min(pixelCount, uint64_t(CMFT_PIXEL_OPS_CHUNK_PIXELS)));
+        args.m_dst = data;
+        args.m_src = data;
+        pixelOpsRange((void*)&args, 0, headCount);
+
+        uint32_t done = headCount;
+        while (done < pixelCount)
+        {
+            const uint32_t end = uint32_t(min(pixelCount, uint64_t(done)*srcBytesPerPixel/dstBytesPerPixel));
+            args.m_dst = data + uint64_t(done)*dstBytesPerPixel;
+            args.m_src = data + uint64_t(done)*srcBytesPerPixel;
+            parallelFor(pixelOpsRange, (void*)&args, end-done, CMFT_CONVERT_MIN_PIXELS_PER_THREAD);
+            done = end;
+        }
+
+        // Give back the tail.
+        const uint64_t dstDataSize = pixelCount*dstBytesPerPixel;
+        void* shrunk = imageAllocator(_image)->realloc(_image.m_data, dstDataSize);
+        if (NULL != shrunk)
+        {
+            _image.m_data = shrunk;
+        }
+        _image.m_dataSize = dstDataSize;
+        _image.m_format = _format;
+    }
+
+    void imageClamp(Image& _dst, const Image& _src)
+    {
+        const ImagePixelOp clampOp = { PixelOp::Clamp, 0.0f };
+        imageApplyPixelOps(_dst, (TextureFormat::Enum)_src.m_format, _src, &clampOp, 1);
+    }
+
+    void imageClamp(Image& _image)
+    {
+        const ImagePixelOp clampOp = { PixelOp::Clamp, 0.0f };
+        imageApplyPixelOps(_image, (TextureFormat::Enum)_image.m_format, &clampOp, 1);
+    }
+
+    bool imageIsCubemap(const Image& _image)
+    {
+        return (6 == _image.m_numFaces) && (_image.m_width == _image.m_height);
+    }
+
+    bool imageIsLatLong(const Image& _image)
+    {
+        const float aspect = (float)(int32_t)_image.m_width/(float)(int32_t)_image.m_height;
+        return (0.00001f > fabsf(aspect-2.0f));
+    }
+
+    bool imageIsHStrip(const Image& _image)
+    {
+        return (_image.m_width == 6*_image.m_height);
+    }
+
+    bool imageValidCubemapFaceList(const Image _faceList[6])
+    {
+        const uint32_t size = _faceList[0].m_width;
+        const uint8_t numMips = _faceList[0].m_numMips;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (_faceList[face].m_width != _faceList[face].m_height
+            ||  size    != _faceList[face].m_width
+            ||  numMips != _faceList[face].m_numMips
+            ||  _faceList[0].m_format != _faceList[face].m_format)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool imageIsCubeCross(const Image& _image)
+    {
+        // Check face count.
+        if (1 != _image.m_numFaces)
+        {
+            return false;
+        }
+
+        // Check aspect.
+        const float aspect = (float)(int32_t)_image.m_width/(float)(int32_t)_image.m_height;
+        const bool isVertical   = (aspect - 3.0f/4.0f) < 0.0001f;
+        const bool isHorizontal = (aspect - 4.0f/3.0f) < 0.0001f;
+
+        if (!isVertical && !isHorizontal)
+        {
+            return false;
+        }
+
+        // Define key points.
+        const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
+        const uint32_t imagePitch = _image.m_width * bytesPerPixel;
+
+        const uint32_t faceSize = alignf((float)(int32_t)_image.m_width / (isVertical ? 3.0f : 4.0f), bytesPerPixel);
+        const uint32_t facePitch = faceSize * bytesPerPixel;
+        const uint32_t rowDataSize = imagePitch * faceSize;
+
+        const uint32_t halfFacePitch   = alignf((float)(int32_t)facePitch   / 2.0f, bytesPerPixel);
+        const uint32_t halfRowDataSize = alignf((float)(int32_t)rowDataSize / 2.0f, bytesPerPixel);
+
+        uint64_t keyPointsOffsets[6];
+        if (isVertical)
+        {
+            //   ___ ___ ___
+            //  |   |   |   | -> rowDataSize
+            //  |___|___|___|
+            //
+            //   ___  -> facePitch
+            //
+            //   . -> keyPoint
+            //       ___
+            //    . |Y+ | .
+            //   ___|___|___
+            //  |X- |Z+ |X+ |
+            //  |___|___|___|
+            //    . |Y- | .
+            //      |___|
+            //    . |Z- | .
+            //      |___|
+            //
+            const uint32_t leftCenter  = halfRowDataSize + halfFacePitch;
+            const uint32_t rightCenter = halfRowDataSize + 5*halfFacePitch;
+            const uint32_t firstRow  = 0;
+            const uint32_t thirdRow  = 2*rowDataSize;
+            const uint32_t fourthRow = 3*rowDataSize;
+            keyPointsOffsets[0] =  leftCenter + firstRow;  //+x
+            keyPointsOffsets[1] = rightCenter + firstRow;  //-x
+            keyPointsOffsets[2] =  leftCenter + thirdRow;  //+y
+            keyPointsOffsets[3] = rightCenter + thirdRow;  //-y
+            keyPointsOffsets[4] =  leftCenter + fourthRow; //+z
+            keyPointsOffsets[5] = rightCenter + fourthRow; //-z
+        }
+        else
+        {
+            //       ___
+            //    . |+Y | .   .
+            //   ___|___|___ ___
+            //  |-X |+Z |+X |-Z |
+            //  |___|___|___|___|
+            //    . |-Y | .   .
+            //      |___|
+            //
+            const uint32_t center0 = halfRowDataSize + halfFacePitch;
+            const uint32_t center1 = halfRowDataSize + 5*halfFacePitch;
+            const uint32_t center2 = halfRowDataSize + 7*halfFacePitch;
+            const uint32_t firstRow = 0;
+            const uint32_t thirdRow = 2*rowDataSize;
+            keyPointsOffsets[0] = firstRow + center0; //+x
+            keyPointsOffsets[1] = firstRow + center1; //-x
+            keyPointsOffsets[2] = firstRow + center2; //+y
+            keyPointsOffsets[3] = thirdRow + center0; //-y
+            keyPointsOffsets[4] = thirdRow + center1; //+z
+            keyPointsOffsets[5] = thirdRow + center2; //-z
+        }
+
+        // Check key points.
+        bool result = true;
+        switch(_image.m_format)
+        {
+        case TextureFormat::BGR8:
+        case TextureFormat::RGB8:
+        case TextureFormat::BGRA8:
+        case TextureFormat::RGBA8:
+            {
+                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                {
+                    const uint8_t* point = (const uint8_t*)_image.m_data + keyPointsOffsets[key];
+                    const bool tap0 = point[0] < 2;
+                    const bool tap1 = point[1] < 2;
+                    const bool tap2 = point[2] < 2;
+                    result &= (tap0 & tap1 & tap2);
+                }
+            }
+        break;
+
+        case TextureFormat::RGB16:
+        case TextureFormat::RGBA16:
+            {
+                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                {
+                    const uint16_t* point = (const uint16_t*)((const uint8_t*)_image.m_data + keyPointsOffsets[key]);
+                    const bool tap0 = point[0] < 2;
+                    const bool tap1 = point[1] < 2;
+                    const bool tap2 = point[2] < 2;
+                    result &= (tap0 & tap1 & tap2);
+                }
+            }
+        break;
+
+        case TextureFormat::RGB16F:
+        case TextureFormat::RGBA16F:
+            {
+                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                {
+                    const uint16_t* point = (const uint16_t*)((const uint8_t*)_image.m_data + keyPointsOffsets[key]);
+                    const bool tap0 = halfToFloat(point[0]) < 0.01f;
+                    const bool tap1 = halfToFloat(point[1]) < 0.01f;
+                    const bool tap2 = halfToFloat(point[2]) < 0.01f;
+                    result &= (tap0 & tap1 & tap2);
+                }
+            }
+        break;
+
+        case TextureFormat::RGB32F:
+        case TextureFormat::RGBA32F:
+            {
+                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                {
+                    const float* point = (const float*)((const uint8_t*)_image.m_data + keyPointsOffsets[key]);
+                    const bool tap0 = point[0] < 0.01f;
+                    const bool tap1 = point[1] < 0.01f;
+                    const bool tap2 = point[2] < 0.01f;
+                    result &= (tap0 & tap1 & tap2);
+                }
+            }
+        break;
+
+        case TextureFormat::RGBE:
+            {
+                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                {
+                    const uint8_t* point = (const uint8_t*)_image.m_data + keyPointsOffsets[key];
+                    const float exp = ldexp(1.0f, point[3] - (128+8));
+                    const bool tap0 = float(point[0])*exp < 0.01f;
+                    const bool tap1 = float(point[1])*exp < 0.01f;
+                    const bool tap2 = float(point[2])*exp < 0.01f;
+                    result &= (tap0 & tap1 & tap2);
+                }
+            }
+        break;
+
+        case TextureFormat::RGB9E5:
+        case TextureFormat::R11G11B10F:
+        case TextureFormat::RGBM8:
+        case TextureFormat::RGBD8:
+        case TextureFormat::LOGLUV8:
+            {
+                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
+                {
+                    float rgba[4];
+                    toRgba32f(rgba, _image.m_format, (const uint8_t*)_image.m_data + keyPointsOffsets[key]);
+                    const bool tap0 = rgba[0] < 0.01f;
+                    const bool tap1 = rgba[1] < 0.01f;
+                    const bool tap2 = rgba[2] < 0.01f;
+                    result &= (tap0 & tap1 & tap2);
+                }
+            }
+        break;
+
+        default:
+            {
+                DEBUG_CHECK(false, "Unknown image format.");
+                result = false;
+            }
+        break;
+        };
+
+        return result;
+    }
+
+    // Cubemap layout views.
+    //-----
+
+    bool imageViewFromLayout(ImageView& _view, const void* _data, const ImageLayout& _layout, const Image& _cubemap)
+    {
+        if (!imageIsCubemap(_cubemap))
+        {
+            return false;
+        }
+
+        // Recorded flips become mirrored rows and negative pitch, rotations swap rows and columns and can not be viewed.
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            if (0 != (faceTransformGet(_cubemap.m_faceTransforms, face)&CMFT_TRANSFORM_SWAP))
+            {
+                return false;
+            }
+        }
+
+        _view.m_data = _data;
+        _view.m_faceSize = _cubemap.m_width;
+        _view.m_format = _cubemap.m_format;
+        _view.m_numMips = _cubemap.m_numMips;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            const uint8_t transform = faceTransformGet(_cubemap.m_faceTransforms, face);
+            for (uint8_t mip = 0; mip < _cubemap.m_numMips; ++mip)
+            {
+                _view.m_offsets[face][mip] = _layout.m_offsets[face][mip];
+                _view.m_pitch[face][mip] = int64_t(_layout.m_pitch[mip]);
+                if (0 != (transform&CMFT_TRANSFORM_MIRROR_Y))
+                {
+                    _view.m_offsets[face][mip] += uint64_t(_layout.m_numRows[mip]-1) * _layout.m_pitch[mip];
+                    _view.m_pitch[face][mip] = -_view.m_pitch[face][mip];
+                }
+            }
+            _view.m_flipX[face] = (0 != (transform&CMFT_TRANSFORM_MIRROR_X));
+        }
+
+        return true;
+    }
+
+    bool imageViewFromCubemap(ImageView& _view, const Image& _cubemap)
+    {
+        ImageLayout layout;
+        imageGetLayout(layout, _cubemap);
+
+        return imageViewFromLayout(_view, _cubemap.m_data, layout, _cubemap);
+    }
+
+    bool imageViewFromCross(ImageView& _view, const Image& _cross)
+    {
+        if (1 != _cross.m_numFaces)
+        {
+            return false;
+        }
+
+        // Checking image aspect.
+        const float aspect = (float)(int32_t)_cross.m_width/(float)(int32_t)_cross.m_height;
+        const bool isVertical   = fabsf(aspect - 3.0f/4.0f) < 0.0001f;
+        const bool isHorizontal = fabsf(aspect - 4.0f/3.0f) < 0.0001f;
+
+        if (!isVertical && !isHorizontal)
+        {
+            return false;
+        }
+
+        // Get sizes. Faces are kept inside the image when dimensions are not exact multiples of face size.
+        const uint32_t bytesPerPixel = getImageDataInfo(_cross.m_format).m_bytesPerPixel;
+        const uint64_t imagePitch = uint64_t(_cross.m_width) * bytesPerPixel;
+        const uint32_t faceSize = isVertical
+                                ? min(_cross.m_width/3, _cross.m_height/4)
+                                : min(_cross.m_width/4, _cross.m_height/3)
+                                ;
+        const uint64_t facePitch = uint64_t(faceSize) * bytesPerPixel;
+        const uint64_t rowDataSize = imagePitch * faceSize;
+
+        if (0 == faceSize)
+        {
+            return false;
+        }
+
+        _view.m_data = _cross.m_data;
+        _view.m_faceSize = faceSize;
+        _view.m_format = _cross.m_format;
+        _view.m_numMips = 1;
+
+        if (isVertical)
+        {
+            //   ___ ___ ___
+            //  |   |   |   | -> rowDataSize
+            //  |___|___|___|
+            //
+            //   ___  -> facePitch
+            //
+            //       ___
+            //      |+Y |
+            //   ___|___|___
+            //  |-X |+Z |+X |
+            //  |___|___|___|
+            //      |-Y |
+            //      |___|
+            //      |-Z |
+            //      |___|
+            //
+            _view.m_offsets[0][0] = rowDataSize + 2*facePitch; //+x
+            _view.m_offsets[1][0] = rowDataSize;               //-x
+            _view.m_offsets[2][0] = facePitch;                 //+y
+            _view.m_offsets[3][0] = 2*rowDataSize + facePitch; //-y
+            _view.m_offsets[4][0] = rowDataSize + facePitch;   //+z
+
+            // -Z is stored upside down, its first row is the last one in memory.
+            _view.m_offsets[5][0] = 4*rowDataSize - imagePitch + facePitch; //-z
+        }
+        else
+        {
+            //       ___
+            //      |+Y |
+            //   ___|___|___ ___
+            //  |-X |+Z |+X |-Z |
+            //  |___|___|___|___|
+            //      |-Y |
+            //      |___|
+            //
+            _view.m_offsets[0][0] = rowDataSize + 2*facePitch; //+x
+            _view.m_offsets[1][0] = rowDataSize;               //-x
+            _view.m_offsets[2][0] = facePitch;                 //+y
+            _view.m_offsets[3][0] = 2*rowDataSize + facePitch; //-y
+            _view.m_offsets[4][0] = rowDataSize + facePitch;   //+z
+            _view.m_offsets[5][0] = rowDataSize + 3*facePitch; //-z
+        }
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            _view.m_pitch[face][0] = int64_t(imagePitch);
+            _view.m_flipX[face] = false;
+        }
+
+        if (isVertical)
+        {
+            _view.m_pitch[5][0] = -int64_t(imagePitch);
+            _view.m_flipX[5] = true;
+        }
+
+        return true;
+    }
+
+    bool imageViewFromHStrip(ImageView& _view, const Image& _hstrip)
+    {
+        if (!imageIsHStrip(_hstrip))
+        {
+            return false;
+        }
+
+        const uint32_t faceSize = _hstrip.m_height;
+        const uint32_t bytesPerPixel = getImageDataInfo(_hstrip.m_format).m_bytesPerPixel;
+
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, _hstrip);
+
+        _view.m_data = _hstrip.m_data;
+        _view.m_faceSize = faceSize;
+        _view.m_format = _hstrip.m_format;
+        _view.m_numMips = _hstrip.m_numMips;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            for (uint8_t mip = 0; mip < _hstrip.m_numMips; ++mip)
+            {
+                // Advance by (facePitch * faceIdx) to get to the desired face in the strip.
+                const uint32_t mipSize = max(UINT32_C(1), faceSize >> mip);
+                const uint64_t mipPitch = uint64_t(mipSize) * bytesPerPixel;
+                _view.m_offsets[face][mip] = srcOffsets[0][mip] + mipPitch*face;
+                _view.m_pitch[face][mip] = int64_t(mipPitch*6);
+            }
+            _view.m_flipX[face] = false;
+        }
+
+        return true;
+    }
+
+    bool imageViewFromImage(ImageView& _view, const Image& _image)
+    {
+        if (imageIsCubemap(_image))
+        {
+            return imageViewFromCubemap(_view, _image);
+        }
+        else if (imageIsHStrip(_image))
+        {
+            return imageViewFromHStrip(_view, _image);
+        }
+        else if (imageIsCubeCross(_image))
+        {
+            return imageViewFromCross(_view, _image);
+        }
+
+        return false;
+    }
+
+    uint32_t imageAtlasNumTiles(const Image& _atlas, uint32_t _tileWidth, uint32_t _tileHeight)
+    {
+        if (0 == _tileWidth || 0 == _tileHeight)
+        {
+            return 0;
+        }
+
+        return (_atlas.m_width/_tileWidth) * (_atlas.m_height/_tileHeight);
+    }
+
+    bool imageViewFromAtlasTile(ImageView& _view, const Image& _atlas, uint32_t _tileIdx, uint32_t _tileWidth, uint32_t _tileHeight)
+    {
+        if (1 != _atlas.m_numFaces
+        ||  _tileIdx >= imageAtlasNumTiles(_atlas, _tileWidth, _tileHeight))
+        {
+            return false;
+        }
+
+        const uint32_t tilesPerRow = _atlas.m_width/_tileWidth;
+
+        // Tile is viewed as a standalone image first.
+        Image tile;
+        tile.m_data = _atlas.m_data;
+        tile.m_width = _tileWidth;
+        tile.m_height = _tileHeight;
+        tile.m_dataSize = uint64_t(_tileWidth) * _tileHeight * getImageDataInfo(_atlas.m_format).m_bytesPerPixel;
+        tile.m_format = _atlas.m_format;
+        tile.m_numMips = 1;
+        tile.m_numFaces = 1;
+
+        // Layout goes by aspect alone, imageIsCubeCross() would check texels outside of the tile.
+        const bool viewed = (_tileWidth == 6*_tileHeight)
+                          ? imageViewFromHStrip(_view, tile)
+                          : imageViewFromCross(_view, tile)
+                          ;
+        if (!viewed)
+        {
+            return false;
+        }
+
+        // Then rows of the tile are moved to their place in the atlas. Pitch of both hstrip and cross views is the image pitch.
+        const uint32_t bytesPerPixel = getImageDataInfo(_atlas.m_format).m_bytesPerPixel;
+        const uint64_t tilePitch = uint64_t(_tileWidth) * bytesPerPixel;
+        const uint64_t atlasPitch = uint64_t(_atlas.m_width) * bytesPerPixel;
+        const uint64_t tileOffset = uint64_t(_tileIdx/tilesPerRow) * _tileHeight * atlasPitch
+                                  + uint64_t(_tileIdx%tilesPerRow) * tilePitch
+                                  ;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            const uint64_t offset = _view.m_offsets[face][0];
+            _view.m_offsets[face][0] = tileOffset + (offset/tilePitch)*atlasPitch + offset%tilePitch;
+            _view.m_pitch[face][0] = (_view.m_pitch[face][0] < 0) ? -int64_t(atlasPitch) : int64_t(atlasPitch);
+        }
+        _view.m_numMips = 1;
+
+        return true;
+    }
+
+    const void* imageViewGetRow(const ImageView& _view, uint8_t _face, uint8_t _mip, uint32_t _y)
+    {
+        return (const uint8_t*)_view.m_data + _view.m_offsets[_face][_mip] + int64_t(_y)*_view.m_pitch[_face][_mip];
+    }
+
+    struct ImageFromViewArgs
+    {
+        const ImageView* m_view;
+        void* m_dst;
+        TextureFormat::Enum m_dstFormat;
+        uint64_t m_dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint32_t m_firstRow[CUBE_FACE_NUM*MAX_MIP_NUM+1]; //!< First row of each (face, mip) level, levels are face major.
+    };
+
+    static void imageFromViewRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const ImageFromViewArgs* args = (const ImageFromViewArgs*)_userData;
+        const ImageView& view = *args->m_view;
+
+        const TextureFormat::Enum srcFormat = view.m_format;
+        const TextureFormat::Enum dstFormat = args->m_dstFormat;
+        const uint32_t srcBytesPerPixel = getImageDataInfo(srcFormat).m_bytesPerPixel;
+        const uint32_t dstBytesPerPixel = getImageDataInfo(dstFormat).m_bytesPerPixel;
+
+        // Rgba32f row goes first to keep it aligned, followed by a row for mirrored faces.
+        uint8_t* scratch = (uint8_t*)malloc(size_t(view.m_faceSize)*(4*sizeof(float) + srcBytesPerPixel));
+        MALLOC_CHECK(scratch);
+        float* rgba32f = (float*)scratch;
+        uint8_t* mirrored = scratch + size_t(view.m_faceSize)*4*sizeof(float);
+
+        uint32_t level = 0;
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            while (args->m_firstRow[level+1] <= row)
+            {
+                ++level;
+            }
+
+            const uint8_t face = uint8_t(level / view.m_numMips);
+            const uint8_t mip  = uint8_t(level % view.m_numMips);
+            const uint32_t yy = row - args->m_firstRow[level];
+            const uint32_t mipSize = max(UINT32_C(1), view.m_faceSize >> mip);
+
+            const uint8_t* src = (const uint8_t*)imageViewGetRow(view, face, mip, yy);
+            if (view.m_flipX[face])
+            {
+                for (uint32_t xx = 0, xxEnd = mipSize-1; xx < mipSize; ++xx, --xxEnd)
+                {
+                    memcpy(&mirrored[xx*srcBytesPerPixel], &src[xxEnd*srcBytesPerPixel], srcBytesPerPixel);
+                }
+                src = mirrored;
+            }
+
+            uint8_t* dst = (uint8_t*)args->m_dst + args->m_dstOffsets[face][mip] + uint64_t(yy)*mipSize*dstBytesPerPixel;
+            convertPixels(dst, dstFormat, src, srcFormat, mipSize, rgba32f);
+        }
+
+        free(scratch);
+    }
+
+    bool imageFromView(Image& _dst, const ImageView& _view, TextureFormat::Enum _format)
+    {
+        if (NULL == _view.m_data || 0 == _view.m_faceSize || 0 == _view.m_numMips)
+        {
+            return false;
+        }
+
+        ImageFromViewArgs args;
+        args.m_view = &_view;
+        args.m_dstFormat = _format;
+
+        // Calculate destination offsets and alloc data.
+        const uint32_t bytesPerPixel = getImageDataInfo(_format).m_bytesPerPixel;
+        uint64_t dstDataSize = 0;
+        uint32_t numRows = 0;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            for (uint8_t mip = 0; mip < _view.m_numMips; ++mip)
+            {
+                const uint32_t mipSize = max(UINT32_C(1), _view.m_faceSize >> mip);
+
+                args.m_dstOffsets[face][mip] = dstDataSize;
+                args.m_firstRow[face*_view.m_numMips + mip] = numRows;
+
+                dstDataSize += uint64_t(mipSize) * mipSize * bytesPerPixel;
+                numRows += mipSize;
+            }
+        }
+        args.m_firstRow[6*_view.m_numMips] = numRows;
+
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+        args.m_dst = dstData;
+
+        const uint32_t minRows = max(UINT32_C(1), uint32_t(CMFT_CONVERT_MIN_PIXELS_PER_THREAD)/_view.m_faceSize);
+        parallelFor(imageFromViewRows, (void*)&args, numRows, minRows);
+
+        // Fill image structure.
+        Image result;
+        result.m_width = _view.m_faceSize;
+        result.m_height = _view.m_faceSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = _format;
+        result.m_numMips = _view.m_numMips;
+        result.m_numFaces = 6;
+        result.m_data = dstData;
+
+        // Output.
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    bool imageCubemapFromCross(Image& _dst, const Image& _src)
+    {
+        ImageView view;
+        if (!imageViewFromCross(view, _src))
+        {
+            return false;
+        }
+
+        return imageFromView(_dst, view, _src.m_format);
+    }
+
+    void imageCubemapFromCross(Image& _image)
+    {
+        Image tmp;
+        if (imageCubemapFromCross(tmp, _image))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    // Latlong <-> cubemap remap tables.
+    //-----
+
+    /// Source texel and bilinear weights sampled by one destination texel.
+    struct RemapTexel
+    {
+        uint32_t m_x;
+        uint32_t m_y;
+        float m_tx;
+        float m_ty;
+        uint8_t m_face; // Source face, for cubemap sources.
+    };
+
+    struct RemapKey
+    {
+        uint32_t m_type; // 0 - cubemap from latlong, 1 - latlong from cubemap.
+        uint32_t m_srcWidth;
+        uint32_t m_srcHeight;
+        uint32_t m_dstWidth;
+        uint32_t m_dstHeight;
+    };
+
+    struct RemapTable
+    {
+        RemapKey m_key;
+        RemapTexel* m_texels;
+        uint64_t m_size;
+        uint64_t m_lastUse;
+        uint32_t m_refs;
+        RemapTable* m_next;
+    };
+
+    static bx::Mutex s_remapMutex;
+    static RemapTable* s_remapTables = NULL;
+    static uint64_t s_remapSize = 0;
+    static uint64_t s_remapMaxSize = 0;
+    static uint64_t s_remapUseCounter = 0;
+
+    static void remapTableFree(RemapTable* _table)
+    {
+        free(_table->m_texels);
+        free(_table);
+    }
+
+    // Drops least recently used tables that are not in use until the cache fits. Mutex has to be locked.
+    static void remapCacheTrim()
+    {
+        while (s_remapSize > s_remapMaxSize)
+        {
+            RemapTable** lru = NULL;
+            for (RemapTable** table = &s_remapTables; NULL != *table; table = &(*table)->m_next)
+            {
+                if (0 == (*table)->m_refs
+                && (NULL == lru || (*table)->m_lastUse < (*lru)->m_lastUse))
+                {
+                    lru = table;
+                }
+            }
+
+            if (NULL == lru)
+            {
+                break;
+            }
+
+            RemapTable* table = *lru;
+            *lru = table->m_next;
+            s_remapSize -= table->m_size;
+            remapTableFree(table);
+        }
+    }
+
+    void imageSetRemapCacheSize(uint64_t _maxBytes)
+    {
+        bx::MutexScope lock(s_remapMutex);
+        s_remapMaxSize = _maxBytes;
+        remapCacheTrim();
+    }
+
+    // Returns cached table for _key, or NULL. Release it with remapCacheRelease().
+    static RemapTable* remapCacheAcquire(const RemapKey& _key)
+    {
+        bx::MutexScope lock(s_remapMutex);
+        for (RemapTable* table = s_remapTables; NULL != table; table = table->m_next)
+        {
+            if (0 == memcmp(&table->m_key, &_key, sizeof(RemapKey)))
+            {
+                table->m_refs++;
+                table->m_lastUse = ++s_remapUseCounter;
+                return table;
+            }
+        }
+
+        return NULL;
+    }
+
+    // Returns whether a table of _numTexels is allowed in the cache.
+    static bool remapCacheFits(uint64_t _numTexels)
+    {
+        bx::MutexScope lock(s_remapMutex);
+        return _numTexels*sizeof(RemapTexel) <= s_remapMaxSize;
+    }
+
+    // Takes ownership of _texels. If another thread inserted the same table meanwhile, that one is returned instead.
+    static RemapTable* remapCacheInsert(const RemapKey& _key, RemapTexel* _texels, uint64_t _numTexels)
+    {
+        RemapTable* table = remapCacheAcquire(_key);
+        if (NULL != table)
+        {
+            free(_texels);
+            return table;
+        }
+
+        table = (RemapTable*)malloc(sizeof(RemapTable));
+        MALLOC_CHECK(table);
+        table->m_key = _key;
+        table->m_texels = _texels;
+        table->m_size = _numTexels*sizeof(RemapTexel);
+        table->m_refs = 1;
+
+        bx::MutexScope lock(s_remapMutex);
+        table->m_lastUse = ++s_remapUseCounter;
+        table->m_next = s_remapTables;
+        s_remapTables = table;
+        s_remapSize += table->m_size;
+        remapCacheTrim();
+
+        return table;
+    }
+
+    static void remapCacheRelease(RemapTable* _table)
+    {
+        if (NULL != _table)
+        {
+            bx::MutexScope lock(s_remapMutex);
+            _table->m_refs--;
+            remapCacheTrim();
+        }
+    }
+
+    // Bilinear or nearest sample of rgba32f rows at _texel. Alpha is set to 1.0.
+    static inline void remapSample(float* _dst, const RemapTexel& _texel, const uint8_t* _srcData, uint32_t _srcPitch, uint32_t _srcWidth, uint32_t _srcHeight, bool _useBilinearInterpolation)
+    {
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+
+        if (_useBilinearInterpolation)
+        {
+            const uint32_t x0 = _texel.m_x;
+            const uint32_t y0 = _texel.m_y;
+            const uint32_t x1 = min(x0+1, _srcWidth-1);
+            const uint32_t y1 = min(y0+1, _srcHeight-1);
+
+            const float *src0 = (const float*)(_srcData + size_t(y0)*_srcPitch + x0*bytesPerPixel);
+            const float *src1 = (const float*)(_srcData + size_t(y0)*_srcPitch + x1*bytesPerPixel);
+            const float *src2 = (const float*)(_srcData + size_t(y1)*_srcPitch + x0*bytesPerPixel);
+            const float *src3 = (const float*)(_srcData + size_t(y1)*_srcPitch + x1*bytesPerPixel);
+
+            const float tx = _texel.m_tx;
+            const float ty = _texel.m_ty;
+            const float invTx = 1.0f - tx;
+            const float invTy = 1.0f - ty;
+
+            float p0[3];
+            float p1[3];
+            float p2[3];
+            float p3[3];
+            vec3Mul(p0, src0, invTx*invTy);
+            vec3Mul(p1, src1,    tx*invTy);
+            vec3Mul(p2, src2, invTx*   ty);
+            vec3Mul(p3, src3,    tx*   ty);
+
+            _dst[0] = p0[0] + p1[0] + p2[0] + p3[0];
+            _dst[1] = p0[1] + p1[1] + p2[1] + p3[1];
+            _dst[2] = p0[2] + p1[2] + p2[2] + p3[2];
+            _dst[3] = 1.0f;
+        }
+        else
+        {
+            const float *src = (const float*)(_srcData + size_t(_texel.m_y)*_srcPitch + _texel.m_x*bytesPerPixel);
+
+            _dst[0] = src[0];
+            _dst[1] = src[1];
+            _dst[2] = src[2];
+            _dst[3] = 1.0f;
+        }
+    }
+
+    static inline void remapTexelFromCoord(RemapTexel& _texel, float _xSrc, float _ySrc, uint8_t _face)
+    {
+        _texel.m_x = uint32_t(_xSrc);
+        _texel.m_y = uint32_t(_ySrc);
+        _texel.m_tx = _xSrc - float(int32_t(_texel.m_x));
+        _texel.m_ty = _ySrc - float(int32_t(_texel.m_y));
+        _texel.m_face = _face;
+    }
+
+    struct CubemapFromLatLongArgs
+    {
+        const uint8_t* m_srcRows;   // Rgba32f source rows, starting at m_srcFirstRow.
+        uint32_t m_srcWidth;
+        uint32_t m_srcHeight;
+        uint32_t m_srcFirstRow;
+        uint32_t m_ownBegin;        // Only texels sampled from source rows [m_ownBegin, m_ownEnd) are written.
+        uint32_t m_ownEnd;
+        const uint32_t* m_rowRanges; // Optional [min, max] source rows per destination row, used to skip rows.
+        const RemapTexel* m_remap;  // Optional remap table, otherwise mapping is computed on the fly.
+        RemapTexel* m_remapOut;     // Remap table being built by cubemapFromLatLongRemapRows().
+        void* m_dstData;
+        uint32_t m_dstFaceSize;
+        bool m_useBilinearInterpolation;
+    };
+
+    // Computes remap texels of _numRows destination rows starting at _row. Rows of all faces are numbered consecutively.
+    static void cubemapFromLatLongRemap(RemapTexel* _out, uint32_t _row, uint32_t _numRows, const float* _warpedU, const CubemapFromLatLongArgs& _args)
+    {
+        using namespace bx;
+
+        const uint32_t dstFaceSize = _args.m_dstFaceSize;
+        const float invDstFaceSizef = 1.0f/float(dstFaceSize);
+        const float4_t srcMaxX = float4_splat(float(int32_t(_args.m_srcWidth))-1.0f);
+        const float4_t srcMaxY = float4_splat(float(int32_t(_args.m_srcHeight))-1.0f);
+
+        for (uint32_t row = _row, end = _row+_numRows; row < end; ++row, _out += dstFaceSize)
+        {
+            const uint8_t face = uint8_t(row/dstFaceSize);
+            const uint32_t yy = row%dstFaceSize;
+            const float vv = texelCoordWarp(2.0f*yy*invDstFaceSizef-1.0f, dstFaceSize);
+
+            for (uint32_t xBegin = 0; xBegin < dstFaceSize; xBegin += 4)
+            {
+                // Cubemap vectors (x,y,z) of four texels. Same operations as texelCoordToVec().
+                const uint32_t last = dstFaceSize-1;
+                const float4_t uu = float4_ld(_warpedU[xBegin]
+                                            , _warpedU[min(xBegin+1, last)]
+                                            , _warpedU[min(xBegin+2, last)]
+                                            , _warpedU[min(xBegin+3, last)]
+                                            );
+
+                float4_t vec[3];
+                for (uint8_t ii = 0; ii < 3; ++ii)
+                {
+                    const float4_t tmp0 = float4_mul(float4_splat(s_faceUvVectors[face][0][ii]), uu);
+                    const float4_t tmp1 = float4_splat(s_faceUvVectors[face][1][ii]*vv);
+                    vec[ii] = float4_add(float4_add(tmp0, tmp1), float4_splat(s_faceUvVectors[face][2][ii]));
+                }
+
+                const float4_t len = float4_sqrt(float4_add(float4_add(float4_mul(vec[0], vec[0])
+                                                                     , float4_mul(vec[1], vec[1]))
+                                                                     , float4_mul(vec[2], vec[2])));
+                const float4_t invLen = float4_div(float4_splat(1.0f), len);
+
+                // Convert cubemap vectors (x,y,z) to latlong (u,v).
+                float4_t srcCoord[2];
+                latLongFromVec4(srcCoord[0], srcCoord[1]
+                              , float4_mul(vec[0], invLen)
+                              , float4_mul(vec[1], invLen)
+                              , float4_mul(vec[2], invLen)
+                              );
+
+                // Convert from [0..1] to [0..(size-1)] range.
+                srcCoord[0] = float4_mul(srcCoord[0], srcMaxX);
+                srcCoord[1] = float4_mul(srcCoord[1], srcMaxY);
+                const float* xSrc = (const float*)&srcCoord[0];
+                const float* ySrc = (const float*)&srcCoord[1];
+
+                for (uint32_t lane = 0, numLanes = min(UINT32_C(4), dstFaceSize-xBegin); lane < numLanes; ++lane)
+                {
+                    remapTexelFromCoord(_out[xBegin+lane], xSrc[lane], ySrc[lane], 0);
+                }
+            }
+        }
+    }
+
+    // Edge fixed up cubemap u coordinates, the same for every row. Release with free().
+    static float* cubemapWarpedU(uint32_t _dstFaceSize)
+    {
+        float* warpedU = (float*)malloc(_dstFaceSize*sizeof(float));
+        MALLOC_CHECK(warpedU);
+
+        const float invDstFaceSizef = 1.0f/float(_dstFaceSize);
+        for (uint32_t xx = 0; xx < _dstFaceSize; ++xx)
+        {
+            warpedU[xx] = texelCoordWarp(2.0f*xx*invDstFaceSizef-1.0f, _dstFaceSize);
+        }
+
+        return warpedU;
+    }
+
+    static void cubemapFromLatLongRemapRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const CubemapFromLatLongArgs* args = (const CubemapFromLatLongArgs*)_userData;
+
+        float* warpedU = cubemapWarpedU(args->m_dstFaceSize);
+        cubemapFromLatLongRemap(args->m_remapOut + size_t(_begin)*args->m_dstFaceSize, _begin, _end-_begin, warpedU, *args);
+        free(warpedU);
+    }
+
+    static void cubemapFromLatLongRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const CubemapFromLatLongArgs* args = (const CubemapFromLatLongArgs*)_userData;
+        const uint32_t ownBegin = args->m_ownBegin;
+        const uint32_t ownEnd = args->m_ownEnd;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstFaceSize = args->m_dstFaceSize;
+        const uint32_t dstPitch = dstFaceSize * bytesPerPixel;
+        const uint64_t dstFaceDataSize = uint64_t(dstPitch) * dstFaceSize;
+
+        // Get source parameters.
+        const uint32_t srcPitch = args->m_srcWidth * bytesPerPixel;
+        const uint8_t* srcData = args->m_srcRows - size_t(args->m_srcFirstRow)*srcPitch;
+
+        // Without a remap table, mapping of each row is computed into a scratch row.
+        float* warpedU = NULL;
+        RemapTexel* scratch = NULL;
+        if (NULL == args->m_remap)
+        {
+            warpedU = cubemapWarpedU(dstFaceSize);
+            scratch = (RemapTexel*)malloc(dstFaceSize*sizeof(RemapTexel));
+            MALLOC_CHECK(scratch);
+        }
+
+        // Rows of all faces are numbered consecutively.
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            if (NULL != args->m_rowRanges
+            && (args->m_rowRanges[row*2+1] < ownBegin || args->m_rowRanges[row*2] >= ownEnd))
+            {
+                continue;
+            }
+
+            const RemapTexel* texels = args->m_remap + size_t(row)*dstFaceSize;
+            if (NULL == args->m_remap)
+            {
+                cubemapFromLatLongRemap(scratch, row, 1, warpedU, *args);
+                texels = scratch;
+            }
+
+            const uint8_t face = uint8_t(row/dstFaceSize);
+            const uint32_t yy = row%dstFaceSize;
+
+            uint8_t* dstFaceData = (uint8_t*)args->m_dstData + face*dstFaceDataSize;
+            uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*dstPitch;
+            for (uint32_t xx = 0; xx < dstFaceSize; ++xx)
+            {
+                // Sample from latlong (u,v).
+                if (texels[xx].m_y >= ownBegin && texels[xx].m_y < ownEnd)
+                {
+                    float* dstColumnData = (float*)((uint8_t*)dstRowData + xx*bytesPerPixel);
+                    remapSample(dstColumnData, texels[xx], srcData, srcPitch, args->m_srcWidth, args->m_srcHeight, args->m_useBilinearInterpolation);
+                }
+            }
+        }
+
+        free(scratch);
+        free(warpedU);
+    }
+
+    // Returns cached remap table of a cubemap from latlong conversion, building it if it fits into the cache. NULL if caching is disabled.
+    static RemapTable* cubemapFromLatLongRemapTable(CubemapFromLatLongArgs& _args)
+    {
+        RemapKey key;
+        key.m_type = 0;
+        key.m_srcWidth = _args.m_srcWidth;
+        key.m_srcHeight = _args.m_srcHeight;
+        key.m_dstWidth = _args.m_dstFaceSize;
+        key.m_dstHeight = _args.m_dstFaceSize;
+
+        RemapTable* table = remapCacheAcquire(key);
+        const uint64_t numTexels = uint64_t(CUBE_FACE_NUM)*_args.m_dstFaceSize*_args.m_dstFaceSize;
+        if (NULL == table && remapCacheFits(numTexels))
+        {
+            _args.m_remapOut = (RemapTexel*)malloc(numTexels*sizeof(RemapTexel));
+            MALLOC_CHECK(_args.m_remapOut);
+            parallelFor(cubemapFromLatLongRemapRows, (void*)&_args, CUBE_FACE_NUM*_args.m_dstFaceSize, 16);
+
+            table = remapCacheInsert(key, _args.m_remapOut, numTexels);
+            _args.m_remapOut = NULL;
+        }
+
+        _args.m_remap = (NULL != table) ? table->m_texels : NULL;
+        return table;
+    }
+
+    /// Computes [min, max] source row sampled by each destination row of imageCubemapFromLatLong().
+    static void cubemapFromLatLongRowRanges(uint32_t* _rowRanges, uint32_t _dstFaceSize, uint32_t _srcHeight)
+    {
+        // Along a face row, the sampled latlong row only depends on the distance from the face center,
+        // so the extremes are at the row ends and in the middle. One row of margin covers rounding and bilinear filtering.
+        const float srcHeightf = float(int32_t(_srcHeight));
+        const float invDstFaceSizef = 1.0f/float(_dstFaceSize);
+        const uint32_t columns[5] =
+        {
+            0,
+            _dstFaceSize-1,
+            (_dstFaceSize-1)/2,
+            _dstFaceSize/2,
+            min(_dstFaceSize/2+1, _dstFaceSize-1),
+        };
+
+        for (uint32_t row = 0; row < CUBE_FACE_NUM*_dstFaceSize; ++row)
+        {
+            const uint8_t face = uint8_t(row/_dstFaceSize);
+            const uint32_t yy = row%_dstFaceSize;
+            const float vv = 2.0f*yy*invDstFaceSizef-1.0f;
+
+            uint32_t rowMin = UINT32_MAX;
+            uint32_t rowMax = 0;
+            for (uint8_t ii = 0; ii < CMFT_COUNTOF(columns); ++ii)
+            {
+                const float uu = 2.0f*columns[ii]*invDstFaceSizef-1.0f;
+
+                float vec[3];
+                texelCoordToVec(vec, uu, vv, face, _dstFaceSize);
+
+                float xSrc;
+                float ySrc;
+                latLongFromVec(xSrc, ySrc, vec);
+
+                const uint32_t y0 = uint32_t(ySrc*(srcHeightf-1.0f));
+                rowMin = min(rowMin, y0);
+                rowMax = max(rowMax, y0);
+            }
+
+            _rowRanges[row*2+0] = (0 != rowMin) ? rowMin-1 : 0;
+            _rowRanges[row*2+1] = min(rowMax+1, _srcHeight-1);
+        }
+    }
+
+    /// Reads _numRows rgba32f rows of a latlong source starting at _firstRow. Rows are read in order, each of them once.
+    typedef bool (*LatLongReadRowsFn)(float* _rows, uint32_t _firstRow, uint32_t _numRows, void* _userData);
+
+    /// Converts latlong source to rgba32f cubemap while reading it, only a band of _bandRows source rows is kept in memory.
+    /// Destination texels are written as soon as the band holding their source texels is read, result is the same as converting
+    /// the whole source at once. Band size is picked from CMFT_LATLONG_BAND_SIZE if _bandRows is 0.
+    static bool cubemapFromLatLongBands(Image& _dst
+                                      , uint32_t _srcWidth
+                                      , uint32_t _srcHeight
+                                      , LatLongReadRowsFn _readRows
+                                      , void* _userData
+                                      , bool _useBilinearInterpolation
+                                      , uint32_t _bandRows
+                                      )
+    {
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t srcPitch = _srcWidth * bytesPerPixel;
+
+        // Band has to hold at least two rows, the last row of each band is kept as the first row of the next one.
+        const uint32_t bandRows = min(_srcHeight, max(UINT32_C(2), (0 != _bandRows) ? _bandRows : uint32_t(CMFT_LATLONG_BAND_SIZE/srcPitch)));
+        uint8_t* band = (uint8_t*)allocScratch(size_t(bandRows)*srcPitch, AllocTag::IoBuffer);
+        MALLOC_CHECK(band);
+        if (NULL == band)
+        {
+            return false;
+        }
+
+        // Alloc data.
+        const uint32_t dstFaceSize = (_srcHeight+1)/2;
+        const uint32_t dstPitch = dstFaceSize * bytesPerPixel;
+        const uint64_t dstFaceDataSize = uint64_t(dstPitch) * dstFaceSize;
+        const uint64_t dstDataSize = dstFaceDataSize * CUBE_FACE_NUM;
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+        if (NULL == dstData)
+        {
+            freeScratch(band);
+            return false;
+        }
+
+        uint32_t* rowRanges = (uint32_t*)malloc(CUBE_FACE_NUM*dstFaceSize*2*sizeof(uint32_t));
+        MALLOC_CHECK(rowRanges);
+        cubemapFromLatLongRowRanges(rowRanges, dstFaceSize, _srcHeight);
+
+        CubemapFromLatLongArgs args;
+        args.m_srcRows = band;
+        args.m_srcWidth = _srcWidth;
+        args.m_srcHeight = _srcHeight;
+        args.m_rowRanges = rowRanges;
+        args.m_remap = NULL;
+        args.m_remapOut = NULL;
+        args.m_dstData = dstData;
+        args.m_dstFaceSize = dstFaceSize;
+        args.m_useBilinearInterpolation = _useBilinearInterpolation;
+        RemapTable* remap = cubemapFromLatLongRemapTable(args);
+
+        // Read source in bands of rows and write destination texels sampled from each band.
+        bool read = true;
+        uint32_t firstRow = 0;
+        uint32_t numRows = 0;
+        for (;;)
+        {
+            const uint32_t numRead = min(bandRows, _srcHeight-firstRow) - numRows;
+            read = _readRows((float*)(band + size_t(numRows)*srcPitch), firstRow+numRows, numRead, _userData);
+            if (!read)
+            {
+                break;
+            }
+            numRows += numRead;
+
+            // Texels sampling the last row of a band are written with the next band, which has the row below.
+            const uint32_t endRow = firstRow+numRows;
+            args.m_srcFirstRow = firstRow;
+            args.m_ownBegin = firstRow;
+            args.m_ownEnd = (_srcHeight == endRow) ? endRow : endRow-1;
+            parallelFor(cubemapFromLatLongRows, (void*)&args, CUBE_FACE_NUM*dstFaceSize, 16);
+
+            if (_srcHeight == endRow)
+            {
+                break;
+            }
+
+            memcpy(band, band + size_t(numRows-1)*srcPitch, srcPitch);
+            firstRow = endRow-1;
+            numRows = 1;
+        }
+
+        remapCacheRelease(remap);
+        free(rowRanges);
+        freeScratch(band);
+
+        if (!read)
+        {
+            getAllocator()->free(dstData);
+            return false;
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = 1;
+        result.m_numFaces = 6;
+        result.m_data = dstData;
+
+        // Output.
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    struct LatLongImageRows
+    {
+        const uint8_t* m_data;
+        uint64_t m_pitch;
+        uint32_t m_width;
+        TextureFormat::Enum m_format;
+    };
+
+    static bool latLongImageReadRows(float* _rows, uint32_t _firstRow, uint32_t _numRows, void* _userData)
+    {
+        const LatLongImageRows* rows = (const LatLongImageRows*)_userData;
+        convertPixels(_rows, TextureFormat::RGBA32F, rows->m_data + _firstRow*rows->m_pitch, rows->m_format, _numRows*rows->m_width, NULL);
+        return true;
+    }
+
+    bool imageCubemapFromLatLong(Image& _dst, const Image& _src, bool _useBilinearInterpolation)
+    {
+        if (!imageIsLatLong(_src))
+        {
+            return false;
+        }
+
+        // Other formats are converted to rgba32f a band of rows at a time, instead of keeping a converted copy of the whole source.
+        if (TextureFormat::RGBA32F != _src.m_format
+        &&  0 == _src.m_faceTransforms
+        &&  0 == getImageDataInfo(_src.m_format).m_blockBytes)
+        {
+            LatLongImageRows rows;
+            rows.m_data = (const uint8_t*)_src.m_data;
+            rows.m_pitch = uint64_t(_src.m_width)*getImageDataInfo(_src.m_format).m_bytesPerPixel;
+            rows.m_width = _src.m_width;
+            rows.m_format = (TextureFormat::Enum)_src.m_format;
+
+            Image result;
+            if (!cubemapFromLatLongBands(result, _src.m_width, _src.m_height, latLongImageReadRows, (void*)&rows, _useBilinearInterpolation, 0))
+            {
+                return false;
+            }
+
+            // Convert result to source format.
+            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
+            imageUnload(result);
+
+            return true;
+        }
+
+        // Conversion is done in rgba32f format.
+        Image imageRgba32f;
+        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+
+        // Alloc data.
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstFaceSize = (imageRgba32f.m_height+1)/2;
+        const uint32_t dstPitch = dstFaceSize * bytesPerPixel;
+        const uint64_t dstFaceDataSize = uint64_t(dstPitch) * dstFaceSize;
+        const uint64_t dstDataSize = dstFaceDataSize * CUBE_FACE_NUM;
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        // Iterate over destination image (cubemap).
+        CubemapFromLatLongArgs args;
+        args.m_srcRows = (const uint8_t*)imageRgba32f.m_data;
+        args.m_srcWidth = imageRgba32f.m_width;
+        args.m_srcHeight = imageRgba32f.m_height;
+        args.m_srcFirstRow = 0;
+        args.m_ownBegin = 0;
+        args.m_ownEnd = imageRgba32f.m_height;
+        args.m_rowRanges = NULL;
+        args.m_remap = NULL;
+        args.m_remapOut = NULL;
+        args.m_dstData = dstData;
+        args.m_dstFaceSize = dstFaceSize;
+        args.m_useBilinearInterpolation = _useBilinearInterpolation;
+
+        RemapTable* remap = cubemapFromLatLongRemapTable(args);
+        parallelFor(cubemapFromLatLongRows, (void*)&args, CUBE_FACE_NUM*dstFaceSize, 16);
+        remapCacheRelease(remap);
+
+        // Fill image structure.
+        Image result;
+        result.m_width = dstFaceSize;
+        result.m_height = dstFaceSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = 1;
+        result.m_numFaces = 6;
+        result.m_data = dstData;
+
+        // Convert result to source format.
+        if (TextureFormat::RGBA32F == _src.m_format)
+        {
+            imageMove(_dst, result);
+        }
+        else
+        {
+            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
+            imageUnload(result);
+        }
+
+        // Cleanup.
+        if (!imageIsRef)
+        {
+            imageUnload(imageRgba32f);
+        }
+
+        return true;
+    }
+
+    void imageCubemapFromLatLong(Image& _image, bool _useBilinearInterpolation)
+    {
+        Image tmp;
+        if (imageCubemapFromLatLong(tmp, _image, _useBilinearInterpolation))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    struct LatLongFromCubemapArgs
+    {
+        const Image* m_src;
+        const uint64_t (*m_srcOffsets)[MAX_MIP_NUM];
+        uint8_t* m_dstMipData;
+        const float* m_phiCosSin;   // cos(phi), sin(phi) per destination column.
+        const RemapTexel* m_remap;  // Optional remap table, otherwise mapping is computed on the fly.
+        RemapTexel* m_remapOut;     // Remap table being built by latLongFromCubemapRemapRows().
+        uint32_t m_dstWidth;
+        uint32_t m_dstHeight;
+        uint8_t m_mip;
+        bool m_useBilinearInterpolation;
+    };
+
+    // Computes remap texels of destination row _yy.
+    static void latLongFromCubemapRemap(RemapTexel* _out, uint32_t _yy, const LatLongFromCubemapArgs& _args)
+    {
+        const uint8_t mip = _args.m_mip;
+        const uint32_t dstMipWidth  = max(UINT32_C(1), _args.m_dstWidth  >> mip);
+        const uint32_t dstMipHeight = max(UINT32_C(1), _args.m_dstHeight >> mip);
+        const float invDstHeightf = 1.0f/float(dstMipHeight-1);
+
+        const float srcWidthf  = float(int32_t(max(UINT32_C(1), _args.m_src->m_width  >> mip)));
+        const float srcHeightf = float(int32_t(max(UINT32_C(1), _args.m_src->m_height >> mip)));
+
+        // Latlong y. Same operations as vecFromLatLong(), theta is constant along the row.
+        const float yDst = _yy*invDstHeightf;
+        const float theta = yDst * float(M_PI);
+        const float sinTheta = sinf(theta);
+        const float cosTheta = cosf(theta);
+
+        for (uint32_t xx = 0; xx < dstMipWidth; ++xx)
+        {
+            // Get cubemap vector (x,y,z) coresponding to latlong (x,y).
+            float vec[3];
+            vec[0] = sinTheta*_args.m_phiCosSin[xx*2];
+            vec[1] = cosTheta;
+            vec[2] = -sinTheta*_args.m_phiCosSin[xx*2+1];
+
+            // Get cubemap (u,v,faceIdx) from cubemap vector (x,y,z).
+            float xSrc;
+            float ySrc;
+            uint8_t faceIdx;
+            vecToTexelCoord(xSrc, ySrc, faceIdx, vec);
+
+            // Convert from [0-1] to [0-size] range.
+            remapTexelFromCoord(_out[xx], xSrc*srcWidthf, ySrc*srcHeightf, faceIdx);
+        }
+    }
+
+    static void latLongFromCubemapRemapRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const LatLongFromCubemapArgs* args = (const LatLongFromCubemapArgs*)_userData;
+        const uint32_t dstMipWidth = max(UINT32_C(1), args->m_dstWidth >> args->m_mip);
+
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            latLongFromCubemapRemap(args->m_remapOut + size_t(yy)*dstMipWidth, yy, *args);
+        }
+    }
+
+    static void latLongFromCubemapRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const LatLongFromCubemapArgs* args = (const LatLongFromCubemapArgs*)_userData;
+        const Image& imageRgba32f = *args->m_src;
+        const uint8_t mip = args->m_mip;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstMipWidth = max(UINT32_C(1), args->m_dstWidth >> mip);
+        const uint32_t dstMipPitch = dstMipWidth * bytesPerPixel;
+
+        const uint32_t srcMipWidth  = max(UINT32_C(1), imageRgba32f.m_width  >> mip);
+        const uint32_t srcMipHeight = max(UINT32_C(1), imageRgba32f.m_height >> mip);
+        const uint32_t srcPitch = srcMipWidth * bytesPerPixel;
+
+        // Without a remap table, mapping of each row is computed into a scratch row.
+        RemapTexel* scratch = NULL;
+        if (NULL == args->m_remap)
+        {
+            scratch = (RemapTexel*)malloc(dstMipWidth*sizeof(RemapTexel));
+            MALLOC_CHECK(scratch);
+        }
+
+        uint8_t* dstMipData = args->m_dstMipData;
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            const RemapTexel* texels = args->m_remap + size_t(yy)*dstMipWidth;
+            if (NULL == args->m_remap)
+            {
+                latLongFromCubemapRemap(scratch, yy, *args);
+                texels = scratch;
+            }
+
+            uint8_t* dstRowData = (uint8_t*)dstMipData + size_t(yy)*dstMipPitch;
+            for (uint32_t xx = 0; xx < dstMipWidth; ++xx)
+            {
+                // Sample from cubemap (u,v, faceIdx).
+                float* dstColumnData = (float*)((uint8_t*)dstRowData + xx*bytesPerPixel);
+                const uint8_t* srcFaceData = (const uint8_t*)imageRgba32f.m_data + args->m_srcOffsets[texels[xx].m_face][mip];
+                remapSample(dstColumnData, texels[xx], srcFaceData, srcPitch, srcMipWidth, srcMipHeight, args->m_useBilinearInterpolation);
+            }
+        }
+
+        free(scratch);
+    }
+
+    bool imageLatLongFromCubemap(Image& _dst, const Image& _src, bool _useBilinearInterpolation)
+    {
+        // Input check.
+        if(!imageIsCubemap(_src))
+        {
+            return false;
+        }
+
+        // Conversion is done in rgba32f format.
+        Image imageRgba32f;
+        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+
+        // Alloc data.
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstHeight = imageRgba32f.m_height*2;
+        const uint32_t dstWidth = imageRgba32f.m_height*4;
+        uint64_t dstDataSize = 0;
+        uint64_t dstMipOffsets[MAX_MIP_NUM];
+        for (uint8_t mip = 0; mip < imageRgba32f.m_numMips; ++mip)
+        {
+            dstMipOffsets[mip] = dstDataSize;
+            const uint32_t dstMipWidth  = max(UINT32_C(1), dstWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
+            dstDataSize += uint64_t(dstMipWidth) * mipHeight * bytesPerPixel;
+        }
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        // Get source image parameters.
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, imageRgba32f);
+
+        // Phi depends only on destination column.
+        float* phiCosSin = (float*)malloc(dstWidth*2*sizeof(float));
+        MALLOC_CHECK(phiCosSin);
+
+        // Iterate over destination image (latlong).
+        for (uint8_t mip = 0; mip < imageRgba32f.m_numMips; ++mip)
+        {
+            const uint32_t dstMipWidth = max(UINT32_C(1), dstWidth >> mip);
+            const float invDstWidthf = 1.0f/float(dstMipWidth-1);
+            for (uint32_t xx = 0; xx < dstMipWidth; ++xx)
+            {
+                const float xDst = xx*invDstWidthf;
+                const float phi = xDst * float(M_PI)*2.0f;
+                phiCosSin[xx*2]   = cosf(phi);
+                phiCosSin[xx*2+1] = sinf(phi);
+            }
+
+            LatLongFromCubemapArgs args;
+            args.m_src = &imageRgba32f;
+            args.m_srcOffsets = srcOffsets;
+            args.m_dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
+            args.m_phiCosSin = phiCosSin;
+            args.m_remap = NULL;
+            args.m_remapOut = NULL;
+            args.m_dstWidth = dstWidth;
+            args.m_dstHeight = dstHeight;
+            args.m_mip = mip;
+            args.m_useBilinearInterpolation = _useBilinearInterpolation;
+
+            // Use or build cached remap table.
+            const uint32_t dstMipHeight = max(UINT32_C(1), dstHeight >> mip);
+            RemapKey key;
+            key.m_type = 1;
+            key.m_srcWidth  = max(UINT32_C(1), imageRgba32f.m_width  >> mip);
+            key.m_srcHeight = max(UINT32_C(1), imageRgba32f.m_height >> mip);
+            key.m_dstWidth  = dstMipWidth;
+            key.m_dstHeight = dstMipHeight;
+
+            RemapTable* remap = remapCacheAcquire(key);
+            const uint64_t numTexels = uint64_t(dstMipWidth)*dstMipHeight;
+            if (NULL == remap && remapCacheFits(numTexels))
+            {
+                args.m_remapOut = (RemapTexel*)malloc(numTexels*sizeof(RemapTexel));
+                MALLOC_CHECK(args.m_remapOut);
+                parallelFor(latLongFromCubemapRemapRows, (void*)&args, dstMipHeight, 16);
+
+                remap = remapCacheInsert(key, args.m_remapOut, numTexels);
+                args.m_remapOut = NULL;
+            }
+            args.m_remap = (NULL != remap) ? remap->m_texels : NULL;
+
+            parallelFor(latLongFromCubemapRows, (void*)&args, dstMipHeight, 16);
+            remapCacheRelease(remap);
+        }
+
+        free(phiCosSin);
+
+        // Fill image structure.
+        Image result;
+        result.m_width = dstWidth;
+        result.m_height = dstHeight;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = imageRgba32f.m_numMips;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
+
+        // Convert back to source format.
+        if (TextureFormat::RGBA32F == _src.m_format)
+        {
+            imageMove(_dst, result);
+        }
+        else
+        {
+            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
+            imageUnload(result);
+        }
+
+        // Cleanup.
+        if (!imageIsRef)
+        {
+            imageUnload(imageRgba32f);
+        }
+
+        return true;
+    }
+
+    void imageLatLongFromCubemap(Image& _cubemap, bool _useBilinearInterpolation)
+    {
+        Image tmp;
+        if (imageLatLongFromCubemap(tmp, _cubemap, _useBilinearInterpolation))
+        {
+            imageMove(_cubemap, tmp);
+        }
+    }
+
+    struct OctahedralFromCubemapArgs
+    {
+        const Image* m_src;
+        const uint64_t (*m_srcOffsets)[MAX_MIP_NUM];
+        uint8_t* m_dstMipData;
+        uint32_t m_dstMipSize;
+        uint8_t m_mip;
+        bool m_useBilinearInterpolation;
+    };
+
+    static void octahedralFromCubemapRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const OctahedralFromCubemapArgs* args = (const OctahedralFromCubemapArgs*)_userData;
+        const Image& imageRgba32f = *args->m_src;
+        const uint8_t mip = args->m_mip;
+
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstMipSize = args->m_dstMipSize;
+        const uint32_t dstMipPitch = dstMipSize * bytesPerPixel;
+        const float invDstMipSize = 1.0f/float(int32_t(dstMipSize));
+
+        const uint32_t srcMipSize = max(UINT32_C(1), imageRgba32f.m_width >> mip);
+        const uint32_t srcPitch = srcMipSize * bytesPerPixel;
+        const float srcMipSizef = float(int32_t(srcMipSize));
+        const float srcMaxCoord = srcMipSizef - 0.001f;
+
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            float* dstRowData = (float*)(args->m_dstMipData + size_t(yy)*dstMipPitch);
+            const float vv = (float(int32_t(yy))+0.5f)*invDstMipSize;
+            for (uint32_t xx = 0; xx < dstMipSize; ++xx)
+            {
+                const float uu = (float(int32_t(xx))+0.5f)*invDstMipSize;
+
+                float vec[3];
+                vecFromOctahedral(vec, uu, vv);
+
+                float xSrc;
+                float ySrc;
+                uint8_t faceIdx;
+                vecToTexelCoord(xSrc, ySrc, faceIdx, vec);
+
+                RemapTexel texel;
+                remapTexelFromCoord(texel, min(xSrc*srcMipSizef, srcMaxCoord), min(ySrc*srcMipSizef, srcMaxCoord), faceIdx);
+
+                const uint8_t* srcFaceData = (const uint8_t*)imageRgba32f.m_data + args->m_srcOffsets[faceIdx][mip];
+                remapSample(dstRowData + xx*4, texel, srcFaceData, srcPitch, srcMipSize, srcMipSize, args->m_useBilinearInterpolation);
+            }
+        }
+    }
+
+    bool imageOctahedralFromCubemap(Image& _dst, const Image& _src, bool _useBilinearInterpolation)
+    {
+        // Input check.
+        if(!imageIsCubemap(_src))
+        {
+            return false;
+        }
+
+        // Conversion is done in rgba32f format.
+        Image imageRgba32f;
+        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+
+        // Alloc data. Map is twice the face size, it has 4/6 texels of the cubemap.
+        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
+        const uint32_t dstSize = imageRgba32f.m_width*2;
+        uint64_t dstDataSize = 0;
+        uint64_t dstMipOffsets[MAX_MIP_NUM];
+        for (uint8_t mip = 0; mip < imageRgba32f.m_numMips; ++mip)
+        {
+            dstMipOffsets[mip] = dstDataSize;
+            const uint32_t dstMipSize = max(UINT32_C(1), dstSize >> mip);
+            dstDataSize += uint64_t(dstMipSize) * dstMipSize * bytesPerPixel;
+        }
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        // Get source image parameters.
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, imageRgba32f);
+
+        // Iterate over destination image (octahedral).
+        for (uint8_t mip = 0; mip < imageRgba32f.m_numMips; ++mip)
+        {
+            OctahedralFromCubemapArgs args;
+            args.m_src = &imageRgba32f;
+            args.m_srcOffsets = srcOffsets;
+            args.m_dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
+            args.m_dstMipSize = max(UINT32_C(1), dstSize >> mip);
+            args.m_mip = mip;
+            args.m_useBilinearInterpolation = _useBilinearInterpolation;
+
+            parallelFor(octahedralFromCubemapRows, (void*)&args, args.m_dstMipSize, 16);
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = dstSize;
+        result.m_height = dstSize;
+        result.m_dataSize = dstDataSize;
+        result.m_format = TextureFormat::RGBA32F;
+        result.m_numMips = imageRgba32f.m_numMips;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
+
+        // Convert back to source format.
+        if (TextureFormat::RGBA32F == _src.m_format)
+        {
+            imageMove(_dst, result);
+        }
+        else
+        {
+            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
+            imageUnload(result);
+        }
+
+        // Cleanup.
+        if (!imageIsRef)
+        {
+            imageUnload(imageRgba32f);
+        }
+
+        return true;
+    }
+
+    void imageOctahedralFromCubemap(Image& _cubemap, bool _useBilinearInterpolation)
+    {
+        Image tmp;
+        if (imageOctahedralFromCubemap(tmp, _cubemap, _useBilinearInterpolation))
+        {
+            imageMove(_cubemap, tmp);
+        }
+    }
+
+    bool imageHStripFromCubemap(Image& _dst, const Image& _src)
+    {
+        // Input check.
+        if(!imageIsCubemap(_src))
+        {
+            return false;
+        }
+
+        // Faces are copied as stored, recorded face transforms are applied first.
+        if (0 != _src.m_faceTransforms)
+        {
+            Image transformed;
+            imageConvert(transformed, (TextureFormat::Enum)_src.m_format, _src);
+            const bool result = imageHStripFromCubemap(_dst, transformed);
+            imageUnload(transformed);
+            return result;
+        }
+
+        // Calculate destination offsets and alloc data.
+        uint64_t dstDataSize = 0;
+        uint64_t dstMipOffsets[MAX_MIP_NUM];
+        const uint32_t dstWidth = _src.m_width*6;
+        const uint32_t dstHeight = _src.m_width;
+        const uint32_t bytesPerPixel = getImageDataInfo(_src.m_format).m_bytesPerPixel;
+        for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
+        {
+            dstMipOffsets[mip] = dstDataSize;
+            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
+
+            dstDataSize += uint64_t(mipWidth) * mipHeight * bytesPerPixel;
+        }
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        // Get source image offsets.
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, _src);
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
+            {
+                // Get src data ptr for current mip and face.
+                const uint8_t* srcFaceData = (const uint8_t*)_src.m_data + srcOffsets[face][mip];
+
+                // Get dst ptr for current mip level.
+                uint8_t* dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
+
+                // Advance by (srcPitch * faceIdx) to get to the desired face in the strip.
+                const uint32_t srcMipSize = max(UINT32_C(1), _src.m_width >> mip);
+                const uint32_t srcMipPitch = srcMipSize * bytesPerPixel;
+                uint8_t* dstFaceData = (uint8_t*)dstMipData + srcMipPitch*face;
+
+                const uint32_t dstMipPitch = srcMipPitch*6;
+
+                for (uint32_t yy = 0; yy < srcMipSize; ++yy)
+                {
+                    const uint8_t* srcRowData = (const uint8_t*)srcFaceData + yy*srcMipPitch;
+                    uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*dstMipPitch;
+
+                    memcpy(dstRowData, srcRowData, srcMipPitch);
+                }
+            }
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = dstWidth;
+        result.m_height = dstHeight;
+        result.m_dataSize = dstDataSize;
+        result.m_format = _src.m_format;
+        result.m_numMips = _src.m_numMips;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
+
+        // Output.
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    void imageHStripFromCubemap(Image& _cubemap)
+    {
+        Image tmp;
+        if (imageHStripFromCubemap(tmp, _cubemap))
+        {
+            imageMove(_cubemap, tmp);
+        }
+    }
+
+    bool imageCubemapFromHStrip(Image& _dst, const Image& _src)
+    {
+        ImageView view;
+        if (!imageViewFromHStrip(view, _src))
+        {
+            return false;
+        }
+
+        return imageFromView(_dst, view, _src.m_format);
+    }
+
+    void imageCubemapFromHStrip(Image& _image)
+    {
+        Image tmp;
+        if (imageCubemapFromHStrip(tmp, _image))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    bool imageFaceListFromCubemap(Image _faceList[6], const Image& _cubemap)
+    {
+        // Input check.
+        if(!imageIsCubemap(_cubemap))
+        {
+            return false;
+        }
+
+        // Faces are copied as stored, recorded face transforms are applied first.
+        if (0 != _cubemap.m_faceTransforms)
+        {
+            Image transformed;
+            imageConvert(transformed, (TextureFormat::Enum)_cubemap.m_format, _cubemap);
+            const bool result = imageFaceListFromCubemap(_faceList, transformed);
+            imageUnload(transformed);
+            return result;
+        }
+
+        // Get destination sizes and offsets.
+        uint64_t dstDataSize = 0;
+        uint64_t dstMipOffsets[MAX_MIP_NUM];
+        const uint8_t bytesPerPixel = getImageDataInfo(_cubemap.m_format).m_bytesPerPixel;
+        for (uint8_t mip = 0; mip < _cubemap.m_numMips; ++mip)
+        {
+            dstMipOffsets[mip] = dstDataSize;
+            const uint32_t mipSize = max(UINT32_C(1), _cubemap.m_width >> mip);
+            dstDataSize += uint64_t(mipSize) * mipSize * bytesPerPixel;
+        }
+
+        // Get source offsets.
+        uint64_t cubemapOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(cubemapOffsets, _cubemap);
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            void* dstData = getAllocator()->alloc(dstDataSize);
+            MALLOC_CHECK(dstData);
+
+            for (uint8_t mip = 0; mip < _cubemap.m_numMips; ++mip)
+            {
+                const uint8_t* srcFaceData = (const uint8_t*)_cubemap.m_data + cubemapOffsets[face][mip];
+                uint8_t* dstFaceData = (uint8_t*)dstData + dstMipOffsets[mip];
+
+                const uint32_t mipFaceSize = max(UINT32_C(1), _cubemap.m_width >> mip);
+                const uint32_t mipPitch = mipFaceSize * bytesPerPixel;
+
+                for (uint32_t yy = 0; yy < mipFaceSize; ++yy)
+                {
+                    const uint8_t* srcRowData = (const uint8_t*)srcFaceData + yy*mipPitch;
+                    uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*mipPitch;
+
+                    memcpy(dstRowData, srcRowData, mipPitch);
+                }
+            }
+
+            // Fill image structure.
+            Image result;
+            result.m_width = _cubemap.m_width;
+            result.m_height = _cubemap.m_height;
+            result.m_dataSize = dstDataSize;
+            result.m_format = _cubemap.m_format;
+            result.m_numMips = _cubemap.m_numMips;
+            result.m_numFaces = 1;
+            result.m_data = dstData;
+
+            // Output.
+            imageMove(_faceList[face], result);
+        }
+
+        return true;
+    }
+
+    bool imageCubemapFromFaceList(Image& _cubemap, const Image _faceList[6])
+    {
+        // Input check.
+        if (!imageValidCubemapFaceList(_faceList))
+        {
+            return false;
+        }
+
+        // Alloc destination data.
+        const uint64_t dstDataSize = _faceList[0].m_dataSize * 6;
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        // Get source offsets.
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, _faceList[0]);
+        const uint32_t bytesPerPixel = getImageDataInfo(_faceList[0].m_format).m_bytesPerPixel;
+
+        // Copy data.
+        uint64_t destinationOffset = 0;
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            const uint8_t* srcFaceData = (const uint8_t*)_faceList[face].m_data;
+            for (uint8_t mip = 0; mip < _faceList[0].m_numMips; ++mip)
+            {
+                const uint8_t* srcMipData = (const uint8_t*)srcFaceData + srcOffsets[0][mip];
+                uint8_t* dstMipData = (uint8_t*)dstData + destinationOffset;
+
+                const uint32_t mipFaceSize = max(UINT32_C(1), _faceList[0].m_width >> mip);
+                const uint32_t mipPitch = mipFaceSize * bytesPerPixel;
+                const uint64_t mipFaceDataSize = uint64_t(mipPitch) * mipFaceSize;
+
+                destinationOffset += mipFaceDataSize;
+
+                for (uint32_t yy = 0; yy < mipFaceSize; ++yy)
+                {
+                    const uint8_t* srcRowData = (const uint8_t*)srcMipData + yy*mipPitch;
+                    uint8_t* dstRowData = (uint8_t*)dstMipData + yy*mipPitch;
+
+                    memcpy(dstRowData, srcRowData, mipPitch);
+                }
+            }
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = _faceList[0].m_width;
+        result.m_height = _faceList[0].m_height;
+        result.m_dataSize = dstDataSize;
+        result.m_format = _faceList[0].m_format;
+        result.m_numMips = _faceList[0].m_numMips;
+        result.m_numFaces = 6;
+        result.m_data = dstData;
+
+        // Output.
+        imageMove(_cubemap, result);
+
+        return true;
+    }
+
+    bool imageCrossFromCubemap(Image& _dst, const Image& _src, bool _vertical)
+    {
+        // Input check.
+        if(!imageIsCubemap(_src))
+        {
+            return false;
+        }
+
+        // Copy source image. Shared source is copied only if -z face is transformed, recorded face transforms are applied while copying.
+        Image srcCpy;
+        if (0 != _src.m_faceTransforms)
+        {
+            imageConvert(srcCpy, (TextureFormat::Enum)_src.m_format, _src);
+        }
+        else
+        {
+            imageShareOrCopy(srcCpy, _src);
+        }
+
+        // Transform -z image face properly.
+        if (_vertical)
+        {
+            imageTransform(srcCpy, IMAGE_FACE_NEGATIVEZ | IMAGE_OP_FLIP_X | IMAGE_OP_FLIP_Y);
+        }
+
+        // Calculate destination offsets and alloc data.
+        uint64_t dstDataSize = 0;
+        uint64_t dstMipOffsets[MAX_MIP_NUM];
+        const uint32_t dstWidth  = (_vertical?3:4) * srcCpy.m_width;
+        const uint32_t dstHeight = (_vertical?4:3) * srcCpy.m_width;
+        const uint32_t bytesPerPixel = getImageDataInfo(srcCpy.m_format).m_bytesPerPixel;
+        for (uint8_t mip = 0; mip < srcCpy.m_numMips; ++mip)
+        {
+            dstMipOffsets[mip] = dstDataSize;
+            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
+
+            dstDataSize += uint64_t(mipWidth) * mipHeight * bytesPerPixel;
+        }
+        void* dstData = getAllocator()->alloc(dstDataSize);
+        MALLOC_CHECK(dstData);
+
+        // Get black pixel.
+        void* blackPixel = alloca(bytesPerPixel);
+        const float blackPixelRgba32f[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        fromRgba32f(blackPixel, TextureFormat::Enum(srcCpy.m_format), blackPixelRgba32f);
+
+        // Fill with black.
+        for (uint8_t mip = 0; mip < srcCpy.m_numMips; ++mip)
+        {
+            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
+            const uint32_t mipPitch = mipWidth*bytesPerPixel;
+
+            uint8_t* dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
+            for (uint32_t yy = 0; yy < mipHeight; ++yy)
+            {
+                uint8_t* dstRowData = (uint8_t*)dstMipData + yy*mipPitch;
+                for (uint32_t xx = 0; xx < mipWidth; ++xx)
+                {
+                    uint8_t* dstColumnData = (uint8_t*)dstRowData + xx*bytesPerPixel;
+                    memcpy(dstColumnData, blackPixel, bytesPerPixel);
+                }
+            }
+        }
+
+        // Get source offsets.
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, srcCpy);
+
+        for (uint8_t mip = 0; mip < srcCpy.m_numMips; ++mip)
+        {
+            const uint32_t srcWidth = max(UINT32_C(1), srcCpy.m_width >> mip);
+            const uint32_t srcPitch = srcWidth * bytesPerPixel;
+
+            const uint32_t mipWidth = max(UINT32_C(1), dstWidth >> mip);
+            const uint32_t mipPitch = mipWidth * bytesPerPixel;
+            const uint32_t faceSize = mipWidth / (_vertical?3:4);
+            const uint32_t facePitch = faceSize * bytesPerPixel;
+            const uint32_t rowDataSize = mipPitch * faceSize;
+
+            // Destination offsets.
+            uint64_t faceOffsets[6];
+            if (_vertical)
+            {
+                //   ___ ___ ___
+                //  |   |   |   | -> rowDataSize
+                //  |___|___|___|
+                //
+                //   ___  -> facePitch
+                //
+                //       ___
+                //      |Y+ |
+                //   ___|___|___
+                //  |X- |Z+ |X+ |
+                //  |___|___|___|
+                //      |Y- |
+                //      |___|
+                //      |Z- |
+                //      |___|
+                //
+                faceOffsets[0] = rowDataSize + 2*facePitch; //+x
+                faceOffsets[1] = rowDataSize;               //-x
+                faceOffsets[2] = facePitch;                 //+y
+                faceOffsets[3] = 2*rowDataSize + facePitch; //-y
+                faceOffsets[4] = rowDataSize + facePitch;   //+z
+                faceOffsets[5] = 3*rowDataSize + facePitch; //-z
+            }
+            else
+            {
+                //       ___
+                //      |+Y |
+                //   ___|___|___ ___
+                //  |-X |+Z |+X |-Z |
+                //  |___|___|___|___|
+                //      |-Y |
+                //      |___|
+                //
+                faceOffsets[0] = rowDataSize + 2*facePitch; //+x
+                faceOffsets[1] = rowDataSize;               //-x
+                faceOffsets[2] = facePitch;                 //+y
+                faceOffsets[3] = 2*rowDataSize + facePitch; //-y
+                faceOffsets[4] = rowDataSize + facePitch;   //+z
+                faceOffsets[5] = rowDataSize + 3*facePitch; //-z
+            }
+
+            uint8_t* dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
+            for (uint8_t face = 0; face < 6; ++face)
+            {
+                uint8_t* dstFaceData = (uint8_t*)dstMipData + faceOffsets[face];
+                const uint8_t* srcFaceData = (uint8_t*)srcCpy.m_data + srcOffsets[face][mip];
+                for (uint32_t yy = 0; yy < faceSize; ++yy)
+                {
+                    uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*mipPitch;
+                    const uint8_t* srcRowData = (const uint8_t*)srcFaceData + yy*srcPitch;
+
+                    memcpy(dstRowData, srcRowData, facePitch);
+                }
+            }
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = dstWidth;
+        result.m_height = dstHeight;
+        result.m_dataSize = dstDataSize;
+        result.m_format = srcCpy.m_format;
+        result.m_numMips = srcCpy.m_numMips;
+        result.m_numFaces = 1;
+        result.m_data = dstData;
+
+        // Output.
+        imageMove(_dst, result);
+
+        // Cleanup.
+        imageUnload(srcCpy);
+
+        return true;
+    }
+
+    void imageCrossFromCubemap(Image& _image, bool _vertical)
+    {
+        Image tmp;
+        if (imageCrossFromCubemap(tmp, _image, _vertical))
+        {
+            imageMove(_image, tmp);
+        }
+    }
+
+    // Synthetic cubemaps.
+    //-----
+
+    static const char* s_cubemapPatternStr[CubemapPattern::Count] =
+    {
+        "gradient",    //Gradient
+        "noise",       //Noise
+        "sunDisk",     //SunDisk
+        "mostlyBlack", //MostlyBlack
+        "spike",       //Spike
+        "constant",    //Constant
+    };
+
+    const char* getCubemapPatternStr(CubemapPattern::Enum _pattern)
+    {
+        DEBUG_CHECK(_pattern < CubemapPattern::Count, "Reading array out of bounds!");
+        return s_cubemapPatternStr[uint8_t(_pattern)];
+    }
+
+    // Texels generated on the stack and converted at once.
+    #define CMFT_PATTERN_CHUNK_PIXELS 256
+
+    static inline float patternHashToUnit(uint32_t _val)
+    {
+        _val ^= _val >> 16;
+        _val *= UINT32_C(0x7feb352d);
+        _val ^= _val >> 15;
+        _val *= UINT32_C(0x846ca68b);
+        _val ^= _val >> 16;
+        return float(_val >> 8)*(1.0f/16777216.0f);
+    }
+
+    struct CubemapPatternArgs
+    {
+        uint8_t* m_dst;
+        TextureFormat::Enum m_format;
+        uint32_t m_bytesPerPixel;
+        uint32_t m_faceSize;
+        CubemapPattern::Enum m_pattern;
+        uint32_t m_seed;
+        float m_sunCos; // Cosine of the angular radius of the sun disk.
+    };
+
+    // Generates rows of all faces, row index is face*size + y.
+    static void cubemapPatternRows(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        const CubemapPatternArgs& args = *(const CubemapPatternArgs*)_userData;
+        const uint32_t faceSize = args.m_faceSize;
+        const float invFaceSize = 2.0f/float(faceSize);
+        const uint32_t spikeBegin = faceSize/2 - 1;
+
+        // Normalized (0.3, 0.9, 0.3).
+        const float sunDir[3] = { 0.30151134f, 0.90453403f, 0.30151134f };
+
+        float rgba32f[CMFT_PATTERN_CHUNK_PIXELS*4];
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t face = uint8_t(row/faceSize);
+            const uint32_t yy = row%faceSize;
+            uint8_t* dstRow = args.m_dst + (uint64_t(face)*faceSize + yy)*faceSize*args.m_bytesPerPixel;
+
+            for (uint32_t x0 = 0; x0 < faceSize; x0 += CMFT_PATTERN_CHUNK_PIXELS)
+            {
+                const uint32_t num = min(faceSize-x0, uint32_t(CMFT_PATTERN_CHUNK_PIXELS));
+                for (uint32_t ii = 0; ii < num; ++ii)
+                {
+                    const uint32_t xx = x0+ii;
+                    float* dst = &rgba32f[ii*4];
+
+                    float vec[3];
+                    texelCoordToVec(vec, (float(xx)+0.5f)*invFaceSize-1.0f, (float(yy)+0.5f)*invFaceSize-1.0f, face, faceSize);
+
+                    const float sky = 0.5f + 0.5f*vec[1];
+                    const float sun = (vec3Dot(vec, sunDir) >= args.m_sunCos) ? 1000.0f : 0.0f;
+
+                    switch (args.m_pattern)
+                    {
+                    case CubemapPattern::Gradient:
+                        dst[0] = 0.2f + 0.3f*sky + 0.1f*vec[0];
+                        dst[1] = 0.3f + 0.4f*sky;
+                        dst[2] = 0.4f + 0.6f*sky + 0.1f*vec[2];
+                        break;
+
+                    case CubemapPattern::Noise:
+                        {
+                            const uint32_t idx = (face*faceSize + yy)*faceSize + xx;
+                            const uint32_t seed = args.m_seed*UINT32_C(0x9e3779b9);
+                            dst[0] = patternHashToUnit(idx*3+0 + seed);
+                            dst[1] = patternHashToUnit(idx*3+1 + seed);
+                            dst[2] = patternHashToUnit(idx*3+2 + seed);
+                        }
+                        break;
+
+                    case CubemapPattern::SunDisk:
+                        dst[0] = 0.2f + 0.3f*sky + sun;
+                        dst[1] = 0.3f + 0.4f*sky + sun*0.9f;
+                        dst[2] = 0.4f + 0.6f*sky + sun*0.8f;
+                        break;
+
+                    case CubemapPattern::MostlyBlack:
+                        dst[0] = sun;
+                        dst[1] = sun*0.9f;
+                        dst[2] = sun*0.8f;
+                        break;
+
+                    case CubemapPattern::Spike:
+                        {
+                            const bool spike = (CMFT_FACE_POS_Y == face)
+                                            && (xx - spikeBegin) < 2
+                                            && (yy - spikeBegin) < 2;
+                            dst[0] = spike ? 1000.0f : 0.05f;
+                            dst[1] = spike ?  800.0f : 0.05f;
+                            dst[2] = spike ?  600.0f : 0.05f;
+                        }
+                        break;
+
+                    default:
+                        dst[0] = 0.5f;
+                        dst[1] = 0.25f;
+                        dst[2] = 0.125f;
+                        break;
+                    }
+                    dst[3] = 1.0f;
+                }
+
+                convertPixels(dstRow + uint64_t(x0)*args.m_bytesPerPixel, args.m_format, rgba32f, TextureFormat::RGBA32F, num, NULL, false);
+            }
+        }
+    }
+
+    bool imageCubemapFromPattern(Image& _dst, CubemapPattern::Enum _pattern, uint32_t _faceSize, TextureFormat::Enum _format, uint32_t _seed)
+    {
+        if (0 == _faceSize
+        ||  CubemapPattern::Count <= _pattern
+        ||  TextureFormat::Unknown <= _format)
+        {
+            WARN("Invalid cubemap pattern parameters.");
+            return false;
+        }
+
+        // Block compressed formats are encoded from a whole rgba32f cubemap.
+        const bool encode = 0 != getImageDataInfo(_format).m_blockBytes;
+        const TextureFormat::Enum format = encode ? TextureFormat::RGBA32F : _format;
+        const uint32_t bytesPerPixel = getImageDataInfo(format).m_bytesPerPixel;
+        const uint64_t dataSize = uint64_t(CUBE_FACE_NUM)*_faceSize*_faceSize*bytesPerPixel;
+
+        Image result;
+        result.m_data = result.m_allocator->alloc(size_t(dataSize));
+        MALLOC_CHECK(result.m_data);
+        if (NULL == result.m_data)
+        {
+            return false;
+        }
+
+        result.m_width    = _faceSize;
+        result.m_height   = _faceSize;
+        result.m_dataSize = dataSize;
+        result.m_format   = format;
+        result.m_numMips  = 1;
+        result.m_numFaces = CUBE_FACE_NUM;
+
+        // Sun disk is about 5 degrees across, but always covers a few texels of small faces.
+        const float sunRadius = max(0.0436f, 1.5f/float(_faceSize));
+
+        CubemapPatternArgs args;
+        args.m_dst = (uint8_t*)result.m_data;
+        args.m_format = format;
+        args.m_bytesPerPixel = bytesPerPixel;
+        args.m_faceSize = _faceSize;
+        args.m_pattern = _pattern;
+        args.m_seed = _seed;
+        args.m_sunCos = cosf(sunRadius);
+        parallelFor(cubemapPatternRows, (void*)&args, CUBE_FACE_NUM*_faceSize);
+
+        if (encode)
+        {
+            imageConvert(result, _format);
+        }
+
+        imageMove(_dst, result);
+
+        return true;
+    }
+
+    // Image loading.
+    //-----
+
+    // 64-bit file positions. Plain ftell()/fseek() use long, which is 32-bit on Windows.
+    static inline int64_t fileTell(FILE* _fp)
+    {
+#if BX_PLATFORM_WINDOWS
+        return _ftelli64(_fp);
+#else
+        return int64_t(ftello(_fp));
+#endif // BX_PLATFORM_WINDOWS
+    }
+
+    static inline int fileSeek(FILE* _fp, int64_t _offset, int _origin)
+    {
+#if BX_PLATFORM_WINDOWS
+        return _fseeki64(_fp, _offset, _origin);
+#else
+        return fseeko(_fp, off_t(_offset), _origin);
+#endif // BX_PLATFORM_WINDOWS
+    }
+
+    /// Mips of _range available in a file with _fileMips mips. Returns false if there are none.
+    static bool loadRangeMips(uint8_t& _firstMip, uint8_t& _numMips, const ImageLoadRange& _range, uint8_t _fileMips)
+    {
+        if (_range.m_firstMip >= _fileMips)
+        {
+            WARN("Mip %u requested, file has %u.", _range.m_firstMip, _fileMips);
+            return false;
+        }
+
+        _firstMip = _range.m_firstMip;
+        _numMips = uint8_t(max(UINT32_C(1), min(uint32_t(_range.m_numMips), uint32_t(_fileMips-_firstMip))));
+
+        return true;
+    }
+
+    static inline bool loadRangeHasFace(const ImageLoadRange& _range, uint8_t _numFaces, uint8_t _face)
+    {
+        return 1 == _numFaces || 0 != (_range.m_faceMask & (1<<_face));
+    }
+
+    /// Cuts loaded image down to _range, for loaders that always read the whole file.
+    static bool imageApplyLoadRange(Image& _image, const ImageLoadRange& _range)
+    {
+        uint8_t firstMip;
+        uint8_t numMips;
+        if (!loadRangeMips(firstMip, numMips, _range, _image.m_numMips))
+        {
+            return false;
+        }
+
+        bool allFaces = true;
+        for (uint8_t face = 0; face < _image.m_numFaces; ++face)
+        {
+            allFaces &= loadRangeHasFace(_range, _image.m_numFaces, face);
+        }
+
+        if (0 == firstMip && numMips == _image.m_numMips && allFaces)
+        {
+            return true;
+        }
+
+        const ImageDataInfo& info = getImageDataInfo(_image.m_format);
+        uint64_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(srcOffsets, _image);
+
+        Image result;
+        result.m_width = max(UINT32_C(1), _image.m_width >> firstMip);
+        result.m_height = max(UINT32_C(1), _image.m_height >> firstMip);
+        result.m_format = _image.m_format;
+        result.m_numMips = numMips;
+        result.m_numFaces = _image.m_numFaces;
+        result.m_dataSize = 0;
+        for (uint8_t mip = 0; mip < numMips; ++mip)
+        {
+            result.m_dataSize += mipFaceDataSize(info, max(UINT32_C(1), result.m_width >> mip), max(UINT32_C(1), result.m_height >> mip));
+        }
+        const uint64_t faceDataSize = result.m_dataSize;
+        result.m_dataSize *= result.m_numFaces;
+        result.m_data = result.m_allocator->alloc(result.m_dataSize);
+        MALLOC_CHECK(result.m_data);
+
+        // Mips of a face follow each other in both images.
+        for (uint8_t face = 0; face < result.m_numFaces; ++face)
+        {
+            uint8_t* dst = (uint8_t*)result.m_data + face*faceDataSize;
+            if (loadRangeHasFace(_range, result.m_numFaces, face))
+            {
+                memcpy(dst, (const uint8_t*)_image.m_data + srcOffsets[face][firstMip], size_t(faceDataSize));
+            }
+            else
+            {
+                memset(dst, 0, size_t(faceDataSize));
+            }
+        }
+
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    // Mip index.
+    //-----
+
+#define MIP_INDEX_TAG         CMFT_MAKEFOURCC('C', 'M', 'I', 'X')
+#define KTX_MIP_INDEX_KEY     "cmftMipIndex"
+
+    /// Key-value data larger than this is skipped without looking for the mip index.
+#ifndef CMFT_KTX_MAX_KEY_VALUE_SIZE
+    #define CMFT_KTX_MAX_KEY_VALUE_SIZE (64<<10)
+#endif //CMFT_KTX_MAX_KEY_VALUE_SIZE
+
+    /// Mip written _ii-th in _layout.
+    static inline uint8_t mipLayoutMip(MipLayout::Enum _layout, uint8_t _ii, uint8_t _numMips)
+    {
+        return (MipLayout::SmallestFirst == _layout) ? uint8_t(_numMips-1-_ii) : _ii;
+    }
+
+    static bool mipIndexRead(ImageMipIndex& _index, Reader* _stream, int64_t _offset)
+    {
+        ioSeek(_stream, _offset, SEEK_SET);
+        const size_t read = ioRead(&_index, 1, sizeof(ImageMipIndex), _stream);
+        IOERROR_CHECK(_stream);
+
+        return sizeof(ImageMipIndex) == read
+            && MIP_INDEX_TAG == _index.m_tag
+            ;
+    }
+
+    /// Reads _bytesKeyValue of Ktx key-value data at the current position and looks for the mip index in it.
+    /// Stream is left at the end of key-value data.
+    static bool ktxReadMipIndex(ImageMipIndex& _index, Reader* _stream, uint32_t _bytesKeyValue)
+    {
+        if (0 == _bytesKeyValue)
+        {
+            return false;
+        }
+
+        if (_bytesKeyValue > CMFT_KTX_MAX_KEY_VALUE_SIZE)
+        {
+            ioSeek(_stream, _bytesKeyValue, SEEK_CUR);
+            IOERROR_CHECK(_stream);
+            return false;
+        }
+
+        uint8_t* keyValue = (uint8_t*)allocScratch(_bytesKeyValue, AllocTag::IoBuffer);
+        MALLOC_CHECK(keyValue);
+        const size_t read = ioRead(keyValue, 1, _bytesKeyValue, _stream);
+        IOERROR_CHECK(_stream);
+
+        // Pairs are a 4 byte size, key with its terminator and value, padded to 4 bytes.
+        const uint32_t keySize = uint32_t(sizeof(KTX_MIP_INDEX_KEY));
+        bool found = false;
+        for (uint32_t pos = 0; !found && pos + sizeof(uint32_t) <= read; )
+        {
+            uint32_t pairSize;
+            memcpy(&pairSize, &keyValue[pos], sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+            if (pairSize > read - pos)
+            {
+                break;
+            }
+
+            if (keySize + sizeof(ImageMipIndex) == pairSize
+            &&  0 == memcmp(&keyValue[pos], KTX_MIP_INDEX_KEY, keySize))
+            {
+                memcpy(&_index, &keyValue[pos+keySize], sizeof(ImageMipIndex));
+                found = (MIP_INDEX_TAG == _index.m_tag);
+            }
+
+            pos += (pairSize+3)&~3;
+        }
+
+        freeScratch(keyValue);
+
+        return found;
+    }
+
+    /// Loads a file with the mip index, mips of _range are read with a single read. Rows in the file are padded to _rowAlignment.
+    static bool imageLoadMipIndexed(Image& _image
+                                  , Reader* _stream
+                                  , const ImageMipIndex& _index
+                                  , uint32_t _width
+                                  , uint32_t _height
+                                  , uint8_t _numMips
+                                  , uint8_t _numFaces
+                                  , TextureFormat::Enum _format
+                                  , TextureFormat::Enum _convertTo
+                                  , uint32_t _rowAlignment
+                                  , uint32_t _element
+                                  , const ImageLoadRange& _range
+                                  )
+    {
+        CMFT_UNUSED size_t read;
+
+        if (_index.m_numMips != _numMips
+        ||  _index.m_numFaces != _numFaces
+        ||  TextureFormat::Unknown == _format)
+        {
+            WARN("Mip index does not match the file header.");
+            return false;
+        }
+
+        if (0 != _element)
+        {
+            WARN("Files with mip index have a single array element, element %u requested.", _element);
+            return false;
+        }
+
+        uint8_t firstMip;
+        uint8_t numMips;
+        if (!loadRangeMips(firstMip, numMips, _range, _numMips))
+        {
+            return false;
+        }
+
+        Image result;
+        result.m_width = max(UINT32_C(1), _width >> firstMip);
+        result.m_height = max(UINT32_C(1), _height >> firstMip);
+        result.m_format = _format;
+        result.m_numMips = numMips;
+        result.m_numFaces = _numFaces;
+
+        // Mips of the range are next to each other in the file, in either order.
+        const ImageDataInfo& info = getImageDataInfo(_format);
+        uint64_t spanBegin = UINT64_MAX;
+        uint64_t spanEnd = 0;
+        uint64_t dataSize = 0;
+        for (uint8_t mip = firstMip; mip < firstMip+numMips; ++mip)
+        {
+            const uint32_t mipWidth  = max(UINT32_C(1), _width  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), _height >> mip);
+            const uint64_t faceSize = mipFaceDataSize(info, mipWidth, mipHeight);
+            if (_index.m_sizes[mip] < faceSize*_numFaces)
+            {
+                WARN("Mip index size of mip %u invalid.", mip);
+                return false;
+            }
+
+            spanBegin = min(spanBegin, _index.m_offsets[mip]);
+            spanEnd = max(spanEnd, _index.m_offsets[mip] + _index.m_sizes[mip]);
+            dataSize += faceSize*_numFaces;
+        }
+
+        uint8_t* src = (uint8_t*)allocScratch(spanEnd-spanBegin, AllocTag::IoBuffer);
+        MALLOC_CHECK(src);
+        ioSeek(_stream, int64_t(spanBegin), SEEK_SET);
+        read = ioRead(src, 1, size_t(spanEnd-spanBegin), _stream);
+        IOERROR_CHECK(_stream);
+        if (read != spanEnd-spanBegin)
+        {
+            WARN("Error reading mips %u-%u.", firstMip, firstMip+numMips-1);
+            freeScratch(src);
+            return false;
+        }
+
+        void* data = getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
+        result.m_dataSize = dataSize;
+        result.m_data = data;
+
+        uint64_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(dstOffsets, result);
+
+        // Drop row padding, faces left out of the range are black.
+        for (uint8_t mip = 0; mip < numMips; ++mip)
+        {
+            const uint32_t mipWidth  = max(UINT32_C(1), result.m_width  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), result.m_height >> mip);
+            const uint32_t numRows = (0 != info.m_blockBytes) ? (mipHeight+3)/4 : mipHeight;
+            const uint64_t pitch = mipFaceDataSize(info, mipWidth, mipHeight)/numRows;
+            const uint64_t srcPitch = (pitch + _rowAlignment-1) & ~uint64_t(_rowAlignment-1);
+            const uint64_t srcFaceSize = _index.m_sizes[firstMip+mip]/_numFaces;
+            const uint8_t* mipSrc = src + (_index.m_offsets[firstMip+mip] - spanBegin);
+
+            for (uint8_t face = 0; face < _numFaces; ++face)
+            {
+                uint8_t* dst = (uint8_t*)data + dstOffsets[face][mip];
+                if (!loadRangeHasFace(_range, _numFaces, face))
+                {
+                    memset(dst, 0, size_t(pitch*numRows));
+                    continue;
+                }
+
+                for (uint32_t yy = 0; yy < numRows; ++yy)
+                {
+                    memcpy(dst + yy*pitch, mipSrc + face*srcFaceSize + yy*srcPitch, size_t(pitch));
+                }
+            }
+        }
+
+        freeScratch(src);
+
+        if (TextureFormat::Unknown != _convertTo
+        &&  _format != _convertTo)
+        {
+            imageConvert(result, _convertTo);
+        }
+
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    /// Loads array element _element of Dds file. Elements follow each other, each one laid out as a single image.
+    /// Faces follow each other within an element, mips of _range are read with a single read per face.
+    bool imageLoadDds(Image& _image, Reader* _stream, TextureFormat::Enum _convertTo, bool _mapFile, uint32_t _element, const ImageLoadRange& _range)
+    {
+        CMFT_UNUSED size_t read;
+
+        // Read magic.
+        uint32_t magic;
+        read = ioRead(&magic, sizeof(uint32_t), 1, _stream);
+        DEBUG_CHECK(read == 1, "Could not read from file.");
+        IOERROR_CHECK(_stream);
+
+        // Check magic.
+        if (DDS_MAGIC != magic)
+        {
+            WARN("Dds magic invalid.");
+            return false;
+        }
+
+        // Read header.
+        DdsHeader ddsHeader;
+        read = 0;
+        read += ioRead(&ddsHeader.m_size,                      1, sizeof(ddsHeader.m_size),                      _stream);
+        read += ioRead(&ddsHeader.m_flags,                     1, sizeof(ddsHeader.m_flags),                     _stream);
+        read += ioRead(&ddsHeader.m_height,                    1, sizeof(ddsHeader.m_height),                    _stream);
+        read += ioRead(&ddsHeader.m_width,                     1, sizeof(ddsHeader.m_width),                     _stream);
+        read += ioRead(&ddsHeader.m_pitchOrLinearSize,         1, sizeof(ddsHeader.m_pitchOrLinearSize),         _stream);
+        read += ioRead(&ddsHeader.m_depth,                     1, sizeof(ddsHeader.m_depth),                     _stream);
+        read += ioRead(&ddsHeader.m_mipMapCount,               1, sizeof(ddsHeader.m_mipMapCount),               _stream);
+        read += ioRead(&ddsHeader.m_reserved1,                 1, sizeof(ddsHeader.m_reserved1),                 _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_size,        1, sizeof(ddsHeader.m_pixelFormat.m_size),        _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_flags,       1, sizeof(ddsHeader.m_pixelFormat.m_flags),       _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_fourcc,      1, sizeof(ddsHeader.m_pixelFormat.m_fourcc),      _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_rgbBitCount, 1, sizeof(ddsHeader.m_pixelFormat.m_rgbBitCount), _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_rBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_rBitMask),    _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_gBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_gBitMask),    _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_bBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_bBitMask),    _stream);
+        read += ioRead(&ddsHeader.m_pixelFormat.m_aBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_aBitMask),    _stream);
+        read += ioRead(&ddsHeader.m_caps,                      1, sizeof(ddsHeader.m_caps),                      _stream);
+        read += ioRead(&ddsHeader.m_caps2,                     1, sizeof(ddsHeader.m_caps2),                     _stream);
+        read += ioRead(&ddsHeader.m_caps3,                     1, sizeof(ddsHeader.m_caps3),                     _stream);
+        read += ioRead(&ddsHeader.m_caps4,                     1, sizeof(ddsHeader.m_caps4),                     _stream);
+        read += ioRead(&ddsHeader.m_reserved2,                 1, sizeof(ddsHeader.m_reserved2),                 _stream);
+        DEBUG_CHECK(read == DDS_HEADER_SIZE, "Error reading file header.");
+        IOERROR_CHECK(_stream);
+
+        // Read DdsDxt10 header if present.
+        DdsHeaderDxt10 ddsHeaderDxt10;
+        memset(&ddsHeaderDxt10, 0, sizeof(DdsHeaderDxt10));
+        const bool hasDdsDxt10 = (DDS_DX10 == ddsHeader.m_pixelFormat.m_fourcc && (ddsHeader.m_flags&DDPF_FOURCC));
+        if (hasDdsDxt10)
+        {
+            read = 0;
+            read += ioRead(&ddsHeaderDxt10.m_dxgiFormat,        1, sizeof(ddsHeaderDxt10.m_dxgiFormat),        _stream);
+            read += ioRead(&ddsHeaderDxt10.m_resourceDimension, 1, sizeof(ddsHeaderDxt10.m_resourceDimension), _stream);
+            read += ioRead(&ddsHeaderDxt10.m_miscFlags,         1, sizeof(ddsHeaderDxt10.m_miscFlags),         _stream);
+            read += ioRead(&ddsHeaderDxt10.m_arraySize,         1, sizeof(ddsHeaderDxt10.m_arraySize),         _stream);
+            read += ioRead(&ddsHeaderDxt10.m_miscFlags2,        1, sizeof(ddsHeaderDxt10.m_miscFlags2),        _stream);
+            DEBUG_CHECK(read == DDS_DX10_HEADER_SIZE, "Error reading Dds dx10 file header.");
+            IOERROR_CHECK(_stream);
+        }
+
+        // Validate header.
+        if (DDS_HEADER_SIZE != ddsHeader.m_size)
+        {
+            WARN("Invalid Dds header size!");
+            return false;
+        }
+
+        if ((ddsHeader.m_flags & (DDSD_CAPS|DDSD_HEIGHT|DDSD_WIDTH|DDSD_PIXELFORMAT)) != (DDSD_CAPS|DDSD_HEIGHT|DDSD_WIDTH|DDSD_PIXELFORMAT))
+        {
+            WARN("Invalid Dds header flags!");
+            return false;
+        }
+
+        if (0 == (ddsHeader.m_caps & DDSCAPS_TEXTURE))
+        {
+            WARN("Invalid Dds header caps!");
+            return false;
+        }
+
+        if (0 == ddsHeader.m_mipMapCount)
+        {
+            WARN("Dds image mipmap count is 0. Setting to 1.");
+            ddsHeader.m_mipMapCount = 1;
+        }
+
+        if (ddsHeader.m_mipMapCount > MAX_MIP_NUM)
+        {
+            WARN("Dds image mipmap count %u is invalid.", ddsHeader.m_mipMapCount);
+            return false;
+        }
+
+        const bool isCubemap = (0 != (ddsHeader.m_caps2 & DDSCAPS2_CUBEMAP));
+        if (isCubemap && (DDS_CUBEMAP_ALLFACES != (ddsHeader.m_caps2 & DDS_CUBEMAP_ALLFACES)))
+        {
+            WARN("Partial cubemap not supported!");
+            return false;
+        }
+
+        // Get format. Block compressed formats without TextureFormat are only decoded.
+        TextureFormat::Enum format = TextureFormat::Unknown;
+        BlockFormat::Enum blockFormat = BlockFormat::Count;
+        if (hasDdsDxt10)
+        {
+            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsDxgiFormat); ii < end; ++ii)
+            {
+                if (s_translateDdsDxgiFormat[ii].m_dxgiFormat == ddsHeaderDxt10.m_dxgiFormat)
+                {
+                    format = s_translateDdsDxgiFormat[ii].m_textureFormat;
+                    break;
+                }
+            }
+
+            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsDxgiBlockFormat); ii < end; ++ii)
+            {
+                if (s_translateDdsDxgiBlockFormat[ii].m_format == ddsHeaderDxt10.m_dxgiFormat)
+                {
+                    blockFormat = s_translateDdsDxgiBlockFormat[ii].m_blockFormat;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            uint32_t ddsBcFlag = 0;
+            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsPfBitCount); ii < end; ++ii)
+            {
+                if (s_translateDdsPfBitCount[ii].m_bitCount == ddsHeader.m_pixelFormat.m_rgbBitCount)
+                {
+                    ddsBcFlag = s_translateDdsPfBitCount[ii].m_flag;
+                    break;
+                }
+            }
+
+            const uint32_t ddsFormat = ddsHeader.m_pixelFormat.m_flags & DDPF_FOURCC
+                ? ddsHeader.m_pixelFormat.m_fourcc
+                : (ddsHeader.m_pixelFormat.m_flags | ddsBcFlag)
+                ;
+
+            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsFormat); ii < end; ++ii)
+            {
+                if (s_translateDdsFormat[ii].m_format == ddsFormat)
+                {
+                    format = s_translateDdsFormat[ii].m_textureFormat;
+                    break;
+                }
+            }
+
+            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsFourccBlockFormat); ii < end && (ddsHeader.m_pixelFormat.m_flags & DDPF_FOURCC); ++ii)
+            {
+                if (s_translateDdsFourccBlockFormat[ii].m_format == ddsHeader.m_pixelFormat.m_fourcc)
+                {
+                    blockFormat = s_translateDdsFourccBlockFormat[ii].m_blockFormat;
+                    break;
+                }
+            }
+        }
+
+        if (TextureFormat::Unknown != format)
+        {
+            blockFormat = blockFormatFromTextureFormat(format);
+        }
+
+        if (TextureFormat::Unknown == format
+        &&  BlockFormat::Count == blockFormat)
+        {
+            const uint8_t bytesPerPixel = uint8_t(ddsHeader.m_pixelFormat.m_rgbBitCount/8);
+            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_ddsValidFormats); ii < end; ++ii)
+            {
+                if (bytesPerPixel == getImageDataInfo(s_ddsValidFormats[ii]).m_bytesPerPixel)
+                {
+                    format = TextureFormat::Enum(ii);
+                }
+            }
+
+            WARN("DDS data format unknown. Guessing... Got %s.", getTextureFormatStr(format));
+
+            if (TextureFormat::Unknown == format)
+            {
+                WARN("DDS data format not supported!");
+                return false;
+            }
+        }
+
+        // Mips follow each other with all of their faces, see ImageEncodeSettings::m_mipLayout.
+        if (MIP_INDEX_TAG == ddsHeader.m_reserved1[0])
+        {
+            const int64_t indexOffset = int64_t(uint64_t(ddsHeader.m_reserved1[1]) | (uint64_t(ddsHeader.m_reserved1[2])<<32));
+            ImageMipIndex index;
+            if (!mipIndexRead(index, _stream, indexOffset))
+            {
+                WARN("Dds mip index invalid.");
+                return false;
+            }
+
+            return imageLoadMipIndexed(_image
+                                     , _stream
+                                     , index
+                                     , ddsHeader.m_width
+                                     , ddsHeader.m_height
+                                     , uint8_t(ddsHeader.m_mipMapCount)
+                                     , isCubemap ? CUBE_FACE_NUM : 1
+                                     , format
+                                     , _convertTo
+                                     , 1
+                                     , _element
+                                     , _range
+                                     );
+        }
+
+        // Data is decoded straight into requested format. Formats that are only decoded default to rgba32f.
+        const TextureFormat::Enum srcFormat = (TextureFormat::Unknown != format) ? format : TextureFormat::RGBA32F;
+        const TextureFormat::Enum dstFormat = (TextureFormat::Unknown != _convertTo) ? _convertTo : srcFormat;
+        const bool decode = (BlockFormat::Count != blockFormat && dstFormat != format);
+
+        // Loaded part of the file.
+        uint8_t firstMip;
+        uint8_t numMips;
+        if (!loadRangeMips(firstMip, numMips, _range, uint8_t(ddsHeader.m_mipMapCount)))
+        {
+            return false;
+        }
+
+        const uint8_t numFaces = isCubemap ? 6 : 1;
+        bool partial = (0 != firstMip || numMips != ddsHeader.m_mipMapCount);
+        for (uint8_t face = 0; face < numFaces; ++face)
+        {
+            partial |= !loadRangeHasFace(_range, numFaces, face);
+        }
+
+        // Calculate data size. Mip offsets are within a face of the file.
+        const uint32_t bytesPerPixel = getImageDataInfo(srcFormat).m_bytesPerPixel;
+        const uint32_t blockBytes = (BlockFormat::Count != blockFormat) ? blockFormatBytes(blockFormat) : 0;
+        uint64_t fileMipOffsets[MAX_MIP_NUM+1];
+        uint64_t dstFaceDataSize = 0;
+        uint64_t faceNumPixels = 0;
+        fileMipOffsets[0] = 0;
+        for (uint8_t mip = 0; mip < ddsHeader.m_mipMapCount; ++mip)
+        {
+            uint32_t width  = max(UINT32_C(1), ddsHeader.m_width  >> mip);
+            uint32_t height = max(UINT32_C(1), ddsHeader.m_height >> mip);
+            const uint64_t pixels = uint64_t(width) * height;
+            fileMipOffsets[mip+1] = fileMipOffsets[mip] + ((0 != blockBytes) ? uint64_t((width+3)/4) * ((height+3)/4) * blockBytes : pixels * bytesPerPixel);
+            if (mip >= firstMip && mip < firstMip+numMips)
+            {
+                faceNumPixels += pixels;
+                dstFaceDataSize += mipFaceDataSize(getImageDataInfo(dstFormat), width, height);
+            }
+        }
+        const uint64_t fileFaceSize = fileMipOffsets[ddsHeader.m_mipMapCount];
+        const uint64_t readFaceSize = fileMipOffsets[firstMip+numMips] - fileMipOffsets[firstMip];
+        const uint64_t dataSize = fileFaceSize * numFaces;
+        const uint64_t dstDataSize = dstFaceDataSize * numFaces;
+
+        // Some software tools produce invalid dds file.
+        // Flags claim there should be a ddsdxt10 header after dds header but in fact image data starts there.
+        // Therefore, to handle those situations, image data size will be checked against remaining unread data size.
+
+        // Current position in file.
+        const int64_t fpCurrentPos = ioTell(_stream);
+
+        // Remaining unread data size.
+        ioSeek(_stream, 0, SEEK_END);
+        const int64_t fpRemaining = ioTell(_stream) - fpCurrentPos;
+
+        // Seek back to currentPos or 20 before currentPos in case remaining unread data size does match image data size.
+        const bool missingDdsDxt10 = (fpRemaining == int64_t(dataSize)-DDS_DX10_HEADER_SIZE);
+
+        // Array size read from a missing dxt10 header is image data.
+        const uint32_t arraySize = (hasDdsDxt10 && !missingDdsDxt10) ? max(UINT32_C(1), ddsHeaderDxt10.m_arraySize) : 1;
+        if (_element >= arraySize)
+        {
+            WARN("Dds array element %u requested, file has %u.", _element, arraySize);
+            return false;
+        }
+
+        const int64_t dataOffset = fpCurrentPos - DDS_DX10_HEADER_SIZE*missingDdsDxt10 + int64_t(_element)*int64_t(dataSize);
+        const uint32_t width  = max(UINT32_C(1), ddsHeader.m_width  >> firstMip);
+        const uint32_t height = max(UINT32_C(1), ddsHeader.m_height >> firstMip);
+
+        // Blocks are read at once and decoded in parallel.
+        if (decode)
+        {
+            uint8_t* blocks = (uint8_t*)getAllocator()->alloc(readFaceSize*numFaces);
+            MALLOC_CHECK(blocks);
+            if (NULL == blocks)
+            {
+                return false;
+            }
+
+            for (uint8_t face = 0; face < numFaces; ++face)
+            {
+                uint8_t* faceBlocks = blocks + face*readFaceSize;
+                if (!loadRangeHasFace(_range, numFaces, face))
+                {
+                    memset(faceBlocks, 0, size_t(readFaceSize));
+                    continue;
+                }
+
+                ioSeek(_stream, dataOffset + int64_t(face*fileFaceSize + fileMipOffsets[firstMip]), SEEK_SET);
+                read = ioRead(faceBlocks, 1, readFaceSize, _stream);
+                DEBUG_CHECK(read == readFaceSize, "Could not read from file.");
+                IOERROR_CHECK(_stream);
+            }
+
+            Image result;
+            const bool decoded = imageDecode(result, dstFormat, blocks, blockFormat, width, height, numMips, numFaces);
+            getAllocator()->free(blocks);
+            if (!decoded)
+            {
+                return false;
+            }
+
+            // Zeroed blocks don't decode to black in every format.
+            if (partial)
+            {
+                uint64_t faceOffsets[CUBE_FACE_NUM];
+                imageGetFaceOffsets(faceOffsets, result);
+                for (uint8_t face = 0; face < numFaces; ++face)
+                {
+                    if (!loadRangeHasFace(_range, numFaces, face))
+                    {
+                        memset((uint8_t*)result.m_data + faceOffsets[face], 0, size_t(result.m_dataSize/numFaces));
+                    }
+                }
+            }
+
+            imageMove(_image, result);
+
+            return true;
+        }
+
+        // Dds data layout matches Image layout, map it directly if requested.
+        void* data = (_mapFile && dstFormat == format && !partial) ? fileMap(_stream, dataOffset, dataSize) : NULL;
+        const bool mapped = (NULL != data);
+        if (!mapped)
+        {
+            // Alloc and read data.
+            data = getAllocator()->alloc(dstDataSize);
+            MALLOC_CHECK(data);
+            if (NULL == data)
+            {
+                return false;
+            }
+
+            for (uint8_t face = 0; face < numFaces; ++face)
+            {
+                uint8_t* faceData = (uint8_t*)data + face*dstFaceDataSize;
+                if (!loadRangeHasFace(_range, numFaces, face))
+                {
+                    memset(faceData, 0, size_t(dstFaceDataSize));
+                    continue;
+                }
+
+                ioSeek(_stream, dataOffset + int64_t(face*fileFaceSize + fileMipOffsets[firstMip]), SEEK_SET);
+                if (0 != blockBytes)
+                {
+                    read = ioRead(faceData, 1, readFaceSize, _stream);
+                    DEBUG_CHECK(read == readFaceSize, "Could not read from file.");
+                    IOERROR_CHECK(_stream);
+                }
+                else
+                {
+                    readConvertedPixels(faceData, dstFormat, _stream, format, faceNumPixels);
+                }
+            }
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = width;
+        result.m_height = height;
+        result.m_dataSize = dstDataSize;
+        result.m_format = dstFormat;
+        result.m_numMips = numMips;
+        result.m_numFaces = numFaces;
+        result.m_data = data;
+        result.m_mapped = mapped;
+
+        // Output.
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    /// Reads block compressed mips of Ktx file into Image order and decodes them, unless _dstFormat is _format.
+    /// Blocks are multiples of KTX_UNPACK_ALIGNMENT, there is no row, face or mip padding.
+    static bool ktxLoadBlocks(Image& _image, Reader* _stream, const KtxHeader& _ktxHeader, BlockFormat::Enum _blockFormat
+                            , TextureFormat::Enum _format, TextureFormat::Enum _dstFormat, uint32_t _element
+                            , uint8_t _firstMip, uint8_t _numMips, const ImageLoadRange& _range)
+    {
+        CMFT_UNUSED size_t read;
+
+        const uint32_t numElements = max(UINT32_C(1), _ktxHeader.m_numArrayElements);
+        const uint8_t numFaces = uint8_t(_ktxHeader.m_numFaces);
+        const uint32_t blockBytes = blockFormatBytes(_blockFormat);
+        const uint32_t width  = max(UINT32_C(1), _ktxHeader.m_pixelWidth  >> _firstMip);
+        const uint32_t height = max(UINT32_C(1), _ktxHeader.m_pixelHeight >> _firstMip);
+
+        uint64_t offsets[MAX_MIP_NUM][CUBE_FACE_NUM];
+        uint64_t dataSize = 0;
+        for (uint8_t face = 0; face < numFaces; ++face)
+        {
+            for (uint8_t mip = 0; mip < _numMips; ++mip)
+            {
+                offsets[mip][face] = dataSize;
+                const uint32_t mipWidth  = max(UINT32_C(1), width  >> mip);
+                const uint32_t mipHeight = max(UINT32_C(1), height >> mip);
+                dataSize += uint64_t((mipWidth+3)/4) * ((mipHeight+3)/4) * blockBytes;
+            }
+        }
+
+        uint8_t* blocks = (uint8_t*)getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(blocks);
+        if (NULL == blocks)
+        {
+            return false;
+        }
+
+        // Mips before the range are skipped, reading stops after it.
+        for (uint8_t mip = 0; mip < _firstMip+_numMips; ++mip)
+        {
+            const uint32_t mipWidth  = max(UINT32_C(1), _ktxHeader.m_pixelWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), _ktxHeader.m_pixelHeight >> mip);
+            const uint64_t faceSize = uint64_t((mipWidth+3)/4) * ((mipHeight+3)/4) * blockBytes;
+            const uint64_t mipSize = faceSize * numFaces;
+
+            // For arrays, image size covers all faces of all elements in the mip.
+            uint32_t imageSize;
+            read = ioRead(&imageSize, sizeof(uint32_t), 1, _stream);
+            DEBUG_CHECK(read == 1, "Error reading Ktx data.");
+            IOERROR_CHECK(_stream);
+
+            if (uint64_t(imageSize) != faceSize
+            &&  uint64_t(imageSize) != mipSize*numElements)
+            {
+                WARN("Ktx mip size invalid.");
+            }
+
+            if (mip < _firstMip)
+            {
+                ioSeek(_stream, int64_t(numElements)*int64_t(mipSize), SEEK_CUR);
+                IOERROR_CHECK(_stream);
+                continue;
+            }
+
+            // Jump faces of previous elements.
+            if (0 != _element)
+            {
+                ioSeek(_stream, int64_t(_element)*int64_t(mipSize), SEEK_CUR);
+                IOERROR_CHECK(_stream);
+            }
+
+            for (uint8_t face = 0; face < numFaces; ++face)
+            {
+                uint8_t* dst = blocks + offsets[mip-_firstMip][face];
+                if (!loadRangeHasFace(_range, numFaces, face))
+                {
+                    memset(dst, 0, size_t(faceSize));
+                    ioSeek(_stream, int64_t(faceSize), SEEK_CUR);
+                    IOERROR_CHECK(_stream);
+                    continue;
+                }
+
+                read = ioRead(dst, 1, faceSize, _stream);
+                DEBUG_CHECK(read == faceSize, "Error reading Ktx data.");
+                IOERROR_CHECK(_stream);
+            }
+
+            // Jump faces of following elements.
+            if (_element+1 < numElements)
+            {
+                ioSeek(_stream, int64_t(numElements-_element-1)*int64_t(mipSize), SEEK_CUR);
+                IOERROR_CHECK(_stream);
+            }
+        }
+
+        Image result;
+        if (_dstFormat == _format)
+        {
+            result.m_width = width;
+            result.m_height = height;
+            result.m_dataSize = dataSize;
+            result.m_format = _format;
+            result.m_numMips = _numMips;
+            result.m_numFaces = numFaces;
+            result.m_data = blocks;
+        }
+        else
+        {
+            const bool decoded = imageDecode(result, _dstFormat, blocks, _blockFormat, width, height, _numMips, numFaces);
+            getAllocator()->free(blocks);
+            if (!decoded)
+            {
+                return false;
+            }
+
+            // Zeroed blocks don't decode to black in every format.
+            uint64_t faceOffsets[CUBE_FACE_NUM];
+            imageGetFaceOffsets(faceOffsets, result);
+            for (uint8_t face = 0; face < numFaces; ++face)
+            {
+                if (!loadRangeHasFace(_range, numFaces, face))
+                {
+                    memset((uint8_t*)result.m_data + faceOffsets[face], 0, size_t(result.m_dataSize/numFaces));
+                }
+            }
+        }
+
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    /// Loads array element _element of Ktx file. Each mip holds faces of all elements, element by element.
+    /// Mips and faces outside of _range are seeked over.
+    bool imageLoadKtx(Image& _image, Reader* _stream, TextureFormat::Enum _convertTo, bool _mapFile, uint32_t _element, const ImageLoadRange& _range)
+    {
+        CMFT_UNUSED size_t read;
+        CMFT_UNUSED int seek;
+
+        KtxHeader ktxHeader;
+
+        // Read magic.
+        uint8_t magic[12];
+        read = ioRead(&magic, KTX_MAGIC_LEN, 1, _stream);
+        DEBUG_CHECK(read == 1, "Could not read from file.");
+        IOERROR_CHECK(_stream);
+
+        const uint8_t ktxMagic[12] = KTX_MAGIC;
+        if (0 != memcmp(magic, ktxMagic, KTX_MAGIC_LEN))
+        {
+            WARN("Ktx magic invalid.");
+            return false;
+        }
+
+        // Read header.
+        read = 0;
+        read += ioRead(&ktxHeader.m_endianness,           1, sizeof(ktxHeader.m_endianness),           _stream);
+        read += ioRead(&ktxHeader.m_glType,               1, sizeof(ktxHeader.m_glType),               _stream);
+        read += ioRead(&ktxHeader.m_glTypeSize,           1, sizeof(ktxHeader.m_glTypeSize),           _stream);
+        read += ioRead(&ktxHeader.m_glFormat,             1, sizeof(ktxHeader.m_glFormat),             _stream);
+        read += ioRead(&ktxHeader.m_glInternalFormat,     1, sizeof(ktxHeader.m_glInternalFormat),     _stream);
+        read += ioRead(&ktxHeader.m_glBaseInternalFormat, 1, sizeof(ktxHeader.m_glBaseInternalFormat), _stream);
+        read += ioRead(&ktxHeader.m_pixelWidth,           1, sizeof(ktxHeader.m_pixelWidth),           _stream);
+        read += ioRead(&ktxHeader.m_pixelHeight,          1, sizeof(ktxHeader.m_pixelHeight),          _stream);
+        read += ioRead(&ktxHeader.m_pixelDepth,           1, sizeof(ktxHeader.m_pixelDepth),           _stream);
+        read += ioRead(&ktxHeader.m_numArrayElements,     1, sizeof(ktxHeader.m_numArrayElements),     _stream);
+        read += ioRead(&ktxHeader.m_numFaces,             1, sizeof(ktxHeader.m_numFaces),             _stream);
+        read += ioRead(&ktxHeader.m_numMips,              1, sizeof(ktxHeader.m_numMips),              _stream);
+        read += ioRead(&ktxHeader.m_bytesKeyValue,        1, sizeof(ktxHeader.m_bytesKeyValue),        _stream);
+        DEBUG_CHECK(read == KTX_HEADER_SIZE, "Error reading Ktx file header.");
+        IOERROR_CHECK(_stream);
+
+        if (0 == ktxHeader.m_numMips)
+        {
+            WARN("Ktx image mipmap count is 0. Setting to 1.");
+            ktxHeader.m_numMips = 1;
+        }
+
+        const uint32_t numElements = max(UINT32_C(1), ktxHeader.m_numArrayElements);
+        if (_element >= numElements)
+        {
+            WARN("Ktx array element %u requested, file has %u.", _element, numElements);
+            return false;
+        }
+
+        if (ktxHeader.m_numMips > MAX_MIP_NUM
+        ||  (1 != ktxHeader.m_numFaces && CUBE_FACE_NUM != ktxHeader.m_numFaces))
+        {
+            WARN("Ktx image mipmap count %u or face count %u is invalid.", ktxHeader.m_numMips, ktxHeader.m_numFaces);
+            return false;
+        }
+
+        // Loaded part of the file.
+        uint8_t firstMip;
+        uint8_t numMips;
+        if (!loadRangeMips(firstMip, numMips, _range, uint8_t(ktxHeader.m_numMips)))
+        {
+            return false;
+        }
+
+        const uint8_t numFaces = uint8_t(ktxHeader.m_numFaces);
+        bool partial = (0 != firstMip || numMips != ktxHeader.m_numMips);
+        for (uint8_t face = 0; face < numFaces; ++face)
+        {
+            partial |= !loadRangeHasFace(_range, numFaces, face);
+        }
+        const uint32_t width  = max(UINT32_C(1), ktxHeader.m_pixelWidth  >> firstMip);
+        const uint32_t height = max(UINT32_C(1), ktxHeader.m_pixelHeight >> firstMip);
+
+        // Get format.
+        TextureFormat::Enum format = TextureFormat::Unknown;
+        for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateKtxFormat); ii < end; ++ii)
+        {
+            if (s_translateKtxFormat[ii].m_glInternalFormat == ktxHeader.m_glInternalFormat)
+            {
+                format = s_translateKtxFormat[ii].m_textureFormat;
+                break;
+            }
+        }
+
+        // Block compressed formats without TextureFormat are only decoded.
+        BlockFormat::Enum blockFormat = blockFormatFromTextureFormat(format);
+        for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateKtxBlockFormat); ii < end && TextureFormat::Unknown == format; ++ii)
+        {
+            if (s_translateKtxBlockFormat[ii].m_glInternalFormat == ktxHeader.m_glInternalFormat)
+            {
+                blockFormat = s_translateKtxBlockFormat[ii].m_blockFormat;
+                break;
+            }
+        }
+
+        if (TextureFormat::Unknown == format
+        &&  BlockFormat::Count == blockFormat)
+        {
+            WARN("Ktx file internal format unknown.");
+            return false;
+        }
+
+        // Data is decoded straight into requested format. Formats that are only decoded default to rgba32f.
+        const TextureFormat::Enum srcFormat = (TextureFormat::Unknown != format) ? format : TextureFormat::RGBA32F;
+        const uint32_t bytesPerPixel = getImageDataInfo(srcFormat).m_bytesPerPixel;
+        const TextureFormat::Enum dstFormat = (TextureFormat::Unknown != _convertTo) ? _convertTo : srcFormat;
+        const uint32_t dstBytesPerPixel = getImageDataInfo(dstFormat).m_bytesPerPixel;
+
+        // Compute data offsets of loaded mips.
+        uint64_t offsets[MAX_MIP_NUM][CUBE_FACE_NUM];
+        uint64_t dataSize = 0;
+        for (uint8_t face = 0; face < numFaces; ++face)
+        {
+            for (uint8_t mip = 0; mip < numMips; ++mip)
+            {
+                offsets[mip][face] = dataSize;
+                const uint32_t mipWidth  = max(UINT32_C(1), width  >> mip);
+                const uint32_t mipHeight = max(UINT32_C(1), height >> mip);
+                dataSize += uint64_t(mipWidth) * mipHeight * dstBytesPerPixel;
+            }
+        }
+
+        // Key-value data holds the mip index of files saved with a mip layout, see ImageEncodeSettings::m_mipLayout.
+        ImageMipIndex mipIndex;
+        if (ktxReadMipIndex(mipIndex, _stream, ktxHeader.m_bytesKeyValue))
+        {
+            return imageLoadMipIndexed(_image
+                                     , _stream
+                                     , mipIndex
+                                     , ktxHeader.m_pixelWidth
+                                     , ktxHeader.m_pixelHeight
+                                     , uint8_t(ktxHeader.m_numMips)
+                                     , numFaces
+                                     , format
+                                     , _convertTo
+                                     , KTX_UNPACK_ALIGNMENT
+                                     , _element
+                                     , _range
+                                     );
+        }
+
+        if (BlockFormat::Count != blockFormat)
+        {
+            return ktxLoadBlocks(_image, _stream, ktxHeader, blockFormat, format, dstFormat, _element, firstMip, numMips, _range);
+        }
+
+        // Single mip without row padding has the same layout as Image, map it directly if requested.
+        // Face data starts after the 4 byte face size, preceded by faces of previous elements.
+        if (_mapFile
+        &&  !partial
+        &&  dstFormat == format
+        &&  1 == ktxHeader.m_numMips
+        &&  0 == ((ktxHeader.m_pixelWidth*bytesPerPixel)&(KTX_UNPACK_ALIGNMENT-1)))
+        {
+            const int64_t elementOffset = int64_t(_element)*int64_t(dataSize);
+            void* mappedData = fileMap(_stream, ioTell(_stream) + int64_t(sizeof(uint32_t)) + elementOffset, dataSize);
+            if (NULL != mappedData)
+            {
+                Image result;
+                result.m_width = ktxHeader.m_pixelWidth;
+                result.m_height = ktxHeader.m_pixelHeight;
+                result.m_dataSize = dataSize;
+                result.m_format = format;
+                result.m_numMips = 1;
+                result.m_numFaces = uint8_t(ktxHeader.m_numFaces);
+                result.m_data = mappedData;
+                result.m_mapped = true;
+
+                imageMove(_image, result);
+
+                return true;
+            }
+        }
+
+        // Alloc data.
+        void* data = getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
+        if (NULL == data)
+        {
+            return false;
+        }
+
+        // Read data. Mips before the range are skipped, reading stops after it.
+        for (uint8_t mip = 0; mip < firstMip+numMips; ++mip)
+        {
+            const uint32_t mipWidth  = max(UINT32_C(1), ktxHeader.m_pixelWidth  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), ktxHeader.m_pixelHeight >> mip);
+            const uint32_t pitch = mipWidth * bytesPerPixel;
+
+            // Read face size.
+            uint32_t faceSize;
+            read = ioRead(&faceSize, sizeof(uint32_t), 1, _stream);
+            DEBUG_CHECK(read == 1, "Error reading Ktx data.");
+            IOERROR_CHECK(_stream);
+
+            const uint32_t pitchRounding = (KTX_UNPACK_ALIGNMENT-1)-((pitch    + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+
+            // For arrays, image size covers all faces of all elements in the mip.
+            if (0 != ktxHeader.m_numArrayElements)
+            {
+                const uint32_t imageSize = faceSize;
+                faceSize = (pitch + pitchRounding) * mipHeight;
+
+                if (uint64_t(imageSize) != uint64_t(faceSize) * ktxHeader.m_numFaces * numElements)
+                {
+                    WARN("Ktx array mip size invalid.");
+                }
+            }
+
+            const uint32_t mipSize = faceSize * ktxHeader.m_numFaces;
+            const uint32_t faceRounding  = (KTX_UNPACK_ALIGNMENT-1)-((faceSize + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+            const uint32_t mipRounding   = (KTX_UNPACK_ALIGNMENT-1)-((mipSize  + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+
+            if (faceSize != ((pitch + pitchRounding) * mipHeight))
+            {
+                WARN("Ktx face size invalid.");
+            }
+
+            // Skipped data is what reading it would consume, rows are padded even if face size says otherwise.
+            const uint32_t paddedFaceSize = (pitch + pitchRounding) * mipHeight;
+            if (mip < firstMip)
+            {
+                const int64_t facesSize = (0 != ktxHeader.m_numArrayElements)
+                                        ? int64_t(numElements)*mipSize
+                                        : int64_t(paddedFaceSize + faceRounding)*ktxHeader.m_numFaces
+                                        ;
+                ioSeek(_stream, facesSize + mipRounding, SEEK_CUR);
+                IOERROR_CHECK(_stream);
+                continue;
+            }
+
+            // Jump faces of previous elements.
+            if (0 != _element)
+            {
+                ioSeek(_stream, int64_t(_element)*mipSize, SEEK_CUR);
+                IOERROR_CHECK(_stream);
+            }
+
+            for (uint8_t face = 0; face < ktxHeader.m_numFaces; ++face)
+            {
+                uint8_t* faceData = (uint8_t*)data + offsets[mip-firstMip][face];
+
+                if (!loadRangeHasFace(_range, numFaces, face))
+                {
+                    memset(faceData, 0, size_t(uint64_t(mipWidth)*mipHeight*dstBytesPerPixel));
+                    ioSeek(_stream, int64_t(paddedFaceSize), SEEK_CUR);
+                    IOERROR_CHECK(_stream);
+                }
+                else if (0 == pitchRounding)
+                {
+                    // Read entire face at once.
+                    readConvertedPixels(faceData, dstFormat, _stream, format, uint64_t(mipWidth)*mipHeight);
+                }
+                else
+                {
+                    // Read row by row.
+                    for (uint32_t yy = 0; yy < mipHeight; ++yy)
+                    {
+                        // Read row.
+                        uint8_t* dst = (uint8_t*)faceData + uint64_t(yy)*mipWidth*dstBytesPerPixel;
+                        readConvertedPixels(dst, dstFormat, _stream, format, mipWidth);
+
+                        // Jump row rounding.
+                        int seek = ioSeek(_stream, pitchRounding, SEEK_CUR);
+                        BX_UNUSED(seek);
+                        DEBUG_CHECK(0 == seek, "File seek error.");
+                        IOERROR_CHECK(_stream);
+                    }
+                }
+
+                // Jump face rounding.
+                int seek = ioSeek(_stream, faceRounding, SEEK_CUR);
+                BX_UNUSED(seek);
+                DEBUG_CHECK(0 == seek, "File seek error.");
+                IOERROR_CHECK(_stream);
+            }
+
+            // Jump faces of following elements.
+            if (_element+1 < numElements)
+            {
+                ioSeek(_stream, int64_t(numElements-_element-1)*mipSize, SEEK_CUR);
+                IOERROR_CHECK(_stream);
+            }
+
+            // Jump mip rounding.
+            int seek = ioSeek(_stream, mipRounding, SEEK_CUR);
+            BX_UNUSED(seek);
+            DEBUG_CHECK(0 == seek, "File seek error.");
+            IOERROR_CHECK(_stream);
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = width;
+        result.m_height = height;
+        result.m_dataSize = dataSize;
+        result.m_format = dstFormat;
+        result.m_numMips = numMips;
+        result.m_numFaces = numFaces;
+        result.m_data = data;
+
+        // Output.
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    static bool isKtx2(Reader* _stream)
+    {
+        const int64_t pos = ioTell(_stream);
+
+        uint8_t magic[KTX2_MAGIC_LEN];
+        const size_t read = ioRead(magic, 1, KTX2_MAGIC_LEN, _stream);
+        ioSeek(_stream, pos, SEEK_SET);
+
+        const uint8_t ktx2Magic[KTX2_MAGIC_LEN] = KTX2_MAGIC;
+        return KTX2_MAGIC_LEN == read && 0 == memcmp(magic, ktx2Magic, KTX2_MAGIC_LEN);
+    }
+
+    struct Ktx2DecodeArgs
+    {
+        const Ktx2Level* m_levels;    //!< Of loaded mips.
+        const uint8_t* m_src;         //!< Level data as read from file, level after level.
+        uint64_t m_srcOffsets[MAX_MIP_NUM];
+        uint64_t m_faceSizes[MAX_MIP_NUM];
+        uint64_t m_dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint8_t* m_dst;
+        uint32_t m_element;
+        uint8_t m_numFaces;
+        bool m_zlib;
+        volatile bool m_failed;
+    };
+
+    /// Decompresses levels and copies faces of the requested element into Image layout.
+    static void ktx2DecodeLevels(void* _args, uint32_t _begin, uint32_t _end)
+    {
+        Ktx2DecodeArgs& args = *(Ktx2DecodeArgs*)_args;
+
+        for (uint32_t mip = _begin; mip < _end; ++mip)
+        {
+            const Ktx2Level& level = args.m_levels[mip];
+            const uint8_t* src = args.m_src + args.m_srcOffsets[mip];
+
+            uint8_t* tmp = NULL;
+            if (args.m_zlib)
+            {
+                tmp = (uint8_t*)allocScratch(level.m_uncompressedByteLength, AllocTag::IoBuffer);
+                MALLOC_CHECK(tmp);
+                if (!zlibDecompress(tmp, uint32_t(level.m_uncompressedByteLength), src, uint32_t(level.m_byteLength)))
+                {
+                    args.m_failed = true;
+                    freeScratch(tmp);
+                    continue;
+                }
+                src = tmp;
+            }
+
+            // Faces of all elements follow each other.
+            const uint64_t faceSize = args.m_faceSizes[mip];
+            for (uint8_t face = 0; face < args.m_numFaces; ++face)
+            {
+                const uint64_t offset = (uint64_t(args.m_element)*args.m_numFaces + face)*faceSize;
+                memcpy(args.m_dst + args.m_dstOffsets[face][mip], src + offset, size_t(faceSize));
+            }
+
+            freeScratch(tmp);
+        }
+    }
+
+    /// Loads array element _element of Ktx2 file in its own format. With _mip other than UINT8_MAX, only that mip is loaded.
+    /// Level index gives offset of every mip, so only the requested ones are read and decompressed.
+    bool imageLoadKtx2(Image& _image, Reader* _stream, uint32_t _element, uint8_t _mip)
+    {
+        CMFT_UNUSED size_t read;
+
+        // Read magic.
+        uint8_t magic[KTX2_MAGIC_LEN];
+        read = ioRead(magic, 1, KTX2_MAGIC_LEN, _stream);
+        DEBUG_CHECK(read == KTX2_MAGIC_LEN, "Could not read from file.");
+        IOERROR_CHECK(_stream);
+
+        const uint8_t ktx2Magic[KTX2_MAGIC_LEN] = KTX2_MAGIC;
+        if (0 != memcmp(magic, ktx2Magic, KTX2_MAGIC_LEN))
+        {
+            WARN("Ktx2 magic invalid.");
+            return false;
+        }
+
+        // Read header.
+        Ktx2Header ktx2Header;
+        read = 0;
+        read += ioRead(&ktx2Header.m_vkFormat,               1, sizeof(ktx2Header.m_vkFormat),               _stream);
+        read += ioRead(&ktx2Header.m_typeSize,               1, sizeof(ktx2Header.m_typeSize),               _stream);
+        read += ioRead(&ktx2Header.m_pixelWidth,             1, sizeof(ktx2Header.m_pixelWidth),             _stream);
+        read += ioRead(&ktx2Header.m_pixelHeight,            1, sizeof(ktx2Header.m_pixelHeight),            _stream);
+        read += ioRead(&ktx2Header.m_pixelDepth,             1, sizeof(ktx2Header.m_pixelDepth),             _stream);
+        read += ioRead(&ktx2Header.m_layerCount,             1, sizeof(ktx2Header.m_layerCount),             _stream);
+        read += ioRead(&ktx2Header.m_faceCount,              1, sizeof(ktx2Header.m_faceCount),              _stream);
+        read += ioRead(&ktx2Header.m_levelCount,             1, sizeof(ktx2Header.m_levelCount),             _stream);
+        read += ioRead(&ktx2Header.m_supercompressionScheme, 1, sizeof(ktx2Header.m_supercompressionScheme), _stream);
+        read += ioRead(&ktx2Header.m_dfdByteOffset,          1, sizeof(ktx2Header.m_dfdByteOffset),          _stream);
+        read += ioRead(&ktx2Header.m_dfdByteLength,          1, sizeof(ktx2Header.m_dfdByteLength),          _stream);
+        read += ioRead(&ktx2Header.m_kvdByteOffset,          1, sizeof(ktx2Header.m_kvdByteOffset),          _stream);
+        read += ioRead(&ktx2Header.m_kvdByteLength,          1, sizeof(ktx2Header.m_kvdByteLength),          _stream);
+        read += ioRead(&ktx2Header.m_sgdByteOffset,          1, sizeof(ktx2Header.m_sgdByteOffset),          _stream);
+        read += ioRead(&ktx2Header.m_sgdByteLength,          1, sizeof(ktx2Header.m_sgdByteLength),          _stream);
+        DEBUG_CHECK(read == KTX2_HEADER_SIZE, "Error reading Ktx2 file header.");
+        IOERROR_CHECK(_stream);
+
+        // Validate header.
+        if (0 != ktx2Header.m_pixelDepth)
+        {
+            WARN("Ktx2 3D textures are not supported.");
+            return false;
+        }
+
+        if (1 != ktx2Header.m_faceCount
+        &&  6 != ktx2Header.m_faceCount)
+        {
+            WARN("Ktx2 face count invalid.");
+            return false;
+        }
+
+        if (KTX2_SUPERCOMPRESSION_NONE != ktx2Header.m_supercompressionScheme
+        &&  KTX2_SUPERCOMPRESSION_ZLIB != ktx2Header.m_supercompressionScheme)
+        {
+            WARN("Ktx2 supercompression scheme %u is not supported, only zlib is.", ktx2Header.m_supercompressionScheme);
+            return false;
+        }
+
+        if (0 == ktx2Header.m_levelCount)
+        {
+            WARN("Ktx2 image mipmap count is 0. Setting to 1.");
+            ktx2Header.m_levelCount = 1;
+        }
+
+        if (ktx2Header.m_levelCount > MAX_MIP_NUM)
+        {
+            WARN("Ktx2 mipmap count %u exceeds %u.", ktx2Header.m_levelCount, MAX_MIP_NUM);
+            return false;
+        }
+
+        const uint32_t numElements = max(UINT32_C(1), ktx2Header.m_layerCount);
+        if (_element >= numElements)
+        {
+            WARN("Ktx2 array element %u requested, file has %u.", _element, numElements);
+            return false;
+        }
+
+        if (UINT8_MAX != _mip
+        &&  _mip >= ktx2Header.m_levelCount)
+        {
+            WARN("Ktx2 mip %u requested, file has %u.", _mip, ktx2Header.m_levelCount);
+            return false;
+        }
+
+        // Get format.
+        TextureFormat::Enum format = TextureFormat::Unknown;
+        for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateKtx2Format); ii < end; ++ii)
+        {
+            if (s_translateKtx2Format[ii].m_vkFormat == ktx2Header.m_vkFormat)
+            {
+                format = s_translateKtx2Format[ii].m_textureFormat;
+                break;
+            }
+        }
+
+        if (TextureFormat::Unknown == format)
+        {
+            WARN("Ktx2 vkFormat %u unknown.", ktx2Header.m_vkFormat);
+            return false;
+        }
+
+        // Read level index.
+        Ktx2Level levels[MAX_MIP_NUM];
+        for (uint32_t level = 0; level < ktx2Header.m_levelCount; ++level)
+        {
+            read = 0;
+            read += ioRead(&levels[level].m_byteOffset,             1, sizeof(uint64_t), _stream);
+            read += ioRead(&levels[level].m_byteLength,             1, sizeof(uint64_t), _stream);
+            read += ioRead(&levels[level].m_uncompressedByteLength, 1, sizeof(uint64_t), _stream);
+            DEBUG_CHECK(read == KTX2_LEVEL_INDEX_SIZE, "Error reading Ktx2 level index.");
+            IOERROR_CHECK(_stream);
+        }
+
+        const uint8_t firstMip = (UINT8_MAX == _mip) ? 0 : _mip;
+        const uint8_t numMips  = (UINT8_MAX == _mip) ? uint8_t(ktx2Header.m_levelCount) : 1;
+        const uint32_t width  = max(UINT32_C(1), ktx2Header.m_pixelWidth  >> firstMip);
+        const uint32_t height = max(UINT32_C(1), ktx2Header.m_pixelHeight >> firstMip);
+        const uint8_t numFaces = uint8_t(ktx2Header.m_faceCount);
+
+        Image result;
+        result.m_width = width;
+        result.m_height = height;
+        result.m_format = format;
+        result.m_numMips = numMips;
+        result.m_numFaces = numFaces;
+
+        Ktx2DecodeArgs args;
+        args.m_levels = &levels[firstMip];
+        args.m_element = _element;
+        args.m_numFaces = numFaces;
+        args.m_zlib = (KTX2_SUPERCOMPRESSION_ZLIB == ktx2Header.m_supercompressionScheme);
+        args.m_failed = false;
+
+        uint64_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(dstOffsets, result);
+        memcpy(args.m_dstOffsets, dstOffsets, sizeof(dstOffsets));
+
+        // Validate level sizes.
+        ioSeek(_stream, 0, SEEK_END);
+        const uint64_t fileSize = uint64_t(ioTell(_stream));
+
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(format);
+        uint64_t srcSize = 0;
+        uint64_t dataSize = 0;
+        for (uint8_t mip = 0; mip < numMips; ++mip)
+        {
+            const Ktx2Level& level = args.m_levels[mip];
+            const uint32_t mipWidth  = max(UINT32_C(1), width  >> mip);
+            const uint32_t mipHeight = max(UINT32_C(1), height >> mip);
+            const uint64_t faceSize = mipFaceDataSize(imageDataInfo, mipWidth, mipHeight);
+
+            if (level.m_uncompressedByteLength != faceSize*numFaces*numElements
+            || (!args.m_zlib && level.m_byteLength != level.m_uncompressedByteLength)
+            ||  level.m_uncompressedByteLength > UINT32_MAX
+            ||  level.m_byteLength > UINT32_MAX
+            ||  level.m_byteOffset + level.m_byteLength > fileSize)
+            {
+                WARN("Ktx2 level %u size invalid.", firstMip+mip);
+                return false;
+            }
+
+            args.m_faceSizes[mip] = faceSize;
+            args.m_srcOffsets[mip] = srcSize;
+            srcSize += level.m_byteLength;
+            dataSize += faceSize*numFaces;
+        }
+
+        // Read levels.
+        uint8_t* src = (uint8_t*)allocScratch(srcSize, AllocTag::IoBuffer);
+        MALLOC_CHECK(src);
+        for (uint8_t mip = 0; mip < numMips; ++mip)
+        {
+            ioSeek(_stream, int64_t(args.m_levels[mip].m_byteOffset), SEEK_SET);
+            read = ioRead(src + args.m_srcOffsets[mip], 1, size_t(args.m_levels[mip].m_byteLength), _stream);
+            DEBUG_CHECK(read == args.m_levels[mip].m_byteLength, "Error reading Ktx2 level data.");
+            IOERROR_CHECK(_stream);
+        }
+
+        // Alloc data.
+        void* data = getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
+        if (NULL == data)
+        {
+            freeScratch(src);
+            return false;
+        }
+
+        // Decode levels.
+        args.m_src = src;
+        args.m_dst = (uint8_t*)data;
+        parallelFor(ktx2DecodeLevels, (void*)&args, numMips, 1);
+
+        freeScratch(src);
+
+        if (args.m_failed)
+        {
+            WARN("Ktx2 level data is corrupt.");
+            getAllocator()->free(data);
+            return false;
+        }
+
+        // Output.
+        result.m_dataSize = dataSize;
+        result.m_data = data;
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    /// Buffered Hdr scanline reader.
+    struct HdrReader
+    {
+        Reader* m_stream;
+        uint8_t* m_buffer;
+        uint8_t* m_scanline; // Rle scanlines are stored one channel after another.
+        uint32_t m_pos;
+        uint32_t m_size;
+        uint32_t m_width;
+        uint32_t m_height;
+        HdrHeader m_header;
+    };
+
+    static bool hdrReaderFill(HdrReader& _reader)
+    {
+        _reader.m_pos = 0;
+        _reader.m_size = uint32_t(ioRead(_reader.m_buffer, 1, CMFT_HDR_READ_BUFFER_SIZE, _reader.m_stream));
+        IOERROR_CHECK(_reader.m_stream);
+
+        return (0 != _reader.m_size);
+    }
+
+    static inline bool hdrReadByte(HdrReader& _reader, uint8_t& _byte)
+    {
+        if (_reader.m_pos == _reader.m_size
+        &&  !hdrReaderFill(_reader))
+        {
+            return false;
+        }
+
+        _byte = _reader.m_buffer[_reader.m_pos++];
+        return true;
+    }
+
+    static bool hdrRead(HdrReader& _reader, uint8_t* _dst, uint32_t _size)
+    {
+        while (0 != _size)
+        {
+            if (_reader.m_pos == _reader.m_size
+            &&  !hdrReaderFill(_reader))
+            {
+                return false;
+            }
+
+            const uint32_t count = min(_size, _reader.m_size - _reader.m_pos);
+            memcpy(_dst, &_reader.m_buffer[_reader.m_pos], count);
+            _reader.m_pos += count;
+            _dst += count;
+            _size -= count;
+        }
+
+        return true;
+    }
+
+    static void hdrReaderClose(HdrReader& _reader)
+    {
+        freeScratch(_reader.m_buffer);
+        _reader.m_buffer = NULL;
+        _reader.m_scanline = NULL;
+    }
+
+    /// Reads Hdr header. Scanlines can be read with hdrReadScanline() afterwards.
+    static bool hdrReaderOpen(HdrReader& _reader, Reader* _stream)
+    {
+        CMFT_UNUSED char* get;
+        CMFT_UNUSED size_t read;
+        char buf[128];
+
+        _reader.m_stream = _stream;
+        _reader.m_buffer = NULL;
+        _reader.m_scanline = NULL;
+
+        // Read first line.
+        get = ioGets(buf, sizeof(buf), _stream);
+        DEBUG_CHECK(NULL != get, "Error reading first line of Hdr file.");
+
+        // Check magic.
+        if(0 != strncmp(buf, HDR_MAGIC_FULL, HDR_MAGIC_LEN))
+        {
+            WARN("HDR magic not valid.");
+            return false;
+        }
+
+        HdrHeader& hdrHeader = _reader.m_header;
+        hdrHeader.m_valid = 0;
+        hdrHeader.m_gamma = 1.0f;
+        hdrHeader.m_exposure = 1.0f;
+
+        // Read header.
+        bool formatDefined = false;
+        for(uint8_t ii = 0, stop = 20; ii < stop; ++ii)
+        {
+            // Read next line.
+            get = ioGets(buf, sizeof(buf), _stream);
+            DEBUG_CHECK(NULL != get, "Error reading Hdr file header.");
+            IOERROR_CHECK(_stream);
+
+            if ((0 == buf[0])
+            || ('\n' == buf[0]))
+            {
+                // End of header.
+                break;
+            }
+            else if (0 == strcmp(buf, "FORMAT=32-bit_rle_rgbe\n"))
+            {
+                formatDefined = true;
+            }
+            else if (1 == sscanf(buf, "GAMMA=%g", &hdrHeader.m_gamma))
+            {
+                hdrHeader.m_valid |= HDR_VALID_GAMMA;
+            }
+            else if (1 == sscanf(buf, "EXPOSURE=%g", &hdrHeader.m_exposure))
+            {
+                hdrHeader.m_valid |= HDR_VALID_EXPOSURE;
+            }
+        }
+
+        if (!formatDefined)
+        {
+            WARN("Invalid Hdr header.");
+        }
+
+        // Read empty line (end of header).
+        get = ioGets(buf, sizeof(buf), _stream);
+        DEBUG_CHECK(NULL != get, "Error reading end of Hdr file header.");
+        IOERROR_CHECK(_stream);
+
+        // Read image size.
+        int32_t width;
+        int32_t height;
+        if (2 != sscanf(buf, "-Y %d +X %d", &height, &width)
+        ||  width <= 0
+        ||  height <= 0)
+        {
+            WARN("Error reading Hdr image size.");
+            return false;
+        }
+
+        _reader.m_width = uint32_t(width);
+        _reader.m_height = uint32_t(height);
+
+        // Alloc read buffer and rle scanline.
+        _reader.m_buffer = (uint8_t*)allocScratch(CMFT_HDR_READ_BUFFER_SIZE + _reader.m_width*4, AllocTag::IoBuffer);
+        MALLOC_CHECK(_reader.m_buffer);
+        _reader.m_scanline = _reader.m_buffer + CMFT_HDR_READ_BUFFER_SIZE;
+        _reader.m_pos = 0;
+        _reader.m_size = 0;
+
+        return true;
+    }
+
+    /// Decodes next scanline into _rgbe, _reader.m_width rgbe pixels.
+    static bool hdrReadScanline(HdrReader& _reader, uint8_t* _rgbe)
+    {
+        const uint32_t width = _reader.m_width;
+
+        // Read first pixel.
+        uint8_t rgbe[4];
+        if (!hdrRead(_reader, rgbe, 4))
+        {
+            WARN("Error reading Hdr image data.");
+            return false;
+        }
+
+        if ((width < 8)
+        || (width > 0x7fff)
+        || (rgbe[0] != 2)
+        || (rgbe[1] != 2)
+        || (rgbe[2] & 0x80))
+        {
+            // Scanline not RLE.
+            memcpy(_rgbe, rgbe, 4);
+            if (!hdrRead(_reader, _rgbe+4, (width-1)*4))
+            {
+                WARN("Error reading Hdr image data.");
+                return false;
+            }
+
+            return true;
+        }
+
+        if (((uint32_t(rgbe[2])<<8)|rgbe[3]) != width)
+        {
+            WARN("Hdr file scanline width is invalid.");
+            return false;
+        }
+
+        // Scanline is RLE, channels are stored one after another.
+        uint8_t* ptr = _reader.m_scanline;
+        for (uint8_t ii = 0; ii < 4; ++ii)
+        {
+            const uint8_t* ptrEnd = _reader.m_scanline + width*(ii+1);
+            while (ptr < ptrEnd)
+            {
+                uint8_t rle[2];
+                if (!hdrRead(_reader, rle, 2))
+                {
+                    WARN("Error reading Hdr image data.");
+                    return false;
+                }
+
+                if (rle[0] > 128)
+                {
+                    // RLE chunk.
+                    const int32_t count = rle[0] - 128;
+                    if (count > (ptrEnd - ptr))
+                    {
+                        WARN("Bad Hdr scanline data.");
+                        return false;
+                    }
+                    memset(ptr, rle[1], count);
+                    ptr += count;
+                }
+                else
+                {
+                    // Normal chunk.
+                    const int32_t count = rle[0];
+                    if (0 == count || count > (ptrEnd - ptr))
+                    {
+                        WARN("Bad Hdr scanline data.");
+                        return false;
+                    }
+                    *ptr++ = rle[1];
+                    if (!hdrRead(_reader, ptr, count-1))
+                    {
+                        WARN("Error reading Hdr image data.");
+                        return false;
+                    }
+                    ptr += count-1;
+                }
+            }
+        }
+
+        // Interleave channels.
+        const uint8_t* scanline = _reader.m_scanline;
+        for (uint32_t ii = 0; ii < width; ++ii)
+        {
+            _rgbe[0] = scanline[ii+(0*width)];
+            _rgbe[1] = scanline[ii+(1*width)];
+            _rgbe[2] = scanline[ii+(2*width)];
+            _rgbe[3] = scanline[ii+(3*width)];
+            _rgbe += 4;
+        }
+
+        return true;
+    }
+
+    /// Decodes rgbe scanline straight into _rgba32f.
+    static bool hdrReadScanlineRgba32f(HdrReader& _reader, float* _rgba32f, uint8_t* _rgbeRow)
+    {
+        if (!hdrReadScanline(_reader, _rgbeRow))
+        {
+            return false;
+        }
+
+        for (uint32_t ii = 0; ii < _reader.m_width; ++ii)
+        {
+            rgbeToRgba32f(&_rgba32f[ii*4], &_rgbeRow[ii*4]);
+        }
+
+        return true;
+    }
+
+    /// Scanlines are decoded straight into the requested format, a band of rgbe rows at a time.
+    bool imageLoadHdr(Image& _image, Reader* _stream, TextureFormat::Enum _convertTo)
+    {
+        HdrReader reader;
+        if (!hdrReaderOpen(reader, _stream))
+        {
+            return false;
+        }
+
+        const TextureFormat::Enum dstFormat = (TextureFormat::Unknown != _convertTo) ? _convertTo : TextureFormat::RGBE;
+        const bool convert = (TextureFormat::RGBE != dstFormat);
+        const uint32_t width = reader.m_width;
+        const uint32_t height = reader.m_height;
+        const uint64_t pitch = uint64_t(width)*getImageDataInfo(dstFormat).m_bytesPerPixel;
+
+        // Allocate data.
+        const uint64_t dataSize = pitch * height;
+        uint8_t* data = (uint8_t*)getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
+        if (NULL == data)
+        {
+            hdrReaderClose(reader);
+            return false;
+        }
+
+        // Rgba32f chunk goes first to keep it aligned.
+        const uint32_t bandRows = convert ? min(height, max(UINT32_C(1), uint32_t(CMFT_LOAD_CONVERT_CHUNK_PIXELS/width))) : 0;
+        const uint32_t bandPixels = bandRows*width;
+        const bool viaRgba32f = (convert && TextureFormat::RGBA32F != dstFormat);
+        const size_t rgba32fSize = viaRgba32f ? size_t(bandPixels)*4*sizeof(float) : 0;
+        uint8_t* band = NULL;
+        if (convert)
+        {
+            band = (uint8_t*)allocScratch(rgba32fSize + size_t(bandPixels)*4, AllocTag::IoBuffer);
+            MALLOC_CHECK(band);
+        }
+        float* rgba32f = viaRgba32f ? (float*)band : NULL;
+        uint8_t* rgbe = band + rgba32fSize;
+
+        bool read = true;
+        for (uint32_t yy = 0; read && yy < height; )
+        {
+            if (!convert)
+            {
+                read = hdrReadScanline(reader, data + yy*pitch);
+                ++yy;
+                continue;
+            }
+
+            const uint32_t numRows = min(bandRows, height-yy);
+            for (uint32_t ii = 0; read && ii < numRows; ++ii)
+            {
+                read = hdrReadScanline(reader, rgbe + size_t(ii)*width*4);
+            }
+
+            if (read)
+            {
+                convertPixels(data + yy*pitch, dstFormat, rgbe, TextureFormat::RGBE, numRows*width, rgba32f);
+            }
+            yy += numRows;
+        }
+
+        freeScratch(band);
+        hdrReaderClose(reader);
+
+        if (!read)
+        {
+            getAllocator()->free(data);
+            return false;
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = width;
+        result.m_height = height;
+        result.m_dataSize = dataSize;
+        result.m_format = dstFormat;
+        result.m_numMips = 1;
+        result.m_numFaces = 1;
+        result.m_data = (void*)data;
+
+        // Output.
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    struct HdrRows
+    {
+        HdrReader* m_reader;
+        uint8_t* m_rgbeRow;
+    };
+
+    static bool hdrReadRowsRgba32f(float* _rows, uint32_t /*_firstRow*/, uint32_t _numRows, void* _userData)
+    {
+        const HdrRows* rows = (const HdrRows*)_userData;
+        const uint32_t width = rows->m_reader->m_width;
+
+        for (uint32_t ii = 0; ii < _numRows; ++ii)
+        {
+            if (!hdrReadScanlineRgba32f(*rows->m_reader, _rows + size_t(ii)*width*4, rows->m_rgbeRow))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool imageCubemapFromLatLongHdr(Image& _dst, const char* _filePath, bool _useBilinearInterpolation, uint32_t _bandRows)
+    {
+        AllocTagScope allocTag(AllocTag::IoBuffer, true);
+
+        CMFT_UNUSED int seek;
+
+        // Open file.
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
+        {
+            WARN("Could not open file %s for reading.", _filePath);
+            return false;
+        }
+        ScopeFclose cleanup(fp);
+        FileReader stream(fp);
+
+        // Check magic.
+        uint32_t magic = 0;
+        if (1 != ioRead(&magic, sizeof(uint32_t), 1, &stream)
+        ||  HDR_MAGIC != magic)
+        {
+            return false;
+        }
+
+        // Seek to beginning.
+        seek = ioSeek(&stream, 0L, SEEK_SET);
+        DEBUG_CHECK(0 == seek, "File seek error.");
+        IOERROR_CHECK(&stream);
+
+        HdrReader reader;
+        if (!hdrReaderOpen(reader, &stream))
+        {
+            return false;
+        }
+
+        Image src;
+        src.m_width = reader.m_width;
+        src.m_height = reader.m_height;
+        if (!imageIsLatLong(src))
+        {
+            hdrReaderClose(reader);
+            return false;
+        }
+
+        HdrRows rows;
+        rows.m_reader = &reader;
+        rows.m_rgbeRow = (uint8_t*)allocScratch(reader.m_width*4, AllocTag::IoBuffer);
+        MALLOC_CHECK(rows.m_rgbeRow);
+
+        const bool converted = cubemapFromLatLongBands(_dst, reader.m_width, reader.m_height, hdrReadRowsRgba32f, (void*)&rows, _useBilinearInterpolation, _bandRows);
+
+        freeScratch(rows.m_rgbeRow);
+        hdrReaderClose(reader);
+
+        return converted;
+    }
+
+    bool imageLoadTga(Image& _image, Reader* _stream, TextureFormat::Enum _convertTo)
+    {
+        CMFT_UNUSED size_t read;
+        CMFT_UNUSED int seek;
+
+        // Load header.
+        TgaHeader tgaHeader;
+        read = 0;
+        read += ioRead(&tgaHeader.m_idLength,        1, sizeof(tgaHeader.m_idLength),        _stream);
+        read += ioRead(&tgaHeader.m_colorMapType,    1, sizeof(tgaHeader.m_colorMapType),    _stream);
+        read += ioRead(&tgaHeader.m_imageType,       1, sizeof(tgaHeader.m_imageType),       _stream);
+        read += ioRead(&tgaHeader.m_colorMapOrigin,  1, sizeof(tgaHeader.m_colorMapOrigin),  _stream);
+        read += ioRead(&tgaHeader.m_colorMapLength,  1, sizeof(tgaHeader.m_colorMapLength),  _stream);
+        read += ioRead(&tgaHeader.m_colorMapDepth,   1, sizeof(tgaHeader.m_colorMapDepth),   _stream);
+        read += ioRead(&tgaHeader.m_xOrigin,         1, sizeof(tgaHeader.m_xOrigin),         _stream);
+        read += ioRead(&tgaHeader.m_yOrigin,         1, sizeof(tgaHeader.m_yOrigin),         _stream);
+        read += ioRead(&tgaHeader.m_width,           1, sizeof(tgaHeader.m_width),           _stream);
+        read += ioRead(&tgaHeader.m_height,          1, sizeof(tgaHeader.m_height),          _stream);
+        read += ioRead(&tgaHeader.m_bitsPerPixel,    1, sizeof(tgaHeader.m_bitsPerPixel),    _stream);
+        read += ioRead(&tgaHeader.m_imageDescriptor, 1, sizeof(tgaHeader.m_imageDescriptor), _stream);
+        DEBUG_CHECK(read == TGA_HEADER_SIZE, "Error reading file header.");
+        IOERROR_CHECK(_stream);
+
+        // Check header.
+        if(0 == (TGA_IT_RGB & tgaHeader.m_imageType))
+        {
+            WARN("Tga file is not true-color image.");
+            return false;
+        }
+
+        // Get format.
+        TextureFormat::Enum format;
+        if (24 == tgaHeader.m_bitsPerPixel)
+        {
+            format = TextureFormat::BGR8;
+            DEBUG_CHECK(0x0 == (tgaHeader.m_imageDescriptor&0xf), "Alpha channel not properly defined.");
+        }
+        else if (32 == tgaHeader.m_bitsPerPixel)
+        {
+            format = TextureFormat::BGRA8;
+            DEBUG_CHECK(0x8 == (tgaHeader.m_imageDescriptor&0xf), "Alpha channel not properly defined.");
+        }
+        else
+        {
+            WARN("Non-supported Tga pixel depth - %u.", tgaHeader.m_bitsPerPixel);
+            return false;
+        }
+
+        // Data is decoded straight into requested format.
+        const TextureFormat::Enum dstFormat = (TextureFormat::Unknown != _convertTo) ? _convertTo : format;
+        const uint32_t dstBytesPerPixel = getImageDataInfo(dstFormat).m_bytesPerPixel;
+
+        // Alloc data.
+        const uint32_t numBytesPerPixel = tgaHeader.m_bitsPerPixel/8;
+        const uint32_t numPixels = tgaHeader.m_width * tgaHeader.m_height;
+        const uint64_t dataSize = uint64_t(numPixels) * dstBytesPerPixel;
+        uint8_t* data = (uint8_t*)getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(data);
+        if (NULL == data)
+        {
+            return false;
+        }
+
+        // Skip to data.
+        const uint32_t skip = tgaHeader.m_idLength + (tgaHeader.m_colorMapType&0x1)*tgaHeader.m_colorMapLength;
+        seek = ioSeek(_stream, skip, SEEK_CUR);
+        DEBUG_CHECK(0 == seek, "File seek error.");
+        IOERROR_CHECK(_stream);
+
+        // Load data.
+        const bool bCompressed = (0 != (tgaHeader.m_imageType&TGA_IT_RLE));
+        if (bCompressed)
+        {
+            // Decode into chunks of native pixels, which are converted into data as they fill up.
+            // A packet can run past the chunk end, the overhang is moved to the beginning of the next chunk.
+            const bool convert = (dstFormat != format);
+            const uint32_t chunkPixels = convert ? min(numPixels, uint32_t(CMFT_LOAD_CONVERT_CHUNK_PIXELS)) : numPixels;
+            const bool viaRgba32f = (convert && TextureFormat::RGBA32F != dstFormat);
+            const size_t rgba32fSize = viaRgba32f ? size_t(chunkPixels)*4*sizeof(float) : 0;
+            uint8_t* chunk = data;
+            if (convert)
+            {
+                chunk = (uint8_t*)allocScratch(rgba32fSize + size_t(chunkPixels+TGA_RLE_MAX_PACKET)*numBytesPerPixel, AllocTag::IoBuffer);
+                MALLOC_CHECK(chunk);
+            }
+            float* rgba32f = viaRgba32f ? (float*)chunk : NULL;
+            uint8_t* chunkBegin = chunk + rgba32fSize;
+            uint8_t* chunkEnd = chunkBegin + size_t(chunkPixels)*numBytesPerPixel;
+
+            // Packets are decoded from a buffer, which always holds a whole packet unless the file ends.
+            const uint32_t maxPacketSize = 1 + TGA_RLE_MAX_PACKET*numBytesPerPixel;
+            uint8_t* buffer = (uint8_t*)allocScratch(CMFT_TGA_READ_BUFFER_SIZE, AllocTag::IoBuffer);
+            MALLOC_CHECK(buffer);
+            uint32_t bufferPos = 0;
+            uint32_t bufferSize = 0;
+            bool eof = false;
+
+            uint32_t n = 0;
+            uint8_t* dataPtr = chunkBegin;
+            uint8_t* dstPtr = data;
+            while (n < numPixels)
+            {
+                if (!eof
+                &&  bufferSize - bufferPos < maxPacketSize)
+                {
+                    bufferSize -= bufferPos;
+                    memmove(buffer, &buffer[bufferPos], bufferSize);
+                    bufferPos = 0;
+
+                    const uint32_t num = uint32_t(ioRead(&buffer[bufferSize], 1, CMFT_TGA_READ_BUFFER_SIZE-bufferSize, _stream));
+                    IOERROR_CHECK(_stream);
+                    bufferSize += num;
+                    eof = (0 == num);
+                }
+
+                const bool rle = (bufferPos < bufferSize) && (0 != (buffer[bufferPos] & 0x80));
+                const uint32_t count = (bufferPos < bufferSize) ? min(uint32_t(buffer[bufferPos] & 0x7f) + 1, numPixels - n) : 0;
+                const uint32_t packetSize = 1 + (rle ? 1 : count)*numBytesPerPixel;
+                if (0 == count
+                ||  bufferSize - bufferPos < packetSize)
+                {
+                    DEBUG_CHECK(false, "Could not read from file.");
+                    break;
+                }
+
+                const uint8_t* packet = &buffer[bufferPos+1];
+                const size_t size = size_t(count)*numBytesPerPixel;
+                if (rle)
+                {
+                    // Fill by doubling the filled part.
+                    memcpy(dataPtr, packet, numBytesPerPixel);
+                    for (size_t filled = numBytesPerPixel; filled < size; filled *= 2)
+                    {
+                        memcpy(dataPtr + filled, dataPtr, min(filled, size-filled));
+                    }
+                }
+                else
+                {
+                    memcpy(dataPtr, packet, size);
+                }
+                bufferPos += packetSize;
+                dataPtr += size;
+                n += count;
+
+                if (convert
+                && (dataPtr >= chunkEnd || n == numPixels))
+                {
+                    const uint8_t* end = min(dataPtr, chunkEnd);
+                    const uint32_t chunkCount = uint32_t(end - chunkBegin)/numBytesPerPixel;
+                    convertPixels(dstPtr, dstFormat, chunkBegin, format, chunkCount, rgba32f);
+                    dstPtr += size_t(chunkCount)*dstBytesPerPixel;
+
+                    const size_t overhang = size_t(dataPtr - end);
+                    memmove(chunkBegin, end, overhang);
+                    dataPtr = chunkBegin + overhang;
+                }
+            }
+
+            freeScratch(buffer);
+            if (convert)
+            {
+                freeScratch(chunk);
+            }
+        }
+        else
+        {
+            readConvertedPixels(data, dstFormat, _stream, format, numPixels);
+        }
+
+        // Fill image structure.
+        Image result;
+        result.m_width = tgaHeader.m_width;
+        result.m_height = tgaHeader.m_height;
+        result.m_dataSize = dataSize;
+        result.m_format = dstFormat;
+        result.m_numMips = 1;
+        result.m_numFaces = 1;
+        result.m_data = data;
+
+        // Flip if necessary.
+        const uint32_t flip = 0
+                            | (tgaHeader.m_imageDescriptor & TGA_DESC_HORIZONTAL ? IMAGE_OP_FLIP_Y : 0)
+                            | (tgaHeader.m_imageDescriptor & TGA_DESC_VERTICAL   ? 0 : IMAGE_OP_FLIP_X)
+                            ;
+        if (flip)
+        {
+            imageTransform(result, flip);
+        }
+
+        // Output.
+        imageMove(_image, result);
+
+        return true;
+    }
+
+    static bool isTga(uint32_t _magic)
+    {
+        //byte 2 is imageType and must be: 1, 2, 3, 9, 10 or 11
+        //byte 1 is colorMapType and must be 1 if imageType is 1 or 9, 0 otherwise
+        const uint8_t colorMapType = uint8_t((_magic>> 8)&0xff);
+        const uint8_t imageType    = uint8_t((_magic>>16)&0xff);
+        switch(imageType)
+        {
+        case 1:
+        case 9:
+            return (1 == colorMapType);
+
+        case 2:
+        case 3:
+        case 10:
+        case 11:
+            return (0 == colorMapType);
+        };
+
+        return false;
+    }
+
+    // Exr helpers.
+    //-----
+
+    static inline uint32_t exrLinesPerChunk(uint8_t _compression)
+    {
+        switch (_compression)
+        {
+        case EXR_COMPRESSION_ZIP:
+        case EXR_COMPRESSION_PXR24:
+            return 16;
+        case EXR_COMPRESSION_PIZ:
+        case EXR_COMPRESSION_B44:
+        case EXR_COMPRESSION_B44A:
+        case EXR_COMPRESSION_DWAA:
+            return 32;
+        case EXR_COMPRESSION_DWAB:
+            return 256;
+        default:
+            return 1;
+        };
+    }
+
+    static inline uint32_t exrSampleSize(int32_t _pixelType)
+    {
+        return (EXR_PIXEL_HALF == _pixelType) ? 2 : 4;
+    }
+
+    static inline int8_t exrComponent(const char* _name)
+    {
+        if (0 == strcmp(_name, "R")) { return 0; }
+        if (0 == strcmp(_name, "G")) { return 1; }
+        if (0 == strcmp(_name, "B")) { return 2; }
+        if (0 == strcmp(_name, "A")) { return 3; }
+        if (0 == strcmp(_name, "Y")) { return EXR_COMPONENT_Y; }
+        return -1;
+    }
+
+    /// Reads zero terminated string at _pos. Returns NULL if it runs past the end.
+    static inline const char* exrReadString(const uint8_t* _data, uint64_t _size, uint64_t& _pos)
+    {
+        const char* str = (const char*)_data + _pos;
+        const uint8_t* end = (const uint8_t*)memchr(str, '\0', size_t(_size - _pos));
+        if (NULL == end)
+        {
+            return NULL;
+        }
 
-        case TextureFormat::RGB32F:
-        case TextureFormat::RGBA32F:
+        _pos = uint64_t(end - _data) + 1;
+        return str;
+    }
+
+    static bool exrReadChannels(ExrHeader& _header, const uint8_t* _value, uint32_t _size)
+    {
+        uint64_t pos = 0;
+        while (pos < _size && '\0' != _value[pos])
+        {
+            const char* name = exrReadString(_value, _size, pos);
+            if (NULL == name || pos + 16 > _size)
             {
-                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
-                {
-                    const float* point = (const float*)((const uint8_t*)_image.m_data + keyPointsOffsets[key]);
-                    const bool tap0 = point[0] < 0.01f;
-                    const bool tap1 = point[1] < 0.01f;
-                    const bool tap2 = point[2] < 0.01f;
-                    result &= (tap0 & tap1 & tap2);
-                }
+                return false;
             }
-        break;
 
-        case TextureFormat::RGBE:
+            if (EXR_MAX_CHANNELS == _header.m_numChannels)
             {
-                for (uint8_t key = 0; (true == result) && (key < 6); ++key)
-                {
-                    const uint8_t* point = (const uint8_t*)_image.m_data + keyPointsOffsets[key];
-                    const float exp = ldexp(1.0f, point[3] - (128+8));
-                    const bool tap0 = float(point[0])*exp < 0.01f;
-                    const bool tap1 = float(point[1])*exp < 0.01f;
-                    const bool tap2 = float(point[2])*exp < 0.01f;
-                    result &= (tap0 & tap1 & tap2);
-                }
+                WARN("Exr images with more than %d channels are not supported.", EXR_MAX_CHANNELS);
+                return false;
             }
-        break;
 
-        default:
+            // Pixel type, pLinear and three reserved bytes, x and y sampling.
+            ExrChannel& channel = _header.m_channels[_header.m_numChannels++];
+            channel.m_component = exrComponent(name);
+            memcpy(&channel.m_pixelType, &_value[pos],    4);
+            memcpy(&channel.m_xSampling, &_value[pos+8],  4);
+            memcpy(&channel.m_ySampling, &_value[pos+12], 4);
+            pos += 16;
+
+            if (channel.m_pixelType < EXR_PIXEL_UINT || channel.m_pixelType > EXR_PIXEL_FLOAT)
             {
-                DEBUG_CHECK(false, "Unknown image format.");
-                result = false;
+                return false;
             }
-        break;
-        };
+        }
 
-        return result;
+        return 0 != _header.m_numChannels;
     }
 
-    bool imageCubemapFromCross(Image& _dst, const Image& _src)
+    /// Parses magic, version and header attributes. _pos is set to the offset table that follows.
+    static bool exrReadHeader(ExrHeader& _header, const uint8_t* _data, uint64_t _size, uint64_t& _pos)
     {
-        // Checking image aspect.
-        const float aspect = (float)(int32_t)_src.m_width/(float)(int32_t)_src.m_height;
-        const bool isVertical   = (aspect - 3.0f/4.0f) < 0.0001f;
-        const bool isHorizontal = (aspect - 3.0f/4.0f) < 0.0001f;
-
-        if (!isVertical && !isHorizontal)
+        uint32_t magic;
+        uint32_t version;
+        if (_size < 8)
         {
             return false;
         }
+        memcpy(&magic,   &_data[0], 4);
+        memcpy(&version, &_data[4], 4);
 
-        // Get sizes.
-        const uint32_t srcBytesPerPixel = getImageDataInfo(_src.m_format).m_bytesPerPixel;
-        const uint32_t imagePitch = _src.m_width * srcBytesPerPixel;
-        const uint32_t faceSize = isVertical ? (_src.m_width+2)/3 : (_src.m_width+3)/4;
-        const uint32_t facePitch = faceSize * srcBytesPerPixel;
-        const uint32_t faceDataSize = facePitch * faceSize;
-        const uint32_t rowDataSize = imagePitch * faceSize;
-
-        // Alloc data.
-        const uint32_t dstDataSize = faceDataSize * CUBE_FACE_NUM;
-        void* data = malloc(dstDataSize);
-        MALLOC_CHECK(data);
-
-        // Setup offsets.
-        uint32_t faceOffsets[6];
-        if (isVertical)
+        if (EXR_MAGIC != magic
+        ||  EXR_VERSION != (version&0xff))
         {
-            //   ___ ___ ___
-            //  |   |   |   | -> rowDataSize
-            //  |___|___|___|
-            //
-            //   ___  -> facePitch
-            //
-            //       ___
-            //      |+Y |
-            //   ___|___|___
-            //  |-X |+Z |+X |
-            //  |___|___|___|
-            //      |-Y |
-            //      |___|
-            //      |-Z |
-            //      |___|
-            //
-            faceOffsets[0] = rowDataSize + 2*facePitch; //+x
-            faceOffsets[1] = rowDataSize;               //-x
-            faceOffsets[2] = facePitch;                 //+y
-            faceOffsets[3] = 2*rowDataSize + facePitch; //-y
-            faceOffsets[4] = rowDataSize + facePitch;   //+z
-            faceOffsets[5] = 3*rowDataSize + facePitch; //-z
+            return false;
         }
-        else
+
+        if (0 != (version & (EXR_FLAG_DEEP|EXR_FLAG_MULTIPART)))
         {
-            //       ___
-            //      |+Y |
-            //   ___|___|___ ___
-            //  |-X |+Z |+X |-Z |
-            //  |___|___|___|___|
-            //      |-Y |
-            //      |___|
-            //
-            faceOffsets[0] = rowDataSize + 2*facePitch; //+x
-            faceOffsets[1] = rowDataSize;               //-x
-            faceOffsets[2] = facePitch;                 //+y
-            faceOffsets[3] = 2*rowDataSize + facePitch; //-y
-            faceOffsets[4] = rowDataSize + facePitch;   //+z
-            faceOffsets[5] = rowDataSize + 3*facePitch; //-z
+            WARN("Deep and multi-part Exr images are not supported.");
+            return false;
         }
 
-        // Copy data.
-        for (uint8_t face = 0; face < 6; ++face)
+        _header.m_numChannels = 0;
+        _header.m_compression = EXR_COMPRESSION_NONE;
+        _header.m_tiled = (0 != (version & EXR_FLAG_TILED));
+        _header.m_tileWidth = 0;
+        _header.m_tileHeight = 0;
+
+        bool hasDataWindow = false;
+        uint64_t pos = 8;
+        for (;;)
         {
-            const uint8_t* srcFaceData = (const uint8_t*)_src.m_data + faceOffsets[face];
-            uint8_t* dstFaceData = (uint8_t*)data + faceDataSize*face;
-            for (uint32_t yy = 0; yy < faceSize; ++yy)
+            // Attribute is name, type name, value size and value. Empty name ends the header.
+            const char* name = exrReadString(_data, _size, pos);
+            if (NULL == name)
+            {
+                return false;
+            }
+
+            if ('\0' == name[0])
+            {
+                break;
+            }
+
+            const char* type = exrReadString(_data, _size, pos);
+            int32_t size;
+            if (NULL == type || pos + 4 > _size)
+            {
+                return false;
+            }
+            memcpy(&size, &_data[pos], 4);
+            pos += 4;
+
+            if (size < 0 || pos + size > _size)
+            {
+                return false;
+            }
+            const uint8_t* value = &_data[pos];
+            pos += size;
+
+            if (0 == strcmp(name, "channels") && 0 == strcmp(type, "chlist"))
             {
-                memcpy(&dstFaceData[facePitch*yy], &srcFaceData[imagePitch*yy], facePitch);
+                if (!exrReadChannels(_header, value, uint32_t(size)))
+                {
+                    return false;
+                }
+            }
+            else if (0 == strcmp(name, "compression") && 1 == size)
+            {
+                _header.m_compression = value[0];
+            }
+            else if (0 == strcmp(name, "dataWindow") && 16 == size)
+            {
+                memcpy(_header.m_dataWindow, value, 16);
+                hasDataWindow = true;
+            }
+            else if (0 == strcmp(name, "tiles") && 9 == size)
+            {
+                memcpy(&_header.m_tileWidth,  &value[0], 4);
+                memcpy(&_header.m_tileHeight, &value[4], 4);
             }
         }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = faceSize;
-        result.m_height = faceSize;
-        result.m_dataSize = dstDataSize;
-        result.m_format = _src.m_format;
-        result.m_numMips = 1;
-        result.m_numFaces = 6;
-        result.m_data = data;
+        _pos = pos;
 
-        // Transform -Z face properly.
-        if (isVertical)
+        return 0 != _header.m_numChannels
+            && hasDataWindow
+            && _header.m_dataWindow[2] >= _header.m_dataWindow[0]
+            && _header.m_dataWindow[3] >= _header.m_dataWindow[1]
+            && (!_header.m_tiled || (0 != _header.m_tileWidth && 0 != _header.m_tileHeight));
+    }
+
+    /// Rle and Zip compression store low and high halves of the data separately, as byte deltas. This undoes it.
+    static void exrUnpredict(uint8_t* _dst, uint8_t* _src, uint32_t _size)
+    {
+        for (uint32_t ii = 1; ii < _size; ++ii)
         {
-            imageTransform(result, IMAGE_FACE_NEGATIVEZ | IMAGE_OP_FLIP_X | IMAGE_OP_FLIP_Y);
+            _src[ii] = uint8_t(_src[ii-1] + _src[ii] - 128);
         }
 
-        // Output.
-        imageMove(_dst, result);
-
-        return true;
+        const uint8_t* src0 = _src;
+        const uint8_t* src1 = _src + (_size+1)/2;
+        for (uint32_t ii = 0; ii < _size; ++ii)
+        {
+            _dst[ii] = (ii&1) ? *src1++ : *src0++;
+        }
     }
 
-    void imageCubemapFromCross(Image& _image)
+    /// Inverse of exrUnpredict().
+    static void exrPredict(uint8_t* _dst, const uint8_t* _src, uint32_t _size)
     {
-        Image tmp;
-        if (imageCubemapFromCross(tmp, _image))
+        uint8_t* dst0 = _dst;
+        uint8_t* dst1 = _dst + (_size+1)/2;
+        for (uint32_t ii = 0; ii < _size; ++ii)
         {
-            imageMove(_image, tmp);
+            *((ii&1) ? dst1++ : dst0++) = _src[ii];
+        }
+
+        for (uint32_t ii = _size; ii-- > 1; )
+        {
+            _dst[ii] = uint8_t(_dst[ii] - _dst[ii-1] + 128);
         }
     }
 
-    bool imageCubemapFromLatLong(Image& _dst, const Image& _src, bool _useBilinearInterpolation)
+    /// Negative count is followed by -count literal bytes, otherwise the next byte repeats count+1 times.
+    static bool exrRleDecode(uint8_t* _dst, uint32_t _dstSize, const uint8_t* _src, uint32_t _srcSize)
     {
-        if (!imageIsLatLong(_src))
+        const uint8_t* srcEnd = _src + _srcSize;
+        uint8_t* dst = _dst;
+        uint8_t* dstEnd = _dst + _dstSize;
+        while (_src < srcEnd)
         {
-            return false;
+            const int32_t count = int8_t(*_src++);
+            if (count < 0)
+            {
+                if (-count > srcEnd-_src || -count > dstEnd-dst)
+                {
+                    return false;
+                }
+                memcpy(dst, _src, -count);
+                dst += -count;
+                _src += -count;
+            }
+            else
+            {
+                if (_src == srcEnd || count+1 > dstEnd-dst)
+                {
+                    return false;
+                }
+                memset(dst, *_src++, count+1);
+                dst += count+1;
+            }
         }
 
-        // Conversion is done in rgba32f format.
-        Image imageRgba32f;
-        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
+        return dst == dstEnd;
+    }
 
-        // Alloc data.
-        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        const uint32_t dstFaceSize = (imageRgba32f.m_height+1)/2;
-        const uint32_t dstPitch = dstFaceSize * bytesPerPixel;
-        const uint32_t dstFaceDataSize = dstPitch * dstFaceSize;
-        const uint32_t dstDataSize = dstFaceDataSize * CUBE_FACE_NUM;
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
+    /// Writes _num samples of one channel into _component of RGBA32F or RGBA16F pixels. Luminance goes to RGB.
+    static void exrStoreChannel(uint8_t* _dst, TextureFormat::Enum _dstFormat, int8_t _component, const uint8_t* _src, int32_t _pixelType, uint32_t _num)
+    {
+        const uint8_t first = (EXR_COMPONENT_Y == _component) ? 0 : uint8_t(_component);
+        const uint8_t last  = (EXR_COMPONENT_Y == _component) ? 2 : uint8_t(_component);
 
-        // Get source parameters.
-        const float srcWidthf  = float(int32_t(imageRgba32f.m_width));
-        const float srcHeightf = float(int32_t(imageRgba32f.m_height));
-        const uint32_t srcPitch = imageRgba32f.m_width * bytesPerPixel;
-        const float invDstFaceSizef = 1.0f/float(dstFaceSize);
+        if (TextureFormat::RGBA16F == _dstFormat)
+        {
+            uint16_t* dst = (uint16_t*)_dst;
+            for (uint32_t ii = 0; ii < _num; ++ii, dst += 4)
+            {
+                uint16_t half;
+                if (EXR_PIXEL_HALF == _pixelType)
+                {
+                    memcpy(&half, &_src[ii*2], 2);
+                }
+                else if (EXR_PIXEL_FLOAT == _pixelType)
+                {
+                    float value;
+                    memcpy(&value, &_src[ii*4], 4);
+                    half = halfFromFloat(value);
+                }
+                else
+                {
+                    uint32_t value;
+                    memcpy(&value, &_src[ii*4], 4);
+                    half = halfFromFloat(float(value));
+                }
 
-        // Iterate over destination image (cubemap).
-        for (uint8_t face = 0; face < 6; ++face)
+                for (uint8_t cc = first; cc <= last; ++cc)
+                {
+                    dst[cc] = half;
+                }
+            }
+        }
+        else
         {
-            uint8_t* dstFaceData = (uint8_t*)dstData + face*dstFaceDataSize;
-            for (uint32_t yy = 0; yy < dstFaceSize; ++yy)
+            float* dst = (float*)_dst;
+            for (uint32_t ii = 0; ii < _num; ++ii, dst += 4)
             {
-                uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*dstPitch;
-                for (uint32_t xx = 0; xx < dstFaceSize; ++xx)
+                float value;
+                if (EXR_PIXEL_HALF == _pixelType)
                 {
-                    float* dstColumnData = (float*)((uint8_t*)dstRowData + xx*bytesPerPixel);
+                    uint16_t half;
+                    memcpy(&half, &_src[ii*2], 2);
+                    value = halfToFloat(half);
+                }
+                else if (EXR_PIXEL_FLOAT == _pixelType)
+                {
+                    memcpy(&value, &_src[ii*4], 4);
+                }
+                else
+                {
+                    uint32_t uint;
+                    memcpy(&uint, &_src[ii*4], 4);
+                    value = float(uint);
+                }
 
-                    // Cubemap (u,v) on current face.
-                    const float uu = 2.0f*xx*invDstFaceSizef-1.0f;
-                    const float vv = 2.0f*yy*invDstFaceSizef-1.0f;
+                for (uint8_t cc = first; cc <= last; ++cc)
+                {
+                    dst[cc] = value;
+                }
+            }
+        }
+    }
 
-                    // Get cubemap vector (x,y,z) from (u,v,faceIdx).
-                    float vec[3];
-                    texelCoordToVec(vec, uu, vv, face, dstFaceSize);
+    struct ExrDecodeArgs
+    {
+        const ExrHeader* m_header;
+        const uint8_t* m_file;
+        uint64_t m_fileSize;
+        const uint8_t* m_offsets;  //!< Chunk offset table, uint64_t per chunk.
+        uint64_t m_numChunks;
+        uint32_t m_firstChunk;     //!< Chunks decoded by exrDecodeChunks() are numbered from this one.
+        uint8_t* m_dst;
+        uint32_t m_dstFirstRow;    //!< m_dst holds rows [m_dstFirstRow, m_dstFirstRow+m_dstNumRows).
+        uint32_t m_dstNumRows;
+        TextureFormat::Enum m_dstFormat;
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_chunkWidth;     //!< Tile width or image width.
+        uint32_t m_chunkHeight;    //!< Tile height or scanlines per chunk.
+        uint32_t m_tilesX;
+        uint32_t m_bytesPerPixel;  //!< Of all channels in the file.
+        bool m_fillDefaults;       //!< Some of RGBA is missing and has to be set to 0 (1 for alpha).
+        volatile bool m_failed;
+    };
 
-                    // Convert cubemap vector (x,y,z) to latlong (u,v).
-                    float xSrc;
-                    float ySrc;
-                    latLongFromVec(xSrc, ySrc, vec);
+    /// Decodes chunk _chunk. _tmp and _raw have to hold an uncompressed chunk each.
+    static bool exrDecodeChunk(const ExrDecodeArgs& _args, uint32_t _chunk, uint8_t* _tmp, uint8_t* _raw)
+    {
+        const ExrHeader& header = *_args.m_header;
 
-                    // Convert from [0..1] to [0..(size-1)] range.
-                    xSrc *= srcWidthf-1.0f;
-                    ySrc *= srcHeightf-1.0f;
+        uint64_t offset;
+        memcpy(&offset, &_args.m_offsets[uint64_t(_chunk)*8], 8);
 
-                    // Sample from latlong (u,v).
-                    if (_useBilinearInterpolation)
-                    {
-                        const uint32_t x0 = uint32_t(xSrc);
-                        const uint32_t y0 = uint32_t(ySrc);
-                        const uint32_t x1 = min(x0+1, imageRgba32f.m_width-1);
-                        const uint32_t y1 = min(y0+1, imageRgba32f.m_height-1);
-
-                        const float *src0 = (const float*)((const uint8_t*)imageRgba32f.m_data + y0*srcPitch + x0*bytesPerPixel);
-                        const float *src1 = (const float*)((const uint8_t*)imageRgba32f.m_data + y0*srcPitch + x1*bytesPerPixel);
-                        const float *src2 = (const float*)((const uint8_t*)imageRgba32f.m_data + y1*srcPitch + x0*bytesPerPixel);
-                        const float *src3 = (const float*)((const uint8_t*)imageRgba32f.m_data + y1*srcPitch + x1*bytesPerPixel);
-
-                        const float tx = xSrc - float(int32_t(x0));
-                        const float ty = ySrc - float(int32_t(y0));
-                        const float invTx = 1.0f - tx;
-                        const float invTy = 1.0f - ty;
-
-                        float p0[3];
-                        float p1[3];
-                        float p2[3];
-                        float p3[3];
-                        vec3Mul(p0, src0, invTx*invTy);
-                        vec3Mul(p1, src1,    tx*invTy);
-                        vec3Mul(p2, src2, invTx*   ty);
-                        vec3Mul(p3, src3,    tx*   ty);
-
-                        const float rr = p0[0] + p1[0] + p2[0] + p3[0];
-                        const float gg = p0[1] + p1[1] + p2[1] + p3[1];
-                        const float bb = p0[2] + p1[2] + p2[2] + p3[2];
-
-                        dstColumnData[0] = rr;
-                        dstColumnData[1] = gg;
-                        dstColumnData[2] = bb;
-                        dstColumnData[3] = 1.0f;
-                    }
-                    else
-                    {
-                        const uint32_t xx = uint32_t(xSrc);
-                        const uint32_t yy = uint32_t(ySrc);
-                        const float *src = (const float*)((const uint8_t*)imageRgba32f.m_data + yy*srcPitch + xx*bytesPerPixel);
-
-                        dstColumnData[0] = src[0];
-                        dstColumnData[1] = src[1];
-                        dstColumnData[2] = src[2];
-                        dstColumnData[3] = 1.0f;
-                    }
+        // Scanline chunks start with y and data size, tiles with tile x, y, level x, y and data size.
+        const uint32_t chunkHeaderSize = header.m_tiled ? 20 : 8;
+        if (offset > _args.m_fileSize
+        ||  chunkHeaderSize > _args.m_fileSize - offset)
+        {
+            return false;
+        }
+        const uint8_t* ptr = _args.m_file + offset;
 
-                }
+        int32_t chunkHeader[5];
+        memcpy(chunkHeader, ptr, chunkHeaderSize);
+
+        uint32_t x0 = 0;
+        uint32_t y0;
+        int32_t dataSize;
+        if (header.m_tiled)
+        {
+            const int32_t tileX = chunkHeader[0];
+            const int32_t tileY = chunkHeader[1];
+            if (tileX < 0 || uint32_t(tileX) >= _args.m_tilesX
+            ||  tileY < 0 || uint64_t(tileY)*_args.m_chunkHeight >= _args.m_height
+            ||  0 != chunkHeader[2] || 0 != chunkHeader[3])
+            {
+                return false;
+            }
+            x0 = uint32_t(tileX)*_args.m_chunkWidth;
+            y0 = uint32_t(tileY)*_args.m_chunkHeight;
+            dataSize = chunkHeader[4];
+        }
+        else
+        {
+            const int64_t yy = int64_t(chunkHeader[0]) - header.m_dataWindow[1];
+            if (yy < 0 || yy >= _args.m_height || 0 != yy%_args.m_chunkHeight)
+            {
+                return false;
             }
+            y0 = uint32_t(yy);
+            dataSize = chunkHeader[1];
         }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = dstFaceSize;
-        result.m_height = dstFaceSize;
-        result.m_dataSize = dstDataSize;
-        result.m_format = TextureFormat::RGBA32F;
-        result.m_numMips = 1;
-        result.m_numFaces = 6;
-        result.m_data = dstData;
+        const uint32_t chunkWidth = min(_args.m_chunkWidth, _args.m_width-x0);
+        const uint32_t numRows = min(_args.m_chunkHeight, _args.m_height-y0);
+        if (y0 < _args.m_dstFirstRow || y0+numRows > _args.m_dstFirstRow+_args.m_dstNumRows)
+        {
+            return false;
+        }
 
-        // Convert result to source format.
-        if (TextureFormat::RGBA32F == _src.m_format)
+        // Scratch buffers hold a full chunk, anything larger is a corrupted header.
+        const uint64_t rawSize64 = uint64_t(chunkWidth)*numRows*_args.m_bytesPerPixel;
+        const uint64_t maxChunkSize = uint64_t(_args.m_chunkWidth)*_args.m_chunkHeight*_args.m_bytesPerPixel;
+        if (rawSize64 > maxChunkSize
+        ||  rawSize64 > UINT32_MAX)
         {
-            imageMove(_dst, result);
+            return false;
         }
-        else
+        const uint32_t rawSize = uint32_t(rawSize64);
+
+        if (dataSize < 0 || offset + chunkHeaderSize + dataSize > _args.m_fileSize)
         {
-            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
-            imageUnload(result);
+            return false;
         }
+        const uint8_t* data = ptr + chunkHeaderSize;
 
-        // Cleanup.
-        if (!imageIsRef)
+        // Chunks that do not get smaller are stored uncompressed.
+        const uint8_t* raw = data;
+        if (uint32_t(dataSize) != rawSize)
         {
-            imageUnload(imageRgba32f);
+            if (EXR_COMPRESSION_RLE == header.m_compression)
+            {
+                if (!exrRleDecode(_tmp, rawSize, data, uint32_t(dataSize)))
+                {
+                    return false;
+                }
+            }
+            else if (EXR_COMPRESSION_ZIPS == header.m_compression
+                 ||  EXR_COMPRESSION_ZIP  == header.m_compression)
+            {
+                if (!zlibDecompress(_tmp, rawSize, data, uint32_t(dataSize)))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+
+            exrUnpredict(_raw, _tmp, rawSize);
+            raw = _raw;
+        }
+
+        // Each row holds all samples of the first channel, then of the second one, etc.
+        const uint32_t dstBytesPerPixel = getImageDataInfo(_args.m_dstFormat).m_bytesPerPixel;
+        for (uint32_t yy = 0; yy < numRows; ++yy)
+        {
+            uint8_t* dstRow = _args.m_dst + (uint64_t(y0-_args.m_dstFirstRow+yy)*_args.m_width + x0)*dstBytesPerPixel;
+
+            if (_args.m_fillDefaults)
+            {
+                if (TextureFormat::RGBA16F == _args.m_dstFormat)
+                {
+                    const uint16_t defaults[4] = { 0, 0, 0, halfFromFloat(1.0f) };
+                    for (uint32_t xx = 0; xx < chunkWidth; ++xx)
+                    {
+                        memcpy(&dstRow[xx*8], defaults, 8);
+                    }
+                }
+                else
+                {
+                    const float defaults[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                    for (uint32_t xx = 0; xx < chunkWidth; ++xx)
+                    {
+                        memcpy(&dstRow[xx*16], defaults, 16);
+                    }
+                }
+            }
+
+            for (uint8_t ii = 0; ii < header.m_numChannels; ++ii)
+            {
+                const ExrChannel& channel = header.m_channels[ii];
+                if (channel.m_component >= 0)
+                {
+                    exrStoreChannel(dstRow, _args.m_dstFormat, channel.m_component, raw, channel.m_pixelType, chunkWidth);
+                }
+                raw += chunkWidth*exrSampleSize(channel.m_pixelType);
+            }
         }
 
         return true;
     }
 
-    void imageCubemapFromLatLong(Image& _image, bool _useBilinearInterpolation)
+    static void exrDecodeChunks(void* _args, uint32_t _begin, uint32_t _end)
     {
-        Image tmp;
-        if (imageCubemapFromLatLong(tmp, _image, _useBilinearInterpolation))
+        ExrDecodeArgs* args = (ExrDecodeArgs*)_args;
+
+        const size_t maxChunkSize = size_t(args->m_chunkWidth)*args->m_chunkHeight*args->m_bytesPerPixel;
+        uint8_t* scratch = (uint8_t*)allocScratch(2*maxChunkSize, AllocTag::IoBuffer);
+        MALLOC_CHECK(scratch);
+
+        for (uint32_t chunk = _begin; chunk < _end && !args->m_failed; ++chunk)
         {
-            imageMove(_image, tmp);
+            if (!exrDecodeChunk(*args, args->m_firstChunk+chunk, scratch, scratch + maxChunkSize))
+            {
+                args->m_failed = true;
+            }
         }
+
+        freeScratch(scratch);
     }
 
-    bool imageLatLongFromCubemap(Image& _dst, const Image& _src, bool _useBilinearInterpolation)
+    /// Reads header of Exr file _file and sets up _args for decoding it. _header has to outlive _args.
+    static bool exrDecodeArgsInit(ExrDecodeArgs& _args, ExrHeader& _header, const uint8_t* _file, uint64_t _fileSize, TextureFormat::Enum _convertTo)
     {
-        // Input check.
-        if(!imageIsCubemap(_src))
+        uint64_t pos;
+        if (!exrReadHeader(_header, _file, _fileSize, pos))
         {
+            WARN("Invalid or unsupported Exr header.");
             return false;
         }
 
-        // Conversion is done in rgba32f format.
-        Image imageRgba32f;
-        const bool imageIsRef = imageRefOrConvert(imageRgba32f, TextureFormat::RGBA32F, _src);
-
-        // Alloc data.
-        const uint32_t bytesPerPixel = 4 /*numChannels*/ * 4 /*bytesPerChannel*/;
-        const uint32_t dstHeight = imageRgba32f.m_height*2;
-        const uint32_t dstWidth = imageRgba32f.m_height*4;
-        uint32_t dstDataSize = 0;
-        uint32_t dstMipOffsets[MAX_MIP_NUM];
-        for (uint8_t mip = 0; mip < imageRgba32f.m_numMips; ++mip)
+        if (EXR_COMPRESSION_NONE != _header.m_compression
+        &&  EXR_COMPRESSION_RLE  != _header.m_compression
+        &&  EXR_COMPRESSION_ZIPS != _header.m_compression
+        &&  EXR_COMPRESSION_ZIP  != _header.m_compression)
         {
-            dstMipOffsets[mip] = dstDataSize;
-            const uint32_t dstMipWidth  = max(UINT32_C(1), dstWidth  >> mip);
-            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
-            dstDataSize += dstMipWidth * mipHeight * bytesPerPixel;
+            WARN("Exr compression %d is not supported. Supported are none, rle, zips and zip.", _header.m_compression);
+            return false;
         }
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
 
-        // Get source image parameters.
-        uint32_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(srcOffsets, imageRgba32f);
-
-        // Iterate over destination image (latlong).
-        for (uint8_t mip = 0; mip < imageRgba32f.m_numMips; ++mip)
+        uint8_t components = 0;
+        bool allHalf = true;
+        uint32_t bytesPerPixel = 0;
+        for (uint8_t ii = 0; ii < _header.m_numChannels; ++ii)
         {
-            const uint32_t dstMipWidth  = max(UINT32_C(1), dstWidth  >> mip);
-            const uint32_t dstMipHeight = max(UINT32_C(1), dstHeight >> mip);
-            const uint32_t dstMipPitch = dstMipWidth * bytesPerPixel;
-            const float invDstWidthf  = 1.0f/float(dstMipWidth-1);
-            const float invDstHeightf = 1.0f/float(dstMipHeight-1);
-
-            const uint32_t srcMipWidth  = max(UINT32_C(1), imageRgba32f.m_width  >> mip);
-            const uint32_t srcMipHeight = max(UINT32_C(1), imageRgba32f.m_height >> mip);
-            const uint32_t srcPitch = srcMipWidth * bytesPerPixel;
-            const float srcWidthf  = float(int32_t(srcMipWidth));
-            const float srcHeightf = float(int32_t(srcMipHeight));
-
-            uint8_t* dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
-            for (uint32_t yy = 0; yy < dstMipHeight; ++yy)
+            const ExrChannel& channel = _header.m_channels[ii];
+            if (1 != channel.m_xSampling || 1 != channel.m_ySampling)
             {
-                uint8_t* dstRowData = (uint8_t*)dstMipData + yy*dstMipPitch;
-                for (uint32_t xx = 0; xx < dstMipWidth; ++xx)
-                {
-                    float* dstColumnData = (float*)((uint8_t*)dstRowData + xx*bytesPerPixel);
-
-                    // Latlong (x,y).
-                    const float xDst = xx*invDstWidthf;
-                    const float yDst = yy*invDstHeightf;
-
-                    // Get cubemap vector (x,y,z) coresponding to latlong (x,y).
-                    float vec[3];
-                    vecFromLatLong(vec, xDst, yDst);
-
-                    // Get cubemap (u,v,faceIdx) from cubemap vector (x,y,z).
-                    float xSrc;
-                    float ySrc;
-                    uint8_t faceIdx;
-                    vecToTexelCoord(xSrc, ySrc, faceIdx, vec);
-
-                    // Convert from [0-1] to [0-size] range.
-                    xSrc *= srcWidthf;
-                    ySrc *= srcHeightf;
-
-                    // Sample from cubemap (u,v, faceIdx).
-                    if (_useBilinearInterpolation)
-                    {
-                        const uint32_t x0 = uint32_t(xSrc);
-                        const uint32_t y0 = uint32_t(ySrc);
-                        const uint32_t x1 = min(x0+1, srcMipWidth-1);
-                        const uint32_t y1 = min(y0+1, srcMipHeight-1);
-
-                        const uint8_t* srcFaceData = (const uint8_t*)imageRgba32f.m_data + srcOffsets[faceIdx][mip];
-                        const float *src0 = (const float*)((const uint8_t*)srcFaceData + y0*srcPitch + x0*bytesPerPixel);
-                        const float *src1 = (const float*)((const uint8_t*)srcFaceData + y0*srcPitch + x1*bytesPerPixel);
-                        const float *src2 = (const float*)((const uint8_t*)srcFaceData + y1*srcPitch + x0*bytesPerPixel);
-                        const float *src3 = (const float*)((const uint8_t*)srcFaceData + y1*srcPitch + x1*bytesPerPixel);
-
-                        const float tx = xSrc - float(int32_t(x0));
-                        const float ty = ySrc - float(int32_t(y0));
-                        const float invTx = 1.0f - tx;
-                        const float invTy = 1.0f - ty;
-
-                        float p0[3];
-                        float p1[3];
-                        float p2[3];
-                        float p3[3];
-                        vec3Mul(p0, src0, invTx*invTy);
-                        vec3Mul(p1, src1,    tx*invTy);
-                        vec3Mul(p2, src2, invTx*   ty);
-                        vec3Mul(p3, src3,    tx*   ty);
-
-                        const float rr = p0[0] + p1[0] + p2[0] + p3[0];
-                        const float gg = p0[1] + p1[1] + p2[1] + p3[1];
-                        const float bb = p0[2] + p1[2] + p2[2] + p3[2];
-
-                        dstColumnData[0] = rr;
-                        dstColumnData[1] = gg;
-                        dstColumnData[2] = bb;
-                        dstColumnData[3] = 1.0f;
-                    }
-                    else
-                    {
-                        const uint32_t xx = uint32_t(xSrc);
-                        const uint32_t yy = uint32_t(ySrc);
-
-                        const uint8_t* srcFaceData = (const uint8_t*)imageRgba32f.m_data + srcOffsets[faceIdx][mip];
-                        const float *src = (const float*)((const uint8_t*)srcFaceData + yy*srcPitch + xx*bytesPerPixel);
+                WARN("Subsampled Exr channels are not supported.");
+                return false;
+            }
 
-                        dstColumnData[0] = src[0];
-                        dstColumnData[1] = src[1];
-                        dstColumnData[2] = src[2];
-                        dstColumnData[3] = 1.0f;
-                    }
-                }
+            if (channel.m_component >= 0)
+            {
+                components |= (EXR_COMPONENT_Y == channel.m_component) ? 0x7 : uint8_t(1<<channel.m_component);
+                allHalf &= (EXR_PIXEL_HALF == channel.m_pixelType);
             }
+            bytesPerPixel += exrSampleSize(channel.m_pixelType);
         }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = dstWidth;
-        result.m_height = dstHeight;
-        result.m_dataSize = dstDataSize;
-        result.m_format = TextureFormat::RGBA32F;
-        result.m_numMips = imageRgba32f.m_numMips;
-        result.m_numFaces = 1;
-        result.m_data = dstData;
-
-        // Convert back to source format.
-        if (TextureFormat::RGBA32F == _src.m_format)
+        if (0 == components)
         {
-            imageMove(_dst, result);
+            WARN("Exr image has none of R, G, B, A or Y channels.");
+            return false;
         }
-        else
-        {
-            imageConvert(_dst, (TextureFormat::Enum)_src.m_format, result);
-            imageUnload(result);
+
+        const TextureFormat::Enum dstFormat = (TextureFormat::RGBA16F == _convertTo || (TextureFormat::Unknown == _convertTo && allHalf))
+                                            ? TextureFormat::RGBA16F
+                                            : TextureFormat::RGBA32F
+                                            ;
+
+        _args.m_header = &_header;
+        _args.m_file = _file;
+        _args.m_fileSize = _fileSize;
+        _args.m_offsets = _file + pos;
+        _args.m_firstChunk = 0;
+        _args.m_dst = NULL;
+        _args.m_dstFirstRow = 0;
+        _args.m_dstFormat = dstFormat;
+        // Data window bounds are 32 bit signed, so its size needs 33 bits. Decoded image and file rows have to fit in memory.
+        const uint64_t width  = uint64_t(int64_t(_header.m_dataWindow[2]) - _header.m_dataWindow[0] + 1);
+        const uint64_t height = uint64_t(int64_t(_header.m_dataWindow[3]) - _header.m_dataWindow[1] + 1);
+        const uint64_t maxBytesPerPixel = max(uint64_t(bytesPerPixel), uint64_t(getImageDataInfo(dstFormat).m_bytesPerPixel));
+        if (width > UINT32_MAX
+        ||  height > UINT32_MAX
+        ||  width*maxBytesPerPixel > SIZE_MAX/height)
+        {
+            WARN("Exr data window is too large.");
+            return false;
         }
 
-        // Cleanup.
-        if (!imageIsRef)
+        _args.m_width  = uint32_t(width);
+        _args.m_height = uint32_t(height);
+        _args.m_chunkWidth  = _header.m_tiled ? min(_header.m_tileWidth,  _args.m_width)  : _args.m_width;
+        _args.m_chunkHeight = _header.m_tiled ? min(_header.m_tileHeight, _args.m_height) : exrLinesPerChunk(_header.m_compression);
+        _args.m_tilesX = uint32_t((width + _args.m_chunkWidth - 1)/_args.m_chunkWidth);
+        _args.m_bytesPerPixel = bytesPerPixel;
+        _args.m_fillDefaults = (0xf != components);
+        _args.m_dstNumRows = _args.m_height;
+        _args.m_failed = false;
+
+        // For mip and rip mapped tiles, level 0 comes first in the offset table.
+        _args.m_numChunks = uint64_t(_args.m_tilesX) * ((height + _args.m_chunkHeight - 1)/_args.m_chunkHeight);
+        if (_args.m_numChunks > UINT32_MAX
+        ||  _args.m_numChunks*8 > _fileSize - pos
+        ||  uint64_t(_args.m_chunkWidth)*_args.m_chunkHeight*bytesPerPixel > UINT32_MAX)
         {
-            imageUnload(imageRgba32f);
+            return false;
         }
 
         return true;
     }
 
-    void imageLatLongFromCubemap(Image& _cubemap, bool _useBilinearInterpolation)
+    /// Loads the first level of scanline or tiled Exr images. Chunks are decompressed in parallel, straight into rgba32f or rgba16f.
+    bool imageLoadExr(Image& _image, Reader* _stream, TextureFormat::Enum _convertTo)
     {
-        Image tmp;
-        if (imageLatLongFromCubemap(tmp, _cubemap, _useBilinearInterpolation))
-        {
-            imageMove(_cubemap, tmp);
-        }
-    }
+        CMFT_UNUSED size_t read;
+        CMFT_UNUSED int seek;
 
-    bool imageHStripFromCubemap(Image& _dst, const Image& _src)
-    {
-        // Input check.
-        if(!imageIsCubemap(_src))
+        // Chunks are addressed by file offsets, so the whole file is read at once.
+        seek = ioSeek(_stream, 0, SEEK_END);
+        DEBUG_CHECK(0 == seek, "File seek error.");
+        const int64_t fileSize = ioTell(_stream);
+        seek = ioSeek(_stream, 0, SEEK_SET);
+        DEBUG_CHECK(0 == seek, "File seek error.");
+        if (fileSize <= 0)
         {
             return false;
         }
 
-        // Calculate destination offsets and alloc data.
-        uint32_t dstDataSize = 0;
-        uint32_t dstMipOffsets[MAX_MIP_NUM];
-        const uint32_t dstWidth = _src.m_width*6;
-        const uint32_t dstHeight = _src.m_width;
-        const uint32_t bytesPerPixel = getImageDataInfo(_src.m_format).m_bytesPerPixel;
-        for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
-        {
-            dstMipOffsets[mip] = dstDataSize;
-            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
-            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
-
-            dstDataSize += mipWidth * mipHeight * bytesPerPixel;
-        }
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
-
-        // Get source image offsets.
-        uint32_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(srcOffsets, _src);
+        uint8_t* file = (uint8_t*)allocScratch(size_t(fileSize), AllocTag::IoBuffer);
+        MALLOC_CHECK(file);
+        read = ioRead(file, 1, size_t(fileSize), _stream);
+        DEBUG_CHECK(read == size_t(fileSize), "Could not read from file.");
+        IOERROR_CHECK(_stream);
 
-        for (uint8_t face = 0; face < 6; ++face)
+        ExrHeader header;
+        ExrDecodeArgs args;
+        if (!exrDecodeArgsInit(args, header, file, uint64_t(fileSize), _convertTo))
         {
-            for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
-            {
-                // Get src data ptr for current mip and face.
-                const uint8_t* srcFaceData = (const uint8_t*)_src.m_data + srcOffsets[face][mip];
-
-                // Get dst ptr for current mip level.
-                uint8_t* dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
+            freeScratch(file);
+            return false;
+        }
+        const TextureFormat::Enum dstFormat = args.m_dstFormat;
+        const uint64_t numChunks = args.m_numChunks;
 
-                // Advance by (srcPitch * faceIdx) to get to the desired face in the strip.
-                const uint32_t srcMipSize = max(UINT32_C(1), _src.m_width >> mip);
-                const uint32_t srcMipPitch = srcMipSize * bytesPerPixel;
-                uint8_t* dstFaceData = (uint8_t*)dstMipData + srcMipPitch*face;
+        const uint64_t dataSize = uint64_t(args.m_width)*args.m_height*getImageDataInfo(dstFormat).m_bytesPerPixel;
+        args.m_dst = (uint8_t*)getAllocator()->alloc(dataSize);
+        MALLOC_CHECK(args.m_dst);
 
-                const uint32_t dstMipPitch = srcMipPitch*6;
+        parallelFor(exrDecodeChunks, (void*)&args, uint32_t(numChunks), 1);
 
-                for (uint32_t yy = 0; yy < srcMipSize; ++yy)
-                {
-                    const uint8_t* srcRowData = (const uint8_t*)srcFaceData + yy*srcMipPitch;
-                    uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*dstMipPitch;
+        freeScratch(file);
 
-                    memcpy(dstRowData, srcRowData, srcMipPitch);
-                }
-            }
+        if (args.m_failed)
+        {
+            WARN("Exr image data is corrupted.");
+            getAllocator()->free(args.m_dst);
+            return false;
         }
 
         // Fill image structure.
         Image result;
-        result.m_width = dstWidth;
-        result.m_height = dstHeight;
-        result.m_dataSize = dstDataSize;
-        result.m_format = _src.m_format;
-        result.m_numMips = _src.m_numMips;
+        result.m_width = args.m_width;
+        result.m_height = args.m_height;
+        result.m_dataSize = dataSize;
+        result.m_format = dstFormat;
+        result.m_numMips = 1;
         result.m_numFaces = 1;
-        result.m_data = dstData;
+        result.m_data = (void*)args.m_dst;
 
         // Output.
-        imageMove(_dst, result);
+        imageMove(_image, result);
 
         return true;
     }
 
-    void imageHStripFromCubemap(Image& _cubemap)
+    struct ExrRows
     {
-        Image tmp;
-        if (imageHStripFromCubemap(tmp, _cubemap))
+        ExrDecodeArgs* m_args;
+        uint8_t* m_staged;      //!< Decoded rows [m_stagedBegin, m_stagedEnd).
+        uint32_t m_stagedBegin;
+        uint32_t m_stagedEnd;
+        uint32_t m_maxStagedRows;
+    };
+
+    /// Decodes whole rows of chunks holding the requested rows, as many as fit. Rows past the requested ones are kept for the next read.
+    static bool exrReadRowsRgba32f(float* _rows, uint32_t _firstRow, uint32_t _numRows, void* _userData)
+    {
+        ExrRows* rows = (ExrRows*)_userData;
+        ExrDecodeArgs& args = *rows->m_args;
+        const uint32_t chunkHeight = args.m_chunkHeight;
+        const uint64_t pitch = uint64_t(args.m_width)*4*sizeof(float);
+
+        while (0 != _numRows)
         {
-            imageMove(_cubemap, tmp);
+            if (_firstRow >= rows->m_stagedEnd)
+            {
+                const uint32_t begin = (_firstRow/chunkHeight)*chunkHeight;
+                const uint32_t end = min(args.m_height, begin + rows->m_maxStagedRows);
+
+                args.m_dst = rows->m_staged;
+                args.m_dstFirstRow = begin;
+                args.m_dstNumRows = end-begin;
+                args.m_firstChunk = (begin/chunkHeight)*args.m_tilesX;
+                const uint32_t numChunks = ((end-begin + chunkHeight-1)/chunkHeight)*args.m_tilesX;
+                parallelFor(exrDecodeChunks, (void*)&args, numChunks, 1);
+                if (args.m_failed)
+                {
+                    return false;
+                }
+
+                // Chunks are usually stored in the order of rows, data up to the next chunk is not needed anymore.
+                const uint64_t nextChunk = uint64_t(args.m_firstChunk) + numChunks;
+                uint64_t dataBegin;
+                uint64_t dataEnd = args.m_fileSize;
+                memcpy(&dataBegin, &args.m_offsets[uint64_t(args.m_firstChunk)*8], 8);
+                if (nextChunk < args.m_numChunks)
+                {
+                    memcpy(&dataEnd, &args.m_offsets[nextChunk*8], 8);
+                }
+                if (dataBegin < dataEnd && dataEnd <= args.m_fileSize)
+                {
+                    fileRelease(args.m_file + dataBegin, dataEnd - dataBegin);
+                }
+
+                rows->m_stagedBegin = begin;
+                rows->m_stagedEnd = end;
+            }
+
+            const uint32_t num = min(_numRows, rows->m_stagedEnd-_firstRow);
+            memcpy(_rows, rows->m_staged + (_firstRow-rows->m_stagedBegin)*pitch, size_t(num*pitch));
+            _rows += size_t(num)*args.m_width*4;
+            _firstRow += num;
+            _numRows -= num;
         }
+
+        return true;
     }
 
-    bool imageCubemapFromHStrip(Image& _dst, const Image& _src)
+    bool imageCubemapFromLatLongExr(Image& _dst, const char* _filePath, bool _useBilinearInterpolation, uint32_t _bandRows)
     {
-        // Input check.
-        if(!imageIsHStrip(_src))
+        AllocTagScope allocTag(AllocTag::IoBuffer, true);
+
+        // Open file.
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
         {
+            WARN("Could not open file %s for reading.", _filePath);
             return false;
         }
+        ScopeFclose cleanup(fp);
+        FileReader stream(fp);
 
-        // Calculate destination offsets and alloc data.
-        uint32_t dstDataSize = 0;
-        uint32_t dstOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        const uint32_t dstSize = _src.m_height;
-        const uint32_t bytesPerPixel = getImageDataInfo(_src.m_format).m_bytesPerPixel;
-        for (uint8_t face = 0; face < 6; ++face)
+        // Check magic.
+        uint32_t magic = 0;
+        if (1 != ioRead(&magic, sizeof(uint32_t), 1, &stream)
+        ||  EXR_MAGIC != magic
+        ||  0 != ioSeek(&stream, 0, SEEK_END))
         {
-            for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
-            {
-                dstOffsets[face][mip] = dstDataSize;
-                const uint32_t mipSize = max(UINT32_C(1), dstSize >> mip);
+            return false;
+        }
 
-                dstDataSize += mipSize * mipSize * bytesPerPixel;
-            }
+        // File is mapped instead of read, only chunks of the current band are touched.
+        const int64_t fileSize = ioTell(&stream);
+        uint8_t* file = (fileSize > 0) ? (uint8_t*)fileMap(&stream, 0, uint64_t(fileSize)) : NULL;
+        if (NULL == file)
+        {
+            return false;
         }
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
 
-        uint32_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(srcOffsets, _src);
+        bool converted = false;
 
-        for (uint8_t face = 0; face < 6; ++face)
+        ExrHeader header;
+        ExrDecodeArgs args;
+        if (exrDecodeArgsInit(args, header, file, uint64_t(fileSize), TextureFormat::RGBA32F))
         {
-            for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
+            Image src;
+            src.m_width = args.m_width;
+            src.m_height = args.m_height;
+            if (imageIsLatLong(src))
             {
-                // Get dst data ptr for current mip and face.
-                uint8_t* dstFaceData = (uint8_t*)dstData + dstOffsets[face][mip];
-
-                // Get src ptr for current mip level.
-                const uint8_t* srcMipData = (const uint8_t*)_src.m_data + srcOffsets[0][mip];
+                const uint64_t pitch = uint64_t(args.m_width)*4*sizeof(float);
+                const uint32_t bandRows = max(UINT32_C(1), (0 != _bandRows) ? _bandRows : uint32_t(CMFT_LATLONG_BAND_SIZE/pitch));
 
-                // Advance by (dstPitch * faceIdx) to get to the desired face in the strip.
-                const uint32_t dstMipSize = max(UINT32_C(1), dstSize >> mip);
-                const uint32_t dstMipPitch = dstMipSize * bytesPerPixel;
-                const uint8_t* srcFaceData = (const uint8_t*)srcMipData + dstMipPitch*face;
+                ExrRows rows;
+                rows.m_args = &args;
+                rows.m_stagedBegin = 0;
+                rows.m_stagedEnd = 0;
+                rows.m_maxStagedRows = max(UINT32_C(1), bandRows/args.m_chunkHeight)*args.m_chunkHeight;
+                rows.m_staged = (uint8_t*)allocScratch(size_t(rows.m_maxStagedRows*pitch), AllocTag::IoBuffer);
+                MALLOC_CHECK(rows.m_staged);
 
-                const uint32_t srcMipPitch = dstMipPitch*6;
-
-                for (uint32_t yy = 0; yy < dstMipSize; ++yy)
-                {
-                    const uint8_t* srcRowData = (const uint8_t*)srcFaceData + yy*srcMipPitch;
-                    uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*dstMipPitch;
+                converted = cubemapFromLatLongBands(_dst, args.m_width, args.m_height, exrReadRowsRgba32f, (void*)&rows, _useBilinearInterpolation, _bandRows);
 
-                    memcpy(dstRowData, srcRowData, dstMipPitch);
-                }
+                freeScratch(rows.m_staged);
             }
         }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = dstSize;
-        result.m_height = dstSize;
-        result.m_dataSize = dstDataSize;
-        result.m_format = _src.m_format;
-        result.m_numMips = _src.m_numMips;
-        result.m_numFaces = 6;
-        result.m_data = dstData;
-
-        // Output.
-        imageMove(_dst, result);
+        fileUnmap(file, uint64_t(fileSize));
 
-        return true;
+        return converted;
     }
 
-    void imageCubemapFromHStrip(Image& _image)
+    /// Loads image from _stream positioned at the beginning of file data. _filePath is used for messages only.
+    static bool imageLoadStream(Image& _image, Reader* _stream, const char* _filePath, TextureFormat::Enum _convertTo, bool _mapFile, uint32_t _element
+                              , const ImageLoadRange& _range = ImageLoadRange())
     {
-        Image tmp;
-        if (imageCubemapFromHStrip(tmp, _image))
+        AllocTagScope allocTag(AllocTag::IoBuffer, true);
+
+        CMFT_UNUSED size_t read;
+        CMFT_UNUSED int seek;
+
+        // Read magic.
+        uint32_t magic;
+        read = ioRead(&magic, sizeof(uint32_t), 1, _stream);
+        DEBUG_CHECK(read == 1, "Could not read from file.");
+        IOERROR_CHECK(_stream);
+
+        // Seek to beginning.
+        seek = ioSeek(_stream, 0L, SEEK_SET);
+        DEBUG_CHECK(0 == seek, "File seek error.");
+        IOERROR_CHECK(_stream);
+
+        if (0 != _element
+        &&  DDS_MAGIC != magic
+        &&  KTX_MAGIC_SHORT != magic)
         {
-            imageMove(_image, tmp);
+            WARN("Could not load element %u of %s. Only Dds and Ktx files hold arrays.", _element, _filePath);
+            return false;
+        }
+
+        // Load image. Dds and Ktx loaders read _range only, other images are cut down to it once loaded.
+        bool loaded = false;
+        bool inRange = false;
+        if (DDS_MAGIC == magic)
+        {
+            loaded = imageLoadDds(_image, _stream, _convertTo, _mapFile, _element, _range);
+            inRange = true;
+        }
+        else if (HDR_MAGIC == magic)
+        {
+            loaded = imageLoadHdr(_image, _stream, _convertTo);
+        }
+        else if (KTX_MAGIC_SHORT == magic)
+        {
+            if (!isKtx2(_stream))
+            {
+                loaded = imageLoadKtx(_image, _stream, _convertTo, _mapFile, _element, _range);
+                inRange = true;
+            }
+            else if (1 == _range.m_numMips && 0x3f == (_range.m_faceMask&0x3f))
+            {
+                // Level index lets a single mip be read alone.
+                loaded = imageLoadKtx2(_image, _stream, _element, _range.m_firstMip);
+                inRange = true;
+            }
+            else
+            {
+                loaded = imageLoadKtx2(_image, _stream, _element, UINT8_MAX);
+            }
+        }
+        else if (EXR_MAGIC == magic)
+        {
+            loaded = imageLoadExr(_image, _stream, _convertTo);
+        }
+        else if (isTga(magic))
+        {
+            loaded = imageLoadTga(_image, _stream, _convertTo);
+        }
+        else
+        {
+            WARN("Could not load %s. Unknown file type.", _filePath);
+            return false;
         }
-    }
 
-    bool imageFaceListFromCubemap(Image _faceList[6], const Image& _cubemap)
-    {
-        // Input check.
-        if(!imageIsCubemap(_cubemap))
+        if (!loaded)
         {
             return false;
         }
 
-        // Get destination sizes and offsets.
-        uint32_t dstDataSize = 0;
-        uint32_t dstMipOffsets[MAX_MIP_NUM];
-        const uint8_t bytesPerPixel = getImageDataInfo(_cubemap.m_format).m_bytesPerPixel;
-        for (uint8_t mip = 0; mip < _cubemap.m_numMips; ++mip)
+        if (!inRange
+        &&  !imageApplyLoadRange(_image, _range))
         {
-            dstMipOffsets[mip] = dstDataSize;
-            const uint32_t mipSize = max(UINT32_C(1), _cubemap.m_width >> mip);
-            dstDataSize += mipSize * mipSize * bytesPerPixel;
+            imageUnload(_image);
+            return false;
         }
 
-        // Get source offsets.
-        uint32_t cubemapOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(cubemapOffsets, _cubemap);
-
-        for (uint8_t face = 0; face < 6; ++face)
+        // Convert if necessary.
+        if (TextureFormat::Unknown != _convertTo
+        &&  _image.m_format != _convertTo)
         {
-            void* dstData = malloc(dstDataSize);
-            MALLOC_CHECK(dstData);
+            imageConvert(_image, _convertTo);
+        }
 
-            for (uint8_t mip = 0; mip < _cubemap.m_numMips; ++mip)
-            {
-                const uint8_t* srcFaceData = (const uint8_t*)_cubemap.m_data + cubemapOffsets[face][mip];
-                uint8_t* dstFaceData = (uint8_t*)dstData + dstMipOffsets[mip];
+        return true;
+    }
 
-                const uint32_t mipFaceSize = max(UINT32_C(1), _cubemap.m_width >> mip);
-                const uint32_t mipPitch = mipFaceSize * bytesPerPixel;
+    static bool imageLoadElement(Image& _image, const char* _filePath, TextureFormat::Enum _convertTo, bool _mapFile, uint32_t _element
+                               , const ImageLoadRange& _range = ImageLoadRange())
+    {
+        // Open file.
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
+        {
+            WARN("Could not open file %s for reading.", _filePath);
+            return false;
+        }
+        ScopeFclose cleanup(fp);
 
-                for (uint32_t yy = 0; yy < mipFaceSize; ++yy)
-                {
-                    const uint8_t* srcRowData = (const uint8_t*)srcFaceData + yy*mipPitch;
-                    uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*mipPitch;
+        FileReader reader(fp);
+        return imageLoadStream(_image, &reader, _filePath, _convertTo, _mapFile, _element, _range);
+    }
 
-                    memcpy(dstRowData, srcRowData, mipPitch);
-                }
-            }
+    bool imageLoad(Image& _image, const char* _filePath, TextureFormat::Enum _convertTo, bool _mapFile)
+    {
+        CMFT_PROFILE_ZONE("imageLoad");
 
-            // Fill image structure.
-            Image result;
-            result.m_width = _cubemap.m_width;
-            result.m_height = _cubemap.m_height;
-            result.m_dataSize = dstDataSize;
-            result.m_format = _cubemap.m_format;
-            result.m_numMips = _cubemap.m_numMips;
-            result.m_numFaces = 1;
-            result.m_data = dstData;
+        return imageLoadElement(_image, _filePath, _convertTo, _mapFile, 0);
+    }
 
-            // Output.
-            imageMove(_faceList[face], result);
-        }
+    bool imageLoad(Image& _image, const char* _filePath, const ImageLoadRange& _range, TextureFormat::Enum _convertTo, bool _mapFile)
+    {
+        CMFT_PROFILE_ZONE("imageLoad");
 
-        return true;
+        return imageLoadElement(_image, _filePath, _convertTo, _mapFile, 0, _range);
     }
 
-    bool imageCubemapFromFaceList(Image& _cubemap, const Image _faceList[6])
+    bool imageLoadFromMemory(Image& _image, const void* _data, size_t _size, TextureFormat::Enum _convertTo)
     {
-        // Input check.
-        if (!imageValidCubemapFaceList(_faceList))
+        CMFT_PROFILE_ZONE("imageLoadFromMemory");
+
+        if (NULL == _data || 0 == _size)
         {
+            WARN("Could not load image from memory. Buffer is empty.");
             return false;
         }
 
-        // Alloc destination data.
-        const uint32_t dstDataSize = _faceList[0].m_dataSize * 6;
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
+        MemoryReader reader(_data, _size);
 
-        // Get source offsets.
-        uint32_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(srcOffsets, _faceList[0]);
-        const uint32_t bytesPerPixel = getImageDataInfo(_faceList[0].m_format).m_bytesPerPixel;
+        // Memory buffers can't be mapped, the caller keeps ownership of _data.
+        return imageLoadStream(_image, &reader, "memory buffer", _convertTo, false, 0);
+    }
 
-        // Copy data.
-        uint32_t destinationOffset = 0;
-        for (uint8_t face = 0; face < 6; ++face)
-        {
-            const uint8_t* srcFaceData = (const uint8_t*)_faceList[face].m_data;
-            for (uint8_t mip = 0; mip < _faceList[0].m_numMips; ++mip)
-            {
-                const uint8_t* srcMipData = (const uint8_t*)srcFaceData + srcOffsets[0][mip];
-                uint8_t* dstMipData = (uint8_t*)dstData + destinationOffset;
+    bool imageLoad(Image& _image, Reader& _reader, TextureFormat::Enum _convertTo)
+    {
+        CMFT_PROFILE_ZONE("imageLoad");
 
-                const uint32_t mipFaceSize = max(UINT32_C(1), _faceList[0].m_width >> mip);
-                const uint32_t mipPitch = mipFaceSize * bytesPerPixel;
-                const uint32_t mipFaceDataSize = mipPitch * mipFaceSize;
+        // Mapping needs a file and a reader could be handing out any part of it, loaded data is always copied.
+        return imageLoadStream(_image, &_reader, "stream", _convertTo, false, 0);
+    }
 
-                destinationOffset += mipFaceDataSize;
+    /// Cubemap data shared by the six face loads of imageCubemapLoadFaceList(). It is allocated by the first face load
+    /// that allocates image data, six times the size of it.
+    struct FaceListBuffer
+    {
+        bx::Mutex m_mutex;
+        Allocator* m_parent;
+        uint8_t* m_data;
+        uint64_t m_faceSize;
+    };
 
-                for (uint32_t yy = 0; yy < mipFaceSize; ++yy)
+    /// Installed with AllocatorScope while loading a face. Hands out the face's part of the shared cubemap data to the first
+    /// allocation of the face size, everything else goes to the parent allocator.
+    struct FaceSliceAllocator : public Allocator
+    {
+        bool isSlice(const void* _ptr) const
+        {
+            return m_taken && _ptr == m_buffer->m_data + m_buffer->m_faceSize*m_face;
+        }
+
+        virtual void* alloc(size_t _size)
+        {
+            if (!m_taken)
+            {
+                bx::MutexScope lock(m_buffer->m_mutex);
+                if (NULL == m_buffer->m_data)
                 {
-                    const uint8_t* srcRowData = (const uint8_t*)srcMipData + yy*mipPitch;
-                    uint8_t* dstRowData = (uint8_t*)dstMipData + yy*mipPitch;
+                    m_buffer->m_data = (uint8_t*)m_buffer->m_parent->alloc(_size*CUBE_FACE_NUM);
+                    m_buffer->m_faceSize = _size;
+                }
 
-                    memcpy(dstRowData, srcRowData, mipPitch);
+                if (NULL != m_buffer->m_data
+                &&  _size == m_buffer->m_faceSize)
+                {
+                    m_taken = true;
+                    return m_buffer->m_data + m_buffer->m_faceSize*m_face;
                 }
             }
-        }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = _faceList[0].m_width;
-        result.m_height = _faceList[0].m_height;
-        result.m_dataSize = dstDataSize;
-        result.m_format = _faceList[0].m_format;
-        result.m_numMips = _faceList[0].m_numMips;
-        result.m_numFaces = 6;
-        result.m_data = dstData;
+            return m_buffer->m_parent->alloc(_size);
+        }
 
-        // Output.
-        imageMove(_cubemap, result);
+        virtual void* realloc(void* _ptr, size_t _size)
+        {
+            if (!isSlice(_ptr))
+            {
+                return m_buffer->m_parent->realloc(_ptr, _size);
+            }
 
-        return true;
-    }
+            void* data = m_buffer->m_parent->alloc(_size);
+            if (NULL != data)
+            {
+                memcpy(data, _ptr, size_t(min(uint64_t(_size), m_buffer->m_faceSize)));
+                m_taken = false;
+            }
+            return data;
+        }
 
-    bool imageCrossFromCubemap(Image& _dst, const Image& _src, bool _vertical)
-    {
-        // Input check.
-        if(!imageIsCubemap(_src))
+        virtual void free(void* _ptr)
         {
-            return false;
+            if (isSlice(_ptr))
+            {
+                m_taken = false;
+            }
+            else
+            {
+                m_buffer->m_parent->free(_ptr);
+            }
         }
 
-        // Copy source image.
-        Image srcCpy;
-        imageCopy(srcCpy, _src);
+        FaceListBuffer* m_buffer;
+        uint8_t m_face;
+        bool m_taken;
+    };
 
-        // Transform -z image face properly.
-        if (_vertical)
+    struct FaceListLoadArgs
+    {
+        const char* const* m_filePaths;
+        TextureFormat::Enum m_convertTo;
+        FaceSliceAllocator m_allocators[CUBE_FACE_NUM];
+        Image m_faces[CUBE_FACE_NUM];
+        bool m_loaded[CUBE_FACE_NUM];
+    };
+
+    static void faceListLoad(void* _userData, uint32_t _begin, uint32_t _end)
+    {
+        FaceListLoadArgs* args = (FaceListLoadArgs*)_userData;
+
+        for (uint32_t face = _begin; face < _end; ++face)
         {
-            imageTransform(srcCpy, IMAGE_FACE_NEGATIVEZ | IMAGE_OP_FLIP_X | IMAGE_OP_FLIP_Y);
+            AllocatorScope allocatorScope(&args->m_allocators[face]);
+            args->m_loaded[face] = imageLoad(args->m_faces[face], args->m_filePaths[face], args->m_convertTo);
         }
+    }
 
-        // Calculate destination offsets and alloc data.
-        uint32_t dstDataSize = 0;
-        uint32_t dstMipOffsets[MAX_MIP_NUM];
-        const uint32_t dstWidth  = (_vertical?3:4) * srcCpy.m_width;
-        const uint32_t dstHeight = (_vertical?4:3) * srcCpy.m_width;
-        const uint32_t bytesPerPixel = getImageDataInfo(srcCpy.m_format).m_bytesPerPixel;
-        for (uint8_t mip = 0; mip < srcCpy.m_numMips; ++mip)
-        {
-            dstMipOffsets[mip] = dstDataSize;
-            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
-            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
+    bool imageCubemapLoadFaceList(Image& _cubemap, const char* const _filePaths[6], TextureFormat::Enum _convertTo)
+    {
+        CMFT_PROFILE_ZONE("imageCubemapLoadFaceList");
 
-            dstDataSize += mipWidth * mipHeight * bytesPerPixel;
+        FaceListBuffer buffer;
+        buffer.m_parent = getAllocator();
+        buffer.m_data = NULL;
+        buffer.m_faceSize = 0;
+
+        FaceListLoadArgs args;
+        args.m_filePaths = _filePaths;
+        args.m_convertTo = _convertTo;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            args.m_allocators[face].m_buffer = &buffer;
+            args.m_allocators[face].m_face = face;
+            args.m_allocators[face].m_taken = false;
+            args.m_loaded[face] = false;
         }
-        void* dstData = malloc(dstDataSize);
-        MALLOC_CHECK(dstData);
 
-        // Get black pixel.
-        void* blackPixel = alloca(bytesPerPixel);
-        const float blackPixelRgba32f[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-        fromRgba32f(blackPixel, TextureFormat::Enum(srcCpy.m_format), blackPixelRgba32f);
+        parallelFor(faceListLoad, (void*)&args, CUBE_FACE_NUM);
 
-        // Fill with black.
-        for (uint8_t mip = 0; mip < srcCpy.m_numMips; ++mip)
+        Image* faces = args.m_faces;
+        bool loaded = true;
+        bool inPlace = true;
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
         {
-            const uint32_t mipWidth  = max(UINT32_C(1), dstWidth  >> mip);
-            const uint32_t mipHeight = max(UINT32_C(1), dstHeight >> mip);
-            const uint32_t mipPitch = mipWidth*bytesPerPixel;
+            loaded &= args.m_loaded[face];
+            inPlace &= args.m_loaded[face]
+                    && 1 == faces[face].m_numFaces
+                    && faces[face].m_dataSize == buffer.m_faceSize
+                    && args.m_allocators[face].isSlice(faces[face].m_data)
+                    ;
+        }
 
-            uint8_t* dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
-            for (uint32_t yy = 0; yy < mipHeight; ++yy)
+        bool valid = false;
+        if (inPlace && imageValidCubemapFaceList(faces))
+        {
+            // Every face was decoded straight into the cubemap.
+            Image result;
+            result.m_width = faces[0].m_width;
+            result.m_height = faces[0].m_height;
+            result.m_dataSize = buffer.m_faceSize*CUBE_FACE_NUM;
+            result.m_format = faces[0].m_format;
+            result.m_numMips = faces[0].m_numMips;
+            result.m_numFaces = CUBE_FACE_NUM;
+            result.m_data = buffer.m_data;
+            result.m_allocator = buffer.m_parent;
+            imageMove(_cubemap, result);
+
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
             {
-                uint8_t* dstRowData = (uint8_t*)dstMipData + yy*mipPitch;
-                for (uint32_t xx = 0; xx < mipWidth; ++xx)
-                {
-                    uint8_t* dstColumnData = (uint8_t*)dstRowData + xx*bytesPerPixel;
-                    memcpy(dstColumnData, blackPixel, bytesPerPixel);
-                }
+                faces[face] = Image();
             }
+            return true;
         }
-
-        // Get source offsets.
-        uint32_t srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(srcOffsets, srcCpy);
-
-        for (uint8_t mip = 0; mip < srcCpy.m_numMips; ++mip)
+        else if (loaded)
         {
-            const uint32_t srcWidth = max(UINT32_C(1), srcCpy.m_width >> mip);
-            const uint32_t srcPitch = srcWidth * bytesPerPixel;
-
-            const uint32_t mipWidth = max(UINT32_C(1), dstWidth >> mip);
-            const uint32_t mipPitch = mipWidth * bytesPerPixel;
-            const uint32_t faceSize = mipWidth / (_vertical?3:4);
-            const uint32_t facePitch = faceSize * bytesPerPixel;
-            const uint32_t rowDataSize = mipPitch * faceSize;
-
-            // Destination offsets.
-            uint32_t faceOffsets[6];
-            if (_vertical)
+            // Faces that didn't fit their part of the cubemap, block compressed faces decoded by the loader for example,
+            // are copied into a new one.
+            const TextureFormat::Enum format = (0 != getImageDataInfo(faces[0].m_format).m_blockBytes)
+                                             ? TextureFormat::RGBA32F
+                                             : faces[0].m_format
+                                             ;
+            bool sameFormat = true;
+            for (uint8_t face = 1; face < CUBE_FACE_NUM; ++face)
             {
-                //   ___ ___ ___
-                //  |   |   |   | -> rowDataSize
-                //  |___|___|___|
-                //
-                //   ___  -> facePitch
-                //
-                //       ___
-                //      |Y+ |
-                //   ___|___|___
-                //  |X- |Z+ |X+ |
-                //  |___|___|___|
-                //      |Y- |
-                //      |___|
-                //      |Z- |
-                //      |___|
-                //
-                faceOffsets[0] = rowDataSize + 2*facePitch; //+x
-                faceOffsets[1] = rowDataSize;               //-x
-                faceOffsets[2] = facePitch;                 //+y
-                faceOffsets[3] = 2*rowDataSize + facePitch; //-y
-                faceOffsets[4] = rowDataSize + facePitch;   //+z
-                faceOffsets[5] = 3*rowDataSize + facePitch; //-z
+                sameFormat &= (faces[face].m_format == faces[0].m_format);
             }
-            else
+
+            for (uint8_t face = 0; face < CUBE_FACE_NUM && !sameFormat; ++face)
             {
-                //       ___
-                //      |+Y |
-                //   ___|___|___ ___
-                //  |-X |+Z |+X |-Z |
-                //  |___|___|___|___|
-                //      |-Y |
-                //      |___|
-                //
-                faceOffsets[0] = rowDataSize + 2*facePitch; //+x
-                faceOffsets[1] = rowDataSize;               //-x
-                faceOffsets[2] = facePitch;                 //+y
-                faceOffsets[3] = 2*rowDataSize + facePitch; //-y
-                faceOffsets[4] = rowDataSize + facePitch;   //+z
-                faceOffsets[5] = rowDataSize + 3*facePitch; //-z
+                if (faces[face].m_format != format)
+                {
+                    imageConvert(faces[face], format);
+                }
             }
 
-            uint8_t* dstMipData = (uint8_t*)dstData + dstMipOffsets[mip];
-            for (uint8_t face = 0; face < 6; ++face)
+            valid = imageValidCubemapFaceList(faces);
+            if (valid)
             {
-                uint8_t* dstFaceData = (uint8_t*)dstMipData + faceOffsets[face];
-                const uint8_t* srcFaceData = (uint8_t*)srcCpy.m_data + srcOffsets[face][mip];
-                for (uint32_t yy = 0; yy < faceSize; ++yy)
-                {
-                    uint8_t* dstRowData = (uint8_t*)dstFaceData + yy*mipPitch;
-                    const uint8_t* srcRowData = (const uint8_t*)srcFaceData + yy*srcPitch;
+                uint64_t faceOffsets[CUBE_FACE_NUM];
+                imageGetFaceOffsets(faceOffsets, faces[0]);
+                const uint64_t faceSize = (1 < faces[0].m_numFaces) ? faceOffsets[1] : faces[0].m_dataSize;
 
-                    memcpy(dstRowData, srcRowData, facePitch);
+                void* data = buffer.m_parent->alloc(size_t(faceSize*CUBE_FACE_NUM));
+                MALLOC_CHECK(data);
+
+                for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+                {
+                    memcpy((uint8_t*)data + faceSize*face, faces[face].m_data, size_t(faceSize));
                 }
-            }
-        }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = dstWidth;
-        result.m_height = dstHeight;
-        result.m_dataSize = dstDataSize;
-        result.m_format = srcCpy.m_format;
-        result.m_numMips = srcCpy.m_numMips;
-        result.m_numFaces = 1;
-        result.m_data = dstData;
+                Image result;
+                result.m_width = faces[0].m_width;
+                result.m_height = faces[0].m_height;
+                result.m_dataSize = faceSize*CUBE_FACE_NUM;
+                result.m_format = faces[0].m_format;
+                result.m_numMips = faces[0].m_numMips;
+                result.m_numFaces = CUBE_FACE_NUM;
+                result.m_data = data;
+                result.m_allocator = buffer.m_parent;
+                imageMove(_cubemap, result);
+            }
+            else
+            {
+                WARN("Cubemap faces are not of the same size.");
+            }
+        }
 
-        // Output.
-        imageMove(_dst, result);
+        // Faces in the shared data release their parts, which is then freed.
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            imageUnload(faces[face]);
+        }
 
-        // Cleanup.
-        imageUnload(srcCpy);
+        if (NULL != buffer.m_data)
+        {
+            buffer.m_parent->free(buffer.m_data);
+        }
 
-        return true;
+        return valid;
     }
 
-    void imageCrossFromCubemap(Image& _image, bool _vertical)
+    uint32_t imageGetArraySize(const char* _filePath)
     {
-        Image tmp;
-        if (imageCrossFromCubemap(tmp, _image, _vertical))
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
         {
-            imageMove(_image, tmp);
+            WARN("Could not open file %s for reading.", _filePath);
+            return 0;
         }
-    }
-
-    // Image loading.
-    //-----
+        ScopeFclose cleanup(fp);
 
-    bool imageLoadDds(Image& _image, FILE* _fp)
-    {
-        CMFT_UNUSED size_t read;
+        // Dds dxt10 header or Ktx header fit into the first 148 bytes.
+        uint8_t header[4+DDS_HEADER_SIZE+DDS_DX10_HEADER_SIZE];
+        memset(header, 0, sizeof(header));
+        CMFT_UNUSED const size_t read = fread(header, 1, sizeof(header), fp);
 
-        // Read magic.
         uint32_t magic;
-        read = fread(&magic, sizeof(uint32_t), 1, _fp);
-        DEBUG_CHECK(read == 1, "Could not read from file.");
-        FERROR_CHECK(_fp);
+        memcpy(&magic, header, sizeof(uint32_t));
 
-        // Check magic.
-        if (DDS_MAGIC != magic)
+        uint32_t arraySize = 1;
+        if (DDS_MAGIC == magic)
         {
-            WARN("Dds magic invalid.");
+            // Pixel format fourcc at 84, dxt10 array size at 140.
+            uint32_t fourcc;
+            memcpy(&fourcc, &header[84], sizeof(uint32_t));
+            if (DDS_DX10 == fourcc)
+            {
+                memcpy(&arraySize, &header[140], sizeof(uint32_t));
+            }
+        }
+        else if (KTX_MAGIC_SHORT == magic)
+        {
+            // Ktx number of array elements at 48, Ktx2 layer count at 32.
+            const uint8_t ktx2Magic[KTX2_MAGIC_LEN] = KTX2_MAGIC;
+            const bool ktx2 = (0 == memcmp(header, ktx2Magic, KTX2_MAGIC_LEN));
+            memcpy(&arraySize, &header[ktx2 ? 32 : 48], sizeof(uint32_t));
+        }
+
+        return max(UINT32_C(1), arraySize);
+    }
+
+    bool imageGetMipIndex(ImageMipIndex& _index, const char* _filePath)
+    {
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
+        {
+            WARN("Could not open file %s for reading.", _filePath);
             return false;
         }
+        ScopeFclose cleanup(fp);
+        FileReader reader(fp);
 
-        // Read header.
-        DdsHeader ddsHeader;
-        read = 0;
-        read += fread(&ddsHeader.m_size,                      1, sizeof(ddsHeader.m_size),                      _fp);
-        read += fread(&ddsHeader.m_flags,                     1, sizeof(ddsHeader.m_flags),                     _fp);
-        read += fread(&ddsHeader.m_height,                    1, sizeof(ddsHeader.m_height),                    _fp);
-        read += fread(&ddsHeader.m_width,                     1, sizeof(ddsHeader.m_width),                     _fp);
-        read += fread(&ddsHeader.m_pitchOrLinearSize,         1, sizeof(ddsHeader.m_pitchOrLinearSize),         _fp);
-        read += fread(&ddsHeader.m_depth,                     1, sizeof(ddsHeader.m_depth),                     _fp);
-        read += fread(&ddsHeader.m_mipMapCount,               1, sizeof(ddsHeader.m_mipMapCount),               _fp);
-        read += fread(&ddsHeader.m_reserved1,                 1, sizeof(ddsHeader.m_reserved1),                 _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_size,        1, sizeof(ddsHeader.m_pixelFormat.m_size),        _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_flags,       1, sizeof(ddsHeader.m_pixelFormat.m_flags),       _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_fourcc,      1, sizeof(ddsHeader.m_pixelFormat.m_fourcc),      _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_rgbBitCount, 1, sizeof(ddsHeader.m_pixelFormat.m_rgbBitCount), _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_rBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_rBitMask),    _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_gBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_gBitMask),    _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_bBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_bBitMask),    _fp);
-        read += fread(&ddsHeader.m_pixelFormat.m_aBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_aBitMask),    _fp);
-        read += fread(&ddsHeader.m_caps,                      1, sizeof(ddsHeader.m_caps),                      _fp);
-        read += fread(&ddsHeader.m_caps2,                     1, sizeof(ddsHeader.m_caps2),                     _fp);
-        read += fread(&ddsHeader.m_caps3,                     1, sizeof(ddsHeader.m_caps3),                     _fp);
-        read += fread(&ddsHeader.m_caps4,                     1, sizeof(ddsHeader.m_caps4),                     _fp);
-        read += fread(&ddsHeader.m_reserved2,                 1, sizeof(ddsHeader.m_reserved2),                 _fp);
-        DEBUG_CHECK(read == DDS_HEADER_SIZE, "Error reading file header.");
-        FERROR_CHECK(_fp);
+        // Dds dwReserved1 at 32, Ktx bytes of key-value data at 60.
+        uint8_t header[KTX_MAGIC_LEN+KTX_HEADER_SIZE];
+        memset(header, 0, sizeof(header));
+        CMFT_UNUSED const size_t read = ioRead(header, 1, sizeof(header), &reader);
 
-        // Read DdsDxt10 header if present.
-        DdsHeaderDxt10 ddsHeaderDxt10;
-        memset(&ddsHeaderDxt10, 0, sizeof(DdsHeaderDxt10));
-        const bool hasDdsDxt10 = (DDS_DX10 == ddsHeader.m_pixelFormat.m_fourcc && (ddsHeader.m_flags&DDPF_FOURCC));
-        if (hasDdsDxt10)
+        uint32_t magic;
+        memcpy(&magic, header, sizeof(uint32_t));
+
+        if (DDS_MAGIC == magic)
         {
-            read = 0;
-            read += fread(&ddsHeaderDxt10.m_dxgiFormat,        1, sizeof(ddsHeaderDxt10.m_dxgiFormat),        _fp);
-            read += fread(&ddsHeaderDxt10.m_resourceDimension, 1, sizeof(ddsHeaderDxt10.m_resourceDimension), _fp);
-            read += fread(&ddsHeaderDxt10.m_miscFlags,         1, sizeof(ddsHeaderDxt10.m_miscFlags),         _fp);
-            read += fread(&ddsHeaderDxt10.m_arraySize,         1, sizeof(ddsHeaderDxt10.m_arraySize),         _fp);
-            read += fread(&ddsHeaderDxt10.m_miscFlags2,        1, sizeof(ddsHeaderDxt10.m_miscFlags2),        _fp);
-            DEBUG_CHECK(read == DDS_DX10_HEADER_SIZE, "Error reading Dds dx10 file header.");
-            FERROR_CHECK(_fp);
+            uint32_t reserved[3];
+            memcpy(reserved, &header[32], sizeof(reserved));
+            return MIP_INDEX_TAG == reserved[0]
+                && mipIndexRead(_index, &reader, int64_t(uint64_t(reserved[1]) | (uint64_t(reserved[2])<<32)))
+                ;
         }
 
-        // Validate header.
-        if (DDS_HEADER_SIZE != ddsHeader.m_size)
+        const uint8_t ktxMagic[KTX_MAGIC_LEN] = KTX_MAGIC;
+        if (0 == memcmp(header, ktxMagic, KTX_MAGIC_LEN))
         {
-            WARN("Invalid Dds header size!");
-            return false;
+            uint32_t bytesKeyValue;
+            memcpy(&bytesKeyValue, &header[60], sizeof(uint32_t));
+            return ktxReadMipIndex(_index, &reader, bytesKeyValue);
         }
 
-        if ((ddsHeader.m_flags & (DDSD_CAPS|DDSD_HEIGHT|DDSD_WIDTH|DDSD_PIXELFORMAT)) != (DDSD_CAPS|DDSD_HEIGHT|DDSD_WIDTH|DDSD_PIXELFORMAT))
+        return false;
+    }
+
+    bool imageGetMipChainInfo(uint32_t& _width, uint32_t& _height, uint8_t& _numMips, uint8_t& _numFaces, const char* _filePath)
+    {
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
         {
-            WARN("Invalid Dds header flags!");
+            WARN("Could not open file %s for reading.", _filePath);
             return false;
         }
+        ScopeFclose cleanup(fp);
 
-        if (0 == (ddsHeader.m_caps & DDSCAPS_TEXTURE))
+        uint8_t header[4+DDS_HEADER_SIZE];
+        memset(header, 0, sizeof(header));
+        CMFT_UNUSED const size_t read = fread(header, 1, sizeof(header), fp);
+
+        uint32_t magic;
+        memcpy(&magic, header, sizeof(uint32_t));
+
+        uint32_t numMips;
+        uint32_t numFaces;
+        if (DDS_MAGIC == magic)
+        {
+            // Height at 12, width at 16, mip count at 28, caps2 at 112.
+            uint32_t caps2;
+            memcpy(&_height, &header[12],  sizeof(uint32_t));
+            memcpy(&_width,  &header[16],  sizeof(uint32_t));
+            memcpy(&numMips, &header[28],  sizeof(uint32_t));
+            memcpy(&caps2,   &header[112], sizeof(uint32_t));
+            numFaces = (0 != (caps2 & DDSCAPS2_CUBEMAP)) ? 6 : 1;
+        }
+        else if (KTX_MAGIC_SHORT == magic)
+        {
+            // Ktx width at 36, faces at 52, mips at 56. Ktx2 width at 20, faces at 36, levels at 40.
+            const uint8_t ktx2Magic[KTX2_MAGIC_LEN] = KTX2_MAGIC;
+            const bool ktx2 = (0 == memcmp(header, ktx2Magic, KTX2_MAGIC_LEN));
+            memcpy(&_width,   &header[ktx2 ? 20 : 36], sizeof(uint32_t));
+            memcpy(&_height,  &header[ktx2 ? 24 : 40], sizeof(uint32_t));
+            memcpy(&numFaces, &header[ktx2 ? 36 : 52], sizeof(uint32_t));
+            memcpy(&numMips,  &header[ktx2 ? 40 : 56], sizeof(uint32_t));
+        }
+        else
         {
-            WARN("Invalid Dds header caps!");
             return false;
         }
 
-        if (0 == ddsHeader.m_mipMapCount)
+        _numMips = uint8_t(max(UINT32_C(1), min(numMips, uint32_t(MAX_MIP_NUM))));
+        _numFaces = uint8_t(numFaces);
+
+        return true;
+    }
+
+    bool imageLoadArrayElement(Image& _image, const char* _filePath, uint32_t _element, TextureFormat::Enum _convertTo, bool _mapFile)
+    {
+        CMFT_PROFILE_ZONE("imageLoadArrayElement");
+
+        return imageLoadElement(_image, _filePath, _convertTo, _mapFile, _element);
+    }
+
+    bool imageLoadKtx2Mip(Image& _image, const char* _filePath, uint8_t _mip, TextureFormat::Enum _convertTo)
+    {
+        CMFT_PROFILE_ZONE("imageLoadKtx2Mip");
+        AllocTagScope allocTag(AllocTag::IoBuffer, true);
+
+        FILE* fp = fopen(_filePath, "rb");
+        if (NULL == fp)
         {
-            WARN("Dds image mipmap count is 0. Setting to 1.");
-            ddsHeader.m_mipMapCount = 1;
+            WARN("Could not open file %s for reading.", _filePath);
+            return false;
         }
+        ScopeFclose cleanup(fp);
+        FileReader reader(fp);
 
-        const bool isCubemap = (0 != (ddsHeader.m_caps2 & DDSCAPS2_CUBEMAP));
-        if (isCubemap && (DDS_CUBEMAP_ALLFACES != (ddsHeader.m_caps2 & DDS_CUBEMAP_ALLFACES)))
+        if (!isKtx2(&reader))
         {
-            WARN("Partial cubemap not supported!");
+            WARN("Could not load mip %u of %s. Not a Ktx2 file.", _mip, _filePath);
             return false;
         }
 
-        // Get format.
-        TextureFormat::Enum format = TextureFormat::Unknown;
-        if (hasDdsDxt10)
+        if (!imageLoadKtx2(_image, &reader, 0, _mip))
         {
-            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsDxgiFormat); ii < end; ++ii)
-            {
-                if (s_translateDdsDxgiFormat[ii].m_dxgiFormat == ddsHeaderDxt10.m_dxgiFormat)
-                {
-                    format = s_translateDdsDxgiFormat[ii].m_textureFormat;
-                    break;
-                }
-            }
+            return false;
         }
-        else
+
+        // Convert if necessary.
+        if (TextureFormat::Unknown != _convertTo
+        &&  _image.m_format != _convertTo)
         {
-            uint32_t ddsBcFlag = 0;
-            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsPfBitCount); ii < end; ++ii)
-            {
-                if (s_translateDdsPfBitCount[ii].m_bitCount == ddsHeader.m_pixelFormat.m_rgbBitCount)
-                {
-                    ddsBcFlag = s_translateDdsPfBitCount[ii].m_flag;
-                    break;
-                }
-            }
+            imageConvert(_image, _convertTo);
+        }
 
-            const uint32_t ddsFormat = ddsHeader.m_pixelFormat.m_flags & DDPF_FOURCC
-                ? ddsHeader.m_pixelFormat.m_fourcc
-                : (ddsHeader.m_pixelFormat.m_flags | ddsBcFlag)
-                ;
+        return true;
+    }
 
-            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateDdsFormat); ii < end; ++ii)
-            {
-                if (s_translateDdsFormat[ii].m_format == ddsFormat)
-                {
-                    format = s_translateDdsFormat[ii].m_textureFormat;
-                    break;
-                }
-            }
-        }
+    uint32_t imageLoadArray(Image* _images, uint32_t _maxImages, const char* _filePath, TextureFormat::Enum _convertTo)
+    {
+        CMFT_PROFILE_ZONE("imageLoadArray");
 
-        if (TextureFormat::Unknown == format)
+        const uint32_t arraySize = imageGetArraySize(_filePath);
+        const uint32_t count = min(arraySize, _maxImages);
+        for (uint32_t ii = 0; ii < count; ++ii)
         {
-            const uint8_t bytesPerPixel = uint8_t(ddsHeader.m_pixelFormat.m_rgbBitCount/8);
-            for (uint8_t ii = 0, end = CMFT_COUNTOF(s_ddsValidFormats); ii < end; ++ii)
+            if (!imageLoadElement(_images[ii], _filePath, _convertTo, false, ii))
             {
-                if (bytesPerPixel == getImageDataInfo(s_ddsValidFormats[ii]).m_bytesPerPixel)
-                {
-                    format = TextureFormat::Enum(ii);
-                }
+                return ii;
             }
+        }
 
-            WARN("DDS data format unknown. Guessing... Got %s.", getTextureFormatStr(format));
+        return count;
+    }
 
-            if (TextureFormat::Unknown == format)
-            {
-                WARN("DDS data format not supported!");
-                return false;
-            }
+    // Image saving.
+    //-----
+
+    static void ddsWriteHeader(Writer* _stream, const DdsHeader& _ddsHeader, const DdsHeaderDxt10& _ddsHeaderDxt10)
+    {
+        CMFT_UNUSED size_t write;
+
+        // Write magic.
+        const uint32_t magic = DDS_MAGIC;
+        write = ioWrite(&magic, 1, 4, _stream);
+        DEBUG_CHECK(write == sizeof(magic), "Error writing Dds magic.");
+        IOERROR_CHECK(_stream);
+
+        // Write header.
+        write = 0;
+        write += ioWrite(&_ddsHeader.m_size,                      1, sizeof(_ddsHeader.m_size),                      _stream);
+        write += ioWrite(&_ddsHeader.m_flags,                     1, sizeof(_ddsHeader.m_flags),                     _stream);
+        write += ioWrite(&_ddsHeader.m_height,                    1, sizeof(_ddsHeader.m_height),                    _stream);
+        write += ioWrite(&_ddsHeader.m_width,                     1, sizeof(_ddsHeader.m_width),                     _stream);
+        write += ioWrite(&_ddsHeader.m_pitchOrLinearSize,         1, sizeof(_ddsHeader.m_pitchOrLinearSize),         _stream);
+        write += ioWrite(&_ddsHeader.m_depth,                     1, sizeof(_ddsHeader.m_depth),                     _stream);
+        write += ioWrite(&_ddsHeader.m_mipMapCount,               1, sizeof(_ddsHeader.m_mipMapCount),               _stream);
+        write += ioWrite(&_ddsHeader.m_reserved1,                 1, sizeof(_ddsHeader.m_reserved1),                 _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_size,        1, sizeof(_ddsHeader.m_pixelFormat.m_size),        _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_flags,       1, sizeof(_ddsHeader.m_pixelFormat.m_flags),       _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_fourcc,      1, sizeof(_ddsHeader.m_pixelFormat.m_fourcc),      _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_rgbBitCount, 1, sizeof(_ddsHeader.m_pixelFormat.m_rgbBitCount), _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_rBitMask,    1, sizeof(_ddsHeader.m_pixelFormat.m_rBitMask),    _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_gBitMask,    1, sizeof(_ddsHeader.m_pixelFormat.m_gBitMask),    _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_bBitMask,    1, sizeof(_ddsHeader.m_pixelFormat.m_bBitMask),    _stream);
+        write += ioWrite(&_ddsHeader.m_pixelFormat.m_aBitMask,    1, sizeof(_ddsHeader.m_pixelFormat.m_aBitMask),    _stream);
+        write += ioWrite(&_ddsHeader.m_caps,                      1, sizeof(_ddsHeader.m_caps),                      _stream);
+        write += ioWrite(&_ddsHeader.m_caps2,                     1, sizeof(_ddsHeader.m_caps2),                     _stream);
+        write += ioWrite(&_ddsHeader.m_caps3,                     1, sizeof(_ddsHeader.m_caps3),                     _stream);
+        write += ioWrite(&_ddsHeader.m_caps4,                     1, sizeof(_ddsHeader.m_caps4),                     _stream);
+        write += ioWrite(&_ddsHeader.m_reserved2,                 1, sizeof(_ddsHeader.m_reserved2),                 _stream);
+        DEBUG_CHECK(write == DDS_HEADER_SIZE, "Error writing Dds file header.");
+        IOERROR_CHECK(_stream);
+
+        if (DDS_DX10 == _ddsHeader.m_pixelFormat.m_fourcc)
+        {
+            write = 0;
+            write += ioWrite(&_ddsHeaderDxt10.m_dxgiFormat,        1, sizeof(_ddsHeaderDxt10.m_dxgiFormat),        _stream);
+            write += ioWrite(&_ddsHeaderDxt10.m_resourceDimension, 1, sizeof(_ddsHeaderDxt10.m_resourceDimension), _stream);
+            write += ioWrite(&_ddsHeaderDxt10.m_miscFlags,         1, sizeof(_ddsHeaderDxt10.m_miscFlags),         _stream);
+            write += ioWrite(&_ddsHeaderDxt10.m_arraySize,         1, sizeof(_ddsHeaderDxt10.m_arraySize),         _stream);
+            write += ioWrite(&_ddsHeaderDxt10.m_miscFlags2,        1, sizeof(_ddsHeaderDxt10.m_miscFlags2),        _stream);
+            DEBUG_CHECK(write == DDS_DX10_HEADER_SIZE, "Error writing Dds dx10 file header.");
+            IOERROR_CHECK(_stream);
         }
+    }
 
-        // Calculate data size.
-        const uint8_t numFaces = isCubemap ? 6 : 1;
-        const uint32_t bytesPerPixel = getImageDataInfo(format).m_bytesPerPixel;
-        uint32_t dataSize = 0;
-        for (uint8_t face = 0; face < numFaces; ++face)
+    bool imageSaveDds(Writer* _stream, const Image& _image, MipLayout::Enum _layout = MipLayout::FileType)
+    {
+        CMFT_UNUSED size_t write;
+
+        DdsHeader ddsHeader;
+        DdsHeaderDxt10 ddsHeaderDxt10;
+        ddsHeaderFromImage(ddsHeader, &ddsHeaderDxt10, _image);
+
+        if (MipLayout::FileType == _layout)
         {
-            for (uint8_t mip = 0; mip < ddsHeader.m_mipMapCount; ++mip)
-            {
-                uint32_t width  = max(UINT32_C(1), ddsHeader.m_width  >> mip);
-                uint32_t height = max(UINT32_C(1), ddsHeader.m_height >> mip);
-                dataSize += width * height * bytesPerPixel;
-            }
+            ddsWriteHeader(_stream, ddsHeader, ddsHeaderDxt10);
+
+            // Write data.
+            DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
+            write = ioWrite(_image.m_data, 1, _image.m_dataSize, _stream);
+            DEBUG_CHECK(write == _image.m_dataSize, "Error writing Dds image data.");
+            IOERROR_CHECK(_stream);
+
+            return true;
         }
 
-        // Some software tools produce invalid dds file.
-        // Flags claim there should be a ddsdxt10 header after dds header but in fact image data starts there.
-        // Therefore, to handle those situations, image data size will be checked against remaining unread data size.
+        // Mips follow each other with all of their faces, index is written after them.
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, _image);
 
-        // Current position in file.
-        long int fpCurrentPos = ftell(_fp);
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
+        const uint64_t dataBegin = 4 + DDS_HEADER_SIZE + ((DDS_DX10 == ddsHeader.m_pixelFormat.m_fourcc) ? DDS_DX10_HEADER_SIZE : 0);
 
-        // Remaining unread data size.
-        fseek(_fp, 0L, SEEK_END);
-        long int fpRemaining = ftell(_fp) - fpCurrentPos;
+        ImageMipIndex index;
+        memset(&index, 0, sizeof(ImageMipIndex));
+        index.m_tag = MIP_INDEX_TAG;
+        index.m_layout = _layout;
+        index.m_numMips = _image.m_numMips;
+        index.m_numFaces = _image.m_numFaces;
 
-        // Seek back to currentPos or 20 before currentPos in case remaining unread data size does match image data size.
-        fseek(_fp, fpCurrentPos - DDS_DX10_HEADER_SIZE*(fpRemaining == (long int)dataSize-DDS_DX10_HEADER_SIZE), SEEK_SET);
+        uint64_t pos = dataBegin;
+        for (uint8_t ii = 0; ii < _image.m_numMips; ++ii)
+        {
+            const uint8_t mip = mipLayoutMip(_layout, ii, _image.m_numMips);
+            const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
+            const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
+            index.m_offsets[mip] = pos;
+            index.m_sizes[mip] = mipFaceDataSize(imageDataInfo, width, height)*_image.m_numFaces;
+            pos += index.m_sizes[mip];
+        }
 
-        // Alloc and read data.
-        void* data = malloc(dataSize);
-        MALLOC_CHECK(data);
-        read = fread(data, 1, dataSize, _fp);
-        DEBUG_CHECK(read == dataSize, "Could not read from file.");
-        FERROR_CHECK(_fp);
+        ddsHeader.m_reserved1[0] = MIP_INDEX_TAG;
+        ddsHeader.m_reserved1[1] = uint32_t(pos);
+        ddsHeader.m_reserved1[2] = uint32_t(pos>>32);
+        ddsWriteHeader(_stream, ddsHeader, ddsHeaderDxt10);
 
-        // Fill image structure.
-        Image result;
-        result.m_width = ddsHeader.m_width;
-        result.m_height = ddsHeader.m_height;
-        result.m_dataSize = dataSize;
-        result.m_format = format;
-        result.m_numMips = uint8_t(ddsHeader.m_mipMapCount);
-        result.m_numFaces = numFaces;
-        result.m_data = data;
+        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
+        for (uint8_t ii = 0; ii < _image.m_numMips; ++ii)
+        {
+            const uint8_t mip = mipLayoutMip(_layout, ii, _image.m_numMips);
+            const uint64_t faceSize = index.m_sizes[mip]/_image.m_numFaces;
+            for (uint8_t face = 0; face < _image.m_numFaces; ++face)
+            {
+                write = ioWrite((const uint8_t*)_image.m_data + offsets[face][mip], 1, faceSize, _stream);
+                DEBUG_CHECK(write == faceSize, "Error writing Dds image data.");
+                IOERROR_CHECK(_stream);
+            }
+        }
 
-        // Output.
-        imageMove(_image, result);
+        write = ioWrite(&index, 1, sizeof(ImageMipIndex), _stream);
+        DEBUG_CHECK(write == sizeof(ImageMipIndex), "Error writing Dds mip index.");
+        IOERROR_CHECK(_stream);
 
         return true;
     }
 
-    bool imageLoadKtx(Image& _image, FILE* _fp)
+    static void ktxWriteHeader(Writer* _stream, const KtxHeader& _ktxHeader)
     {
-        CMFT_UNUSED size_t read;
-        CMFT_UNUSED int seek;
-
-        KtxHeader ktxHeader;
+        CMFT_UNUSED size_t write;
 
-        // Read magic.
-        uint8_t magic[12];
-        read = fread(&magic, KTX_MAGIC_LEN, 1, _fp);
-        DEBUG_CHECK(read == 1, "Could not read from file.");
-        FERROR_CHECK(_fp);
+        // Write magic.
+        const uint8_t magic[KTX_MAGIC_LEN+1] = KTX_MAGIC;
+        write = ioWrite(&magic, 1, KTX_MAGIC_LEN, _stream);
+        DEBUG_CHECK(write == KTX_MAGIC_LEN, "Error writing Ktx magic.");
+        IOERROR_CHECK(_stream);
 
-        const uint8_t ktxMagic[12] = KTX_MAGIC;
-        if (0 != memcmp(magic, ktxMagic, KTX_MAGIC_LEN))
-        {
-            WARN("Ktx magic invalid.");
-            return false;
-        }
+        // Write header.
+        write = 0;
+        write += ioWrite(&_ktxHeader.m_endianness,           1, sizeof(_ktxHeader.m_endianness),           _stream);
+        write += ioWrite(&_ktxHeader.m_glType,               1, sizeof(_ktxHeader.m_glType),               _stream);
+        write += ioWrite(&_ktxHeader.m_glTypeSize,           1, sizeof(_ktxHeader.m_glTypeSize),           _stream);
+        write += ioWrite(&_ktxHeader.m_glFormat,             1, sizeof(_ktxHeader.m_glFormat),             _stream);
+        write += ioWrite(&_ktxHeader.m_glInternalFormat,     1, sizeof(_ktxHeader.m_glInternalFormat),     _stream);
+        write += ioWrite(&_ktxHeader.m_glBaseInternalFormat, 1, sizeof(_ktxHeader.m_glBaseInternalFormat), _stream);
+        write += ioWrite(&_ktxHeader.m_pixelWidth,           1, sizeof(_ktxHeader.m_pixelWidth),           _stream);
+        write += ioWrite(&_ktxHeader.m_pixelHeight,          1, sizeof(_ktxHeader.m_pixelHeight),          _stream);
+        write += ioWrite(&_ktxHeader.m_pixelDepth,           1, sizeof(_ktxHeader.m_pixelDepth),           _stream);
+        write += ioWrite(&_ktxHeader.m_numArrayElements,     1, sizeof(_ktxHeader.m_numArrayElements),     _stream);
+        write += ioWrite(&_ktxHeader.m_numFaces,             1, sizeof(_ktxHeader.m_numFaces),             _stream);
+        write += ioWrite(&_ktxHeader.m_numMips,              1, sizeof(_ktxHeader.m_numMips),              _stream);
+        write += ioWrite(&_ktxHeader.m_bytesKeyValue,        1, sizeof(_ktxHeader.m_bytesKeyValue),        _stream);
+        DEBUG_CHECK(write == KTX_HEADER_SIZE, "Error writing Ktx header.");
+        IOERROR_CHECK(_stream);
+    }
 
-        // Read header.
-        read = 0;
-        read += fread(&ktxHeader.m_endianness,           1, sizeof(ktxHeader.m_endianness),           _fp);
-        read += fread(&ktxHeader.m_glType,               1, sizeof(ktxHeader.m_glType),               _fp);
-        read += fread(&ktxHeader.m_glTypeSize,           1, sizeof(ktxHeader.m_glTypeSize),           _fp);
-        read += fread(&ktxHeader.m_glFormat,             1, sizeof(ktxHeader.m_glFormat),             _fp);
-        read += fread(&ktxHeader.m_glInternalFormat,     1, sizeof(ktxHeader.m_glInternalFormat),     _fp);
-        read += fread(&ktxHeader.m_glBaseInternalFormat, 1, sizeof(ktxHeader.m_glBaseInternalFormat), _fp);
-        read += fread(&ktxHeader.m_pixelWidth,           1, sizeof(ktxHeader.m_pixelWidth),           _fp);
-        read += fread(&ktxHeader.m_pixelHeight,          1, sizeof(ktxHeader.m_pixelHeight),          _fp);
-        read += fread(&ktxHeader.m_pixelDepth,           1, sizeof(ktxHeader.m_pixelDepth),           _fp);
-        read += fread(&ktxHeader.m_numArrayElements,     1, sizeof(ktxHeader.m_numArrayElements),     _fp);
-        read += fread(&ktxHeader.m_numFaces,             1, sizeof(ktxHeader.m_numFaces),             _fp);
-        read += fread(&ktxHeader.m_numMips,              1, sizeof(ktxHeader.m_numMips),              _fp);
-        read += fread(&ktxHeader.m_bytesKeyValue,        1, sizeof(ktxHeader.m_bytesKeyValue),        _fp);
-        DEBUG_CHECK(read == KTX_HEADER_SIZE, "Error reading Ktx file header.");
-        FERROR_CHECK(_fp);
+    /// Bytes written for faces of mip _mip of a Ktx file, with row and face padding. _mipRounding gets padding after them.
+    static uint64_t ktxMipFacesSize(uint32_t& _mipRounding, const Image& _image, uint8_t _mip)
+    {
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
 
-        if (0 == ktxHeader.m_numMips)
+        uint32_t width  = max(UINT32_C(1), _image.m_width  >> _mip);
+        uint32_t height = max(UINT32_C(1), _image.m_height >> _mip);
+        if (0 != imageDataInfo.m_blockBytes)
         {
-            WARN("Ktx image mipmap count is 0. Setting to 1.");
-            ktxHeader.m_numMips = 1;
+            width  = (width +3)/4;
+            height = (height+3)/4;
         }
 
-        // Get format.
-        TextureFormat::Enum format = TextureFormat::Unknown;
-        for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateKtxFormat); ii < end; ++ii)
+        const uint32_t pitch = width * (0 != imageDataInfo.m_blockBytes ? imageDataInfo.m_blockBytes : imageDataInfo.m_bytesPerPixel);
+        const uint32_t faceSize = pitch * height;
+        const uint32_t mipSize = faceSize * _image.m_numFaces;
+
+        const uint32_t pitchRounding = (KTX_UNPACK_ALIGNMENT-1)-((pitch    + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+        const uint32_t faceRounding  = (KTX_UNPACK_ALIGNMENT-1)-((faceSize + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+        _mipRounding = (KTX_UNPACK_ALIGNMENT-1)-((mipSize  + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+
+        return uint64_t((pitch + pitchRounding)*height + faceRounding)*_image.m_numFaces;
+    }
+
+    bool imageSaveKtx(Writer* _stream, const Image& _image, MipLayout::Enum _layout = MipLayout::FileType)
+    {
+        KtxHeader ktxHeader;
+        ktxHeaderFromImage(ktxHeader, _image);
+
+        CMFT_UNUSED size_t write;
+
+        // Mip index is a key-value pair, offsets of mips follow from their sizes.
+        const bool mipIndex = (MipLayout::FileType != _layout);
+        const uint32_t keySize = uint32_t(sizeof(KTX_MIP_INDEX_KEY));
+        const uint32_t pairSize = keySize + uint32_t(sizeof(ImageMipIndex));
+        const uint8_t pad[4] = { 0, 0, 0, 0 };
+
+        ImageMipIndex index;
+        if (mipIndex)
         {
-            if (s_translateKtxFormat[ii].m_glInternalFormat == ktxHeader.m_glInternalFormat)
+            ktxHeader.m_bytesKeyValue = uint32_t(sizeof(uint32_t)) + ((pairSize+3)&~3);
+
+            memset(&index, 0, sizeof(ImageMipIndex));
+            index.m_tag = MIP_INDEX_TAG;
+            index.m_layout = _layout;
+            index.m_numMips = _image.m_numMips;
+            index.m_numFaces = _image.m_numFaces;
+
+            uint64_t pos = KTX_MAGIC_LEN + KTX_HEADER_SIZE + ktxHeader.m_bytesKeyValue;
+            for (uint8_t ii = 0; ii < _image.m_numMips; ++ii)
             {
-                format = s_translateKtxFormat[ii].m_textureFormat;
-                break;
+                const uint8_t mip = mipLayoutMip(_layout, ii, _image.m_numMips);
+                uint32_t mipRounding;
+                index.m_offsets[mip] = pos + sizeof(uint32_t);
+                index.m_sizes[mip] = ktxMipFacesSize(mipRounding, _image, mip);
+                pos = index.m_offsets[mip] + index.m_sizes[mip] + mipRounding;
             }
         }
 
-        if (TextureFormat::Unknown == format)
-        {
-            WARN("Ktx file internal format unknown.");
-            return false;
-        }
-
-        const uint32_t bytesPerPixel = getImageDataInfo(format).m_bytesPerPixel;
+        ktxWriteHeader(_stream, ktxHeader);
 
-        // Compute data offsets.
-        uint32_t offsets[MAX_MIP_NUM][CUBE_FACE_NUM];
-        uint32_t dataSize = 0;
-        for (uint8_t face = 0; face < ktxHeader.m_numFaces; ++face)
+        if (mipIndex)
         {
-            for (uint8_t mip = 0; mip < ktxHeader.m_numMips; ++mip)
-            {
-                offsets[mip][face] = dataSize;
-                const uint32_t width  = max(UINT32_C(1), ktxHeader.m_pixelWidth  >> mip);
-                const uint32_t height = max(UINT32_C(1), ktxHeader.m_pixelHeight >> mip);
-                dataSize += width * height * bytesPerPixel;
-            }
+            write = 0;
+            write += ioWrite(&pairSize, 1, sizeof(uint32_t), _stream);
+            write += ioWrite(KTX_MIP_INDEX_KEY, 1, keySize, _stream);
+            write += ioWrite(&index, 1, sizeof(ImageMipIndex), _stream);
+            write += ioWrite(&pad, 1, ((pairSize+3)&~3) - pairSize, _stream);
+            DEBUG_CHECK(write == ktxHeader.m_bytesKeyValue, "Error writing Ktx mip index.");
+            IOERROR_CHECK(_stream);
         }
 
-        // Alloc data.
-        void* data = (void*)malloc(dataSize);
-        MALLOC_CHECK(data);
+        // Get source offsets.
+        uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        imageGetMipOffsets(offsets, _image);
 
-        // Jump header key-value data.
-        seek = fseek(_fp, ktxHeader.m_bytesKeyValue, SEEK_CUR);
-        DEBUG_CHECK(0 == seek, "File seek error.");
-        FERROR_CHECK(_fp);
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
 
-        // Read data.
-        for (uint8_t mip = 0; mip < ktxHeader.m_numMips; ++mip)
+        // Write data.
+        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
+        for (uint8_t ii = 0; ii < _image.m_numMips; ++ii)
         {
-            const uint32_t width  = max(UINT32_C(1), ktxHeader.m_pixelWidth  >> mip);
-            const uint32_t height = max(UINT32_C(1), ktxHeader.m_pixelHeight >> mip);
-            const uint32_t pitch = width * bytesPerPixel;
+            const uint8_t mip = mipLayoutMip(_layout, ii, _image.m_numMips);
+            uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
+            uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
 
-            // Read face size.
-            uint32_t faceSize;
-            read = fread(&faceSize, sizeof(uint32_t), 1, _fp);
-            DEBUG_CHECK(read == 1, "Error reading Ktx data.");
-            FERROR_CHECK(_fp);
+            // Rows of blocks for compressed formats.
+            if (0 != imageDataInfo.m_blockBytes)
+            {
+                width  = (width +3)/4;
+                height = (height+3)/4;
+            }
+
+            const uint32_t pitch = width * (0 != imageDataInfo.m_blockBytes ? imageDataInfo.m_blockBytes : imageDataInfo.m_bytesPerPixel);
+            const uint32_t faceSize = pitch * height;
+            const uint32_t mipSize = faceSize * _image.m_numFaces;
 
-            const uint32_t mipSize = faceSize * ktxHeader.m_numFaces;
             const uint32_t pitchRounding = (KTX_UNPACK_ALIGNMENT-1)-((pitch    + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
             const uint32_t faceRounding  = (KTX_UNPACK_ALIGNMENT-1)-((faceSize + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
             const uint32_t mipRounding   = (KTX_UNPACK_ALIGNMENT-1)-((mipSize  + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
 
-            if (faceSize != ((pitch + pitchRounding) * height))
-            {
-                WARN("Ktx face size invalid.");
-            }
+            // Write face size.
+            write = ioWrite(&faceSize, sizeof(uint32_t), 1, _stream);
+            DEBUG_CHECK(write == 1, "Error writing Ktx data.");
+            IOERROR_CHECK(_stream);
 
-            for (uint8_t face = 0; face < ktxHeader.m_numFaces; ++face)
+            for (uint8_t face = 0; face < _image.m_numFaces; ++face)
             {
-                uint8_t* faceData = (uint8_t*)data + offsets[mip][face];
+                const uint8_t* faceData = (const uint8_t*)_image.m_data + offsets[face][mip];
 
                 if (0 == pitchRounding)
                 {
-                    // Read entire face at once.
-                    read = fread(faceData, 1, faceSize, _fp);
-                    DEBUG_CHECK(read == faceSize, "Error reading Ktx face data.");
-                    FERROR_CHECK(_fp);
+                    // Write entire face at once.
+                    write = ioWrite(faceData, 1, faceSize, _stream);
+                    DEBUG_CHECK(write == faceSize, "Error writing Ktx face data.");
+                    IOERROR_CHECK(_stream);
                 }
                 else
                 {
-                    // Read row by row.
-                    for (uint32_t yy = 0; yy < ktxHeader.m_pixelHeight; ++yy)
+                    // Write row by row.
+                    for (uint32_t yy = 0; yy < height; ++yy)
                     {
-                        // Read row.
-                        uint8_t* dst = (uint8_t*)faceData + yy*pitch;
-                        read = fread(dst, 1, pitch, _fp);
-                        DEBUG_CHECK(read == pitch, "Error reading Ktx row data.");
-                        FERROR_CHECK(_fp);
+                        // Write row.
+                        const uint8_t* src = (const uint8_t*)faceData + yy*pitch;
+                        write = ioWrite(src, 1, pitch, _stream);
+                        DEBUG_CHECK(write == pitch, "Error writing Ktx row data.");
+                        IOERROR_CHECK(_stream);
 
-                        // Jump row rounding.
-                        int seek = fseek(_fp, pitchRounding, SEEK_CUR);
-                        BX_UNUSED(seek);
-                        DEBUG_CHECK(0 == seek, "File seek error.");
-                        FERROR_CHECK(_fp);
+                        // Write row rounding.
+                        write = ioWrite(&pad, 1, pitchRounding, _stream);
+                        DEBUG_CHECK(write == pitchRounding, "Error writing Ktx row rounding.");
+                        IOERROR_CHECK(_stream);
                     }
                 }
 
-                // Jump face rounding.
-                int seek = fseek(_fp, faceRounding, SEEK_CUR);
-                BX_UNUSED(seek);
-                DEBUG_CHECK(0 == seek, "File seek error.");
-                FERROR_CHECK(_fp);
+                // Write face rounding.
+                if (faceRounding)
+                {
+                    write = ioWrite(&pad, 1, faceRounding, _stream);
+                    DEBUG_CHECK(write == faceRounding, "Error writing Ktx face rounding.");
+                    IOERROR_CHECK(_stream);
+                }
             }
 
-            // Jump mip rounding.
-            int seek = fseek(_fp, mipRounding, SEEK_CUR);
-            BX_UNUSED(seek);
-            DEBUG_CHECK(0 == seek, "File seek error.");
-            FERROR_CHECK(_fp);
+            // Write mip rounding.
+            if (mipRounding)
+            {
+                write = ioWrite(&pad, 1, mipRounding, _stream);
+                DEBUG_CHECK(write == mipRounding, "Error writing Ktx mip rounding.");
+                IOERROR_CHECK(_stream);
+            }
         }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = ktxHeader.m_pixelWidth;
-        result.m_height = ktxHeader.m_pixelHeight;
-        result.m_dataSize = dataSize;
-        result.m_format = format;
-        result.m_numMips = uint8_t(ktxHeader.m_numMips);
-        result.m_numFaces = uint8_t(ktxHeader.m_numFaces);
-        result.m_data = data;
-
-        // Output.
-        imageMove(_image, result);
-
         return true;
     }
 
-    bool imageLoadHdr(Image& _image, FILE* _fp)
+    struct Ktx2EncodeArgs
     {
-        CMFT_UNUSED char* get;
-        CMFT_UNUSED size_t read;
-        char buf[128];
+        const uint8_t* m_src;
+        uint64_t m_srcOffsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+        uint64_t m_faceSizes[MAX_MIP_NUM];
+        uint8_t* m_levels[MAX_MIP_NUM];      //!< Compressed levels.
+        uint32_t m_levelSizes[MAX_MIP_NUM];  //!< Compressed sizes.
+        uint8_t m_numFaces;
+        volatile bool m_failed;
+    };
 
-        // Read first line.
-        get = fgets(buf, sizeof(buf), _fp);
-        DEBUG_CHECK(NULL != get, "Error reading first line of Hdr file.");
+    /// Gathers faces of each level and compresses them into a single zlib stream.
+    static void ktx2EncodeLevels(void* _args, uint32_t _begin, uint32_t _end)
+    {
+        Ktx2EncodeArgs& args = *(Ktx2EncodeArgs*)_args;
 
-        // Check magic.
-        if(0 != strncmp(buf, HDR_MAGIC_FULL, HDR_MAGIC_LEN))
+        for (uint32_t mip = _begin; mip < _end; ++mip)
         {
-            WARN("HDR magic not valid.");
-            return false;
-        }
-
-        HdrHeader hdrHeader;
-        hdrHeader.m_valid = 0;
-        hdrHeader.m_gamma = 1.0f;
-        hdrHeader.m_exposure = 1.0f;
+            const uint64_t faceSize = args.m_faceSizes[mip];
+            const uint64_t levelSize = faceSize*args.m_numFaces;
 
-        // Read header.
-        bool formatDefined = false;
-        for(uint8_t ii = 0, stop = 20; ii < stop; ++ii)
-        {
-            // Read next line.
-            get = fgets(buf, sizeof(buf), _fp);
-            DEBUG_CHECK(NULL != get, "Error reading Hdr file header.");
-            FERROR_CHECK(_fp);
+            // Deflate blocks can expand incompressible data a little.
+            const uint64_t capacity = levelSize + levelSize/8 + 1024;
+            if (capacity > UINT32_MAX)
+            {
+                args.m_failed = true;
+                continue;
+            }
 
-            if ((0 == buf[0])
-            || ('\n' == buf[0]))
+            const uint8_t* level = args.m_src + args.m_srcOffsets[0][mip];
+            uint8_t* tmp = NULL;
+            if (1 != args.m_numFaces)
             {
-                // End of header.
-                break;
+                tmp = (uint8_t*)allocScratch(levelSize, AllocTag::IoBuffer);
+                MALLOC_CHECK(tmp);
+                for (uint8_t face = 0; face < args.m_numFaces; ++face)
+                {
+                    memcpy(tmp + face*faceSize, args.m_src + args.m_srcOffsets[face][mip], size_t(faceSize));
+                }
+                level = tmp;
             }
-            else if (0 == strcmp(buf, "FORMAT=32-bit_rle_rgbe\n"))
+
+            uint8_t* dst = (uint8_t*)allocScratch(capacity, AllocTag::IoBuffer);
+            MALLOC_CHECK(dst);
+            args.m_levels[mip] = dst;
+            args.m_levelSizes[mip] = zlibCompress(dst, uint32_t(capacity), level, uint32_t(levelSize));
+            if (0 == args.m_levelSizes[mip])
             {
-                formatDefined = true;
+                args.m_failed = true;
             }
-            else if (1 == sscanf(buf, "GAMMA=%g", &hdrHeader.m_gamma))
+
+            freeScratch(tmp);
+        }
+    }
+
+    /// Writes Ktx2 with zlib supercompression of every mip, mips are compressed in parallel.
+    bool imageSaveKtx2(Writer* _stream, const Image& _image)
+    {
+        const TranslateKtx2Format* translate = NULL;
+        for (uint8_t ii = 0, end = CMFT_COUNTOF(s_translateKtx2Format); ii < end; ++ii)
+        {
+            if (s_translateKtx2Format[ii].m_textureFormat == _image.m_format)
             {
-                hdrHeader.m_valid |= HDR_VALID_GAMMA;
+                translate = &s_translateKtx2Format[ii];
+                break;
             }
-            else if (1 == sscanf(buf, "EXPOSURE=%g", &hdrHeader.m_exposure))
+        }
+        DEBUG_CHECK(NULL != translate, "Not a valid Ktx2 texture format!");
+        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
+
+        // Compress levels.
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
+
+        Ktx2EncodeArgs args;
+        args.m_src = (const uint8_t*)_image.m_data;
+        args.m_numFaces = _image.m_numFaces;
+        args.m_failed = false;
+        imageGetMipOffsets(args.m_srcOffsets, _image);
+        for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
+        {
+            const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
+            const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
+            args.m_faceSizes[mip] = mipFaceDataSize(imageDataInfo, width, height);
+            args.m_levels[mip] = NULL;
+        }
+
+        parallelFor(ktx2EncodeLevels, (void*)&args, _image.m_numMips, 1);
+
+        if (args.m_failed)
+        {
+            WARN("Ktx2 level compression failed, levels must be smaller than 4GB.");
+            for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
             {
-                hdrHeader.m_valid |= HDR_VALID_EXPOSURE;
+                freeScratch(args.m_levels[mip]);
             }
+            return false;
         }
 
-        if (!formatDefined)
+        // Data format descriptor and writer key-value.
+        uint8_t dfd[92];
+        const uint32_t dfdSize = ktx2DfdFromFormat(dfd, _image.m_format);
+
+        const char writerKeyValue[] = "KTXwriter\0cmft";
+        const uint32_t writerKeyValueSize = sizeof(writerKeyValue);
+        const uint32_t writerPadding = (4-(writerKeyValueSize&3))&3;
+        const uint8_t pad[4] = { 0, 0, 0, 0 };
+
+        // Header, level index, dfd and key-value data are followed by levels, smallest one first.
+        Ktx2Header ktx2Header;
+        ktx2Header.m_vkFormat = translate->m_vkFormat;
+        ktx2Header.m_typeSize = (0 != imageDataInfo.m_blockBytes) ? 1 : (imageDataInfo.m_bytesPerPixel/imageDataInfo.m_numChanels);
+        ktx2Header.m_pixelWidth = _image.m_width;
+        ktx2Header.m_pixelHeight = _image.m_height;
+        ktx2Header.m_pixelDepth = 0;
+        ktx2Header.m_layerCount = 0;
+        ktx2Header.m_faceCount = _image.m_numFaces;
+        ktx2Header.m_levelCount = _image.m_numMips;
+        ktx2Header.m_supercompressionScheme = KTX2_SUPERCOMPRESSION_ZLIB;
+        ktx2Header.m_dfdByteOffset = KTX2_MAGIC_LEN + KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE*_image.m_numMips;
+        ktx2Header.m_dfdByteLength = dfdSize;
+        ktx2Header.m_kvdByteOffset = ktx2Header.m_dfdByteOffset + dfdSize;
+        ktx2Header.m_kvdByteLength = sizeof(uint32_t) + writerKeyValueSize + writerPadding;
+        ktx2Header.m_sgdByteOffset = 0;
+        ktx2Header.m_sgdByteLength = 0;
+
+        Ktx2Level levels[MAX_MIP_NUM];
+        uint64_t offset = ktx2Header.m_kvdByteOffset + ktx2Header.m_kvdByteLength;
+        for (uint8_t mip = _image.m_numMips; mip-- > 0; )
+        {
+            levels[mip].m_byteOffset = offset;
+            levels[mip].m_byteLength = args.m_levelSizes[mip];
+            levels[mip].m_uncompressedByteLength = args.m_faceSizes[mip]*_image.m_numFaces;
+            offset += args.m_levelSizes[mip];
+        }
+
+        CMFT_UNUSED size_t write;
+
+        // Write magic.
+        const uint8_t magic[KTX2_MAGIC_LEN] = KTX2_MAGIC;
+        write = ioWrite(&magic, 1, KTX2_MAGIC_LEN, _stream);
+        DEBUG_CHECK(write == KTX2_MAGIC_LEN, "Error writing Ktx2 magic.");
+        IOERROR_CHECK(_stream);
+
+        // Write header.
+        write = 0;
+        write += ioWrite(&ktx2Header.m_vkFormat,               1, sizeof(ktx2Header.m_vkFormat),               _stream);
+        write += ioWrite(&ktx2Header.m_typeSize,               1, sizeof(ktx2Header.m_typeSize),               _stream);
+        write += ioWrite(&ktx2Header.m_pixelWidth,             1, sizeof(ktx2Header.m_pixelWidth),             _stream);
+        write += ioWrite(&ktx2Header.m_pixelHeight,            1, sizeof(ktx2Header.m_pixelHeight),            _stream);
+        write += ioWrite(&ktx2Header.m_pixelDepth,             1, sizeof(ktx2Header.m_pixelDepth),             _stream);
+        write += ioWrite(&ktx2Header.m_layerCount,             1, sizeof(ktx2Header.m_layerCount),             _stream);
+        write += ioWrite(&ktx2Header.m_faceCount,              1, sizeof(ktx2Header.m_faceCount),              _stream);
+        write += ioWrite(&ktx2Header.m_levelCount,             1, sizeof(ktx2Header.m_levelCount),             _stream);
+        write += ioWrite(&ktx2Header.m_supercompressionScheme, 1, sizeof(ktx2Header.m_supercompressionScheme), _stream);
+        write += ioWrite(&ktx2Header.m_dfdByteOffset,          1, sizeof(ktx2Header.m_dfdByteOffset),          _stream);
+        write += ioWrite(&ktx2Header.m_dfdByteLength,          1, sizeof(ktx2Header.m_dfdByteLength),          _stream);
+        write += ioWrite(&ktx2Header.m_kvdByteOffset,          1, sizeof(ktx2Header.m_kvdByteOffset),          _stream);
+        write += ioWrite(&ktx2Header.m_kvdByteLength,          1, sizeof(ktx2Header.m_kvdByteLength),          _stream);
+        write += ioWrite(&ktx2Header.m_sgdByteOffset,          1, sizeof(ktx2Header.m_sgdByteOffset),          _stream);
+        write += ioWrite(&ktx2Header.m_sgdByteLength,          1, sizeof(ktx2Header.m_sgdByteLength),          _stream);
+        DEBUG_CHECK(write == KTX2_HEADER_SIZE, "Error writing Ktx2 header.");
+        IOERROR_CHECK(_stream);
+
+        // Write level index.
+        for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
         {
-            WARN("Invalid Hdr header.");
+            write = 0;
+            write += ioWrite(&levels[mip].m_byteOffset,             1, sizeof(uint64_t), _stream);
+            write += ioWrite(&levels[mip].m_byteLength,             1, sizeof(uint64_t), _stream);
+            write += ioWrite(&levels[mip].m_uncompressedByteLength, 1, sizeof(uint64_t), _stream);
+            DEBUG_CHECK(write == KTX2_LEVEL_INDEX_SIZE, "Error writing Ktx2 level index.");
         }
+        IOERROR_CHECK(_stream);
 
-        // Read empty line (end of header).
-        get = fgets(buf, sizeof(buf), _fp);
-        DEBUG_CHECK(NULL != get, "Error reading end of Hdr file header.");
-        FERROR_CHECK(_fp);
+        // Write data format descriptor and key-value data.
+        write  = ioWrite(dfd, 1, dfdSize, _stream);
+        write += ioWrite(&writerKeyValueSize, 1, sizeof(uint32_t), _stream);
+        write += ioWrite(writerKeyValue, 1, writerKeyValueSize, _stream);
+        write += ioWrite(pad, 1, writerPadding, _stream);
+        DEBUG_CHECK(write == dfdSize+ktx2Header.m_kvdByteLength, "Error writing Ktx2 data format descriptor.");
+        IOERROR_CHECK(_stream);
 
-        // Read image size.
-        int32_t width;
-        int32_t height;
-        read = sscanf(buf, "-Y %d +X %d", &height, &width);
-        DEBUG_CHECK(2 == read, "Error reading Hdr image size.");
+        // Write levels.
+        for (uint8_t mip = _image.m_numMips; mip-- > 0; )
+        {
+            write = ioWrite(args.m_levels[mip], 1, args.m_levelSizes[mip], _stream);
+            DEBUG_CHECK(write == args.m_levelSizes[mip], "Error writing Ktx2 level data.");
+            IOERROR_CHECK(_stream);
 
-        // Allocate data.
-        const uint32_t dataSize = width * height * 4 /* bytesPerChannel */;
-        uint8_t* data = (uint8_t*)malloc(dataSize);
-        MALLOC_CHECK(data);
+            freeScratch(args.m_levels[mip]);
+        }
+
+        return true;
+    }
 
-        // Read first chunk.
-        unsigned char rgbe[4];
-        read = fread(rgbe, 4*sizeof(unsigned char), 1, _fp);
-        DEBUG_CHECK(read == 1, "Could not read Hdr image data.");
-        FERROR_CHECK(_fp);
+    /// Returns Ktx face size of _mip, with rows of texels or blocks padded to KTX_UNPACK_ALIGNMENT.
+    static uint32_t ktxFaceSize(const Image& _image, uint8_t _mip, uint32_t& _pitch, uint32_t& _numRows)
+    {
+        const ImageDataInfo& imageDataInfo = getImageDataInfo(_image.m_format);
 
-        uint8_t* dataPtr = (uint8_t*)data;
+        uint32_t width  = max(UINT32_C(1), _image.m_width  >> _mip);
+        uint32_t height = max(UINT32_C(1), _image.m_height >> _mip);
 
-        if ((width < 8)
-        || (width > 0x7fff)
-        || (rgbe[0] != 2)
-        || (rgbe[1] != 2)
-        || (rgbe[2] & 0x80))
+        // Rows of blocks for compressed formats.
+        if (0 != imageDataInfo.m_blockBytes)
         {
-            // File not RLE.
+            width  = (width +3)/4;
+            height = (height+3)/4;
+        }
+
+        _pitch = width * (0 != imageDataInfo.m_blockBytes ? imageDataInfo.m_blockBytes : imageDataInfo.m_bytesPerPixel);
+        _numRows = height;
 
-            // Save already read pixel.
-            dataPtr[0] = rgbe[0];
-            dataPtr[1] = rgbe[1];
-            dataPtr[2] = rgbe[2];
-            dataPtr[3] = rgbe[3];
-            dataPtr += 4;
+        const uint32_t pitchRounding = (KTX_UNPACK_ALIGNMENT-1)-((_pitch + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+        return (_pitch + pitchRounding) * height;
+    }
 
-            // Read rest of the file.
-            const uint32_t remaningDataSize = dataSize - 4;
-            read = fread(dataPtr, remaningDataSize, 1, _fp);
-            DEBUG_CHECK(read == 1, "Error reading Hdr image data.");
-            FERROR_CHECK(_fp);
+    bool imageArrayWriterOpen(ImageArrayWriter& _writer, const char* _fileName, ImageFileType::Enum _ft, uint32_t _numElements)
+    {
+        if (ImageFileType::DDS != _ft
+        &&  ImageFileType::KTX != _ft)
+        {
+            WARN("Arrays can only be written to Dds or Ktx files.");
+            return false;
         }
-        else
+
+        if (0 == _numElements)
+        {
+            WARN("Array must have at least one element.");
+            return false;
+        }
+
+        uint8_t* written = (uint8_t*)getAllocator()->alloc(_numElements);
+        MALLOC_CHECK(written);
+        if (NULL == written)
+        {
+            return false;
+        }
+        memset(written, 0, _numElements);
+
+        FILE* fp = fopen(_fileName, "wb");
+        if (NULL == fp)
         {
-            // File is RLE.
+            WARN("Could not open file %s for writing.", _fileName);
+            getAllocator()->free(written);
+            return false;
+        }
+
+        _writer.m_fp = fp;
+        _writer.m_fileType = _ft;
+        _writer.m_numElements = _numElements;
+        _writer.m_numWritten = 0;
+        _writer.m_written = written;
+        _writer.m_layout = Image();
+        _writer.m_dataOffset = 0;
+        _writer.m_dataEnd = 0;
+
+        return true;
+    }
+
+    /// Writes header for the layout of _image and computes data offsets.
+    static bool imageArrayWriterBegin(ImageArrayWriter& _writer, const Image& _image)
+    {
+        CMFT_UNUSED size_t write;
 
-            uint8_t* scanlineBuffer = (uint8_t*)alloca(width*4);
-            MALLOC_CHECK(scanlineBuffer);
-            uint8_t* ptr;
-            const uint8_t* ptrEnd;
-            uint32_t numScanlines = height-1;
-            int32_t count;
-            for (;;)
+        if (ImageFileType::DDS == _writer.m_fileType)
+        {
+            if (_writer.m_numElements > 1
+            &&  DXGI_FORMAT_UNKNOWN == getDdsDxgiFormat(_image.m_format))
             {
-                DEBUG_CHECK(((uint16_t(rgbe[2])<<8)|(rgbe[3]&0xff)) == width, "Hdr file scanline width is invalid.");
+                WARN("%s images can not be written to Dds arrays.", getTextureFormatStr(_image.m_format));
+                return false;
+            }
 
-                ptr = scanlineBuffer;
-                for (uint8_t ii = 0; ii < 4; ++ii)
-                {
-                    ptrEnd = (const uint8_t*)scanlineBuffer + width*(ii+1);
-                    while (ptr < ptrEnd)
-                    {
-                        unsigned char rle[2];
-                        read = fread(rle, sizeof(rle), 1, _fp);
-                        DEBUG_CHECK(read == 1, "Error reading Hdr image data.");
-                        FERROR_CHECK(_fp);
+            DdsHeader ddsHeader;
+            DdsHeaderDxt10 ddsHeaderDxt10;
+            ddsHeaderFromImage(ddsHeader, &ddsHeaderDxt10, _image, _writer.m_numElements);
+            FileWriter stream(_writer.m_fp);
+            ddsWriteHeader(&stream, ddsHeader, ddsHeaderDxt10);
 
-                        if (rle[0] > 128)
-                        {
-                            // RLE chunk.
-                            count = rle[0] - 128;
-                            DEBUG_CHECK((count != 0) && (count <= (ptrEnd - ptr)), "Bad scanline data!");
-                            while (count-- > 0)
-                            {
-                                *ptr++ = rle[1];
-                            }
-                        }
-                        else
-                        {
-                            // Normal chunk.
-                            count = rle[0];
-                            DEBUG_CHECK((count != 0) && (count <= (ptrEnd - ptr)), "Bad scanline data!");
-                            *ptr++ = rle[1];
-                            if (--count > 0)
-                            {
-                                read = fread(ptr, 1, count, _fp);
-                                DEBUG_CHECK(int32_t(read) == count, "Error reading Hdr image data.");
-                                FERROR_CHECK(_fp);
-                                ptr += count;
-                            }
-                        }
-                    }
-                }
+            _writer.m_dataOffset = fileTell(_writer.m_fp);
+            _writer.m_dataEnd = _writer.m_dataOffset + int64_t(_image.m_dataSize)*_writer.m_numElements;
+        }
+        else
+        {
+            KtxHeader ktxHeader;
+            ktxHeaderFromImage(ktxHeader, _image, _writer.m_numElements);
+            FileWriter stream(_writer.m_fp);
+            ktxWriteHeader(&stream, ktxHeader);
 
-                // Copy scanline data.
-                for (int32_t ii = 0; ii < width; ++ii)
-                {
-                    dataPtr[0] = scanlineBuffer[ii+(0*width)];
-                    dataPtr[1] = scanlineBuffer[ii+(1*width)];
-                    dataPtr[2] = scanlineBuffer[ii+(2*width)];
-                    dataPtr[3] = scanlineBuffer[ii+(3*width)];
-                    dataPtr += 4;
-                }
+            _writer.m_dataOffset = fileTell(_writer.m_fp);
 
-                // Break if reached the end.
-                if (0 == numScanlines--)
+            // Image size of each mip covers all faces of all elements.
+            int64_t offset = _writer.m_dataOffset;
+            for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
+            {
+                uint32_t pitch, numRows;
+                const uint64_t imageSize = uint64_t(ktxFaceSize(_image, mip, pitch, numRows)) * _image.m_numFaces * _writer.m_numElements;
+                if (imageSize > UINT32_MAX)
                 {
-                    break;
+                    WARN("Ktx array mip size exceeds 4GB.");
+                    return false;
                 }
 
-                // Read next scanline.
-                read = fread(rgbe, sizeof(rgbe), 1, _fp);
-                DEBUG_CHECK(read == 1, "Could not read Hdr image data.");
-                FERROR_CHECK(_fp);
+                const uint32_t imageSize32 = uint32_t(imageSize);
+                fileSeek(_writer.m_fp, offset, SEEK_SET);
+                write = fwrite(&imageSize32, sizeof(uint32_t), 1, _writer.m_fp);
+                DEBUG_CHECK(write == 1, "Error writing Ktx data.");
+                FERROR_CHECK(_writer.m_fp);
+
+                offset += sizeof(uint32_t) + imageSize;
             }
+            _writer.m_dataEnd = offset;
         }
 
-        // Fill image structure.
-        Image result;
-        result.m_width = uint32_t(width);
-        result.m_height = uint32_t(height);
-        result.m_dataSize = dataSize;
-        result.m_format = TextureFormat::RGBE;
-        result.m_numMips = 1;
-        result.m_numFaces = 1;
-        result.m_data = (void*)data;
-
-        // Output.
-        imageMove(_image, result);
+        _writer.m_layout.m_width    = _image.m_width;
+        _writer.m_layout.m_height   = _image.m_height;
+        _writer.m_layout.m_dataSize = _image.m_dataSize;
+        _writer.m_layout.m_format   = _image.m_format;
+        _writer.m_layout.m_numMips  = _image.m_numMips;
+        _writer.m_layout.m_numFaces = _image.m_numFaces;
 
         return true;
     }
 
-    bool imageLoadTga(Image& _image, FILE* _fp)
+    bool imageArrayWriterWrite(ImageArrayWriter& _writer, uint32_t _element, const Image& _image)
     {
-        CMFT_UNUSED size_t read;
-        CMFT_UNUSED int seek;
-
-        // Load header.
-        TgaHeader tgaHeader;
-        read = 0;
-        read += fread(&tgaHeader.m_idLength,        1, sizeof(tgaHeader.m_idLength),        _fp);
-        read += fread(&tgaHeader.m_colorMapType,    1, sizeof(tgaHeader.m_colorMapType),    _fp);
-        read += fread(&tgaHeader.m_imageType,       1, sizeof(tgaHeader.m_imageType),       _fp);
-        read += fread(&tgaHeader.m_colorMapOrigin,  1, sizeof(tgaHeader.m_colorMapOrigin),  _fp);
-        read += fread(&tgaHeader.m_colorMapLength,  1, sizeof(tgaHeader.m_colorMapLength),  _fp);
-        read += fread(&tgaHeader.m_colorMapDepth,   1, sizeof(tgaHeader.m_colorMapDepth),   _fp);
-        read += fread(&tgaHeader.m_xOrigin,         1, sizeof(tgaHeader.m_xOrigin),         _fp);
-        read += fread(&tgaHeader.m_yOrigin,         1, sizeof(tgaHeader.m_yOrigin),         _fp);
-        read += fread(&tgaHeader.m_width,           1, sizeof(tgaHeader.m_width),           _fp);
-        read += fread(&tgaHeader.m_height,          1, sizeof(tgaHeader.m_height),          _fp);
-        read += fread(&tgaHeader.m_bitsPerPixel,    1, sizeof(tgaHeader.m_bitsPerPixel),    _fp);
-        read += fread(&tgaHeader.m_imageDescriptor, 1, sizeof(tgaHeader.m_imageDescriptor), _fp);
-        DEBUG_CHECK(read == TGA_HEADER_SIZE, "Error reading file header.");
-        FERROR_CHECK(_fp);
+        CMFT_PROFILE_ZONE("imageArrayWriterWrite");
+        AllocTagScope allocTag(AllocTag::IoBuffer, true);
 
-        // Check header.
-        if(0 == (TGA_IT_RGB & tgaHeader.m_imageType))
+        CMFT_UNUSED size_t write;
+
+        if (NULL == _writer.m_fp)
         {
-            WARN("Tga file is not true-color image.");
+            WARN("Array writer is not open.");
             return false;
         }
 
-        // Get format.
-        TextureFormat::Enum format;
-        if (24 == tgaHeader.m_bitsPerPixel)
+        if (_element >= _writer.m_numElements)
         {
-            format = TextureFormat::BGR8;
-            DEBUG_CHECK(0x0 == (tgaHeader.m_imageDescriptor&0xf), "Alpha channel not properly defined.");
+            WARN("Array element %u out of range, array has %u.", _element, _writer.m_numElements);
+            return false;
         }
-        else if (32 == tgaHeader.m_bitsPerPixel)
+
+        if (_writer.m_written[_element])
         {
-            format = TextureFormat::BGRA8;
-            DEBUG_CHECK(0x8 == (tgaHeader.m_imageDescriptor&0xf), "Alpha channel not properly defined.");
+            WARN("Array element %u is already written.", _element);
+            return false;
         }
-        else
+
+        if (!checkValidInternalFormat(_writer.m_fileType, _image.m_format))
         {
-            WARN("Non-supported Tga pixel depth - %u.", tgaHeader.m_bitsPerPixel);
+            WARN("%s images can not be written to %s files.", getTextureFormatStr(_image.m_format), getFileTypeStr(_writer.m_fileType));
             return false;
         }
 
-        // Alloc data.
-        const uint32_t numBytesPerPixel = tgaHeader.m_bitsPerPixel/8;
-        const uint32_t numPixels = tgaHeader.m_width * tgaHeader.m_height;
-        const uint32_t dataSize = numPixels * numBytesPerPixel;
-        uint8_t* data = (uint8_t*)malloc(dataSize);
-        MALLOC_CHECK(data);
-
-        // Skip to data.
-        const uint32_t skip = tgaHeader.m_idLength + (tgaHeader.m_colorMapType&0x1)*tgaHeader.m_colorMapLength;
-        seek = fseek(_fp, skip, SEEK_CUR);
-        DEBUG_CHECK(0 == seek, "File seek error.");
-        FERROR_CHECK(_fp);
+        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
 
-        // Load data.
-        const bool bCompressed = (0 != (tgaHeader.m_imageType&TGA_IT_RLE));
-        if (bCompressed)
+        if (0 == _writer.m_numWritten)
         {
-            uint8_t buf[5];
-            uint32_t n = 0;
-            uint8_t* dataPtr = data;
-            while (n < numPixels)
+            if (!imageArrayWriterBegin(_writer, _image))
             {
-                read = fread(buf, numBytesPerPixel+1, 1, _fp);
-                DEBUG_CHECK(read == 1, "Could not read from file.");
-                FERROR_CHECK(_fp);
+                return false;
+            }
+        }
+        else if (_image.m_width    != _writer.m_layout.m_width
+             ||  _image.m_height   != _writer.m_layout.m_height
+             ||  _image.m_format   != _writer.m_layout.m_format
+             ||  _image.m_numMips  != _writer.m_layout.m_numMips
+             ||  _image.m_numFaces != _writer.m_layout.m_numFaces)
+        {
+            WARN("Array element %u does not match the layout of the first written element.", _element);
+            return false;
+        }
+
+        if (ImageFileType::DDS == _writer.m_fileType)
+        {
+            // Elements follow each other, each with Image data layout.
+            fileSeek(_writer.m_fp, _writer.m_dataOffset + int64_t(_element)*int64_t(_image.m_dataSize), SEEK_SET);
+            write = fwrite(_image.m_data, 1, _image.m_dataSize, _writer.m_fp);
+            DEBUG_CHECK(write == _image.m_dataSize, "Error writing Dds image data.");
+            FERROR_CHECK(_writer.m_fp);
+        }
+        else
+        {
+            uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+            imageGetMipOffsets(offsets, _image);
 
-                const uint8_t count = buf[0] & 0x7f;
+            const uint8_t pad[4] = { 0, 0, 0, 0 };
 
-                memcpy(dataPtr, &buf[1], numBytesPerPixel);
-                dataPtr += numBytesPerPixel;
-                n++;
+            // Each mip holds faces of all elements, element by element.
+            int64_t mipOffset = _writer.m_dataOffset;
+            for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
+            {
+                uint32_t pitch, numRows;
+                const uint32_t faceSize = ktxFaceSize(_image, mip, pitch, numRows);
+                const uint32_t pitchRounding = faceSize/numRows - pitch;
 
-                if (buf[0] & 0x80)
+                for (uint8_t face = 0; face < _image.m_numFaces; ++face)
                 {
-                    // RLE chunk.
-                    for (uint8_t ii = 0; ii < count; ++ii)
+                    const int64_t faceOffset = mipOffset + int64_t(sizeof(uint32_t))
+                                             + (int64_t(_element)*_image.m_numFaces + face)*faceSize;
+                    fileSeek(_writer.m_fp, faceOffset, SEEK_SET);
+
+                    const uint8_t* faceData = (const uint8_t*)_image.m_data + offsets[face][mip];
+                    if (0 == pitchRounding)
                     {
-                        memcpy(dataPtr, &buf[1], numBytesPerPixel);
-                        dataPtr += numBytesPerPixel;
-                        n++;
+                        write = fwrite(faceData, 1, faceSize, _writer.m_fp);
+                        DEBUG_CHECK(write == faceSize, "Error writing Ktx face data.");
+                        FERROR_CHECK(_writer.m_fp);
                     }
-                }
-                else
-                {
-                    // Normal chunk.
-                    for (uint8_t ii = 0; ii < count; ++ii)
+                    else
                     {
-                        read = fread(buf, numBytesPerPixel, 1, _fp);
-                        DEBUG_CHECK(read == 1, "Could not read from file.");
-                        FERROR_CHECK(_fp);
-
-                        memcpy(dataPtr, buf, numBytesPerPixel);
-                        dataPtr += numBytesPerPixel;
-                        n++;
+                        for (uint32_t yy = 0; yy < numRows; ++yy)
+                        {
+                            write  = fwrite(faceData + uint64_t(yy)*pitch, 1, pitch, _writer.m_fp);
+                            write += fwrite(&pad, 1, pitchRounding, _writer.m_fp);
+                            DEBUG_CHECK(write == pitch+pitchRounding, "Error writing Ktx row data.");
+                            FERROR_CHECK(_writer.m_fp);
+                        }
                     }
                 }
-            }
-        }
-        else
-        {
-            read = fread(data, dataSize, 1, _fp);
-            DEBUG_CHECK(read == 1, "Could not read from file.");
-            FERROR_CHECK(_fp);
-        }
-
-        // Fill image structure.
-        Image result;
-        result.m_width = tgaHeader.m_width;
-        result.m_height = tgaHeader.m_height;
-        result.m_dataSize = dataSize;
-        result.m_format = format;
-        result.m_numMips = 1;
-        result.m_numFaces = 1;
-        result.m_data = data;
 
-        // Flip if necessary.
-        const uint32_t flip = 0
-                            | (tgaHeader.m_imageDescriptor & TGA_DESC_HORIZONTAL ? IMAGE_OP_FLIP_Y : 0)
-                            | (tgaHeader.m_imageDescriptor & TGA_DESC_VERTICAL   ? 0 : IMAGE_OP_FLIP_X)
-                            ;
-        if (flip)
-        {
-            imageTransform(result, flip);
+                mipOffset += int64_t(sizeof(uint32_t)) + int64_t(faceSize)*_image.m_numFaces*_writer.m_numElements;
+            }
         }
 
-        // Output.
-        imageMove(_image, result);
+        _writer.m_written[_element] = 1;
+        _writer.m_numWritten++;
 
         return true;
     }
 
-    static bool isTga(uint32_t _magic)
+    bool imageArrayWriterClose(ImageArrayWriter& _writer)
     {
-        //byte 2 is imageType and must be: 1, 2, 3, 9, 10 or 11
-        //byte 1 is colorMapType and must be 1 if imageType is 1 or 9, 0 otherwise
-        const uint8_t colorMapType = uint8_t((_magic>> 8)&0xff);
-        const uint8_t imageType    = uint8_t((_magic>>16)&0xff);
-        switch(imageType)
+        if (NULL == _writer.m_fp)
         {
-        case 1:
-        case 9:
-            return (1 == colorMapType);
+            return false;
+        }
 
-        case 2:
-        case 3:
-        case 10:
-        case 11:
-            return (0 == colorMapType);
-        };
+        const bool complete = (_writer.m_numWritten == _writer.m_numElements);
+        if (!complete)
+        {
+            WARN("%u of %u array elements were not written.", _writer.m_numElements-_writer.m_numWritten, _writer.m_numElements);
 
-        return false;
+            // Extend the file over trailing elements that were never written, they read as zeroes.
+            fileSeek(_writer.m_fp, 0, SEEK_END);
+            if (0 != _writer.m_numWritten
+            &&  fileTell(_writer.m_fp) < _writer.m_dataEnd)
+            {
+                const uint8_t zero = 0;
+                fileSeek(_writer.m_fp, _writer.m_dataEnd-1, SEEK_SET);
+                CMFT_UNUSED const size_t write = fwrite(&zero, 1, 1, _writer.m_fp);
+                FERROR_CHECK(_writer.m_fp);
+            }
+        }
+
+        fclose(_writer.m_fp);
+        getAllocator()->free(_writer.m_written);
+
+        _writer.m_fp = NULL;
+        _writer.m_written = NULL;
+        _writer.m_numElements = 0;
+        _writer.m_numWritten = 0;
+
+        return complete;
     }
 
-    bool imageLoad(Image& _image, const char* _filePath, TextureFormat::Enum _convertTo)
+    bool imageMappedWriterOpen(ImageMappedWriter& _writer
+                             , const char* _fileName
+                             , ImageFileType::Enum _ft
+                             , TextureFormat::Enum _format
+                             , uint32_t _width
+                             , uint32_t _height
+                             , uint8_t _numMips
+                             , uint8_t _numFaces
+                             , const ImageEncodeSettings* _settings
+                             )
     {
-        CMFT_UNUSED size_t read;
-        CMFT_UNUSED int seek;
+        CMFT_UNUSED size_t write;
 
-        // Open file.
-        FILE* fp = fopen(_filePath, "rb");
-        if (NULL == fp)
+        if (ImageFileType::DDS != _ft
+        &&  ImageFileType::KTX != _ft)
         {
-            WARN("Could not open file %s for reading.", _filePath);
+            WARN("Mapped output can only be written to Dds or Ktx files.");
             return false;
         }
-        ScopeFclose cleanup(fp);
-
-        // Read magic.
-        uint32_t magic;
-        read = fread(&magic, sizeof(uint32_t), 1, fp);
-        DEBUG_CHECK(read == 1, "Could not read from file.");
-        FERROR_CHECK(fp);
-
-        // Seek to beginning.
-        seek = fseek(fp, 0L, SEEK_SET);
-        DEBUG_CHECK(0 == seek, "File seek error.");
-        FERROR_CHECK(fp);
 
-        // Load image.
-        bool loaded = false;
-        if (DDS_MAGIC == magic)
+        if (!checkValidInternalFormat(_ft, _format))
         {
-            loaded = imageLoadDds(_image, fp);
+            WARN("%s images can not be written to %s files.", getTextureFormatStr(_format), getFileTypeStr(_ft));
+            return false;
         }
-        else if (HDR_MAGIC == magic)
+
+        if (0 == _width
+        ||  0 == _height
+        ||  0 == _numMips
+        ||  MAX_MIP_NUM < _numMips
+        ||  (1 != _numFaces && CUBE_FACE_NUM != _numFaces))
         {
-            loaded = imageLoadHdr(_image, fp);
+            WARN("Invalid layout of mapped output %s.", _fileName);
+            return false;
         }
-        else if (KTX_MAGIC_SHORT == magic)
+
+        Image layout;
+        layout.m_width    = _width;
+        layout.m_height   = _height;
+        layout.m_format   = _format;
+        layout.m_numMips  = _numMips;
+        layout.m_numFaces = _numFaces;
+
+        ImageLayout tightLayout;
+        imageGetLayout(tightLayout, layout);
+        layout.m_dataSize = tightLayout.m_dataSize;
+
+        FILE* fp = fopen(_fileName, "w+b");
+        if (NULL == fp)
         {
-            loaded = imageLoadKtx(_image, fp);
+            WARN("Could not open file %s for writing.", _fileName);
+            return false;
         }
-        else if (isTga(magic))
+
+        _writer.m_fp = fp;
+        _writer.m_data = NULL;
+        _writer.m_fileType = _ft;
+        _writer.m_layout = layout;
+        _writer.m_settings = encodeSettings(_settings);
+        _writer.m_failed = false;
+        memset(_writer.m_written, 0, sizeof(_writer.m_written));
+
+        FileWriter stream(fp);
+        if (ImageFileType::DDS == _ft)
         {
-            loaded = imageLoadTga(_image, fp);
+            DdsHeader ddsHeader;
+            DdsHeaderDxt10 ddsHeaderDxt10;
+            ddsHeaderFromImage(ddsHeader, &ddsHeaderDxt10, layout);
+            ddsWriteHeader(&stream, ddsHeader, ddsHeaderDxt10);
+
+            // Same layout as image data.
+            const int64_t dataOffset = fileTell(fp);
+            _writer.m_faceLayout = tightLayout;
+            for (uint8_t face = 0; face < _numFaces; ++face)
+            {
+                for (uint8_t mip = 0; mip < _numMips; ++mip)
+                {
+                    _writer.m_faceOffsets[face][mip] = uint64_t(dataOffset) + tightLayout.m_offsets[face][mip];
+                }
+            }
+            _writer.m_fileSize = uint64_t(dataOffset) + tightLayout.m_dataSize;
         }
         else
         {
-            WARN("Could not load %s. Unknown file type.", _filePath);
-            return false;
+            KtxHeader ktxHeader;
+            ktxHeaderFromImage(ktxHeader, layout);
+            ktxWriteHeader(&stream, ktxHeader);
+
+            // Padded faces are multiples of KTX_UNPACK_ALIGNMENT, there is no face or mip rounding.
+            imageGetLayout(_writer.m_faceLayout, layout, KTX_UNPACK_ALIGNMENT);
+
+            uint64_t offset = uint64_t(fileTell(fp));
+            for (uint8_t mip = 0; mip < _numMips; ++mip)
+            {
+                const uint64_t faceSize = _writer.m_faceLayout.m_pitch[mip]*_writer.m_faceLayout.m_numRows[mip];
+                if (faceSize > UINT32_MAX)
+                {
+                    WARN("Ktx face size exceeds 4GB.");
+                    _writer.m_failed = true;
+                    break;
+                }
+
+                const uint32_t faceSize32 = uint32_t(faceSize);
+                write = fwrite(&faceSize32, sizeof(uint32_t), 1, fp);
+                DEBUG_CHECK(write == 1, "Error writing Ktx data.");
+                FERROR_CHECK(fp);
+
+                for (uint8_t face = 0; face < _numFaces; ++face)
+                {
+                    _writer.m_faceOffsets[face][mip] = offset + sizeof(uint32_t) + face*faceSize;
+                }
+
+                offset += sizeof(uint32_t) + faceSize*_numFaces;
+                fileSeek(fp, int64_t(offset), SEEK_SET);
+            }
+            _writer.m_fileSize = offset;
         }
 
-        if (!loaded)
+        // Extend the file to its final size, faces read as zeroes until they are written.
+        const uint8_t zero = 0;
+        fileSeek(fp, int64_t(_writer.m_fileSize)-1, SEEK_SET);
+        write = fwrite(&zero, 1, 1, fp);
+        fflush(fp);
+
+        if (_writer.m_failed
+        ||  1 != write
+        ||  0 != ferror(fp))
         {
+            WARN("Could not create mapped output %s of %.1f MB.", _fileName, double(_writer.m_fileSize)/(1024.0*1024.0));
+            fclose(fp);
+            _writer.m_fp = NULL;
+            remove(_fileName);
             return false;
         }
 
-        // Convert if necessary.
-        if (TextureFormat::Unknown != _convertTo
-        &&  _image.m_format != _convertTo)
+#if CMFT_IMAGE_MMAP
+        // Shared mapping, faces go to the page cache and are written back by the system. Faces are written with seeks otherwise.
+        void* ptr = mmap(NULL, size_t(_writer.m_fileSize), PROT_READ|PROT_WRITE, MAP_SHARED, fileno(fp), 0);
+        if (MAP_FAILED != ptr)
         {
-            imageConvert(_image, _convertTo);
+            _writer.m_data = (uint8_t*)ptr;
         }
+#endif // CMFT_IMAGE_MMAP
 
         return true;
     }
 
-    // Image saving.
-    //-----
-
-    bool imageSaveDds(const char* _fileName, const Image& _image)
+    bool imageMappedWriterFace(ImageMappedWriter& _writer, uint8_t _mip, uint8_t _face, const Image& _image)
     {
-        CMFT_UNUSED size_t write;
+        CMFT_PROFILE_ZONE("imageMappedWriterFace");
+        AllocTagScope allocTag(AllocTag::IoBuffer, true);
 
-        DdsHeader ddsHeader;
-        DdsHeaderDxt10 ddsHeaderDxt10;
-        ddsHeaderFromImage(ddsHeader, &ddsHeaderDxt10, _image);
+        const Image& layout = _writer.m_layout;
 
-        // Open file.
-        FILE* fp = fopen(_fileName, "wb");
-        if (NULL == fp)
+        if (NULL == _writer.m_fp)
         {
-            WARN("Could not open file %s for writing.", _fileName);
+            WARN("Mapped writer is not open.");
             return false;
         }
-        ScopeFclose cleanup(fp);
 
-        // Write magic.
-        const uint32_t magic = DDS_MAGIC;
-        write = fwrite(&magic, 1, 4, fp);
-        DEBUG_CHECK(write == sizeof(magic), "Error writing Dds magic.");
-        FERROR_CHECK(fp);
+        if (_mip >= layout.m_numMips
+        ||  _face >= layout.m_numFaces)
+        {
+            WARN("Face %u of mip %u out of range, file has %u faces and %u mips.", _face, _mip, layout.m_numFaces, layout.m_numMips);
+            return false;
+        }
 
-        // Write header.
-        write = 0;
-        write += fwrite(&ddsHeader.m_size,                      1, sizeof(ddsHeader.m_size),                      fp);
-        write += fwrite(&ddsHeader.m_flags,                     1, sizeof(ddsHeader.m_flags),                     fp);
-        write += fwrite(&ddsHeader.m_height,                    1, sizeof(ddsHeader.m_height),                    fp);
-        write += fwrite(&ddsHeader.m_width,                     1, sizeof(ddsHeader.m_width),                     fp);
-        write += fwrite(&ddsHeader.m_pitchOrLinearSize,         1, sizeof(ddsHeader.m_pitchOrLinearSize),         fp);
-        write += fwrite(&ddsHeader.m_depth,                     1, sizeof(ddsHeader.m_depth),                     fp);
-        write += fwrite(&ddsHeader.m_mipMapCount,               1, sizeof(ddsHeader.m_mipMapCount),               fp);
-        write += fwrite(&ddsHeader.m_reserved1,                 1, sizeof(ddsHeader.m_reserved1),                 fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_size,        1, sizeof(ddsHeader.m_pixelFormat.m_size),        fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_flags,       1, sizeof(ddsHeader.m_pixelFormat.m_flags),       fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_fourcc,      1, sizeof(ddsHeader.m_pixelFormat.m_fourcc),      fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_rgbBitCount, 1, sizeof(ddsHeader.m_pixelFormat.m_rgbBitCount), fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_rBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_rBitMask),    fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_gBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_gBitMask),    fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_bBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_bBitMask),    fp);
-        write += fwrite(&ddsHeader.m_pixelFormat.m_aBitMask,    1, sizeof(ddsHeader.m_pixelFormat.m_aBitMask),    fp);
-        write += fwrite(&ddsHeader.m_caps,                      1, sizeof(ddsHeader.m_caps),                      fp);
-        write += fwrite(&ddsHeader.m_caps2,                     1, sizeof(ddsHeader.m_caps2),                     fp);
-        write += fwrite(&ddsHeader.m_caps3,                     1, sizeof(ddsHeader.m_caps3),                     fp);
-        write += fwrite(&ddsHeader.m_caps4,                     1, sizeof(ddsHeader.m_caps4),                     fp);
-        write += fwrite(&ddsHeader.m_reserved2,                 1, sizeof(ddsHeader.m_reserved2),                 fp);
-        DEBUG_CHECK(write == DDS_HEADER_SIZE, "Error writing Dds file header.");
-        FERROR_CHECK(fp);
+        if (_writer.m_written[_face][_mip])
+        {
+            WARN("Face %u of mip %u is already written.", _face, _mip);
+            return false;
+        }
 
-        if (DDS_DX10 == ddsHeader.m_pixelFormat.m_fourcc)
+        if (_image.m_width  != max(UINT32_C(1), layout.m_width  >> _mip)
+        ||  _image.m_height != max(UINT32_C(1), layout.m_height >> _mip)
+        ||  1 != _image.m_numMips
+        ||  1 != _image.m_numFaces)
         {
-            write = 0;
-            write += fwrite(&ddsHeaderDxt10.m_dxgiFormat,        1, sizeof(ddsHeaderDxt10.m_dxgiFormat),        fp);
-            write += fwrite(&ddsHeaderDxt10.m_resourceDimension, 1, sizeof(ddsHeaderDxt10.m_resourceDimension), fp);
-            write += fwrite(&ddsHeaderDxt10.m_miscFlags,         1, sizeof(ddsHeaderDxt10.m_miscFlags),         fp);
-            write += fwrite(&ddsHeaderDxt10.m_arraySize,         1, sizeof(ddsHeaderDxt10.m_arraySize),         fp);
-            write += fwrite(&ddsHeaderDxt10.m_miscFlags2,        1, sizeof(ddsHeaderDxt10.m_miscFlags2),        fp);
-            DEBUG_CHECK(write == DDS_DX10_HEADER_SIZE, "Error writing Dds dx10 file header.");
-            FERROR_CHECK(fp);
+            WARN("Face %u of mip %u has to be a single %ux%u face.", _face, _mip, max(UINT32_C(1), layout.m_width >> _mip), max(UINT32_C(1), layout.m_height >> _mip));
+            return false;
         }
 
-        // Write data.
-        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
-        write = fwrite(_image.m_data, 1, _image.m_dataSize, fp);
-        DEBUG_CHECK(write == _image.m_dataSize, "Error writing Dds image data.");
-        FERROR_CHECK(fp);
+        // Only the face is converted, memory use stays at a face in the file format.
+        Image converted;
+        const Image* face = &_image;
+        if (_image.m_format != layout.m_format)
+        {
+            imageConvert(converted, layout.m_format, _image, &_writer.m_settings);
+            if (NULL == converted.m_data)
+            {
+                _writer.m_failed = true;
+                return false;
+            }
+            face = &converted;
+        }
 
-        return true;
-    }
+        ImageLayout faceLayout;
+        imageGetLayout(faceLayout, *face);
 
-    bool imageSaveKtx(const char* _fileName, const Image& _image)
-    {
-        KtxHeader ktxHeader;
-        ktxHeaderFromImage(ktxHeader, _image);
+        const uint8_t* src = (const uint8_t*)face->m_data;
+        const uint64_t srcPitch = faceLayout.m_pitch[0];
+        const uint64_t dstPitch = _writer.m_faceLayout.m_pitch[_mip];
+        const uint32_t numRows = faceLayout.m_numRows[0];
+        const uint64_t offset = _writer.m_faceOffsets[_face][_mip];
 
-        // Open file.
-        FILE* fp = fopen(_fileName, "wb");
-        if (NULL == fp)
+        bool written = true;
+        if (NULL != _writer.m_data)
         {
-            WARN("Could not open file %s for writing.", _fileName);
+            // Row padding of the file is zero already.
+            uint8_t* dst = _writer.m_data + offset;
+            for (uint32_t yy = 0; yy < numRows; ++yy)
+            {
+                memcpy(dst + yy*dstPitch, src + yy*srcPitch, size_t(srcPitch));
+            }
+        }
+        else if (srcPitch == dstPitch)
+        {
+            fileSeek(_writer.m_fp, int64_t(offset), SEEK_SET);
+            written = (1 == fwrite(src, size_t(srcPitch*numRows), 1, _writer.m_fp));
+        }
+        else
+        {
+            for (uint32_t yy = 0; yy < numRows && written; ++yy)
+            {
+                fileSeek(_writer.m_fp, int64_t(offset + yy*dstPitch), SEEK_SET);
+                written = (1 == fwrite(src + yy*srcPitch, size_t(srcPitch), 1, _writer.m_fp));
+            }
+        }
+
+        imageUnload(converted);
+
+        if (!written)
+        {
+            WARN("Error writing face %u of mip %u.", _face, _mip);
+            _writer.m_failed = true;
             return false;
         }
-        ScopeFclose cleanup(fp);
 
-        CMFT_UNUSED size_t write;
+        _writer.m_written[_face][_mip] = 1;
 
-        // Write magic.
-        const uint8_t magic[KTX_MAGIC_LEN+1] = KTX_MAGIC;
-        write = fwrite(&magic, 1, KTX_MAGIC_LEN, fp);
-        DEBUG_CHECK(write == KTX_MAGIC_LEN, "Error writing Ktx magic.");
-        FERROR_CHECK(fp);
+        return true;
+    }
 
-        // Write header.
-        write = 0;
-        write += fwrite(&ktxHeader.m_endianness,           1, sizeof(ktxHeader.m_endianness),           fp);
-        write += fwrite(&ktxHeader.m_glType,               1, sizeof(ktxHeader.m_glType),               fp);
-        write += fwrite(&ktxHeader.m_glTypeSize,           1, sizeof(ktxHeader.m_glTypeSize),           fp);
-        write += fwrite(&ktxHeader.m_glFormat,             1, sizeof(ktxHeader.m_glFormat),             fp);
-        write += fwrite(&ktxHeader.m_glInternalFormat,     1, sizeof(ktxHeader.m_glInternalFormat),     fp);
-        write += fwrite(&ktxHeader.m_glBaseInternalFormat, 1, sizeof(ktxHeader.m_glBaseInternalFormat), fp);
-        write += fwrite(&ktxHeader.m_pixelWidth,           1, sizeof(ktxHeader.m_pixelWidth),           fp);
-        write += fwrite(&ktxHeader.m_pixelHeight,          1, sizeof(ktxHeader.m_pixelHeight),          fp);
-        write += fwrite(&ktxHeader.m_pixelDepth,           1, sizeof(ktxHeader.m_pixelDepth),           fp);
-        write += fwrite(&ktxHeader.m_numArrayElements,     1, sizeof(ktxHeader.m_numArrayElements),     fp);
-        write += fwrite(&ktxHeader.m_numFaces,             1, sizeof(ktxHeader.m_numFaces),             fp);
-        write += fwrite(&ktxHeader.m_numMips,              1, sizeof(ktxHeader.m_numMips),              fp);
-        write += fwrite(&ktxHeader.m_bytesKeyValue,        1, sizeof(ktxHeader.m_bytesKeyValue),        fp);
-        DEBUG_CHECK(write == KTX_HEADER_SIZE, "Error writing Ktx header.");
+    bool imageMappedWriterClose(ImageMappedWriter& _writer)
+    {
+        if (NULL == _writer.m_fp)
+        {
+            return false;
+        }
 
-        // Get source offsets.
-        uint32_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
-        imageGetMipOffsets(offsets, _image);
+        uint32_t numMissing = 0;
+        for (uint8_t face = 0; face < _writer.m_layout.m_numFaces; ++face)
+        {
+            for (uint8_t mip = 0; mip < _writer.m_layout.m_numMips; ++mip)
+            {
+                numMissing += (0 == _writer.m_written[face][mip]);
+            }
+        }
 
-        const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
-        const uint8_t pad[4] = { 0, 0, 0, 0 };
+        if (0 != numMissing)
+        {
+            WARN("%u faces of mapped output were not written.", numMissing);
+        }
 
-        // Write data.
-        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
-        for (uint8_t mip = 0; mip < _image.m_numMips; ++mip)
+        bool failed = _writer.m_failed;
+#if CMFT_IMAGE_MMAP
+        if (NULL != _writer.m_data)
         {
-            const uint32_t width  = max(UINT32_C(1), _image.m_width  >> mip);
-            const uint32_t height = max(UINT32_C(1), _image.m_height >> mip);
+            failed |= (0 != munmap(_writer.m_data, size_t(_writer.m_fileSize)));
+        }
+#endif // CMFT_IMAGE_MMAP
+        failed |= (0 != ferror(_writer.m_fp));
+        failed |= (0 != fclose(_writer.m_fp));
 
-            const uint32_t pitch = width * bytesPerPixel;
-            const uint32_t faceSize = pitch * height;
-            const uint32_t mipSize = faceSize * _image.m_numFaces;
+        _writer.m_fp = NULL;
+        _writer.m_data = NULL;
+        _writer.m_fileSize = 0;
 
-            const uint32_t pitchRounding = (KTX_UNPACK_ALIGNMENT-1)-((pitch    + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
-            const uint32_t faceRounding  = (KTX_UNPACK_ALIGNMENT-1)-((faceSize + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
-            const uint32_t mipRounding   = (KTX_UNPACK_ALIGNMENT-1)-((mipSize  + KTX_UNPACK_ALIGNMENT-1)&(KTX_UNPACK_ALIGNMENT-1));
+        return !failed && 0 == numMissing;
+    }
 
-            // Write face size.
-            write = fwrite(&faceSize, sizeof(uint32_t), 1, fp);
-            DEBUG_CHECK(write == 1, "Error writing Ktx data.");
-            FERROR_CHECK(fp);
+    /// Rle encodes one channel of _width interleaved rgbe pixels. Returns the end of written data.
+    static uint8_t* hdrRleEncodeChannel(uint8_t* _out, const uint8_t* _channel, uint32_t _width)
+    {
+        // Runs shorter than this are stored as normal chunks.
+        const uint32_t minRun = 3;
 
-            for (uint8_t face = 0; face < _image.m_numFaces; ++face)
+        uint32_t xx = 0;
+        while (xx < _width)
+        {
+            // Find next run.
+            uint32_t runBegin = xx;
+            uint32_t runCount = 0;
+            while (runBegin < _width)
             {
-                const uint8_t* faceData = (const uint8_t*)_image.m_data + offsets[face][mip];
-
-                if (0 == pitchRounding)
+                runCount = 1;
+                while (runBegin+runCount < _width
+                    && runCount < 127
+                    && _channel[(runBegin+runCount)*4] == _channel[runBegin*4])
                 {
-                    // Write entire face at once.
-                    write = fwrite(faceData, 1, faceSize, fp);
-                    DEBUG_CHECK(write == faceSize, "Error writing Ktx face data.");
-                    FERROR_CHECK(fp);
+                    ++runCount;
                 }
-                else
-                {
-                    // Write row by row.
-                    for (uint32_t yy = 0; yy < height; ++yy)
-                    {
-                        // Write row.
-                        const uint8_t* src = (const uint8_t*)faceData + yy*pitch;
-                        write = fwrite(src, 1, pitch, fp);
-                        DEBUG_CHECK(write == pitch, "Error writing Ktx row data.");
-                        FERROR_CHECK(fp);
 
-                        // Write row rounding.
-                        write = fwrite(&pad, 1, pitchRounding, fp);
-                        DEBUG_CHECK(write == pitchRounding, "Error writing Ktx row rounding.");
-                        FERROR_CHECK(fp);
-                    }
+                if (runCount >= minRun)
+                {
+                    break;
                 }
 
-                // Write face rounding.
-                if (faceRounding)
+                runBegin += runCount;
+                runCount = 0;
+            }
+
+            // Write normal chunks up to the run.
+            while (xx < runBegin)
+            {
+                const uint32_t count = min(runBegin-xx, UINT32_C(128));
+                *_out++ = uint8_t(count);
+                for (uint32_t ii = 0; ii < count; ++ii)
                 {
-                    write = fwrite(&pad, 1, faceRounding, fp);
-                    DEBUG_CHECK(write == faceRounding, "Error writing Ktx face rounding.");
-                    FERROR_CHECK(fp);
+                    *_out++ = _channel[(xx+ii)*4];
                 }
+                xx += count;
             }
 
-            // Write mip rounding.
-            if (mipRounding)
+            // Write run.
+            if (0 != runCount)
             {
-                write = fwrite(&pad, 1, mipRounding, fp);
-                DEBUG_CHECK(write == mipRounding, "Error writing Ktx mip rounding.");
-                FERROR_CHECK(fp);
+                *_out++ = uint8_t(128+runCount);
+                *_out++ = _channel[runBegin*4];
+                xx += runCount;
             }
         }
 
-        return true;
+        return _out;
     }
 
-    bool imageSaveHdr(const char* _fileName, const Image& _image)
+    struct HdrEncodeArgs
     {
-        // Hdr file type assumes rgbe image format.
-        Image imageRgbe;
-        const bool imageIsRef = imageRefOrConvert(imageRgbe, TextureFormat::RGBE, _image);
+        const uint8_t* m_src;
+        TextureFormat::Enum m_format;
+        uint32_t m_width;
+        uint64_t m_srcPitch;
+        uint32_t m_firstRow;
+        bool m_rle;
+        uint8_t* m_rows;        //!< m_rowCapacity bytes for each row of the band.
+        uint32_t* m_rowSizes;
+        uint32_t m_rowCapacity;
+    };
 
-        // Open file.
-        FILE* fp = fopen(_fileName, "wb");
-        if (NULL == fp)
+    /// Converts band rows [_begin, _end) to rgbe and rle encodes them.
+    static void hdrEncodeRows(void* _args, uint32_t _begin, uint32_t _end)
+    {
+        HdrEncodeArgs* args = (HdrEncodeArgs*)_args;
+
+        const uint32_t width = args->m_width;
+        const bool isRgbe = (TextureFormat::RGBE == args->m_format);
+        const bool viaRgba32f = (!isRgbe && TextureFormat::RGBA32F != args->m_format);
+
+        // Unencoded rows are converted straight into the band. Rgba32f row goes first to keep it aligned.
+        const bool convert = (!isRgbe && args->m_rle);
+        const size_t rgba32fSize = viaRgba32f ? size_t(width)*4*sizeof(float) : 0;
+        const size_t scratchSize = rgba32fSize + (convert ? size_t(width)*4 : 0);
+        uint8_t* scratch = NULL;
+        if (0 != scratchSize)
         {
-            WARN("Could not open file %s for writing.", _fileName);
-            return false;
+            scratch = (uint8_t*)allocScratch(scratchSize, AllocTag::IoBuffer);
+            MALLOC_CHECK(scratch);
         }
-        ScopeFclose cleanup(fp);
+        float* rgba32f = viaRgba32f ? (float*)scratch : NULL;
+        uint8_t* rgbeRow = convert ? scratch + rgba32fSize : NULL;
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t* srcRow = args->m_src + uint64_t(args->m_firstRow+row)*args->m_srcPitch;
+            uint8_t* dst = args->m_rows + uint64_t(row)*args->m_rowCapacity;
+
+            if (!args->m_rle)
+            {
+                convertPixels(dst, TextureFormat::RGBE, srcRow, args->m_format, width, rgba32f, false);
+                args->m_rowSizes[row] = width*4;
+                continue;
+            }
+
+            const uint8_t* rgbe = srcRow;
+            if (convert)
+            {
+                convertPixels(rgbeRow, TextureFormat::RGBE, srcRow, args->m_format, width, rgba32f, false);
+                rgbe = rgbeRow;
+            }
+
+            uint8_t* ptr = dst;
+            *ptr++ = 2;
+            *ptr++ = 2;
+            *ptr++ = uint8_t(width>>8);
+            *ptr++ = uint8_t(width&0xff);
+            for (uint8_t ii = 0; ii < 4; ++ii)
+            {
+                ptr = hdrRleEncodeChannel(ptr, rgbe+ii, width);
+            }
 
-        if (1 != imageRgbe.m_numFaces)
+            args->m_rowSizes[row] = uint32_t(ptr - dst);
+        }
+
+        if (NULL != scratch)
+        {
+            freeScratch(scratch);
+        }
+    }
+
+    bool imageSaveHdr(Writer* _stream, const Image& _image)
+    {
+        if (1 != _image.m_numFaces)
         {
             WARN("Image seems to be containing more than one face. "
                  "Only the first one will be saved due to the limits of HDR format."
                 );
         }
 
-        if (1 != imageRgbe.m_numMips)
+        if (1 != _image.m_numMips)
         {
             WARN("Image seems to be containing more than one mip map. "
                  "Only the first one will be saved due to the limits of HDR format."
@@ -4175,91 +13101,173 @@ namespace cmft
         }
 
         HdrHeader hdrHeader;
-        hdrHeaderFromImage(hdrHeader, imageRgbe);
+        hdrHeaderFromImage(hdrHeader, _image);
 
         CMFT_UNUSED size_t write = 0;
 
         // Write magic.
         char magic[HDR_MAGIC_LEN+1] = HDR_MAGIC_FULL;
         magic[HDR_MAGIC_LEN] = '\n';
-        write = fwrite(&magic, HDR_MAGIC_LEN+1, 1, fp);
+        write = ioWrite(&magic, HDR_MAGIC_LEN+1, 1, _stream);
         DEBUG_CHECK(write == 1, "Error writing Hdr magic.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
         // Write comment.
         char comment[21] = "# Output from cmft.\n";
-        write = fwrite(&comment, 20, 1, fp);
+        write = ioWrite(&comment, 20, 1, _stream);
         DEBUG_CHECK(write == 1, "Error writing Hdr comment.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
         // Write format.
         const char format[24] = "FORMAT=32-bit_rle_rgbe\n";
-        write = fwrite(&format, 23, 1, fp);
+        write = ioWrite(&format, 23, 1, _stream);
         DEBUG_CHECK(write == 1, "Error writing Hdr format.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
         // Don't write gamma for now...
         //char gamma[32];
         //sprintf(gamma, "GAMMA=%g\n", hdrHeader.m_gamma);
         //const size_t gammaLen = strlen(gamma);
-        //write = fwrite(&gamma, gammaLen, 1, fp);
+        //write = ioWrite(&gamma, gammaLen, 1, _stream);
         //DEBUG_CHECK(write == 1, "Error writing Hdr gamma.");
-        //FERROR_CHECK(fp);
+        //IOERROR_CHECK(_stream);
 
         // Write exposure.
         char exposure[32];
         sprintf(exposure, "EXPOSURE=%g\n", hdrHeader.m_exposure);
         const size_t exposureLen = strlen(exposure);
-        write = fwrite(&exposure, exposureLen, 1, fp);
+        write = ioWrite(&exposure, exposureLen, 1, _stream);
         DEBUG_CHECK(write == 1, "Error writing Hdr exposure.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
         // Write header terminator.
         char headerTerminator = '\n';
-        write = fwrite(&headerTerminator, 1, 1, fp);
+        write = ioWrite(&headerTerminator, 1, 1, _stream);
         DEBUG_CHECK(write == 1, "Error writing Hdr header terminator.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
         // Write image size.
         char imageSize[32];
-        sprintf(imageSize, "-Y %d +X %d\n", imageRgbe.m_height, imageRgbe.m_width);
+        sprintf(imageSize, "-Y %d +X %d\n", _image.m_height, _image.m_width);
         const size_t imageSizeLen = strlen(imageSize);
-        write = fwrite(&imageSize, imageSizeLen, 1, fp);
+        write = ioWrite(&imageSize, imageSizeLen, 1, _stream);
         DEBUG_CHECK(write == 1, "Error writing Hdr image size.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
-        // Write data. //TODO: implement RLE option.
-        DEBUG_CHECK(NULL != imageRgbe.m_data, "Image data is null.");
-        const uint32_t pitch = imageRgbe.m_width * getImageDataInfo(imageRgbe.m_format).m_bytesPerPixel;
-        const uint8_t* srcPtr = (uint8_t*)imageRgbe.m_data;
-        for (uint32_t yy = 0; yy < imageRgbe.m_height; ++yy)
-        {
-            write = fwrite(srcPtr, 1, pitch, fp);
-            DEBUG_CHECK(write == pitch, "Error writing Hdr data.");
-            FERROR_CHECK(fp);
-            srcPtr+=pitch;
-        }
+        // Write data. Bands of scanlines are converted to rgbe and rle encoded in parallel, then written in order.
+        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
+        const uint32_t width = _image.m_width;
 
-        // Cleanup.
-        if (!imageIsRef)
+        HdrEncodeArgs args;
+        args.m_src = (const uint8_t*)_image.m_data;
+        args.m_format = _image.m_format;
+        args.m_width = width;
+        args.m_srcPitch = uint64_t(width) * getImageDataInfo(_image.m_format).m_bytesPerPixel;
+        args.m_rle = (width >= 8 && width <= 0x7fff);
+
+        // Worst case rle scanline is 4 bytes of header, plus one extra byte per 128 bytes of each channel.
+        args.m_rowCapacity = args.m_rle ? 4 + 4*(width + (width+127)/128) : width*4;
+
+        const uint32_t bandRows = min(_image.m_height, max(UINT32_C(1), uint32_t(CMFT_HDR_WRITE_BAND_PIXELS/width)));
+        args.m_rows = (uint8_t*)allocScratch(uint64_t(args.m_rowCapacity)*bandRows + bandRows*sizeof(uint32_t), AllocTag::IoBuffer);
+        MALLOC_CHECK(args.m_rows);
+        args.m_rowSizes = (uint32_t*)(args.m_rows + uint64_t(args.m_rowCapacity)*bandRows);
+
+        for (uint32_t y0 = 0; y0 < _image.m_height; y0 += bandRows)
         {
-            imageUnload(imageRgbe);
+            const uint32_t numRows = min(bandRows, _image.m_height-y0);
+            args.m_firstRow = y0;
+
+            parallelFor(hdrEncodeRows, (void*)&args, numRows, CMFT_HDR_WRITE_MIN_ROWS);
+
+            // Encoded rows are packed together in place and written at once.
+            uint8_t* end = args.m_rows + args.m_rowSizes[0];
+            for (uint32_t yy = 1; yy < numRows; ++yy)
+            {
+                const uint8_t* row = args.m_rows + uint64_t(yy)*args.m_rowCapacity;
+                memmove(end, row, args.m_rowSizes[yy]);
+                end += args.m_rowSizes[yy];
+            }
+
+            const size_t size = size_t(end - args.m_rows);
+            write = ioWrite(args.m_rows, 1, size, _stream);
+            DEBUG_CHECK(write == size, "Error writing Hdr data.");
+            IOERROR_CHECK(_stream);
         }
 
+        freeScratch(args.m_rows);
+
         return true;
     }
 
-    bool imageSaveTga(const char* _fileName, const Image& _image, bool _yflip = true)
+    struct TgaEncodeArgs
     {
-        // Open file.
-        FILE* fp = fopen(_fileName, "wb");
-        if (NULL == fp)
+        const uint8_t* m_src;
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_bytesPerPixel;
+        bool m_yflip;
+        uint8_t* m_rows;        //!< m_rowCapacity bytes for each row.
+        uint32_t* m_rowSizes;
+        uint32_t m_rowCapacity;
+    };
+
+    /// Rle encodes rows [_begin, _end). Packets don't cross rows, as Tga 2.0 requires.
+    static void tgaEncodeRows(void* _args, uint32_t _begin, uint32_t _end)
+    {
+        TgaEncodeArgs* args = (TgaEncodeArgs*)_args;
+
+        const uint32_t bpp = args->m_bytesPerPixel;
+        const uint32_t width = args->m_width;
+
+        for (uint32_t row = _begin; row < _end; ++row)
         {
-            WARN("Could not open file %s for writing.", _fileName);
-            return false;
+            const uint32_t yy = args->m_yflip ? args->m_height-1-row : row;
+            const uint8_t* src = args->m_src + uint64_t(yy)*width*bpp;
+            uint8_t* dst = args->m_rows + uint64_t(row)*args->m_rowCapacity;
+            uint8_t* out = dst;
+
+            uint32_t xx = 0;
+            while (xx < width)
+            {
+                uint32_t run = 1;
+                while (xx+run < width
+                    && run < TGA_RLE_MAX_PACKET
+                    && 0 == memcmp(&src[(xx+run)*bpp], &src[xx*bpp], bpp))
+                {
+                    ++run;
+                }
+
+                if (run > 1)
+                {
+                    *out++ = uint8_t(0x80 | (run-1));
+                    memcpy(out, &src[xx*bpp], bpp);
+                    out += bpp;
+                    xx += run;
+                    continue;
+                }
+
+                // Raw packet ends where a run starts.
+                uint32_t count = 1;
+                while (xx+count < width
+                    && count < TGA_RLE_MAX_PACKET
+                    && !(xx+count+1 < width && 0 == memcmp(&src[(xx+count+1)*bpp], &src[(xx+count)*bpp], bpp)))
+                {
+                    ++count;
+                }
+
+                *out++ = uint8_t(count-1);
+                memcpy(out, &src[xx*bpp], size_t(count)*bpp);
+                out += size_t(count)*bpp;
+                xx += count;
+            }
+
+            args->m_rowSizes[row] = uint32_t(out - dst);
         }
-        ScopeFclose cleanup(fp);
+    }
 
+    bool imageSaveTga(Writer* _stream, const Image& _image, bool _rle = false, bool _yflip = true)
+    {
         if (1 != _image.m_numFaces)
         {
             WARN("Image seems to be containing more than one face. "
@@ -4274,38 +13282,112 @@ namespace cmft
                 );
         }
 
+        // Rgbm, rgbd and LogLuv are stored in Tga byte order, the same as BGRA8.
+        if (TextureFormat::RGBM8   == _image.m_format
+        ||  TextureFormat::RGBD8   == _image.m_format
+        ||  TextureFormat::LOGLUV8 == _image.m_format)
+        {
+            const uint32_t numPixels = _image.m_width*_image.m_height;
+            uint8_t* swizzled = (uint8_t*)allocScratch(uint64_t(numPixels)*4, AllocTag::IoBuffer);
+            MALLOC_CHECK(swizzled);
+
+            const uint8_t* src = (const uint8_t*)_image.m_data;
+            for (uint32_t ii = 0; ii < numPixels; ++ii)
+            {
+                swizzled[ii*4+0] = src[ii*4+2];
+                swizzled[ii*4+1] = src[ii*4+1];
+                swizzled[ii*4+2] = src[ii*4+0];
+                swizzled[ii*4+3] = src[ii*4+3];
+            }
+
+            Image image = _image;
+            image.m_data = swizzled;
+            image.m_dataSize = uint64_t(numPixels)*4;
+            image.m_format = TextureFormat::BGRA8;
+            image.m_numMips = 1;
+            image.m_numFaces = 1;
+            const bool result = imageSaveTga(_stream, image, _rle, _yflip);
+
+            freeScratch(swizzled);
+            return result;
+        }
+
         TgaHeader tgaHeader;
         tgaHeaderFromImage(tgaHeader, _image);
+        if (_rle)
+        {
+            tgaHeader.m_imageType |= TGA_IT_RLE;
+        }
 
         // Write header.
         CMFT_UNUSED size_t write = 0;
-        write += fwrite(&tgaHeader.m_idLength,        1, sizeof(tgaHeader.m_idLength),        fp);
-        write += fwrite(&tgaHeader.m_colorMapType,    1, sizeof(tgaHeader.m_colorMapType),    fp);
-        write += fwrite(&tgaHeader.m_imageType,       1, sizeof(tgaHeader.m_imageType),       fp);
-        write += fwrite(&tgaHeader.m_colorMapOrigin,  1, sizeof(tgaHeader.m_colorMapOrigin),  fp);
-        write += fwrite(&tgaHeader.m_colorMapLength,  1, sizeof(tgaHeader.m_colorMapLength),  fp);
-        write += fwrite(&tgaHeader.m_colorMapDepth,   1, sizeof(tgaHeader.m_colorMapDepth),   fp);
-        write += fwrite(&tgaHeader.m_xOrigin,         1, sizeof(tgaHeader.m_xOrigin),         fp);
-        write += fwrite(&tgaHeader.m_yOrigin,         1, sizeof(tgaHeader.m_yOrigin),         fp);
-        write += fwrite(&tgaHeader.m_width,           1, sizeof(tgaHeader.m_width),           fp);
-        write += fwrite(&tgaHeader.m_height,          1, sizeof(tgaHeader.m_height),          fp);
-        write += fwrite(&tgaHeader.m_bitsPerPixel,    1, sizeof(tgaHeader.m_bitsPerPixel),    fp);
-        write += fwrite(&tgaHeader.m_imageDescriptor, 1, sizeof(tgaHeader.m_imageDescriptor), fp);
+        write += ioWrite(&tgaHeader.m_idLength,        1, sizeof(tgaHeader.m_idLength),        _stream);
+        write += ioWrite(&tgaHeader.m_colorMapType,    1, sizeof(tgaHeader.m_colorMapType),    _stream);
+        write += ioWrite(&tgaHeader.m_imageType,       1, sizeof(tgaHeader.m_imageType),       _stream);
+        write += ioWrite(&tgaHeader.m_colorMapOrigin,  1, sizeof(tgaHeader.m_colorMapOrigin),  _stream);
+        write += ioWrite(&tgaHeader.m_colorMapLength,  1, sizeof(tgaHeader.m_colorMapLength),  _stream);
+        write += ioWrite(&tgaHeader.m_colorMapDepth,   1, sizeof(tgaHeader.m_colorMapDepth),   _stream);
+        write += ioWrite(&tgaHeader.m_xOrigin,         1, sizeof(tgaHeader.m_xOrigin),         _stream);
+        write += ioWrite(&tgaHeader.m_yOrigin,         1, sizeof(tgaHeader.m_yOrigin),         _stream);
+        write += ioWrite(&tgaHeader.m_width,           1, sizeof(tgaHeader.m_width),           _stream);
+        write += ioWrite(&tgaHeader.m_height,          1, sizeof(tgaHeader.m_height),          _stream);
+        write += ioWrite(&tgaHeader.m_bitsPerPixel,    1, sizeof(tgaHeader.m_bitsPerPixel),    _stream);
+        write += ioWrite(&tgaHeader.m_imageDescriptor, 1, sizeof(tgaHeader.m_imageDescriptor), _stream);
         DEBUG_CHECK(write == TGA_HEADER_SIZE, "Error writing Tga header.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
-        // Write data. //TODO: implement RLE option.
+        // Write data.
         DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
-        const uint32_t pitch = _image.m_width * getImageDataInfo(_image.m_format).m_bytesPerPixel;
-        if (_yflip)
+        const uint32_t bytesPerPixel = getImageDataInfo(_image.m_format).m_bytesPerPixel;
+        const uint32_t pitch = _image.m_width * bytesPerPixel;
+        if (_rle)
+        {
+            // Rows are encoded in parallel. Encoded row is at most one header byte per 128 pixels bigger than raw one.
+            TgaEncodeArgs args;
+            args.m_src = (const uint8_t*)_image.m_data;
+            args.m_width = _image.m_width;
+            args.m_height = _image.m_height;
+            args.m_bytesPerPixel = bytesPerPixel;
+            args.m_yflip = _yflip;
+            args.m_rowCapacity = pitch + (_image.m_width+TGA_RLE_MAX_PACKET-1)/TGA_RLE_MAX_PACKET;
+            args.m_rows = (uint8_t*)allocScratch(uint64_t(args.m_rowCapacity)*_image.m_height, AllocTag::IoBuffer);
+            MALLOC_CHECK(args.m_rows);
+            args.m_rowSizes = (uint32_t*)allocScratch(_image.m_height*sizeof(uint32_t), AllocTag::IoBuffer);
+            MALLOC_CHECK(args.m_rowSizes);
+
+            parallelFor(tgaEncodeRows, (void*)&args, _image.m_height, 16);
+
+            // Rows are packed together in place and written in blocks of about 1MB.
+            uint32_t yy = 0;
+            while (yy < _image.m_height)
+            {
+                uint8_t* begin = args.m_rows + uint64_t(yy)*args.m_rowCapacity;
+                uint8_t* end = begin + args.m_rowSizes[yy];
+                for (++yy; yy < _image.m_height && uint64_t(end - begin) < (UINT64_C(1)<<20); ++yy)
+                {
+                    const uint8_t* row = args.m_rows + uint64_t(yy)*args.m_rowCapacity;
+                    memmove(end, row, args.m_rowSizes[yy]);
+                    end += args.m_rowSizes[yy];
+                }
+
+                const size_t size = size_t(end - begin);
+                write = ioWrite(begin, 1, size, _stream);
+                DEBUG_CHECK(write == size, "Error writing Tga data.");
+                IOERROR_CHECK(_stream);
+            }
+
+            freeScratch(args.m_rowSizes);
+            freeScratch(args.m_rows);
+        }
+        else if (_yflip)
         {
             const uint8_t* src = (uint8_t*)_image.m_data + _image.m_height * pitch;
             for (uint32_t yy = 0; yy < _image.m_height; ++yy)
             {
                 src-=pitch;
-                write = fwrite(src, 1, pitch, fp);
+                write = ioWrite(src, 1, pitch, _stream);
                 DEBUG_CHECK(write == pitch, "Error writing Tga data.");
-                FERROR_CHECK(fp);
+                IOERROR_CHECK(_stream);
             }
         }
         else
@@ -4313,38 +13395,271 @@ namespace cmft
             const uint8_t* src = (uint8_t*)_image.m_data;
             for (uint32_t yy = 0; yy < _image.m_height; ++yy)
             {
-                write = fwrite(src, 1, pitch, fp);
+                write = ioWrite(src, 1, pitch, _stream);
                 DEBUG_CHECK(write == pitch, "Error writing Tga data.");
-                FERROR_CHECK(fp);
+                IOERROR_CHECK(_stream);
                 src+=pitch;
             }
         }
 
         // Write footer.
         TgaFooter tgaFooter = { 0, 0, TGA_ID };
-        write  = fwrite(&tgaFooter.m_extensionOffset, 1, sizeof(tgaFooter.m_extensionOffset), fp);
-        write += fwrite(&tgaFooter.m_developerOffset, 1, sizeof(tgaFooter.m_developerOffset), fp);
-        write += fwrite(&tgaFooter.m_signature,       1, sizeof(tgaFooter.m_signature),       fp);
+        write  = ioWrite(&tgaFooter.m_extensionOffset, 1, sizeof(tgaFooter.m_extensionOffset), _stream);
+        write += ioWrite(&tgaFooter.m_developerOffset, 1, sizeof(tgaFooter.m_developerOffset), _stream);
+        write += ioWrite(&tgaFooter.m_signature,       1, sizeof(tgaFooter.m_signature),       _stream);
         DEBUG_CHECK(TGA_FOOTER_SIZE == write, "Error writing Tga footer.");
-        FERROR_CHECK(fp);
+        IOERROR_CHECK(_stream);
 
         return true;
     }
 
-    bool imageSave(const Image& _image, const char* _fileName, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo)
+    struct ExrEncodeArgs
     {
-        // Get image in desired format.
-        Image image;
-        bool imageIsRef;
-        if (TextureFormat::Unknown != _convertTo)
+        const uint8_t* m_src;
+        uint32_t m_width;
+        uint32_t m_height;
+        uint8_t m_numChannels;
+        uint8_t m_sampleSize;
+        uint8_t* m_chunks;      //!< m_chunkCapacity bytes for each chunk.
+        uint32_t* m_chunkSizes;
+        uint32_t m_chunkCapacity;
+    };
+
+    static void exrEncodeChunks(void* _args, uint32_t _begin, uint32_t _end)
+    {
+        ExrEncodeArgs* args = (ExrEncodeArgs*)_args;
+
+        const uint32_t numLines = exrLinesPerChunk(EXR_COMPRESSION_ZIP);
+        const uint32_t pixelSize = args->m_numChannels*args->m_sampleSize;
+        uint8_t* scratch = (uint8_t*)allocScratch(2*size_t(args->m_chunkCapacity), AllocTag::IoBuffer);
+        MALLOC_CHECK(scratch);
+        uint8_t* predicted = scratch + args->m_chunkCapacity;
+
+        for (uint32_t chunk = _begin; chunk < _end; ++chunk)
         {
-            imageIsRef = imageRefOrConvert(image, _convertTo, _image);
+            const uint32_t y0 = chunk*numLines;
+            const uint32_t numRows = min(numLines, args->m_height-y0);
+
+            // Channels go in alphabetical order, which is A, B, G, R.
+            uint8_t* raw = scratch;
+            for (uint32_t yy = 0; yy < numRows; ++yy)
+            {
+                const uint8_t* srcRow = args->m_src + uint64_t(y0+yy)*args->m_width*pixelSize;
+                for (uint8_t cc = args->m_numChannels; cc-- > 0; )
+                {
+                    for (uint32_t xx = 0; xx < args->m_width; ++xx)
+                    {
+                        memcpy(raw, &srcRow[xx*pixelSize + cc*args->m_sampleSize], args->m_sampleSize);
+                        raw += args->m_sampleSize;
+                    }
+                }
+            }
+
+            const uint32_t rawSize = uint32_t(raw - scratch);
+            exrPredict(predicted, scratch, rawSize);
+
+            // Stored uncompressed if it does not get any smaller.
+            uint8_t* dst = args->m_chunks + uint64_t(chunk)*args->m_chunkCapacity;
+            uint32_t size = zlibCompress(dst, rawSize-1, predicted, rawSize);
+            if (0 == size)
+            {
+                memcpy(dst, scratch, rawSize);
+                size = rawSize;
+            }
+            args->m_chunkSizes[chunk] = size;
         }
-        else
+
+        freeScratch(scratch);
+    }
+
+    static inline uint8_t* exrWriteAttribute(uint8_t* _ptr, const char* _name, const char* _type, const void* _value, int32_t _size)
+    {
+        const size_t nameLen = strlen(_name)+1;
+        const size_t typeLen = strlen(_type)+1;
+        memcpy(_ptr, _name, nameLen);  _ptr += nameLen;
+        memcpy(_ptr, _type, typeLen);  _ptr += typeLen;
+        memcpy(_ptr, &_size, 4);       _ptr += 4;
+        memcpy(_ptr, _value, _size);   _ptr += _size;
+        return _ptr;
+    }
+
+    /// Saves scanline Exr with zip compression. Chunks are compressed in parallel.
+    bool imageSaveExr(Writer* _stream, const Image& _image)
+    {
+        if (1 != _image.m_numFaces)
+        {
+            WARN("Image seems to be containing more than one face. "
+                 "Only the first one will be saved due to the limits of EXR format."
+                );
+        }
+
+        if (1 != _image.m_numMips)
+        {
+            WARN("Image seems to be containing more than one mip map. "
+                 "Only the first one will be saved due to the limits of EXR format."
+                );
+        }
+
+        const ImageDataInfo& info = getImageDataInfo(_image.m_format);
+        const int32_t pixelType = (PixelDataType::HALF_FLOAT == info.m_pixelType) ? EXR_PIXEL_HALF : EXR_PIXEL_FLOAT;
+        const uint8_t numChannels = info.m_numChanels;
+        const uint8_t sampleSize = uint8_t(exrSampleSize(pixelType));
+
+        // Header.
+        uint8_t header[512];
+        uint8_t* ptr = header;
+
+        uint8_t channels[4*18+1];
+        uint8_t* channel = channels;
+        static const char* s_channelNames[4] = { "R", "G", "B", "A" };
+        for (uint8_t cc = numChannels; cc-- > 0; )
+        {
+            const int32_t sampling = 1;
+            memcpy(channel, s_channelNames[cc], 2); channel += 2;
+            memcpy(channel, &pixelType, 4);         channel += 4;
+            memset(channel, 0, 4);                  channel += 4;
+            memcpy(channel, &sampling, 4);          channel += 4;
+            memcpy(channel, &sampling, 4);          channel += 4;
+        }
+        *channel++ = '\0';
+
+        const uint8_t compression = EXR_COMPRESSION_ZIP;
+        const int32_t window[4] = { 0, 0, int32_t(_image.m_width)-1, int32_t(_image.m_height)-1 };
+        const uint8_t lineOrder = 0;
+        const float pixelAspectRatio = 1.0f;
+        const float screenWindowCenter[2] = { 0.0f, 0.0f };
+        const float screenWindowWidth = 1.0f;
+
+        ptr = exrWriteAttribute(ptr, "channels",           "chlist",      channels,            int32_t(channel-channels));
+        ptr = exrWriteAttribute(ptr, "compression",        "compression", &compression,        1);
+        ptr = exrWriteAttribute(ptr, "dataWindow",         "box2i",       window,              16);
+        ptr = exrWriteAttribute(ptr, "displayWindow",      "box2i",       window,              16);
+        ptr = exrWriteAttribute(ptr, "lineOrder",          "lineOrder",   &lineOrder,          1);
+        ptr = exrWriteAttribute(ptr, "pixelAspectRatio",   "float",       &pixelAspectRatio,   4);
+        ptr = exrWriteAttribute(ptr, "screenWindowCenter", "v2f",         screenWindowCenter,  8);
+        ptr = exrWriteAttribute(ptr, "screenWindowWidth",  "float",       &screenWindowWidth,  4);
+        *ptr++ = '\0';
+        const uint32_t headerSize = uint32_t(ptr-header);
+
+        // Compress chunks.
+        DEBUG_CHECK(NULL != _image.m_data, "Image data is null.");
+        const uint32_t numLines = exrLinesPerChunk(EXR_COMPRESSION_ZIP);
+        const uint32_t numChunks = (_image.m_height + numLines - 1)/numLines;
+
+        ExrEncodeArgs args;
+        args.m_src = (const uint8_t*)_image.m_data;
+        args.m_width = _image.m_width;
+        args.m_height = _image.m_height;
+        args.m_numChannels = numChannels;
+        args.m_sampleSize = sampleSize;
+        args.m_chunkCapacity = _image.m_width*numLines*numChannels*sampleSize;
+        args.m_chunks = (uint8_t*)allocScratch(uint64_t(numChunks)*args.m_chunkCapacity + numChunks*sizeof(uint32_t), AllocTag::IoBuffer);
+        MALLOC_CHECK(args.m_chunks);
+        args.m_chunkSizes = (uint32_t*)(args.m_chunks + uint64_t(numChunks)*args.m_chunkCapacity);
+
+        parallelFor(exrEncodeChunks, (void*)&args, numChunks, 1);
+
+        CMFT_UNUSED size_t write = 0;
+
+        // Write magic, version and header.
+        const uint32_t magic = EXR_MAGIC;
+        const uint32_t version = EXR_VERSION;
+        write  = ioWrite(&magic,   4, 1, _stream);
+        write += ioWrite(&version, 4, 1, _stream);
+        write += ioWrite(header, headerSize, 1, _stream);
+        DEBUG_CHECK(write == 3, "Error writing Exr header.");
+        IOERROR_CHECK(_stream);
+
+        // Write offset table.
+        uint64_t offset = 8 + headerSize + uint64_t(numChunks)*8;
+        for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            write = ioWrite(&offset, 8, 1, _stream);
+            DEBUG_CHECK(write == 1, "Error writing Exr offset table.");
+            offset += 8 + args.m_chunkSizes[chunk];
+        }
+        IOERROR_CHECK(_stream);
+
+        // Write chunks.
+        for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            const int32_t yy = int32_t(chunk*numLines);
+            const uint32_t size = args.m_chunkSizes[chunk];
+            write  = ioWrite(&yy,   4, 1, _stream);
+            write += ioWrite(&size, 4, 1, _stream);
+            write += ioWrite(args.m_chunks + uint64_t(chunk)*args.m_chunkCapacity, size, 1, _stream);
+            DEBUG_CHECK(write == 3, "Error writing Exr data.");
+            IOERROR_CHECK(_stream);
+        }
+
+        freeScratch(args.m_chunks);
+
+        return true;
+    }
+
+    /// Writes _image, already in a format valid for _ft, to _stream.
+    static bool imageSaveStream(Writer* _stream, const Image& _image, ImageFileType::Enum _ft, const ImageEncodeSettings& _settings)
+    {
+        AllocTagScope allocTag(AllocTag::IoBuffer, true);
+
+        if (ImageFileType::DDS == _ft)
+        {
+            return imageSaveDds(_stream, _image, _settings.m_mipLayout);
+        }
+        else if (ImageFileType::KTX == _ft)
+        {
+            return imageSaveKtx(_stream, _image, _settings.m_mipLayout);
+        }
+        else if (ImageFileType::TGA == _ft)
+        {
+            return imageSaveTga(_stream, _image, _settings.m_tgaRle);
+        }
+        else if (ImageFileType::HDR == _ft)
         {
-            imageRef(image, _image);
-            imageIsRef = true;
+            return imageSaveHdr(_stream, _image);
         }
+        else if (ImageFileType::EXR == _ft)
+        {
+            return imageSaveExr(_stream, _image);
+        }
+        else if (ImageFileType::KTX2 == _ft)
+        {
+            return imageSaveKtx2(_stream, _image);
+        }
+
+        return false;
+    }
+
+    /// Checks that _format can be saved as _ft, warns with the list of valid formats otherwise.
+    static bool imageSaveCheckFormat(ImageFileType::Enum _ft, TextureFormat::Enum _format)
+    {
+        if (checkValidInternalFormat(_ft, _format))
+        {
+            return true;
+        }
+
+        char buf[1024];
+        getValidTextureFormatsStr(buf, _ft);
+
+        WARN("Could not save %s as *.%s image."
+            " Valid internal formats are: %s."
+            " Choose one of the valid internal formats or a different file type.\n"
+            , getTextureFormatStr(_format)
+            , getFilenameExtensionStr(_ft)
+            , buf
+            );
+
+        return false;
+    }
+
+    bool imageSave(const Image& _image, const char* _fileName, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo, bool _writeBehind, const ImageEncodeSettings* _settings)
+    {
+        CMFT_PROFILE_ZONE("imageSave");
+
+        // Get image in desired format.
+        Image image;
+        const TextureFormat::Enum format = (TextureFormat::Unknown != _convertTo) ? _convertTo : (TextureFormat::Enum)_image.m_format;
+        const bool imageIsRef = imageRefOrConvert(image, format, _image, _settings);
 
         // Append appropriate extension to file name.
         char filePath[512];
@@ -4353,39 +13668,46 @@ namespace cmft
 
         // Check for valid texture format and save.
         bool result = false;
-        if (checkValidInternalFormat(_ft, image.m_format))
+        if (imageSaveCheckFormat(_ft, (TextureFormat::Enum)image.m_format))
         {
-            if (ImageFileType::DDS == _ft)
-            {
-                result = imageSaveDds(filePath, image);
-            }
-            else if (ImageFileType::KTX == _ft)
+            // Open file, in memory with write-behind output.
+            WriteFile file;
+            FILE* fp = writeFileOpen(file, filePath, _writeBehind);
+            if (NULL == fp)
             {
-                result = imageSaveKtx(filePath, image);
+                WARN("Could not open file %s for writing.", filePath);
             }
-            else if (ImageFileType::TGA == _ft)
-            {
-                result = imageSaveTga(filePath, image);
-            }
-            else if (ImageFileType::HDR == _ft)
+            else
             {
-                result = imageSaveHdr(filePath, image);
+                ScopeWriteFile cleanup(file);
+                FileWriter writer(fp);
+                result = imageSaveStream(&writer, image, _ft, encodeSettings(_settings));
             }
         }
-        else
-        {
-            char buf[1024];
-            getValidTextureFormatsStr(buf, _ft);
 
-            WARN("Could not save %s as *.%s image."
-                " Valid internal formats are: %s."
-                " Choose one of the valid internal formats or a different file type.\n"
-                , getTextureFormatStr(image.m_format)
-                , getFilenameExtensionStr(_ft)
-                , buf
-                );
+        // Cleanup.
+        if (!imageIsRef)
+        {
+            imageUnload(image);
         }
 
+        return result;
+    }
+
+    bool imageSave(const Image& _image, Writer& _writer, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo, const ImageEncodeSettings* _settings)
+    {
+        CMFT_PROFILE_ZONE("imageSave");
+
+        // Get image in desired format.
+        Image image;
+        const TextureFormat::Enum format = (TextureFormat::Unknown != _convertTo) ? _convertTo : (TextureFormat::Enum)_image.m_format;
+        const bool imageIsRef = imageRefOrConvert(image, format, _image, _settings);
+
+        const bool result = imageSaveCheckFormat(_ft, (TextureFormat::Enum)image.m_format)
+                         && imageSaveStream(&_writer, image, _ft, encodeSettings(_settings))
+                         && !_writer.isError()
+                         ;
+
         // Cleanup.
         if (!imageIsRef)
         {
@@ -4395,6 +13717,42 @@ namespace cmft
         return result;
     }
 
+    bool imageSaveToMemory(void*& _data, size_t& _size, const Image& _image, ImageFileType::Enum _ft, TextureFormat::Enum _convertTo, const ImageEncodeSettings* _settings)
+    {
+        CMFT_PROFILE_ZONE("imageSaveToMemory");
+
+        _data = NULL;
+        _size = 0;
+
+        MemoryWriter writer;
+        if (!imageSave(_image, writer, _ft, _convertTo, _settings))
+        {
+            return false;
+        }
+
+        _data = writer.release(_size);
+        return true;
+    }
+
+    bool imageSaveWriteBehindBegin(uint64_t _maxQueuedBytes)
+    {
+        return writeBehindStart(_maxQueuedBytes);
+    }
+
+    bool imageSaveWriteBehindFlush()
+    {
+        CMFT_PROFILE_ZONE("imageSaveWriteBehindFlush");
+
+        return writeBehindFlush();
+    }
+
+    bool imageSaveWriteBehindEnd()
+    {
+        CMFT_PROFILE_ZONE("imageSaveWriteBehindEnd");
+
+        return writeBehindStop();
+    }
+
 } // namespace cmft
 
 /* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_IRRADIANCEPROGRAM_H_HEADER_GUARD
+#define CMFT_IRRADIANCEPROGRAM_H_HEADER_GUARD
+
+namespace cmft
+{
+    static const char s_irradianceShProgramSource[] =
+    {
+        "typedef unsigned char  uint8_t;\n"
+        "typedef unsigned short uint16_t;\n"
+        "typedef unsigned int   uint32_t;\n"
+        "\n"
+        "typedef char  int8_t;\n"
+        "typedef short int16_t;\n"
+        "typedef int   int32_t;\n"
+        "\n"
+        "__constant float3 s_faceUvVectors[6][3] =\n"
+        "{\n"
+        "    { // +x face\n"
+        "        {  0.0f,  0.0f, -1.0f }, // u -> -z\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        {  1.0f,  0.0f,  0.0f }, // +x face\n"
+        "    },\n"
+        "    { // -x face\n"
+        "        {  0.0f,  0.0f,  1.0f }, // u -> +z\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        { -1.0f,  0.0f,  0.0f }, // -x face\n"
+        "    },\n"
+        "    { // +y face\n"
+        "        {  1.0f,  0.0f,  0.0f }, // u -> +x\n"
+        "        {  0.0f,  0.0f,  1.0f }, // v -> +z\n"
+        "        {  0.0f,  1.0f,  0.0f }, // +y face\n"
+        "    },\n"
+        "    { // -y face\n"
+        "        {  1.0f,  0.0f,  0.0f }, // u -> +x\n"
+        "        {  0.0f,  0.0f, -1.0f }, // v -> -z\n"
+        "        {  0.0f, -1.0f,  0.0f }, // -y face\n"
+        "    },\n"
+        "    { // +z face\n"
+        "        {  1.0f,  0.0f,  0.0f }, // u -> +x\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        {  0.0f,  0.0f,  1.0f }, // +z face\n"
+        "    },\n"
+        "    { // -z face\n"
+        "        { -1.0f,  0.0f,  0.0f }, // u -> -x\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        {  0.0f,  0.0f, -1.0f }, // -z face\n"
+        "    }\n"
+        "};\n"
+        "\n"
+        "static float3 texelCoordToVec(float _u\n"
+        "                            , float _v\n"
+        "                            , int8_t _faceId\n"
+        "                            , int32_t _faceSize\n"
+        "                            )\n"
+        "{\n"
+        "    if (1 != _faceSize)\n"
+        "    {\n"
+        "        // Edge fixup.\n"
+        "        const float faceSizef = (float)_faceSize;\n"
+        "        const float faceSizef_Min1 = faceSizef - 1.0f;\n"
+        "        const float a = (faceSizef*faceSizef) / (faceSizef_Min1*faceSizef_Min1*faceSizef_Min1);\n"
+        "        _u = a * _u*_u*_u + _u;\n"
+        "        _v = a * _v*_v*_v + _v;\n"
+        "    }\n"
+        "\n"
+        "    return normalize(_u * s_faceUvVectors[_faceId][0] + _v * s_faceUvVectors[_faceId][1] + s_faceUvVectors[_faceId][2]);\n"
+        "}\n"
+        "\n"
+        "// Same as areaElement() in cubemaputils.h.\n"
+        "static float areaElement(float _x, float _y)\n"
+        "{\n"
+        "    return atan2(_x*_y, sqrt(_x*_x + _y*_y + 1.0f));\n"
+        "}\n"
+        "\n"
+        "// Same as texelNormalSolidAngle() in radiance.h.\n"
+        "static float4 texelNormalSolidAngle(int2 _coord, int8_t _faceId, int32_t _faceSize)\n"
+        "{\n"
+        "    const float invFaceSize = 1.0f/(float)_faceSize;\n"
+        "    const float uu = 2.0f*((float)_coord.x + 0.5f)*invFaceSize - 1.0f;\n"
+        "    const float vv = 2.0f*((float)_coord.y + 0.5f)*invFaceSize - 1.0f;\n"
+        "\n"
+        "    const float x0 = uu - invFaceSize;\n"
+        "    const float x1 = uu + invFaceSize;\n"
+        "    const float y0 = vv - invFaceSize;\n"
+        "    const float y1 = vv + invFaceSize;\n"
+        "    const float solidAngle = areaElement(x1, y1)\n"
+        "                           - areaElement(x0, y1)\n"
+        "                           - areaElement(x1, y0)\n"
+        "                           + areaElement(x0, y0)\n"
+        "                           ;\n"
+        "\n"
+        "    const float3 vec = texelCoordToVec(uu, vv, _faceId, _faceSize);\n"
+        "    const float4 result = { vec.x, vec.y, vec.z, solidAngle };\n"
+        "    return result;\n"
+        "}\n"
+        "\n"
+        "// Basis constants match evalSHBasis() on the host.\n"
+        "#define SQRT_PI 1.7724538509055160272981674833411f\n"
+        "#define PI4     12.566370614359172953850573533118f\n"
+        "#define PI16    50.265482457436691815402294132472f\n"
+        "#define PI64    201.06192982974676726160917652989f\n"
+        "\n"
+        "static void evalSHBasis5(float _shBasis[25], float3 _dir)\n"
+        "{\n"
+        "    const float x = _dir.x;\n"
+        "    const float y = _dir.y;\n"
+        "    const float z = _dir.z;\n"
+        "\n"
+        "    const float x2 = x*x;\n"
+        "    const float y2 = y*y;\n"
+        "    const float z2 = z*z;\n"
+        "\n"
+        "    const float z3 = z2*z;\n"
+        "\n"
+        "    const float x4 = x2*x2;\n"
+        "    const float y4 = y2*y2;\n"
+        "    const float z4 = z2*z2;\n"
+        "\n"
+        "    _shBasis[ 0] =  1.0f/(2.0f*SQRT_PI);\n"
+        "\n"
+        "    _shBasis[ 1] = -sqrt(3.0f/PI4)*y;\n"
+        "    _shBasis[ 2] =  sqrt(3.0f/PI4)*z;\n"
+        "    _shBasis[ 3] = -sqrt(3.0f/PI4)*x;\n"
+        "\n"
+        "    _shBasis[ 4] =  sqrt(15.0f/PI4)*y*x;\n"
+        "    _shBasis[ 5] = -sqrt(15.0f/PI4)*y*z;\n"
+        "    _shBasis[ 6] =  sqrt(5.0f/PI16)*(3.0f*z2-1.0f);\n"
+        "    _shBasis[ 7] = -sqrt(15.0f/PI4)*x*z;\n"
+        "    _shBasis[ 8] =  sqrt(15.0f/PI16)*(x2-y2);\n"
+        "\n"
+        "    _shBasis[ 9] = -sqrt( 70.0f/PI64)*y*(3.0f*x2-y2);\n"
+        "    _shBasis[10] =  sqrt(105.0f/ PI4)*y*x*z;\n"
+        "    _shBasis[11] = -sqrt( 42.0f/PI64)*y*(-1.0f+5.0f*z2);\n"
+        "    _shBasis[12] =  sqrt(  7.0f/PI16)*(5.0f*z3-3.0f*z);\n"
+        "    _shBasis[13] = -sqrt( 42.0f/PI64)*x*(-1.0f+5.0f*z2);\n"
+        "    _shBasis[14] =  sqrt(105.0f/PI16)*(x2-y2)*z;\n"
+        "    _shBasis[15] = -sqrt( 70.0f/PI64)*x*(x2-3.0f*y2);\n"
+        "\n"
+        "    _shBasis[16] =  3.0f*sqrt(35.0f/PI16)*x*y*(x2-y2);\n"
+        "    _shBasis[17] = -3.0f*sqrt(70.0f/PI64)*y*z*(3.0f*x2-y2);\n"
+        "    _shBasis[18] =  3.0f*sqrt( 5.0f/PI16)*y*x*(-1.0f+7.0f*z2);\n"
+        "    _shBasis[19] = -3.0f*sqrt(10.0f/PI64)*y*z*(-3.0f+7.0f*z2);\n"
+        "    _shBasis[20] =  (105.0f*z4-90.0f*z2+9.0f)/(16.0f*SQRT_PI);\n"
+        "    _shBasis[21] = -3.0f*sqrt(10.0f/PI64)*x*z*(-3.0f+7.0f*z2);\n"
+        "    _shBasis[22] =  3.0f*sqrt( 5.0f/PI64)*(x2-y2)*(-1.0f+7.0f*z2);\n"
+        "    _shBasis[23] = -3.0f*sqrt(70.0f/PI64)*x*z*(x2-3.0f*y2);\n"
+        "    _shBasis[24] =  3.0f*sqrt(35.0f/(4.0f*PI64))*(x4-6.0f*y2*x2+y4);\n"
+        "}\n"
+        "\n"
+        "// _shRgb holds 25 rgb coefficients already scaled by their band factor. Third dimension goes over faces starting from _faceId.\n"
+        "__kernel void irradianceSh(__global float4* _out\n"
+        "                         , __constant float4* _shRgb\n"
+        "                         , int32_t _faceSize\n"
+        "                         , int8_t _faceId\n"
+        "                         )\n"
+        "{\n"
+        "    const int xx = get_global_id(0);\n"
+        "    const int yy = get_global_id(1);\n"
+        "    const int zz = get_global_id(2);\n"
+        "\n"
+        "    const float invFaceSize_Mul2 = 2.0f/_faceSize;\n"
+        "    const float uu = ((float)xx + 0.5f) * invFaceSize_Mul2 - 1.0f;\n"
+        "    const float vv = ((float)yy + 0.5f) * invFaceSize_Mul2 - 1.0f;\n"
+        "    const float3 vec = texelCoordToVec(uu, vv, _faceId + (int8_t)zz, _faceSize);\n"
+        "\n"
+        "    float shBasis[25];\n"
+        "    evalSHBasis5(shBasis, vec);\n"
+        "\n"
+        "    float4 rgb = { 0.0f, 0.0f, 0.0f, 0.0f };\n"
+        "    for (int32_t ii = 0; ii < 25; ++ii)\n"
+        "    {\n"
+        "        rgb += _shRgb[ii] * shBasis[ii];\n"
+        "    }\n"
+        "    rgb.w = 1.0f;\n"
+        "\n"
+        "    _out[(zz*_faceSize + yy)*_faceSize + xx] = rgb;\n"
+        "}\n"
+        "\n"
+        "// Projects one face onto the first _numCoeffs SH basis functions. Each work-item accumulates a strided subset of texels,\n"
+        "// then the work-group reduces them in _scratch and writes 25 partial rgb coefficients. Sum of solid angles is in .w of the first one.\n"
+        "// Work-group size has to be a power of two.\n"
+        "__kernel void shProject(__global float4* _partials\n"
+        "                      , __global const float* _src\n"
+        "                      , __local float4* _scratch\n"
+        "                      , int32_t _faceSize\n"
+        "                      , int8_t _faceId\n"
+        "                      , int32_t _numChannels\n"
+        "                      , int32_t _flipX\n"
+        "                      , int32_t _numCoeffs\n"
+        "                      )\n"
+        "{\n"
+        "    float4 acc[25];\n"
+        "    for (int32_t ii = 0; ii < 25; ++ii)\n"
+        "    {\n"
+        "        acc[ii] = (float4)(0.0f, 0.0f, 0.0f, 0.0f);\n"
+        "    }\n"
+        "    float weight = 0.0f;\n"
+        "\n"
+        "    const int32_t numTexels = _faceSize*_faceSize;\n"
+        "    for (int32_t tt = get_global_id(0); tt < numTexels; tt += get_global_size(0))\n"
+        "    {\n"
+        "        const int2 coord = { tt%_faceSize, tt/_faceSize };\n"
+        "        const float4 ns = texelNormalSolidAngle(coord, _faceId, _faceSize);\n"
+        "\n"
+        "        const int32_t srcX = _flipX ? _faceSize-1-coord.x : coord.x;\n"
+        "        __global const float* src = _src + (coord.y*_faceSize + srcX)*_numChannels;\n"
+        "        const float4 color = { src[0]*ns.w, src[1]*ns.w, src[2]*ns.w, 0.0f };\n"
+        "\n"
+        "        float shBasis[25];\n"
+        "        evalSHBasis5(shBasis, ns.xyz);\n"
+        "\n"
+        "        for (int32_t ii = 0; ii < _numCoeffs; ++ii)\n"
+        "        {\n"
+        "            acc[ii] += color * shBasis[ii];\n"
+        "        }\n"
+        "        weight += ns.w;\n"
+        "    }\n"
+        "    acc[0].w = weight;\n"
+        "\n"
+        "    const int32_t lid = get_local_id(0);\n"
+        "    const int32_t groupSize = get_local_size(0);\n"
+        "    __global float4* partial = _partials + get_group_id(0)*25;\n"
+        "    for (int32_t ii = 0; ii < 25; ++ii)\n"
+        "    {\n"
+        "        _scratch[lid] = acc[ii];\n"
+        "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+        "\n"
+        "        for (int32_t stride = groupSize/2; stride > 0; stride /= 2)\n"
+        "        {\n"
+        "            if (lid < stride)\n"
+        "            {\n"
+        "                _scratch[lid] += _scratch[lid+stride];\n"
+        "            }\n"
+        "            barrier(CLK_LOCAL_MEM_FENCE);\n"
+        "        }\n"
+        "\n"
+        "        if (0 == lid)\n"
+        "        {\n"
+        "            partial[ii] = _scratch[0];\n"
+        "        }\n"
+        "        barrier(CLK_LOCAL_MEM_FENCE);\n"
+        "    }\n"
+        "}\n"
+    };
+
+} // namespace cmft
+
+#endif // CMFT_IRRADIANCEPROGRAM_H_HEADER_GUARD
@@ -3,7 +3,309 @@
  * License: http://www.opensource.org/licenses/BSD-2-Clause
  */
 
+#include "base/config.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <bx/cpu.h>
+#include <bx/mutex.h>
+#include <bx/os.h> //bx::yield
+#include <bx/sem.h>
+#include <bx/thread.h>
+
+#include "base/utils.h"
+
+#include "messages.h"
+
 bool g_printInfo     = true;
 bool g_printWarnings = true;
 
+namespace cmft
+{
+    /// Returns value of *_ptr before the call, it is set to _new only if that was _old.
+    static inline uint32_t atomicCompareAndSwap(volatile uint32_t* _ptr, uint32_t _old, uint32_t _new)
+    {
+#if BX_COMPILER_MSVC
+        return (uint32_t)_InterlockedCompareExchange((volatile long*)_ptr, long(_new), long(_old));
+#else
+        return __sync_val_compare_and_swap(_ptr, _old, _new);
+#endif // BX_COMPILER_MSVC
+    }
+
+    struct MessageSlot
+    {
+        volatile uint32_t m_sequence; //!< Ring position the slot is free for, or position+1 once the message is written.
+        MessageType::Enum m_type;
+        char m_message[CMFT_MESSAGE_MAX_LENGTH];
+    };
+
+    struct MessageSink
+    {
+        MessageSink()
+            : m_slots(NULL)
+            , m_mask(0)
+            , m_writePos(0)
+            , m_readPos(0)
+            , m_numWriters(0)
+            , m_numDropped(0)
+            , m_fn(NULL)
+            , m_userData(NULL)
+            , m_active(false)
+            , m_quit(false)
+        {
+        }
+
+        MessageSlot* m_slots;
+        uint32_t m_mask;
+        volatile uint32_t m_writePos;   //!< Next position to claim, advanced by printing threads.
+        volatile uint32_t m_readPos;    //!< Next position to write out, advanced by the sink thread only.
+        volatile int32_t m_numWriters;  //!< Printing threads that might still be queueing.
+        volatile uint32_t m_numDropped;
+        MessageFn m_fn;
+        void* m_userData;
+        volatile bool m_active;
+        volatile bool m_quit;
+        bx::Mutex m_mutex;              //!< Serializes start, flush and stop.
+        bx::Semaphore m_sem;            //!< Posted for every queued message, on flush and on quit.
+        bx::Thread m_thread;
+    };
+    static MessageSink s_sink;
+
+    void messageSetCallback(MessageFn _fn, void* _userData)
+    {
+        s_sink.m_userData = _userData;
+        s_sink.m_fn = _fn;
+    }
+
+    static void messageWrite(MessageType::Enum _type, const char* _message)
+    {
+        MessageFn fn = s_sink.m_fn;
+        if (NULL != fn)
+        {
+            fn(_type, _message, s_sink.m_userData);
+            return;
+        }
+
+        fprintf((MessageType::Warning == _type) ? stderr : stdout, "%s\n", _message);
+    }
+
+    /// Writes out queued messages in order, up to the first one that is still being written. Returns the number written out.
+    static uint32_t messageSinkDrain()
+    {
+        MessageSink& sink = s_sink;
+
+        uint32_t num = 0;
+        for (;;)
+        {
+            const uint32_t pos = sink.m_readPos;
+            MessageSlot& slot = sink.m_slots[pos & sink.m_mask];
+            if (pos+1 != slot.m_sequence)
+            {
+                break;
+            }
+            bx::memoryBarrier();
+
+            messageWrite(slot.m_type, slot.m_message);
+
+            bx::memoryBarrier();
+            slot.m_sequence = pos + sink.m_mask+1;
+            sink.m_readPos = pos+1;
+            ++num;
+        }
+
+        uint32_t numDropped;
+        do
+        {
+            numDropped = sink.m_numDropped;
+        } while (0 != numDropped && numDropped != atomicCompareAndSwap(&sink.m_numDropped, numDropped, 0));
+
+        if (0 != numDropped)
+        {
+            char message[128];
+            snprintf(message, sizeof(message), "CMFT WARNING: %u messages were dropped, message sink is full.", numDropped);
+            messageWrite(MessageType::Warning, message);
+            ++num;
+        }
+
+        return num;
+    }
+
+    static int32_t messageSinkThread(void* /*_userData*/)
+    {
+        MessageSink& sink = s_sink;
+
+        for (;;)
+        {
+            sink.m_sem.wait();
+
+            // Nothing is queued anymore once quit is set, drain after reading it.
+            const bool quit = sink.m_quit;
+            if (0 != messageSinkDrain())
+            {
+                fflush(stdout);
+                fflush(stderr);
+            }
+
+            if (quit)
+            {
+                break;
+            }
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    bool messageSinkStart(uint32_t _numSlots)
+    {
+        MessageSink& sink = s_sink;
+        bx::MutexScope lock(sink.m_mutex);
+        if (sink.m_active)
+        {
+            return false;
+        }
+
+        uint32_t numSlots = 2;
+        while (numSlots < _numSlots && numSlots < UINT32_C(1)<<20)
+        {
+            numSlots *= 2;
+        }
+
+        MessageSlot* slots = (MessageSlot*)malloc(numSlots*sizeof(MessageSlot));
+        MALLOC_CHECK(slots);
+        if (NULL == slots)
+        {
+            return false;
+        }
+
+        for (uint32_t ii = 0; ii < numSlots; ++ii)
+        {
+            slots[ii].m_sequence = ii;
+        }
+
+        sink.m_slots = slots;
+        sink.m_mask = numSlots-1;
+        sink.m_writePos = 0;
+        sink.m_readPos = 0;
+        sink.m_numDropped = 0;
+        sink.m_quit = false;
+        sink.m_thread.init(messageSinkThread);
+
+        bx::memoryBarrier();
+        sink.m_active = true;
+
+        return true;
+    }
+
+    void messageSinkFlush()
+    {
+        MessageSink& sink = s_sink;
+        bx::MutexScope lock(sink.m_mutex);
+
+        if (sink.m_active)
+        {
+            const uint32_t writePos = sink.m_writePos;
+            sink.m_sem.post();
+
+            while (0 < int32_t(writePos - sink.m_readPos))
+            {
+                bx::yield();
+            }
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+    }
+
+    void messageSinkStop()
+    {
+        MessageSink& sink = s_sink;
+        bx::MutexScope lock(sink.m_mutex);
+        if (!sink.m_active)
+        {
+            return;
+        }
+
+        // Threads that saw the sink active finish queueing, later ones print in place.
+        sink.m_active = false;
+        bx::memoryBarrier();
+        while (0 != sink.m_numWriters)
+        {
+            bx::yield();
+        }
+
+        sink.m_quit = true;
+        sink.m_sem.post();
+        sink.m_thread.shutdown();
+
+        fflush(stdout);
+        fflush(stderr);
+
+        free(sink.m_slots);
+        sink.m_slots = NULL;
+    }
+
+    bool messageSinkIsActive()
+    {
+        return s_sink.m_active;
+    }
+
+    /// Claims the next free slot of the ring and writes the message into it. Drops the message if the ring is full.
+    static void messageQueue(MessageSink& _sink, MessageType::Enum _type, const char* _format, va_list _args)
+    {
+        for (;;)
+        {
+            const uint32_t pos = _sink.m_writePos;
+            MessageSlot& slot = _sink.m_slots[pos & _sink.m_mask];
+            const int32_t diff = int32_t(slot.m_sequence - pos);
+
+            if (0 == diff)
+            {
+                if (pos == atomicCompareAndSwap(&_sink.m_writePos, pos, pos+1))
+                {
+                    slot.m_type = _type;
+                    vsnprintf(slot.m_message, sizeof(slot.m_message), _format, _args);
+
+                    bx::memoryBarrier();
+                    slot.m_sequence = pos+1;
+                    _sink.m_sem.post();
+                    return;
+                }
+            }
+            else if (0 > diff)
+            {
+                // Sink thread is a whole ring behind.
+                bx::atomicIncr(&_sink.m_numDropped);
+                return;
+            }
+        }
+    }
+
+    void messagePrint(MessageType::Enum _type, const char* _format, ...)
+    {
+        MessageSink& sink = s_sink;
+
+        va_list args;
+        va_start(args, _format);
+
+        bx::atomicIncr(&sink.m_numWriters);
+        if (sink.m_active)
+        {
+            messageQueue(sink, _type, _format, args);
+        }
+        else
+        {
+            char message[CMFT_MESSAGE_MAX_LENGTH];
+            vsnprintf(message, sizeof(message), _format, args);
+            messageWrite(_type, message);
+        }
+        bx::atomicDecr(&sink.m_numWriters);
+
+        va_end(args);
+    }
+
+} // namespace cmft
+
 /* vim: set sw=4 ts=4 expandtab: */
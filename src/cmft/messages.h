@@ -6,26 +6,87 @@
 #ifndef CMFT_MESSAGES_H_HEADER_GUARD
 #define CMFT_MESSAGES_H_HEADER_GUARD
 
+#include <stdint.h>
+
+#include <bx/macros.h> //BX_PRINTF_ARGS
+
 #include "base/macros.h"
+#include "base/utils.h" //NoCopyNoAssign
+
+// Longer messages are truncated by the message sink.
+#ifndef CMFT_MESSAGE_MAX_LENGTH
+    #define CMFT_MESSAGE_MAX_LENGTH 1024
+#endif // CMFT_MESSAGE_MAX_LENGTH
+
+namespace cmft
+{
+    struct MessageType
+    {
+        enum Enum
+        {
+            Info,
+            Warning,
+        };
+    };
+
+    /// Receives every printed message, without trailing new line. Called from the sink thread while it is running,
+    /// from the printing thread otherwise.
+    typedef void (*MessageFn)(MessageType::Enum _type, const char* _message, void* _userData);
+
+    /// Installs _fn in place of printing to stdout and stderr, NULL restores printing.
+    void messageSetCallback(MessageFn _fn, void* _userData = NULL);
+
+    /// Starts the sink thread. Messages are queued in a ring of _numSlots slots without locking and written out by
+    /// the sink thread, so printing never blocks. Messages that do not fit in a full ring are dropped and counted.
+    /// Returns false if the sink thread is already running or the ring could not be allocated.
+    bool messageSinkStart(uint32_t _numSlots = 256);
+
+    /// Blocks until all queued messages are written out and flushes stdout and stderr.
+    void messageSinkFlush();
+
+    /// Flushes and stops the sink thread, messages are written out by the printing thread afterwards.
+    void messageSinkStop();
+
+    ///
+    bool messageSinkIsActive();
+
+    void messagePrint(MessageType::Enum _type, const char* _format, ...) BX_PRINTF_ARGS(2, 3);
+
+    struct ScopeMessageSink : NoCopyNoAssign
+    {
+        ScopeMessageSink(uint32_t _numSlots = 256) : m_started(messageSinkStart(_numSlots)) { }
+
+        ~ScopeMessageSink()
+        {
+            if (m_started)
+            {
+                messageSinkStop();
+            }
+        }
+
+        bool m_started;
+    };
+
+} // namespace cmft
 
 extern bool g_printWarnings;
-#define _WARN(_format, ...)                                                             \
-do                                                                                      \
-{                                                                                       \
-    if (g_printWarnings)                                                                \
-    {                                                                                   \
-        fprintf(stderr, "CMFT WARNING" _FILE_LINE_ ": "  _format "\n", ##__VA_ARGS__);  \
-    }                                                                                   \
+#define _WARN(_format, ...)                                                                                   \
+do                                                                                                            \
+{                                                                                                             \
+    if (g_printWarnings)                                                                                      \
+    {                                                                                                         \
+        ::cmft::messagePrint(::cmft::MessageType::Warning, "CMFT WARNING" _FILE_LINE_ ": " _format, ##__VA_ARGS__); \
+    }                                                                                                         \
 } while(0)
 
 extern bool g_printInfo;
-#define _INFO(_format, ...)                                         \
-do                                                                  \
-{                                                                   \
-    if (g_printInfo)                                                \
-    {                                                               \
-        fprintf(stdout, "CMFT info: " _format "\n", ##__VA_ARGS__); \
-    }                                                               \
+#define _INFO(_format, ...)                                                                 \
+do                                                                                          \
+{                                                                                           \
+    if (g_printInfo)                                                                        \
+    {                                                                                       \
+        ::cmft::messagePrint(::cmft::MessageType::Info, "CMFT info: " _format, ##__VA_ARGS__); \
+    }                                                                                       \
 } while(0)
 
 #endif //CMFT_MESSAGES_H_HEADER_GUARD
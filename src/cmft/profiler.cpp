@@ -0,0 +1,275 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "profiler.h"
+
+#include "base/config.h"
+#include "base/utils.h"
+#include "messages.h"
+
+#include <stdio.h>
+#include <stdlib.h> //malloc
+#include <string.h>
+
+#include <bx/os.h> //bx::getTid
+#include <bx/timer.h> //bx::getHPCounter
+#include <bx/mutex.h> //bx::Mutex
+
+#if BX_PLATFORM_LINUX
+#   include <linux/perf_event.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif // BX_PLATFORM_LINUX
+
+namespace cmft
+{
+    struct ProfileZone
+    {
+        const char* m_name;
+        int64_t m_begin;
+        int64_t m_end;
+        uint32_t m_tid;
+    };
+
+    static bx::Mutex s_profilerMutex;
+    static ProfileZone* s_profileZones = NULL;
+    static uint32_t s_numProfileZones = 0;
+    static uint32_t s_profileZonesCapacity = 0;
+    static int64_t s_profilerStartTime = 0;
+    static volatile bool s_profilerActive = false;
+
+    void profilerStart()
+    {
+        bx::MutexScope lock(s_profilerMutex);
+        s_numProfileZones = 0;
+        s_profilerStartTime = bx::getHPCounter();
+        s_profilerActive = true;
+    }
+
+    bool profilerStop(const char* _filePath)
+    {
+        bx::MutexScope lock(s_profilerMutex);
+        s_profilerActive = false;
+
+        bool result = true;
+        if (NULL != _filePath)
+        {
+            FILE* fp = fopen(_filePath, "w");
+            if (NULL == fp)
+            {
+                WARN("Could not open file %s for writing.", _filePath);
+                result = false;
+            }
+            else
+            {
+                // Chrome trace timestamps are in microseconds.
+                const double toUs = 1000000.0/double(bx::getHPFrequency());
+
+                fprintf(fp, "{\"traceEvents\":[\n");
+                for (uint32_t ii = 0; ii < s_numProfileZones; ++ii)
+                {
+                    const ProfileZone& zone = s_profileZones[ii];
+                    fprintf(fp, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n"
+                           , zone.m_name
+                           , zone.m_tid
+                           , double(zone.m_begin - s_profilerStartTime)*toUs
+                           , double(zone.m_end - zone.m_begin)*toUs
+                           , (ii+1 == s_numProfileZones) ? "" : ","
+                           );
+                }
+                fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+
+                FERROR_CHECK(fp);
+                fclose(fp);
+            }
+        }
+
+        free(s_profileZones);
+        s_profileZones = NULL;
+        s_numProfileZones = 0;
+        s_profileZonesCapacity = 0;
+
+        return result;
+    }
+
+    ProfileScope::ProfileScope(const char* _name)
+        : m_name(_name)
+        , m_begin(s_profilerActive ? bx::getHPCounter() : 0)
+    {
+    }
+
+    ProfileScope::~ProfileScope()
+    {
+        if (0 == m_begin || !s_profilerActive)
+        {
+            return;
+        }
+
+        const int64_t end = bx::getHPCounter();
+        const uint32_t tid = bx::getTid();
+
+        bx::MutexScope lock(s_profilerMutex);
+        if (!s_profilerActive)
+        {
+            return;
+        }
+
+        if (s_numProfileZones == s_profileZonesCapacity)
+        {
+            const uint32_t capacity = max(UINT32_C(4096), s_profileZonesCapacity*2);
+            ProfileZone* zones = (ProfileZone*)realloc(s_profileZones, capacity*sizeof(ProfileZone));
+            MALLOC_CHECK(zones);
+            if (NULL == zones)
+            {
+                return;
+            }
+            s_profileZones = zones;
+            s_profileZonesCapacity = capacity;
+        }
+
+        ProfileZone& zone = s_profileZones[s_numProfileZones++];
+        zone.m_name = m_name;
+        zone.m_begin = m_begin;
+        zone.m_end = end;
+        zone.m_tid = tid;
+    }
+
+    // Hardware counters.
+    //-----
+
+    enum PerfCounter
+    {
+        PerfCycles,
+        PerfInstructions,
+        PerfLlcMisses,
+        PerfDtlbMisses,
+
+        PerfCount
+    };
+
+    static int s_perfFds[PerfCount] = { -1, -1, -1, -1 };
+
+#if BX_PLATFORM_LINUX
+    static int perfEventOpen(uint32_t _type, uint64_t _config)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = _type;
+        attr.config = _config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // Calling thread on any CPU, no group. Inherited counters can't be read as a group on older kernels.
+        return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif // BX_PLATFORM_LINUX
+
+    bool perfCountersOpen()
+    {
+        perfCountersClose();
+
+#if BX_PLATFORM_LINUX
+        const uint64_t cacheReadMiss = (uint64_t(PERF_COUNT_HW_CACHE_OP_READ)<<8) | (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS)<<16);
+        s_perfFds[PerfCycles]       = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        s_perfFds[PerfInstructions] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        s_perfFds[PerfLlcMisses]    = perfEventOpen(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL   | cacheReadMiss);
+        s_perfFds[PerfDtlbMisses]   = perfEventOpen(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | cacheReadMiss);
+#endif // BX_PLATFORM_LINUX
+
+        for (uint8_t ii = 0; ii < PerfCount; ++ii)
+        {
+            if (-1 != s_perfFds[ii])
+            {
+                return true;
+            }
+        }
+
+        WARN("Hardware performance counters are not available.");
+        return false;
+    }
+
+    void perfCountersClose()
+    {
+        for (uint8_t ii = 0; ii < PerfCount; ++ii)
+        {
+#if BX_PLATFORM_LINUX
+            if (-1 != s_perfFds[ii])
+            {
+                close(s_perfFds[ii]);
+            }
+#endif // BX_PLATFORM_LINUX
+            s_perfFds[ii] = -1;
+        }
+    }
+
+    bool perfCountersRead(PerfCounters& _counters)
+    {
+        uint64_t values[PerfCount] = { 0, 0, 0, 0 };
+        bool open = false;
+
+        for (uint8_t ii = 0; ii < PerfCount; ++ii)
+        {
+#if BX_PLATFORM_LINUX
+            uint64_t data[3]; // Value, time enabled, time running.
+            if (-1 != s_perfFds[ii]
+            &&  sizeof(data) == read(s_perfFds[ii], data, sizeof(data)))
+            {
+                values[ii] = (0 != data[2] && data[2] < data[1])
+                           ? uint64_t(double(data[0])*double(data[1])/double(data[2]))
+                           : data[0]
+                           ;
+                open = true;
+            }
+#endif // BX_PLATFORM_LINUX
+        }
+
+        _counters.m_cycles       = values[PerfCycles];
+        _counters.m_instructions = values[PerfInstructions];
+        _counters.m_llcMisses    = values[PerfLlcMisses];
+        _counters.m_dtlbMisses   = values[PerfDtlbMisses];
+
+        return open;
+    }
+
+    void perfCountersDelta(PerfCounters& _delta, const PerfCounters& _begin, const PerfCounters& _end)
+    {
+        // Scaled counts of multiplexed counters may step back a little.
+        _delta.m_cycles       = (_end.m_cycles       > _begin.m_cycles)       ? _end.m_cycles       - _begin.m_cycles       : 0;
+        _delta.m_instructions = (_end.m_instructions > _begin.m_instructions) ? _end.m_instructions - _begin.m_instructions : 0;
+        _delta.m_llcMisses    = (_end.m_llcMisses    > _begin.m_llcMisses)    ? _end.m_llcMisses    - _begin.m_llcMisses    : 0;
+        _delta.m_dtlbMisses   = (_end.m_dtlbMisses   > _begin.m_dtlbMisses)   ? _end.m_dtlbMisses   - _begin.m_dtlbMisses   : 0;
+    }
+
+    void perfCountersPrint(const char* _stage, const PerfCounters& _delta, uint64_t _taps)
+    {
+        const double ipc = (0 != _delta.m_cycles) ? double(_delta.m_instructions)/double(_delta.m_cycles) : 0.0;
+        const double bytesPerTap = (0 != _taps) ? double(_delta.m_llcMisses)*64.0/double(_taps) : 0.0;
+        const double dtlbPerKilo = (0 != _delta.m_instructions) ? double(_delta.m_dtlbMisses)*1000.0/double(_delta.m_instructions) : 0.0;
+
+        INFO("Counters -> %s:"
+             "\n\t[cycles=%llu]"
+             "\n\t[instructions=%llu]"
+             "\n\t[llcMisses=%llu]"
+             "\n\t[dtlbMisses=%llu]"
+             "\n\t[ipc=%.2f]"
+             "\n\t[bytesPerTap=%.3f]"
+             "\n\t[dtlbMissesPerKiloInstruction=%.3f]"
+             , _stage
+             , (unsigned long long)_delta.m_cycles
+             , (unsigned long long)_delta.m_instructions
+             , (unsigned long long)_delta.m_llcMisses
+             , (unsigned long long)_delta.m_dtlbMisses
+             , ipc
+             , bytesPerTap
+             , dtlbPerKilo
+             );
+    }
+
+} // namespace cmft
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_PROFILER_H_HEADER_GUARD
+#define CMFT_PROFILER_H_HEADER_GUARD
+
+#include "base/config.h"
+
+#include <stdint.h>
+
+#include <bx/macros.h> //BX_CONCATENATE
+
+#include "base/utils.h" //NoCopyNoAssign
+
+namespace cmft
+{
+    /// Starts recording profile zones. Zones are kept in memory until profilerStop().
+    /// Zones are only compiled in with CMFT_CONFIG_PROFILE, otherwise nothing is recorded.
+    void profilerStart();
+
+    /// Stops recording and writes recorded zones to _filePath as Chrome trace event JSON,
+    /// which can be opened in chrome://tracing or Perfetto. Zones are discarded if _filePath is NULL.
+    bool profilerStop(const char* _filePath);
+
+    /// Records a zone from construction to destruction on the calling thread. _name has to be a string literal.
+    struct ProfileScope
+    {
+        ProfileScope(const char* _name);
+        ~ProfileScope();
+
+        const char* m_name;
+        int64_t m_begin;
+    };
+
+    /// Hardware counter totals, see perfCountersOpen(). Counters the host doesn't have read as zero.
+    struct PerfCounters
+    {
+        PerfCounters()
+            : m_cycles(0)
+            , m_instructions(0)
+            , m_llcMisses(0)
+            , m_dtlbMisses(0)
+        {
+        }
+
+        uint64_t m_cycles;
+        uint64_t m_instructions;
+        uint64_t m_llcMisses;  //!< Last level cache read misses, each one reads a cache line from memory.
+        uint64_t m_dtlbMisses; //!< Data TLB read misses.
+    };
+
+    /// Opens cycle, instruction, last level cache miss and dTLB miss counters of user space code with perf_event_open, Linux only.
+    /// The calling thread and all threads it starts from then on are counted together, threads that already run are not, so
+    /// counters have to be opened before the thread pool starts. Returns false where the host exposes none of the counters,
+    /// e.g. in virtual machines without a virtual PMU or with kernel.perf_event_paranoid above 2.
+    bool perfCountersOpen();
+
+    ///
+    void perfCountersClose();
+
+    /// Reads totals since perfCountersOpen(), scaled up for the time counters were multiplexed out. Returns false if not open.
+    bool perfCountersRead(PerfCounters& _counters);
+
+    /// Counts between two reads.
+    void perfCountersDelta(PerfCounters& _delta, const PerfCounters& _begin, const PerfCounters& _end);
+
+    /// Prints counts of _stage and metrics derived from them: instructions per cycle, bytes read from memory per tap for _taps
+    /// above zero (LLC misses of 64 byte lines) and dTLB misses per thousand instructions.
+    void perfCountersPrint(const char* _stage, const PerfCounters& _delta, uint64_t _taps = 0);
+
+    /// Prints counts from construction to destruction, nothing if counters are not open.
+    struct ScopePerfCounters : NoCopyNoAssign
+    {
+        ScopePerfCounters(const char* _stage, uint64_t _taps = 0)
+            : m_stage(_stage)
+            , m_taps(_taps)
+            , m_open(perfCountersRead(m_begin))
+        {
+        }
+
+        ~ScopePerfCounters()
+        {
+            PerfCounters end;
+            if (m_open
+            &&  perfCountersRead(end))
+            {
+                PerfCounters delta;
+                perfCountersDelta(delta, m_begin, end);
+                perfCountersPrint(m_stage, delta, m_taps);
+            }
+        }
+
+        const char* m_stage;
+        uint64_t m_taps;
+        PerfCounters m_begin;
+        bool m_open;
+    };
+
+} // namespace cmft
+
+#if CMFT_CONFIG_PROFILE
+    #define CMFT_PROFILE_ZONE(_name) cmft::ProfileScope BX_CONCATENATE(profileScope, __LINE__)(_name)
+#else
+    #define CMFT_PROFILE_ZONE(_name) do {} while(0)
+#endif // CMFT_CONFIG_PROFILE
+
+#endif //CMFT_PROFILER_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
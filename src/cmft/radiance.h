@@ -18,6 +18,53 @@ namespace cmft
         "typedef short int16_t;\n"
         "typedef int   int32_t;\n"
         "\n"
+        "// Specialized variants are built with per mip parameters as compile time constants, so loops and invariant terms are resolved by the compiler.\n"
+        "#ifdef CMFT_DST_FACE_SIZE\n"
+        "    #define DST_FACE_SIZE CMFT_DST_FACE_SIZE\n"
+        "#else\n"
+        "    #define DST_FACE_SIZE _dstFaceSize\n"
+        "#endif\n"
+        "\n"
+        "#ifdef CMFT_SRC_FACE_SIZE\n"
+        "    #define SRC_FACE_SIZE CMFT_SRC_FACE_SIZE\n"
+        "#else\n"
+        "    #define SRC_FACE_SIZE _srcFaceSize\n"
+        "#endif\n"
+        "\n"
+        "#ifdef CMFT_SPECULAR_POWER\n"
+        "    #define SPECULAR_POWER CMFT_SPECULAR_POWER\n"
+        "    #define SPECULAR_ANGLE CMFT_SPECULAR_ANGLE\n"
+        "    #define FILTER_SIZE    CMFT_FILTER_SIZE\n"
+        "#else\n"
+        "    #define SPECULAR_POWER _specularPower\n"
+        "    #define SPECULAR_ANGLE _specularAngle\n"
+        "    #define FILTER_SIZE    _filterSize\n"
+        "#endif\n"
+        "\n"
+        "// Specialized variants may look up lobe weights in a table of the mip over [SPECULAR_ANGLE, 1], passed as the last kernel argument.\n"
+        "#ifdef CMFT_LOBE_TABLE_SIZE\n"
+        "    #define LOBE_TABLE_ARG , __constant float* _lobeTable\n"
+        "    #define LOBE_TABLE_PASS , _lobeTable\n"
+        "    #define LOBE_WEIGHT(_dot, _power) lobeWeight(_lobeTable, _dot)\n"
+        "#else\n"
+        "    #define LOBE_TABLE_ARG\n"
+        "    #define LOBE_TABLE_PASS\n"
+        "    #define LOBE_WEIGHT(_dot, _power) native_powr(_dot, _power)\n"
+        "#endif\n"
+        "\n"
+        "#ifdef CMFT_LOBE_TABLE_SIZE\n"
+        "static float lobeWeight(__constant float* _lobeTable, float _dot)\n"
+        "{\n"
+        "    const float tt = clamp((_dot - SPECULAR_ANGLE)*CMFT_LOBE_TABLE_SCALE, 0.0f, (float)CMFT_LOBE_TABLE_SIZE);\n"
+        "#if CMFT_LOBE_TABLE_LERP\n"
+        "    const int32_t idx = (int32_t)tt;\n"
+        "    return mix(_lobeTable[idx], _lobeTable[idx+1], tt - (float)idx);\n"
+        "#else\n"
+        "    return _lobeTable[(int32_t)(tt + 0.5f)];\n"
+        "#endif\n"
+        "}\n"
+        "#endif\n"
+        "\n"
         "__constant float3 s_faceUvVectors[6][3] =\n"
         "{\n"
         "    { // +x face\n"
@@ -84,6 +131,172 @@ namespace cmft
         "\n"
         "__constant sampler_t s_imageSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;\n"
         "\n"
+        "// Same as areaElement() in cubemaputils.h.\n"
+        "static float areaElement(float _x, float _y)\n"
+        "{\n"
+        "    return atan2(_x*_y, sqrt(_x*_x + _y*_y + 1.0f));\n"
+        "}\n"
+        "\n"
+        "// Same as the texel normal and solid angle stored by buildCubemapNormalSolidAngle() in cubemapfilter.cpp.\n"
+        "static float4 texelNormalSolidAngle(int2 _coord, int8_t _faceId, int32_t _faceSize)\n"
+        "{\n"
+        "    const float invFaceSize = 1.0f/(float)_faceSize;\n"
+        "    const float uu = 2.0f*((float)_coord.x + 0.5f)*invFaceSize - 1.0f;\n"
+        "    const float vv = 2.0f*((float)_coord.y + 0.5f)*invFaceSize - 1.0f;\n"
+        "\n"
+        "    const float x0 = uu - invFaceSize;\n"
+        "    const float x1 = uu + invFaceSize;\n"
+        "    const float y0 = vv - invFaceSize;\n"
+        "    const float y1 = vv + invFaceSize;\n"
+        "    const float solidAngle = areaElement(x1, y1)\n"
+        "                           - areaElement(x0, y1)\n"
+        "                           - areaElement(x1, y0)\n"
+        "                           + areaElement(x0, y0)\n"
+        "                           ;\n"
+        "\n"
+        "    const float3 vec = texelCoordToVec(uu, vv, _faceId, _faceSize);\n"
+        "    const float4 result = { vec.x, vec.y, vec.z, solidAngle };\n"
+        "    return result;\n"
+        "}\n"
+        "\n"
+        "// Compact normal images hold only the solid angle, texel normal is computed.\n"
+        "static float4 compactNormalSolidAngle(float _solidAngle, int2 _coord, int8_t _faceId, int32_t _faceSize)\n"
+        "{\n"
+        "    const float invFaceSize = 1.0f/(float)_faceSize;\n"
+        "    const float uu = 2.0f*((float)_coord.x + 0.5f)*invFaceSize - 1.0f;\n"
+        "    const float vv = 2.0f*((float)_coord.y + 0.5f)*invFaceSize - 1.0f;\n"
+        "\n"
+        "    const float3 vec = texelCoordToVec(uu, vv, _faceId, _faceSize);\n"
+        "    const float4 result = { vec.x, vec.y, vec.z, _solidAngle };\n"
+        "    return result;\n"
+        "}\n"
+        "\n"
+        "// With face atlas, all six faces are stacked vertically in one image and the same image is bound for each face.\n"
+        "#ifdef CMFT_FACE_ATLAS\n"
+        "    #define FACE_COORD(_coord, _faceId, _faceSize) ((int2)((_coord).x, (_coord).y + (_faceId)*(_faceSize)))\n"
+        "#else\n"
+        "    #define FACE_COORD(_coord, _faceId, _faceSize) (_coord)\n"
+        "#endif\n"
+        "\n"
+        "#define READ_SRC(_image, _coord, _faceId, _faceSize) read_imagef(_image, s_imageSampler, FACE_COORD(_coord, _faceId, _faceSize))\n"
+        "\n"
+        "// With analytic normals, normal and solid angle images are not uploaded and texel normals are computed instead of fetched.\n"
+        "#ifdef CMFT_ANALYTIC_NORMALS\n"
+        "    #define READ_NORMAL(_image, _coord, _faceId, _faceSize) texelNormalSolidAngle(_coord, _faceId, _faceSize)\n"
+        "#elif defined(CMFT_COMPACT_NORMALS)\n"
+        "    #define READ_NORMAL(_image, _coord, _faceId, _faceSize) compactNormalSolidAngle(READ_SRC(_image, _coord, _faceId, _faceSize).x, _coord, _faceId, _faceSize)\n"
+        "#else\n"
+        "    #define READ_NORMAL(_image, _coord, _faceId, _faceSize) READ_SRC(_image, _coord, _faceId, _faceSize)\n"
+        "#endif\n"
+        "\n"
+        "// Neighbour faces in order: left, right, top, bottom. Second value is the edge that belongs to the neighbour face.\n"
+        "__constant uint8_t s_cubeFaceNeighbours[6][4][2] =\n"
+        "{\n"
+        "    { { 4, 1 }, { 5, 0 }, { 2, 1 }, { 3, 1 } }, // +x face\n"
+        "    { { 5, 1 }, { 4, 0 }, { 2, 0 }, { 3, 0 } }, // -x face\n"
+        "    { { 1, 2 }, { 0, 2 }, { 5, 2 }, { 4, 2 } }, // +y face\n"
+        "    { { 1, 3 }, { 0, 3 }, { 4, 3 }, { 5, 3 } }, // -y face\n"
+        "    { { 1, 1 }, { 0, 0 }, { 2, 3 }, { 3, 2 } }, // +z face\n"
+        "    { { 0, 1 }, { 1, 0 }, { 2, 2 }, { 3, 3 } }, // -z face\n"
+        "};\n"
+        "\n"
+        "// _u and _v are in [0.0 .. 1.0] range.\n"
+        "static int8_t vecToTexelCoord(float* _u, float* _v, float3 _vec)\n"
+        "{\n"
+        "    const float3 absVec = fabs(_vec);\n"
+        "    const float maxComp = fmax(fmax(absVec.x, absVec.y), absVec.z);\n"
+        "\n"
+        "    int8_t faceIdx;\n"
+        "    if (maxComp == absVec.x)      { faceIdx = (_vec.x >= 0.0f) ? 0 : 1; }\n"
+        "    else if (maxComp == absVec.y) { faceIdx = (_vec.y >= 0.0f) ? 2 : 3; }\n"
+        "    else                          { faceIdx = (_vec.z >= 0.0f) ? 4 : 5; }\n"
+        "\n"
+        "    const float3 faceVec = _vec / maxComp;\n"
+        "    *_u = (dot(s_faceUvVectors[faceIdx][0], faceVec) + 1.0f) * 0.5f;\n"
+        "    *_v = (dot(s_faceUvVectors[faceIdx][1], faceVec) + 1.0f) * 0.5f;\n"
+        "\n"
+        "    return faceIdx;\n"
+        "}\n"
+        "\n"
+        "// Area is stored as (minX, minY, maxX, maxY).\n"
+        "static float4 areaAdd(float4 _area, float _x, float _y)\n"
+        "{\n"
+        "    const float2 point = { _x, _y };\n"
+        "    _area.xy = fmin(_area.xy, point);\n"
+        "    _area.zw = fmax(_area.zw, point);\n"
+        "    return _area;\n"
+        "}\n"
+        "\n"
+        "static float4 areaClamp(float4 _area)\n"
+        "{\n"
+        "    _area.xy = fmax(_area.xy, 0.0f);\n"
+        "    _area.zw = fmin(_area.zw, 1.0f);\n"
+        "    return _area;\n"
+        "}\n"
+        "\n"
+        "// Same as determineFilterArea() in cubemapfilter.cpp. Returns hit face index.\n"
+        "static int8_t determineFilterArea(float4 _filterArea[6], float3 _tapVec, float _filterSize)\n"
+        "{\n"
+        "    for (int8_t face = 0; face < 6; ++face)\n"
+        "    {\n"
+        "        const float4 empty = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };\n"
+        "        _filterArea[face] = empty;\n"
+        "    }\n"
+        "\n"
+        "    float uu, vv;\n"
+        "    const int8_t hitFaceIdx = vecToTexelCoord(&uu, &vv, _tapVec);\n"
+        "\n"
+        "    const float4 hitArea = { uu-_filterSize, vv-_filterSize, uu+_filterSize, vv+_filterSize };\n"
+        "    _filterArea[hitFaceIdx] = areaClamp(hitArea);\n"
+        "\n"
+        "    const float bleedAmount[4] =\n"
+        "    {\n"
+        "        _filterSize - uu,\n"
+        "        uu + _filterSize - 1.0f,\n"
+        "        _filterSize - vv,\n"
+        "        vv + _filterSize - 1.0f,\n"
+        "    };\n"
+        "\n"
+        "    const float2 bleedBb[4] =\n"
+        "    {\n"
+        "        _filterArea[hitFaceIdx].yw,\n"
+        "        _filterArea[hitFaceIdx].yw,\n"
+        "        _filterArea[hitFaceIdx].xz,\n"
+        "        _filterArea[hitFaceIdx].xz,\n"
+        "    };\n"
+        "\n"
+        "    for (uint8_t side = 0; side < 4; ++side)\n"
+        "    {\n"
+        "        uint8_t currentFaceIdx = hitFaceIdx;\n"
+        "        for (float amount = bleedAmount[side]; amount > 0.0f; amount -= 1.0f)\n"
+        "        {\n"
+        "            const uint8_t neighbourFaceIdx  = s_cubeFaceNeighbours[currentFaceIdx][side][0];\n"
+        "            const uint8_t neighbourFaceEdge = s_cubeFaceNeighbours[currentFaceIdx][side][1];\n"
+        "            currentFaceIdx = neighbourFaceIdx;\n"
+        "\n"
+        "            float bbMin = bleedBb[side].x;\n"
+        "            float bbMax = bleedBb[side].y;\n"
+        "            if (side == neighbourFaceEdge || 3 == (side + neighbourFaceEdge))\n"
+        "            {\n"
+        "                bbMin = 1.0f - bbMin;\n"
+        "                bbMax = 1.0f - bbMax;\n"
+        "            }\n"
+        "\n"
+        "            float4 area = _filterArea[neighbourFaceIdx];\n"
+        "            switch (neighbourFaceEdge)\n"
+        "            {\n"
+        "            case 0: area = areaAdd(areaAdd(area, 0.0f,          bbMin), amount, bbMax); break;\n"
+        "            case 1: area = areaAdd(areaAdd(area, 1.0f - amount, bbMin), 1.0f,   bbMax); break;\n"
+        "            case 2: area = areaAdd(areaAdd(area, bbMin, 0.0f         ), bbMax,  amount); break;\n"
+        "            case 3: area = areaAdd(areaAdd(area, bbMin, 1.0f - amount), bbMax,  1.0f  ); break;\n"
+        "            }\n"
+        "            _filterArea[neighbourFaceIdx] = areaClamp(area);\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    return hitFaceIdx;\n"
+        "}\n"
+        "\n"
         "__kernel void radianceFilter(__write_only image2d_t _out\n"
         "                           , float _specularPower\n"
         "                           , float _specularAngle\n"
@@ -102,29 +315,30 @@ namespace cmft
         "                           , __read_only image2d_t _normalSolidAngle3\n"
         "                           , __read_only image2d_t _normalSolidAngle4\n"
         "                           , __read_only image2d_t _normalSolidAngle5\n"
+        "                           LOBE_TABLE_ARG\n"
         "                           )\n"
         "{\n"
         "    const int row    = get_global_id(0);\n"
         "    const int column = get_global_id(1);\n"
         "\n"
-        "    const float invDstFaceSize_Mul2 = 2.0f/_dstFaceSize;\n"
+        "    const float invDstFaceSize_Mul2 = 2.0f/DST_FACE_SIZE;\n"
         "    const float vv = ((float)row    + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
         "    const float uu = ((float)column + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
-        "    const float3 tapVec = texelCoordToVec(uu, vv, _faceId, _dstFaceSize);\n"
+        "    const float3 tapVec = texelCoordToVec(uu, vv, _faceId, DST_FACE_SIZE);\n"
         "\n"
         "    float4 colorWeight = { 0.0f, 0.0f, 0.0f, 0.0f };\n"
-        "    for (int32_t yy = 0; yy < _srcFaceSize; ++yy)\n"
+        "    for (int32_t yy = 0; yy < SRC_FACE_SIZE; ++yy)\n"
         "    {\n"
-        "        for (int32_t xx = 0; xx < _srcFaceSize; ++xx)\n"
+        "        for (int32_t xx = 0; xx < SRC_FACE_SIZE; ++xx)\n"
         "        {\n"
         "            const int2 coord = { xx, yy };\n"
         "\n"
-        "            const float4 normal0 = read_imagef(_normalSolidAngle0, s_imageSampler, coord);\n"
-        "            const float4 normal1 = read_imagef(_normalSolidAngle1, s_imageSampler, coord);\n"
-        "            const float4 normal2 = read_imagef(_normalSolidAngle2, s_imageSampler, coord);\n"
-        "            const float4 normal3 = read_imagef(_normalSolidAngle3, s_imageSampler, coord);\n"
-        "            const float4 normal4 = read_imagef(_normalSolidAngle4, s_imageSampler, coord);\n"
-        "            const float4 normal5 = read_imagef(_normalSolidAngle5, s_imageSampler, coord);\n"
+        "            const float4 normal0 = READ_NORMAL(_normalSolidAngle0, coord, 0, SRC_FACE_SIZE);\n"
+        "            const float4 normal1 = READ_NORMAL(_normalSolidAngle1, coord, 1, SRC_FACE_SIZE);\n"
+        "            const float4 normal2 = READ_NORMAL(_normalSolidAngle2, coord, 2, SRC_FACE_SIZE);\n"
+        "            const float4 normal3 = READ_NORMAL(_normalSolidAngle3, coord, 3, SRC_FACE_SIZE);\n"
+        "            const float4 normal4 = READ_NORMAL(_normalSolidAngle4, coord, 4, SRC_FACE_SIZE);\n"
+        "            const float4 normal5 = READ_NORMAL(_normalSolidAngle5, coord, 5, SRC_FACE_SIZE);\n"
         "\n"
         "            const float dotProduct0 = dot(normal0.xyz, tapVec);\n"
         "            const float dotProduct1 = dot(normal1.xyz, tapVec);\n"
@@ -133,12 +347,12 @@ namespace cmft
         "            const float dotProduct4 = dot(normal4.xyz, tapVec);\n"
         "            const float dotProduct5 = dot(normal5.xyz, tapVec);\n"
         "\n"
-        "            if (dotProduct0 >= _specularAngle) { colorWeight += read_imagef(_srcData0, s_imageSampler, coord) * normal0.w * native_powr(dotProduct0, _specularPower); }\n"
-        "            if (dotProduct1 >= _specularAngle) { colorWeight += read_imagef(_srcData1, s_imageSampler, coord) * normal1.w * native_powr(dotProduct1, _specularPower); }\n"
-        "            if (dotProduct2 >= _specularAngle) { colorWeight += read_imagef(_srcData2, s_imageSampler, coord) * normal2.w * native_powr(dotProduct2, _specularPower); }\n"
-        "            if (dotProduct3 >= _specularAngle) { colorWeight += read_imagef(_srcData3, s_imageSampler, coord) * normal3.w * native_powr(dotProduct3, _specularPower); }\n"
-        "            if (dotProduct4 >= _specularAngle) { colorWeight += read_imagef(_srcData4, s_imageSampler, coord) * normal4.w * native_powr(dotProduct4, _specularPower); }\n"
-        "            if (dotProduct5 >= _specularAngle) { colorWeight += read_imagef(_srcData5, s_imageSampler, coord) * normal5.w * native_powr(dotProduct5, _specularPower); }\n"
+        "            if (dotProduct0 >= SPECULAR_ANGLE) { colorWeight += READ_SRC(_srcData0, coord, 0, SRC_FACE_SIZE) * normal0.w * LOBE_WEIGHT(dotProduct0, SPECULAR_POWER); }\n"
+        "            if (dotProduct1 >= SPECULAR_ANGLE) { colorWeight += READ_SRC(_srcData1, coord, 1, SRC_FACE_SIZE) * normal1.w * LOBE_WEIGHT(dotProduct1, SPECULAR_POWER); }\n"
+        "            if (dotProduct2 >= SPECULAR_ANGLE) { colorWeight += READ_SRC(_srcData2, coord, 2, SRC_FACE_SIZE) * normal2.w * LOBE_WEIGHT(dotProduct2, SPECULAR_POWER); }\n"
+        "            if (dotProduct3 >= SPECULAR_ANGLE) { colorWeight += READ_SRC(_srcData3, coord, 3, SRC_FACE_SIZE) * normal3.w * LOBE_WEIGHT(dotProduct3, SPECULAR_POWER); }\n"
+        "            if (dotProduct4 >= SPECULAR_ANGLE) { colorWeight += READ_SRC(_srcData4, coord, 4, SRC_FACE_SIZE) * normal4.w * LOBE_WEIGHT(dotProduct4, SPECULAR_POWER); }\n"
+        "            if (dotProduct5 >= SPECULAR_ANGLE) { colorWeight += READ_SRC(_srcData5, coord, 5, SRC_FACE_SIZE) * normal5.w * LOBE_WEIGHT(dotProduct5, SPECULAR_POWER); }\n"
         "        }\n"
         "    }\n"
         "\n"
@@ -150,6 +364,469 @@ namespace cmft
         "    const int2 dst = { column, row };\n"
         "    write_imagef(_out, dst, colorWeight);\n"
         "}\n"
+        "\n"
+        "static float4 processFilterArea(float4 _colorWeight\n"
+        "                              , float4 _area\n"
+        "                              , float _faceSize_MinusOne\n"
+        "                              , float3 _tapVec\n"
+        "                              , float _specularPower\n"
+        "                              , float _specularAngle\n"
+        "                              , __read_only image2d_t _srcData\n"
+        "                              , __read_only image2d_t _normalSolidAngle\n"
+        "                              , int8_t _faceId\n"
+        "                              , int32_t _srcFaceSize\n"
+        "                              LOBE_TABLE_ARG\n"
+        "                              )\n"
+        "{\n"
+        "    if (_area.x > _area.z || _area.y > _area.w)\n"
+        "    {\n"
+        "        return _colorWeight;\n"
+        "    }\n"
+        "\n"
+        "    const int32_t minX = (int32_t)(_area.x * _faceSize_MinusOne);\n"
+        "    const int32_t minY = (int32_t)(_area.y * _faceSize_MinusOne);\n"
+        "    const int32_t maxX = (int32_t)(_area.z * _faceSize_MinusOne);\n"
+        "    const int32_t maxY = (int32_t)(_area.w * _faceSize_MinusOne);\n"
+        "\n"
+        "    for (int32_t yy = minY; yy <= maxY; ++yy)\n"
+        "    {\n"
+        "        for (int32_t xx = minX; xx <= maxX; ++xx)\n"
+        "        {\n"
+        "            const int2 coord = { xx, yy };\n"
+        "            const float4 normal = READ_NORMAL(_normalSolidAngle, coord, _faceId, _srcFaceSize);\n"
+        "            const float dotProduct = dot(normal.xyz, _tapVec);\n"
+        "            if (dotProduct >= _specularAngle)\n"
+        "            {\n"
+        "                const float4 color = READ_SRC(_srcData, coord, _faceId, _srcFaceSize);\n"
+        "                const float weight = normal.w * LOBE_WEIGHT(dotProduct, _specularPower);\n"
+        "                _colorWeight.xyz += color.xyz * weight;\n"
+        "                _colorWeight.w   += weight;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    return _colorWeight;\n"
+        "}\n"
+        "\n"
+        "// Same as radianceFilter but iterates only over the filter area of each face, the same way CPU path does.\n"
+        "__kernel void radianceFilterBounded(__write_only image2d_t _out\n"
+        "                                  , float _specularPower\n"
+        "                                  , float _specularAngle\n"
+        "                                  , int32_t _dstFaceSize\n"
+        "                                  , int8_t _faceId\n"
+        "                                  , int32_t _srcFaceSize\n"
+        "                                  , __read_only image2d_t _srcData0\n"
+        "                                  , __read_only image2d_t _srcData1\n"
+        "                                  , __read_only image2d_t _srcData2\n"
+        "                                  , __read_only image2d_t _srcData3\n"
+        "                                  , __read_only image2d_t _srcData4\n"
+        "                                  , __read_only image2d_t _srcData5\n"
+        "                                  , __read_only image2d_t _normalSolidAngle0\n"
+        "                                  , __read_only image2d_t _normalSolidAngle1\n"
+        "                                  , __read_only image2d_t _normalSolidAngle2\n"
+        "                                  , __read_only image2d_t _normalSolidAngle3\n"
+        "                                  , __read_only image2d_t _normalSolidAngle4\n"
+        "                                  , __read_only image2d_t _normalSolidAngle5\n"
+        "                                  , float _filterSize\n"
+        "                                  LOBE_TABLE_ARG\n"
+        "                                  )\n"
+        "{\n"
+        "    const int row    = get_global_id(0);\n"
+        "    const int column = get_global_id(1);\n"
+        "\n"
+        "    const float invDstFaceSize_Mul2 = 2.0f/DST_FACE_SIZE;\n"
+        "    const float vv = ((float)row    + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
+        "    const float uu = ((float)column + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
+        "    const float3 tapVec = texelCoordToVec(uu, vv, _faceId, DST_FACE_SIZE);\n"
+        "\n"
+        "    float4 filterArea[6];\n"
+        "    const int8_t hitFaceIdx = determineFilterArea(filterArea, tapVec, FILTER_SIZE);\n"
+        "\n"
+        "    const float faceSize_MinusOne = (float)(SRC_FACE_SIZE-1);\n"
+        "    float4 colorWeight = { 0.0f, 0.0f, 0.0f, 0.0f };\n"
+        "    colorWeight = processFilterArea(colorWeight, filterArea[0], faceSize_MinusOne, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData0, _normalSolidAngle0, 0, SRC_FACE_SIZE LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterArea(colorWeight, filterArea[1], faceSize_MinusOne, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData1, _normalSolidAngle1, 1, SRC_FACE_SIZE LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterArea(colorWeight, filterArea[2], faceSize_MinusOne, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData2, _normalSolidAngle2, 2, SRC_FACE_SIZE LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterArea(colorWeight, filterArea[3], faceSize_MinusOne, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData3, _normalSolidAngle3, 3, SRC_FACE_SIZE LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterArea(colorWeight, filterArea[4], faceSize_MinusOne, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData4, _normalSolidAngle4, 4, SRC_FACE_SIZE LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterArea(colorWeight, filterArea[5], faceSize_MinusOne, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData5, _normalSolidAngle5, 5, SRC_FACE_SIZE LOBE_TABLE_PASS);\n"
+        "\n"
+        "    if (0.0f != colorWeight.w)\n"
+        "    {\n"
+        "        colorWeight /= colorWeight.w;\n"
+        "    }\n"
+        "    // Result of convolution is zero, take a direct color sample.\n"
+        "    else\n"
+        "    {\n"
+        "        float hitU, hitV;\n"
+        "        vecToTexelCoord(&hitU, &hitV, tapVec);\n"
+        "        const int2 coord = { (int32_t)(hitU*(float)SRC_FACE_SIZE), (int32_t)(hitV*(float)SRC_FACE_SIZE) };\n"
+        "        switch (hitFaceIdx)\n"
+        "        {\n"
+        "        case 0:  colorWeight = READ_SRC(_srcData0, coord, 0, SRC_FACE_SIZE); break;\n"
+        "        case 1:  colorWeight = READ_SRC(_srcData1, coord, 1, SRC_FACE_SIZE); break;\n"
+        "        case 2:  colorWeight = READ_SRC(_srcData2, coord, 2, SRC_FACE_SIZE); break;\n"
+        "        case 3:  colorWeight = READ_SRC(_srcData3, coord, 3, SRC_FACE_SIZE); break;\n"
+        "        case 4:  colorWeight = READ_SRC(_srcData4, coord, 4, SRC_FACE_SIZE); break;\n"
+        "        default: colorWeight = READ_SRC(_srcData5, coord, 5, SRC_FACE_SIZE); break;\n"
+        "        }\n"
+        "        colorWeight.w = 1.0f;\n"
+        "    }\n"
+        "\n"
+        "    const int2 dst = { column, row };\n"
+        "    write_imagef(_out, dst, colorWeight);\n"
+        "}\n"
+        "\n"
+        "// Tiled variant of radianceFilterBounded for devices with dedicated local memory.\n"
+        "// Work-group iterates over the union of filter areas of its work items. Source blocks are loaded cooperatively into local memory\n"
+        "// and each work item accumulates texels of the block that are inside its own filter area, so the same texels contribute as with the bounded kernel.\n"
+        "#define TILE_SIZE 8\n"
+        "#define SRC_TILE_SIZE 16\n"
+        "\n"
+        "static float4 processFilterAreaTiled(float4 _colorWeight\n"
+        "                                   , int4 _area\n"
+        "                                   , int4 _groupArea\n"
+        "                                   , int32_t _srcFaceSize\n"
+        "                                   , float3 _tapVec\n"
+        "                                   , float _specularPower\n"
+        "                                   , float _specularAngle\n"
+        "                                   , __read_only image2d_t _srcData\n"
+        "                                   , __read_only image2d_t _normalSolidAngle\n"
+        "                                   , __local float4* _tileColor\n"
+        "                                   , __local float4* _tileNormal\n"
+        "                                   , int8_t _faceId\n"
+        "                                   LOBE_TABLE_ARG\n"
+        "                                   )\n"
+        "{\n"
+        "    const int32_t localIdx = get_local_id(0)*TILE_SIZE + get_local_id(1);\n"
+        "\n"
+        "    // Loop bounds are the same for the whole work-group, so all work items reach the barriers.\n"
+        "    for (int32_t tileY = _groupArea.y; tileY <= _groupArea.w; tileY += SRC_TILE_SIZE)\n"
+        "    {\n"
+        "        for (int32_t tileX = _groupArea.x; tileX <= _groupArea.z; tileX += SRC_TILE_SIZE)\n"
+        "        {\n"
+        "            for (int32_t ii = localIdx; ii < SRC_TILE_SIZE*SRC_TILE_SIZE; ii += TILE_SIZE*TILE_SIZE)\n"
+        "            {\n"
+        "                const int2 coord = { min(tileX + ii%SRC_TILE_SIZE, _srcFaceSize-1), min(tileY + ii/SRC_TILE_SIZE, _srcFaceSize-1) };\n"
+        "                _tileNormal[ii] = READ_NORMAL(_normalSolidAngle, coord, _faceId, _srcFaceSize);\n"
+        "                _tileColor[ii]  = READ_SRC(_srcData, coord, _faceId, _srcFaceSize);\n"
+        "            }\n"
+        "            barrier(CLK_LOCAL_MEM_FENCE);\n"
+        "\n"
+        "            const int32_t minX = max(_area.x, tileX);\n"
+        "            const int32_t minY = max(_area.y, tileY);\n"
+        "            const int32_t maxX = min(_area.z, tileX + SRC_TILE_SIZE-1);\n"
+        "            const int32_t maxY = min(_area.w, tileY + SRC_TILE_SIZE-1);\n"
+        "            for (int32_t yy = minY; yy <= maxY; ++yy)\n"
+        "            {\n"
+        "                for (int32_t xx = minX; xx <= maxX; ++xx)\n"
+        "                {\n"
+        "                    const int32_t idx = (yy-tileY)*SRC_TILE_SIZE + (xx-tileX);\n"
+        "                    const float4 normal = _tileNormal[idx];\n"
+        "                    const float dotProduct = dot(normal.xyz, _tapVec);\n"
+        "                    if (dotProduct >= _specularAngle)\n"
+        "                    {\n"
+        "                        const float4 color = _tileColor[idx];\n"
+        "                        const float weight = normal.w * LOBE_WEIGHT(dotProduct, _specularPower);\n"
+        "                        _colorWeight.xyz += color.xyz * weight;\n"
+        "                        _colorWeight.w   += weight;\n"
+        "                    }\n"
+        "                }\n"
+        "            }\n"
+        "            barrier(CLK_LOCAL_MEM_FENCE);\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    return _colorWeight;\n"
+        "}\n"
+        "\n"
+        "__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))\n"
+        "void radianceFilterTiled(__write_only image2d_t _out\n"
+        "                       , float _specularPower\n"
+        "                       , float _specularAngle\n"
+        "                       , int32_t _dstFaceSize\n"
+        "                       , int8_t _faceId\n"
+        "                       , int32_t _srcFaceSize\n"
+        "                       , __read_only image2d_t _srcData0\n"
+        "                       , __read_only image2d_t _srcData1\n"
+        "                       , __read_only image2d_t _srcData2\n"
+        "                       , __read_only image2d_t _srcData3\n"
+        "                       , __read_only image2d_t _srcData4\n"
+        "                       , __read_only image2d_t _srcData5\n"
+        "                       , __read_only image2d_t _normalSolidAngle0\n"
+        "                       , __read_only image2d_t _normalSolidAngle1\n"
+        "                       , __read_only image2d_t _normalSolidAngle2\n"
+        "                       , __read_only image2d_t _normalSolidAngle3\n"
+        "                       , __read_only image2d_t _normalSolidAngle4\n"
+        "                       , __read_only image2d_t _normalSolidAngle5\n"
+        "                       , float _filterSize\n"
+        "                       LOBE_TABLE_ARG\n"
+        "                       )\n"
+        "{\n"
+        "    __local float4 tileColor[SRC_TILE_SIZE*SRC_TILE_SIZE];\n"
+        "    __local float4 tileNormal[SRC_TILE_SIZE*SRC_TILE_SIZE];\n"
+        "    __local int32_t groupArea[6*4];\n"
+        "\n"
+        "    // Global size is rounded up to the work-group size, work items outside of the face only help with loading.\n"
+        "    const int row    = get_global_id(0);\n"
+        "    const int column = get_global_id(1);\n"
+        "    const bool valid = (row < DST_FACE_SIZE && column < DST_FACE_SIZE);\n"
+        "\n"
+        "    const float invDstFaceSize_Mul2 = 2.0f/DST_FACE_SIZE;\n"
+        "    const float vv = ((float)row    + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
+        "    const float uu = ((float)column + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
+        "    const float3 tapVec = texelCoordToVec(uu, vv, _faceId, DST_FACE_SIZE);\n"
+        "\n"
+        "    float4 filterArea[6];\n"
+        "    const int8_t hitFaceIdx = determineFilterArea(filterArea, tapVec, FILTER_SIZE);\n"
+        "\n"
+        "    // Texel bounds of filter areas, the same as in processFilterArea(). Empty area is (INT_MAX, INT_MAX, -1, -1).\n"
+        "    const float faceSize_MinusOne = (float)(SRC_FACE_SIZE-1);\n"
+        "    int4 area[6];\n"
+        "    for (int8_t face = 0; face < 6; ++face)\n"
+        "    {\n"
+        "        const float4 curr = filterArea[face];\n"
+        "        if (!valid || curr.x > curr.z || curr.y > curr.w)\n"
+        "        {\n"
+        "            const int4 empty = { INT_MAX, INT_MAX, -1, -1 };\n"
+        "            area[face] = empty;\n"
+        "        }\n"
+        "        else\n"
+        "        {\n"
+        "            const int4 bounds = { (int32_t)(curr.x * faceSize_MinusOne)\n"
+        "                                , (int32_t)(curr.y * faceSize_MinusOne)\n"
+        "                                , (int32_t)(curr.z * faceSize_MinusOne)\n"
+        "                                , (int32_t)(curr.w * faceSize_MinusOne)\n"
+        "                                };\n"
+        "            area[face] = bounds;\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    // Union of filter areas of the work-group.\n"
+        "    const int32_t localIdx = get_local_id(0)*TILE_SIZE + get_local_id(1);\n"
+        "    if (localIdx < 6*4)\n"
+        "    {\n"
+        "        groupArea[localIdx] = (localIdx%4 < 2) ? INT_MAX : -1;\n"
+        "    }\n"
+        "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+        "\n"
+        "    for (int8_t face = 0; face < 6; ++face)\n"
+        "    {\n"
+        "        if (area[face].x <= area[face].z)\n"
+        "        {\n"
+        "            atomic_min(&groupArea[face*4+0], area[face].x);\n"
+        "            atomic_min(&groupArea[face*4+1], area[face].y);\n"
+        "            atomic_max(&groupArea[face*4+2], area[face].z);\n"
+        "            atomic_max(&groupArea[face*4+3], area[face].w);\n"
+        "        }\n"
+        "    }\n"
+        "    barrier(CLK_LOCAL_MEM_FENCE);\n"
+        "\n"
+        "    float4 colorWeight = { 0.0f, 0.0f, 0.0f, 0.0f };\n"
+        "    colorWeight = processFilterAreaTiled(colorWeight, area[0], vload4(0, groupArea), SRC_FACE_SIZE, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData0, _normalSolidAngle0, tileColor, tileNormal, 0 LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterAreaTiled(colorWeight, area[1], vload4(1, groupArea), SRC_FACE_SIZE, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData1, _normalSolidAngle1, tileColor, tileNormal, 1 LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterAreaTiled(colorWeight, area[2], vload4(2, groupArea), SRC_FACE_SIZE, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData2, _normalSolidAngle2, tileColor, tileNormal, 2 LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterAreaTiled(colorWeight, area[3], vload4(3, groupArea), SRC_FACE_SIZE, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData3, _normalSolidAngle3, tileColor, tileNormal, 3 LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterAreaTiled(colorWeight, area[4], vload4(4, groupArea), SRC_FACE_SIZE, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData4, _normalSolidAngle4, tileColor, tileNormal, 4 LOBE_TABLE_PASS);\n"
+        "    colorWeight = processFilterAreaTiled(colorWeight, area[5], vload4(5, groupArea), SRC_FACE_SIZE, tapVec, SPECULAR_POWER, SPECULAR_ANGLE, _srcData5, _normalSolidAngle5, tileColor, tileNormal, 5 LOBE_TABLE_PASS);\n"
+        "\n"
+        "    if (!valid)\n"
+        "    {\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    if (0.0f != colorWeight.w)\n"
+        "    {\n"
+        "        colorWeight /= colorWeight.w;\n"
+        "    }\n"
+        "    // Result of convolution is zero, take a direct color sample.\n"
+        "    else\n"
+        "    {\n"
+        "        float hitU, hitV;\n"
+        "        vecToTexelCoord(&hitU, &hitV, tapVec);\n"
+        "        const int2 coord = { (int32_t)(hitU*(float)SRC_FACE_SIZE), (int32_t)(hitV*(float)SRC_FACE_SIZE) };\n"
+        "        switch (hitFaceIdx)\n"
+        "        {\n"
+        "        case 0:  colorWeight = READ_SRC(_srcData0, coord, 0, SRC_FACE_SIZE); break;\n"
+        "        case 1:  colorWeight = READ_SRC(_srcData1, coord, 1, SRC_FACE_SIZE); break;\n"
+        "        case 2:  colorWeight = READ_SRC(_srcData2, coord, 2, SRC_FACE_SIZE); break;\n"
+        "        case 3:  colorWeight = READ_SRC(_srcData3, coord, 3, SRC_FACE_SIZE); break;\n"
+        "        case 4:  colorWeight = READ_SRC(_srcData4, coord, 4, SRC_FACE_SIZE); break;\n"
+        "        default: colorWeight = READ_SRC(_srcData5, coord, 5, SRC_FACE_SIZE); break;\n"
+        "        }\n"
+        "        colorWeight.w = 1.0f;\n"
+        "    }\n"
+        "\n"
+        "    const int2 dst = { column, row };\n"
+        "    write_imagef(_out, dst, colorWeight);\n"
+        "}\n"
+        "\n"
+        "// Task of radianceFilterBatch, one face of one mip of a cubemap in the source atlas. Has to match RadianceBatchTask in cubemapfilter.cpp.\n"
+        "typedef struct\n"
+        "{\n"
+        "    int32_t m_texelBegin;  // First work item of the task, tasks are sorted by it.\n"
+        "    int32_t m_srcCell;     // Atlas cell of face 0 of the source, other faces follow.\n"
+        "    int32_t m_srcFaceSize;\n"
+        "    int32_t m_dstFaceSize;\n"
+        "    int32_t m_face;\n"
+        "    float m_specularPower;\n"
+        "    float m_specularAngle;\n"
+        "    float m_filterSize;\n"
+        "} BatchTask;\n"
+        "\n"
+        "// Same as processFilterArea with texel normals computed and source face read from an atlas cell at _cellOrigin.\n"
+        "static float4 processFilterAreaBatch(float4 _colorWeight\n"
+        "                                   , float4 _area\n"
+        "                                   , int32_t _srcFaceSize\n"
+        "                                   , float3 _tapVec\n"
+        "                                   , float _specularPower\n"
+        "                                   , float _specularAngle\n"
+        "                                   , __read_only image2d_t _atlas\n"
+        "                                   , int2 _cellOrigin\n"
+        "                                   , int8_t _faceId\n"
+        "                                   )\n"
+        "{\n"
+        "    if (_area.x > _area.z || _area.y > _area.w)\n"
+        "    {\n"
+        "        return _colorWeight;\n"
+        "    }\n"
+        "\n"
+        "    const float faceSize_MinusOne = (float)(_srcFaceSize-1);\n"
+        "    const int32_t minX = (int32_t)(_area.x * faceSize_MinusOne);\n"
+        "    const int32_t minY = (int32_t)(_area.y * faceSize_MinusOne);\n"
+        "    const int32_t maxX = (int32_t)(_area.z * faceSize_MinusOne);\n"
+        "    const int32_t maxY = (int32_t)(_area.w * faceSize_MinusOne);\n"
+        "\n"
+        "    for (int32_t yy = minY; yy <= maxY; ++yy)\n"
+        "    {\n"
+        "        for (int32_t xx = minX; xx <= maxX; ++xx)\n"
+        "        {\n"
+        "            const int2 coord = { xx, yy };\n"
+        "            const float4 normal = texelNormalSolidAngle(coord, _faceId, _srcFaceSize);\n"
+        "            const float dotProduct = dot(normal.xyz, _tapVec);\n"
+        "            if (dotProduct >= _specularAngle)\n"
+        "            {\n"
+        "                const float4 color = read_imagef(_atlas, s_imageSampler, _cellOrigin + coord);\n"
+        "                const float weight = normal.w * native_powr(dotProduct, _specularPower);\n"
+        "                _colorWeight.xyz += color.xyz * weight;\n"
+        "                _colorWeight.w   += weight;\n"
+        "            }\n"
+        "        }\n"
+        "    }\n"
+        "\n"
+        "    return _colorWeight;\n"
+        "}\n"
+        "\n"
+        "// Filters faces of many small cubemaps and mips in a single dispatch. Sources are stored in one atlas of square cells,\n"
+        "// each work item finds its task by binary search over task offsets and writes one texel to _out at its global index.\n"
+        "__kernel void radianceFilterBatch(__global float4* _out\n"
+        "                                , __global const BatchTask* _tasks\n"
+        "                                , int32_t _numTasks\n"
+        "                                , int32_t _numTexels\n"
+        "                                , int32_t _cellSize\n"
+        "                                , int32_t _cellsPerRow\n"
+        "                                , __read_only image2d_t _atlas\n"
+        "                                )\n"
+        "{\n"
+        "    const int32_t idx = get_global_id(0);\n"
+        "    if (idx >= _numTexels)\n"
+        "    {\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    int32_t lo = 0;\n"
+        "    int32_t hi = _numTasks-1;\n"
+        "    while (lo < hi)\n"
+        "    {\n"
+        "        const int32_t mid = (lo + hi + 1)/2;\n"
+        "        if (_tasks[mid].m_texelBegin <= idx) { lo = mid;    }\n"
+        "        else                                 { hi = mid-1;  }\n"
+        "    }\n"
+        "    const BatchTask task = _tasks[lo];\n"
+        "\n"
+        "    const int32_t texel  = idx - task.m_texelBegin;\n"
+        "    const int32_t row    = texel / task.m_dstFaceSize;\n"
+        "    const int32_t column = texel - row*task.m_dstFaceSize;\n"
+        "\n"
+        "    const float invDstFaceSize_Mul2 = 2.0f/(float)task.m_dstFaceSize;\n"
+        "    const float vv = ((float)row    + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
+        "    const float uu = ((float)column + 0.5f) * invDstFaceSize_Mul2 - 1.0f;\n"
+        "    const float3 tapVec = texelCoordToVec(uu, vv, (int8_t)task.m_face, task.m_dstFaceSize);\n"
+        "\n"
+        "    float4 filterArea[6];\n"
+        "    const int8_t hitFaceIdx = determineFilterArea(filterArea, tapVec, task.m_filterSize);\n"
+        "\n"
+        "    int2 cellOrigin[6];\n"
+        "    for (int8_t face = 0; face < 6; ++face)\n"
+        "    {\n"
+        "        const int32_t cell = task.m_srcCell + face;\n"
+        "        const int2 origin = { (cell % _cellsPerRow)*_cellSize, (cell / _cellsPerRow)*_cellSize };\n"
+        "        cellOrigin[face] = origin;\n"
+        "    }\n"
+        "\n"
+        "    float4 colorWeight = { 0.0f, 0.0f, 0.0f, 0.0f };\n"
+        "    for (int8_t face = 0; face < 6; ++face)\n"
+        "    {\n"
+        "        colorWeight = processFilterAreaBatch(colorWeight, filterArea[face], task.m_srcFaceSize, tapVec, task.m_specularPower, task.m_specularAngle, _atlas, cellOrigin[face], face);\n"
+        "    }\n"
+        "\n"
+        "    if (0.0f != colorWeight.w)\n"
+        "    {\n"
+        "        colorWeight /= colorWeight.w;\n"
+        "    }\n"
+        "    // Result of convolution is zero, take a direct color sample.\n"
+        "    else\n"
+        "    {\n"
+        "        float hitU, hitV;\n"
+        "        vecToTexelCoord(&hitU, &hitV, tapVec);\n"
+        "        const int2 coord = { (int32_t)(hitU*(float)task.m_srcFaceSize), (int32_t)(hitV*(float)task.m_srcFaceSize) };\n"
+        "        colorWeight = read_imagef(_atlas, s_imageSampler, cellOrigin[hitFaceIdx] + coord);\n"
+        "        colorWeight.w = 1.0f;\n"
+        "    }\n"
+        "\n"
+        "    _out[idx] = colorWeight;\n"
+        "}\n"
+        "\n"
+        "// Packs filtered face into 4 bytes per texel, so only packed data is read back.\n"
+        "// Formats: 0 - BGRA8, 1 - RGBA8, 2 - RGBE. Rounding is the same as in host conversions.\n"
+        "__kernel void radianceEncode(__read_only image2d_t _in\n"
+        "                           , __global uchar4* _out\n"
+        "                           , int32_t _faceSize\n"
+        "                           , uint8_t _format\n"
+        "                           )\n"
+        "{\n"
+        "    const int32_t column = get_global_id(0);\n"
+        "    const int32_t row    = get_global_id(1);\n"
+        "    const int2 coord = { column, row };\n"
+        "    const float4 color = read_imagef(_in, s_imageSampler, coord);\n"
+        "\n"
+        "    uchar4 packed = { 0, 0, 0, 0 };\n"
+        "    if (2 == _format)\n"
+        "    {\n"
+        "        const float maxVal = fmin(fmax(color.x, fmax(color.y, color.z)), 1.70141183e+38f);\n"
+        "        if (maxVal > 0.0f)\n"
+        "        {\n"
+        "            // Exponent is ceil(log2(maxVal)), taken from float bits.\n"
+        "            const uint32_t bits = as_uint(maxVal);\n"
+        "            const int32_t exp = (int32_t)(bits>>23) - 127 + (0 != (bits&0x7fffff));\n"
+        "            const float toRgb8 = 255.0f * as_float((uint32_t)(127-exp)<<23);\n"
+        "            packed.x = (uchar)fmin(fmax(color.x*toRgb8, 0.0f), 255.0f);\n"
+        "            packed.y = (uchar)fmin(fmax(color.y*toRgb8, 0.0f), 255.0f);\n"
+        "            packed.z = (uchar)fmin(fmax(color.z*toRgb8, 0.0f), 255.0f);\n"
+        "            packed.w = (uchar)(exp+128);\n"
+        "        }\n"
+        "    }\n"
+        "    else\n"
+        "    {\n"
+        "        const float4 unorm = clamp(color, 0.0f, 1.0f) * 255.0f;\n"
+        "        packed.x = (uchar)(0 == _format ? unorm.z : unorm.x);\n"
+        "        packed.y = (uchar)unorm.y;\n"
+        "        packed.z = (uchar)(0 == _format ? unorm.x : unorm.z);\n"
+        "        packed.w = (uchar)unorm.w;\n"
+        "    }\n"
+        "\n"
+        "    _out[row*_faceSize + column] = packed;\n"
+        "}\n"
     };
 
 } // namespace cmft
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_RESAMPLEPROGRAM_H_HEADER_GUARD
+#define CMFT_RESAMPLEPROGRAM_H_HEADER_GUARD
+
+namespace cmft
+{
+    // Device versions of imageCubemapFromLatLong() and of the box filtered imageGenerateMipMapChain().
+    // Operations are done in the same order as on the host, contraction is off so that results stay close to host ones.
+    static const char s_resampleProgramSource[] =
+    {
+        "#pragma OPENCL FP_CONTRACT OFF\n"
+        "\n"
+        "typedef unsigned char  uint8_t;\n"
+        "typedef unsigned short uint16_t;\n"
+        "typedef unsigned int   uint32_t;\n"
+        "\n"
+        "typedef char  int8_t;\n"
+        "typedef short int16_t;\n"
+        "typedef int   int32_t;\n"
+        "\n"
+        "__constant float3 s_faceUvVectors[6][3] =\n"
+        "{\n"
+        "    { // +x face\n"
+        "        {  0.0f,  0.0f, -1.0f }, // u -> -z\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        {  1.0f,  0.0f,  0.0f }, // +x face\n"
+        "    },\n"
+        "    { // -x face\n"
+        "        {  0.0f,  0.0f,  1.0f }, // u -> +z\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        { -1.0f,  0.0f,  0.0f }, // -x face\n"
+        "    },\n"
+        "    { // +y face\n"
+        "        {  1.0f,  0.0f,  0.0f }, // u -> +x\n"
+        "        {  0.0f,  0.0f,  1.0f }, // v -> +z\n"
+        "        {  0.0f,  1.0f,  0.0f }, // +y face\n"
+        "    },\n"
+        "    { // -y face\n"
+        "        {  1.0f,  0.0f,  0.0f }, // u -> +x\n"
+        "        {  0.0f,  0.0f, -1.0f }, // v -> -z\n"
+        "        {  0.0f, -1.0f,  0.0f }, // -y face\n"
+        "    },\n"
+        "    { // +z face\n"
+        "        {  1.0f,  0.0f,  0.0f }, // u -> +x\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        {  0.0f,  0.0f,  1.0f }, // +z face\n"
+        "    },\n"
+        "    { // -z face\n"
+        "        { -1.0f,  0.0f,  0.0f }, // u -> -x\n"
+        "        {  0.0f, -1.0f,  0.0f }, // v -> -y\n"
+        "        {  0.0f,  0.0f, -1.0f }, // -z face\n"
+        "    }\n"
+        "};\n"
+        "\n"
+        "// Same polynomial atan2 and acos approximations as latLongFromVec4() on the host.\n"
+        "static float2 latLongFromVec(float3 _vec)\n"
+        "{\n"
+        "    const float pi     = 3.14159265358979f;\n"
+        "    const float halfPi = 1.57079632679490f;\n"
+        "\n"
+        "    const float yy = _vec.z;\n"
+        "    const float xx = -_vec.x;\n"
+        "    const float ax = fabs(xx);\n"
+        "    const float ay = fabs(yy);\n"
+        "    const float tt = fmin(ax, ay) / fmax(fmax(ax, ay), 1e-30f);\n"
+        "    const float t2 = tt*tt;\n"
+        "\n"
+        "    float atanPoly = 0.0028662257f;\n"
+        "    atanPoly = atanPoly*t2 - 0.0161657367f;\n"
+        "    atanPoly = atanPoly*t2 + 0.0429096138f;\n"
+        "    atanPoly = atanPoly*t2 - 0.0752896400f;\n"
+        "    atanPoly = atanPoly*t2 + 0.1065626393f;\n"
+        "    atanPoly = atanPoly*t2 - 0.1420889944f;\n"
+        "    atanPoly = atanPoly*t2 + 0.1999355085f;\n"
+        "    atanPoly = atanPoly*t2 - 0.3333314528f;\n"
+        "    atanPoly = atanPoly*t2 + 1.0f;\n"
+        "    atanPoly = atanPoly*tt;\n"
+        "\n"
+        "    atanPoly = (ay > ax)     ? halfPi - atanPoly : atanPoly;\n"
+        "    atanPoly = signbit(xx)   ? pi - atanPoly     : atanPoly;\n"
+        "    const float phi = signbit(yy) ? -atanPoly : atanPoly;\n"
+        "\n"
+        "    const float ty = fmin(fabs(_vec.y), 1.0f);\n"
+        "\n"
+        "    float acosPoly = -0.0012624911f;\n"
+        "    acosPoly = acosPoly*ty + 0.0066700901f;\n"
+        "    acosPoly = acosPoly*ty - 0.0170881256f;\n"
+        "    acosPoly = acosPoly*ty + 0.0308918810f;\n"
+        "    acosPoly = acosPoly*ty - 0.0501743046f;\n"
+        "    acosPoly = acosPoly*ty + 0.0889789874f;\n"
+        "    acosPoly = acosPoly*ty - 0.2145988016f;\n"
+        "    acosPoly = acosPoly*ty + 1.5707963050f;\n"
+        "    acosPoly = acosPoly*sqrt(1.0f - ty);\n"
+        "\n"
+        "    const float theta = (_vec.y < 0.0f) ? pi - acosPoly : acosPoly;\n"
+        "\n"
+        "    float2 uv;\n"
+        "    uv.x = fmin((pi + phi)*0.15915494309f, 1.0f);\n"
+        "    uv.y = fmin(theta*0.31830988618f, 1.0f);\n"
+        "    return uv;\n"
+        "}\n"
+        "\n"
+        "// Faces of a cubemap from rgba32f latlong _src, third dimension goes over faces starting from _faceId.\n"
+        "// _warp is the edge fixup factor of texelCoordWarp().\n"
+        "__kernel void cubemapFromLatLong(__global float4* _dst\n"
+        "                               , __global const float4* _src\n"
+        "                               , int32_t _srcWidth\n"
+        "                               , int32_t _srcHeight\n"
+        "                               , int32_t _faceSize\n"
+        "                               , float _warp\n"
+        "                               , int8_t _faceId\n"
+        "                               , int32_t _bilinear\n"
+        "                               )\n"
+        "{\n"
+        "    const int32_t xx = get_global_id(0);\n"
+        "    const int32_t yy = get_global_id(1);\n"
+        "    const int32_t zz = get_global_id(2);\n"
+        "    const int8_t faceId = _faceId + (int8_t)zz;\n"
+        "\n"
+        "    const float invFaceSize = 1.0f/(float)_faceSize;\n"
+        "    const float cu = 2.0f*(float)xx*invFaceSize - 1.0f;\n"
+        "    const float cv = 2.0f*(float)yy*invFaceSize - 1.0f;\n"
+        "    const float uu = _warp*(cu*cu*cu) + cu;\n"
+        "    const float vv = _warp*(cv*cv*cv) + cv;\n"
+        "\n"
+        "    const float3 vec = (s_faceUvVectors[faceId][0]*uu + s_faceUvVectors[faceId][1]*vv) + s_faceUvVectors[faceId][2];\n"
+        "    const float len = sqrt((vec.x*vec.x + vec.y*vec.y) + vec.z*vec.z);\n"
+        "    const float invLen = 1.0f/len;\n"
+        "    const float2 uv = latLongFromVec(vec*invLen);\n"
+        "\n"
+        "    const float xSrc = uv.x*((float)_srcWidth - 1.0f);\n"
+        "    const float ySrc = uv.y*((float)_srcHeight - 1.0f);\n"
+        "    const int32_t x0 = (int32_t)xSrc;\n"
+        "    const int32_t y0 = (int32_t)ySrc;\n"
+        "\n"
+        "    float4 rgba;\n"
+        "    if (_bilinear)\n"
+        "    {\n"
+        "        const int32_t x1 = min(x0+1, _srcWidth-1);\n"
+        "        const int32_t y1 = min(y0+1, _srcHeight-1);\n"
+        "\n"
+        "        const float tx = xSrc - (float)x0;\n"
+        "        const float ty = ySrc - (float)y0;\n"
+        "        const float invTx = 1.0f - tx;\n"
+        "        const float invTy = 1.0f - ty;\n"
+        "\n"
+        "        const float4 p0 = _src[y0*_srcWidth + x0] * (invTx*invTy);\n"
+        "        const float4 p1 = _src[y0*_srcWidth + x1] * (   tx*invTy);\n"
+        "        const float4 p2 = _src[y1*_srcWidth + x0] * (invTx*   ty);\n"
+        "        const float4 p3 = _src[y1*_srcWidth + x1] * (   tx*   ty);\n"
+        "        rgba = ((p0 + p1) + p2) + p3;\n"
+        "    }\n"
+        "    else\n"
+        "    {\n"
+        "        rgba = _src[y0*_srcWidth + x0];\n"
+        "    }\n"
+        "    rgba.w = 1.0f;\n"
+        "\n"
+        "    _dst[(zz*_faceSize + yy)*_faceSize + xx] = rgba;\n"
+        "}\n"
+        "\n"
+        "// 2x2 box downsample of one face. Offsets are in texels, _width is the width of the destination mip.\n"
+        "__kernel void mipBox(__global float4* _data\n"
+        "                   , uint32_t _srcOffset\n"
+        "                   , uint32_t _dstOffset\n"
+        "                   , int32_t _width\n"
+        "                   )\n"
+        "{\n"
+        "    const int32_t xx = get_global_id(0);\n"
+        "    const int32_t yy = get_global_id(1);\n"
+        "\n"
+        "    const int32_t parentWidth = _width*2;\n"
+        "    __global const float4* src0 = _data + _srcOffset + (yy*2)*parentWidth + xx*2;\n"
+        "    __global const float4* src1 = src0 + parentWidth;\n"
+        "\n"
+        "    _data[_dstOffset + yy*_width + xx] = (((src0[0] + src0[1]) + src1[0]) + src1[1]) * 0.25f;\n"
+        "}\n"
+        "\n"
+        "// Averages texels shared by cube edges (two texels, .z is negative) and corners (three texels). Each texel is in one group at most.\n"
+        "__kernel void averageSeams(__global float4* _data\n"
+        "                         , __global const int4* _groups\n"
+        "                         )\n"
+        "{\n"
+        "    const int4 group = _groups[get_global_id(0)];\n"
+        "    if (group.z < 0)\n"
+        "    {\n"
+        "        const float4 avg = (_data[group.x] + _data[group.y]) * 0.5f;\n"
+        "        _data[group.x] = avg;\n"
+        "        _data[group.y] = avg;\n"
+        "    }\n"
+        "    else\n"
+        "    {\n"
+        "        const float4 avg = ((_data[group.x] + _data[group.y]) + _data[group.z]) * (1.0f/3.0f);\n"
+        "        _data[group.x] = avg;\n"
+        "        _data[group.y] = avg;\n"
+        "        _data[group.z] = avg;\n"
+        "    }\n"
+        "}\n"
+    };
+
+} // namespace cmft
+
+#endif //CMFT_RESAMPLEPROGRAM_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,330 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "cmft/stream.h"
+
+#include <stdlib.h> //malloc, realloc, free
+#include <string.h> //memcpy, memset
+
+#include <bx/platform.h>
+
+#ifndef CMFT_STREAM_PREAD
+    #define CMFT_STREAM_PREAD BX_PLATFORM_POSIX
+#endif //CMFT_STREAM_PREAD
+
+#if CMFT_STREAM_PREAD
+    #include <unistd.h> //pread
+#endif //CMFT_STREAM_PREAD
+
+namespace cmft
+{
+    // Reader.
+    //-----
+
+    bool Reader::readAt(void* /*_data*/, size_t /*_size*/, uint64_t /*_offset*/)
+    {
+        return false;
+    }
+
+    bool Reader::canReadAt() const
+    {
+        return false;
+    }
+
+    bool Reader::isError() const
+    {
+        return false;
+    }
+
+    FILE* Reader::getFile()
+    {
+        return NULL;
+    }
+
+    bool Writer::isError() const
+    {
+        return false;
+    }
+
+    // FileReader.
+    //-----
+
+    static inline int64_t streamFileTell(FILE* _fp)
+    {
+#if BX_PLATFORM_WINDOWS
+        return _ftelli64(_fp);
+#else
+        return int64_t(ftello(_fp));
+#endif // BX_PLATFORM_WINDOWS
+    }
+
+    static inline bool streamFileSeek(FILE* _fp, int64_t _offset, int _origin)
+    {
+#if BX_PLATFORM_WINDOWS
+        return 0 == _fseeki64(_fp, _offset, _origin);
+#else
+        return 0 == fseeko(_fp, off_t(_offset), _origin);
+#endif // BX_PLATFORM_WINDOWS
+    }
+
+    FileReader::FileReader(FILE* _fp)
+        : m_fp(_fp)
+    {
+    }
+
+    size_t FileReader::read(void* _data, size_t _size)
+    {
+        return fread(_data, 1, _size, m_fp);
+    }
+
+    bool FileReader::seek(int64_t _offset, int _origin)
+    {
+        return streamFileSeek(m_fp, _offset, _origin);
+    }
+
+    int64_t FileReader::tell()
+    {
+        return streamFileTell(m_fp);
+    }
+
+    bool FileReader::readAt(void* _data, size_t _size, uint64_t _offset)
+    {
+#if CMFT_STREAM_PREAD
+        const int fd = fileno(m_fp);
+        uint8_t* dst = (uint8_t*)_data;
+        while (0 != _size)
+        {
+            const ssize_t num = pread(fd, dst, _size, off_t(_offset));
+            if (num <= 0)
+            {
+                return false;
+            }
+
+            dst     += num;
+            _size   -= size_t(num);
+            _offset += uint64_t(num);
+        }
+
+        return true;
+#else
+        (void)_data;
+        (void)_size;
+        (void)_offset;
+        return false;
+#endif //CMFT_STREAM_PREAD
+    }
+
+    bool FileReader::canReadAt() const
+    {
+        return (0 != CMFT_STREAM_PREAD);
+    }
+
+    bool FileReader::isError() const
+    {
+        return (0 != ferror(m_fp));
+    }
+
+    FILE* FileReader::getFile()
+    {
+        return m_fp;
+    }
+
+    // MemoryReader.
+    //-----
+
+    MemoryReader::MemoryReader(const void* _data, size_t _size)
+        : m_data((const uint8_t*)_data)
+        , m_size(_size)
+        , m_pos(0)
+    {
+    }
+
+    size_t MemoryReader::read(void* _data, size_t _size)
+    {
+        const size_t avail = (m_pos < m_size) ? m_size - m_pos : 0;
+        const size_t num = (_size < avail) ? _size : avail;
+        memcpy(_data, m_data + m_pos, num);
+        m_pos += num;
+        return num;
+    }
+
+    bool MemoryReader::seek(int64_t _offset, int _origin)
+    {
+        int64_t base = 0;
+        if (SEEK_CUR == _origin)
+        {
+            base = int64_t(m_pos);
+        }
+        else if (SEEK_END == _origin)
+        {
+            base = int64_t(m_size);
+        }
+
+        const int64_t pos = base + _offset;
+        if (pos < 0)
+        {
+            return false;
+        }
+
+        // Position past the end is allowed like with files, reads from there return nothing.
+        m_pos = size_t(pos);
+        return true;
+    }
+
+    int64_t MemoryReader::tell()
+    {
+        return int64_t(m_pos);
+    }
+
+    bool MemoryReader::readAt(void* _data, size_t _size, uint64_t _offset)
+    {
+        if (_offset > m_size
+        ||  _size > m_size - _offset)
+        {
+            return false;
+        }
+
+        memcpy(_data, m_data + _offset, _size);
+        return true;
+    }
+
+    bool MemoryReader::canReadAt() const
+    {
+        return true;
+    }
+
+    // FileWriter.
+    //-----
+
+    FileWriter::FileWriter(FILE* _fp)
+        : m_fp(_fp)
+    {
+    }
+
+    size_t FileWriter::write(const void* _data, size_t _size)
+    {
+        return fwrite(_data, 1, _size, m_fp);
+    }
+
+    bool FileWriter::seek(int64_t _offset, int _origin)
+    {
+        return streamFileSeek(m_fp, _offset, _origin);
+    }
+
+    int64_t FileWriter::tell()
+    {
+        return streamFileTell(m_fp);
+    }
+
+    bool FileWriter::isError() const
+    {
+        return (0 != ferror(m_fp));
+    }
+
+    // MemoryWriter.
+    //-----
+
+    MemoryWriter::MemoryWriter()
+        : m_data(NULL)
+        , m_size(0)
+        , m_capacity(0)
+        , m_pos(0)
+        , m_error(false)
+    {
+    }
+
+    MemoryWriter::~MemoryWriter()
+    {
+        free(m_data);
+    }
+
+    size_t MemoryWriter::write(const void* _data, size_t _size)
+    {
+        if (m_error)
+        {
+            return 0;
+        }
+
+        const size_t end = m_pos + _size;
+        if (end > m_capacity)
+        {
+            size_t capacity = (0 != m_capacity) ? m_capacity : 4096;
+            while (capacity < end)
+            {
+                capacity *= 2;
+            }
+
+            uint8_t* data = (uint8_t*)realloc(m_data, capacity);
+            if (NULL == data)
+            {
+                m_error = true;
+                return 0;
+            }
+
+            m_data = data;
+            m_capacity = capacity;
+        }
+
+        if (m_pos > m_size)
+        {
+            memset(m_data + m_size, 0, m_pos - m_size);
+        }
+
+        memcpy(m_data + m_pos, _data, _size);
+        m_pos = end;
+        m_size = (end > m_size) ? end : m_size;
+
+        return _size;
+    }
+
+    bool MemoryWriter::seek(int64_t _offset, int _origin)
+    {
+        int64_t base = 0;
+        if (SEEK_CUR == _origin)
+        {
+            base = int64_t(m_pos);
+        }
+        else if (SEEK_END == _origin)
+        {
+            base = int64_t(m_size);
+        }
+
+        const int64_t pos = base + _offset;
+        if (pos < 0)
+        {
+            return false;
+        }
+
+        m_pos = size_t(pos);
+        return true;
+    }
+
+    int64_t MemoryWriter::tell()
+    {
+        return int64_t(m_pos);
+    }
+
+    bool MemoryWriter::isError() const
+    {
+        return m_error;
+    }
+
+    void* MemoryWriter::release(size_t& _size)
+    {
+        void* data = m_data;
+        _size = m_size;
+
+        m_data = NULL;
+        m_size = 0;
+        m_capacity = 0;
+        m_pos = 0;
+        m_error = false;
+
+        return data;
+    }
+
+} // namespace cmft
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,944 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "base/config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bx/os.h>
+
+#if BX_PLATFORM_WINDOWS
+#   include <windows.h>
+#elif BX_PLATFORM_LINUX
+#   include <pthread.h>
+#   include <sched.h>
+#   include <unistd.h>
+#elif BX_PLATFORM_POSIX
+#   include <unistd.h>
+#endif // BX_PLATFORM_
+
+#include "base/macros.h"
+#include "base/utils.h"
+
+#include "threadpool.h"
+#include "messages.h"
+
+namespace cmft
+{
+    // NUMA topology.
+    //-----
+
+#if BX_PLATFORM_LINUX
+    // Reads cpu list of the form "0-7,16-23".
+    static bool cpuListRead(cpu_set_t& _set, const char* _path)
+    {
+        FILE* fp = fopen(_path, "r");
+        if (NULL == fp)
+        {
+            return false;
+        }
+
+        char list[1024];
+        const bool read = (NULL != fgets(list, sizeof(list), fp));
+        fclose(fp);
+        if (!read)
+        {
+            return false;
+        }
+
+        CPU_ZERO(&_set);
+
+        bool any = false;
+        const char* ptr = list;
+        while ('\0' != *ptr && '\n' != *ptr)
+        {
+            char* end;
+            const long first = strtol(ptr, &end, 10);
+            if (end == ptr)
+            {
+                break;
+            }
+
+            long last = first;
+            if ('-' == *end)
+            {
+                ptr = end+1;
+                last = strtol(ptr, &end, 10);
+            }
+
+            for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+            {
+                CPU_SET(int(cpu), &_set);
+                any = true;
+            }
+
+            ptr = (',' == *end) ? end+1 : end;
+        }
+
+        return any;
+    }
+
+    // Nodes are indexed by their number. Numbering may have gaps, e.g. offline nodes, those have no CPUs and are skipped by users.
+    static uint16_t numaNumNodes()
+    {
+        // Node list has the same form as cpu lists.
+        cpu_set_t nodes;
+        if (!cpuListRead(nodes, "/sys/devices/system/node/online"))
+        {
+            return 0;
+        }
+
+        uint16_t numNodes = 0;
+        for (int node = 0; node < CPU_SETSIZE; ++node)
+        {
+            if (CPU_ISSET(node, &nodes))
+            {
+                numNodes = uint16_t(node+1);
+            }
+        }
+
+        return numNodes;
+    }
+
+    static bool cpuSetRestrict(cpu_set_t& _set);
+
+    // CPUs of the node the process may run on.
+    static bool numaNodeCpuSet(cpu_set_t& _set, uint16_t _node)
+    {
+        char path[64];
+        sprintf(path, "/sys/devices/system/node/node%u/cpulist", _node);
+
+        return cpuListRead(_set, path)
+            && cpuSetRestrict(_set)
+            ;
+    }
+
+    // Node of each CPU, built once on first use.
+    static uint8_t s_numaCpuNode[CPU_SETSIZE];
+    static uint16_t s_numaNumNodes = 0;
+    static bx::Mutex s_numaMutex;
+
+    static uint16_t numaInit()
+    {
+        bx::MutexScope lock(s_numaMutex);
+        if (0 == s_numaNumNodes)
+        {
+            memset(s_numaCpuNode, 0, sizeof(s_numaCpuNode));
+
+            const uint16_t numNodes = min(numaNumNodes(), uint16_t(CMFT_MAX_NUMA_NODES));
+            for (uint16_t node = 1; node < numNodes; ++node)
+            {
+                cpu_set_t set;
+                if (numaNodeCpuSet(set, node))
+                {
+                    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                    {
+                        if (CPU_ISSET(cpu, &set))
+                        {
+                            s_numaCpuNode[cpu] = uint8_t(node);
+                        }
+                    }
+                }
+            }
+
+            s_numaNumNodes = max(uint16_t(1), numNodes);
+        }
+
+        return s_numaNumNodes;
+    }
+#endif // BX_PLATFORM_LINUX
+
+    uint16_t getNumNumaNodes()
+    {
+#if BX_PLATFORM_LINUX
+        return numaInit();
+#else
+        return 1;
+#endif // BX_PLATFORM_LINUX
+    }
+
+    uint16_t getCurrentNumaNode()
+    {
+#if BX_PLATFORM_LINUX
+        if (1 == numaInit())
+        {
+            return 0;
+        }
+
+        const int cpu = sched_getcpu();
+        return (0 <= cpu && cpu < CPU_SETSIZE) ? uint16_t(s_numaCpuNode[cpu]) : 0;
+#else
+        return 0;
+#endif // BX_PLATFORM_LINUX
+    }
+
+    struct NumaNodeArgs
+    {
+        ThreadPoolFn m_fn;
+        void* m_userData;
+        uint16_t m_node;
+    };
+
+    static int32_t numaNodeThread(void* _userData)
+    {
+        const NumaNodeArgs* args = (const NumaNodeArgs*)_userData;
+
+#if BX_PLATFORM_LINUX
+        cpu_set_t set;
+        if (!numaNodeCpuSet(set, args->m_node)
+        ||  0 != pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set))
+        {
+            WARN("Could not pin thread to NUMA node %u.", args->m_node);
+        }
+#endif // BX_PLATFORM_LINUX
+
+        args->m_fn(args->m_userData, args->m_node);
+
+        return EXIT_SUCCESS;
+    }
+
+    void runOnNumaNodes(ThreadPoolFn _fn, void* _userData)
+    {
+        const uint16_t numNodes = getNumNumaNodes();
+
+        NumaNodeArgs args[CMFT_MAX_NUMA_NODES];
+        bx::Thread threads[CMFT_MAX_NUMA_NODES];
+        bool started[CMFT_MAX_NUMA_NODES];
+        for (uint16_t node = 0; node < numNodes; ++node)
+        {
+            started[node] = false;
+
+#if BX_PLATFORM_LINUX
+            // Gaps in node numbering and nodes without CPUs of the process are skipped, no thread runs there.
+            cpu_set_t set;
+            if (1 < numNodes
+            &&  !numaNodeCpuSet(set, node))
+            {
+                continue;
+            }
+#endif // BX_PLATFORM_LINUX
+
+            args[node].m_fn = _fn;
+            args[node].m_userData = _userData;
+            args[node].m_node = node;
+            threads[node].init(numaNodeThread, (void*)&args[node]);
+            started[node] = true;
+        }
+
+        for (uint16_t node = 0; node < numNodes; ++node)
+        {
+            if (started[node])
+            {
+                threads[node].shutdown();
+            }
+        }
+    }
+
+    static void pinCurrentThreadToNumaNode(uint16_t _workerIdx)
+    {
+#if BX_PLATFORM_LINUX
+        const uint16_t numNodes = numaNumNodes();
+        if (numNodes <= 1)
+        {
+            return;
+        }
+
+        // Nodes without CPUs the process may run on are skipped.
+        uint16_t node = _workerIdx%numNodes;
+        cpu_set_t set;
+        bool found = false;
+        for (uint16_t ii = 0; ii < numNodes && !found; ++ii)
+        {
+            node = (_workerIdx+ii)%numNodes;
+            found = numaNodeCpuSet(set, node);
+        }
+
+        if (!found
+        ||  0 != pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set))
+        {
+            WARN("Could not pin worker thread %u to NUMA node %u.", _workerIdx, node);
+        }
+#else
+        BX_UNUSED(_workerIdx);
+#endif // BX_PLATFORM_LINUX
+    }
+
+    // CPU topology.
+    //-----
+
+    static CpuInfo s_cpuInfo;
+    static bool s_cpuInfoInitialized = false;
+    static bx::Mutex s_cpuInfoMutex;
+
+#if BX_PLATFORM_LINUX
+    static cpu_set_t s_cpuAllowed;                   // Affinity mask of the process.
+    static cpu_set_t s_cpuCores[CMFT_MAX_THREADS];   // Allowed CPUs of each physical core.
+
+    // Quota/period pair of cgroup v2 cpu.max ("max 100000" without a quota) or of cgroup v1 cpu.cfs_quota_us and cpu.cfs_period_us.
+    static float cgroupReadQuota(const char* _dir, bool _v2)
+    {
+        char path[1024+32];
+        double quota = -1.0;
+        double period = 0.0;
+        if (_v2)
+        {
+            snprintf(path, sizeof(path), "%s/cpu.max", _dir);
+            FILE* fp = fopen(path, "r");
+            if (NULL != fp)
+            {
+                if (2 != fscanf(fp, "%lf %lf", &quota, &period))
+                {
+                    quota = -1.0;
+                }
+                fclose(fp);
+            }
+        }
+        else
+        {
+            snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", _dir);
+            FILE* fp = fopen(path, "r");
+            if (NULL != fp)
+            {
+                if (1 != fscanf(fp, "%lf", &quota))
+                {
+                    quota = -1.0;
+                }
+                fclose(fp);
+            }
+
+            snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", _dir);
+            fp = fopen(path, "r");
+            if (NULL != fp)
+            {
+                if (1 != fscanf(fp, "%lf", &period))
+                {
+                    period = 0.0;
+                }
+                fclose(fp);
+            }
+        }
+
+        return (0.0 < quota && 0.0 < period) ? float(quota/period) : 0.0f;
+    }
+
+    // Smallest CPU quota of the cgroup of the process and of its parents, zero without a quota.
+    static float cgroupCpuQuota()
+    {
+        float result = 0.0f;
+
+        FILE* fp = fopen("/proc/self/cgroup", "r");
+        if (NULL == fp)
+        {
+            return result;
+        }
+
+        // Lines are "<id>:<controllers>:<path>", cgroup v2 has id 0 and no controllers.
+        char line[1024];
+        while (NULL != fgets(line, sizeof(line), fp))
+        {
+            char* controllers = strchr(line, ':');
+            char* group = (NULL != controllers) ? strchr(controllers+1, ':') : NULL;
+            if (NULL == group)
+            {
+                continue;
+            }
+            *group++ = '\0';
+            controllers++;
+            group[strcspn(group, "\n")] = '\0';
+
+            const bool v2 = ('\0' == controllers[0]);
+            bool cpu = v2;
+            char* next = NULL;
+            for (char* name = strtok_r(controllers, ",", &next); NULL != name && !cpu; name = strtok_r(NULL, ",", &next))
+            {
+                cpu = (0 == strcmp(name, "cpu"));
+            }
+            if (!cpu)
+            {
+                continue;
+            }
+
+            // Mount point of the hierarchy. Inside of a cgroup namespace, group path is "/" and the mount is the container's group.
+            const char* mounts[] = { v2 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/cpu", v2 ? "/sys/fs/cgroup/unified" : "/sys/fs/cgroup/cpu,cpuacct" };
+            for (uint8_t mm = 0; mm < BX_COUNTOF(mounts); ++mm)
+            {
+                char dir[1024];
+                snprintf(dir, sizeof(dir), "%s%s", mounts[mm], ('/' == group[0] && '\0' == group[1]) ? "" : group);
+
+                // Limits of parents apply too.
+                for (;;)
+                {
+                    const float quota = cgroupReadQuota(dir, v2);
+                    if (0.0f != quota)
+                    {
+                        result = (0.0f == result) ? quota : min(result, quota);
+                    }
+
+                    char* slash = strrchr(dir, '/');
+                    if (NULL == slash
+                    ||  size_t(slash - dir) <= strlen(mounts[mm]))
+                    {
+                        break;
+                    }
+                    *slash = '\0';
+                }
+            }
+        }
+        fclose(fp);
+
+        return result;
+    }
+#endif // BX_PLATFORM_LINUX
+
+    static void cpuInfoInit(CpuInfo& _info)
+    {
+        _info.m_cpuQuota = 0.0f;
+
+#if BX_PLATFORM_WINDOWS
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        _info.m_numCpus = uint16_t(max(DWORD(1), min(info.dwNumberOfProcessors, DWORD(CMFT_MAX_THREADS))));
+        _info.m_numCores = _info.m_numCpus;
+
+        DWORD size = 0;
+        GetLogicalProcessorInformation(NULL, &size);
+        SYSTEM_LOGICAL_PROCESSOR_INFORMATION* procs = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(size);
+        if (NULL != procs
+        &&  GetLogicalProcessorInformation(procs, &size))
+        {
+            uint16_t numCores = 0;
+            for (DWORD ii = 0; ii < size/sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION); ++ii)
+            {
+                numCores += uint16_t(RelationProcessorCore == procs[ii].Relationship);
+            }
+            _info.m_numCores = max(uint16_t(1), min(numCores, _info.m_numCpus));
+        }
+        free(procs);
+#elif BX_PLATFORM_LINUX
+        CPU_ZERO(&s_cpuAllowed);
+        if (0 != sched_getaffinity(0, sizeof(cpu_set_t), &s_cpuAllowed))
+        {
+            const long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+            for (long cpu = 0; cpu < numCpus && cpu < CPU_SETSIZE; ++cpu)
+            {
+                CPU_SET(int(cpu), &s_cpuAllowed);
+            }
+        }
+
+        // Core of a CPU is identified by the first allowed CPU of its SMT siblings.
+        uint16_t numCpus = 0;
+        uint16_t numCores = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE && numCpus < CMFT_MAX_THREADS; ++cpu)
+        {
+            if (!CPU_ISSET(cpu, &s_cpuAllowed))
+            {
+                continue;
+            }
+            numCpus++;
+
+            char path[96];
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+
+            cpu_set_t siblings;
+            if (!cpuListRead(siblings, path))
+            {
+                CPU_ZERO(&siblings);
+                CPU_SET(cpu, &siblings);
+            }
+            CPU_AND(&siblings, &siblings, &s_cpuAllowed);
+
+            int first = cpu;
+            for (int sibling = 0; sibling < cpu; ++sibling)
+            {
+                if (CPU_ISSET(sibling, &siblings))
+                {
+                    first = sibling;
+                    break;
+                }
+            }
+
+            if (first == cpu)
+            {
+                memcpy(&s_cpuCores[numCores++], &siblings, sizeof(cpu_set_t));
+            }
+        }
+
+        _info.m_numCpus = max(uint16_t(1), numCpus);
+        _info.m_numCores = max(uint16_t(1), numCores);
+        _info.m_cpuQuota = cgroupCpuQuota();
+#elif BX_PLATFORM_POSIX
+        const long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        _info.m_numCpus = uint16_t(max(1L, min(numCpus, long(CMFT_MAX_THREADS))));
+        _info.m_numCores = _info.m_numCpus;
+#else
+        _info.m_numCpus = 1;
+        _info.m_numCores = 1;
+#endif // BX_PLATFORM_
+    }
+
+    const CpuInfo& getCpuInfo()
+    {
+        bx::MutexScope lock(s_cpuInfoMutex);
+        if (!s_cpuInfoInitialized)
+        {
+            cpuInfoInit(s_cpuInfo);
+            s_cpuInfoInitialized = true;
+        }
+
+        return s_cpuInfo;
+    }
+
+#if BX_PLATFORM_LINUX
+    // Leaves out CPUs the process may not run on, returns false if none are left.
+    static bool cpuSetRestrict(cpu_set_t& _set)
+    {
+        getCpuInfo();
+        CPU_AND(&_set, &_set, &s_cpuAllowed);
+        return 0 != CPU_COUNT(&_set);
+    }
+#endif // BX_PLATFORM_LINUX
+
+    /// CPUs worth of quota rounded to the nearest, at least one.
+    static inline uint16_t cpuQuotaLimit(uint16_t _num, float _quota)
+    {
+        return (0.0f != _quota) ? max(uint16_t(1), min(_num, uint16_t(min(_quota + 0.5f, float(CMFT_MAX_THREADS))))) : _num;
+    }
+
+    uint16_t getNumHardwareThreads()
+    {
+        const CpuInfo& info = getCpuInfo();
+        return cpuQuotaLimit(info.m_numCpus, info.m_cpuQuota);
+    }
+
+    uint16_t getDefaultNumThreads()
+    {
+        const CpuInfo& info = getCpuInfo();
+        return cpuQuotaLimit(info.m_numCores, info.m_cpuQuota);
+    }
+
+    uint32_t getNumRunnableThreads()
+    {
+#if BX_PLATFORM_LINUX
+        FILE* fp = fopen("/proc/loadavg", "r");
+        if (NULL == fp)
+        {
+            return 0;
+        }
+
+        // "<load1> <load5> <load15> <runnable>/<total> <last pid>"
+        float load[3];
+        unsigned int runnable = 0;
+        unsigned int total = 0;
+        if (5 != fscanf(fp, "%f %f %f %u/%u", &load[0], &load[1], &load[2], &runnable, &total))
+        {
+            runnable = 0;
+        }
+        fclose(fp);
+
+        return uint32_t(runnable);
+#else
+        return 0;
+#endif // BX_PLATFORM_LINUX
+    }
+
+    ScopeCpuCore::ScopeCpuCore(uint16_t _core)
+        : m_restore(false)
+    {
+#if BX_PLATFORM_LINUX
+        const CpuInfo& info = getCpuInfo();
+
+        cpu_set_t prev;
+        if (0 != pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &prev))
+        {
+            return;
+        }
+        memcpy(m_prev, &prev, sizeof(cpu_set_t));
+
+        if (0 == pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &s_cpuCores[_core%info.m_numCores]))
+        {
+            m_restore = true;
+        }
+#else
+        BX_UNUSED(_core);
+#endif // BX_PLATFORM_LINUX
+    }
+
+    ScopeCpuCore::~ScopeCpuCore()
+    {
+#if BX_PLATFORM_LINUX
+        if (m_restore)
+        {
+            cpu_set_t prev;
+            memcpy(&prev, m_prev, sizeof(cpu_set_t));
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &prev);
+        }
+#endif // BX_PLATFORM_LINUX
+    }
+
+#if BX_PLATFORM_LINUX
+    BX_STATIC_ASSERT(sizeof(ScopeCpuRange::m_prev) >= sizeof(cpu_set_t));
+    BX_STATIC_ASSERT(sizeof(ScopeCpuCore::m_prev) >= sizeof(cpu_set_t));
+#endif // BX_PLATFORM_LINUX
+
+    ScopeCpuRange::ScopeCpuRange(uint16_t _first, uint16_t _count)
+        : m_restore(false)
+    {
+#if BX_PLATFORM_LINUX
+        cpu_set_t prev;
+        if (0 != pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &prev))
+        {
+            return;
+        }
+        memcpy(m_prev, &prev, sizeof(cpu_set_t));
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        uint16_t idx = 0;
+        uint16_t num = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE && num < _count; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &prev))
+            {
+                if (idx++ >= _first)
+                {
+                    CPU_SET(cpu, &set);
+                    num++;
+                }
+            }
+        }
+
+        if (0 != num
+        &&  0 == pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set))
+        {
+            m_restore = true;
+        }
+#else
+        BX_UNUSED(_first, _count);
+#endif // BX_PLATFORM_LINUX
+    }
+
+    ScopeCpuRange::~ScopeCpuRange()
+    {
+#if BX_PLATFORM_LINUX
+        if (m_restore)
+        {
+            cpu_set_t prev;
+            memcpy(&prev, m_prev, sizeof(cpu_set_t));
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &prev);
+        }
+#endif // BX_PLATFORM_LINUX
+    }
+
+    // ThreadPool.
+    //-----
+
+    static int32_t threadPoolWorker(void* _userData)
+    {
+        ThreadPool::WorkerArgs* args = (ThreadPool::WorkerArgs*)_userData;
+        return args->m_pool->worker(args->m_workerIdx);
+    }
+
+    ThreadPool::ThreadPool()
+        : m_tasks(NULL)
+        , m_taskHead(0)
+        , m_taskCount(0)
+        , m_taskCapacity(0)
+        , m_numThreads(0)
+        , m_pinToNumaNodes(false)
+        , m_quit(false)
+    {
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        shutdown();
+    }
+
+    bool ThreadPool::init(uint16_t _numThreads, bool _pinToNumaNodes)
+    {
+        shutdown();
+
+        m_pinToNumaNodes = _pinToNumaNodes;
+        reserve(_numThreads);
+
+        return (m_numThreads == min(_numThreads, uint16_t(CMFT_MAX_THREADS)));
+    }
+
+    void ThreadPool::shutdown()
+    {
+        if (0 != m_numThreads)
+        {
+            {
+                bx::MutexScope lock(m_mutex);
+                m_quit = true;
+            }
+            m_workSem.post(m_numThreads);
+
+            for (uint16_t ii = 0; ii < m_numThreads; ++ii)
+            {
+                m_threads[ii].shutdown();
+            }
+
+            m_numThreads = 0;
+            m_quit = false;
+
+            // Drop wake-ups that were not consumed.
+            while (m_workSem.wait(0)) {}
+        }
+
+        free(m_tasks);
+        m_tasks = NULL;
+        m_taskHead = 0;
+        m_taskCount = 0;
+        m_taskCapacity = 0;
+    }
+
+    void ThreadPool::reserve(uint16_t _numThreads)
+    {
+        bx::MutexScope lock(m_mutex);
+
+        const uint16_t numThreads = min(_numThreads, uint16_t(CMFT_MAX_THREADS));
+        while (m_numThreads < numThreads)
+        {
+            WorkerArgs& args = m_workerArgs[m_numThreads];
+            args.m_pool = this;
+            args.m_workerIdx = m_numThreads;
+            m_threads[m_numThreads].init(threadPoolWorker, (void*)&args);
+            m_numThreads++;
+        }
+    }
+
+    void ThreadPool::dispatch(JobGroup& _group, ThreadPoolFn _fn, void* _userData, uint32_t _numTasks)
+    {
+        if (0 == _numTasks)
+        {
+            return;
+        }
+
+        {
+            bx::MutexScope lock(m_mutex);
+
+            // Grow ring buffer.
+            if (m_taskCount + _numTasks > m_taskCapacity)
+            {
+                const uint32_t capacity = max(m_taskCount + _numTasks, m_taskCapacity*2);
+                Task* tasks = (Task*)malloc(capacity*sizeof(Task));
+                MALLOC_CHECK(tasks);
+                for (uint32_t ii = 0; ii < m_taskCount; ++ii)
+                {
+                    tasks[ii] = m_tasks[(m_taskHead+ii)%m_taskCapacity];
+                }
+                free(m_tasks);
+                m_tasks = tasks;
+                m_taskHead = 0;
+                m_taskCapacity = capacity;
+            }
+
+            for (uint32_t ii = 0; ii < _numTasks; ++ii)
+            {
+                Task& task = m_tasks[(m_taskHead+m_taskCount)%m_taskCapacity];
+                task.m_fn = _fn;
+                task.m_userData = _userData;
+                task.m_taskIdx = ii;
+                task.m_group = &_group;
+                m_taskCount++;
+            }
+
+            _group.m_pending += _numTasks;
+        }
+
+        m_workSem.post(min(_numTasks, uint32_t(m_numThreads)));
+    }
+
+    bool ThreadPool::pop(Task& _task)
+    {
+        // Mutex has to be locked.
+        if (0 == m_taskCount)
+        {
+            return false;
+        }
+
+        _task = m_tasks[m_taskHead];
+        m_taskHead = (m_taskHead+1)%m_taskCapacity;
+        m_taskCount--;
+
+        return true;
+    }
+
+    void ThreadPool::execute(const Task& _task)
+    {
+        _task.m_fn(_task.m_userData, _task.m_taskIdx);
+
+        // Post under the lock, waiter may destroy the group as soon as m_pending hits zero.
+        bx::MutexScope lock(m_mutex);
+        _task.m_group->m_pending--;
+        _task.m_group->m_done.post();
+    }
+
+    void ThreadPool::wait(JobGroup& _group)
+    {
+        for (;;)
+        {
+            Task task;
+            bool hasTask;
+            {
+                bx::MutexScope lock(m_mutex);
+                if (0 == _group.m_pending)
+                {
+                    break;
+                }
+
+                // Help out while waiting.
+                hasTask = pop(task);
+            }
+
+            if (hasTask)
+            {
+                execute(task);
+            }
+            else
+            {
+                _group.m_done.wait();
+            }
+        }
+    }
+
+    int32_t ThreadPool::worker(uint16_t _workerIdx)
+    {
+        if (m_pinToNumaNodes)
+        {
+            pinCurrentThreadToNumaNode(_workerIdx);
+        }
+
+        for (;;)
+        {
+            m_workSem.wait();
+
+            Task task;
+            bool hasTask;
+            {
+                bx::MutexScope lock(m_mutex);
+                if (m_quit)
+                {
+                    break;
+                }
+
+                hasTask = pop(task);
+            }
+
+            // Keep going while there is work queued.
+            while (hasTask)
+            {
+                execute(task);
+
+                bx::MutexScope lock(m_mutex);
+                hasTask = !m_quit && pop(task);
+            }
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    // Shared pool.
+    //-----
+
+    static ThreadPool s_threadPool;
+    static bx::Mutex s_threadPoolMutex;
+    static bool s_threadPoolInitialized = false;
+
+    bool threadPoolInit(uint16_t _numThreads, bool _pinToNumaNodes)
+    {
+        bx::MutexScope lock(s_threadPoolMutex);
+        s_threadPoolInitialized = true;
+
+        return s_threadPool.init(_numThreads, _pinToNumaNodes);
+    }
+
+    void threadPoolShutdown()
+    {
+        bx::MutexScope lock(s_threadPoolMutex);
+        s_threadPoolInitialized = false;
+
+        s_threadPool.shutdown();
+    }
+
+    ThreadPool& threadPoolGet()
+    {
+        bx::MutexScope lock(s_threadPoolMutex);
+        if (!s_threadPoolInitialized)
+        {
+            s_threadPoolInitialized = true;
+            s_threadPool.init(getNumHardwareThreads()-1);
+        }
+
+        return s_threadPool;
+    }
+
+    // Job system.
+    //-----
+
+    static JobSystem* s_jobSystem = NULL;
+
+    void setJobSystem(JobSystem* _jobSystem)
+    {
+        s_jobSystem = _jobSystem;
+    }
+
+    JobSystem* getJobSystem()
+    {
+        return (NULL != s_jobSystem) ? s_jobSystem : &threadPoolGet();
+    }
+
+    struct ParallelForArgs
+    {
+        ParallelForFn m_fn;
+        void* m_userData;
+        uint32_t m_count;
+        uint32_t m_rangeSize;
+    };
+
+    static void parallelForTask(void* _userData, uint32_t _taskIdx)
+    {
+        const ParallelForArgs* args = (const ParallelForArgs*)_userData;
+        const uint32_t begin = _taskIdx*args->m_rangeSize;
+        const uint32_t end = min(args->m_count, begin+args->m_rangeSize);
+        args->m_fn(args->m_userData, begin, end);
+    }
+
+    void parallelFor(ParallelForFn _fn, void* _userData, uint32_t _count, uint32_t _minRangeSize)
+    {
+        if (0 == _count)
+        {
+            return;
+        }
+
+        JobSystem& jobSystem = *getJobSystem();
+        const uint32_t maxRanges = uint32_t(jobSystem.getNumThreads())+1;
+        const uint32_t minRangeSize = max(UINT32_C(1), _minRangeSize);
+        const uint32_t numRanges = max(UINT32_C(1), min(maxRanges, _count/minRangeSize));
+
+        // Not worth dispatching.
+        if (1 == numRanges)
+        {
+            _fn(_userData, 0, _count);
+            return;
+        }
+
+        ParallelForArgs args;
+        args.m_fn = _fn;
+        args.m_userData = _userData;
+        args.m_count = _count;
+        args.m_rangeSize = (_count + numRanges-1)/numRanges;
+
+        jobSystem.run(parallelForTask, (void*)&args, (_count + args.m_rangeSize-1)/args.m_rangeSize);
+    }
+
+} // namespace cmft
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_THREADPOOL_H_HEADER_GUARD
+#define CMFT_THREADPOOL_H_HEADER_GUARD
+
+#include "base/config.h"
+
+#include <stdint.h>
+
+#include <bx/thread.h>
+#include <bx/mutex.h>
+#include <bx/sem.h>
+
+#include "cmft/jobsystem.h"
+
+namespace cmft
+{
+
+#ifndef CMFT_MAX_THREADS
+    #define CMFT_MAX_THREADS 256
+#endif //CMFT_MAX_THREADS
+
+    typedef JobFn ThreadPoolFn;
+
+    /// Long-lived worker threads, the default JobSystem.
+    /// The thread waiting for a group executes queued tasks too, so tasks can dispatch and wait for other tasks.
+    struct ThreadPool : public JobSystem
+    {
+        ThreadPool();
+        virtual ~ThreadPool();
+
+        /// Starts _numThreads workers. With _pinToNumaNodes, workers are distributed round-robin
+        /// over NUMA nodes and pinned to the CPUs of their node (Linux only).
+        bool init(uint16_t _numThreads, bool _pinToNumaNodes = false);
+
+        /// Stops all workers. All dispatched groups have to be waited for before calling it.
+        void shutdown();
+
+        /// Starts additional workers if there are less than _numThreads running.
+        virtual void reserve(uint16_t _numThreads);
+
+        virtual uint16_t getNumThreads()
+        {
+            return m_numThreads;
+        }
+
+        /// Queues _fn(_userData, taskIdx) for taskIdx in [0, _numTasks).
+        virtual void dispatch(JobGroup& _group, ThreadPoolFn _fn, void* _userData, uint32_t _numTasks);
+
+        /// Blocks until all tasks of _group are done.
+        virtual void wait(JobGroup& _group);
+
+        struct Task
+        {
+            ThreadPoolFn m_fn;
+            void* m_userData;
+            uint32_t m_taskIdx;
+            JobGroup* m_group;
+        };
+
+        struct WorkerArgs
+        {
+            ThreadPool* m_pool;
+            uint16_t m_workerIdx;
+        };
+
+        bool pop(Task& _task);
+        void execute(const Task& _task);
+        int32_t worker(uint16_t _workerIdx);
+
+        bx::Mutex m_mutex;
+        bx::Semaphore m_workSem;
+        Task* m_tasks;
+        uint32_t m_taskHead;
+        uint32_t m_taskCount;
+        uint32_t m_taskCapacity;
+        uint16_t m_numThreads;
+        bool m_pinToNumaNodes;
+        bool m_quit;
+        bx::Thread m_threads[CMFT_MAX_THREADS];
+        WorkerArgs m_workerArgs[CMFT_MAX_THREADS];
+    };
+
+    /// CPUs available to the process, detected once on first use. On Linux the affinity mask, SMT siblings and the cgroup CPU quota
+    /// (cpu.max of cgroup v2, cpu.cfs_quota_us of cgroup v1) are taken into account. Elsewhere all CPUs of the system are available.
+    struct CpuInfo
+    {
+        uint16_t m_numCpus;  //!< Logical CPUs the process may run on.
+        uint16_t m_numCores; //!< Physical cores among them, SMT siblings are counted once.
+        float m_cpuQuota;    //!< CPUs worth of cgroup CPU quota, zero without a quota.
+    };
+
+    ///
+    const CpuInfo& getCpuInfo();
+
+    /// Number of hardware threads available to the process. Logical CPUs it may run on, no more than its CPU quota allows.
+    uint16_t getNumHardwareThreads();
+
+    /// Default number of compute threads. One per available physical core, no more than the CPU quota of the process allows.
+    uint16_t getDefaultNumThreads();
+
+    /// Threads of all processes on the system that are running or waiting for a CPU at the moment, the calling one included.
+    /// Read from /proc/loadavg on Linux, 0 where it is not known.
+    uint32_t getNumRunnableThreads();
+
+#ifndef CMFT_MAX_NUMA_NODES
+    #define CMFT_MAX_NUMA_NODES 8
+#endif //CMFT_MAX_NUMA_NODES
+
+    /// Number of NUMA nodes, at most CMFT_MAX_NUMA_NODES. 1 without NUMA or outside of Linux. Nodes keep the kernel numbering,
+    /// which may have gaps for offline nodes, so this is the highest online node plus one.
+    uint16_t getNumNumaNodes();
+
+    /// NUMA node of the CPU the calling thread currently runs on. Stays valid only for threads pinned to a node.
+    uint16_t getCurrentNumaNode();
+
+    /// Runs _fn(_userData, node) for every NUMA node at once, each on its own thread pinned to the node.
+    /// Memory first touched by _fn is then allocated on that node. Nodes without CPUs the process may run on are skipped. Blocks until done.
+    void runOnNumaNodes(ThreadPoolFn _fn, void* _userData);
+
+    /// Restricts the calling thread to _count CPUs starting with the _first CPU it is currently allowed to run on,
+    /// and restores the previous affinity when going out of scope (Linux only, no-op elsewhere).
+    struct ScopeCpuRange
+    {
+        ScopeCpuRange(uint16_t _first, uint16_t _count);
+        ~ScopeCpuRange();
+
+        uint64_t m_prev[16]; //!< Previous cpu_set_t.
+        bool m_restore;
+    };
+
+    /// Restricts the calling thread to the CPUs of available physical core _core%CpuInfo::m_numCores, so that compute threads
+    /// don't share a core while others are idle. Restores the previous affinity when going out of scope (Linux only, no-op elsewhere).
+    struct ScopeCpuCore
+    {
+        ScopeCpuCore(uint16_t _core);
+        ~ScopeCpuCore();
+
+        uint64_t m_prev[16]; //!< Previous cpu_set_t.
+        bool m_restore;
+    };
+
+    /// (Re)starts the shared thread pool used by filters and image conversions.
+    bool threadPoolInit(uint16_t _numThreads, bool _pinToNumaNodes = false);
+
+    ///
+    void threadPoolShutdown();
+
+    /// Returns the shared thread pool. Starts it with one worker per hardware thread, minus the calling thread, on first use.
+    /// cmft calls run their tasks on getJobSystem(), which is this pool unless setJobSystem() installed another one.
+    ThreadPool& threadPoolGet();
+
+    typedef void (*ParallelForFn)(void* _userData, uint32_t _begin, uint32_t _end);
+
+    /// Splits [0, _count) into ranges of at least _minRangeSize elements, at most one per thread,
+    /// and runs _fn(_userData, begin, end) for each of them on getJobSystem(). Blocks until done.
+    void parallelFor(ParallelForFn _fn, void* _userData, uint32_t _count, uint32_t _minRangeSize = 1);
+
+} // namespace cmft
+
+#endif //CMFT_THREADPOOL_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,311 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "base/config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bx/thread.h>
+#include <bx/mutex.h>
+#include <bx/sem.h>
+#include <bx/string.h>
+
+#include "base/macros.h"
+#include "base/utils.h"
+
+#include "writebehind.h"
+#include "messages.h"
+#include "profiler.h"
+
+namespace cmft
+{
+    struct WriteBehindEntry
+    {
+        WriteBehindEntry* m_next;
+        void* m_data;
+        uint64_t m_size;
+        char m_filePath[1024];
+    };
+
+    struct WriteBehind
+    {
+        WriteBehind()
+            : m_head(NULL)
+            , m_tail(NULL)
+            , m_queuedBytes(0)
+            , m_maxQueuedBytes(0)
+            , m_numPending(0)
+            , m_numWaiters(0)
+            , m_numFailed(0)
+            , m_active(false)
+            , m_quit(false)
+        {
+        }
+
+        bx::Mutex m_mutex;
+        bx::Semaphore m_workSem;  //!< Posted for every queued entry and on quit.
+        bx::Semaphore m_doneSem;  //!< Posted once for every waiter when an entry is written.
+        bx::Thread m_thread;
+        WriteBehindEntry* m_head;
+        WriteBehindEntry* m_tail;
+        uint64_t m_queuedBytes;
+        uint64_t m_maxQueuedBytes;
+        uint32_t m_numPending;    //!< Queued or being written.
+        uint32_t m_numWaiters;
+        uint32_t m_numFailed;
+        bool m_active;
+        bool m_quit;
+    };
+    static WriteBehind s_writeBehind;
+
+    /// Writes the whole file with a single unbuffered write.
+    static bool writeBehindWrite(const WriteBehindEntry& _entry)
+    {
+        CMFT_PROFILE_ZONE("writeBehindWrite");
+
+        FILE* fp = fopen(_entry.m_filePath, "wb");
+        if (NULL == fp)
+        {
+            return false;
+        }
+        setvbuf(fp, NULL, _IONBF, 0);
+
+        const size_t write = fwrite(_entry.m_data, 1, size_t(_entry.m_size), fp);
+        const bool failed = (write != _entry.m_size) || ferror(fp);
+
+        return (0 == fclose(fp)) && !failed;
+    }
+
+    static bool hasPending(const WriteBehind& _wb)
+    {
+        return 0 != _wb.m_numPending;
+    }
+
+    static bool isQueueFull(const WriteBehind& _wb)
+    {
+        return 0 != _wb.m_numPending && _wb.m_queuedBytes > _wb.m_maxQueuedBytes;
+    }
+
+    typedef bool (*WriteBehindConditionFn)(const WriteBehind& _wb);
+
+    /// Blocks until _fn returns false. Has to be called with the mutex locked, which is released while waiting.
+    static void writeBehindWaitWhile(WriteBehindConditionFn _fn)
+    {
+        WriteBehind& wb = s_writeBehind;
+        while (_fn(wb))
+        {
+            wb.m_numWaiters++;
+            wb.m_mutex.unlock();
+            wb.m_doneSem.wait();
+            wb.m_mutex.lock();
+        }
+    }
+
+    static int32_t writeBehindThread(void* /*_userData*/)
+    {
+        WriteBehind& wb = s_writeBehind;
+
+        for (;;)
+        {
+            wb.m_workSem.wait();
+
+            WriteBehindEntry* entry;
+            {
+                bx::MutexScope lock(wb.m_mutex);
+                entry = wb.m_head;
+                if (NULL == entry)
+                {
+                    if (wb.m_quit)
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                wb.m_head = entry->m_next;
+                if (NULL == wb.m_head)
+                {
+                    wb.m_tail = NULL;
+                }
+            }
+
+            const bool written = writeBehindWrite(*entry);
+            if (!written)
+            {
+                WARN("Could not write file %s.", entry->m_filePath);
+            }
+
+            uint32_t numWaiters;
+            {
+                bx::MutexScope lock(wb.m_mutex);
+                wb.m_queuedBytes -= entry->m_size;
+                wb.m_numPending--;
+                wb.m_numFailed += !written;
+
+                numWaiters = wb.m_numWaiters;
+                wb.m_numWaiters = 0;
+            }
+            wb.m_doneSem.post(numWaiters);
+
+            free(entry->m_data);
+            free(entry);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    bool writeBehindStart(uint64_t _maxQueuedBytes)
+    {
+        WriteBehind& wb = s_writeBehind;
+        if (!CMFT_WRITE_BEHIND)
+        {
+            INFO("Write-behind output is not supported on this platform, files are written in place.");
+            return false;
+        }
+
+        if (wb.m_active)
+        {
+            bx::MutexScope lock(wb.m_mutex);
+            wb.m_maxQueuedBytes = _maxQueuedBytes;
+            return true;
+        }
+
+        wb.m_maxQueuedBytes = _maxQueuedBytes;
+        wb.m_numFailed = 0;
+        wb.m_quit = false;
+        wb.m_thread.init(writeBehindThread);
+        wb.m_active = true;
+
+        return true;
+    }
+
+    bool writeBehindFlush()
+    {
+        WriteBehind& wb = s_writeBehind;
+        if (!wb.m_active)
+        {
+            return true;
+        }
+
+        bx::MutexScope lock(wb.m_mutex);
+        writeBehindWaitWhile(hasPending);
+
+        const bool result = (0 == wb.m_numFailed);
+        wb.m_numFailed = 0;
+        return result;
+    }
+
+    bool writeBehindStop()
+    {
+        WriteBehind& wb = s_writeBehind;
+        if (!wb.m_active)
+        {
+            return true;
+        }
+
+        const bool result = writeBehindFlush();
+
+        {
+            bx::MutexScope lock(wb.m_mutex);
+            wb.m_quit = true;
+            wb.m_active = false;
+        }
+        wb.m_workSem.post();
+        wb.m_thread.shutdown();
+
+        return result;
+    }
+
+    bool writeBehindIsActive()
+    {
+        return s_writeBehind.m_active;
+    }
+
+    void writeBehindQueue(const char* _filePath, void* _data, uint64_t _size)
+    {
+        WriteBehind& wb = s_writeBehind;
+
+        WriteBehindEntry* entry = (WriteBehindEntry*)malloc(sizeof(WriteBehindEntry));
+        MALLOC_CHECK(entry);
+        entry->m_next = NULL;
+        entry->m_data = _data;
+        entry->m_size = _size;
+        bx::strlcpy(entry->m_filePath, _filePath, sizeof(entry->m_filePath));
+
+        {
+            bx::MutexScope lock(wb.m_mutex);
+
+            // Memory is bounded, wait for earlier files to be written.
+            writeBehindWaitWhile(isQueueFull);
+
+            if (NULL == wb.m_tail)
+            {
+                wb.m_head = entry;
+            }
+            else
+            {
+                wb.m_tail->m_next = entry;
+            }
+            wb.m_tail = entry;
+            wb.m_queuedBytes += _size;
+            wb.m_numPending++;
+        }
+        wb.m_workSem.post();
+    }
+
+    // WriteFile.
+    //-----
+
+    FILE* writeFileOpen(WriteFile& _file, const char* _filePath, bool _writeBehind)
+    {
+        _file.m_fp = NULL;
+        _file.m_data = NULL;
+        _file.m_size = 0;
+        _file.m_writeBehind = false;
+        bx::strlcpy(_file.m_filePath, _filePath, sizeof(_file.m_filePath));
+
+#if CMFT_WRITE_BEHIND
+        if (_writeBehind && writeBehindIsActive())
+        {
+            _file.m_fp = open_memstream(&_file.m_data, &_file.m_size);
+            _file.m_writeBehind = (NULL != _file.m_fp);
+        }
+#else
+        BX_UNUSED(_writeBehind);
+#endif // CMFT_WRITE_BEHIND
+
+        if (NULL == _file.m_fp)
+        {
+            _file.m_fp = fopen(_filePath, "wb");
+        }
+
+        return _file.m_fp;
+    }
+
+    void writeFileClose(WriteFile& _file)
+    {
+        if (NULL == _file.m_fp)
+        {
+            return;
+        }
+
+        fclose(_file.m_fp);
+        _file.m_fp = NULL;
+
+        // Memory stream buffer is valid after close.
+        if (_file.m_writeBehind)
+        {
+            writeBehindQueue(_file.m_filePath, _file.m_data, _file.m_size);
+            _file.m_data = NULL;
+            _file.m_size = 0;
+        }
+    }
+
+} // namespace cmft
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFT_WRITEBEHIND_H_HEADER_GUARD
+#define CMFT_WRITEBEHIND_H_HEADER_GUARD
+
+#include "base/config.h"
+#include "base/utils.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <bx/platform.h>
+
+// Savers encode into memory with open_memstream(), other platforms always write in place.
+#ifndef CMFT_WRITE_BEHIND
+    #define CMFT_WRITE_BEHIND (BX_PLATFORM_LINUX || BX_PLATFORM_OSX)
+#endif // CMFT_WRITE_BEHIND
+
+namespace cmft
+{
+    /// Starts the background I/O thread. Queued files are written in order, each one with a single write.
+    /// Queueing blocks while more than _maxQueuedBytes are waiting to be written.
+    bool writeBehindStart(uint64_t _maxQueuedBytes);
+
+    /// Blocks until all queued files are written. Returns false if writing any of them failed since the last call.
+    bool writeBehindFlush();
+
+    /// Flushes and stops the I/O thread.
+    bool writeBehindStop();
+
+    ///
+    bool writeBehindIsActive();
+
+    /// Queues _size bytes of _data for writing to _filePath. Takes ownership of _data, it is released with free().
+    void writeBehindQueue(const char* _filePath, void* _data, uint64_t _size);
+
+    /// File written by a saver. With write-behind, data is written to memory and queued on close.
+    struct WriteFile
+    {
+        FILE* m_fp;
+        char* m_data;
+        size_t m_size;
+        bool m_writeBehind;
+        char m_filePath[1024];
+    };
+
+    /// Opens _filePath for writing, in memory if _writeBehind is requested and the I/O thread is running.
+    FILE* writeFileOpen(WriteFile& _file, const char* _filePath, bool _writeBehind);
+
+    /// Closes the file and queues it if it was written to memory.
+    void writeFileClose(WriteFile& _file);
+
+    struct ScopeWriteFile : NoCopyNoAssign
+    {
+        ScopeWriteFile(WriteFile& _file) : m_file(_file) { }
+
+        ~ScopeWriteFile()
+        {
+            writeFileClose(m_file);
+        }
+
+        WriteFile& m_file;
+    };
+
+} // namespace cmft
+
+#endif //CMFT_WRITEBEHIND_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
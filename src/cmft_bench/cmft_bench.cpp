@@ -0,0 +1,679 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <bx/commandline.h>
+#include <bx/timer.h>
+
+#include <cmft/image.h>
+#include <cmft/cubemapfilter.h>
+#include <cmft/clcontext.h>
+#include <cmft/threadpool.h>
+
+#include <base/config.h>
+#include <base/macros.h> //countof
+#include <base/utils.h> //strncpy
+
+#include <cmft/messages.h> //INFO, WARN, g_printInfo, g_printWarnings
+#include <cmft/profiler.h> //PerfCounters
+
+using namespace cmft;
+
+#define BENCH_MAX_LIST   16
+#define BENCH_MAX_RESULT 4096
+#define BENCH_COPY(_dst, _src) cmft_strncpy((_dst), (_src), CMFT_COUNTOF(_dst)-1)
+
+struct BenchParameters
+{
+    uint32_t m_faceSizes[BENCH_MAX_LIST];
+    uint32_t m_numFaceSizes;
+    uint32_t m_mipCounts[BENCH_MAX_LIST];
+    uint32_t m_numMipCounts;
+    uint32_t m_lightingModels[BENCH_MAX_LIST];
+    uint32_t m_numLightingModels;
+    uint32_t m_threads[BENCH_MAX_LIST];
+    uint32_t m_numThreads;
+    uint32_t m_shOrder;
+    uint32_t m_repeat;
+    uint32_t m_pattern;
+    bool m_useOpenCL;
+    bool m_perfCounters;
+    char m_tmpDir[512];
+    char m_output[512];
+};
+
+// Zero fields are not applicable to the benchmark and are not written.
+struct BenchResult
+{
+    char m_name[32];
+    char m_detail[32];
+    char m_device[16];
+    uint32_t m_faceSize;
+    uint32_t m_mipCount;
+    uint32_t m_threads;
+    double m_seconds;
+    double m_texelsPerSec;
+    uint64_t m_numTexels;
+    uint64_t m_taps;          //!< Radiance filter taps of a run, see RadianceFilterEstimate.
+    PerfCounters m_counters;  //!< Average of the runs, zero without --perfCounters.
+};
+
+static const char* s_lightingModelStr[LightingModel::Count] =
+{
+    "phong",
+    "phongbrdf",
+    "blinn",
+    "blinnbrdf",
+};
+
+static BenchResult s_results[BENCH_MAX_RESULT];
+static uint32_t s_numResults = 0;
+static bool s_perfCounters = false;
+
+static uint32_t parseList(uint32_t* _out, const char* _str, const char* const* _names = NULL, uint32_t _numNames = 0)
+{
+    uint32_t count = 0;
+    while (NULL != _str && '\0' != *_str && count < BENCH_MAX_LIST)
+    {
+        const char* end = strchr(_str, ',');
+        const size_t len = (NULL == end) ? strlen(_str) : size_t(end-_str);
+
+        bool named = false;
+        for (uint32_t ii = 0; ii < _numNames; ++ii)
+        {
+            if (len == strlen(_names[ii]) && 0 == strncmp(_str, _names[ii], len))
+            {
+                _out[count++] = ii;
+                named = true;
+                break;
+            }
+        }
+
+        if (!named)
+        {
+            char* numEnd;
+            const unsigned long value = strtoul(_str, &numEnd, 10);
+            if (numEnd != _str)
+            {
+                _out[count++] = uint32_t(value);
+            }
+            else
+            {
+                WARN("Ignoring unknown list value '%.*s'.", int(len), _str);
+            }
+        }
+
+        _str = (NULL == end) ? NULL : end+1;
+    }
+
+    return count;
+}
+
+static void benchParametersFromCommandLine(BenchParameters& _params, const bx::CommandLine& _cmdLine)
+{
+    static const uint32_t s_defaultFaceSizes[] = { 64, 128, 256 };
+    static const uint32_t s_defaultMipCounts[] = { 1, 7 };
+    static const uint32_t s_defaultLightingModels[] = { LightingModel::PhongBrdf, LightingModel::BlinnBrdf };
+
+    memcpy(_params.m_faceSizes, s_defaultFaceSizes, sizeof(s_defaultFaceSizes));
+    _params.m_numFaceSizes = CMFT_COUNTOF(s_defaultFaceSizes);
+    memcpy(_params.m_mipCounts, s_defaultMipCounts, sizeof(s_defaultMipCounts));
+    _params.m_numMipCounts = CMFT_COUNTOF(s_defaultMipCounts);
+    memcpy(_params.m_lightingModels, s_defaultLightingModels, sizeof(s_defaultLightingModels));
+    _params.m_numLightingModels = CMFT_COUNTOF(s_defaultLightingModels);
+    _params.m_threads[0] = 1;
+    _params.m_threads[1] = getNumHardwareThreads();
+    _params.m_numThreads = (1 == _params.m_threads[1]) ? 1 : 2;
+    _params.m_shOrder = 5;
+    _params.m_repeat = 3;
+    _params.m_pattern = CubemapPattern::SunDisk;
+    _params.m_useOpenCL = false;
+    _params.m_perfCounters = false;
+    _params.m_tmpDir[0] = '\0';
+    BENCH_COPY(_params.m_output, "cmft_bench.json");
+
+    uint32_t list[BENCH_MAX_LIST];
+    uint32_t count;
+    if (0 != (count = parseList(list, _cmdLine.findOption("faceSizes"))))
+    {
+        memcpy(_params.m_faceSizes, list, count*sizeof(uint32_t));
+        _params.m_numFaceSizes = count;
+    }
+    if (0 != (count = parseList(list, _cmdLine.findOption("mipCounts"))))
+    {
+        memcpy(_params.m_mipCounts, list, count*sizeof(uint32_t));
+        _params.m_numMipCounts = count;
+    }
+    if (0 != (count = parseList(list, _cmdLine.findOption("lightingModels"), s_lightingModelStr, LightingModel::Count)))
+    {
+        memcpy(_params.m_lightingModels, list, count*sizeof(uint32_t));
+        _params.m_numLightingModels = count;
+    }
+    if (0 != (count = parseList(list, _cmdLine.findOption("threads"))))
+    {
+        memcpy(_params.m_threads, list, count*sizeof(uint32_t));
+        _params.m_numThreads = count;
+    }
+
+    const char* patternStr[CubemapPattern::Count];
+    for (uint32_t ii = 0; ii < CubemapPattern::Count; ++ii)
+    {
+        patternStr[ii] = getCubemapPatternStr(CubemapPattern::Enum(ii));
+    }
+    if (0 != parseList(list, _cmdLine.findOption("pattern"), patternStr, CubemapPattern::Count)
+    &&  list[0] < CubemapPattern::Count)
+    {
+        _params.m_pattern = list[0];
+    }
+
+    _cmdLine.hasArg(_params.m_shOrder,   '\0', "shOrder");
+    _cmdLine.hasArg(_params.m_repeat,    '\0', "repeat");
+    _cmdLine.hasArg(_params.m_useOpenCL, '\0', "useOpenCL");
+    _cmdLine.hasArg(_params.m_perfCounters, '\0', "perfCounters");
+    BENCH_COPY(_params.m_tmpDir, _cmdLine.findOption("tmpDir"));
+
+    const char* output = _cmdLine.findOption("output");
+    if (NULL != output)
+    {
+        BENCH_COPY(_params.m_output, output);
+    }
+
+    _params.m_repeat = max(UINT32_C(1), _params.m_repeat);
+}
+
+static void printHelp()
+{
+    fprintf(stderr
+           , "cmft_bench - cmft performance benchmark\n"
+             "\n"
+             "Usage: cmft_bench [options]\n"
+             "\n"
+             "    --faceSizes <list>       Comma separated face sizes. Default: 64,128,256\n"
+             "    --mipCounts <list>       Comma separated radiance mip counts. Default: 1,7\n"
+             "    --lightingModels <list>  Comma separated radiance lighting models (phong, phongbrdf, blinn, blinnbrdf). Default: phongbrdf,blinnbrdf\n"
+             "    --threads <list>         Comma separated CPU thread counts. Default: 1,<hardware threads>\n"
+             "    --shOrder <uint>         Spherical harmonics order. Default: 5\n"
+             "    --repeat <uint>          Runs per configuration, the fastest one is reported. Default: 3\n"
+             "    --pattern <name>         Source cubemap (gradient, noise, sunDisk, mostlyBlack, spike, constant). Default: sunDisk\n"
+             "    --useOpenCL <bool>       Also benchmark on the first OpenCL GPU device. Default: false\n"
+             "    --perfCounters <bool>    Collect cycles, instructions, LLC and dTLB misses per run and report IPC and bytes read from memory per texel and radiance tap. Linux with hardware counters exposed only. Default: false\n"
+             "    --tmpDir <path>          Directory for loader benchmark files. Default: working directory\n"
+             "    --output <path>          JSON report path. Default: cmft_bench.json\n"
+             "\n"
+           );
+}
+
+static uint64_t cubemapNumTexels(uint32_t _faceSize, uint32_t _mipCount)
+{
+    uint64_t numTexels = 0;
+    for (uint32_t mip = 0; mip < _mipCount; ++mip)
+    {
+        const uint64_t mipSize = max(UINT32_C(1), _faceSize>>mip);
+        numTexels += 6*mipSize*mipSize;
+    }
+    return numTexels;
+}
+
+/// Runs of a benchmark are counted between perfCountersRead() of _begin and this.
+static void countersAdd(PerfCounters& _sum, const PerfCounters& _begin)
+{
+    PerfCounters end;
+    PerfCounters delta;
+    if (perfCountersRead(end))
+    {
+        perfCountersDelta(delta, _begin, end);
+        _sum.m_cycles       += delta.m_cycles;
+        _sum.m_instructions += delta.m_instructions;
+        _sum.m_llcMisses    += delta.m_llcMisses;
+        _sum.m_dtlbMisses   += delta.m_dtlbMisses;
+    }
+}
+
+static double benchIpc(const BenchResult& _result)
+{
+    return (0 != _result.m_counters.m_cycles) ? double(_result.m_counters.m_instructions)/double(_result.m_counters.m_cycles) : 0.0;
+}
+
+/// Bytes read from memory, LLC misses of 64 byte lines, per _count.
+static double benchBytesPer(const BenchResult& _result, uint64_t _count)
+{
+    return (0 != _count) ? double(_result.m_counters.m_llcMisses)*64.0/double(_count) : 0.0;
+}
+
+static void addResult(const char* _name
+                    , const char* _detail
+                    , const char* _device
+                    , uint32_t _faceSize
+                    , uint32_t _mipCount
+                    , uint32_t _threads
+                    , double _seconds
+                    , uint64_t _numTexels
+                    , const PerfCounters& _counters = PerfCounters()
+                    , uint32_t _runs = 1
+                    , uint64_t _taps = 0
+                    )
+{
+    if (BENCH_MAX_RESULT == s_numResults)
+    {
+        return;
+    }
+
+    BenchResult& result = s_results[s_numResults++];
+    BENCH_COPY(result.m_name, _name);
+    BENCH_COPY(result.m_detail, _detail);
+    BENCH_COPY(result.m_device, _device);
+    result.m_faceSize = _faceSize;
+    result.m_mipCount = _mipCount;
+    result.m_threads = _threads;
+    result.m_seconds = _seconds;
+    result.m_texelsPerSec = (0.0 < _seconds) ? double(_numTexels)/_seconds : 0.0;
+    result.m_numTexels = _numTexels;
+    result.m_taps = _taps;
+    result.m_counters.m_cycles       = _counters.m_cycles/_runs;
+    result.m_counters.m_instructions = _counters.m_instructions/_runs;
+    result.m_counters.m_llcMisses    = _counters.m_llcMisses/_runs;
+    result.m_counters.m_dtlbMisses   = _counters.m_dtlbMisses/_runs;
+
+    printf("%-12s %-12s %-8s %6u %4u %4u %10.4f s %14.0f texels/s"
+          , result.m_name
+          , result.m_detail
+          , result.m_device
+          , result.m_faceSize
+          , result.m_mipCount
+          , result.m_threads
+          , result.m_seconds
+          , result.m_texelsPerSec
+          );
+    if (s_perfCounters)
+    {
+        printf(" %5.2f ipc %8.3f B/texel", benchIpc(result), benchBytesPer(result, result.m_numTexels));
+        if (0 != result.m_taps)
+        {
+            printf(" %8.4f B/tap", benchBytesPer(result, result.m_taps));
+        }
+    }
+    printf("\n");
+}
+
+static bool writeJson(const char* _filePath, const ClContext* _clContext)
+{
+    FILE* fp = fopen(_filePath, "w");
+    if (NULL == fp)
+    {
+        WARN("Could not open file %s for writing.", _filePath);
+        return false;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "    \"hardwareThreads\": %u,\n", getNumHardwareThreads());
+    if (NULL != _clContext)
+    {
+        fprintf(fp, "    \"clDevice\": \"%s %s\",\n", _clContext->m_deviceVendor, _clContext->m_deviceName);
+    }
+    fprintf(fp, "    \"results\": [\n");
+    for (uint32_t ii = 0; ii < s_numResults; ++ii)
+    {
+        const BenchResult& result = s_results[ii];
+        fprintf(fp, "        { \"name\": \"%s\"", result.m_name);
+        if ('\0' != result.m_detail[0]) { fprintf(fp, ", \"detail\": \"%s\"", result.m_detail); }
+        fprintf(fp, ", \"device\": \"%s\"", result.m_device);
+        if (0 != result.m_faceSize)     { fprintf(fp, ", \"faceSize\": %u", result.m_faceSize); }
+        if (0 != result.m_mipCount)     { fprintf(fp, ", \"mipCount\": %u", result.m_mipCount); }
+        if (0 != result.m_threads)      { fprintf(fp, ", \"threads\": %u", result.m_threads); }
+        if (0 != result.m_counters.m_cycles)
+        {
+            fprintf(fp, ", \"cycles\": %llu, \"instructions\": %llu, \"llcMisses\": %llu, \"dtlbMisses\": %llu, \"ipc\": %.3f, \"bytesPerTexel\": %.4f"
+                   , (unsigned long long)result.m_counters.m_cycles
+                   , (unsigned long long)result.m_counters.m_instructions
+                   , (unsigned long long)result.m_counters.m_llcMisses
+                   , (unsigned long long)result.m_counters.m_dtlbMisses
+                   , benchIpc(result)
+                   , benchBytesPer(result, result.m_numTexels)
+                   );
+            if (0 != result.m_taps)     { fprintf(fp, ", \"taps\": %llu, \"bytesPerTap\": %.5f", (unsigned long long)result.m_taps, benchBytesPer(result, result.m_taps)); }
+        }
+        fprintf(fp, ", \"seconds\": %.6f, \"texelsPerSec\": %.1f }%s\n"
+               , result.m_seconds
+               , result.m_texelsPerSec
+               , (ii+1 == s_numResults) ? "" : ","
+               );
+    }
+    fprintf(fp, "    ]\n");
+    fprintf(fp, "}\n");
+
+    fclose(fp);
+    return true;
+}
+
+static double secondsSince(int64_t _start)
+{
+    return double(bx::getHPCounter()-_start)/double(bx::getHPFrequency());
+}
+
+static void benchRadiance(const BenchParameters& _params, const Image& _src, const ClContext* _clContext)
+{
+    const uint32_t faceSize = _src.m_width;
+    for (uint32_t mm = 0; mm < _params.m_numMipCounts; ++mm)
+    {
+        const uint32_t mipCount = _params.m_mipCounts[mm];
+        const uint64_t numTexels = cubemapNumTexels(faceSize, mipCount);
+
+        for (uint32_t ll = 0; ll < _params.m_numLightingModels; ++ll)
+        {
+            const LightingModel::Enum lightingModel = LightingModel::Enum(_params.m_lightingModels[ll]);
+
+            RadianceFilterEstimate estimate;
+            imageRadianceFilterEstimate(estimate, faceSize, (TextureFormat::Enum)_src.m_format, faceSize, lightingModel, false, uint8_t(mipCount), 10, 1);
+
+            // CPU threads alone, together with the device, then the device alone.
+            for (uint32_t dd = 0, ddEnd = (NULL == _clContext) ? 1 : 3; dd < ddEnd; ++dd)
+            {
+                const char* device = (0 == dd) ? "cpu" : (1 == dd) ? "cpu+gpu" : "gpu";
+                const ClContext* clContext = (0 == dd) ? NULL : _clContext;
+
+                for (uint32_t tt = 0, ttEnd = (2 == dd) ? 1 : _params.m_numThreads; tt < ttEnd; ++tt)
+                {
+                    const uint32_t numThreads = (2 == dd) ? 0 : _params.m_threads[tt];
+
+                    double best = HUGE_VAL;
+                    PerfCounters counters;
+                    for (uint32_t rr = 0; rr < _params.m_repeat; ++rr)
+                    {
+                        Image dst;
+                        PerfCounters begin;
+                        perfCountersRead(begin);
+                        const int64_t start = bx::getHPCounter();
+                        imageRadianceFilter(dst, faceSize, lightingModel, false, uint8_t(mipCount), 10, 1, _src, int16_t(numThreads), clContext);
+                        best = min(best, secondsSince(start));
+                        countersAdd(counters, begin);
+                        imageUnload(dst);
+                    }
+
+                    addResult("radiance", s_lightingModelStr[lightingModel], device, faceSize, mipCount, numThreads, best, numTexels, counters, _params.m_repeat, estimate.m_numTaps);
+                }
+            }
+        }
+    }
+}
+
+static void benchIrradianceSh(const BenchParameters& _params, const Image& _src, const ClContext* _clContext)
+{
+    const uint32_t faceSize = _src.m_width;
+    const uint64_t numTexels = cubemapNumTexels(faceSize, 1);
+
+    char shOrder[16];
+    sprintf(shOrder, "order%u", _params.m_shOrder);
+
+    for (uint32_t dd = 0, ddEnd = (NULL == _clContext) ? 1 : 2; dd < ddEnd; ++dd)
+    {
+        const char* device = (0 == dd) ? "cpu" : "gpu";
+        const ClContext* clContext = (0 == dd) ? NULL : _clContext;
+
+        for (uint32_t tt = 0, ttEnd = (1 == dd) ? 1 : _params.m_numThreads; tt < ttEnd; ++tt)
+        {
+            // Both filters run on the shared thread pool, the calling thread helps out.
+            const uint32_t numThreads = (1 == dd) ? 0 : _params.m_threads[tt];
+            if (0 == dd)
+            {
+                threadPoolInit(uint16_t(max(UINT32_C(1), numThreads)-1));
+            }
+
+            double bestIrradiance = HUGE_VAL;
+            double bestShCoeffs = HUGE_VAL;
+            PerfCounters irradianceCounters;
+            PerfCounters shCoeffsCounters;
+            for (uint32_t rr = 0; rr < _params.m_repeat; ++rr)
+            {
+                Image dst;
+                PerfCounters begin;
+                perfCountersRead(begin);
+                int64_t start = bx::getHPCounter();
+                imageIrradianceFilterSh(dst, faceSize, _src, uint8_t(_params.m_shOrder), clContext);
+                bestIrradiance = min(bestIrradiance, secondsSince(start));
+                countersAdd(irradianceCounters, begin);
+                imageUnload(dst);
+
+                double shCoeffs[SH_COEFF_NUM][3];
+                perfCountersRead(begin);
+                start = bx::getHPCounter();
+                imageShCoeffs(shCoeffs, _src, uint8_t(_params.m_shOrder), clContext);
+                bestShCoeffs = min(bestShCoeffs, secondsSince(start));
+                countersAdd(shCoeffsCounters, begin);
+            }
+
+            addResult("irradiance", shOrder, device, faceSize, 0, numThreads, bestIrradiance, numTexels, irradianceCounters, _params.m_repeat);
+            addResult("shcoeffs",   shOrder, device, faceSize, 0, numThreads, bestShCoeffs,   numTexels, shCoeffsCounters,   _params.m_repeat);
+        }
+    }
+
+    threadPoolInit(getNumHardwareThreads()-1);
+}
+
+static void benchConversions(const BenchParameters& _params, const Image& _src)
+{
+    const uint32_t faceSize = _src.m_width;
+    const uint64_t numTexels = cubemapNumTexels(faceSize, 1);
+
+    static const TextureFormat::Enum s_formats[] =
+    {
+        TextureFormat::RGBA16F,
+        TextureFormat::RGBE,
+        TextureFormat::BGRA8,
+    };
+
+    for (uint32_t ii = 0; ii < CMFT_COUNTOF(s_formats); ++ii)
+    {
+        double bestTo = HUGE_VAL;
+        double bestFrom = HUGE_VAL;
+        PerfCounters toCounters;
+        PerfCounters fromCounters;
+        for (uint32_t rr = 0; rr < _params.m_repeat; ++rr)
+        {
+            Image dst;
+            PerfCounters begin;
+            perfCountersRead(begin);
+            int64_t start = bx::getHPCounter();
+            imageConvert(dst, s_formats[ii], _src);
+            bestTo = min(bestTo, secondsSince(start));
+            countersAdd(toCounters, begin);
+
+            Image back;
+            perfCountersRead(begin);
+            start = bx::getHPCounter();
+            imageConvert(back, TextureFormat::RGBA32F, dst);
+            bestFrom = min(bestFrom, secondsSince(start));
+            countersAdd(fromCounters, begin);
+
+            imageUnload(back);
+            imageUnload(dst);
+        }
+
+        char detail[32];
+        sprintf(detail, "to%s", getTextureFormatStr(s_formats[ii]));
+        addResult("convert", detail, "cpu", faceSize, 0, 0, bestTo, numTexels, toCounters, _params.m_repeat);
+        sprintf(detail, "from%s", getTextureFormatStr(s_formats[ii]));
+        addResult("convert", detail, "cpu", faceSize, 0, 0, bestFrom, numTexels, fromCounters, _params.m_repeat);
+    }
+
+    double bestToLatLong = HUGE_VAL;
+    double bestFromLatLong = HUGE_VAL;
+    PerfCounters toLatLongCounters;
+    PerfCounters fromLatLongCounters;
+    uint64_t latLongTexels = 0;
+    for (uint32_t rr = 0; rr < _params.m_repeat; ++rr)
+    {
+        Image latLong;
+        PerfCounters begin;
+        perfCountersRead(begin);
+        int64_t start = bx::getHPCounter();
+        imageLatLongFromCubemap(latLong, _src);
+        bestToLatLong = min(bestToLatLong, secondsSince(start));
+        countersAdd(toLatLongCounters, begin);
+        latLongTexels = uint64_t(latLong.m_width)*latLong.m_height;
+
+        Image cubemap;
+        perfCountersRead(begin);
+        start = bx::getHPCounter();
+        imageCubemapFromLatLong(cubemap, latLong);
+        bestFromLatLong = min(bestFromLatLong, secondsSince(start));
+        countersAdd(fromLatLongCounters, begin);
+
+        imageUnload(cubemap);
+        imageUnload(latLong);
+    }
+
+    addResult("convert", "toLatLong",   "cpu", faceSize, 0, 0, bestToLatLong,   latLongTexels, toLatLongCounters,   _params.m_repeat);
+    addResult("convert", "fromLatLong", "cpu", faceSize, 0, 0, bestFromLatLong, numTexels,     fromLatLongCounters, _params.m_repeat);
+}
+
+static void benchLoaders(const BenchParameters& _params, const Image& _src)
+{
+    const uint32_t faceSize = _src.m_width;
+    const uint64_t numTexels = cubemapNumTexels(faceSize, 1);
+
+    struct LoaderCase
+    {
+        ImageFileType::Enum m_fileType;
+        TextureFormat::Enum m_format;
+    };
+
+    static const LoaderCase s_cases[] =
+    {
+        { ImageFileType::DDS, TextureFormat::RGBA32F },
+        { ImageFileType::DDS, TextureFormat::RGBA16F },
+        { ImageFileType::KTX, TextureFormat::RGBA32F },
+        { ImageFileType::TGA, TextureFormat::BGRA8   },
+        { ImageFileType::HDR, TextureFormat::RGBE    },
+        { ImageFileType::EXR, TextureFormat::RGBA16F },
+        { ImageFileType::KTX2, TextureFormat::RGBA16F },
+    };
+
+    for (uint32_t ii = 0; ii < CMFT_COUNTOF(s_cases); ++ii)
+    {
+        const LoaderCase& loaderCase = s_cases[ii];
+
+        // Tga, Hdr and Exr files hold a single face, cubemap is saved as a horizontal strip.
+        Image image;
+        const bool strip = (ImageFileType::TGA == loaderCase.m_fileType
+                         || ImageFileType::HDR == loaderCase.m_fileType
+                         || ImageFileType::EXR == loaderCase.m_fileType
+                         );
+        if (strip)
+        {
+            imageHStripFromCubemap(image, _src);
+        }
+        else
+        {
+            imageRef(image, _src);
+        }
+
+        char fileName[512];
+        sprintf(fileName, "%s%scmft_bench_%u", _params.m_tmpDir, ('\0' == _params.m_tmpDir[0]) ? "" : "/", ii);
+        const bool saved = imageSave(image, fileName, loaderCase.m_fileType, loaderCase.m_format);
+        if (strip)
+        {
+            imageUnload(image);
+        }
+        if (!saved)
+        {
+            continue;
+        }
+
+        char filePath[512];
+        sprintf(filePath, "%s%s", fileName, getFilenameExtensionStr(loaderCase.m_fileType));
+
+        double best = HUGE_VAL;
+        PerfCounters counters;
+        for (uint32_t rr = 0; rr < _params.m_repeat; ++rr)
+        {
+            Image loaded;
+            PerfCounters begin;
+            perfCountersRead(begin);
+            const int64_t start = bx::getHPCounter();
+            imageLoad(loaded, filePath, TextureFormat::RGBA32F);
+            best = min(best, secondsSince(start));
+            countersAdd(counters, begin);
+            imageUnload(loaded);
+        }
+        remove(filePath);
+
+        char detail[32];
+        sprintf(detail, "%s%s", getFileTypeStr(loaderCase.m_fileType), getTextureFormatStr(loaderCase.m_format));
+        addResult("load", detail, "cpu", faceSize, 0, 0, best, numTexels, counters, _params.m_repeat);
+    }
+}
+
+int main(int _argc, char const* const* _argv)
+{
+    bx::CommandLine cmdLine(_argc, _argv);
+
+    if (cmdLine.hasArg('h', "help"))
+    {
+        printHelp();
+        return EXIT_SUCCESS;
+    }
+
+    BenchParameters params;
+    benchParametersFromCommandLine(params, cmdLine);
+
+    g_printInfo = false;
+
+    // Before any worker thread starts, counters only follow threads started after them.
+    s_perfCounters = params.m_perfCounters && perfCountersOpen();
+
+    ClContext clContext;
+    const ClContext* activeClContext = NULL;
+    bool clLoaded = false;
+    if (params.m_useOpenCL)
+    {
+        clLoaded = bx::clLoad();
+        if (clLoaded && clContext.init(CL_VENDOR_ANY_GPU, CL_DEVICE_TYPE_GPU, 0))
+        {
+            activeClContext = &clContext;
+        }
+        else
+        {
+            WARN("OpenCL device is not available, benchmarking on the CPU only.");
+        }
+    }
+
+    printf("%-12s %-12s %-8s %6s %4s %4s %12s %23s\n", "name", "detail", "device", "face", "mips", "thr", "time", "throughput");
+
+    for (uint32_t ff = 0; ff < params.m_numFaceSizes; ++ff)
+    {
+        // Default sky gradient with a bright sun has high dynamic range, as real radiance filter inputs do.
+        Image src;
+        if (!imageCubemapFromPattern(src, CubemapPattern::Enum(params.m_pattern), params.m_faceSizes[ff]))
+        {
+            continue;
+        }
+
+        benchRadiance(params, src, activeClContext);
+        benchIrradianceSh(params, src, activeClContext);
+        benchConversions(params, src);
+        benchLoaders(params, src);
+
+        imageUnload(src);
+    }
+
+    const bool written = writeJson(params.m_output, activeClContext);
+
+    clContext.destroy();
+    if (clLoaded)
+    {
+        bx::clUnload();
+    }
+
+    perfCountersClose();
+
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -8,18 +8,41 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/stat.h>
 
 #include <bx/commandline.h>
-
+#include <bx/mutex.h>
+#include <bx/os.h>
+#include <bx/platform.h>
+#include <bx/sem.h>
+#include <bx/thread.h>
+#include <bx/timer.h>
+#include <bx/uint32_t.h> // bx::uint32_cntlz
+
+#if BX_PLATFORM_POSIX
+#   include <errno.h>
+#   include <sys/socket.h>
+#   include <sys/time.h>
+#   include <sys/un.h>
+#   include <unistd.h>
+#endif // BX_PLATFORM_POSIX
+
+#include <cmft/allocator.h>
 #include <cmft/image.h>
 #include <cmft/cubemapfilter.h>
+#include <cmft/threadpool.h>
+#include <cmft/profiler.h>
 
 #include <base/config.h>
+#include <base/half.h> //halfFromFloat
+#include <base/hash.h> //HashMurmur2A
 #include <base/macros.h> //countof
 #include <base/utils.h> //strncpy
 
 #include <cmft/messages.h> //INFO, WARN, g_printInfo, g_printWarnings
 
+#include "tokenize.h" //tokenizeCommandLine
+
 using namespace cmft;
 
 struct FilterType
@@ -30,6 +53,20 @@ struct FilterType
         Radiance,
         Irradiance,
         ShCoeffs,
+        RadianceGgx,
+        BrdfLut,
+        BrdfLutGgx,
+        RadiancePreview,
+    };
+};
+
+struct JobPriority
+{
+    enum Enum
+    {
+        Background,
+        Normal,
+        High,
     };
 };
 
@@ -42,6 +79,7 @@ struct OutputType
         CubeCross,
         HStrip,
         FaceList,
+        Octahedral,
 
         Count,
     };
@@ -54,6 +92,7 @@ static const char* s_outputTypeStr[OutputType::Count] =
     "CubeCross",
     "HStrip",
     "FaceList",
+    "Octahedral",
 };
 
 static const char* getOutputTypeStr(OutputType::Enum _outputType)
@@ -81,10 +120,48 @@ struct CliOptionMap
 
 static const CliOptionMap s_filterType[] =
 {
-    { "none",       FilterType::None       },
-    { "radiance",   FilterType::Radiance   },
-    { "irradiance", FilterType::Irradiance },
-    { "shcoeffs",   FilterType::ShCoeffs   },
+    { "none",            FilterType::None            },
+    { "radiance",        FilterType::Radiance        },
+    { "irradiance",      FilterType::Irradiance      },
+    { "shcoeffs",        FilterType::ShCoeffs        },
+    { "ggx",             FilterType::RadianceGgx     },
+    { "brdflut",         FilterType::BrdfLut         },
+    { "brdflutggx",      FilterType::BrdfLutGgx      },
+    { "radiancepreview", FilterType::RadiancePreview },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
+struct ShFormat
+{
+    enum Enum
+    {
+        C,
+        Float32,
+        Float16,
+    };
+};
+
+static const CliOptionMap s_shFormat[] =
+{
+    { "c",       ShFormat::C       },
+    { "float32", ShFormat::Float32 },
+    { "float16", ShFormat::Float16 },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
+struct IrradianceMethod
+{
+    enum Enum
+    {
+        Sh,
+        Cosine,
+    };
+};
+
+static const CliOptionMap s_irradianceMethod[] =
+{
+    { "sh",     IrradianceMethod::Sh     },
+    { "cosine", IrradianceMethod::Cosine },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -97,6 +174,27 @@ static const CliOptionMap s_lightingModel[] =
     CLI_OPTION_MAP_TERMINATOR,
 };
 
+static const CliOptionMap s_cubemapPattern[] =
+{
+    { "none",        CubemapPattern::Count       },
+    { "gradient",    CubemapPattern::Gradient    },
+    { "noise",       CubemapPattern::Noise       },
+    { "sundisk",     CubemapPattern::SunDisk     },
+    { "mostlyblack", CubemapPattern::MostlyBlack },
+    { "spike",       CubemapPattern::Spike       },
+    { "constant",    CubemapPattern::Constant    },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
+static const CliOptionMap s_resampleFilter[] =
+{
+    { "box",      ResampleFilter::Box      },
+    { "triangle", ResampleFilter::Triangle },
+    { "lanczos",  ResampleFilter::Lanczos  },
+    { "kaiser",   ResampleFilter::Kaiser   },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
 static const CliOptionMap s_clVendors[] =
 {
     { "NONE_FROM_THE_LIST", (uint32_t)CL_VENDOR_OTHER   },
@@ -106,6 +204,7 @@ static const CliOptionMap s_clVendors[] =
     { "nvidia",             (uint32_t)CL_VENDOR_NVIDIA  },
     { "anyGpuVendor",       (uint32_t)CL_VENDOR_ANY_GPU },
     { "anyCpuVendor",       (uint32_t)CL_VENDOR_ANY_CPU },
+    { "auto",               (uint32_t)CL_VENDOR_AUTO    },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -118,12 +217,22 @@ static const CliOptionMap s_deviceType[] =
     CLI_OPTION_MAP_TERMINATOR,
 };
 
+static const CliOptionMap s_jobPriority[] =
+{
+    { "background", JobPriority::Background },
+    { "normal",     JobPriority::Normal     },
+    { "high",       JobPriority::High       },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
 static const CliOptionMap s_validFileTypes[] =
 {
     { "dds", ImageFileType::DDS },
     { "ktx", ImageFileType::KTX },
     { "tga", ImageFileType::TGA },
     { "hdr", ImageFileType::HDR },
+    { "exr", ImageFileType::EXR },
+    { "ktx2", ImageFileType::KTX2 },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -140,6 +249,33 @@ static const CliOptionMap s_validTextureFormats[] =
     { "rgba16",  TextureFormat::RGBA16  },
     { "rgba16f", TextureFormat::RGBA16F },
     { "rgba32f", TextureFormat::RGBA32F },
+    { "rg16f",   TextureFormat::RG16F   },
+    { "rg32f",   TextureFormat::RG32F   },
+    { "rgb9e5",  TextureFormat::RGB9E5     },
+    { "r11g11b10f", TextureFormat::R11G11B10F },
+    { "rgbm",    TextureFormat::RGBM8     },
+    { "rgbd",    TextureFormat::RGBD8     },
+    { "logluv",  TextureFormat::LOGLUV8   },
+    { "bc6h",    TextureFormat::BC6H_UF16 },
+    { "bc6hs",   TextureFormat::BC6H_SF16 },
+    { "bc7",     TextureFormat::BC7       },
+    { "etc2",    TextureFormat::ETC2      },
+    { "astc4x4", TextureFormat::ASTC4X4   },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
+static const CliOptionMap s_compressionQuality[] =
+{
+    { "fast",    CompressionQuality::Fast    },
+    { "quality", CompressionQuality::Quality },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
+static const CliOptionMap s_mipLayout[] =
+{
+    { "filetype",      MipLayout::FileType      },
+    { "largestfirst",  MipLayout::LargestFirst  },
+    { "smallestfirst", MipLayout::SmallestFirst },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -150,6 +286,7 @@ static const CliOptionMap s_validDdsOutputTypes[] =
     { "cubecross", OutputType::CubeCross },
     { "hstrip",    OutputType::HStrip    },
     { "facelist",  OutputType::FaceList  },
+    { "octahedral", OutputType::Octahedral },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -160,6 +297,7 @@ static const CliOptionMap s_validKtxOutputTypes[] =
     { "cubecross", OutputType::CubeCross },
     { "hstrip",    OutputType::HStrip    },
     { "facelist",  OutputType::FaceList  },
+    { "octahedral", OutputType::Octahedral },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -169,6 +307,7 @@ static const CliOptionMap s_validTgaOutputTypes[] =
     { "cubecross", OutputType::CubeCross },
     { "hstrip",    OutputType::HStrip    },
     { "facelist",  OutputType::FaceList  },
+    { "octahedral", OutputType::Octahedral },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -178,6 +317,28 @@ static const CliOptionMap s_validHdrOutputTypes[] =
     { "cubecross", OutputType::CubeCross },
     { "hstrip",    OutputType::HStrip    },
     { "facelist",  OutputType::FaceList  },
+    { "octahedral", OutputType::Octahedral },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
+static const CliOptionMap s_validExrOutputTypes[] =
+{
+    { "latlong",   OutputType::LatLong   },
+    { "cubecross", OutputType::CubeCross },
+    { "hstrip",    OutputType::HStrip    },
+    { "facelist",  OutputType::FaceList  },
+    { "octahedral", OutputType::Octahedral },
+    CLI_OPTION_MAP_TERMINATOR,
+};
+
+static const CliOptionMap s_validKtx2OutputTypes[] =
+{
+    { "latlong",   OutputType::LatLong   },
+    { "cubemap",   OutputType::Cubemap   },
+    { "cubecross", OutputType::CubeCross },
+    { "hstrip",    OutputType::HStrip    },
+    { "facelist",  OutputType::FaceList  },
+    { "octahedral", OutputType::Octahedral },
     CLI_OPTION_MAP_TERMINATOR,
 };
 
@@ -199,6 +360,14 @@ const CliOptionMap* getValidOutputTypes(ImageFileType::Enum _fileType)
     {
         return s_validHdrOutputTypes;
     }
+    else if (ImageFileType::EXR == _fileType)
+    {
+        return s_validExrOutputTypes;
+    }
+    else if (ImageFileType::KTX2 == _fileType)
+    {
+        return s_validKtx2OutputTypes;
+    }
     else
     {
         return NULL;
@@ -295,6 +464,10 @@ struct InputParameters
     char m_inputNegYFace[2048];
     char m_inputPosZFace[2048];
     char m_inputNegZFace[2048];
+    bool m_mapInput;
+    uint32_t m_generatePattern;
+    uint32_t m_generateFaceSize;
+    uint32_t m_generateSeed;
 
     // Image Operations.
     float m_inputGammaPowNumerator;
@@ -302,6 +475,8 @@ struct InputParameters
     float m_outputGammaPowNumerator;
     float m_outputGammaPowDenominator;
     bool m_generateMipMapChain;
+    uint32_t m_mipChainFilter;
+    bool m_mipChainAverageSeams;
 
     // Cubemap rotate/flip.
     uint32_t m_imageOpPosX;
@@ -314,27 +489,88 @@ struct InputParameters
     // Filter parameters.
     uint32_t m_filterType;
     uint32_t m_srcFaceSize;
+    uint32_t m_resizeFilter;
     bool m_excludeBase;
     uint32_t m_mipCount;
     uint32_t m_glossScale;
     uint32_t m_glossBias;
+    float m_lobeTolerance;
+    float m_adaptiveSampling;
     uint32_t m_dstFaceSize;
     uint32_t m_lightingModel;
+    bool m_sourcePyramid;
+    bool m_chainFilter;
+    float m_chainMaxError;
+    float m_timeBudget;
+    bool m_costHeatmap;
+    bool m_halfPrecision;
+    bool m_gpuEncode;
+    bool m_bakeIrradiance;
+    bool m_bakeShCoeffs;
+    uint32_t m_irradianceFaceSize;
+    uint32_t m_irradianceMethod;
+    uint32_t m_shOrder;
+    uint32_t m_shSourceSize;
+    float m_shSourceMaxError;
+    uint32_t m_shFormat;
+    uint32_t m_probeTileWidth;
+    uint32_t m_probeTileHeight;
+    uint32_t m_probeBasis;
+    float m_probeBasisMaxError;
+    uint32_t m_numSamples;
+    uint32_t m_numLightSamples;
+
+    // Sharded radiance bake.
+    uint32_t m_shardIndex;
+    uint32_t m_shardCount;
+    bool m_mergeShards;
+    char m_shardFile[1024];
+    char m_checkpointFile[1024];
+    float m_checkpointInterval;
+    bool m_resume;
 
     // Processing devices.
     uint32_t m_numCpuProcessingThreads;
+    uint32_t m_minCpuProcessingThreads;
+    uint32_t m_maxCpuProcessingThreads;
+    bool m_pinThreadsToNuma;
+    bool m_pinThreadsToCores;
+    bool m_numaReplicas;
+    bool m_hugePages;
+    bool m_memoryStats;
+    bool m_dryRun;
+    bool m_deterministic;
     bool m_useOpenCL;
+    bool m_gpuProfile;
     uint32_t m_clVendor;
     char m_vendorStrPart[1024];
     uint32_t m_deviceType;
     uint32_t m_deviceIndex;
+    uint32_t m_numDevices;
+    uint32_t m_clCpuCores;
+    char m_clBinaryCacheDir[1024];
 
     // Output.
     uint32_t m_outputFilesNum;
 #define MAX_OUTPUT_NUM 16
     OutputFile m_outputFiles[MAX_OUTPUT_NUM];
+    uint32_t m_compressionQuality;
+    bool m_tgaRle;
+    uint32_t m_mipLayout;
+    float m_rgbmRange;
+    float m_rgbdRange;
+    bool m_writeBehind;
+    bool m_mappedOutput;
 
     // Misc.
+    char m_filterCacheDir[1024];
+    uint32_t m_sourceCacheSize;
+    uint32_t m_priority;
+    float m_deadline;
+    uint32_t m_backgroundShare;
+    char m_filterMatrixDir[1024];
+    char m_autotuneFile[1024];
+    bool m_autotuneOpenCL;
     bool m_silent;
 };
 
@@ -350,6 +586,10 @@ void inputParametersFromCommandLine(InputParameters& _inputParameters, const bx:
     CMFT_COPY(_inputParameters.m_inputNegYFace, _cmdLine.findOption("inputFaceNegY"));
     CMFT_COPY(_inputParameters.m_inputPosZFace, _cmdLine.findOption("inputFacePosZ"));
     CMFT_COPY(_inputParameters.m_inputNegZFace, _cmdLine.findOption("inputFaceNegZ"));
+    _cmdLine.hasArg(_inputParameters.m_mapInput, '\0', "mapInput");
+    valueFromOptionMap(_inputParameters.m_generatePattern, s_cubemapPattern, _cmdLine.findOption("generate"));
+    _cmdLine.hasArg(_inputParameters.m_generateFaceSize, '\0', "generateFaceSize");
+    _cmdLine.hasArg(_inputParameters.m_generateSeed,     '\0', "generateSeed");
 
     // Image Operations.
     _cmdLine.hasArg(_inputParameters.m_inputGammaPowNumerator,    '\0', "inputGamma");
@@ -359,6 +599,8 @@ void inputParametersFromCommandLine(InputParameters& _inputParameters, const bx:
     _cmdLine.hasArg(_inputParameters.m_outputGammaPowNumerator,   '\0', "outputGammaNumerator");
     _cmdLine.hasArg(_inputParameters.m_outputGammaPowDenominator, '\0', "outputGammaDenominator");
     _cmdLine.hasArg(_inputParameters.m_generateMipMapChain,       '\0', "generateMipChain");
+    _cmdLine.hasArg(_inputParameters.m_mipChainAverageSeams,      '\0', "mipChainAverageSeams");
+    valueFromOptionMap(_inputParameters.m_mipChainFilter, s_resampleFilter, _cmdLine.findOption("mipChainFilter"));
 
     // Cubemap rotate/flip.
     _inputParameters.m_imageOpPosX = 0
@@ -414,18 +656,78 @@ void inputParametersFromCommandLine(InputParameters& _inputParameters, const bx:
 
     // Filter parameters.
     _cmdLine.hasArg(_inputParameters.m_srcFaceSize, '\0', "srcFaceSize");
+    valueFromOptionMap(_inputParameters.m_resizeFilter, s_resampleFilter, _cmdLine.findOption("resizeFilter"));
     _cmdLine.hasArg(_inputParameters.m_excludeBase, '\0', "excludeBase");
     _cmdLine.hasArg(_inputParameters.m_mipCount,    '\0', "mipCount");
     _cmdLine.hasArg(_inputParameters.m_glossScale,  '\0', "glossScale");
     _cmdLine.hasArg(_inputParameters.m_glossBias,   '\0', "glossBias");
+    _cmdLine.hasArg(_inputParameters.m_lobeTolerance, '\0', "lobeTolerance");
+    _cmdLine.hasArg(_inputParameters.m_adaptiveSampling, '\0', "adaptiveSampling");
     _cmdLine.hasArg(_inputParameters.m_dstFaceSize, '\0', "dstFaceSize");
 
     // Lighting model.
     valueFromOptionMap(_inputParameters.m_lightingModel, s_lightingModel, _cmdLine.findOption("lightingModel"));
 
+    // Irradiance method.
+    valueFromOptionMap(_inputParameters.m_irradianceMethod, s_irradianceMethod, _cmdLine.findOption("irradianceMethod"));
+
+    // Spherical harmonics order.
+    _cmdLine.hasArg(_inputParameters.m_shOrder, '\0', "shOrder");
+    _cmdLine.hasArg(_inputParameters.m_shSourceSize, '\0', "shSourceSize");
+    _cmdLine.hasArg(_inputParameters.m_shSourceMaxError, '\0', "shSourceMaxError");
+    valueFromOptionMap(_inputParameters.m_shFormat, s_shFormat, _cmdLine.findOption("shFormat"));
+    _cmdLine.hasArg(_inputParameters.m_probeTileWidth, '\0', "probeTileWidth");
+    _cmdLine.hasArg(_inputParameters.m_probeTileHeight, '\0', "probeTileHeight");
+    _cmdLine.hasArg(_inputParameters.m_probeBasis, '\0', "probeBasis");
+    _cmdLine.hasArg(_inputParameters.m_probeBasisMaxError, '\0', "probeBasisMaxError");
+    _cmdLine.hasArg(_inputParameters.m_sourcePyramid, '\0', "sourcePyramid");
+    _cmdLine.hasArg(_inputParameters.m_chainFilter, '\0', "chainFilter");
+    _cmdLine.hasArg(_inputParameters.m_chainMaxError, '\0', "chainMaxError");
+    _cmdLine.hasArg(_inputParameters.m_timeBudget, '\0', "timeBudget");
+    _cmdLine.hasArg(_inputParameters.m_costHeatmap, '\0', "costHeatmap");
+    _cmdLine.hasArg(_inputParameters.m_halfPrecision, '\0', "halfPrecision");
+    _cmdLine.hasArg(_inputParameters.m_bakeIrradiance, '\0', "bakeIrradiance");
+    _cmdLine.hasArg(_inputParameters.m_bakeShCoeffs, '\0', "bakeShCoeffs");
+    _cmdLine.hasArg(_inputParameters.m_irradianceFaceSize, '\0', "irradianceFaceSize");
+    _cmdLine.hasArg(_inputParameters.m_gpuEncode, '\0', "gpuEncode");
+
+    // Importance sampling.
+    _cmdLine.hasArg(_inputParameters.m_numSamples, '\0', "numSamples");
+    _cmdLine.hasArg(_inputParameters.m_numLightSamples, '\0', "numLightSamples");
+
+    // Sharded radiance bake.
+    _cmdLine.hasArg(_inputParameters.m_shardIndex, '\0', "shardIndex");
+    _cmdLine.hasArg(_inputParameters.m_shardCount, '\0', "shardCount");
+    _cmdLine.hasArg(_inputParameters.m_mergeShards, '\0', "mergeShards");
+    CMFT_COPY(_inputParameters.m_shardFile, _cmdLine.findOption("shardFile"));
+    CMFT_COPY(_inputParameters.m_checkpointFile, _cmdLine.findOption("checkpoint"));
+    _cmdLine.hasArg(_inputParameters.m_checkpointInterval, '\0', "checkpointInterval");
+    _cmdLine.hasArg(_inputParameters.m_resume, '\0', "resume");
+
     // Processing devices.
     _cmdLine.hasArg(_inputParameters.m_numCpuProcessingThreads, '\0', "numCpuProcessingThreads");
+    _cmdLine.hasArg(_inputParameters.m_minCpuProcessingThreads, '\0', "minCpuProcessingThreads");
+    _cmdLine.hasArg(_inputParameters.m_maxCpuProcessingThreads, '\0', "maxCpuProcessingThreads");
+    _cmdLine.hasArg(_inputParameters.m_pinThreadsToNuma, '\0', "pinThreadsToNuma");
+    _cmdLine.hasArg(_inputParameters.m_pinThreadsToCores, '\0', "pinThreadsToCores");
+    _cmdLine.hasArg(_inputParameters.m_numaReplicas, '\0', "numaReplicas");
+    _cmdLine.hasArg(_inputParameters.m_hugePages, '\0', "hugePages");
+    _cmdLine.hasArg(_inputParameters.m_memoryStats, '\0', "memoryStats");
+    _cmdLine.hasArg(_inputParameters.m_dryRun, '\0', "dryRun");
+    _cmdLine.hasArg(_inputParameters.m_deterministic, '\0', "deterministic");
+    _cmdLine.hasArg(_inputParameters.m_writeBehind, '\0', "writeBehind");
+    _cmdLine.hasArg(_inputParameters.m_mappedOutput, '\0', "mappedOutput");
+    _cmdLine.hasArg(_inputParameters.m_tgaRle, '\0', "tgaRle");
+    _cmdLine.hasArg(_inputParameters.m_rgbmRange, '\0', "rgbmRange");
+    _cmdLine.hasArg(_inputParameters.m_rgbdRange, '\0', "rgbdRange");
+    if (!(_inputParameters.m_rgbmRange > 0.0f) || !(_inputParameters.m_rgbdRange > 0.0f))
+    {
+        WARN("Encoding ranges have to be positive, rgbm %g and rgbd %g are ignored.", _inputParameters.m_rgbmRange, _inputParameters.m_rgbdRange);
+        _inputParameters.m_rgbmRange = ImageEncodeSettings().m_rgbmRange;
+        _inputParameters.m_rgbdRange = ImageEncodeSettings().m_rgbdRange;
+    }
     _cmdLine.hasArg(_inputParameters.m_useOpenCL, '\0', "useOpenCL");
+    _cmdLine.hasArg(_inputParameters.m_gpuProfile, '\0', "gpuProfile");
 
     // Cl vendor.
     uint32_t clVendor = (uint32_t)CL_VENDOR_ANY_GPU;
@@ -439,11 +741,24 @@ void inputParametersFromCommandLine(InputParameters& _inputParameters, const bx:
     // Device type/index.
     valueFromOptionMap(_inputParameters.m_deviceType, s_deviceType, _cmdLine.findOption("deviceType"));
     _cmdLine.hasArg(_inputParameters.m_deviceIndex, '\0', "deviceIndex");
+    _cmdLine.hasArg(_inputParameters.m_numDevices, '\0', "numDevices");
+    _cmdLine.hasArg(_inputParameters.m_clCpuCores, '\0', "clCpuCores");
+    CMFT_COPY(_inputParameters.m_clBinaryCacheDir, _cmdLine.findOption("clBinaryCache"));
+    CMFT_COPY(_inputParameters.m_filterCacheDir, _cmdLine.findOption("filterCache"));
+    _cmdLine.hasArg(_inputParameters.m_sourceCacheSize, '\0', "sourceCache");
+    valueFromOptionMap(_inputParameters.m_priority, s_jobPriority, _cmdLine.findOption("priority"));
+    _cmdLine.hasArg(_inputParameters.m_deadline, '\0', "deadline");
+    _cmdLine.hasArg(_inputParameters.m_backgroundShare, '\0', "backgroundShare");
+    CMFT_COPY(_inputParameters.m_filterMatrixDir, _cmdLine.findOption("filterMatrix"));
+    CMFT_COPY(_inputParameters.m_autotuneFile, _cmdLine.findOption("autotune"));
+    _inputParameters.m_autotuneOpenCL = !_cmdLine.hasArg("useOpenCL");
 
     // Misc.
     _inputParameters.m_silent = _cmdLine.hasArg("silent");
 
     // Output.
+    valueFromOptionMap(_inputParameters.m_compressionQuality, s_compressionQuality, _cmdLine.findOption("compressionQuality"));
+    valueFromOptionMap(_inputParameters.m_mipLayout, s_mipLayout, _cmdLine.findOption("mipLayout"));
     uint32_t outputCount = 0;
     uint32_t outputEnd = MAX_OUTPUT_NUM;
     _cmdLine.hasArg(outputEnd, '\0', "outputNum");
@@ -531,10 +846,14 @@ void inputParametersFromCommandLine(InputParameters& _inputParameters, const bx:
                     continue;
                 }
 
-                // Check if present.
+                // Check if present. BRDF lookup table is saved as is and does not need one.
                 if (NULL == outputTypeStr)
                 {
-                    WARN("Output(%u) - Texture format not specified. Defaulting to latlong.", outputId);
+                    if (FilterType::BrdfLut    != _inputParameters.m_filterType
+                    &&  FilterType::BrdfLutGgx != _inputParameters.m_filterType)
+                    {
+                        WARN("Output(%u) - Texture format not specified. Defaulting to latlong.", outputId);
+                    }
                 }
                 // Check if supported and valid.
                 else
@@ -596,9 +915,18 @@ void inputParametersDefault(InputParameters& _inputParameters)
     strcpy(_inputParameters.m_inputNegYFace, "");
     strcpy(_inputParameters.m_inputPosZFace, "");
     strcpy(_inputParameters.m_inputNegZFace, "");
+    _inputParameters.m_mapInput = false;
+    _inputParameters.m_generatePattern = CubemapPattern::Count;
+    _inputParameters.m_generateFaceSize = 256;
+    _inputParameters.m_generateSeed = 0;
 
     // Output.
     _inputParameters.m_outputFilesNum = 0;
+    _inputParameters.m_compressionQuality = CompressionQuality::Fast;
+    _inputParameters.m_tgaRle = false;
+    _inputParameters.m_mipLayout = MipLayout::FileType;
+    _inputParameters.m_rgbmRange = ImageEncodeSettings().m_rgbmRange;
+    _inputParameters.m_rgbdRange = ImageEncodeSettings().m_rgbdRange;
 
     // Image Operations.
     _inputParameters.m_inputGammaPowNumerator = 1.0f;
@@ -606,6 +934,8 @@ void inputParametersDefault(InputParameters& _inputParameters)
     _inputParameters.m_outputGammaPowNumerator = 1.0f;
     _inputParameters.m_outputGammaPowDenominator = 1.0f;
     _inputParameters.m_generateMipMapChain = false;
+    _inputParameters.m_mipChainFilter = ResampleFilter::Box;
+    _inputParameters.m_mipChainAverageSeams = false;
 
     // Cubemap rotate/flip.
     _inputParameters.m_imageOpPosX = 0;
@@ -618,27 +948,111 @@ void inputParametersDefault(InputParameters& _inputParameters)
     // Filter parameters.
     _inputParameters.m_filterType = 0;
     _inputParameters.m_srcFaceSize = 0;
+    _inputParameters.m_resizeFilter = ResampleFilter::Box;
     _inputParameters.m_excludeBase = false;
     _inputParameters.m_mipCount = 9;
     _inputParameters.m_glossScale = 10;
     _inputParameters.m_glossBias = 1;
+    _inputParameters.m_lobeTolerance = FilterSettings().m_lobeTolerance;
+    _inputParameters.m_adaptiveSampling = 0.0f;
     _inputParameters.m_dstFaceSize = 0;
     _inputParameters.m_lightingModel = 0;
+    _inputParameters.m_sourcePyramid = false;
+    _inputParameters.m_chainFilter = false;
+    _inputParameters.m_chainMaxError = 0.0f;
+    _inputParameters.m_timeBudget = 0.0f;
+    _inputParameters.m_costHeatmap = false;
+    _inputParameters.m_halfPrecision = false;
+    _inputParameters.m_bakeIrradiance = false;
+    _inputParameters.m_bakeShCoeffs = false;
+    _inputParameters.m_irradianceFaceSize = 0;
+    _inputParameters.m_gpuEncode = false;
+    _inputParameters.m_irradianceMethod = IrradianceMethod::Sh;
+    _inputParameters.m_shOrder = 5;
+    _inputParameters.m_shSourceSize = 64;
+    _inputParameters.m_shSourceMaxError = 0.002f;
+    _inputParameters.m_shFormat = ShFormat::C;
+    _inputParameters.m_probeTileWidth = 0;
+    _inputParameters.m_probeTileHeight = 0;
+    _inputParameters.m_probeBasis = 0;
+    _inputParameters.m_probeBasisMaxError = 0.0f;
+    _inputParameters.m_numSamples = 128;
+    _inputParameters.m_numLightSamples = 0;
+
+    // Sharded radiance bake.
+    _inputParameters.m_shardIndex = 0;
+    _inputParameters.m_shardCount = 1;
+    _inputParameters.m_mergeShards = false;
+    strcpy(_inputParameters.m_shardFile, "");
+    strcpy(_inputParameters.m_checkpointFile, "");
+    _inputParameters.m_checkpointInterval = 60.0f;
+    _inputParameters.m_resume = false;
 
     // Processing devices.
     _inputParameters.m_numCpuProcessingThreads = UINT32_MAX;
+    _inputParameters.m_minCpuProcessingThreads = 1;
+    _inputParameters.m_maxCpuProcessingThreads = 0;
+    _inputParameters.m_pinThreadsToNuma = false;
+    _inputParameters.m_pinThreadsToCores = false;
+    _inputParameters.m_numaReplicas = false;
+    _inputParameters.m_hugePages = false;
+    _inputParameters.m_memoryStats = false;
+    _inputParameters.m_dryRun = false;
+    _inputParameters.m_deterministic = false;
+    _inputParameters.m_writeBehind = true;
+    _inputParameters.m_mappedOutput = false;
     _inputParameters.m_useOpenCL = true;
+    _inputParameters.m_gpuProfile = false;
     _inputParameters.m_deviceIndex = 0;
+    _inputParameters.m_numDevices = 1;
+    _inputParameters.m_clCpuCores = 0;
     _inputParameters.m_clVendor = CL_VENDOR_ANY_GPU;
     strcpy(_inputParameters.m_vendorStrPart, "");
     _inputParameters.m_deviceType = CL_DEVICE_TYPE_GPU;
+    strcpy(_inputParameters.m_clBinaryCacheDir, "");
+    strcpy(_inputParameters.m_filterCacheDir, "");
+    _inputParameters.m_sourceCacheSize = 512;
+    _inputParameters.m_priority = JobPriority::Normal;
+    _inputParameters.m_deadline = 0.0f;
+    _inputParameters.m_backgroundShare = 100;
+    strcpy(_inputParameters.m_filterMatrixDir, "");
+    strcpy(_inputParameters.m_autotuneFile, "");
+    _inputParameters.m_autotuneOpenCL = true;
 
     // Misc.
     _inputParameters.m_silent = false;
 }
 
+/// Filter options of a job. They are passed to each filter call of the job, so jobs of a batch or server run with their own.
+FilterSettings filterSettingsFromInputParameters(const InputParameters& _inputParameters)
+{
+    FilterSettings settings;
+    settings.m_lobeTolerance = _inputParameters.m_lobeTolerance;
+    settings.m_adaptiveTolerance = max(0.0f, _inputParameters.m_adaptiveSampling);
+    settings.m_shSourceFaceSize = _inputParameters.m_shSourceSize;
+    settings.m_shSourceMaxError = _inputParameters.m_shSourceMaxError;
+    settings.m_minCpuThreads = uint16_t(min(_inputParameters.m_minCpuProcessingThreads, uint32_t(UINT16_MAX)));
+    settings.m_maxCpuThreads = uint16_t(min(_inputParameters.m_maxCpuProcessingThreads, uint32_t(UINT16_MAX)));
+    settings.m_deterministic = _inputParameters.m_deterministic;
+    settings.m_numaReplicas = _inputParameters.m_numaReplicas;
+    settings.m_pinThreadsToCores = _inputParameters.m_pinThreadsToCores;
+    settings.m_gpuProfiling = _inputParameters.m_gpuProfile;
+    return settings;
+}
+
+ImageEncodeSettings encodeSettingsFromInputParameters(const InputParameters& _inputParameters)
+{
+    ImageEncodeSettings settings;
+    settings.m_rgbmRange = _inputParameters.m_rgbmRange;
+    settings.m_rgbdRange = _inputParameters.m_rgbdRange;
+    settings.m_compressionQuality = (CompressionQuality::Enum)_inputParameters.m_compressionQuality;
+    settings.m_mipLayout = (MipLayout::Enum)_inputParameters.m_mipLayout;
+    settings.m_tgaRle = _inputParameters.m_tgaRle;
+    return settings;
+}
+
 /// Outputs C file.
-void outputShCoeffs(const char* _fileName, double _shCoeffs[SH_COEFF_NUM][3])
+void outputShCoeffs(const char* _fileName, double _shCoeffs[SH_COEFF_NUM][3], uint8_t _shOrder)
 {
     // Get base name.
     char baseName[128];
@@ -653,50 +1067,37 @@ void outputShCoeffs(const char* _fileName, double _shCoeffs[SH_COEFF_NUM][3])
 
     // File content.
     char content[10240];
-    sprintf(content,
-           "#ifndef CMFT_%s_H_HEADER_GUARD\n"
-           "#define CMFT_%s_H_HEADER_GUARD\n"
-           "\n"
-           "static const double s_shCoeffs%s[25][3] =\n"
-           "{\n"
-           "    /* Band 0 */ { %21.18f, %21.18f, %21.18f },\n"
-           "    /* Band 1 */ { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f },\n"
-           "    /* Band 2 */ { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f },\n"
-           "    /* Band 3 */ { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f },\n"
-           "    /* Band 4 */ { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }, { %21.18f, %21.18f, %21.18f }\n"
-           "};\n"
-           "\n"
-           "#endif // CMFT_%s_H_HEADER_GUARD\n"
-           , baseNameUpper
-           , baseNameUpper
-           , baseName
-           , _shCoeffs[ 0][0], _shCoeffs[ 0][1], _shCoeffs[ 0][2]
-           , _shCoeffs[ 1][0], _shCoeffs[ 1][1], _shCoeffs[ 1][2]
-           , _shCoeffs[ 2][0], _shCoeffs[ 2][1], _shCoeffs[ 2][2]
-           , _shCoeffs[ 3][0], _shCoeffs[ 3][1], _shCoeffs[ 3][2]
-           , _shCoeffs[ 4][0], _shCoeffs[ 4][1], _shCoeffs[ 4][2]
-           , _shCoeffs[ 5][0], _shCoeffs[ 5][1], _shCoeffs[ 5][2]
-           , _shCoeffs[ 6][0], _shCoeffs[ 6][1], _shCoeffs[ 6][2]
-           , _shCoeffs[ 7][0], _shCoeffs[ 7][1], _shCoeffs[ 7][2]
-           , _shCoeffs[ 8][0], _shCoeffs[ 8][1], _shCoeffs[ 8][2]
-           , _shCoeffs[ 9][0], _shCoeffs[ 9][1], _shCoeffs[ 9][2]
-           , _shCoeffs[10][0], _shCoeffs[10][1], _shCoeffs[10][2]
-           , _shCoeffs[11][0], _shCoeffs[11][1], _shCoeffs[11][2]
-           , _shCoeffs[12][0], _shCoeffs[12][1], _shCoeffs[12][2]
-           , _shCoeffs[13][0], _shCoeffs[13][1], _shCoeffs[13][2]
-           , _shCoeffs[14][0], _shCoeffs[14][1], _shCoeffs[14][2]
-           , _shCoeffs[15][0], _shCoeffs[15][1], _shCoeffs[15][2]
-           , _shCoeffs[16][0], _shCoeffs[16][1], _shCoeffs[16][2]
-           , _shCoeffs[17][0], _shCoeffs[17][1], _shCoeffs[17][2]
-           , _shCoeffs[18][0], _shCoeffs[18][1], _shCoeffs[18][2]
-           , _shCoeffs[19][0], _shCoeffs[19][1], _shCoeffs[19][2]
-           , _shCoeffs[20][0], _shCoeffs[20][1], _shCoeffs[20][2]
-           , _shCoeffs[21][0], _shCoeffs[21][1], _shCoeffs[21][2]
-           , _shCoeffs[22][0], _shCoeffs[22][1], _shCoeffs[22][2]
-           , _shCoeffs[23][0], _shCoeffs[23][1], _shCoeffs[23][2]
-           , _shCoeffs[24][0], _shCoeffs[24][1], _shCoeffs[24][2]
-           , baseNameUpper
-           );
+    char* ptr = content;
+    ptr += sprintf(ptr,
+                   "#ifndef CMFT_%s_H_HEADER_GUARD\n"
+                   "#define CMFT_%s_H_HEADER_GUARD\n"
+                   "\n"
+                   "static const double s_shCoeffs%s[%u][3] =\n"
+                   "{\n"
+                   , baseNameUpper
+                   , baseNameUpper
+                   , baseName
+                   , _shOrder*_shOrder
+                   );
+
+    for (uint8_t band = 0, ii = 0; band < _shOrder; ++band)
+    {
+        ptr += sprintf(ptr, "    /* Band %u */", band);
+        for (uint8_t end = (band+1)*(band+1); ii < end; ++ii)
+        {
+            ptr += sprintf(ptr, " { %21.18f, %21.18f, %21.18f }%s"
+                         , _shCoeffs[ii][0], _shCoeffs[ii][1], _shCoeffs[ii][2]
+                         , (ii+1 == _shOrder*_shOrder) ? "\n" : ((ii+1 == end) ? ",\n" : ",")
+                         );
+        }
+    }
+
+    sprintf(ptr,
+            "};\n"
+            "\n"
+            "#endif // CMFT_%s_H_HEADER_GUARD\n"
+            , baseNameUpper
+            );
 
     // Append *.c extension.
     char filePath[512];
@@ -719,6 +1120,293 @@ void outputShCoeffs(const char* _fileName, double _shCoeffs[SH_COEFF_NUM][3])
     FERROR_CHECK(fp);
 }
 
+/// Outputs binary file. 16 byte header: "CMSH", uint32_t version (1), uint32_t number of probes, uint16_t coefficients
+/// per probe and uint16_t bytes per value (4 or 2). Followed by rgb values of all coefficients of all probes, little endian.
+void outputShCoeffsBinary(const char* _fileName, double (*_shCoeffs)[SH_COEFF_NUM][3], uint32_t _numProbes, uint8_t _shOrder, bool _half)
+{
+    const uint16_t numCoeffs = uint16_t(_shOrder*_shOrder);
+    const uint16_t valueSize = _half ? 2 : 4;
+    const size_t dataSize = 16 + size_t(_numProbes)*numCoeffs*3*valueSize;
+
+    uint8_t* data = (uint8_t*)malloc(dataSize);
+    MALLOC_CHECK(data);
+
+    memcpy(data, "CMSH", 4);
+    const uint32_t version = 1;
+    memcpy(data+4,  &version,    4);
+    memcpy(data+8,  &_numProbes, 4);
+    memcpy(data+12, &numCoeffs,  2);
+    memcpy(data+14, &valueSize,  2);
+
+    uint8_t* dst = data + 16;
+    for (uint32_t probe = 0; probe < _numProbes; ++probe)
+    {
+        for (uint16_t ii = 0; ii < numCoeffs; ++ii)
+        {
+            for (uint8_t cc = 0; cc < 3; ++cc, dst += valueSize)
+            {
+                const float val = float(_shCoeffs[probe][ii][cc]);
+                if (_half)
+                {
+                    const uint16_t half = halfFromFloat(val);
+                    memcpy(dst, &half, 2);
+                }
+                else
+                {
+                    memcpy(dst, &val, 4);
+                }
+            }
+        }
+    }
+
+    // Append *.bin extension.
+    char filePath[512];
+    strcpy(filePath, _fileName);
+    strcat(filePath, ".bin");
+
+    FILE* fp = fopen(filePath, "wb");
+    if (NULL == fp)
+    {
+        WARN("Could not open file %s for writing.", filePath);
+        free(data);
+        return;
+    }
+    ScopeFclose cleanup(fp);
+
+    CMFT_UNUSED size_t write;
+    write = fwrite(data, dataSize, 1, fp);
+    DEBUG_CHECK(write == 1, "Error writing sh coeffs file content.");
+    FERROR_CHECK(fp);
+
+    free(data);
+}
+
+/// C output holds a single probe, more of them are written as float32 binary.
+void outputShCoeffs(const InputParameters& _inputParameters, double (*_shCoeffs)[SH_COEFF_NUM][3], uint32_t _numProbes = 1)
+{
+    uint32_t format = _inputParameters.m_shFormat;
+    if (ShFormat::C == format && 1 != _numProbes)
+    {
+        INFO("C output holds one set of spherical harmonics coefficients, writing %u of them as float32.", _numProbes);
+        format = ShFormat::Float32;
+    }
+
+    for (uint32_t ii = 0; ii < _inputParameters.m_outputFilesNum; ++ii)
+    {
+        const char* fileName = _inputParameters.m_outputFiles[ii].m_fileName;
+        if (ShFormat::C == format)
+        {
+            INFO("Saving spherical harmonics coefficients to %s.c", fileName);
+            outputShCoeffs(fileName, _shCoeffs[0], (uint8_t)_inputParameters.m_shOrder);
+        }
+        else
+        {
+            INFO("Saving spherical harmonics coefficients of %u probes to %s.bin", _numProbes, fileName);
+            outputShCoeffsBinary(fileName, _shCoeffs, _numProbes, (uint8_t)_inputParameters.m_shOrder, ShFormat::Float16 == format);
+        }
+    }
+}
+
+/// Outputs binary file. 32 byte header: "CMPB", uint32_t version (1), uint32_t number of probes, uint32_t number of components,
+/// uint32_t values per probe, uint32_t face size, uint32_t mip count and float relative RMS error. Followed by float32 mean,
+/// components and coefficients of all probes, little endian. Values are rgb of all texels, face by face and mip by mip within a face.
+void outputProbeBasisBinary(const char* _fileName, const ProbeBasis& _basis)
+{
+    uint32_t header[8];
+    memcpy(&header[0], "CMPB", 4);
+    header[1] = 1;
+    header[2] = _basis.m_numProbes;
+    header[3] = _basis.m_numComponents;
+    header[4] = _basis.m_dimension;
+    header[5] = _basis.m_faceSize;
+    header[6] = _basis.m_numMips;
+    memcpy(&header[7], &_basis.m_error, 4);
+
+    // Append *.bin extension.
+    char filePath[512];
+    strcpy(filePath, _fileName);
+    strcat(filePath, ".bin");
+
+    FILE* fp = fopen(filePath, "wb");
+    if (NULL == fp)
+    {
+        WARN("Could not open file %s for writing.", filePath);
+        return;
+    }
+    ScopeFclose cleanup(fp);
+
+    CMFT_UNUSED size_t write;
+    write = fwrite(header, sizeof(header), 1, fp);
+    DEBUG_CHECK(write == 1, "Error writing probe basis header.");
+    write = fwrite(_basis.m_mean, sizeof(float), _basis.m_dimension, fp);
+    DEBUG_CHECK(write == _basis.m_dimension, "Error writing probe basis mean.");
+    write = fwrite(_basis.m_basis, sizeof(float)*_basis.m_dimension, _basis.m_numComponents, fp);
+    DEBUG_CHECK(write == _basis.m_numComponents, "Error writing probe basis components.");
+    write = fwrite(_basis.m_coeffs, sizeof(float)*_basis.m_numComponents, _basis.m_numProbes, fp);
+    DEBUG_CHECK(write == _basis.m_numProbes, "Error writing probe basis coefficients.");
+    FERROR_CHECK(fp);
+}
+
+struct SaveOutputArgs
+{
+    const InputParameters* m_inputParameters;
+    const Image* m_images[MAX_OUTPUT_NUM]; //!< Filtered image, or its copy already converted to the output texture format.
+};
+
+/// Layouts made by moving whole texels of the cubemap. They can be made from an image converted to the output format,
+/// with the same result as converting after.
+static bool outputTypeMovesTexels(OutputType::Enum _outputType)
+{
+    return OutputType::Cubemap   == _outputType
+        || OutputType::FaceList  == _outputType
+        || OutputType::CubeCross == _outputType
+        || OutputType::HStrip    == _outputType
+        ;
+}
+
+/// Converts shared output image to the layout of output _outputIdx and saves it. Runs as a thread pool task, one per output.
+void saveOutput(void* _userData, uint32_t _outputIdx)
+{
+    const SaveOutputArgs* args = (const SaveOutputArgs*)_userData;
+    const InputParameters& inputParameters = *args->m_inputParameters;
+    const Image& image = *args->m_images[_outputIdx];
+    const uint32_t outputIdx = _outputIdx;
+
+    const OutputType::Enum    ot = (OutputType::Enum)inputParameters.m_outputFiles[outputIdx].m_outputType;
+    const TextureFormat::Enum tf = (TextureFormat::Enum)inputParameters.m_outputFiles[outputIdx].m_textureFormat;
+    const ImageFileType::Enum ft = (ImageFileType::Enum)inputParameters.m_outputFiles[outputIdx].m_fileType;
+    const char* outputFileName = inputParameters.m_outputFiles[outputIdx].m_fileName;
+    const ImageEncodeSettings encodeSettings = encodeSettingsFromInputParameters(inputParameters);
+
+    // BRDF lookup table is a plain 2D image, saved as is for any output type.
+    const bool plainImage = (FilterType::BrdfLut    == inputParameters.m_filterType
+                          || FilterType::BrdfLutGgx == inputParameters.m_filterType);
+    if (plainImage)
+    {
+        INFO("Output(%u) - Saving %s [%s %ux%u %s].", outputIdx, outputFileName, getFileTypeStr(ft), image.m_width, image.m_height, getTextureFormatStr(tf));
+
+        const bool saved = imageSave(image, outputFileName, ft, tf, true, &encodeSettings);
+        if (!saved)
+        {
+            WARN("Saving failed!");
+        }
+    }
+    // Face list is a special case because it is saving 6 images.
+    else if (OutputType::FaceList == ot)
+    {
+        Image outputFaceList[6];
+
+        imageFaceListFromCubemap(outputFaceList, image);
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            char faceFileName[2048];
+            sprintf(faceFileName, "%s_%s", outputFileName, s_cubemapFaceIdNames[face]);
+
+            INFO("Output(%u) - Saving %s [%s %ux%u %s %s %u-faces %d-mips]."
+                , outputIdx
+                , faceFileName
+                , getFileTypeStr(ft)
+                , outputFaceList[face].m_width
+                , outputFaceList[face].m_height
+                , getTextureFormatStr(outputFaceList[face].m_format)
+                , getOutputTypeStr(ot)
+                , outputFaceList[face].m_numFaces
+                , outputFaceList[face].m_numMips
+                );
+
+            const bool saved = imageSave(outputFaceList[face], faceFileName, ft, tf, true, &encodeSettings);
+            if (!saved)
+            {
+                WARN("Saving failed!");
+            }
+        }
+
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            imageUnload(outputFaceList[face]);
+        }
+
+    }
+    // Cubemap is a special case becase no transformation is required. Same for octahedral and latlong maps filtered directly.
+    else if (OutputType::Cubemap == ot
+         || (OutputType::Octahedral == ot && !imageIsCubemap(image))
+         || (OutputType::LatLong    == ot && !imageIsCubemap(image)))
+    {
+        INFO("Output(%u) - Saving %s [%s %ux%u %s %s %u-faces %d-mips]."
+            , outputIdx
+            , outputFileName
+            , getFileTypeStr(ft)
+            , image.m_width
+            , image.m_height
+            , getTextureFormatStr(tf)
+            , getOutputTypeStr(ot)
+            , image.m_numFaces
+            , image.m_numMips
+            );
+
+        const bool saved = imageSave(image, outputFileName, ft, tf, true, &encodeSettings);
+        if (!saved)
+        {
+            WARN("Saving failed!");
+        }
+    }
+    else
+    {
+        Image outputImage;
+
+        if (OutputType::LatLong == ot)
+        {
+            imageLatLongFromCubemap(outputImage, image);
+        }
+        else if (OutputType::CubeCross == ot)
+        {
+            bool vertical = true;
+            const char* param0 = inputParameters.m_outputFiles[outputIdx].m_optionalParam0;
+            if (NULL != param0
+            && (0 == bx::stricmp(param0, "horizontal") || 0 == bx::stricmp(param0, "0")))
+            {
+                vertical = false;
+            }
+
+            imageCrossFromCubemap(outputImage, image, vertical);
+        }
+        else if (OutputType::HStrip == ot)
+        {
+            imageHStripFromCubemap(outputImage, image);
+        }
+        else if (OutputType::Octahedral == ot)
+        {
+            imageOctahedralFromCubemap(outputImage, image);
+        }
+        else
+        {
+            WARN("Output(%u) - Invalid output type.", outputIdx);
+            return;
+        }
+
+        INFO("Output(%u) - Saving %s [%s %ux%u %s %s %u-faces %d-mips]."
+            , outputIdx
+            , outputFileName
+            , getFileTypeStr(ft)
+            , outputImage.m_width
+            , outputImage.m_height
+            , getTextureFormatStr(tf)
+            , getOutputTypeStr(ot)
+            , outputImage.m_numFaces
+            , outputImage.m_numMips
+            );
+
+        const bool saved = imageSave(outputImage, outputFileName, ft, tf, true, &encodeSettings);
+        if (!saved)
+        {
+            WARN("Saving failed!");
+        }
+
+        imageUnload(outputImage);
+    }
+}
+
 void printHelp()
 {
     fprintf(stderr
@@ -824,35 +1512,120 @@ void printHelp()
             "         --output0 <output name>\n"
             "         --output0params dds,bgra8,cubemap\n"
 
+            "\n"
+            "6. Typical parameters for generating split-sum BRDF lookup table, sampled with (NdotV, glossiness) in shaders:\n"
+            "\n"
+            "    cmft --filter brdflut\n"
+            "         --lightingModel blinnbrdf\n"
+            "         --glossScale 10\n"
+            "         --glossBias 1\n"
+            "         --dstFaceSize 256\n"
+            "         --numSamples 1024\n"
+            "         --outputNum 1\n"
+            "         --output0 <output name>\n"
+            "         --output0params dds,rg16f\n"
+
             "\n"
             "All options listed:\n"
             "    --help                             Prints this message\n"
             "    --printCLDevices                   Prints OpenCL devices that can be used for processing. Although application allows CPU-type devices to be picked, GPU-type devices are meant to be used as OpenCL devices!\n"
-            "    --input <file path>                Input cubemap for filtering. Can be *.dds, *.ktx, *.hdr, *.tga and in form of: cubemap, latlong image, cube cross, horizontal strip.\n"
+            "    --input <file path>                Input cubemap for filtering. Can be *.dds, *.ktx, *.ktx2, *.hdr, *.exr, *.tga and in form of: cubemap, latlong image, cube cross, horizontal strip.\n"
             "    --inputFacePosX <file path>        Input face +x in case --input is not specified.\n"
             "    --inputFaceNegX <file path>        Input face -x in case --input is not specified.\n"
             "    --inputFacePosY <file path>        Input face +y in case --input is not specified.\n"
             "    --inputFaceNegY <file path>        Input face -y in case --input is not specified.\n"
             "    --inputFacePosZ <file path>        Input face +z in case --input is not specified.\n"
             "    --inputFaceNegZ <file path>        Input face -z in case --input is not specified.\n"
+            "    --generate <pattern>               Generates procedural input cubemap instead of loading it, for benchmarks and pathological cases.\n"
+            "          gradient\n"
+            "          noise\n"
+            "          sunDisk\n"
+            "          mostlyBlack\n"
+            "          spike\n"
+            "          constant\n"
+            "    --generateFaceSize <uint>          Face size of the generated cubemap. Default: 256\n"
+            "    --generateSeed <uint>              Seed of the noise pattern. Default: 0\n"
+            "    --batch <file path>                Runs every line of the file as a separate job. Lines hold options the same way the command line does and override options given on the command line. Empty lines and lines starting with # are skipped.\n"
+            "                                       Jobs are pipelined: next input is loaded and previous output is saved while current job is filtered. OpenCL context and worker threads are shared by all jobs.\n"
+            "    --server <socket path|stdin>       Keeps OpenCL context, compiled kernels and caches alive and runs jobs as they arrive. Each job is a single line of options, the same as for --batch. \"quit\" line stops the server.\n"
+            "                                       With stdin jobs are read from stdin and \"CMFT result: <exit code>\" is printed after each of them. Otherwise a local socket is created at the path, every connection sends one job line and receives its exit code.\n"
+            "    --priority <priority>              Priority of a job sent to a --server socket. Queued jobs run by priority, then by earliest deadline. A job of higher priority stops a running radiance filter after its current tile and runs first,\n"
+            "                                       the stopped job later resumes from the faces it had finished. Default: normal.\n"
+            "          background\n"
+            "          normal\n"
+            "          high\n"
+            "    --deadline <seconds>               Time after arrival by which a --server job should be done. Among jobs of the same priority the one with the earliest deadline runs first, missed deadlines are reported. 0 means none. Default: 0.\n"
+            "    --backgroundShare <percent>        Share of CPU cores background priority --server jobs filter with, leaving the rest to other work. Default: 100.\n"
+            "    --mapInput <bool>                  Memory map *.dds and single mip *.ktx input instead of reading it. Avoids a copy when input is already in the working format.\n"
             "    --filter <filter>                  Filter action to be executed.\n"
             "          radiance\n"
             "          irradiance\n"
             "          shCoeffs\n"
+            "          ggx\n"
+            "          brdflut\n"
+            "          brdflutggx\n"
+            "          radiancepreview\n"
             "          none\n"
-            "    --srcFaceSize <uint>               Resize input image to <uint>. If <uint> == 0, input face size is left as is.\n"
-            "    --dstFaceSize <uint>               Filter output face size. If <uint> == 0, output face size will be same as srcFaceSize.\n"
-            "    --excludeBase <bool>               Exclude base image when generating mipmaped radiance cubemap. [radiance filter param]\n"
-            "    --mipCount <uint>                  Radiance cubemap mipmap number. Glossiness distribution is uniform. [radiance filter param]\n"
-            "    --glossScale <uint>                Equation is glossScale * mipGlossiness + glossBias. [radiance filter param]\n"
-            "    --glossBias <uint>                 Equation is glossScale * mipGlossiness + glossBias. [radiance filter param]\n"
-            "    --lightingModel <model>            Lighting model that matches game lighting equation. [radiance filter param]\n"
+            "    --srcFaceSize <uint>               Resize input image to <uint>. If <uint> == 0, input face size is left as is. Dds and Ktx cubemaps with mips are read from the smallest mip at least <uint> big.\n"
+            "    --dstFaceSize <uint>               Filter output face size. If <uint> == 0, output face size will be same as srcFaceSize. BRDF lookup table is <uint>x<uint>, 256x256 if <uint> == 0.\n"
+            "    --resizeFilter <kernel>            Kernel used for srcFaceSize resize and for dstFaceSize resize with filter none. Existing mips are resized too in the latter case.\n"
+            "          box\n"
+            "          triangle\n"
+            "          lanczos\n"
+            "          kaiser\n"
+            "    --excludeBase <bool>               Exclude base image when generating mipmaped radiance cubemap. [radiance, radiancepreview and ggx filter param]\n"
+            "    --mipCount <uint>                  Radiance cubemap mipmap number. Glossiness distribution is uniform. [radiance, radiancepreview and ggx filter param]\n"
+            "    --glossScale <uint>                Equation is glossScale * mipGlossiness + glossBias. [radiance, radiancepreview, ggx and brdflut filter param]\n"
+            "    --glossBias <uint>                 Equation is glossScale * mipGlossiness + glossBias. [radiance, radiancepreview, ggx and brdflut filter param]\n"
+            "    --lobeTolerance <float>            Relative lobe weight where the lobe is cut off. Bigger values shrink filter areas of glossy mips and lose some lobe energy. Default: 0.00001. [radiance filter param]\n"
+            "    --adaptiveSampling <float>         Filter wide lobe mips on a sparse grid of texels, refine where interpolation is off by more than this relative error and interpolate the rest. 0.005 is typical. Default: 0 (off). [radiance filter param]\n"
+            "    --lightingModel <model>            Lighting model that matches game lighting equation. [radiance, radiancepreview and brdflut filter param]\n"
             "          phong\n"
             "          phongbrdf\n"
             "          blinn\n"
             "          blinnbrdf\n"
-            "    --numCpuProcessingThreads <uint>   Should not be bigger than the number of physical CPU cores/threads. [radiance filter param]\n"
-            "    --useOpenCL <bool>                 OpenCL processing can be used alongside processing on CPU. Therefore, OpenCL device should be GPU. [radiance filter param]\n"
+            "    --sourcePyramid <bool>             Filter rough mips from a downsampled copy of the input. Faster, slightly less accurate. [radiance filter param]\n"
+            "    --chainFilter <bool>               Filter each mip from the previous one with the residual lobe, on the CPU. Costs about as much as the first mip, rough mips are approximate. [radiance filter param]\n"
+            "    --chainMaxError <float>            With chainFilter, check a region of each chained mip against direct filtering and filter mips whose relative RMS error is above this directly. Default: 0 (no check). [radiance filter param]\n"
+            "    --timeBudget <float>               Seconds filtering may take. Per mip source pyramid level and lobe tolerance, or GGX sample count, are lowered from a cost model calibrated on this machine until the estimate fits, and printed. Default: 0 (full quality). [radiance and ggx filter param]\n"
+            "    --costHeatmap <bool>               Also write per texel filter cost of every mip, to every output with \"_cost\" appended to its file name. R is source texels in the filter area, G texels visited after culling, B taps taken. Use a float output format. [radiance filter param]\n"
+            "    --halfPrecision <bool>             Store filter source and output in RGBA16F. Halves memory use, OpenCL devices also get compact normal tables. Accumulation is still fp32. [radiance filter param]\n"
+            "    --bakeIrradiance <bool>            Also write irradiance of the input, to every output with \"_irradiance\" appended to its file name. It is evaluated from the SH projection the radiance filter makes anyway. [radiance filter param]\n"
+            "    --bakeShCoeffs <bool>              Also write SH coefficients of the input next to the outputs, as with shcoeffs filter. They come from the same projection, input is loaded and prepared once. [radiance filter param]\n"
+            "    --irradianceFaceSize <uint>        Face size of the irradiance written with bakeIrradiance. Default: dstFaceSize. [radiance filter param]\n"
+            "    --gpuEncode <bool>                 Pack radiance results to the output format on the OpenCL device and read back only packed data. All outputs have to be BGRA8 or all RGBA8, without output gamma. [radiance filter param]\n"
+            "    --numSamples <uint>                Number of GGX importance samples per texel. For BRDF lookup table, number of lobe samples per texel, 512-1024 is typical. [ggx and brdflut filter param]\n"
+            "    --numLightSamples <uint>           Number of samples per texel picked from input luminance and combined with GGX samples. Speeds up convergence of small bright lights. Default: 0. [ggx filter param]\n"
+            "    --irradianceMethod <method>        sh (default) evaluates projected spherical harmonics, cosine convolves a 16-31 texel face downsample of the input with the cosine lobe directly. Cosine has no SH ringing on high contrast inputs and is slower. Octahedral outputs always use sh. [irradiance filter param]\n"
+            "    --shOrder <uint>                   Number of spherical harmonics bands: 2, 3 or 5. [irradiance and shcoeffs filter param]\n"
+            "    --shSourceSize <uint>              Sources with bigger faces are box filtered down to at least this face size before SH projection. 0 projects full sources. Default: 64. [irradiance and shcoeffs filter param]\n"
+            "    --shSourceMaxError <float>         Box filtered sources are kept big enough for the estimated relative error of projected bands to stay below this. Default: 0.002. [irradiance and shcoeffs filter param]\n"
+            "    --shFormat <format>                Output of shcoeffs filter: c (default, C array in <output>.c), float32 or float16 (packed binary <output>.bin with a 16 byte \"CMSH\" header). [shcoeffs filter param]\n"
+            "    --probeTileWidth <uint>            With probeTileHeight, input is an atlas of hstrip or cube cross probes of this size, numbered row by row. Coefficients of all of them are written to one binary file. [shcoeffs filter param]\n"
+            "    --probeTileHeight <uint>           See probeTileWidth. [shcoeffs filter param]\n"
+            "    --probeBasis <uint>                With probeTileWidth and probeTileHeight, every probe of the atlas is filtered and the batch is stored as up to <uint> shared PCA components plus per probe coefficients, in one binary file with a \"CMPB\" header. Default: 0 (off). [radiance and irradiance filter param]\n"
+            "    --probeBasisMaxError <float>       Keep the fewest components that reconstruct probes within this relative RMS error. Default: 0 (all probeBasis components). [radiance and irradiance filter param]\n"
+            "    --shardCount <uint>                Split radiance bake into <uint> shards of about equal cost, to be filtered by separate processes or machines with otherwise the same options. Default: 1. [radiance filter param]\n"
+            "    --shardIndex <uint>                Shard filtered by this run, from 0 to shardCount-1. Partial result is written to <shardFile>_<shardIndex>of<shardCount>.dds instead of the outputs. [radiance filter param]\n"
+            "    --mergeShards <bool>               Instead of loading and filtering the input, put together all shards of the bake and write the outputs. [radiance filter param]\n"
+            "    --shardFile <file path>            File name of partial results without the shard suffix and extension. [radiance filter param]\n"
+            "    --checkpoint <file path>           Save radiance faces to the file as they get filtered, together with a key of the input and parameters. File is removed once filtering is done. [radiance filter param]\n"
+            "    --checkpointInterval <float>       Seconds between flushes of the checkpoint file. Default: 60. [radiance filter param]\n"
+            "    --resume <bool>                    Load faces of an interrupted earlier run from the checkpoint file and filter only the rest. Checkpoint of a different input or parameters is ignored. [radiance filter param]\n"
+            "    --numCpuProcessingThreads <uint>   Should not be bigger than the number of physical CPU cores/threads. Default: one per physical core the process may run on, within its cgroup CPU quota, none when filtering with OpenCL. [radiance filter param]\n"
+            "    --maxCpuProcessingThreads <uint>   Adjust the number of radiance CPU threads taking tiles to the load of the machine, up to this many, as other processes wait for CPUs or leave them idle. Threads that don't raise throughput are taken back. Run queue is read on Linux only. Default: 0 (off, fixed thread count). [radiance filter param]\n"
+            "    --minCpuProcessingThreads <uint>   Fewest radiance CPU threads kept active with maxCpuProcessingThreads. Default: 1. [radiance filter param]\n"
+            "    --pinThreadsToNuma <bool>          Distribute worker threads over NUMA nodes and pin them to the CPUs of their node. Linux only.\n"
+            "    --pinThreadsToCores <bool>         Pin each radiance CPU thread to its own physical core while filtering, SMT siblings are left idle. Linux only. Default: false. [radiance filter param]\n"
+            "    --numaReplicas <bool>              Copy radiance filter source to every NUMA node, so CPU threads read node-local memory. Implies pinThreadsToNuma. Linux only. Default: false.\n"
+            "    --hugePages <bool>                 Back large image and scratch buffers with huge pages (large pages on Windows), falls back to regular pages. Default: false.\n"
+            "    --memoryStats <bool>               Track allocations and print current and peak bytes and allocation counts per purpose (source copy, normal table, mip chain, conversion, I/O buffer) at the end, after each job in server mode. Default: false.\n"
+            "    --dryRun <bool>                    Load the input and print expected source taps per mip, peak memory and radiance filter time calibrated on this machine, without filtering or saving. Default: false. [radiance filter param]\n"
+            "    --deterministic <bool>             Make results independent of timing and device limits. With OpenCL, radiance is filtered on the first device only and CPU threads stay idle.\n"
+            "    --writeBehind <bool>               Encode output files into memory and write them on a background I/O thread. Default: true. Linux and OSX only.\n"
+            "    --mappedOutput <bool>              Create radiance outputs at their final size up front and write each face to its place in the file as soon as it is filtered, mapped where possible. Filtered mips are not kept, peak memory drops to the filter working set. Cubemap outputs to dds or ktx only, without mip chain generation, filterCache, checkpoints or gpuEncode. Default: false. [radiance filter param]\n"
+            "    --useOpenCL <bool>                 OpenCL processing can be used alongside processing on CPU. Therefore, OpenCL device should be GPU. [radiance, irradiance and shcoeffs filter param]\n"
+            "    --gpuProfile <bool>                Measure upload, kernel and readback times of OpenCL devices from profiling events and print kernel vs transfer vs host idle time. Default: false. [radiance filter param]\n"
             "    --clVendor <vendor>                This parameter should generally be 'anyGpuVendor'. If other vendor is to be choosen, type in part of the vendor name. Use 'cmft --printCLDevices' to list available devices and vendors. [radiance filter param]\n"
             "          intel\n"
             "          amd\n"
@@ -860,14 +1633,20 @@ void printHelp()
             "          nvidia\n"
             "          anyGpuVendor\n"
             "          anyCpuVendor\n"
+            "          auto                         Calibrate radiance filter on every device and use the fastest 'numDevices' of them, 'deviceType' and 'deviceIndex' are ignored. Scores are cached in 'clBinaryCache' directory.\n"
             "          [other]\n"
             "    --deviceType <type>                After selecting vendor, 'deviceType' is considered. If desired 'deviceType' is not present, value is ignored. [radiance filter param]\n"
             "          gpu\n"
             "          cpu\n"
             "          accelerator\n"
             "          default\n"
-            "    --deviceIndex <uint>               If there are multiple devices of chosen vendor and type, <uint> is used for selection. There is no support for multiple OpenCL devices for now. [radiance filter param]\n"
+            "    --deviceIndex <uint>               If there are multiple devices of chosen vendor and type, <uint> is used for selection. [radiance filter param]\n"
+            "    --numDevices <uint>                Number of OpenCL devices used for radiance filtering, starting at 'deviceIndex'. Faces are shared between devices by their measured throughput. [radiance filter param]\n"
+            "    --clCpuCores <uint>                Restrict OpenCL CPU devices to <uint> cores, CPU processing threads are then kept on the remaining ones. 0 uses all cores. Requires OpenCL 1.2. Default: 0. [radiance filter param]\n"
+            "    --clBinaryCache <dir path>         Directory for storing compiled OpenCL program binaries. Subsequent runs on the same device load them instead of compiling. [radiance filter param]\n"
             "    --generateMipChain <bool>          After processing, generate entire mip map chain.\n"
+            "    --mipChainFilter <kernel>          Kernel used to generate mip map chain. Same options as resizeFilter.\n"
+            "    --mipChainAverageSeams <bool>      Average texels on shared cubemap edges of every generated mip.\n"
             "    --inputGammaNumerator <uint>       Gamma applied to cubemap before processing. Use this field to specify gamma numerator. Gamma equation is value^(numerator/denominator).\n"
             "    --inputGammaDenominator <uint>     Gamma applied to cubemap before processing. Use this field to specify gamma denominator. Gamma equation is value^(numerator/denominator).\n"
             "    --outputGammaNumerator <uint>      Gamma applied to cubemap after processing. Use this field to specify gamma numerator. Gamma equation is value^(numerator/denominator).\n"
@@ -906,17 +1685,34 @@ void printHelp()
             "    --output[0..N-1] <file name>       File name without extension.\n"
             "    --output[0..N-1]params <params>    Output parameters as following:\n"
             "          <params> = <fileFormat>,<textureFormat>,<outputType>,<optional_param>\n"
-            "          <fileFromat> = [dds,ktx,tga,hdr]\n"
-            "          <dds_textureFormat> = [bgr8,bgra8,rgba16,rgba16f,rgba32f]\n"
-            "          <ktx_textureFormat> = [rgb8,rgb16,rgb16f,rgb32f,rgba8,rgba16,rgba16f,rgba32f]\n"
-            "          <tga_textureFormat> = [bgr8,bgra8]\n"
+            "          <fileFromat> = [dds,ktx,tga,hdr,exr,ktx2]\n"
+            "          <dds_textureFormat> = [bgr8,bgra8,rgba16,rgba16f,rgba32f,rg16f,rg32f,rgb9e5,r11g11b10f,rgbm,rgbd,logluv,bc6h,bc6hs,bc7]\n"
+            "          <ktx_textureFormat> = [rgb8,rgb16,rgb16f,rgb32f,rgba8,rgba16,rgba16f,rgba32f,rg16f,rg32f,rgb9e5,r11g11b10f,rgbm,rgbd,logluv,bc6h,bc6hs,etc2,astc4x4]\n"
+            "          <tga_textureFormat> = [bgr8,bgra8,rgbm,rgbd,logluv]\n"
             "          <hdr_textureFormat> = [rgbe]\n"
-            "          <dds_outputType> = [cubemap,latlong,cubecross,hstrip,facelist]\n"
-            "          <ktx_outputType> = [cubemap,latlong,cubecross,hstrip,facelist]\n"
-            "          <tga_outputType> = [latlong,cubecross,hstrip,facelist]\n"
-            "          <hdr_outputType> = [latlong,cubecross,hstrip,facelist]\n"
+            "          <exr_textureFormat> = [rgb16f,rgb32f,rgba16f,rgba32f]\n"
+            "          <ktx2_textureFormat> = [rgb8,rgb16,rgb16f,rgb32f,rgba8,rgba16,rgba16f,rgba32f,rg16f,rg32f,bc6h,bc6hs,bc7,etc2,astc4x4]\n"
+            "          <dds_outputType> = [cubemap,latlong,cubecross,hstrip,facelist,octahedral]\n"
+            "          <ktx_outputType> = [cubemap,latlong,cubecross,hstrip,facelist,octahedral]\n"
+            "          <tga_outputType> = [latlong,cubecross,hstrip,facelist,octahedral]\n"
+            "          <hdr_outputType> = [latlong,cubecross,hstrip,facelist,octahedral]\n"
+            "          <exr_outputType> = [latlong,cubecross,hstrip,facelist,octahedral]\n"
+            "          <ktx2_outputType> = [cubemap,latlong,cubecross,hstrip,facelist,octahedral]\n"
             "          <cubecross_optional_param> = [vertical,horizontal]\n"
+            "          Octahedral maps are twice the face size. When all outputs are octahedral, radiance and irradiance filters write them directly.\n"
+            "          When all outputs are latlong, radiance filter writes them directly, four times the face size wide.\n"
+            "    --compressionQuality <preset>      Block encoder preset for bc6h (unsigned), bc6hs (signed), bc7, etc2 and astc4x4 outputs: [fast,quality]. Default is fast.\n"
+            "    --tgaRle <bool>                    Save *.tga outputs Rle compressed. Default: false.\n"
+            "    --mipLayout <layout>               Order of mips in *.dds and *.ktx outputs: [filetype,largestfirst,smallestfirst]. Other than filetype, each mip with all of its faces is one contiguous range and a mip offset index is written, for runtimes streaming mips in. Default is filetype.\n"
+            "    --rgbmRange <float>                Rgbm outputs store rgb/rgbmRange scaled by alpha. Default: 8. Decoding shaders have to use the same value.\n"
+            "    --rgbdRange <float>                Rgbd outputs store rgb*alpha/rgbdRange. Default: 255. Decoding shaders have to use the same value.\n"
+            "    --filterCache <dir path>           Directory for caching filtered cubemaps, keyed by input pixels and filter parameters. Identical jobs load the cached result instead of filtering. Radiance mips are also cached one by one, jobs with other mip count or gloss parameters filter only the mips that changed.\n"
+            "    --sourceCache <MB>                 Memory for loaded sources kept by --batch and --server, keyed by input path, file time and size, and source options. Jobs of the same source start filtering from a kept one instead of loading it again. 0 disables it. Default: 512.\n"
+            "    --filterMatrix <dir path>          Directory for caching radiance filter weights of the job configuration (face sizes, mipCount, glossScale, glossBias, lightingModel, excludeBase, sourcePyramid). Jobs of the same configuration filter on the CPU by sparse weights instead of processing the filter areas. Wide lobes are evaluated exactly instead of in the SH domain.\n"
+            "    --autotune <file path>             File of radiance processing configurations tuned per machine and source face size class. Missing ones are found by short calibration bakes over CPU thread counts and OpenCL use, and stored. Applies to numCpuProcessingThreads and useOpenCL when they are not given. Remove the file to tune again.\n"
             "    --silent                           Do not print any output.\n"
+            "    --profile <file_path>              Write time spent in load, filter and save stages as Chrome trace JSON (chrome://tracing). Requires a build with CMFT_CONFIG_PROFILE.\n"
+            "    --perfCounters <bool>              Print cycles, instructions, LLC and dTLB misses of load, filter and save stages (of the whole run with --batch), with IPC and bytes read from memory per radiance filter tap. Counts the whole process. Linux with hardware counters exposed only.\n"
 
             "\n"
             "Command line parameters are case insenitive (except for file names and paths).\n"
@@ -924,348 +1720,3784 @@ void printHelp()
           );
 }
 
-int cmftMain(int _argc, char const* const* _argv)
+struct JobState
 {
-    bx::CommandLine cmdLine(_argc, _argv);
+    enum Enum
+    {
+        Failed,
+        Done,  //!< Job is complete, there is nothing to save.
+        Ready, //!< Image is ready for the next stage.
+        Preempted, //!< Filtering was stopped for a more urgent job, image still holds the loaded source.
+    };
+};
 
-    // Action for --help.
-    if (1 == _argc || cmdLine.hasArg('h', "help"))
+/// File name of shard _shardIndex of a sharded bake, without extension.
+void shardFileName(char _fileName[2048], const InputParameters& _inputParameters, uint32_t _shardIndex)
+{
+    sprintf(_fileName, "%s_%uof%u", _inputParameters.m_shardFile, _shardIndex, _inputParameters.m_shardCount);
+}
+
+/// Loads partial results of all shards and puts them together. Missing shards fail the job.
+bool mergeShards(Image& _image, const InputParameters& _inputParameters)
+{
+    const uint32_t shardCount = _inputParameters.m_shardCount;
+    Image* shards = (Image*)malloc(shardCount*sizeof(Image));
+    MALLOC_CHECK(shards);
+    for (uint32_t ii = 0; ii < shardCount; ++ii)
     {
-        printHelp();
-        return EXIT_SUCCESS;
+        shards[ii] = Image();
     }
 
-    // Action for --printCLDevices.
-    if (cmdLine.hasArg("printCLDevices"))
+    bool loaded = true;
+    for (uint32_t ii = 0; ii < shardCount && loaded; ++ii)
     {
-        if (bx::clLoad())
+        char fileName[2048];
+        shardFileName(fileName, _inputParameters, ii);
+
+        char filePath[2048];
+        snprintf(filePath, sizeof(filePath), "%s%s", fileName, getFilenameExtensionStr(ImageFileType::DDS));
+
+        loaded = imageLoad(shards[ii], filePath);
+        if (!loaded)
         {
-            clPrintDevices();
-            bx::clUnload();
-            return EXIT_SUCCESS;
+            WARN("Could not load shard %u of %u from %s.", ii, shardCount, filePath);
         }
-
-        WARN("ERROR! OpenCL is not set up properly on the machine.");
-        return EXIT_FAILURE;
     }
 
-    InputParameters inputParameters;
-    inputParametersDefault(inputParameters);
-    inputParametersFromCommandLine(inputParameters, cmdLine);
+    const bool merged = loaded && imageRadianceFilterMerge(_image, shards, shardCount);
+    if (merged)
+    {
+        INFO("Merged %u shards of %s.", shardCount, _inputParameters.m_shardFile);
+    }
 
-    if (inputParameters.m_silent)
+    for (uint32_t ii = 0; ii < shardCount; ++ii)
     {
-        g_printInfo = false;
-        g_printWarnings = false;
+        imageUnload(shards[ii]);
     }
+    free(shards);
 
-    Image image;
-    Image imageFaceList[6];
+    return merged;
+}
+
+/// Decodes block compressed image to RGBA16F if it is HDR, to RGBA8 otherwise. Other images are left as they are.
+void imageDecodeBlocks(Image& _image)
+{
+    const TextureFormat::Enum format = (TextureFormat::Enum)_image.m_format;
+    if (0 != getImageDataInfo(format).m_blockBytes)
+    {
+        const bool hdr = (TextureFormat::BC6H_UF16 == format || TextureFormat::BC6H_SF16 == format);
+        imageConvert(_image, hdr ? TextureFormat::RGBA16F : TextureFormat::RGBA8);
+    }
+}
+
+/// OpenCL contexts kept for all jobs of a run.
+struct ClDevices
+{
+    ClDevices()
+        : m_initParameters(NULL)
+        , m_numActive(0)
+        , m_clLoaded(false)
+    {
+        for (uint8_t ii = 0; ii < CMFT_CL_MAX_CONTEXTS; ++ii)
+        {
+            m_active[ii] = NULL;
+        }
+    }
+
+    ClContext m_contexts[CMFT_CL_MAX_CONTEXTS];
+    const ClContext* m_active[CMFT_CL_MAX_CONTEXTS]; //!< Successfully initialized contexts, one per device.
+    bx::Thread m_initThread; //!< Runs cmftClInit() started by cmftClInitBegin().
+    const InputParameters* m_initParameters;
+    uint8_t m_numActive;
+    bool m_clLoaded;
+};
+
+/// Waits for devices started with cmftClInitBegin(), returns immediately if they are ready. Returns the first active context.
+const ClContext* cmftClInitEnd(ClDevices& _clDevices)
+{
+    if (_clDevices.m_initThread.isRunning())
+    {
+        _clDevices.m_initThread.shutdown();
+    }
+
+    return _clDevices.m_active[0];
+}
+
+// Source cache.
+//-----
+
+/// Sources kept at most, least recently used one is dropped first when either this or the memory budget is exceeded.
+#ifndef CMFT_SOURCE_CACHE_MAX_ENTRIES
+#   define CMFT_SOURCE_CACHE_MAX_ENTRIES 32
+#endif // CMFT_SOURCE_CACHE_MAX_ENTRIES
+
+struct SourceCacheEntry
+{
+    uint64_t m_key;
+    uint64_t m_lastUse;
+    Image m_image;
+};
+
+/// Loaded sources ready for filtering, kept across jobs of --batch and --server. Jobs get them shared with imageShare(),
+/// source operations of later stages copy the data before modifying it.
+struct SourceCache
+{
+    SourceCache()
+        : m_budget(0)
+        , m_size(0)
+        , m_useCounter(0)
+        , m_numEntries(0)
+    {
+    }
+
+    bx::Mutex m_mutex;
+    uint64_t m_budget; //!< Bytes, 0 if the cache is not used.
+    uint64_t m_size;
+    uint64_t m_useCounter;
+    uint32_t m_numEntries;
+    SourceCacheEntry m_entries[CMFT_SOURCE_CACHE_MAX_ENTRIES];
+};
+static SourceCache s_sourceCache;
+
+/// Starts keeping loaded sources, up to _sizeMB megabytes of them.
+void sourceCacheInit(uint32_t _sizeMB)
+{
+    bx::MutexScope lock(s_sourceCache.m_mutex);
+    s_sourceCache.m_budget = uint64_t(_sizeMB)<<20;
+}
+
+void sourceCacheShutdown()
+{
+    bx::MutexScope lock(s_sourceCache.m_mutex);
+    for (uint32_t ii = 0; ii < s_sourceCache.m_numEntries; ++ii)
+    {
+        imageUnload(s_sourceCache.m_entries[ii].m_image);
+    }
+    s_sourceCache.m_numEntries = 0;
+    s_sourceCache.m_size = 0;
+    s_sourceCache.m_budget = 0;
+}
+
+/// Adds modification time and size of the file to the key. Returns false if the file does not exist.
+bool sourceCacheAddFile(HashMurmur2A& _murmur, const char* _filePath)
+{
+    struct stat st;
+    if (0 != stat(_filePath, &st))
+    {
+        return false;
+    }
+
+    _murmur.add(_filePath, int(strlen(_filePath)));
+    _murmur.add(uint64_t(st.st_mtime));
+    _murmur.add(uint64_t(st.st_size));
+    return true;
+}
+
+/// Computes the key of the source cmftLoadStage() prepares for _inputParameters. Returns false if the source can not be cached.
+bool sourceCacheKey(uint64_t& _key, const InputParameters& _inputParameters, const ClContext* _clContext)
+{
+    const InputParameters& ip = _inputParameters;
+
+    // Spherical harmonics are computed from some sources while loading them, mapped sources are not copied.
+    if (FilterType::ShCoeffs == ip.m_filterType
+    ||  ip.m_mapInput)
+    {
+        return false;
+    }
+
+    const char* faceFilePaths[CUBE_FACE_NUM] =
+    {
+        ip.m_inputPosXFace,
+        ip.m_inputNegXFace,
+        ip.m_inputPosYFace,
+        ip.m_inputNegYFace,
+        ip.m_inputPosZFace,
+        ip.m_inputNegZFace,
+    };
+
+    uint32_t hash[2];
+    for (uint32_t ii = 0; ii < 2; ++ii)
+    {
+        HashMurmur2A murmur;
+        murmur.begin(ii);
+
+        // Source.
+        if (CubemapPattern::Count != ip.m_generatePattern)
+        {
+            murmur.add(ip.m_generatePattern);
+            murmur.add(ip.m_generateFaceSize);
+            murmur.add(ip.m_generateSeed);
+        }
+        else if ('\0' != ip.m_inputFilePath[0])
+        {
+            if (!sourceCacheAddFile(murmur, ip.m_inputFilePath))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                if (!sourceCacheAddFile(murmur, faceFilePaths[face]))
+                {
+                    return false;
+                }
+            }
+        }
+
+        // Preparation, filter type and gammas decide the loaded format and mips.
+        murmur.add(ip.m_filterType);
+        murmur.add(uint8_t(ip.m_halfPrecision));
+        murmur.add(ip.m_inputGammaPowNumerator);
+        murmur.add(ip.m_inputGammaPowDenominator);
+        murmur.add(ip.m_outputGammaPowNumerator);
+        murmur.add(ip.m_outputGammaPowDenominator);
+        murmur.add(ip.m_srcFaceSize);
+        murmur.add(ip.m_resizeFilter);
+        murmur.add(ip.m_imageOpPosX);
+        murmur.add(ip.m_imageOpNegX);
+        murmur.add(ip.m_imageOpPosY);
+        murmur.add(ip.m_imageOpNegY);
+        murmur.add(ip.m_imageOpPosZ);
+        murmur.add(ip.m_imageOpNegZ);
+
+        // Rgbm and rgbd sources are decoded with the ranges of the job.
+        murmur.add(ip.m_rgbmRange);
+        murmur.add(ip.m_rgbdRange);
+
+        // OpenCL latlong conversion differs from the CPU one in the last bits.
+        murmur.add(uint8_t(NULL != _clContext));
+
+        hash[ii] = murmur.end();
+    }
+
+    _key = (uint64_t(hash[0])<<32) | hash[1];
+    return true;
+}
+
+/// Shares the source kept under _key with _image. Returns false if there is none.
+bool sourceCacheFind(Image& _image, uint64_t _key)
+{
+    bx::MutexScope lock(s_sourceCache.m_mutex);
+    for (uint32_t ii = 0; ii < s_sourceCache.m_numEntries; ++ii)
+    {
+        SourceCacheEntry& entry = s_sourceCache.m_entries[ii];
+        if (_key == entry.m_key)
+        {
+            entry.m_lastUse = ++s_sourceCache.m_useCounter;
+            imageShare(_image, entry.m_image);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// Keeps _image under _key, sharing its data. Least recently used sources are dropped to stay within the budget.
+void sourceCacheStore(uint64_t _key, Image& _image)
+{
+    bx::MutexScope lock(s_sourceCache.m_mutex);
+    SourceCache& cache = s_sourceCache;
+
+    if (_image.m_dataSize > cache.m_budget
+    ||  _image.m_mapped
+    ||  NULL == _image.m_data)
+    {
+        return;
+    }
+
+    while (0 != cache.m_numEntries
+    &&    (CMFT_SOURCE_CACHE_MAX_ENTRIES == cache.m_numEntries || cache.m_size + _image.m_dataSize > cache.m_budget))
+    {
+        uint32_t lru = 0;
+        for (uint32_t ii = 1; ii < cache.m_numEntries; ++ii)
+        {
+            if (cache.m_entries[ii].m_lastUse < cache.m_entries[lru].m_lastUse)
+            {
+                lru = ii;
+            }
+        }
+
+        SourceCacheEntry& entry = cache.m_entries[lru];
+        cache.m_size -= entry.m_image.m_dataSize;
+        imageUnload(entry.m_image);
+
+        SourceCacheEntry& last = cache.m_entries[--cache.m_numEntries];
+        entry.m_key = last.m_key;
+        entry.m_lastUse = last.m_lastUse;
+        imageMove(entry.m_image, last.m_image);
+    }
+
+    SourceCacheEntry& entry = cache.m_entries[cache.m_numEntries++];
+    entry.m_key = _key;
+    entry.m_lastUse = ++cache.m_useCounter;
+    imageShare(entry.m_image, _image);
+    cache.m_size += _image.m_dataSize;
+}
+
+/// Loads input image, assembles it into a cubemap and applies source image operations.
+/// Latlong input is converted on _clContext if one is given, or on the first of _pendingClDevices, waiting for cmftClInitBegin()
+/// to set them up. In --batch and --server sources are kept in the source cache.
+JobState::Enum cmftLoadStage(Image& _image, const InputParameters& _inputParameters, const ClContext* _clContext = NULL, ClDevices* _pendingClDevices = NULL)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    CMFT_PROFILE_ZONE("cmftLoadStage");
+
+    // Merged shards are filtered already.
+    if (_inputParameters.m_mergeShards)
+    {
+        return mergeShards(_image, _inputParameters) ? JobState::Ready : JobState::Failed;
+    }
+
+    // BRDF lookup table is generated without input.
+    if (FilterType::BrdfLut    == _inputParameters.m_filterType
+    ||  FilterType::BrdfLutGgx == _inputParameters.m_filterType)
+    {
+        return JobState::Ready;
+    }
+
+    uint64_t sourceKey;
+    const bool cacheSource = (0 != s_sourceCache.m_budget)
+                          && sourceCacheKey(sourceKey, _inputParameters, _clContext)
+                          ;
+    if (cacheSource
+    &&  sourceCacheFind(_image, sourceKey))
+    {
+        INFO("Using loaded source from source cache.");
+        return JobState::Ready;
+    }
+
+    bool imageLoaded = false;
+
+    // Half precision radiance filtering keeps the whole pipeline in RGBA16F. Without a filter and gamma the source keeps
+    // its own format, layout conversions copy texels as they are and resampling steps convert on their own.
+    const bool keepFormat = FilterType::None == _inputParameters.m_filterType
+                         && 0.0001f > fabsf(_inputParameters.m_inputGammaPowNumerator  / _inputParameters.m_inputGammaPowDenominator  - 1.0f)
+                         && 0.0001f > fabsf(_inputParameters.m_outputGammaPowNumerator / _inputParameters.m_outputGammaPowDenominator - 1.0f)
+                         ;
+    const TextureFormat::Enum loadFormat = keepFormat
+                                         ? TextureFormat::Unknown
+                                         : (_inputParameters.m_halfPrecision && FilterType::Radiance == _inputParameters.m_filterType)
+                                         ? TextureFormat::RGBA16F
+                                         : TextureFormat::RGBA32F
+                                         ;
+
+    // Loaders decode rgbm and rgbd with the default ranges. With other ranges the source is loaded as it is and converted below.
+    const ImageEncodeSettings encodeSettings = encodeSettingsFromInputParameters(_inputParameters);
+    const bool defaultRanges = ImageEncodeSettings().m_rgbmRange == encodeSettings.m_rgbmRange
+                            && ImageEncodeSettings().m_rgbdRange == encodeSettings.m_rgbdRange
+                            ;
+    const TextureFormat::Enum fileFormat = defaultRanges ? loadFormat : TextureFormat::Unknown;
+
+    // Load image.
+    if (CubemapPattern::Count != _inputParameters.m_generatePattern)
+    {
+        const CubemapPattern::Enum pattern = CubemapPattern::Enum(_inputParameters.m_generatePattern);
+        INFO("Generating %s cubemap of face size %u.", getCubemapPatternStr(pattern), _inputParameters.m_generateFaceSize);
+        imageLoaded = imageCubemapFromPattern(_image
+                                             , pattern
+                                             , _inputParameters.m_generateFaceSize
+                                             , (TextureFormat::Unknown == loadFormat) ? TextureFormat::RGBA32F : loadFormat
+                                             , _inputParameters.m_generateSeed
+                                             );
+    }
+    else if (0 != strcmp("", _inputParameters.m_inputFilePath))
+    {
+        // Latlong Hdr and Exr input is converted to cubemap while decoding, without keeping the whole source image in memory.
+        // Exr keeps its own format otherwise, so it goes this way only when it would be loaded as rgba32f anyway.
+        if (FilterType::ShCoeffs != _inputParameters.m_filterType
+        &&  TextureFormat::RGBA16F != loadFormat
+        && (imageCubemapFromLatLongHdr(_image, _inputParameters.m_inputFilePath)
+        || (TextureFormat::RGBA32F == loadFormat && imageCubemapFromLatLongExr(_image, _inputParameters.m_inputFilePath))))
+        {
+            INFO("Converted latlong image to cubemap while decoding it.");
+            imageLoaded = true;
+        }
+        else
+        {
+            // Irradiance and SH filters integrate the base mip only, Dds and Ktx loaders skip the rest.
+            ImageLoadRange loadRange;
+            if (FilterType::Irradiance == _inputParameters.m_filterType
+            ||  FilterType::ShCoeffs   == _inputParameters.m_filterType)
+            {
+                loadRange.m_numMips = 1;
+            }
+
+            // Smaller source face size is taken from the smallest existing cubemap mip at least as big, which is the only one loaded.
+            // Resize below is then skipped or starts from that mip. Either way source ends up with a single mip, as after resizing the base.
+            uint32_t fileWidth;
+            uint32_t fileHeight;
+            uint8_t fileMips;
+            uint8_t fileFaces;
+            if (0 != _inputParameters.m_srcFaceSize
+            &&  imageGetMipChainInfo(fileWidth, fileHeight, fileMips, fileFaces, _inputParameters.m_inputFilePath)
+            &&  CUBE_FACE_NUM == fileFaces
+            &&  fileWidth > _inputParameters.m_srcFaceSize)
+            {
+                uint8_t mip = 0;
+                while (mip+1 < fileMips
+                &&     max(UINT32_C(1), fileWidth >> (mip+1)) >= _inputParameters.m_srcFaceSize)
+                {
+                    ++mip;
+                }
+
+                if (0 != mip)
+                {
+                    INFO("Loading mip %u (%ux%u) of source for source face size %u."
+                        , mip
+                        , max(UINT32_C(1), fileWidth >> mip)
+                        , max(UINT32_C(1), fileHeight >> mip)
+                        , _inputParameters.m_srcFaceSize
+                        );
+                    loadRange.m_firstMip = mip;
+                    loadRange.m_numMips = 1;
+                }
+            }
+
+            imageLoaded = imageLoad(_image, _inputParameters.m_inputFilePath, loadRange, fileFormat, _inputParameters.m_mapInput);
+        }
+    }
+    else
+    {
+        if (0 != strcmp("", _inputParameters.m_inputPosXFace)
+        &&  0 != strcmp("", _inputParameters.m_inputNegXFace)
+        &&  0 != strcmp("", _inputParameters.m_inputPosYFace)
+        &&  0 != strcmp("", _inputParameters.m_inputNegYFace)
+        &&  0 != strcmp("", _inputParameters.m_inputPosZFace)
+        &&  0 != strcmp("", _inputParameters.m_inputNegZFace))
+        {
+            // Faces are loaded concurrently, each one decoding straight into its part of the cubemap.
+            const char* faceFilePaths[CUBE_FACE_NUM] =
+            {
+                _inputParameters.m_inputPosXFace,
+                _inputParameters.m_inputNegXFace,
+                _inputParameters.m_inputPosYFace,
+                _inputParameters.m_inputNegYFace,
+                _inputParameters.m_inputPosZFace,
+                _inputParameters.m_inputNegZFace,
+            };
+
+            INFO("Assembling cubemap from image list.");
+            imageLoaded = imageCubemapLoadFaceList(_image, faceFilePaths, fileFormat);
+        }
+    }
+
+    if(!imageLoaded)
+    {
+        WARN("Invalid input!\n");
+        imageUnload(_image);
+        return JobState::Failed;
+    }
+
+    // Layout conversions work on whole texels, block compressed source loaded in its own format is decoded.
+    imageDecodeBlocks(_image);
+
+    // Source is used as loaded unless it has to be resized or transformed as a cubemap.
+    const bool keepSourceLayout = (0 == _inputParameters.m_srcFaceSize
+                               &&  0 == (_inputParameters.m_imageOpPosX | _inputParameters.m_imageOpNegX
+                                       | _inputParameters.m_imageOpPosY | _inputParameters.m_imageOpNegY
+                                       | _inputParameters.m_imageOpPosZ | _inputParameters.m_imageOpNegZ));
+
+    // Source loaded in its own format for other encoding ranges, layout conversions would decode rgbm and rgbd with the defaults.
+    if (fileFormat != loadFormat)
+    {
+        imageConvert(_image, loadFormat, &encodeSettings);
+    }
+    else if (!defaultRanges
+         &&  !keepSourceLayout
+         && (TextureFormat::RGBM8 == _image.m_format || TextureFormat::RGBD8 == _image.m_format))
+    {
+        imageConvert(_image, TextureFormat::RGBA32F, &encodeSettings);
+    }
+
+    // Every tile of a probe atlas is integrated in one parallel pass.
+    if (FilterType::ShCoeffs == _inputParameters.m_filterType
+    &&  0 != _inputParameters.m_probeTileWidth
+    &&  0 != _inputParameters.m_probeTileHeight)
+    {
+        imageApplyGamma(_image, _inputParameters.m_inputGammaPowNumerator / _inputParameters.m_inputGammaPowDenominator);
+
+        const uint32_t numProbes = imageAtlasNumTiles(_image, _inputParameters.m_probeTileWidth, _inputParameters.m_probeTileHeight);
+        double (*shCoeffs)[SH_COEFF_NUM][3] = (double (*)[SH_COEFF_NUM][3])malloc(max(UINT32_C(1), numProbes)*sizeof(double[SH_COEFF_NUM][3]));
+        MALLOC_CHECK(shCoeffs);
+
+        INFO("Computing spherical harmonics coefficients of %u probes.", numProbes);
+        if (!imageShCoeffsAtlas(shCoeffs, _image, _inputParameters.m_probeTileWidth, _inputParameters.m_probeTileHeight, (uint8_t)_inputParameters.m_shOrder))
+        {
+            WARN("Computing spherical harmonics coefficients failed.");
+            free(shCoeffs);
+            imageUnload(_image);
+            return JobState::Failed;
+        }
+
+        outputShCoeffs(_inputParameters, shCoeffs, numProbes);
+
+        free(shCoeffs);
+        imageUnload(_image);
+        return JobState::Done;
+    }
+
+    // Probes of an atlas are filtered together and stored as a shared basis.
+    if ((FilterType::Radiance == _inputParameters.m_filterType || FilterType::Irradiance == _inputParameters.m_filterType)
+    &&  0 != _inputParameters.m_probeBasis
+    &&  0 != _inputParameters.m_probeTileWidth
+    &&  0 != _inputParameters.m_probeTileHeight)
+    {
+        imageApplyGamma(_image, _inputParameters.m_inputGammaPowNumerator / _inputParameters.m_inputGammaPowDenominator);
+
+        const uint32_t numProbes = imageAtlasNumTiles(_image, _inputParameters.m_probeTileWidth, _inputParameters.m_probeTileHeight);
+        Image* probes = (Image*)malloc(max(UINT32_C(1), numProbes)*sizeof(Image));
+        MALLOC_CHECK(probes);
+
+        bool ok = (0 != numProbes);
+        uint32_t numLoaded = 0;
+        for (; ok && numLoaded < numProbes; ++numLoaded)
+        {
+            probes[numLoaded] = Image();
+
+            ImageView view;
+            ok = imageViewFromAtlasTile(view, _image, numLoaded, _inputParameters.m_probeTileWidth, _inputParameters.m_probeTileHeight)
+              && imageFromView(probes[numLoaded], view, TextureFormat::RGBA32F);
+        }
+        imageUnload(_image);
+
+        if (ok && FilterType::Radiance == _inputParameters.m_filterType)
+        {
+            INFO("Filtering radiance of %u probes.", numProbes);
+            ok = imageRadianceFilterBatch(probes
+                                        , probes
+                                        , numProbes
+                                        , _inputParameters.m_dstFaceSize
+                                        , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                        , (bool)_inputParameters.m_excludeBase
+                                        , (uint8_t)_inputParameters.m_mipCount
+                                        , (uint8_t)_inputParameters.m_glossScale
+                                        , (uint8_t)_inputParameters.m_glossBias
+                                        , (int16_t)_inputParameters.m_numCpuProcessingThreads
+                                        , _clContext
+                                        , false
+                                        , false
+                                        , &filterSettings
+                                        );
+        }
+        else if (ok)
+        {
+            INFO("Filtering irradiance of %u probes.", numProbes);
+            for (uint32_t probe = 0; ok && probe < numProbes; ++probe)
+            {
+                ok = (IrradianceMethod::Cosine == _inputParameters.m_irradianceMethod)
+                   ? imageIrradianceFilterCosine(probes[probe], _inputParameters.m_dstFaceSize, probes[probe])
+                   : imageIrradianceFilterSh(probes[probe], _inputParameters.m_dstFaceSize, probes[probe], (uint8_t)_inputParameters.m_shOrder, _clContext, NULL, &filterSettings)
+                   ;
+            }
+        }
+
+        ProbeBasis basis;
+        ok = ok && probeBasisCompute(basis, probes, numProbes, _inputParameters.m_probeBasis, _inputParameters.m_probeBasisMaxError);
+
+        for (uint32_t probe = 0; probe < numLoaded; ++probe)
+        {
+            imageUnload(probes[probe]);
+        }
+        free(probes);
+
+        if (!ok)
+        {
+            WARN("Computing probe basis failed.");
+            return JobState::Failed;
+        }
+
+        for (uint32_t ii = 0; ii < _inputParameters.m_outputFilesNum; ++ii)
+        {
+            INFO("Saving basis of %u probes to %s.bin", numProbes, _inputParameters.m_outputFiles[ii].m_fileName);
+            outputProbeBasisBinary(_inputParameters.m_outputFiles[ii].m_fileName, basis);
+        }
+
+        probeBasisUnload(basis);
+        return JobState::Done;
+    }
+
+    // Spherical harmonics coefficients are computed directly from latlong input.
+    if (FilterType::ShCoeffs == _inputParameters.m_filterType
+    &&  imageIsLatLong(_image)
+    &&  keepSourceLayout)
+    {
+        imageApplyGamma(_image, _inputParameters.m_inputGammaPowNumerator / _inputParameters.m_inputGammaPowDenominator);
+
+        double shCoeffs[SH_COEFF_NUM][3];
+        if (!imageShCoeffsFromLatLong(shCoeffs, _image, (uint8_t)_inputParameters.m_shOrder))
+        {
+            WARN("Computing spherical harmonics coefficients failed.");
+            imageUnload(_image);
+            return JobState::Failed;
+        }
+
+        outputShCoeffs(_inputParameters, &shCoeffs);
+
+        imageUnload(_image);
+        return JobState::Done;
+    }
+
+    // Irradiance and SH filters read cube cross and hstrip faces in place, no cubemap has to be assembled for them.
+    const bool filterReadsLayout = keepSourceLayout
+                                && (FilterType::Irradiance == _inputParameters.m_filterType
+                                ||  FilterType::ShCoeffs   == _inputParameters.m_filterType)
+                                && (imageIsCubeCross(_image) || imageIsHStrip(_image))
+                                ;
+
+    // Assemble cubemap.
+    if (!imageIsCubemap(_image) && !filterReadsLayout)
+    {
+        if(imageIsCubeCross(_image))
+        {
+            INFO("Converting cube cross to cubemap.");
+            imageCubemapFromCross(_image);
+        }
+        else if (imageIsLatLong(_image))
+        {
+            INFO("Converting latlong image to cubemap.");
+            const ClContext* clContext = (NULL != _pendingClDevices) ? cmftClInitEnd(*_pendingClDevices) : _clContext;
+            imageCubemapFromLatLong(_image, true, clContext);
+        }
+        else if (imageIsHStrip(_image))
+        {
+            INFO("Converting hstrip image to cubemap.");
+            imageCubemapFromHStrip(_image);
+        }
+        else
+        {
+            INFO("Image is not cubemap(6 faces), cubecross(ratio 3:4 or 4:3), latlong(ratio 2:1), hstrip(ratio 6:1).");
+        }
+    }
+
+    if (!imageIsCubemap(_image) && !filterReadsLayout)
+    {
+        INFO("Exiting...");
+        imageUnload(_image);
+        return JobState::Failed;
+    }
+
+    // Resize if requested.
+    if (0 != _inputParameters.m_srcFaceSize && _image.m_width != _inputParameters.m_srcFaceSize)
+    {
+        INFO("Resizing source image from %ux%u to %ux%u."
+            , _image.m_width
+            , _image.m_height
+            , _inputParameters.m_srcFaceSize
+            , _inputParameters.m_srcFaceSize
+            );
+        imageResize(_image
+                  , _inputParameters.m_srcFaceSize
+                  , _inputParameters.m_srcFaceSize
+                  , (ResampleFilter::Enum)_inputParameters.m_resizeFilter
+                  );
+    }
+
+    // Transform cubemap if requested. Transforms are only recorded, filters and savers read faces through them.
+    imageTransformDeferred(_image
+                 , IMAGE_FACE_POSITIVEX | _inputParameters.m_imageOpPosX
+                 , IMAGE_FACE_NEGATIVEX | _inputParameters.m_imageOpNegX
+                 , IMAGE_FACE_POSITIVEY | _inputParameters.m_imageOpPosY
+                 , IMAGE_FACE_NEGATIVEY | _inputParameters.m_imageOpNegY
+                 , IMAGE_FACE_POSITIVEZ | _inputParameters.m_imageOpPosZ
+                 , IMAGE_FACE_NEGATIVEZ | _inputParameters.m_imageOpNegZ
+                 );
+
+    // Apply gamma on input image.
+    imageApplyGamma(_image, _inputParameters.m_inputGammaPowNumerator / _inputParameters.m_inputGammaPowDenominator);
+
+    if (cacheSource)
+    {
+        sourceCacheStore(sourceKey, _image);
+    }
+
+    return JobState::Ready;
+}
+
+/// Returns the format radiance results can be packed to on the GPU, Unknown if outputs don't allow it.
+/// Filtered image is clamped before saving, so only formats where packing clamps anyway are used.
+TextureFormat::Enum gpuEncodeFormat(const InputParameters& _inputParameters)
+{
+    if (!_inputParameters.m_gpuEncode
+    ||  0 == _inputParameters.m_outputFilesNum)
+    {
+        return TextureFormat::Unknown;
+    }
+
+    const TextureFormat::Enum format = (TextureFormat::Enum)_inputParameters.m_outputFiles[0].m_textureFormat;
+    bool supported = (TextureFormat::BGRA8 == format || TextureFormat::RGBA8 == format)
+                  && 1.0f == _inputParameters.m_outputGammaPowNumerator / _inputParameters.m_outputGammaPowDenominator
+                  && !_inputParameters.m_generateMipMapChain
+                  ;
+    for (uint32_t ii = 1; ii < _inputParameters.m_outputFilesNum; ++ii)
+    {
+        supported &= (format == (TextureFormat::Enum)_inputParameters.m_outputFiles[ii].m_textureFormat);
+    }
+
+    if (!supported)
+    {
+        WARN("GPU encoding needs all outputs in BGRA8 or all in RGBA8, without output gamma and mip chain generation. It is not used.");
+        return TextureFormat::Unknown;
+    }
+
+    return format;
+}
+
+// Filter result cache.
+//-----
+
+/// Radiance and irradiance filters write octahedral maps directly when no output needs a cubemap.
+bool outputsAreOctahedral(const InputParameters& _inputParameters)
+{
+    for (uint32_t ii = 0; ii < _inputParameters.m_outputFilesNum; ++ii)
+    {
+        if (OutputType::Octahedral != _inputParameters.m_outputFiles[ii].m_outputType)
+        {
+            return false;
+        }
+    }
+
+    return (0 != _inputParameters.m_outputFilesNum);
+}
+
+/// Radiance filter writes latlong maps directly when no output needs a cubemap.
+bool outputsAreLatLong(const InputParameters& _inputParameters)
+{
+    for (uint32_t ii = 0; ii < _inputParameters.m_outputFilesNum; ++ii)
+    {
+        if (OutputType::LatLong != _inputParameters.m_outputFiles[ii].m_outputType)
+        {
+            return false;
+        }
+    }
+
+    return (0 != _inputParameters.m_outputFilesNum);
+}
+
+/// Bump when filtering changes its results, existing cache entries are then not used anymore.
+#define CMFT_FILTER_CACHE_VERSION 1
+
+/// Writes the 64-bit cache key of the filter stage result as 16 hex digits. Key covers pixels of the loaded cubemap
+/// and every parameter cmftFilterStage() depends on.
+void filterCacheKey(char _key[17], const Image& _image, const InputParameters& _inputParameters, uint8_t _numClDevices)
+{
+    const InputParameters& ip = _inputParameters;
+
+    // Filter options as cmftFilterStage() passes them on.
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(ip);
+
+    uint32_t hash[2];
+    for (uint32_t ii = 0; ii < 2; ++ii)
+    {
+        HashMurmur2A murmur;
+        murmur.begin(ii);
+        murmur.add(uint32_t(CMFT_FILTER_CACHE_VERSION));
+
+        // Source.
+        murmur.add(_image.m_width);
+        murmur.add(_image.m_height);
+        murmur.add(uint32_t(_image.m_format));
+        murmur.add(_image.m_numMips);
+        murmur.add(_image.m_numFaces);
+        murmur.add(_image.m_faceTransforms);
+        const uint64_t chunkSize = UINT64_C(1)<<30;
+        for (uint64_t offset = 0; offset < _image.m_dataSize; offset += chunkSize)
+        {
+            const uint64_t size = min(chunkSize, _image.m_dataSize - offset);
+            murmur.add((const uint8_t*)_image.m_data + offset, int(size));
+        }
+
+        // Filter and output image parameters.
+        murmur.add(ip.m_filterType);
+        murmur.add(ip.m_resizeFilter);
+        murmur.add(uint8_t(ip.m_excludeBase));
+        murmur.add(ip.m_mipCount);
+        murmur.add(ip.m_glossScale);
+        murmur.add(ip.m_glossBias);
+        murmur.add(filterSettings.m_lobeTolerance);
+        murmur.add(filterSettings.m_adaptiveTolerance);
+        murmur.add(ip.m_dstFaceSize);
+        murmur.add(ip.m_lightingModel);
+        murmur.add(uint8_t(ip.m_sourcePyramid));
+        murmur.add(uint8_t(ip.m_chainFilter));
+        murmur.add(ip.m_chainMaxError);
+        murmur.add(ip.m_timeBudget);
+        murmur.add(uint8_t(ip.m_halfPrecision));
+        murmur.add(ip.m_irradianceMethod);
+        murmur.add(ip.m_shOrder);
+        murmur.add(filterSettings.m_shSourceFaceSize);
+        murmur.add(filterSettings.m_shSourceMaxError);
+        murmur.add(ip.m_numSamples);
+        murmur.add(ip.m_numLightSamples);
+        murmur.add(uint8_t(ip.m_generateMipMapChain));
+        murmur.add(ip.m_mipChainFilter);
+        murmur.add(uint8_t(ip.m_mipChainAverageSeams));
+        murmur.add(ip.m_outputGammaPowNumerator);
+        murmur.add(ip.m_outputGammaPowDenominator);
+        murmur.add(uint8_t(outputsAreOctahedral(ip)));
+        murmur.add(uint8_t(outputsAreLatLong(ip)));
+        murmur.add(uint8_t('\0' != ip.m_filterMatrixDir[0]));
+
+        // OpenCL results differ from CPU ones in the last bits, GPU encoding also depends on output formats.
+        murmur.add(uint8_t(0 != _numClDevices));
+        murmur.add(uint8_t(filterSettings.m_deterministic));
+        murmur.add(uint8_t(ip.m_gpuEncode));
+        if (ip.m_gpuEncode)
+        {
+            for (uint32_t jj = 0; jj < ip.m_outputFilesNum; ++jj)
+            {
+                murmur.add(ip.m_outputFiles[jj].m_textureFormat);
+            }
+        }
+
+        hash[ii] = murmur.end();
+    }
+
+    sprintf(_key, "%08x%08x", hash[0], hash[1]);
+}
+
+/// File type used for caching images in _format, Count if the format can not be cached.
+ImageFileType::Enum filterCacheFileType(TextureFormat::Enum _format)
+{
+    if (checkValidInternalFormat(ImageFileType::DDS, _format))
+    {
+        return ImageFileType::DDS;
+    }
+    else if (checkValidInternalFormat(ImageFileType::KTX, _format))
+    {
+        return ImageFileType::KTX;
+    }
+
+    return ImageFileType::Count;
+}
+
+/// Loads cached filter result for _key, if there is one.
+bool filterCacheLoad(Image& _image, const char* _cacheDir, const char* _key)
+{
+    const ImageFileType::Enum fileTypes[2] = { ImageFileType::DDS, ImageFileType::KTX };
+    for (uint8_t ii = 0; ii < 2; ++ii)
+    {
+        char filePath[2048];
+        sprintf(filePath, "%s/cmft_%s%s", _cacheDir, _key, getFilenameExtensionStr(fileTypes[ii]));
+
+        FILE* fp = fopen(filePath, "rb");
+        if (NULL == fp)
+        {
+            continue;
+        }
+        fclose(fp);
+
+        Image cached;
+        if (imageLoad(cached, filePath))
+        {
+            INFO("Filter cache hit, loaded %s.", filePath);
+            imageMove(_image, cached);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// Stores filter result under _key. Image is written to a temporary file first, so concurrent jobs never see a partial entry.
+void filterCacheStore(const Image& _image, const char* _cacheDir, const char* _key)
+{
+    const ImageFileType::Enum fileType = filterCacheFileType((TextureFormat::Enum)_image.m_format);
+    if (ImageFileType::Count == fileType)
+    {
+        INFO("Filter cache can not store %s images, result is not cached.", getTextureFormatStr(_image.m_format));
+        return;
+    }
+
+    char tmpName[2048];
+    sprintf(tmpName, "%s/cmft_%s_tmp%u", _cacheDir, _key, bx::getTid());
+
+    char tmpPath[2048];
+    sprintf(tmpPath, "%s%s", tmpName, getFilenameExtensionStr(fileType));
+
+    char filePath[2048];
+    sprintf(filePath, "%s/cmft_%s%s", _cacheDir, _key, getFilenameExtensionStr(fileType));
+
+    if (!imageSave(_image, tmpName, fileType, TextureFormat::Unknown, false)
+    ||  0 != rename(tmpPath, filePath))
+    {
+        WARN("Could not store filter result in cache directory %s.", _cacheDir);
+        remove(tmpPath);
+        return;
+    }
+
+    INFO("Filter result cached as %s.", filePath);
+}
+
+/// Bump when radiance filtering of single mips changes its results, cached levels are then not used anymore.
+#define CMFT_LEVEL_CACHE_VERSION 1
+#define CMFT_LEVEL_CACHE_MAGIC   0x4c564c43 // "CLVL"
+
+/// Radiance mips kept in the filter cache directory next to whole results, a file per face. Keys cover the source and only
+/// the parameters a single mip depends on, so a job that changes mip count or gloss parameters filters just the mips whose
+/// face size, specular power or filter angle changed and takes the others from earlier jobs.
+struct LevelCache
+{
+    struct Header
+    {
+        uint32_t m_magic;
+        uint32_t m_faceSize;
+        uint32_t m_format;
+        uint32_t m_dataSize;
+    };
+
+    LevelCache()
+        : m_cacheDir(NULL)
+        , m_mipCount(0)
+        , m_numLoaded(0)
+        , m_numStored(0)
+    {
+        memset(m_mipFaceSize, 0, sizeof(m_mipFaceSize));
+        memset(m_keys, 0, sizeof(m_keys));
+    }
+
+    const char* m_cacheDir;
+    uint8_t m_mipCount;
+    uint32_t m_mipFaceSize[MAX_MIP_NUM];
+    char m_keys[MAX_MIP_NUM][17];
+    uint32_t m_numLoaded;
+    uint32_t m_numStored;
+};
+
+void levelCacheFilePath(char _filePath[2048], const LevelCache& _cache, uint8_t _mip, uint8_t _face)
+{
+    sprintf(_filePath, "%s/cmft_level_%s_%u.bin", _cache.m_cacheDir, _cache.m_keys[_mip], _face);
+}
+
+/// Stores a filtered face of a mip, see LevelCache. Written to a temporary file first, like filterCacheStore().
+void levelCacheFace(uint32_t _cubemap, uint8_t _mip, uint8_t _face, const Image& _image, void* _userData)
+{
+    LevelCache& cache = *(LevelCache*)_userData;
+    const uint32_t faceSize = _image.m_width;
+    const TextureFormat::Enum format = _image.m_format;
+    if (0 != _cubemap
+    ||  _mip >= cache.m_mipCount
+    ||  faceSize != cache.m_mipFaceSize[_mip]
+    ||  (TextureFormat::RGBA32F != format && TextureFormat::RGBA16F != format))
+    {
+        return;
+    }
+
+    LevelCache::Header header;
+    header.m_magic = CMFT_LEVEL_CACHE_MAGIC;
+    header.m_faceSize = faceSize;
+    header.m_format = uint32_t(format);
+    header.m_dataSize = faceSize*faceSize*getImageDataInfo(format).m_bytesPerPixel;
+
+    char filePath[2048];
+    levelCacheFilePath(filePath, cache, _mip, _face);
+
+    char tmpPath[2048+16];
+    sprintf(tmpPath, "%s_tmp%u", filePath, bx::getTid());
+
+    FILE* fp = fopen(tmpPath, "wb");
+    bool stored = (NULL != fp)
+               && 1 == fwrite(&header, sizeof(header), 1, fp)
+               && 1 == fwrite(_image.m_data, header.m_dataSize, 1, fp)
+               ;
+    if (NULL != fp)
+    {
+        stored &= (0 == fclose(fp));
+    }
+
+    if (!stored
+    ||  0 != rename(tmpPath, filePath))
+    {
+        remove(tmpPath);
+        return;
+    }
+
+    cache.m_numStored++;
+}
+
+/// Loads a face of a mip stored by an earlier job, if there is one of the same size and format.
+bool levelCacheResume(uint32_t _cubemap, uint8_t _mip, uint8_t _face, void* _data, uint32_t _faceSize, TextureFormat::Enum _format, void* _userData)
+{
+    LevelCache& cache = *(LevelCache*)_userData;
+    if (0 != _cubemap
+    ||  _mip >= cache.m_mipCount
+    ||  _faceSize != cache.m_mipFaceSize[_mip])
+    {
+        return false;
+    }
+
+    char filePath[2048];
+    levelCacheFilePath(filePath, cache, _mip, _face);
+
+    FILE* fp = fopen(filePath, "rb");
+    if (NULL == fp)
+    {
+        return false;
+    }
+
+    LevelCache::Header header;
+    const bool loaded = 1 == fread(&header, sizeof(header), 1, fp)
+                     && CMFT_LEVEL_CACHE_MAGIC == header.m_magic
+                     && _faceSize == header.m_faceSize
+                     && uint32_t(_format) == header.m_format
+                     && _faceSize*_faceSize*getImageDataInfo(_format).m_bytesPerPixel == header.m_dataSize
+                     && 1 == fread(_data, header.m_dataSize, 1, fp)
+                     ;
+    fclose(fp);
+
+    cache.m_numLoaded += loaded;
+    return loaded;
+}
+
+/// Derives level keys of the radiance filter job and hooks the cache into _progress.
+void levelCacheBegin(LevelCache& _cache, FilterProgress& _progress, const Image& _image, const InputParameters& _inputParameters, uint8_t _numClDevices)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    const InputParameters& ip = _inputParameters;
+
+    RadianceFilterEstimate estimate;
+    imageRadianceFilterEstimate(estimate
+                              , _image.m_width
+                              , (TextureFormat::Enum)_image.m_format
+                              , ip.m_dstFaceSize
+                              , (LightingModel::Enum)ip.m_lightingModel
+                              , (bool)ip.m_excludeBase
+                              , (uint8_t)ip.m_mipCount
+                              , (uint8_t)ip.m_glossScale
+                              , (uint8_t)ip.m_glossBias
+                              , ip.m_sourcePyramid
+                              , ip.m_halfPrecision
+                              , NULL
+                              , &filterSettings
+                              );
+
+    // Source pixels are hashed once for all mips.
+    uint32_t srcHash[2];
+    for (uint32_t ii = 0; ii < 2; ++ii)
+    {
+        HashMurmur2A murmur;
+        murmur.begin(ii);
+        murmur.add(_image.m_width);
+        murmur.add(_image.m_height);
+        murmur.add(uint32_t(_image.m_format));
+        murmur.add(_image.m_numMips);
+        murmur.add(_image.m_numFaces);
+        murmur.add(_image.m_faceTransforms);
+        const uint64_t chunkSize = UINT64_C(1)<<30;
+        for (uint64_t offset = 0; offset < _image.m_dataSize; offset += chunkSize)
+        {
+            const uint64_t size = min(chunkSize, _image.m_dataSize - offset);
+            murmur.add((const uint8_t*)_image.m_data + offset, int(size));
+        }
+        srcHash[ii] = murmur.end();
+    }
+
+    _cache.m_cacheDir = ip.m_filterCacheDir;
+    _cache.m_mipCount = estimate.m_mipCount;
+    for (uint8_t mip = 0; mip < estimate.m_mipCount; ++mip)
+    {
+        _cache.m_mipFaceSize[mip] = estimate.m_mipFaceSize[mip];
+
+        uint32_t hash[2];
+        for (uint32_t ii = 0; ii < 2; ++ii)
+        {
+            HashMurmur2A murmur;
+            murmur.begin(ii);
+            murmur.add(uint32_t(CMFT_LEVEL_CACHE_VERSION));
+            murmur.add(srcHash[0]);
+            murmur.add(srcHash[1]);
+
+            // Mip parameters. Copied base has no lobe.
+            murmur.add(estimate.m_mipFaceSize[mip]);
+            murmur.add(estimate.m_mipSpecularPower[mip]);
+            murmur.add(estimate.m_mipCosAngle[mip]);
+            murmur.add(ip.m_lightingModel);
+            murmur.add(uint8_t(0 == mip && ip.m_excludeBase));
+
+            // Parameters every mip depends on, same as in filterCacheKey().
+            murmur.add(uint8_t(ip.m_sourcePyramid));
+            murmur.add(uint8_t(ip.m_halfPrecision));
+            murmur.add(uint8_t(0 != _numClDevices));
+            murmur.add(uint8_t(filterSettings.m_deterministic));
+            murmur.add(filterSettings.m_adaptiveTolerance);
+
+            hash[ii] = murmur.end();
+        }
+
+        sprintf(_cache.m_keys[mip], "%08x%08x", hash[0], hash[1]);
+    }
+
+    _progress.m_faceCallback = levelCacheFace;
+    _progress.m_resumeCallback = levelCacheResume;
+    _progress.m_userData = &_cache;
+}
+
+/// Bump when radiance matrices change, matrices of earlier versions are then built again.
+#define CMFT_FILTER_MATRIX_VERSION 1
+
+/// Matrix of the last radiance configuration, batch jobs sharing it neither build nor load it again.
+static RadianceFilterMatrix s_filterMatrix;
+static char s_filterMatrixKey[17];
+
+/// Writes the 64-bit key of the radiance matrix for sources of _srcFaceSize as 16 hex digits.
+void filterMatrixKey(char _key[17], uint32_t _srcFaceSize, const InputParameters& _inputParameters)
+{
+    const InputParameters& ip = _inputParameters;
+
+    uint32_t hash[2];
+    for (uint32_t ii = 0; ii < 2; ++ii)
+    {
+        HashMurmur2A murmur;
+        murmur.begin(ii);
+        murmur.add(uint32_t(CMFT_FILTER_MATRIX_VERSION));
+        murmur.add(_srcFaceSize);
+        murmur.add(ip.m_dstFaceSize);
+        murmur.add(ip.m_lightingModel);
+        murmur.add(uint8_t(ip.m_excludeBase));
+        murmur.add(ip.m_mipCount);
+        murmur.add(ip.m_glossScale);
+        murmur.add(ip.m_glossBias);
+        murmur.add(uint8_t(ip.m_sourcePyramid));
+        hash[ii] = murmur.end();
+    }
+
+    sprintf(_key, "%08x%08x", hash[0], hash[1]);
+}
+
+/// Radiance matrix for sources of _srcFaceSize, kept from the previous job, loaded from the matrix directory or built and
+/// stored there. Returns NULL if the matrix can not be built.
+const RadianceFilterMatrix* filterMatrixAcquire(uint32_t _srcFaceSize, const InputParameters& _inputParameters)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    char key[17];
+    filterMatrixKey(key, _srcFaceSize, _inputParameters);
+    if (NULL != s_filterMatrix.m_rows
+    &&  0 == strcmp(key, s_filterMatrixKey))
+    {
+        return &s_filterMatrix;
+    }
+
+    radianceFilterMatrixUnload(s_filterMatrix);
+    s_filterMatrixKey[0] = '\0';
+
+    const char* matrixDir = _inputParameters.m_filterMatrixDir;
+
+    char filePath[2048];
+    sprintf(filePath, "%s/cmft_matrix_%s.cmfm", matrixDir, key);
+
+    if (radianceFilterMatrixLoad(s_filterMatrix, filePath)
+    &&  _srcFaceSize == s_filterMatrix.m_srcFaceSize)
+    {
+        INFO("Radiance matrix loaded from %s.", filePath);
+    }
+    else
+    {
+        if (!radianceFilterMatrixBuild(s_filterMatrix
+                                     , _srcFaceSize
+                                     , _inputParameters.m_dstFaceSize
+                                     , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                     , (bool)_inputParameters.m_excludeBase
+                                     , (uint8_t)_inputParameters.m_mipCount
+                                     , (uint8_t)_inputParameters.m_glossScale
+                                     , (uint8_t)_inputParameters.m_glossBias
+                                     , _inputParameters.m_sourcePyramid
+                                     , &filterSettings
+                                     ))
+        {
+            return NULL;
+        }
+
+        // Written to a temporary file first, so concurrent jobs never see a partial matrix.
+        char tmpPath[2048];
+        sprintf(tmpPath, "%s/cmft_matrix_%s_tmp%u.cmfm", matrixDir, key, bx::getTid());
+
+        if (!radianceFilterMatrixSave(s_filterMatrix, tmpPath)
+        ||  0 != rename(tmpPath, filePath))
+        {
+            WARN("Could not store radiance matrix in directory %s.", matrixDir);
+            remove(tmpPath);
+        }
+        else
+        {
+            INFO("Radiance matrix stored as %s.", filePath);
+        }
+    }
+
+    strcpy(s_filterMatrixKey, key);
+    return &s_filterMatrix;
+}
+
+/// CPU threads and OpenCL devices radiance of a job is filtered on.
+struct ProcessingConfig
+{
+    int16_t m_numCpuThreads;
+    uint8_t m_numClDevices; //!< First ones of ClDevices::m_active.
+};
+
+/// Bump when the file format or the calibration changes, configurations of older versions are tuned again.
+#define CMFT_AUTOTUNE_VERSION 1
+
+// Sources of calibration bakes are downscaled to this face size, destination is scaled with them.
+#ifndef CMFT_AUTOTUNE_FACE_SIZE
+    #define CMFT_AUTOTUNE_FACE_SIZE 256
+#endif // CMFT_AUTOTUNE_FACE_SIZE
+
+#define CMFT_AUTOTUNE_MAX_CONFIGS 32
+
+/// Writes the 64-bit key of the machine as 16 hex digits. Key covers the host name, number of hardware threads and the
+/// OpenCL devices in use, so one file can be shared by several machines.
+void autotuneMachineKey(char _key[17], const ClDevices& _clDevices)
+{
+    char hostName[256] = "";
+#if BX_PLATFORM_POSIX
+    if (0 != gethostname(hostName, sizeof(hostName)-1))
+    {
+        hostName[0] = '\0';
+    }
+    hostName[sizeof(hostName)-1] = '\0';
+#endif // BX_PLATFORM_POSIX
+
+    uint32_t hash[2];
+    for (uint32_t ii = 0; ii < 2; ++ii)
+    {
+        HashMurmur2A murmur;
+        murmur.begin(ii);
+        murmur.add(uint32_t(CMFT_AUTOTUNE_VERSION));
+        murmur.add(hostName, int(strlen(hostName)));
+        murmur.add(getNumHardwareThreads());
+        for (uint8_t jj = 0; jj < _clDevices.m_numActive; ++jj)
+        {
+            const char* deviceName = _clDevices.m_active[jj]->m_deviceName;
+            murmur.add(deviceName, int(strlen(deviceName)));
+        }
+        hash[ii] = murmur.end();
+    }
+
+    sprintf(_key, "%08x%08x", hash[0], hash[1]);
+}
+
+/// Face size class of _faceSize, the base 2 logarithm rounded down.
+uint32_t autotuneSizeClass(uint32_t _faceSize)
+{
+    return 31 - bx::uint32_cntlz(max(UINT32_C(1), _faceSize));
+}
+
+/// Finds a configuration in the autotune file. Lines are "<machine key> <size class> <cpu threads> <OpenCL devices>".
+bool autotuneFind(ProcessingConfig& _config, const char* _filePath, const char* _machineKey, uint32_t _sizeClass)
+{
+    FILE* fp = fopen(_filePath, "r");
+    if (NULL == fp)
+    {
+        return false;
+    }
+
+    bool found = false;
+    char line[256];
+    while (!found && NULL != fgets(line, sizeof(line), fp))
+    {
+        char key[17];
+        uint32_t sizeClass;
+        int32_t numCpuThreads;
+        uint32_t numClDevices;
+        if (4 == sscanf(line, "%16s %u %d %u", key, &sizeClass, &numCpuThreads, &numClDevices)
+        &&  0 == strcmp(key, _machineKey)
+        &&  sizeClass == _sizeClass)
+        {
+            _config.m_numCpuThreads = int16_t(numCpuThreads);
+            _config.m_numClDevices = uint8_t(numClDevices);
+            found = true;
+        }
+    }
+
+    fclose(fp);
+    return found;
+}
+
+/// Adds the configuration to the autotune file, replacing an earlier one of the same machine and size class.
+bool autotuneStore(const char* _filePath, const char* _machineKey, uint32_t _sizeClass, const ProcessingConfig& _config)
+{
+    // Written to a temporary file first, so concurrent jobs never see a partial file.
+    char tmpPath[2048];
+    sprintf(tmpPath, "%s_tmp%u", _filePath, bx::getTid());
+
+    FILE* dst = fopen(tmpPath, "w");
+    if (NULL == dst)
+    {
+        return false;
+    }
+
+    FILE* src = fopen(_filePath, "r");
+    if (NULL != src)
+    {
+        char line[256];
+        while (NULL != fgets(line, sizeof(line), src))
+        {
+            char key[17];
+            uint32_t sizeClass;
+            if (2 == sscanf(line, "%16s %u", key, &sizeClass)
+            &&  0 == strcmp(key, _machineKey)
+            &&  sizeClass == _sizeClass)
+            {
+                continue;
+            }
+            fputs(line, dst);
+        }
+        fclose(src);
+    }
+
+    fprintf(dst, "%s %u %d %u\n", _machineKey, _sizeClass, int32_t(_config.m_numCpuThreads), uint32_t(_config.m_numClDevices));
+
+    const bool written = (0 == ferror(dst));
+    fclose(dst);
+
+    if (!written
+    ||  0 != rename(tmpPath, _filePath))
+    {
+        remove(tmpPath);
+        return false;
+    }
+
+    return true;
+}
+
+/// Times radiance filtering of the job parameters on a downscaled _image for every candidate configuration.
+/// Thread counts are powers of two up to the number of hardware threads, each alone and together with all OpenCL devices.
+/// Options given on the command line are kept. Returns false if no candidate could filter.
+bool autotuneCalibrate(ProcessingConfig& _config, const Image& _image, const InputParameters& _inputParameters, const ClDevices& _clDevices)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    const uint32_t faceSize = min(_image.m_width, uint32_t(CMFT_AUTOTUNE_FACE_SIZE));
+    const uint32_t dstFaceSize = (0 == _inputParameters.m_dstFaceSize)
+                               ? faceSize
+                               : max(UINT32_C(1), uint32_t(uint64_t(_inputParameters.m_dstFaceSize)*faceSize/_image.m_width))
+                               ;
+
+    Image src;
+    imageResize(src, faceSize, faceSize, _image);
+
+    const bool tuneThreads = (UINT32_MAX == _inputParameters.m_numCpuProcessingThreads);
+    const bool tuneOpenCL = _inputParameters.m_autotuneOpenCL && 0 != _clDevices.m_numActive;
+
+    ProcessingConfig candidates[CMFT_AUTOTUNE_MAX_CONFIGS];
+    uint32_t numCandidates = 0;
+    const uint16_t numHardwareThreads = min(getNumHardwareThreads(), uint16_t(CMFT_MAX_THREADS));
+    for (uint8_t useOpenCL = 0; useOpenCL < 2; ++useOpenCL)
+    {
+        const uint8_t numClDevices = useOpenCL ? _clDevices.m_numActive : 0;
+        if ((useOpenCL && 0 == numClDevices)
+        ||  (!tuneOpenCL && numClDevices != _config.m_numClDevices))
+        {
+            continue;
+        }
+
+        if (!tuneThreads)
+        {
+            candidates[numCandidates].m_numCpuThreads = _config.m_numCpuThreads;
+            candidates[numCandidates].m_numClDevices = numClDevices;
+            numCandidates++;
+            continue;
+        }
+
+        // Devices may filter alone.
+        for (uint32_t threads = useOpenCL ? 0 : 1; ; threads = (0 == threads) ? 1 : min(threads*2, uint32_t(numHardwareThreads)))
+        {
+            candidates[numCandidates].m_numCpuThreads = int16_t(threads);
+            candidates[numCandidates].m_numClDevices = numClDevices;
+            numCandidates++;
+
+            if (threads == numHardwareThreads
+            ||  numCandidates == CMFT_AUTOTUNE_MAX_CONFIGS)
+            {
+                break;
+            }
+        }
+    }
+
+    INFO("Autotune -> Calibrating %u configuration%s on %ux%u source.", numCandidates, numCandidates==1?"":"s", faceSize, faceSize);
+
+    const bool printInfo = g_printInfo;
+    const bool printWarnings = g_printWarnings;
+
+    double bestTime = 0.0;
+    bool warmedUp[2] = { false, false };
+    for (uint32_t ii = 0; ii < numCandidates; ++ii)
+    {
+        const ProcessingConfig& candidate = candidates[ii];
+
+        // First run fills normal tables and builds programs on devices, it is repeated.
+        const uint8_t useOpenCL = uint8_t(0 != candidate.m_numClDevices);
+        const uint8_t numRuns = warmedUp[useOpenCL] ? 1 : 2;
+        warmedUp[useOpenCL] = true;
+
+        double time = 0.0;
+        bool filtered = true;
+        for (uint8_t run = 0; run < numRuns && filtered; ++run)
+        {
+            g_printInfo = false;
+            g_printWarnings = false;
+
+            Image dst;
+            const int64_t begin = bx::getHPCounter();
+            filtered = imageRadianceFilter(dst
+                                         , dstFaceSize
+                                         , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                         , (bool)_inputParameters.m_excludeBase
+                                         , (uint8_t)_inputParameters.m_mipCount
+                                         , (uint8_t)_inputParameters.m_glossScale
+                                         , (uint8_t)_inputParameters.m_glossBias
+                                         , src
+                                         , candidate.m_numCpuThreads
+                                         , _clDevices.m_active
+                                         , candidate.m_numClDevices
+                                         , _inputParameters.m_sourcePyramid
+                                         , _inputParameters.m_halfPrecision
+                                         , TextureFormat::Unknown
+                                         , NULL
+                                         , NULL
+                                         , 0
+                                         , NULL
+                                         , &filterSettings
+                                         );
+            time = double(bx::getHPCounter() - begin)/double(bx::getHPFrequency());
+            imageUnload(dst);
+
+            g_printInfo = printInfo;
+            g_printWarnings = printWarnings;
+        }
+
+        if (!filtered)
+        {
+            INFO("Autotune -> %d CPU threads, %u OpenCL devices: failed.", candidate.m_numCpuThreads, candidate.m_numClDevices);
+            continue;
+        }
+
+        INFO("Autotune -> %d CPU threads, %u OpenCL devices: %.3f seconds.", candidate.m_numCpuThreads, candidate.m_numClDevices, time);
+
+        if (0.0 == bestTime || time < bestTime)
+        {
+            bestTime = time;
+            _config = candidate;
+        }
+    }
+
+    imageUnload(src);
+
+    return (0.0 != bestTime);
+}
+
+/// Sets options of _config left at default to the configuration tuned for this machine and the face size class of _image.
+/// Configurations not in the autotune file yet are calibrated and stored.
+void autotuneApply(ProcessingConfig& _config, const Image& _image, const InputParameters& _inputParameters, const ClDevices& _clDevices)
+{
+    const bool tuneThreads = (UINT32_MAX == _inputParameters.m_numCpuProcessingThreads);
+    const bool tuneOpenCL = _inputParameters.m_autotuneOpenCL && 0 != _clDevices.m_numActive;
+    if (!tuneThreads && !tuneOpenCL)
+    {
+        return;
+    }
+
+    const char* filePath = _inputParameters.m_autotuneFile;
+
+    char machineKey[17];
+    autotuneMachineKey(machineKey, _clDevices);
+    const uint32_t sizeClass = autotuneSizeClass(_image.m_width);
+
+    ProcessingConfig tuned;
+    if (autotuneFind(tuned, filePath, machineKey, sizeClass))
+    {
+        INFO("Autotune -> Configuration for face size class %u loaded from %s.", 1<<sizeClass, filePath);
+    }
+    else
+    {
+        // Calibration keeps options that are given and tunes the rest.
+        tuned = _config;
+        if (!autotuneCalibrate(tuned, _image, _inputParameters, _clDevices))
+        {
+            WARN("Autotune -> Calibration failed, options are left at default.");
+            return;
+        }
+
+        // Stored configuration is complete only when both options were tuned.
+        if (tuneThreads && (tuneOpenCL || 0 == _clDevices.m_numActive))
+        {
+            if (autotuneStore(filePath, machineKey, sizeClass, tuned))
+            {
+                INFO("Autotune -> Configuration for face size class %u stored in %s.", 1<<sizeClass, filePath);
+            }
+            else
+            {
+                WARN("Autotune -> Could not store configuration in %s.", filePath);
+            }
+        }
+    }
+
+    if (tuneThreads)
+    {
+        _config.m_numCpuThreads = tuned.m_numCpuThreads;
+    }
+
+    if (tuneOpenCL)
+    {
+        _config.m_numClDevices = min(tuned.m_numClDevices, _clDevices.m_numActive);
+    }
+
+    INFO("Autotune -> Radiance is filtered on %d CPU threads and %u OpenCL devices.", _config.m_numCpuThreads, _config.m_numClDevices);
+}
+
+#define CMFT_CHECKPOINT_MAGIC   0x54504b43 // "CKPT"
+#define CMFT_CHECKPOINT_VERSION 1
+
+/// Radiance faces of a long bake, written to a file as they get filtered so an interrupted job can resume from them.
+/// File has a header with the filter cache key of the job, followed by face records. A record cut short by the interruption
+/// is dropped on resume, the file is then written again with the complete records only.
+struct Checkpoint
+{
+    struct Header
+    {
+        uint32_t m_magic;
+        uint32_t m_version;
+        char m_key[16];
+        uint32_t m_shardIndex;
+        uint32_t m_shardCount;
+    };
+
+    struct Record
+    {
+        uint32_t m_faceSize;
+        uint32_t m_format;
+        uint8_t m_mip;
+        uint8_t m_face;
+        uint8_t m_reserved[2];
+        uint32_t m_dataSize;
+    };
+
+    Checkpoint()
+        : m_fp(NULL)
+        , m_lastFlush(0)
+        , m_flushInterval(0)
+        , m_numResumed(0)
+        , m_inMemory(false)
+    {
+        memset(m_faces, 0, sizeof(m_faces));
+        memset(m_records, 0, sizeof(m_records));
+    }
+
+    FILE* m_fp;
+    uint64_t m_lastFlush;
+    uint64_t m_flushInterval; //!< In bx::getHPCounter() ticks.
+    void* m_faces[MAX_MIP_NUM][CUBE_FACE_NUM]; //!< Texels of faces loaded for resuming, NULL where there are none.
+    Record m_records[MAX_MIP_NUM][CUBE_FACE_NUM];
+    uint32_t m_numResumed;
+    bool m_inMemory; //!< Finished faces are kept in m_faces instead of being written to a file.
+    char m_filePath[1024];
+};
+
+/// Appends a finished face to the checkpoint. Flushes the file once the checkpoint interval has passed since the last flush.
+void checkpointFace(uint32_t _cubemap, uint8_t _mip, uint8_t _face, const Image& _image, void* _userData)
+{
+    Checkpoint& checkpoint = *(Checkpoint*)_userData;
+    const TextureFormat::Enum format = _image.m_format;
+    if ((NULL == checkpoint.m_fp && !checkpoint.m_inMemory)
+    ||  0 != _cubemap
+    ||  _mip >= MAX_MIP_NUM
+    ||  (TextureFormat::RGBA32F != format && TextureFormat::RGBA16F != format))
+    {
+        return;
+    }
+
+    Checkpoint::Record record;
+    memset(&record, 0, sizeof(record));
+    record.m_faceSize = _image.m_width;
+    record.m_format = uint32_t(format);
+    record.m_mip = _mip;
+    record.m_face = _face;
+    record.m_dataSize = _image.m_width*_image.m_width*getImageDataInfo(format).m_bytesPerPixel;
+
+    if (checkpoint.m_inMemory)
+    {
+        void* data = malloc(record.m_dataSize);
+        MALLOC_CHECK(data);
+        memcpy(data, _image.m_data, record.m_dataSize);
+
+        free(checkpoint.m_faces[_mip][_face]);
+        checkpoint.m_faces[_mip][_face] = data;
+        checkpoint.m_records[_mip][_face] = record;
+        return;
+    }
+
+    if (1 != fwrite(&record, sizeof(record), 1, checkpoint.m_fp)
+    ||  1 != fwrite(_image.m_data, record.m_dataSize, 1, checkpoint.m_fp))
+    {
+        WARN("Could not write checkpoint %s, checkpointing is stopped.", checkpoint.m_filePath);
+        fclose(checkpoint.m_fp);
+        checkpoint.m_fp = NULL;
+        return;
+    }
+
+    const uint64_t now = bx::getHPCounter();
+    if (now - checkpoint.m_lastFlush >= checkpoint.m_flushInterval)
+    {
+        fflush(checkpoint.m_fp);
+        checkpoint.m_lastFlush = now;
+    }
+}
+
+/// Copies a face loaded from the checkpoint, if there is one of the same size and format.
+bool checkpointResume(uint32_t _cubemap, uint8_t _mip, uint8_t _face, void* _data, uint32_t _faceSize, TextureFormat::Enum _format, void* _userData)
+{
+    Checkpoint& checkpoint = *(Checkpoint*)_userData;
+    if (0 != _cubemap
+    ||  _mip >= MAX_MIP_NUM
+    ||  NULL == checkpoint.m_faces[_mip][_face])
+    {
+        return false;
+    }
+
+    const Checkpoint::Record& record = checkpoint.m_records[_mip][_face];
+    if (record.m_faceSize != _faceSize
+    ||  record.m_format != uint32_t(_format))
+    {
+        return false;
+    }
+
+    memcpy(_data, checkpoint.m_faces[_mip][_face], record.m_dataSize);
+    checkpoint.m_numResumed++;
+    return true;
+}
+
+/// Opens checkpoint of the job. With resume, faces of an earlier run with the same key are loaded first and written again.
+void checkpointBegin(Checkpoint& _checkpoint, FilterProgress& _progress, const char _key[17], const InputParameters& _inputParameters)
+{
+    cmft_strncpy(_checkpoint.m_filePath, _inputParameters.m_checkpointFile, CMFT_COUNTOF(_checkpoint.m_filePath)-1);
+
+    Checkpoint::Header header;
+    memset(&header, 0, sizeof(header));
+    header.m_magic = CMFT_CHECKPOINT_MAGIC;
+    header.m_version = CMFT_CHECKPOINT_VERSION;
+    memcpy(header.m_key, _key, sizeof(header.m_key));
+    header.m_shardIndex = _inputParameters.m_shardIndex;
+    header.m_shardCount = _inputParameters.m_shardCount;
+
+    uint32_t numLoaded = 0;
+    FILE* fp = _inputParameters.m_resume ? fopen(_checkpoint.m_filePath, "rb") : NULL;
+    if (NULL != fp)
+    {
+        Checkpoint::Header fileHeader;
+        if (1 == fread(&fileHeader, sizeof(fileHeader), 1, fp)
+        &&  0 == memcmp(&fileHeader, &header, sizeof(header)))
+        {
+            Checkpoint::Record record;
+            while (1 == fread(&record, sizeof(record), 1, fp))
+            {
+                if (record.m_mip >= MAX_MIP_NUM
+                ||  record.m_face >= CUBE_FACE_NUM)
+                {
+                    break;
+                }
+
+                void* data = malloc(record.m_dataSize);
+                MALLOC_CHECK(data);
+                if (1 != fread(data, record.m_dataSize, 1, fp))
+                {
+                    free(data);
+                    break;
+                }
+
+                free(_checkpoint.m_faces[record.m_mip][record.m_face]);
+                numLoaded += (NULL == _checkpoint.m_faces[record.m_mip][record.m_face]);
+                _checkpoint.m_faces[record.m_mip][record.m_face] = data;
+                _checkpoint.m_records[record.m_mip][record.m_face] = record;
+            }
+
+            INFO("Loaded %u faces from checkpoint %s.", numLoaded, _checkpoint.m_filePath);
+        }
+        else
+        {
+            INFO("Checkpoint %s belongs to a different job, it is started over.", _checkpoint.m_filePath);
+        }
+        fclose(fp);
+    }
+
+    // Loaded faces are kept in the new file too.
+    _checkpoint.m_fp = fopen(_checkpoint.m_filePath, "wb");
+    if (NULL == _checkpoint.m_fp
+    ||  1 != fwrite(&header, sizeof(header), 1, _checkpoint.m_fp))
+    {
+        WARN("Could not open checkpoint %s for writing.", _checkpoint.m_filePath);
+    }
+    else
+    {
+        for (uint8_t mip = 0; mip < MAX_MIP_NUM; ++mip)
+        {
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                const Checkpoint::Record& record = _checkpoint.m_records[mip][face];
+                if (NULL != _checkpoint.m_faces[mip][face])
+                {
+                    Image loaded;
+                    loaded.m_width = record.m_faceSize;
+                    loaded.m_height = record.m_faceSize;
+                    loaded.m_dataSize = record.m_dataSize;
+                    loaded.m_format = (TextureFormat::Enum)record.m_format;
+                    loaded.m_numMips = 1;
+                    loaded.m_numFaces = 1;
+                    loaded.m_data = _checkpoint.m_faces[mip][face];
+                    checkpointFace(0, mip, face, loaded, &_checkpoint);
+                }
+            }
+        }
+        fflush(_checkpoint.m_fp);
+    }
+
+    _checkpoint.m_flushInterval = uint64_t(double(max(0.0f, _inputParameters.m_checkpointInterval))*double(bx::getHPFrequency()));
+    _checkpoint.m_lastFlush = bx::getHPCounter();
+
+    _progress.m_faceCallback = checkpointFace;
+    _progress.m_resumeCallback = checkpointResume;
+    _progress.m_userData = &_checkpoint;
+}
+
+/// Closes checkpoint file, it is removed once filtering is finished.
+void checkpointEnd(Checkpoint& _checkpoint, bool _finished)
+{
+    if (NULL != _checkpoint.m_fp)
+    {
+        fclose(_checkpoint.m_fp);
+        _checkpoint.m_fp = NULL;
+
+        if (_finished)
+        {
+            remove(_checkpoint.m_filePath);
+        }
+    }
+
+    for (uint8_t mip = 0; mip < MAX_MIP_NUM; ++mip)
+    {
+        for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+        {
+            free(_checkpoint.m_faces[mip][face]);
+            _checkpoint.m_faces[mip][face] = NULL;
+        }
+    }
+}
+
+/// Lets a server job give way to a more urgent one. Radiance filter stops after its current tile once m_progress.m_cancel is set,
+/// faces finished by then are kept in m_faces and are not filtered again when the job runs next.
+struct JobPreemption
+{
+    JobPreemption()
+    {
+        m_faces.m_inMemory = true;
+    }
+
+    FilterProgress m_progress;
+    Checkpoint m_faces;
+};
+
+void cmftSaveStage(const Image& _image, const InputParameters& _inputParameters);
+
+/// Writes irradiance and SH coefficients baked with the radiance. Irradiance gets output gamma and clamping like the radiance,
+/// it is saved to every output with "_irradiance" appended to the file name.
+void cmftSaveBakeProducts(EnvironmentBake& _bake, const InputParameters& _inputParameters)
+{
+    if (_inputParameters.m_bakeShCoeffs)
+    {
+        outputShCoeffs(_inputParameters, &_bake.m_shCoeffs);
+    }
+
+    if (_inputParameters.m_bakeIrradiance)
+    {
+        ImagePixelOp outputOps[2];
+        outputOps[0].m_op = PixelOp::Gamma;
+        outputOps[0].m_value = _inputParameters.m_outputGammaPowNumerator / _inputParameters.m_outputGammaPowDenominator;
+        outputOps[1].m_op = PixelOp::Clamp;
+        outputOps[1].m_value = 0.0f;
+        imageApplyPixelOps(_bake.m_irradiance, (TextureFormat::Enum)_bake.m_irradiance.m_format, outputOps, 2);
+
+        InputParameters* irradianceParameters = (InputParameters*)malloc(sizeof(InputParameters));
+        MALLOC_CHECK(irradianceParameters);
+        memcpy(irradianceParameters, &_inputParameters, sizeof(InputParameters));
+        irradianceParameters->m_filterType = FilterType::Irradiance;
+        for (uint32_t ii = 0; ii < irradianceParameters->m_outputFilesNum; ++ii)
+        {
+            OutputFile& output = irradianceParameters->m_outputFiles[ii];
+            const size_t len = strlen(output.m_fileName);
+            cmft_strncpy(&output.m_fileName[len], "_irradiance", CMFT_COUNTOF(output.m_fileName)-1-len);
+        }
+
+        cmftSaveStage(_bake.m_irradiance, *irradianceParameters);
+        free(irradianceParameters);
+    }
+
+    imageUnload(_bake.m_irradiance);
+}
+
+/// Writes cost heatmap of the radiance filter of _image, see imageRadianceFilterCost(). Counts are saved as they are, without
+/// output gamma, to every output with "_cost" appended to the file name.
+void cmftSaveCostHeatmap(const Image& _image, const InputParameters& _inputParameters)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    Image cost;
+    if (!imageRadianceFilterCost(cost
+                               , _image
+                               , _inputParameters.m_dstFaceSize
+                               , (LightingModel::Enum)_inputParameters.m_lightingModel
+                               , (bool)_inputParameters.m_excludeBase
+                               , (uint8_t)_inputParameters.m_mipCount
+                               , (uint8_t)_inputParameters.m_glossScale
+                               , (uint8_t)_inputParameters.m_glossBias
+                               , &filterSettings
+                               ))
+    {
+        return;
+    }
+
+    InputParameters* costParameters = (InputParameters*)malloc(sizeof(InputParameters));
+    MALLOC_CHECK(costParameters);
+    memcpy(costParameters, &_inputParameters, sizeof(InputParameters));
+    for (uint32_t ii = 0; ii < costParameters->m_outputFilesNum; ++ii)
+    {
+        OutputFile& output = costParameters->m_outputFiles[ii];
+        const size_t len = strlen(output.m_fileName);
+        cmft_strncpy(&output.m_fileName[len], "_cost", CMFT_COUNTOF(output.m_fileName)-1-len);
+    }
+
+    cmftSaveStage(cost, *costParameters);
+    free(costParameters);
+    imageUnload(cost);
+}
+
+/// Filters loaded image and prepares it for saving. With _preemption the radiance filter can be stopped, JobState::Preempted is returned then.
+/// Radiance outputs written face by face as faces get filtered, see --mappedOutput.
+struct MappedOutputs
+{
+    MappedOutputs()
+        : m_format(TextureFormat::Unknown)
+        , m_numOps(0)
+        , m_numWriters(0)
+        , m_failed(false)
+    {
+    }
+
+    ImageMappedWriter m_writers[MAX_OUTPUT_NUM];
+    TextureFormat::Enum m_format; //!< Source format, filtered images are returned in it.
+    ImageEncodeSettings m_settings;
+    ImagePixelOp m_ops[2];
+    uint8_t m_numOps;
+    uint32_t m_numWriters;
+    bool m_failed;
+};
+
+/// Mapped outputs can only be plain cubemaps of filtered faces, in files with a fixed layout.
+bool mappedOutputSupported(const InputParameters& _inputParameters)
+{
+    if (FilterType::Radiance != _inputParameters.m_filterType
+    ||  0 == _inputParameters.m_outputFilesNum
+    ||  _inputParameters.m_generateMipMapChain
+    ||  _inputParameters.m_gpuEncode
+    ||  _inputParameters.m_bakeIrradiance
+    ||  _inputParameters.m_bakeShCoeffs
+    ||  MipLayout::FileType != _inputParameters.m_mipLayout
+    ||  '\0' != _inputParameters.m_filterCacheDir[0]
+    ||  '\0' != _inputParameters.m_checkpointFile[0])
+    {
+        return false;
+    }
+
+    for (uint32_t ii = 0; ii < _inputParameters.m_outputFilesNum; ++ii)
+    {
+        const OutputFile& output = _inputParameters.m_outputFiles[ii];
+        if (OutputType::Cubemap != output.m_outputType
+        || (ImageFileType::DDS != output.m_fileType && ImageFileType::KTX != output.m_fileType))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Applies output gamma and clamp to a filtered face, like the filter stage does to the whole image, and writes it to every output.
+void mappedOutputFace(uint32_t _cubemap, uint8_t _mip, uint8_t _face, const Image& _image, void* _userData)
+{
+    BX_UNUSED(_cubemap);
+    MappedOutputs& outputs = *(MappedOutputs*)_userData;
+
+    // Same steps as for the whole image, converted to the source format first and gamma applied in it.
+    Image converted;
+    const bool convertedIsRef = imageRefOrConvert(converted, outputs.m_format, _image, &outputs.m_settings);
+
+    Image face;
+    imageApplyPixelOps(face, outputs.m_format, converted, outputs.m_ops, outputs.m_numOps, &outputs.m_settings);
+    outputs.m_failed |= (NULL == face.m_data);
+    if (!convertedIsRef)
+    {
+        imageUnload(converted);
+    }
+
+    for (uint32_t ii = 0; ii < outputs.m_numWriters && NULL != face.m_data; ++ii)
+    {
+        outputs.m_failed |= !imageMappedWriterFace(outputs.m_writers[ii], _mip, _face, face);
+    }
+
+    imageUnload(face);
+}
+
+/// Filters radiance of _image straight into the outputs. Returns Done, or Failed if filtering or writing failed.
+JobState::Enum mappedOutputFilter(Image& _image, const InputParameters& _inputParameters, const ProcessingConfig& _config, const ClDevices& _clDevices)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    const InputParameters& ip = _inputParameters;
+
+    RadianceFilterEstimate estimate;
+    imageRadianceFilterEstimate(estimate
+                              , _image.m_width
+                              , (TextureFormat::Enum)_image.m_format
+                              , ip.m_dstFaceSize
+                              , (LightingModel::Enum)ip.m_lightingModel
+                              , (bool)ip.m_excludeBase
+                              , (uint8_t)ip.m_mipCount
+                              , (uint8_t)ip.m_glossScale
+                              , (uint8_t)ip.m_glossBias
+                              , ip.m_sourcePyramid
+                              , ip.m_halfPrecision
+                              , NULL
+                              , &filterSettings
+                              );
+
+    MappedOutputs outputs;
+    outputs.m_format = (TextureFormat::Enum)_image.m_format;
+    outputs.m_settings = encodeSettingsFromInputParameters(ip);
+    outputs.m_ops[0].m_op = PixelOp::Gamma;
+    outputs.m_ops[0].m_value = ip.m_outputGammaPowNumerator / ip.m_outputGammaPowDenominator;
+    outputs.m_ops[1].m_op = PixelOp::Clamp;
+    outputs.m_ops[1].m_value = 0.0f;
+    outputs.m_numOps = 2;
+
+    for (uint32_t ii = 0; ii < ip.m_outputFilesNum; ++ii)
+    {
+        const OutputFile& output = ip.m_outputFiles[ii];
+        const ImageFileType::Enum ft = (ImageFileType::Enum)output.m_fileType;
+        const TextureFormat::Enum tf = (TextureFormat::Enum)output.m_textureFormat;
+        const TextureFormat::Enum format = (TextureFormat::Unknown != tf) ? tf : (TextureFormat::Enum)_image.m_format;
+
+        char filePath[2048];
+        sprintf(filePath, "%s%s", output.m_fileName, getFilenameExtensionStr(ft));
+
+        INFO("Output(%u) - Writing %s as faces get filtered [%s %ux%u %s %u-mips]."
+            , ii
+            , filePath
+            , getFileTypeStr(ft)
+            , estimate.m_mipFaceSize[0]
+            , estimate.m_mipFaceSize[0]
+            , getTextureFormatStr(format)
+            , estimate.m_mipCount
+            );
+
+        if (!imageMappedWriterOpen(outputs.m_writers[outputs.m_numWriters], filePath, ft, format, estimate.m_mipFaceSize[0], estimate.m_mipFaceSize[0], estimate.m_mipCount, CUBE_FACE_NUM, &outputs.m_settings))
+        {
+            outputs.m_failed = true;
+            break;
+        }
+        outputs.m_numWriters++;
+    }
+
+    bool filtered = false;
+    if (!outputs.m_failed)
+    {
+        FilterProgress progress;
+        progress.m_faceCallback = mappedOutputFace;
+        progress.m_userData = &outputs;
+        progress.m_faceCallbackOnly = true;
+
+        Image result;
+        filtered = imageRadianceFilter(result
+                                     , ip.m_dstFaceSize
+                                     , (LightingModel::Enum)ip.m_lightingModel
+                                     , (bool)ip.m_excludeBase
+                                     , (uint8_t)ip.m_mipCount
+                                     , (uint8_t)ip.m_glossScale
+                                     , (uint8_t)ip.m_glossBias
+                                     , _image
+                                     , _config.m_numCpuThreads
+                                     , _clDevices.m_active
+                                     , _config.m_numClDevices
+                                     , ip.m_sourcePyramid
+                                     , ip.m_halfPrecision
+                                     , TextureFormat::Unknown
+                                     , NULL
+                                     , &progress
+                                     , 0
+                                     , NULL
+                                     , &filterSettings
+                                     );
+        imageUnload(result);
+    }
+    imageUnload(_image);
+
+    bool written = filtered && !outputs.m_failed;
+    for (uint32_t ii = 0; ii < outputs.m_numWriters; ++ii)
+    {
+        written &= imageMappedWriterClose(outputs.m_writers[ii]);
+    }
+
+    if (!written)
+    {
+        WARN("Writing mapped outputs failed!");
+        return JobState::Failed;
+    }
+
+    return JobState::Done;
+}
+
+/// Estimated taps of the radiance filter of _image, zero for other filters.
+static uint64_t cmftFilterTaps(const Image& _image, const InputParameters& _inputParameters)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    const InputParameters& ip = _inputParameters;
+    if (FilterType::Radiance != ip.m_filterType
+    ||  !imageIsCubemap(_image))
+    {
+        return 0;
+    }
+
+    RadianceFilterEstimate estimate;
+    imageRadianceFilterEstimate(estimate
+                              , _image.m_width
+                              , (TextureFormat::Enum)_image.m_format
+                              , ip.m_dstFaceSize
+                              , (LightingModel::Enum)ip.m_lightingModel
+                              , (bool)ip.m_excludeBase
+                              , (uint8_t)ip.m_mipCount
+                              , (uint8_t)ip.m_glossScale
+                              , (uint8_t)ip.m_glossBias
+                              , ip.m_sourcePyramid
+                              , ip.m_halfPrecision
+                              , NULL
+                              , &filterSettings
+                              );
+    return estimate.m_numTaps;
+}
+
+JobState::Enum cmftFilterStage(Image& _image, const InputParameters& _inputParameters, const ClDevices& _clDevices, JobPreemption* _preemption = NULL)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    CMFT_PROFILE_ZONE("cmftFilterStage");
+
+    // Sharded bakes filter the cubemap radiance only.
+    const bool sharded = (1 < _inputParameters.m_shardCount) || _inputParameters.m_mergeShards;
+    if (sharded
+    &&  (FilterType::Radiance != _inputParameters.m_filterType
+    ||   outputsAreOctahedral(_inputParameters)
+    ||   outputsAreLatLong(_inputParameters)
+    ||   '\0' == _inputParameters.m_shardFile[0]))
+    {
+        WARN("Sharding requires radiance filter with cubemap outputs and shardFile.");
+        imageUnload(_image);
+        return JobState::Failed;
+    }
+
+    // Radiance options left at default take the configuration tuned for the machine and source face size.
+    ProcessingConfig config;
+    config.m_numCpuThreads = (int16_t)_inputParameters.m_numCpuProcessingThreads;
+    config.m_numClDevices = _clDevices.m_numActive;
+    if ('\0' != _inputParameters.m_autotuneFile[0]
+    &&  FilterType::Radiance == _inputParameters.m_filterType
+    &&  !_inputParameters.m_mergeShards
+    &&  !outputsAreOctahedral(_inputParameters)
+    &&  !outputsAreLatLong(_inputParameters))
+    {
+        autotuneApply(config, _image, _inputParameters, _clDevices);
+    }
+
+    if (FilterType::Radiance == _inputParameters.m_filterType
+    &&  _inputParameters.m_costHeatmap
+    &&  imageIsCubemap(_image))
+    {
+        cmftSaveCostHeatmap(_image, _inputParameters);
+    }
+
+    // Result of an identical earlier job.
+    char cacheKey[17];
+    const bool useCache = ('\0' != _inputParameters.m_filterCacheDir[0])
+                       && !sharded
+                       && (FilterType::ShCoeffs   != _inputParameters.m_filterType)
+                       && (FilterType::BrdfLut    != _inputParameters.m_filterType)
+                       && (FilterType::BrdfLutGgx != _inputParameters.m_filterType)
+                       && !_inputParameters.m_bakeIrradiance
+                       && !_inputParameters.m_bakeShCoeffs
+                       ;
+    if (useCache)
+    {
+        filterCacheKey(cacheKey, _image, _inputParameters, config.m_numClDevices);
+        if (filterCacheLoad(_image, _inputParameters.m_filterCacheDir, cacheKey))
+        {
+            return JobState::Ready;
+        }
+    }
+
+    TextureFormat::Enum encodeFormat = TextureFormat::Unknown;
+
+    // Octahedral map of twice the face size has about the texel density of the cubemap.
+    const bool octahedral = outputsAreOctahedral(_inputParameters)
+                         && (FilterType::Radiance   == _inputParameters.m_filterType
+                         ||  FilterType::Irradiance == _inputParameters.m_filterType)
+                         ;
+    const uint32_t octahedralSize = _inputParameters.m_dstFaceSize*2;
+
+    // Latlong of four times the face size, same as imageLatLongFromCubemap() makes of the filtered cubemap.
+    const bool latLong = outputsAreLatLong(_inputParameters)
+                      && FilterType::Radiance == _inputParameters.m_filterType
+                      ;
+    const uint32_t latLongWidth = _inputParameters.m_dstFaceSize*4;
+
+    // Radiance faces are saved as they get filtered, so an interrupted job can resume from them.
+    Checkpoint checkpoint;
+    FilterProgress checkpointProgress;
+    const bool useCheckpoint = ('\0' != _inputParameters.m_checkpointFile[0])
+                            && (FilterType::Radiance == _inputParameters.m_filterType)
+                            && !octahedral
+                            && !latLong
+                            && !_inputParameters.m_mergeShards
+                            ;
+    if (useCheckpoint)
+    {
+        char checkpointKey[17];
+        filterCacheKey(checkpointKey, _image, _inputParameters, config.m_numClDevices);
+        checkpointBegin(checkpoint, (NULL != _preemption) ? _preemption->m_progress : checkpointProgress, checkpointKey, _inputParameters);
+    }
+    else if (NULL != _preemption)
+    {
+        _preemption->m_progress.m_faceCallback = checkpointFace;
+        _preemption->m_progress.m_resumeCallback = checkpointResume;
+        _preemption->m_progress.m_userData = &_preemption->m_faces;
+    }
+    FilterProgress* progress = (NULL != _preemption) ? &_preemption->m_progress
+                             : useCheckpoint         ? &checkpointProgress
+                             : NULL
+                             ;
+
+    // Filter cubemap.
+    if (_inputParameters.m_mergeShards)
+    {
+        // Image was put together from filtered shards.
+    }
+    else if (octahedral
+         &&  FilterType::Radiance == _inputParameters.m_filterType)
+    {
+        imageRadianceFilterOctahedral(_image
+                                    , octahedralSize
+                                    , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                    , (bool)_inputParameters.m_excludeBase
+                                    , (uint8_t)_inputParameters.m_mipCount
+                                    , (uint8_t)_inputParameters.m_glossScale
+                                    , (uint8_t)_inputParameters.m_glossBias
+                                    , _inputParameters.m_sourcePyramid
+                                    , NULL
+                                    , &filterSettings
+                                    );
+    }
+    else if (latLong)
+    {
+        imageRadianceFilterLatLong(_image
+                                 , latLongWidth
+                                 , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                 , (bool)_inputParameters.m_excludeBase
+                                 , (uint8_t)_inputParameters.m_mipCount
+                                 , (uint8_t)_inputParameters.m_glossScale
+                                 , (uint8_t)_inputParameters.m_glossBias
+                                 , _inputParameters.m_sourcePyramid
+                                 , NULL
+                                 , &filterSettings
+                                 );
+    }
+    else if (octahedral
+         &&  FilterType::Irradiance == _inputParameters.m_filterType)
+    {
+        imageIrradianceFilterShOctahedral(_image, octahedralSize, (uint8_t)_inputParameters.m_shOrder, _clDevices.m_active[0], NULL, &filterSettings);
+    }
+    else if (FilterType::Radiance == _inputParameters.m_filterType
+         &&  sharded)
+    {
+        FilterShard shard;
+        shard.m_index = _inputParameters.m_shardIndex;
+        shard.m_count = _inputParameters.m_shardCount;
+
+        Image result;
+        const bool filtered = imageRadianceFilter(result
+                                                , _inputParameters.m_dstFaceSize
+                                                , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                                , (bool)_inputParameters.m_excludeBase
+                                                , (uint8_t)_inputParameters.m_mipCount
+                                                , (uint8_t)_inputParameters.m_glossScale
+                                                , (uint8_t)_inputParameters.m_glossBias
+                                                , _image
+                                                , config.m_numCpuThreads
+                                                , _clDevices.m_active
+                                                , config.m_numClDevices
+                                                , _inputParameters.m_sourcePyramid
+                                                , _inputParameters.m_halfPrecision
+                                                , TextureFormat::Unknown
+                                                , NULL
+                                                , progress
+                                                , 0
+                                                , &shard
+                                                , &filterSettings
+                                                );
+        if (!filtered
+        &&  NULL != _preemption
+        &&  _preemption->m_progress.m_cancel)
+        {
+            if (useCheckpoint)
+            {
+                checkpointEnd(checkpoint, false);
+            }
+            return JobState::Preempted;
+        }
+        imageUnload(_image);
+
+        // Partial result is written as is, outputs are written by the merge.
+        char fileName[2048];
+        shardFileName(fileName, _inputParameters, shard.m_index);
+
+        const bool saved = filtered
+                        && imageSave(result, fileName, ImageFileType::DDS, TextureFormat::Unknown, false)
+                        ;
+        imageUnload(result);
+        if (useCheckpoint)
+        {
+            checkpointEnd(checkpoint, saved);
+        }
+
+        if (!saved)
+        {
+            WARN("Could not write shard %u of %u to %s.", shard.m_index, shard.m_count, fileName);
+            return JobState::Failed;
+        }
+
+        INFO("Shard %u of %u written to %s.", shard.m_index, shard.m_count, fileName);
+        return JobState::Done;
+    }
+    else if (FilterType::Radiance == _inputParameters.m_filterType)
+    {
+        Image result;
+        bool filtered = false;
+
+        // Irradiance and SH coefficients come from the projection of the same filter run.
+        const bool bake = _inputParameters.m_bakeIrradiance || _inputParameters.m_bakeShCoeffs;
+        if (bake)
+        {
+            const uint32_t dstFaceSize = (0 == _inputParameters.m_dstFaceSize) ? _image.m_width : _inputParameters.m_dstFaceSize;
+
+            EnvironmentBake products;
+            filtered = imageEnvironmentBake(products
+                                          , _image
+                                          , _inputParameters.m_dstFaceSize
+                                          , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                          , (bool)_inputParameters.m_excludeBase
+                                          , (uint8_t)_inputParameters.m_mipCount
+                                          , (uint8_t)_inputParameters.m_glossScale
+                                          , (uint8_t)_inputParameters.m_glossBias
+                                          , _inputParameters.m_bakeIrradiance ? ((0 == _inputParameters.m_irradianceFaceSize) ? dstFaceSize : _inputParameters.m_irradianceFaceSize) : 0
+                                          , (uint8_t)_inputParameters.m_shOrder
+                                          , config.m_numCpuThreads
+                                          , _clDevices.m_active
+                                          , config.m_numClDevices
+                                          , _inputParameters.m_sourcePyramid
+                                          , _inputParameters.m_halfPrecision
+                                          , NULL
+                                          , progress
+                                          , &filterSettings
+                                          );
+            if (filtered)
+            {
+                imageMove(result, products.m_radiance);
+                cmftSaveBakeProducts(products, _inputParameters);
+            }
+        }
+
+        // Jobs of one configuration filter by the same sparse weights. Faces are not reported, checkpoints need the filter.
+        if (!bake
+        &&  '\0' != _inputParameters.m_filterMatrixDir[0]
+        &&  !useCheckpoint
+        &&  imageIsCubemap(_image))
+        {
+            const RadianceFilterMatrix* matrix = filterMatrixAcquire(_image.m_width, _inputParameters);
+            filtered = (NULL != matrix)
+                    && imageRadianceFilterMatrix(result, _image, *matrix)
+                    ;
+        }
+
+        // Successive convolution runs on the CPU, without face reports for checkpoints.
+        if (!filtered
+        &&  !bake
+        &&  _inputParameters.m_chainFilter
+        &&  !useCheckpoint
+        &&  imageIsCubemap(_image))
+        {
+            filtered = imageRadianceFilterChain(result
+                                               , _inputParameters.m_dstFaceSize
+                                               , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                               , (bool)_inputParameters.m_excludeBase
+                                               , (uint8_t)_inputParameters.m_mipCount
+                                               , (uint8_t)_inputParameters.m_glossScale
+                                               , (uint8_t)_inputParameters.m_glossBias
+                                               , _image
+                                               , _inputParameters.m_chainMaxError
+                                               , NULL
+                                               , &filterSettings
+                                               );
+        }
+
+        // Quality is lowered per mip until filtering on the devices of the job fits the time budget.
+        if (!filtered
+        &&  !bake
+        &&  0.0f < _inputParameters.m_timeBudget
+        &&  NULL == progress
+        &&  imageIsCubemap(_image))
+        {
+            FilterProfile profile;
+            filtered = filterProfileCalibrate(profile, config.m_numCpuThreads, _clDevices.m_active, config.m_numClDevices)
+                    && imageRadianceFilterBudget(result
+                                               , _image
+                                               , double(_inputParameters.m_timeBudget)
+                                               , profile
+                                               , _inputParameters.m_dstFaceSize
+                                               , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                               , (bool)_inputParameters.m_excludeBase
+                                               , (uint8_t)_inputParameters.m_mipCount
+                                               , (uint8_t)_inputParameters.m_glossScale
+                                               , (uint8_t)_inputParameters.m_glossBias
+                                               , _clDevices.m_active
+                                               , config.m_numClDevices
+                                               , _inputParameters.m_halfPrecision
+                                               , NULL
+                                               , &filterSettings
+                                               );
+        }
+
+        // Outputs are written as faces get filtered, the filtered chain is never held in memory.
+        if (!filtered
+        &&  _inputParameters.m_mappedOutput)
+        {
+            if (NULL == progress
+            &&  imageIsCubemap(_image)
+            &&  mappedOutputSupported(_inputParameters))
+            {
+                return mappedOutputFilter(_image, _inputParameters, config, _clDevices);
+            }
+
+            WARN("Mapped output needs cubemap outputs to dds or ktx, without mip chain generation, filterCache, checkpoints, preemption, gpuEncode or bakes. It is not used.");
+        }
+
+        // Start filter.
+        if (!filtered
+        &&  !bake)
+        {
+            // Mips of earlier jobs of the same source are reused. Checkpoints and preemption take the face callbacks.
+            LevelCache levelCache;
+            FilterProgress levelProgress;
+            if (useCache
+            &&  NULL == progress)
+            {
+                levelCacheBegin(levelCache, levelProgress, _image, _inputParameters, config.m_numClDevices);
+            }
+
+            encodeFormat = gpuEncodeFormat(_inputParameters);
+            filtered = imageRadianceFilter(result
+                                          , _inputParameters.m_dstFaceSize
+                                          , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                          , (bool)_inputParameters.m_excludeBase
+                                          , (uint8_t)_inputParameters.m_mipCount
+                                          , (uint8_t)_inputParameters.m_glossScale
+                                          , (uint8_t)_inputParameters.m_glossBias
+                                          , _image
+                                          , config.m_numCpuThreads
+                                          , _clDevices.m_active
+                                          , config.m_numClDevices
+                                          , _inputParameters.m_sourcePyramid
+                                          , _inputParameters.m_halfPrecision
+                                          , encodeFormat
+                                          , NULL
+                                          , (NULL != levelCache.m_cacheDir) ? &levelProgress : progress
+                                          , 0
+                                          , NULL
+                                          , &filterSettings
+                                          );
+
+            if (0 != levelCache.m_numLoaded)
+            {
+                INFO("Filter cache -> %u mip faces taken from earlier jobs, %u filtered.", levelCache.m_numLoaded, levelCache.m_numStored);
+            }
+        }
+
+        if (!filtered
+        &&  NULL != _preemption
+        &&  _preemption->m_progress.m_cancel)
+        {
+            if (useCheckpoint)
+            {
+                checkpointEnd(checkpoint, false);
+            }
+            return JobState::Preempted;
+        }
+
+        if (filtered)
+        {
+            imageMove(_image, result);
+        }
+
+        if (useCheckpoint)
+        {
+            checkpointEnd(checkpoint, filtered);
+        }
+    }
+    else if (FilterType::RadianceGgx == _inputParameters.m_filterType)
+    {
+        // Sample counts are lowered per mip until filtering fits the time budget.
+        RadianceFilterQuality quality;
+        FilterProfile profile;
+        const bool budget = 0.0f < _inputParameters.m_timeBudget
+                         && filterProfileCalibrate(profile, (int16_t)_inputParameters.m_numCpuProcessingThreads)
+                         && imageRadianceFilterPlan(quality
+                                                  , double(_inputParameters.m_timeBudget)
+                                                  , profile
+                                                  , _image.m_width
+                                                  , _inputParameters.m_dstFaceSize
+                                                  , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                                  , (bool)_inputParameters.m_excludeBase
+                                                  , (uint8_t)_inputParameters.m_mipCount
+                                                  , (uint8_t)_inputParameters.m_glossScale
+                                                  , (uint8_t)_inputParameters.m_glossBias
+                                                  , _inputParameters.m_numSamples
+                                                  , &filterSettings
+                                                  )
+                         ;
+
+        imageRadianceFilterGgx(_image
+                             , _inputParameters.m_dstFaceSize
+                             , (bool)_inputParameters.m_excludeBase
+                             , (uint8_t)_inputParameters.m_mipCount
+                             , (uint8_t)_inputParameters.m_glossScale
+                             , (uint8_t)_inputParameters.m_glossBias
+                             , _inputParameters.m_numSamples
+                             , _inputParameters.m_numLightSamples
+                             , budget ? &quality : NULL
+                             );
+    }
+    else if (FilterType::RadiancePreview == _inputParameters.m_filterType)
+    {
+        imageRadianceFilterPreview(_image
+                                 , _inputParameters.m_dstFaceSize
+                                 , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                 , (bool)_inputParameters.m_excludeBase
+                                 , (uint8_t)_inputParameters.m_mipCount
+                                 , (uint8_t)_inputParameters.m_glossScale
+                                 , (uint8_t)_inputParameters.m_glossBias
+                                 , &filterSettings
+                                 );
+    }
+    else if (FilterType::BrdfLut    == _inputParameters.m_filterType
+         ||  FilterType::BrdfLutGgx == _inputParameters.m_filterType)
+    {
+        // Square table of dstFaceSize texels, 256 if not set.
+        const uint32_t lutSize = (0 == _inputParameters.m_dstFaceSize) ? 256 : _inputParameters.m_dstFaceSize;
+
+        const bool created = (FilterType::BrdfLut == _inputParameters.m_filterType)
+                           ? imageBrdfLut(_image
+                                        , lutSize
+                                        , lutSize
+                                        , (LightingModel::Enum)_inputParameters.m_lightingModel
+                                        , (uint8_t)_inputParameters.m_glossScale
+                                        , (uint8_t)_inputParameters.m_glossBias
+                                        , _inputParameters.m_numSamples
+                                        , TextureFormat::RGBA32F
+                                        )
+                           : imageBrdfLutGgx(_image
+                                           , lutSize
+                                           , lutSize
+                                           , (uint8_t)_inputParameters.m_glossScale
+                                           , (uint8_t)_inputParameters.m_glossBias
+                                           , _inputParameters.m_numSamples
+                                           , TextureFormat::RGBA32F
+                                           )
+                           ;
+        if (!created)
+        {
+            return JobState::Failed;
+        }
+    }
+    else if (FilterType::Irradiance == _inputParameters.m_filterType
+         &&  IrradianceMethod::Cosine == _inputParameters.m_irradianceMethod)
+    {
+        imageIrradianceFilterCosine(_image, _inputParameters.m_dstFaceSize);
+    }
+    else if (FilterType::Irradiance == _inputParameters.m_filterType)
+    {
+        imageIrradianceFilterSh(_image, _inputParameters.m_dstFaceSize, (uint8_t)_inputParameters.m_shOrder, _clDevices.m_active[0], NULL, &filterSettings);
+    }
+    else if (FilterType::ShCoeffs == _inputParameters.m_filterType)
+    {
+        double shCoeffs[SH_COEFF_NUM][3];
+        if (!imageShCoeffs(shCoeffs, _image, (uint8_t)_inputParameters.m_shOrder, _clDevices.m_active[0], &filterSettings))
+        {
+            WARN("Computing spherical harmonics coefficients failed.");
+            imageUnload(_image);
+            return JobState::Failed;
+        }
+
+        outputShCoeffs(_inputParameters, &shCoeffs);
+
+        imageUnload(_image);
+        return JobState::Done;
+    }
+    else if (FilterType::None == _inputParameters.m_filterType)
+    {
+        if (0 != _inputParameters.m_dstFaceSize && _image.m_width != _inputParameters.m_dstFaceSize)
+        {
+            INFO("Resizing destination image from %ux%u to %ux%u."
+                , _image.m_width
+                , _image.m_height
+                , _inputParameters.m_dstFaceSize
+                , _inputParameters.m_dstFaceSize
+                );
+            imageResize(_image
+                      , _inputParameters.m_dstFaceSize
+                      , _inputParameters.m_dstFaceSize
+                      , (ResampleFilter::Enum)_inputParameters.m_resizeFilter
+                      , ResizeMips::Keep
+                      );
+        }
+    }
+
+    // Generate mip map chain if requested.
+    if (_inputParameters.m_generateMipMapChain)
+    {
+        imageGenerateMipMapChain(_image
+                               , UINT8_MAX
+                               , (ResampleFilter::Enum)_inputParameters.m_mipChainFilter
+                               , _inputParameters.m_mipChainAverageSeams
+                               , _clDevices.m_active[0]
+                               );
+    }
+
+    // Apply gamma on output image and clamp it to [0.0-1.0] range in a single pass. Results packed on the GPU are clamped already.
+    ImagePixelOp outputOps[2];
+    uint8_t numOutputOps = 0;
+    outputOps[numOutputOps].m_op = PixelOp::Gamma;
+    outputOps[numOutputOps].m_value = _inputParameters.m_outputGammaPowNumerator / _inputParameters.m_outputGammaPowDenominator;
+    numOutputOps++;
+    if (TextureFormat::Unknown == encodeFormat
+    ||  encodeFormat != _image.m_format)
+    {
+        outputOps[numOutputOps].m_op = PixelOp::Clamp;
+        outputOps[numOutputOps].m_value = 0.0f;
+        numOutputOps++;
+    }
+    const ImageEncodeSettings encodeSettings = encodeSettingsFromInputParameters(_inputParameters);
+    imageApplyPixelOps(_image, (TextureFormat::Enum)_image.m_format, outputOps, numOutputOps, &encodeSettings);
+
+    // Image can still reference mapped input file if it was not filtered. Detach it, outputs may overwrite the input file.
+    if (_image.m_mapped)
+    {
+        Image tmp;
+        imageCopy(tmp, _image);
+        imageMove(_image, tmp);
+    }
+
+    if (useCache)
+    {
+        filterCacheStore(_image, _inputParameters.m_filterCacheDir, cacheKey);
+    }
+
+    return JobState::Ready;
+}
+
+/// Saves all outputs of filtered image.
+void cmftSaveStage(const Image& _image, const InputParameters& _inputParameters)
+{
+    CMFT_PROFILE_ZONE("cmftSaveStage");
+
+    const ImageEncodeSettings encodeSettings = encodeSettingsFromInputParameters(_inputParameters);
+
+    SaveOutputArgs saveOutputArgs;
+    saveOutputArgs.m_inputParameters = &_inputParameters;
+    for (uint8_t ii = 0; ii < MAX_OUTPUT_NUM; ++ii)
+    {
+        saveOutputArgs.m_images[ii] = &_image;
+    }
+
+    // Outputs of the same texture format share a single conversion, when their layouts only move texels.
+    // Each output is otherwise converted on its own while saving. Output gamma is already applied, format is the only key.
+    Image converted[MAX_OUTPUT_NUM];
+    const bool plainImage = (FilterType::BrdfLut    == _inputParameters.m_filterType
+                          || FilterType::BrdfLutGgx == _inputParameters.m_filterType);
+    if (!plainImage && imageIsCubemap(_image))
+    {
+        uint8_t numShared = 0;
+        for (uint8_t ii = 0; ii < _inputParameters.m_outputFilesNum; ++ii)
+        {
+            const OutputFile& output = _inputParameters.m_outputFiles[ii];
+            const TextureFormat::Enum tf = (TextureFormat::Enum)output.m_textureFormat;
+            if (TextureFormat::Unknown == tf
+            ||  _image.m_format == tf
+            ||  0 != getImageDataInfo(tf).m_blockBytes
+            ||  !outputTypeMovesTexels((OutputType::Enum)output.m_outputType))
+            {
+                continue;
+            }
+
+            for (uint8_t jj = 0; jj < ii; ++jj)
+            {
+                const OutputFile& first = _inputParameters.m_outputFiles[jj];
+                if (first.m_textureFormat == output.m_textureFormat
+                &&  outputTypeMovesTexels((OutputType::Enum)first.m_outputType))
+                {
+                    if (NULL == converted[jj].m_data)
+                    {
+                        imageConvert(converted[jj], tf, _image, &encodeSettings);
+                        saveOutputArgs.m_images[jj] = &converted[jj];
+                    }
+                    saveOutputArgs.m_images[ii] = &converted[jj];
+                    numShared++;
+                    break;
+                }
+            }
+        }
+
+        if (0 != numShared)
+        {
+            INFO("%u output%s reuse%s the conversion of an earlier output.", numShared, numShared==1?"":"s", numShared==1?"s":"");
+        }
+    }
+
+    // Outputs only read the image, their layout conversion and encoding run concurrently on the job system.
+    getJobSystem()->run(saveOutput, (void*)&saveOutputArgs, _inputParameters.m_outputFilesNum);
+
+    for (uint8_t ii = 0; ii < MAX_OUTPUT_NUM; ++ii)
+    {
+        imageUnload(converted[ii]);
+    }
+}
+
+/// Loads OpenCL lib and creates contexts if any of the OpenCL filters is requested.
+/// One context per device, 'numDevices' devices starting at 'deviceIndex', or the fastest 'numDevices' devices with 'clVendor auto'.
+/// Devices found more than once are skipped.
+void cmftClInit(ClDevices& _clDevices, const InputParameters& _inputParameters)
+{
+    if (_inputParameters.m_useOpenCL
+    && (FilterType::Radiance   == _inputParameters.m_filterType
+    ||  FilterType::Irradiance == _inputParameters.m_filterType
+    ||  FilterType::ShCoeffs   == _inputParameters.m_filterType))
+    {
+        // Dynamically load opencl lib.
+        if (bx::clLoad())
+        {
+            _clDevices.m_clLoaded = true;
+
+            const uint32_t numDevices = max(UINT32_C(1), min(_inputParameters.m_numDevices, uint32_t(CMFT_CL_MAX_CONTEXTS)));
+
+            // Fastest devices first.
+            ClDeviceScore ranked[CMFT_CL_MAX_CONTEXTS];
+            uint8_t numRanked = 0;
+            const bool autoSelect = (CL_VENDOR_AUTO == _inputParameters.m_clVendor);
+            if (autoSelect)
+            {
+                numRanked = clRankDevices(ranked, uint8_t(numDevices), imageRadianceFilterCalibrate, _inputParameters.m_clBinaryCacheDir);
+                if (0 == numRanked)
+                {
+                    WARN("No OpenCL device passed calibration.");
+                }
+            }
+
+            for (uint32_t ii = 0; ii < numDevices; ++ii)
+            {
+                ClContext& clContext = _clDevices.m_contexts[ii];
+                const bool initialized = autoSelect
+                                       ? (ii < numRanked && clContext.init(ranked[ii].m_platform, ranked[ii].m_device))
+                                       : clContext.init((uint8_t)_inputParameters.m_clVendor
+                                                      , _inputParameters.m_deviceType
+                                                      , _inputParameters.m_deviceIndex + ii
+                                                      )
+                                       ;
+                if (!initialized)
+                {
+                    continue;
+                }
+
+                // Context initialization falls back to the first device if the requested one is not present.
+                bool duplicate = false;
+                for (uint8_t jj = 0; jj < _clDevices.m_numActive; ++jj)
+                {
+                    duplicate |= (_clDevices.m_active[jj]->m_device       == clContext.m_device)
+                              |  (_clDevices.m_active[jj]->m_parentDevice == clContext.m_device);
+                }
+
+                if (duplicate)
+                {
+                    clContext.destroy();
+                    continue;
+                }
+
+                if (0 != _inputParameters.m_clCpuCores
+                &&  0 != (clContext.m_deviceType&CL_DEVICE_TYPE_CPU)
+                &&  clContext.partition(_inputParameters.m_clCpuCores))
+                {
+                    INFO("OpenCL device %s restricted to %u cores.", clContext.m_deviceName, _inputParameters.m_clCpuCores);
+                }
+
+                clContext.setBinaryCacheDir(_inputParameters.m_clBinaryCacheDir);
+                _clDevices.m_active[_clDevices.m_numActive++] = &clContext;
+
+                if (autoSelect)
+                {
+                    INFO("OpenCL device %s chosen by calibration, score %.2f.", clContext.m_deviceName, ranked[ii].m_score);
+                }
+            }
+
+            if (1 < numDevices && numDevices != _clDevices.m_numActive)
+            {
+                WARN("Only %u of %u requested OpenCL devices are available.", _clDevices.m_numActive, numDevices);
+            }
+
+            // Programs are built now, the filter would build them first thing.
+            for (uint8_t ii = 0; ii < _clDevices.m_numActive; ++ii)
+            {
+                filterPrecompile(_clDevices.m_active[ii]
+                               , FilterType::Radiance == _inputParameters.m_filterType
+                               , FilterType::Radiance != _inputParameters.m_filterType
+                               );
+            }
+        }
+    }
+}
+
+int32_t cmftClInitThread(void* _userData)
+{
+    ClDevices& clDevices = *(ClDevices*)_userData;
+    cmftClInit(clDevices, *clDevices.m_initParameters);
+    return EXIT_SUCCESS;
+}
+
+/// Starts cmftClInit() on a thread of its own, so that loading OpenCL, creating contexts and building programs overlap with
+/// loading the input. _inputParameters have to stay valid until cmftClInitEnd().
+void cmftClInitBegin(ClDevices& _clDevices, const InputParameters& _inputParameters)
+{
+    if (_inputParameters.m_useOpenCL
+    && (FilterType::Radiance   == _inputParameters.m_filterType
+    ||  FilterType::Irradiance == _inputParameters.m_filterType
+    ||  FilterType::ShCoeffs   == _inputParameters.m_filterType))
+    {
+        _clDevices.m_initParameters = &_inputParameters;
+        _clDevices.m_initThread.init(cmftClInitThread, &_clDevices);
+    }
+}
+
+void cmftClShutdown(ClDevices& _clDevices)
+{
+    cmftClInitEnd(_clDevices);
+
+    for (uint8_t ii = 0; ii < CMFT_CL_MAX_CONTEXTS; ++ii)
+    {
+        _clDevices.m_contexts[ii].destroy();
+    }
+    _clDevices.m_numActive = 0;
+
+    // Unload opencl lib.
+    if (_clDevices.m_clLoaded)
+    {
+        bx::clUnload();
+        _clDevices.m_clLoaded = false;
+    }
+}
+
+/// Jobs of a batch run through three stages. Each job uses one of the slots until it is saved.
+#define CMFT_BATCH_NUM_SLOTS 3
+#define CMFT_BATCH_MAX_ARGS  256
+
+struct BatchJob
+{
+    InputParameters m_inputParameters;
+    Image m_image;
+    JobState::Enum m_state;
+};
+
+struct BatchLoadArgs
+{
+    BatchJob* m_job;
+    const char* m_line;
+    uint32_t m_jobIdx;
+    uint32_t m_numJobs;
+    int m_baseArgc;
+    char const* const* m_baseArgv;
+};
+
+/// Parses job options from _line, options given on the command line (_baseArgv) are used for everything _line does not specify.
+void inputParametersFromJobLine(InputParameters& _inputParameters, const char* _line, int _baseArgc, char const* const* _baseArgv)
+{
+    // Job options go first, they take precedence over the ones given on the command line.
+    const uint32_t maxJobArgs = CMFT_BATCH_MAX_ARGS - _baseArgc;
+    char* data = (char*)malloc(strlen(_line)+2);
+    MALLOC_CHECK(data);
+    char* jobArgv[CMFT_BATCH_MAX_ARGS];
+    uint32_t dataSize;
+    int jobArgc;
+    tokenizeCommandLine(_line, data, dataSize, jobArgc, jobArgv, int(maxJobArgs), '\0');
+
+    const char* argv[CMFT_BATCH_MAX_ARGS+1];
+    int argc = 0;
+    argv[argc++] = _baseArgv[0];
+    for (int ii = 0; ii < jobArgc; ++ii)
+    {
+        argv[argc++] = jobArgv[ii];
+    }
+    for (int ii = 1; ii < _baseArgc; ++ii)
+    {
+        argv[argc++] = _baseArgv[ii];
+    }
+
+    bx::CommandLine cmdLine(argc, argv);
+    inputParametersDefault(_inputParameters);
+    inputParametersFromCommandLine(_inputParameters, cmdLine);
+
+    free(data);
+}
+
+/// Copies command line arguments to _baseArgv, except for _option and its value. Returns number of arguments copied.
+int baseArgsWithout(const char* _baseArgv[CMFT_BATCH_MAX_ARGS], int _argc, char const* const* _argv, const char* _option)
+{
+    int baseArgc = 0;
+    for (int ii = 0; ii < _argc && baseArgc < CMFT_BATCH_MAX_ARGS/2; ++ii)
+    {
+        if (0 == strcmp(_argv[ii], _option))
+        {
+            ++ii;
+            continue;
+        }
+        _baseArgv[baseArgc++] = _argv[ii];
+    }
+
+    return baseArgc;
+}
+
+void batchLoadTask(void* _userData, uint32_t /*_taskIdx*/)
+{
+    const BatchLoadArgs* args = (const BatchLoadArgs*)_userData;
+    BatchJob& job = *args->m_job;
+
+    inputParametersFromJobLine(job.m_inputParameters, args->m_line, args->m_baseArgc, args->m_baseArgv);
+
+    INFO("Batch job %u/%u - %s", args->m_jobIdx+1, args->m_numJobs, args->m_line);
+    job.m_state = cmftLoadStage(job.m_image, job.m_inputParameters);
+}
+
+void batchSaveTask(void* _userData, uint32_t /*_taskIdx*/)
+{
+    const BatchJob* job = (const BatchJob*)_userData;
+    cmftSaveStage(job->m_image, job->m_inputParameters);
+}
+
+/// Runs every non-empty line of _batchFilePath, except for '#' comments, as a separate job with the options of that line.
+/// Job N+1 is loaded and job N-1 is saved on the thread pool while job N is filtered on this thread.
+/// OpenCL context is created once from _inputParameters and shared by all jobs.
+int cmftBatch(const char* _batchFilePath, const InputParameters& _inputParameters, int _argc, char const* const* _argv)
+{
+    FILE* fp = fopen(_batchFilePath, "rb");
+    if (NULL == fp)
+    {
+        WARN("Could not open batch file %s.", _batchFilePath);
+        return EXIT_FAILURE;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    const long fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char* text = (char*)allocScratch(fileSize+1, AllocTag::IoBuffer);
+    MALLOC_CHECK(text);
+    const size_t read = fread(text, 1, fileSize, fp);
+    text[read] = '\0';
+    fclose(fp);
+
+    // Split lines in place.
+    uint32_t numJobs = 0;
+    uint32_t maxJobs = 0;
+    const char** lines = NULL;
+    for (char* line = text; NULL != line;)
+    {
+        char* next = strpbrk(line, "\r\n");
+        if (NULL != next)
+        {
+            *next++ = '\0';
+        }
+
+        while (' ' == *line || '\t' == *line)
+        {
+            ++line;
+        }
+
+        if ('\0' != *line && '#' != *line)
+        {
+            if (numJobs == maxJobs)
+            {
+                maxJobs = max(UINT32_C(64), maxJobs*2);
+                lines = (const char**)realloc(lines, maxJobs*sizeof(const char*));
+                MALLOC_CHECK(lines);
+            }
+            lines[numJobs++] = line;
+        }
+
+        line = next;
+    }
+
+    // Command line options without --batch are passed on to every job.
+    const char* baseArgv[CMFT_BATCH_MAX_ARGS];
+    const int baseArgc = baseArgsWithout(baseArgv, _argc, _argv, "--batch");
+
+    // Devices are set up while the first job is loaded.
+    ClDevices clDevices;
+    cmftClInitBegin(clDevices, _inputParameters);
+    sourceCacheInit(_inputParameters.m_sourceCacheSize);
+
+    JobSystem& jobSystem = *getJobSystem();
+
+    BatchJob jobs[CMFT_BATCH_NUM_SLOTS];
+    BatchLoadArgs loadArgs;
+    loadArgs.m_numJobs = numJobs;
+    loadArgs.m_baseArgc = baseArgc;
+    loadArgs.m_baseArgv = baseArgv;
+
+    uint32_t numFailed = 0;
+    for (uint32_t ii = 0; ii < numJobs+2; ++ii)
+    {
+        JobGroup group;
+
+        // Load job ii.
+        if (ii < numJobs)
+        {
+            loadArgs.m_job = &jobs[ii%CMFT_BATCH_NUM_SLOTS];
+            loadArgs.m_line = lines[ii];
+            loadArgs.m_jobIdx = ii;
+            jobSystem.dispatch(group, batchLoadTask, (void*)&loadArgs, 1);
+        }
+
+        // Save job ii-2.
+        BatchJob* saveJob = (2 <= ii) ? &jobs[(ii-2)%CMFT_BATCH_NUM_SLOTS] : NULL;
+        if (NULL != saveJob && JobState::Ready == saveJob->m_state)
+        {
+            jobSystem.dispatch(group, batchSaveTask, (void*)saveJob, 1);
+        }
+
+        // Filter job ii-1. OpenCL contexts are only used from this thread.
+        if (1 <= ii && ii <= numJobs)
+        {
+            cmftClInitEnd(clDevices);
+
+            BatchJob& job = jobs[(ii-1)%CMFT_BATCH_NUM_SLOTS];
+            if (JobState::Ready == job.m_state)
+            {
+                job.m_state = cmftFilterStage(job.m_image, job.m_inputParameters, clDevices);
+            }
+        }
+
+        jobSystem.wait(group);
+
+        // Job ii-2 is complete, its slot is free for job ii+1.
+        if (NULL != saveJob)
+        {
+            numFailed += (JobState::Failed == saveJob->m_state);
+            imageUnload(saveJob->m_image);
+        }
+    }
+
+    sourceCacheShutdown();
+    cmftClShutdown(clDevices);
+
+    free(lines);
+    freeScratch(text);
+
+    if (0 != numFailed)
+    {
+        WARN("Batch - %u of %u jobs failed.", numFailed, numJobs);
+        return EXIT_FAILURE;
+    }
+
+    INFO("Done.");
+    return EXIT_SUCCESS;
+}
+
+/// Set with --memoryStats.
+static TrackingAllocator* s_memoryTracker = NULL;
+
+/// Longest job line accepted by the server.
+#define CMFT_SERVER_MAX_LINE (64<<10)
+
+/// Longest queue of jobs waiting for their turn on a server socket, together with the running one.
+#define CMFT_SERVER_MAX_JOBS 64
+
+/// Time a connection gets to send its job line. Idle clients must not hold up other connections.
+#define CMFT_SERVER_READ_TIMEOUT_MS 5000
+
+/// Failed accepts in a row after which the server stops taking jobs. Waits between retries double up to a second.
+#define CMFT_SERVER_MAX_ACCEPT_FAILURES 16
+
+/// Server job, queued until it is the most urgent one. Preempted job keeps its loaded source and finished faces for the next run.
+struct ServerJob
+{
+    ServerJob()
+        : m_inputParameters(NULL)
+        , m_line(NULL)
+        , m_arrival(0)
+        , m_deadline(INT64_MAX)
+        , m_startTime(0)
+        , m_order(0)
+        , m_client(-1)
+        , m_loaded(false)
+    {
+    }
+
+    InputParameters* m_inputParameters;
+    char* m_line;
+    Image m_image;
+    JobPreemption m_preemption;
+    int64_t m_arrival;
+    int64_t m_deadline;  //!< In bx::getHPCounter() ticks, INT64_MAX without a deadline.
+    int64_t m_startTime; //!< First run of the job.
+    uint64_t m_order;
+    int m_client;        //!< Connection waiting for the exit code, -1 for jobs from stdin.
+    bool m_loaded;
+};
+
+/// Job options of the line override ones given on the command line.
+ServerJob* serverJobCreate(const char* _line, int _baseArgc, char const* const* _baseArgv, int _client)
+{
+    ServerJob* job = (ServerJob*)malloc(sizeof(ServerJob));
+    MALLOC_CHECK(job);
+    *job = ServerJob();
+
+    job->m_inputParameters = (InputParameters*)malloc(sizeof(InputParameters));
+    MALLOC_CHECK(job->m_inputParameters);
+    inputParametersFromJobLine(*job->m_inputParameters, _line, _baseArgc, _baseArgv);
+
+    const size_t lineSize = strlen(_line)+1;
+    job->m_line = (char*)malloc(lineSize);
+    MALLOC_CHECK(job->m_line);
+    memcpy(job->m_line, _line, lineSize);
+
+    job->m_arrival = bx::getHPCounter();
+    if (0.0f < job->m_inputParameters->m_deadline)
+    {
+        job->m_deadline = job->m_arrival + int64_t(double(job->m_inputParameters->m_deadline)*double(bx::getHPFrequency()));
+    }
+    job->m_client = _client;
+
+    return job;
+}
+
+void serverJobDestroy(ServerJob* _job)
+{
+    checkpointEnd(_job->m_preemption.m_faces, true);
+    imageUnload(_job->m_image);
+    free(_job->m_inputParameters);
+    free(_job->m_line);
+    free(_job);
+}
+
+/// Job of higher priority goes first, then the one with the earlier deadline, then the one that came first.
+bool serverJobOutranks(const ServerJob& _a, const ServerJob& _b)
+{
+    if (_a.m_inputParameters->m_priority != _b.m_inputParameters->m_priority)
+    {
+        return _a.m_inputParameters->m_priority > _b.m_inputParameters->m_priority;
+    }
+
+    if (_a.m_deadline != _b.m_deadline)
+    {
+        return _a.m_deadline < _b.m_deadline;
+    }
+
+    return _a.m_order < _b.m_order;
+}
+
+/// Runs a job in server mode, or the rest of a preempted one. Background jobs filter with their share of CPU cores.
+JobState::Enum serverRunJob(ServerJob& _job, const ClDevices& _clDevices, uint32_t _backgroundShare)
+{
+    InputParameters& inputParameters = *_job.m_inputParameters;
+
+    INFO("Server job - %s%s", _job.m_loaded ? "Resuming " : "", _job.m_line);
+    messageSinkFlush();
+
+    const int64_t startTime = bx::getHPCounter();
+    if (0 == _job.m_startTime)
+    {
+        _job.m_startTime = startTime;
+    }
+    if (NULL != s_memoryTracker)
+    {
+        s_memoryTracker->resetStats();
+    }
+
+    if (JobPriority::Background == inputParameters.m_priority
+    &&  100 > _backgroundShare)
+    {
+        const uint32_t numThreads = max(1u, uint32_t(getDefaultNumThreads())*_backgroundShare/100);
+        inputParameters.m_numCpuProcessingThreads = min(inputParameters.m_numCpuProcessingThreads, numThreads);
+    }
+
+    JobState::Enum state = JobState::Ready;
+    if (!_job.m_loaded)
+    {
+        state = cmftLoadStage(_job.m_image, inputParameters, _clDevices.m_active[0]);
+        _job.m_loaded = true;
+    }
+    if (JobState::Ready == state)
+    {
+        state = cmftFilterStage(_job.m_image, inputParameters, _clDevices, &_job.m_preemption);
+    }
+    if (JobState::Ready == state)
+    {
+        cmftSaveStage(_job.m_image, inputParameters);
+    }
+
+    const double toSec = 1.0/double(bx::getHPFrequency());
+    const int64_t now = bx::getHPCounter();
+    if (JobState::Preempted == state)
+    {
+        uint32_t numFaces = 0;
+        for (uint8_t mip = 0; mip < MAX_MIP_NUM; ++mip)
+        {
+            for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+            {
+                numFaces += (NULL != _job.m_preemption.m_faces.m_faces[mip][face]);
+            }
+        }
+
+        // Checkpoint file holds the finished faces instead.
+        inputParameters.m_resume |= ('\0' != inputParameters.m_checkpointFile[0]);
+
+        INFO("Server job - Preempted after %.3f seconds, %u finished faces are kept.", double(now-startTime)*toSec, numFaces);
+        messageSinkFlush();
+        return state;
+    }
+
+    imageUnload(_job.m_image);
+    INFO("Server job - %s in %.3f seconds.", JobState::Failed == state ? "Failed" : "Done", double(now-_job.m_startTime)*toSec);
+    if (now > _job.m_deadline)
+    {
+        WARN("Server job - Missed its deadline by %.3f seconds.", double(now-_job.m_deadline)*toSec);
+    }
+    if (NULL != s_memoryTracker)
+    {
+        s_memoryTracker->printStats();
+    }
+    messageSinkFlush();
+
+    return state;
+}
+
+/// Strips trailing new line characters. Returns true if the line asks the server to quit.
+bool serverJobLine(char* _line)
+{
+    for (size_t len = strlen(_line); 0 < len && ('\n' == _line[len-1] || '\r' == _line[len-1]); --len)
+    {
+        _line[len-1] = '\0';
+    }
+
+    return (0 == strcmp(_line, "quit"));
+}
+
+/// Sends exit code of the job to the connection and closes it.
+void serverReply(int _client, int _exitCode)
+{
+#if BX_PLATFORM_POSIX
+    char reply[16];
+    const int replyLen = sprintf(reply, "%d\n", _exitCode);
+#   if defined(MSG_NOSIGNAL)
+    // Client that went away must not stop the server with SIGPIPE.
+    CMFT_UNUSED const ssize_t sent = send(_client, reply, replyLen, MSG_NOSIGNAL);
+#   else
+    CMFT_UNUSED const ssize_t sent = send(_client, reply, replyLen, 0);
+#   endif // defined(MSG_NOSIGNAL)
+    close(_client);
+#else
+    BX_UNUSED(_client, _exitCode);
+#endif // BX_PLATFORM_POSIX
+}
 
-    bool imageLoaded = false;
+/// Jobs that came in on the server socket, waiting for the runner thread.
+struct ServerQueue
+{
+    ServerQueue()
+        : m_running(NULL)
+        , m_numJobs(0)
+        , m_order(0)
+        , m_quit(false)
+    {
+    }
 
-    // Load image.
-    if (0 != strcmp("", inputParameters.m_inputFilePath))
+    bx::Mutex m_mutex;
+    bx::Semaphore m_sem; //!< Posted for every queued job and on quit.
+    ServerJob* m_jobs[CMFT_SERVER_MAX_JOBS];
+    ServerJob* m_running;
+    uint32_t m_numJobs;
+    uint64_t m_order;
+    bool m_quit;
+};
+
+/// Queues a job, or a preempted one again. Running job that the new one outranks by priority is preempted. Returns false if the queue is full.
+bool serverQueuePush(ServerQueue& _queue, ServerJob* _job)
+{
+    bx::MutexScope lock(_queue.m_mutex);
+
+    const bool again = (_job == _queue.m_running);
+    if (again)
+    {
+        _queue.m_running = NULL;
+    }
+    else if (CMFT_SERVER_MAX_JOBS <= _queue.m_numJobs + uint32_t(NULL != _queue.m_running))
     {
-       imageLoaded = imageLoad(image, inputParameters.m_inputFilePath, TextureFormat::RGBA32F);
+        return false;
     }
     else
     {
-        if (0 != strcmp("", inputParameters.m_inputPosXFace)
-        &&  0 != strcmp("", inputParameters.m_inputNegXFace)
-        &&  0 != strcmp("", inputParameters.m_inputPosYFace)
-        &&  0 != strcmp("", inputParameters.m_inputNegYFace)
-        &&  0 != strcmp("", inputParameters.m_inputPosZFace)
-        &&  0 != strcmp("", inputParameters.m_inputNegZFace))
-        {
-            imageLoaded = imageLoad(imageFaceList[0], inputParameters.m_inputPosXFace, TextureFormat::RGBA32F)
-                       && imageLoad(imageFaceList[1], inputParameters.m_inputNegXFace, TextureFormat::RGBA32F)
-                       && imageLoad(imageFaceList[2], inputParameters.m_inputPosYFace, TextureFormat::RGBA32F)
-                       && imageLoad(imageFaceList[3], inputParameters.m_inputNegYFace, TextureFormat::RGBA32F)
-                       && imageLoad(imageFaceList[4], inputParameters.m_inputPosZFace, TextureFormat::RGBA32F)
-                       && imageLoad(imageFaceList[5], inputParameters.m_inputNegZFace, TextureFormat::RGBA32F)
-                       ;
+        _job->m_order = _queue.m_order++;
+    }
+
+    ServerJob* running = _queue.m_running;
+    if (NULL != running
+    &&  _job->m_inputParameters->m_priority > running->m_inputParameters->m_priority
+    &&  !running->m_preemption.m_progress.m_cancel)
+    {
+        INFO("Server - Preempting running job for a job of higher priority.");
+        running->m_preemption.m_progress.m_cancel = true;
+    }
+
+    _queue.m_jobs[_queue.m_numJobs++] = _job;
+    _queue.m_sem.post();
+
+    return true;
+}
+
+/// Waits for the most urgent job and marks it as running. Returns NULL once the server quits and no jobs are left.
+ServerJob* serverQueuePop(ServerQueue& _queue)
+{
+    for (;;)
+    {
+        {
+            bx::MutexScope lock(_queue.m_mutex);
 
-            if (imageLoaded)
+            if (0 != _queue.m_numJobs)
             {
-                INFO("Assembling cubemap from image list.");
-                imageCubemapFromFaceList(image, imageFaceList);
+                uint32_t best = 0;
+                for (uint32_t ii = 1; ii < _queue.m_numJobs; ++ii)
+                {
+                    if (serverJobOutranks(*_queue.m_jobs[ii], *_queue.m_jobs[best]))
+                    {
+                        best = ii;
+                    }
+                }
+
+                ServerJob* job = _queue.m_jobs[best];
+                _queue.m_jobs[best] = _queue.m_jobs[--_queue.m_numJobs];
+
+                job->m_preemption.m_progress.m_cancel = false;
+                _queue.m_running = job;
+                return job;
             }
 
-            for (uint8_t ii = 0; ii < 6; ++ii)
+            if (_queue.m_quit)
             {
-                imageUnload(imageFaceList[ii]);
+                return NULL;
             }
         }
-    }
 
-    if(!imageLoaded)
-    {
-        WARN("Invalid input!\n");
-        return EXIT_FAILURE;
+        _queue.m_sem.wait();
     }
+}
 
-    // Assemble cubemap.
-    if (!imageIsCubemap(image))
+void serverQueueDone(ServerQueue& _queue)
+{
+    bx::MutexScope lock(_queue.m_mutex);
+    _queue.m_running = NULL;
+}
+
+struct ServerAcceptArgs
+{
+    ServerQueue* m_queue;
+    char* m_line;
+    const char* const* m_baseArgv;
+    int m_baseArgc;
+    int m_fd;
+};
+
+#if BX_PLATFORM_POSIX
+/// Reads job lines from server socket connections and queues them, until a "quit" line.
+int32_t serverAcceptThread(void* _userData)
+{
+    const ServerAcceptArgs& args = *(const ServerAcceptArgs*)_userData;
+    ServerQueue& queue = *args.m_queue;
+    char* line = args.m_line;
+
+    uint32_t acceptFailures = 0;
+    for (bool quit = false; !quit;)
     {
-        if(imageIsCubeCross(image))
+        const int client = accept(args.m_fd, NULL, NULL);
+        if (0 > client)
         {
-            INFO("Converting cube cross to cubemap.");
-            imageCubemapFromCross(image);
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            // Out of descriptors or similar, back off instead of spinning.
+            if (CMFT_SERVER_MAX_ACCEPT_FAILURES <= ++acceptFailures)
+            {
+                WARN("Server - Accepting connections keeps failing (%s), no more jobs are taken.", strerror(errno));
+                quit = true;
+                continue;
+            }
+
+            bx::sleep(min(UINT32_C(10)<<acceptFailures, UINT32_C(1000)));
+            continue;
         }
-        else if (imageIsLatLong(image))
+        acceptFailures = 0;
+
+        struct timeval timeout;
+        timeout.tv_sec  = CMFT_SERVER_READ_TIMEOUT_MS/1000;
+        timeout.tv_usec = (CMFT_SERVER_READ_TIMEOUT_MS%1000)*1000;
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // Read until new line or until the client stops sending.
+        size_t size = 0;
+        bool timedOut = false;
+        while (size < CMFT_SERVER_MAX_LINE-1)
         {
-            INFO("Converting latlong image to cubemap.");
-            imageCubemapFromLatLong(image);
+            const ssize_t num = read(client, &line[size], CMFT_SERVER_MAX_LINE-1-size);
+            if (0 > num && EINTR == errno)
+            {
+                continue;
+            }
+
+            if (0 >= num)
+            {
+                timedOut = (0 > num && (EAGAIN == errno || EWOULDBLOCK == errno));
+                break;
+            }
+
+            size += size_t(num);
+            if (NULL != memchr(&line[size-num], '\n', num))
+            {
+                break;
+            }
         }
-        else if (imageIsHStrip(image))
+        line[size] = '\0';
+
+        if (timedOut)
         {
-            INFO("Converting hstrip image to cubemap.");
-            imageCubemapFromHStrip(image);
+            WARN("Server - No job line within %u ms, connection is closed.", CMFT_SERVER_READ_TIMEOUT_MS);
+            serverReply(client, EXIT_FAILURE);
+            continue;
         }
-        else
+
+        char* end = strchr(line, '\n');
+        if (NULL != end)
         {
-            INFO("Image is not cubemap(6 faces), cubecross(ratio 3:4 or 4:3), latlong(ratio 2:1), hstrip(ratio 6:1).");
+            end[1] = '\0';
         }
-    }
 
-    if (!imageIsCubemap(image))
-    {
-        INFO("Exiting...");
-        return EXIT_FAILURE;
-    }
+        quit = serverJobLine(line);
+        if (quit)
+        {
+            serverReply(client, EXIT_SUCCESS);
+            continue;
+        }
 
-    // Resize if requested.
-    if (0 != inputParameters.m_srcFaceSize && image.m_width != inputParameters.m_srcFaceSize)
-    {
-        INFO("Resizing source image from %ux%u to %ux%u."
-            , image.m_width
-            , image.m_height
-            , inputParameters.m_srcFaceSize
-            , inputParameters.m_srcFaceSize
-            );
-        imageResize(image, inputParameters.m_srcFaceSize, inputParameters.m_srcFaceSize);
+        ServerJob* job = serverJobCreate(line, args.m_baseArgc, args.m_baseArgv, client);
+        if (!serverQueuePush(queue, job))
+        {
+            WARN("Server - Job queue is full, job is rejected.");
+            serverJobDestroy(job);
+            serverReply(client, EXIT_FAILURE);
+        }
     }
 
-    // Transform cubemap if requested.
-    imageTransform(image
-                 , IMAGE_FACE_POSITIVEX | inputParameters.m_imageOpPosX
-                 , IMAGE_FACE_NEGATIVEX | inputParameters.m_imageOpNegX
-                 , IMAGE_FACE_POSITIVEY | inputParameters.m_imageOpPosY
-                 , IMAGE_FACE_NEGATIVEY | inputParameters.m_imageOpNegY
-                 , IMAGE_FACE_POSITIVEZ | inputParameters.m_imageOpPosZ
-                 , IMAGE_FACE_NEGATIVEZ | inputParameters.m_imageOpNegZ
-                 );
+    bx::MutexScope lock(queue.m_mutex);
+    queue.m_quit = true;
+    queue.m_sem.post();
 
-    // Apply gamma on input image.
-    imageApplyGamma(image, inputParameters.m_inputGammaPowNumerator / inputParameters.m_inputGammaPowDenominator);
+    return EXIT_SUCCESS;
+}
+#endif // BX_PLATFORM_POSIX
+
+/// Keeps OpenCL context, compiled kernels, worker threads and filter caches alive and runs jobs as they come in.
+/// Every job is a single line of options, the same as on the command line, which override options given on the command line.
+/// With _address "stdin" jobs are read from stdin and run in order, "CMFT result: <exit code>" is written to stdout after each of them.
+/// Otherwise _address is the path of a local (Unix domain) socket. Each connection sends one job line and receives the exit code.
+/// Socket jobs are queued and run by priority and deadline, a job of higher priority preempts the running one.
+/// A "quit" line stops the server, jobs queued before it are still run.
+int cmftServer(const char* _address, const InputParameters& _inputParameters, int _argc, char const* const* _argv)
+{
+    const char* baseArgv[CMFT_BATCH_MAX_ARGS];
+    const int baseArgc = baseArgsWithout(baseArgv, _argc, _argv, "--server");
 
-    // Filter cubemap.
-    if (FilterType::Radiance == inputParameters.m_filterType)
+    char* line = (char*)allocScratch(CMFT_SERVER_MAX_LINE, AllocTag::IoBuffer);
+    MALLOC_CHECK(line);
+
+    ClDevices clDevices;
+    cmftClInit(clDevices, _inputParameters);
+    sourceCacheInit(_inputParameters.m_sourceCacheSize);
+
+    // Warm up worker threads.
+    threadPoolGet();
+
+    const uint32_t backgroundShare = min(_inputParameters.m_backgroundShare, 100u);
+
+    int result = EXIT_SUCCESS;
+    if (0 == strcmp(_address, "stdin"))
     {
-        ClContext clContext;
+        INFO("Server - Reading jobs from stdin.");
+        messageSinkFlush();
 
-        int32_t clLoaded = 0;
-        if (inputParameters.m_useOpenCL)
+        while (NULL != fgets(line, CMFT_SERVER_MAX_LINE, stdin))
         {
-            // Dynamically load opencl lib.
-            clLoaded = bx::clLoad();
-            if (clLoaded)
+            if (serverJobLine(line))
             {
-                clContext.init((uint8_t)inputParameters.m_clVendor
-                             , inputParameters.m_deviceType
-                             , inputParameters.m_deviceIndex
-                             );
+                break;
             }
-        }
 
-        // Start filter.
-        imageRadianceFilter(image
-                          , inputParameters.m_dstFaceSize
-                          , (LightingModel::Enum)inputParameters.m_lightingModel
-                          , (bool)inputParameters.m_excludeBase
-                          , (uint8_t)inputParameters.m_mipCount
-                          , (uint8_t)inputParameters.m_glossScale
-                          , (uint8_t)inputParameters.m_glossBias
-                          , (int8_t)inputParameters.m_numCpuProcessingThreads
-                          , &clContext
-                          );
+            if ('\0' == line[0] || '#' == line[0])
+            {
+                continue;
+            }
+
+            ServerJob* job = serverJobCreate(line, baseArgc, baseArgv, -1);
+            const JobState::Enum state = serverRunJob(*job, clDevices, backgroundShare);
+            serverJobDestroy(job);
+
+            fprintf(stdout, "CMFT result: %d\n", (JobState::Failed == state) ? EXIT_FAILURE : EXIT_SUCCESS);
+            messageSinkFlush();
+        }
+    }
+    else
+    {
+#if BX_PLATFORM_POSIX
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        cmft_strncpy(addr.sun_path, _address, sizeof(addr.sun_path)-1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(_address);
+        if (0 > fd
+        ||  0 != bind(fd, (const struct sockaddr*)&addr, sizeof(addr))
+        ||  0 != listen(fd, 8))
+        {
+            WARN("Server - Could not listen on %s.", _address);
+            result = EXIT_FAILURE;
+        }
+        else
+        {
+            INFO("Server - Listening on %s.", _address);
+            messageSinkFlush();
+
+            // Connections are taken while jobs run, OpenCL contexts are only used from this thread.
+            ServerQueue queue;
+            ServerAcceptArgs acceptArgs;
+            acceptArgs.m_queue = &queue;
+            acceptArgs.m_line = line;
+            acceptArgs.m_baseArgv = baseArgv;
+            acceptArgs.m_baseArgc = baseArgc;
+            acceptArgs.m_fd = fd;
+
+            bx::Thread acceptThread;
+            acceptThread.init(serverAcceptThread, &acceptArgs);
+
+            for (ServerJob* job = serverQueuePop(queue); NULL != job; job = serverQueuePop(queue))
+            {
+                const JobState::Enum state = serverRunJob(*job, clDevices, backgroundShare);
+                if (JobState::Preempted == state)
+                {
+                    serverQueuePush(queue, job);
+                    continue;
+                }
 
+                serverQueueDone(queue);
+                serverReply(job->m_client, (JobState::Failed == state) ? EXIT_FAILURE : EXIT_SUCCESS);
+                serverJobDestroy(job);
+            }
 
-        clContext.destroy();
+            acceptThread.shutdown();
+        }
 
-        // Unload opencl lib.
-        if (clLoaded)
+        if (0 <= fd)
         {
-            bx::clUnload();
+            close(fd);
+            unlink(_address);
         }
+#else
+        WARN("Server - Local sockets are not supported on this platform, use --server stdin to read jobs from stdin.");
+        result = EXIT_FAILURE;
+#endif // BX_PLATFORM_POSIX
     }
-    else if (FilterType::Irradiance == inputParameters.m_filterType)
+
+    sourceCacheShutdown();
+    cmftClShutdown(clDevices);
+    freeScratch(line);
+
+    INFO("Server - Stopped.");
+    return result;
+}
+
+/// Prints expected taps per mip, peak memory and time of the radiance filter of _image on the processing configuration
+/// of the job, without filtering. Radiance filter parameters of the cubemap path are used for every output.
+void cmftDryRun(const Image& _image, const InputParameters& _inputParameters, const ClDevices& _clDevices)
+{
+    const FilterSettings filterSettings = filterSettingsFromInputParameters(_inputParameters);
+    if (FilterType::Radiance != _inputParameters.m_filterType)
     {
-        imageIrradianceFilterSh(image, inputParameters.m_dstFaceSize);
+        WARN("Dry run -> Only radiance filter is estimated.");
+        return;
     }
-    else if (FilterType::ShCoeffs == inputParameters.m_filterType)
+
+    FilterProfile profile;
+    if (!filterProfileCalibrate(profile, (int16_t)_inputParameters.m_numCpuProcessingThreads, _clDevices.m_active, _clDevices.m_numActive))
     {
-        double shCoeffs[SH_COEFF_NUM][3];
-        imageShCoeffs(shCoeffs, image);
+        WARN("Dry run -> Calibration failed, no processing devices are selected. Time is not estimated.");
+    }
 
-        for (uint32_t ii = 0; ii < inputParameters.m_outputFilesNum; ++ii)
+    RadianceFilterEstimate estimate;
+    imageRadianceFilterEstimate(estimate
+                              , _image.m_width
+                              , _image.m_format
+                              , _inputParameters.m_dstFaceSize
+                              , (LightingModel::Enum)_inputParameters.m_lightingModel
+                              , (bool)_inputParameters.m_excludeBase
+                              , (uint8_t)_inputParameters.m_mipCount
+                              , (uint8_t)_inputParameters.m_glossScale
+                              , (uint8_t)_inputParameters.m_glossBias
+                              , _inputParameters.m_sourcePyramid
+                              , _inputParameters.m_halfPrecision
+                              , &profile
+                              , &filterSettings
+                              );
+
+    INFO("Dry run -> %ux%u source, %u mips.", _image.m_width, _image.m_width, estimate.m_mipCount);
+    for (uint8_t mip = 0; mip < estimate.m_mipCount; ++mip)
+    {
+        const uint32_t faceSize = estimate.m_mipFaceSize[mip];
+        if (estimate.m_mipSh[mip])
         {
-            const char* fileName = inputParameters.m_outputFiles[ii].m_fileName;
-            INFO("Saving spherical harmonics coefficients to %s.c", fileName);
-            outputShCoeffs(fileName, shCoeffs);
+            INFO("Dry run -> Mip %u, %ux%u: %.1f million taps, convolved in SH domain.", mip, faceSize, faceSize, double(estimate.m_mipTaps[mip])*1e-6);
+        }
+        else if (0 == estimate.m_mipTaps[mip])
+        {
+            INFO("Dry run -> Mip %u, %ux%u: copied.", mip, faceSize, faceSize);
+        }
+        else
+        {
+            INFO("Dry run -> Mip %u, %ux%u: %.1f million taps from %ux%u source."
+                , mip, faceSize, faceSize
+                , double(estimate.m_mipTaps[mip])*1e-6
+                , estimate.m_mipSrcFaceSize[mip], estimate.m_mipSrcFaceSize[mip]
+                );
         }
+    }
+
+    if (0 != estimate.m_shProjectionTaps)
+    {
+        INFO("Dry run -> SH projection: %.1f million taps.", double(estimate.m_shProjectionTaps)*1e-6);
+    }
+
+    INFO("Dry run -> %.1f million taps, peak memory %.1f MB."
+        , double(estimate.m_numTaps)*1e-6
+        , double(estimate.m_peakBytes)/(1024.0*1024.0)
+        );
+
+    if (0.0 != estimate.m_seconds)
+    {
+        INFO("Dry run -> Estimated filter time %.2f seconds on %u CPU threads (%.1f million taps per second each) and %u OpenCL devices (%.1f million taps per second)."
+            , estimate.m_seconds
+            , profile.m_numCpuThreads
+            , profile.m_cpuTapsPerSecond*1e-6
+            , _clDevices.m_numActive
+            , profile.m_clTapsPerSecond*1e-6
+            );
+    }
+}
+
+int cmftMain(int _argc, char const* const* _argv)
+{
+    bx::CommandLine cmdLine(_argc, _argv);
 
-        INFO("Done.");
+    // Action for --help.
+    if (1 == _argc || cmdLine.hasArg('h', "help"))
+    {
+        printHelp();
         return EXIT_SUCCESS;
     }
-    else if (FilterType::None == inputParameters.m_filterType)
+
+    // Action for --printCLDevices.
+    if (cmdLine.hasArg("printCLDevices"))
     {
-        if (0 != inputParameters.m_dstFaceSize && image.m_width != inputParameters.m_dstFaceSize)
+        if (bx::clLoad())
         {
-            INFO("Resizing destination image from %ux%u to %ux%u."
-                , image.m_width
-                , image.m_height
-                , inputParameters.m_dstFaceSize
-                , inputParameters.m_dstFaceSize
-                );
-            imageResize(image, inputParameters.m_dstFaceSize, inputParameters.m_dstFaceSize);
+            clPrintDevices();
+            bx::clUnload();
+            return EXIT_SUCCESS;
         }
+
+        WARN("ERROR! OpenCL is not set up properly on the machine.");
+        return EXIT_FAILURE;
     }
 
-    // Generate mip map chain if requested.
-    if (inputParameters.m_generateMipMapChain)
+    InputParameters inputParameters;
+    inputParametersDefault(inputParameters);
+    inputParametersFromCommandLine(inputParameters, cmdLine);
+
+    if (inputParameters.m_silent)
     {
-        imageGenerateMipMapChain(image);
+        g_printInfo = false;
+        g_printWarnings = false;
     }
 
-    // Apply gamma on output image.
-    imageApplyGamma(image, inputParameters.m_outputGammaPowNumerator / inputParameters.m_outputGammaPowDenominator);
+    // Messages of worker threads are written out by the sink thread.
+    ScopeMessageSink messageSink;
 
-    // Clamp rgba32f image to [0.0-1.0] range.
-    imageClamp(image);
+    // Counters follow threads started from here on, thread pool workers included.
+    bool perfCounters = false;
+    cmdLine.hasArg(perfCounters, '\0', "perfCounters");
+    if (perfCounters)
+    {
+        perfCountersOpen();
+    }
 
-    // Save output images.
-    for (uint32_t outputIdx = 0; outputIdx < inputParameters.m_outputFilesNum; ++outputIdx)
+    if (inputParameters.m_hugePages)
     {
-        const OutputType::Enum    ot = (OutputType::Enum)inputParameters.m_outputFiles[outputIdx].m_outputType;
-        const TextureFormat::Enum tf = (TextureFormat::Enum)inputParameters.m_outputFiles[outputIdx].m_textureFormat;
-        const ImageFileType::Enum ft = (ImageFileType::Enum)inputParameters.m_outputFiles[outputIdx].m_fileType;
-        const char* outputFileName = inputParameters.m_outputFiles[outputIdx].m_fileName;
+        static HugePageAllocator s_hugePageAllocator;
+        setAllocator(&s_hugePageAllocator);
+    }
 
-        // Face list is a special case because it is saving 6 images.
-        if (OutputType::FaceList == ot)
-        {
-            Image outputFaceList[6];
+    // Tracker goes on top of the allocator chosen above, it is never destroyed.
+    if (inputParameters.m_memoryStats)
+    {
+        static TrackingAllocator s_trackingAllocator(getAllocator());
+        setAllocator(&s_trackingAllocator);
+        s_memoryTracker = &s_trackingAllocator;
+    }
 
-            imageFaceListFromCubemap(outputFaceList, image);
+    // Start worker threads.
+    if (inputParameters.m_pinThreadsToNuma
+    ||  inputParameters.m_numaReplicas)
+    {
+        threadPoolInit(getNumHardwareThreads()-1, true);
+    }
 
-            for (uint8_t face = 0; face < 6; ++face)
-            {
-                char faceFileName[2048];
-                sprintf(faceFileName, "%s_%s", outputFileName, s_cubemapFaceIdNames[face]);
-
-                INFO("Output(%u) - Saving %s [%s %ux%u %s %s %u-faces %d-mips]."
-                    , outputIdx
-                    , faceFileName
-                    , getFileTypeStr(ft)
-                    , outputFaceList[face].m_width
-                    , outputFaceList[face].m_height
-                    , getTextureFormatStr(outputFaceList[face].m_format)
-                    , getOutputTypeStr(ot)
-                    , outputFaceList[face].m_numFaces
-                    , outputFaceList[face].m_numMips
-                    );
-
-                const bool saved = imageSave(outputFaceList[face], faceFileName, ft, tf);
-                if (!saved)
-                {
-                    WARN("Saving failed!");
-                }
-            }
+    // Start recording profile zones.
+    const char* profileFilePath = cmdLine.findOption("profile");
+    if (NULL != profileFilePath)
+    {
+        if (!CMFT_CONFIG_PROFILE)
+        {
+            WARN("Profile zones are not compiled in. Rebuild with CMFT_CONFIG_PROFILE=1 for --profile.");
+        }
+        profilerStart();
+    }
 
-            for (uint8_t face = 0; face < 6; ++face)
-            {
-                imageUnload(outputFaceList[face]);
-            }
+    // Queue output files for the I/O thread. Server replies only after its outputs are written, writes stay in place.
+    const char* serverAddress = cmdLine.findOption("server");
+    if (inputParameters.m_writeBehind
+    &&  NULL == serverAddress)
+    {
+        imageSaveWriteBehindBegin();
+    }
 
+    // Action for --batch.
+    const char* batchFilePath = cmdLine.findOption("batch");
+    if (NULL != batchFilePath)
+    {
+        int result;
+        {
+            ScopePerfCounters counters("batch");
+            result = cmftBatch(batchFilePath, inputParameters, _argc, _argv);
         }
-        // Cubemap is a special case becase no transformation is required.
-        else if (OutputType::Cubemap == ot)
+        if (!imageSaveWriteBehindEnd())
         {
-            INFO("Output(%u) - Saving %s [%s %ux%u %s %s %u-faces %d-mips]."
-                , outputIdx
-                , outputFileName
-                , getFileTypeStr(ft)
-                , image.m_width
-                , image.m_height
-                , getTextureFormatStr(tf)
-                , getOutputTypeStr(ot)
-                , image.m_numFaces
-                , image.m_numMips
-                );
-
-            const bool saved = imageSave(image, outputFileName, ft, tf);
-            if (!saved)
-            {
-                WARN("Saving failed!");
-            }
+            result = EXIT_FAILURE;
         }
-        else
+        if (NULL != s_memoryTracker)
         {
-            Image outputImage;
+            s_memoryTracker->printStats();
+        }
+        profilerStop(profileFilePath);
+        return result;
+    }
 
-            if (OutputType::LatLong == ot)
-            {
-                imageLatLongFromCubemap(outputImage, image);
-            }
-            else if (OutputType::CubeCross == ot)
-            {
-                bool vertical = true;
-                const char* param0 = inputParameters.m_outputFiles[outputIdx].m_optionalParam0;
-                if (NULL != param0
-                && (0 == bx::stricmp(param0, "horizontal") || 0 == bx::stricmp(param0, "0")))
-                {
-                    vertical = false;
-                }
+    // Action for --server.
+    if (NULL != serverAddress)
+    {
+        const int result = cmftServer(serverAddress, inputParameters, _argc, _argv);
+        profilerStop(profileFilePath);
+        return result;
+    }
 
-                imageCrossFromCubemap(outputImage, image, vertical);
-            }
-            else if (OutputType::HStrip == ot)
-            {
-                imageHStripFromCubemap(outputImage, image);
-            }
-            else
-            {
-                WARN("Output(%u) - Invalid output type.", outputIdx);
-                continue;
-            }
+    // Devices are set up while the input is loaded, latlong input is converted on them too.
+    ClDevices clDevices;
+    cmftClInitBegin(clDevices, inputParameters);
 
-            INFO("Output(%u) - Saving %s [%s %ux%u %s %s %u-faces %d-mips]."
-                , outputIdx
-                , outputFileName
-                , getFileTypeStr(ft)
-                , outputImage.m_width
-                , outputImage.m_height
-                , getTextureFormatStr(tf)
-                , getOutputTypeStr(ot)
-                , outputImage.m_numFaces
-                , outputImage.m_numMips
-                );
+    Image image;
+    JobState::Enum state;
+    {
+        ScopePerfCounters counters("load");
+        state = cmftLoadStage(image, inputParameters, NULL, &clDevices);
+    }
+    cmftClInitEnd(clDevices);
 
-            const bool saved = imageSave(outputImage, outputFileName, ft, tf);
-            if (!saved)
-            {
-                WARN("Saving failed!");
-            }
+    if (JobState::Ready == state
+    &&  inputParameters.m_dryRun)
+    {
+        cmftDryRun(image, inputParameters, clDevices);
+        state = JobState::Done;
+    }
 
-            imageUnload(outputImage);
-        }
+    if (JobState::Ready == state)
+    {
+        ScopePerfCounters counters("filter", cmftFilterTaps(image, inputParameters));
+        state = cmftFilterStage(image, inputParameters, clDevices);
+    }
+
+    cmftClShutdown(clDevices);
+
+    if (JobState::Ready == state)
+    {
+        ScopePerfCounters counters("save");
+        cmftSaveStage(image, inputParameters);
     }
 
     // Cleanup.
     imageUnload(image);
 
+    if (!imageSaveWriteBehindEnd())
+    {
+        state = JobState::Failed;
+    }
+
+    if (NULL != s_memoryTracker)
+    {
+        s_memoryTracker->printStats();
+    }
+
+    if (NULL != profileFilePath
+    &&  profilerStop(profileFilePath))
+    {
+        INFO("Profile written to %s.", profileFilePath);
+    }
+
+    if (JobState::Failed == state)
+    {
+        return EXIT_FAILURE;
+    }
+
     INFO("Done.");
     return EXIT_SUCCESS;
 }
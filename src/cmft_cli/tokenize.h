@@ -6,6 +6,9 @@
 #ifndef CMFT_TOKENIZE_H_HEADER_GUARD
 #define CMFT_TOKENIZE_H_HEADER_GUARD
 
+#include <stdint.h>
+#include <ctype.h> // isspace
+
 /// Code from: https://github.com/bkaradzic/bgfx/blob/master/tools/geometryc/tokenizecmd.cpp
 /*
  * Copyright 2012-2014 Branimir Karadzic. All rights reserved.
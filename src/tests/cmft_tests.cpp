@@ -0,0 +1,677 @@
+/*
+ * Copyright 2014 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <bx/commandline.h>
+
+#include <cmft/image.h>
+#include <cmft/cubemapfilter.h>
+#include <cmft/threadpool.h> //getNumHardwareThreads
+#include <cmft/blockcompress.h> //BlockTexels
+#include <cmft/deflate.h> //zlibCompress, zlibDecompress
+
+#include <base/config.h>
+#include <base/macros.h> //countof
+#include <base/utils.h> //max
+
+#include <cmft/messages.h> //INFO, WARN, g_printInfo, g_printWarnings
+
+using namespace cmft;
+
+struct TestParameters
+{
+    uint32_t m_srcFaceSize;
+    uint32_t m_dstFaceSize;
+    uint32_t m_mipCount;
+    const char* m_input;
+    bool m_verbose;
+};
+
+/// Error bounds of a fast path against the reference, relative to the reference peak of each mip.
+struct TestThresholds
+{
+    double m_maxRelError; //!< Largest absolute texel error divided by the peak.
+    double m_minPsnr;     //!< In dB, peak over RMS error.
+};
+
+struct TestPath
+{
+    const char* m_name;
+    bool m_useSourcePyramid;
+    bool m_halfPrecision;
+    TestThresholds m_thresholds;
+};
+
+// Default path covers SIMD, SoA, lobe table and SH hybrid, whichever of them are enabled in config.
+// Thresholds leave some headroom over the worst errors measured on the sources below. Those are SH convolved mips of the spike
+// for default and half paths and mips filtered from coarse source levels, which blur the spike before the lobe is applied, for pyramid.
+static const TestPath s_paths[] =
+{
+    { "default", false, false, { 0.05, 32.0 } },
+    { "half",    false, true,  { 0.05, 32.0 } },
+    { "pyramid", true,  false, { 0.18, 30.0 } },
+};
+
+static const LightingModel::Enum s_lightingModels[] =
+{
+    LightingModel::Phong,
+    LightingModel::PhongBrdf,
+    LightingModel::Blinn,
+    LightingModel::BlinnBrdf,
+};
+
+static const char* s_lightingModelStr[LightingModel::Count] =
+{
+    "phong",
+    "phongbrdf",
+    "blinn",
+    "blinnbrdf",
+};
+
+static void testParametersFromCommandLine(TestParameters& _params, const bx::CommandLine& _cmdLine)
+{
+    _params.m_srcFaceSize = 64;
+    _params.m_dstFaceSize = 32;
+    _params.m_mipCount = 6;
+
+    _cmdLine.hasArg(_params.m_srcFaceSize, '\0', "srcFaceSize");
+    _cmdLine.hasArg(_params.m_dstFaceSize, '\0', "dstFaceSize");
+    _cmdLine.hasArg(_params.m_mipCount,    '\0', "mipCount");
+    _params.m_verbose = _cmdLine.hasArg('v', "verbose");
+
+    // Runtime directory cubemap is used when no input is given.
+    _params.m_input = _cmdLine.findOption("input", "okretnica.tga");
+
+    _params.m_srcFaceSize = max(UINT32_C(4), _params.m_srcFaceSize);
+    _params.m_dstFaceSize = max(UINT32_C(1), _params.m_dstFaceSize);
+    _params.m_mipCount    = max(UINT32_C(1), _params.m_mipCount);
+}
+
+static void printHelp()
+{
+    fprintf(stderr
+           , "cmft_tests - cmft accuracy tests\n"
+             "\n"
+             "Runs radiance filter fast paths against the double precision reference and fails when errors exceed thresholds.\n"
+             "Block codecs are checked against the source, deflate, Exr and Ktx2 round trips have to be exact.\n"
+             "Thresholds are set for the default sizes.\n"
+             "\n"
+             "Usage: cmft_tests [options]\n"
+             "\n"
+             "    --srcFaceSize <uint>  Face size sources are created or resized at. Default: 64\n"
+             "    --dstFaceSize <uint>  Radiance face size. Default: 32\n"
+             "    --mipCount <uint>     Radiance mip count. Default: 6\n"
+             "    --input <path>        Real cubemap, cube cross or latlong image. Default: okretnica.tga if present\n"
+             "    -v, --verbose         Print errors of passing mips too.\n"
+             "\n"
+           );
+}
+
+static bool loadSourceCubemap(Image& _image, const char* _filePath, uint32_t _faceSize)
+{
+    Image image;
+    if (!imageLoad(image, _filePath, TextureFormat::RGBA32F))
+    {
+        return false;
+    }
+
+    if (imageIsCubeCross(image))
+    {
+        imageCubemapFromCross(image);
+    }
+    else if (imageIsLatLong(image))
+    {
+        imageCubemapFromLatLong(image);
+    }
+
+    if (!imageIsCubemap(image))
+    {
+        WARN("%s is not a cubemap, cube cross or latlong image.", _filePath);
+        imageUnload(image);
+        return false;
+    }
+
+    // Reference cost grows with source size, real cubemaps are tested at the same size as synthetic ones.
+    imageResize(image, _faceSize, _faceSize, ResampleFilter::Box);
+    imageMove(_image, image);
+
+    return true;
+}
+
+// Error measurement.
+//-----
+
+struct MipError
+{
+    double m_peak;
+    double m_maxError;
+    double m_rms;
+    double m_psnr;
+};
+
+static void measureMipError(MipError& _error, const Image& _image, uint8_t _mip, const Image& _reference)
+{
+    uint64_t offsets[CUBE_FACE_NUM][MAX_MIP_NUM];
+    imageGetMipOffsets(offsets, _image);
+
+    uint64_t refOffsets[CUBE_FACE_NUM];
+    imageGetFaceOffsets(refOffsets, _reference);
+
+    const uint32_t mipFaceSize = _reference.m_width;
+    const uint32_t numValues = mipFaceSize*mipFaceSize*4;
+
+    double peak = 0.0;
+    double maxError = 0.0;
+    double sumSq = 0.0;
+    for (uint8_t face = 0; face < CUBE_FACE_NUM; ++face)
+    {
+        const float* data = (const float*)((const uint8_t*)_image.m_data     + offsets[face][_mip]);
+        const float* ref  = (const float*)((const uint8_t*)_reference.m_data + refOffsets[face]);
+        for (uint32_t ii = 0; ii < numValues; ii += 4)
+        {
+            for (uint8_t ch = 0; ch < 3; ++ch)
+            {
+                const double err = fabs(double(data[ii+ch]) - double(ref[ii+ch]));
+                peak = max(peak, fabs(double(ref[ii+ch])));
+                maxError = max(maxError, err);
+                sumSq += err*err;
+            }
+        }
+    }
+
+    _error.m_peak = peak;
+    _error.m_maxError = maxError;
+    _error.m_rms = sqrt(sumSq/double(uint64_t(numValues/4)*3*CUBE_FACE_NUM));
+    _error.m_psnr = (0.0 == _error.m_rms || 0.0 == peak) ? 999.0 : 20.0*log10(peak/_error.m_rms);
+}
+
+// Tests.
+//-----
+
+static uint32_t s_numChecks = 0;
+static uint32_t s_numFailures = 0;
+
+static void checkError(const TestParameters& _params, const char* _sourceName, const char* _path, const char* _variant, uint8_t _mip
+                     , const MipError& _error, const TestThresholds& _thresholds)
+{
+    const bool failed = _error.m_maxError > _thresholds.m_maxRelError*_error.m_peak
+                     || _error.m_psnr < _thresholds.m_minPsnr
+                     ;
+    s_numChecks++;
+    s_numFailures += failed;
+
+    if (failed || _params.m_verbose)
+    {
+        printf("%-10s %-8s %-10s %4u %12.6f %12.6f %12.6f %8.2f   %s\n"
+              , _sourceName
+              , _path
+              , _variant
+              , _mip
+              , _error.m_peak
+              , _error.m_maxError
+              , _error.m_rms
+              , _error.m_psnr
+              , failed ? "FAIL" : "ok"
+              );
+    }
+}
+
+/// Checks that have to reproduce their input exactly print no errors.
+static void checkExact(const TestParameters& _params, const char* _sourceName, const char* _path, const char* _variant, bool _failed)
+{
+    s_numChecks++;
+    s_numFailures += _failed;
+
+    if (_failed || _params.m_verbose)
+    {
+        printf("%-10s %-8s %-10s %4s %12s %12s %12s %8s   %s\n"
+              , _sourceName
+              , _path
+              , _variant
+              , "-", "-", "-", "-", "-"
+              , _failed ? "FAIL" : "ok"
+              );
+    }
+}
+
+static void testSource(const TestParameters& _params, const char* _sourceName, const Image& _src)
+{
+    const uint8_t glossScale = 10;
+    const uint8_t glossBias = 1;
+
+    for (uint32_t mm = 0; mm < CMFT_COUNTOF(s_lightingModels); ++mm)
+    {
+        const LightingModel::Enum lightingModel = s_lightingModels[mm];
+
+        // Reference is computed once per mip and shared by all paths.
+        Image reference[MAX_MIP_NUM];
+        uint8_t mipCount = 0;
+        for (uint8_t mip = 0; mip < _params.m_mipCount && mip < MAX_MIP_NUM; ++mip)
+        {
+            if (!imageRadianceFilterMipReference(reference[mip], _params.m_dstFaceSize, lightingModel, mip, uint8_t(_params.m_mipCount), glossScale, glossBias, _src))
+            {
+                break;
+            }
+            mipCount++;
+        }
+
+        for (uint32_t pp = 0; pp < CMFT_COUNTOF(s_paths); ++pp)
+        {
+            const TestPath& path = s_paths[pp];
+
+            Image filtered;
+            if (!imageRadianceFilter(filtered, _params.m_dstFaceSize, lightingModel, false, uint8_t(_params.m_mipCount), glossScale, glossBias, _src
+                                   , int16_t(getNumHardwareThreads()), (const ClContext*)NULL, path.m_useSourcePyramid, path.m_halfPrecision))
+            {
+                WARN("%s %s %s: filtering failed.", _sourceName, path.m_name, s_lightingModelStr[lightingModel]);
+                s_numChecks++;
+                s_numFailures++;
+                continue;
+            }
+            imageConvert(filtered, TextureFormat::RGBA32F);
+
+            for (uint8_t mip = 0; mip < mipCount && mip < filtered.m_numMips; ++mip)
+            {
+                MipError error;
+                measureMipError(error, filtered, mip, reference[mip]);
+
+                checkError(_params, _sourceName, path.m_name, s_lightingModelStr[lightingModel], mip, error, path.m_thresholds);
+            }
+
+            imageUnload(filtered);
+        }
+
+        for (uint8_t mip = 0; mip < mipCount; ++mip)
+        {
+            imageUnload(reference[mip]);
+        }
+    }
+}
+
+// Round trips.
+//-----
+
+// Etc2 and Astc have no decoder in cmft, these decode the modes their encoders write, following the specs.
+typedef bool (*BlockDecodeFn)(BlockTexels& _texels, const uint8_t* _src);
+
+static uint32_t readBlockBits(const uint8_t* _src, uint32_t _pos, uint32_t _numBits)
+{
+    uint32_t result = 0;
+    for (uint32_t ii = 0; ii < _numBits; ++ii)
+    {
+        const uint32_t pos = _pos+ii;
+        result |= uint32_t((_src[pos>>3]>>(pos&7))&1) << ii;
+    }
+    return result;
+}
+
+/// Individual and differential modes only, T, H and planar blocks fail.
+static bool etc2DecodeBlock(BlockTexels& _texels, const uint8_t* _src)
+{
+    static const int32_t s_modifiers[8][2] =
+    {
+        {  2,   8 },
+        {  5,  17 },
+        {  9,  29 },
+        { 13,  42 },
+        { 18,  60 },
+        { 24,  80 },
+        { 33, 106 },
+        { 47, 183 },
+    };
+
+    uint64_t bits = 0;
+    for (uint8_t ii = 0; ii < 8; ++ii)
+    {
+        bits = (bits<<8) | _src[ii];
+    }
+
+    const bool diff = 0 != ((bits>>33)&1);
+    const bool flip = 0 != ((bits>>32)&1);
+
+    int32_t base[2][3];
+    for (uint8_t cc = 0; cc < 3; ++cc)
+    {
+        if (diff)
+        {
+            const int32_t c5 = int32_t((bits>>(59-cc*8))&0x1f);
+            const int32_t d3 = int32_t((bits>>(56-cc*8))&0x7);
+            const int32_t c5b = c5 + ((d3 >= 4) ? d3-8 : d3);
+            if (c5b < 0 || c5b > 31)
+            {
+                return false;
+            }
+            base[0][cc] = (c5 <<3) | (c5 >>2);
+            base[1][cc] = (c5b<<3) | (c5b>>2);
+        }
+        else
+        {
+            base[0][cc] = int32_t((bits>>(60-cc*8))&0xf)*17;
+            base[1][cc] = int32_t((bits>>(56-cc*8))&0xf)*17;
+        }
+    }
+
+    const uint32_t table[2] = { uint32_t((bits>>37)&7), uint32_t((bits>>34)&7) };
+    for (uint32_t yy = 0; yy < 4; ++yy)
+    {
+        for (uint32_t xx = 0; xx < 4; ++xx)
+        {
+            // Pixel indices are stored column by column.
+            const uint32_t idx = xx*4+yy;
+            const uint32_t msb = uint32_t(bits>>(16+idx))&1;
+            const uint32_t lsb = uint32_t(bits>>idx)&1;
+            const uint8_t sub = uint8_t(flip ? yy >= 2 : xx >= 2);
+            const int32_t mod = s_modifiers[table[sub]][lsb];
+
+            float* texel = _texels[yy*4+xx];
+            for (uint8_t cc = 0; cc < 3; ++cc)
+            {
+                texel[cc] = float(clamp(base[sub][cc] + (msb ? -mod : mod), 0, 255)) * (1.0f/255.0f);
+            }
+            texel[3] = 1.0f;
+        }
+    }
+
+    return true;
+}
+
+/// Block mode 0x053 only: single plane 4x4 weight grid of range 0..7, single partition with LDR RGB direct endpoints.
+static bool astc4x4DecodeBlock(BlockTexels& _texels, const uint8_t* _src)
+{
+    if (0x053 != readBlockBits(_src, 0, 11)
+    ||  0     != readBlockBits(_src, 11, 2)
+    ||  8     != readBlockBits(_src, 13, 4))
+    {
+        return false;
+    }
+
+    // 63 bits are left for 6 endpoint values, which fits range 0..255.
+    int32_t values[6];
+    for (uint8_t ii = 0; ii < 6; ++ii)
+    {
+        values[ii] = int32_t(readBlockBits(_src, 17+ii*8, 8));
+    }
+
+    int32_t endpoints[2][3];
+    if (values[1]+values[3]+values[5] >= values[0]+values[2]+values[4])
+    {
+        for (uint8_t cc = 0; cc < 3; ++cc)
+        {
+            endpoints[0][cc] = values[cc*2];
+            endpoints[1][cc] = values[cc*2+1];
+        }
+    }
+    else
+    {
+        // Blue contraction.
+        endpoints[0][0] = (values[1]+values[5])>>1;
+        endpoints[0][1] = (values[3]+values[5])>>1;
+        endpoints[0][2] = values[5];
+        endpoints[1][0] = (values[0]+values[4])>>1;
+        endpoints[1][1] = (values[2]+values[4])>>1;
+        endpoints[1][2] = values[4];
+    }
+
+    for (uint8_t texel = 0; texel < 16; ++texel)
+    {
+        // Weights are stored bit reversed from the top of the block.
+        uint32_t weight = 0;
+        for (uint8_t ii = 0; ii < 3; ++ii)
+        {
+            weight |= readBlockBits(_src, 127-(texel*3+ii), 1) << ii;
+        }
+        weight = (weight<<3) | weight;
+        weight += (weight > 32);
+
+        for (uint8_t cc = 0; cc < 3; ++cc)
+        {
+            const int32_t c0 = endpoints[0][cc]*257;
+            const int32_t c1 = endpoints[1][cc]*257;
+            const int32_t val = (c0*(64-int32_t(weight)) + c1*int32_t(weight) + 32)>>6;
+            _texels[texel][cc] = float(val) * (1.0f/65535.0f);
+        }
+        _texels[texel][3] = 1.0f;
+    }
+
+    return true;
+}
+
+/// Decodes single mip _src into _dst, an RGBA32F image of the same size.
+static bool imageDecodeBlocks(Image& _dst, const Image& _src, BlockDecodeFn _decode, uint32_t _blockBytes)
+{
+    uint64_t srcOffsets[CUBE_FACE_NUM];
+    uint64_t dstOffsets[CUBE_FACE_NUM];
+    imageGetFaceOffsets(srcOffsets, _src);
+    imageGetFaceOffsets(dstOffsets, _dst);
+
+    const uint32_t numBlocksX = (_src.m_width +3)/4;
+    const uint32_t numBlocksY = (_src.m_height+3)/4;
+    for (uint8_t face = 0; face < _src.m_numFaces; ++face)
+    {
+        const uint8_t* blocks = (const uint8_t*)_src.m_data + srcOffsets[face];
+        float* dst = (float*)((uint8_t*)_dst.m_data + dstOffsets[face]);
+        for (uint32_t by = 0; by < numBlocksY; ++by)
+        {
+            for (uint32_t bx = 0; bx < numBlocksX; ++bx)
+            {
+                BlockTexels texels;
+                if (!_decode(texels, blocks + (by*numBlocksX + bx)*_blockBytes))
+                {
+                    return false;
+                }
+
+                for (uint32_t yy = 0; yy < 4 && by*4+yy < _dst.m_height; ++yy)
+                {
+                    for (uint32_t xx = 0; xx < 4 && bx*4+xx < _dst.m_width; ++xx)
+                    {
+                        memcpy(&dst[((by*4+yy)*_dst.m_width + bx*4+xx)*4], texels[yy*4+xx], 4*sizeof(float));
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+struct TestCodec
+{
+    TextureFormat::Enum m_format;
+    BlockDecodeFn m_decode; //!< NULL if imageConvert() decodes the format.
+    uint32_t m_blockBytes;
+    bool m_hdr;             //!< Otherwise compared to the source clamped and quantized to 8 bits.
+    TestThresholds m_thresholds;
+};
+
+// Encoders fit a single line per block. Worst errors are on sharp edges of the real cubemap, and for Etc2 on the constant,
+// which its 4 and 5 bit base colors do not hit.
+static const TestCodec s_codecs[] =
+{
+    { TextureFormat::BC6H_UF16, NULL,               16, true,  { 0.25, 36.0 } },
+    { TextureFormat::BC7,       NULL,               16, false, { 0.20, 36.0 } },
+    { TextureFormat::ETC2,      etc2DecodeBlock,     8, false, { 0.25, 28.0 } },
+    { TextureFormat::ASTC4X4,   astc4x4DecodeBlock, 16, false, { 0.20, 35.0 } },
+};
+
+static void testCodecs(const TestParameters& _params, const char* _sourceName, const Image& _src)
+{
+    Image ldr;
+    Image ldrReference;
+    imageConvert(ldr, TextureFormat::RGBA8, _src);
+    imageConvert(ldrReference, TextureFormat::RGBA32F, ldr);
+    imageUnload(ldr);
+
+    for (uint32_t ii = 0; ii < CMFT_COUNTOF(s_codecs); ++ii)
+    {
+        const TestCodec& codec = s_codecs[ii];
+        const Image& reference = codec.m_hdr ? _src : ldrReference;
+
+        Image encoded;
+        imageConvert(encoded, codec.m_format, _src);
+
+        Image decoded;
+        bool decodedOk = true;
+        if (NULL == codec.m_decode)
+        {
+            imageConvert(decoded, TextureFormat::RGBA32F, encoded);
+        }
+        else
+        {
+            imageCopy(decoded, reference);
+            decodedOk = imageDecodeBlocks(decoded, encoded, codec.m_decode, codec.m_blockBytes);
+        }
+
+        if (decodedOk)
+        {
+            MipError error;
+            measureMipError(error, decoded, 0, reference);
+            checkError(_params, _sourceName, "codec", getTextureFormatStr(codec.m_format), 0, error, codec.m_thresholds);
+        }
+        else
+        {
+            WARN("%s %s: block mode not written by cmft.", _sourceName, getTextureFormatStr(codec.m_format));
+            checkExact(_params, _sourceName, "codec", getTextureFormatStr(codec.m_format), true);
+        }
+
+        imageUnload(decoded);
+        imageUnload(encoded);
+    }
+
+    imageUnload(ldrReference);
+}
+
+static void testDeflate(const TestParameters& _params, const char* _sourceName, const char* _variant, const void* _data, uint32_t _size)
+{
+    // Same capacity as Ktx2 levels, deflate blocks can expand incompressible data a little.
+    const uint32_t capacity = _size + _size/8 + 1024;
+    uint8_t* compressed   = (uint8_t*)malloc(capacity);
+    uint8_t* decompressed = (uint8_t*)malloc(_size);
+
+    const uint32_t compressedSize = zlibCompress(compressed, capacity, (const uint8_t*)_data, _size);
+    const bool failed = 0 == compressedSize
+                     || !zlibDecompress(decompressed, _size, compressed, compressedSize)
+                     || 0 != memcmp(decompressed, _data, _size)
+                     ;
+    checkExact(_params, _sourceName, "deflate", _variant, failed);
+
+    free(decompressed);
+    free(compressed);
+}
+
+static void testFile(const TestParameters& _params, const char* _sourceName, const Image& _src, ImageFileType::Enum _ft, TextureFormat::Enum _format)
+{
+    Image expected;
+    imageConvert(expected, _format, _src);
+
+    bool failed = true;
+    void* data;
+    size_t size;
+    if (imageSaveToMemory(data, size, expected, _ft))
+    {
+        Image loaded;
+        if (imageLoadFromMemory(loaded, data, size, _format))
+        {
+            failed = loaded.m_format   != expected.m_format
+                  || loaded.m_width    != expected.m_width
+                  || loaded.m_height   != expected.m_height
+                  || loaded.m_numMips  != expected.m_numMips
+                  || loaded.m_numFaces != expected.m_numFaces
+                  || loaded.m_dataSize != expected.m_dataSize
+                  || 0 != memcmp(loaded.m_data, expected.m_data, size_t(expected.m_dataSize))
+                  ;
+            imageUnload(loaded);
+        }
+        free(data);
+    }
+
+    checkExact(_params, _sourceName, getFileTypeStr(_ft), getTextureFormatStr(_format), failed);
+
+    imageUnload(expected);
+}
+
+/// Block codecs can not represent uncorrelated texels, sources without _lossy are only checked for lossless round trips.
+static void testRoundTrips(const TestParameters& _params, const char* _sourceName, const Image& _src, bool _lossy)
+{
+    if (_lossy)
+    {
+        testCodecs(_params, _sourceName, _src);
+    }
+
+    Image ldr;
+    imageConvert(ldr, TextureFormat::RGBA8, _src);
+    testDeflate(_params, _sourceName, "rgba32f", _src.m_data, uint32_t(_src.m_dataSize));
+    testDeflate(_params, _sourceName, "rgba8",   ldr.m_data,  uint32_t(ldr.m_dataSize));
+    imageUnload(ldr);
+
+    // Exr holds a single 2D image.
+    Image latlong;
+    if (imageLatLongFromCubemap(latlong, _src))
+    {
+        testFile(_params, _sourceName, latlong, ImageFileType::EXR, TextureFormat::RGBA16F);
+        testFile(_params, _sourceName, latlong, ImageFileType::EXR, TextureFormat::RGBA32F);
+        imageUnload(latlong);
+    }
+
+    Image mipmapped;
+    imageCopy(mipmapped, _src);
+    imageGenerateMipMapChain(mipmapped);
+    testFile(_params, _sourceName, mipmapped, ImageFileType::KTX2, TextureFormat::RGBA16F);
+    testFile(_params, _sourceName, mipmapped, ImageFileType::KTX2, TextureFormat::BC6H_UF16);
+    testFile(_params, _sourceName, mipmapped, ImageFileType::KTX2, TextureFormat::ETC2);
+    imageUnload(mipmapped);
+}
+
+int main(int _argc, char const* const* _argv)
+{
+    bx::CommandLine cmdLine(_argc, _argv);
+
+    if (cmdLine.hasArg('h', "help"))
+    {
+        printHelp();
+        return EXIT_SUCCESS;
+    }
+
+    TestParameters params;
+    testParametersFromCommandLine(params, cmdLine);
+
+    g_printInfo = false;
+
+    printf("%-10s %-8s %-10s %4s %12s %12s %12s %8s\n", "source", "path", "model", "mip", "peak", "max", "rms", "psnr");
+
+    for (uint8_t pattern = 0; pattern < CubemapPattern::Count; ++pattern)
+    {
+        Image src;
+        if (imageCubemapFromPattern(src, CubemapPattern::Enum(pattern), params.m_srcFaceSize))
+        {
+            testSource(params, getCubemapPatternStr(CubemapPattern::Enum(pattern)), src);
+            testRoundTrips(params, getCubemapPatternStr(CubemapPattern::Enum(pattern)), src, CubemapPattern::Noise != pattern);
+            imageUnload(src);
+        }
+    }
+
+    Image src;
+    if (loadSourceCubemap(src, params.m_input, params.m_srcFaceSize))
+    {
+        const char* name = strrchr(params.m_input, '/');
+        testSource(params, (NULL != name) ? name+1 : params.m_input, src);
+        testRoundTrips(params, (NULL != name) ? name+1 : params.m_input, src, true);
+        imageUnload(src);
+    }
+    else
+    {
+        printf("Skipping %s, it could not be loaded.\n", params.m_input);
+    }
+
+    printf("%u of %u checks within thresholds.\n", s_numChecks - s_numFailures, s_numChecks);
+
+    return (0 == s_numFailures) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */